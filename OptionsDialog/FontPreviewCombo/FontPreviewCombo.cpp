@@ -77,6 +77,22 @@ END_MESSAGE_MAP()
 
 /////////////////////////////////////////////////////////////////////////////
 
+// Font measurement cache.  This holds the measurements from earlier
+// InitFonts() calls, keyed by face name, for the font height and sample
+// text in effect.
+struct FontMeasurement
+{
+	LONG height;        // logical font height
+	LONG nameWidth;     // width of the name in the GUI font
+	LONG sampleWidth;   // width of the sample in the font, capped relative to the name
+};
+static struct FontMeasurementCache
+{
+	int fontHeight = 0;
+	CString sample;
+	std::unordered_map<std::basic_string<TCHAR>, FontMeasurement> fonts;
+} fontMeasurementCache;
+
 static int CALLBACK FontEnumProc(ENUMLOGFONT *lplf, NEWTEXTMETRIC *lptm, DWORD dwType, LPARAM lpData)
 {
 	// skip "@" fonts - these are for writing sideways (rotated 90 degrees)
@@ -96,6 +112,20 @@ static int CALLBACK FontEnumProc(ENUMLOGFONT *lplf, NEWTEXTMETRIC *lptm, DWORD d
 	if (lplf->elfLogFont.lfCharSet == SYMBOL_CHARSET)
 		flags |= CFontPreviewCombo::ffSymbol;
 
+	// use the cached measurements if we've seen this font before
+	auto &cache = fontMeasurementCache.fonts;
+	if (auto it = cache.find(faceName); it != cache.end())
+	{
+		auto &m = it->second;
+		fonts->maxNameWidth = max(fonts->maxNameWidth, m.nameWidth);
+		fonts->maxSampleWidth = max(fonts->maxSampleWidth, m.sampleWidth);
+		fonts->fonts.emplace(
+			std::piecewise_construct,
+			std::forward_as_tuple(faceName),
+			std::forward_as_tuple(faceName, flags, m.height));
+		return TRUE;
+	}
+
 	// set up a logical font
 	CFont cf;
 	if (!cf.CreateFont(fonts->fontHeight, 0, 0, 0, FW_NORMAL, FALSE, FALSE, FALSE, 
@@ -120,15 +150,19 @@ static int CALLBACK FontEnumProc(ENUMLOGFONT *lplf, NEWTEXTMETRIC *lptm, DWORD d
 	dc.SelectObject(hf);
 
 	// measure sample in the control font
+	LONG cappedSampleWidth = 0;
 	hf = (HFONT)dc.SelectObject(cf);
 	if (hf != nullptr)
 	{
 		sz = dc.GetTextExtent(fonts->sample);
-		LONG cappedSampleWidth = min(sz.cx, static_cast<LONG>(nameWidth * 1.25f));
+		cappedSampleWidth = min(sz.cx, static_cast<LONG>(nameWidth * 1.25f));
 		fonts->maxSampleWidth = max(fonts->maxSampleWidth, cappedSampleWidth);
 		dc.SelectObject(hf);
 	}
 
+	// cache the measurements
+	cache.emplace(faceName, FontMeasurement{ lf.lfHeight, nameWidth, cappedSampleWidth });
+
 	// add it to the font vector
 	fonts->fonts.emplace(
 		std::piecewise_construct,
@@ -145,7 +179,18 @@ void CFontPreviewCombo::InitFonts(Fonts &fonts, CWnd *parent, int fontHeight, co
 	fonts.fontHeight = fontHeight;
 	fonts.sample = sampleText;
 	fonts.cwndPar = parent;
-	EnumFontFamilies(parent->GetDC()->m_hDC, NULL, reinterpret_cast<FONTENUMPROC>(FontEnumProc), reinterpret_cast<LPARAM>(&fonts));
+
+	// the cached measurements only apply to the same height and sample
+	auto &cache = fontMeasurementCache;
+	if (cache.fontHeight != fontHeight || cache.sample != sampleText)
+	{
+		cache.fonts.clear();
+		cache.fontHeight = fontHeight;
+		cache.sample = sampleText;
+	}
+
+	CClientDC dc(parent);
+	EnumFontFamilies(dc.m_hDC, NULL, reinterpret_cast<FONTENUMPROC>(FontEnumProc), reinterpret_cast<LPARAM>(&fonts));
 
 	// create a vector of the fonts, for sorting
 	fonts.byName.reserve(fonts.fonts.size() + 1);
@@ -157,6 +202,13 @@ void CFontPreviewCombo::InitFonts(Fonts &fonts, CWnd *parent, int fontHeight, co
 		return lstrcmpi(a->name.GetString(), b->name.GetString()) < 0; });
 }
 
+void CFontPreviewCombo::PreloadFonts(int fontHeight, const TCHAR *sampleText)
+{
+	// run a font enumeration against the screen DC, to fill the cache
+	Fonts fonts;
+	InitFonts(fonts, nullptr, fontHeight, sampleText);
+}
+
 void CFontPreviewCombo::Init(Fonts *fonts)
 {
 	// save the font map
@@ -122,8 +122,17 @@ public:
 // Operations
 public:
 
-	// populate a Fonts object with the system font list
+	// Populate a Fonts object with the system font list.  Measuring the
+	// fonts is the slow part, since it means creating every installed
+	// font, so the measurements are cached by face name for the life of
+	// the DLL; only fonts that weren't seen on an earlier call (such as
+	// newly installed fonts) are measured again.
 	static void InitFonts(Fonts &fonts, CWnd *parent, int fontHeight = 16, const TCHAR *sampleText = _T("abcABC"));
+
+	// Fill the measurement cache ahead of time, for a later InitFonts()
+	// call with the same font height and sample text.  This can be called
+	// on a background thread, but not at the same time as InitFonts().
+	static void PreloadFonts(int fontHeight = 16, const TCHAR *sampleText = _T("abcABC"));
 	
 	// call this to load the font strings
 	void Init(Fonts *fonts);
@@ -57,3 +57,13 @@ extern "C" void WINAPI ShowOptionsDialog(
 	bool isAdminHostRunning,
 	SetUpAdminAutoRunCallback setUpAdminAutoRunCallback,
 	/*[OUT]*/ RECT *finalDialogRect);
+
+// Preload the dialog's slow-to-gather data.  The host can call this on
+// a background thread after loading the DLL, before the user opens the
+// dialog, to make the first ShowOptionsDialog() call faster.  This must
+// not be called concurrently with ShowOptionsDialog().
+//
+// This is optional, and was added without changing the interface
+// version, so the host should look it up with GetProcAddress() and
+// skip the call if it's missing.
+extern "C" void WINAPI PreloadOptionsDialog();
@@ -0,0 +1,12 @@
+// This file is part of PinballY
+// Copyright 2018 Michael J Roberts | GPL v3 or later | NO WARRANTY
+//
+// Animation clock
+
+#include "stdafx.h"
+#include "AnimClock.h"
+
+// statics
+HiResTimer AnimClock::timer;
+DWORD AnimClock::frameTime = 0;
+int AnimClock::frameDepth = 0;
@@ -0,0 +1,54 @@
+// This file is part of PinballY
+// Copyright 2018 Michael J Roberts | GPL v3 or later | NO WARRANTY
+//
+// Animation clock
+//
+// Animations (the wheel spin, popup and menu transitions, the info box
+// fade, and sprite fades) compute their state from the time elapsed
+// since they started.  This clock supplies that time.  It runs on the
+// high-resolution performance counter, since GetTickCount() only
+// advances in 10-16ms steps, which shows up as uneven steps in an
+// animation that renders at 60 fps or more.
+//
+// The clock is latched for the duration of each frame: D3DView's
+// RenderFrame() opens a FrameScope, updates the window's animations,
+// and draws.  Everything drawn in the frame is thus positioned for the
+// same instant, and the animation steps follow the present cadence
+// rather than the delivery of WM_TIMER messages, which are low priority
+// and tend to bunch up when the message queue is busy.  Outside of a
+// frame, Now() reads the current time.
+//
+// Times are in milliseconds, as DWORD values that wrap like GetTickCount()
+// values, so elapsed times can be computed by simple subtraction.
+
+#pragma once
+#include "HiResTimer.h"
+
+class AnimClock
+{
+public:
+	// get the animation time: the frame time during a frame, otherwise
+	// the current time
+	static DWORD Now() { return frameDepth != 0 ? frameTime : Live(); }
+
+	// get the current time, ignoring any frame latch
+	static DWORD Live() { return static_cast<DWORD>(static_cast<UINT64>(timer.GetTime_ticks() * timer.GetTickTime_sec() * 1000.0)); }
+
+	// Frame scope.  Create one of these on the stack to latch the clock
+	// until it goes out of scope.  Scopes can nest (as when one window's
+	// rendering triggers another's); the outermost scope sets the time.
+	class FrameScope
+	{
+	public:
+		FrameScope() { if (frameDepth++ == 0) frameTime = Live(); }
+		~FrameScope() { --frameDepth; }
+	};
+
+protected:
+	// time source
+	static HiResTimer timer;
+
+	// latched frame time, and the frame scope nesting depth
+	static DWORD frameTime;
+	static int frameDepth;
+};
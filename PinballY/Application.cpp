@@ -43,6 +43,8 @@
 #include "InstCardWin.h"
 #include "InstCardView.h"
 #include "AudioManager.h"
+#include "AudioMixer.h"
+#include "FFmpegProbe.h"
 #include "DOFClient.h"
 #include "TextureShader.h"
 #include "I420Shader.h"
@@ -51,10 +53,32 @@
 #include "MonitorCheck.h"
 #include "HighScores.h"
 #include "VLCAudioVideoPlayer.h"
+#include "VideoSprite.h"
 #include "RefTableList.h"
+#include "CaptureTimeStats.h"
 #include "CaptureStatusWin.h"
+#include "CaptureEncoder.h"
+#include "DesktopDuplication.h"
 #include "LogFile.h"
 #include "RealDMD.h"
+#include "TextureBudget.h"
+#include "HiResTimer.h"
+#include "TextureCache.h"
+#include "MediaFileIndex.h"
+#include "VPTableInfoIndex.h"
+#include "HighScoreImageCache.h"
+#include "LoaderPool.h"
+#include "BackgroundFileWriter.h"
+#include "Sprite.h"
+#include "Trace.h"
+#include "StartupTimeline.h"
+#include "LaunchTimeline.h"
+#include "StartupTasks.h"
+#include "Benchmark.h"
+#include "SessionRecorder.h"
+#include "MemoryStats.h"
+#include "ScriptLog.h"
+#include "FontCache.h"
 #include "../Utilities/SWFParser.h"
 
 // --------------------------------------------------------------------------
@@ -101,14 +125,49 @@ namespace ConfigVars
 	static const TCHAR *MuteAttractMode = _T("AttractMode.Mute");
 	static const TCHAR *GameTimeout = _T("GameTimeout");
 	static const TCHAR *HideTaskbarDuringGame = _T("HideTaskbarDuringGame");
+	static const TCHAR *GameSchedPriority = _T("GameScheduling.GamePriority");
+	static const TCHAR *GameSchedFrontendCores = _T("GameScheduling.FrontendCores");
+	static const TCHAR *GameSchedEcoQoS = _T("GameScheduling.EcoQoS");
+	static const TCHAR *GameLaunchOverlap = _T("GameLaunch.Overlap");
 	static const TCHAR *FirstRunTime = _T("FirstRunTime");
 	static const TCHAR *HideUnconfiguredGames = _T("GameList.HideUnconfigured");
 	static const TCHAR *VSyncLock = _T("VSyncLock");
+	static const TCHAR *FlipModelSwapChain = _T("FlipModelSwapChain");
+	static const TCHAR *PresentThreads = _T("PresentThreads");
+	static const TCHAR *WatchdogHangTimeout = _T("Watchdog.HangTimeout");
+	static const TCHAR *LogMemoryInterval = _T("Log.MemoryInterval");
+	static const TCHAR *LogScriptRateLimit = _T("Log.ScriptRateLimit");
+	static const TCHAR *LowMemoryMode = _T("LowMemoryMode");
+	static const TCHAR *LowMemoryMaxVideos = _T("LowMemoryMode.MaxVideos");
+	static const TCHAR *DamageTrackedRendering = _T("DamageTrackedRendering");
+	static const TCHAR *MultiWindowRenderPass = _T("MultiWindowRenderPass");
+	static const TCHAR *HiddenWindowReleaseDelay = _T("HiddenWindowReleaseDelay");
+	static const TCHAR *TextureMemoryBudget = _T("TextureMemoryBudget");
+	static const TCHAR *TextureCache = _T("TextureCache");
+	static const TCHAR *TextureCacheVideoPosters = _T("TextureCache.VideoPosters");
+	static const TCHAR *TextureCacheVideoPosterTime = _T("TextureCache.VideoPosterTime");
+	static const TCHAR *MediaFileIndex = _T("MediaFileIndex");
+	static const TCHAR *VPTableInfoIndex = _T("VPTableInfoIndex");
+	static const TCHAR *HighScoreImageCache = _T("HighScoreImageCache");
+	static const TCHAR *HighScoreImageCacheDisk = _T("HighScoreImageCache.Disk");
+	static const TCHAR *AnimationStreamingThreshold = _T("AnimationStreamingThreshold");
+	static const TCHAR *SharedImages = _T("SharedImages");
+	static const TCHAR *VideoTextureRing = _T("VideoTextureRing");
+	static const TCHAR *VideoHardwareDecoding = _T("VideoHardwareDecoding");
+	static const TCHAR *VideoPlayerPool = _T("VideoPlayerPool");
+	static const TCHAR *VideoSharedDecoding = _T("VideoSharedDecoding");
+	static const TCHAR *VideoDownscale = _T("VideoDownscale");
+	static const TCHAR *VideoScalerQuality = _T("VideoScalerQuality");
+	static const TCHAR *VideoGaplessLoop = _T("VideoGaplessLoop");
+	static const TCHAR *AudioSharedMixer = _T("AudioSharedMixer");
 	static const TCHAR *DOFEnable = _T("DOF.Enable");
 	static const TCHAR *MouseHideByMoving = _T("Mouse.HideByMoving");
 	static const TCHAR *MouseHideCoors = _T("Mouse.HideCoords");
 	static const TCHAR *KeepDMDInFront = _T("DMDWindow.KeepInFrontOfBg");
 	static const TCHAR *UseInternalSWFRenderer = _T("UseInternalSWFRenderer");
+	static const TCHAR *RawInputBatching = _T("RawInputBatching");
+	static const TCHAR *OptionsDialogPreload = _T("OptionsDialog.Preload");
+	static const TCHAR *TraceChromeJson = _T("Trace.ChromeJson");
 }
 
 // include the capture-related variables
@@ -139,6 +198,9 @@ Application *Application::inst;
 bool Application::isInForeground = true;
 bool Application::playVideosInBackground = false;
 bool Application::pfPlayVideosInBackground = false;
+DWORD_PTR Application::savedAffinityMask = 0;
+bool Application::ecoQoSApplied = false;
+CriticalSection Application::frontendSchedLock;
 HCURSOR Application::emptyCursor;
 
 
@@ -148,6 +210,9 @@ HCURSOR Application::emptyCursor;
 //
 int Application::Main(HINSTANCE hInstance, LPTSTR lpCmdLine, int nCmdShow)
 {
+	// start the startup timeline
+	StartupTimeline::Begin();
+
 	// remember the instance handle globally
 	G_hInstance = hInstance;
 
@@ -331,6 +396,49 @@ int Application::EventLoop(int nCmdShow)
 				}
 			}
 		}
+
+		// Javascript profiling
+		else if (std::regex_match(argp, m, std::basic_regex<TCHAR>(_T("/jsprofile(:(.*))?"), std::regex_constants::icase)))
+		{
+			// /JSProfile[:budget=<milliseconds>]
+			// Times all calls into Javascript, logs a summary at exit, and
+			// logs each call that takes longer than the budget.  A budget
+			// of zero disables the individual slow call reports.
+			JavascriptEngine::profilingEnabled = true;
+			if (m[2].matched && m[2].length() != 0)
+			{
+				TSTRING subopts = m[2];
+				if (std::regex_search(subopts.c_str(), m, std::basic_regex<TCHAR>(_T("\\bbudget=(\\d+(\\.\\d*)?)"), std::regex_constants::icase)))
+					JavascriptEngine::profileBudget = _ttof(m[1].str().c_str());
+			}
+		}
+
+		// Benchmark mode
+		else if (Benchmark::ParseOption(argp))
+		{
+			// /Benchmark[:games=<N>[,<N>...]][,media=<folder>][,session=<file>][,out=<folder>]
+			// Runs the game list benchmarks against a generated collection,
+			// the media benchmarks against a folder of media files, or a
+			// session recording playback, and exits.  See Benchmark.h.
+		}
+
+		// Session recording
+		else if (SessionRecorder::ParseOption(argp))
+		{
+			// /RecordSession:<file>
+			// Records the key commands processed during the session, for
+			// playback with /Benchmark:session=<file>.  See SessionRecorder.h.
+		}
+	}
+
+	// In benchmark mode, set up the generated collection, and use its
+	// settings and stats files in place of the normal ones
+	if (Benchmark::IsActive())
+	{
+		InteractiveErrorHandler eh;
+		if (!Benchmark::Prepare(configFilePath, gameStatsPath, eh))
+			return 0;
+		configFileDesc.dir = configFilePath.c_str();
 	}
 
 	// initialize the core subsystems and load config settings
@@ -357,12 +465,21 @@ int Application::EventLoop(int nCmdShow)
 	RefPtr<DummyWindow> dummyWindow(new DummyWindow());
 	dummyWindow->Create(NULL, _T("PinballY"), WS_POPUPWINDOW, SW_SHOW);
 
-	// If desired, check for monitors
+	// If desired, wait for the monitors to come online.  The only part
+	// of startup that actually depends on the full desktop layout is
+	// the window placement, so run the wait as a background task (the
+	// wait dialog runs its own modal loop on the task's thread), and
+	// carry on loading the game list and setting up the other
+	// subsystems in the meantime.  We join the task just before
+	// creating the windows.  On a cold boot where the TVs are slow to
+	// wake up, this lets the loading work finish while we're waiting
+	// for the displays, rather than starting only after they're up.
 	if (const TCHAR *monWaitSpec = ConfigManager::GetInstance()->Get(_T("WaitForMonitors"), _T(""));
-		!std::regex_match(monWaitSpec, std::basic_regex<TCHAR>(_T("\\s*"))))
+		!IsBlankString(monWaitSpec))
 	{
+		TSTRING spec = monWaitSpec;
 		int extraWait = ConfigManager::GetInstance()->GetInt(_T("WaitForMonitors.ExtraDelay"), 0);
-		MonitorCheck::WaitForMonitors(monWaitSpec, extraWait * 1000);
+		StartupTasks::Add("Monitor wait", {}, [spec, extraWait]() { MonitorCheck::WaitForMonitors(spec.c_str(), extraWait * 1000); });
 	}
 
 	// Check for a RunBefore program.  Do this after the monitor check
@@ -376,20 +493,47 @@ int Application::EventLoop(int nCmdShow)
 	// (Note: if someone actually does want to mess with the config
 	// file at some point, it would be simple enough to re-read the 
 	// config file after the RunBefore process finishes.  But for now
-	// let's assume this isn't necessary.)
-	CheckRunAtStartup();
+	// let's assume this isn't necessary.)  If there's a RunBefore
+	// program, this means that the monitor wait can't overlap with
+	// the game list loading, since the program has to run between
+	// the two.
+	if (const TCHAR *cmd = ConfigManager::GetInstance()->Get(_T("RunAtStartup"), _T("")); !IsBlankString(cmd))
+	{
+		StartupTasks::Join("Monitor wait");
+		StartupTimeline::Phase phase("RunBefore program");
+		CheckRunAtStartup();
+	}
 
-	// set up DOF before creating the UI
-	if (ConfigManager::GetInstance()->GetBool(ConfigVars::DOFEnable, true))
-		DOFClient::Init();
+	// Start creating the libvlc instance in the background.  Loading
+	// the VLC plugins can take a while on the first run after a reboot,
+	// and we'll need the instance as soon as the first game's videos
+	// load.
+	StartupTasks::Add("VLC prewarm", {}, []() { VLCAudioVideoPlayer::PrewarmInstance(); });
+
+	// DOF initialization was started on a background thread when we
+	// loaded the config.  Wait for it in the background, and finish
+	// the UI side of the setup when it's done, so that the playfield
+	// can come up while DOF is still loading.
+	StartupTasks::Add("DOF startup", {}, []() { DOFClient::WaitReady(); }, [this]()
+	{
+		if (auto pfv = GetPlayfieldView(); pfv != nullptr)
+			pfv->OnDOFStartupReady();
+	});
 
 	// initialize the game list
 	CapturingErrorHandler loadErrs;
 	if (!InitGameList(loadErrs, InteractiveErrorHandler()))
 		return 0;
 
-	// initialize the Pinscape device list
-	PinscapeDevice::FindDevices(pinscapeDevices);
+	// Scan for Pinscape devices in the background.  The device list isn't
+	// needed until the first Night Mode command; the accessors join the
+	// task before using the list.
+	StartupTasks::Add("Pinscape device scan", {}, [this]() { PinscapeDevice::FindDevices(pinscapeDevices); });
+
+	// Preload the options dialog in the background, if desired.  The
+	// dialog joins the task before using the DLL.
+	if (ConfigManager::GetInstance()->GetBool(ConfigVars::OptionsDialogPreload, true))
+		StartupTasks::Add("Options dialog preload", {}, []() { PlayfieldView::PreloadSettingsDialog(); });
 
 	// create the window objects
 	playfieldWin.Attach(new PlayfieldWin());
@@ -398,76 +542,90 @@ int Application::EventLoop(int nCmdShow)
 	topperWin.Attach(new TopperWin());
 	instCardWin.Attach(new InstCardWin());
 
-	// get the FFmpeg version by running FFmpeg with no arguments and
-	// finding the version string in the stdout results
-	{
-		// run FFmpeg (32- or 64-bit version, according to our build type)
-		// with stdout capture
-		TCHAR ffmpeg[MAX_PATH];
-		GetDeployedFilePath(ffmpeg, _T("ffmpeg\\ffmpeg.exe"), _T("$(SolutionDir)ffmpeg$(64)\\ffmpeg.exe"));
-		CreateProcessCaptureStdout(ffmpeg, _T(""), 5000,
-			[this](const BYTE *stdoutContents, long len)
-		{
-			// find "ffmpeg version <xxx>"
-			CSTRING buf((const CHAR *)stdoutContents, (size_t)len);
-			std::match_results<CSTRING::const_iterator> m;
-			if (std::regex_search(buf, m, std::regex("ffmpeg version (\\S+)", std::regex_constants::icase)))
-				ffmpegVersion = m[1].str();
-		}, [](const TCHAR *) {});
-	}
+	// Load the cached FFmpeg capabilities (version, encoders, input
+	// devices).  This only reads the cache file; we don't run ffmpeg
+	// itself until something actually needs the information and the
+	// cache doesn't match the installed ffmpeg.exe.
+	FFmpegProbe::LoadCache();
 
 	// create the high scores reader object
 	highScores.Attach(new HighScores());
 
+	// create a window, timing it for the startup timeline
+	auto CreateWin = [nCmdShow](FrameWin *win, HWND parent, int titleId, const CHAR *phaseName)
+	{
+		StartupTimeline::Phase phase(phaseName);
+		return win->CreateWin(parent, nCmdShow, LoadStringT(titleId));
+	};
+
+	// The windows need the final desktop layout to restore their
+	// positions, so make sure the monitor wait has finished
+	StartupTasks::Join("Monitor wait");
+
 	// open the UI windows
+	StartupTimeline::Phase createWindowsPhase("Create windows");
 	bool ok = true;
-	if (!playfieldWin->CreateWin(NULL, nCmdShow, LoadStringT(IDS_WINTTL_PLAYFIELD)))
+	if (!CreateWin(playfieldWin, NULL, IDS_WINTTL_PLAYFIELD, "Create playfield window"))
 	{
 		ok = false;
 		PostQuitMessage(1);
 	}
 
 	// set up the backglass window
-	if (ok && !backglassWin->CreateWin(playfieldWin->GetHWnd(), nCmdShow, LoadStringT(IDS_WINTTL_BACKGLASS)))
+	if (ok && !CreateWin(backglassWin, playfieldWin->GetHWnd(), IDS_WINTTL_BACKGLASS, "Create backglass window"))
 	{
 		ok = false;
 		PostQuitMessage(1);
 	}
 
 	// set up the DMD window
-	if (ok && !dmdWin->CreateWin(playfieldWin->GetHWnd(), nCmdShow, LoadStringT(IDS_WINTTL_DMD)))
+	if (ok && !CreateWin(dmdWin, playfieldWin->GetHWnd(), IDS_WINTTL_DMD, "Create DMD window"))
 	{
 		ok = false;
 		PostQuitMessage(1);
 	}
 
 	// set up the topper window
-	if (ok && !topperWin->CreateWin(playfieldWin->GetHWnd(), nCmdShow, LoadStringT(IDS_WINTTL_TOPPER)))
+	if (ok && !CreateWin(topperWin, playfieldWin->GetHWnd(), IDS_WINTTL_TOPPER, "Create topper window"))
 	{
 		ok = false;
 		PostQuitMessage(1);
 	}
 
 	// set up the instruction card window
-	if (ok && !instCardWin->CreateWin(playfieldWin->GetHWnd(), nCmdShow, LoadStringT(IDS_WINTTL_INSTCARD)))
+	if (ok && !CreateWin(instCardWin, playfieldWin->GetHWnd(), IDS_WINTTL_INSTCARD, "Create instruction card window"))
 	{
 		ok = false;
 		PostQuitMessage(1);
 	}
 
+	createWindowsPhase.End();
+
 	// initialize javascript
-	GetPlayfieldView()->InitJavascript();
+	{
+		StartupTimeline::Phase phase("Javascript init");
+		GetPlayfieldView()->InitJavascript();
+	}
 
 	// set up raw input through the main playfield window's message loop
 	if (ok)
+	{
+		InputManager::GetInstance()->EnableRawInputBatching(ConfigManager::GetInstance()->GetBool(ConfigVars::RawInputBatching, true));
 		ok = InputManager::GetInstance()->InitRawInput(playfieldWin->GetHWnd());
+	}
 
 	// initialize the high scores object
-	highScores->Init();
+	{
+		StartupTimeline::Phase phase("High score init");
+		highScores->Init();
+	}
 
 	// try setting up real DMD support
 	if (ok)
+	{
+		StartupTimeline::Phase phase("Real DMD init");
 		GetPlayfieldView()->InitRealDMD(InUiErrorHandler());
+	}
 
 	// Generate a PINemHi version request on behalf of the main window
 	highScores->GetVersion(GetPlayfieldView()->GetHWnd());
@@ -482,11 +640,11 @@ int Application::EventLoop(int nCmdShow)
 	if (loadErrs.CountErrors() != 0)
 		GetPlayfieldView()->ShowError(ErrorIconType::EIT_Error, LoadStringT(IDS_ERR_LISTLOADWARNINGS), &loadErrs);
 
-	// wait for DOF initialization to complete
-	DOFClient::WaitReady();
-
-	// If we ran into DOF errors, show those
-	GetPlayfieldView()->ShowDOFClientInitErrors();
+	// preload the button sounds, now that we know where the media live
+	{
+		StartupTimeline::Phase phase("Button sound preload");
+		GetPlayfieldView()->PreloadButtonSounds();
+	}
 
 	// bring the main playfield window to the front
 	SetForegroundWindow(playfieldWin->GetHWnd());
@@ -506,12 +664,47 @@ int Application::EventLoop(int nCmdShow)
 	// usually won't happen right away.
 	refTableList->Init();
 
+	// Start indexing the VP table metadata for the table files.  This
+	// runs at background priority, and only reads files that are new
+	// or changed since the last session.
+	VPTableInfoIndex::UpdateFromGameList();
+
 	// launch the watchdog process
 	watchdog.Launch();
 
+	// Startup is complete, except for the first frame in each window.
+	// Have the startup timeline wait for the first frames from the
+	// visible windows.
+	auto ExpectFirstFrame = [](FrameWin *win, const CHAR *phaseName)
+	{
+		if (win != nullptr && IsWindowVisible(win->GetHWnd()) && !IsIconic(win->GetHWnd()) && win->GetView() != nullptr)
+			StartupTimeline::ExpectFirstFrame(win->GetView()->GetHWnd(), phaseName);
+	};
+	ExpectFirstFrame(playfieldWin, "First frame (playfield)");
+	ExpectFirstFrame(backglassWin, "First frame (backglass)");
+	ExpectFirstFrame(dmdWin, "First frame (DMD)");
+	ExpectFirstFrame(topperWin, "First frame (topper)");
+	ExpectFirstFrame(instCardWin, "First frame (instruction card)");
+	StartupTimeline::WaitForFirstFrames();
+
+	// have the playfield window handle background startup task completions
+	StartupTasks::SetUiWindow(GetPlayfieldView()->GetHWnd(), PFVMsgStartupTaskDone);
+
+	// have it handle audio/video player retirements as well
+	AudioVideoPlayer::SetRetirementNotify(GetPlayfieldView()->GetHWnd(), PFVMsgPlayerRetired);
+
+	// start the benchmark tests, if we're in benchmark mode
+	Benchmark::Start();
+
+	// start the session recording, if desired
+	SessionRecorder::Start();
+
 	// run the main window's message loop
 	int retcode = D3DView::MessageLoop();
 
+	// make sure the startup tasks are finished
+	StartupTasks::Shutdown();
+
 	// if there's a game monitor thread, shut it down
 	if (gameMonitor != nullptr)
 	{
@@ -534,7 +727,7 @@ int Application::EventLoop(int nCmdShow)
 		WaitForSingleObject(newFileScanThread->hThread, 5000);
 
 	// save any updates to the config file or game databases
-	SaveFiles();
+	FlushFiles();
 
 	// if there's an admin host thread, terminate it
 	adminHost.Shutdown();
@@ -560,6 +753,7 @@ int Application::EventLoop(int nCmdShow)
 
 	// wait for the audio/video player deletion queue to empty
 	AudioVideoPlayer::WaitForDeletionQueue(5000);
+	AudioVideoPlayer::ShutdownRetirementWorker();
 
 	// Shut down Javascript.  Do this after saving files, because if we were
 	// launched by a debugger (e.g., VS Code), the debugger might kill the
@@ -568,6 +762,12 @@ int Application::EventLoop(int nCmdShow)
 	// if we get asynchronously terminated like that.
 	JavascriptEngine::Terminate();
 
+	// launch the next benchmark session, if any
+	Benchmark::Shutdown();
+
+	// close the session recording
+	SessionRecorder::Shutdown();
+
 	// check for a RunAfter program
 	CheckRunAtExit();
 
@@ -644,7 +844,7 @@ void Application::RestartAsAdmin()
 	// Save all file and config updates before we launch the new 
 	// process, so that it starts up with the same values we have 
 	// in memory right now.
-	SaveFiles();
+	FlushFiles();
 
 	// We only attempt the Admin mode launch on explicit user
 	// request, and we only offer that option when a game launch
@@ -697,6 +897,9 @@ Application::Application()
 	// asynchronous loading, so that they're tolerant of running before
 	// the loading is completed.)
 	refTableList.reset(new RefTableList());
+
+	// create the capture timing statistics object
+	captureTimeStats.reset(new CaptureTimeStats());
 }
 
 bool Application::Init()
@@ -708,6 +911,10 @@ bool Application::Init()
 	// can log messages during initialization if desired
 	LogFile::Init();
 
+	// start the performance trace
+	Trace::Init();
+	StartupTimeline::Phase phase("Core init");
+
 	// Set up the config manager.  Do this as the first thing after
 	// setting up the log file.
 	ConfigManager::Init();
@@ -715,14 +922,27 @@ bool Application::Init()
 	// let the log file load any config data it needs
 	LogFile::Get()->InitConfig();
 
+	// Load the image file information cache saved in the last session,
+	// and check file times through the media file index, so that image
+	// header lookups for files we've already seen don't touch the disk.
+	{
+		TCHAR path[MAX_PATH];
+		GetDeployedFilePath(path, _T("ImageInfoCache.dat"), _T(""));
+		ImageFileInfoCache::Load(path);
+		ImageFileInfoCache::SetFileTimeProvider(&MediaFileIndex::GetFileTime);
+	}
+
 	// initialize the media type list
 	GameListItem::InitMediaTypeList();
 
 	// initialize D3D
+	StartupTimeline::Phase d3dPhase("D3D device setup");
 	if (!D3D::Init())
 		return false;
+	d3dPhase.End();
 
 	// create the texture shader
+	StartupTimeline::Phase shaderPhase("Shader setup");
 	textureShader.reset(new TextureShader());
 	if (!textureShader->Init())
 		return false;
@@ -747,15 +967,31 @@ bool Application::Init()
 	if (!i444A10Shader->Init())
 		return false;
 
+	// create the NV12 shader (YUV 4:2:0 with interleaved chroma, for
+	// hardware-decoded videos)
+	nv12Shader.reset(new NV12Shader());
+	if (!nv12Shader->Init())
+		return false;
+	shaderPhase.End();
+
 	// initialize the audio manager
 	AudioManager::Init();
 
 	// start Media Foundation
 	MFStartup(MF_VERSION, MFSTARTUP_NOSOCKET);
 
-	// initialize the input manager
+	// initialize the input manager, starting with the joystick descriptors
+	// saved from the last session, so that device discovery doesn't have
+	// to ask each device for its strings again
+	StartupTimeline::Phase inputPhase("Input manager init");
+	{
+		TCHAR path[MAX_PATH];
+		GetDeployedFilePath(path, _T("JoystickCache.dat"), _T(""));
+		JoystickManager::LoadDescriptorCache(path);
+	}
 	if (!InputManagerWithConfig::Init())
 		return false;
+	inputPhase.End();
 
 	// initialize DirectWrite
 	DirectWriteUtils::Init(LogFileErrorHandler());
@@ -766,9 +1002,15 @@ bool Application::Init()
 
 Application::~Application()
 {
+	// finish any startup tasks still running, in case we exited early
+	StartupTasks::Shutdown();
+
 	// clean up static resources for the SWF mini-renderer
 	SWFParser::Shutdown();
 
+	// release the shared fonts while GDI+ is still running
+	FontCache::Clear();
+
 	// shut down the DOF client
 	DOFClient::Shutdown(true);
 
@@ -778,10 +1020,56 @@ Application::~Application()
 	// clear the media type lists
 	GameListItem::ClearMediaTypeList();
 
-	// shut down libvlc
+	// shut down libvlc, and then the shared audio mixer that its players
+	// were feeding
 	VLCAudioVideoPlayer::OnAppExit();
+	AudioMixer::Shutdown();
+
+	// let any ffmpeg probe in progress finish
+	FFmpegProbe::Shutdown();
+
+	// stop the texture cache background transcoder
+	TextureCache::Shutdown();
+
+	// save the image file information cache for the next session
+	{
+		TCHAR path[MAX_PATH];
+		GetDeployedFilePath(path, _T("ImageInfoCache.dat"), _T(""));
+		ImageFileInfoCache::Save(path);
+	}
+
+	// save the joystick descriptor cache
+	{
+		TCHAR path[MAX_PATH];
+		GetDeployedFilePath(path, _T("JoystickCache.dat"), _T(""));
+		JoystickManager::SaveDescriptorCache(path);
+	}
+
+	// save the PINemHi results for the next session
+	if (highScores != nullptr)
+		highScores->SaveResultCache();
+
+	// stop the VP table metadata indexer (it uses the media file index,
+	// so do this first)
+	VPTableInfoIndex::Shutdown();
+
+	// stop the media file index monitor
+	MediaFileIndex::Shutdown();
 
-	// clean up DirectWrite
+	// complete any pending file writes and stop the writer thread
+	BackgroundFileWriter::Shutdown();
+
+	// shut down the loader thread pool
+	LoaderPool::Shutdown();
+
+	// log the DirectWrite text cache statistics, and clean up DirectWrite
+	if (auto dw = DirectWriteUtils::Get(); dw != nullptr)
+	{
+		auto cs = dw->GetCacheStats();
+		LogFile::Get()->Write(LogFile::JSLogging,
+			_T("DirectWrite text cache: formats %I64u hits, %I64u misses; layouts %I64u hits, %I64u misses\n"),
+			cs.formatHits, cs.formatMisses, cs.layoutHits, cs.layoutMisses);
+	}
 	DirectWriteUtils::Terminate();
 
 	// clean up the input subsystem
@@ -796,6 +1084,9 @@ Application::~Application()
 	// clean up the config manager
 	ConfigManager::Shutdown();
 
+	// write the trace file
+	Trace::Shutdown();
+
 	// close the log file
 	LogFile::Shutdown();
 
@@ -812,6 +1103,8 @@ Application::~Application()
 
 bool Application::LoadConfig(const ConfigFileDesc &fileDesc)
 {
+	StartupTimeline::Phase phase("Load config");
+
 	// load the configuration
 	if (!ConfigManager::GetInstance()->Load(fileDesc))
 		return false;
@@ -840,9 +1133,63 @@ bool Application::LoadConfig(const ConfigFileDesc &fileDesc)
 
 bool Application::InitGameList(CapturingErrorHandler &loadErrs, ErrorHandler &fatalErrorHandler)
 {
+	StartupTimeline::Phase phase("Game list init");
+
+	// make sure the startup media preread (below) isn't still using the
+	// old game list, if we're re-creating it
+	StartupTasks::Join("Startup media preread");
+
 	GameList::Create();
 	GameList::Get()->Init(loadErrs);
-	if (!GameList::Get()->Load(loadErrs))
+
+	// On the initial load, read the startup media into the file cache
+	// in the background while the game list loads.  The startup videos
+	// start playing as soon as the UI is up, and on a cold disk, the
+	// first reads would otherwise hold up the video and audio decoders
+	// at the very start of playback.  The media folders are set up as
+	// soon as the game list is initialized, so we can search for the
+	// files now.  Custom windows aren't covered, since their startup
+	// video names are only known once their scripts have run.
+	static bool startupMediaPreread = false;
+	if (!startupMediaPreread)
+	{
+		startupMediaPreread = true;
+		StartupTasks::Add("Startup media preread", {}, []()
+		{
+			// Startup video names - these must match the StartupVideoName()
+			// overrides in the window classes, and the real DMD names in
+			// RealDMD::LoadStartupVideo()
+			static const TCHAR *const videoNames[] = {
+				_T("Startup Video"), _T("Startup Video (bg)"), _T("Startup Video (dmd)"),
+				_T("Startup Video (topper)"), _T("Startup Video (instcard)"),
+				_T("Startup Video (realdmd)"), _T("Startup Video (realdmd color)")
+			};
+
+			// Read each file that exists.  Startup videos are usually short,
+			// but cap the read, to avoid flooding the file cache with a
+			// long video.
+			const UINT64 maxBytes = 64 * 1024 * 1024;
+			auto gl = GameList::Get();
+			TCHAR path[MAX_PATH];
+			for (auto name : videoNames)
+			{
+				if (gl->FindGlobalVideoFile(path, _T("Startup Videos"), name))
+					PrereadFile(path, maxBytes);
+			}
+			if (gl->FindGlobalAudioFile(path, _T("Startup Sounds"), _T("Startup Audio")))
+				PrereadFile(path, maxBytes);
+		});
+	}
+
+	// load the capture timing statistics, which live alongside the
+	// game stats database
+	captureTimeStats->Init();
+	bool loaded;
+	{
+		Benchmark::Timer benchmarkTimer("gameList.load");
+		loaded = GameList::Get()->Load(loadErrs);
+	}
+	if (!loaded)
 	{
 		MultiErrorList meh;
 		meh.Add(&loadErrs);
@@ -863,20 +1210,35 @@ bool Application::ReloadConfig()
 	// errors via the in-UI mechanism
 	InUiErrorHandler uieh;
 
-	// clear media in all windows
-	ClearMedia();
-
-	// re-create the game list
-	GameList::ReCreate();
-
-	// load the settings file
+	// Load the settings file.  This notifies the config subscribers,
+	// which update their own settings from the changed variables.
 	if (!LoadConfig(configFileDesc))
 		return false;
 
-	// reset the game list
+	// If nothing changed, or the changes only affect settings that the
+	// windows apply on their own, we're done.  This is the common case
+	// for small edits in the options dialog, such as a font or color
+	// change, and it saves reloading all of the media and the game list.
+	const auto &changes = ConfigManager::GetInstance()->GetReloadChanges();
+	if (changes.IsEmpty() || changes.Only(&IsLiveConfigVar))
+		return true;
+
+	// clear media in all windows
+	ClearMedia();
+
+	// Re-create the game list if any of its settings changed.  Other
+	// changes can affect how the media are presented, so they still
+	// require reloading the media, but we can keep the game list.
 	CapturingErrorHandler loadErrs;
-	if (!InitGameList(loadErrs, uieh))
-		return false;
+	if (changes.all || !changes.Only(&IsNonGameListConfigVar))
+	{
+		// re-create the game list
+		GameList::ReCreate();
+
+		// reset the game list
+		if (!InitGameList(loadErrs, uieh))
+			return false;
+	}
 
 	// update the selection in the main playfield window (which will
 	// trigger updates in the other windows)
@@ -884,7 +1246,8 @@ bool Application::ReloadConfig()
 		pfv->OnGameListRebuild();
 
 	// reload DMD support
-	GetPlayfieldView()->InitRealDMD(uieh);
+	if (changes.HasPrefix(_T("RealDMD")))
+		GetPlayfieldView()->InitRealDMD(uieh);
 
 	// show any non-fatal game list load errors
 	if (loadErrs.CountErrors() != 0)
@@ -894,6 +1257,67 @@ bool Application::ReloadConfig()
 	return true;
 }
 
+bool Application::IsLiveConfigVar(const TSTRING &name)
+{
+	// Variables applied directly by the config subscribers (mainly
+	// PlayfieldView::OnConfigChange), without reloading media.  These
+	// are matched by prefix.
+	static const TCHAR *const prefixes[] = {
+		_T("AttractMode."), _T("Buttons."), _T("Capture."), _T("Coin"), _T("ExitMenu."),
+		_T("GameLaunch."), _T("GameScheduling."), _T("InfoBox."), _T("LaunchFocus."), _T("Log."), _T("LowerStatus."), _T("Mouse."),
+		_T("StatusLine."), _T("UpperStatus."),
+	};
+	static const TCHAR *const exact[] = {
+		_T("CreditBalance"), _T("CrossfadeTime"), _T("GameTimeout"), _T("HideTaskbarDuringGame"),
+		_T("MaxCreditBalance"), _T("PricingModel"), _T("SimultaneousWindowUpdate"),
+	};
+	for (auto p : prefixes)
+	{
+		if (_tcsnicmp(name.c_str(), p, _tcslen(p)) == 0)
+			return true;
+	}
+	for (auto e : exact)
+	{
+		if (_tcsicmp(name.c_str(), e) == 0)
+			return true;
+	}
+
+	// Font and color settings are live, except for the ones that go into
+	// pre-rendered images (the wheel titles and the high score slides),
+	// since the current images have to be reloaded to pick up a change.
+	// Window positions are saved by the program itself and don't affect
+	// anything until the next use.
+	auto EndsWith = [&name](const TCHAR *suffix)
+	{
+		size_t len = _tcslen(suffix);
+		return name.length() >= len && _tcsicmp(name.c_str() + name.length() - len, suffix) == 0;
+	};
+	if (EndsWith(_T("Font")) || EndsWith(_T("Color")))
+		return _tcsnicmp(name.c_str(), _T("Wheel"), 5) != 0 && StrStrI(name.c_str(), _T("HighScore")) == nullptr
+			&& StrStrI(name.c_str(), _T("HiScore")) == nullptr;
+	if (EndsWith(_T(".Position")))
+		return true;
+
+	// anything else requires at least a media reload
+	return false;
+}
+
+bool Application::IsNonGameListConfigVar(const TSTRING &name)
+{
+	// Variables that the game list reads when it's created: the system
+	// definitions, the file locations, and the game list options
+	static const TCHAR *const prefixes[] = {
+		_T("System"), _T("GameList."), _T("MediaPath"), _T("TableDatabasePath"),
+		_T("SortTableDatabases"), _T("PinballXPath"), _T("MediaFileIndex"),
+	};
+	for (auto p : prefixes)
+	{
+		if (_tcsnicmp(name.c_str(), p, _tcslen(p)) == 0)
+			return false;
+	}
+	return true;
+}
+
 void Application::OnConfigChange()
 {
 	// load application-level variables
@@ -906,11 +1330,117 @@ void Application::OnConfigChange()
 	hideUnconfiguredGames = cfg->GetBool(ConfigVars::HideUnconfiguredGames, false);
 	useInternalSWFRenderer = cfg->GetBool(ConfigVars::UseInternalSWFRenderer, true);
 
+	// enable or disable the Chrome JSON trace file
+	Trace::EnableChromeJson(cfg->GetBool(ConfigVars::TraceChromeJson, false));
+
 	// update the video sync mode
 	D3DWin::vsyncMode = cfg->GetBool(ConfigVars::VSyncLock, false) ? 1 : 0;
 
+	// update the swap chain presentation model (applies to new windows)
+	D3DWin::flipModel = cfg->GetBool(ConfigVars::FlipModelSwapChain, false);
+	D3DWin::presentThreads = cfg->GetBool(ConfigVars::PresentThreads, false);
+
+	// update the watchdog's hang report timeout
+	watchdog.SetHangTimeout(max(0, cfg->GetInt(ConfigVars::WatchdogHangTimeout, 30)) * 1000);
+
+	// update the periodic memory statistics log
+	MemoryStats::SetLogInterval(max(0, cfg->GetInt(ConfigVars::LogMemoryInterval, 600)));
+	ScriptLog::SetRateLimit(cfg->GetInt(ConfigVars::LogScriptRateLimit, 50));
+
+	// update the damage tracking mode for window rendering
+	D3DView::damageTracking = cfg->GetBool(ConfigVars::DamageTrackedRendering, true);
+	D3DView::multiWindowRenderPass = cfg->GetBool(ConfigVars::MultiWindowRenderPass, false);
+
+	// update the delay for releasing hidden windows' swap chains
+	D3DView::hiddenSwapChainReleaseDelay = max(0, cfg->GetInt(ConfigVars::HiddenWindowReleaseDelay, 60));
+
+	// update the per-window frame rate limits
+	D3DView::ReloadFrameRateConfig();
+
+	// update the texture memory budget (configured in megabytes)
+	TextureBudget::SetBudget(static_cast<INT64>(max(0, cfg->GetInt(ConfigVars::TextureMemoryBudget, 0))) * 1024 * 1024);
+	TextureCache::enabled = cfg->GetBool(ConfigVars::TextureCache, false);
+	TextureCache::posterFrames = cfg->GetBool(ConfigVars::TextureCacheVideoPosters, true);
+	TextureCache::posterFrameTime = static_cast<DWORD>(max(0, cfg->GetInt(ConfigVars::TextureCacheVideoPosterTime, 0)));
+
+	// update the media file index mode
+	MediaFileIndex::enabled = cfg->GetBool(ConfigVars::MediaFileIndex, true);
+	VPTableInfoIndex::enabled = cfg->GetBool(ConfigVars::VPTableInfoIndex, true);
+
+	// update the high score image cache modes
+	HighScoreImageCache::enabled = cfg->GetBool(ConfigVars::HighScoreImageCache, true);
+	HighScoreImageCache::diskEnabled = cfg->GetBool(ConfigVars::HighScoreImageCacheDisk, false);
+	if (!HighScoreImageCache::enabled)
+		HighScoreImageCache::Clear();
+
+	// update the animated image streaming threshold (configured in megabytes)
+	Sprite::animStreamingThreshold = static_cast<size_t>(max(0, cfg->GetInt(ConfigVars::AnimationStreamingThreshold, 64))) * 1024 * 1024;
+	Sprite::sharedImages = cfg->GetBool(ConfigVars::SharedImages, true);
+
+	// update the video frame upload mode
+	VLCAudioVideoPlayer::useTextureRing = cfg->GetBool(ConfigVars::VideoTextureRing, true);
+	VLCAudioVideoPlayer::hardwareDecoding = cfg->GetBool(ConfigVars::VideoHardwareDecoding, false);
+	VLCAudioVideoPlayer::playerPoolSize = max(0, min(16, cfg->GetInt(ConfigVars::VideoPlayerPool, 4)));
+	VideoSprite::sharedDecoding = cfg->GetBool(ConfigVars::VideoSharedDecoding, true);
+	VLCAudioVideoPlayer::downscaleToWindow = cfg->GetBool(ConfigVars::VideoDownscale, true);
+	VLCAudioVideoPlayer::gaplessLooping = cfg->GetBool(ConfigVars::VideoGaplessLoop, true);
+	VLCAudioVideoPlayer::useSharedMixer = cfg->GetBool(ConfigVars::AudioSharedMixer, true);
+	{
+		const TCHAR *q = cfg->Get(ConfigVars::VideoScalerQuality, _T("bicubic"));
+		VLCAudioVideoPlayer::scalerMode = _tcsicmp(q, _T("fast")) == 0 ? 0 : _tcsicmp(q, _T("bilinear")) == 0 ? 1 : 2;
+	}
+
+	// Apply the low-memory profile, if it's in effect.  This tightens the
+	// settings above, so it has to come after them.  The playfield view
+	// applies the prefetch limit when it loads its own settings.
+	const TCHAR *lowMemReason;
+	bool lowMem = IsLowMemoryMode(&lowMemReason);
+	Sprite::limitToWindowSize = lowMem;
+	VideoSprite::maxPlayers = lowMem ? max(1, cfg->GetInt(ConfigVars::LowMemoryMaxVideos, 6)) : 0;
+	if (lowMem)
+	{
+		// stream animated images over 8MB instead of keeping all frames
+		const size_t lowMemAnimThreshold = 8 * 1024 * 1024;
+		if (Sprite::animStreamingThreshold == 0 || Sprite::animStreamingThreshold > lowMemAnimThreshold)
+			Sprite::animStreamingThreshold = lowMemAnimThreshold;
+
+		// don't keep idle players in the pool
+		VLCAudioVideoPlayer::playerPoolSize = 0;
+
+		// release hidden windows' swap chains promptly
+		const int lowMemReleaseDelay = 5;
+		if (D3DView::hiddenSwapChainReleaseDelay <= 0 || D3DView::hiddenSwapChainReleaseDelay > lowMemReleaseDelay)
+			D3DView::hiddenSwapChainReleaseDelay = lowMemReleaseDelay;
+
+		// if there's no texture budget, set one: half of the video memory,
+		// up to 512MB
+		if (TextureBudget::GetBudget() == 0)
+		{
+			INT64 budget = 512 * 1024 * 1024;
+			if (UINT64 vram = D3D::Get()->GetDedicatedVideoMemory(); vram != 0)
+				budget = min(budget, static_cast<INT64>(vram / 2));
+			TextureBudget::SetBudget(budget);
+		}
+	}
+
+	// log the profile status
+	LogFile::Get()->Write(_T("Low-memory profile: %s (%s)\n"), lowMem ? _T("on") : _T("off"), lowMemReason);
+	if (lowMem)
+	{
+		LogFile::Get()->Write(_T("  still images limited to window size\n")
+			_T("  maximum concurrent video players: %d\n")
+			_T("  animated images stream when over %d MB\n")
+			_T("  video player pool disabled\n")
+			_T("  hidden window resources released after %d seconds\n")
+			_T("  texture memory budget: %d MB\n")
+			_T("  playfield neighbor prefetch disabled\n"),
+			VideoSprite::maxPlayers, static_cast<int>(Sprite::animStreamingThreshold / (1024 * 1024)),
+			D3DView::hiddenSwapChainReleaseDelay, static_cast<int>(TextureBudget::GetBudget() / (1024 * 1024)));
+	}
+
 	// If the DOF mode has changed since we last checked, create or destroy
 	// the DOF client.
+	StartupTasks::Join("DOF startup");
 	DOFClient::WaitReady();
 	bool dofWasActive = DOFClient::Get() != nullptr;
 	bool dofIsActive = cfg->GetBool(ConfigVars::DOFEnable, true);
@@ -943,38 +1473,49 @@ void Application::OnConfigChange()
 		SetWindowLongPtr(dmdWin->GetHWnd(), GWLP_HWNDPARENT, reinterpret_cast<LONG_PTR>(dmdOwner->GetHWnd()));
 }
 
-void Application::SaveFiles()
+bool Application::SaveFiles(bool flush)
 {
 	// Skip this if the options dialog is showing.  The options dialog
 	// also accesses the config file, so give it exclusive access while
 	// it's running.
 	if (auto pfv = inst->GetPlayfieldView(); pfv != nullptr && pfv->IsSettingsDialogOpen())
-		return;
+		return false;
 
 	// save any statistics database updates
 	GameList::Get()->SaveStatsDb();
+	captureTimeStats->Save();
 
 	// save the current game selection and game list filter
 	GameList::Get()->SaveConfig();
 
 	// save change to game database XML files
-	GameList::Get()->SaveGameListFiles();
+	bool heldBack = GameList::Get()->SaveGameListFiles(flush);
 
 	// save any config setting updates
 	ConfigManager::GetInstance()->SaveIfDirty();
+
+	// tell the caller if any files were held back for a later save
+	return heldBack;
+}
+
+void Application::FlushFiles()
+{
+	// save the files, then wait for the background writes
+	SaveFiles(true);
+	BackgroundFileWriter::Flush();
 }
 
 void Application::CheckRunAtStartup()
 {
 	if (const TCHAR *cmd = ConfigManager::GetInstance()->Get(_T("RunAtStartup"), _T("")); 
-	    !std::regex_match(cmd, std::basic_regex<TCHAR>(_T("\\s*"))))
+	    !IsBlankString(cmd))
 		RunCommand(cmd, InteractiveErrorHandler(), IDS_ERR_RUNATSTARTUP);
 }
 
 void Application::CheckRunAtExit()
 {
 	if (const TCHAR *cmd = ConfigManager::GetInstance()->Get(_T("RunAtExit"), _T(""));
-		!std::regex_match(cmd, std::basic_regex<TCHAR>(_T("\\s*"))))
+		!IsBlankString(cmd))
 		RunCommand(cmd, InteractiveErrorHandler(), IDS_ERR_RUNATEXIT);
 }
 
@@ -1116,16 +1657,9 @@ bool Application::LoadStartupVideos()
 
 void Application::SyncSelectedGame()
 {
-	if (backglassWin != 0 && backglassWin->GetView() != 0)
-		backglassWin->GetView()->SendMessage(WM_COMMAND, ID_SYNC_GAME);
-	if (dmdWin != 0 && dmdWin->GetView() != 0)
-		dmdWin->GetView()->SendMessage(WM_COMMAND, ID_SYNC_GAME);
-	if (topperWin != 0 && topperWin->GetView() != 0)
-		topperWin->GetView()->SendMessage(WM_COMMAND, ID_SYNC_GAME);
-	if (instCardWin != 0 && instCardWin->GetView() != 0)
-		instCardWin->GetView()->SendMessage(WM_COMMAND, ID_SYNC_GAME);
-
-	CustomView::ForEachCustomView([](CustomView *cv) { cv->SendMessageW(WM_COMMAND, ID_SYNC_GAME); return true; });
+	// sync all of the windows in one coordinated pass through the playfield view
+	if (auto pfv = GetPlayfieldView(); pfv != nullptr)
+		pfv->SyncAllViews();
 }
 
 void Application::InitDialogPos(HWND hDlg, const TCHAR *configVar)
@@ -1282,6 +1816,41 @@ void Application::EnumFrameWindows(std::function<void(FrameWin*)> func)
 	if (topperWin != nullptr) func(topperWin);
 }
 
+bool Application::IsLowMemoryMode(const TCHAR **reason)
+{
+	const TCHAR *dummy;
+	if (reason == nullptr)
+		reason = &dummy;
+
+	// check for an explicit setting
+	const TCHAR *mode = ConfigManager::GetInstance()->Get(ConfigVars::LowMemoryMode, _T("auto"));
+	if (_tcsicmp(mode, _T("auto")) != 0)
+	{
+		bool on = ConfigManager::GetInstance()->GetBool(ConfigVars::LowMemoryMode, false);
+		*reason = on ? _T("enabled in settings") : _T("disabled in settings");
+		return on;
+	}
+
+	// Auto mode.  The 32-bit build has only 2GB of address space for
+	// everything, including the libvlc decoders and the D3D driver's
+	// mappings, so it always uses the profile.
+#ifndef _WIN64
+	*reason = _T("auto, 32-bit build");
+	return true;
+#else
+	// use it on video cards with less than 2GB of dedicated memory
+	if (auto d3d = D3D::Get(); d3d != nullptr && d3d->GetDedicatedVideoMemory() != 0
+		&& d3d->GetDedicatedVideoMemory() < 2048ULL * 1024 * 1024)
+	{
+		*reason = _T("auto, less than 2GB of dedicated video memory");
+		return true;
+	}
+
+	*reason = _T("auto");
+	return false;
+#endif
+}
+
 void Application::CheckForegroundStatus()
 {
 	// if one of our main windows is active, we're in the foreground
@@ -1326,6 +1895,11 @@ void Application::OnActivateApp(BaseWin* /*win*/, bool activating, DWORD /*other
 		// if we're switching to the foreground, do some extra work
 		if (activating)
 		{
+			// Discard the cached global media lookups.  The user might
+			// have added media folders while we were in the background,
+			// and the index can't monitor folders that didn't exist.
+			MediaFileIndex::ClearLookupCache();
+
 			// Launch a file scan thread, if one isn't already in progress.
 			// This looks for new game files that were added since we last 
 			// checked, so that we can dynamically incorporate newly 
@@ -1423,6 +1997,13 @@ void Application::BeginRunningGameMode(GameListItem *game, GameSystem *system)
 
 void Application::EndRunningGameMode()
 {
+	// restore our normal scheduling
+	RestoreFrontendScheduling();
+
+	// stop watching the game's focus events
+	if (gameMonitor != nullptr)
+		gameMonitor->RemoveFocusHook();
+
 	// End running game mode in the backglass, DMD, and topper windows
 	if (auto bgv = GetBackglassView(); bgv != nullptr)
 		bgv->EndRunningGameMode();
@@ -1446,6 +2027,151 @@ void Application::EndRunningGameMode()
 	EnumFrameWindows([](FrameWin *win) { win->RestorePreRunPlacement(); });
 }
 
+// Process power throttling (EcoQoS).  SetProcessInformation() and the
+// power throttling structures are only defined in the SDK headers for
+// Windows 8 and later targets, and the throttling class itself needs
+// Windows 10 1709, so we bind to it dynamically and define our own
+// copies of the structures.
+namespace
+{
+	struct PowerThrottlingState
+	{
+		ULONG Version;
+		ULONG ControlMask;
+		ULONG StateMask;
+	};
+	const int ProcessPowerThrottlingClass = 4;    // PROCESS_INFORMATION_CLASS::ProcessPowerThrottling
+	const ULONG PowerThrottlingVersion = 1;       // PROCESS_POWER_THROTTLING_CURRENT_VERSION
+	const ULONG PowerThrottlingExecSpeed = 0x1;   // PROCESS_POWER_THROTTLING_EXECUTION_SPEED
+
+	bool SetPowerThrottling(bool eco)
+	{
+		typedef BOOL (WINAPI *SetProcessInformation_t)(HANDLE, int, LPVOID, DWORD);
+		static auto setProcessInformation = reinterpret_cast<SetProcessInformation_t>(
+			GetProcAddress(GetModuleHandle(_T("kernel32.dll")), "SetProcessInformation"));
+		if (setProcessInformation == nullptr)
+			return false;
+
+		// Turning EcoQoS on sets the execution speed state explicitly;
+		// turning it off returns the decision to the system, which is
+		// the default state for a process.
+		PowerThrottlingState s = { PowerThrottlingVersion, eco ? PowerThrottlingExecSpeed : 0, eco ? PowerThrottlingExecSpeed : 0 };
+		return setProcessInformation(GetCurrentProcess(), ProcessPowerThrottlingClass, &s, sizeof(s)) != 0;
+	}
+}
+
+void Application::ApplyFrontendScheduling(DWORD_PTR affinityMask, bool ecoQoS)
+{
+	CriticalSectionLocker locker(frontendSchedLock);
+
+	// confine our threads to the reserved cores, remembering the original mask
+	if (affinityMask != 0 && savedAffinityMask == 0)
+	{
+		DWORD_PTR procMask, sysMask;
+		if (GetProcessAffinityMask(GetCurrentProcess(), &procMask, &sysMask)
+			&& SetProcessAffinityMask(GetCurrentProcess(), affinityMask))
+			savedAffinityMask = procMask;
+	}
+
+	// enter EcoQoS mode
+	if (ecoQoS && !ecoQoSApplied)
+		ecoQoSApplied = SetPowerThrottling(true);
+}
+
+void Application::RestoreFrontendScheduling()
+{
+	CriticalSectionLocker locker(frontendSchedLock);
+	if (savedAffinityMask != 0)
+	{
+		SetProcessAffinityMask(GetCurrentProcess(), savedAffinityMask);
+		savedAffinityMask = 0;
+	}
+	if (ecoQoSApplied)
+	{
+		SetPowerThrottling(false);
+		ecoQoSApplied = false;
+	}
+}
+
+void Application::YieldResourcesToGame()
+{
+	// evict all cached textures
+	TextureBudget::EvictAll();
+	Sprite::ReleaseSharedImages();
+
+	// trim the swap chains for the frozen windows
+	auto Trim = [](D3DView *view) {
+		if (view != nullptr)
+			view->TrimSwapChain();
+	};
+	Trim(GetPlayfieldView());
+	Trim(GetBackglassView());
+	Trim(GetDMDView());
+	Trim(GetTopperView());
+	Trim(GetInstCardView());
+	CustomView::ForEachCustomView([&Trim](CustomView *cv) { Trim(cv); return true; });
+
+	// release the driver's internal allocations
+	D3D::Get()->Trim();
+
+	// empty our working set, so that the game gets the physical memory
+	SetProcessWorkingSetSize(GetCurrentProcess(), static_cast<SIZE_T>(-1), static_cast<SIZE_T>(-1));
+
+	LogFile::Get()->Write(LogFile::TableLaunchLogging, _T("+ table launch: yielded UI resources to the running game\n"));
+}
+
+void Application::RecoverD3DDevice()
+{
+	// if the last attempt failed, give the driver a moment to settle
+	// before trying again
+	DWORD now = GetTickCount();
+	if (deviceRecoveryAttempts != 0 && now - lastDeviceRecoveryTime < deviceRecoveryRetryInterval)
+		return;
+	lastDeviceRecoveryTime = now;
+	++deviceRecoveryAttempts;
+
+	HiResTimer timer;
+	double t0 = timer.GetTime_seconds();
+
+	// Release everything that holds resources on the old device: the
+	// media in all of the windows, the cached textures, and the windows'
+	// swap chains and text overlays.  Sprites we don't reach this way
+	// discard their old textures the next time they're rendered.
+	ClearMedia();
+	TextureBudget::EvictAll();
+	Sprite::ReleaseSharedImages();
+	D3DView::ReleaseAllDeviceResources();
+
+	// create the new device, and rebuild the shaders and windows on it
+	auto Reinit = [](Shader *s) { return s == nullptr || s->Reinit(); };
+	bool ok = D3D::Get()->RecreateDevice()
+		&& Reinit(textureShader.get())
+		&& Reinit(dmdShader.get())
+		&& Reinit(i420Shader.get())
+		&& Reinit(i420AShader.get())
+		&& Reinit(i444A10Shader.get())
+		&& Reinit(nv12Shader.get())
+		&& D3DView::RestoreAllDeviceResources();
+
+	if (ok)
+	{
+		LogFile::Get()->Write(_T("D3D: device recovered in %.0f ms\n"), (timer.GetTime_seconds() - t0) * 1000.0);
+		deviceRecoveryAttempts = 0;
+	}
+	else if (deviceRecoveryAttempts >= maxDeviceRecoveryAttempts)
+	{
+		LogSysError(ErrorIconType::EIT_Error, LoadStringT(IDS_ERR_D3DINIT),
+			MsgFmt(_T("The graphics device was lost, and couldn't be restored after %d attempts"), deviceRecoveryAttempts));
+		PostQuitMessage(0);
+	}
+	else
+	{
+		// try again on a later idle pass
+		LogFile::Get()->Write(_T("D3D: device recovery attempt %d failed\n"), deviceRecoveryAttempts);
+		D3D::Get()->OnDeviceLost(DXGI_ERROR_DEVICE_REMOVED);
+	}
+}
+
 bool Application::Launch(int cmd, DWORD launchFlags,
 	GameListItem *game, GameSystem *system,
 	const std::list<LaunchCaptureItem> *captureList, int captureStartupDelay,
@@ -1464,6 +2190,9 @@ bool Application::Launch(GameMonitorThread *mon, ErrorHandler &eh)
 	// if there's already a game monitor thread, shut it down
 	if (gameMonitor != nullptr)
 	{
+		// remove its focus hook, if any, while we're still on the UI thread
+		gameMonitor->RemoveFocusHook();
+
 		// shut it down
 		gameMonitor->Shutdown(eh, 500, false);
 
@@ -1492,9 +2221,16 @@ bool Application::LaunchNextQueuedGame(ErrorHandler &eh)
 	queuedLaunches.pop_front();
 
 	// launch it
+	LaunchTimeline::Phase phase("start monitor thread");
 	return Launch(mon, eh);
 }
 
+void Application::NoteFrontendStaged()
+{
+	if (gameMonitor != nullptr)
+		SetEvent(gameMonitor->frontendStagedEvent);
+}
+
 void Application::QueueLaunch(int cmd, DWORD launchFlags,
 	GameListItem *game, GameSystem *system,
 	const std::list<LaunchCaptureItem> *captureList, int captureStartupDelay,
@@ -1758,17 +2494,34 @@ bool Application::IsMuteTableAudioNow() const
 	return mute;
 }
 
+CSTRING Application::GetFFmpegVersion() const
+{
+	return FFmpegProbe::GetVersion();
+}
+
 bool Application::UpdatePinscapeDeviceList()
 {
+	// make sure the startup scan is done
+	StartupTasks::Join("Pinscape device scan");
+
 	// update the device list
 	PinscapeDevice::FindDevices(pinscapeDevices);
 
+	// Refresh the Night Mode status in the background.  The status
+	// can change outside of our control, via the device's own Night
+	// Mode button, so the cached status might be out of date.
+	for (auto &d : pinscapeDevices)
+		d.QueryNightMode();
+
 	// indicate whether or not any devices were found
 	return pinscapeDevices.begin() != pinscapeDevices.end();
 }
 
 bool Application::GetPinscapeNightMode(bool &nightMode)
 {
+	// make sure the startup scan is done
+	StartupTasks::Join("Pinscape device scan");
+
 	// presume we're not in night mode
 	nightMode = false;
 
@@ -1791,6 +2544,7 @@ bool Application::GetPinscapeNightMode(bool &nightMode)
 void Application::SetPinscapeNightMode(bool nightMode)
 {
 	// set the new mode in all attached devices
+	StartupTasks::Join("Pinscape device scan");
 	for (auto &d : pinscapeDevices)
 		d.SetNightMode(nightMode);
 }
@@ -1857,6 +2611,7 @@ Application::GameMonitorThread::GameMonitorThread() :
 	startStopEvent = CreateEvent(0, TRUE, FALSE, 0);
 	shutdownEvent = CreateEvent(0, TRUE, FALSE, 0);
 	closeEvent = CreateEvent(0, TRUE, FALSE, 0);
+	frontendStagedEvent = CreateEvent(0, TRUE, FALSE, 0);
 
 	// keep references to the game views
 	playfieldView = Application::Get()->GetPlayfieldView();
@@ -1867,22 +2622,102 @@ Application::GameMonitorThread::GameMonitorThread() :
 	CustomView::ForEachCustomView([this](CustomView *cv) { customViews.emplace_back(cv, RefCounted::DoAddRef); return true; });
 }
 
-Application::GameMonitorThread::~GameMonitorThread()
+bool Application::GameMonitorThread::WaitForFrontendStaging()
 {
-}
+	// The UI sets the event right after starting the launch, so this
+	// should be brief, but don't wait forever in case the UI is stuck;
+	// the staging is only there to release the devices to the game, so
+	// it's better to proceed than to hang the launch.
+	LaunchTimeline::Phase phase("wait for frontend staging");
+	HANDLE waitHandles[] = { frontendStagedEvent, shutdownEvent, closeEvent };
+	switch (WaitForMultipleObjects(countof(waitHandles), waitHandles, FALSE, 30000))
+	{
+	case WAIT_OBJECT_0:
+		return true;
 
-bool Application::GameMonitorThread::IsThreadRunning()
-{
-	return hThread != NULL && WaitForSingleObject(hThread, 0) == WAIT_TIMEOUT;
-}
+	case WAIT_TIMEOUT:
+		LogFile::Get()->Write(LogFile::TableLaunchLogging,
+			_T("+ table launch: timed out waiting for the UI to release DOF and the real DMD; continuing\n"));
+		return true;
 
-bool Application::GameMonitorThread::IsGameProcessRunning() const
-{
-	bool retval = hGameProc != NULL && WaitForSingleObject(hGameProc, 0) == WAIT_TIMEOUT;
-	return retval;
+	default:
+		LogFile::Get()->Write(LogFile::TableLaunchLogging,
+			_T("+ table launch: interrupted waiting for the UI pre-launch staging; aborting launch\n"));
+		return false;
+	}
 }
 
-void Application::GameMonitorThread::CloseGame()
+void Application::GameMonitorThread::ApplySchedulingPolicy()
+{
+	// if there's no policy, there's nothing to do
+	if (gamePriorityClass == 0 && frontendCores <= 0 && !ecoQoS)
+		return;
+
+	// Open the game process for the updates.  The monitor handle might
+	// not have the access rights we need, since some of the launch paths
+	// open the process with only enough rights to wait for it.  This
+	// fails for a game running elevated in Admin mode, which is out of
+	// our reach from a regular process, so in that case we can only
+	// apply the parts of the policy that affect our own process.
+	HandleHolder hProc = OpenProcess(PROCESS_SET_INFORMATION | PROCESS_QUERY_LIMITED_INFORMATION,
+		FALSE, GetProcessId(hGameProc));
+	auto LogError = [](const TCHAR *what)
+	{
+		WindowsErrorMessage winerr;
+		LogFile::Get()->Write(LogFile::TableLaunchLogging,
+			_T("+ table launch: unable to set the game's %s: %s\n"), what, winerr.Get());
+	};
+
+	// set the game's priority class
+	if (gamePriorityClass != 0 && (hProc == NULL || !SetPriorityClass(hProc, gamePriorityClass)))
+		LogError(_T("priority class"));
+
+	// Divide the cores.  We take the highest-numbered cores in our
+	// current mask for ourselves, and give the game the rest.
+	DWORD_PTR frontendMask = 0;
+	DWORD_PTR procMask, sysMask;
+	if (frontendCores > 0 && GetProcessAffinityMask(GetCurrentProcess(), &procMask, &sysMask))
+	{
+		DWORD_PTR gameMask = procMask;
+		for (int n = 0; n < frontendCores && gameMask != 0; ++n)
+		{
+			DWORD_PTR bit = static_cast<DWORD_PTR>(1) << (sizeof(DWORD_PTR) * 8 - 1);
+			for (; bit != 0 && (gameMask & bit) == 0; bit >>= 1);
+			frontendMask |= bit;
+			gameMask &= ~bit;
+		}
+
+		if (gameMask == 0)
+		{
+			// there aren't enough cores to leave any for the game
+			LogFile::Get()->Write(LogFile::TableLaunchLogging,
+				_T("+ table launch: GameScheduling.FrontendCores (%d) leaves no cores for the game; ignored\n"), frontendCores);
+			frontendMask = 0;
+		}
+		else if (hProc == NULL || !SetProcessAffinityMask(hProc, gameMask))
+			LogError(_T("core affinity"));
+	}
+
+	// apply our side of the policy
+	Application::ApplyFrontendScheduling(frontendMask, ecoQoS);
+}
+
+Application::GameMonitorThread::~GameMonitorThread()
+{
+}
+
+bool Application::GameMonitorThread::IsThreadRunning()
+{
+	return hThread != NULL && WaitForSingleObject(hThread, 0) == WAIT_TIMEOUT;
+}
+
+bool Application::GameMonitorThread::IsGameProcessRunning() const
+{
+	bool retval = hGameProc != NULL && WaitForSingleObject(hGameProc, 0) == WAIT_TIMEOUT;
+	return retval;
+}
+
+void Application::GameMonitorThread::CloseGame()
 {
 	// if the game is running, close its windows
 	if (IsGameProcessRunning())
@@ -2034,6 +2869,9 @@ void Application::GameMonitorThread::CloseGame()
 
 void Application::GameMonitorThread::BringToForeground()
 {
+	// we're giving focus back to the game, so stop holding it
+	RemoveFocusHook();
+
 	if (IsGameProcessRunning())
 	{
 		// find the other app's windows
@@ -2088,6 +2926,13 @@ void Application::GameMonitorThread::BringToForeground()
 		for (auto hwnd : ctx.hwnd)
 			BringWindowToTop(hwnd);
 
+		// If the game has no visible window yet, and we don't have a
+		// window to restore from the pause, the game is presumably still
+		// starting up.  Watch for its window to appear, and bring it to
+		// the front then.
+		if (ctx.hwnd.size() == 0 && stolenFocusWindow == NULL)
+			InstallFocusHook(FocusHookMode::ShowGame, EVENT_OBJECT_SHOW, 10000);
+
 		// If we noted the foreground window on pause, restore it as
 		// the foreground window.  Do this last to ensure that focus
 		// ends up here.
@@ -2157,6 +3002,30 @@ void Application::GameMonitorThread::Prepare(
 	this->hideTaskbar = cfg->GetBool(ConfigVars::HideTaskbarDuringGame, true);
 	this->gameInactivityTimeout.Format(_T("%ld"), cfg->GetInt(ConfigVars::GameTimeout, 0) * 1000);
 
+	// get the scheduling policy
+	static const struct { const TCHAR *name; DWORD cls; } priorityClasses[] = {
+		{ _T("Idle"), IDLE_PRIORITY_CLASS },
+		{ _T("BelowNormal"), BELOW_NORMAL_PRIORITY_CLASS },
+		{ _T("Normal"), NORMAL_PRIORITY_CLASS },
+		{ _T("AboveNormal"), ABOVE_NORMAL_PRIORITY_CLASS },
+		{ _T("High"), HIGH_PRIORITY_CLASS },
+	};
+	this->gamePriorityClass = 0;
+	const TCHAR *gamePriority = cfg->Get(ConfigVars::GameSchedPriority, _T(""));
+	for (auto &p : priorityClasses)
+	{
+		if (_tcsicmp(gamePriority, p.name) == 0)
+			this->gamePriorityClass = p.cls;
+	}
+	this->frontendCores = cfg->GetInt(ConfigVars::GameSchedFrontendCores, 0);
+	this->ecoQoS = cfg->GetBool(ConfigVars::GameSchedEcoQoS, false);
+
+	// Get the launch overlap policy.  If it's off, the UI does its staging
+	// before starting the launch, so there's nothing to wait for.
+	this->launchOverlap = cfg->GetBool(ConfigVars::GameLaunchOverlap, true);
+	if (!this->launchOverlap)
+		SetEvent(frontendStagedEvent);
+
 	// log the launch start
 	LogFile::Get()->Group(LogFile::TableLaunchLogging);
 	LogFile::Get()->Write(LogFile::TableLaunchLogging,
@@ -2185,10 +3054,22 @@ void Application::GameMonitorThread::Prepare(
 		// remember the two-pass encoding option
 		capture.twoPassEncoding = cfg->GetBool(ConfigVars::CaptureTwoPassEncoding, false);
 
-		// remember the video codec for pass 1 of a two-pass recording
+		// If this is part of a batch with deferred encoding, we'll hand
+		// off the second passes to the batch's encode queue.  This only
+		// applies in two-pass mode, since there's no separate encoding
+		// pass to defer otherwise.
+		if (capture.twoPassEncoding && batchCaptureInfo.encodeQueue != nullptr)
+			encodeQueue = batchCaptureInfo.encodeQueue;
+
+		// remember the single-pass (all windows at once) option
+		capture.singlePass = cfg->GetBool(ConfigVars::CaptureSinglePass, false);
+
+		// remember the screen capture source
+		capture.desktopDuplication = _tcsicmp(cfg->Get(ConfigVars::CaptureSource, _T("gdigrab")), _T("dxgi")) == 0;
+
+		// remember the video codec for pass 1 of a two-pass recording; if
+		// this isn't set, we'll use the selected video encoder's options
 		capture.vcodecPass1 = cfg->Get(ConfigVars::CaptureVidoCodecPass1, _T(""));
-		if (capture.vcodecPass1.length() == 0)
-			capture.vcodecPass1 = _T("-c:v libx264 -threads 8 -qp 0 -preset ultrafast");
 
 		// remember the temp folder
 		capture.tempFolder = cfg->Get(ConfigVars::CaptureTempFolder, _T(""));
@@ -2200,6 +3081,9 @@ void Application::GameMonitorThread::Prepare(
 
 		// build our local list of capture items
 		bool audioNeeded = false;
+		DWORD singlePassTime = 0;
+		DWORD singlePassOverhead = 0;
+		int nSinglePass = 0;
 		for (auto &cap : *captureList)
 		{
 			// create a capture item in our local list
@@ -2220,13 +3104,43 @@ void Application::GameMonitorThread::Prepare(
 			if (auto cfgvar = item.mediaType.captureStopConfigVar; cfgvar != nullptr)
 				item.manualStop = _tcsicmp(cfg->Get(cfgvar, _T("auto")), _T("manual")) == 0;
 
+			// Get the video encoder and quality settings.  The per-type
+			// settings (Capture.<type>.Encoder and Capture.<type>.Quality)
+			// override the global settings.
+			if (item.mediaType.IsVideo())
+			{
+				const TCHAR *encoder = cfg->Get(MsgFmt(_T("Capture.%s.Encoder"), item.mediaType.configId), nullptr);
+				item.encoderId = encoder != nullptr ? encoder : cfg->Get(ConfigVars::CaptureVideoEncoder, _T("auto"));
+				item.quality = cfg->GetInt(MsgFmt(_T("Capture.%s.Quality"), item.mediaType.configId),
+					cfg->GetInt(ConfigVars::CaptureVideoQuality, -1));
+			}
+
+			// In single-pass mode, automatically timed videos are captured
+			// together, so they add the longest of their times to the total
+			// rather than the sum.  Note the item's group membership.
+			if (capture.singlePass && item.mediaType.IsVideo() && !item.manualStart && !item.manualStop)
+			{
+				item.batched = true;
+				singlePassTime = max(singlePassTime, item.captureTime);
+				nSinglePass += 1;
+			}
+
 			// Add it to the total time, plus a couple of seconds of overhead 
 			// for launching ffmpeg.  Note that there's no way to guess how long
 			// the capture will actually run if we're in manual stop mode, so
 			// we can only make a wild guess, but we'll still use the configured
 			// fixed capture time (as our wild guess, in this case), since that
-			// should at least be on the right order of magnitude.
-			capture.totalTime += item.captureTime + 2000;
+			// should at least be on the right order of magnitude.  Use the
+			// measured overhead from past captures instead of the fixed
+			// couple of seconds if we have it.
+			auto stats = Application::Get()->captureTimeStats.get();
+			const TCHAR *sys = gameSys.displayName.c_str();
+			DWORD overhead = static_cast<DWORD>(max(0.0f,
+				stats->GetAverage(sys, item.mediaType.configId, CaptureTimeStats::Phase::Capture, 2.0f)) * 1000.0f);
+			if (!item.batched)
+				capture.totalTime += item.captureTime + overhead;
+			else
+				singlePassOverhead = max(singlePassOverhead, overhead);
 
 			// If we're doing two-pass encoding, add an estimate of the second
 			// pass encoding time.  This option is normally used only on a machine
@@ -2240,11 +3154,17 @@ void Application::GameMonitorThread::Prepare(
 			// assume that a factor of two (times the video running time) is a 
 			// decent upper bound.  And of course we've already established that 
 			// a factor of one is a good lower bound if we're using this mode.
-			// So let's just split the difference and call it 1.5x.
-			if (capture.twoPassEncoding
+			// So let's just split the difference and call it 1.5x, unless we
+			// have measured encoding times from past captures.  If we're
+			// deferring the second pass to the background, it stays off
+			// this game's clock.
+			if (capture.twoPassEncoding && encodeQueue == nullptr
 				&& (item.mediaType.format == MediaType::Format::SilentVideo
 					|| item.mediaType.format == MediaType::Format::VideoWithAudio))
-				capture.totalTime += item.captureTime * 3 / 2;
+			{
+				capture.totalTime += static_cast<DWORD>(item.captureTime
+					* stats->GetAverage(sys, item.mediaType.configId, CaptureTimeStats::Phase::Encode, 1.5f));
+			}
 
 			// get the source window's rotation
 			item.windowRotation = cap.win->GetRotation();
@@ -2268,6 +3188,16 @@ void Application::GameMonitorThread::Prepare(
 				audioNeeded = true;
 		}
 
+		// Add the single-pass group time.  A group of one gains nothing
+		// from the group capture, so just capture it as a normal item.
+		if (nSinglePass != 0)
+			capture.totalTime += singlePassTime + singlePassOverhead;
+		if (nSinglePass == 1)
+		{
+			for (auto &item : capture.items)
+				item.batched = false;
+		}
+
 		// If audio is required, figure the audio device
 		if (audioNeeded)
 		{
@@ -2360,6 +3290,7 @@ bool Application::GameMonitorThread::Launch(ErrorHandler &eh)
 		{
 			gl->SetLastPlayedNow(pgame);
 			gl->SetPlayCount(pgame, gl->GetPlayCount(pgame) + 1);
+			gl->CommitStatsJournal();
 		}
 	}
 
@@ -2752,7 +3683,8 @@ DWORD Application::GameMonitorThread::Main()
 			for (auto const &s : rotate)
 			{
 				std::match_results<TSTRING::const_iterator> m;
-				if (std::regex_match(s, m, std::basic_regex<TCHAR>(_T("(\\w+),(90|180|270)"))))
+				static const std::basic_regex<TCHAR> windowRotatePat(_T("(\\w+),(90|180|270)"));
+				if (std::regex_match(s, m, windowRotatePat))
 				{
 					TSTRING windowName = m[1].str();
 					int theta = _ttoi(m[2].str().c_str());
@@ -3013,8 +3945,18 @@ DWORD Application::GameMonitorThread::Main()
 	RunBeforeAfterParser runBeforePreCmd(this, rotationManager,
 		_T("RunBeforePre (initial pre-launch command)"), IDS_ERR_GAMERUNBEFOREPRE, 
 		GetLaunchParam("runBeforePre", gameSys.runBeforePre), false);
+	LaunchTimeline::Phase runBeforePrePhase("RunBeforePre command");
 	if (!runBeforePreCmd.Run())
 		return 0;
+	runBeforePrePhase.End();
+
+	// Make sure the UI is done releasing DOF and the real DMD before we
+	// go on.  Under the overlap policy, the UI does this concurrently
+	// with the RunBeforePre command.  This must come before the RunBefore
+	// message, since the UI's DOF shutdown can make COM calls that would
+	// dispatch our SendMessage in the middle of the shutdown.
+	if (!WaitForFrontendStaging())
+		return 0;
 
 	// Display the "Launching Game" message in the main window, and run
 	// Javascript scripts.  Stop if the Javascript handlers cancel the launch.
@@ -3035,8 +3977,20 @@ DWORD Application::GameMonitorThread::Main()
 	RunBeforeAfterParser runBeforeCmd(this, rotationManager,
 		_T("RunBefore (pre-launch command)"), IDS_ERR_GAMERUNBEFORE,
 		GetLaunchParam("runBefore", gameSys.runBefore), false);
+	LaunchTimeline::Phase runBeforePhase("RunBefore command");
 	if (!runBeforeCmd.Run())
 		return 0;
+	runBeforePhase.End();
+
+	// Under the overlap policy, the UI only queued its file saves before
+	// starting the launch, so wait for the writes to finish now.  The
+	// files should be safely on disk before the game starts, in case the
+	// game crashes the system.
+	if (launchOverlap)
+	{
+		LaunchTimeline::Phase phase("wait for file writes");
+		BackgroundFileWriter::Flush();
+	}
 
 	// Do another check for adding a default extension to the game file.
 	// We already did this once, before the Run Before commands, because
@@ -3059,6 +4013,11 @@ DWORD Application::GameMonitorThread::Main()
 	// we get the more accurate starting time.
 	launchTime = GetTickCount64();
 
+	// remember when the launch started, for the capture timing statistics
+	// and the performance trace
+	ULONGLONG launchStartTime = launchTime;
+	int64_t traceLaunchStart = Trace::Now();
+
 	// Get the current system time in FILETIME format, in case we need
 	// it to look for a recently launched process in the two-stage launch
 	// used by Steam (see below).
@@ -3089,8 +4048,10 @@ DWORD Application::GameMonitorThread::Main()
 	startupInfo.dwFlags = STARTF_USESHOWWINDOW;
 	startupInfo.wShowWindow = GetLaunchParamInt("swShow", gameSys.swShow);
 
-	// process creation flags
-	DWORD createFlags = 0;
+	// Process creation flags.  Create the process suspended, so that
+	// we can add it to the game job before it has a chance to launch
+	// any child processes of its own.
+	DWORD createFlags = CREATE_SUSPENDED;
 
 	// If the system has environment variables to add, build a merged
 	// environment.
@@ -3108,6 +4069,7 @@ DWORD Application::GameMonitorThread::Main()
 	}
 
 	// Try launching the new process.
+	LaunchTimeline::Phase createProcessPhase("create process");
 	const TSTRING &workingPath = GetLaunchParam("workingPath", gameSys.workingPath);
 	PROCESS_INFORMATION procInfo;
 	ZeroMemory(&procInfo, sizeof(procInfo));
@@ -3291,6 +4253,17 @@ DWORD Application::GameMonitorThread::Main()
 		}
 	}
 
+	// If we launched the process ourselves, it's still suspended.  Add
+	// it to the game job, then let it run.  (We don't have a thread
+	// handle for an Admin Host launch, but the Admin Host doesn't start
+	// its processes suspended, and we couldn't add an elevated process
+	// to our job anyway.)
+	if (procInfo.hThread != NULL)
+	{
+		CreateGameJob(procInfo.hProcess);
+		ResumeThread(procInfo.hThread);
+	}
+
 	// We don't need the thread handle - close it immediately
 	if (procInfo.hThread != NULL)
 		CloseHandle(procInfo.hThread);
@@ -3301,8 +4274,11 @@ DWORD Application::GameMonitorThread::Main()
 
 	// remember the first-stage process handle
 	HANDLE hProcFirstStage = procInfo.hProcess;
+	createProcessPhase.End();
+	ULONGLONG processStartTime = GetTickCount64();
 
 	// wait for the process to start up
+	LaunchTimeline::Phase startupPhase("process startup");
 	WaitForStartup(exe.c_str(), hProcFirstStage);
 
 	// Some games, such as Steam-based systems or Future Pinball + BAM,
@@ -3397,16 +4373,22 @@ DWORD Application::GameMonitorThread::Main()
 							// new process to open its main window.  So retry until we 
 							// find the window we're looking for, encounter an error, or
 							// receive an Application Shutdown or Close Game signal.
+							// Watch for window events in the new process so that we
+							// only have to recheck when it actually opens a window.
+							WindowEventWaiter winEvents(procInfo.th32ProcessID);
 							while (FindMainWindowForProcess(procInfo.th32ProcessID, &tidMainGameThread) == NULL)
 							{
-								// Pause for a bit, exiting the thread if we get a Shutdown
-								// signal.  Don't stop on a Close event, though:  that would
-								// leave the second-stage process running.  The two-stage
-								// launch programs generally don't have any UI in the first
-								// stage, so it's best to treat the whole launch as an atomic
-								// operation for the purposes of the Close signal.
+								// Pause until a window event or timeout, exiting the thread
+								// if we get a Shutdown signal.  Don't stop on a Close event,
+								// though:  that would leave the second-stage process running.
+								// The two-stage launch programs generally don't have any UI
+								// in the first stage, so it's best to treat the whole launch
+								// as an atomic operation for the purposes of the Close signal.
+								// If the event hook is working, the timeout only serves as a
+								// backstop; otherwise it's our polling interval.
 								HANDLE waitHandles[] = { shutdownEvent };
-								if (WaitForMultipleObjects(countof(waitHandles), waitHandles, FALSE, 500) != WAIT_TIMEOUT)
+								DWORD waitResult = winEvents.Wait(waitHandles, countof(waitHandles), winEvents.IsHooked() ? 5000 : 500);
+								if (waitResult == WAIT_OBJECT_0 || waitResult == WAIT_FAILED)
 								{
 									LogFile::Get()->Write(LogFile::TableLaunchLogging,
 										_T("+ table launch: interrupted waiting for first child process window to open; aborting launch\n"));
@@ -3464,8 +4446,17 @@ DWORD Application::GameMonitorThread::Main()
 			// here would leave the actual game process running indefinitely,
 			// since we haven't identified the process yet and thus can't
 			// explicitly shut it down yet.
+			//
+			// If the launcher is in a job, wait on the job notifications
+			// instead, so that we can rescan as soon as the launcher starts
+			// a new process.  We still need the timeout, since the target
+			// process isn't necessarily in the launcher's process tree:
+			// Steam, for example, has the already-running Steam client
+			// launch the game on the launcher's behalf.
+			if (hJob != NULL)
+				WaitForJobNewProcess(1000);
 			HANDLE waitHandles[] = { shutdownEvent };
-			if (WaitForMultipleObjects(countof(waitHandles), waitHandles, FALSE, 1000) != WAIT_TIMEOUT)
+			if (WaitForMultipleObjects(countof(waitHandles), waitHandles, FALSE, hJob != NULL ? 0 : 1000) != WAIT_TIMEOUT)
 			{
 				// shutting down the app; abort immediately
 				LogFile::Get()->Write(LogFile::TableLaunchLogging,
@@ -3475,16 +4466,29 @@ DWORD Application::GameMonitorThread::Main()
 		}
 	}
 
+	startupPhase.End();
+
 	// The process has started.  Now give it a few seconds to display a
-	// visible and non-minimized window.
+	// visible and non-minimized window.  Rather than polling the window
+	// list, watch for window events in the process, and recheck when one
+	// occurs.  The event hook doesn't cover restoring a minimized window,
+	// so recheck periodically as well, but at a much lower rate than we
+	// need to when polling without the hook.
+	LaunchTimeline::Phase windowPhase("game window");
 	HWND hwndGame = NULL;
+	WindowEventWaiter winEvents(pid);
+	DWORD pollInterval = 50;
 	for (UINT64 waitEnd = GetTickCount64() + 5000; GetTickCount64() < waitEnd; )
 	{
 		// pause briefly
 		HANDLE waitHandles[] = { shutdownEvent, closeEvent };
-		switch (WaitForMultipleObjects(countof(waitHandles), waitHandles, FALSE, 50))
+		UINT64 now = GetTickCount64();
+		DWORD remaining = now < waitEnd ? static_cast<DWORD>(waitEnd - now) : 0;
+		switch (winEvents.Wait(waitHandles, countof(waitHandles), min(remaining, pollInterval)))
 		{
 		case WAIT_TIMEOUT:
+		case WAIT_OBJECT_0 + countof(waitHandles):
+			// timeout or window event - check for a window
 			break;
 
 		case WAIT_OBJECT_0:
@@ -3505,6 +4509,11 @@ DWORD Application::GameMonitorThread::Main()
 			return 0;
 		}
 
+		// after the first check, we only need the periodic backstop if
+		// the event hook is working
+		if (winEvents.IsHooked())
+			pollInterval = 1000;
+
 		// check for an open window
 		struct enumctx
 		{
@@ -3548,10 +4557,21 @@ DWORD Application::GameMonitorThread::Main()
 	}
 
 	// Successful launch!
-	LogFile::Get()->Write(LogFile::TableLaunchLogging, _T("+ table launch: process launch succeeded\n"));
+	windowPhase.End();
+	LogFile::Get()->Write(LogFile::TableLaunchLogging,
+		_T("+ table launch: process launch succeeded; the game window appeared %I64u ms after the process started\n"),
+		GetTickCount64() - processStartTime);
 
 	// Count this as the starting time for the actual game session
 	launchTime = GetTickCount64();
+	Trace::Interval("Game launch", "launch", traceLaunchStart, Trace::Now(), game.title.c_str());
+
+	// if we're capturing, record the launch time for the capture time estimates
+	if ((launchFlags & LaunchFlags::Capturing) != 0)
+	{
+		Application::Get()->captureTimeStats->AddSample(gameSys.displayName.c_str(), _T(""),
+			CaptureTimeStats::Phase::Launch, static_cast<float>(launchTime - launchStartTime) / 1000.0f);
+	}
 
 	// switch the playfield view to Running mode (unless we've received a Close command already)
 	if (playfieldView != nullptr && !closeCommandIssued)
@@ -3747,8 +4767,8 @@ DWORD Application::GameMonitorThread::Main()
 		while (*p != 0 && !closeCommandIssued)
 		{
 			// find the next token - stop if there are no more tokens
-			std::basic_regex<TCHAR> tokPat(_T("(^\\s*([^\\s\\[\\]]+|\\[[^\\]]+\\]|\\{[^}]+\\})\\s*).*"));
-			std::basic_regex<TCHAR> clickPat(_T("\\[r?click\\b\\s*(.*)\\]"), std::regex_constants::icase);
+			static const std::basic_regex<TCHAR> tokPat(_T("(^\\s*([^\\s\\[\\]]+|\\[[^\\]]+\\]|\\{[^}]+\\})\\s*).*"));
+			static const std::basic_regex<TCHAR> clickPat(_T("\\[r?click\\b\\s*(.*)\\]"), std::regex_constants::icase);
 			std::match_results<const TCHAR*> m;
 			std::match_results<TSTRING::const_iterator> ms;
 			if (!std::regex_match(p, m, tokPat))
@@ -3835,7 +4855,7 @@ DWORD Application::GameMonitorThread::Main()
 				// given by the gridPos database entry for this game.  First,
 				// we need to pull out the <down> and <right> key names from 
 				// the [gridpos <down> <right>] syntax.
-				std::basic_regex<TCHAR> gpPat(_T("\\s*(\\S+)\\s+([^\\s\\]]+).*"));
+				static const std::basic_regex<TCHAR> gpPat(_T("\\s*(\\S+)\\s+([^\\s\\]]+).*"));
 				std::match_results<const TCHAR*> gm;
 				if (std::regex_match(tok.c_str() + 9, gm, gpPat))
 				{
@@ -3904,6 +4924,9 @@ DWORD Application::GameMonitorThread::Main()
 	}
 	prioritySetter;
 
+	// apply the configured scheduling policy for the game and for us
+	ApplySchedulingPolicy();
+
 	// If we're capturing screenshots of the running game, start
 	// the capture process
 	if ((launchFlags & LaunchFlags::Capturing) != 0)
@@ -3928,6 +4951,31 @@ DWORD Application::GameMonitorThread::Main()
 		int nMediaItemsAttempted = 0;
 		int nMediaItemsOk = 0;
 
+		// Get the path to ffmpeg.exe.  Note that this is always called 
+		// ffmpeg\\ffmpeg.exe in a deployed system, but the development
+		// build system has separate 32-bit and 64-bit copies.
+		TCHAR ffmpeg[MAX_PATH];
+		FFmpegProbe::GetFFmpegPath(ffmpeg);
+
+		// Select the video encoder for each video item.  This might have
+		// to run ffmpeg to test for hardware encoder support, which takes
+		// a moment on the first capture of the session, so do it while
+		// the game is starting up, and count the time against the startup
+		// delay.
+		ULONGLONG encoderStartTime = GetTickCount64();
+		for (auto &item : capture.items)
+		{
+			if (item.mediaType.IsVideo())
+			{
+				auto encoder = CaptureEncoder::Select(ffmpeg, item.encoderId.c_str());
+				item.vcodecOpts = CaptureEncoder::GetOptions(encoder, item.quality);
+				item.vcodecPass1 = capture.vcodecPass1.length() != 0 ? capture.vcodecPass1 : encoder->pass1Opts;
+				LogFile::Get()->Write(LogFile::CaptureLogging, _T("+ %s: using video encoder %s\n"),
+					item.mediaType.nameStr.c_str(), encoder->ffmpegName);
+			}
+		}
+		DWORD encoderSelectTime = static_cast<DWORD>(GetTickCount64() - encoderStartTime);
+
 		// do the initial startup wait, to allow the game to boot up
 		{
 			// set up the wait handles for each step requiring a wait
@@ -3939,7 +4987,8 @@ DWORD Application::GameMonitorThread::Main()
 			// Wait for the initial startup time.  If any events fire
 			// (that is, we don't time out), something happened that
 			// interrupted the capture, so stop immediately.
-			if (WaitForMultipleObjects(countof(h), h, FALSE, capture.startupDelay) != WAIT_TIMEOUT)
+			DWORD startupWait = capture.startupDelay - min(capture.startupDelay, encoderSelectTime);
+			if (WaitForMultipleObjects(countof(h), h, FALSE, startupWait) != WAIT_TIMEOUT)
 			{
 				overallStatusMsgId = IDS_ERR_CAP_GAME_EXITED;
 				captureOkay = false;
@@ -3947,157 +4996,15 @@ DWORD Application::GameMonitorThread::Main()
 			}
 		}
 
-		// Get the path to ffmpeg.exe.  Note that this is always called 
-		// ffmpeg\\ffmpeg.exe in a deployed system, but the development
-		// build system has separate 32-bit and 64-bit copies.
-		TCHAR ffmpeg[MAX_PATH];
-		GetDeployedFilePath(ffmpeg, _T("ffmpeg\\ffmpeg.exe"), _T("$(SolutionDir)ffmpeg$(64)\\ffmpeg.exe"));
-
-		// Capture one item.  Returns true to continue capturing
-		// additional items, false to end the capture process.
-		// A true return doesn't necessarily mean that the 
-		// individual capture succeeded; it just means that we
-		// didn't run into a condition that ends the whole
-		// process, such as the game exiting prematurely.
-		for (auto &item: capture.items)
+		// Prepare the output file for an item: save any existing file of the
+		// item's type under a backup name, and make sure the media folder
+		// exists.  Returns true if the file is ready, false if the item has
+		// to be skipped, in which case the reason goes on the status list.
+		auto PrepareOutputFile = [&statusList, &captureOkay](CaptureItem &item) -> bool
 		{
-			// count the item attempted
-			nMediaItemsAttempted += 1;
-
 			// get the descriptor for the item, for status messages
 			const TSTRING &itemDesc = item.mediaType.nameStr;
 
-			// If the game has already exited, or a shutdown or close event
-			// is already pending, abort this capture before it starts
-			{
-				HANDLE h[] = { hGameProc, shutdownEvent, closeEvent };
-				if (WaitForMultipleObjects(countof(h), h, FALSE, 0) != WAIT_TIMEOUT)
-				{
-					abortCapture = true;
-					captureOkay = false;
-				}
-			}
-
-			// if we've already decided to abort, just add a status message
-			// for this item saying so
-			if (abortCapture)
-			{
-				statusList.Error(MsgFmt(_T("%s: %s"), itemDesc.c_str(), LoadStringT(IDS_ERR_CAP_ITEM_NOT_STARTED).c_str()));
-				break;
-			}
-
-			// If we're capturing audio for this item, and we haven't found
-			// the audio capture device yet, find it now.  We use FFMPEG's
-			// DirectShow (dshow) audio capture capability, so we have to 
-			// find the device using the dshow API to make sure we see the
-			// same device name that FFMPEG will see when it scans for a
-			// device.  Note that Windows has multiple media APIs that can
-			// access the same audio devices, but it's important to use the
-			// same API that FFMPEG uses, since the different APIs can use
-			// different names for the same devices.  For example, dshow 
-			// truncates long device names in different ways on different
-			// Windows versions.
-			bool hasAudio =	(item.mediaType.format == MediaType::VideoWithAudio && item.enableAudio)
-				|| item.mediaType.format == MediaType::Audio;
-			if (hasAudio && audioCaptureDevice.length() == 0)
-			{
-				// Audio capture is needed, but audio isn't available.  Note
-				// that the item didn't complete successfully.
-				captureOkay = false;
-
-				// If this is video with audio, disable audio for the item and
-				// continue with the capture; we can at least still capture a
-				// silent video for it.  If it's pure audio, there's no point,
-				// so just skip the item.
-				if (item.mediaType.format == MediaType::VideoWithAudio)
-				{
-					// disable the audio, proceed with the capture (but log an
-					// error to alert the user to the reason the video doesn't
-					// have the audio they requested)
-					statusList.Error(MsgFmt(_T("%s: %s"), itemDesc.c_str(), LoadStringT(IDS_ERR_CAP_NO_AUDIO_DEV_VIDEO).c_str()));
-					item.enableAudio = false;
-				}
-				else
-				{
-					// pure audio - skip the item entirely
-					statusList.Error(MsgFmt(_T("%s: %s"), itemDesc.c_str(), LoadStringT(IDS_ERR_CAP_NO_AUDIO_DEV).c_str()));
-					continue;
-				}
-			}
-
-			// If this item is in Manual Start mode, wait for the start signal
-			if (item.manualStart)
-			{
-				// Move the status window over the playfield window, even if we're
-				// going to capture the playfield.  We're not actually capturing
-				// anything while waiting for the Go signal, so it doesn't matter
-				// if we put the status window in front of the window we're about
-				// to capture, hence we can put it anywhere.  The window is more
-				// than just status in this case - it's showing a prompt - so we
-				// want it to be as conspicuous as possible.  The playfield window
-				// is the best place to make the user notice it.
-				capture.statusWin->PositionOver(Application::Get()->GetPlayfieldWin());
-
-				// put the status window in waiting mode
-				capture.statusWin->SetCaptureStatus(MsgFmt(IDS_CAPSTAT_MANUAL_START, itemDesc.c_str()), item.captureTime);
-				capture.statusWin->SetManualStartMode(true);
-
-				// clear any previous manual start/stop signal
-				ResetEvent(startStopEvent);
-
-				// Wait for the start/stop event
-				HANDLE h[] = { startStopEvent, hGameProc, shutdownEvent, closeEvent };
-				static const TCHAR *hDesc[] = { 
-					_T("Started"), _T("game exited"), _T("PinballY shutting down"), _T("user pressed Exit Game button") 
-				};
-				switch (DWORD result = WaitForMultipleObjects(countof(h), h, FALSE, INFINITE))
-				{
-				case WAIT_OBJECT_0:
-					// The user pressed the Go button combo.  Ready to proceed
-					break;
-
-				case WAIT_OBJECT_0 + 1:
-				case WAIT_OBJECT_0 + 2:
-				case WAIT_OBJECT_0 + 3:
-					// The game process exited, or the user canceled, or the program is exiting
-					captureOkay = false;
-					abortCapture = true;
-					LogFile::Get()->Write(LogFile::CaptureLogging, 
-						MsgFmt(_T("+ Capture aborted: %s while waiting for manual start\n"), hDesc[result - WAIT_OBJECT_0]));
-					statusList.Error(MsgFmt(_T("%s: %s"), itemDesc.c_str(), LoadStringT(IDS_ERR_CAP_ITEM_INTERRUPTED).c_str()));
-					break;
-					
-				default:
-					// error waiting
-					captureOkay = false;
-					abortCapture = true;
-					{
-						WindowsErrorMessage err;
-						LogFile::Get()->Write(LogFile::CaptureLogging,
-							MsgFmt(_T("+ Capture aborted: error waiting: %s\n"), err.Get()));
-					}
-					statusList.Error(MsgFmt(_T("%s: %s"), itemDesc.c_str(), LoadStringT(IDS_ERR_CAP_ITEM_INTERRUPTED)));
-					break;
-				}
-			}
-
-			// stop if the capture was aborted
-			if (abortCapture)
-				break;
-
-			// ready to go - set the status window message
-			curStatus.Format(LoadStringT(IDS_CAPSTAT_ITEM), itemDesc.c_str());
-			capture.statusWin->SetCaptureStatus(curStatus, item.captureTime);
-			capture.statusWin->SetManualStartMode(false);
-
-			// Move the status window over the playfield window when capturing
-			// in any other window, and move it over the backglass window when
-			// capturing the playfield.
-			if (item.mediaType.javascriptId == L"table image" || item.mediaType.javascriptId == L"table video")
-				capture.statusWin->PositionOver(Application::Get()->GetBackglassWin());
-			else
-				capture.statusWin->PositionOver(Application::Get()->GetPlayfieldWin());
-
 			// save (by renaming) any existing files of the type we're about to capture
 			TSTRING oldName;
 			if (FileExists(item.filename.c_str())
@@ -4105,7 +5012,7 @@ DWORD Application::GameMonitorThread::Main()
 			{
 				// backup rename failed - skip this file
 				captureOkay = false;
-				continue;
+				return false;
 			}
 
 			// if the file still exists, skip the item
@@ -4113,7 +5020,7 @@ DWORD Application::GameMonitorThread::Main()
 			{
 				statusList.Error(MsgFmt(_T("%s: %s"), itemDesc.c_str(), LoadStringT(IDS_ERR_CAP_ITEM_EXISTS).c_str()));
 				captureOkay = false;
-				continue;
+				return false;
 			}
 
 			// if the directory doesn't exist, try creating it
@@ -4129,10 +5036,22 @@ DWORD Application::GameMonitorThread::Main()
 					LogFile::Get()->Write(LogFile::CaptureLogging, _T("+ Media folder creation failed: %s, error %s\n"), dir, winErr.Get());
 					statusList.Error(MsgFmt(_T("%s: %s"), itemDesc.c_str(), winErr.Get()));
 					captureOkay = false;
-					continue;
+					return false;
 				}
 			}
 
+			// the file is ready
+			return true;
+		};
+
+		// Figure the ffmpeg video filters for an item, as a comma-separated
+		// filter list (without the -vf switch).  Returns an empty string if
+		// the item doesn't need any filters.  'orient' selects whether or
+		// not to include the rotation and mirroring filters; these are
+		// omitted for Desktop Duplication captures, which orient the frames
+		// on the GPU.
+		auto GetVideoFilters = [this](const CaptureItem &item, bool orient) -> TSTRING
+		{
 			// Figure the ffmpeg transforms to apply to the captured screen
 			// images to get the final video in the correct orientation.  We
 			// need to invert the transformations we apply to our display
@@ -4144,25 +5063,18 @@ DWORD Application::GameMonitorThread::Main()
 			// transforms are mutually commutative, so it doesn't matter
 			// which one goes first.)
 			TSTRING transforms;
-			auto AddTransform = [&transforms, &item](const TCHAR *t) 
+			auto AddTransform = [&transforms](const TCHAR *t) 
 			{
-				// add visual transforms for visual media only
-				if (item.mediaType.format != MediaType::Audio)
-				{
-					// add the -vf switch before the first item; add commas
-					// before subsequent items
-					if (transforms.length() == 0)
-						transforms = _T("-vf \"");
-					else
-						transforms += _T(",");
+				// add commas between items
+				if (transforms.length() != 0)
+					transforms += _T(",");
 
-					// add the new transform
-					transforms += t;
-				}
+				// add the new transform
+				transforms += t;
 			};
-			if (item.windowMirrorVert)
+			if (item.windowMirrorVert && orient)
 				AddTransform(_T("vflip"));
-			if (item.windowMirrorHorz)
+			if (item.windowMirrorHorz && orient)
 				AddTransform(_T("hflip"));
 
 			// Now add the rotation transform.  We need to figure the total
@@ -4172,7 +5084,7 @@ DWORD Application::GameMonitorThread::Main()
 			// are all clockwise, so we need counter-clockwise rotations for
 			// the reversals.  Note that we normalize to 0..359 degrees.
 			int rotate = ((item.mediaRotation - item.windowRotation) + 360) % 360;
-			switch (rotate)
+			switch (orient ? rotate : 0)
 			{
 			case 90:
 				AddTransform(_T("transpose=2"));  // 90 degrees counter-clockwise
@@ -4258,19 +5170,1003 @@ DWORD Application::GameMonitorThread::Main()
 					AddTransform(MsgFmt(_T("scale=%d:%d"), xscale, yscale));
 			}
 
-			// add the close quote to the transforms if applicable
-			if (transforms.length() != 0)
-				transforms += _T("\"");
+			// return the filter list
+			return transforms;
+		};
 
-			// set up the image format options, if we're capturing a still
-			// image or a video
-			TSTRINGEx imageOpts;
-			switch (item.mediaType.format)
+		// Run an ffmpeg pass for a list of items.  The list normally has
+		// just one item, but a single-pass group capture runs all of the
+		// group's items in the same ffmpeg process, and we report the
+		// status to each of them.  'logSuccess' indicates whether or not
+		// we'll log a successful completion; this should be false until
+		// the last pass
+		// if we're doing a multi-pass capture, so that we don't roll out the
+		// "mission accomplished" banner prematurely.  'isCapturePass' is true
+		// on the first pass where we actually the capture, and false on
+		// subsequent passes.  This is used for Manual Stop mode: we only pay 
+		// attention to Manual Stop mode on the actual capture pass, not on
+		// subsequent encoding passes.
+		auto RunFFMPEG = [this, &statusList, &curStatus, &captureOkay, &abortCapture, &nMediaItemsOk]
+			(TSTRINGEx &cmdline, const std::list<CaptureItem*> &items, bool logSuccess, bool isCapturePass)
+		{
+			// trace the pass
+			Trace::Scope trace(isCapturePass ? "Capture pass" : "Encode pass", "capture",
+				items.size() != 0 ? items.front()->mediaType.nameStr.c_str() : nullptr);
+
+			// presume failure
+			bool result = false;
+
+			// add a status message for each item
+			auto ItemStatus = [&statusList, &items](const TCHAR *msg)
 			{
-			case MediaType::Image:
-			case MediaType::SilentVideo:
-			case MediaType::VideoWithAudio:
-				imageOpts.Format(
+				for (auto item : items)
+					statusList.Error(MsgFmt(_T("%s: %s"), item->mediaType.nameStr.c_str(), msg));
+			};
+
+			// note if we're in manual stop mode
+			bool manualStop = false;
+			for (auto item : items)
+				manualStop |= item->manualStop;
+
+			// Log the command for debugging purposes, as there's a lot that
+			// can go wrong here and little information back from ffmpeg that
+			// we can analyze mechanically.
+			auto LogCommandLine = [&curStatus, &cmdline](bool log)
+			{
+				if (log)
+				{
+					LogFile::Get()->Group();
+					LogFile::Get()->Write(_T("Media capture: %s: launching FFMPEG\n> %s\n"),
+						curStatus.c_str(), cmdline.c_str());
+				}
+			};
+
+			// log the command line information if logging is enabled
+			LogCommandLine(LogFile::Get()->IsFeatureEnabled(LogFile::CaptureLogging));
+
+			// Set up an "inheritable handle" security attributes struct,
+			// for creating the stdin and stdout/stderr handles for the
+			// child process.  These need to be inheritable so that we 
+			// can open the files and pass the handles to the child.
+			SECURITY_ATTRIBUTES sa;
+			sa.nLength = sizeof(sa);
+			sa.lpSecurityDescriptor = NULL;
+			sa.bInheritHandle = TRUE;
+
+			// Create a pipe for the ffmpeg stdin.  This will let us send
+			// a "q" key to cancel the capture prematurely if necessary.
+			HandleHolder hStdinRead, hStdinWrite;
+			if (CreatePipe(&hStdinRead, &hStdinWrite, &sa, 1024))
+			{
+				// don't let the child inherit our end of the pipe
+				SetHandleInformation(hStdinWrite, HANDLE_FLAG_INHERIT, 0);
+			}
+			else
+			{
+				// failed to create the pipe - just pass the NUL device
+				hStdinRead = CreateFile(_T("NUL"), GENERIC_READ, 0, &sa, OPEN_EXISTING, 0, NULL);
+
+				// we absolutely need the pipe in Manual Stop mode, since it's
+				// the way we tell ffmpeg to stop the capture
+				if (manualStop && isCapturePass)
+				{
+					ItemStatus(LoadStringT(IDS_ERR_CAP_MANUAL_STOP_NO_PIPE).c_str());
+					LogFile::Get()->Write(LogFile::CaptureLogging,
+						_T("+ Manual Stop isn't possible for this item because an error occurred\n")
+						_T("  trying to create a pipe to send the stop command to ffmpeg; capture aborted\n"));
+					captureOkay = false;
+					abortCapture = true;
+					return false;
+				}
+			}
+
+			// Set up a temp file to capture output from FFmpeg, so that we can
+			// copy it to the log file after the capture is done.  Do this whether
+			// or not capture logging is enabled; if the capture fails due to an
+			// FFmpeg error, we'll log the FFmpeg output regardless of the log
+			// settings, to give the user a chance to see what went wrong even
+			// if they weren't anticipating anything going wrong.
+			HandleHolder hStdOut;
+			TSTRING fnameStdOut;
+			{
+				// create the temp file
+				TCHAR tmpPath[MAX_PATH] = _T("<no temp path>"), tmpName[MAX_PATH] = _T("<no temp name>");
+				GetTempPath(countof(tmpPath), tmpPath);
+				GetTempFileName(tmpPath, _T("PBYCap"), 0, tmpName);
+				hStdOut = CreateFile(tmpName, GENERIC_WRITE, 0, &sa, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+
+				// log an error if that failed, but continue with the capture
+				if (hStdOut == NULL)
+				{
+					// log the error
+					WindowsErrorMessage err;
+					LogFile::Get()->Write(LogFile::CaptureLogging,
+						_T("+ Unable to log FFMPEG output: error opening temp file %s (error %d: %s)\n"),
+						tmpName, err.GetCode(), err.Get());
+
+					// direct FFmpeg output to NUL
+					hStdOut = CreateFile(_T("NUL"), GENERIC_WRITE, 0, &sa, OPEN_EXISTING, 0, NULL);
+				}
+				else
+				{
+					// successfully opened the file - remember its name
+					fnameStdOut = tmpName;
+				}
+			}
+
+			// Set up the startup info.  Use Show-No-Activate to try to keep
+			// the game window activated and in the foreground, since VP (and
+			// probably others) stop animations when in the background.
+			STARTUPINFO startupInfo;
+			ZeroMemory(&startupInfo, sizeof(startupInfo));
+			startupInfo.cb = sizeof(startupInfo);
+			startupInfo.dwFlags = STARTF_USESHOWWINDOW | STARTF_USESTDHANDLES;
+			startupInfo.wShowWindow = SW_SHOWNOACTIVATE;
+			startupInfo.hStdInput = hStdinRead;
+			startupInfo.hStdOutput = hStdOut;
+			startupInfo.hStdError = hStdOut;
+
+			// launch the process
+			PROCESS_INFORMATION procInfo;
+			if (CreateProcess(NULL, cmdline.data(), NULL, NULL, TRUE, CREATE_NO_WINDOW, 
+				NULL, NULL, &startupInfo, &procInfo))
+			{
+				// ffmpeg launched successfully.  Put the handles in holders
+				// so that we auto-close the handles when done with them.
+				HandleHolder hFfmpegProc(procInfo.hProcess);
+				HandleHolder hFfmpegThread(procInfo.hThread);
+
+				// close our copy of the child's stdin read handle
+				hStdinRead = NULL;
+
+				// copy the ffmpeg output log file to our log, if capturing a log
+				auto CopyOutputToLog = [&hStdOut, &fnameStdOut, &LogCommandLine](bool force)
+				{
+					// close our copy of the output file handle to make sure the
+					// file is really closed
+					hStdOut = nullptr;
+
+					// check if we're include capture logging
+					if (!LogFile::Get()->IsFeatureEnabled(LogFile::CaptureLogging))
+					{
+						// Capture logging is disabled, so we're not logging this by
+						// default.  Check for a 'force' override.
+						if (force)
+						{
+							// We're forcing the output, due to an error in the capture.
+							// In this case, we won't have logged the command line earlier,
+							// so do so now.
+							LogCommandLine(true);
+						}
+						else
+						{
+							// capture logging disabled, not forcing it; don't copy the output
+							return;
+						}
+					}
+
+					// if there's a log file, copy it
+					if (fnameStdOut.length() != 0)
+					{
+						// read the file
+						long len;
+						std::unique_ptr<BYTE> txt(ReadFileAsStr(fnameStdOut.c_str(), SilentErrorHandler(),
+							len, ReadFileAsStr_NewlineTerm | ReadFileAsStr_NullTerm));
+
+						// copy it to the log file
+						if (txt != nullptr)
+						{
+							// in case the log file contains null bytes, write it piecewise
+							// in null-terminated chunks
+							const BYTE *endp = txt.get() + len;
+							for (const BYTE *p = txt.get(); p < endp; )
+							{
+								// find the end of this null-terminated chunk
+								const BYTE *q;
+								for (q = p; q != endp && *q != 0; ++q);
+
+								// write this chunk
+								LogFile::Get()->WriteStrA((const char *)p);
+
+								// skip the null byte
+								p = q + 1;
+							}
+						}
+
+						// delete the temp file
+						DeleteFile(fnameStdOut.c_str());
+					}
+				};
+
+				// Wait for the process to finish, or for a shutdown or
+				// close-game event to interrupt it.  Also include the
+				// start/stop event as the last handle, but don't count
+				// it just yet - we'll only include it in the actual wait
+				// if we're in manual stop mode.
+				HANDLE h[] = { hFfmpegProc, hGameProc, shutdownEvent, closeEvent, startStopEvent };
+				static const TCHAR *waitName[] = {
+					_T("ffmpeg exited"), _T("game exited"), _T("app shutdown"), _T("user Exit Game command"), _T("Manual Stop")
+				};
+				DWORD nWaitHandles = countof(h) - 1;
+
+				// Check for Manual Stop mode.  This only applies on the
+				// capture pass (not on subsequent encode/compress passes).
+				if (manualStop && isCapturePass)
+				{
+					// include the manual stop event in the wait list
+					nWaitHandles += 1;
+
+					// set the capture status window to reflect manual stop mode
+					capture.statusWin->SetManualStopMode(true);
+
+					// clear any past manual start/stop signal
+					ResetEvent(startStopEvent);
+				}
+
+			WaitForFfmpeg:
+				// wait for the capture to finish
+				const TCHAR *waitResultName = nullptr;
+				switch (DWORD waitResult = WaitForMultipleObjects(nWaitHandles, h, FALSE, INFINITE))
+				{
+				case WAIT_OBJECT_0 + 4:
+					// The user pressed the Manual Stop button to terminate a manually
+					// timed capture.  Send ffmpeg the "Q" key on its stdin to stop
+					// the capture.
+					if (hStdinWrite != NULL)
+					{
+						static const char msg[] = "q\n";
+						DWORD actual;
+						WriteFile(hStdinWrite, msg, sizeof(msg) - 1, &actual, NULL);
+					}
+
+					// Now go back for another wait pass, this time removing the
+					// Manual Stop event from the wait list.  This gives ffmpeg a
+					// chance to exit before we proceed.
+					nWaitHandles -= 1;
+					goto WaitForFfmpeg;
+
+				case WAIT_OBJECT_0:
+					// The ffmpeg process finished successfully
+					{
+						// retrieve the process exit code
+						DWORD exitCode;
+						GetExitCodeProcess(hFfmpegProc, &exitCode);
+
+						// Copy the output to the log.  If the FFmpeg exit code was non-zero,
+						// log it even if capture logging is turned off in the options, since
+						// the error information is too useful to discard just because the
+						// user wasn't anticipating an error.
+						CopyOutputToLog(exitCode != 0);
+
+						// log the process exit code
+						LogFile::Get()->Write(LogFile::CaptureLogging,
+							_T("\n+ FFMPEG completed: process exit code %d\n"), (int)exitCode);
+
+						// consider this a success if the exit code was 0, otherwise consider
+						// it an error
+						if (exitCode == 0)
+						{
+							// success
+							result = true;
+
+							// log successful completion if desired
+							if (logSuccess)
+							{
+								// log the success
+								ItemStatus(LoadStringT(IDS_ERR_CAP_ITEM_OK).c_str());
+
+								// count the success
+								nMediaItemsOk += static_cast<int>(items.size());
+							}
+						}
+						else
+						{
+							// log the error
+							ItemStatus(MsgFmt(IDS_ERR_CAP_ITEM_FFMPEG_ERR_LOGGED, (int)exitCode).Get());
+							captureOkay = false;
+						}
+					}
+					break;
+
+				default:
+					// Error/unexpected wait result
+					waitResultName = _T("Error waiting for ffmpeg to exit");
+					goto Interruption;
+
+				case WAIT_OBJECT_0 + 1:
+				case WAIT_OBJECT_0 + 2:
+				case WAIT_OBJECT_0 + 3:
+					waitResultName = waitName[waitResult - WAIT_OBJECT_0];
+
+				Interruption:
+					// Shutdown event, close event, or premature game termination,
+					// or another error.  Count this as an interrupted capture.
+					ItemStatus(LoadStringT(IDS_ERR_CAP_ITEM_INTERRUPTED).c_str());
+					captureOkay = false;
+					abortCapture = true;
+
+					// log it
+					CopyOutputToLog(false);
+					LogFile::Get()->Write(LogFile::CaptureLogging, _T("\n+ capture interrupted (%s)\n"), waitResultName);
+
+					// Send ffmpeg a "Q" key press on its stdin to try to shut
+					// it down immediately
+					if (hStdinWrite != NULL)
+					{
+						static const char msg[] = "q\n";
+						DWORD actual;
+						WriteFile(hStdinWrite, msg, sizeof(msg) - 1, &actual, NULL);
+					}
+					break;
+				}
+			}
+			else
+			{
+				// Error launching ffmpeg.  It's likely that all subsequent
+				// ffmpeg launch attempts will fail, because the problem is
+				// probably something permanent (e.g., ffmpeg.exe isn't
+				// installed where we expect it to be installed, or there's
+				// a file permissions problem).  So skip any remaining items
+				// by setting the 'abort' flag.
+				WindowsErrorMessage err;
+				LogFile::Get()->Write(LogFile::CaptureLogging, _T("+ FFMPEG launch failed: Win32 error %d, %s\n"), err.GetCode(), err.Get());
+				ItemStatus(MsgFmt(IDS_ERR_CAP_ITEM_FFMPEG_LAUNCH, err.Get()));
+				captureOkay = false;
+				abortCapture = true;
+			}
+
+			// add a blank line to the log after the FFMPEG output, for readability 
+			LogFile::Get()->Group(LogFile::CaptureLogging);
+
+			// we're done with manual stop mode, if it was ever in effect
+			capture.statusWin->SetManualStopMode(false);
+
+			// return the operation status
+			return result;
+		};
+
+		// Get the name of the temporary file for the first pass of a two-pass
+		// capture for an item
+		auto GetTempCaptureFile = [this](const CaptureItem &item) -> TSTRING
+		{
+			// start with the output file name, and replace the suffix with .tmp.mkv
+			static const std::basic_regex<TCHAR> extPat(_T("\\.([^.]+)$"));
+			TSTRING tmpfile = std::regex_replace(item.filename, extPat, _T(".tmp.mkv"));
+
+			// If there's a temp folder specified in the settings, replace
+			// the path to the temp file with the temp folder.
+			if (capture.tempFolder.length() != 0)
+			{
+				// combine the temp folder with the base file name from
+				// the current temp file to get the full path
+				TCHAR buf[MAX_PATH];
+				PathCombine(buf, capture.tempFolder.c_str(), PathFindFileName(tmpfile.c_str()));
+
+				// replace the original temp file name
+				tmpfile = buf;
+			}
+
+			// return the name
+			return tmpfile;
+		};
+
+		// Record a capture timing sample for an item, for the capture time
+		// estimates
+		auto AddTimingSample = [this](const CaptureItem *item, CaptureTimeStats::Phase phase, float value)
+		{
+			Application::Get()->captureTimeStats->AddSample(gameSys.displayName.c_str(), item->mediaType.configId, phase, value);
+		};
+
+		// get the elapsed time in seconds since a starting tick count
+		auto SecondsSince = [](ULONGLONG t0) { return static_cast<float>(GetTickCount64() - t0) / 1000.0f; };
+
+		// Record the capture overhead for a group capture pass.  The pass
+		// runs for the longest of the items' times, so the overhead is the
+		// time beyond that.
+		auto AddGroupCaptureSample = [&AddTimingSample, &SecondsSince](const std::list<CaptureItem*> &items, ULONGLONG t0, DWORD maxTime)
+		{
+			float overhead = SecondsSince(t0) - static_cast<float>(maxTime) / 1000.0f;
+			for (auto item : items)
+				AddTimingSample(item, CaptureTimeStats::Phase::Capture, overhead);
+		};
+
+		// Set up a deferred second pass for an item.  The completion
+		// callback records the encoding time, as a ratio to the video's
+		// running time, like a foreground encoding pass.
+		auto MakeDeferredPass = [this](const TCHAR *cmdline, const CaptureItem *item)
+		{
+			CaptureEncodeQueue::Pass pass(cmdline, item->filename.c_str(),
+				MsgFmt(_T("%s: %s"), game.title.c_str(), item->mediaType.nameStr.c_str()));
+			pass.onDone = [sys = gameSys.displayName, mediaType = TSTRING(item->mediaType.configId), videoTime = item->captureTime]
+				(bool ok, DWORD ms)
+			{
+				if (ok && videoTime != 0)
+				{
+					Application::Get()->captureTimeStats->AddSample(sys.c_str(), mediaType.c_str(),
+						CaptureTimeStats::Phase::DeferredEncode, static_cast<float>(ms) / static_cast<float>(videoTime));
+				}
+			};
+			return pass;
+		};
+
+		// Hand off second passes to the batch's deferred encoding queue.
+		// The queue takes over the temp file, so the caller mustn't delete
+		// it.  We count the items as captured now; the queue notifies the
+		// main window of any encoding failures when the passes finish.
+		auto DeferEncoding = [this, &statusList, &nMediaItemsOk]
+			(std::list<CaptureEncodeQueue::Pass> &&passes, const std::list<CaptureItem*> &items, const TCHAR *tmpfile)
+		{
+			for (auto item : items)
+				statusList.Error(MsgFmt(_T("%s: %s"), item->mediaType.nameStr.c_str(), LoadStringT(IDS_ERR_CAP_ITEM_QUEUED).c_str()));
+			nMediaItemsOk += static_cast<int>(items.size());
+			encodeQueue->Add(std::move(passes), tmpfile);
+		};
+
+		// Start a Desktop Duplication capture for a list of items.  This
+		// creates one pipe input for each item, cropped to the item's window
+		// and with the same orientation transforms that GetVideoFilters()
+		// would otherwise apply.  Returns null if Desktop Duplication isn't
+		// available for these items, in which case the caller falls back on
+		// gdigrab.
+		auto StartDesktopDuplication = [](const std::list<CaptureItem*> &items) -> std::unique_ptr<DesktopDuplication>
+		{
+			std::unique_ptr<DesktopDuplication> dup(new DesktopDuplication());
+			for (auto item : items)
+			{
+				int rotate = ((item->mediaRotation - item->windowRotation) + 360) % 360;
+				if (!dup->AddTarget(item->rc, item->windowMirrorVert, item->windowMirrorHorz, rotate))
+					dup.reset();
+				if (dup == nullptr)
+					break;
+			}
+			if (dup != nullptr && !dup->Start())
+				dup.reset();
+
+			if (dup == nullptr)
+				LogFile::Get()->Write(LogFile::CaptureLogging, _T("+ Desktop Duplication isn't available for this capture; using gdigrab\n"));
+			return dup;
+		};
+
+		// In single-pass mode, capture all of the automatically timed video
+		// items together in one ffmpeg session, rather than capturing each
+		// window in turn.  We grab the bounding rectangle of all of the
+		// windows from the desktop, split the frames in the ffmpeg filter
+		// graph, and crop each copy down to one window, writing one output
+		// file per item.  The items share one audio input, if any of them
+		// want audio.  This makes the game time needed for the videos the
+		// longest of the item times rather than the sum of them.  Items in
+		// manual start or stop mode, still images, and audio tracks aren't
+		// part of the group; they go through the normal per-item loop below.
+		std::list<CaptureItem*> group;
+		for (auto &item : capture.items)
+		{
+			if (item.batched)
+				group.push_back(&item);
+		}
+		if (group.size() != 0)
+		{
+			// count the items attempted
+			nMediaItemsAttempted += static_cast<int>(group.size());
+
+			// If the game has already exited, or a shutdown or close event
+			// is already pending, abort the capture before it starts
+			{
+				HANDLE h[] = { hGameProc, shutdownEvent, closeEvent };
+				if (WaitForMultipleObjects(countof(h), h, FALSE, 0) != WAIT_TIMEOUT)
+				{
+					abortCapture = true;
+					captureOkay = false;
+				}
+			}
+
+			// if we've already decided to abort, add a status message for
+			// each item saying so
+			if (abortCapture)
+			{
+				for (auto item : group)
+					statusList.Error(MsgFmt(_T("%s: %s"), item->mediaType.nameStr.c_str(), LoadStringT(IDS_ERR_CAP_ITEM_NOT_STARTED).c_str()));
+				group.clear();
+			}
+
+			// set up the output files, dropping any items that fail
+			for (auto it = group.begin(); it != group.end(); )
+			{
+				if (PrepareOutputFile(**it))
+					++it;
+				else
+					it = group.erase(it);
+			}
+
+			// Check for audio.  If there's no audio capture device, capture
+			// the affected items without audio, as in the per-item case.
+			bool groupAudio = false;
+			for (auto item : group)
+			{
+				if (item->mediaType.format == MediaType::VideoWithAudio && item->enableAudio)
+				{
+					if (audioCaptureDevice.length() != 0)
+					{
+						// audio is available - include it in the session
+						groupAudio = true;
+					}
+					else
+					{
+						// no audio - note the error and capture a silent video
+						statusList.Error(MsgFmt(_T("%s: %s"), item->mediaType.nameStr.c_str(), LoadStringT(IDS_ERR_CAP_NO_AUDIO_DEV_VIDEO).c_str()));
+						item->enableAudio = false;
+						captureOkay = false;
+					}
+				}
+			}
+
+			if (group.size() != 0)
+			{
+				// Figure the desktop area to grab, as the bounding rectangle
+				// of all of the windows, and the longest item capture time,
+				// which determines the length of the session.  Also build a
+				// list of the item names for the status message.
+				RECT rcAll;
+				SetRectEmpty(&rcAll);
+				DWORD maxTime = 0;
+				TSTRING groupDesc;
+				for (auto item : group)
+				{
+					UnionRect(&rcAll, &rcAll, &item->rc);
+					maxTime = max(maxTime, item->captureTime);
+					if (groupDesc.length() != 0)
+						groupDesc += _T(", ");
+					groupDesc += item->mediaType.nameStr;
+				}
+
+				// set the status window message
+				curStatus.Format(LoadStringT(IDS_CAPSTAT_ITEM), groupDesc.c_str());
+				capture.statusWin->SetCaptureStatus(curStatus, maxTime);
+				capture.statusWin->SetManualStartMode(false);
+
+				// Move the status window over a window that we're not capturing,
+				// so that it doesn't show up in any of the videos.  If we're
+				// capturing all of the visible windows, hide it for the session.
+				{
+					auto app = Application::Get();
+					FrameWin *wins[] = { 
+						app->GetPlayfieldWin(), app->GetBackglassWin(), app->GetDMDWin(), 
+						app->GetTopperWin(), app->GetInstCardWin() 
+					};
+					FrameWin *statusOver = nullptr;
+					for (auto win : wins)
+					{
+						// skip missing and hidden windows
+						if (win == nullptr || !IsWindowVisible(win->GetHWnd()))
+							continue;
+
+						// check for overlap with any of the capture areas
+						RECT rcWin, rcOverlap;
+						GetWindowRect(win->GetHWnd(), &rcWin);
+						bool overlap = false;
+						for (auto item : group)
+							overlap |= (IntersectRect(&rcOverlap, &rcWin, &item->rc) != 0);
+
+						// if it's clear, use this window
+						if (!overlap)
+						{
+							statusOver = win;
+							break;
+						}
+					}
+					if (statusOver != nullptr)
+						capture.statusWin->PositionOver(statusOver);
+					else
+						ShowWindow(capture.statusWin->GetHWnd(), SW_HIDE);
+				}
+
+				// Set up the video inputs.  In Desktop Duplication mode, each
+				// item gets its own input, with the frames already cropped to
+				// the window and oriented.  Otherwise, we grab the bounding
+				// rectangle of the windows with gdigrab, and crop each item's
+				// window out of it in the filter graph.
+				int nGroup = static_cast<int>(group.size());
+				std::unique_ptr<DesktopDuplication> dup;
+				if (capture.desktopDuplication)
+					dup = StartDesktopDuplication(group);
+				TSTRINGEx videoOpts;
+				if (dup != nullptr)
+				{
+					for (int i = 0; i < nGroup; ++i)
+						videoOpts += _T(" ") + dup->GetInputOpts(i);
+				}
+				else
+				{
+					videoOpts.Format(
+						_T(" -f gdigrab")
+						_T(" -framerate 30")
+						_T(" -offset_x %d -offset_y %d -video_size %dx%d -i desktop"),
+						rcAll.left, rcAll.top, rcAll.right - rcAll.left, rcAll.bottom - rcAll.top);
+				}
+
+				// set up the audio input; it follows the video inputs
+				int audioInput = dup != nullptr ? nGroup : 1;
+				TSTRINGEx audioOpts;
+				if (groupAudio)
+					audioOpts.Format(_T("-f dshow -i audio=\"%s\""), audioCaptureDevice.c_str());
+
+				// if we're on a 64-bit build, use a very large realtime input 
+				// buffer to reduce the chance dropped frames
+				TSTRINGEx rtbufsizeOpts(IF_32_64(_T(""), _T("-rtbufsize 2000M")));
+
+				// Figure the filters for an item.  With gdigrab, crop the item's
+				// window out of the grab area, then apply the item's transforms.
+				// Desktop Duplication has already done the cropping and the
+				// orientation, so only the scaling filters (if any) remain.
+				auto GetGroupItemFilters = [&rcAll, &GetVideoFilters, &dup](const CaptureItem *item) -> TSTRING
+				{
+					if (dup != nullptr)
+					{
+						TSTRING filters = GetVideoFilters(*item, false);
+						return filters.length() != 0 ? filters : _T("null");
+					}
+
+					TSTRING filters = MsgFmt(_T("crop=%d:%d:%d:%d"),
+						item->rc.right - item->rc.left, item->rc.bottom - item->rc.top,
+						item->rc.left - rcAll.left, item->rc.top - rcAll.top).Get();
+					if (TSTRING t = GetVideoFilters(*item, true); t.length() != 0)
+						filters += _T(",") + t;
+					return filters;
+				};
+
+				// does an item get the audio track?
+				auto ItemHasAudio = [groupAudio](const CaptureItem *item) {
+					return groupAudio && item->mediaType.format == MediaType::VideoWithAudio && item->enableAudio;
+				};
+
+				// audio output options for an item
+				TSTRINGEx audioMapOpts;
+				audioMapOpts.Format(_T("-map %d:a -c:a aac -b:a 128k"), audioInput);
+
+				if (capture.twoPassEncoding)
+				{
+					// Two-pass encoding.  The first pass captures the video with
+					// the fast pass 1 codec, including the audio track if any item
+					// wants it.  With gdigrab, this records the whole grab area to
+					// a single temp file, and each item's second pass crops the
+					// item's window out of it.  With Desktop Duplication, each
+					// item's input goes to its own temp file.
+					std::vector<TSTRING> tmpfiles;
+					TSTRINGEx pass1Outputs;
+					if (dup != nullptr)
+					{
+						int i = 0;
+						for (auto item : group)
+						{
+							tmpfiles.push_back(GetTempCaptureFile(*item));
+							pass1Outputs += MsgFmt(_T(" -map %d:v %s %s -t %d \"%s\""),
+								i, ItemHasAudio(item) ? audioMapOpts.c_str() : _T("-an"), item->vcodecPass1.c_str(),
+								item->captureTime / 1000, tmpfiles.back().c_str()).Get();
+							++i;
+						}
+					}
+					else
+					{
+						tmpfiles.push_back(GetTempCaptureFile(*group.front()));
+						pass1Outputs.Format(_T(" -t %d %s %s \"%s\""),
+							maxTime / 1000, groupAudio ? _T("-c:a aac -b:a 128k") : _T("-an"), group.front()->vcodecPass1.c_str(),
+							tmpfiles.back().c_str());
+					}
+
+					TSTRINGEx cmdline1;
+					cmdline1.Format(_T("\"%s\" -y -loglevel warning -thread_queue_size 32")
+						_T(" %s %s %s")
+						_T(" -probesize 30M")
+						_T("%s"),
+						ffmpeg,
+						rtbufsizeOpts.c_str(), videoOpts.c_str(), audioOpts.c_str(),
+						pass1Outputs.c_str());
+
+					ULONGLONG t0 = GetTickCount64();
+					bool pass1Ok = RunFFMPEG(cmdline1, group, false, true);
+					if (pass1Ok)
+						AddGroupCaptureSample(group, t0, maxTime);
+
+					// we're done with the screen capture
+					if (dup != nullptr)
+						dup->Stop();
+
+					if (pass1Ok && encodeQueue != nullptr)
+					{
+						// Pipelined batch capture - queue the second passes
+						// to run in the background.  With gdigrab, the items
+						// share one temp file, so they go in a single job.
+						int i = 0;
+						std::list<CaptureEncodeQueue::Pass> passes;
+						for (auto item : group)
+						{
+							TSTRINGEx cmdline2;
+							cmdline2.Format(_T("\"%s\" -y -loglevel warning")
+								_T(" -i \"%s\"")
+								_T(" -vf \"%s\" %s %s -t %d -max_muxing_queue_size 1024")
+								_T(" \"%s\""),
+								ffmpeg,
+								tmpfiles[dup != nullptr ? i : 0].c_str(),
+								GetGroupItemFilters(item).c_str(), item->vcodecOpts.c_str(), ItemHasAudio(item) ? _T("-c:a copy") : _T("-an"),
+								item->captureTime / 1000,
+								item->filename.c_str());
+							passes.emplace_back(MakeDeferredPass(cmdline2.c_str(), item));
+
+							// with separate temp files, each item gets its own job
+							if (dup != nullptr)
+							{
+								std::list<CaptureItem*> jobItems{ item };
+								DeferEncoding(std::move(passes), jobItems, tmpfiles[i].c_str());
+								passes.clear();
+							}
+							++i;
+						}
+						if (dup == nullptr)
+							DeferEncoding(std::move(passes), group, tmpfiles[0].c_str());
+
+						// the queue owns the temp files now
+						tmpfiles.clear();
+					}
+					else if (pass1Ok)
+					{
+						// run the second pass for each item
+						int i = 0;
+						for (auto item : group)
+						{
+							curStatus.Format(LoadStringT(IDS_CAPSTAT_ENCODING_ITEM), item->mediaType.nameStr.c_str());
+							capture.statusWin->SetCaptureStatus(curStatus.c_str(), item->captureTime*3/2);
+
+							TSTRINGEx cmdline2;
+							cmdline2.Format(_T("\"%s\" -y -loglevel warning")
+								_T(" -i \"%s\"")
+								_T(" -vf \"%s\" %s %s -t %d -max_muxing_queue_size 1024")
+								_T(" \"%s\""),
+								ffmpeg,
+								tmpfiles[dup != nullptr ? i : 0].c_str(),
+								GetGroupItemFilters(item).c_str(), item->vcodecOpts.c_str(), ItemHasAudio(item) ? _T("-c:a copy") : _T("-an"),
+								item->captureTime / 1000,
+								item->filename.c_str());
+							++i;
+
+							std::list<CaptureItem*> runItems{ item };
+							ULONGLONG t0 = GetTickCount64();
+							if (RunFFMPEG(cmdline2, runItems, true, false) && item->captureTime != 0)
+								AddTimingSample(item, CaptureTimeStats::Phase::Encode, SecondsSince(t0) * 1000.0f / item->captureTime);
+
+							// stop if the capture was aborted
+							if (abortCapture)
+								break;
+						}
+					}
+
+					// delete the temp files
+					for (auto &tmpfile : tmpfiles)
+					{
+						if (FileExists(tmpfile.c_str()))
+							DeleteFile(tmpfile.c_str());
+					}
+				}
+				else
+				{
+					// One-pass encoding.  Run each item's video through its
+					// filters into its own output file, with its own time limit.
+					// With gdigrab, start by splitting the grabbed frames into
+					// one stream per item.
+					TSTRINGEx graph, outputs;
+					if (dup == nullptr)
+					{
+						graph.Format(_T("[0:v]split=%d"), nGroup);
+						for (int i = 0; i < nGroup; ++i)
+							graph += MsgFmt(_T("[s%d]"), i).Get();
+					}
+					int i = 0;
+					for (auto item : group)
+					{
+						if (graph.length() != 0)
+							graph += _T(";");
+						graph += MsgFmt(dup != nullptr ? _T("[%d:v]%s[v%d]") : _T("[s%d]%s[v%d]"),
+							i, GetGroupItemFilters(item).c_str(), i).Get();
+						outputs += MsgFmt(_T(" -map \"[v%d]\" %s %s -t %d \"%s\""),
+							i, item->vcodecOpts.c_str(), ItemHasAudio(item) ? audioMapOpts.c_str() : _T("-an"),
+							item->captureTime / 1000, item->filename.c_str()).Get();
+						++i;
+					}
+
+					TSTRINGEx cmdline;
+					cmdline.Format(_T("\"%s\" -y -loglevel warning -probesize 30M -thread_queue_size 32")
+						_T(" %s %s %s")
+						_T(" -filter_complex \"%s\"%s"),
+						ffmpeg,
+						rtbufsizeOpts.c_str(), videoOpts.c_str(), audioOpts.c_str(),
+						graph.c_str(), outputs.c_str());
+
+					ULONGLONG t0 = GetTickCount64();
+					if (RunFFMPEG(cmdline, group, true, true))
+						AddGroupCaptureSample(group, t0, maxTime);
+				}
+			}
+		}
+		// Capture one item.  Returns true to continue capturing
+		// additional items, false to end the capture process.
+		// A true return doesn't necessarily mean that the 
+		// individual capture succeeded; it just means that we
+		// didn't run into a condition that ends the whole
+		// process, such as the game exiting prematurely.
+		for (auto &item: capture.items)
+		{
+			// skip items captured in the single-pass group
+			if (item.batched)
+				continue;
+
+			// count the item attempted
+			nMediaItemsAttempted += 1;
+
+			// get the descriptor for the item, for status messages
+			const TSTRING &itemDesc = item.mediaType.nameStr;
+
+			// If the game has already exited, or a shutdown or close event
+			// is already pending, abort this capture before it starts
+			{
+				HANDLE h[] = { hGameProc, shutdownEvent, closeEvent };
+				if (WaitForMultipleObjects(countof(h), h, FALSE, 0) != WAIT_TIMEOUT)
+				{
+					abortCapture = true;
+					captureOkay = false;
+				}
+			}
+
+			// if we've already decided to abort, just add a status message
+			// for this item saying so
+			if (abortCapture)
+			{
+				statusList.Error(MsgFmt(_T("%s: %s"), itemDesc.c_str(), LoadStringT(IDS_ERR_CAP_ITEM_NOT_STARTED).c_str()));
+				break;
+			}
+
+			// If we're capturing audio for this item, and we haven't found
+			// the audio capture device yet, find it now.  We use FFMPEG's
+			// DirectShow (dshow) audio capture capability, so we have to 
+			// find the device using the dshow API to make sure we see the
+			// same device name that FFMPEG will see when it scans for a
+			// device.  Note that Windows has multiple media APIs that can
+			// access the same audio devices, but it's important to use the
+			// same API that FFMPEG uses, since the different APIs can use
+			// different names for the same devices.  For example, dshow 
+			// truncates long device names in different ways on different
+			// Windows versions.
+			bool hasAudio =	(item.mediaType.format == MediaType::VideoWithAudio && item.enableAudio)
+				|| item.mediaType.format == MediaType::Audio;
+			if (hasAudio && audioCaptureDevice.length() == 0)
+			{
+				// Audio capture is needed, but audio isn't available.  Note
+				// that the item didn't complete successfully.
+				captureOkay = false;
+
+				// If this is video with audio, disable audio for the item and
+				// continue with the capture; we can at least still capture a
+				// silent video for it.  If it's pure audio, there's no point,
+				// so just skip the item.
+				if (item.mediaType.format == MediaType::VideoWithAudio)
+				{
+					// disable the audio, proceed with the capture (but log an
+					// error to alert the user to the reason the video doesn't
+					// have the audio they requested)
+					statusList.Error(MsgFmt(_T("%s: %s"), itemDesc.c_str(), LoadStringT(IDS_ERR_CAP_NO_AUDIO_DEV_VIDEO).c_str()));
+					item.enableAudio = false;
+				}
+				else
+				{
+					// pure audio - skip the item entirely
+					statusList.Error(MsgFmt(_T("%s: %s"), itemDesc.c_str(), LoadStringT(IDS_ERR_CAP_NO_AUDIO_DEV).c_str()));
+					continue;
+				}
+			}
+
+			// If this item is in Manual Start mode, wait for the start signal
+			if (item.manualStart)
+			{
+				// Move the status window over the playfield window, even if we're
+				// going to capture the playfield.  We're not actually capturing
+				// anything while waiting for the Go signal, so it doesn't matter
+				// if we put the status window in front of the window we're about
+				// to capture, hence we can put it anywhere.  The window is more
+				// than just status in this case - it's showing a prompt - so we
+				// want it to be as conspicuous as possible.  The playfield window
+				// is the best place to make the user notice it.
+				capture.statusWin->PositionOver(Application::Get()->GetPlayfieldWin());
+
+				// put the status window in waiting mode
+				capture.statusWin->SetCaptureStatus(MsgFmt(IDS_CAPSTAT_MANUAL_START, itemDesc.c_str()), item.captureTime);
+				capture.statusWin->SetManualStartMode(true);
+
+				// clear any previous manual start/stop signal
+				ResetEvent(startStopEvent);
+
+				// Wait for the start/stop event
+				HANDLE h[] = { startStopEvent, hGameProc, shutdownEvent, closeEvent };
+				static const TCHAR *hDesc[] = { 
+					_T("Started"), _T("game exited"), _T("PinballY shutting down"), _T("user pressed Exit Game button") 
+				};
+				switch (DWORD result = WaitForMultipleObjects(countof(h), h, FALSE, INFINITE))
+				{
+				case WAIT_OBJECT_0:
+					// The user pressed the Go button combo.  Ready to proceed
+					break;
+
+				case WAIT_OBJECT_0 + 1:
+				case WAIT_OBJECT_0 + 2:
+				case WAIT_OBJECT_0 + 3:
+					// The game process exited, or the user canceled, or the program is exiting
+					captureOkay = false;
+					abortCapture = true;
+					LogFile::Get()->Write(LogFile::CaptureLogging, 
+						MsgFmt(_T("+ Capture aborted: %s while waiting for manual start\n"), hDesc[result - WAIT_OBJECT_0]));
+					statusList.Error(MsgFmt(_T("%s: %s"), itemDesc.c_str(), LoadStringT(IDS_ERR_CAP_ITEM_INTERRUPTED).c_str()));
+					break;
+					
+				default:
+					// error waiting
+					captureOkay = false;
+					abortCapture = true;
+					{
+						WindowsErrorMessage err;
+						LogFile::Get()->Write(LogFile::CaptureLogging,
+							MsgFmt(_T("+ Capture aborted: error waiting: %s\n"), err.Get()));
+					}
+					statusList.Error(MsgFmt(_T("%s: %s"), itemDesc.c_str(), LoadStringT(IDS_ERR_CAP_ITEM_INTERRUPTED)));
+					break;
+				}
+			}
+
+			// stop if the capture was aborted
+			if (abortCapture)
+				break;
+
+			// ready to go - set the status window message
+			curStatus.Format(LoadStringT(IDS_CAPSTAT_ITEM), itemDesc.c_str());
+			capture.statusWin->SetCaptureStatus(curStatus, item.captureTime);
+			capture.statusWin->SetManualStartMode(false);
+
+			// Move the status window over the playfield window when capturing
+			// in any other window, and move it over the backglass window when
+			// capturing the playfield.
+			if (item.mediaType.javascriptId == L"table image" || item.mediaType.javascriptId == L"table video")
+				capture.statusWin->PositionOver(Application::Get()->GetBackglassWin());
+			else
+				capture.statusWin->PositionOver(Application::Get()->GetPlayfieldWin());
+
+			// set up the output file; skip the item if that fails
+			if (!PrepareOutputFile(item))
+				continue;
+
+			// In Desktop Duplication mode, start the in-process screen capture
+			// for visual media
+			std::unique_ptr<DesktopDuplication> dup;
+			if (capture.desktopDuplication && item.mediaType.format != MediaType::Audio)
+				dup = StartDesktopDuplication({ &item });
+
+			// Figure the video transforms for visual media.  Desktop
+			// Duplication does the orientation transforms itself.
+			TSTRING transforms;
+			if (item.mediaType.format != MediaType::Audio)
+			{
+				if (TSTRING filters = GetVideoFilters(item, dup == nullptr); filters.length() != 0)
+					transforms = _T("-vf \"") + filters + _T("\"");
+			}
+
+			// set up the image format options, if we're capturing a still
+			// image or a video
+			TSTRINGEx imageOpts;
+			switch (item.mediaType.format)
+			{
+			case MediaType::Image:
+			case MediaType::SilentVideo:
+			case MediaType::VideoWithAudio:
+				if (dup != nullptr)
+				{
+					imageOpts = _T(" ") + dup->GetInputOpts(0);
+					break;
+				}
+				imageOpts.Format(
 					_T(" -f gdigrab")
 					_T(" -framerate 30")
 					_T(" -offset_x %d -offset_y %d -video_size %dx%d -i desktop"),
@@ -4336,22 +6232,8 @@ DWORD Application::GameMonitorThread::Main()
 				// We'll re-encode to the actual output file and apply rotations
 				// in the second pass.
 
-				// generate the temp file name - start with the output file name,
-				// and replace the suffix with .tmp.mkv
-				tmpfile = std::regex_replace(item.filename, std::basic_regex<TCHAR>(_T("\\.([^.]+)$")), _T(".tmp.mkv"));
-
-				// If there's a temp folder specified in the settings, replace
-				// the path to the temp file with the temp folder.
-				if (capture.tempFolder.length() != 0)
-				{
-					// combine the temp folder with the base file name from
-					// the current temp file to get the full path
-					TCHAR buf[MAX_PATH];
-					PathCombine(buf, capture.tempFolder.c_str(), PathFindFileName(tmpfile.c_str()));
-
-					// replace the original temp file name
-					tmpfile = buf;
-				}
+				// generate the temp file name
+				tmpfile = GetTempCaptureFile(item);
 
 				// Build the first-pass command line
 				cmdline1.Format(_T("\"%s\" -y -loglevel warning -thread_queue_size 32")
@@ -4361,17 +6243,17 @@ DWORD Application::GameMonitorThread::Main()
 					_T(" \"%s\""),
 					ffmpeg,
 					imageOpts.c_str(), audioOpts.c_str(), timeLimitOpt.c_str(),
-					rtbufsizeOpts.c_str(), acodecOpts.c_str(), capture.vcodecPass1.c_str(),
+					rtbufsizeOpts.c_str(), acodecOpts.c_str(), item.vcodecPass1.c_str(),
 					tmpfile.c_str());
 
 				// Format the command line for the second pass while we're here
 				cmdline2.Format(_T("\"%s\" -y -loglevel warning")
 					_T(" -i \"%s\"")
-					_T(" %s -c:a copy -max_muxing_queue_size 1024")
+					_T(" %s %s -c:a copy -max_muxing_queue_size 1024")
 					_T(" \"%s\""),
 					ffmpeg,
 					tmpfile.c_str(),
-					transforms.c_str(), 
+					transforms.c_str(), item.vcodecOpts.c_str(),
 					item.filename.c_str());
 			}
 			else
@@ -4380,361 +6262,55 @@ DWORD Application::GameMonitorThread::Main()
 				// directly to the desired output file
 				cmdline1.Format(_T("\"%s\" -y -loglevel warning -probesize 30M -thread_queue_size 32")
 					_T(" %s %s")
-					_T(" %s %s %s %s")
+					_T(" %s %s %s %s %s")
 					_T(" \"%s\""),
 					ffmpeg, 
 					imageOpts.c_str(), audioOpts.c_str(), acodecOpts.c_str(),
-					transforms.c_str(), timeLimitOpt.c_str(), rtbufsizeOpts.c_str(),
+					transforms.c_str(), item.vcodecOpts.c_str(), timeLimitOpt.c_str(), rtbufsizeOpts.c_str(),
 					item.filename.c_str());
 			}
 
-			// Run the capture.  'logSuccess' indicates whether or not we'll log
-			// a successful completion; this should be false until the last pass
-			// if we're doing a multi-pass capture, so that we don't roll out the
-			// "mission accomplished" banner prematurely.  'isCapturePass' is true
-			// on the first pass where we actually the capture, and false on
-			// subsequent passes.  This is used for Manual Stop mode: we only pay 
-			// attention to Manual Stop mode on the actual capture pass, not on
-			// subsequent encoding passes.
-			auto RunFFMPEG = [this, &statusList, &curStatus, &item, &itemDesc, &captureOkay, &abortCapture, &nMediaItemsOk]
-				(TSTRINGEx &cmdline, bool logSuccess, bool isCapturePass)
-			{
-				// presume failure
-				bool result = false;
-
-				// Log the command for debugging purposes, as there's a lot that
-				// can go wrong here and little information back from ffmpeg that
-				// we can analyze mechanically.
-				auto LogCommandLine = [&curStatus, &cmdline](bool log)
-				{
-					if (log)
-					{
-						LogFile::Get()->Group();
-						LogFile::Get()->Write(_T("Media capture: %s: launching FFMPEG\n> %s\n"),
-							curStatus.c_str(), cmdline.c_str());
-					}
-				};
-
-				// log the command line information if logging is enabled
-				LogCommandLine(LogFile::Get()->IsFeatureEnabled(LogFile::CaptureLogging));
-
-				// Set up an "inheritable handle" security attributes struct,
-				// for creating the stdin and stdout/stderr handles for the
-				// child process.  These need to be inheritable so that we 
-				// can open the files and pass the handles to the child.
-				SECURITY_ATTRIBUTES sa;
-				sa.nLength = sizeof(sa);
-				sa.lpSecurityDescriptor = NULL;
-				sa.bInheritHandle = TRUE;
-
-				// Create a pipe for the ffmpeg stdin.  This will let us send
-				// a "q" key to cancel the capture prematurely if necessary.
-				HandleHolder hStdinRead, hStdinWrite;
-				if (CreatePipe(&hStdinRead, &hStdinWrite, &sa, 1024))
-				{
-					// don't let the child inherit our end of the pipe
-					SetHandleInformation(hStdinWrite, HANDLE_FLAG_INHERIT, 0);
-				}
-				else
-				{
-					// failed to create the pipe - just pass the NUL device
-					hStdinRead = CreateFile(_T("NUL"), GENERIC_READ, 0, &sa, OPEN_EXISTING, 0, NULL);
-
-					// we absolutely need the pipe in Manual Stop mode, since it's
-					// the way we tell ffmpeg to stop the capture
-					if (item.manualStop && isCapturePass)
-					{
-						statusList.Error(MsgFmt(_T("%s: %s"), itemDesc.c_str(), LoadStringT(IDS_ERR_CAP_MANUAL_STOP_NO_PIPE).c_str()));
-						LogFile::Get()->Write(LogFile::CaptureLogging,
-							_T("+ Manual Stop isn't possible for this item because an error occurred\n")
-							_T("  trying to create a pipe to send the stop command to ffmpeg; capture aborted\n"));
-						captureOkay = false;
-						abortCapture = true;
-						return false;
-					}
-				}
-
-				// Set up a temp file to capture output from FFmpeg, so that we can
-				// copy it to the log file after the capture is done.  Do this whether
-				// or not capture logging is enabled; if the capture fails due to an
-				// FFmpeg error, we'll log the FFmpeg output regardless of the log
-				// settings, to give the user a chance to see what went wrong even
-				// if they weren't anticipating anything going wrong.
-				HandleHolder hStdOut;
-				TSTRING fnameStdOut;
-				{
-					// create the temp file
-					TCHAR tmpPath[MAX_PATH] = _T("<no temp path>"), tmpName[MAX_PATH] = _T("<no temp name>");
-					GetTempPath(countof(tmpPath), tmpPath);
-					GetTempFileName(tmpPath, _T("PBYCap"), 0, tmpName);
-					hStdOut = CreateFile(tmpName, GENERIC_WRITE, 0, &sa, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
-
-					// log an error if that failed, but continue with the capture
-					if (hStdOut == NULL)
-					{
-						// log the error
-						WindowsErrorMessage err;
-						LogFile::Get()->Write(LogFile::CaptureLogging,
-							_T("+ Unable to log FFMPEG output: error opening temp file %s (error %d: %s)\n"),
-							tmpName, err.GetCode(), err.Get());
-
-						// direct FFmpeg output to NUL
-						hStdOut = CreateFile(_T("NUL"), GENERIC_WRITE, 0, &sa, OPEN_EXISTING, 0, NULL);
-					}
-					else
-					{
-						// successfully opened the file - remember its name
-						fnameStdOut = tmpName;
-					}
-				}
-
-				// Set up the startup info.  Use Show-No-Activate to try to keep
-				// the game window activated and in the foreground, since VP (and
-				// probably others) stop animations when in the background.
-				STARTUPINFO startupInfo;
-				ZeroMemory(&startupInfo, sizeof(startupInfo));
-				startupInfo.cb = sizeof(startupInfo);
-				startupInfo.dwFlags = STARTF_USESHOWWINDOW | STARTF_USESTDHANDLES;
-				startupInfo.wShowWindow = SW_SHOWNOACTIVATE;
-				startupInfo.hStdInput = hStdinRead;
-				startupInfo.hStdOutput = hStdOut;
-				startupInfo.hStdError = hStdOut;
-
-				// launch the process
-				PROCESS_INFORMATION procInfo;
-				if (CreateProcess(NULL, cmdline.data(), NULL, NULL, TRUE, CREATE_NO_WINDOW, 
-					NULL, NULL, &startupInfo, &procInfo))
-				{
-					// ffmpeg launched successfully.  Put the handles in holders
-					// so that we auto-close the handles when done with them.
-					HandleHolder hFfmpegProc(procInfo.hProcess);
-					HandleHolder hFfmpegThread(procInfo.hThread);
-
-					// close our copy of the child's stdin read handle
-					hStdinRead = NULL;
-
-					// copy the ffmpeg output log file to our log, if capturing a log
-					auto CopyOutputToLog = [&hStdOut, &fnameStdOut, &LogCommandLine](bool force)
-					{
-						// close our copy of the output file handle to make sure the
-						// file is really closed
-						hStdOut = nullptr;
-
-						// check if we're include capture logging
-						if (!LogFile::Get()->IsFeatureEnabled(LogFile::CaptureLogging))
-						{
-							// Capture logging is disabled, so we're not logging this by
-							// default.  Check for a 'force' override.
-							if (force)
-							{
-								// We're forcing the output, due to an error in the capture.
-								// In this case, we won't have logged the command line earlier,
-								// so do so now.
-								LogCommandLine(true);
-							}
-							else
-							{
-								// capture logging disabled, not forcing it; don't copy the output
-								return;
-							}
-						}
-
-						// if there's a log file, copy it
-						if (fnameStdOut.length() != 0)
-						{
-							// read the file
-							long len;
-							std::unique_ptr<BYTE> txt(ReadFileAsStr(fnameStdOut.c_str(), SilentErrorHandler(),
-								len, ReadFileAsStr_NewlineTerm | ReadFileAsStr_NullTerm));
-
-							// copy it to the log file
-							if (txt != nullptr)
-							{
-								// in case the log file contains null bytes, write it piecewise
-								// in null-terminated chunks
-								const BYTE *endp = txt.get() + len;
-								for (const BYTE *p = txt.get(); p < endp; )
-								{
-									// find the end of this null-terminated chunk
-									const BYTE *q;
-									for (q = p; q != endp && *q != 0; ++q);
-
-									// write this chunk
-									LogFile::Get()->WriteStrA((const char *)p);
-
-									// skip the null byte
-									p = q + 1;
-								}
-							}
-
-							// delete the temp file
-							DeleteFile(fnameStdOut.c_str());
-						}
-					};
-
-					// Wait for the process to finish, or for a shutdown or
-					// close-game event to interrupt it.  Also include the
-					// start/stop event as the last handle, but don't count
-					// it just yet - we'll only include it in the actual wait
-					// if we're in manual stop mode.
-					HANDLE h[] = { hFfmpegProc, hGameProc, shutdownEvent, closeEvent, startStopEvent };
-					static const TCHAR *waitName[] = {
-						_T("ffmpeg exited"), _T("game exited"), _T("app shutdown"), _T("user Exit Game command"), _T("Manual Stop")
-					};
-					DWORD nWaitHandles = countof(h) - 1;
-
-					// Check for Manual Stop mode.  This only applies on the
-					// capture pass (not on subsequent encode/compress passes).
-					if (item.manualStop && isCapturePass)
-					{
-						// include the manual stop event in the wait list
-						nWaitHandles += 1;
-
-						// set the capture status window to reflect manual stop mode
-						capture.statusWin->SetManualStopMode(true);
-
-						// clear any past manual start/stop signal
-						ResetEvent(startStopEvent);
-					}
-
-				WaitForFfmpeg:
-					// wait for the capture to finish
-					const TCHAR *waitResultName = nullptr;
-					switch (DWORD waitResult = WaitForMultipleObjects(nWaitHandles, h, FALSE, INFINITE))
-					{
-					case WAIT_OBJECT_0 + 4:
-						// The user pressed the Manual Stop button to terminate a manually
-						// timed capture.  Send ffmpeg the "Q" key on its stdin to stop
-						// the capture.
-						if (hStdinWrite != NULL)
-						{
-							static const char msg[] = "q\n";
-							DWORD actual;
-							WriteFile(hStdinWrite, msg, sizeof(msg) - 1, &actual, NULL);
-						}
-
-						// Now go back for another wait pass, this time removing the
-						// Manual Stop event from the wait list.  This gives ffmpeg a
-						// chance to exit before we proceed.
-						nWaitHandles -= 1;
-						goto WaitForFfmpeg;
-
-					case WAIT_OBJECT_0:
-						// The ffmpeg process finished successfully
-						{
-							// retrieve the process exit code
-							DWORD exitCode;
-							GetExitCodeProcess(hFfmpegProc, &exitCode);
-
-							// Copy the output to the log.  If the FFmpeg exit code was non-zero,
-							// log it even if capture logging is turned off in the options, since
-							// the error information is too useful to discard just because the
-							// user wasn't anticipating an error.
-							CopyOutputToLog(exitCode != 0);
-
-							// log the process exit code
-							LogFile::Get()->Write(LogFile::CaptureLogging,
-								_T("\n+ FFMPEG completed: process exit code %d\n"), (int)exitCode);
-
-							// consider this a success if the exit code was 0, otherwise consider
-							// it an error
-							if (exitCode == 0)
-							{
-								// success
-								result = true;
-
-								// log successful completion if desired
-								if (logSuccess)
-								{
-									// log the success
-									statusList.Error(MsgFmt(_T("%s: %s"), itemDesc.c_str(), LoadStringT(IDS_ERR_CAP_ITEM_OK).c_str()));
-
-									// count the success
-									nMediaItemsOk += 1;
-								}
-							}
-							else
-							{
-								// log the error
-								statusList.Error(MsgFmt(_T("%s: %s"), itemDesc.c_str(),
-									MsgFmt(IDS_ERR_CAP_ITEM_FFMPEG_ERR_LOGGED, (int)exitCode).Get()));
-								captureOkay = false;
-							}
-						}
-						break;
-
-					default:
-						// Error/unexpected wait result
-						waitResultName = _T("Error waiting for ffmpeg to exit");
-						goto Interruption;
-
-					case WAIT_OBJECT_0 + 1:
-					case WAIT_OBJECT_0 + 2:
-					case WAIT_OBJECT_0 + 3:
-						waitResultName = waitName[waitResult - WAIT_OBJECT_0];
-
-					Interruption:
-						// Shutdown event, close event, or premature game termination,
-						// or another error.  Count this as an interrupted capture.
-						statusList.Error(MsgFmt(_T("%s: %s"), itemDesc.c_str(), LoadStringT(IDS_ERR_CAP_ITEM_INTERRUPTED).c_str()));
-						captureOkay = false;
-						abortCapture = true;
-
-						// log it
-						CopyOutputToLog(false);
-						LogFile::Get()->Write(LogFile::CaptureLogging, _T("\n+ capture interrupted (%s)\n"), waitResultName);
-
-						// Send ffmpeg a "Q" key press on its stdin to try to shut
-						// it down immediately
-						if (hStdinWrite != NULL)
-						{
-							static const char msg[] = "q\n";
-							DWORD actual;
-							WriteFile(hStdinWrite, msg, sizeof(msg) - 1, &actual, NULL);
-						}
-						break;
-					}
-				}
-				else
-				{
-					// Error launching ffmpeg.  It's likely that all subsequent
-					// ffmpeg launch attempts will fail, because the problem is
-					// probably something permanent (e.g., ffmpeg.exe isn't
-					// installed where we expect it to be installed, or there's
-					// a file permissions problem).  So skip any remaining items
-					// by setting the 'abort' flag.
-					WindowsErrorMessage err;
-					LogFile::Get()->Write(LogFile::CaptureLogging, _T("+ FFMPEG launch failed: Win32 error %d, %s\n"), err.GetCode(), err.Get());
-					statusList.Error(MsgFmt(_T("%s: %s"), itemDesc.c_str(),	MsgFmt(IDS_ERR_CAP_ITEM_FFMPEG_LAUNCH, err.Get()).Get()));
-					captureOkay = false;
-					abortCapture = true;
-				}
-
-				// add a blank line to the log after the FFMPEG output, for readability 
-				LogFile::Get()->Group(LogFile::CaptureLogging);
-
-				// we're done with manual stop mode, if it was ever in effect
-				capture.statusWin->SetManualStopMode(false);
-
-				// return the operation status
-				return result;
-			};
-
 			// Run the first pass.  Only show the success status for the first pass
 			// if there will be no second pass, since we won't know if the overall
 			// operation is successful until after the second pass, if there is one.
 			// Pass 'capturePass' as true on this pass, since this is the actual
 			// screen capture phase, regardless of whether we're doing the capture 
 			// in one pass or two.
+			std::list<CaptureItem*> runItems{ &item };
 			bool twoPass = (cmdline2.length() != 0);
-			if (RunFFMPEG(cmdline1, !twoPass, true))
+			ULONGLONG t0 = GetTickCount64();
+			bool pass1Ok = RunFFMPEG(cmdline1, runItems, !twoPass, true);
+
+			// Record the capture overhead, beyond the item's capture time.
+			// Skip this in Manual Stop mode, since the running time is up to
+			// the user.
+			if (pass1Ok && !item.manualStop)
+				AddTimingSample(&item, CaptureTimeStats::Phase::Capture, SecondsSince(t0) - static_cast<float>(item.captureTime) / 1000.0f);
+
+			// we're done with the screen capture
+			if (dup != nullptr)
+				dup->Stop();
+
+			if (pass1Ok)
 			{
-				// success - if there's a second pass, run it
-				if (twoPass)
+				// Success - if there's a second pass, run it, or queue it
+				// if this is a pipelined batch capture
+				if (twoPass && encodeQueue != nullptr)
+				{
+					std::list<CaptureEncodeQueue::Pass> passes;
+					passes.emplace_back(MakeDeferredPass(cmdline2.c_str(), &item));
+					DeferEncoding(std::move(passes), runItems, tmpfile.c_str());
+
+					// the queue owns the temp file now
+					tmpfile = _T("");
+				}
+				else if (twoPass)
 				{
 					curStatus.Format(LoadStringT(IDS_CAPSTAT_ENCODING_ITEM), itemDesc.c_str());
 					capture.statusWin->SetCaptureStatus(curStatus.c_str(), item.captureTime*3/2);
-					RunFFMPEG(cmdline2, true, false);
+					ULONGLONG t0 = GetTickCount64();
+					if (RunFFMPEG(cmdline2, runItems, true, false) && item.captureTime != 0)
+						AddTimingSample(&item, CaptureTimeStats::Phase::Encode, SecondsSince(t0) * 1000.0f / item.captureTime);
 				}
 			}
 
@@ -4754,6 +6330,9 @@ DWORD Application::GameMonitorThread::Main()
 		// close the capture status window
 		capture.statusWin->PostMessage(WM_CLOSE);
 
+		// save the timing statistics from this capture
+		Application::Get()->captureTimeStats->Save();
+
 		// Display the results to the main window
 		if (playfieldView != nullptr)
 		{
@@ -4894,23 +6473,123 @@ void Application::GameMonitorThread::StealFocusFromGame(HWND hwndActive, HWND hw
 
 	// if we don't already have focus, grab it
 	if (!IsForegroundProcess())
+		TakeForeground(hwndActive, hwndFocus);
+
+	// watch for the game taking focus back for the next few seconds
+	focusHwndActive = hwndActive;
+	focusHwndFocus = hwndFocus;
+	focusRetakes = 0;
+	InstallFocusHook(FocusHookMode::HoldFocus, EVENT_SYSTEM_FOREGROUND, 3000);
+}
+
+void Application::GameMonitorThread::TakeForeground(HWND hwndActive, HWND hwndFocus)
+{
+	// inject a call in to the child process to set our window
+	// as the foreground
+	DWORD tid;
+	HandleHolder hRemoteThread = CreateRemoteThread(
+		hGameProc, NULL, 0,
+		(LPTHREAD_START_ROUTINE)&SetForegroundWindow, hwndActive,
+		0, &tid);
+
+	// explicitly set ourselves as the foreground window here, too,
+	// for good measure
+	BetterSetForegroundWindow(hwndActive, hwndFocus);
+}
+
+void Application::GameMonitorThread::InstallFocusHook(FocusHookMode mode, DWORD event, DWORD timeout_ms)
+{
+	// replace any existing hook
+	RemoveFocusHook();
+
+	// Hook the event in the game process.  Use the process ID of the
+	// actual game process, which differs from the process we launched
+	// in a two-stage launch.
+	DWORD gamePid = hGameProc != NULL ? GetProcessId(hGameProc) : 0;
+	if (gamePid == 0)
+		return;
+
+	focusHook = SetWinEventHook(event, event, NULL, &OnFocusEvent, gamePid, 0, WINEVENT_OUTOFCONTEXT);
+	if (focusHook != NULL)
+	{
+		focusHookMode = mode;
+		focusHookExpires = GetTickCount64() + timeout_ms;
+	}
+}
+
+void Application::GameMonitorThread::RemoveFocusHook()
+{
+	if (focusHook != NULL)
+	{
+		UnhookWinEvent(focusHook);
+		focusHook = NULL;
+	}
+	focusHookMode = FocusHookMode::None;
+}
+
+void CALLBACK Application::GameMonitorThread::OnFocusEvent(
+	HWINEVENTHOOK hook, DWORD event, HWND hwnd, LONG idObject, LONG idChild, DWORD, DWORD)
+{
+	// we're only interested in the windows themselves, not their contents
+	if (idObject != OBJID_WINDOW || idChild != CHILDID_SELF || hwnd == NULL)
+		return;
+
+	// The hook belongs to the current game monitor, which removes it
+	// before it's replaced.  If it's somehow not the current monitor's
+	// hook, it's stale, so just remove it.
+	auto mon = Application::Get()->gameMonitor.Get();
+	if (mon == nullptr || mon->focusHook != hook)
+	{
+		UnhookWinEvent(hook);
+		return;
+	}
+
+	// if the hook has expired, remove it
+	if (GetTickCount64() > mon->focusHookExpires)
+	{
+		mon->RemoveFocusHook();
+		return;
+	}
+
+	switch (mon->focusHookMode)
 	{
-		// inject a call in to the child process to set our window
-		// as the foreground
-		DWORD tid;
-		HandleHolder hRemoteThread = CreateRemoteThread(
-			hGameProc, NULL, 0,
-			(LPTHREAD_START_ROUTINE)&SetForegroundWindow, hwndActive,
-			0, &tid);
+	case FocusHookMode::HoldFocus:
+		// The game took the foreground back after we stole it for a
+		// Pause command.  Take it back again, up to the retry limit.
+		if (event == EVENT_SYSTEM_FOREGROUND)
+		{
+			if (++mon->focusRetakes > maxFocusRetakes)
+			{
+				LogFile::Get()->Write(LogFile::TableLaunchLogging,
+					_T("+ pause: the game keeps taking focus back; leaving it in the foreground\n"));
+				mon->RemoveFocusHook();
+				break;
+			}
+
+			mon->stolenFocusWindow = hwnd;
+			mon->TakeForeground(mon->focusHwndActive, mon->focusHwndFocus);
+		}
+		break;
 
-		// explicitly set ourselves as the foreground window here, too,
-		// for good measure
-		BetterSetForegroundWindow(hwndActive, hwndFocus);
+	case FocusHookMode::ShowGame:
+		// A window in the game process was shown during a Resume.  If
+		// it's a top-level window, bring it to the front.
+		if (IsWindowVisible(hwnd) && !IsIconic(hwnd) && GetWindowOwner(hwnd) == NULL)
+		{
+			mon->RemoveFocusHook();
+			BringWindowToTop(hwnd);
+			SetForegroundWindow(hwnd);
+			if (auto pfv = Application::Get()->GetPlayfieldView(); pfv != nullptr)
+				pfv->SendToBackForResumeGame();
+		}
+		break;
 	}
 }
 
 bool Application::GameMonitorThread::WaitForStartup(const TCHAR *exepath, HANDLE hProc)
 {
+	Trace::Scope trace("Wait for game startup", "launch", exepath);
+
 	// Determine the executable type
 	DWORD_PTR exeinfo;
 	SHFILEINFO shinfo;
@@ -4963,11 +6642,146 @@ bool Application::GameMonitorThread::WaitForStartup(const TCHAR *exepath, HANDLE
 }
 
 
+bool Application::GameMonitorThread::CreateGameJob(HANDLE hProc)
+{
+	auto Fail = [this](const TCHAR *what)
+	{
+		WindowsErrorMessage err;
+		LogFile::Get()->Write(LogFile::TableLaunchLogging,
+			_T("+ table launch: unable to set up the game job object (%s: %s); continuing without it\n"), what, err.Get());
+		hJob = NULL;
+		return false;
+	};
+
+	// Create the completion port, if we haven't already.  Note that we
+	// keep the port for the life of the monitor object, even if we fail
+	// to set up the job, since Shutdown() can post to it at any time.
+	if (hJobPort == NULL && (hJobPort = CreateIoCompletionPort(INVALID_HANDLE_VALUE, NULL, 0, 1)) == NULL)
+		return Fail(_T("CreateIoCompletionPort"));
+
+	// create the job
+	if ((hJob = CreateJobObject(NULL, NULL)) == NULL)
+		return Fail(_T("CreateJobObject"));
+
+	// Let processes that explicitly ask to break away from the job do
+	// so.  We don't impose any other limits; the job is purely for
+	// tracking.  In particular, we don't kill the job on close, since
+	// the game shouldn't depend on our lifetime.
+	JOBOBJECT_EXTENDED_LIMIT_INFORMATION limits;
+	ZeroMemory(&limits, sizeof(limits));
+	limits.BasicLimitInformation.LimitFlags = JOB_OBJECT_LIMIT_BREAKAWAY_OK;
+	if (!SetInformationJobObject(hJob, JobObjectExtendedLimitInformation, &limits, sizeof(limits)))
+		return Fail(_T("setting job limits"));
+
+	// associate it with the completion port
+	JOBOBJECT_ASSOCIATE_COMPLETION_PORT port;
+	port.CompletionKey = reinterpret_cast<PVOID>(jobPortKeyJob);
+	port.CompletionPort = hJobPort;
+	if (!SetInformationJobObject(hJob, JobObjectAssociateCompletionPortInformation, &port, sizeof(port)))
+		return Fail(_T("associating the completion port"));
+
+	// Add the process.  This can fail if we're in a job ourselves on
+	// versions of Windows before 8, which don't allow nested jobs.
+	if (!AssignProcessToJobObject(hJob, hProc))
+		return Fail(_T("AssignProcessToJobObject"));
+
+	// success
+	return true;
+}
+
+bool Application::GameMonitorThread::WaitForJobNewProcess(DWORD timeout)
+{
+	// wait for packets until we see a new process or run out of time
+	for (UINT64 tEnd = GetTickCount64() + timeout; ; )
+	{
+		// figure the remaining wait time
+		UINT64 now = GetTickCount64();
+		DWORD remaining = now < tEnd ? static_cast<DWORD>(tEnd - now) : 0;
+
+		// read the next packet
+		DWORD msg;
+		ULONG_PTR key;
+		LPOVERLAPPED ov;
+		if (!GetQueuedCompletionStatus(hJobPort, &msg, &key, &ov, remaining))
+			return false;
+
+		// a wakeup packet interrupts the wait
+		if (key == jobPortKeyWake)
+			return false;
+
+		// check for a new process; ignore other job notifications
+		if (key == jobPortKeyJob && msg == JOB_OBJECT_MSG_NEW_PROCESS)
+			return true;
+	}
+}
+
+thread_local bool Application::GameMonitorThread::WindowEventWaiter::eventFired = false;
+
+Application::GameMonitorThread::WindowEventWaiter::WindowEventWaiter(DWORD pid)
+{
+	// Hook window creation and show events in the process.  That range
+	// includes EVENT_OBJECT_DESTROY, which is harmless for our purposes:
+	// at worst it triggers a redundant window check.
+	eventFired = false;
+	hook = SetWinEventHook(EVENT_OBJECT_CREATE, EVENT_OBJECT_SHOW,
+		NULL, &OnWinEvent, pid, 0, WINEVENT_OUTOFCONTEXT);
+}
+
+Application::GameMonitorThread::WindowEventWaiter::~WindowEventWaiter()
+{
+	if (hook != NULL)
+		UnhookWinEvent(hook);
+}
+
+void CALLBACK Application::GameMonitorThread::WindowEventWaiter::OnWinEvent(
+	HWINEVENTHOOK, DWORD, HWND, LONG idObject, LONG idChild, DWORD, DWORD)
+{
+	// we're only interested in the windows themselves, not their contents
+	if (idObject == OBJID_WINDOW && idChild == CHILDID_SELF)
+		eventFired = true;
+}
+
+DWORD Application::GameMonitorThread::WindowEventWaiter::Wait(const HANDLE *handles, DWORD n, DWORD timeout)
+{
+	for (UINT64 tEnd = GetTickCount64() + timeout; ; )
+	{
+		// if a window event fired while we were processing messages, return it
+		if (eventFired)
+		{
+			eventFired = false;
+			return WAIT_OBJECT_0 + n;
+		}
+
+		// figure the remaining wait time
+		UINT64 now = GetTickCount64();
+		DWORD remaining = timeout == INFINITE ? INFINITE : now < tEnd ? static_cast<DWORD>(tEnd - now) : 0;
+
+		// Wait for the handles or a message.  On anything other than
+		// a message, return the result.
+		DWORD result = MsgWaitForMultipleObjects(n, handles, FALSE, remaining, QS_ALLINPUT);
+		if (result != WAIT_OBJECT_0 + n)
+			return result;
+
+		// Process messages.  The hook callbacks are delivered through
+		// the message queue.
+		MSG msg;
+		while (PeekMessage(&msg, NULL, 0, 0, PM_REMOVE))
+		{
+			TranslateMessage(&msg);
+			DispatchMessage(&msg);
+		}
+	}
+}
+
 bool Application::GameMonitorThread::Shutdown(ErrorHandler &eh, DWORD timeout, bool force)
 {
 	// set the shutdown event to tell background threads to exit
 	SetEvent(shutdownEvent);
 
+	// wake the thread if it's waiting on the job port
+	if (hJobPort != NULL)
+		PostQueuedCompletionStatus(hJobPort, 0, jobPortKeyWake, NULL);
+
 	// wait for the thread to exit, but not too long
 	DWORD result = WaitForSingleObject(hThread, timeout);
 	if (result == WAIT_OBJECT_0)
@@ -5671,6 +7485,10 @@ DWORD Application::NewFileScanThread::Main()
 			// appropriate
 			if (auto pfv = Application::Get()->GetPlayfieldView(); pfv != nullptr)
 				pfv->OnNewFilesAdded();
+
+			// index the new files' VP table metadata
+			if (nAdded != 0)
+				VPTableInfoIndex::UpdateFromGameList();
 		}
 
 		// the thread is now done with its work, so we can remove the
@@ -5693,8 +7511,71 @@ DWORD Application::NewFileScanThread::Main()
 
 
 
+WatchdogHeartbeat *Application::Watchdog::heartbeat = nullptr;
+
+Application::Watchdog::~Watchdog()
+{
+	// detach the heartbeat block from the tracer and unmap it
+	if (heartbeat != nullptr)
+	{
+		Trace::SetHeartbeat(nullptr);
+		UnmapViewOfFile(heartbeat);
+		heartbeat = nullptr;
+	}
+}
+
+void Application::Watchdog::SetHangTimeout(DWORD ms)
+{
+	hangTimeout_ms = ms;
+	if (heartbeat != nullptr)
+		heartbeat->hangTimeout_ms = ms;
+}
+
+void CALLBACK Application::Watchdog::HeartbeatTimerProc(HWND, UINT, UINT_PTR, DWORD)
+{
+	// Modal loops (message boxes, dialogs, menus) don't go through our
+	// main message loop, but they do dispatch thread timer messages, so
+	// this keeps the heartbeat going while one is open.
+	Heartbeat();
+}
+
+void Application::Watchdog::CreateHeartbeat()
+{
+	// Create the shared heartbeat block.  This is a named mapping, so
+	// that the watchdog can open it using our process ID.
+	WCHAR name[128];
+	WatchdogHeartbeat::GetMappingName(name, countof(name), GetCurrentProcessId());
+	hHeartbeatMap = CreateFileMapping(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, 0, sizeof(WatchdogHeartbeat), name);
+	if (hHeartbeatMap == NULL)
+		return;
+	auto hb = static_cast<WatchdogHeartbeat*>(MapViewOfFile(hHeartbeatMap, FILE_MAP_WRITE, 0, 0, sizeof(WatchdogHeartbeat)));
+	if (hb == nullptr)
+	{
+		hHeartbeatMap = NULL;
+		return;
+	}
+
+	// initialize it
+	ZeroMemory(hb, sizeof(*hb));
+	hb->size = sizeof(*hb);
+	hb->uiThreadId = GetCurrentThreadId();
+	hb->hangTimeout_ms = hangTimeout_ms;
+	GetExeFilePath(hb->reportFolder, countof(hb->reportFolder));
+	hb->signature = WatchdogHeartbeat::SIGNATURE;
+
+	// start stamping it, and recording the UI thread's trace scopes in it
+	heartbeat = hb;
+	Trace::SetHeartbeat(hb);
+	SetTimer(NULL, 0, 1000, &HeartbeatTimerProc);
+}
+
 void Application::Watchdog::Launch()
 {
+	// Set up the heartbeat block before launching the process, so that
+	// it's there when the watchdog looks for it.  We're on the UI thread
+	// here, which is the thread the heartbeat monitors.
+	CreateHeartbeat();
+
 	// create the pipes for communicating with the watchdog process
 	SECURITY_ATTRIBUTES sa;
 	sa.nLength = sizeof(sa);
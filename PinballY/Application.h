@@ -12,7 +12,9 @@
 #include "DMDWin.h"
 #include "TopperWin.h"
 #include "CaptureStatusWin.h"
+#include "CaptureEncodeQueue.h"
 #include "../Utilities/DateUtil.h"
+#include "../Utilities/WatchdogHeartbeat.h"
 #include "JavascriptEngine.h"
 
 struct ConfigFileDesc;
@@ -21,9 +23,11 @@ class DMDShader;
 class I420Shader;
 class I420AShader;
 class I444A10Shader;
+class NV12Shader;
 class PinscapeDevice;
 class HighScores;
 class RefTableList;
+class CaptureTimeStats;
 struct MediaType;
 
 class Application
@@ -53,15 +57,33 @@ public:
 	TSTRING gameStatsPath;
 
 	// Explicitly reload the configuration.  This reloads the settings
-	// file and rebuilds all game list data.
+	// file, and then rebuilds whatever depends on the changed variables:
+	// nothing beyond the subscribers' own updates if only "live" settings
+	// changed, the media if presentation settings changed, and the game
+	// list data if any of its settings changed.
 	bool ReloadConfig();
 
+	// Classify a changed config variable for ReloadConfig().  A "live"
+	// variable is fully applied by the config subscribers.  A non-game
+	// list variable doesn't affect the game list data.
+	static bool IsLiveConfigVar(const TSTRING &name);
+	static bool IsNonGameListConfigVar(const TSTRING &name);
+
 	// reload settings after a config change
 	void OnConfigChange();
 
 	// Save files.  This saves any in-memory changes to the configuration
-	// file and the game statistics file.
-	static void SaveFiles();
+	// file and the game statistics file.  The game database and stats
+	// files are written in the background; see BackgroundFileWriter.
+	// Unless 'flush' is true, game database files with a batch of game
+	// moves in progress are held back; returns true if any were, in
+	// which case the caller should save again later.
+	static bool SaveFiles(bool flush = false);
+
+	// Save files and wait for the background writes to complete.  Use
+	// this where the files have to be on disk when we return, such as
+	// before launching a game or at exit.
+	static void FlushFiles();
 
 	// Initialize a dialog window position.  A dialog proc can call this
 	// on receiving WM_INITDIALOG to set the dialog position to the last
@@ -150,6 +172,7 @@ public:
 	std::unique_ptr<I420Shader> i420Shader;
 	std::unique_ptr<I420AShader> i420AShader;
 	std::unique_ptr<I444A10Shader> i444A10Shader;
+	std::unique_ptr<NV12Shader> nv12Shader;
 
 	// Show one of our application windows.  If the window is currently
 	// hidden, we'll make it visible; if it's minimized, we'll restore it.
@@ -260,6 +283,11 @@ public:
 
 		// total estimated capture time (in seconds) for the entire batch
 		int totalTime;
+
+		// Deferred encoding queue, if the batch is using one.  In two-pass
+		// mode, each video's second pass goes into this queue to run in
+		// the background, rather than holding up the next game.
+		CaptureEncodeQueue *encodeQueue = nullptr;
 	};
 
 	// Launch flags
@@ -306,6 +334,14 @@ public:
 	// Launch the next game in the queue
 	bool LaunchNextQueuedGame(ErrorHandler &eh);
 
+	// Note that the UI has finished its pre-launch staging (shutting
+	// down DOF and the real DMD) for the current launch.  Under the
+	// GameLaunch.Overlap policy, the game monitor thread waits for this
+	// before it fires the RunBefore events and creates the game process.
+	// The UI calls this after starting the launch, whether or not the
+	// launch succeeded.
+	void NoteFrontendStaged();
+
 	// Remove the next game in the queue without launching it
 	void RemoveNextQueuedGame();
 
@@ -387,6 +423,33 @@ public:
 	void BeginRunningGameMode(GameListItem *game, GameSystem *system);
 	void EndRunningGameMode();
 
+	// Frontend scheduling while a game is running.  The game monitor
+	// thread applies this after launching the game, according to the
+	// GameScheduling.* settings: it confines our process to the cores
+	// reserved for it (if 'affinityMask' is non-zero), and optionally
+	// puts it in EcoQoS mode, so that our background threads don't
+	// compete with the game.  EndRunningGameMode() restores the original
+	// settings.  These can be called from any thread.
+	static void ApplyFrontendScheduling(DWORD_PTR affinityMask, bool ecoQoS);
+	static void RestoreFrontendScheduling();
+
+	// Yield resources to the running game.  The playfield view calls
+	// this after it has released its own media on entering run freeze
+	// mode, if the "yield resources" option is enabled.  This evicts
+	// all cached textures, trims the swap chains of the windows that
+	// are frozen, trims the D3D driver allocations, and empties the
+	// process working set.  Everything is restored on demand when we
+	// return to the UI.
+	void YieldResourcesToGame();
+
+	// Recover from a lost D3D device.  The message loop calls this when
+	// the device has been removed or reset, such as after a driver
+	// timeout or a driver update.  This re-creates the device in place
+	// and reloads the windows' graphics, without restarting the program.
+	// If the device can't be re-created, we try again on later idle
+	// passes, and give up and exit after several failures.
+	void RecoverD3DDevice();
+
 	// Clean up the game monitor thread
 	void CleanGameMonitor();
 
@@ -405,6 +468,17 @@ public:
 	// Set the playfield play-videos-in-background flag
 	static inline void SetPfPlayVideosInBackground(bool f) { pfPlayVideosInBackground = f; }
 
+	// Is the low-memory profile in effect?  This is the LowMemoryMode
+	// setting, which can be "auto" to enable the profile for the 32-bit
+	// build, and for video cards with less than 2GB of dedicated memory.
+	// If 'reason' is provided, we fill it in with a description of why
+	// the profile is or isn't in effect, for the log.
+	static bool IsLowMemoryMode(const TCHAR **reason = nullptr);
+
+	// Stamp the watchdog heartbeat.  The main message loop calls this on
+	// each pass, so that the watchdog can detect a hung UI thread.
+	static void Heartbeat() { Watchdog::Heartbeat(); }
+
 	// Get the first run time
 	DateTime GetFirstRunTime() const { return firstRunTime; }
 
@@ -448,7 +522,8 @@ public:
 	void UpdateVideoMute();
 
 	// Update the Pinscape device list.  Returns true if any Pinscape
-	// devices are currently active, false if not.
+	// devices are currently active, false if not.  This also starts
+	// an asynchronous refresh of each device's Night Mode status.
 	bool UpdatePinscapeDeviceList();
 
 	// Get the Pinscape Night Mode status.  The return value indicates
@@ -456,11 +531,12 @@ public:
 	// true means there's at least one Pinscape device, false means
 	// there aren't any devices.  If there are any Pinscape devices,
 	// nightMode is set to true if any of them are in night mode, false
-	// if not.
+	// if not.  This uses the devices' last known status, so it never
+	// waits for USB I/O.
 	bool GetPinscapeNightMode(bool &nightMode);
 
 	// Set the Pinscape Night Mode status.  This sets all devices to
-	// the new mode.
+	// the new mode.  The requests are sent to the devices asynchronously.
 	void SetPinscapeNightMode(bool nightMode);
 
 	// Toggle Pinscape Night Mode
@@ -503,8 +579,13 @@ public:
 	// Reference table list object
 	std::unique_ptr<RefTableList> refTableList;
 
-	// get the FFmpeg version string
-	const CHAR *GetFFmpegVersion() const { return ffmpegVersion.c_str(); }
+	// Capture timing statistics, for capture time estimates
+	std::unique_ptr<CaptureTimeStats> captureTimeStats;
+
+	// Get the FFmpeg version string, from the cached capability probe.
+	// This is empty if the version isn't known yet; in that case, we
+	// start a background probe, so it'll be available next time.
+	CSTRING GetFFmpegVersion() const;
 
 	// Javascript debugger options
 	JavascriptEngine::DebugOptions javascriptDebugOptions;
@@ -532,6 +613,12 @@ protected:
 
 	// global singleton instance
 	static Application *inst;
+
+	// D3D device recovery attempt tracking
+	int deviceRecoveryAttempts = 0;
+	DWORD lastDeviceRecoveryTime = 0;
+	static const int maxDeviceRecoveryAttempts = 5;
+	static const DWORD deviceRecoveryRetryInterval = 2000;
 	
 	// PinVol mail slot, if available
 	HandleHolder pinVolMailSlot;
@@ -676,9 +763,6 @@ protected:
 		return false;
 	}
 
-	// FFmpeg version, if available
-	CSTRING ffmpegVersion;
-
 	// Game monitor thread.  We launch a game by creating a monitor
 	// thread, which does the actual process launch and then monitors
 	// the process so that we know when it exits.
@@ -729,6 +813,51 @@ protected:
 		// false if an error occurs or we get a shutdown signal
 		bool WaitForStartup(const TCHAR *exepath, HANDLE pProc);
 
+		// Create a job object for the game's process tree, and add the
+		// given process to it.  The job is associated with a completion
+		// port, which receives a notification for each new process that
+		// the game launches.  Returns true on success.  On failure, we
+		// simply proceed without the job; it's only used to avoid some
+		// polling during the launch.
+		bool CreateGameJob(HANDLE hProc);
+
+		// Wait for a new process to start in the game's job.  Returns
+		// true if a new process started within the timeout, false on a
+		// timeout, error, or shutdown wakeup (see Shutdown()).
+		bool WaitForJobNewProcess(DWORD timeout);
+
+		// Window event waiter.  This installs a WinEvent hook for window
+		// creation and show events in a given process, so that the monitor
+		// thread can sleep until the game opens a window, rather than
+		// repeatedly enumerating windows while waiting for it.  The hook
+		// is out-of-context, so its callback runs on our own thread while
+		// Wait() is processing messages.
+		class WindowEventWaiter
+		{
+		public:
+			WindowEventWaiter(DWORD pid);
+			~WindowEventWaiter();
+
+			// did the hook install successfully?
+			bool IsHooked() const { return hook != NULL; }
+
+			// Wait for one of the handles to be signaled, a window event
+			// in the target process, or the timeout.  Returns WAIT_OBJECT_0+i
+			// for handle[i], WAIT_OBJECT_0+n for a window event, WAIT_TIMEOUT,
+			// or WAIT_FAILED.
+			DWORD Wait(const HANDLE *handles, DWORD n, DWORD timeout);
+
+		protected:
+			static void CALLBACK OnWinEvent(HWINEVENTHOOK hook, DWORD event, HWND hwnd,
+				LONG idObject, LONG idChild, DWORD idEventThread, DWORD dwmsEventTime);
+
+			// hook handle
+			HWINEVENTHOOK hook = NULL;
+
+			// flag: a window event has fired since the last Wait() return
+			static thread_local bool eventFired;
+		};
+
 		// thread main
 		static DWORD WINAPI SMain(LPVOID lpParam);
 		DWORD Main();
@@ -792,12 +921,47 @@ protected:
 		// batch capture information
 		BatchCaptureInfo batchCaptureInfo;
 
+		// deferred second-pass encoding queue, for a pipelined batch capture
+		RefPtr<CaptureEncodeQueue> encodeQueue;
+
 		// game inactivity timeout, in milliseconds
 		TSTRINGEx gameInactivityTimeout;
 
 		// hide the Windows taskbar while the game is running?
 		bool hideTaskbar;
 
+		// Scheduling policy while the game is running, from the
+		// GameScheduling.* settings: the priority class for the game
+		// process (0 to leave it as launched), the number of cores to
+		// reserve for our own process (0 to leave the affinities alone),
+		// and whether to put our process in EcoQoS mode
+		DWORD gamePriorityClass;
+		int frontendCores;
+		bool ecoQoS;
+
+		// apply the scheduling policy to the game process and to our own
+		void ApplySchedulingPolicy();
+
+		// Overlap the UI's pre-launch staging with the launch steps, per
+		// the GameLaunch.Overlap setting.  When this is set, the UI only
+		// queues the file saves before the launch, and shuts down DOF and
+		// the real DMD after starting the monitor thread.  The monitor
+		// thread waits for the file writes before creating the process,
+		// and waits for the staging event before firing the RunBefore
+		// events, so the game still gets the files on disk and the DOF
+		// and DMD devices released before it starts.
+		bool launchOverlap;
+
+		// Frontend staging event.  The UI sets this via NoteFrontendStaged()
+		// when it's done shutting down DOF and the real DMD.  This starts
+		// out set when the overlap policy is off, since the UI does the
+		// staging before the launch in that case.
+		HandleHolder frontendStagedEvent;
+
+		// wait for the frontend staging event; returns false if the
+		// thread is shutting down or the game was closed
+		bool WaitForFrontendStaging();
+
 		// Media capture information.  To avoid any cross-thread sync
 		// issues, we grab all of the information we need for media
 		// capture before we launch the game thread, and stash it here.
@@ -813,7 +977,9 @@ protected:
 				mediaRotation(0),
 				captureTime(0),
 				manualStart(false),
-				manualStop(false)
+				manualStop(false),
+				batched(false),
+				quality(-1)
 			{ }
 
 			// media type
@@ -856,10 +1022,27 @@ protected:
 			// manual start/stop mode
 			bool manualStart;
 			bool manualStop;
+
+			// Is this item part of the single-pass capture group?  In
+			// single-pass mode, all of the automatically timed videos are
+			// captured together in one ffmpeg session.
+			bool batched;
+
+			// Video encoder selection, for video items: the configured
+			// encoder ID ("auto", "software", "nvenc", "qsv", "amf") and
+			// quality level (-1 for the encoder default), and the resolved
+			// ffmpeg options for the final encoding and for the first pass
+			// of a two-pass capture.  The options are resolved on the
+			// monitor thread, since finding out which hardware encoders
+			// work requires running ffmpeg.
+			TSTRING encoderId;
+			int quality;
+			TSTRING vcodecOpts;
+			TSTRING vcodecPass1;
 		};
 		struct CaptureInfo
 		{
-			CaptureInfo() : startupDelay(5000), twoPassEncoding(false), videoResLimit(ResLimitNone) { }
+			CaptureInfo() : startupDelay(5000), twoPassEncoding(false), singlePass(false), desktopDuplication(false), videoResLimit(ResLimitNone) { }
 			
 			// initialization time (ms)
 			static const DWORD initTime = 3000;
@@ -873,7 +1056,16 @@ protected:
 			// two-pass encoding mode
 			bool twoPassEncoding;
 
-			// video codec options for pass 1 of a two-pass recording
+			// single-pass mode: capture all of the video items at once
+			bool singlePass;
+
+			// Use Desktop Duplication as the screen capture source, instead
+			// of ffmpeg's gdigrab?
+			bool desktopDuplication;
+
+			// video codec options for pass 1 of a two-pass recording, from
+			// the settings; if empty, we use the pass 1 options for each
+			// item's video encoder
 			TSTRING vcodecPass1;
 
 			// temporary file folder
@@ -903,6 +1095,17 @@ protected:
 		// handle to game process
 		HandleHolder hGameProc;
 
+		// Job object containing the game's process tree, and the I/O
+		// completion port that receives its notifications.  The job is
+		// only created for processes we launch directly (not through the
+		// Admin Host).  The port uses two completion keys: one for the
+		// job notifications, and one for our own wakeup packets, which
+		// Shutdown() posts to interrupt a wait on the port.
+		HandleHolder hJob;
+		HandleHolder hJobPort;
+		static const ULONG_PTR jobPortKeyJob = 1;
+		static const ULONG_PTR jobPortKeyWake = 2;
+
 		// game process ID
 		DWORD pid;
 
@@ -920,6 +1123,44 @@ protected:
 		// first place.
 		HWND stolenFocusWindow = NULL;
 
+		// Focus event hook.  A Pause command steals focus from the game,
+		// but the game can take it back as its windows finish activating
+		// (a full-screen game re-asserting itself, for example), which
+		// leaves the Pause menu hidden behind the game.  Rather than
+		// polling, we hook foreground changes in the game process for a
+		// few seconds after the steal, and take focus back each time the
+		// game grabs it.  Likewise, if there's no game window to bring
+		// forward on Resume, because the game hasn't shown it yet, we hook
+		// window show events in the process and bring the game forward
+		// when its window appears.
+		//
+		// The hook is out-of-context, so its callback runs on the thread
+		// that installed it.  The pause and resume commands come from the
+		// UI thread, so that's where the callbacks run, and the hook must
+		// only be installed and removed on the UI thread.
+		enum class FocusHookMode { None, HoldFocus, ShowGame };
+		void InstallFocusHook(FocusHookMode mode, DWORD event, DWORD timeout_ms);
+		void RemoveFocusHook();
+		static void CALLBACK OnFocusEvent(HWINEVENTHOOK hook, DWORD event, HWND hwnd,
+			LONG idObject, LONG idChild, DWORD idEventThread, DWORD dwmsEventTime);
+		HWINEVENTHOOK focusHook = NULL;
+		FocusHookMode focusHookMode = FocusHookMode::None;
+		UINT64 focusHookExpires = 0;
+
+		// our windows to activate when holding focus, and the number of
+		// times we've taken focus back since the steal
+		HWND focusHwndActive = NULL;
+		HWND focusHwndFocus = NULL;
+		int focusRetakes = 0;
+
+		// Limit on taking focus back after a steal.  If the game keeps
+		// grabbing focus, it's probably because the user is deliberately
+		// switching back to it, so stop fighting after a few tries.
+		static const int maxFocusRetakes = 5;
+
+		// take the foreground from the game
+		void TakeForeground(HWND hwndActive, HWND hwndFocus);
+
 		// Start/stop a manual capture.  The application calls this when
 		// the user presses the "proceed" button combination.
 		void ManualCaptureGo();
@@ -1042,20 +1283,50 @@ protected:
 	// state changes in effect after we exit.  For example, the
 	// watchdog will restore visibility of the taskbar window if
 	// we crash after hiding it.
+	//
+	// The watchdog also monitors the UI thread for hangs, through a
+	// shared heartbeat block (see WatchdogHeartbeat.h) that the UI
+	// thread stamps on each message loop pass.
 	struct Watchdog
 	{
+		~Watchdog();
+
 		// launch the watchdog process
 		void Launch();
 
 		// send a notification message to the watchdog process
 		void Notify(const char *msg);
 
+		// Stamp the heartbeat.  The main message loop calls this on each
+		// pass.  This is just a counter increment, so it's cheap.
+		static void Heartbeat()
+		{
+			if (heartbeat != nullptr)
+				heartbeat->counter = heartbeat->counter + 1;
+		}
+
+		// set the hang report timeout, in milliseconds (0 disables reports)
+		void SetHangTimeout(DWORD ms);
+
 		// process handle of the watchdog (we launch it as a child)
 		HandleHolder hProc;
 
 		// communications pipes
 		HandleHolder hPipeRead;
 		HandleHolder hPipeWrite;
+
+		// create the heartbeat block
+		void CreateHeartbeat();
+
+		// heartbeat timer procedure, for modal loops
+		static void CALLBACK HeartbeatTimerProc(HWND, UINT, UINT_PTR, DWORD);
+
+		// heartbeat shared memory block
+		HandleHolder hHeartbeatMap;
+		static WatchdogHeartbeat *heartbeat;
+
+		// hang timeout, as last set from the config
+		DWORD hangTimeout_ms = 30000;
 	};
 	Watchdog watchdog;
 
@@ -1222,6 +1493,13 @@ protected:
 	static bool playVideosInBackground;
 	static bool pfPlayVideosInBackground;
 
+	// Frontend scheduling state saved by ApplyFrontendScheduling(): our
+	// original affinity mask (0 if we haven't changed it), and whether
+	// we've turned on EcoQoS
+	static DWORD_PTR savedAffinityMask;
+	static bool ecoQoSApplied;
+	static CriticalSection frontendSchedLock;
+
 	// Pinscape device list
 	std::list<PinscapeDevice> pinscapeDevices;
 };
@@ -4,6 +4,9 @@
 #include "stdafx.h"
 #include "AudioManager.h"
 #include "GameList.h"
+#include "LogFile.h"
+#include "Trace.h"
+#include "MemoryStats.h"
 
 // statics
 AudioManager *AudioManager::inst;
@@ -36,85 +39,145 @@ AudioManager::AudioManager()
 
 AudioManager::~AudioManager()
 {
-	// Go through the cached sounds to check for items that are
-	// still playing.  Move each item that's actively playing to
-	// a separate pending list.
-	std::list<std::unique_ptr<DirectX::SoundEffect>> pending;
-	for (auto &s : cache)
+	// check for sounds that are still playing
+	auto IsPlaying = [this]()
 	{
-		// if it hasn't been updated, transfer it to the pending list
-		if (s.second->IsInUse())
-			pending.emplace_back(s.second.release());
-	}
-
-	// Anything left in the cache can now be deleted, as we 
-	// transfered all active items over to 'pending'.  We don't
-	// actually have to clear the cache manually, as the map
-	// destructor would do that anyway, but we might as well
-	// do that work while we're waiting for sounds to finish.
-	cache.clear();
+		for (auto &s : cache)
+		{
+			for (auto &v : s.second.voices)
+			{
+				if (v.inst->GetState() == DirectX::PLAYING)
+					return true;
+			}
+		}
+		return false;
+	};
 
-	// Now wait for the remaining sounds to finish, within reason
+	// wait for the remaining sounds to finish, within reason
 	DWORD t0 = GetTickCount();
-	while (pending.size() != 0 && GetTickCount() - t0 < 30000)
+	while (IsPlaying() && GetTickCount() - t0 < 30000)
 	{
 		// pause briefly
 		Sleep(15);
 
 		// do engine housekeeping
 		engine->Update();
+	}
 
-		// clean the pending list
-		CleanSoundList(pending);
+	// log the playback statistics
+	if (stats.plays != 0)
+	{
+		LogFile::Get()->Write(_T("Audio: %I64u sound effect playback(s), %I64u load(s) at play time, %I64u voice steal(s); ")
+			_T("start latency average %.2f ms, maximum %.2f ms\n"),
+			stats.plays, stats.loads, stats.steals, stats.avgLatencyMs, stats.maxLatencyMs);
 	}
 
-	// delete the DXTK audio engine object
+	// delete the sounds, then the DXTK audio engine object
+	cache.clear();
+	MemoryStats::AddCPU(MemoryStats::AudioCache, -cacheBytes);
+	cacheBytes = 0;
 	delete engine;
 }
 
-void AudioManager::PlayFile(const TCHAR *path, float volume)
+AudioManager::Sound *AudioManager::GetSound(const TCHAR *path, bool &loaded)
 {
-	// look for an existing instance in our cache
+	// look for an existing entry in our cache
+	loaded = false;
 	if (auto it = cache.find(path); it != cache.end())
+		return it->second.effect != nullptr ? &it->second : nullptr;
+
+	// Load the effect.  Add a cache entry even if the load fails, so that
+	// we don't keep trying to load a bad file on every button press.
+	loaded = true;
+	Sound &sound = cache[path];
+	auto effect = std::make_unique<DirectX::SoundEffect>(engine, path);
+	if (effect->GetFormat() == nullptr)
 	{
-		// got it - simply reuse the existing effect
-		it->second->Play(volume, 0.0f, 0.0f);
+		LogFile::Get()->Write(_T("Audio: unable to load sound effect %s\n"), path);
+		return nullptr;
 	}
-	else
+	sound.effect = std::move(effect);
+
+	// count the PCM data in the memory statistics
+	INT64 bytes = static_cast<INT64>(sound.effect->GetSampleSizeInBytes());
+	cacheBytes += bytes;
+	MemoryStats::AddCPU(MemoryStats::AudioCache, bytes);
+
+	// Set up the voice pool.  The instances only allocate their source
+	// voices on the first Play(), so play each one silently and stop it
+	// right away to get the voice allocated now.
+	sound.voices.resize(voicesPerSound);
+	for (auto &v : sound.voices)
 	{
-		// load the effect 
-		auto sound = std::make_unique<DirectX::SoundEffect>(engine, path);
-		if (sound->GetFormat() != nullptr)
-		{
-			// start it playing
-			sound->Play(volume, 0.0f, 0.0f);
-
-			// add it to the cache
-			cache.emplace(path, sound.release());
-		}
+		v.inst = sound.effect->CreateInstance();
+		v.inst->SetVolume(0.0f);
+		v.inst->Play();
+		v.inst->Stop(true);
+		v.volume = 0.0f;
 	}
+
+	return &sound;
 }
 
-void AudioManager::Update()
+bool AudioManager::Preload(const TCHAR *path)
 {
-	// update the engine
-	if (!engine->Update() && engine->IsCriticalError())
-		criticalError = true;
+	bool loaded;
+	return GetSound(path, loaded) != nullptr;
 }
 
-void AudioManager::CleanSoundList(std::list<std::unique_ptr<DirectX::SoundEffect>> &list)
+void AudioManager::PlayFile(const TCHAR *path, float volume)
 {
-	for (auto it = list.begin(); it != list.end(); )
+	// note the starting time, for the latency statistics
+	int64_t t0 = Trace::Now();
+
+	// find or load the sound
+	bool loaded;
+	Sound *sound = GetSound(path, loaded);
+	if (sound == nullptr)
+		return;
+
+	// Pick a voice: the first idle one, or failing that, the one that
+	// started playing longest ago.
+	Sound::Voice *voice = nullptr;
+	for (auto &v : sound->voices)
 	{
-		// remember the next item in case we unlink this one
-		auto nxt = it;
-		nxt++;
+		if (v.inst->GetState() != DirectX::PLAYING)
+		{
+			voice = &v;
+			break;
+		}
+		if (voice == nullptr || v.startSeq < voice->startSeq)
+			voice = &v;
+	}
 
-		// if this one is done, remove it
-		if (!(*it)->IsInUse())
-			list.erase(it);
+	// if we're stealing a busy voice, stop its current playback
+	bool steal = voice->inst->GetState() == DirectX::PLAYING;
+	if (steal)
+		voice->inst->Stop(true);
 
-		// move on to the next item
-		it = nxt;
+	// set the volume, if it's changed, and start playback
+	if (voice->volume != volume)
+	{
+		voice->inst->SetVolume(volume);
+		voice->volume = volume;
 	}
+	voice->inst->Play();
+	voice->startSeq = ++playSeq;
+
+	// update the statistics
+	static LARGE_INTEGER freq = []() { LARGE_INTEGER f; QueryPerformanceFrequency(&f); return f; }();
+	double ms = static_cast<double>(Trace::Now() - t0) * 1000.0 / static_cast<double>(freq.QuadPart);
+	stats.plays += 1;
+	stats.loads += loaded ? 1 : 0;
+	stats.steals += steal ? 1 : 0;
+	stats.avgLatencyMs += (ms - stats.avgLatencyMs) / static_cast<double>(stats.plays);
+	stats.maxLatencyMs = max(stats.maxLatencyMs, ms);
+	Trace::Counter("Sound effect start latency ms", ms);
+}
+
+void AudioManager::Update()
+{
+	// update the engine
+	if (!engine->Update() && engine->IsCriticalError())
+		criticalError = true;
 }
@@ -6,6 +6,7 @@
 #pragma once
 #include <Audio.h>
 #include <memory>
+#include <vector>
 #include <unordered_map>
 
 class AudioManager
@@ -23,6 +24,25 @@ public:
 	// Play a sound file.  The file is given as a full path.
 	void PlayFile(const TCHAR *filename, float volume = 1.0f);
 
+	// Preload a sound file and set up its voice pool.  This loads the
+	// PCM data into memory and allocates the XAudio2 voices ahead of
+	// time, so that the first playback doesn't have to wait for either.
+	// Returns true if the file loaded successfully.
+	bool Preload(const TCHAR *filename);
+
+	// Playback statistics.  The latency is the time from the PlayFile()
+	// call to the voice start, which is the part of the key-press-to-
+	// sound delay that happens on our side of the audio engine.
+	struct Stats
+	{
+		UINT64 plays = 0;           // number of playbacks
+		UINT64 loads = 0;           // playbacks that had to load the file first
+		UINT64 steals = 0;          // playbacks that stole a voice that was still playing
+		double avgLatencyMs = 0.0;  // average latency
+		double maxLatencyMs = 0.0;  // maximum latency
+	};
+	const Stats &GetStats() const { return stats; }
+
 	// Update.  This takes care of timed housekeeping work in the DXTK
 	// engine.  This must be called regularly, typically at the same
 	// time that we render a D3D frame.
@@ -42,13 +62,48 @@ protected:
 	// Critical audio engine error detected
 	bool criticalError;
 
-	// Sound cache.  This is a table of reusable sound effects,
-	// indexed by filename.  
-	std::unordered_map<TSTRING, std::unique_ptr<DirectX::SoundEffect>> cache;
+	// Cached sound.  Each sound has a fixed pool of effect instances,
+	// each of which holds on to its XAudio2 source voice between
+	// playbacks, so playing a sound never has to create a voice.  A
+	// playback uses an idle voice if there is one; otherwise it steals
+	// the voice that started longest ago.  Held-button autorepeat thus
+	// cycles through the same few voices instead of creating a new
+	// voice on every repeat.
+	struct Sound
+	{
+		// voice pool entry
+		struct Voice
+		{
+			std::unique_ptr<DirectX::SoundEffectInstance> inst;
+			float volume = -1.0f;   // current volume setting
+			UINT64 startSeq = 0;    // playback sequence number at last start
+		};
+
+		// the loaded PCM data
+		std::unique_ptr<DirectX::SoundEffect> effect;
+
+		// Voice pool.  This is declared after the effect, so that the
+		// instances are destroyed first, as DXTK requires.
+		std::vector<Voice> voices;
+	};
+
+	// Sound cache, indexed by filename
+	std::unordered_map<TSTRING, Sound> cache;
+
+	// total PCM data size of the cached sounds, for the memory statistics
+	INT64 cacheBytes = 0;
+
+	// number of voices per sound
+	static const int voicesPerSound = 4;
+
+	// find or load a sound
+	Sound *GetSound(const TCHAR *filename, bool &loaded);
+
+	// playback sequence counter, for the voice steal order
+	UINT64 playSeq = 0;
 
-	// Clean up a play list.  This takes a list of SoundEffect objects, scans
-	// it for finished items, and erases each item that's no longer playing.
-	void CleanSoundList(std::list<std::unique_ptr<DirectX::SoundEffect>> &list);
+	// statistics
+	Stats stats;
 
 	// construction and destruction are handled through our own static methods,
 	// so they're protected
@@ -0,0 +1,476 @@
+// This file is part of PinballY
+// Copyright 2018 Michael J Roberts | GPL v3 or later | NO WARRANTY
+//
+// Shared audio mixer
+
+#include "stdafx.h"
+#include <avrt.h>
+#include "AudioMixer.h"
+#include "LogFile.h"
+
+#pragma comment(lib, "avrt.lib")
+
+// statics
+AudioMixer *AudioMixer::inst = nullptr;
+bool AudioMixer::initTried = false;
+
+bool AudioMixer::Init()
+{
+	// only try once
+	if (inst != nullptr || initTried)
+		return inst != nullptr;
+	initTried = true;
+
+	// create the mixer and start the render thread
+	AudioMixer *m = new AudioMixer();
+	DWORD tid;
+	m->hThread = CreateThread(NULL, 0, &SThreadMain, m, 0, &tid);
+	if (m->hThread == NULL)
+	{
+		WindowsErrorMessage err;
+		LogFile::Get()->Write(_T("Audio mixer: unable to start the render thread (%s); using separate audio outputs\n"), err.Get());
+		delete m;
+		return false;
+	}
+
+	// wait for the thread to open the device
+	HANDLE h[] = { m->hReadyEvent, m->hThread };
+	WaitForMultipleObjects(countof(h), h, FALSE, INFINITE);
+	if (!m->deviceOk)
+	{
+		LogFile::Get()->Write(_T("Audio mixer: no output device available; using separate audio outputs\n"));
+		delete m;
+		return false;
+	}
+
+	LogFile::Get()->Write(_T("Audio mixer: %u Hz, %u channels, %hs samples, %.1f ms device buffer\n"),
+		m->deviceRate, m->deviceChannels, m->deviceFloat ? "float" : "16-bit",
+		static_cast<double>(m->bufferFrames) * 1000.0 / m->deviceRate);
+
+	inst = m;
+	return true;
+}
+
+void AudioMixer::Shutdown()
+{
+	delete inst;
+	inst = nullptr;
+}
+
+AudioMixer::AudioMixer()
+{
+	hQuitEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+	hBufferEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
+	hReadyEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+}
+
+AudioMixer::~AudioMixer()
+{
+	// stop the render thread
+	SetEvent(hQuitEvent);
+	if (hThread != NULL)
+		WaitForSingleObject(hThread, 5000);
+
+	// close the remaining sources, so that their producers stop waiting
+	// for buffer space
+	CriticalSectionLocker locker(lock);
+	for (auto &s : sources)
+		s->Close();
+	sources.clear();
+
+	// log statistics
+	if (stats.sources != 0)
+	{
+		LogFile::Get()->Write(_T("Audio mixer: %I64u streams, %I64u device periods, %I64u samples dropped, %u device resets\n"),
+			stats.sources, stats.periods, stats.dropped, stats.resets);
+	}
+}
+
+AudioMixer::Source *AudioMixer::CreateSource(UINT32 rate, UINT32 channels, float vol)
+{
+	Source *s = new Source(rate, channels, vol);
+
+	CriticalSectionLocker locker(lock);
+	sources.emplace_back(s, RefCounted::DoAddRef);
+	stats.sources += 1;
+	return s;
+}
+
+AudioMixer::Stats AudioMixer::GetStats()
+{
+	CriticalSectionLocker locker(lock);
+	return stats;
+}
+
+DWORD AudioMixer::ThreadMain()
+{
+	// WASAPI needs COM on this thread
+	CoInitializeEx(NULL, COINIT_MULTITHREADED);
+
+	// Register with MMCSS, so that the scheduler gives us priority over
+	// the UI and decoder threads.  A glitch in the mix is audible in
+	// every stream at once.
+	DWORD taskIndex = 0;
+	HANDLE hTask = AvSetMmThreadCharacteristics(_T("Pro Audio"), &taskIndex);
+
+	// open the device, and let Init() know how it went
+	deviceOk = OpenDevice();
+	SetEvent(hReadyEvent);
+
+	// render until told to quit
+	bool open = deviceOk;
+	while (deviceOk)
+	{
+		// If the device went away, try reopening it (whatever is the
+		// default device now) every second or so.  The sources keep
+		// buffering in the meantime, and drop what doesn't fit.
+		if (!open)
+		{
+			if (WaitForSingleObject(hQuitEvent, 1000) == WAIT_OBJECT_0)
+				break;
+
+			if ((open = OpenDevice()) != false)
+			{
+				CriticalSectionLocker locker(lock);
+				stats.resets += 1;
+			}
+			continue;
+		}
+
+		// wait for the device to ask for more data
+		HANDLE h[] = { hQuitEvent, hBufferEvent };
+		DWORD w = WaitForMultipleObjects(countof(h), h, FALSE, 200);
+		if (w == WAIT_OBJECT_0)
+			break;
+
+		// render a period; on failure, close the device and try again
+		if (HRESULT hr = RenderPeriod(); FAILED(hr))
+		{
+			LogFile::Get()->Write(_T("Audio mixer: render error %lx%s; reopening the device\n"),
+				static_cast<long>(hr), hr == AUDCLNT_E_DEVICE_INVALIDATED ? _T(" (device invalidated)") : _T(""));
+			CloseDevice();
+			open = false;
+		}
+	}
+
+	// clean up
+	CloseDevice();
+	if (hTask != NULL)
+		AvRevertMmThreadCharacteristics(hTask);
+	CoUninitialize();
+	return 0;
+}
+
+bool AudioMixer::OpenDevice()
+{
+	auto Error = [](HRESULT hr, const TCHAR *where)
+	{
+		LogFile::Get()->Write(_T("Audio mixer: %s failed, error %lx\n"), where, static_cast<long>(hr));
+		return false;
+	};
+
+	// get the default render device
+	HRESULT hr;
+	RefPtr<IMMDeviceEnumerator> enumerator;
+	if (FAILED(hr = CoCreateInstance(__uuidof(MMDeviceEnumerator), NULL, CLSCTX_ALL, IID_PPV_ARGS(&enumerator))))
+		return Error(hr, _T("creating the device enumerator"));
+
+	RefPtr<IMMDevice> device;
+	if (FAILED(hr = enumerator->GetDefaultAudioEndpoint(eRender, eConsole, &device)))
+		return Error(hr, _T("getting the default output device"));
+
+	RefPtr<IAudioClient> c;
+	if (FAILED(hr = device->Activate(__uuidof(IAudioClient), CLSCTX_ALL, NULL, reinterpret_cast<void**>(&c))))
+		return Error(hr, _T("activating the audio client"));
+
+	// Use the engine's mix format, so that the audio engine doesn't have
+	// to convert anything.  In shared mode this is almost always 32-bit
+	// float; we also handle 16-bit PCM, and give up on anything else.
+	WAVEFORMATEX *wfx = nullptr;
+	if (FAILED(hr = c->GetMixFormat(&wfx)))
+		return Error(hr, _T("getting the mix format"));
+	std::unique_ptr<WAVEFORMATEX, decltype(&CoTaskMemFree)> wfxHolder(wfx, &CoTaskMemFree);
+
+	// The extensible format's subtype GUIDs are the base format tags
+	// plugged into a template GUID, so we can just check the first field.
+	WORD tag = wfx->wFormatTag;
+	if (tag == WAVE_FORMAT_EXTENSIBLE)
+		tag = static_cast<WORD>(reinterpret_cast<WAVEFORMATEXTENSIBLE*>(wfx)->SubFormat.Data1);
+	bool isFloat = (tag == WAVE_FORMAT_IEEE_FLOAT && wfx->wBitsPerSample == 32);
+	if (!isFloat && !(tag == WAVE_FORMAT_PCM && wfx->wBitsPerSample == 16))
+	{
+		LogFile::Get()->Write(_T("Audio mixer: unsupported device mix format (tag %u, %u bits)\n"),
+			tag, wfx->wBitsPerSample);
+		return false;
+	}
+
+	// Initialize the stream in event-driven mode, with a 10ms buffer.
+	// The engine's own period is usually 10ms, so this is about as
+	// short as shared mode gets.
+	const REFERENCE_TIME bufferDuration = 100000;
+	if (FAILED(hr = c->Initialize(AUDCLNT_SHAREMODE_SHARED, AUDCLNT_STREAMFLAGS_EVENTCALLBACK | AUDCLNT_STREAMFLAGS_NOPERSIST,
+		bufferDuration, 0, wfx, NULL)))
+		return Error(hr, _T("initializing the audio stream"));
+
+	UINT32 nFrames;
+	RefPtr<IAudioRenderClient> r;
+	if (FAILED(hr = c->SetEventHandle(hBufferEvent))
+		|| FAILED(hr = c->GetBufferSize(&nFrames))
+		|| FAILED(hr = c->GetService(IID_PPV_ARGS(&r))))
+		return Error(hr, _T("setting up the audio stream"));
+
+	// start out with a buffer of silence
+	BYTE *data;
+	if (SUCCEEDED(r->GetBuffer(nFrames, &data)))
+		r->ReleaseBuffer(nFrames, AUDCLNT_BUFFERFLAGS_SILENT);
+
+	if (FAILED(hr = c->Start()))
+		return Error(hr, _T("starting the audio stream"));
+
+	// success - keep the objects and the format
+	client = c;
+	render = r;
+	deviceRate = wfx->nSamplesPerSec;
+	deviceChannels = wfx->nChannels;
+	deviceFloat = isFloat;
+	bufferFrames = nFrames;
+	mixBuf.resize(static_cast<size_t>(nFrames) * deviceChannels);
+
+	CriticalSectionLocker locker(lock);
+	stats.bufferMs = static_cast<double>(nFrames) * 1000.0 / deviceRate;
+	return true;
+}
+
+void AudioMixer::CloseDevice()
+{
+	if (client != nullptr)
+		client->Stop();
+	render = nullptr;
+	client = nullptr;
+}
+
+HRESULT AudioMixer::RenderPeriod()
+{
+	// figure how much space there is in the device buffer
+	HRESULT hr;
+	UINT32 padding;
+	if (FAILED(hr = client->GetCurrentPadding(&padding)))
+		return hr;
+	UINT32 frames = bufferFrames - padding;
+	if (frames == 0)
+		return S_OK;
+
+	BYTE *data;
+	if (FAILED(hr = render->GetBuffer(frames, &data)))
+		return hr;
+
+	// mix the sources, dropping closed sources that have played out
+	size_t n = static_cast<size_t>(frames) * deviceChannels;
+	std::fill(mixBuf.begin(), mixBuf.begin() + n, 0.0f);
+	bool any = false;
+	{
+		CriticalSectionLocker locker(lock);
+		for (auto it = sources.begin(); it != sources.end(); )
+		{
+			auto s = it->Get();
+			if (s->MixInto(mixBuf.data(), frames, deviceChannels, deviceRate, stats.dropped))
+				any = true;
+			else if (s->closed)
+			{
+				it = sources.erase(it);
+				continue;
+			}
+			++it;
+		}
+		stats.periods += 1;
+	}
+
+	// if nothing is playing, just tell the engine it's silence
+	if (!any)
+		return render->ReleaseBuffer(frames, AUDCLNT_BUFFERFLAGS_SILENT);
+
+	// convert to the device format, clipping to full scale
+	if (deviceFloat)
+	{
+		float *dst = reinterpret_cast<float*>(data);
+		for (size_t i = 0; i < n; ++i)
+			dst[i] = fminf(fmaxf(mixBuf[i], -1.0f), 1.0f);
+	}
+	else
+	{
+		INT16 *dst = reinterpret_cast<INT16*>(data);
+		for (size_t i = 0; i < n; ++i)
+			dst[i] = static_cast<INT16>(fminf(fmaxf(mixBuf[i], -1.0f), 1.0f) * 32767.0f);
+	}
+
+	return render->ReleaseBuffer(frames, 0);
+}
+
+// -----------------------------------------------------------------------
+//
+// Sources
+//
+
+AudioMixer::Source::Source(UINT32 rate, UINT32 channels, float vol) :
+	rate(rate), channels(channels), gain(vol), target(vol)
+{
+	ring.resize(static_cast<size_t>(rate) * channels * sourceBuffer_ms / 1000);
+	hSpaceEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
+}
+
+void AudioMixer::Source::Write(const float *samples, UINT32 frames)
+{
+	size_t n = static_cast<size_t>(frames) * channels;
+	while (n != 0 && !closed)
+	{
+		// copy as much as fits, in up to two pieces around the end of the ring
+		{
+			CriticalSectionLocker locker(lock);
+			size_t cap = ring.size();
+			size_t copy = min(n, cap - count);
+			size_t w = (readPos + count) % cap;
+			size_t first = min(copy, cap - w);
+			memcpy(&ring[w], samples, first * sizeof(float));
+			memcpy(&ring[0], samples + first, (copy - first) * sizeof(float));
+			count += copy;
+			samples += copy;
+			n -= copy;
+		}
+
+		// If there's more, wait for the render thread to make room.  If
+		// it doesn't within the time limit (because the device is gone,
+		// say), drop the rest rather than stalling the producer forever.
+		if (n != 0 && WaitForSingleObject(hSpaceEvent, writeTimeout_ms) == WAIT_TIMEOUT)
+		{
+			CriticalSectionLocker locker(lock);
+			dropped += n;
+			break;
+		}
+	}
+}
+
+void AudioMixer::Source::Flush()
+{
+	CriticalSectionLocker locker(lock);
+	readPos = count = 0;
+	frac = 0.0;
+	SetEvent(hSpaceEvent);
+}
+
+void AudioMixer::Source::Drain(DWORD timeout_ms)
+{
+	for (DWORD t0 = GetTickCount(); !closed && !paused && GetTickCount() - t0 < timeout_ms; )
+	{
+		{
+			CriticalSectionLocker locker(lock);
+			if (count == 0)
+				break;
+		}
+		WaitForSingleObject(hSpaceEvent, 20);
+	}
+}
+
+void AudioMixer::Source::SetVolume(float vol, DWORD fade_ms)
+{
+	CriticalSectionLocker locker(lock);
+	target = vol;
+	UINT32 fadeFrames = static_cast<UINT32>(static_cast<UINT64>(fade_ms) * rate / 1000);
+	if (fadeFrames == 0)
+	{
+		gain = vol;
+		step = 0.0f;
+	}
+	else
+		step = (target - gain) / static_cast<float>(fadeFrames);
+}
+
+void AudioMixer::Source::Close()
+{
+	closed = true;
+	SetEvent(hSpaceEvent);
+}
+
+bool AudioMixer::Source::MixInto(float *out, UINT32 frames, UINT32 outChannels, UINT32 outRate, UINT64 &droppedTotal)
+{
+	CriticalSectionLocker locker(lock);
+
+	// collect the dropped sample count
+	droppedTotal += dropped;
+	dropped = 0;
+
+	// if we're paused or empty, there's nothing to contribute
+	if (paused || count == 0)
+		return false;
+
+	// Figure the channel mapping: matching channels map straight across,
+	// and mono goes to both front channels.  Extra source channels are
+	// dropped, and extra device channels are left silent.
+	UINT32 nCh = min(channels, outChannels);
+	bool monoToStereo = (channels == 1 && outChannels >= 2);
+
+	// advance the fade by one frame
+	auto Fade = [this]()
+	{
+		if (step != 0.0f)
+		{
+			gain += step;
+			if ((step > 0.0f && gain >= target) || (step < 0.0f && gain <= target))
+			{
+				gain = target;
+				step = 0.0f;
+			}
+		}
+	};
+
+	size_t cap = ring.size();
+	UINT32 i = 0;
+	if (rate == outRate)
+	{
+		// same rate - straight copy with gain
+		for (; i < frames && count >= channels; ++i, out += outChannels)
+		{
+			Fade();
+			for (UINT32 c = 0; c < nCh; ++c)
+				out[c] += ring[(readPos + c) % cap] * gain;
+			if (monoToStereo)
+				out[1] += ring[readPos] * gain;
+
+			readPos = (readPos + channels) % cap;
+			count -= channels;
+		}
+	}
+	else
+	{
+		// Rate mismatch - linear interpolation between adjacent source
+		// frames.  This only happens when the device was reset with a
+		// new format mid-stream, so quality isn't critical.
+		double srcStep = static_cast<double>(rate) / static_cast<double>(outRate);
+		for (; i < frames && count >= channels * 2; ++i, out += outChannels)
+		{
+			Fade();
+			float f = static_cast<float>(frac);
+			for (UINT32 c = 0; c < nCh; ++c)
+			{
+				float a = ring[(readPos + c) % cap], b = ring[(readPos + channels + c) % cap];
+				out[c] += (a + (b - a) * f) * gain;
+			}
+			if (monoToStereo)
+			{
+				float a = ring[readPos], b = ring[(readPos + 1) % cap];
+				out[1] += (a + (b - a) * f) * gain;
+			}
+
+			// advance the read position by the whole source frames we passed
+			frac += srcStep;
+			size_t adv = static_cast<size_t>(frac);
+			frac -= static_cast<double>(adv);
+			adv = min(adv * channels, count);
+			readPos = (readPos + adv) % cap;
+			count -= adv;
+		}
+	}
+
+	// let the producer know there's room
+	SetEvent(hSpaceEvent);
+	return i != 0;
+}
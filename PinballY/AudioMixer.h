@@ -0,0 +1,191 @@
+// This file is part of PinballY
+// Copyright 2018 Michael J Roberts | GPL v3 or later | NO WARRANTY
+//
+// Shared audio mixer
+//
+// Left to its own devices, libvlc opens a separate audio output stream
+// for every media player, each with its own resampler and buffering, and
+// we can easily have several players making sound at once: the table
+// audio, the launch audio, and the audio tracks of the playfield and
+// backglass videos.  Instead, we have libvlc deliver the decoded PCM to
+// us through its audio callbacks, and we mix all of the streams into a
+// single WASAPI shared-mode stream on the default output device.
+//
+// Each player gets a Source, which buffers its samples until the render
+// thread mixes them.  Each source has its own gain, with linear fades
+// between levels, so a volume change or mute is just a couple of stores
+// under the source's lock, rather than a trip through libvlc.
+//
+// libvlc converts each stream to stereo float samples at the device's
+// sample rate before handing it to us, so the mixer normally only has
+// to apply the gains and sum.  If the device is reset with a different
+// format while a stream is playing, we fall back on simple linear
+// interpolation for the rest of that stream.
+
+#pragma once
+#include <list>
+#include <vector>
+#include <mmdeviceapi.h>
+#include <audioclient.h>
+#include "../Utilities/Pointers.h"
+#include "../Utilities/WinUtil.h"
+
+class AudioMixer
+{
+public:
+	// Initialize the global singleton.  This opens the output device and
+	// starts the render thread.  Returns false if the device couldn't be
+	// opened, in which case players should use their own audio output.
+	// We only try once per session.
+	static bool Init();
+
+	// shut down and delete the global singleton
+	static void Shutdown();
+
+	// get the global singleton; null if the mixer isn't running
+	static AudioMixer *Get() { return inst; }
+
+	// Mixer source.  The producer (a libvlc audio thread) writes samples
+	// into the source's buffer, and the render thread mixes them out.
+	class Source : public RefCounted
+	{
+	public:
+		// Write interleaved float samples.  If the buffer is full, this
+		// waits for the render thread to make room, up to a time limit,
+		// which paces the producer against the device clock.
+		void Write(const float *samples, UINT32 frames);
+
+		// discard buffered samples
+		void Flush();
+
+		// wait for the buffered samples to play out, up to a time limit
+		void Drain(DWORD timeout_ms);
+
+		// pause/resume mixing
+		void Pause(bool pause) { paused = pause; }
+
+		// Set the volume, as a linear gain (1.0 = unity).  The gain moves
+		// to the new level linearly over 'fade_ms' milliseconds.
+		void SetVolume(float vol, DWORD fade_ms);
+
+		// Close the source.  The render thread drops it from the mix
+		// once the buffer has played out.
+		void Close();
+
+	protected:
+		friend class AudioMixer;
+		Source(UINT32 rate, UINT32 channels, float vol);
+		~Source() { }
+
+		// Mix up to 'frames' frames into 'out', which is in the device
+		// format (interleaved, 'outChannels' per frame, at 'outRate').
+		// Returns true if we contributed any samples.
+		bool MixInto(float *out, UINT32 frames, UINT32 outChannels, UINT32 outRate, UINT64 &dropped);
+
+		// sample format
+		UINT32 rate;
+		UINT32 channels;
+
+		// Sample ring buffer.  'readPos' and 'count' are in samples
+		// (not frames).  These are protected by the lock.
+		CriticalSection lock;
+		std::vector<float> ring;
+		size_t readPos = 0;
+		size_t count = 0;
+
+		// fractional read position, for resampling on a rate mismatch
+		double frac = 0.0;
+
+		// current gain, target gain, and per-frame fade step
+		float gain;
+		float target;
+		float step = 0.0f;
+
+		// samples dropped because the buffer was full
+		UINT64 dropped = 0;
+
+		// space event - signaled when the render thread consumes samples
+		HandleHolder hSpaceEvent;
+
+		// status flags
+		volatile bool paused = false;
+		volatile bool closed = false;
+	};
+
+	// Create a source.  'rate' and 'channels' give the format of the
+	// samples the producer will write; 'vol' is the initial gain.  The
+	// returned object carries a reference on behalf of the caller.
+	Source *CreateSource(UINT32 rate, UINT32 channels, float vol);
+
+	// Get the device sample rate.  Producers should deliver samples at
+	// this rate when they can, to avoid resampling in the mixer.
+	UINT32 GetSampleRate() const { return deviceRate; }
+
+	// Statistics
+	struct Stats
+	{
+		UINT64 sources = 0;      // number of sources created
+		UINT64 periods = 0;      // number of device buffer periods rendered
+		UINT64 dropped = 0;      // samples dropped because a source buffer was full
+		UINT32 resets = 0;       // number of times we had to reopen the device
+		double bufferMs = 0.0;   // device buffer length
+	};
+	Stats GetStats();
+
+	// source buffer length, in milliseconds
+	static const DWORD sourceBuffer_ms = 100;
+
+	// maximum time to wait for buffer space in Write()
+	static const DWORD writeTimeout_ms = 500;
+
+protected:
+	AudioMixer();
+	~AudioMixer();
+
+	// global singleton instance
+	static AudioMixer *inst;
+
+	// have we tried to initialize yet?
+	static bool initTried;
+
+	// Open/close the default output device.  These run on the render
+	// thread, so that all of the WASAPI objects live in its apartment.
+	bool OpenDevice();
+	void CloseDevice();
+
+	// render one device period
+	HRESULT RenderPeriod();
+
+	// render thread entrypoint
+	static DWORD WINAPI SThreadMain(LPVOID param) { return static_cast<AudioMixer*>(param)->ThreadMain(); }
+	DWORD ThreadMain();
+
+	// device objects
+	RefPtr<IAudioClient> client;
+	RefPtr<IAudioRenderClient> render;
+
+	// device format
+	UINT32 deviceRate = 48000;
+	UINT32 deviceChannels = 2;
+	bool deviceFloat = true;
+	UINT32 bufferFrames = 0;
+
+	// mixing buffer, in the device layout, as floats
+	std::vector<float> mixBuf;
+
+	// active sources; protected by the lock
+	std::list<RefPtr<Source>> sources;
+	CriticalSection lock;
+
+	// statistics; protected by the lock
+	Stats stats;
+
+	// render thread, and its events
+	HandleHolder hThread;
+	HandleHolder hQuitEvent;
+	HandleHolder hBufferEvent;
+	HandleHolder hReadyEvent;
+
+	// did the initial device open succeed?
+	bool deviceOk = false;
+};
@@ -8,6 +8,14 @@
 DWORD AudioVideoPlayer::nextCookie = 1;
 std::list<RefPtr<AudioVideoPlayer>> AudioVideoPlayer::pendingDeletion;
 CriticalSection AudioVideoPlayer::pendingDeletionLock;
+std::list<AudioVideoPlayer*> AudioVideoPlayer::retireQueue;
+HandleHolder AudioVideoPlayer::hRetireThread;
+HandleHolder AudioVideoPlayer::hRetireEvent;
+bool AudioVideoPlayer::retireStarted = false;
+bool AudioVideoPlayer::retireShuttingDown = false;
+HWND AudioVideoPlayer::hwndRetireNotify = NULL;
+UINT AudioVideoPlayer::retireNotifyMsg = 0;
+CriticalSection AudioVideoPlayer::retireLock;
 
 AudioVideoPlayer::AudioVideoPlayer(HWND hwndVideo, HWND hwndEvent, bool audioOnly) :
 	hwndVideo(hwndVideo),
@@ -75,3 +83,110 @@ void AudioVideoPlayer::WaitForDeletionQueue(DWORD timeout)
 		Sleep(100);
 	}
 }
+
+bool AudioVideoPlayer::StartRetirementWorker()
+{
+	// if we've already started, there's nothing to do
+	if (retireStarted)
+		return hRetireThread != NULL;
+
+	// only try once
+	retireStarted = true;
+
+	// create the work event
+	hRetireEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
+	if (hRetireEvent == NULL)
+		return false;
+
+	// launch the thread
+	DWORD tid;
+	hRetireThread = CreateThread(NULL, 0, &RetireThreadMain, nullptr, 0, &tid);
+	if (hRetireThread == NULL)
+		return false;
+
+	// bump down the priority so that the shutdowns don't glitch the UI
+	SetThreadPriority(hRetireThread, THREAD_PRIORITY_BELOW_NORMAL);
+	return true;
+}
+
+void AudioVideoPlayer::Retire(AudioVideoPlayer *player)
+{
+	// Add the player to the pending deletion queue.  Do this right away,
+	// rather than after the shutdown, so that WaitForDeletionQueue() sees
+	// players that are still waiting for the worker.
+	player->SetPendingDeletion();
+
+	// queue it for the worker
+	{
+		CriticalSectionLocker locker(retireLock);
+		if (!retireShuttingDown && StartRetirementWorker())
+		{
+			retireQueue.push_back(player);
+			SetEvent(hRetireEvent);
+			return;
+		}
+	}
+
+	// the worker isn't available, so shut it down inline
+	player->Shutdown();
+	player->Release();
+	ProcessDeletionQueue();
+}
+
+void AudioVideoPlayer::SetRetirementNotify(HWND hwnd, UINT msg)
+{
+	CriticalSectionLocker locker(retireLock);
+	hwndRetireNotify = hwnd;
+	retireNotifyMsg = msg;
+}
+
+void AudioVideoPlayer::ShutdownRetirementWorker()
+{
+	// tell the thread to exit once the queue is empty, and wait for it
+	{
+		CriticalSectionLocker locker(retireLock);
+		retireShuttingDown = true;
+		hwndRetireNotify = NULL;
+		if (hRetireEvent != NULL)
+			SetEvent(hRetireEvent);
+	}
+	if (hRetireThread != NULL)
+		WaitForSingleObject(hRetireThread, 5000);
+}
+
+DWORD WINAPI AudioVideoPlayer::RetireThreadMain(LPVOID)
+{
+	for (;;)
+	{
+		// wait for work
+		WaitForSingleObject(hRetireEvent, INFINITE);
+
+		// shut down the queued players
+		for (;;)
+		{
+			AudioVideoPlayer *player;
+			{
+				CriticalSectionLocker locker(retireLock);
+				if (retireQueue.size() == 0)
+				{
+					if (retireShuttingDown)
+						return 0;
+					break;
+				}
+				player = retireQueue.front();
+				retireQueue.pop_front();
+			}
+
+			// Stop playback, and drop the queue's reference.  The pending
+			// deletion queue still has its reference, so the object itself
+			// is always deleted on the UI thread.
+			player->Shutdown();
+			player->Release();
+
+			// let the UI thread know that the player can be deleted
+			CriticalSectionLocker locker(retireLock);
+			if (hwndRetireNotify != NULL)
+				PostMessage(hwndRetireNotify, retireNotifyMsg, 0, 0);
+		}
+	}
+}
@@ -72,6 +72,25 @@ public:
 	// Wait for the deletion queue to empty
 	static void WaitForDeletionQueue(DWORD timeout = INFINITE);
 
+	// Retire a player.  This takes over the caller's reference, adds
+	// the player to the pending deletion queue, and hands it to the
+	// retirement worker, a single long-lived background thread that
+	// shuts down playback.  The libvlc "stop" call can block for a
+	// noticeable time while libvlc waits for its own threads to exit,
+	// so we keep it off the UI thread.  The shutdown returns the libvlc
+	// player to the idle player pool when there's room.  Each time a
+	// player is ready to delete, the worker posts the notification
+	// message set with SetRetirementNotify() to the UI window, which
+	// should respond by calling ProcessDeletionQueue().
+	static void Retire(AudioVideoPlayer *player);
+
+	// Set the window and message for retirement notifications
+	static void SetRetirementNotify(HWND hwnd, UINT msg);
+
+	// Stop the retirement worker.  This finishes the queued shutdowns
+	// first.  Call at program exit.
+	static void ShutdownRetirementWorker();
+
 	// Get this playback session's cookie.  This is an ID for the
 	// object, generated at construction, that's meant to be unique 
 	// over the lifetime of the process.  (It's not unique across 
@@ -100,6 +119,11 @@ public:
 	// replay from the beginning
 	virtual bool Replay(ErrorHandler &eh) = 0;
 
+	// Pause or resume playback.  A paused player holds its current frame
+	// and stops decoding, which saves the decoding work for media that's
+	// loaded but not on screen.  Players that can't pause ignore this.
+	virtual void SetPause(bool pause) { }
+
 	// Is playback running?  This returns true after the first
 	// "session started" event fires.
 	virtual bool IsPlaying() const = 0;
@@ -107,12 +131,41 @@ public:
 	// Is a frame ready yet?
 	virtual bool IsFrameReady() const = 0;
 
+	// Is a new frame waiting to be rendered?  This returns true when
+	// the decoder has presented a frame that hasn't been rendered yet,
+	// so that the caller can skip redrawing when the video image
+	// hasn't changed since the last render.
+	virtual bool IsFrameAvailable() const = 0;
+
+	// Get the frame serial number.  This counts the frames that the
+	// player has uploaded for rendering.  When several sprites share
+	// one player, only the first render after a new frame arrives sees
+	// IsFrameAvailable(), so the other sprites use the serial number
+	// to tell that the image has changed since their own last render.
+	virtual UINT64 GetFrameSerial() const { return 0; }
+
+	// Add/remove an additional event window.  A player that's shared
+	// among sprites in several windows sends the AVPMsgFirstFrameReady
+	// notification to each window, so that each window can start its
+	// own cross-fade.  The other events go only to the main event
+	// window; if the main event window is removed, the next added
+	// window takes over that role.
+	virtual void AddEventWindow(HWND hwnd) { }
+	virtual void RemoveEventWindow(HWND hwnd) { }
+
 	// Set looping playback.  When set, we'll automatically
 	// restart the video from the beginning whenever we reach
 	// the end.
 	virtual void SetLooping(bool f) = 0;
 	virtual bool IsLooping() const = 0;
 
+	// Does the player handle looping internally?  A player that loops
+	// internally still sends AVPMsgLoopNeeded each time the playback
+	// wraps around, as a notification, but the playback has already
+	// restarted by the time the message arrives, so the event window
+	// shouldn't call Replay() in response.
+	virtual bool IsLoopHandledInPlayer() const { return false; }
+
 	// Mute audio
 	virtual void Mute(bool f) = 0;
 	virtual bool IsMute() const = 0;
@@ -174,4 +227,21 @@ protected:
 
 	// deletion queue resource lock
 	static CriticalSection pendingDeletionLock;
+
+	// Retirement worker.  The queue holds a reference on each player
+	// until the worker has shut it down.
+	static std::list<AudioVideoPlayer*> retireQueue;
+	static HandleHolder hRetireThread;
+	static HandleHolder hRetireEvent;
+	static bool retireStarted;
+	static bool retireShuttingDown;
+	static HWND hwndRetireNotify;
+	static UINT retireNotifyMsg;
+	static CriticalSection retireLock;
+
+	// start the worker thread, if we haven't already
+	static bool StartRetirementWorker();
+
+	// worker thread entrypoint
+	static DWORD WINAPI RetireThreadMain(LPVOID);
 };
@@ -137,7 +137,7 @@ bool BackglassBaseView::ShowInstructionCard(const TCHAR *filename)
 	{
 		// start the fade, and start the timer to monitor for completion
 		instructionCard->StartFade(1, instCardFadeTime);
-		SetTimer(hWnd, animTimerID, animTimerInterval, 0);
+		StartAnimation();
 	}
 
 	// update the drawing list with the card
@@ -154,7 +154,7 @@ void BackglassBaseView::RemoveInstructionCard()
 	{
 		// start the fade-out, and set the timer to monitor for completion
 		instructionCard->StartFade(-1, instCardFadeTime);
-		SetTimer(hWnd, animTimerID, animTimerInterval, 0);
+		StartAnimation();
 	}
 }
 
@@ -0,0 +1,258 @@
+// This file is part of PinballY
+// Copyright 2018 Michael J Roberts | GPL v3 or later | NO WARRANTY
+//
+// Background file writer
+
+#include "stdafx.h"
+#include "BackgroundFileWriter.h"
+#include "Application.h"
+#include "LogFile.h"
+#include "Resource.h"
+
+// statics
+std::list<BackgroundFileWriter::Item> BackgroundFileWriter::pending;
+bool BackgroundFileWriter::busy = false;
+bool BackgroundFileWriter::flushing = false;
+HandleHolder BackgroundFileWriter::hThread;
+HandleHolder BackgroundFileWriter::hWorkEvent;
+HandleHolder BackgroundFileWriter::hIdleEvent;
+bool BackgroundFileWriter::started = false;
+bool BackgroundFileWriter::shuttingDown = false;
+CriticalSection BackgroundFileWriter::lock;
+
+bool BackgroundFileWriter::Start()
+{
+	// if we've already started, there's nothing to do
+	if (started)
+		return hThread != NULL;
+
+	// only try once
+	started = true;
+
+	// create the events; the idle event starts out signaled, since
+	// there's nothing to write yet
+	hWorkEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
+	hIdleEvent = CreateEvent(NULL, TRUE, TRUE, NULL);
+	if (hWorkEvent == NULL || hIdleEvent == NULL)
+		return false;
+
+	// launch the thread
+	DWORD tid;
+	hThread = CreateThread(NULL, 0, &ThreadMain, nullptr, 0, &tid);
+	if (hThread == NULL)
+		return false;
+
+	// bump down the priority so that the writes don't glitch the UI
+	SetThreadPriority(hThread, THREAD_PRIORITY_BELOW_NORMAL);
+	return true;
+}
+
+void BackgroundFileWriter::Write(const TCHAR *filename, std::vector<BYTE> &&contents,
+	bool backup, const TCHAR *errorSummary, std::function<void(bool ok)> onWritten)
+{
+	{
+		CriticalSectionLocker locker(lock);
+
+		// If the writer thread is running, queue the write.  If there's
+		// already a write pending for the same file, replace its contents.
+		// Keep the backup flag if either request asked for it, since the
+		// earlier request might be the one that's supposed to save the
+		// original file.
+		if (!shuttingDown && Start())
+		{
+			auto it = std::find_if(pending.begin(), pending.end(),
+				[filename](const Item &i) { return _tcsicmp(i.filename.c_str(), filename) == 0; });
+			if (it != pending.end())
+			{
+				it->contents = std::move(contents);
+				it->backup |= backup;
+				if (errorSummary != nullptr)
+					it->errorSummary = errorSummary;
+				it->onWritten = std::move(onWritten);
+			}
+			else
+				pending.push_back({ filename, std::move(contents), backup, errorSummary != nullptr ? errorSummary : _T(""), std::move(onWritten) });
+
+			ResetEvent(hIdleEvent);
+			SetEvent(hWorkEvent);
+			return;
+		}
+	}
+
+	// the writer isn't available, so write the file inline
+	WriteItem({ filename, std::move(contents), backup, errorSummary != nullptr ? errorSummary : _T(""), std::move(onWritten) });
+}
+
+void BackgroundFileWriter::Flush()
+{
+	// if the thread never started, there's nothing pending
+	if (hThread == NULL)
+		return;
+
+	// tell the writer to skip the coalescing delay, and wake it up
+	{
+		CriticalSectionLocker locker(lock);
+		if (pending.size() == 0 && !busy)
+			return;
+
+		flushing = true;
+		SetEvent(hWorkEvent);
+	}
+
+	// wait for the writer to go idle
+	WaitForSingleObject(hIdleEvent, INFINITE);
+}
+
+void BackgroundFileWriter::Shutdown()
+{
+	// complete the pending writes
+	Flush();
+
+	// tell the thread to exit, and wait for it
+	{
+		CriticalSectionLocker locker(lock);
+		shuttingDown = true;
+		if (hWorkEvent != NULL)
+			SetEvent(hWorkEvent);
+	}
+	if (hThread != NULL)
+		WaitForSingleObject(hThread, 5000);
+}
+
+void BackgroundFileWriter::WriteItem(const Item &item)
+{
+	CapturingErrorHandler eh;
+	auto Finish = [&eh, &item]()
+	{
+		bool ok = eh.CountErrors() == 0;
+		if (ok)
+			LogFile::Get()->Write(_T("Saved %s (%d bytes)\n"), item.filename.c_str(), static_cast<int>(item.contents.size()));
+		else if (item.errorSummary.length() != 0)
+		{
+			// report the errors in the UI
+			Application::AsyncErrorHandler aeh;
+			aeh.GroupError(ErrorIconType::EIT_Error, item.errorSummary.c_str(), eh);
+		}
+		else
+		{
+			// log the errors only
+			eh.EnumErrors([&item](const ErrorList::Item &e) {
+				LogFile::Get()->Write(_T("Error saving %s: %s\n"), item.filename.c_str(), e.message.c_str());
+			});
+		}
+
+		// notify the caller
+		if (item.onWritten)
+			item.onWritten(ok);
+	};
+
+	// if the destination folder doesn't exist, create it
+	TCHAR dir[MAX_PATH];
+	_tcscpy_s(dir, item.filename.c_str());
+	PathRemoveFileSpec(dir);
+	if (!DirectoryExists(dir))
+		CreateSubDirectory(dir, NULL, NULL);
+
+	// write the contents to a temp file in the same folder
+	TSTRING tmpfile = item.filename + _T("~");
+	{
+		FILEPtrHolder fp;
+		if (int err = _tfopen_s(&fp, tmpfile.c_str(), _T("wb")); err != 0)
+		{
+			eh.Error(MsgFmt(IDS_ERR_OPENFILE, tmpfile.c_str(), FileErrorMessage(err).c_str()));
+			return Finish();
+		}
+
+		if (fwrite(item.contents.data(), 1, item.contents.size(), fp) != item.contents.size()
+			|| fflush(fp) != 0)
+		{
+			eh.Error(MsgFmt(IDS_ERR_WRITEFILE, tmpfile.c_str(), FileErrorMessage(errno).c_str()));
+			fp.fclose();
+			DeleteFile(tmpfile.c_str());
+			return Finish();
+		}
+	}
+
+	// If desired, keep the original file as a backup copy; otherwise the
+	// temp file simply replaces it.
+	if (item.backup && FileExists(item.filename.c_str()))
+	{
+		TSTRING backup = item.filename + _T(".bak");
+		DeleteFile(backup.c_str());
+		if (!MoveFile(item.filename.c_str(), backup.c_str()))
+		{
+			WindowsErrorMessage winerr;
+			eh.Error(MsgFmt(IDS_ERR_MOVEFILE, item.filename.c_str(), backup.c_str(), winerr.Get()));
+			DeleteFile(tmpfile.c_str());
+			return Finish();
+		}
+	}
+
+	// move the temp file into place
+	if (!MoveFileEx(tmpfile.c_str(), item.filename.c_str(), MOVEFILE_REPLACE_EXISTING))
+	{
+		WindowsErrorMessage winerr;
+		eh.Error(MsgFmt(IDS_ERR_MOVEFILE, tmpfile.c_str(), item.filename.c_str(), winerr.Get()));
+		DeleteFile(tmpfile.c_str());
+	}
+
+	Finish();
+}
+
+DWORD WINAPI BackgroundFileWriter::ThreadMain(LPVOID)
+{
+	for (;;)
+	{
+		// wait for work
+		WaitForSingleObject(hWorkEvent, INFINITE);
+
+		// Wait out the coalescing delay, so that a burst of requests
+		// only writes each file once.  A flush request cuts this short.
+		// Read the clock once per iteration, so that the remaining time
+		// can't underflow if the delay runs out between two readings.
+		for (DWORD t0 = GetTickCount(); ; )
+		{
+			DWORD elapsed = GetTickCount() - t0;
+			if (elapsed >= coalesceDelay)
+				break;
+			{
+				CriticalSectionLocker locker(lock);
+				if (flushing || shuttingDown)
+					break;
+			}
+			WaitForSingleObject(hWorkEvent, coalesceDelay - elapsed);
+		}
+
+		// write the pending files, one at a time, until the list is empty
+		for (;;)
+		{
+			Item item;
+			{
+				CriticalSectionLocker locker(lock);
+				if (pending.size() == 0)
+				{
+					// we're idle - release any flush waiters
+					busy = false;
+					flushing = false;
+					SetEvent(hIdleEvent);
+					break;
+				}
+
+				item = std::move(pending.front());
+				pending.pop_front();
+				busy = true;
+			}
+
+			WriteItem(item);
+		}
+
+		// stop if we're shutting down
+		{
+			CriticalSectionLocker locker(lock);
+			if (shuttingDown)
+				break;
+		}
+	}
+
+	return 0;
+}
@@ -0,0 +1,108 @@
+// This file is part of PinballY
+// Copyright 2018 Michael J Roberts | GPL v3 or later | NO WARRANTY
+//
+// Background file writer
+//
+// This is a write-behind service for the game database XML files and
+// the game stats database.  Those files are rewritten whole on every
+// save, and a large database can take long enough to write that the
+// UI visibly stalls, particularly on a hard disk that's spun down.
+//
+// The caller formats the new file contents in memory, on its own
+// thread, and hands them to Write().  Formatting is quick, and doing
+// it on the caller's thread means that we capture a consistent copy
+// of the data without any locking on the in-memory structures.  The
+// writer thread takes care of the slow part, the actual disk writes.
+//
+// Writes are coalesced.  The writer waits a short time after the first
+// request before it starts writing, and a new request for a file that
+// already has a write pending simply replaces the pending contents, so
+// a burst of edits only writes each file once.  Each file is written
+// to a temporary file first, and then moved into place, so a crash in
+// the middle of a write can't leave a truncated file behind.
+//
+// The caller can supply a callback to run when a write has completed,
+// which tells the caller whether or not the write succeeded.  The game
+// stats database uses this to delete the journal segments that the new
+// file contents incorporate, and the callers use it to mark the file as
+// dirty again if the write failed, so that the next save retries it.
+//
+// Flush() is a barrier: it waits until all pending writes have been
+// completed.  The application uses this before launching a game, since
+// a game launch always has some risk of crashing the system, and at
+// exit.
+
+#pragma once
+#include <list>
+#include <vector>
+#include <functional>
+
+class BackgroundFileWriter
+{
+public:
+	// Queue a write.  'contents' is the exact byte contents of the new
+	// file.  If 'backup' is true, the existing file (if any) is kept as
+	// a backup copy, with .bak appended to its name, rather than being
+	// deleted.  If 'errorSummary' is non-null, errors are reported in
+	// the UI with that summary message; otherwise they're only logged.
+	// 'onWritten' is called when the write has finished, on the writer
+	// thread, with 'ok' set to true if the file was written successfully.
+	// If a new request replaces a pending one, the new request's callback
+	// replaces the old one, since the new contents supersede the old.
+	// This can be called from any thread.
+	static void Write(const TCHAR *filename, std::vector<BYTE> &&contents,
+		bool backup = false, const TCHAR *errorSummary = nullptr,
+		std::function<void(bool ok)> onWritten = nullptr);
+
+	// Wait for all pending writes to complete
+	static void Flush();
+
+	// Shut down the writer.  This completes the pending writes, and then
+	// stops the writer thread.  The application calls this at exit.
+	static void Shutdown();
+
+protected:
+	// pending write
+	struct Item
+	{
+		TSTRING filename;
+		std::vector<BYTE> contents;
+		bool backup;
+		TSTRING errorSummary;
+		std::function<void(bool ok)> onWritten;
+	};
+
+	// start the writer thread, if we haven't already
+	static bool Start();
+
+	// carry out a write
+	static void WriteItem(const Item &item);
+
+	// writer thread entrypoint
+	static DWORD WINAPI ThreadMain(LPVOID);
+
+	// pending writes, in order of the first request for each file
+	static std::list<Item> pending;
+
+	// Is the writer thread busy with a write?  Flush() has to wait for
+	// the current write as well as the pending ones.
+	static bool busy;
+
+	// Is a flush requested?  The writer skips the coalescing delay while
+	// a flush is waiting.
+	static bool flushing;
+
+	// writer thread, and its events: work available, and idle (no
+	// pending writes and no write in progress)
+	static HandleHolder hThread;
+	static HandleHolder hWorkEvent;
+	static HandleHolder hIdleEvent;
+	static bool started;
+	static bool shuttingDown;
+
+	// lock for the pending list and status flags
+	static CriticalSection lock;
+
+	// coalescing delay, in milliseconds
+	static const DWORD coalesceDelay = 500;
+};
@@ -11,6 +11,7 @@
 #include "MouseButtons.h"
 #include "DMDView.h"
 #include "LogFile.h"
+#include "FontCache.h"
 
 BaseView::~BaseView()
 {
@@ -151,7 +152,78 @@ bool BaseView::OnCommand(int cmd, int source, HWND hwndControl)
 	return __super::OnCommand(cmd, source, hwndControl);
 }
 
+TSTRING BaseView::GetInstCardCacheKey(const TCHAR *filename)
+{
+	WIN32_FILE_ATTRIBUTE_DATA attrs;
+	if (!GetFileAttributesEx(filename, GetFileExInfoStandard, &attrs))
+		ZeroMemory(&attrs, sizeof(attrs));
+
+	return MsgFmt(_T("%08lx%08lx|%ldx%ld|"), attrs.ftLastWriteTime.dwHighDateTime, attrs.ftLastWriteTime.dwLowDateTime,
+		szLayout.cx, szLayout.cy).Get() + TSTRING(filename);
+}
+
+void BaseView::PrefetchInstructionCard(const TCHAR *filename)
+{
+	// if it's already in the cache, there's nothing to do
+	TSTRING key = GetInstCardCacheKey(filename);
+	if (instCardCache.Contains(key))
+		return;
+
+	// skip SWF files, since the Flash loader runs synchronously
+	ImageFileDesc imageDesc;
+	if (!GetImageFileInfo(filename, imageDesc, true) || imageDesc.imageType == ImageFileDesc::ImageType::SWF)
+		return;
+
+	// Load it.  Use a silent error handler; if it fails, we'll try again
+	// (and report the error) if the user actually asks for the card.
+	RefPtr<Sprite> sprite(LoadInstructionCard(filename, LoaderPool::Priority::Prefetch, SilentErrorHandler()));
+	if (sprite != nullptr)
+	{
+		INT64 bytes = static_cast<INT64>(szLayout.cy) * szLayout.cy * imageDesc.dispSize.cx / max(1L, imageDesc.dispSize.cy) * 4;
+		instCardCache.Add(key, sprite, bytes);
+	}
+}
+
 Sprite *BaseView::PrepInstructionCard(const TCHAR *filename)
+{
+	// if we have a pre-rendered copy in the cache, use it
+	TSTRING key = GetInstCardCacheKey(filename);
+	if (Sprite *sprite = instCardCache.Get(key); sprite != nullptr)
+	{
+		sprite->alpha = 1.0f;
+		sprite->AddRef();
+		return sprite;
+	}
+
+	// load it
+	CapturingErrorHandler eh;
+	Sprite *sprite = LoadInstructionCard(filename, LoaderPool::Priority::High, eh);
+	if (sprite == nullptr)
+	{
+		// Load failed.  If the file is an SWF (Shockwave Flash), handle
+		// it with a special error in the main window, to give the user
+		// a chance to disable SWF loading in the future.  Otherwise 
+		// just show the error normally.
+		ImageFileDesc imageDesc;
+		GetImageFileInfo(filename, imageDesc, true);
+		auto pfv = Application::Get()->GetPlayfieldView();
+		if (imageDesc.imageType == ImageFileDesc::ImageType::SWF)
+			pfv->ShowFlashError(eh);
+		else
+			pfv->ShowError(ErrorIconType::EIT_Error, nullptr, &eh);
+
+		// return failure
+		return nullptr;
+	}
+
+	// keep it in the cache in case it's needed again
+	instCardCache.Add(key, sprite, static_cast<INT64>(sprite->loadSize.x * szLayout.cy) * szLayout.cy * 4);
+
+	// return the new sprite; the caller inherits our reference
+	return sprite;
+}
+
+Sprite *BaseView::LoadInstructionCard(const TCHAR *filename, LoaderPool::Priority priority, ErrorHandler &eh)
 {
 	// get the file dimensions
 	ImageFileDesc imageDesc;
@@ -173,23 +245,10 @@ Sprite *BaseView::PrepInstructionCard(const TCHAR *filename)
 	SIZE pixSize = { (int)(wid * szLayout.cy), (int)(ht * szLayout.cy) };
 
 	// load the image at the calculated size
-	CapturingErrorHandler eh;
 	RefPtr<Sprite> sprite(new Sprite());
+	sprite->loadPriority = priority;
 	if (!sprite->Load(filename, normSize, pixSize, hWnd, eh))
-	{
-		// Load failed.  If the file is an SWF (Shockwave Flash), handle
-		// it with a special error in the main window, to give the user
-		// a chance to disable SWF loading in the future.  Otherwise 
-		// just show the error normally.
-		auto pfv = Application::Get()->GetPlayfieldView();
-		if (imageDesc.imageType == ImageFileDesc::ImageType::SWF)
-			pfv->ShowFlashError(eh);
-		else
-			pfv->ShowError(ErrorIconType::EIT_Error, nullptr, &eh);
-
-		// return failure
 		return nullptr;
-	}
 
 	// return the new sprite, adding a reference on behalf of the caller
 	sprite->AddRef();
@@ -493,7 +552,7 @@ void BaseView::DrawDropAreaList(POINT pt)
 		fmt.SetAlignment(Gdiplus::StringAlignmentCenter);
 		fmt.SetLineAlignment(Gdiplus::StringAlignmentCenter);
 		Gdiplus::SolidBrush txtbr(Gdiplus::Color(255, 255, 255, 255));
-		std::unique_ptr<Gdiplus::Font> font(CreateGPFont(_T("Tahoma"), 36, 400, false));
+		std::shared_ptr<Gdiplus::Font> font(FontCache::GetGPFont(_T("Tahoma"), 36, 400, false));
 
 		// Find the drop area at the current mouse location
 		activeDropArea = FindDropAreaHit(pt);
@@ -1037,6 +1096,65 @@ JsValueRef BaseView::JsCreateDrawingLayer(int zIndex)
 	}
 }
 
+JsValueRef BaseView::JsGetFrameStats()
+{
+	auto js = JavascriptEngine::Get();
+	try
+	{
+		PerfMon::FrameTimeStats ft;
+		GetRecentFrameTimeStats(ft);
+
+		auto obj = JavascriptEngine::JsObj::CreateObject();
+		obj.Set("fps", static_cast<double>(GetCurFPS()));
+		obj.Set("fpsAvg", static_cast<double>(GetRollingFPS()));
+		obj.Set("frames", static_cast<int>(ft.nFrames));
+		obj.Set("framesOverBudget", static_cast<int>(ft.nOverBudget));
+		obj.Set("budget", static_cast<double>(ft.budget_ms));
+		obj.Set("p50", static_cast<double>(ft.p50_ms));
+		obj.Set("p95", static_cast<double>(ft.p95_ms));
+		obj.Set("p99", static_cast<double>(ft.p99_ms));
+		obj.Set("max", static_cast<double>(ft.max_ms));
+		obj.Set("overBudget", frameBudget.over);
+		return obj.jsobj;
+	}
+	catch (JavascriptEngine::CallException exc)
+	{
+		exc.Log(_T("<window>.getFrameStats()"));
+		return js->Throw(exc.jsErrorCode, _T("<window>.getFrameStats()"));
+	}
+}
+
+bool BaseView::CheckFrameBudget()
+{
+	// A window that hasn't drawn anything since the last check is idle,
+	// and its recent frame times are stale, so count it as within the
+	// budget.  Otherwise compare the recent 95th percentile against the
+	// budget.
+	bool over = false;
+	if (int64_t n = GetFrameCount(); n != frameBudget.lastFrameCount)
+	{
+		frameBudget.lastFrameCount = n;
+		PerfMon::FrameTimeStats ft;
+		GetRecentFrameTimeStats(ft);
+		over = ft.p95_ms > ft.budget_ms;
+	}
+
+	// if this agrees with the current state, start the count over
+	if (over == frameBudget.over)
+	{
+		frameBudget.count = 0;
+		return false;
+	}
+
+	// change state after enough consecutive contrary checks
+	if (++frameBudget.count < frameBudgetChecks)
+		return false;
+
+	frameBudget.over = over;
+	frameBudget.count = 0;
+	return true;
+}
+
 BaseView::JsDrawingLayer::~JsDrawingLayer()
 {
 	// remove our reference on the js object
@@ -1143,7 +1261,7 @@ void BaseView::DrawingLayerConvertSpriteType(JsValueRef self)
 	}
 }
 
-void BaseView::JsDrawingLayerDraw(JsValueRef self, JsValueRef drawFunc, JsValueRef widthArg, JsValueRef heightArg)
+void BaseView::JsDrawingLayerDraw(JsValueRef self, JsValueRef drawFunc, JsValueRef widthArg, JsValueRef heightArg, JsValueRef options)
 {
 	// make sure we have a standard video sprite
 	DrawingLayerConvertSpriteType<VideoSprite>(self);
@@ -1162,10 +1280,20 @@ void BaseView::JsDrawingLayerDraw(JsValueRef self, JsValueRef drawFunc, JsValueR
 			int width = JavascriptEngine::IsUndefinedOrNull(widthArg) ? szLayout.cx : JavascriptEngine::JsToNative<int>(widthArg);
 			int height = JavascriptEngine::IsUndefinedOrNull(heightArg) ? szLayout.cy : JavascriptEngine::JsToNative<int>(heightArg);
 
+			// Check options.  { gpu: true } selects Direct2D drawing straight
+			// into the layer's texture.
+			bool gpu = false;
+			if (!JavascriptEngine::IsUndefinedOrNull(options))
+			{
+				JavascriptEngine::JsObj optObj(options);
+				if (optObj.Has("gpu"))
+					gpu = optObj.Get<bool>("gpu");
+			}
+
 			// the playfield view manages the Javascript drawing context - have
 			// it do the drawing
 			if (auto pfv = Application::Get()->GetPlayfieldView(); pfv != nullptr)
-				pfv->JsDraw(sprite, width, height, drawFunc);
+				pfv->JsDraw(sprite, width, height, drawFunc, gpu);
 
 			// if we're frozen in the background, force a refresh
 			if (freezeBackgroundRendering && !Application::IsInForeground())
@@ -1468,7 +1596,7 @@ void BaseView::JsDrawingLayerSetPos(JsValueRef self, float x, float y, WSTRING a
 
 		// set the new alignment point
 		l->pos.xAlign = l->pos.yAlign = 0;
-		std::wregex pat(L"\\s*(top|middle|bottom)?\\b\\s*(left|center|right)?\\s*", std::regex_constants::icase);
+		static const std::wregex pat(L"\\s*(top|middle|bottom)?\\b\\s*(left|center|right)?\\s*", std::regex_constants::icase);
 		std::match_results<WSTRING::const_iterator> m;
 		if (std::regex_match(align, m, pat))
 		{
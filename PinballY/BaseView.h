@@ -13,6 +13,7 @@
 #include "VideoSprite.h"
 #include "MediaDropTarget.h"
 #include "JavascriptEngine.h"
+#include "SpriteCache.h"
 
 class BaseView : public D3DView
 {
@@ -64,6 +65,18 @@ public:
 	JsValueRef JsCreateDrawingLayer(int zIndex);
 	void JsRemoveDrawingLayer(JavascriptEngine::JsObj obj);
 
+	// Javascript frame statistics for this window
+	JsValueRef JsGetFrameStats();
+
+	// Check the window's recent frame times against the frame budget,
+	// for the Javascript PerfBudgetEvent.  The window is in the over-
+	// budget state when its 95th percentile frame time has been over
+	// the budget for several consecutive checks, and leaves the state
+	// after as many consecutive checks within the budget.  Returns true
+	// if the state changed.  The playfield view calls this once a second.
+	bool CheckFrameBudget();
+	bool IsOverFrameBudget() const { return frameBudget.over; }
+
 	// get the layout size
 	SIZE GetLayoutSize() const { return szLayout; }
 
@@ -78,6 +91,13 @@ public:
 			(static_cast<float>(szLayout.cx) / static_cast<float>(szLayout.cy)));
 	}
 
+	// Pre-render an instruction card into the card cache, so that a later
+	// PrepInstructionCard() for the same file can display it immediately.
+	// The image is decoded on the loader pool at prefetch priority.  SWF
+	// cards aren't pre-rendered, since the Flash player has to run on the
+	// UI thread.
+	void PrefetchInstructionCard(const TCHAR *filename);
+
 protected:
 	~BaseView();
 
@@ -88,9 +108,24 @@ protected:
 	bool IsBorderlessWindowMode(HWND parent);
 
 	// Instruction card display setup.  Returns a new sprite on
-	// success, null on failure.
+	// success, null on failure.  This uses the pre-rendered sprite
+	// from the card cache, if available.
 	Sprite *PrepInstructionCard(const TCHAR *filename);
 
+	// Load an instruction card sprite.  Returns a new sprite on success,
+	// or null on failure.
+	Sprite *LoadInstructionCard(const TCHAR *filename, LoaderPool::Priority priority, ErrorHandler &eh);
+
+	// Get the instruction card cache key for a file.  This covers the
+	// file's modification time and our layout size, so that an entry
+	// doesn't outlive changes to the file or the window.
+	TSTRING GetInstCardCacheKey(const TCHAR *filename);
+
+	// Instruction card cache.  This holds the cards we've pre-rendered
+	// for the games around the current selection, plus the ones we've
+	// recently displayed.
+	SpriteCache instCardCache{ 6 };
+
 	// Scale sprites
 	virtual void ScaleSprites() override;
 
@@ -336,6 +371,18 @@ protected:
 	// backglassWindow, etc)
 	JsValueRef jsSelf = JS_INVALID_REFERENCE;
 
+	// frame budget state, for CheckFrameBudget()
+	struct FrameBudgetState
+	{
+		bool over = false;          // currently in the over-budget state?
+		int count = 0;              // consecutive checks contrary to the current state
+		int64_t lastFrameCount = 0; // frame counter as of the last check
+	};
+	FrameBudgetState frameBudget;
+
+	// number of consecutive checks required to change the frame budget state
+	static const int frameBudgetChecks = 3;
+
 	// Javascript custom drawing layers.  Javascript code can create
 	// sprite layers for its own use.  These are layered in front of
 	// the system sprites, in a sorting order specified by the script
@@ -432,7 +479,7 @@ protected:
 	bool JsDrawingLayerLoadImage(JsValueRef self, WSTRING filename);
 	bool JsDrawingLayerLoadVideo(JsValueRef self, WSTRING filename, JavascriptEngine::JsObj options);
 	void JsDrawingLayerLoadDMDText(JsValueRef self, WSTRING text, JavascriptEngine::JsObj options);
-	void JsDrawingLayerDraw(JsValueRef self, JsValueRef drawFunc, JsValueRef width, JsValueRef height);
+	void JsDrawingLayerDraw(JsValueRef self, JsValueRef drawFunc, JsValueRef width, JsValueRef height, JsValueRef options);
 	void JsDrawingLayerClear(JsValueRef self, JsValueRef argb);
 	float JsDrawingLayerGetAlpha(JsValueRef self) const;
 	void JsDrawingLayerSetAlpha(JsValueRef self, float alpha);
@@ -0,0 +1,1256 @@
+// This file is part of PinballY
+// Copyright 2018 Michael J Roberts | GPL v3 or later | NO WARRANTY
+//
+// Benchmark mode
+
+#include "stdafx.h"
+#include <regex>
+#include "../Utilities/FileUtil.h"
+#include "Benchmark.h"
+#include "Application.h"
+#include "GameList.h"
+#include "JavascriptEngine.h"
+#include "LogFile.h"
+#include "VersionInfo.h"
+#include "PlayfieldView.h"
+#include "Sprite.h"
+#include "VideoSprite.h"
+#include "TextureBudget.h"
+#include "MemoryStats.h"
+#include "../Utilities/std_filesystem.h"
+#include <psapi.h>
+
+namespace fs = std::filesystem;
+
+// global singleton
+Benchmark *Benchmark::inst = nullptr;
+
+// Placeholder image for the generated wheel and table images: a 1x1
+// transparent PNG.  The content doesn't matter for the tests, since we
+// only time the lookups, not the rendering.
+static const BYTE placeholderPNG[] = {
+	0x89, 0x50, 0x4E, 0x47, 0x0D, 0x0A, 0x1A, 0x0A, 0x00, 0x00, 0x00, 0x0D, 0x49, 0x48, 0x44, 0x52,
+	0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x01, 0x08, 0x06, 0x00, 0x00, 0x00, 0x1F, 0x15, 0xC4,
+	0x89, 0x00, 0x00, 0x00, 0x0D, 0x49, 0x44, 0x41, 0x54, 0x78, 0xDA, 0x63, 0x64, 0x60, 0xF8, 0x5F,
+	0x0F, 0x00, 0x02, 0x87, 0x01, 0x80, 0xEB, 0x47, 0xBA, 0x92, 0x00, 0x00, 0x00, 0x00, 0x49, 0x45,
+	0x4E, 0x44, 0xAE, 0x42, 0x60, 0x82
+};
+
+// name of the marker file that records a completed collection
+static const TCHAR *markerFile = _T("Benchmark.txt");
+
+bool Benchmark::ParseOption(const TCHAR *arg)
+{
+	std::match_results<const TCHAR*> m;
+	if (!std::regex_match(arg, m, std::basic_regex<TCHAR>(_T("/benchmark(:(.*))?"), std::regex_constants::icase)))
+		return false;
+
+	// create the singleton
+	if (inst == nullptr)
+		inst = new Benchmark();
+
+	// Scan the sub-options.  Each option starts with "name=", at the start
+	// of the list or after a comma, and its value runs to the start of the
+	// next option.  This lets the folder names contain commas, and lets the
+	// 'games' list use commas as separators.
+	if (m[2].matched && m[2].length() != 0)
+	{
+		TSTRING subopts = m[2];
+		std::basic_regex<TCHAR> namePat(_T("(^|,)(\\w+)="));
+		std::regex_iterator<TSTRING::const_iterator> it(subopts.cbegin(), subopts.cend(), namePat), end;
+		while (it != end)
+		{
+			TSTRING name = (*it)[2];
+			auto valStart = (*it)[0].second;
+			auto valEnd = ++it != end ? (*it)[0].first : subopts.cend();
+			TSTRING val(valStart, valEnd);
+
+			if (_tcsicmp(name.c_str(), _T("games")) == 0)
+			{
+				// games=<N>[,<N>...]
+				for (const TCHAR *p = val.c_str(); *p != 0; )
+				{
+					if (int n = _ttoi(p); n > 0)
+						inst->sizes.push_back(n);
+					while (*p != 0 && *p != ',')
+						++p;
+					if (*p == ',')
+						++p;
+				}
+			}
+			else if (_tcsicmp(name.c_str(), _T("media")) == 0)
+				inst->mediaFolder = val;
+			else if (_tcsicmp(name.c_str(), _T("session")) == 0)
+				inst->sessionFile = val;
+			else if (_tcsicmp(name.c_str(), _T("out")) == 0)
+				inst->outFolder = val;
+		}
+	}
+
+	// apply the defaults
+	if (inst->sizes.size() == 0)
+		inst->sizes = { 1000, 10000, 50000 };
+	if (inst->outFolder.length() == 0)
+	{
+		TCHAR exePath[MAX_PATH], folder[MAX_PATH];
+		GetExeFilePath(exePath, countof(exePath));
+		PathCombine(folder, exePath, _T("Benchmark"));
+		inst->outFolder = folder;
+	}
+
+	return true;
+}
+
+bool Benchmark::Prepare(TSTRING &configFolder, TSTRING &gameStatsPath, ErrorHandler &eh)
+{
+	// The media suite runs against the normal settings, so that it
+	// measures the actual cabinet configuration
+	if (inst == nullptr || inst->mediaFolder.length() != 0)
+		return true;
+
+	// figure the collection folder for this session's size
+	TCHAR exePath[MAX_PATH], base[MAX_PATH], folder[MAX_PATH];
+	GetExeFilePath(exePath, countof(exePath));
+	PathCombine(base, exePath, _T("Benchmark"));
+	PathCombine(folder, base, MsgFmt(_T("Games%d"), inst->sizes[0]));
+
+	// Check the marker file.  This is the last file we write, so if it's
+	// present with the current generator version, the collection is complete.
+	TCHAR marker[MAX_PATH];
+	PathCombine(marker, folder, markerFile);
+	bool current = false;
+	{
+		FILEPtrHolder fp;
+		int ver = 0;
+		if (_tfopen_s(&fp, marker, _T("r")) == 0 && fscanf_s(fp, "generator=%d", &ver) == 1 && ver == generatorVersion)
+			current = true;
+	}
+
+	// generate the files if needed
+	if (!current)
+	{
+		LogFile::Get()->Group();
+		LogFile::Get()->Write(_T("Benchmark: generating %d-game collection in %s\n"), inst->sizes[0], folder);
+		if (!inst->Generate(folder, eh))
+			return false;
+	}
+
+	// use the collection's settings and stats files
+	configFolder = folder;
+	TCHAR stats[MAX_PATH];
+	PathCombine(stats, folder, _T("GameStats.csv"));
+	gameStatsPath = stats;
+
+	LogFile::Get()->Write(_T("Benchmark: running with %d games; results will be written to %s\n"),
+		inst->sizes[0], inst->outFolder.c_str());
+	return true;
+}
+
+bool Benchmark::Generate(const TCHAR *folder, ErrorHandler &eh)
+{
+	// Systems.  We use two, so that the per-system parts of the database
+	// loading and media lookup get exercised.
+	static const struct
+	{
+		const TCHAR *name;      // system name
+		const TCHAR *cls;       // system class
+		const TCHAR *dir;       // media and database folder name
+		const TCHAR *ext;       // table file extension
+	} systems[] = {
+		{ _T("Visual Pinball X"), _T("VPX"), _T("Visual Pinball X"), _T(".vpx") },
+		{ _T("Future Pinball"), _T("FP"), _T("Future Pinball"), _T(".fpt") },
+	};
+
+	// word lists for the titles
+	static const TCHAR *const words1[] = {
+		_T("Alien"), _T("Black"), _T("Cosmic"), _T("Dragon"), _T("Eight"), _T("Flash"), _T("Gold"),
+		_T("High"), _T("Ice"), _T("Jungle"), _T("King"), _T("Lost"), _T("Magic"), _T("Night"),
+		_T("Orbit"), _T("Pirate"), _T("Queen"), _T("Royal"), _T("Space"), _T("Twilight"), _T("Under"),
+		_T("Viking"), _T("Wild"), _T("Xenon"), _T("Yukon"), _T("Zodiac")
+	};
+	static const TCHAR *const words2[] = {
+		_T("Ball"), _T("Castle"), _T("Derby"), _T("Express"), _T("Fever"), _T("Galaxy"), _T("Hunter"),
+		_T("Legend"), _T("Machine"), _T("Quest"), _T("Rider"), _T("Safari"), _T("Trek"), _T("Zone")
+	};
+	static const TCHAR *const manufs[] = {
+		_T("Bally"), _T("Williams"), _T("Gottlieb"), _T("Stern"), _T("Data East"), _T("Sega"),
+		_T("Capcom"), _T("Premier"), _T("Midway"), _T("Chicago Coin"), _T("Zaccaria"), _T("Jersey Jack")
+	};
+	static const TCHAR *const categories[] = {
+		_T("Solid State"), _T("Electromechanical"), _T("Multiball"), _T("Movie"), _T("Kids")
+	};
+	static const TCHAR *const types[] = { _T("SS"), _T("EM"), _T("ME") };
+
+	// Random number generator.  This is a simple LCG with a fixed seed, so
+	// that every run generates the identical collection.
+	UINT32 seed = 12345;
+	auto Rand = [&seed](UINT32 n) { seed = seed * 1103515245 + 12345; return (seed >> 16) % n; };
+
+	// create the folders
+	auto Dir = [&eh](const TCHAR *parent, const TCHAR *sub, TCHAR result[MAX_PATH])
+	{
+		PathCombine(result, parent, sub);
+		if (!DirectoryExists(result) && !CreateSubDirectory(result, nullptr, NULL))
+		{
+			WindowsErrorMessage err;
+			eh.SysError(_T("Benchmark: unable to create the game collection folder"),
+				MsgFmt(_T("CreateSubDirectory(%s) failed: %s"), result, err.Get()));
+			return false;
+		}
+		return true;
+	};
+	TCHAR mediaDir[MAX_PATH], dbDir[MAX_PATH], tablesDir[MAX_PATH];
+	if (!Dir(folder, _T("Media"), mediaDir)
+		|| !Dir(folder, _T("Databases"), dbDir)
+		|| !Dir(folder, _T("Tables"), tablesDir))
+		return false;
+
+	// open a file for writing
+	auto Open = [&eh](FILEPtrHolder &fp, const TCHAR *path, const TCHAR *mode)
+	{
+		if (_tfopen_s(&fp, path, mode) != 0)
+		{
+			eh.Error(MsgFmt(_T("Benchmark: unable to create %s"), path));
+			return false;
+		}
+		return true;
+	};
+
+	// write a placeholder image
+	auto Image = [](const TCHAR *dir, const TSTRING &name)
+	{
+		TCHAR path[MAX_PATH];
+		PathCombine(path, dir, (name + _T(".png")).c_str());
+		FILEPtrHolder fp;
+		if (_tfopen_s(&fp, path, _T("wb")) == 0)
+			fwrite(placeholderPNG, sizeof(placeholderPNG), 1, fp);
+	};
+
+	// Stand-in game player, for the session suite's game launches: a
+	// hidden command prompt that waits about five seconds and exits.
+	// This lets a launch go through the normal game monitoring without
+	// running a real player on the empty table files.
+	TCHAR player[MAX_PATH];
+	GetSystemDirectory(player, countof(player));
+	PathAppend(player, _T("cmd.exe"));
+
+	// write the settings file
+	TCHAR path[MAX_PATH];
+	PathCombine(path, folder, _T("Settings.txt"));
+	{
+		FILEPtrHolder fp;
+		if (!Open(fp, path, _T("w, ccs=UTF-8")))
+			return false;
+
+		_ftprintf(fp, _T("# PinballY benchmark collection - generated file, do not edit\n"));
+		_ftprintf(fp, _T("MediaPath = %s\nTableDatabasePath = %s\n"), mediaDir, dbDir);
+		for (size_t i = 0; i < countof(systems); ++i)
+		{
+			auto const &s = systems[i];
+			TCHAR sysTables[MAX_PATH];
+			if (!Dir(tablesDir, s.dir, sysTables))
+				return false;
+
+			int n = static_cast<int>(i) + 1;
+			_ftprintf(fp, _T("System%d = %s\n"), n, s.name);
+			_ftprintf(fp, _T("System%d.Class = %s\n"), n, s.cls);
+			_ftprintf(fp, _T("System%d.MediaDir = %s\n"), n, s.dir);
+			_ftprintf(fp, _T("System%d.DatabaseDir = %s\n"), n, s.dir);
+			_ftprintf(fp, _T("System%d.Enabled = true\n"), n);
+			_ftprintf(fp, _T("System%d.Exe = %s\n"), n, player);
+			_ftprintf(fp, _T("System%d.Parameters = /c ping -n 6 127.0.0.1 >nul\n"), n);
+			_ftprintf(fp, _T("System%d.ShowWindow = SW_HIDE\n"), n);
+			_ftprintf(fp, _T("System%d.TablePath = %s\n"), n, sysTables);
+			_ftprintf(fp, _T("System%d.DefExt = %s\n"), n, s.ext);
+		}
+	}
+
+	// open the per-system databases and create the media folders
+	FILEPtrHolder db[countof(systems)];
+	TCHAR wheelDir[countof(systems)][MAX_PATH], tableImageDir[countof(systems)][MAX_PATH];
+	for (size_t i = 0; i < countof(systems); ++i)
+	{
+		TCHAR sysDb[MAX_PATH], sysMedia[MAX_PATH];
+		if (!Dir(dbDir, systems[i].dir, sysDb)
+			|| !Dir(mediaDir, systems[i].dir, sysMedia)
+			|| !Dir(sysMedia, _T("Wheel Images"), wheelDir[i])
+			|| !Dir(sysMedia, _T("Table Images"), tableImageDir[i]))
+			return false;
+
+		PathCombine(path, sysDb, (TSTRING(systems[i].dir) + _T(".xml")).c_str());
+		if (!Open(db[i], path, _T("w, ccs=UTF-8")))
+			return false;
+		_ftprintf(db[i], _T("<menu>\n"));
+	}
+
+	// open the stats file
+	PathCombine(path, folder, _T("GameStats.csv"));
+	FILEPtrHolder stats;
+	if (!Open(stats, path, _T("w, ccs=UTF-8")))
+		return false;
+	_ftprintf(stats, _T("Game,Last Played,Play Count,Play Time,Is Favorite,Rating,Audio Volume,Categories,")
+		_T("Is Hidden,Date Added,High Score Style,Marked For Capture,Show When Running\n"));
+
+	// generate the games
+	int nGames = sizes[0];
+	for (int i = 0; i < nGames; ++i)
+	{
+		// pick the attributes
+		size_t sysIdx = Rand(4) == 0 ? 1 : 0;
+		auto const &s = systems[sysIdx];
+		const TCHAR *w1 = words1[Rand(countof(words1))];
+		const TCHAR *w2 = words2[Rand(countof(words2))];
+		const TCHAR *manuf = manufs[Rand(countof(manufs))];
+		int year = 1960 + static_cast<int>(Rand(61));
+		const TCHAR *type = types[Rand(countof(types))];
+		float rating = static_cast<float>(Rand(11)) / 2.0f;
+
+		// Build the title and the media name.  The index makes every
+		// title unique, which keeps the media names unique.
+		MsgFmt title(_T("%s %s %d"), w1, w2, i + 1);
+		TSTRING mediaName = MsgFmt(_T("%s (%s %d)"), title.Get(), manuf, year).Get();
+
+		// write the database entry
+		_ftprintf(db[sysIdx], _T("  <game name=\"%s\">\n")
+			_T("    <description>%s</description>\n")
+			_T("    <manufacturer>%s</manufacturer>\n")
+			_T("    <year>%d</year>\n")
+			_T("    <type>%s</type>\n")
+			_T("    <rating>%.1f</rating>\n")
+			_T("    <enabled>True</enabled>\n")
+			_T("  </game>\n"),
+			mediaName.c_str(), mediaName.c_str(), manuf, year, type, rating);
+
+		// create an empty table file
+		TCHAR sysTables[MAX_PATH], tableFile[MAX_PATH];
+		PathCombine(sysTables, tablesDir, s.dir);
+		PathCombine(tableFile, sysTables, (mediaName + s.ext).c_str());
+		{
+			FILEPtrHolder fp;
+			_tfopen_s(&fp, tableFile, _T("wb"));
+		}
+
+		// Media: every game has a wheel image, and every other game has a
+		// table image, so that the lookups see both hits and misses.
+		Image(wheelDir[sysIdx], mediaName);
+		if (i % 2 == 0)
+			Image(tableImageDir[sysIdx], mediaName);
+
+		// write stats for about a third of the games
+		if (Rand(3) == 0)
+		{
+			int playCount = static_cast<int>(Rand(200));
+			const TCHAR *cat1 = categories[Rand(countof(categories))];
+			const TCHAR *cat2 = categories[Rand(countof(categories))];
+			TSTRING cats = cat1 == cat2 ? TSTRING(cat1) : TSTRING(cat1) + _T(",") + cat2;
+			_ftprintf(stats, _T("\"%s.%s\",%04d%02d%02d%02d%02d%02d,%d,%d,%s,%.1f,,\"%s\",%s,20180101000000,,,\n"),
+				mediaName.c_str(), s.name,
+				2010 + static_cast<int>(Rand(9)), 1 + static_cast<int>(Rand(12)), 1 + static_cast<int>(Rand(28)),
+				static_cast<int>(Rand(24)), static_cast<int>(Rand(60)), static_cast<int>(Rand(60)),
+				playCount, playCount * static_cast<int>(Rand(600)),
+				Rand(10) == 0 ? _T("Yes") : _T("No"), rating, cats.c_str(),
+				Rand(50) == 0 ? _T("Yes") : _T("No"));
+		}
+	}
+
+	// close the databases
+	for (auto &d : db)
+		_ftprintf(d, _T("</menu>\n"));
+
+	// write the marker file last, so that an interrupted run regenerates the collection
+	PathCombine(path, folder, markerFile);
+	FILEPtrHolder fp;
+	if (!Open(fp, path, _T("w")))
+		return false;
+	fprintf(fp, "generator=%d\ngames=%d\n", generatorVersion, nGames);
+	return true;
+}
+
+void Benchmark::Start()
+{
+	if (inst != nullptr)
+		inst->timerId = SetTimer(NULL, 0, startDelay_ms, &TimerProc);
+}
+
+void CALLBACK Benchmark::TimerProc(HWND, UINT, UINT_PTR, DWORD)
+{
+	// this is a one-shot timer
+	if (inst != nullptr)
+	{
+		KillTimer(NULL, inst->timerId);
+		inst->timerId = 0;
+		inst->Run();
+	}
+}
+
+void Benchmark::Record(const CHAR *name, double ms, int count)
+{
+	if (inst != nullptr)
+	{
+		inst->results.emplace_back(name, ms, count);
+		LogFile::Get()->Write(_T("Benchmark: %hs: %.3f ms%s\n"), name, ms,
+			count >= 0 ? MsgFmt(_T(" (%d)"), count).Get() : _T(""));
+	}
+}
+
+void Benchmark::Run()
+{
+	// if there's a media folder, run the media suite instead
+	if (mediaFolder.length() != 0)
+	{
+		StartMediaSuite();
+		return;
+	}
+
+	// likewise for a session recording
+	if (sessionFile.length() != 0)
+	{
+		StartSessionSuite();
+		return;
+	}
+
+	auto gl = GameList::Get();
+	LogFile::Get()->Group();
+	LogFile::Get()->Write(_T("Benchmark: starting tests, %d games loaded\n"), gl->GetAllGamesCount());
+
+	// time a test
+	auto Time = [this](const CHAR *name, std::function<int()> func)
+	{
+		double t0 = timer.GetTime_seconds();
+		int count = func();
+		Record(name, (timer.GetTime_seconds() - t0) * 1000.0, count);
+	};
+
+	// Filter switching.  Make a copy of the filter list first, since the
+	// list can change when filters are selected.
+	auto oldFilter = gl->GetCurFilter();
+	std::vector<GameListFilter*> filters(gl->GetFilters().begin(), gl->GetFilters().end());
+	for (auto f : filters)
+	{
+		CSTRING name = "filter[" + CSTRING(TCHARToAnsi(f->GetFilterId().c_str()).c_str()) + "]";
+		Time(name.c_str(), [gl, f]() { gl->SetFilter(f); return gl->GetCurFilterCount(); });
+	}
+
+	// go back to the original filter for the remaining tests
+	if (oldFilter != nullptr)
+		gl->SetFilter(oldFilter);
+
+	// refreshing the current filter and re-sorting the title index
+	Time("refreshFilter", [gl]() { gl->RefreshFilter(); return gl->GetCurFilterCount(); });
+	Time("sortTitleIndex", [gl]() { gl->SortTitleIndex(); return gl->GetAllGamesCount(); });
+
+	// media lookup for every game and media type
+	Time("mediaLookup", [gl]()
+	{
+		int found = 0;
+		gl->EnumGames([&found](GameListItem *game)
+		{
+			for (auto mt : GameListItem::allMediaTypes)
+			{
+				std::list<TSTRING> files;
+				if (game->GetMediaItems(files, *mt))
+					found += static_cast<int>(files.size());
+			}
+		});
+		return found;
+	});
+
+	// wheel paging, one game at a time and by letter groups
+	Time("wheel.next[1000]", [gl]() { for (int i = 0; i < 1000; ++i) gl->SetGame(1); return 1000; });
+	Time("wheel.nextLetter[26]", [gl]()
+	{
+		for (int i = 0; i < 26; ++i)
+			gl->SetGame(gl->FindNextLetter());
+		return 26;
+	});
+
+	// String scanners.  Time each of the hand-written scanners that
+	// replaced a one-off regex against the regex it replaced, compiling
+	// the pattern on each call as the old code did, over the titles and
+	// file names in the collection.
+	std::vector<TSTRING> titles, files;
+	gl->EnumGames([&titles, &files](GameListItem *game)
+	{
+		titles.emplace_back(game->title);
+		files.emplace_back(game->filename);
+	});
+	auto Scan = [&Time](const CHAR *name, const std::vector<TSTRING> &strs, std::function<size_t(const TSTRING&)> func)
+	{
+		Time(name, [&strs, &func]()
+		{
+			// accumulate the results so that the calls can't be optimized away
+			volatile size_t total = 0;
+			for (auto const &s : strs)
+				total += func(s);
+			return static_cast<int>(strs.size());
+		});
+	};
+	Scan("strings.titleKey.regex", titles, [](const TSTRING &s) {
+		return std::regex_replace(s, std::basic_regex<TCHAR>(_T("[.,:\\(\\)]")), _T("")).length(); });
+	Scan("strings.titleKey.scan", titles, [](const TSTRING &s) {
+		return StripChars(s.c_str(), _T(".,:()")).length(); });
+	Scan("strings.replaceExt.regex", files, [](const TSTRING &s) {
+		return std::regex_replace(s, std::basic_regex<TCHAR>(_T("\\.[^.\\\\/:]+$")), _T(".pinballyHighScores")).length(); });
+	Scan("strings.replaceExt.scan", files, [](const TSTRING &s) {
+		return ReplaceFileExt(s.c_str(), _T(".pinballyHighScores")).length(); });
+	Scan("strings.stripSuffix.regex", files, [](const TSTRING &s) {
+		return std::regex_replace(s, std::basic_regex<TCHAR>(_T("\\.fp$"), std::regex_constants::icase), _T("")).length(); });
+	Scan("strings.stripSuffix.scan", files, [](const TSTRING &s) {
+		return StripSuffixI(s.c_str(), _T(".fp")).length(); });
+	Scan("strings.isBlank.regex", titles, [](const TSTRING &s) {
+		return static_cast<size_t>(std::regex_match(s, std::basic_regex<TCHAR>(_T("\\s*")))); });
+	Scan("strings.isBlank.scan", titles, [](const TSTRING &s) {
+		return static_cast<size_t>(IsBlankString(s.c_str())); });
+	Scan("strings.cachedRegex", titles, [](const TSTRING &s) {
+		return std::regex_replace(s, GetCachedRegex(_T("[.,:\\(\\)]")), _T("")).length(); });
+
+	// Dilation kernels.  Time the vector and scalar versions of the rect
+	// dilation that DMDView uses for text outlines, and of the general
+	// disc dilation, on a bitmap the size of a large DMD text layer with
+	// a sparse random pattern standing in for text, and check that the
+	// two versions produce the same pixels.
+	{
+		const UINT w = 512, h = 128;
+		Gdiplus::Bitmap bmp(w, h, PixelFormat32bppARGB);
+		Gdiplus::Rect rc(0, 0, w, h);
+		Gdiplus::BitmapData bd;
+		bmp.LockBits(&rc, Gdiplus::ImageLockModeWrite, PixelFormat32bppARGB, &bd);
+		UINT32 seed = 12345;
+		for (UINT y = 0; y < h; ++y)
+		{
+			UINT32 *p = reinterpret_cast<UINT32*>(static_cast<BYTE*>(bd.Scan0) + y * bd.Stride);
+			for (UINT x = 0; x < w; ++x)
+			{
+				seed = seed*1103515245 + 12345;
+				p[x] = ((seed >> 16) & 7) == 0 ? (seed | 0xFF000000) : 0;
+			}
+		}
+		bmp.UnlockBits(&bd);
+
+		// count the pixels that differ between two results
+		auto Compare = [&rc, w, h](Gdiplus::Bitmap *a, Gdiplus::Bitmap *b)
+		{
+			Gdiplus::BitmapData bda, bdb;
+			a->LockBits(&rc, Gdiplus::ImageLockModeRead, PixelFormat32bppARGB, &bda);
+			b->LockBits(&rc, Gdiplus::ImageLockModeRead, PixelFormat32bppARGB, &bdb);
+			int nDiffs = 0;
+			for (UINT y = 0; y < h; ++y)
+			{
+				const UINT32 *pa = reinterpret_cast<const UINT32*>(static_cast<const BYTE*>(bda.Scan0) + y * bda.Stride);
+				const UINT32 *pb = reinterpret_cast<const UINT32*>(static_cast<const BYTE*>(bdb.Scan0) + y * bdb.Stride);
+				for (UINT x = 0; x < w; ++x)
+					nDiffs += (pa[x] != pb[x]) ? 1 : 0;
+			}
+			a->UnlockBits(&bda);
+			b->UnlockBits(&bdb);
+			return nDiffs;
+		};
+
+		std::unique_ptr<Gdiplus::Bitmap> vec, ref;
+		Time("dilation.rect.vector", [&]() { vec.reset(Gdiplus::DilationEffectRect(&bmp, 3, 3)); return -1; });
+		Time("dilation.rect.scalar", [&]() { ref.reset(Gdiplus::DilationEffectRect(&bmp, 3, 3, true)); return -1; });
+		Record("dilation.rect.diffs", 0.0, Compare(vec.get(), ref.get()));
+
+		Time("dilation.disc.vector", [&]() { vec.reset(Gdiplus::DilationEffect(&bmp, 3, 3, Gdiplus::DilationModeDisc)); return -1; });
+		Time("dilation.disc.scalar", [&]() { ref.reset(Gdiplus::DilationEffect(&bmp, 3, 3, Gdiplus::DilationModeDisc, true)); return -1; });
+		Record("dilation.disc.diffs", 0.0, Compare(vec.get(), ref.get()));
+	}
+
+	// Javascript tests
+	if (auto js = JavascriptEngine::Get(); js != nullptr)
+	{
+		LogFileErrorHandler eh(_T("Benchmark: "));
+		auto Eval = [js, &eh](const WCHAR *script)
+		{
+			JsValueRef ret;
+			int n = -1;
+			if (js->EvalScript(script, L"system:benchmark", &ret, eh))
+			{
+				double d;
+				if (JsNumberToDouble(ret, &d) == JsNoError)
+					n = static_cast<int>(d);
+			}
+			return n;
+		};
+
+		// getAllGames() builds a game info object for every game
+		Time("js.getAllGames", [&Eval]() { return Eval(L"gameList.getAllGames().length"); });
+
+		// custom filters, with a per-game select() and a selectBatch()
+		Eval(L"gameList.createFilter({ id: \"Benchmark.Select\", title: \"Benchmark select\", "
+			L"select: game => game.year >= 1990 });"
+			L"gameList.createFilter({ id: \"Benchmark.SelectBatch\", title: \"Benchmark selectBatch\", "
+			L"selectBatch: ids => ids.map(id => id % 2) });"
+			L"0");
+
+		auto JsFilter = [gl, &Time](const CHAR *name, const TCHAR *id)
+		{
+			if (auto f = gl->GetFilterById(id); f != nullptr)
+				Time(name, [gl, f]() { gl->SetFilter(f); return gl->GetCurFilterCount(); });
+		};
+		JsFilter("js.filter.select", _T("Benchmark.Select"));
+		JsFilter("js.filter.selectBatch", _T("Benchmark.SelectBatch"));
+
+		if (oldFilter != nullptr)
+			gl->SetFilter(oldFilter);
+	}
+
+	// write the results
+	WriteResults();
+
+	// we're done - exit the program
+	if (auto pfw = Application::Get()->GetPlayfieldWin(); pfw != nullptr)
+		::PostMessage(pfw->GetHWnd(), WM_CLOSE, 0, 0);
+}
+
+void Benchmark::WriteResults()
+{
+	// make sure the output folder exists
+	if (!DirectoryExists(outFolder.c_str()))
+		CreateSubDirectory(outFolder.c_str(), nullptr, NULL);
+
+	TCHAR path[MAX_PATH];
+	PathCombine(path, outFolder.c_str(), MsgFmt(_T("Benchmark-%d.json"), sizes[0]));
+	FILEPtrHolder fp;
+	if (_tfopen_s(&fp, path, _T("w")) != 0)
+	{
+		LogFile::Get()->Write(_T("Benchmark: unable to write results file %s\n"), path);
+		return;
+	}
+
+	// escape a string for JSON
+	auto Str = [](const CHAR *s)
+	{
+		CSTRING r;
+		for (; *s != 0; ++s)
+		{
+			if (*s == '"' || *s == '\\')
+				r += '\\';
+			r += *s;
+		}
+		return r;
+	};
+
+	SYSTEMTIME st;
+	GetLocalTime(&st);
+	fprintf(fp, "{\n  \"version\": \"%s\",\n  \"build\": \"%s\",\n  \"games\": %d,\n"
+		"  \"timestamp\": \"%04d-%02d-%02dT%02d:%02d:%02d\",\n  \"results\": [\n",
+		Str(G_VersionInfo.fullVer).c_str(), IF_32_64("x86", "x64"), sizes[0],
+		st.wYear, st.wMonth, st.wDay, st.wHour, st.wMinute, st.wSecond);
+	for (size_t i = 0; i < results.size(); ++i)
+	{
+		auto const &r = results[i];
+		fprintf(fp, "    { \"name\": \"%s\", \"ms\": %.3f", Str(r.name.c_str()).c_str(), r.ms);
+		if (r.count >= 0)
+			fprintf(fp, ", \"count\": %d", r.count);
+		fprintf(fp, " }%s\n", i + 1 < results.size() ? "," : "");
+	}
+	fprintf(fp, "  ]\n}\n");
+
+	LogFile::Get()->Write(_T("Benchmark: results written to %s\n"), path);
+}
+
+double Benchmark::GetProcessCpuTime_ms()
+{
+	FILETIME ftCreate, ftExit, ftKernel, ftUser;
+	if (!GetProcessTimes(GetCurrentProcess(), &ftCreate, &ftExit, &ftKernel, &ftUser))
+		return 0.0;
+
+	auto ToMs = [](const FILETIME &ft) { return static_cast<double>((static_cast<UINT64>(ft.dwHighDateTime) << 32) | ft.dwLowDateTime) / 10000.0; };
+	return ToMs(ftKernel) + ToMs(ftUser);
+}
+
+void Benchmark::StartMediaSuite()
+{
+	// collect the files
+	static const TCHAR *videoExts[] = { _T(".mp4"), _T(".mpg"), _T(".f4v"), _T(".mkv"), _T(".wmv"), _T(".m4v"), _T(".avi"), _T(".mov") };
+	std::error_code ec;
+	for (auto &file : fs::recursive_directory_iterator(mediaFolder, ec))
+	{
+		if (!fs::is_regular_file(file.path(), ec))
+			continue;
+
+		// Identify the type by the file contents for images, since that's
+		// how the sprite loader picks its decoder, and by the extension
+		// for videos.
+		TSTRING path = file.path().c_str();
+		ImageFileDesc desc;
+		if (GetImageFileInfo(path.c_str(), desc, false, true))
+		{
+			switch (desc.imageType)
+			{
+			case ImageFileDesc::ImageType::PNG:
+			case ImageFileDesc::ImageType::JPEG:
+				mediaItems.emplace_back(path, "image", false);
+				break;
+
+			case ImageFileDesc::ImageType::GIF:
+			case ImageFileDesc::ImageType::APNG:
+				mediaItems.emplace_back(path, "animation", false);
+				break;
+
+			case ImageFileDesc::ImageType::SWF:
+				mediaItems.emplace_back(path, "flash", false);
+				break;
+			}
+		}
+		else
+		{
+			const TCHAR *ext = PathFindExtension(path.c_str());
+			if (std::find_if(std::begin(videoExts), std::end(videoExts), [ext](const TCHAR *e) { return _tcsicmp(e, ext) == 0; }) != std::end(videoExts))
+				mediaItems.emplace_back(path, "video", true);
+		}
+	}
+
+	// sort by name, so that the reports line up between runs
+	std::sort(mediaItems.begin(), mediaItems.end(), [](const MediaItem &a, const MediaItem &b) { return _tcsicmp(a.path.c_str(), b.path.c_str()) < 0; });
+
+	LogFile::Get()->Group();
+	LogFile::Get()->Write(_T("Benchmark: starting media tests, %d files in %s\n"),
+		static_cast<int>(mediaItems.size()), mediaFolder.c_str());
+
+	// Start with the baseline measurement.  This is the CPU load of the
+	// program with nothing under test, which we subtract from the load
+	// during the playback of each item.
+	mediaPhase = MediaPhase::Baseline;
+	phaseStart = timer.GetTime_seconds();
+	cpuStart_ms = GetProcessCpuTime_ms();
+	mediaTimerId = SetTimer(NULL, 0, mediaPoll_ms, &MediaTimerProc);
+}
+
+void CALLBACK Benchmark::MediaTimerProc(HWND, UINT, UINT_PTR, DWORD)
+{
+	if (inst != nullptr)
+		inst->MediaStep();
+}
+
+void Benchmark::MediaStep()
+{
+	double now = timer.GetTime_seconds();
+	double elapsed_ms = (now - phaseStart) * 1000.0;
+	switch (mediaPhase)
+	{
+	case MediaPhase::Baseline:
+		if (elapsed_ms >= mediaBaseline_ms)
+		{
+			baselineCpu_pct = (GetProcessCpuTime_ms() - cpuStart_ms) / elapsed_ms * 100.0;
+			LogFile::Get()->Write(_T("Benchmark: baseline CPU load %.1f%%\n"), baselineCpu_pct);
+			mediaIndex = 0;
+			StartMediaItem();
+		}
+		break;
+
+	case MediaPhase::Loading:
+		{
+			auto &item = mediaItems[mediaIndex];
+
+			// For still images, the decoding (and the texture creation that
+			// goes with it) is done when the loader thread finishes, which is
+			// before the first render.  The video player decodes on its own
+			// threads, so for videos and Flash objects, we can only see when
+			// the first frame is ready.
+			if (item.decode_ms < 0 && !mediaSprite->IsLoadPending() && !item.video && strcmp(item.kind, "flash") != 0)
+				item.decode_ms = (now - loadStart) * 1000.0;
+
+			if (mediaSprite->IsFrameReady())
+			{
+				item.ok = true;
+				item.firstFrame_ms = (now - loadStart) * 1000.0;
+				if (item.decode_ms < 0)
+					item.decode_ms = item.firstFrame_ms;
+
+				// Still images don't use any CPU once they're displayed, so
+				// we're done with them.  For animations and videos, go on to
+				// the steady-state measurement.
+				if (strcmp(item.kind, "image") == 0)
+				{
+					item.vram = TextureBudget::GetTotalBytes() - vramStart;
+					EndMediaItem();
+				}
+				else
+				{
+					mediaPhase = MediaPhase::Steady;
+					phaseStart = now;
+					cpuStart_ms = GetProcessCpuTime_ms();
+				}
+			}
+			else if ((now - loadStart) * 1000.0 >= mediaLoadTimeout_ms)
+			{
+				LogFile::Get()->Write(_T("Benchmark: %s: no frame displayed after %u ms\n"), item.path.c_str(), mediaLoadTimeout_ms);
+				EndMediaItem();
+			}
+		}
+		break;
+
+	case MediaPhase::Steady:
+		if (elapsed_ms >= mediaSteady_ms)
+		{
+			auto &item = mediaItems[mediaIndex];
+			item.cpu_pct = max(0.0, (GetProcessCpuTime_ms() - cpuStart_ms) / elapsed_ms * 100.0 - baselineCpu_pct);
+			item.vram = TextureBudget::GetTotalBytes() - vramStart;
+			EndMediaItem();
+		}
+		break;
+	}
+}
+
+void Benchmark::StartMediaItem()
+{
+	// if we've run out of items, finish up
+	auto pfv = Application::Get()->GetPlayfieldView();
+	if (mediaIndex >= mediaItems.size() || pfv == nullptr)
+	{
+		KillTimer(NULL, mediaTimerId);
+		mediaTimerId = 0;
+		WriteMediaResults();
+		if (auto pfw = Application::Get()->GetPlayfieldWin(); pfw != nullptr)
+			::PostMessage(pfw->GetHWnd(), WM_CLOSE, 0, 0);
+		return;
+	}
+
+	// Size the sprite to fill the window, and rasterize at the window
+	// size, as the playfield does
+	auto &item = mediaItems[mediaIndex];
+	RECT rc;
+	GetClientRect(pfv->GetHWnd(), &rc);
+	SIZE pixSize = { max(1L, rc.right - rc.left), max(1L, rc.bottom - rc.top) };
+	POINTF normSize = { static_cast<float>(pixSize.cx) / static_cast<float>(pixSize.cy), 1.0f };
+
+	// load it
+	LogFileErrorHandler eh(_T("Benchmark: "));
+	vramStart = TextureBudget::GetTotalBytes();
+	loadStart = timer.GetTime_seconds();
+	bool ok;
+	if (item.video)
+	{
+		RefPtr<VideoSprite> v(new VideoSprite());
+		ok = v->LoadVideo(item.path, pfv->GetHWnd(), normSize, eh, _T("Benchmark video"), true, 0);
+		v->SetLooping(true);
+		mediaSprite = v.Get();
+	}
+	else
+	{
+		mediaSprite.Attach(new Sprite());
+		ok = mediaSprite->Load(item.path.c_str(), normSize, pixSize, NULL, eh);
+	}
+	item.load_ms = (timer.GetTime_seconds() - loadStart) * 1000.0;
+
+	// display it, and start watching for the first frame
+	if (ok)
+	{
+		pfv->SetBenchmarkSprite(mediaSprite.Get());
+		mediaPhase = MediaPhase::Loading;
+		phaseStart = loadStart;
+	}
+	else
+		EndMediaItem();
+}
+
+void Benchmark::EndMediaItem()
+{
+	auto &item = mediaItems[mediaIndex];
+
+	// remove the sprite
+	if (auto pfv = Application::Get()->GetPlayfieldView(); pfv != nullptr)
+		pfv->SetBenchmarkSprite(nullptr);
+	mediaSprite = nullptr;
+
+	// For still images, decode the file again on its own, to separate the
+	// decoding from the texture upload.  The file is in the disk cache by
+	// now, so this measures only the decoder.
+	if (item.ok && strcmp(item.kind, "image") == 0)
+	{
+		double t0 = timer.GetTime_seconds();
+		DirectX::TexMetadata meta;
+		DirectX::ScratchImage img;
+		if (SUCCEEDED(DirectX::LoadFromWICFile(item.path.c_str(), DirectX::WIC_FLAGS_IGNORE_SRGB, &meta, img)))
+		{
+			double decode_ms = (timer.GetTime_seconds() - t0) * 1000.0;
+			item.upload_ms = max(0.0, item.decode_ms - decode_ms);
+			item.decode_ms = decode_ms;
+		}
+	}
+
+	LogFile::Get()->Write(_T("Benchmark: %s: %hs, %s, load %.1f ms, decode %.1f ms, first frame %.1f ms, CPU %.1f%%, %I64d bytes\n"),
+		item.path.c_str(), item.kind, item.ok ? _T("OK") : _T("failed"),
+		item.load_ms, item.decode_ms, item.firstFrame_ms, item.cpu_pct, item.vram);
+
+	// go on to the next item
+	++mediaIndex;
+	StartMediaItem();
+}
+
+void Benchmark::WriteMediaResults()
+{
+	// make sure the output folder exists
+	if (!DirectoryExists(outFolder.c_str()))
+		CreateSubDirectory(outFolder.c_str(), nullptr, NULL);
+
+	TCHAR path[MAX_PATH];
+	PathCombine(path, outFolder.c_str(), _T("Benchmark-Media.json"));
+	FILEPtrHolder fp;
+	if (_tfopen_s(&fp, path, _T("w")) != 0)
+	{
+		LogFile::Get()->Write(_T("Benchmark: unable to write results file %s\n"), path);
+		return;
+	}
+
+	// escape a file name for JSON, as UTF-8
+	auto Str = [](const TSTRING &s)
+	{
+		CSTRING u = WideToAnsi(s.c_str(), CP_UTF8);
+		CSTRING r;
+		for (auto c : u)
+		{
+			if (c == '"' || c == '\\')
+				r += '\\';
+			r += c;
+		}
+		return r;
+	};
+
+	// write a number, or null for a measurement that doesn't apply
+	auto Num = [](double d)
+	{
+		CHAR buf[64];
+		if (d < 0)
+			return CSTRING("null");
+		sprintf_s(buf, "%.3f", d);
+		return CSTRING(buf);
+	};
+
+	SYSTEMTIME st;
+	GetLocalTime(&st);
+	fprintf(fp, "{\n  \"version\": \"%s\",\n  \"build\": \"%s\",\n"
+		"  \"timestamp\": \"%04d-%02d-%02dT%02d:%02d:%02d\",\n  \"folder\": \"%s\",\n"
+		"  \"baselineCpuPct\": %.3f,\n  \"files\": [\n",
+		G_VersionInfo.fullVer, IF_32_64("x86", "x64"),
+		st.wYear, st.wMonth, st.wDay, st.wHour, st.wMinute, st.wSecond,
+		Str(mediaFolder).c_str(), baselineCpu_pct);
+	for (size_t i = 0; i < mediaItems.size(); ++i)
+	{
+		auto const &m = mediaItems[i];
+		fprintf(fp, "    { \"file\": \"%s\", \"kind\": \"%s\", \"ok\": %s, \"loadMs\": %s, \"decodeMs\": %s, "
+			"\"uploadMs\": %s, \"firstFrameMs\": %s, \"cpuPct\": %s, \"vramBytes\": %s }%s\n",
+			Str(m.path).c_str(), m.kind, m.ok ? "true" : "false",
+			Num(m.load_ms).c_str(), Num(m.decode_ms).c_str(), Num(m.upload_ms).c_str(),
+			Num(m.firstFrame_ms).c_str(), Num(m.cpu_pct).c_str(),
+			m.vram < 0 ? "null" : std::to_string(m.vram).c_str(),
+			i + 1 < mediaItems.size() ? "," : "");
+	}
+	fprintf(fp, "  ],\n");
+
+	// Write the worst offenders by each measure.  Files that failed to
+	// load go in their own list, since they have no measurements.
+	auto Worst = [this, &fp, &Str](const CHAR *name, std::function<double(const MediaItem&)> key, bool last)
+	{
+		std::vector<const MediaItem*> v;
+		for (auto const &m : mediaItems)
+		{
+			if (m.ok && key(m) >= 0)
+				v.push_back(&m);
+		}
+		std::sort(v.begin(), v.end(), [&key](const MediaItem *a, const MediaItem *b) { return key(*a) > key(*b); });
+		if (v.size() > mediaWorstCount)
+			v.resize(mediaWorstCount);
+
+		fprintf(fp, "  \"%s\": [", name);
+		for (size_t i = 0; i < v.size(); ++i)
+			fprintf(fp, "%s\n    { \"file\": \"%s\", \"value\": %.3f }", i == 0 ? "" : ",", Str(v[i]->path).c_str(), key(*v[i]));
+		fprintf(fp, "%s]%s\n", v.size() != 0 ? "\n  " : "", last ? "" : ",");
+	};
+	Worst("worstFirstFrame", [](const MediaItem &m) { return m.firstFrame_ms; }, false);
+	Worst("worstDecode", [](const MediaItem &m) { return m.decode_ms; }, false);
+	Worst("worstCpu", [](const MediaItem &m) { return m.cpu_pct; }, false);
+	Worst("worstVram", [](const MediaItem &m) { return static_cast<double>(m.vram); }, false);
+
+	fprintf(fp, "  \"failed\": [");
+	bool first = true;
+	for (auto const &m : mediaItems)
+	{
+		if (!m.ok)
+		{
+			fprintf(fp, "%s\n    \"%s\"", first ? "" : ",", Str(m.path).c_str());
+			first = false;
+		}
+	}
+	fprintf(fp, "%s]\n}\n", first ? "" : "\n  ");
+
+	LogFile::Get()->Write(_T("Benchmark: media results written to %s\n"), path);
+}
+
+void Benchmark::StartSessionSuite()
+{
+	// load the recording
+	LogFileErrorHandler eh(_T("Benchmark: "));
+	auto pfv = Application::Get()->GetPlayfieldView();
+	if (pfv == nullptr || !SessionRecorder::Load(sessionFile.c_str(), sessionEvents, eh) || sessionEvents.size() == 0)
+	{
+		LogFile::Get()->Write(_T("Benchmark: no session events to play back from %s\n"), sessionFile.c_str());
+		if (auto pfw = Application::Get()->GetPlayfieldWin(); pfw != nullptr)
+			::PostMessage(pfw->GetHWnd(), WM_CLOSE, 0, 0);
+		return;
+	}
+
+	LogFile::Get()->Group();
+	LogFile::Get()->Write(_T("Benchmark: starting session playback, %d events from %s, %d games loaded\n"),
+		static_cast<int>(sessionEvents.size()), sessionFile.c_str(), GameList::Get()->GetAllGamesCount());
+
+	// Start from the same place every time, and seed the random number
+	// generator, so that attract mode picks the same games on each run
+	pfv->ResetForPlayback();
+	srand(1);
+
+	// start the playback
+	sessionIndex = 0;
+	sessionStart = lastMemorySample = timer.GetTime_seconds();
+	sessionRunning = true;
+	SessionStep();
+	sessionTimerId = SetTimer(NULL, 0, sessionPoll_ms, &SessionTimerProc);
+}
+
+void CALLBACK Benchmark::SessionTimerProc(HWND, UINT, UINT_PTR, DWORD)
+{
+	if (inst != nullptr && inst->sessionRunning)
+		inst->SessionStep();
+}
+
+void Benchmark::SessionStep()
+{
+	// A command can run a nested message loop (for a dialog, say), which
+	// would call back here from the timer.  Hold the playback until the
+	// outer step is done.
+	static bool inStep = false;
+	if (inStep)
+		return;
+	inStep = true;
+
+	auto pfv = Application::Get()->GetPlayfieldView();
+	double now = timer.GetTime_seconds();
+	double t_ms = (now - sessionStart) * 1000.0;
+
+	// deliver the events that are due
+	while (pfv != nullptr && sessionIndex < sessionEvents.size() && sessionEvents[sessionIndex].t <= t_ms)
+	{
+		auto const &e = sessionEvents[sessionIndex++];
+		pfv->PlaybackKeyEvent(e.mode, e.repeatCount, e.bg, e.cmds);
+	}
+
+	// note phase changes
+	const CHAR *phase = pfv != nullptr ? pfv->GetUIPhase() : "wheel";
+	if (sessionPhaseName == nullptr || strcmp(phase, sessionPhaseName) != 0)
+	{
+		if (sessionPhase != nullptr)
+			sessionPhase->time_ms += (now - sessionPhaseStart) * 1000.0;
+
+		sessionPhase = &sessionPhases[phase];
+		sessionPhase->visits += 1;
+		sessionPhaseName = phase;
+		sessionPhaseStart = now;
+		LogFile::Get()->Write(_T("Benchmark: session phase %hs at %.0f ms\n"), phase, t_ms);
+	}
+
+	// sample the memory use periodically
+	if ((now - lastMemorySample) * 1000.0 >= sessionMemoryInterval_ms)
+	{
+		MemoryStats::Snapshot s;
+		MemoryStats::GetSnapshot(s);
+		sessionPhase->peakPrivateBytes = max(sessionPhase->peakPrivateBytes, s.privateBytes);
+		sessionPhase->peakWorkingSet = max(sessionPhase->peakWorkingSet, s.workingSet);
+		sessionPhase->peakTextureBytes = max(sessionPhase->peakTextureBytes, s.textureBytes);
+		lastMemorySample = now;
+	}
+
+	// We're done when all of the events have been delivered, the tail
+	// period has elapsed, and any game launched during the session has
+	// returned.
+	if (sessionIndex >= sessionEvents.size()
+		&& t_ms >= sessionEvents.back().t + sessionTail_ms
+		&& !Application::Get()->IsGameActive())
+	{
+		sessionPhase->time_ms += (now - sessionPhaseStart) * 1000.0;
+		KillTimer(NULL, sessionTimerId);
+		sessionTimerId = 0;
+		sessionRunning = false;
+		WriteSessionResults();
+		if (auto pfw = Application::Get()->GetPlayfieldWin(); pfw != nullptr)
+			::PostMessage(pfw->GetHWnd(), WM_CLOSE, 0, 0);
+	}
+
+	inStep = false;
+}
+
+void Benchmark::OnFrame(const TCHAR *window, float ms)
+{
+	if (auto p = inst->sessionPhase; p != nullptr)
+	{
+		auto it = p->frames.find(window);
+		if (it == p->frames.end())
+			it = p->frames.emplace(window, std::vector<float>()).first;
+		it->second.push_back(ms);
+	}
+}
+
+void Benchmark::OnInputLatency(float ms)
+{
+	if (auto p = inst->sessionPhase; p != nullptr)
+		p->inputLatency.push_back(ms);
+}
+
+void Benchmark::OnMediaSync(const TCHAR *window, const TCHAR *disposition)
+{
+	auto it = inst->mediaSyncs.find(window);
+	if (it == inst->mediaSyncs.end())
+		it = inst->mediaSyncs.emplace(window, MediaSyncStats()).first;
+
+	// A new sync replaces one still in progress, since a new selection
+	// supersedes the old one.  At the end of a sync, count the disposition.
+	auto &m = it->second;
+	double now = inst->timer.GetTime_seconds();
+	if (disposition == nullptr)
+		m.start = now;
+	else if (m.start >= 0.0)
+	{
+		if (_tcscmp(disposition, _T("success")) == 0)
+			m.latency.push_back(static_cast<float>((now - m.start) * 1000.0));
+		else if (_tcscmp(disposition, _T("skip")) == 0)
+			++m.skipped;
+		else
+			++m.errors;
+		m.start = -1.0;
+	}
+}
+
+void Benchmark::WriteSessionResults()
+{
+	// make sure the output folder exists
+	if (!DirectoryExists(outFolder.c_str()))
+		CreateSubDirectory(outFolder.c_str(), nullptr, NULL);
+
+	TCHAR path[MAX_PATH];
+	PathCombine(path, outFolder.c_str(), MsgFmt(_T("Benchmark-Session-%d.json"), sizes[0]));
+	FILEPtrHolder fp;
+	if (_tfopen_s(&fp, path, _T("w")) != 0)
+	{
+		LogFile::Get()->Write(_T("Benchmark: unable to write results file %s\n"), path);
+		return;
+	}
+
+	// escape a string for JSON, as UTF-8
+	auto Str = [](const TCHAR *s)
+	{
+		CSTRING u = WideToAnsi(s, CP_UTF8);
+		CSTRING r;
+		for (auto c : u)
+		{
+			if (c == '"' || c == '\\')
+				r += '\\';
+			r += c;
+		}
+		return r;
+	};
+
+	// write the percentiles for a list of samples
+	auto Percentiles = [&fp](std::vector<float> &v)
+	{
+		std::sort(v.begin(), v.end());
+		size_t n = v.size();
+		auto Pct = [&v, n](float pct) { return n == 0 ? 0.0f : v[min(n - 1, static_cast<size_t>(ceil(n * pct / 100.0f)) - 1)]; };
+		fprintf(fp, "{ \"count\": %d, \"p50Ms\": %.3f, \"p95Ms\": %.3f, \"p99Ms\": %.3f, \"maxMs\": %.3f",
+			static_cast<int>(n), Pct(50.0f), Pct(95.0f), Pct(99.0f), n == 0 ? 0.0f : v[n - 1]);
+	};
+
+	// the process-wide memory peaks
+	PROCESS_MEMORY_COUNTERS pmc;
+	ZeroMemory(&pmc, sizeof(pmc));
+	GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc));
+
+	SYSTEMTIME st;
+	GetLocalTime(&st);
+	fprintf(fp, "{\n  \"version\": \"%s\",\n  \"build\": \"%s\",\n  \"games\": %d,\n"
+		"  \"timestamp\": \"%04d-%02d-%02dT%02d:%02d:%02d\",\n  \"session\": \"%s\",\n"
+		"  \"events\": %d,\n  \"durationMs\": %.0f,\n"
+		"  \"peakWorkingSet\": %I64u,\n  \"peakPagefileUsage\": %I64u,\n  \"phases\": [\n",
+		G_VersionInfo.fullVer, IF_32_64("x86", "x64"), sizes[0],
+		st.wYear, st.wMonth, st.wDay, st.wHour, st.wMinute, st.wSecond,
+		Str(sessionFile.c_str()).c_str(), static_cast<int>(sessionEvents.size()),
+		(timer.GetTime_seconds() - sessionStart) * 1000.0,
+		static_cast<UINT64>(pmc.PeakWorkingSetSize), static_cast<UINT64>(pmc.PeakPagefileUsage));
+
+	size_t nPhase = 0;
+	for (auto &p : sessionPhases)
+	{
+		auto &s = p.second;
+		fprintf(fp, "    { \"name\": \"%s\", \"timeMs\": %.0f, \"visits\": %d,\n      \"frames\": {",
+			p.first.c_str(), s.time_ms, s.visits);
+		size_t nWin = 0;
+		for (auto &f : s.frames)
+		{
+			fprintf(fp, "%s\n        \"%s\": ", nWin++ == 0 ? "" : ",", Str(f.first.c_str()).c_str());
+			Percentiles(f.second);
+			fprintf(fp, " }");
+		}
+		fprintf(fp, "%s},\n      \"inputLatency\": ", nWin != 0 ? "\n      " : "");
+		Percentiles(s.inputLatency);
+		fprintf(fp, " },\n      \"peakPrivateBytes\": %I64d, \"peakWorkingSet\": %I64d, \"peakTextureBytes\": %I64d }%s\n",
+			s.peakPrivateBytes, s.peakWorkingSet, s.peakTextureBytes, ++nPhase < sessionPhases.size() ? "," : "");
+	}
+	fprintf(fp, "  ],\n  \"mediaSync\": {");
+
+	size_t nWin = 0;
+	for (auto &m : mediaSyncs)
+	{
+		fprintf(fp, "%s\n    \"%s\": ", nWin++ == 0 ? "" : ",", Str(m.first.c_str()).c_str());
+		Percentiles(m.second.latency);
+		fprintf(fp, ", \"skipped\": %d, \"errors\": %d }", m.second.skipped, m.second.errors);
+	}
+	fprintf(fp, "%s}\n}\n", nWin != 0 ? "\n  " : "");
+
+	LogFile::Get()->Write(_T("Benchmark: session results written to %s\n"), path);
+}
+
+void Benchmark::Shutdown()
+{
+	if (inst == nullptr)
+		return;
+
+	// stop the media and session suites, if they're still running
+	if (inst->mediaTimerId != 0)
+		KillTimer(NULL, inst->mediaTimerId);
+	if (inst->sessionTimerId != 0)
+		KillTimer(NULL, inst->sessionTimerId);
+	inst->mediaSprite = nullptr;
+	inst->sessionRunning = false;
+
+	// if there are more sizes to run, launch the next session
+	if (inst->mediaFolder.length() == 0 && inst->sizes.size() > 1)
+	{
+		TSTRING lst;
+		for (size_t i = 1; i < inst->sizes.size(); ++i)
+			lst += MsgFmt(_T("%s%d"), i > 1 ? _T(",") : _T(""), inst->sizes[i]).Get();
+
+		TCHAR exe[MAX_PATH];
+		GetModuleFileName(NULL, exe, countof(exe));
+		TSTRING cmd = MsgFmt(_T("\"%s\" /Benchmark:games=%s,out=%s"), exe, lst.c_str(), inst->outFolder.c_str()).Get();
+		if (inst->sessionFile.length() != 0)
+			cmd += MsgFmt(_T(",session=%s"), inst->sessionFile.c_str()).Get();
+
+		STARTUPINFO si;
+		ZeroMemory(&si, sizeof(si));
+		si.cb = sizeof(si);
+		PROCESS_INFORMATION pi;
+		if (CreateProcess(NULL, cmd.data(), NULL, NULL, FALSE, 0, NULL, NULL, &si, &pi))
+		{
+			CloseHandle(pi.hThread);
+			CloseHandle(pi.hProcess);
+		}
+		else
+		{
+			WindowsErrorMessage err;
+			LogFile::Get()->Write(_T("Benchmark: unable to launch the next session (%s): %s\n"), cmd.c_str(), err.Get());
+		}
+	}
+
+	delete inst;
+	inst = nullptr;
+}
@@ -0,0 +1,264 @@
+// This file is part of PinballY
+// Copyright 2018 Michael J Roberts | GPL v3 or later | NO WARRANTY
+//
+// Benchmark mode
+//
+// Running the program with /Benchmark generates a synthetic game
+// collection, starts up against it, times the main game list operations,
+// writes the timings to a JSON file, and exits.  This gives us numbers
+// that can be compared between builds, to catch performance regressions
+// in the parts of the program that scale with the size of the collection.
+//
+//   /Benchmark[:games=<N>[,<N>...]][,media=<folder>][,session=<file>][,out=<folder>]
+//
+// 'games' lists the collection sizes to run; the default is 1000, 10000,
+// and 50000.  Each size runs in its own session, since the collection is
+// set up through the config file: when one size is finished, we launch a
+// new copy of the program for the next one.  The results go to
+// Benchmark-<N>.json in the output folder, which defaults to the
+// Benchmark folder under the program folder.
+//
+// Each collection lives in Benchmark\Games<N>, with its own settings file,
+// XML table databases for two systems, a GameStats.csv with play history,
+// ratings, favorites, and categories for a portion of the games, empty
+// table files, and placeholder wheel and table images.  The files are
+// generated on the first run for each size and reused afterwards, since
+// writing out 50,000 games' worth of files takes a while.  The generator
+// uses a fixed random seed, so every build sees the same collection.
+//
+// The benchmark runs from a timer once the windows are up, so it sees the
+// same fully initialized program as a normal session, including the
+// Javascript engine for the getAllGames() and custom filter timings.
+//
+// 'media' selects the media suite instead.  This runs against the normal
+// settings, so that it measures the actual cabinet setup, and loads every
+// image, animation, Flash object, and video in the given folder tree, one
+// at a time, through the normal sprite loaders, displaying each one on
+// top of the playfield window.  For each file, we record the load call
+// time, the decode time, the texture upload time (for still images, where
+// the two can be separated), the latency to the first displayed frame,
+// the steady-state CPU load while it plays (for animations and videos),
+// and the texture memory it uses.  The results go to Benchmark-Media.json,
+// which ends with lists of the worst files by each measure.
+//
+// 'session' selects the session suite.  This replays a session recording
+// made with /RecordSession (see SessionRecorder.h) against the generated
+// collection, delivering each recorded key command at its recorded time.
+// Before starting, we reset the UI to a fixed starting point (the first
+// game in the All Games filter) and seed the random number generator, so
+// that attract mode makes the same choices on every run.  Game launches
+// run the collection's stand-in "player", a hidden command prompt that
+// exits after about five seconds, so a launch and return go through the
+// normal game monitoring.  While the session plays, we collect each
+// window's frame times, the input latency samples, and the process and
+// texture memory peaks, broken down by UI phase (wheel, menu, popup,
+// attract, or game, per PlayfieldView::GetUIPhase()), plus the media
+// sync latencies for each window: the time from the start of a new game
+// selection's media load to the end of its cross-fade.  The results go
+// to Benchmark-Session-<N>.json.
+
+#pragma once
+#include <vector>
+#include <map>
+#include "HiResTimer.h"
+#include "SessionRecorder.h"
+
+class Sprite;
+
+class Benchmark
+{
+public:
+	// Parse a command line option.  Returns true if it's a /Benchmark
+	// option, in which case we enable benchmark mode.
+	static bool ParseOption(const TCHAR *arg);
+
+	// is benchmark mode active?
+	static bool IsActive() { return inst != nullptr; }
+
+	// Set up the synthetic collection for this session, generating the
+	// files if needed.  Fills in the config folder and GameStats.csv path
+	// to use for the session.  Call this before loading the config.
+	static bool Prepare(TSTRING &configFolder, TSTRING &gameStatsPath, ErrorHandler &eh);
+
+	// Start the benchmark.  Call this from the UI thread when startup is
+	// complete.  The tests run from a timer, after a short delay to let
+	// the startup work settle.
+	static void Start();
+
+	// Shut down.  If there are more collection sizes to run, this
+	// launches the next session.  Call at program exit.
+	static void Shutdown();
+
+	// Record a measurement taken by the caller, such as the startup
+	// game list load.  Does nothing if benchmark mode isn't active.
+	static void Record(const CHAR *name, double ms, int count = -1);
+
+	// Session suite measurement hooks.  The windows call OnFrame() with
+	// each frame time, the input latency tracker calls OnInputLatency()
+	// with each completed sample, and the playfield calls OnMediaSync()
+	// at the start (with a null disposition) and end of each window's
+	// media sync.  Check IsSessionRunning() before calling these.
+	static bool IsSessionRunning() { return inst != nullptr && inst->sessionRunning; }
+	static void OnFrame(const TCHAR *window, float ms);
+	static void OnInputLatency(float ms);
+	static void OnMediaSync(const TCHAR *window, const TCHAR *disposition);
+
+	// Scoped timer.  This records the time until it goes out of scope.
+	// 'name' must be a static string.
+	class Timer
+	{
+	public:
+		Timer(const CHAR *name) : name(name), t0(inst != nullptr ? inst->timer.GetTime_seconds() : 0.0) { }
+		~Timer() { if (inst != nullptr) Record(name, (inst->timer.GetTime_seconds() - t0) * 1000.0); }
+
+	protected:
+		const CHAR *name;
+		double t0;
+	};
+
+protected:
+	Benchmark() { }
+
+	// global singleton
+	static Benchmark *inst;
+
+	// generate the collection files in the given folder
+	bool Generate(const TCHAR *folder, ErrorHandler &eh);
+
+	// run the tests
+	static void CALLBACK TimerProc(HWND, UINT, UINT_PTR, DWORD);
+	void Run();
+
+	// write the results file
+	void WriteResults();
+
+	// collection sizes, with the current session's size first
+	std::vector<int> sizes;
+
+	// media corpus folder, for the media suite; empty for the game list suite
+	TSTRING mediaFolder;
+
+	// output folder
+	TSTRING outFolder;
+
+	// Media suite.  This runs as a state machine from a polling timer, since
+	// the loads complete asynchronously, and the frames have to go through
+	// the normal render cycle in the message loop.
+	struct MediaItem
+	{
+		MediaItem(const TSTRING &path, const CHAR *kind, bool video) : path(path), kind(kind), video(video) { }
+		TSTRING path;              // file path
+		const CHAR *kind;          // "image", "animation", "flash", or "video"
+		bool video;                // load through the video player?
+		bool ok = false;           // did it load and display?
+		double load_ms = -1;       // time in the synchronous load call
+		double decode_ms = -1;     // decode time
+		double upload_ms = -1;     // texture upload time, if it can be separated from decoding
+		double firstFrame_ms = -1; // time from the start of loading to the first displayed frame
+		double cpu_pct = -1;       // steady-state CPU load above the baseline, as a percentage of one core
+		INT64 vram = -1;           // texture memory in use, in bytes
+	};
+	std::vector<MediaItem> mediaItems;
+
+	void StartMediaSuite();
+	static void CALLBACK MediaTimerProc(HWND, UINT, UINT_PTR, DWORD);
+	void MediaStep();
+	void StartMediaItem();
+	void EndMediaItem();
+	void WriteMediaResults();
+
+	// total CPU time used by the process, in milliseconds
+	static double GetProcessCpuTime_ms();
+
+	// media suite state
+	enum class MediaPhase { Baseline, Loading, Steady };
+	MediaPhase mediaPhase = MediaPhase::Baseline;
+	size_t mediaIndex = 0;           // current item index
+	RefPtr<Sprite> mediaSprite;      // current item's sprite
+	double phaseStart = 0.0;         // start time of the current phase, in seconds
+	double loadStart = 0.0;          // start time of the current item's load
+	double cpuStart_ms = 0.0;        // process CPU time at the start of the current phase
+	INT64 vramStart = 0;             // texture memory in use before the current item
+	double baselineCpu_pct = 0.0;    // CPU load with no item loaded
+	UINT_PTR mediaTimerId = 0;       // polling timer
+
+	// Session suite.  This runs from a polling timer that delivers the
+	// recorded events as their times come up.
+	TSTRING sessionFile;
+	std::vector<SessionRecorder::Event> sessionEvents;
+
+	void StartSessionSuite();
+	static void CALLBACK SessionTimerProc(HWND, UINT, UINT_PTR, DWORD);
+	void SessionStep();
+	void WriteSessionResults();
+
+	// per-phase statistics
+	struct SessionPhase
+	{
+		double time_ms = 0.0;              // total time spent in the phase
+		int visits = 0;                    // number of times the phase was entered
+		std::map<TSTRING, std::vector<float>, std::less<>> frames;  // frame times by window, in milliseconds
+		std::vector<float> inputLatency;   // input latency samples, in milliseconds
+		INT64 peakPrivateBytes = 0;        // memory peaks while in the phase
+		INT64 peakWorkingSet = 0;
+		INT64 peakTextureBytes = 0;
+	};
+	std::map<CSTRING, SessionPhase> sessionPhases;
+
+	// per-window media sync statistics
+	struct MediaSyncStats
+	{
+		double start = -1.0;               // start time of the sync in progress, or -1 if none
+		std::vector<float> latency;        // completed sync times, in milliseconds
+		int skipped = 0;                   // syncs with no media to load
+		int errors = 0;                    // syncs that failed
+	};
+	std::map<TSTRING, MediaSyncStats, std::less<>> mediaSyncs;
+
+	// session state
+	bool sessionRunning = false;       // playback in progress
+	size_t sessionIndex = 0;           // next event to deliver
+	double sessionStart = 0.0;         // playback start time, in seconds
+	double sessionPhaseStart = 0.0;    // start time of the current phase
+	double lastMemorySample = 0.0;     // time of the last memory sample
+	const CHAR *sessionPhaseName = nullptr;  // current phase name
+	SessionPhase *sessionPhase = nullptr;    // current phase statistics
+	UINT_PTR sessionTimerId = 0;       // polling timer
+
+	// measurement
+	struct Result
+	{
+		Result(const CHAR *name, double ms, int count) : name(name), ms(ms), count(count) { }
+		CSTRING name;      // test name
+		double ms;         // elapsed time in milliseconds
+		int count;         // result count (games selected, etc), or -1 if not applicable
+	};
+	std::vector<Result> results;
+
+	// timer
+	HiResTimer timer;
+
+	// benchmark timer ID
+	UINT_PTR timerId = 0;
+
+	// Delay from the end of startup to the start of the tests.  This lets
+	// the background startup tasks finish, so that they don't compete
+	// with the tests for the CPU.
+	static const DWORD startDelay_ms = 5000;
+
+	// collection generator version; bump this when changing the generator
+	// so that existing collections are regenerated
+	static const int generatorVersion = 2;
+
+	// media suite timing parameters
+	static const UINT mediaPoll_ms = 15;            // polling interval
+	static const DWORD mediaBaseline_ms = 2000;     // idle CPU baseline measurement time
+	static const DWORD mediaLoadTimeout_ms = 15000; // give up on a load after this long
+	static const DWORD mediaSteady_ms = 3000;       // steady-state playback measurement time
+	static const size_t mediaWorstCount = 10;       // number of entries in each worst-offender list
+
+	// session suite timing parameters
+	static const UINT sessionPoll_ms = 10;              // polling interval
+	static const DWORD sessionMemoryInterval_ms = 250;  // memory sampling interval
+	static const DWORD sessionTail_ms = 5000;           // keep measuring this long after the last event
+};
@@ -4,6 +4,15 @@
 #include "stdafx.h"
 #include "Resource.h"
 #include "CSVFile.h"
+#include "BackgroundFileWriter.h"
+#include "LogFile.h"
+#include "../Utilities/DateUtil.h"
+
+#if defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define CSV_SCAN_SSE2 1
+#include <emmintrin.h>
+#include <intrin.h>
+#endif
 
 CSVFile::CSVFile() : dirty(false)
 {
@@ -13,6 +22,26 @@ CSVFile::~CSVFile()
 {
 }
 
+size_t CSVFile::EstimateMemory() const
+{
+	// start with the file contents and the row list
+	size_t bytes = fileContentsLen * sizeof(wchar_t) + rows.capacity() * sizeof(Row);
+
+	// add the field arrays, plus any values stored outside the file contents
+	for (auto const &row : rows)
+	{
+		bytes += row.fields.capacity() * sizeof(Field);
+		for (auto const &field : row.fields)
+			bytes += field.GetPrivateSize();
+	}
+
+	// add the column map
+	for (auto const &col : columns)
+		bytes += sizeof(col) + col.first.capacity() * sizeof(TCHAR);
+
+	return bytes;
+}
+
 CSVFile::Column *CSVFile::DefineColumn(const TCHAR *name)
 {
 	// look for an existing column of the same name
@@ -27,6 +56,47 @@ CSVFile::Column *CSVFile::DefineColumn(const TCHAR *name)
 	return &it.first->second;
 }
 
+// Find the end of an unquoted field: the next comma, newline, or the
+// null terminator.  This is the inner loop of the file parser, since
+// most fields aren't quoted, so we scan eight characters at a time
+// with SSE2 where available.  The vector loads are aligned, so a load
+// never crosses into the next memory page, which makes it safe to read
+// past the null terminator within the final block.
+static wchar_t *FindFieldEnd(wchar_t *p)
+{
+#ifdef CSV_SCAN_SSE2
+	// scan one character at a time up to a 16-byte boundary
+	for (; (reinterpret_cast<UINT_PTR>(p) & 15) != 0; ++p)
+	{
+		if (*p == ',' || *p == 0 || *p == 10 || *p == 13)
+			return p;
+	}
+
+	// scan the aligned blocks
+	const __m128i comma = _mm_set1_epi16(',');
+	const __m128i cr = _mm_set1_epi16(13);
+	const __m128i lf = _mm_set1_epi16(10);
+	const __m128i zero = _mm_setzero_si128();
+	for (;; p += 8)
+	{
+		__m128i v = _mm_load_si128(reinterpret_cast<const __m128i*>(p));
+		__m128i m = _mm_or_si128(
+			_mm_or_si128(_mm_cmpeq_epi16(v, comma), _mm_cmpeq_epi16(v, zero)),
+			_mm_or_si128(_mm_cmpeq_epi16(v, cr), _mm_cmpeq_epi16(v, lf)));
+		if (int mask = _mm_movemask_epi8(m); mask != 0)
+		{
+			// each character match sets two mask bits
+			unsigned long bit;
+			_BitScanForward(&bit, static_cast<unsigned long>(mask));
+			return p + bit / 2;
+		}
+	}
+#else
+	for (; *p != ',' && *p != 0 && *p != 10 && *p != 13; ++p);
+	return p;
+#endif
+}
+
 bool CSVFile::Read(ErrorHandler &eh, UINT mbCodePage)
 {
 	// read the file into memory
@@ -45,6 +115,7 @@ bool CSVFile::Read(ErrorHandler &eh, UINT mbCodePage)
 
 	// store the contents in our internal content pointer
 	fileContents.reset(contents);
+	fileContentsLen = static_cast<size_t>(fileLen);
 
 	// Parse a field
 	wchar_t *p = contents;
@@ -113,7 +184,7 @@ bool CSVFile::Read(ErrorHandler &eh, UINT mbCodePage)
 		{
 			// It's not quoted.  Parse everything up to the end of the
 			// field - comma, newline, or end of file.
-			for (; *p != ',' && *p != 0 && *p != 10 && *p != 13; ++p);
+			p = FindFieldEnd(p);
 
 			// we can use everything up to the separator for field storage
 			fieldLen = p - start;
@@ -181,9 +252,12 @@ bool CSVFile::Read(ErrorHandler &eh, UINT mbCodePage)
 		if (*p == 0)
 			return true;
 
-		// create a new row
+		// Create a new row.  Reserve space for the file's columns, so
+		// that the field vector doesn't have to grow (and copy the fields)
+		// as we go.
 		rows.emplace_back();
 		Row &row = rows.back();
+		row.fields.reserve(colno);
 
 		// parse the fields
 		for (eol = false; !eol ;)
@@ -199,116 +273,381 @@ bool CSVFile::Read(ErrorHandler &eh, UINT mbCodePage)
 
 bool CSVFile::Write(ErrorHandler &eh)
 {
-	// set up a temporary filename for the initial write
+	// format the file contents in memory
+	WSTRING txt;
+	FormatText(txt);
+
+	// Write the contents to a temporary file, with as few WriteFile()
+	// calls as possible, then move it into place.  The move replaces the
+	// original file in one step, so a crash during the write can't leave
+	// a truncated file behind.
 	TSTRING tempfile = filename + _T("~");
-
-	// open the temp file
-	FILE *fp = nullptr;
-	if (int err = _tfopen_s(&fp, tempfile.c_str(), _T("w,ccs=UTF-16LE")); err != 0)
+	HANDLE h = CreateFile(tempfile.c_str(), GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (h == INVALID_HANDLE_VALUE)
 	{
-		eh.Error(MsgFmt(IDS_ERR_OPENFILE, tempfile.c_str(), FileErrorMessage(err).c_str()));
+		WindowsErrorMessage winerr;
+		eh.Error(MsgFmt(IDS_ERR_OPENFILE, tempfile.c_str(), winerr.Get()));
 		return false;
 	}
+	HandleHolder hFile(h);
 
-	// report a write error and return false
-	auto ReportError = [&eh, &fp, &tempfile, this](int err)
+	const BYTE *p = reinterpret_cast<const BYTE*>(txt.data());
+	for (size_t rem = txt.length() * sizeof(WCHAR); rem != 0; )
 	{
-		// report the error
-		eh.Error(MsgFmt(IDS_ERR_WRITEFILE, tempfile.c_str(), FileErrorMessage(err).c_str()));
-
-		// close and delete the temp file if we opened it
-		if (fp != nullptr)
+		DWORD len = rem < writeChunkSize ? static_cast<DWORD>(rem) : writeChunkSize;
+		DWORD actual;
+		if (!WriteFile(hFile, p, len, &actual, NULL) || actual != len)
 		{
-			fclose(fp);
-			_tunlink(tempfile.c_str());
+			WindowsErrorMessage winerr;
+			eh.Error(MsgFmt(IDS_ERR_WRITEFILE, tempfile.c_str(), winerr.Get()));
+			hFile.Clear();
+			DeleteFile(tempfile.c_str());
+			return false;
 		}
+		p += len;
+		rem -= len;
+	}
+	hFile.Clear();
 
-		// return an error indication
+	// move the temp file into place
+	if (!MoveFileEx(tempfile.c_str(), filename.c_str(), MOVEFILE_REPLACE_EXISTING))
+	{
+		WindowsErrorMessage winerr;
+		eh.Error(MsgFmt(IDS_ERR_MOVEFILE, tempfile.c_str(), filename.c_str(), winerr.Get()));
+		DeleteFile(tempfile.c_str());
 		return false;
-	};
+	}
+
+	// all nice and clean
+	dirty = false;
+
+	// success
+	return true;
+}
 
-	// We need to write the column list in column index order, so build
-	// a vector of the columns by index.
-	std::vector<Column*> colByIndex;
+void CSVFile::FormatText(WSTRING &txt) const
+{
+	// Size the buffer from the last save, with some room to grow, so
+	// that we don't have to regrow it as we go.  On the first save,
+	// estimate from the table size.
+	txt.clear();
+	txt.reserve(formatLengthHint != 0 ? formatLengthHint + formatLengthHint / 8 : rows.size() * columns.size() * 16);
+
+	// start with the byte order mark
+	txt.push_back(0xFEFF);
+
+	// write the column list, in column index order, as the first line
+	std::vector<const Column*> colByIndex;
 	colByIndex.resize(columns.size());
 	for (auto &c : columns)
 		colByIndex[c.second.index] = &c.second;
 
-	// write a string segment to the file
-	auto WriteSegment = [fp, ReportError](const TCHAR *str, size_t len)
-	{
-		if (_ftprintf(fp, _T("%.*s"), (int)len, str) < 0)
-			return ReportError(errno);
-		else
-			return true;
-	};
-
-	// Write the column list as the first line
-	const TCHAR *comma = _T("");
+	bool comma = false;
 	for (auto c : colByIndex)
 	{
-		// write the field separator, if any
-		if (_ftprintf(fp, comma) < 0)
-			return ReportError(errno);
-
-		// we'll need a comma before the next column
-		comma = _T(",");
-		
-		// write the column name
-		if (!CSVify(c->GetName(), -1, WriteSegment))
-			return false;
+		if (comma)
+			txt.push_back(',');
+		comma = true;
+		AppendField(txt, c->GetName(), true);
 	}
+	txt.append(_T("\r\n"), 2);
 
-	// end the line
-	if (_ftprintf(fp, _T("\n")) < 0)
-		return ReportError(errno);
-
-	// Write each row
+	// write each row
 	for (auto const &row : rows)
 	{
-		// write the row's fields
-		comma = _T("");
+		comma = false;
 		for (auto const &field : row.fields)
 		{
-			// write the field separator, if any
-			if (_ftprintf(fp, comma) < 0)
-				return ReportError(errno);
+			if (comma)
+				txt.push_back(',');
+			comma = true;
+			AppendField(txt, field.Get(), true);
+		}
+		txt.append(_T("\r\n"), 2);
+	}
 
-			// write the column value
-			if (!CSVify(field.Get(), -1, WriteSegment))
-				return false;
+	// remember the size for next time
+	formatLengthHint = txt.length();
+}
+
+void CSVFile::AppendField(WSTRING &buf, const TCHAR *str, bool crlf)
+{
+	// a null string is written as an empty field
+	if (str == nullptr)
+		return;
+
+	// Copy the value, a run of ordinary characters at a time.  The value
+	// needs quotes if it contains a comma, quote, or newline; we don't
+	// know that until we find one, but everything before the first one
+	// is plain text, so we can just insert the open quote at the start
+	// of the field when we get there.
+	size_t start = buf.length();
+	bool quoted = false;
+	const TCHAR *run = str;
+	const TCHAR *p = str;
+	for (; *p != 0; ++p)
+	{
+		TCHAR c = *p;
+		if (c == ',' || c == '"' || c == '\n' || c == '\r')
+		{
+			// copy the run of ordinary characters before this one
+			buf.append(run, p - run);
+			run = p + 1;
+
+			// insert the open quote if we haven't already
+			if (!quoted)
+			{
+				buf.insert(start, 1, '"');
+				quoted = true;
+			}
+
+			// stutter quotes, and expand newlines if desired
+			if (c == '"')
+				buf.append(_T("\"\""), 2);
+			else if (c == '\n' && crlf)
+				buf.append(_T("\r\n"), 2);
+			else
+				buf.push_back(c);
+		}
+	}
+
+	// copy the last run, and close the quotes if we opened them
+	buf.append(run, p - run);
+	if (quoted)
+		buf.push_back('"');
+}
+
+void CSVFile::Format(std::vector<BYTE> &contents) const
+{
+	// format the text, and store the bytes
+	WSTRING txt;
+	FormatText(txt);
+	const BYTE *p = reinterpret_cast<const BYTE*>(txt.data());
+	contents.assign(p, p + txt.length() * sizeof(WCHAR));
+}
+
+void CSVFile::WriteIfDirtyInBackground()
+{
+	// if the last background write failed, the file is still dirty
+	if (writeFailed->exchange(false))
+		dirty = true;
 
-			// we'll need a comma before the next column
-			comma = _T(",");
+	if (dirty)
+	{
+		std::vector<BYTE> contents;
+		Format(contents);
+
+		// If there's a journal, commit it and start a new segment.  The
+		// new file contents incorporate everything in the segments up to
+		// this point, so once the file has been written, those segments
+		// are obsolete.  Until then, they're still needed in case the
+		// write doesn't make it to disk.
+		int lastSeg = 0;
+		if (journalFile.length() != 0)
+		{
+			LogFileErrorHandler eh(_T("Journal: "));
+			CommitJournal(eh);
+			hJournal.Clear();
+			lastSeg = journalSeg++;
 		}
 
-		// add a newline after the row
-		if (_ftprintf(fp, _T("\n")) < 0)
-			return ReportError(errno);
+		// On success, delete the obsolete journal segments.  On failure,
+		// keep them, and flag the write for a retry on the next save.
+		auto onWritten = [journalFile = this->journalFile, lastSeg, writeFailed = this->writeFailed](bool ok)
+		{
+			if (!ok)
+				*writeFailed = true;
+			else if (journalFile.length() != 0)
+			{
+				EnumJournalSegments(journalFile, [lastSeg](int seg, const TSTRING &path) {
+					if (seg <= lastSeg)
+						DeleteFile(path.c_str());
+				});
+			}
+		};
+
+		BackgroundFileWriter::Write(filename.c_str(), std::move(contents), false, nullptr, std::move(onWritten));
+		dirty = false;
 	}
+}
 
-	// close the temp file
-	if (fclose(fp) < 0)
-		return ReportError(errno);
+// Journal record checksum (32-bit FNV-1a)
+static UINT32 JournalChecksum(const BYTE *p, size_t len)
+{
+	UINT32 h = 2166136261U;
+	for (; len != 0; --len)
+		h = (h ^ *p++) * 16777619U;
+	return h;
+}
 
-	// the temp file is now closed
-	fp = nullptr;
+void CSVFile::AddJournalRecord(int rowIndex, const Column *col, const TCHAR *value)
+{
+	// skip this if there's no journal, or we're replaying it
+	if (journalFile.length() == 0 || replayingJournal)
+		return;
 
-	// delete the original file and rename the temp file to the original name
-	_tunlink(filename.c_str());
-	if (_trename(tempfile.c_str(), filename.c_str()))
+	// Build the record text: 'S' (set) or 'C' (clear to null), the row
+	// number, the column name, and the value, in CSV format
+	WSTRING txt = value != nullptr ? _T("S,") : _T("C,");
+	txt += std::to_wstring(rowIndex) + _T(",");
+	AppendField(txt, col->GetName(), false);
+	if (value != nullptr)
 	{
-		eh.Error(MsgFmt(IDS_ERR_MOVEFILE, tempfile.c_str(), filename.c_str(), FileErrorMessage(errno).c_str()));
-		return false;
+		txt += _T(",");
+		AppendField(txt, value, false);
 	}
 
-	// all nice and clean
-	dirty = false;
+	// Add the record to the pending list: the payload length in bytes,
+	// the payload checksum, and the payload.  The length and checksum
+	// let the replay detect a record that was only partially written
+	// when the power failed.
+	const BYTE *payload = reinterpret_cast<const BYTE*>(txt.data());
+	UINT32 hdr[2] = { static_cast<UINT32>(txt.length() * sizeof(WCHAR)), 0 };
+	hdr[1] = JournalChecksum(payload, hdr[0]);
+	const BYTE *h = reinterpret_cast<const BYTE*>(hdr);
+	journalPending.insert(journalPending.end(), h, h + sizeof(hdr));
+	journalPending.insert(journalPending.end(), payload, payload + hdr[0]);
+}
 
-	// success
+bool CSVFile::CommitJournal(ErrorHandler &eh)
+{
+	// if there's nothing pending, there's nothing to do
+	if (journalFile.length() == 0 || journalPending.size() == 0)
+		return true;
+
+	// open the current segment, if we haven't already
+	TSTRING path = MsgFmt(_T("%s.%d"), journalFile.c_str(), journalSeg).Get();
+	if (hJournal == NULL)
+	{
+		HANDLE h = CreateFile(path.c_str(), FILE_APPEND_DATA, FILE_SHARE_READ, NULL, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+		if (h == INVALID_HANDLE_VALUE)
+		{
+			WindowsErrorMessage winerr;
+			eh.Error(MsgFmt(IDS_ERR_OPENFILE, path.c_str(), winerr.Get()));
+			return false;
+		}
+		hJournal = h;
+	}
+
+	// Append the records and flush them to disk.  If the write fails, the
+	// segment might end with a partial record, which would hide anything
+	// appended after it from the replay, so close it and leave the records
+	// pending for the next commit, which will start a new segment.
+	DWORD actual;
+	DWORD len = static_cast<DWORD>(journalPending.size());
+	if (!WriteFile(hJournal, journalPending.data(), len, &actual, NULL) || actual != len
+		|| !FlushFileBuffers(hJournal))
+	{
+		WindowsErrorMessage winerr;
+		eh.Error(MsgFmt(IDS_ERR_WRITEFILE, path.c_str(), winerr.Get()));
+		hJournal.Clear();
+		++journalSeg;
+		return false;
+	}
+
+	// the records are now safely on disk
+	journalPending.clear();
 	return true;
 }
 
+void CSVFile::EnumJournalSegments(const TSTRING &journalFile, std::function<void(int seg, const TSTRING &path)> func)
+{
+	// get the folder containing the segments
+	TCHAR dir[MAX_PATH];
+	_tcscpy_s(dir, journalFile.c_str());
+	PathRemoveFileSpec(dir);
+
+	// find the files named <journalFile>.<number>
+	std::vector<std::pair<int, TSTRING>> segs;
+	WIN32_FIND_DATA fd;
+	HANDLE hFind = FindFirstFile((journalFile + _T(".*")).c_str(), &fd);
+	if (hFind != INVALID_HANDLE_VALUE)
+	{
+		do
+		{
+			const TCHAR *ext = _tcsrchr(fd.cFileName, '.');
+			if (ext != nullptr && ext[1] != 0 && _tcsspn(ext + 1, _T("0123456789")) == _tcslen(ext + 1))
+			{
+				TCHAR path[MAX_PATH];
+				PathCombine(path, dir, fd.cFileName);
+				segs.emplace_back(_ttoi(ext + 1), path);
+			}
+		} while (FindNextFile(hFind, &fd));
+		FindClose(hFind);
+	}
+
+	// visit them in segment order
+	std::sort(segs.begin(), segs.end(), [](const std::pair<int, TSTRING> &a, const std::pair<int, TSTRING> &b) { return a.first < b.first; });
+	for (auto &s : segs)
+		func(s.first, s.second);
+}
+
+int CSVFile::ReplayJournal()
+{
+	if (journalFile.length() == 0)
+		return 0;
+
+	// replay each segment in order
+	int nRecords = 0;
+	replayingJournal = true;
+	EnumJournalSegments(journalFile, [this, &nRecords](int seg, const TSTRING &path)
+	{
+		// start the new session's segment after the last existing one
+		if (seg >= journalSeg)
+			journalSeg = seg + 1;
+
+		// load the segment
+		long len;
+		SilentErrorHandler eh;
+		std::unique_ptr<BYTE[]> buf(ReadFileAsStr(path.c_str(), eh, len, 0));
+		if (buf == nullptr)
+			return;
+
+		// Apply the records.  Stop at the first record that runs past the
+		// end of the file or fails its checksum, since that's a record that
+		// was being written when the session ended.
+		const BYTE *p = buf.get(), *endp = p + len;
+		while (endp - p >= static_cast<ptrdiff_t>(sizeof(UINT32) * 2))
+		{
+			UINT32 hdr[2];
+			memcpy(hdr, p, sizeof(hdr));
+			const BYTE *payload = p + sizeof(hdr);
+			if (static_cast<size_t>(endp - payload) < hdr[0] || (hdr[0] % sizeof(WCHAR)) != 0
+				|| JournalChecksum(payload, hdr[0]) != hdr[1])
+				break;
+			p = payload + hdr[0];
+
+			// parse the record: type, row, column name, value
+			WSTRING txt(reinterpret_cast<const WCHAR*>(payload), hdr[0] / sizeof(WCHAR));
+			std::list<TSTRING> fields;
+			ParseCSV(txt.c_str(), txt.length(), fields);
+			if (fields.size() < 3)
+				continue;
+			auto it = fields.begin();
+			const TSTRING &type = *it++;
+			int rowIndex = _ttoi((it++)->c_str());
+			const TSTRING &colName = *it++;
+			if (rowIndex < 0 || (type != _T("S") && type != _T("C")) || (type == _T("S") && it == fields.end()))
+				continue;
+
+			// Find the column.  Skip the record if the column isn't in the
+			// schema; it might be from a newer version of the program.
+			auto col = columns.find(colName);
+			if (col == columns.end())
+				continue;
+
+			// create rows up to the record's row as needed, and apply the update
+			while (rowIndex >= static_cast<int>(rows.size()))
+				CreateRow();
+			col->second.Set(rowIndex, type == _T("S") ? it->c_str() : nullptr);
+			++nRecords;
+		}
+	});
+	replayingJournal = false;
+
+	return nRecords;
+}
+
 bool CSVFile::CSVify(const std::list<TSTRING> &lst, std::function<bool(const TCHAR *, size_t)> append)
 {
 	// write the row's fields
@@ -524,28 +863,49 @@ const TCHAR *CSVFile::Column::Get(int rowIndex, const TCHAR *defaultVal) const
 
 int CSVFile::Column::GetInt(int rowIndex, int defaultVal) const
 {
-	if (const TCHAR *val = Get(rowIndex, nullptr); val != nullptr && val[0] != 0)
-		return _ttoi(val);
+	if (Field *field = GetField(rowIndex); field != nullptr)
+		return field->GetInt(defaultVal);
 	else
 		return defaultVal;
 }
 
 float CSVFile::Column::GetFloat(int rowIndex, float defaultVal) const
 {
-	if (const TCHAR *val = Get(rowIndex, nullptr); val != nullptr && val[0] != 0)
-		return _tcstof(val, nullptr);
+	if (Field *field = GetField(rowIndex); field != nullptr)
+		return field->GetFloat(defaultVal);
 	else
 		return defaultVal;
 }
 
 bool CSVFile::Column::GetBool(int rowIndex, bool defaultVal) const
 {
-	if (const TCHAR *val = Get(rowIndex, nullptr); val != nullptr)
-		return val[0] == 'Y' || val[0] == 'y' || _ttoi(val) != 0;
+	if (Field *field = GetField(rowIndex); field != nullptr)
+		return field->GetBool(defaultVal);
 	else
 		return defaultVal;
 }
 
+DATE CSVFile::Column::GetDate(int rowIndex) const
+{
+	if (Field *field = GetField(rowIndex); field != nullptr)
+		return field->GetDate();
+	else
+		return 0.0;
+}
+
+DATE CSVFile::Field::GetDate() const
+{
+	if (value == nullptr || value[0] == 0)
+		return 0.0;
+	if ((typedFlags & HasDate) == 0)
+	{
+		DateTime d(value);
+		dateVal = d.IsValid() ? d.ToVariantDate() : 0.0;
+		typedFlags |= HasDate;
+	}
+	return dateVal;
+}
+
 CSVFile::Column::ParsedData *CSVFile::Column::GetParsedData(int rowIndex) const
 {
 	// get the value from the field, if it exists; otherwise return null
@@ -599,8 +959,9 @@ void CSVFile::Column::Set(int rowIndex, const TCHAR *val) const
 		// store the new value
 		field->Set(val);
 
-		// mark the in-memory database as updated
-		csv->dirty = true;
+		// mark the in-memory database as updated, and journal the change
+		csv->TouchRow(rowIndex);
+		csv->AddJournalRecord(rowIndex, this, val);
 	}
 }
 
@@ -609,7 +970,7 @@ void CSVFile::Column::SetParsedData(int rowIndex, ParsedData *data) const
 	if (Field *field = GetOrCreateField(rowIndex); field != nullptr)
 	{
 		field->SetParsedData(data);
-		csv->dirty = true;
+		csv->TouchRow(rowIndex);
 	}
 }
 
@@ -5,6 +5,7 @@
 //
 
 #pragma once
+#include <atomic>
 
 class ErrorHandler;
 
@@ -58,12 +59,61 @@ public:
 	// write the file if it's dirty
 	bool WriteIfDirty(ErrorHandler &eh) { return dirty ? Write(eh) : true; }
 
+	// Format the file contents in memory, exactly as Write() would write
+	// them to the file: UTF-16LE with a byte order mark, with CR-LF line
+	// endings.
+	void Format(std::vector<BYTE> &contents) const;
+
+	// If the file is dirty, format its contents and queue them for
+	// writing on the BackgroundFileWriter thread.  This clears the dirty
+	// flag as soon as the write is queued; if the write fails, the next
+	// call sets it again, to retry the write.  If there's a journal, this
+	// also serves as the journal compaction step: it commits the journal,
+	// starts a new journal segment, and deletes the older segments when
+	// the write completes, since the new file incorporates them.
+	void WriteIfDirtyInBackground();
+
+	// Write-ahead journal.  Rewriting a large file is too slow to do
+	// after every change, so updates can be lost if the power fails
+	// before the next save.  With a journal file set, each field update
+	// is also recorded as a journal record, and CommitJournal() appends
+	// the records made since the last commit to the journal and flushes
+	// them to disk, which is cheap enough to do after each change that
+	// matters.  The journal is a series of numbered segment files, named
+	// <journalFile>.<n>.  Each record stores an absolute field value, so
+	// replaying a record that the main file already reflects is harmless,
+	// which makes it safe to lose power at any point in the cycle.
+	void SetJournalFile(const TCHAR *journalFile) { this->journalFile = journalFile; }
+
+	// Replay the journal segments left over from earlier sessions.  Call
+	// this after Read().  Returns the number of records applied.
+	int ReplayJournal();
+
+	// commit the pending journal records to disk
+	bool CommitJournal(ErrorHandler &eh);
+
 	// get the number of rows
 	size_t GetNumRows() const { return rows.size(); }
 
 	// add a blank row, returning the row number
 	int CreateRow();
 
+	// Get a row's change stamp.  Each update to a field in the row
+	// assigns the row a new stamp, higher than any stamp before, so a
+	// client can tell whether a row has changed since it last looked at
+	// it by saving the stamp and comparing it later.  Returns 0 for an
+	// invalid row number.
+	UINT64 GetRowStamp(int row) const
+		{ return row >= 0 && row < (int)rows.size() ? rows[row].stamp : 0; }
+
+	// Mark a row as changed, as though a field had been updated.  This
+	// is for clients that update a field's parsed data object in place
+	// and only rebuild the text form later, before saving.
+	void MarkRowChanged(int row) { if (row >= 0 && row < (int)rows.size()) TouchRow(row); }
+
+	// mark the file as having unsaved changes
+	void SetDirty() { dirty = true; }
+
 	// Column description
 	class Column
 	{
@@ -83,6 +133,11 @@ public:
 		float GetFloat(int row, float defaultVal = 0.0f) const;
 		bool GetBool(int row, bool defaultVal = false) const;
 
+		// Get the value from a row as a Variant DATE, parsing the text
+		// as a DateTime in YYYYMMDDHHMMSS format.  Returns 0.0 if the
+		// field is empty or isn't a valid date.
+		DATE GetDate(int row) const;
+
 		// set the value in a row
 		void Set(int row, const TCHAR *value) const;
 		void Set(int row, int value) const;
@@ -121,6 +176,10 @@ public:
 		int index;
 	};
 
+	// Estimate the memory used by the in-memory copy of the file, in
+	// bytes, for the memory statistics
+	size_t EstimateMemory() const;
+
 	// Define a column.  The client calls this to define the columns in
 	// its schema.  This returns a Column accessor object that the client
 	// can use to access the column field for a given row.
@@ -152,11 +211,45 @@ protected:
 		const TCHAR *Get(const TCHAR *defaultVal = nullptr) const
 			{ return value != nullptr ? value : defaultVal; }
 
+		// size of the private value store, if the value has outgrown the file storage
+		size_t GetPrivateSize() const
+			{ return value != nullptr && value != fileStorage ? (_tcslen(value) + 1) * sizeof(TCHAR) : 0; }
+
+		// Get the value as a number or boolean.  These parse the text on
+		// the first call, and cache the result for later calls.
+		int GetInt(int defaultVal) const
+		{
+			if (value == nullptr || value[0] == 0)
+				return defaultVal;
+			if ((typedFlags & HasInt) == 0)
+				intVal = _ttoi(value), typedFlags |= HasInt;
+			return intVal;
+		}
+		float GetFloat(float defaultVal) const
+		{
+			if (value == nullptr || value[0] == 0)
+				return defaultVal;
+			if ((typedFlags & HasFloat) == 0)
+				floatVal = _tcstof(value, nullptr), typedFlags |= HasFloat;
+			return floatVal;
+		}
+		bool GetBool(bool defaultVal) const
+		{
+			if (value == nullptr)
+				return defaultVal;
+			if ((typedFlags & HasBool) == 0)
+				boolVal = value[0] == 'Y' || value[0] == 'y' || _ttoi(value) != 0, typedFlags |= HasBool;
+			return boolVal;
+		}
+		DATE GetDate() const;
+
 		void Set(const TCHAR *val)
 		{
 			// If we can fit the value into the original file storage
 			// area, reuse that space.  Otherwise, allocate new memory.
+			// The new text invalidates the cached typed values.
 			Clear();
+			typedFlags = 0;
 			if (val != nullptr)
 			{
 				size_t lenNeeded = _tcslen(val) + 1;
@@ -193,6 +286,21 @@ protected:
 		TCHAR *fileStorage;
 		size_t fileStorageLen;
 
+		// Cached typed values.  The stats database columns are read far
+		// more often than they're written (the filters read several of
+		// them for every game on every filter change), so we parse each
+		// field's text at most once per type, on first use.  The flags
+		// indicate which of the cached values are valid.
+		static const BYTE HasInt = 0x01;
+		static const BYTE HasFloat = 0x02;
+		static const BYTE HasBool = 0x04;
+		static const BYTE HasDate = 0x08;
+		mutable BYTE typedFlags = 0;
+		mutable bool boolVal = false;
+		mutable int intVal = 0;
+		mutable float floatVal = 0.0f;
+		mutable DATE dateVal = 0.0;
+
 		// client-defined parsed data
 		std::unique_ptr<Column::ParsedData> parsedData;
 	};
@@ -201,15 +309,67 @@ protected:
 	struct Row
 	{
 		std::vector<Field> fields;
+
+		// change stamp of the last update to the row
+		UINT64 stamp = 0;
 	};
 
+	// last row change stamp assigned
+	UINT64 rowStampCounter = 0;
+
+	// mark a row as changed
+	void TouchRow(int rowIndex) { dirty = true; rows[rowIndex].stamp = ++rowStampCounter; }
+
 	// Row list
 	std::vector<Row> rows;
 
-	// Raw file contents
+	// Raw file contents, and the length in characters
 	std::unique_ptr<wchar_t> fileContents;
+	size_t fileContentsLen = 0;
+
+	// Format the file contents as text, for Write() and Format().  The
+	// text starts with the byte order mark and uses CR-LF line endings.
+	void FormatText(WSTRING &txt) const;
+
+	// Append a field value to a buffer, CSV-ified as in CSVify(), in a
+	// single scan of the value.  If 'crlf' is true, newlines in the value
+	// are expanded to CR-LF, as in the file text.
+	static void AppendField(WSTRING &buf, const TCHAR *str, bool crlf);
+
+	// Length of the last formatted text, used to size the buffer for the
+	// next save, so that building the text doesn't have to regrow it
+	mutable size_t formatLengthHint = 0;
+
+	// maximum size of a single WriteFile() call when writing the file
+	static const DWORD writeChunkSize = 4 * 1024 * 1024;
 
 	// have we written field values since loading the file?
 	bool dirty;
+
+	// Set by the background writer's completion callback if the last
+	// background write failed.  This is shared with the callback, since
+	// the write can finish after the file object has been destroyed.
+	std::shared_ptr<std::atomic<bool>> writeFailed = std::make_shared<std::atomic<bool>>(false);
+
+	// Journal file base name, and the current segment number.  The
+	// segment file is opened on the first commit.
+	TSTRING journalFile;
+	int journalSeg = 1;
+	HandleHolder hJournal;
+
+	// journal records added since the last commit
+	std::vector<BYTE> journalPending;
+
+	// Are we replaying the journal?  Updates made during the replay
+	// aren't journaled again.
+	bool replayingJournal = false;
+
+	// add a journal record for a field update
+	void AddJournalRecord(int rowIndex, const Column *col, const TCHAR *value);
+
+	// Enumerate the journal segments for a base name, in segment order.
+	// This is static, since the compaction step uses it on the file
+	// writer thread to delete the obsolete segments.
+	static void EnumJournalSegments(const TSTRING &journalFile, std::function<void(int seg, const TSTRING &path)> func);
 };
 
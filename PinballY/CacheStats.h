@@ -0,0 +1,26 @@
+// This file is part of PinballY
+// Copyright 2018 Michael J Roberts | GPL v3 or later | NO WARRANTY
+//
+// Cache hit statistics
+//
+// A simple hit/miss counter for the media caches, for the performance
+// overlay.  The counters are updated with interlocked operations, so
+// they can be used from any thread.
+
+#pragma once
+
+struct CacheHitStats
+{
+	void Hit() { InterlockedIncrement64(&hits); }
+	void Miss() { InterlockedIncrement64(&misses); }
+
+	// get the hit rate as a percentage of lookups; 0 if there haven't been any
+	int GetHitRate() const
+	{
+		LONG64 n = hits + misses;
+		return n != 0 ? static_cast<int>(hits * 100 / n) : 0;
+	}
+
+	volatile LONG64 hits = 0;
+	volatile LONG64 misses = 0;
+};
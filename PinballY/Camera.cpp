@@ -44,10 +44,25 @@ Camera::Camera()
 Camera::~Camera()
 {
 	// delete interfaces
+	ReleaseBuffers();
+}
+
+void Camera::ReleaseBuffers()
+{
 	if (cbView != 0) cbView->Release();
 	if (cbOrtho != 0) cbOrtho->Release();
 	if (cbViewText != 0) cbViewText->Release();
 	if (cbProjectionText != 0) cbProjectionText->Release();
+	cbView = 0;
+	cbOrtho = 0;
+	cbViewText = 0;
+	cbProjectionText = 0;
+}
+
+bool Camera::Reinit()
+{
+	ReleaseBuffers();
+	return Init(viewSize.width, viewSize.height);
 }
 
 bool Camera::Init(int width, int height)
@@ -98,8 +113,14 @@ bool Camera::Init(int width, int height)
 
 void Camera::SetViewSize(int width, int height)
 {
-	viewSize.width = width > 1 ? width : 1;
-	viewSize.height = height > 1 ? height : 1;
+	// the constant buffers only need updating if the size actually changed
+	width = width > 1 ? width : 1;
+	height = height > 1 ? height : 1;
+	if (width == viewSize.width && height == viewSize.height)
+		return;
+
+	viewSize.width = width;
+	viewSize.height = height;
 	RecalcView();
 	RecalcOrthoProjection();
 	RecalcTextView();
@@ -149,6 +170,9 @@ void Camera::SetMonitorRotation(int degrees)
 
 void Camera::SetMirrorHorz(bool f)
 {
+	if (f == mirrorHorz)
+		return;
+
 	mirrorHorz = f;
 	RecalcView();
 	RecalcTextView();
@@ -156,6 +180,9 @@ void Camera::SetMirrorHorz(bool f)
 
 void Camera::SetMirrorVert(bool f)
 {
+	if (f == mirrorVert)
+		return;
+
 	mirrorVert = f;
 	RecalcView();
 	RecalcTextView();
@@ -178,13 +205,15 @@ void Camera::SetRotation(float pitch, float yaw, float roll)
 void Camera::SetOrthoScaleFactor(float f)
 {
 	// store the new factor and update the projection
-	orthoScaleFactorX = orthoScaleFactorY = f;
-	RecalcOrthoProjection();
+	SetOrthoScaleFactor(f, f);
 }
 
 void Camera::SetOrthoScaleFactor(float fx, float fy)
 {
-	// store the new factor and update the projection
+	// store the new factor and update the projection, if it changed
+	if (fx == orthoScaleFactorX && fy == orthoScaleFactorY)
+		return;
+
 	orthoScaleFactorX = fx;
 	orthoScaleFactorY = fy;
 	RecalcOrthoProjection();
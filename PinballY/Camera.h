@@ -29,6 +29,10 @@ public:
 	// initialize; returns true on success, false on failure
 	bool Init(int width, int height);
 
+	// Re-create the constant buffers after the D3D device has been
+	// replaced, keeping the current view settings
+	bool Reinit();
+
 	// udpate the view size
 	void SetViewSize(int width, int height);
 
@@ -139,6 +143,9 @@ protected:
 	// monitor rotation in degrees - the 'up' vector is always sync'ed with this
 	int monitorRotation;
 
+	// release the constant buffers
+	void ReleaseBuffers();
+
 	// constant buffers for the ortho view
 	ID3D11Buffer *cbView;
 	ID3D11Buffer *cbOrtho;
@@ -43,4 +43,12 @@ namespace ConfigVars
 	static const TCHAR *CaptureVidoCodecPass1 = _T("Capture.VideoCodecPass1");
 	static const TCHAR *CaptureTempFolder = _T("Capture.TempFolder");
 	static const TCHAR *CaptureVideoResLimit = _T("Capture.VideoResolutionLimit");
+	static const TCHAR *CaptureSinglePass = _T("Capture.SinglePass");
+	static const TCHAR *CaptureVideoEncoder = _T("Capture.VideoEncoder");
+	static const TCHAR *CaptureVideoQuality = _T("Capture.VideoQuality");
+	static const TCHAR *CaptureSource = _T("Capture.Source");
+	static const TCHAR *CaptureDeferredEncoding = _T("Capture.DeferredEncoding");
+	static const TCHAR *CaptureDeferredEncodingThreads = _T("Capture.DeferredEncoding.Threads");
+	static const TCHAR *CaptureDeferredEncodingCpuLimit = _T("Capture.DeferredEncoding.CpuLimit");
+	static const TCHAR *CaptureExcludeStatusWin = _T("Capture.ExcludeStatusWindow");
 }
@@ -0,0 +1,254 @@
+// This file is part of PinballY
+// Copyright 2018 Michael J Roberts | GPL v3 or later | NO WARRANTY
+//
+// Deferred capture encoding queue
+
+#include "stdafx.h"
+#include "../Utilities/WinUtil.h"
+#include "CaptureEncodeQueue.h"
+#include "LogFile.h"
+#include "Trace.h"
+
+CaptureEncodeQueue::CaptureEncodeQueue(HWND hwndNotify, UINT notifyMsg, int maxThreads, int cpuLimit) :
+	hwndNotify(hwndNotify), notifyMsg(notifyMsg), maxThreads(max(maxThreads, 1))
+{
+	// Create the job object for the encoder processes.  Run everything
+	// in the job at idle priority, and kill the processes if the job
+	// handle is closed, so that we don't leave encoders running if we
+	// exit abnormally.
+	hJob = CreateJobObject(NULL, NULL);
+	if (hJob != NULL)
+	{
+		JOBOBJECT_EXTENDED_LIMIT_INFORMATION li;
+		ZeroMemory(&li, sizeof(li));
+		li.BasicLimitInformation.LimitFlags = JOB_OBJECT_LIMIT_KILL_ON_JOB_CLOSE | JOB_OBJECT_LIMIT_PRIORITY_CLASS;
+		li.BasicLimitInformation.PriorityClass = IDLE_PRIORITY_CLASS;
+		SetInformationJobObject(hJob, JobObjectExtendedLimitInformation, &li, sizeof(li));
+
+		// Set the CPU rate cap.  The rate is in hundredths of a percent
+		// of the total CPU capacity across all processors.  This isn't
+		// supported before Windows 8, in which case we'll just have to
+		// rely on the idle priority class.
+		if (cpuLimit > 0 && cpuLimit < 100)
+		{
+			JOBOBJECT_CPU_RATE_CONTROL_INFORMATION ci;
+			ZeroMemory(&ci, sizeof(ci));
+			ci.ControlFlags = JOB_OBJECT_CPU_RATE_CONTROL_ENABLE | JOB_OBJECT_CPU_RATE_CONTROL_HARD_CAP;
+			ci.CpuRate = cpuLimit * 100;
+			if (!SetInformationJobObject(hJob, JobObjectCpuRateControlInformation, &ci, sizeof(ci)))
+			{
+				WindowsErrorMessage err;
+				LogFile::Get()->Write(LogFile::CaptureLogging,
+					_T("+ Deferred encoding: unable to set the CPU rate limit (error %d: %s)\n"),
+					err.GetCode(), err.Get());
+			}
+		}
+	}
+}
+
+CaptureEncodeQueue::~CaptureEncodeQueue()
+{
+	// discard any jobs that haven't started yet, and tell the workers
+	// to stop after their current jobs
+	{
+		CriticalSectionLocker locker(lock);
+		shutdown = true;
+		jobs.clear();
+	}
+
+	// kill the running encoders
+	if (hJob != NULL)
+		TerminateJobObject(hJob, 1);
+
+	// wait for the worker threads to exit
+	for (auto &h : threads)
+		WaitForSingleObject(h, INFINITE);
+}
+
+void CaptureEncodeQueue::Add(std::list<Pass> &&passes, const TCHAR *tmpfile)
+{
+	CriticalSectionLocker locker(lock);
+
+	// add the job
+	for (auto &p : passes)
+		LogFile::Get()->Write(LogFile::CaptureLogging, _T("+ Deferred encoding: %s queued\n"), p.desc.c_str());
+	nPending += static_cast<int>(passes.size());
+	jobs.emplace_back(std::move(passes), tmpfile);
+	Trace::Counter("Deferred encodes pending", nPending);
+
+	// forget any worker threads that have already exited
+	threads.remove_if([](const HandleHolder &h) { return WaitForSingleObject(h, 0) == WAIT_OBJECT_0; });
+
+	// if we're below the thread limit, and all of the current workers
+	// are busy, start a new worker
+	if (nWorkers < maxThreads && nWorkers <= nBusy)
+	{
+		DWORD tid;
+		if (HANDLE h = CreateThread(NULL, 0, &SThreadMain, this, 0, &tid); h != NULL)
+		{
+			SetThreadPriority(h, THREAD_PRIORITY_BELOW_NORMAL);
+			threads.emplace_back(h);
+			nWorkers += 1;
+		}
+	}
+}
+
+int CaptureEncodeQueue::GetPending()
+{
+	CriticalSectionLocker locker(lock);
+	return nPending;
+}
+
+void CaptureEncodeQueue::GetResults(int &nOk, int &nFailed)
+{
+	CriticalSectionLocker locker(lock);
+	nOk = this->nOk;
+	nFailed = this->nFailed;
+	this->nOk = this->nFailed = 0;
+}
+
+DWORD CaptureEncodeQueue::ThreadMain()
+{
+	for (;;)
+	{
+		// get the next job; exit if the queue is empty
+		CriticalSectionLocker locker(lock);
+		if (shutdown || jobs.size() == 0)
+		{
+			nWorkers -= 1;
+			return 0;
+		}
+		Job job(std::move(jobs.front()));
+		jobs.pop_front();
+		nBusy += 1;
+		locker.Unlock();
+
+		// run its passes
+		for (auto &pass : job.passes)
+		{
+			// run the pass
+			ULONGLONG t0 = GetTickCount64();
+			Trace::Scope trace("Deferred encode pass", "capture", pass.desc.c_str());
+			bool ok = RunPass(pass);
+			trace.End();
+			if (pass.onDone != nullptr)
+				pass.onDone(ok, static_cast<DWORD>(GetTickCount64() - t0));
+
+			// count the result
+			locker.Lock(lock);
+			nPending -= 1;
+			Trace::Counter("Deferred encodes pending", nPending);
+			bool stop = shutdown;
+			if (ok)
+				nOk += 1;
+			else
+				nFailed += 1;
+			locker.Unlock();
+
+			// stop if the queue is being destroyed
+			if (stop)
+				break;
+
+			// let the main window know
+			PostMessage(hwndNotify, notifyMsg, 0, 0);
+		}
+
+		// we're done with the temp file
+		if (FileExists(job.tmpfile.c_str()))
+			DeleteFile(job.tmpfile.c_str());
+
+		// this job is finished
+		locker.Lock(lock);
+		nBusy -= 1;
+	}
+}
+
+bool CaptureEncodeQueue::RunPass(Pass &pass)
+{
+	// set up inheritable handles for the child's stdin and stdout/stderr
+	SECURITY_ATTRIBUTES sa;
+	sa.nLength = sizeof(sa);
+	sa.lpSecurityDescriptor = NULL;
+	sa.bInheritHandle = TRUE;
+	HandleHolder hOutRead, hOutWrite;
+	if (CreatePipe(&hOutRead, &hOutWrite, &sa, 0))
+		SetHandleInformation(hOutRead, HANDLE_FLAG_INHERIT, 0);
+	else
+		hOutWrite = CreateFile(_T("NUL"), GENERIC_WRITE, 0, &sa, OPEN_EXISTING, 0, NULL);
+	HandleHolder hIn(CreateFile(_T("NUL"), GENERIC_READ, 0, &sa, OPEN_EXISTING, 0, NULL));
+
+	// Launch the process suspended, so that we can put it in the job
+	// (and thus under the CPU cap) before it does any work
+	STARTUPINFO startupInfo;
+	ZeroMemory(&startupInfo, sizeof(startupInfo));
+	startupInfo.cb = sizeof(startupInfo);
+	startupInfo.dwFlags = STARTF_USESHOWWINDOW | STARTF_USESTDHANDLES;
+	startupInfo.wShowWindow = SW_HIDE;
+	startupInfo.hStdInput = hIn;
+	startupInfo.hStdOutput = hOutWrite;
+	startupInfo.hStdError = hOutWrite;
+	PROCESS_INFORMATION procInfo;
+	int exitCode = -1;
+	std::string output;
+	if (CreateProcess(NULL, pass.cmdline.data(), NULL, NULL, TRUE, CREATE_NO_WINDOW | CREATE_SUSPENDED | IDLE_PRIORITY_CLASS,
+		NULL, NULL, &startupInfo, &procInfo))
+	{
+		HandleHolder hProc(procInfo.hProcess);
+		HandleHolder hThread(procInfo.hThread);
+		if (hJob != NULL)
+			AssignProcessToJobObject(hJob, hProc);
+
+		// If the queue is being destroyed, the destructor might have
+		// terminated the job before we added the process, so don't let
+		// it start.  Otherwise, let it run.
+		CriticalSectionLocker locker(lock);
+		if (shutdown)
+			TerminateProcess(hProc, 1);
+		else
+			ResumeThread(hThread);
+		locker.Unlock();
+
+		// close our copy of the child's output handle, so that the pipe
+		// reports end-of-file when the child exits
+		hOutWrite = NULL;
+
+		// collect the output
+		if (hOutRead != NULL)
+		{
+			char buf[4096];
+			DWORD actual;
+			while (ReadFile(hOutRead, buf, sizeof(buf), &actual, NULL) && actual != 0)
+				output.append(buf, actual);
+		}
+
+		// wait for the process to exit, and get its exit code
+		WaitForSingleObject(hProc, INFINITE);
+		DWORD code;
+		if (GetExitCodeProcess(hProc, &code))
+			exitCode = static_cast<int>(code);
+	}
+	else
+	{
+		WindowsErrorMessage err;
+		output = TCHARToAnsi(MsgFmt(_T("FFmpeg launch failed: Win32 error %d, %s\n"), err.GetCode(), err.Get()));
+	}
+
+	// Log the results.  As with the foreground passes, log the command
+	// line and output on failure even if capture logging is disabled.
+	auto lf = LogFile::Get();
+	bool ok = (exitCode == 0);
+	if (!ok || lf->IsFeatureEnabled(LogFile::CaptureLogging))
+	{
+		lf->Group();
+		lf->Write(_T("Media capture: %s: deferred encoding\n> %s\n"), pass.desc.c_str(), pass.cmdline.c_str());
+		lf->WriteStrA(output.c_str());
+		lf->Write(_T("\n+ FFMPEG completed: process exit code %d\n"), exitCode);
+		lf->Group();
+	}
+
+	// if the encoding failed, delete any partial output file
+	if (!ok && FileExists(pass.outfile.c_str()))
+		DeleteFile(pass.outfile.c_str());
+
+	return ok;
+}
@@ -0,0 +1,120 @@
+// This file is part of PinballY
+// Copyright 2018 Michael J Roberts | GPL v3 or later | NO WARRANTY
+//
+// Deferred capture encoding queue
+//
+// In two-pass capture mode, each video is first captured with a fast,
+// near-lossless codec to a temp file, and then re-encoded to its final
+// format in a second pass.  The second pass doesn't need the game at
+// all, so during a batch capture, there's no reason to keep the next
+// game waiting for it.  The encode queue lets the game monitor thread
+// hand off the second pass and move straight on to the next game; the
+// queued passes run on background threads, overlapping with the launch
+// and capture of the following games.
+//
+// Since the whole point of two-pass mode is that the machine can't
+// encode in real time while a game is running, the background encoders
+// have to stay out of the game's way.  They run at idle priority, so
+// that they only get CPU time the game doesn't want, and inside a job
+// object with a hard CPU rate cap, so that they can't saturate the
+// machine even when the game is idling at a loading screen.  The number
+// of encoders running at once is also capped.
+//
+// The queue posts a notification message to the main window each time
+// a job finishes.  The window handler calls GetResults() to collect the
+// outcome counts.
+
+#pragma once
+#include <list>
+#include <functional>
+#include "../Utilities/Pointers.h"
+#include "../Utilities/WinUtil.h"
+
+class CaptureEncodeQueue : public RefCounted
+{
+public:
+	// Create the queue.  'maxThreads' is the maximum number of encoding
+	// passes to run at once, and 'cpuLimit' is the CPU rate cap for all
+	// of the encoders together, as a percentage of the total machine
+	// capacity.  Notifications are posted to 'hwndNotify' as 'notifyMsg'.
+	CaptureEncodeQueue(HWND hwndNotify, UINT notifyMsg, int maxThreads, int cpuLimit);
+
+	// Second-pass encoding for one media item
+	struct Pass
+	{
+		Pass(const TCHAR *cmdline, const TCHAR *outfile, const TCHAR *desc) :
+			cmdline(cmdline), outfile(outfile), desc(desc) { }
+
+		// full ffmpeg command line
+		TSTRING cmdline;
+
+		// Final media file.  We delete this if the pass fails, so that a
+		// partial file isn't mistaken for a good capture.
+		TSTRING outfile;
+
+		// item description, for the log
+		TSTRING desc;
+
+		// Optional completion callback, with the pass status and running
+		// time in milliseconds.  This is called on the worker thread.
+		std::function<void(bool ok, DWORD ms)> onDone;
+	};
+
+	// Queue the second passes for a first-pass temp file.  A group
+	// capture can record several items into one temp file, so a job
+	// can have several passes; they run in order, and we delete the
+	// temp file when the last one finishes.
+	void Add(std::list<Pass> &&passes, const TCHAR *tmpfile);
+
+	// Get the number of passes queued or running
+	int GetPending();
+
+	// Collect the numbers of passes that succeeded and failed since the
+	// last call
+	void GetResults(int &nOk, int &nFailed);
+
+protected:
+	// Destruction terminates any running passes and discards the queue
+	~CaptureEncodeQueue();
+
+	// queued job
+	struct Job
+	{
+		Job(std::list<Pass> &&passes, const TCHAR *tmpfile) : passes(std::move(passes)), tmpfile(tmpfile) { }
+
+		std::list<Pass> passes;
+		TSTRING tmpfile;
+	};
+
+	// worker thread entrypoint
+	static DWORD WINAPI SThreadMain(LPVOID param) { return static_cast<CaptureEncodeQueue*>(param)->ThreadMain(); }
+	DWORD ThreadMain();
+
+	// run a pass; returns true on success
+	bool RunPass(Pass &pass);
+
+	// notification window and message
+	HWND hwndNotify;
+	UINT notifyMsg;
+
+	// maximum number of worker threads
+	int maxThreads;
+
+	// Job object for the ffmpeg processes.  This carries the priority
+	// class and CPU rate cap, and kills any running passes when we
+	// terminate it.
+	HandleHolder hJob;
+
+	// worker thread handles
+	std::list<HandleHolder> threads;
+
+	// Shared state.  These are protected by the lock.
+	CriticalSection lock;
+	std::list<Job> jobs;    // jobs waiting for a worker
+	int nWorkers = 0;       // number of worker threads running
+	int nBusy = 0;          // number of jobs in progress
+	int nPending = 0;       // number of passes queued or running
+	int nOk = 0;            // passes succeeded since the last GetResults()
+	int nFailed = 0;        // passes failed since the last GetResults()
+	bool shutdown = false;  // destructor has been called
+};
@@ -0,0 +1,169 @@
+// This file is part of PinballY
+// Copyright 2018 Michael J Roberts | GPL v3 or later | NO WARRANTY
+//
+// Media capture video encoders
+
+#include "stdafx.h"
+#include "../Utilities/WinUtil.h"
+#include "../Utilities/ProcUtil.h"
+#include "CaptureEncoder.h"
+#include "LogFile.h"
+#include "FFmpegProbe.h"
+
+// Software encoder.  With no quality setting, we leave the codec choice
+// to ffmpeg, which picks libx264 at its default quality for our video
+// formats; that's what captures have always used.
+const CaptureEncoder::Profile CaptureEncoder::software = {
+	_T("software"), _T("libx264"),
+	_T("-c:v libx264 -crf %d"),
+	_T("-c:v libx264 -threads 8 -qp 0 -preset ultrafast"),
+	23
+};
+
+// Hardware encoders, in order of preference for "auto" mode
+static const CaptureEncoder::Profile hardwareProfiles[] = {
+	{
+		_T("nvenc"), _T("h264_nvenc"),
+		_T("-c:v h264_nvenc -preset fast -rc vbr -cq %d -b:v 0"),
+		_T("-c:v h264_nvenc -preset fast -rc constqp -qp 0"),
+		23
+	},
+	{
+		_T("qsv"), _T("h264_qsv"),
+		_T("-c:v h264_qsv -preset veryfast -global_quality %d"),
+		_T("-c:v h264_qsv -preset veryfast -global_quality 1"),
+		23
+	},
+	{
+		_T("amf"), _T("h264_amf"),
+		_T("-c:v h264_amf -quality speed -rc cqp -qp_i %d -qp_p %d"),
+		_T("-c:v h264_amf -quality speed -rc cqp -qp_i 0 -qp_p 0"),
+		23
+	},
+};
+
+// Hardware probe results.  These are protected by the lock, since the
+// probe runs on the game monitor thread.
+static struct
+{
+	CriticalSection lock;
+
+	// ffmpeg path we probed; empty if we haven't probed yet
+	TSTRING ffmpeg;
+
+	// availability of each hardware encoder
+	bool available[countof(hardwareProfiles)];
+} probeResults;
+
+const CaptureEncoder::Profile *CaptureEncoder::Select(const TCHAR *ffmpeg, const TCHAR *id)
+{
+	// software mode doesn't need a probe
+	if (_tcsicmp(id, software.id) == 0)
+		return &software;
+
+	// make sure we've tested the hardware encoders
+	Probe(ffmpeg);
+
+	// find the first matching encoder that's available
+	bool autoMode = _tcsicmp(id, _T("auto")) == 0;
+	CriticalSectionLocker locker(probeResults.lock);
+	for (size_t i = 0; i < countof(hardwareProfiles); ++i)
+	{
+		if ((autoMode || _tcsicmp(id, hardwareProfiles[i].id) == 0) && probeResults.available[i])
+			return &hardwareProfiles[i];
+	}
+
+	// no luck - fall back on software encoding
+	if (!autoMode)
+	{
+		LogFile::Get()->Write(LogFile::CaptureLogging,
+			_T("+ Video encoder \"%s\" isn't available; using software encoding\n"), id);
+	}
+	return &software;
+}
+
+TSTRING CaptureEncoder::GetOptions(const Profile *profile, int quality)
+{
+	// with no quality setting, use ffmpeg's defaults for software encoding
+	if (quality < 0 && profile == &software)
+		return _T("");
+
+	// apply the profile default if no quality was specified, and limit
+	// the quality to the quantizer range
+	if (quality < 0)
+		quality = profile->defaultQuality;
+	quality = min(quality, 51);
+
+	// format the options
+	TSTRINGEx opts;
+	opts.Format(profile->opts, quality, quality);
+	return opts;
+}
+
+void CaptureEncoder::Probe(const TCHAR *ffmpeg)
+{
+	// if we've already probed this ffmpeg build, there's nothing to do
+	CriticalSectionLocker locker(probeResults.lock);
+	if (_tcsicmp(probeResults.ffmpeg.c_str(), ffmpeg) == 0)
+		return;
+
+	// presume nothing is available
+	probeResults.ffmpeg = ffmpeg;
+	for (auto &a : probeResults.available)
+		a = false;
+
+	// get the list of encoders in this ffmpeg build from the probe cache
+	FFmpegProbe::Capabilities caps;
+	if (!FFmpegProbe::GetCapabilities(caps, 30000))
+	{
+		LogFile::Get()->Write(LogFile::CaptureLogging,
+			_T("+ Video encoder detection: unable to get the ffmpeg encoder list; using software encoding\n"));
+		return;
+	}
+
+	// check each hardware encoder
+	for (size_t i = 0; i < countof(hardwareProfiles); ++i)
+	{
+		// check that the build includes the encoder
+		auto &p = hardwareProfiles[i];
+		if (!caps.HasEncoder(TCHARToAnsi(p.ffmpegName).c_str()))
+		{
+			LogFile::Get()->Write(LogFile::CaptureLogging,
+				_T("+ Video encoder detection: %s isn't included in this ffmpeg build\n"), p.ffmpegName);
+			continue;
+		}
+
+		// Run a short test encode, to make sure the GPU and driver can
+		// actually do the work.  ffmpeg exits with an error if the
+		// hardware isn't there, or if the driver rejects any of the options.
+		TSTRINGEx args;
+		args.Format(_T("-hide_banner -loglevel error -f lavfi -i color=c=black:s=640x480:r=30 -frames:v 10 %s -f null -"),
+			GetOptions(&p, -1).c_str());
+		probeResults.available[i] = (RunFFmpeg(ffmpeg, args.c_str(), nullptr, 15000) == 0);
+		LogFile::Get()->Write(LogFile::CaptureLogging, _T("+ Video encoder detection: %s is %s\n"),
+			p.ffmpegName, probeResults.available[i] ? _T("available") : _T("not supported by this system"));
+	}
+}
+
+int CaptureEncoder::RunFFmpeg(const TCHAR *ffmpeg, const TCHAR *args, std::string *output, DWORD timeout)
+{
+	// Launch the process and wait for it.  AsyncProcess reads the output
+	// while the process runs, so the timeout covers the whole run, even
+	// if the child stops writing without exiting.
+	TSTRINGEx cmdline;
+	cmdline.Format(_T("\"%s\" %s"), ffmpeg, args);
+	AsyncProcess::Options opts;
+	opts.timeout = timeout;
+	RefPtr<AsyncProcess> proc;
+	proc.Attach(AsyncProcess::Start(ffmpeg, cmdline.c_str(), opts));
+	proc->Wait();
+
+	// if it didn't run to completion, there's no exit code
+	if (proc->GetStatus() != AsyncProcess::Status::Exited)
+		return -1;
+
+	// return the output, if desired, and the exit code
+	if (output != nullptr)
+		*output = proc->GetOutput();
+	return static_cast<int>(proc->GetExitCode());
+}
@@ -0,0 +1,81 @@
+// This file is part of PinballY
+// Copyright 2018 Michael J Roberts | GPL v3 or later | NO WARRANTY
+//
+// Media capture video encoders
+//
+// Media capture encodes the captured video with ffmpeg.  The default is
+// the libx264 software encoder, but that runs on the same CPU as the game
+// being captured, and on a machine without many cores to spare, the
+// competition can make the game (and thus the captured video) stutter.
+// Most GPUs have dedicated video encoder hardware that ffmpeg can use
+// instead: NVENC on NVIDIA cards, Quick Sync (QSV) on Intel graphics, and
+// AMF on AMD cards.
+//
+// Hardware support depends on both the ffmpeg build (which has to include
+// the encoder) and the installed GPU and driver (which have to provide
+// the hardware), so we can't tell from the encoder list alone whether an
+// encoder will work.  We check by running a short test encode with each
+// hardware encoder that the ffmpeg build lists.  The results are cached
+// for the session, so the test only runs on the first capture.  The
+// encoder list itself comes from the cached ffmpeg probe (FFmpegProbe.h),
+// so it doesn't require an extra ffmpeg run.
+
+#pragma once
+
+class CaptureEncoder
+{
+public:
+	// Encoder profile
+	struct Profile
+	{
+		// Config ID, for the Capture.VideoEncoder setting
+		const TCHAR *id;
+
+		// ffmpeg encoder name
+		const TCHAR *ffmpegName;
+
+		// ffmpeg options for the final encoding, as a printf format
+		// string; the quality level is passed as the argument (twice,
+		// for encoders that need it in more than one option)
+		const TCHAR *opts;
+
+		// ffmpeg options for the first pass of a two-pass capture.  This
+		// should be as fast as possible, and as close to lossless as the
+		// encoder allows, since the second pass re-encodes the result.
+		const TCHAR *pass1Opts;
+
+		// default quality level, for the final encoding
+		int defaultQuality;
+	};
+
+	// Select the encoder for a Capture.VideoEncoder setting: "auto"
+	// (use the first working hardware encoder, or software if none
+	// is available), "software", "nvenc", "qsv", or "amf".  If the
+	// selected hardware encoder isn't available, this falls back on
+	// software encoding.  This can run ffmpeg to test the hardware
+	// encoders, so it should only be called on a background thread.
+	static const Profile *Select(const TCHAR *ffmpeg, const TCHAR *id);
+
+	// Get the final encoding options for a profile at a given quality
+	// level.  The quality scale is the usual H.264 quantizer scale, 0 to
+	// 51, with lower numbers giving higher quality.  -1 selects the
+	// profile's default.
+	static TSTRING GetOptions(const Profile *profile, int quality);
+
+	// software encoder profile
+	static const Profile software;
+
+	// Run ffmpeg with the given arguments, waiting up to 'timeout'
+	// milliseconds for it to finish.  If 'output' is non-null, we
+	// collect the stdout/stderr output there.  Returns the ffmpeg exit
+	// code, or -1 if ffmpeg couldn't be launched or didn't finish in
+	// time.
+	static int RunFFmpeg(const TCHAR *ffmpeg, const TCHAR *args, std::string *output, DWORD timeout);
+
+protected:
+	// Test the hardware encoders with the given ffmpeg build, if we
+	// haven't already.  The encoder list comes from the ffmpeg probe
+	// cache (see FFmpegProbe.h); the test encodes run once per session,
+	// since they depend on the GPU and driver as well as the ffmpeg build.
+	static void Probe(const TCHAR *ffmpeg);
+};
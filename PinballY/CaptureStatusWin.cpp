@@ -2,12 +2,21 @@
 // Copyright 2018 Michael J Roberts | GPL v3 or later | NO WARRANTY
 //
 #include "stdafx.h"
+#include "../Utilities/Config.h"
 #include "CaptureStatusWin.h"
 #include "Application.h"
 #include "FrameWin.h"
 #include "PlayfieldWin.h"
 #include "D3DView.h"
 #include "PlayfieldView.h"
+#include "FontCache.h"
+#include "LogFile.h"
+#include "CaptureConfigVars.h"
+
+// Windows 10 2004 display affinity mode, for older SDKs
+#ifndef WDA_EXCLUDEFROMCAPTURE
+#define WDA_EXCLUDEFROMCAPTURE 0x00000011
+#endif
 
 
 CaptureStatusWin::CaptureStatusWin() : BaseWin(0)
@@ -33,13 +42,19 @@ CaptureStatusWin::~CaptureStatusWin()
 {
 }
 
+void CaptureStatusWin::InvalidateContents()
+{
+	contentDirty = true;
+	if (hWnd != NULL)
+		InvalidateRect(hWnd, NULL, FALSE);
+}
+
 void CaptureStatusWin::SetCaptureStatus(const TCHAR *msg, DWORD time_ms)
 {
 	CriticalSectionLocker locker(lock);
 	status = msg;
 	curOpTime.total = curOpTime.rem = time_ms;
-	if (hWnd != NULL)
-		InvalidateRect(hWnd, NULL, FALSE);
+	InvalidateContents();
 }
 
 // Set the estimated total time for the capture process
@@ -47,24 +62,21 @@ void CaptureStatusWin::SetTotalTime(DWORD time_ms)
 {
 	CriticalSectionLocker locker(lock);
 	gameTime.total = gameTime.rem = time_ms;
-	if (hWnd != NULL)
-		InvalidateRect(hWnd, NULL, FALSE);
+	InvalidateContents();
 }
 
 void CaptureStatusWin::BatchCaptureCancelPrompt(bool show)
 {
 	CriticalSectionLocker locker(lock);
 	batchCancelPrompt = show;
-	if (hWnd != NULL)
-		InvalidateRect(hWnd, NULL, FALSE);
+	InvalidateContents();
 }
 
 void CaptureStatusWin::ShowCaptureCancel()
 {
 	CriticalSectionLocker locker(lock);
 	canceled = true;
-	if (hWnd != NULL)
-		InvalidateRect(hWnd, NULL, FALSE);
+	InvalidateContents();
 }
 
 void CaptureStatusWin::SetManualStartMode(bool f)
@@ -101,7 +113,7 @@ void CaptureStatusWin::UpdateBlinkMode()
 	blinkState = true;
 
 	// in any case, make sure we redraw for the mode change
-	InvalidateRect(hWnd, NULL, FALSE);
+	InvalidateContents();
 }
 
 // Set the batch time estimates
@@ -113,6 +125,7 @@ void CaptureStatusWin::SetBatchInfo(int nCurGame, int nGames, int remainingTime_
 	this->nGames = nGames;
 	batchTime.rem = remainingTime_ms;
 	batchTime.total = totalTime_ms;
+	contentDirty = true;
 }
 
 // Set the drawing rotation, in degrees
@@ -213,6 +226,19 @@ bool CaptureStatusWin::OnCreate(CREATESTRUCT *lpcs)
 	// make the window topmost
 	SetWindowPos(hWnd, HWND_TOPMOST, -1, -1, -1, -1, SWP_NOMOVE | SWP_NOSIZE | SWP_NOACTIVATE);
 
+	// Exclude the window from screen capture, if desired.  This keeps
+	// the status box out of the captured video even when it overlaps
+	// the capture area.  It requires Windows 10 2004 or later; on older
+	// systems, the call fails, and the window is captured as usual.
+	if (ConfigManager::GetInstance()->GetBool(ConfigVars::CaptureExcludeStatusWin, true)
+		&& !SetWindowDisplayAffinity(hWnd, WDA_EXCLUDEFROMCAPTURE))
+	{
+		WindowsErrorMessage err;
+		LogFile::Get()->Write(LogFile::CaptureLogging,
+			_T("Capture: the status window can't be excluded from capture (error %d: %s)\n"),
+			err.GetCode(), err.Get());
+	}
+
 	// remember the initial tick time
 	lastTicks = GetTickCount();
 
@@ -225,240 +251,255 @@ bool CaptureStatusWin::OnCreate(CREATESTRUCT *lpcs)
 
 void CaptureStatusWin::OnPaint(HDC hdc)
 {
-	// get the window layout
-	RECT rcCli;
-	GetClientRect(hWnd, &rcCli);
+	CriticalSectionLocker locker(lock);
+
+	// Re-render the contents if anything has changed since the last
+	// paint.  Most paints are just for the window being uncovered or
+	// moved, or for a rotation change, none of which change the contents.
+	if (contentDirty || content.hbitmap == NULL)
+	{
+		DrawOffScreen(content, winWidth, winHeight, [this](HDC hdcmem, HBITMAP, const void*, const BITMAPINFO&) {
+			DrawContents(hdcmem); });
+		contentDirty = false;
+	}
+
+	// Figure the window layout.  The window is sized for the rotation,
+	// so its width and height swap at 90 and 270 degrees.
 	int cx = winWidth, cy = winHeight;
 	if (rotation == 90 || rotation == 270)
 		cx = winHeight, cy = winWidth;
 
-	DrawOffScreen(cx, cy, [this, hdc, &rcCli, cx, cy](HDC hdcmem, HBITMAP hbmp, const void *, const BITMAPINFO &)
+	// Figure where the contents' upper left, upper right, and lower left
+	// corners go in the window.  We rotate around the center, so that
+	// the center stays put, and then apply the mirroring.
+	float rad = rotation * 3.14159265f / 180.0f;
+	float cosA = cosf(rad), sinA = sinf(rad);
+	auto Map = [this, cx, cy, cosA, sinA](float x, float y) -> POINT
 	{
-		// set up a gdiplus context on the off-screen DC
-		Gdiplus::Graphics g(hdcmem);
+		float wx = x*cosA + y*sinA + cx/2.0f;
+		float wy = -x*sinA + y*cosA + cy/2.0f;
+		if (mirrorHorz)
+			wx = cx - wx;
+		if (mirrorVert)
+			wy = cy - wy;
+		return { lroundf(wx), lroundf(wy) };
+	};
+	float hw = winWidth/2.0f, hh = winHeight/2.0f;
+	POINT pts[3] = { Map(-hw, -hh), Map(hw, -hh), Map(-hw, hh) };
+
+	// copy the contents into the window through the transform
+	MemoryDC memdc;
+	HGDIOBJ oldbmp = SelectObject(memdc, content.hbitmap);
+	PlgBlt(hdc, pts, memdc, 0, 0, winWidth, winHeight, NULL, 0, 0);
+	SelectObject(memdc, oldbmp);
+}
 
-		// figure the basic color scheme based on the mode
-		Gdiplus::Color bkColor, textColor, frameColor, blinkOffColor;
-		if (batchCancelPrompt || canceled)
-		{
-			// cancel prompt or cancellation in progress - white text on red, with a red frame
-			textColor = Gdiplus::Color(255, 255, 255);
-			bkColor = Gdiplus::Color(255, 0, 0);
-			frameColor = Gdiplus::Color(128, 0, 0);
-			blinkOffColor = Gdiplus::Color(128, 64, 64);
-		}
-		else
-		{
-			// normal mode - black text on a white background
-			bkColor = Gdiplus::Color(255, 255, 255);
-			textColor = Gdiplus::Color(0, 0, 0);
+void CaptureStatusWin::DrawContents(HDC hdcmem)
+{
+	// the contents are always drawn unrotated
+	int cx = winWidth, cy = winHeight;
 
-			// use a blue frame for single captures, purple for batches
-			frameColor = isBatch ? Gdiplus::Color(128, 0, 128) : Gdiplus::Color(0, 0, 192);
-			blinkOffColor = isBatch ? Gdiplus::Color(192, 144, 192) : Gdiplus::Color(144, 144, 192);
-		}
+	// set up a gdiplus context on the off-screen DC
+	Gdiplus::Graphics g(hdcmem);
 
-		// set up brushes and pens
-		int frameWidth = 6;
-		Gdiplus::SolidBrush bkgbr(bkColor);
-		Gdiplus::SolidBrush textBr(textColor); 
-		Gdiplus::Pen framePen(frameColor, (float)frameWidth);
-		Gdiplus::SolidBrush frameBrush(frameColor);
-		Gdiplus::SolidBrush titleTextBr(Gdiplus::Color(255, 255, 255));
-		Gdiplus::SolidBrush ctlBr(Gdiplus::Color(238, 238, 238));
-		Gdiplus::SolidBrush ctlTextBr(blinkState ? frameColor : blinkOffColor);
-
-		// draw the background and window frame
-		g.FillRectangle(&bkgbr, rcCli.left, rcCli.top, cx, cy);
-		g.DrawRectangle(&framePen, frameWidth / 2, frameWidth / 2, cx - frameWidth, cy - frameWidth);
-
-		// Set up the gdiplus transform to put the origin in the center of
-		// the window, and set the rotation to our drawing to match the
-		// current background area rotation.  We center the origin to make
-		// the rotation easier to think about, as placing the origin at the
-		// center means that it stays at the center after any rotation.
-		// (We could have placed it at the upper left like a normal window,
-		// but that's harder to think about with the rotation because the
-		// rotation effectively moves the origin to one of the other corners,
-		// so we'd need a compensating translation.  Which is perfectly
-		// doable; it's just harder to think about.)
-		g.RotateTransform(-rotation);
-		g.TranslateTransform(float(cx/2), float(cy/2), Gdiplus::MatrixOrder::MatrixOrderAppend);
-
-		// apply mirroring transforms as needed
-		if (mirrorHorz)
-		{
-			g.ScaleTransform(-1, 1, Gdiplus::MatrixOrderAppend);
-			g.TranslateTransform(float(cx), 0, Gdiplus::MatrixOrder::MatrixOrderAppend);
-		}
-		if (mirrorVert)
-		{
-			g.ScaleTransform(1, -1, Gdiplus::MatrixOrderAppend);
-			g.TranslateTransform(0, float(cy), Gdiplus::MatrixOrder::MatrixOrderAppend);
-		}
+	// figure the basic color scheme based on the mode
+	Gdiplus::Color bkColor, textColor, frameColor, blinkOffColor;
+	if (batchCancelPrompt || canceled)
+	{
+		// cancel prompt or cancellation in progress - white text on red, with a red frame
+		textColor = Gdiplus::Color(255, 255, 255);
+		bkColor = Gdiplus::Color(255, 0, 0);
+		frameColor = Gdiplus::Color(128, 0, 0);
+		blinkOffColor = Gdiplus::Color(128, 64, 64);
+	}
+	else
+	{
+		// normal mode - black text on a white background
+		bkColor = Gdiplus::Color(255, 255, 255);
+		textColor = Gdiplus::Color(0, 0, 0);
 
-		// set up the text layout area, taking into account that the Gdiplus
-		// origin is at the center of the window
-		Gdiplus::RectF rcLayout(float(-winWidth / 2), float(-winHeight / 2), float(winWidth), float(winHeight));
+		// use a blue frame for single captures, purple for batches
+		frameColor = isBatch ? Gdiplus::Color(128, 0, 128) : Gdiplus::Color(0, 0, 192);
+		blinkOffColor = isBatch ? Gdiplus::Color(192, 144, 192) : Gdiplus::Color(144, 144, 192);
+	}
+
+	// set up brushes and pens
+	int frameWidth = 6;
+	Gdiplus::SolidBrush bkgbr(bkColor);
+	Gdiplus::SolidBrush textBr(textColor); 
+	Gdiplus::Pen framePen(frameColor, (float)frameWidth);
+	Gdiplus::SolidBrush frameBrush(frameColor);
+	Gdiplus::SolidBrush titleTextBr(Gdiplus::Color(255, 255, 255));
+	Gdiplus::SolidBrush ctlBr(Gdiplus::Color(238, 238, 238));
+	Gdiplus::SolidBrush ctlTextBr(blinkState ? frameColor : blinkOffColor);
+
+	// draw the background and window frame
+	g.FillRectangle(&bkgbr, 0, 0, cx, cy);
+	g.DrawRectangle(&framePen, frameWidth / 2, frameWidth / 2, cx - frameWidth, cy - frameWidth);
+
+	// Put the origin at the center of the window, to make the layout
+	// symmetrical.  The rotation and mirroring are applied when the
+	// contents are copied into the window, in OnPaint().
+	g.TranslateTransform(float(cx/2), float(cy/2));
+
+	// set up the text layout area, taking into account that the Gdiplus
+	// origin is at the center of the window
+	Gdiplus::RectF rcLayout(float(-winWidth / 2), float(-winHeight / 2), float(winWidth), float(winHeight));
+
+	// set up a centering text formatter
+	Gdiplus::StringFormat cformat(Gdiplus::StringFormat::GenericTypographic());
+	cformat.SetFormatFlags(cformat.GetFormatFlags() & ~Gdiplus::StringFormatFlagsLineLimit);
+	cformat.SetAlignment(Gdiplus::StringAlignmentCenter);
+	cformat.SetLineAlignment(Gdiplus::StringAlignmentCenter);
+
+	// set up a right-aligned formatter
+	Gdiplus::StringFormat rformat(Gdiplus::StringFormat::GenericTypographic());
+	rformat.SetFormatFlags(rformat.GetFormatFlags() & ~Gdiplus::StringFormatFlagsLineLimit);
+	rformat.SetAlignment(Gdiplus::StringAlignmentFar);
+
+	// set up a regular typographic formatter
+	Gdiplus::StringFormat tformat(Gdiplus::StringFormat::GenericTypographic());
+	tformat.SetFormatFlags(tformat.GetFormatFlags() & ~Gdiplus::StringFormatFlagsLineLimit);
+
+	// check the message mode
+	if (canceled)
+	{
+		auto textFont = FontCache::GetGPFont(_T("Tahoma"), 24, 400, false);
+		g.DrawString(LoadStringT(IDS_CAPSTAT_CANCELED), -1, textFont.get(), rcLayout, &cformat, &textBr);
+	}
+	else if (batchCancelPrompt)
+	{
+		auto textFont = FontCache::GetGPFont(_T("Tahoma"), 24, 400, false);
+		g.DrawString(LoadStringT(IDS_CAPSTAT_BATCH_CONFIRM_CXL), -1, textFont.get(), rcLayout, &cformat, &textBr);
+	}
+	else
+	{
+		//
+		// No special modes - show the normal status screen, with the
+		// current operation message and the countdown timers.
+		//
+
+		// measure the text for the top title area
+		TSTRINGEx title;
+		auto titleFont = FontCache::GetGPFont(_T("Tahoma"), 22, 400, false);
+		title.Load(isBatch ? IDS_CAPSTAT_BATCH_TITLE : IDS_CAPSTAT_TITLE);
+		Gdiplus::RectF bbox;
+		g.MeasureString(title.c_str(), -1, titleFont.get(), rcLayout, &cformat, &bbox);
+
+		// fill the title bar area and draw the title text
+		Gdiplus::RectF rcTitleBar = rcLayout;
+		rcTitleBar.X += frameWidth;
+		rcTitleBar.Height = bbox.Height + 16;
+		g.FillRectangle(&frameBrush, rcTitleBar);
+		g.DrawString(title.c_str(), -1, titleFont.get(), rcTitleBar, &cformat, &titleTextBr);
+
+		// format a time value
+		auto FmtTime = [](DWORD ms)
+		{
+			int s = ms / 1000;
+			int hh = s / 3600;
+			int mm = (s % 3600) / 60;
+			int ss = (s % 60);
 
-		// set up a centering text formatter
-		Gdiplus::StringFormat cformat(Gdiplus::StringFormat::GenericTypographic());
-		cformat.SetFormatFlags(cformat.GetFormatFlags() & ~Gdiplus::StringFormatFlagsLineLimit);
-		cformat.SetAlignment(Gdiplus::StringAlignmentCenter);
-		cformat.SetLineAlignment(Gdiplus::StringAlignmentCenter);
+			if (hh > 0)
+				return MsgFmt(_T("%d:%02d:%02d"), hh, mm, ss);
+			else
+				return MsgFmt(_T("%d:%02d"), mm, ss);
+		};
 
-		// set up a right-aligned formatter
-		Gdiplus::StringFormat rformat(Gdiplus::StringFormat::GenericTypographic());
-		rformat.SetFormatFlags(rformat.GetFormatFlags() & ~Gdiplus::StringFormatFlagsLineLimit);
-		rformat.SetAlignment(Gdiplus::StringAlignmentFar);
+		// get the text for the bottom control area
+		TSTRINGEx ctls;
+		auto ctlFont = FontCache::GetGPFont(_T("Tahoma"), 16, 700, false);
+		if (manualStartMode || manualStopMode)
+		{
+			// figure the main prompt
+			int prompt = manualStartMode ? IDS_CAPSTAT_MANUAL_START_PROMPT : IDS_CAPSTAT_MANUAL_STOP_PROMPT;
 
-		// set up a regular typographic formatter
-		Gdiplus::StringFormat tformat(Gdiplus::StringFormat::GenericTypographic());
-		tformat.SetFormatFlags(tformat.GetFormatFlags() & ~Gdiplus::StringFormatFlagsLineLimit);
+			// get the string for the button gesture
+			TSTRINGEx gesture;
+			gesture.Load(manualGoResId);
 
-		// check the message mode
-		if (canceled)
+			// format the prompt message
+			ctls.Format(LoadStringT(prompt), gesture.c_str());
+		}
+		else if (manualStopMode)
 		{
-			std::unique_ptr<Gdiplus::Font> textFont(CreateGPFont(_T("Tahoma"), 24, 400, false));
-			g.DrawString(LoadStringT(IDS_CAPSTAT_CANCELED), -1, textFont.get(), rcLayout, &cformat, &textBr);
+			// show the manual stop prompt
+			ctls.Load(IDS_CAPSTAT_MANUAL_STOP_PROMPT);
 		}
-		else if (batchCancelPrompt)
+		else
 		{
-			std::unique_ptr<Gdiplus::Font> textFont(CreateGPFont(_T("Tahoma"), 24, 400, false));
-			g.DrawString(LoadStringT(IDS_CAPSTAT_BATCH_CONFIRM_CXL), -1, textFont.get(), rcLayout, &cformat, &textBr);
+			// regular mode - show "press exit to cancel"
+			ctls.Load(IDS_CAPSTAT_EXIT_KEY);
+		}
+
+		// fill the control area and draw the text
+		Gdiplus::RectF rcCtlBar = rcLayout;
+		g.MeasureString(_T("X"), -1, ctlFont.get(), rcLayout, &cformat, &bbox);
+		rcCtlBar.Height = bbox.Height*3 + 20;
+		rcCtlBar.Y += rcLayout.Height - rcCtlBar.Height - frameWidth;
+		rcCtlBar.X += frameWidth;
+		rcCtlBar.Width -= frameWidth * 2;
+		g.FillRectangle(&ctlBr, rcCtlBar);
+		g.DrawString(ctls.c_str(), -1, ctlFont.get(), rcCtlBar, &cformat, &ctlTextBr);
+
+		// draw the progress bar
+		Gdiplus::RectF rcProgBar = rcCtlBar;
+		rcProgBar.Height = bbox.Height * 1.25f;
+		rcProgBar.Y -= rcProgBar.Height;
+		Gdiplus::SolidBrush progBkgBr(Gdiplus::Color(192, 220, 192));
+		Gdiplus::SolidBrush progBarBr(Gdiplus::Color(0, 192, 0));
+		g.FillRectangle(&progBkgBr, rcProgBar);
+		rcProgBar.Width *= isBatch ? batchTime.Progress() : gameTime.Progress();
+		g.FillRectangle(&progBarBr, rcProgBar);
+
+		// generate the main status text
+		TSTRINGEx statusTxt, timeLabel, timeVal;
+		if (isBatch)
+		{
+			// Batch mode
+			statusTxt.Format(LoadStringT(IDS_CAPSTAT_BATCH_GAME), nCurGame, nGames);
+			statusTxt += _T("\n\n") + status;
+
+			timeLabel.Load(IDS_CAPSTAT_BATCH_TIMES);
+			timeVal.Format(_T("\n%s\n%s\n%s"), FmtTime(curOpTime.rem), FmtTime(gameTime.rem), FmtTime(batchTime.rem));
 		}
 		else
 		{
-			//
-			// No special modes - show the normal status screen, with the
-			// current operation message and the countdown timers.
-			//
-
-			// measure the text for the top title area
-			TSTRINGEx title;
-			std::unique_ptr<Gdiplus::Font> titleFont(CreateGPFont(_T("Tahoma"), 22, 400, false));
-			title.Load(isBatch ? IDS_CAPSTAT_BATCH_TITLE : IDS_CAPSTAT_TITLE);
-			Gdiplus::RectF bbox;
-			g.MeasureString(title.c_str(), -1, titleFont.get(), rcLayout, &cformat, &bbox);
-
-			// fill the title bar area and draw the title text
-			Gdiplus::RectF rcTitleBar = rcLayout;
-			rcTitleBar.X += frameWidth;
-			rcTitleBar.Height = bbox.Height + 16;
-			g.FillRectangle(&frameBrush, rcTitleBar);
-			g.DrawString(title.c_str(), -1, titleFont.get(), rcTitleBar, &cformat, &titleTextBr);
-
-			// format a time value
-			auto FmtTime = [](DWORD ms)
-			{
-				int s = ms / 1000;
-				int hh = s / 3600;
-				int mm = (s % 3600) / 60;
-				int ss = (s % 60);
-
-				if (hh > 0)
-					return MsgFmt(_T("%d:%02d:%02d"), hh, mm, ss);
-				else
-					return MsgFmt(_T("%d:%02d"), mm, ss);
-			};
-
-			// get the text for the bottom control area
-			TSTRINGEx ctls;
-			std::unique_ptr<Gdiplus::Font> ctlFont(CreateGPFont(_T("Tahoma"), 16, 700, false));
-			if (manualStartMode || manualStopMode)
-			{
-				// figure the main prompt
-				int prompt = manualStartMode ? IDS_CAPSTAT_MANUAL_START_PROMPT : IDS_CAPSTAT_MANUAL_STOP_PROMPT;
-
-				// get the string for the button gesture
-				TSTRINGEx gesture;
-				gesture.Load(manualGoResId);
-
-				// format the prompt message
-				ctls.Format(LoadStringT(prompt), gesture.c_str());
-			}
-			else if (manualStopMode)
-			{
-				// show the manual stop prompt
-				ctls.Load(IDS_CAPSTAT_MANUAL_STOP_PROMPT);
-			}
-			else
-			{
-				// regular mode - show "press exit to cancel"
-				ctls.Load(IDS_CAPSTAT_EXIT_KEY);
-			}
-
-			// fill the control area and draw the text
-			Gdiplus::RectF rcCtlBar = rcLayout;
-			g.MeasureString(_T("X"), -1, ctlFont.get(), rcLayout, &cformat, &bbox);
-			rcCtlBar.Height = bbox.Height*3 + 20;
-			rcCtlBar.Y += rcLayout.Height - rcCtlBar.Height - frameWidth;
-			rcCtlBar.X += frameWidth;
-			rcCtlBar.Width -= frameWidth * 2;
-			g.FillRectangle(&ctlBr, rcCtlBar);
-			g.DrawString(ctls.c_str(), -1, ctlFont.get(), rcCtlBar, &cformat, &ctlTextBr);
-
-			// draw the progress bar
-			Gdiplus::RectF rcProgBar = rcCtlBar;
-			rcProgBar.Height = bbox.Height * 1.25f;
-			rcProgBar.Y -= rcProgBar.Height;
-			Gdiplus::SolidBrush progBkgBr(Gdiplus::Color(192, 220, 192));
-			Gdiplus::SolidBrush progBarBr(Gdiplus::Color(0, 192, 0));
-			g.FillRectangle(&progBkgBr, rcProgBar);
-			rcProgBar.Width *= isBatch ? batchTime.Progress() : gameTime.Progress();
-			g.FillRectangle(&progBarBr, rcProgBar);
-
-			// generate the main status text
-			TSTRINGEx statusTxt, timeLabel, timeVal;
-			if (isBatch)
-			{
-				// Batch mode
-				statusTxt.Format(LoadStringT(IDS_CAPSTAT_BATCH_GAME), nCurGame, nGames);
-				statusTxt += _T("\n\n") + status;
-
-				timeLabel.Load(IDS_CAPSTAT_BATCH_TIMES);
-				timeVal.Format(_T("\n%s\n%s\n%s"), FmtTime(curOpTime.rem), FmtTime(gameTime.rem), FmtTime(batchTime.rem));
-			}
-			else
-			{
-				// Single game capture mode
-				statusTxt = status;
-				timeLabel.Load(IDS_CAPSTAT_TIMES);
-				timeVal.Format(_T("\n%s\n%s"), FmtTime(curOpTime.rem), FmtTime(gameTime.rem));
-			}
-
-			// figure the text area
-			std::unique_ptr<Gdiplus::Font> txtFont(CreateGPFont(_T("Tahoma"), 14, 400, false));
-			Gdiplus::RectF rcTxt = rcLayout;
-			int txtMargin = 30;
-			rcTxt.Y += rcTitleBar.Height + txtMargin;
-			rcTxt.X += txtMargin + frameWidth;
-			rcTxt.Height -= rcTitleBar.Height + rcCtlBar.Height + rcProgBar.Height - txtMargin * 2;
-			rcTxt.Width -= txtMargin * 2 + frameWidth * 2;
-
-			// draw the status text
-			g.DrawString(statusTxt.c_str(), -1, txtFont.get(), rcTxt, &tformat, &textBr);
-			g.MeasureString(statusTxt.c_str(), -1, txtFont.get(), rcTxt, &tformat, &bbox);
-			rcTxt.Y += bbox.Height + 24;
-
-			// draw the 'time remaining' labels
-			g.DrawString(timeLabel.c_str(), -1, txtFont.get(), rcTxt, &tformat, &textBr);
-			g.MeasureString(timeLabel.c_str(), -1, txtFont.get(), rcTxt, &tformat, &bbox);
-
-			// draw the time values, right-justified with a bit of padding to the left
-			Gdiplus::RectF tvbox;
-			g.MeasureString(timeVal.c_str(), -1, txtFont.get(), rcTxt, &rformat, &tvbox);
-			rcTxt.X += bbox.Width + 10 + tvbox.Width;
-			rcTxt.Width = tvbox.Width;
-			g.DrawString(timeVal.c_str(), -1, txtFont.get(), rcTxt, &rformat, &textBr);
+			// Single game capture mode
+			statusTxt = status;
+			timeLabel.Load(IDS_CAPSTAT_TIMES);
+			timeVal.Format(_T("\n%s\n%s"), FmtTime(curOpTime.rem), FmtTime(gameTime.rem));
 		}
 
-		// flush the gdiplus drawing operations to the DC
-		g.Flush();
+		// figure the text area
+		auto txtFont = FontCache::GetGPFont(_T("Tahoma"), 14, 400, false);
+		Gdiplus::RectF rcTxt = rcLayout;
+		int txtMargin = 30;
+		rcTxt.Y += rcTitleBar.Height + txtMargin;
+		rcTxt.X += txtMargin + frameWidth;
+		rcTxt.Height -= rcTitleBar.Height + rcCtlBar.Height + rcProgBar.Height - txtMargin * 2;
+		rcTxt.Width -= txtMargin * 2 + frameWidth * 2;
+
+		// draw the status text
+		g.DrawString(statusTxt.c_str(), -1, txtFont.get(), rcTxt, &tformat, &textBr);
+		g.MeasureString(statusTxt.c_str(), -1, txtFont.get(), rcTxt, &tformat, &bbox);
+		rcTxt.Y += bbox.Height + 24;
+
+		// draw the 'time remaining' labels
+		g.DrawString(timeLabel.c_str(), -1, txtFont.get(), rcTxt, &tformat, &textBr);
+		g.MeasureString(timeLabel.c_str(), -1, txtFont.get(), rcTxt, &tformat, &bbox);
+
+		// draw the time values, right-justified with a bit of padding to the left
+		Gdiplus::RectF tvbox;
+		g.MeasureString(timeVal.c_str(), -1, txtFont.get(), rcTxt, &rformat, &tvbox);
+		rcTxt.X += bbox.Width + 10 + tvbox.Width;
+		rcTxt.Width = tvbox.Width;
+		g.DrawString(timeVal.c_str(), -1, txtFont.get(), rcTxt, &rformat, &textBr);
+	}
 
-		// copy the off-screen bitmap into the window
-		BitBlt(hdc, 0, 0, cx, cy, hdcmem, 0, 0, SRCCOPY);
-	});
+	// flush the gdiplus drawing operations to the DC
+	g.Flush();
 }
 
 bool CaptureStatusWin::OnTimer(WPARAM timer, LPARAM callback)
@@ -483,7 +524,7 @@ void CaptureStatusWin::OnBlinkTimer()
 	blinkState = !blinkState;
 
 	// redraw
-	InvalidateRect(hWnd, NULL, FALSE);
+	InvalidateContents();
 
 	// set the next timer
 	SetTimer(hWnd, BlinkTimerId, blinkState ? BlinkOnTime : BlinkOffTime, NULL);
@@ -522,5 +563,8 @@ void CaptureStatusWin::OnCountdownTimer()
 
 	// if anything changed, redraw the window
 	if (redraw)
-		InvalidateRect(hWnd, NULL, FALSE);
+	{
+		CriticalSectionLocker locker(lock);
+		InvalidateContents();
+	}
 }
@@ -3,6 +3,7 @@
 //
 #pragma once
 
+#include "../Utilities/GraphicsUtil.h"
 #include "BaseWin.h"
 
 class FrameWin;
@@ -71,9 +72,24 @@ protected:
 	// no need to erase the background
 	virtual bool OnEraseBkgnd(HDC hdc) { return true; }
 
-	// paint
+	// Paint.  The contents are drawn unrotated into an off-screen
+	// bitmap, which is only re-drawn when the contents change; each
+	// paint just copies the bitmap into the window, applying the
+	// rotation and mirroring as part of the copy.
 	virtual void OnPaint(HDC) override;
 
+	// draw the contents into the off-screen bitmap
+	void DrawContents(HDC hdcmem);
+
+	// Mark the contents as changed and invalidate the window.  The
+	// caller must hold the lock.
+	void InvalidateContents();
+
+	// off-screen contents bitmap, and the flag indicating that it's
+	// out of date
+	DIBitmap content;
+	bool contentDirty = true;
+
 	// timers
 	virtual bool OnTimer(WPARAM timer, LPARAM callback) override;
 	void OnCountdownTimer();
@@ -0,0 +1,115 @@
+// This file is part of PinballY
+// Copyright 2018 Michael J Roberts | GPL v3 or later | NO WARRANTY
+//
+// Capture timing statistics
+
+#include "stdafx.h"
+#include "../Utilities/FileUtil.h"
+#include "CaptureTimeStats.h"
+#include "Application.h"
+#include "LogFile.h"
+
+CaptureTimeStats::CaptureTimeStats()
+{
+	// define the columns
+	systemCol = csv.DefineColumn(_T("System"));
+	mediaTypeCol = csv.DefineColumn(_T("Media Type"));
+	phaseCol = csv.DefineColumn(_T("Phase"));
+	samplesCol = csv.DefineColumn(_T("Samples"));
+	averageCol = csv.DefineColumn(_T("Average"));
+}
+
+void CaptureTimeStats::Init()
+{
+	// The file goes in the same folder as GameStats.csv: the folder
+	// set on the command line, if any, otherwise the program folder.
+	auto const &gameStatsPath = Application::Get()->gameStatsPath;
+	const TCHAR *fname = _T("CaptureTimes.csv");
+	TCHAR statsFile[MAX_PATH];
+	if (gameStatsPath.length() != 0)
+		PathCombine(statsFile, gameStatsPath.c_str(), fname);
+	else
+		GetDeployedFilePath(statsFile, fname, _T(""));
+	csv.SetFile(statsFile);
+
+	// load the file, if it exists
+	CriticalSectionLocker locker(lock);
+	if (FileExists(statsFile))
+		csv.Read(SilentErrorHandler());
+
+	// index the rows
+	for (int i = 0, n = static_cast<int>(csv.GetNumRows()); i < n; ++i)
+	{
+		rows.emplace(
+			TSTRING(systemCol->Get(i, _T(""))) + _T("|") + mediaTypeCol->Get(i, _T("")) + _T("|") + phaseCol->Get(i, _T("")),
+			i);
+	}
+}
+
+const TCHAR *CaptureTimeStats::PhaseName(Phase phase)
+{
+	switch (phase)
+	{
+	case Phase::Launch:
+		return _T("Launch");
+
+	case Phase::Capture:
+		return _T("Capture");
+
+	case Phase::Encode:
+		return _T("Encode");
+
+	case Phase::DeferredEncode:
+		return _T("Deferred Encode");
+	}
+	return _T("");
+}
+
+TSTRING CaptureTimeStats::Key(const TCHAR *system, const TCHAR *mediaType, Phase phase)
+{
+	return TSTRING(system) + _T("|") + mediaType + _T("|") + PhaseName(phase);
+}
+
+void CaptureTimeStats::AddSample(const TCHAR *system, const TCHAR *mediaType, Phase phase, float value)
+{
+	CriticalSectionLocker locker(lock);
+
+	// find the row, or create a new one
+	int row;
+	if (auto it = rows.find(Key(system, mediaType, phase)); it != rows.end())
+	{
+		row = it->second;
+	}
+	else
+	{
+		row = csv.CreateRow();
+		systemCol->Set(row, system);
+		mediaTypeCol->Set(row, mediaType);
+		phaseCol->Set(row, PhaseName(phase));
+		rows.emplace(Key(system, mediaType, phase), row);
+	}
+
+	// update the moving average
+	int n = min(samplesCol->GetInt(row, 0) + 1, window);
+	float avg = averageCol->GetFloat(row, value);
+	avg += (value - avg) / static_cast<float>(n);
+	samplesCol->Set(row, n);
+	averageCol->Set(row, avg);
+
+	LogFile::Get()->Write(LogFile::CaptureLogging, _T("+ Capture timing: %s, %s%s%s: %.2f (average %.2f)\n"),
+		system, PhaseName(phase), mediaType[0] != 0 ? _T(", ") : _T(""), mediaType, value, avg);
+}
+
+float CaptureTimeStats::GetAverage(const TCHAR *system, const TCHAR *mediaType, Phase phase, float defaultVal)
+{
+	CriticalSectionLocker locker(lock);
+	if (auto it = rows.find(Key(system, mediaType, phase)); it != rows.end())
+		return averageCol->GetFloat(it->second, defaultVal);
+	return defaultVal;
+}
+
+void CaptureTimeStats::Save()
+{
+	CriticalSectionLocker locker(lock);
+	csv.WriteIfDirtyInBackground();
+}
@@ -0,0 +1,97 @@
+// This file is part of PinballY
+// Copyright 2018 Michael J Roberts | GPL v3 or later | NO WARRANTY
+//
+// Capture timing statistics
+//
+// Media capture time estimates are only as good as their assumptions
+// about how long a game takes to launch, how much overhead ffmpeg adds
+// to each capture, and how long the second encoding pass runs.  These
+// vary a lot from one machine to the next, and from one system to the
+// next (Visual Pinball and Future Pinball launch at very different
+// speeds, for example).  So rather than relying only on fixed guesses,
+// we record the actual timings of each capture, per system and media
+// type, and base the estimates on their moving averages.
+//
+// The phases we measure are:
+//
+//   Launch  - seconds from starting the game process until its window
+//             is ready, per system (the media type is empty)
+//
+//   Capture - seconds of overhead in the capture pass, beyond the
+//             configured capture time, per system and media type
+//
+//   Encode  - ratio of the second-pass encoding time to the video
+//             running time, per system and media type
+//
+//   Deferred Encode - the same ratio for second passes run by the
+//             background encoders in a pipelined batch capture, which
+//             run under a CPU cap, so they're timed separately
+//
+// The statistics are stored in CaptureTimes.csv, in the same folder as
+// GameStats.csv.  The game monitor thread and the background encoders
+// add samples, and the UI thread reads the averages, so access to the
+// data is protected by a lock.
+
+#pragma once
+#include <unordered_map>
+#include "../Utilities/WinUtil.h"
+#include "CSVFile.h"
+
+class CaptureTimeStats
+{
+public:
+	CaptureTimeStats();
+
+	// measured phase
+	enum class Phase
+	{
+		Launch,
+		Capture,
+		Encode,
+		DeferredEncode
+	};
+
+	// Load the statistics file, if it exists
+	void Init();
+
+	// Add a sample for a phase.  'mediaType' is the media type's config
+	// ID, or an empty string for the Launch phase.
+	void AddSample(const TCHAR *system, const TCHAR *mediaType, Phase phase, float value);
+
+	// Get the moving average for a phase, or the default value if we
+	// don't have any samples yet
+	float GetAverage(const TCHAR *system, const TCHAR *mediaType, Phase phase, float defaultVal);
+
+	// Save the file if it has changes, via the background file writer
+	void Save();
+
+protected:
+	// Moving average window.  The average adapts to each new sample with
+	// weight 1/N, where N is the number of samples so far, up to this
+	// limit.  This gives a plain average until we have enough samples,
+	// then an exponential moving average, so that the estimates track
+	// changes to the machine or settings.
+	static const int window = 10;
+
+	// phase names, as stored in the file
+	static const TCHAR *PhaseName(Phase phase);
+
+	// get the row key for a system, media type, and phase
+	static TSTRING Key(const TCHAR *system, const TCHAR *mediaType, Phase phase);
+
+	// the stats file
+	CSVFile csv;
+
+	// columns
+	CSVFile::Column *systemCol;
+	CSVFile::Column *mediaTypeCol;
+	CSVFile::Column *phaseCol;
+	CSVFile::Column *samplesCol;
+	CSVFile::Column *averageCol;
+
+	// row index, by key
+	std::unordered_map<TSTRING, int> rows;
+
+	// lock, for access from the capture threads
+	CriticalSection lock;
+};
@@ -0,0 +1,35 @@
+// This file is part of PinballY
+// Copyright 2018 Michael J Roberts | GPL v3 or later | NO WARRANTY
+//
+// Capture Transform Shader - pixel shader
+//
+// This copies an area of a Desktop Duplication frame into a capture
+// frame, applying the capture rotation and mirroring.  The constant
+// buffer gives an affine transform from the output texture coordinates
+// to the desktop texture coordinates.
+
+Texture2D desktopTexture;
+SamplerState SampleType;
+
+cbuffer TransformBufferType
+{
+	float2 origin;
+	float2 padding0;
+	float2 axisX;
+	float2 padding1;
+	float2 axisY;
+	float2 padding2;
+}
+
+struct PixelInputType
+{
+	float4 position : SV_POSITION;
+	float2 tex : TEXCOORD0;
+};
+
+float4 main(PixelInputType input) : SV_TARGET
+{
+	// map the output position to the desktop, and copy the pixel
+	float2 uv = origin + input.tex.x * axisX + input.tex.y * axisY;
+	return float4(desktopTexture.Sample(SampleType, uv).xyz, 1);
+}
@@ -7,14 +7,20 @@
 #include <Windows.h>
 #include <windowsx.h>
 #include <d3d11_1.h>
+#include <dxgi1_3.h>
 #include <DirectXMath.h>
 #include "Resource.h"
 #include "D3D.h"
 #include "D3DWin.h"
+#include "TextureBudget.h"
+#include "Shader.h"
+#include "LogFile.h"
+#include "../Utilities/Config.h"
 #include "shaders/FullScreenQuadShaderVS.h"
 
 #pragma comment(lib, "d3d11.lib")
 #pragma comment(lib, "dxguid.lib")
+#pragma comment(lib, "dxgi.lib")
 
 
 // DIRECT3D MEMORY LEAK DEBUGGING
@@ -76,6 +82,16 @@ D3D::D3D()
 	linearWrapSamplerState = NULL;
 	linearNoWrapSamplerState = NULL;
 	cbWorld = NULL;
+	cbWorldRing = NULL;
+	worldRingNext = worldRingSlots;
+	worldRingCur = 0;
+	worldVSSlot = worldPSSlot = -1;
+	lastWorldValid = false;
+	quadVertexBuffer = NULL;
+	quadIndexBuffer = NULL;
+	ZeroMemory(&pipelineState, sizeof(pipelineState));
+	ZeroMemory(&adapterLuid, sizeof(adapterLuid));
+	stateStats = { 0, 0 };
 	vsFullScreenQuad = NULL;
 	depthStencilStateOn = NULL;
 	depthStencilStateOff = NULL;
@@ -89,6 +105,11 @@ D3D::D3D()
 
 // destruction
 D3D::~D3D()
+{
+	ReleaseDeviceObjects();
+}
+
+void D3D::ReleaseDeviceObjects()
 {
 	ID3D11Debug *debug = 0;
 
@@ -111,6 +132,9 @@ D3D::~D3D()
 	if (linearWrapSamplerState != NULL) linearWrapSamplerState->Release();
 	if (linearNoWrapSamplerState != NULL) linearNoWrapSamplerState->Release();
 	if (cbWorld != NULL) cbWorld->Release();
+	if (cbWorldRing != NULL) cbWorldRing->Release();
+	if (quadVertexBuffer != NULL) quadVertexBuffer->Release();
+	if (quadIndexBuffer != NULL) quadIndexBuffer->Release();
 	if (vsFullScreenQuad != NULL) vsFullScreenQuad->Release();
 	if (depthStencilStateOn != NULL) depthStencilStateOn->Release();
 	if (depthStencilStateOff != NULL) depthStencilStateOff->Release();
@@ -119,6 +143,21 @@ D3D::~D3D()
 	if (depthStencilStateDrawWhereStencilClear != NULL) depthStencilStateDrawWhereStencilClear->Release();
 	if (defaultRasterizerState != NULL) defaultRasterizerState->Release();
 	if (mirrorRasterizerState != NULL) mirrorRasterizerState->Release();
+	blendState = NULL;
+	linearWrapSamplerState = NULL;
+	linearNoWrapSamplerState = NULL;
+	cbWorld = NULL;
+	cbWorldRing = NULL;
+	quadVertexBuffer = NULL;
+	quadIndexBuffer = NULL;
+	vsFullScreenQuad = NULL;
+	depthStencilStateOn = NULL;
+	depthStencilStateOff = NULL;
+	depthStencilStateSetStencil = NULL;
+	depthStencilStateDrawWhereStencilSet = NULL;
+	depthStencilStateDrawWhereStencilClear = NULL;
+	defaultRasterizerState = NULL;
+	mirrorRasterizerState = NULL;
 
 	// clear internal references and release the main D3D interfaces
 	if (internalContextPointer != 0)
@@ -130,6 +169,10 @@ D3D::~D3D()
 	if (internalContext1Pointer != 0) internalContext1Pointer->Release();
 	if (device1 != 0) device1->Release();
 	if (device != 0) device->Release();
+	internalContextPointer = NULL;
+	internalContext1Pointer = NULL;
+	device1 = NULL;
+	device = NULL;
 
 #ifdef DEBUG_D3D_LEAKS
 	// show the live object list if desired
@@ -145,14 +188,18 @@ D3D::~D3D()
 bool D3D::InitD3D()
 {
 	HRESULT hr;
-	auto GenErr = [&hr](const TCHAR *details) {
-		LogSysError(ErrorIconType::EIT_Error, LoadStringT(IDS_ERR_D3DINIT),
-			MsgFmt(_T("%s, system error code %lx"), details, hr));
+	auto GenErr = [this, &hr](const TCHAR *details) {
+		if (recovering)
+			LogFile::Get()->Write(_T("D3D: device re-creation failed: %s, system error code %lx\n"), details, hr);
+		else
+			LogSysError(ErrorIconType::EIT_Error, LoadStringT(IDS_ERR_D3DINIT),
+				MsgFmt(_T("%s, system error code %lx"), details, hr));
 		return false;
 	};
 
-	// device flags
-	UINT createDeviceFlags = D3D11_CREATE_DEVICE_VIDEO_SUPPORT;
+	// Device flags.  BGRA support is required for Direct2D interop, which
+	// the Javascript drawing layers use to draw directly into textures.
+	UINT createDeviceFlags = D3D11_CREATE_DEVICE_VIDEO_SUPPORT | D3D11_CREATE_DEVICE_BGRA_SUPPORT;
 
 	// add the Debug flag if in debug mode
 	IF_DEBUG(createDeviceFlags |= D3D11_CREATE_DEVICE_DEBUG);
@@ -176,8 +223,8 @@ bool D3D::InitD3D()
 	};
 	UINT numFeatureLevels = ARRAYSIZE(featureLevels);
 
-	// try each driver type until we successfully create the device
-	for (UINT driverTypeIndex = 0; driverTypeIndex < numDriverTypes; driverTypeIndex++)
+	// try creating the device on a given adapter with a given driver type
+	auto TryCreateDevice = [&](IDXGIAdapter *adapter, D3D_DRIVER_TYPE type)
 	{
 		// Try with gradually reducing feature levels.  We can accept as
 		// low as 11.0.
@@ -198,30 +245,63 @@ bool D3D::InitD3D()
 				UINT curDeviceFlags = createDeviceFlags & ~removeFlags[flagLevel];
 
 				// try creating the driver with the current type and device flags
-				driverType = driverTypes[driverTypeIndex];
-				hr = D3D11CreateDevice(nullptr, driverType, nullptr, curDeviceFlags,
+				hr = D3D11CreateDevice(adapter, type, nullptr, curDeviceFlags,
 					&featureLevels[startLevel], numFeatureLevels - startLevel,
 					D3D11_SDK_VERSION, &device, &featureLevel, &internalContextPointer);
 
 				// if that succeeded, stop searching
 				if (SUCCEEDED(hr))
-					break;
+					return true;
 			}
-
-			// break out of the level search if successful
-			if (SUCCEEDED(hr))
-				break;
 		}
 
-		// stop searching on the first successful device creation
-		if (SUCCEEDED(hr))
-			break;
+		// no luck
+		return false;
+	};
+
+	// Log the adapters, and look for the one selected in the settings,
+	// if any.  If we find it, try creating the device there first.  An
+	// explicit adapter requires the UNKNOWN driver type.
+	bool created = false;
+	RefPtr<IDXGIAdapter1> selectedAdapter;
+	LogAdapters(ConfigManager::GetInstance()->Get(_T("GPUAdapter"), _T("")), selectedAdapter);
+	if (selectedAdapter != nullptr)
+	{
+		created = TryCreateDevice(selectedAdapter, D3D_DRIVER_TYPE_UNKNOWN);
+		if (created)
+			driverType = D3D_DRIVER_TYPE_HARDWARE;
+		else
+			LogFile::Get()->Write(_T("D3D: unable to create the device on the selected adapter (error %lx); using the default adapter\n"), hr);
+	}
+
+	// otherwise, try each driver type on the default adapter until we
+	// successfully create the device
+	for (UINT driverTypeIndex = 0; !created && driverTypeIndex < numDriverTypes; driverTypeIndex++)
+	{
+		driverType = driverTypes[driverTypeIndex];
+		created = TryCreateDevice(nullptr, driverType);
 	}
 
 	// if we couldn't create a device, return failure
-	if (FAILED(hr))
+	if (!created)
 		return GenErr(_T("D3D11CreateDevice failed"));
 
+	// note which adapter we ended up on
+	{
+		RefPtr<IDXGIDevice> dxgiDevice;
+		RefPtr<IDXGIAdapter> adapter;
+		DXGI_ADAPTER_DESC desc;
+		if (SUCCEEDED(device->QueryInterface(__uuidof(IDXGIDevice), reinterpret_cast<void**>(&dxgiDevice)))
+			&& SUCCEEDED(dxgiDevice->GetAdapter(&adapter))
+			&& SUCCEEDED(adapter->GetDesc(&desc)))
+		{
+			adapterLuid = desc.AdapterLuid;
+			adapterName = desc.Description;
+			adapterVideoMemory = desc.DedicatedVideoMemory;
+			LogFile::Get()->Write(_T("D3D: rendering on adapter \"%s\"\n"), adapterName.c_str());
+		}
+	}
+
 	// Try to get the upgraded Device1 and DeviceContext1 interfaces, available in
 	// DirectX 11.1 or later.  These give us access to some additional functions;
 	// if not available, we'll use fallbacks in the 11.0 interfaces that we
@@ -319,8 +399,59 @@ bool D3D::InitD3D()
 
 	// set up the initial world matrix
 	worldMatrix = XMMatrixIdentity();
-	CBWorld cbw = { XMMatrixTranspose(worldMatrix) };
+	CBWorld cbw = { XMMatrixTranspose(worldMatrix), { 0.0f, 0.0f, 1.0f, 1.0f } };
 	internalContextPointer->UpdateSubresource(cbWorld, 0, nullptr, &cbw, 0, 0);
+	lastWorldValid = false;
+
+	// Create the world transform ring, if the device can bind constant
+	// buffers by offset, and map dynamic constant buffers without
+	// overwriting (see cbWorldRing).  This is optional; we fall back on
+	// cbWorld if it's not available.
+	D3D11_FEATURE_DATA_D3D11_OPTIONS opts;
+	ZeroMemory(&opts, sizeof(opts));
+	if (internalContext1Pointer != NULL
+		&& SUCCEEDED(device->CheckFeatureSupport(D3D11_FEATURE_D3D11_OPTIONS, &opts, sizeof(opts)))
+		&& opts.ConstantBufferOffsetting && opts.MapNoOverwriteOnDynamicConstantBuffer)
+	{
+		bd.Usage = D3D11_USAGE_DYNAMIC;
+		bd.ByteWidth = worldRingSlots * worldRingSlotConstants * 16;
+		bd.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+		if (FAILED(device->CreateBuffer(&bd, nullptr, &cbWorldRing)))
+			cbWorldRing = NULL;
+	}
+	worldRingNext = worldRingSlots;
+	worldRingCur = 0;
+	worldVSSlot = worldPSSlot = -1;
+
+	// Create the shared unit quad vertex buffer.  This is a 1x1 square
+	// centered at the origin, which sprites scale to their actual size
+	// via the world transform.
+	const CommonVertex quadVertices[] = {
+		{ XMFLOAT4(-0.5f, 0.5f, 0.0f, 0.0f), XMFLOAT2(0.0f, 0.0f), XMFLOAT3(0, 1, 0) },  // top left
+		{ XMFLOAT4(0.5f, 0.5f, 0.0f, 0.0f), XMFLOAT2(1.0f, 0.0f), XMFLOAT3(0, 1, 0) },   // top right
+		{ XMFLOAT4(0.5f, -0.5f, 0.0f, 0.0f), XMFLOAT2(1.0f, 1.0f), XMFLOAT3(0, 1, 0) },  // bottom right
+		{ XMFLOAT4(-0.5f, -0.5f, 0.0f, 0.0f), XMFLOAT2(0.0f, 1.0f), XMFLOAT3(0, 1, 0) }  // bottom left
+	};
+	D3D11_SUBRESOURCE_DATA sd;
+	ZeroMemory(&sd, sizeof(sd));
+	sd.pSysMem = quadVertices;
+	ZeroMemory(&bd, sizeof(bd));
+	bd.Usage = D3D11_USAGE_IMMUTABLE;
+	bd.ByteWidth = sizeof(quadVertices);
+	bd.BindFlags = D3D11_BIND_VERTEX_BUFFER;
+	if (FAILED(hr = device->CreateBuffer(&bd, &sd, &quadVertexBuffer)))
+		return GenErr(_T("Creating unit quad vertex buffer"));
+
+	// create the shared unit quad index buffer
+	static const WORD quadIndices[] = {
+		0, 1, 2,	// top face 1
+		2, 3, 0		// top face 2
+	};
+	sd.pSysMem = quadIndices;
+	bd.ByteWidth = sizeof(quadIndices);
+	bd.BindFlags = D3D11_BIND_INDEX_BUFFER;
+	if (FAILED(hr = device->CreateBuffer(&bd, &sd, &quadIndexBuffer)))
+		return GenErr(_T("Creating unit quad index buffer"));
 
 	// Create the default sample state: linear, wrap coordinates
 	D3D11_SAMPLER_DESC sampDesc;
@@ -347,11 +478,16 @@ bool D3D::InitD3D()
 	if (FAILED(hr = CreateVertexShader(g_vsFullScreenQuadShader, sizeof(g_vsFullScreenQuadShader), &vsFullScreenQuad)))
 		return GenErr(_T("Creating full-screen quad vertex shader"));
 
-	// set up alpha blending
+	// Set up alpha blending.  We use premultiplied alpha throughout:
+	// every pixel shader outputs its color already multiplied by its
+	// alpha, so the source color is added as-is.  Premultiplied colors
+	// filter and mip correctly at the edges of transparent areas, where
+	// straight alpha picks up fringes from the color values stored in
+	// the invisible pixels.
 	D3D11_BLEND_DESC BlendState;
 	ZeroMemory(&BlendState, sizeof(BlendState));
 	BlendState.RenderTarget[0].BlendEnable = TRUE;
-	BlendState.RenderTarget[0].SrcBlend = D3D11_BLEND_SRC_ALPHA;
+	BlendState.RenderTarget[0].SrcBlend = D3D11_BLEND_ONE;
 	BlendState.RenderTarget[0].DestBlend = D3D11_BLEND_INV_SRC_ALPHA;
 	BlendState.RenderTarget[0].BlendOp = D3D11_BLEND_OP_ADD;
 	BlendState.RenderTarget[0].SrcBlendAlpha = D3D11_BLEND_ONE;
@@ -371,8 +507,8 @@ void D3D::RenderFullScreenQuad()
 	// lock the device context
 	DeviceContextLocker ctx;
 
-	ctx->IASetPrimitiveTopology(D3D10_PRIMITIVE_TOPOLOGY_TRIANGLESTRIP);
-	ctx->VSSetShader(vsFullScreenQuad, nullptr, 0);
+	SetTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLESTRIP);
+	VSSetShader(vsFullScreenQuad);
 	ctx->Draw(4, 0);
 }
 
@@ -383,7 +519,7 @@ void D3D::StartStencilMasking()
 	DeviceContextLocker ctx;
 
 	// set the SET STENCIL state, with reference value 1
-	ctx->OMSetDepthStencilState(depthStencilStateSetStencil, 1);
+	SetDepthStencilState(depthStencilStateSetStencil, 1);
 	useStencil = true;
 }
 
@@ -394,22 +530,77 @@ void D3D::UseStencilMask(bool drawWhereSet)
 	useStencil = true;
 
 	// set the DRAW WHERE SET or DRAW WHERE CLEAR state
-	DeviceContextLocker ctx;
-	ctx->OMSetDepthStencilState(
+	SetDepthStencilState(
 		drawWhereSet ? depthStencilStateDrawWhereStencilSet : depthStencilStateDrawWhereStencilClear, 
 		1);
 }
 
 // Update the world transform
-void D3D::UpdateWorldTransform(const XMMATRIX &matrix)
+void D3D::UpdateWorldTransform(const XMMATRIX &matrix, const XMFLOAT4 &texRect)
 {
-	// set up the world matrix
+	// set up the world matrix and texture rectangle
 	CBWorld cbw;
 	cbw.world = matrix;
+	cbw.texRect = texRect;
+
+	// skip the upload if it's the same as the last one
+	if (lastWorldValid && memcmp(&cbw, &lastWorld, sizeof(cbw)) == 0)
+		return;
+	lastWorld = cbw;
+	lastWorldValid = true;
 
-	// update the resource
+	// if we don't have the world ring, just update the resource
 	DeviceContextLocker ctx;
-	ctx->UpdateSubresource(cbWorld, 0, nullptr, &cbw, 0, 0);
+	if (cbWorldRing == NULL)
+	{
+		ctx->UpdateSubresource(cbWorld, 0, nullptr, &cbw, 0, 0);
+		return;
+	}
+
+	// Write the transform into the next ring slot.  The slots already
+	// written are still in use by draws the GPU might not have finished,
+	// so map without overwriting, unless we're starting the ring over,
+	// in which case we discard the old contents and get a fresh buffer.
+	D3D11_MAP mapType = D3D11_MAP_WRITE_NO_OVERWRITE;
+	if (worldRingNext >= worldRingSlots)
+	{
+		worldRingNext = 0;
+		mapType = D3D11_MAP_WRITE_DISCARD;
+	}
+	D3D11_MAPPED_SUBRESOURCE m;
+	if (FAILED(ctx->Map(cbWorldRing, 0, mapType, 0, &m)))
+	{
+		lastWorldValid = false;
+		return;
+	}
+	memcpy(static_cast<BYTE*>(m.pData) + worldRingNext * worldRingSlotConstants * 16, &cbw, sizeof(cbw));
+	ctx->Unmap(cbWorldRing, 0);
+	worldRingCur = worldRingNext++;
+
+	// bind the shaders to the new slot
+	BindWorldRing(ctx.GetContext1());
+}
+
+void D3D::BindWorldRing(ID3D11DeviceContext1 *ctx1)
+{
+	// Bind the current slot by offset.  This bypasses the pipeline state
+	// cache, since the cache only compares buffer pointers, so mark the
+	// cached entries as unknown; the world slots are only ever set here.
+	UINT first = worldRingCur * worldRingSlotConstants, num = worldRingSlotConstants;
+	if (worldVSSlot >= 0)
+	{
+		if (worldVSSlot < static_cast<int>(countof(pipelineState.vsConstantBuffers)))
+			pipelineState.vsConstantBuffers[worldVSSlot] = nullptr;
+		ctx1->VSSetConstantBuffers1(worldVSSlot, 1, &cbWorldRing, &first, &num);
+		++stateStats.issued;
+	}
+	if (worldPSSlot >= 0)
+	{
+		if (worldPSSlot < static_cast<int>(countof(pipelineState.psConstantBuffers)))
+			pipelineState.psConstantBuffers[worldPSSlot] = nullptr;
+		ctx1->PSSetConstantBuffers1(worldPSSlot, 1, &cbWorldRing, &first, &num);
+		++stateStats.issued;
+	}
 }
 
 // Create a 2D texture
@@ -427,6 +618,9 @@ HRESULT D3D::CreateTexture2D(
 	if (FAILED(hr = device->CreateTexture2D(texDesc, initData, &t2d)))
 		return hr;
 
+	// count it in the texture memory budget
+	TextureBudget::Track(t2d);
+
 	// create the shader resource view
 	hr = device->CreateShaderResourceView(t2d, viewDesc, rv);
 
@@ -447,8 +641,20 @@ void D3D::SetUseDepthStencil(bool on)
 	useStencil = on;
 
 	// set the new state object
+	SetDepthStencilState(on ? depthStencilStateOn : depthStencilStateOff, 0);
+}
+
+void D3D::SetDepthStencilState(ID3D11DepthStencilState *state, UINT ref)
+{
+	// skip the call if the state and reference value are already set
+	if (ref != pipelineState.stencilRef)
+		pipelineState.depthStencilState = nullptr;
+	if (IsStateCurrent(pipelineState.depthStencilState, state))
+		return;
+	pipelineState.stencilRef = ref;
+
 	DeviceContextLocker ctx;
-	ctx->OMSetDepthStencilState(on ? depthStencilStateOn : depthStencilStateOff, 0);
+	ctx->OMSetDepthStencilState(state, ref);
 }
 
 void D3D::SetWin(D3DWin *win)
@@ -459,6 +665,7 @@ void D3D::SetWin(D3DWin *win)
 		// set the render targets
 		DeviceContextLocker ctx;
 		ctx->OMSetRenderTargets(1, &win->renderTargetView, win->depthStencilView);
+		InvalidateShaderResourceCache();
 
 		// Setup the viewport
 		D3D11_VIEWPORT vp;
@@ -476,6 +683,163 @@ void D3D::SetWin(D3DWin *win)
 	}
 }
 
+void D3D::LogAdapters(const TCHAR *select, RefPtr<IDXGIAdapter1> &selected)
+{
+	RefPtr<IDXGIFactory1> factory;
+	if (FAILED(CreateDXGIFactory1(IID_PPV_ARGS(&factory))))
+		return;
+
+	// The selection can be an adapter number, as listed in the log, or
+	// any part of the adapter's description (e.g., "NVIDIA").
+	bool selecting = select != nullptr && select[0] != 0;
+	bool selectByIndex = selecting && _tcsspn(select, _T("0123456789")) == _tcslen(select);
+	UINT selectIndex = selectByIndex ? static_cast<UINT>(_ttoi(select)) : 0;
+
+	LogFile::Get()->Write(_T("D3D: video adapters:\n"));
+	RefPtr<IDXGIAdapter1> adapter;
+	for (UINT i = 0; factory->EnumAdapters1(i, &adapter) != DXGI_ERROR_NOT_FOUND; ++i, adapter = nullptr)
+	{
+		DXGI_ADAPTER_DESC1 desc;
+		if (FAILED(adapter->GetDesc1(&desc)))
+			continue;
+
+		LogFile::Get()->Write(_T("  [%u] %s (vendor %04x, device %04x), %I64u MB dedicated video memory%s\n"),
+			i, desc.Description, desc.VendorId, desc.DeviceId,
+			static_cast<UINT64>(desc.DedicatedVideoMemory) / (1024 * 1024),
+			(desc.Flags & DXGI_ADAPTER_FLAG_SOFTWARE) != 0 ? _T(", software") : _T(""));
+
+		// list the outputs (monitors) the adapter drives
+		RefPtr<IDXGIOutput> output;
+		for (UINT j = 0; adapter->EnumOutputs(j, &output) != DXGI_ERROR_NOT_FOUND; ++j, output = nullptr)
+		{
+			DXGI_OUTPUT_DESC odesc;
+			if (SUCCEEDED(output->GetDesc(&odesc)))
+			{
+				const RECT &rc = odesc.DesktopCoordinates;
+				LogFile::Get()->Write(_T("      output %s: %d,%d - %d,%d%s\n"),
+					odesc.DeviceName, rc.left, rc.top, rc.right, rc.bottom,
+					odesc.AttachedToDesktop ? _T("") : _T(" (not attached to the desktop)"));
+			}
+		}
+
+		// check for a match to the selection
+		if (selecting && selected == nullptr
+			&& (selectByIndex ? i == selectIndex : StrStrI(desc.Description, select) != nullptr))
+			selected = adapter.Get();
+	}
+
+	// note if the selection didn't match anything
+	if (selecting && selected == nullptr)
+		LogFile::Get()->Write(_T("D3D: no adapter matches GPUAdapter = \"%s\"; using the default adapter\n"), select);
+}
+
+bool D3D::GetMonitorAdapter(HMONITOR hMonitor, LUID &luid, TSTRING &name)
+{
+	RefPtr<IDXGIFactory1> factory;
+	if (FAILED(CreateDXGIFactory1(IID_PPV_ARGS(&factory))))
+		return false;
+
+	// search each adapter's outputs for the monitor
+	RefPtr<IDXGIAdapter1> adapter;
+	for (UINT i = 0; factory->EnumAdapters1(i, &adapter) != DXGI_ERROR_NOT_FOUND; ++i, adapter = nullptr)
+	{
+		RefPtr<IDXGIOutput> output;
+		for (UINT j = 0; adapter->EnumOutputs(j, &output) != DXGI_ERROR_NOT_FOUND; ++j, output = nullptr)
+		{
+			DXGI_OUTPUT_DESC odesc;
+			DXGI_ADAPTER_DESC1 desc;
+			if (SUCCEEDED(output->GetDesc(&odesc)) && odesc.Monitor == hMonitor
+				&& SUCCEEDED(adapter->GetDesc1(&desc)))
+			{
+				luid = desc.AdapterLuid;
+				name = desc.Description;
+				return true;
+			}
+		}
+	}
+
+	// not found
+	return false;
+}
+
+void D3D::OnDeviceLost(HRESULT hr)
+{
+	// note the first error for the loss; later reports are just echoes
+	if (InterlockedCompareExchange(&deviceLost, 1, 0) == 0)
+		lostError = hr;
+}
+
+bool D3D::RecreateDevice()
+{
+	// log the reason the device was removed
+	HRESULT reason = device != nullptr ? device->GetDeviceRemovedReason() : S_OK;
+	LogFile::Get()->Write(_T("D3D: device lost (error %lx, removal reason %lx); re-creating the device\n"),
+		static_cast<long>(lostError), static_cast<long>(reason));
+
+	// Hold on to the old device until the next recovery, in case a
+	// background thread is still using it, and release everything else.
+	// Don't clear the device context lock, since other threads might
+	// be waiting on it.
+	{
+		DeviceContextLocker ctx;
+		lostDevice = device;
+		ReleaseDeviceObjects();
+
+		// nothing is bound on the new device yet
+		ZeroMemory(&pipelineState, sizeof(pipelineState));
+		Shader::InvalidatePreparedShader();
+		curwin = 0;
+
+		// create the new device
+		recovering = true;
+		bool ok = InitD3D();
+		recovering = false;
+		if (!ok)
+		{
+			// Put the lost device back in place until the next attempt, so
+			// that anything that uses the device in the meantime gets errors
+			// from the removed device rather than null pointers.
+			ReleaseDeviceObjects();
+			device = lostDevice;
+			device->AddRef();
+			device->GetImmediateContext(&internalContextPointer);
+			return false;
+		}
+
+		// the device is back, with a new generation of resources
+		++deviceGeneration;
+		lostError = S_OK;
+		InterlockedExchange(&deviceLost, 0);
+	}
+
+	return true;
+}
+
+void D3D::Trim()
+{
+	// Clear the device context state, so that Trim() can release any
+	// resources that are only being retained because they're bound
+	DeviceContextLocker ctx;
+	ctx->ClearState();
+	ctx->Flush();
+
+	// ClearState() wiped out everything we had bound, so forget our
+	// cached pipeline state, and restore the blend state, which we only
+	// set once at initialization
+	ZeroMemory(&pipelineState, sizeof(pipelineState));
+	Shader::InvalidatePreparedShader();
+	curwin = 0;
+	ctx->OMSetBlendState(blendState, 0, 0xffffffff);
+
+	// trim the DXGI device allocations (requires Windows 8.1 or later)
+	IDXGIDevice3 *dxgiDevice = nullptr;
+	if (SUCCEEDED(device->QueryInterface(__uuidof(IDXGIDevice3), reinterpret_cast<void**>(&dxgiDevice))))
+	{
+		dxgiDevice->Trim();
+		dxgiDevice->Release();
+	}
+}
+
 void D3D::UnsetWin(D3DWin *win)
 {
 	if (win == curwin)
@@ -483,6 +847,7 @@ void D3D::UnsetWin(D3DWin *win)
 		// clear the render targets
 		DeviceContextLocker ctx;
 		ctx->OMSetRenderTargets(0, 0, 0);
+		InvalidateShaderResourceCache();
 		curwin = 0;
 	}
 }
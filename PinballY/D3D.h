@@ -18,12 +18,14 @@
 #include <windowsx.h>
 #include <d3d11_1.h>
 #include <DirectXMath.h>
+#include "../Utilities/Pointers.h"
 #include "CommonVertex.h"
 
 // constant buffer definitions
 struct CBWorld
 {
 	DirectX::XMMATRIX world;
+	DirectX::XMFLOAT4 texRect;
 };
 struct CBOrtho
 {
@@ -56,6 +58,53 @@ public:
 	// This has no effect if a different window is active.
 	void UnsetWin(D3DWin *win);
 
+	// Get the description of the adapter we're rendering on
+	const TCHAR *GetAdapterName() const { return adapterName.c_str(); }
+
+	// Get the rendering adapter's dedicated video memory size, in bytes
+	UINT64 GetDedicatedVideoMemory() const { return adapterVideoMemory; }
+
+	// Find the adapter that drives a monitor.  Returns false if the
+	// monitor isn't found among the DXGI outputs.
+	bool GetMonitorAdapter(HMONITOR hMonitor, LUID &luid, TSTRING &name);
+
+	// is the given adapter the one we're rendering on?
+	bool IsRenderAdapter(const LUID &luid) const
+		{ return luid.LowPart == adapterLuid.LowPart && luid.HighPart == adapterLuid.HighPart; }
+
+	// Device loss.  A driver timeout (TDR), a driver update, or a GPU
+	// reset removes the device, after which every call on it fails or
+	// does nothing, and nothing we draw reaches the screen.  The swap
+	// chain reports this from Present() as DXGI_ERROR_DEVICE_REMOVED or
+	// DXGI_ERROR_DEVICE_RESET.  Whoever sees one of these errors calls
+	// OnDeviceLost(), which can be done from any thread.  The UI thread
+	// checks IsDeviceLost() on each idle pass, and recovers by creating
+	// a new device and rebuilding everything that depended on the old
+	// one (see Application::RecoverD3DDevice()).
+	static bool IsDeviceLostError(HRESULT hr) { return hr == DXGI_ERROR_DEVICE_REMOVED || hr == DXGI_ERROR_DEVICE_RESET; }
+	void OnDeviceLost(HRESULT hr);
+	bool IsDeviceLost() const { return deviceLost != 0; }
+
+	// Device generation.  This is incremented each time we re-create the
+	// device.  Objects that hold device resources can record this when
+	// they create their resources, and compare it later to find out if
+	// the resources came from a device that's since been lost.
+	UINT GetDeviceGeneration() const { return deviceGeneration; }
+
+	// Re-create the device after a loss.  This releases our device
+	// objects and creates a new device with the same settings as at
+	// startup.  The caller must release every window's swap chain before
+	// calling this, and is responsible for rebuilding other objects that
+	// hold device resources.  Errors are logged rather than displayed,
+	// since the caller can retry.  UI thread only.
+	bool RecreateDevice();
+
+	// Release the driver's internal allocations made on our behalf, via
+	// IDXGIDevice3::Trim().  We use this when yielding resources to a
+	// running game.  This clears the device context state, so it also
+	// resets our cached pipeline state.
+	void Trim();
+
 	// Device context locker.  Device context methods aren't natively
 	// thread-safe, so we have to provide our own thread protection
 	// when using the device context.  This object provides the context
@@ -183,23 +232,52 @@ public:
 		const void *byteCode, SIZE_T byteCodeLength, ID3D11InputLayout **inputLayout)
 		{ return device->CreateInputLayout(desc, numElements, byteCode, byteCodeLength, inputLayout); }
 
+	// Pipeline state call statistics.  The state-setting methods below
+	// skip calls that would bind the object that's already bound; these
+	// counters tally the calls we actually passed to the device context
+	// and the ones we skipped as redundant.
+	struct StateStats
+	{
+		UINT64 issued;
+		UINT64 elided;
+	};
+	const StateStats &GetStateStats() const { return stateStats; }
+	void ResetStateStats() { stateStats = { 0, 0 }; }
+
+	// Invalidate the cached shader resource bindings.  D3D implicitly
+	// unbinds any shader resource that's bound as a render target, so
+	// this must be called after changing the render targets.
+	void InvalidateShaderResourceCache() { ZeroMemory(pipelineState.psResources, sizeof(pipelineState.psResources)); }
+
 	// set the input layout
 	inline void SetInputLayout(ID3D11InputLayout *layout)
 	{
+		if (IsStateCurrent(pipelineState.inputLayout, layout))
+			return;
+
 		DeviceContextLocker ctx;
 		ctx->IASetInputLayout(layout);
 	}
 
 	// set the primitive topology to triangle list
-	inline void SetTriangleTopology()
+	inline void SetTriangleTopology() { SetTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST); }
+
+	// set the primitive topology
+	inline void SetTopology(D3D11_PRIMITIVE_TOPOLOGY topology)
 	{
+		if (IsStateCurrent(pipelineState.topology, topology))
+			return;
+
 		DeviceContextLocker ctx;
-		ctx->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST); 
+		ctx->IASetPrimitiveTopology(topology); 
 	}
 
 	// load a resource view into the pixel shader
 	inline void PSSetShaderResources(int startSlot, int numResources, ID3D11ShaderResourceView *const *resources)
 	{
+		if (IsStateCurrent(pipelineState.psResources, startSlot, numResources, resources))
+			return;
+
 		DeviceContextLocker ctx;
 		ctx->PSSetShaderResources(startSlot, numResources, resources); 
 	}
@@ -208,23 +286,31 @@ public:
 	inline void PSClearShaderResource(int slot)
 	{ 
 		static ID3D11ShaderResourceView *const r[1] = { 0 };
-		DeviceContextLocker ctx;
-		ctx->PSSetShaderResources(slot, 1, r);
+		PSSetShaderResources(slot, 1, r);
 	}
 
 	// set shaders
 	inline void VSSetShader(ID3D11VertexShader *vs)
 	{
+		if (IsStateCurrent(pipelineState.vs, vs))
+			return;
+
 		DeviceContextLocker ctx;
 		ctx->VSSetShader(vs, nullptr, 0); 
 	}
 	inline void PSSetShader(ID3D11PixelShader *ps)
 	{
+		if (IsStateCurrent(pipelineState.ps, ps))
+			return;
+
 		DeviceContextLocker ctx;
 		ctx->PSSetShader(ps, nullptr, 0);
 	}
 	inline void GSSetShader(ID3D11GeometryShader *gs)
 	{
+		if (IsStateCurrent(pipelineState.gs, gs))
+			return;
+
 		DeviceContextLocker ctx;
 		ctx->GSSetShader(gs, nullptr, 0);
 	}
@@ -232,16 +318,25 @@ public:
 	// set shader constant buffers
 	inline void VSSetConstantBuffers(int startIdx, int numBuffers, ID3D11Buffer *const *buffers)
 	{
+		if (IsStateCurrent(pipelineState.vsConstantBuffers, startIdx, numBuffers, buffers))
+			return;
+
 		DeviceContextLocker ctx;
 		ctx->VSSetConstantBuffers(startIdx, numBuffers, buffers); 
 	}
 	inline void PSSetConstantBuffers(int startIdx, int numBuffers, ID3D11Buffer *const *buffers)
 	{ 
+		if (IsStateCurrent(pipelineState.psConstantBuffers, startIdx, numBuffers, buffers))
+			return;
+
 		DeviceContextLocker ctx;
 		ctx->PSSetConstantBuffers(startIdx, numBuffers, buffers); 
 	}
 	inline void GSSetConstantBuffers(int startIdx, int numBuffers, ID3D11Buffer *const *buffers)
 	{ 
+		if (IsStateCurrent(pipelineState.gsConstantBuffers, startIdx, numBuffers, buffers))
+			return;
+
 		DeviceContextLocker ctx;
 		ctx->GSSetConstantBuffers(startIdx, numBuffers, buffers); 
 	}
@@ -249,6 +344,13 @@ public:
 	// set the input assembler vertex buffer
 	inline void IASetVertexBuffer(ID3D11Buffer *buffer, UINT stride)
 	{
+		// skip the call if this buffer is already bound with the same stride
+		if (stride != pipelineState.vertexStride)
+			pipelineState.vertexBuffer = nullptr;
+		if (IsStateCurrent(pipelineState.vertexBuffer, buffer))
+			return;
+		pipelineState.vertexStride = stride;
+
 		UINT offset = 0;
 		DeviceContextLocker ctx;
 		ctx->IASetVertexBuffers(0, 1, &buffer, &stride, &offset);
@@ -257,38 +359,87 @@ public:
 	// set the index buffer using WORD (16-bit unsigned int) format
 	inline void IASetIndexBuffer(ID3D11Buffer *buffer)
 	{
+		// skip the call if this buffer is already bound
+		if (IsStateCurrent(pipelineState.indexBuffer, buffer))
+			return;
+
 		DeviceContextLocker ctx;
 		ctx->IASetIndexBuffer(buffer, DXGI_FORMAT_R16_UINT, 0); 
 	}
 
-	// update the world transform matrix
-	void UpdateWorldTransform(const DirectX::XMMATRIX &matrix);
+	// Set the shared unit quad vertex and index buffers.  This is a
+	// 1x1 rectangle centered at the origin, in the Z=0 plane, drawn as
+	// two triangles (6 indices).  Sprites use this for their meshes,
+	// scaling it to the desired size via the world transform, so that
+	// we don't need separate buffers for every rectangle.
+	inline void IASetUnitQuad()
+	{
+		IASetVertexBuffer(quadVertexBuffer, sizeof(CommonVertex));
+		IASetIndexBuffer(quadIndexBuffer);
+	}
 
-	// set the world constant buffer in a shader
+	// is the unit quad mesh available?
+	bool IsUnitQuadAvailable() const { return quadVertexBuffer != NULL && quadIndexBuffer != NULL; }
+
+	// Update the world transform matrix.  The texture rectangle gives
+	// the region of the texture to map onto the mesh, as { u0, v0, du, dv };
+	// this is normally the whole texture, but can be a sub-region for an
+	// image in a texture atlas.  (Only the basic Texture Shader applies
+	// the texture rectangle; other shaders always use the whole texture.)
+	void UpdateWorldTransform(const DirectX::XMMATRIX &matrix)
+		{ UpdateWorldTransform(matrix, { 0.0f, 0.0f, 1.0f, 1.0f }); }
+	void UpdateWorldTransform(const DirectX::XMMATRIX &matrix, const DirectX::XMFLOAT4 &texRect);
+
+	// Set the world constant buffer in a shader.  With the world ring
+	// (see cbWorldRing), this binds the slot holding the current world
+	// transform, and remembers the shader slot, so that the next world
+	// transform update can rebind it at its new offset.
 	inline void VSSetWorldConstantBuffer(int startIdx)
 	{
+		if (cbWorldRing == NULL)
+		{
+			VSSetConstantBuffers(startIdx, 1, &cbWorld);
+			return;
+		}
+
+		worldVSSlot = startIdx;
 		DeviceContextLocker ctx;
-		ctx->VSSetConstantBuffers(startIdx, 1, &cbWorld); 
+		BindWorldRing(ctx.GetContext1());
 	}
 	inline void PSSetWorldConstantBuffer(int startIdx)
 	{
+		if (cbWorldRing == NULL)
+		{
+			PSSetConstantBuffers(startIdx, 1, &cbWorld);
+			return;
+		}
+
+		worldPSSlot = startIdx;
 		DeviceContextLocker ctx;
-		ctx->PSSetConstantBuffers(startIdx, 1, &cbWorld);
+		BindWorldRing(ctx.GetContext1());
 	}
 
 	// Set the pixel shader sampler to the linear sampler, with
 	// wrapping (default) or clamping when outside the 0..1 range.
 	inline void PSSetSampler(bool wrap = true)
 	{ 
+		ID3D11SamplerState *sampler = wrap ? linearWrapSamplerState : linearNoWrapSamplerState;
+		if (IsStateCurrent(pipelineState.psSampler, sampler))
+			return;
+
 		DeviceContextLocker ctx;
-		ctx->PSSetSamplers(0, 1, wrap ? &linearWrapSamplerState : &linearNoWrapSamplerState); 
+		ctx->PSSetSamplers(0, 1, &sampler); 
 	}
 
 	// set the normal or mirrored rasterizer state
 	inline void SetMirroredRasterizerState(bool mirrored)
 	{
+		ID3D11RasterizerState *state = mirrored ? mirrorRasterizerState : defaultRasterizerState;
+		if (IsStateCurrent(pipelineState.rasterizerState, state))
+			return;
+
 		DeviceContextLocker ctx;
-		ctx->RSSetState(mirrored ? mirrorRasterizerState : defaultRasterizerState);
+		ctx->RSSetState(state);
 	}
 
 	// draw
@@ -298,9 +449,19 @@ public:
 		ctx->DrawIndexed(indexCount, 0, 0);
 	}
 
+	// draw a range of the index buffer
+	inline void DrawIndexed(UINT indexCount, UINT startIndex)
+	{
+		DeviceContextLocker ctx;
+		ctx->DrawIndexed(indexCount, startIndex, 0);
+	}
+
 	// turn the depth stencil on or off
 	void SetUseDepthStencil(bool useDepth);
 
+	// set the depth stencil state object and stencil reference value
+	void SetDepthStencilState(ID3D11DepthStencilState *state, UINT ref);
+
 	// start a stencil masking pass: call this, then render objects
 	// to update the stencil
 	void StartStencilMasking();
@@ -334,10 +495,41 @@ protected:
 	// on failure.
 	bool InitD3D();
 
+	// release the device and the objects we create on it
+	void ReleaseDeviceObjects();
+
+	// Device loss status.  deviceLost is set (from any thread) when we
+	// see a device-lost error, and cleared when we re-create the device.
+	// lostError is the first error reported for the loss.
+	volatile LONG deviceLost = 0;
+	HRESULT lostError = S_OK;
+	UINT deviceGeneration = 0;
+
+	// Are we re-creating the device after a loss?  Initialization errors
+	// are logged instead of displayed while this is set.
+	bool recovering = false;
+
+	// The last lost device.  We keep a reference to this until the next
+	// recovery (or shutdown), since a background loader thread could
+	// still be in the middle of creating a texture through a device
+	// pointer it fetched before the recovery.
+	RefPtr<ID3D11Device> lostDevice;
+
+	// Log the video adapters and their outputs.  If 'select' is non-empty,
+	// this also looks for the adapter it selects (the GPUAdapter setting:
+	// an adapter number or part of its description), and stores it in
+	// 'selected' if found.
+	void LogAdapters(const TCHAR *select, RefPtr<IDXGIAdapter1> &selected);
+
 	// driver and version information
 	D3D_DRIVER_TYPE driverType;
 	D3D_FEATURE_LEVEL featureLevel;
 
+	// rendering adapter
+	LUID adapterLuid;
+	TSTRING adapterName;
+	UINT64 adapterVideoMemory = 0;
+
 	// device interface, with Device1 version if available
 	ID3D11Device *device;
 	ID3D11Device1 *device1;
@@ -389,9 +581,111 @@ protected:
 	// instance of the D3D buffer.
 	ID3D11Buffer *cbWorld;
 
+	// World transform ring buffer.  Updating cbWorld in place for every
+	// draw forces the driver to copy or rename the buffer each time,
+	// since the last draw might still be reading it.  When the device
+	// supports binding constant buffers by offset (D3D 11.1), we instead
+	// write each draw's transform into the next slot of one large dynamic
+	// buffer, mapped without overwriting the slots already in use, and
+	// bind the shaders to the new slot's offset.  When the ring fills up,
+	// we start over from the beginning with a discard, which gives us a
+	// fresh buffer while the GPU finishes with the old one.  This is null
+	// if offsets aren't supported, in which case we update cbWorld.
+	ID3D11Buffer *cbWorldRing;
+	static const UINT worldRingSlots = 4096;
+	static const UINT worldRingSlotConstants = 16;     // one slot = 16 constants = 256 bytes, the offset granularity
+	UINT worldRingNext;       // next free slot; worldRingSlots means the next write starts over with a discard
+	UINT worldRingCur;        // slot holding the current transform
+	int worldVSSlot;          // vertex shader slot the world buffer is bound to, or -1
+	int worldPSSlot;          // pixel shader slot the world buffer is bound to, or -1
+
+	// bind the current world ring slot to the shader slots
+	void BindWorldRing(ID3D11DeviceContext1 *ctx1);
+
+	// Last world transform uploaded.  Consecutive draws with the same
+	// transform (such as text runs) skip the upload.
+	CBWorld lastWorld;
+	bool lastWorldValid;
+
 	// world matrix
 	DirectX::XMMATRIX worldMatrix;
 
+	// Shared unit quad vertex and index buffers, for sprite meshes
+	ID3D11Buffer *quadVertexBuffer;
+	ID3D11Buffer *quadIndexBuffer;
+
+	// Pipeline state cache.  This records the objects currently bound to
+	// the device context through our state-setting methods, so that we
+	// can skip redundant calls when consecutive draws use the same state,
+	// which is the normal case for a list of sprites sharing a shader and
+	// the unit quad.  The pointers are for comparison only; the context
+	// holds its own references while the objects are bound, which also
+	// guarantees that a bound object's address can't be reused for a new
+	// object.  A null entry means "unknown", so setting a null object is
+	// always passed through to the context.  Everything that changes the
+	// context state must go through these methods (or invalidate the
+	// affected entries) to keep the cache accurate.
+	struct PipelineState
+	{
+		ID3D11InputLayout *inputLayout;
+		D3D11_PRIMITIVE_TOPOLOGY topology;
+		ID3D11Buffer *vertexBuffer;
+		UINT vertexStride;
+		ID3D11Buffer *indexBuffer;
+		ID3D11VertexShader *vs;
+		ID3D11PixelShader *ps;
+		ID3D11GeometryShader *gs;
+		ID3D11Buffer *vsConstantBuffers[4];
+		ID3D11Buffer *psConstantBuffers[4];
+		ID3D11Buffer *gsConstantBuffers[4];
+		ID3D11ShaderResourceView *psResources[4];
+		ID3D11SamplerState *psSampler;
+		ID3D11RasterizerState *rasterizerState;
+		ID3D11DepthStencilState *depthStencilState;
+		UINT stencilRef;
+	};
+	PipelineState pipelineState;
+
+	// call statistics for the state cache
+	StateStats stateStats;
+
+	// Check a cached state entry against a new value.  If it matches,
+	// counts an elided call and returns true.  Otherwise stores the new
+	// value, counts an issued call, and returns false.
+	template<typename T> bool IsStateCurrent(T &cur, T val)
+	{
+		if (cur == val && cur != T())
+		{
+			++stateStats.elided;
+			return true;
+		}
+		cur = val;
+		++stateStats.issued;
+		return false;
+	}
+
+	// Check a cached slot array against a new set of values.  Slots past
+	// the end of the cache aren't tracked, so any call that touches them
+	// is always issued.
+	template<typename T, size_t N> bool IsStateCurrent(T *(&cur)[N], int start, int n, T *const *vals)
+	{
+		if (start >= 0 && n >= 0 && size_t(start + n) <= N)
+		{
+			bool same = true;
+			for (int i = 0; i < n && same; ++i)
+				same = (cur[start + i] == vals[i] && vals[i] != nullptr);
+			if (same)
+			{
+				++stateStats.elided;
+				return true;
+			}
+			for (int i = 0; i < n; ++i)
+				cur[start + i] = vals[i];
+		}
+		++stateStats.issued;
+		return false;
+	}
+
 	// special vertex shader to render a full-screen quad
 	ID3D11VertexShader *vsFullScreenQuad;
 };
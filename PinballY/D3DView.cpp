@@ -11,6 +11,19 @@
 #include "AudioManager.h"
 #include "Sprite.h"
 #include "VideoSprite.h"
+#include "VLCAudioVideoPlayer.h"
+#include "TextureBudget.h"
+#include "InputLatency.h"
+#include "MemoryStats.h"
+#include "SpriteCache.h"
+#include "TextureCache.h"
+#include "MediaFileIndex.h"
+#include "HighScoreImageCache.h"
+#include "FontCache.h"
+#include "StartupTimeline.h"
+#include "Benchmark.h"
+#include "LogFile.h"
+#include "AnimClock.h"
 
 using namespace DirectX;
 
@@ -20,11 +33,17 @@ namespace ConfigVars
 	static const TCHAR *Rotation = _T("Rotation");
 	static const TCHAR *MirrorHorz = _T("MirrorHorz");
 	static const TCHAR *MirrorVert = _T("MirrorVert");
+	static const TCHAR *MaxFrameRate = _T("MaxFrameRate");
+	static const TCHAR *AdaptiveFrameRate = _T("AdaptiveFrameRate");
 };
 
 // statics
 std::list<D3DView*> D3DView::activeD3DViews;
 std::list<D3DView::IdleEventSubscriber*> D3DView::idleEventSubscribers;
+bool D3DView::damageTracking = true;
+bool D3DView::multiWindowRenderPass = false;
+int D3DView::hiddenSwapChainReleaseDelay = 60;
+int D3DView::lowPowerFrameRate = 0;
 
 // construction
 D3DView::D3DView(int contextMenuId, const TCHAR *configVarPrefix) 
@@ -61,6 +80,7 @@ void D3DView::SetRotation(int rotation)
 
 	// this changes our camera view sizing
 	OnResizeCameraView();
+	InvalidateRender();
 
 	// save the change to the configuration
 	ConfigManager::GetInstance()->Set(configVarRotation.c_str(), camera->GetMonitorRotation());
@@ -70,6 +90,7 @@ void D3DView::SetMirrorHorz(bool f)
 {
 	// set the mirroring in the camera
 	camera->SetMirrorHorz(f);
+	InvalidateRender();
 
 	// save the change to the configuration
 	ConfigManager::GetInstance()->SetBool(configVarMirrorHorz.c_str(), camera->IsMirrorHorz());
@@ -79,6 +100,7 @@ void D3DView::SetMirrorVert(bool f)
 {
 	// set the mirroring in the camera
 	camera->SetMirrorVert(f);
+	InvalidateRender();
 
 	// save the change to the configuration
 	ConfigManager::GetInstance()->SetBool(configVarMirrorVert.c_str(), camera->IsMirrorVert());
@@ -87,7 +109,7 @@ void D3DView::SetMirrorVert(bool f)
 bool D3DView::InitWin()
 {
 	// do nothing if I've already been initialized
-	if (d3dwin != nullptr)
+	if (camera != nullptr)
 		return true;
 
 	// load the menu icons
@@ -114,6 +136,7 @@ bool D3DView::InitWin()
 	int rotation = ConfigManager::GetInstance()->GetInt(configVarRotation.c_str());
 	bool mirrorHorz = ConfigManager::GetInstance()->GetBool(configVarMirrorHorz.c_str());
 	bool mirrorVert = ConfigManager::GetInstance()->GetBool(configVarMirrorVert.c_str());
+	LoadFrameRateConfig();
 
 	// get the actual window size
 	RECT arc;
@@ -121,9 +144,9 @@ bool D3DView::InitWin()
 	int width = arc.right - arc.left;
 	int height = arc.bottom - arc.top;
 
-	// initialize D3D
-	d3dwin = new D3DWin();
-	if (!d3dwin->Init(hWnd))
+	// initialize D3D, unless we're deferring the swap chain until the
+	// first frame
+	if (!deferSwapChain && !CreateSwapChain())
 	{
 		DestroyWindow(hWnd);
 		return false;
@@ -174,6 +197,134 @@ bool D3DView::InitWin()
 	return true;
 }
 
+bool D3DView::CreateSwapChain()
+{
+	// do nothing if we already have a swap chain, or if a prior
+	// attempt failed
+	if (d3dwin != nullptr)
+		return true;
+	if (swapChainFailed)
+		return false;
+
+	// create the D3D window
+	d3dwin = new D3DWin();
+	if (!d3dwin->Init(hWnd))
+	{
+		delete d3dwin;
+		d3dwin = nullptr;
+		swapChainFailed = true;
+		return false;
+	}
+
+	// the new swap chain is at the full window size
+	swapChainTrimmed = false;
+
+	// make sure we're on a monitor driven by the rendering adapter
+	CheckRenderAdapter();
+	return true;
+}
+
+void D3DView::CheckRenderAdapter()
+{
+	// only check when the window lands on a new monitor
+	HMONITOR hMonitor = MonitorFromWindow(hWnd, MONITOR_DEFAULTTONEAREST);
+	if (hMonitor == adapterCheckMonitor)
+		return;
+	adapterCheckMonitor = hMonitor;
+
+	// find the monitor's adapter, and warn if it's not the rendering adapter
+	LUID luid;
+	TSTRING monitorAdapter;
+	auto d3d = D3D::Get();
+	if (d3d->GetMonitorAdapter(hMonitor, luid, monitorAdapter) && !d3d->IsRenderAdapter(luid))
+	{
+		LogFile::Get()->Write(_T("Warning: the %s window is on a monitor driven by \"%s\", but rendering ")
+			_T("is on \"%s\".  Each frame in this window has to be copied between the adapters, ")
+			_T("which adds GPU load and latency.  You can use the GPUAdapter setting to select the ")
+			_T("rendering adapter.\n"),
+			configVarPrefix.c_str(), monitorAdapter.c_str(), d3d->GetAdapterName());
+	}
+}
+
+void D3DView::ReleaseSwapChain()
+{
+	if (d3dwin != nullptr)
+	{
+		LogFile::Get()->Write(_T("%s window hidden; releasing its swap chain\n"), configVarPrefix.c_str());
+		delete d3dwin;
+		d3dwin = nullptr;
+		swapChainTrimmed = false;
+	}
+}
+
+void D3DView::ReleaseDeviceResources()
+{
+	// release the swap chain, and clear the creation failure flag so
+	// that we try again on the new device
+	if (d3dwin != nullptr)
+	{
+		delete d3dwin;
+		d3dwin = nullptr;
+	}
+	swapChainFailed = false;
+	swapChainTrimmed = false;
+
+	// release the text overlay, with its font textures
+	delete textDraw;
+	textDraw = nullptr;
+	dmdFont = nullptr;
+
+	// release the GPU timing queries
+	gpuTimer.ReleaseQueries();
+}
+
+bool D3DView::RestoreDeviceResources()
+{
+	// re-create the camera's constant buffers
+	if (!camera->Reinit())
+		return false;
+
+	// re-create the text handler and reload the font
+	textDraw = new TextDraw();
+	if (!textDraw->Init())
+		return false;
+
+	TCHAR fontfile[MAX_PATH];
+	GetDeployedFilePath(fontfile, _T("assets\\dotfont.dxtkfont"), _T(""));
+	LogFileErrorHandler eh(_T("D3D device recovery: "));
+	if ((dmdFont = textDraw->GetFont(fontfile, eh)) == 0)
+		return false;
+
+	// redraw on the next pass
+	InvalidateRender();
+	return true;
+}
+
+void D3DView::ReleaseAllDeviceResources()
+{
+	for (auto it : activeD3DViews)
+		it->ReleaseDeviceResources();
+}
+
+bool D3DView::RestoreAllDeviceResources()
+{
+	bool ok = true;
+	for (auto it : activeD3DViews)
+	{
+		if (!it->RestoreDeviceResources())
+			ok = false;
+	}
+	return ok;
+}
+
+void D3DView::UpdateSwapChainReleaseTimer(bool show)
+{
+	if (show || !deferSwapChain || hiddenSwapChainReleaseDelay <= 0)
+		KillTimer(hWnd, releaseSwapChainTimerID);
+	else if (d3dwin != nullptr)
+		SetTimer(hWnd, releaseSwapChainTimerID, hiddenSwapChainReleaseDelay * 1000, 0);
+}
+
 bool D3DView::OnNCDestroy()
 {
 	// remove myself from the active D3D view list, and release the list ref
@@ -216,8 +367,46 @@ void D3DView::RenderFrame()
 	if (IsIconic(hWnd) || !IsWindowVisible(hWnd))
 		return;
 
-	// count the frame
+	// skip rendering while the D3D device is lost; the idle loop will
+	// recover it (see Application::RecoverD3DDevice())
+	if (D3D::Get()->IsDeviceLost())
+		return;
+
+	// create the swap chain, if we deferred it or released it while the
+	// window was hidden
+	if (d3dwin == nullptr && !CreateSwapChain())
+		return;
+
+	// if we trimmed the swap chain, restore the full-size buffers
+	if (swapChainTrimmed)
+	{
+		RECT rc;
+		GetClientRect(hWnd, &rc);
+		swapChainTrimmed = false;
+		d3dwin->ResizeWindow(rc.right - rc.left, rc.bottom - rc.top);
+	}
+
+	// Latch the animation clock for the frame, and bring any running
+	// animation up to date for the frame time.  Do this before taking
+	// the snapshot below, since an animation step can change the
+	// drawing list.
+	AnimClock::FrameScope animFrame;
+	if (animating)
+		animating = OnAnimationFrame();
+
+	// count the frame, and start timing it
 	perfMon.CountFrame();
+	perfMon.BeginFrameTime();
+
+	// Snapshot the drawing list and clear the pending render request.
+	// Do this before rendering, so that any changes made as side 
+	// effects of the rendering itself (such as an animation advancing)
+	// will be picked up on the next pass.
+	renderNeeded = false;
+	lastRenderTime = GetTickCount();
+	lastRenderedSprites.clear();
+	for (auto &s : sprites)
+		lastRenderedSprites.push_back(s.Get());
 
 	// make sure I'm the active window in D3D
 	D3D *d3d = D3D::Get();
@@ -226,6 +415,10 @@ void D3DView::RenderFrame()
 	// prepare D3D for a new frame
 	d3dwin->BeginFrame();
 
+	// start the GPU timing if the performance display is active
+	if (fpsDisplay)
+		gpuTimer.BeginFrame();
+
 	// turn off the depth stencil
 	d3d->SetUseDepthStencil(false);
 	
@@ -236,15 +429,166 @@ void D3DView::RenderFrame()
 	// to the winding order.
 	d3d->SetMirroredRasterizerState(camera->IsMirrorHorz() ^ camera->IsMirrorVert());
 
-	// render the sprite list
+	// Render the sprite list.  For GPU timing, group the sprites by
+	// shader type; consecutive sprites with the same shader are timed
+	// as a group.
 	for (auto &s : sprites)
+	{
+		if (fpsDisplay)
+			gpuTimer.Mark(s->GetShaderID());
 		s->Render(camera);
+	}
 
 	// draw any text overlay
+	if (fpsDisplay)
+		gpuTimer.Mark("Text");
 	textDraw->Render(camera);
 
+	// finish the GPU timing
+	if (fpsDisplay)
+		gpuTimer.EndFrame();
+
 	// close out the frame
 	d3dwin->EndFrame();
+
+	// complete any input latency samples waiting for this window's frame
+	if (InputLatency::IsPending())
+		InputLatency::OnPresent(hWnd);
+
+	// count the first frame for the startup timeline
+	if (StartupTimeline::IsActive())
+		StartupTimeline::OnPresent(hWnd);
+
+	// record the frame time, and add it to the session benchmark, if
+	// one is running
+	float frameTime_ms = perfMon.EndFrameTime();
+	if (Benchmark::IsSessionRunning())
+		Benchmark::OnFrame(configVarPrefix.c_str(), frameTime_ms);
+}
+
+void D3DView::TrimSwapChain()
+{
+	if (freezeBackgroundRendering && !swapChainTrimmed && d3dwin != nullptr)
+	{
+		// D3DWin won't go below 8x8
+		d3dwin->ResizeWindow(8, 8);
+		swapChainTrimmed = true;
+	}
+}
+
+bool D3DView::RenderFrameIfNeeded()
+{
+	// skip hidden and minimized windows
+	if (IsIconic(hWnd) || !IsWindowVisible(hWnd))
+		return false;
+
+	// if damage tracking is enabled, skip the frame if nothing has changed
+	if (damageTracking && !IsRenderNeeded())
+		return false;
+
+	// skip the frame if it's too soon under the frame rate limits
+	if (!IsFrameDue())
+		return false;
+
+	// Wait for the swap chain to be ready for a new frame.  This only
+	// waits with flip model swap chains, where it keeps us from rendering
+	// frames ahead of the display.  If input arrives first, skip the frame
+	// for now, so that the message loop can handle the input promptly.
+	if (d3dwin != nullptr && !d3dwin->WaitForFrameReady(100))
+		return false;
+
+	// render the frame
+	RenderFrame();
+	lastFrameTicks = frameRateTimer.GetTime_ticks();
+	return true;
+}
+
+void D3DView::LoadFrameRateConfig()
+{
+	auto cfg = ConfigManager::GetInstance();
+	maxFrameRate = max(0, cfg->GetInt(MsgFmt(_T("%s.%s"), configVarPrefix.c_str(), ConfigVars::MaxFrameRate), 0));
+	adaptiveFrameRate = cfg->GetBool(MsgFmt(_T("%s.%s"), configVarPrefix.c_str(), ConfigVars::AdaptiveFrameRate), false);
+}
+
+void D3DView::ReloadFrameRateConfig()
+{
+	for (auto v : activeD3DViews)
+		v->LoadFrameRateConfig();
+}
+
+int D3DView::GetFrameRateLimit() const
+{
+	// start with the fixed limit
+	int rate = maxFrameRate;
+
+	// In adaptive mode, drop to the idle rate if nothing in the drawing
+	// list is moving.  Still images only need redrawing when something
+	// changes, so the lower rate just spaces out a burst of changes.
+	if (adaptiveFrameRate && (rate == 0 || rate > adaptiveIdleFrameRate))
+	{
+		bool animated = false;
+		for (auto &s : sprites)
+		{
+			if (s != nullptr && s->IsAnimated())
+			{
+				animated = true;
+				break;
+			}
+		}
+		if (!animated)
+			rate = adaptiveIdleFrameRate;
+	}
+
+	// apply the global low-power cap
+	if (lowPowerFrameRate != 0 && (rate == 0 || rate > lowPowerFrameRate))
+		rate = lowPowerFrameRate;
+
+	return rate;
+}
+
+bool D3DView::IsFrameDue()
+{
+	return GetTimeToNextFrame_ms() == 0;
+}
+
+DWORD D3DView::GetTimeToNextFrame_ms()
+{
+	// if there's no limit, a frame is always due
+	int rate = GetFrameRateLimit();
+	if (rate == 0)
+		return 0;
+
+	// check the time since the last frame against the frame interval
+	double dt = double(frameRateTimer.GetTime_ticks() - lastFrameTicks) * frameRateTimer.GetTickTime_sec();
+	double interval = 1.0 / rate;
+	return dt >= interval ? 0 : static_cast<DWORD>(ceil((interval - dt) * 1000.0));
+}
+
+bool D3DView::IsRenderNeeded() const
+{
+	// check for an explicit request, a running animation, or a change
+	// in the text overlay
+	if (renderNeeded || animating || textDraw == nullptr || textDraw->IsDirty())
+		return true;
+
+	// refresh periodically even if we don't detect any changes
+	if (GetTickCount() - lastRenderTime >= maxRenderInterval)
+		return true;
+
+	// if the drawing list has changed, we need to redraw
+	if (sprites.size() != lastRenderedSprites.size())
+		return true;
+
+	// check each sprite for a change in the list or in the sprite itself
+	auto prv = lastRenderedSprites.begin();
+	for (auto &s : sprites)
+	{
+		if (s.Get() != *prv++ || (s != nullptr && s->IsRenderDirty()))
+			return true;
+	}
+
+	// nothing has changed since the last frame
+	return false;
 }
 
 void D3DView::ScaleSprite(Sprite *sprite, float span, bool maintainAspect)
@@ -340,27 +684,70 @@ bool D3DView::OnActivate(int waCode, int minimized, HWND hWndOther)
 
 void D3DView::ToggleFrameCounter()
 {
-	if (!fpsDisplay)
+	if (fpsDisplay && perfPage + 1 < NPerfPages)
+	{
+		// advance to the next page
+		++perfPage;
+	}
+	else if (!fpsDisplay)
 	{
 		// start the timer
 		SetTimer(hWnd, fpsTimerID, 250, 0);
 		fpsDisplay = true;
+		perfPage = PerfPageFrame;
 
-		// get the current statistics
+		// get the current statistics, and start a new frame time sample
 		perfMon.GetCurFPS(fpsCur, 1.0f);
 		fpsAvg = perfMon.GetRollingFPS();
+		perfMon.ResetFrameTimes();
+		gpuTimer.Reset();
 	}
 	else
 	{
 		// stop the timer
 		KillTimer(hWnd, fpsTimerID);
 		fpsDisplay = false;
+
+		// log the frame times gathered while the display was showing
+		LogFrameTimeStats();
 	}
 
 	// update the text display
 	UpdateText();
 }
 
+float D3DView::GetCurFPS()
+{
+	// Take a new sample if enough time has passed since the last one.
+	// This shares the sample cycle with the FPS display, so fpsCur is
+	// always the latest value from either source.
+	perfMon.GetCurFPS(fpsCur, .5f);
+	return fpsCur;
+}
+
+void D3DView::LogFrameTimeStats()
+{
+	PerfMon::FrameTimeStats stats;
+	perfMon.GetFrameTimeStats(stats);
+	LogFile::Get()->Group();
+	LogFile::Get()->WriteTimestamp(
+		_T("%s frame times: %I64d frames, p50 %.2fms, p95 %.2fms, p99 %.2fms, max %.2fms, ")
+		_T("%I64d over %.2fms budget\n"),
+		configVarPrefix.c_str(), stats.nFrames, stats.p50_ms, stats.p95_ms, stats.p99_ms,
+		stats.max_ms, stats.nOverBudget, stats.budget_ms);
+
+	GPUTimer::Stats gpu;
+	gpuTimer.GetStats(gpu);
+	TSTRING groups;
+	for (auto &g : gpu.groups)
+		groups += MsgFmt(_T(", %hs %.2fms"), g.name, g.avg_ms).Get();
+	LogFile::Get()->Write(_T("%s GPU times: %I64d frames, avg %.2fms, max %.2fms%s\n"),
+		configVarPrefix.c_str(), gpu.nFrames, gpu.avg_ms, gpu.max_ms, groups.c_str());
+
+	// log the input latency (global to all windows)
+	InputLatency::LogStats();
+}
+
 bool D3DView::OnCommand(int cmd, int source, HWND hwndControl)
 {
 	// run it by our command handler
@@ -437,6 +824,15 @@ bool D3DView::OnTimer(WPARAM timer, LPARAM callback)
 
 		// timer handled
 		return true;
+
+	case releaseSwapChainTimerID:
+		// this is a one-shot
+		KillTimer(hWnd, timer);
+
+		// if we're still hidden, release the swap chain
+		if (!IsWindowVisible(hWnd))
+			ReleaseSwapChain();
+		return true;
 	}
 
 	// use the default handling
@@ -500,47 +896,207 @@ void D3DView::MouseDragBegin(int button, POINT pt)
 	SetCapture(hWnd);
 }
 
+// performance overlay text color
+static const XMFLOAT4 perfTextColor = { 1.0f, 0.6f, 0.0f, 1.0f };
+
 // Update the text display
 void D3DView::UpdateText()
 {
 	// clear old text
 	textDraw->Clear();
 
-	// starting x and y offset
-	float x = 10;
-	float y = 10;
-	float lineHeight = dmdFont->GetLineHeight();
-
-	// add the FPS display
+	// add the performance overlay
 	if (fpsDisplay)
 	{
-		XMFLOAT4 color = { 1.0f, 0.6f, 0.0f, 1.0f };
+		// starting x and y offset
+		float x = 10;
+		float y = 10;
 
-		// format the text
+		// add the page header and the FPS counters, which we show on every page
+		static const TCHAR *const pageNames[] = { _T("Frame"), _T("Media"), _T("Caches") };
+		static_assert(countof(pageNames) == NPerfPages, "page name list doesn't match the PerfPage enum");
 		TCHAR buf[256];
-		_stprintf_s(buf, _T("FPS Cur %.2f, Avg %.2f"), fpsCur, fpsAvg);
-
-		// add it
-		textDraw->Add(buf, dmdFont, color, x, y, 0);
-		y += lineHeight;
+		_stprintf_s(buf, _T("FPS Cur %.2f, Avg %.2f | Page %d/%d: %s"),
+			fpsCur, fpsAvg, perfPage + 1, static_cast<int>(NPerfPages), pageNames[perfPage]);
+		AddPerfLine(buf, x, y);
 
-		// add the cpu display
-		PerfMon::CPUMetrics cpuMetrics;
-		if (perfMon.GetCPUMetrics(cpuMetrics))
+		// add the page contents
+		switch (perfPage)
 		{
-			TCHAR *p = buf + _stprintf_s(
-				buf, _T("CPU: %3d%% | Cores: "), cpuMetrics.cpuLoad);
-			for (int i = 0; i < cpuMetrics.nCpus; ++i)
-			{
-				p += _stprintf_s(p, buf + countof(buf) - p, _T("%3d%%  "),
-					cpuMetrics.coreLoad[i]);
-			}
-			textDraw->Add(buf, dmdFont, color, x, y, 0);
-			y += lineHeight;
+		case PerfPageFrame:
+			AddPerfFramePage(x, y);
+			break;
+
+		case PerfPageMedia:
+			AddPerfMediaPage(x, y);
+			break;
+
+		case PerfPageCaches:
+			AddPerfCachePage(x, y);
+			break;
 		}
 	}
 }
 
+void D3DView::AddPerfLine(const TCHAR *txt, float x, float &y)
+{
+	textDraw->Add(txt, dmdFont, perfTextColor, x, y, 0);
+	y += dmdFont->GetLineHeight();
+}
+
+void D3DView::AddPerfFramePage(float x, float &y)
+{
+	TCHAR buf[256];
+	float lineHeight = dmdFont->GetLineHeight();
+
+	// add the frame time statistics
+	PerfMon::FrameTimeStats ft;
+	perfMon.GetFrameTimeStats(ft);
+	_stprintf_s(buf, _T("Frame ms: p50 %.1f, p95 %.1f, p99 %.1f, max %.1f | Over %.1fms: %I64d/%I64d"),
+		ft.p50_ms, ft.p95_ms, ft.p99_ms, ft.max_ms, ft.budget_ms, ft.nOverBudget, ft.nFrames);
+	AddPerfLine(buf, x, y);
+
+	// Add the frame time graph.  We plot each recent frame as a dash at
+	// its frame time, with a dotted line at the frame time budget.  The
+	// vertical scale is twice the budget, extended as needed to fit the
+	// longest frame in the graph.
+	float times[PerfMon::nRecentFrameTimes];
+	int nTimes = perfMon.GetRecentFrameTimes(times, countof(times));
+	float scale_ms = ft.budget_ms * 2.0f;
+	for (int i = 0; i < nTimes; ++i)
+		scale_ms = max(scale_ms, times[i]);
+
+	const float graphHeight = lineHeight * 6.0f;
+	const float xStep = 4.0f;
+	float yTop = y + lineHeight/2.0f;
+	float yBottom = yTop + graphHeight;
+	auto GraphY = [yTop, yBottom, scale_ms](float ms) { return yBottom - (yBottom - yTop) * ms / scale_ms; };
+
+	_stprintf_s(buf, _T("%.0f ms"), scale_ms);
+	textDraw->Add(buf, dmdFont, perfTextColor, x, yTop - lineHeight/2.0f, 0);
+	const XMFLOAT4 budgetColor = { 0.6f, 0.6f, 0.6f, 1.0f };
+	const XMFLOAT4 overColor = { 1.0f, 0.2f, 0.2f, 1.0f };
+	float xGraph = x + 80.0f;
+	for (float xb = xGraph; xb < xGraph + PerfMon::nRecentFrameTimes * xStep; xb += xStep * 4.0f)
+		textDraw->Add(_T("."), dmdFont, budgetColor, xb, GraphY(ft.budget_ms) - lineHeight/2.0f, 0);
+	for (int i = 0; i < nTimes; ++i)
+	{
+		textDraw->Add(_T("-"), dmdFont, times[i] > ft.budget_ms ? overColor : perfTextColor,
+			xGraph + i * xStep, GraphY(times[i]) - lineHeight/2.0f, 0);
+	}
+	y = yBottom + lineHeight/2.0f;
+
+	// add the cpu display
+	PerfMon::CPUMetrics cpuMetrics;
+	if (perfMon.GetCPUMetrics(cpuMetrics))
+	{
+		TCHAR *p = buf + _stprintf_s(buf, _T("CPU: %3d%% | Cores: "), cpuMetrics.cpuLoad);
+		for (int i = 0; i < cpuMetrics.nCpus; ++i)
+			p += _stprintf_s(p, buf + countof(buf) - p, _T("%3d%%  "), cpuMetrics.coreLoad[i]);
+		AddPerfLine(buf, x, y);
+	}
+
+	// add the GPU timing, with the breakdown by shader type
+	GPUTimer::Stats gpu;
+	gpuTimer.GetStats(gpu);
+	TCHAR *p = buf + _stprintf_s(buf, _T("GPU ms: avg %.2f, max %.2f"), gpu.avg_ms, gpu.max_ms);
+	for (auto &g : gpu.groups)
+	{
+		if (p < buf + countof(buf) - 64)
+			p += _stprintf_s(p, buf + countof(buf) - p, _T(" | %hs %.2f"), g.name, g.avg_ms);
+	}
+	AddPerfLine(buf, x, y);
+
+	// add the pipeline state call counters (these are global to all windows)
+	const D3D::StateStats &ss = D3D::Get()->GetStateStats();
+	UINT64 totalCalls = ss.issued + ss.elided;
+	_stprintf_s(buf, _T("D3D state calls: %I64u issued, %I64u elided (%d%%)"),
+		ss.issued, ss.elided, totalCalls != 0 ? int(ss.elided * 100 / totalCalls) : 0);
+	AddPerfLine(buf, x, y);
+
+	// add the input latency, with the p95 times by stage (also global to all windows)
+	InputLatency::Stats il;
+	InputLatency::GetStats(il);
+	_stprintf_s(buf, _T("Input ms: p50 %.1f, p95 %.1f, p99 %.1f, max %.1f | p95 queue %.1f, cmd %.1f, media %.1f, render %.1f | %d presses"),
+		il.p50_ms, il.p95_ms, il.p99_ms, il.max_ms,
+		il.queue.p95_ms, il.command.p95_ms, il.media.p95_ms, il.render.p95_ms, il.nSamples);
+	AddPerfLine(buf, x, y);
+}
+
+void D3DView::AddPerfMediaPage(float x, float &y)
+{
+	TCHAR buf[256];
+
+	// add the texture memory use, against the budget (global to all windows)
+	auto MB = [](INT64 bytes) { return static_cast<double>(bytes) / (1024.0 * 1024.0); };
+	if (INT64 budget = TextureBudget::GetBudget(); budget != 0)
+	{
+		_stprintf_s(buf, _T("VRAM: %.1f MB in %ld textures, budget %.1f MB"),
+			MB(TextureBudget::GetTotalBytes()), TextureBudget::GetTextureCount(), MB(budget));
+	}
+	else
+	{
+		_stprintf_s(buf, _T("VRAM: %.1f MB in %ld textures, no budget"),
+			MB(TextureBudget::GetTotalBytes()), TextureBudget::GetTextureCount());
+	}
+	AddPerfLine(buf, x, y);
+
+	// add the memory usage breakdown by subsystem (also global to all windows)
+	MemoryStats::Snapshot ms;
+	MemoryStats::GetSnapshot(ms);
+	AddPerfLine(MemoryStats::Format(ms).c_str(), x, y);
+
+	// add the video startup times (also global to all windows)
+	VLCAudioVideoPlayer::StartupStats vs;
+	VLCAudioVideoPlayer::GetStartupStats(vs);
+	_stprintf_s(buf, _T("Video start ms: last %.1f, avg %.1f, max %.1f | %I64u videos, %I64u pooled"),
+		vs.last_ms, vs.avg_ms, vs.max_ms, vs.nVideos, vs.nPooled);
+	AddPerfLine(buf, x, y);
+
+	// add the active video players, with their frame counts
+	std::vector<VLCAudioVideoPlayer::PlaybackStats> ps;
+	VLCAudioVideoPlayer::GetPlaybackStats(ps);
+	_stprintf_s(buf, _T("Video players: %d playing"), static_cast<int>(ps.size()));
+	AddPerfLine(buf, x, y);
+	const size_t maxPlayerLines = 10;
+	for (size_t i = 0; i < ps.size() && i < maxPlayerLines; ++i)
+	{
+		const TCHAR *name = _tcsrchr(ps[i].path.c_str(), '\\');
+		_stprintf_s(buf, _T("  %.60s: %I64u decoded, %I64u dropped"),
+			name != nullptr ? name + 1 : ps[i].path.c_str(), ps[i].decoded, ps[i].dropped);
+		AddPerfLine(buf, x, y);
+	}
+	if (ps.size() > maxPlayerLines)
+	{
+		_stprintf_s(buf, _T("  (%d more)"), static_cast<int>(ps.size() - maxPlayerLines));
+		AddPerfLine(buf, x, y);
+	}
+}
+
+void D3DView::AddPerfCachePage(float x, float &y)
+{
+	// add a hit rate line for a cache (these are all global to all windows)
+	TCHAR buf[256];
+	auto CacheLine = [this, &buf, x, &y](const TCHAR *name, const CacheHitStats &s, bool enabled)
+	{
+		if (enabled)
+		{
+			_stprintf_s(buf, _T("%s: %d%% hits | %I64d hits, %I64d misses"),
+				name, s.GetHitRate(), static_cast<INT64>(s.hits), static_cast<INT64>(s.misses));
+		}
+		else
+			_stprintf_s(buf, _T("%s: disabled"), name);
+		AddPerfLine(buf, x, y);
+	};
+
+	CacheLine(_T("Media sprite cache (popups, instruction cards)"), SpriteCache::hitStats, true);
+	CacheLine(_T("Texture cache"), TextureCache::hitStats, TextureCache::enabled);
+	CacheLine(_T("Video poster frames"), TextureCache::posterHitStats, TextureCache::enabled && TextureCache::posterFrames);
+	CacheLine(_T("High score image cache"), HighScoreImageCache::hitStats, HighScoreImageCache::enabled);
+	CacheLine(_T("Global media lookups"), MediaFileIndex::lookupHitStats, MediaFileIndex::enabled);
+	CacheLine(_T("Font cache"), FontCache::hitStats, true);
+}
+
 void D3DView::UpdateMenu(HMENU hMenu, BaseWin *fromWin)
 {
 	// update FPS display
@@ -557,6 +1113,7 @@ void D3DView::OnResize(int width, int height)
 	__super::OnResize(width, height);
 
 	// update D3D resources with the new size
+	swapChainTrimmed = false;
 	if (d3dwin != 0)
 		d3dwin->ResizeWindow(width, height);
 
@@ -593,12 +1150,15 @@ void D3DView::OnResizeCameraView()
 	// Update the drawing list, to account for any changes in scaling
 	// for the new layout
 	ScaleSprites();
+
+	// the camera view has changed, so the window has to be redrawn
+	InvalidateRender();
 }
 
 void D3DView::RenderAll()
 {
 	for (auto it : activeD3DViews)
-		it->RenderFrame();
+		it->RenderFrameIfNeeded();
 }
 
 int D3DView::MessageLoop()
@@ -609,33 +1169,60 @@ int D3DView::MessageLoop()
 	// idle processing
 	DWORD lastIdleTime = GetTickCount();
 	int curRenderWinIndex = 0;
-	auto DoIdle = [&lastIdleTime, audioManager, &curRenderWinIndex](bool inForeground)
+	int idlePassesWithoutRender = 0;
+	auto DoIdle = [&lastIdleTime, audioManager, &curRenderWinIndex, &idlePassesWithoutRender](bool inForeground)
 	{
+		// If the D3D device has been lost, recover it before rendering
+		// anything else, since nothing will display until we do.
+		if (D3D::Get()->IsDeviceLost())
+			Application::Get()->RecoverD3DDevice();
+
 		// Do graphics rendering in one D3D view when the message queue is idle.
 		// We work through the windows round-robin on each idle pass.  We only
 		// render one window per idle pass so that we can get right back to the
 		// event loop, to minimize event processing latency.  We don't want key
 		// presses to feel laggy by forcing them to wait for every window to
 		// render.
-		int n = 0;
-		for (auto it : activeD3DViews)
+		//
+		// In multi-window pass mode, we continue around the round-robin list
+		// until every window has had a turn, but we stop as soon as any input
+		// arrives in our message queue.  That lets every window update on
+		// every pass while the user isn't doing anything, while still getting
+		// back to the event loop promptly when there's input to handle.
+		int nViews = (int)activeD3DViews.size();
+		int nPasses = multiWindowRenderPass || nViews == 0 ? nViews : 1;
+		for (int pass = 0; pass < nPasses; ++pass)
 		{
-			if (n++ == curRenderWinIndex)
+			// make sure the index is still in range, in case the window
+			// list has changed since the last pass
+			if (curRenderWinIndex >= nViews)
+				curRenderWinIndex = 0;
+
+			// find the current window
+			auto it = activeD3DViews.begin();
+			std::advance(it, curRenderWinIndex);
+
+			// advance to the next render window for the next pass
+			if (++curRenderWinIndex >= nViews)
+				curRenderWinIndex = 0;
+
+			// Render the frame, unless the application is in the background
+			// and this window has background rendering frozen.  Skip the
+			// frame if nothing in the window has changed since the last
+			// frame.
+			if ((inForeground || !(*it)->freezeBackgroundRendering) && (*it)->RenderFrameIfNeeded())
 			{
-				// Render the frame, unless the application is in the background
-				// and this window has background rendering frozen.
-				if (inForeground || !it->freezeBackgroundRendering)
-					it->RenderFrame();
+				// note that we rendered something on this round
+				idlePassesWithoutRender = 0;
 
-				// only render one window per idle pass
-				break;
+				// if input is waiting, go back to the event loop to handle it
+				if (HIWORD(GetQueueStatus(QS_INPUT)) != 0)
+					break;
 			}
+			else
+				++idlePassesWithoutRender;
 		}
 
-		// advance to the next render window for the next pass
-		if (++curRenderWinIndex >= (int)activeD3DViews.size())
-			curRenderWinIndex = 0;
-
 		// call idle event subscribers
 		for (auto it = idleEventSubscribers.begin(); it != idleEventSubscribers.end(); )
 		{
@@ -656,13 +1243,50 @@ int D3DView::MessageLoop()
 		// Update the audio engine
 		audioManager->Update();
 
+		// release cached textures if we're over the texture memory budget
+		TextureBudget::Enforce();
+
 		// reset the idle timer
 		lastIdleTime = GetTickCount();
+
+		// If we've gone a full round of the windows without finding
+		// anything to render, everything on screen is up to date.  Rather
+		// than spinning through the idle loop, wait briefly for a message
+		// to arrive, so that a set of static windows doesn't keep a CPU
+		// core busy.  Keep the wait short, since a new video frame or
+		// animation step could come due at any time.
+		//
+		// In low-power mode, every window is capped at the low-power rate,
+		// so we can sleep until the next window's frame comes due instead,
+		// or for one low-power frame interval if a window is due but had
+		// nothing new to draw.  That keeps the CPU in its idle states
+		// between frames, which is where the power savings come from.
+		if (idlePassesWithoutRender >= (int)activeD3DViews.size())
+		{
+			DWORD wait = 1;
+			if (lowPowerFrameRate != 0)
+			{
+				wait = max(1000 / lowPowerFrameRate, 1);
+				for (auto v : activeD3DViews)
+				{
+					if (DWORD t = v->GetTimeToNextFrame_ms(); t != 0 && !IsIconic(v->hWnd) && IsWindowVisible(v->hWnd))
+						wait = min(wait, t);
+				}
+			}
+			// With presentation threads, also wake up when a window's swap
+			// chain frees up for its next frame.
+			HANDLE hFrameReady = D3DWin::GetFrameReadyEvent();
+			MsgWaitForMultipleObjectsEx(hFrameReady != NULL ? 1 : 0, &hFrameReady, wait, QS_ALLINPUT, MWMO_INPUTAVAILABLE);
+			idlePassesWithoutRender = 0;
+		}
 	};
 
 	// loop until we get an application Quit message or the window closes
 	for (;;)
 	{
+		// let the watchdog know that the UI thread is still alive
+		Application::Heartbeat();
+
 		// Force a render pass if it's been too long
 		if (GetTickCount() > lastIdleTime + 100)
 			DoIdle(Application::IsInForeground());
@@ -21,6 +21,7 @@ class Sprite;
 #include "Camera.h"
 #include "TextDraw.h"
 #include "PerfMon.h"
+#include "GPUTimer.h"
 #include "BaseWin.h"
 #include "ViewWin.h"
 
@@ -35,6 +36,66 @@ public:
 	// render a frame
 	void RenderFrame();
 
+	// Render a frame if anything has changed since the last frame.
+	// Returns true if we rendered, false if we skipped the frame
+	// because the window contents are already up to date.  Does a
+	// full render on every call if damage tracking is disabled.
+	bool RenderFrameIfNeeded();
+
+	// Trim the swap chain.  While background rendering is frozen for a
+	// running game, this shrinks the swap chain buffers to the minimum
+	// size, to release their video memory to the game.  The next frame
+	// we render restores the full size.  This has no effect if
+	// background rendering isn't frozen.
+	void TrimSwapChain();
+
+	// Start or cancel the timer that releases the swap chain while the
+	// window is hidden.  Views that defer their swap chain (see
+	// deferSwapChain) call this when the frame window is shown or
+	// hidden.  The next frame after the window is shown again creates
+	// a new swap chain.
+	void UpdateSwapChainReleaseTimer(bool show);
+
+	// Mark the view as needing a redraw on the next render pass.  Most
+	// changes are detected automatically through the sprite list, but
+	// this can be used for changes that the sprites can't see, such as
+	// camera or layout changes.
+	void InvalidateRender() { renderNeeded = true; }
+
+	// Check which video adapter drives the window's monitor, and log a
+	// warning if it's not the adapter we render on, since every frame
+	// then has to be copied across adapters.  This only does the check
+	// when the window has moved to a different monitor since the last
+	// check.  The frame window calls this when it moves.
+	void CheckRenderAdapter();
+
+	// Global damage tracking setting.  When enabled, the idle loop only
+	// renders views where something has changed since the last frame,
+	// so windows showing still images don't redraw continuously.
+	static bool damageTracking;
+
+	// Global multi-window render pass setting.  When enabled, each idle
+	// pass of the message loop renders every window that needs updating,
+	// rather than just one window, stopping early if input arrives.
+	static bool multiWindowRenderPass;
+
+	// Global delay, in seconds, before releasing the swap chain of a
+	// hidden window (for views that defer their swap chains).  Zero
+	// keeps the swap chain for the whole session.
+	static int hiddenSwapChainReleaseDelay;
+
+	// Reload the per-window frame rate settings for all active views.
+	// This is called when the configuration changes.
+	static void ReloadFrameRateConfig();
+
+	// Set the global low-power frame rate.  When non-zero, this caps the
+	// frame rate of every window, on top of the per-window limits, and
+	// lets the idle loop sleep until the next frame is due rather than
+	// polling.  The playfield view sets this during the quiet stretches
+	// of attract mode; zero restores the normal limits.
+	static void SetLowPowerFrameRate(int fps) { lowPowerFrameRate = fps; }
+	static int GetLowPowerFrameRate() { return lowPowerFrameRate; }
+
 	// get/set monitor rotation in degrees
 	int GetRotation() const { return camera->GetMonitorRotation(); }
 	void SetRotation(int rotation);
@@ -53,12 +114,39 @@ public:
 	// Render all D3D windows.  This can be explicitly called in nested
 	// message loops (e.g., WM_ENTERIDLE) to continue rendering if
 	// desired.  If this isn't called, D3D views will freeze at the 
-	// last frame before the nested loop was entered.
+	// last frame before the nested loop was entered.  Windows with
+	// no changes since their last frame are skipped.
 	static void RenderAll();
 
-	// Toggle the frame counter display
+	// D3D device recovery.  When the D3D device is lost, the application
+	// releases the device resources of every view, replaces the device
+	// (see D3D::RecreateDevice()), and then restores the views on the
+	// new device.  Restoring returns false if any view fails.
+	static void ReleaseAllDeviceResources();
+	static bool RestoreAllDeviceResources();
+
+	// Toggle the frame counter display.  This cycles through the pages
+	// of the performance overlay, then turns the overlay off.  Turning
+	// on the display resets the frame time statistics, and turning it
+	// off writes the statistics gathered while it was displayed to the
+	// log file.
 	void ToggleFrameCounter();
 
+	// Write the CPU and GPU frame time statistics to the log file
+	void LogFrameTimeStats();
+
+	// Performance statistics, for the Javascript perf API.  GetCurFPS()
+	// returns the frame rate over the last half second or so.
+	float GetCurFPS();
+	float GetRollingFPS() { return perfMon.GetRollingFPS(); }
+	void GetRecentFrameTimeStats(PerfMon::FrameTimeStats &stats) const { perfMon.GetRecentFrameTimeStats(stats); }
+	bool GetCPUMetrics(PerfMon::CPUMetrics &metrics) { return perfMon.GetCPUMetrics(metrics); }
+	int64_t GetFrameCount() const { return perfMon.GetFrameCount(); }
+
+	// get the config variable prefix, which also serves as the window's
+	// name in the performance reports
+	const TCHAR *GetConfigVarPrefix() const { return configVarPrefix.c_str(); }
+
 	// Idle event subscriber
 	class IdleEventSubscriber
 	{
@@ -107,6 +195,36 @@ protected:
 	// update the text overlay
 	void UpdateText();
 
+	// Add the performance overlay pages to the text overlay.  'y' is the
+	// position for the next line of text, and is updated on return.
+	void AddPerfFramePage(float x, float &y);
+	void AddPerfMediaPage(float x, float &y);
+	void AddPerfCachePage(float x, float &y);
+
+	// add a line of text to the performance overlay
+	void AddPerfLine(const TCHAR *txt, float x, float &y);
+
+	// Check if anything has changed since the last frame that would
+	// require rendering a new frame
+	bool IsRenderNeeded() const;
+
+	// Animation frame hook.  RenderFrame() calls this at the start of
+	// each frame while an animation is running (see StartAnimationFrames),
+	// with the animation clock latched at the frame time (see AnimClock.h),
+	// so that the subclass can update its animation state for the frame
+	// about to be drawn.  Returns true if the animation is still running.
+	virtual bool OnAnimationFrame() { return false; }
+
+	// Start running animation frames.  This renders the window on every
+	// frame, calling OnAnimationFrame() before each one, until the hook
+	// reports that the animation is finished.  Animations should also
+	// keep a slow WM_TIMER going as a fallback, since nothing renders
+	// while the window is hidden or minimized.
+	void StartAnimationFrames() { animating = true; renderNeeded = true; }
+
+	// is an animation running?
+	bool animating = false;
+
 	// Scale a sprite according to the window size.  'span' is the fraction
 	// of the window's width and/or height to fill, where 1.0 means we scale
 	// the sprite to exactly fill the width or height.  
@@ -185,6 +303,7 @@ protected:
 
 	// Timer IDs
 	static const int fpsTimerID = 1;	// performance overlay timer
+	static const int releaseSwapChainTimerID = 2;  // release the swap chain while hidden
 
 	// Window layout area.  This is the client area, rotated as needed to
 	// match the camera orientation.  So if we're rotated 90 or 270 degrees,
@@ -192,9 +311,40 @@ protected:
 	// height.
 	SIZE szLayout;
 
-	// Direct3D window interface
+	// Direct3D window interface.  This is null until the swap chain is
+	// created, which for a deferred view isn't until the first frame.
 	D3DWin *d3dwin;
 
+	// Create the swap chain, if we haven't already.  Returns false if
+	// creation fails; we only try once, so that a failure doesn't
+	// repeat the error on every frame.
+	bool CreateSwapChain();
+
+	// Release the swap chain and its D3D resources
+	void ReleaseSwapChain();
+
+	// Release and restore this view's device resources, for device
+	// recovery.  Sprite textures don't need to be released here, since
+	// each sprite discards textures from an old device on its own on
+	// the next render; but subclasses that keep sprites or other device
+	// objects outside of the drawing list should override these to
+	// release them and reload them, calling the base class versions.
+	// The swap chain is re-created on the next frame.
+	virtual void ReleaseDeviceResources();
+	virtual bool RestoreDeviceResources();
+
+	// Defer swap chain creation until the first frame.  Subclasses set
+	// this for windows that are often hidden, such as the topper or the
+	// DMD on setups with a real DMD, so that a window that's never shown
+	// doesn't cost us the startup time or the video memory.
+	bool deferSwapChain = false;
+
+	// did a swap chain creation attempt fail?
+	bool swapChainFailed = false;
+
+	// monitor at the last CheckRenderAdapter() test
+	HMONITOR adapterCheckMonitor = NULL;
+
 	// Freeze background rendering.  When a game is running, and this 
 	// window is showing a blank background or a static image, we can
 	// freeze updates when we're in the background to minimize the
@@ -203,6 +353,9 @@ protected:
 	// frames as usual.
 	bool freezeBackgroundRendering = false;
 
+	// Have we trimmed the swap chain buffers (see TrimSwapChain())?
+	bool swapChainTrimmed = false;
+
 	// D3D camera
 	Camera *camera;
 
@@ -213,6 +366,51 @@ protected:
 	// Sprite list in drawing order
 	std::list<RefPtr<Sprite>> sprites;
 
+	// Damage tracking state.  renderNeeded is an explicit request for
+	// a new frame, for changes outside of the sprite list.  The last
+	// rendered sprite list lets us detect additions, removals, and
+	// reordering in the drawing list without having to intercept every
+	// subclass update; the pointers are for comparison only.  We also
+	// force a refresh at a low rate as a backstop, in case something
+	// changes through a path the tracking doesn't see.
+	bool renderNeeded = true;
+	DWORD lastRenderTime = 0;
+	std::vector<const Sprite*> lastRenderedSprites;
+	static const DWORD maxRenderInterval = 1000;
+
+	// Frame rate limits.  maxFrameRate is the maximum rate, in frames
+	// per second, at which the idle loop renders this window, or zero
+	// for no limit.  If adaptiveFrameRate is set, we further limit the
+	// rate to adaptiveIdleFrameRate whenever the drawing list contains
+	// only still images, and return to the full rate as soon as a video,
+	// animation, or fade starts.  These are loaded from the window's
+	// config variables.
+	int maxFrameRate = 0;
+	bool adaptiveFrameRate = false;
+	static const int adaptiveIdleFrameRate = 10;
+
+	// time of the last frame, for the frame rate limits
+	HiResTimer frameRateTimer;
+	int64_t lastFrameTicks = 0;
+
+	// load the frame rate settings from the config
+	void LoadFrameRateConfig();
+
+	// global low-power frame rate cap, or zero for none
+	static int lowPowerFrameRate;
+
+	// Get the current frame rate limit for this window, taking into
+	// account the fixed, adaptive, and low-power limits.  Zero means
+	// no limit.
+	int GetFrameRateLimit() const;
+
+	// Is a new frame due under the frame rate limits?
+	bool IsFrameDue();
+
+	// Get the time until the next frame is due under the frame rate
+	// limits, in milliseconds; zero if it's due now or there's no limit
+	DWORD GetTimeToNextFrame_ms();
+
 	// add a sprite to the drawing list
 	inline void AddToDrawingList(Sprite *sprite) 
 	{ 
@@ -223,11 +421,25 @@ protected:
 	// performance monitor for this window
 	PerfMon perfMon;
 
+	// GPU timer for this window.  This is only active while the FPS
+	// display is showing.
+	GPUTimer gpuTimer;
+
 	// display the FPS counters?
 	bool fpsDisplay;
 
+	// Performance overlay pages.  Each window has its own page selection.
+	enum PerfPage
+	{
+		PerfPageFrame,      // frame times, CPU and GPU load, input latency
+		PerfPageMedia,      // texture memory, memory breakdown, video players
+		PerfPageCaches,     // cache hit rates
+		NPerfPages
+	};
+	int perfPage = PerfPageFrame;
+
 	// latest FPS statistics
-	float fpsCur, fpsAvg;
+	float fpsCur = 0.0f, fpsAvg = 0.0f;
 
 	// config variable prefix for this window's variables
 	TSTRING configVarPrefix;
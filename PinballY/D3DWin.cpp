@@ -7,19 +7,37 @@
 #include <Windows.h>
 #include <windowsx.h>
 #include <d3d11_1.h>
+#include <dxgi1_3.h>
 #include <DirectXMath.h>
 #include "D3D.h"
 #include "Resource.h"
 #include "D3DWin.h"
+#include "TextureBudget.h"
+#include "StartupTimeline.h"
 #include "shaders/FullScreenQuadShaderVS.h"
 
 // vertical sync mode
 int D3DWin::vsyncMode = 0;
 
+// flip model swap chains
+bool D3DWin::flipModel = false;
+
+// per-window presentation threads
+bool D3DWin::presentThreads = false;
+HANDLE D3DWin::hFrameReadyEvent = NULL;
+
 D3DWin::D3DWin()
 {
 	swapChain = 0;
 	swapChain1 = 0;
+	swapChainFlags = 0;
+	frameLatencyWaitable = NULL;
+	hPresentThread = NULL;
+	hPresentEvent = NULL;
+	hPresentedEvent = NULL;
+	hPresentQuitEvent = NULL;
+	frameReady = false;
+	presentPending = false;
 	renderTargetView = 0;
 	depthStencil = 0;
 	depthStencilView = 0;
@@ -36,9 +54,13 @@ D3DWin::~D3DWin()
 	// make sure I'm no longer the current window
 	D3D::Get()->UnsetWin(this);
 
+	// shut down the presentation thread before releasing the swap chain
+	StopPresentThread();
+
 	// release D3D objects
 	if (swapChain != 0) swapChain->Release();
 	if (swapChain1 != 0) swapChain1->Release();
+	if (frameLatencyWaitable != NULL) CloseHandle(frameLatencyWaitable);
 	if (renderTargetView != 0) renderTargetView->Release();
 	ReleaseTempRenderTargets();
 	if (depthStencil != 0) depthStencil->Release();
@@ -53,6 +75,7 @@ void D3DWin::ReleaseTempRenderTargets()
 
 bool D3DWin::Init(HWND hWnd)
 {
+	StartupTimeline::Phase phase("Swap chain setup");
 	HRESULT hr;
 	auto GenErr = [hr](const TCHAR *details) {
 		LogSysError(ErrorIconType::EIT_Error, LoadStringT(IDS_ERR_D3DINIT),
@@ -120,14 +143,52 @@ bool D3DWin::Init(HWND hWnd)
 		sd.SampleDesc.Count = 1;
 		sd.SampleDesc.Quality = 0;
 		sd.BufferUsage = DXGI_USAGE_RENDER_TARGET_OUTPUT;
-		sd.BufferCount = 1;
-		sd.SwapEffect = DXGI_SWAP_EFFECT_DISCARD;
 
-		// create the DX11.1 SwapChain1 interface; if that succeeds, query the
-		// base SwapChain interface from it as well
-		if (SUCCEEDED(hr = dxgiFactory2->CreateSwapChainForHwnd(device, hWnd, &sd, nullptr, nullptr, &swapChain1)))
+		// If flip model presentation is enabled, try creating a flip model
+		// swap chain with a frame latency waitable object.  FLIP_DISCARD
+		// requires Windows 10, so fall back on FLIP_SEQUENTIAL if that
+		// fails, and then on the bitblt model if neither is available.
+		hr = E_FAIL;
+		if (flipModel)
+		{
+			sd.BufferCount = 2;
+			sd.Flags = swapChainFlags = DXGI_SWAP_CHAIN_FLAG_FRAME_LATENCY_WAITABLE_OBJECT;
+			sd.SwapEffect = DXGI_SWAP_EFFECT_FLIP_DISCARD;
+			if (FAILED(hr = dxgiFactory2->CreateSwapChainForHwnd(device, hWnd, &sd, nullptr, nullptr, &swapChain1)))
+			{
+				sd.SwapEffect = DXGI_SWAP_EFFECT_FLIP_SEQUENTIAL;
+				hr = dxgiFactory2->CreateSwapChainForHwnd(device, hWnd, &sd, nullptr, nullptr, &swapChain1);
+			}
+		}
+
+		// if we didn't create a flip model swap chain, use the bitblt model
+		if (FAILED(hr))
+		{
+			sd.BufferCount = 1;
+			sd.Flags = swapChainFlags = 0;
+			sd.SwapEffect = DXGI_SWAP_EFFECT_DISCARD;
+			hr = dxgiFactory2->CreateSwapChainForHwnd(device, hWnd, &sd, nullptr, nullptr, &swapChain1);
+		}
+
+		// if we created the DX11.1 SwapChain1 interface, query the base 
+		// SwapChain interface from it as well
+		if (SUCCEEDED(hr))
 			hr = swapChain1->QueryInterface(__uuidof(IDXGISwapChain), reinterpret_cast<void**>(&swapChain));
 
+		// For a flip model swap chain, limit the frame queue to a single
+		// frame, and get the waitable object that tells us when the queue
+		// has room for the next frame.
+		if (SUCCEEDED(hr) && swapChainFlags != 0)
+		{
+			IDXGISwapChain2 *swapChain2 = nullptr;
+			if (SUCCEEDED(swapChain1->QueryInterface(__uuidof(IDXGISwapChain2), reinterpret_cast<void**>(&swapChain2))))
+			{
+				swapChain2->SetMaximumFrameLatency(1);
+				frameLatencyWaitable = swapChain2->GetFrameLatencyWaitableObject();
+				swapChain2->Release();
+			}
+		}
+
 		// done with the factory interface
 		dxgiFactory2->Release();
 	}
@@ -166,6 +227,13 @@ bool D3DWin::Init(HWND hWnd)
 	if (FAILED(hr = InitSwapChain(width, height, &errLoc)))
 		return GenErr(MsgFmt(_T("%s failed"), errLoc));
 
+	// Start the presentation thread if desired.  This requires a frame
+	// latency waitable object, since that's what lets the thread wait for
+	// the swap chain to have room before presenting, so that Present()
+	// itself doesn't block while holding the device context lock.
+	if (presentThreads && frameLatencyWaitable != NULL)
+		StartPresentThread();
+
 	return true;
 }
 
@@ -212,6 +280,7 @@ HRESULT D3DWin::InitSwapChain(int width, int height, const TCHAR **errLocation)
 		*errLocation = _T("Creating depth stencil");
 		return hr;
 	}
+	TextureBudget::Track(depthStencil);
 
 	// Create the depth stencil view
 	D3D11_DEPTH_STENCIL_VIEW_DESC descDSV;
@@ -300,14 +369,25 @@ void D3DWin::ResizeWindow(int width, int height)
 		depthStencilView = 0;
 	}
 
+	// make sure the presentation thread isn't holding a frame from the
+	// old buffers
+	WaitForPresent();
+
 	// hold the device context lock while performing DXGI operations
 	D3D::DeviceContextLocker context;
 
-	// preserve the existing buffer count and format
+	// preserve the existing buffer count and format; the flags have
+	// to match the ones we used to create the swap chain
 	if (swapChain != 0)
 	{
-		if (FAILED(hr = swapChain->ResizeBuffers(0, width, height, DXGI_FORMAT_UNKNOWN, 0)))
+		// If the device has been lost, leave it to the device recovery to
+		// rebuild the swap chain, rather than treating this as fatal.
+		if (FAILED(hr = swapChain->ResizeBuffers(0, width, height, DXGI_FORMAT_UNKNOWN, swapChainFlags)))
+		{
+			if (D3D::IsDeviceLostError(hr))
+				return D3D::Get()->OnDeviceLost(hr);
 			return GenErr(_T("Resizing swap chain buffers, error %lx"));
+		}
 
 		// re-create the swap chain objects
 		const TCHAR *errLoc;
@@ -320,8 +400,18 @@ void D3DWin::ResizeWindow(int width, int height)
 // Begin rendering a frame
 void D3DWin::BeginFrame()
 {
-	// clear the target view
+	// if the presentation thread still has the last frame, let it finish
+	WaitForPresent();
+
+	// Bind our render targets.  A flip model swap chain unbinds the
+	// back buffer from the device context on each Present(), so we have
+	// to re-bind it for each new frame, even if we're still the current
+	// D3D window.
 	D3D::DeviceContextLocker context;
+	context->OMSetRenderTargets(1, &renderTargetView, depthStencilView);
+	D3D::Get()->InvalidateShaderResourceCache();
+
+	// clear the target view
 	context->ClearRenderTargetView(renderTargetView, backgroundColor);
 
 	// clear the depth buffer
@@ -334,9 +424,132 @@ void D3DWin::BeginFrame()
 // End rendering a frame
 void D3DWin::EndFrame()
 {
+	// if we have a presentation thread, hand the frame off to it
+	if (hPresentThread != NULL)
+	{
+		frameReady = false;
+		presentPending = true;
+		SetEvent(hPresentEvent);
+		return;
+	}
+
 	// present the back buffer to the screen
 	D3D::DeviceContextLocker context;
-	swapChain->Present(vsyncMode, 0);
+	if (HRESULT hr = swapChain->Present(vsyncMode, 0); D3D::IsDeviceLostError(hr))
+		D3D::Get()->OnDeviceLost(hr);
+}
+
+// Wait for the swap chain to be ready for a new frame
+bool D3DWin::WaitForFrameReady(DWORD timeout)
+{
+	// with a presentation thread, the thread does the waiting
+	if (hPresentThread != NULL)
+		return frameReady;
+
+	// bitblt swap chains have no frame latency object, so they're always ready
+	if (frameLatencyWaitable == NULL)
+		return true;
+
+	// Wait for the frame latency object, or for user input to arrive.  If
+	// both are ready, the wait returns the lower index, so we'll consider
+	// the window ready whenever its object is signaled.
+	return MsgWaitForMultipleObjectsEx(1, &frameLatencyWaitable, timeout, QS_INPUT, MWMO_INPUTAVAILABLE) == WAIT_OBJECT_0;
+}
+
+void D3DWin::StartPresentThread()
+{
+	// create the shared frame ready event on first use
+	if (hFrameReadyEvent == NULL)
+		hFrameReadyEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
+
+	// create our events
+	hPresentEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
+	hPresentedEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
+	hPresentQuitEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+	if (hFrameReadyEvent == NULL || hPresentEvent == NULL || hPresentedEvent == NULL || hPresentQuitEvent == NULL)
+	{
+		StopPresentThread();
+		return;
+	}
+
+	// Start the thread.  If that fails, we'll simply present on the UI
+	// thread as usual.  Run it at raised priority, since it does almost
+	// no work, and the point is to present promptly when the swap chain
+	// frees up.
+	DWORD tid;
+	if ((hPresentThread = CreateThread(NULL, 0, &SPresentThreadMain, this, 0, &tid)) != NULL)
+		SetThreadPriority(hPresentThread, THREAD_PRIORITY_ABOVE_NORMAL);
+	else
+		StopPresentThread();
+}
+
+void D3DWin::StopPresentThread()
+{
+	// tell the thread to exit, and wait for it
+	if (hPresentThread != NULL)
+	{
+		SetEvent(hPresentQuitEvent);
+		WaitForSingleObject(hPresentThread, 5000);
+		CloseHandle(hPresentThread);
+		hPresentThread = NULL;
+	}
+
+	// close the events
+	auto Close = [](HANDLE &h) { if (h != NULL) { CloseHandle(h); h = NULL; } };
+	Close(hPresentEvent);
+	Close(hPresentedEvent);
+	Close(hPresentQuitEvent);
+
+	// we're back to presenting on the UI thread
+	frameReady = false;
+	presentPending = false;
+}
+
+void D3DWin::WaitForPresent()
+{
+	// Wait for the thread to present the last frame we handed off.  The
+	// thread only asks for a frame once the swap chain has room for it,
+	// so the Present() call itself doesn't wait for a vblank, and this
+	// should never take long.  Use a timeout anyway, so that a wedged
+	// driver can't hang the UI.
+	for (int tries = 0; hPresentThread != NULL && presentPending && tries < 10; ++tries)
+		WaitForSingleObject(hPresentedEvent, 10);
+}
+
+DWORD D3DWin::PresentThreadMain()
+{
+	for (;;)
+	{
+		// Wait for the swap chain to have room for a new frame.  This is
+		// the wait that can last until the monitor's next vblank, which is
+		// why it's here instead of on the UI thread.
+		HANDLE h1[] = { hPresentQuitEvent, frameLatencyWaitable };
+		if (WaitForMultipleObjects(2, h1, FALSE, INFINITE) != WAIT_OBJECT_0 + 1)
+			break;
+
+		// let the UI thread render the next frame, and wake its idle wait
+		frameReady = true;
+		SetEvent(hFrameReadyEvent);
+
+		// wait for the UI thread to hand off the frame
+		HANDLE h2[] = { hPresentQuitEvent, hPresentEvent };
+		if (WaitForMultipleObjects(2, h2, FALSE, INFINITE) != WAIT_OBJECT_0 + 1)
+			break;
+
+		// present it
+		{
+			D3D::DeviceContextLocker context;
+			if (HRESULT hr = swapChain->Present(vsyncMode, 0); D3D::IsDeviceLostError(hr))
+				D3D::Get()->OnDeviceLost(hr);
+		}
+
+		// let the UI thread know the buffer is free again
+		presentPending = false;
+		SetEvent(hPresentedEvent);
+	}
+
+	// done
+	return 0;
 }
 
 void D3DWin::RenderToWindow()
@@ -346,6 +559,7 @@ void D3DWin::RenderToWindow()
 	context->OMSetRenderTargets(
 		1, &renderTargetView,
 		D3D::Get()->GetUseStencil() ? depthStencilView : 0);
+	D3D::Get()->InvalidateShaderResourceCache();
 }
 
 void D3DWin::RenderToNull()
@@ -353,6 +567,7 @@ void D3DWin::RenderToNull()
 	bool useStencil = D3D::Get()->GetUseStencil();
 	D3D::DeviceContextLocker context;
 	context->OMSetRenderTargets(0, 0, useStencil ? depthStencilView : 0);
+	D3D::Get()->InvalidateShaderResourceCache();
 }
 
 void D3DWin::RenderToTemp(int n, float scale)
@@ -395,6 +610,9 @@ void D3DWin::RenderToTemp(int n, float scale)
 		ID3D11Texture2D *pTexture;
 		if (SUCCEEDED(device->CreateTexture2D(&textureDesc, NULL, &pTexture)))
 		{
+			// count it in the texture memory budget
+			TextureBudget::Track(pTexture);
+
 			// Create the render target view for the texture.  This is used to set
 			// the texture as the pixel output surface for a rendering pass.
 			D3D11_RENDER_TARGET_VIEW_DESC renderTargetViewDesc;
@@ -430,6 +648,7 @@ void D3DWin::RenderToTemp(int n, float scale)
 	context->OMSetRenderTargets(
 		1, &tempRenderTargets[n].renderTargetView,
 		useStencil ? depthStencilView : 0);
+	D3D::Get()->InvalidateShaderResourceCache();
 }
 
 // Set a temp buffer as shader input
@@ -438,8 +657,7 @@ void D3DWin::TempRenderTargetToShader(int shaderResourceIndex, int tempBufferInd
 	if (size_t(tempBufferIndex) < tempRenderTargets.size()
 		&& tempRenderTargets[tempBufferIndex].shaderResourceView != 0)
 	{
-		D3D::DeviceContextLocker context;
-		context->PSSetShaderResources(
+		D3D::Get()->PSSetShaderResources(
 			shaderResourceIndex,
 			1, &tempRenderTargets[tempBufferIndex].shaderResourceView);
 	}
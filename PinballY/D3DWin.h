@@ -33,6 +33,34 @@ public:
 	// vertical sync on each frame, so we'll throttle to the refresh rate.
 	static int vsyncMode;
 
+	// Global swap chain model setting.  If true, we create new window swap
+	// chains using the DXGI flip presentation model, with a frame latency
+	// waitable object, when the system supports it.  The flip model lets
+	// the window compositor use our back buffer directly instead of making
+	// a copy, which saves about a frame of latency.  Otherwise we use the
+	// older "bitblt" model.  This only affects windows created after the
+	// setting is changed.
+	static bool flipModel;
+
+	// Global presentation thread setting.  If true, each new window with
+	// a flip model swap chain presents its frames from its own thread,
+	// rather than calling Present() on the UI thread.  With vsync enabled,
+	// Present() and the frame latency wait can block until the monitor's
+	// next vertical blank, and with several windows on monitors with
+	// different refresh rates, a single thread waiting its turn for each
+	// monitor ends up running every window at the pace of the slowest
+	// one.  With a thread per window, the UI thread never waits for a
+	// vblank: it just skips a window until its thread reports that the
+	// swap chain is ready for the next frame.  Like flipModel, this only
+	// affects windows created after the setting is changed.
+	static bool presentThreads;
+
+	// Get the shared "frame ready" event.  Presentation threads signal
+	// this whenever a window becomes ready for a new frame, so that the
+	// message loop can include it in its idle wait.  This is null until
+	// the first presentation thread starts.
+	static HANDLE GetFrameReadyEvent() { return hFrameReadyEvent; }
+
 	// Initialize D3D resources.  Returns true on success,
 	// false on failure.
 	bool Init(HWND hwnd);
@@ -43,10 +71,23 @@ public:
 	// get the current screen size
 	SIZE GetViewPortSize() const { return viewPortSize; }
 
-	// Begin/end frame rendering
+	// Begin/end frame rendering.  With a presentation thread, EndFrame()
+	// just hands the frame off to the thread, and BeginFrame() waits for
+	// any prior hand-off to be presented before drawing into the buffer.
 	void BeginFrame();
 	void EndFrame();
 
+	// Wait for the swap chain to be ready for a new frame.  With a flip
+	// model swap chain, this waits on the frame latency object until the
+	// previous frame has been presented, so that we don't queue up frames
+	// ahead of the display.  The wait ends early if user input arrives,
+	// to avoid holding up input processing.  Returns true if the window
+	// is ready for a new frame, false if the wait timed out or was cut
+	// short by input.  Always returns true for bitblt swap chains.  With
+	// a presentation thread, this doesn't wait at all; it just checks
+	// whether the thread has found the swap chain ready.
+	bool WaitForFrameReady(DWORD timeout);
+
 	// Set the render target to the window
 	void RenderToWindow();
 
@@ -97,6 +138,44 @@ protected:
 	IDXGISwapChain *swapChain;
 	IDXGISwapChain1 *swapChain1;
 
+	// Swap chain creation flags.  ResizeBuffers() must be called with the
+	// same flags used to create the swap chain.
+	UINT swapChainFlags;
+
+	// Frame latency waitable object, for a flip model swap chain.  This
+	// is null if we're using a bitblt swap chain.
+	HANDLE frameLatencyWaitable;
+
+	// Start/stop the presentation thread
+	void StartPresentThread();
+	void StopPresentThread();
+
+	// wait for a frame handed off to the presentation thread to be presented
+	void WaitForPresent();
+
+	// presentation thread entrypoint
+	static DWORD WINAPI SPresentThreadMain(LPVOID param) { return static_cast<D3DWin*>(param)->PresentThreadMain(); }
+	DWORD PresentThreadMain();
+
+	// Presentation thread, and its events.  hPresentEvent tells the thread
+	// that a frame is ready to present; hPresentedEvent tells the UI thread
+	// that the thread has presented it; hPresentQuitEvent tells the thread
+	// to exit.  The thread handle is null if we're presenting on the UI
+	// thread.
+	HANDLE hPresentThread;
+	HANDLE hPresentEvent;
+	HANDLE hPresentedEvent;
+	HANDLE hPresentQuitEvent;
+
+	// Presentation thread status.  frameReady means that the swap chain
+	// has room for a new frame; presentPending means that EndFrame() has
+	// handed off a frame that the thread hasn't presented yet.
+	volatile bool frameReady;
+	volatile bool presentPending;
+
+	// shared frame ready event (see GetFrameReadyEvent())
+	static HANDLE hFrameReadyEvent;
+
 	// Window render target view.  This is used for rendering
 	// directly to the screen.
 	ID3D11RenderTargetView *renderTargetView;
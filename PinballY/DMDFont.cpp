@@ -13,6 +13,10 @@
 #include "DMDFonts/Font_CC_20px_az.h"
 
 
+// fixed DMD height and width
+const int dmdHeight = 32;
+const int dmdWidth = 128;
+
 // DMD Font class
 
 DMDFont::DMDFont(const BYTE *pix, int pixWidth, int cellHeight, const BYTE *charWidths, const int *charOffsets) :
@@ -22,6 +26,36 @@ DMDFont::DMDFont(const BYTE *pix, int pixWidth, int cellHeight, const BYTE *char
 	charWidths(charWidths),
 	charOffsets(charOffsets)
 {
+	// build the code point map
+	for (int c = 0; c < 128; ++c)
+	{
+		// if it's a lower-case character, and the font doesn't contain
+		// this character, use the upper-case glyph
+		int g = c;
+		if (g >= 'a' && g <= 'z' && charWidths[g - 32] == 0)
+			g = g - 'a' + 'A';
+
+		glyphIndex[c] = (g >= 32 && g <= 126 && charWidths[g - 32] != 0) ? static_cast<BYTE>(g - 32) : noGlyph;
+	}
+
+	// figure the packed glyph table size
+	size_t total = 0;
+	for (int i = 0; i < 95; ++i)
+		total += static_cast<size_t>(charWidths[i]) * cellHeight;
+
+	// pack the glyphs
+	glyphPix.reset(new BYTE[max(total, static_cast<size_t>(1))]);
+	BYTE *dst = glyphPix.get();
+	for (int i = 0; i < 95; ++i)
+	{
+		glyphOffset[i] = static_cast<int>(dst - glyphPix.get());
+		const BYTE *srcRow = pix + charOffsets[i];
+		for (int row = 0; row < cellHeight; ++row, srcRow += pixWidth)
+		{
+			for (int col = 0; col < charWidths[i]; ++col)
+				*dst++ = srcRow[col] & 0x0f;
+		}
+	}
 }
 
 DMDFont::~DMDFont()
@@ -37,70 +71,58 @@ SIZE DMDFont::MeasureString(const TCHAR *str) const
 	// add up the character widths
 	for (const TCHAR *p = str; *p != 0; ++p)
 	{
-		// get the next character
-		TCHAR c = *p;
-
-		// if it's a lower-case character, and the font doesn't contain
-		// this character, convert to upper-case
-		if (c >= 'a' && c <= 'z' && charWidths[c] == 0)
-			c = c - 'a' + 'A';
-
-		// if it's in range, add its width
-		if (c >= 32 && c <= 126)
-			s.cx += charWidths[c - 32];
+		if (BYTE g = GlyphIndex(*p); g != noGlyph)
+			s.cx += charWidths[g];
 	}
 
 	// return the tally
 	return s;
 }
 
-// fixed DMD height and width
-const int dmdHeight = 32;
-const int dmdWidth = 128;
+int DMDFont::LayoutString(const TCHAR *str, int x, Span *spans) const
+{
+	int n = 0;
+	for (const TCHAR *p = str; *p != 0 && x < dmdWidth; ++p)
+	{
+		// skip characters with no glyph
+		BYTE g = GlyphIndex(*p);
+		if (g == noGlyph)
+			continue;
+
+		// clip the glyph to the display, and add the visible part
+		int w = charWidths[g];
+		int x0 = max(x, 0), x1 = min(x + w, dmdWidth);
+		if (x1 > x0)
+			spans[n++] = { glyphPix.get() + glyphOffset[g] + (x0 - x), w, x0, x1 - x0 };
+
+		// advance past the glyph
+		x += w;
+	}
+
+	return n;
+}
 
 // draw in 32-bit RGBA, four bytes per pixel
 void DMDFont::DrawString32(const TCHAR *str, BYTE *dmdPix, int x, int y, const Color *colors) const
 {
-	// get a pointer to the starting row positions
-	BYTE *dstRow = dmdPix + (y*dmdWidth*4) + x*4;
-	const BYTE *srcRow = pix;
+	// lay out the string
+	Span spans[dmdWidth];
+	int nSpans = LayoutString(str, x, spans);
 
-	// work across each row
-	for (int row = 0, ycur = y; row < cellHeight; ++row, dstRow += dmdWidth*4, srcRow += pixWidth, ++ycur)
-	{
-		// start at the current row position
-		BYTE *dst = dstRow;
-		int xcur = x;
+	// clip the rows to the display
+	int row0 = max(0, -y), row1 = min(cellHeight, dmdHeight - y);
 
-		// visit each character
-		for (const TCHAR *p = str; *p != 0; ++p)
+	// draw each row
+	for (int row = row0; row < row1; ++row)
+	{
+		BYTE *dstRow = dmdPix + (y + row)*dmdWidth*4;
+		for (int i = 0; i < nSpans; ++i)
 		{
-			// get the next character
-			TCHAR c = *p;
-
-			// if it's a lower-case character, and the font doesn't contain
-			// this character, convert to upper-case
-			if (c >= 'a' && c <= 'z' && charWidths[c] == 0)
-				c = c - 'a' + 'A';
-
-			// if it's in range, draw it
-			if (c >= 32 && c <= 126)
-			{
-				// convert the character code point to a data index
-				c -= 32;
-
-				// get the first byte of this row of this character in the
-				// font data
-				const BYTE *src = srcRow + charOffsets[c];
-
-				// copy the pixels
-				for (int colRem = charWidths[c]; colRem != 0; --colRem, ++xcur, ++src, dst += 4)
-				{
-					// clip to 128x32
-					if (xcur >= 0 && xcur < dmdWidth && ycur >= 0 && ycur < dmdHeight)
-						memcpy(dst, &colors[*src & 0xf].c, 4);
-				}
-			}
+			const Span &s = spans[i];
+			const BYTE *src = s.src + row*s.stride;
+			BYTE *dst = dstRow + s.x*4;
+			for (int col = 0; col < s.width; ++col, dst += 4)
+				memcpy(dst, colors[src[col]].c, 4);
 		}
 	}
 }
@@ -108,46 +130,21 @@ void DMDFont::DrawString32(const TCHAR *str, BYTE *dmdPix, int x, int y, const C
 // draw in 4-bit grayscale, one byte per pixel
 void DMDFont::DrawString4(const TCHAR *str, BYTE *dmdPix, int x, int y) const
 {
-	// get a pointer to the starting row positions
-	BYTE *dstRow = dmdPix + (y*dmdWidth) + x;
-	const BYTE *srcRow = pix;
+	// lay out the string
+	Span spans[dmdWidth];
+	int nSpans = LayoutString(str, x, spans);
 
-	// work across each row
-	for (int row = 0, ycur = y; row < cellHeight; ++row, dstRow += dmdWidth, srcRow += pixWidth, ++ycur)
-	{
-		// start at the current row position
-		BYTE *dst = dstRow;
-		int xcur = x;
+	// clip the rows to the display
+	int row0 = max(0, -y), row1 = min(cellHeight, dmdHeight - y);
 
-		// visit each character
-		for (const TCHAR *p = str; *p != 0; ++p)
+	// copy each glyph row
+	for (int row = row0; row < row1; ++row)
+	{
+		BYTE *dstRow = dmdPix + (y + row)*dmdWidth;
+		for (int i = 0; i < nSpans; ++i)
 		{
-			// get the next character
-			TCHAR c = *p;
-
-			// if it's a lower-case character, and the font doesn't contain
-			// this character, convert to upper-case
-			if (c >= 'a' && c <= 'z' && charWidths[c] == 0)
-				c = c - 'a' + 'A';
-
-			// if it's in range, draw it
-			if (c >= 32 && c <= 126)
-			{
-				// convert the character code point to a data index
-				c -= 32;
-
-				// get the first byte of this row of this character in the
-				// font data
-				const BYTE *src = srcRow + charOffsets[c];
-
-				// copy the pixels
-				for (int colRem = charWidths[c]; colRem != 0; --colRem, ++xcur, ++dst, ++src)
-				{
-					// clip to 128x32
-					if (xcur >= 0 && xcur < dmdWidth && ycur >= 0 && ycur < dmdHeight)
-						*dst = *src & 0x0f;
-				}
-			}
+			const Span &s = spans[i];
+			memcpy(dstRow + s.x, s.src + row*s.stride, s.width);
 		}
 	}
 }
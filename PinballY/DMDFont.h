@@ -16,6 +16,7 @@
 // for details on how the font data sets are generated.
 
 #pragma once
+#include <memory>
 
 class DMDFont
 {
@@ -64,12 +65,14 @@ public:
 	// RGB values for grayscale values 0..15, where 0 is fully off and
 	// 15 is fully on.
 	//
-	// For efficiency, 
+	// For efficiency, the string is laid out and clipped once, and
+	// then drawn row by row from the packed glyph tables.
 	void DrawString32(const TCHAR *str, BYTE *pix, int x, int y, const Color *colors) const;
 
 	// Draw a string into a 128x32 pixel array, in 4-bit grayscale.
 	// Each pixel is represented by one byte.  We only store 4-bit
-	// values, so every byte written will have a value 0..15.
+	// values, so every byte written will have a value 0..15.  Each
+	// glyph row is a single block copy from the packed glyph tables.
 	void DrawString4(const TCHAR *str, BYTE *pix, int x, int y) const;
 
 	// cell height
@@ -92,6 +95,41 @@ public:
 
 	// character offsets, for ASCII code points 32..126
 	const int *charOffsets;
+
+protected:
+	// Glyph tables, built when the font is constructed.  glyphIndex[]
+	// maps each ASCII code point to its index in charWidths[], with
+	// lower-case letters that the font doesn't contain mapped to their
+	// upper-case equivalents, and code points with no glyph mapped to
+	// noGlyph.  glyphPix holds the glyph images packed one glyph at a
+	// time, each stored as cellHeight rows of charWidths[i] pixels,
+	// with the pixel values already masked to 4 bits.  glyphOffset[]
+	// gives the offset of each glyph's first pixel in glyphPix.
+	static const BYTE noGlyph = 0xFF;
+	BYTE glyphIndex[128];
+	std::unique_ptr<BYTE[]> glyphPix;
+	int glyphOffset[95];
+
+	// Laid-out glyph span, for drawing.  This is the visible part of
+	// one glyph after horizontal clipping: the glyph's first visible
+	// pixel in its top row, the glyph row stride, and the destination
+	// x position and width.
+	struct Span
+	{
+		const BYTE *src;
+		int stride;
+		int x;
+		int width;
+	};
+
+	// Lay out a string at the given x position, clipping to the DMD
+	// width.  Fills in spans[] and returns the number of spans.  There
+	// can be at most one span per column, so the array must have room
+	// for 128 entries.
+	int LayoutString(const TCHAR *str, int x, Span *spans) const;
+
+	// get the glyph index for a character, or noGlyph
+	BYTE GlyphIndex(TCHAR c) const { return c < 128 ? glyphIndex[c] : noGlyph; }
 };
 
 // predefined fonts
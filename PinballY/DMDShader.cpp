@@ -22,6 +22,13 @@ DMDShader::~DMDShader()
 {
 }
 
+void DMDShader::ReleaseDeviceObjects()
+{
+	cbAlpha = nullptr;
+	cbBgColor = nullptr;
+	__super::ReleaseDeviceObjects();
+}
+
 bool DMDShader::Init()
 {
 	D3D *d3d = D3D::Get();
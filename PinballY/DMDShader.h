@@ -38,6 +38,8 @@ public:
 	void SetBgColor(RGBQUAD color, BYTE alpha);
 
 protected:
+	void ReleaseDeviceObjects() override;
+
 	// alpha buffer type - must match the layout in TextureShaderPS.hlsl
 	struct AlphaBufferType
 	{
@@ -70,6 +70,9 @@ float4 main(PixelInputType input) : SV_TARGET
 	else
 		textureColor = (textureColor * (1.0f - r2 / 0.25f)) + (bkColor * r2 / 0.25f);
 
+	// premultiply the alpha, to match our blend state
+	textureColor.xyz *= textureColor.w;
+
 	// return the texture color
 	return textureColor;
 }
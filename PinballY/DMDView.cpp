@@ -63,6 +63,9 @@
 #include "MouseButtons.h"
 #include "VPinMAMEIfc.h"
 #include "DMDFont.h"
+#include "LoaderPool.h"
+#include "HighScoreImageCache.h"
+#include "MemoryStats.h"
 
 using namespace DirectX;
 
@@ -113,10 +116,30 @@ void DMDView::ClearMedia()
 	__super::ClearMedia();
 }
 
+void DMDView::UpdateHighScoreImageBytes()
+{
+	// add up the DIB sizes
+	INT64 bytes = 0;
+	for (auto &i : highScoreImages)
+	{
+		if (i.dibits != nullptr)
+		{
+			auto const &bmih = i.bmi.bmiHeader;
+			INT64 stride = ((bmih.biWidth * bmih.biBitCount + 31) / 32) * 4;
+			bytes += stride * abs(bmih.biHeight);
+		}
+	}
+
+	// apply the change to the statistics
+	MemoryStats::AddCPU(MemoryStats::DMDImages, bytes - highScoreImageBytes);
+	highScoreImageBytes = bytes;
+}
+
 void DMDView::ClearHighScoreImages()
 {
 	// clear the list
 	highScoreImages.clear();
+	UpdateHighScoreImageBytes();
 
 	// reset the list position pointer
 	highScorePos = highScoreImages.end();
@@ -532,7 +555,7 @@ struct HighScoreGraphicsGenThread
 		style(style)
 	{
 		// get the DMD view, if available
-		if (auto dmdview = Application::Get()->GetDMDView(); dmdview != nullptr)
+		if (dmdview = Application::Get()->GetDMDView(); dmdview != nullptr)
 		{
 			// count the thread
 			InterlockedIncrement(&dmdview->nHighScoreThreads);
@@ -559,7 +582,7 @@ struct HighScoreGraphicsGenThread
 	virtual ~HighScoreGraphicsGenThread()
 	{
 		// count the thread exist in the view object
-		if (auto dmdview = Application::Get()->GetDMDView(); dmdview != nullptr)
+		if (dmdview != nullptr)
 			InterlockedDecrement(&dmdview->nHighScoreThreads);
 	}
 
@@ -574,6 +597,28 @@ struct HighScoreGraphicsGenThread
 	// high score request sequence number
 	DWORD seqno;
 
+	// The DMD view, for the thread count and cancellation checks.  The
+	// view outlives the generator tasks, since it waits for them to
+	// finish before it's destroyed.
+	DMDView *dmdview = nullptr;
+
+	// Is this request superseded by a newer request?  This is set for
+	// the game high score requests, which are obsolete as soon as the
+	// selection moves to another game.
+	bool cancelOnNewRequest = false;
+
+	// Has this request been cancelled?  The renderers check this between
+	// slides, so that we stop as soon as possible after the user moves
+	// on to another game, rather than wasting CPU time on images that
+	// will just be discarded.  All requests are cancelled when the view
+	// is shutting down.
+	bool IsCancelled() const
+	{
+		return dmdview != nullptr
+			&& (dmdview->cancelHighScoreThreads
+				|| (cancelOnNewRequest && dmdview->pendingImageRequestSeqNo != seqno));
+	}
+
 	// VPinMAME 16-shade monochrome palette for generated dots; the 100%
 	// brightness entry is also used as the color for the simulated segments
 	// in the 16-segment alphanumeric display mode.
@@ -620,16 +665,120 @@ struct HighScoreGraphicsGenThread
 	// Generated images
 	std::list<HighScoreImage> images;
 
+	// High score image cache key, and whether to use the cache.  We
+	// only cache the game high score slides, not the one-off image
+	// requests from Javascript.
+	UINT64 cacheKey = 0;
+	bool useCache = false;
+
+	// Figure the cache key for the images.  This is a 64-bit FNV-1a
+	// hash of everything that goes into the rendering: the game, the
+	// slide text and timing, the style, fonts, and colors, and the
+	// image sizes.  Call this on the UI thread after populating the
+	// slide list.
+	void SetCacheKey(GameListItem *game, SIZE layoutSize)
+	{
+		UINT64 hash = 0xcbf29ce484222325ULL;
+		auto Mix = [&hash](const void *p, size_t len)
+		{
+			for (auto b = static_cast<const BYTE*>(p); len != 0; --len, ++b)
+				hash = (hash ^ *b) * 0x100000001b3ULL;
+		};
+		auto MixInt = [&Mix](INT64 i) { Mix(&i, sizeof(i)); };
+		auto MixStr = [&Mix](const TSTRING &s) { Mix(s.c_str(), (s.length() + 1) * sizeof(TCHAR)); };
+
+		// game and image size
+		MixStr(game->GetGameId());
+		MixInt(dmdWidth);
+		MixInt(dmdHeight);
+		MixInt(layoutSize.cx);
+		MixInt(layoutSize.cy);
+
+		// style, fonts, and colors
+		MixStr(style);
+		MixStr(fontName);
+		Mix(palette.color, sizeof(palette.color));
+		Mix(&bgColor, sizeof(bgColor));
+		MixInt(bgAlpha);
+		MixInt(alphanumOptions.slant);
+		for (auto l : { &alphanumOptions.lit, &alphanumOptions.glow1, &alphanumOptions.glow2, &alphanumOptions.unlit })
+		{
+			MixInt(l->color.GetValue());
+			MixInt(l->dilationx);
+			MixInt(l->dilationy);
+			MixInt(l->blur);
+		}
+		MixStr(ttHighScoreFont.family);
+		MixInt(ttHighScoreFont.ptSize);
+		MixInt(ttHighScoreFont.weight);
+		MixInt(ttHighScoreFont.italic);
+		MixInt(ttHighScoreTextColor);
+
+		// the TT background image, including its modification time, so
+		// that we notice if the user replaces it
+		MixStr(ttBkgImageFile);
+		WIN32_FILE_ATTRIBUTE_DATA attrs;
+		if (ttBkgImageFile.length() != 0 && GetFileAttributesEx(ttBkgImageFile.c_str(), GetFileExInfoStandard, &attrs))
+			Mix(&attrs.ftLastWriteTime, sizeof(attrs.ftLastWriteTime));
+
+		// the slides
+		for (auto &s : slides)
+		{
+			MixInt(s.displayTime);
+			MixInt(static_cast<INT64>(s.messages.size()));
+			for (auto &m : s.messages)
+				MixStr(m);
+		}
+
+		cacheKey = hash;
+		useCache = true;
+	}
+
+	// Convert the generated images to a cache entry
+	std::shared_ptr<const HighScoreImageCache::Entry> ToCacheEntry() const
+	{
+		auto entry = std::make_shared<HighScoreImageCache::Entry>();
+		for (auto &i : images)
+		{
+			// skip any image that didn't render
+			if (i.dibits == nullptr)
+				return nullptr;
+
+			auto &c = entry->emplace_back();
+			c.spriteType = i.spriteType;
+			c.displayTime = i.displayTime;
+			c.bgColor = i.bgColor;
+			c.bgAlpha = i.bgAlpha;
+			c.bmih = i.bmi.bmiHeader;
+			auto p = static_cast<const BYTE*>(i.dibits);
+			c.pix.assign(p, p + HighScoreImageCache::PixelBytes(i.bmi.bmiHeader));
+		}
+		return entry;
+	}
+
+	// Populate the image list from a cache entry
+	static void FromCacheEntry(const HighScoreImageCache::Entry &entry, std::list<HighScoreImage> &images)
+	{
+		for (auto &c : entry)
+		{
+			BITMAPINFO bmi;
+			ZeroMemory(&bmi, sizeof(bmi));
+			bmi.bmiHeader = c.bmih;
+			BYTE *pix = new BYTE[c.pix.size()];
+			memcpy(pix, c.pix.data(), c.pix.size());
+			images.emplace_back(static_cast<HighScoreImage::SpriteType>(c.spriteType), bmi, pix,
+				c.displayTime, c.bgColor, c.bgAlpha);
+		}
+	}
+
 	// launch the thread
 	void Launch()
 	{
 
-		// create the thread
-		DWORD tid;
-		HandleHolder hThread = CreateThread(NULL, 0, &HighScoreGraphicsGenThread::SMain, this, 0, &tid);
-		if (hThread == nullptr)
+		// queue the work on the loader pool
+		if (!LoaderPool::Submit([this]() { Main(); }))
 		{
-			// we couldn't launch the thread, so do the work inline instead
+			// we couldn't queue the task, so do the work inline instead
 			Main();
 		}
 	}
@@ -642,22 +791,46 @@ struct HighScoreGraphicsGenThread
 		// so make sure we delete the object on exiting the thread routine.
 		std::unique_ptr<HighScoreGraphicsGenThread> thisptr(this);
 
-		// create the graphics according to the style
-		if (_tcsicmp(style.c_str(), _T("alpha")) == 0)
-		{
-			// Alphanumeric segmented display style
-			RenderAlphanum();
-		}
-		else if (_tcsicmp(style.c_str(), _T("tt")) == 0)
+		// if the request was cancelled while it was queued, skip it
+		if (IsCancelled())
+			return 0;
+
+		// if the images are in the disk cache, use the cached copies
+		std::shared_ptr<const HighScoreImageCache::Entry> entry;
+		if (useCache && HighScoreImageCache::Load(cacheKey, entry))
 		{
-			// typewriter style
-			RenderTT();
+			FromCacheEntry(*entry, images);
 		}
 		else
 		{
-			// "Dots" style - this is also the default if the style setting
-			// isn't recognized
-			RenderDots();
+			// create the graphics according to the style
+			if (_tcsicmp(style.c_str(), _T("alpha")) == 0)
+			{
+				// Alphanumeric segmented display style
+				RenderAlphanum();
+			}
+			else if (_tcsicmp(style.c_str(), _T("tt")) == 0)
+			{
+				// typewriter style
+				RenderTT();
+			}
+			else
+			{
+				// "Dots" style - this is also the default if the style setting
+				// isn't recognized
+				RenderDots();
+			}
+
+			// if the request was cancelled, discard the partial results
+			if (IsCancelled())
+				return 0;
+
+			// add the images to the cache
+			if (useCache)
+			{
+				if (auto newEntry = ToCacheEntry(); newEntry != nullptr)
+					HighScoreImageCache::Add(cacheKey, newEntry);
+			}
 		}
 
 		// Send the sprite list back to the window
@@ -787,6 +960,10 @@ struct HighScoreGraphicsGenThread
 		// process each group
 		for (auto &group : slides)
 		{
+			// stop if the request has been cancelled
+			if (IsCancelled())
+				return;
+
 			// create the DIB buffer at 4 bytes per pixel
 			BYTE *pix = new BYTE[dmdWidth*dmdHeight * 4];
 
@@ -977,6 +1154,10 @@ struct HighScoreGraphicsGenThread
 		// draw the slides
 		for (auto &group : slides)
 		{
+			// stop if the request has been cancelled
+			if (IsCancelled())
+				return;
+
 			// create the image
 			DrawToImage(group, viewSize.cx, viewSize.cy, [this, &group, font, viewSize,
 				charCellWid, charCellHt, alphaGridWid, alphaGridHt, scale, x0, y0, &xform]
@@ -1157,6 +1338,10 @@ struct HighScoreGraphicsGenThread
 		// process each slide
 		for (auto &group : slides)
 		{
+			// stop if the request has been cancelled
+			if (IsCancelled())
+				return;
+
 			// Load the background image.  If we found a user media file, try loading
 			// that first.
 			std::unique_ptr<Gdiplus::Image> ttBkgImage;
@@ -1313,9 +1498,11 @@ void DMDView::GenerateHighScoreImages()
 		DMDPalette pal;
 		GetCurGameHighScoreColor(pal);
 
-		// create the high score thread
+		// create the high score thread; it's obsolete as soon as there's
+		// a newer request
 		HighScoreGraphicsGenThread *th = new HighScoreGraphicsGenThread(
 			this, pendingImageRequestSeqNo, pal, style);
+		th->cancelOnNewRequest = true;
 		
 		// capture the message list to the thread
 		game->DispHighScoreGroups([&th, &style](const std::list<const TSTRING*> &group)
@@ -1389,6 +1576,18 @@ void DMDView::GenerateHighScoreImages()
 		if (th->slides.size() == 1)
 			th->slides.begin()->displayTime += 2000;
 
+		// If we've already generated these images, use the cached copies,
+		// so that we don't have to run the generator again.
+		th->SetCacheKey(game, GetLayoutSize());
+		if (std::shared_ptr<const HighScoreImageCache::Entry> entry; HighScoreImageCache::Find(th->cacheKey, entry))
+		{
+			std::list<HighScoreImage> images;
+			HighScoreGraphicsGenThread::FromCacheEntry(*entry, images);
+			delete th;
+			SetHighScoreImages(pendingImageRequestSeqNo, &images);
+			return;
+		}
+
 		// launch the thread
 		th->Launch();
 	}
@@ -1698,6 +1897,11 @@ void DMDView::GetCurGameHighScoreColor(DMDPalette &pal, RGBQUAD *pTxtColor, RGBQ
 
 void DMDView::WaitForHighScoreThreads(DWORD timeout)
 {
+	// Cancel the outstanding requests.  Any that are still queued on the
+	// loader pool will exit as soon as they start, and running ones will
+	// stop at their next checkpoint.
+	cancelHighScoreThreads = true;
+
 	// get the starting time
 	DWORD t0 = GetTickCount();
 
@@ -1735,6 +1939,7 @@ void DMDView::SetHighScoreImages(DWORD seqno, std::list<HighScoreImage> *images)
 		// transfer the images to our high score list
 		for (auto &i : *images)
 			highScoreImages.emplace_back(i);
+		UpdateHighScoreImageBytes();
 
 		// set up at the end of the high score list, to indicate that we're
 		// not currently showing one of these images
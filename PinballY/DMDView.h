@@ -56,7 +56,9 @@ public:
 	static const DMDFont *PickHighScoreFont(const std::list<TSTRING> &group);
 	static const DMDFont *PickHighScoreFont(const std::list<const TSTRING*> &group);
 
-	// wait for high score image generator threads to exit
+	// Wait for the high score image generator tasks to exit.  This
+	// cancels any requests still outstanding, so it's for use when the
+	// view is shutting down.
 	void WaitForHighScoreThreads(DWORD timeout = INFINITE);
 
 	// enter/exit running game mode
@@ -243,7 +245,7 @@ public:
 
 protected:
 	// ConfigManager::Subscriber implementation
-	virtual void OnConfigReload() override { OnConfigChange(); }
+	virtual void OnConfigReload(const ConfigManager::ChangeSet &) override { OnConfigChange(); }
 
 	// update internal variables for a config change
 	void OnConfigChange();
@@ -279,6 +281,11 @@ protected:
 	// handle a change of background image
 	virtual void OnChangeBackgroundImage() override;
 
+	// Don't share the background video decoder with other windows.  We
+	// stop and restart the video around the high score slide show, which
+	// would interrupt the video in the other windows as well.
+	virtual bool CanShareBackgroundVideo() const override { return false; }
+
 	// add the main background image to the drawing list
 	virtual void AddBackgroundToDrawingList();
 
@@ -292,6 +299,11 @@ protected:
 	// clear out the high score images
 	void ClearHighScoreImages();
 
+	// Update the memory statistics for the high score image DIBs.  Call
+	// this after changing the high score image list.
+	void UpdateHighScoreImageBytes();
+	INT64 highScoreImageBytes = 0;
+
 	// get the "auto" high score style for the current game
 	const TCHAR *GetCurGameHighScoreStyle();
 
@@ -346,9 +358,12 @@ protected:
 	DWORD nextImageRequestSeqNo = 1;
 
 	// Sequence number of current outstanding image request
-	// in this window
-	DWORD pendingImageRequestSeqNo = 0;
+	// in this window.  The generator tasks read this to check if
+	// they've been superseded, so it's volatile.
+	volatile DWORD pendingImageRequestSeqNo = 0;
 
-	// Number of outstanding high score image generator threads
+	// Number of outstanding high score image generator tasks, and
+	// the flag to cancel all of them at shutdown
 	volatile DWORD nHighScoreThreads = 0;
+	volatile bool cancelHighScoreThreads = false;
 };
@@ -11,6 +11,7 @@
 #include "DiceCoefficient.h"
 #include "GameList.h"
 #include "LogFile.h"
+#include "StartupTimeline.h"
 
 #pragma comment(lib, "Propsys.lib")
 
@@ -52,6 +53,9 @@ void DOFClient::Init()
 			// retrieve the context
 			std::unique_ptr<ThreadContext> ctx(static_cast<ThreadContext*>(lpvParam));
 
+			// time it for the startup timeline
+			StartupTimeline::Phase phase("DOF init");
+
 			// log what we're doing
 			LogFile::Get()->Group(LogFile::DofLogging);
 			LogFile::Get()->Write(LogFile::DofLogging, _T("DOF (DirectOutput): initializing DOF client\n"));
@@ -225,6 +229,15 @@ DOFClient::DOFClient()
 
 DOFClient::~DOFClient()
 {
+	// Stop the dispatch thread.  Any states still queued are discarded,
+	// since we're about to shut down DOF anyway.
+	if (hDispatchThread != NULL)
+	{
+		dispatchExit = true;
+		SetEvent(hDispatchEvent);
+		WaitForSingleObject(hDispatchThread, 5000);
+	}
+
 	// if we initialized DOF, un-initialize it
 	if (ready && pDispatch != 0)
 	{
@@ -240,19 +253,45 @@ void DOFClient::SetNamedState(const WCHAR *name, int val)
 {
 	if (ready && pDispatch != nullptr)
 	{
-		// Invoke UpdateNamedTableElement(name, val)
-		// NB - Invoke() arguments are sent in reverse order
-		VARIANTEx argp[2];
-		InitVariantFromString(name, &argp[1]);		// state name
-		InitVariantFromInt32(val, &argp[0]);		// value
-		DISPPARAMS args = { argp, nullptr, countof(argp), 0 };
-		VARIANTEx result;
-		EXCEPINFOEx exc;
-		pDispatch->Invoke(dispidUpdateNamedTableElement, IID_NULL,
-			LOCALE_SYSTEM_DEFAULT, DISPATCH_METHOD, &args, &result, &exc, 0);
+		// if there's no dispatch thread, send the state directly
+		if (hDispatchThread == NULL)
+		{
+			InvokeSetNamedState(name, val);
+			return;
+		}
+
+		CriticalSectionLocker locker(dispatchLock);
+
+		// If there's already a state pending for this name, replace its
+		// value, unless that would turn a pending ON into an OFF.  Otherwise
+		// add a new entry at the end of the queue.
+		if (auto it = dispatchPending.find(name); it != dispatchPending.end() && (it->second->val == 0 || val != 0))
+			it->second->val = val;
+		else
+		{
+			dispatchQueue.emplace_back(name, val);
+			dispatchPending[name] = std::prev(dispatchQueue.end());
+		}
+
+		// wake up the dispatch thread
+		SetEvent(hDispatchEvent);
 	}
 }
 
+void DOFClient::InvokeSetNamedState(const WCHAR *name, int val)
+{
+	// Invoke UpdateNamedTableElement(name, val)
+	// NB - Invoke() arguments are sent in reverse order
+	VARIANTEx argp[2];
+	InitVariantFromString(name, &argp[1]);		// state name
+	InitVariantFromInt32(val, &argp[0]);		// value
+	DISPPARAMS args = { argp, nullptr, countof(argp), 0 };
+	VARIANTEx result;
+	EXCEPINFOEx exc;
+	pDispatch->Invoke(dispidUpdateNamedTableElement, IID_NULL,
+		LOCALE_SYSTEM_DEFAULT, DISPATCH_METHOD, &args, &result, &exc, 0);
+}
+
 // DOF COM object GUIDs
 static IID IID_Dof = { 0x63dc1112, 0x571f, 0x4a49, { 0xb2, 0xfd, 0xcf, 0x98, 0xc0, 0x2b, 0xf5, 0xd4 } };
 static IID IID_Events = { 0xa5ff940d, 0x41d4, 0x4dad, { 0x80, 0xaf, 0x46, 0x88, 0xe3, 0xf7, 0x37, 0xc1 } };
@@ -398,10 +437,61 @@ bool DOFClient::InitInst(ErrorHandler &eh)
 	// load the ROM table mapping file
 	LoadTableMap(eh);
 
+	// Start the named state dispatch thread.  If that fails, we'll just
+	// send the states directly.
+	if ((hDispatchEvent = CreateEvent(NULL, FALSE, FALSE, NULL)) != NULL)
+	{
+		DWORD tid;
+		hDispatchThread = CreateThread(NULL, 0, &DispatchThreadMain, this, 0, &tid);
+	}
+
 	// success
 	return true;
 }
 
+DWORD WINAPI DOFClient::DispatchThreadMain(LPVOID lParam)
+{
+	auto self = static_cast<DOFClient*>(lParam);
+
+	// initialize COM on this thread
+	CoInitializeEx(NULL, COINIT_APARTMENTTHREADED);
+
+	// process queued states until we're told to exit
+	while (!self->dispatchExit)
+	{
+		// wait for new states
+		WaitForSingleObject(self->hDispatchEvent, INFINITE);
+
+		// send the queued states
+		for (;;)
+		{
+			// take the next state off the queue
+			WSTRING name;
+			int val;
+			{
+				CriticalSectionLocker locker(self->dispatchLock);
+				if (self->dispatchExit || self->dispatchQueue.size() == 0)
+					break;
+
+				auto it = self->dispatchQueue.begin();
+				if (auto p = self->dispatchPending.find(it->name); p != self->dispatchPending.end() && p->second == it)
+					self->dispatchPending.erase(p);
+				name = std::move(it->name);
+				val = it->val;
+				self->dispatchQueue.pop_front();
+			}
+
+			// send it to DOF, outside of the lock, so that the UI thread can
+			// keep queueing states while DOF works
+			self->InvokeSetNamedState(name.c_str(), val);
+		}
+	}
+
+	// done
+	CoUninitialize();
+	return 0;
+}
+
 // Load the table mapping file
 using namespace rapidxml;
 void DOFClient::LoadTableMap(ErrorHandler &eh)
@@ -430,8 +520,13 @@ void DOFClient::LoadTableMap(ErrorHandler &eh)
 		}
 	}
 
-	// read the file
-	if (filename != _T(""))
+	// read the file, using the cached copy if it's current
+	if (filename != _T("") && LoadTableMapCache(filename.c_str()))
+	{
+		LogFile::Get()->Write(LogFile::DofLogging, _T("DOF: loaded table mappings from cache (%d entries)\n"),
+			static_cast<int>(titleRomList.size()));
+	}
+	else if (filename != _T(""))
 	{
 		// load the file into memory
 		long len = 0;
@@ -490,6 +585,7 @@ void DOFClient::LoadTableMap(ErrorHandler &eh)
 						// get the ROM name and add the mapping
 						TSTRING romName = AnsiToTSTRING(r->value());
 						titleRomList.emplace_back(tableName.c_str(), romName.c_str());
+						titleIndex.Add(SimplifiedTitle(tableName.c_str()).c_str());
 
 						// add this ROM to the list of known ROMs
 						TSTRING romKey = romName;
@@ -499,6 +595,12 @@ void DOFClient::LoadTableMap(ErrorHandler &eh)
 				}
 			}
 		}
+
+		// build the fuzzy-match index over the titles
+		titleIndex.Build();
+
+		// save the parsed map for next time
+		SaveTableMapCache(filename.c_str());
 	}
 
 	// Retrieve the pre-configured table element descriptors
@@ -633,6 +735,153 @@ const TCHAR *DOFClient::GetRomForTable(const GameListItem *game)
 	return rom;
 }
 
+// Table map cache file layout.  The header is followed by the mapping
+// file path, then by one record per title/ROM pair, each followed by
+// the title and ROM strings (without null terminators) and the title's
+// bigram codes.
+struct TableMapCacheFileHeader
+{
+	char signature[16];
+	UINT32 charSize;
+	UINT32 nEntries;
+	UINT64 srcSize;
+	FILETIME srcTime;
+	UINT32 pathLength;
+};
+struct TableMapCacheFileRecord
+{
+	UINT32 titleLength;
+	UINT32 romLength;
+	UINT32 nBigrams;
+};
+static const char tableMapCacheSignature[16] = "PBYDOFMap/1";
+
+void DOFClient::GetTableMapCacheFile(TCHAR path[MAX_PATH])
+{
+	GetDeployedFilePath(path, _T("DOFTableMapCache.dat"), _T(""));
+}
+
+bool DOFClient::LoadTableMapCache(const TCHAR *filename)
+{
+	// get the mapping file's size and modification time
+	WIN32_FILE_ATTRIBUTE_DATA attrs;
+	if (!GetFileAttributesEx(filename, GetFileExInfoStandard, &attrs))
+		return false;
+	UINT64 srcSize = (static_cast<UINT64>(attrs.nFileSizeHigh) << 32) | attrs.nFileSizeLow;
+
+	// open the cache file
+	TCHAR path[MAX_PATH];
+	GetTableMapCacheFile(path);
+	FILEPtrHolder fp;
+	if (_tfopen_s(&fp, path, _T("rb")) != 0)
+		return false;
+
+	// check the header against the mapping file
+	TableMapCacheFileHeader hdr;
+	if (fread(&hdr, sizeof(hdr), 1, fp) != 1
+		|| memcmp(hdr.signature, tableMapCacheSignature, sizeof(hdr.signature)) != 0
+		|| hdr.charSize != sizeof(TCHAR)
+		|| hdr.srcSize != srcSize
+		|| CompareFileTime(&hdr.srcTime, &attrs.ftLastWriteTime) != 0
+		|| hdr.pathLength >= 32768)
+		return false;
+
+	TSTRING srcPath(hdr.pathLength, 0);
+	if (fread(&srcPath[0], sizeof(TCHAR), hdr.pathLength, fp) != hdr.pathLength
+		|| _tcsicmp(srcPath.c_str(), filename) != 0)
+		return false;
+
+	// read the entries into temporary containers, so that a damaged
+	// file leaves the current map intact
+	std::vector<TitleRomPair> pairs;
+	DiceCoefficient::BigramIndex<TCHAR> index;
+	pairs.reserve(hdr.nEntries);
+	for (UINT32 i = 0; i < hdr.nEntries; ++i)
+	{
+		TableMapCacheFileRecord rec;
+		if (fread(&rec, sizeof(rec), 1, fp) != 1
+			|| rec.titleLength >= 32768 || rec.romLength >= 32768 || rec.nBigrams == 0 || rec.nBigrams >= 32768)
+			return false;
+
+		TSTRING title(rec.titleLength, 0), rom(rec.romLength, 0);
+		DiceCoefficient::PackedBigramSet<TCHAR> bigrams;
+		bigrams.resize(rec.nBigrams);
+		if ((rec.titleLength != 0 && fread(&title[0], sizeof(TCHAR), rec.titleLength, fp) != rec.titleLength)
+			|| (rec.romLength != 0 && fread(&rom[0], sizeof(TCHAR), rec.romLength, fp) != rec.romLength)
+			|| fread(bigrams.data(), sizeof(UINT32), rec.nBigrams, fp) != rec.nBigrams)
+			return false;
+
+		pairs.emplace_back(title.c_str(), rom.c_str());
+		index.Add(std::move(bigrams));
+	}
+
+	// success - install the map
+	titleRomList = std::move(pairs);
+	titleIndex = std::move(index);
+	titleIndex.Build();
+
+	// add the ROMs to the list of known ROMs
+	for (auto const &p : titleRomList)
+	{
+		TSTRING romKey = p.rom;
+		std::transform(romKey.begin(), romKey.end(), romKey.begin(), ::_totlower);
+		knownROMs[romKey] = p.rom;
+	}
+
+	return true;
+}
+
+void DOFClient::SaveTableMapCache(const TCHAR *filename)
+{
+	// get the mapping file's size and modification time
+	WIN32_FILE_ATTRIBUTE_DATA attrs;
+	if (!GetFileAttributesEx(filename, GetFileExInfoStandard, &attrs))
+		return;
+
+	// Write to a temporary file, then move it into place, so that a
+	// crash while writing can't leave a truncated cache file behind.
+	TCHAR path[MAX_PATH];
+	GetTableMapCacheFile(path);
+	TSTRING tmpFile = TSTRING(path) + _T(".tmp");
+	bool ok = false;
+	{
+		FILEPtrHolder fp;
+		if (_tfopen_s(&fp, tmpFile.c_str(), _T("wb")) == 0)
+		{
+			TableMapCacheFileHeader hdr;
+			memcpy(hdr.signature, tableMapCacheSignature, sizeof(hdr.signature));
+			hdr.charSize = sizeof(TCHAR);
+			hdr.nEntries = static_cast<UINT32>(titleRomList.size());
+			hdr.srcSize = (static_cast<UINT64>(attrs.nFileSizeHigh) << 32) | attrs.nFileSizeLow;
+			hdr.srcTime = attrs.ftLastWriteTime;
+			hdr.pathLength = static_cast<UINT32>(_tcslen(filename));
+			ok = fwrite(&hdr, sizeof(hdr), 1, fp) == 1
+				&& fwrite(filename, sizeof(TCHAR), hdr.pathLength, fp) == hdr.pathLength;
+
+			for (size_t i = 0; ok && i < titleRomList.size(); ++i)
+			{
+				auto const &p = titleRomList[i];
+				auto const &bigrams = titleIndex.Get(static_cast<int>(i));
+				TableMapCacheFileRecord rec;
+				rec.titleLength = static_cast<UINT32>(p.title.length());
+				rec.romLength = static_cast<UINT32>(p.rom.length());
+				rec.nBigrams = static_cast<UINT32>(bigrams.size());
+				ok = fwrite(&rec, sizeof(rec), 1, fp) == 1
+					&& fwrite(p.title.c_str(), sizeof(TCHAR), rec.titleLength, fp) == rec.titleLength
+					&& fwrite(p.rom.c_str(), sizeof(TCHAR), rec.romLength, fp) == rec.romLength
+					&& fwrite(bigrams.data(), sizeof(UINT32), rec.nBigrams, fp) == rec.nBigrams;
+			}
+		}
+	}
+
+	// move the new file into place
+	if (!ok || !MoveFileEx(tmpFile.c_str(), path, MOVEFILE_REPLACE_EXISTING))
+	{
+		DeleteFile(tmpFile.c_str());
+		LogFile::Get()->Write(LogFile::DofLogging, _T("DOF: unable to save the table mapping cache file %s\n"), path);
+	}
+}
+
 const TCHAR *DOFClient::GetRomForTitle(const TCHAR *title, const GameSystem *system)
 {
 	// return null if not ready
@@ -643,8 +892,8 @@ const TCHAR *DOFClient::GetRomForTitle(const TCHAR *title, const GameSystem *sys
 	TSTRING titleKey = SimplifiedTitle(title);
 
 	// pre-compute the bigram set for the string
-	DiceCoefficient::BigramSet<TCHAR> titleBigrams;
-	DiceCoefficient::BuildBigramSet(titleBigrams, titleKey.c_str());
+	DiceCoefficient::PackedBigramSet<TCHAR> titleBigrams;
+	DiceCoefficient::BuildPackedBigramSet(titleBigrams, titleKey.c_str());
 
 	// The DOF config tool uses a naming convention to distinguish
 	// games with titles implemented in multiple systems:
@@ -660,39 +909,32 @@ const TCHAR *DOFClient::GetRomForTitle(const TCHAR *title, const GameSystem *sys
 	// system setting for the title, and try this alongside the plain
 	// title string for each stage of the match.
 	TSTRING prefixedTitleKey;
-	DiceCoefficient::BigramSet<TCHAR> prefixedBigrams;
+	DiceCoefficient::PackedBigramSet<TCHAR> prefixedBigrams;
 	if (system != nullptr && system->dofTitlePrefix.length() != 0)
 	{
 		prefixedTitleKey = system->dofTitlePrefix + _T(" ") + titleKey;
-		DiceCoefficient::BuildBigramSet(prefixedBigrams, prefixedTitleKey.c_str());
+		DiceCoefficient::BuildPackedBigramSet(prefixedBigrams, prefixedTitleKey.c_str());
 	}
 
 	// Try finding the name via fuzzy match.  Start with a minimum score
 	// of 30% - this is an arbitrary threshold to reduce the chances that
 	// we match something wildly unrelated.
 	float bestScore = 0.3f;
-	TitleRomPair *bestMatch = 0;
-	for (auto it = titleRomList.begin(); it != titleRomList.end(); ++it)
-	{
-		// check the prefixed title, if present
-		float score;
-		if (prefixedTitleKey.length() != 0
-			&& (score = DiceCoefficient::DiceCoefficient(prefixedBigrams, it->titleBigrams)) > bestScore)
-		{
-			bestMatch = &*it;
-			bestScore = score;
-		}
+	int bestMatch = titleIndex.Best(titleBigrams, bestScore, &bestScore);
 
-		// now try the base title
-		if ((score = DiceCoefficient::DiceCoefficient(titleBigrams, it->titleBigrams)) > bestScore)
-		{
-			bestMatch = &*it;
-			bestScore = score;
-		}
+	// Check the prefixed title, if present.  On a tie, prefer the earlier
+	// list entry, or the prefixed match for the same entry.
+	if (prefixedTitleKey.length() != 0)
+	{
+		float prefixedScore;
+		int prefixedMatch = titleIndex.Best(prefixedBigrams, 0.3f, &prefixedScore);
+		if (prefixedMatch >= 0
+			&& (bestMatch < 0 || prefixedScore > bestScore || (prefixedScore == bestScore && prefixedMatch <= bestMatch)))
+			bestMatch = prefixedMatch;
 	}
 
 	// return the best match we found, if any
-	return bestMatch != nullptr ? bestMatch->rom.c_str() : nullptr;
+	return bestMatch >= 0 ? titleRomList[bestMatch].rom.c_str() : nullptr;
 }
 
 // Simplified title generator.  Removes leading and trailing whitespace,
@@ -701,7 +943,7 @@ const TCHAR *DOFClient::GetRomForTitle(const TCHAR *title, const GameSystem *sys
 TSTRING DOFClient::SimplifiedTitle(const TCHAR *title)
 {
 	// strip extra whitespace and punctuation
-	std::basic_regex<TCHAR> pat(_T("^\\s+|[^a-zA-Z0-9\\-]+|\\s\\s+|\\s+$"));
+	static const std::basic_regex<TCHAR> pat(_T("^\\s+|[^a-zA-Z0-9\\-]+|\\s\\s+|\\s+$"));
 	TSTRING ret = std::regex_replace(title, pat, _T(" "));
 
 	// convert to lower-case
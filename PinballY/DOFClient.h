@@ -71,6 +71,13 @@ public:
 	// than that, so they're virtually guaranteed to be unique by virtue
 	// of the length alone.  But the PBY prefix further helps avoid
 	// accidental collisions.
+	//
+	// Some toy configurations make the DOF calls slow enough to stall
+	// the UI, so this doesn't call into DOF directly.  It just queues the
+	// new state for the dispatch thread to send.  If a state for the same
+	// name is already waiting in the queue, the new value replaces it,
+	// except that a pending non-zero value isn't collapsed into a zero,
+	// so that both halves of a pulse always reach DOF.
 	void SetNamedState(const WCHAR *name, int val);
 
 	// Map a table to a DOF ROM name.  This consults the table/ROM mapping
@@ -139,6 +146,40 @@ protected:
 	// load the table mapping file
 	void LoadTableMap(ErrorHandler &eh);
 
+	// Named state dispatch thread.  This sends the states queued by
+	// SetNamedState() to DOF.
+	static DWORD WINAPI DispatchThreadMain(LPVOID lParam);
+	HandleHolder hDispatchThread;
+	HandleHolder hDispatchEvent;
+	volatile bool dispatchExit = false;
+
+	// Named state dispatch queue, in the order queued, with an index of
+	// the latest pending entry for each name, for coalescing repeated
+	// states.  Protected by dispatchLock.
+	struct PendingState
+	{
+		PendingState(const WCHAR *name, int val) : name(name), val(val) { }
+		WSTRING name;
+		int val;
+	};
+	std::list<PendingState> dispatchQueue;
+	std::unordered_map<WSTRING, std::list<PendingState>::iterator> dispatchPending;
+	CriticalSection dispatchLock;
+
+	// send a named state to DOF
+	void InvokeSetNamedState(const WCHAR *name, int val);
+
+	// Table map cache.  Parsing the table mapping XML and building the
+	// title bigram sets takes a noticeable part of a second with the
+	// full DOF config, so we save the parsed map, with the bigram sets,
+	// in a binary cache file.  The cache is tied to the mapping file's
+	// path, size, and modification time, so any change to the mapping
+	// file simply makes us parse it again.  LoadTableMapCache() returns
+	// true if it loaded a current cache.
+	bool LoadTableMapCache(const TCHAR *filename);
+	void SaveTableMapCache(const TCHAR *filename);
+	static void GetTableMapCacheFile(TCHAR path[MAX_PATH]);
+
 	// Game title/ROM mappings from the DOF table mappings file.  The DOF
 	// PinballX/front-end configuration uses ROM names to trigger table-
 	// specific effects when a game is selected in the menu UI, but the
@@ -167,34 +208,25 @@ protected:
 	// that way, so we have to provide our own similar implementation.
 	//
 	// Because of the need for fuzzy matching to the DOF mapping table,
-	// we store the mapping table as a simple list of title/ROM pairs.
-	// There are ways to index fuzzy-matched data more efficiently than
-	// a linear search, but we have a small data set, so I don't think
-	// it's worth the trouble.  However, we do at least pre-compute the
-	// bigram set for each title string, which is what the fuzzy
-	// matching algorithm uses to compute the similarity to a subject
-	// string.  The bigram computation is relatively time-consuming,
-	// so it makes the search process much faster if we pre-compute it 
-	// for each string in the index.
-	//
-	// The simplifiedTitle is the title after running it through the
-	// SimplifyTitle() function.  This removes extra spaces and
-	// punctuation to make fuzzy matching easier.
-	//
+	// We store the mapping table as a list of title/ROM pairs, with a
+	// bigram index over the titles for the fuzzy matching.  The index
+	// entries are in the same order as the list entries.  Each index
+	// entry is built from the title after running it through the
+	// SimplifyTitle() function, which removes extra spaces and
+	// punctuation to make fuzzy matching easier.  With the index, a
+	// lookup only has to score the titles that share at least one
+	// bigram with the subject title, rather than every title in the
+	// list.
 	struct TitleRomPair
 	{
 		TitleRomPair(const TCHAR *title, const TCHAR *rom)
-			: title(title), rom(rom)
-		{
-			// pre-compute the bigram set for the simplified title string
-			DiceCoefficient::BuildBigramSet(titleBigrams, SimplifiedTitle(title).c_str());
-		}
+			: title(title), rom(rom) { }
 
 		TSTRING title;
-		DiceCoefficient::BigramSet<TCHAR> titleBigrams;
 		TSTRING rom;
 	};
-	std::list<TitleRomPair> titleRomList;
+	std::vector<TitleRomPair> titleRomList;
+	DiceCoefficient::BigramIndex<TCHAR> titleIndex;
 
 	// Simplified title string.  This removes punctuation marks and
 	// collapses runs of whitespace to single spaces.
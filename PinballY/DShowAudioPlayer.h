@@ -34,6 +34,7 @@ public:
 
 	// is a frame ready?
 	virtual bool IsFrameReady() const override { return true; }
+	virtual bool IsFrameAvailable() const override { return false; }
 
 	// get/set looping mode
 	virtual bool IsLooping() const override { return looping; }
@@ -0,0 +1,517 @@
+// This file is part of PinballY
+// Copyright 2018 Michael J Roberts | GPL v3 or later | NO WARRANTY
+//
+// Desktop Duplication screen capture source
+
+#include "stdafx.h"
+#include <d3d11.h>
+#include <dxgi1_2.h>
+#include "DesktopDuplication.h"
+#include "LogFile.h"
+#include "shaders/FullScreenQuadShaderVS.h"
+#include "shaders/CaptureTransformShaderPS.h"
+
+#pragma comment(lib, "dxgi.lib")
+
+DesktopDuplication::DesktopDuplication()
+{
+}
+
+DesktopDuplication::~DesktopDuplication()
+{
+	Stop();
+}
+
+bool DesktopDuplication::AddTarget(const RECT &rc, bool mirrorVert, bool mirrorHorz, int rotate)
+{
+	// find the monitor containing the area
+	RefPtr<IDXGIFactory1> factory;
+	if (FAILED(CreateDXGIFactory1(IID_PPV_ARGS(&factory))))
+		return false;
+
+	RefPtr<IDXGIAdapter1> curAdapter;
+	for (UINT i = 0; factory->EnumAdapters1(i, &curAdapter) != DXGI_ERROR_NOT_FOUND; ++i, curAdapter = nullptr)
+	{
+		RefPtr<IDXGIOutput> output;
+		for (UINT j = 0; curAdapter->EnumOutputs(j, &output) != DXGI_ERROR_NOT_FOUND; ++j, output = nullptr)
+		{
+			// check if the area is entirely within this monitor
+			DXGI_OUTPUT_DESC desc;
+			RECT rcInt;
+			if (FAILED(output->GetDesc(&desc))
+				|| !desc.AttachedToDesktop
+				|| !IntersectRect(&rcInt, &rc, &desc.DesktopCoordinates)
+				|| !EqualRect(&rcInt, &rc))
+				continue;
+
+			// All of the monitors have to be on the same adapter, since
+			// we capture them all with one device
+			DXGI_ADAPTER_DESC1 adesc;
+			curAdapter->GetDesc1(&adesc);
+			if (adapter != nullptr)
+			{
+				DXGI_ADAPTER_DESC1 curDesc;
+				adapter->GetDesc1(&curDesc);
+				if (memcmp(&curDesc.AdapterLuid, &adesc.AdapterLuid, sizeof(LUID)) != 0)
+				{
+					LogFile::Get()->Write(LogFile::CaptureLogging,
+						_T("+ Desktop Duplication: capture areas are on different video adapters\n"));
+					return false;
+				}
+			}
+			else
+				adapter = curAdapter;
+
+			// find or add the source for this monitor
+			size_t srcIndex;
+			for (srcIndex = 0; srcIndex < sources.size() && sources[srcIndex]->desc.Monitor != desc.Monitor; ++srcIndex);
+			if (srcIndex == sources.size())
+			{
+				auto src = new Source();
+				src->desc = desc;
+				if (FAILED(output->QueryInterface(IID_PPV_ARGS(&src->output))))
+				{
+					delete src;
+					return false;
+				}
+				sources.emplace_back(src);
+			}
+
+			// add the target
+			auto t = new Target();
+			t->rc = rc;
+			t->mirrorVert = mirrorVert;
+			t->mirrorHorz = mirrorHorz;
+			t->rotate = rotate;
+			t->source = srcIndex;
+			t->width = rc.right - rc.left;
+			t->height = rc.bottom - rc.top;
+			if (rotate == 90 || rotate == 270)
+				std::swap(t->width, t->height);
+			targets.emplace_back(t);
+			return true;
+		}
+	}
+
+	// the area isn't contained in any one monitor
+	LogFile::Get()->Write(LogFile::CaptureLogging,
+		_T("+ Desktop Duplication: capture area (%d,%d)-(%d,%d) isn't contained in a single monitor\n"),
+		rc.left, rc.top, rc.right, rc.bottom);
+	return false;
+}
+
+bool DesktopDuplication::Start()
+{
+	// set up the device and targets
+	if (!Init())
+		return false;
+
+	// create the stop event
+	hStopEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+	if (hStopEvent == NULL)
+		return false;
+
+	// create the pipes
+	static LONG pipeCounter = 0;
+	for (auto &t : targets)
+	{
+		t->pipeName = MsgFmt(_T("\\\\.\\pipe\\PinballY.Capture.%lu.%ld"),
+			GetCurrentProcessId(), InterlockedIncrement(&pipeCounter)).Get();
+		DWORD frameBytes = t->width * t->height * 4;
+		t->hPipe = CreateNamedPipe(t->pipeName.c_str(), PIPE_ACCESS_OUTBOUND | FILE_FLAG_OVERLAPPED | FILE_FLAG_FIRST_PIPE_INSTANCE,
+			PIPE_TYPE_BYTE | PIPE_WAIT | PIPE_REJECT_REMOTE_CLIENTS, 1, frameBytes, 0, 0, NULL);
+		t->hEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+		if (t->hPipe == INVALID_HANDLE_VALUE || t->hEvent == NULL)
+		{
+			t->hPipe.Detach();
+			WindowsErrorMessage err;
+			LogFile::Get()->Write(LogFile::CaptureLogging,
+				_T("+ Desktop Duplication: error creating pipe %s: %s\n"), t->pipeName.c_str(), err.Get());
+			return false;
+		}
+		t->buf.resize(frameBytes);
+
+		// start waiting for ffmpeg to connect
+		ZeroMemory(&t->ov, sizeof(t->ov));
+		t->ov.hEvent = t->hEvent;
+		if (ConnectNamedPipe(t->hPipe, &t->ov))
+			t->state = Target::State::Ready;
+		else if (DWORD err = GetLastError(); err == ERROR_PIPE_CONNECTED)
+			t->state = Target::State::Ready;
+		else if (err == ERROR_IO_PENDING)
+			t->state = Target::State::Connecting;
+		else
+			return false;
+	}
+
+	// launch the capture thread
+	DWORD tid;
+	hThread = CreateThread(NULL, 0, &SThreadMain, this, 0, &tid);
+	return hThread != NULL;
+}
+
+void DesktopDuplication::Stop()
+{
+	// tell the thread to stop, and wait for it to exit
+	if (hThread != NULL)
+	{
+		SetEvent(hStopEvent);
+		WaitForSingleObject(hThread, INFINITE);
+		hThread = NULL;
+	}
+}
+
+TSTRING DesktopDuplication::GetInputOpts(int index) const
+{
+	auto &t = targets[index];
+	return MsgFmt(_T("-f rawvideo -pix_fmt bgra -video_size %dx%d -framerate %d -use_wallclock_as_timestamps 1")
+		_T(" -thread_queue_size 32 -i \"%s\""),
+		t->width, t->height, frameRate, t->pipeName.c_str()).Get();
+}
+
+bool DesktopDuplication::Init()
+{
+	auto Fail = [](const TCHAR *what, HRESULT hr)
+	{
+		LogFile::Get()->Write(LogFile::CaptureLogging, _T("+ Desktop Duplication: %s failed, HRESULT %lx\n"), what, (long)hr);
+		return false;
+	};
+
+	// there's nothing to do if there aren't any targets
+	if (targets.size() == 0)
+		return false;
+
+	// create the device on the monitors' adapter
+	HRESULT hr;
+	if (FAILED(hr = D3D11CreateDevice(adapter, D3D_DRIVER_TYPE_UNKNOWN, NULL, 0, NULL, 0,
+		D3D11_SDK_VERSION, &device, NULL, &context)))
+		return Fail(_T("D3D11CreateDevice"), hr);
+
+	// create the shaders
+	if (FAILED(hr = device->CreateVertexShader(g_vsFullScreenQuadShader, sizeof(g_vsFullScreenQuadShader), NULL, &vs)))
+		return Fail(_T("CreateVertexShader"), hr);
+	if (FAILED(hr = device->CreatePixelShader(g_psCaptureTransformShader, sizeof(g_psCaptureTransformShader), NULL, &ps)))
+		return Fail(_T("CreatePixelShader"), hr);
+
+	// The targets map the desktop pixels 1:1 (apart from rotation), so
+	// use point sampling, clamped at the edges
+	D3D11_SAMPLER_DESC sd;
+	ZeroMemory(&sd, sizeof(sd));
+	sd.Filter = D3D11_FILTER_MIN_MAG_MIP_POINT;
+	sd.AddressU = sd.AddressV = sd.AddressW = D3D11_TEXTURE_ADDRESS_CLAMP;
+	sd.ComparisonFunc = D3D11_COMPARISON_NEVER;
+	sd.MaxLOD = D3D11_FLOAT32_MAX;
+	if (FAILED(hr = device->CreateSamplerState(&sd, &sampler)))
+		return Fail(_T("CreateSamplerState"), hr);
+
+	// don't cull, so that the quad winding doesn't matter
+	D3D11_RASTERIZER_DESC rd;
+	ZeroMemory(&rd, sizeof(rd));
+	rd.FillMode = D3D11_FILL_SOLID;
+	rd.CullMode = D3D11_CULL_NONE;
+	rd.DepthClipEnable = TRUE;
+	if (FAILED(hr = device->CreateRasterizerState(&rd, &rasterizerState)))
+		return Fail(_T("CreateRasterizerState"), hr);
+
+	// set up the duplication interfaces
+	for (auto &src : sources)
+	{
+		if (!InitDuplication(src.get()))
+			return false;
+	}
+
+	// set up the targets
+	for (auto &t : targets)
+	{
+		if (!InitTarget(t.get()))
+			return false;
+	}
+
+	// success
+	return true;
+}
+
+bool DesktopDuplication::InitDuplication(Source *src)
+{
+	// create the duplication interface
+	src->dup = nullptr;
+	HRESULT hr = src->output->DuplicateOutput(device, &src->dup);
+	if (FAILED(hr))
+	{
+		// This fails with DXGI_ERROR_UNSUPPORTED if the monitor isn't
+		// driven by the adapter (as on some hybrid graphics systems), and
+		// with E_ACCESSDENIED while the secure desktop is showing.
+		LogFile::Get()->Write(LogFile::CaptureLogging,
+			_T("+ Desktop Duplication: DuplicateOutput failed for %ws, HRESULT %lx\n"), src->desc.DeviceName, (long)hr);
+		return false;
+	}
+
+	// note the rotation
+	DXGI_OUTDUPL_DESC desc;
+	src->dup->GetDesc(&desc);
+	src->rotation = desc.Rotation;
+	return true;
+}
+
+bool DesktopDuplication::InitTarget(Target *t)
+{
+	auto &src = sources[t->source];
+	HRESULT hr;
+
+	// Figure the texture coordinate transform.  Start with a point in
+	// the output frame, in normalized coordinates (0..1).  The output is
+	// the source area mirrored, then rotated counter-clockwise, so undo
+	// the rotation and then the mirroring to find the point in the
+	// source area.
+	const RECT &drc = src->desc.DesktopCoordinates;
+	auto Map = [t, &src, &drc](float u, float v, float &x, float &y)
+	{
+		// undo the rotation
+		float s, r;
+		switch (t->rotate)
+		{
+		case 90:  s = 1.0f - v; r = u; break;
+		case 180: s = 1.0f - u; r = 1.0f - v; break;
+		case 270: s = v; r = 1.0f - u; break;
+		default:  s = u; r = v; break;
+		}
+
+		// undo the mirroring
+		if (t->mirrorHorz)
+			s = 1.0f - s;
+		if (t->mirrorVert)
+			r = 1.0f - r;
+
+		// figure the normalized position on the monitor's desktop area
+		float dx = (t->rc.left - drc.left + s * (t->rc.right - t->rc.left)) / (drc.right - drc.left);
+		float dy = (t->rc.top - drc.top + r * (t->rc.bottom - t->rc.top)) / (drc.bottom - drc.top);
+
+		// The duplication texture is in the monitor's native orientation,
+		// so if the desktop is rotated on this monitor, rotate back to the
+		// texture layout.  The desktop rotation is clockwise.
+		switch (src->rotation)
+		{
+		case DXGI_MODE_ROTATION_ROTATE90:  x = dy; y = 1.0f - dx; break;
+		case DXGI_MODE_ROTATION_ROTATE180: x = 1.0f - dx; y = 1.0f - dy; break;
+		case DXGI_MODE_ROTATION_ROTATE270: x = 1.0f - dy; y = dx; break;
+		default:                           x = dx; y = dy; break;
+		}
+	};
+
+	// The transform is affine, so we can describe it by the image of
+	// the origin and of the two unit axes
+	float cb[12] = { 0 };
+	float x1, y1, x2, y2;
+	Map(0.0f, 0.0f, cb[0], cb[1]);
+	Map(1.0f, 0.0f, x1, y1);
+	Map(0.0f, 1.0f, x2, y2);
+	cb[4] = x1 - cb[0];
+	cb[5] = y1 - cb[1];
+	cb[8] = x2 - cb[0];
+	cb[9] = y2 - cb[1];
+
+	D3D11_BUFFER_DESC bd;
+	ZeroMemory(&bd, sizeof(bd));
+	bd.Usage = D3D11_USAGE_IMMUTABLE;
+	bd.ByteWidth = sizeof(cb);
+	bd.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+	D3D11_SUBRESOURCE_DATA init = { cb, 0, 0 };
+	if (FAILED(hr = device->CreateBuffer(&bd, &init, &t->cb)))
+		return false;
+
+	// create the render target and staging textures
+	D3D11_TEXTURE2D_DESC td;
+	ZeroMemory(&td, sizeof(td));
+	td.Width = t->width;
+	td.Height = t->height;
+	td.MipLevels = 1;
+	td.ArraySize = 1;
+	td.Format = DXGI_FORMAT_B8G8R8A8_UNORM;
+	td.SampleDesc.Count = 1;
+	td.Usage = D3D11_USAGE_DEFAULT;
+	td.BindFlags = D3D11_BIND_RENDER_TARGET;
+	if (FAILED(hr = device->CreateTexture2D(&td, NULL, &t->rt))
+		|| FAILED(hr = device->CreateRenderTargetView(t->rt, NULL, &t->rtv)))
+		return false;
+
+	td.Usage = D3D11_USAGE_STAGING;
+	td.BindFlags = 0;
+	td.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
+	if (FAILED(hr = device->CreateTexture2D(&td, NULL, &t->staging)))
+		return false;
+
+	return true;
+}
+
+DWORD DesktopDuplication::ThreadMain()
+{
+	// set up the fixed pipeline state
+	context->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLESTRIP);
+	context->IASetInputLayout(NULL);
+	context->VSSetShader(vs, NULL, 0);
+	context->PSSetShader(ps, NULL, 0);
+	ID3D11SamplerState *samplers[] = { sampler };
+	context->PSSetSamplers(0, 1, samplers);
+	context->RSSetState(rasterizerState);
+
+	// send frames at the fixed frame rate until all of the targets are
+	// done, or we're told to stop
+	LARGE_INTEGER freq, t0, now;
+	QueryPerformanceFrequency(&freq);
+	QueryPerformanceCounter(&t0);
+	for (UINT64 frameNo = 1; ; ++frameNo)
+	{
+		// get the latest desktop images
+		for (auto &src : sources)
+			AcquireFrame(src.get());
+
+		// send a frame to each target that's ready for one
+		bool active = false;
+		for (auto &t : targets)
+		{
+			UpdatePipeState(t.get());
+			if (t->state == Target::State::Ready && sources[t->source]->frame != nullptr)
+				SendFrame(t.get());
+			if (t->state != Target::State::Done)
+				active = true;
+		}
+
+		// stop when all of the targets are done
+		if (!active)
+			break;
+
+		// wait for the next frame time, or the stop signal
+		QueryPerformanceCounter(&now);
+		INT64 next = t0.QuadPart + static_cast<INT64>(frameNo * freq.QuadPart / frameRate);
+		DWORD wait = next > now.QuadPart ? static_cast<DWORD>((next - now.QuadPart) * 1000 / freq.QuadPart) : 0;
+		if (WaitForSingleObject(hStopEvent, wait) == WAIT_OBJECT_0)
+			break;
+	}
+
+	// Cancel any pending pipe operations and close the pipes.  Closing
+	// the pipe ends the input for ffmpeg, if it's still reading.
+	for (auto &t : targets)
+	{
+		if (t->state == Target::State::Connecting || t->state == Target::State::Writing)
+		{
+			DWORD actual;
+			CancelIoEx(t->hPipe, &t->ov);
+			GetOverlappedResult(t->hPipe, &t->ov, &actual, TRUE);
+		}
+		t->hPipe = NULL;
+		t->state = Target::State::Done;
+	}
+
+	// release the duplication interfaces (there can only be one per
+	// monitor in the whole system, so don't hold them any longer than
+	// necessary)
+	for (auto &src : sources)
+		src->dup = nullptr;
+
+	return 0;
+}
+
+void DesktopDuplication::AcquireFrame(Source *src)
+{
+	// if we lost the duplication interface, try to re-create it
+	if (src->dup == nullptr && !InitDuplication(src))
+		return;
+
+	// get the next frame, if there's a new one
+	DXGI_OUTDUPL_FRAME_INFO info;
+	RefPtr<IDXGIResource> res;
+	HRESULT hr = src->dup->AcquireNextFrame(0, &info, &res);
+	if (hr == DXGI_ERROR_WAIT_TIMEOUT)
+	{
+		// no change since the last frame - keep using the old image
+		return;
+	}
+	else if (hr == DXGI_ERROR_ACCESS_LOST)
+	{
+		// The duplication was interrupted, by a mode change or a switch
+		// to a full-screen exclusive swap chain, for example.  Release the
+		// interface; we'll try to re-create it on the next frame.
+		src->dup = nullptr;
+		return;
+	}
+	else if (FAILED(hr))
+		return;
+
+	// copy the new image, if the desktop image changed (rather than just
+	// the mouse pointer) or we don't have an image yet
+	RefPtr<ID3D11Texture2D> tex;
+	if ((info.LastPresentTime.QuadPart != 0 || src->frame == nullptr)
+		&& SUCCEEDED(res->QueryInterface(IID_PPV_ARGS(&tex))))
+	{
+		// create our copy on the first frame
+		if (src->frame == nullptr)
+		{
+			D3D11_TEXTURE2D_DESC td;
+			tex->GetDesc(&td);
+			td.MipLevels = 1;
+			td.ArraySize = 1;
+			td.Usage = D3D11_USAGE_DEFAULT;
+			td.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+			td.CPUAccessFlags = 0;
+			td.MiscFlags = 0;
+			if (FAILED(device->CreateTexture2D(&td, NULL, &src->frame))
+				|| FAILED(device->CreateShaderResourceView(src->frame, NULL, &src->srv)))
+			{
+				src->frame = nullptr;
+				src->srv = nullptr;
+			}
+		}
+
+		if (src->frame != nullptr)
+			context->CopyResource(src->frame, tex);
+	}
+
+	// done with the frame
+	src->dup->ReleaseFrame();
+}
+
+void DesktopDuplication::UpdatePipeState(Target *t)
+{
+	// check for completion of a pending connect or write
+	if (t->state == Target::State::Connecting || t->state == Target::State::Writing)
+	{
+		DWORD actual;
+		if (GetOverlappedResult(t->hPipe, &t->ov, &actual, FALSE))
+			t->state = Target::State::Ready;
+		else if (GetLastError() != ERROR_IO_INCOMPLETE)
+			t->state = Target::State::Done;
+	}
+}
+
+void DesktopDuplication::SendFrame(Target *t)
+{
+	// render the target area into the output frame
+	auto &src = sources[t->source];
+	ID3D11RenderTargetView *rtvs[] = { t->rtv };
+	context->OMSetRenderTargets(1, rtvs, NULL);
+	D3D11_VIEWPORT vp = { 0.0f, 0.0f, static_cast<float>(t->width), static_cast<float>(t->height), 0.0f, 1.0f };
+	context->RSSetViewports(1, &vp);
+	ID3D11ShaderResourceView *srvs[] = { src->srv };
+	context->PSSetShaderResources(0, 1, srvs);
+	ID3D11Buffer *cbs[] = { t->cb };
+	context->PSSetConstantBuffers(0, 1, cbs);
+	context->Draw(4, 0);
+
+	// read it back
+	context->CopyResource(t->staging, t->rt);
+	D3D11_MAPPED_SUBRESOURCE m;
+	if (FAILED(context->Map(t->staging, 0, D3D11_MAP_READ, 0, &m)))
+		return;
+	UINT rowBytes = t->width * 4;
+	for (int y = 0; y < t->height; ++y)
+		memcpy(t->buf.data() + y * rowBytes, static_cast<const BYTE*>(m.pData) + y * m.RowPitch, rowBytes);
+	context->Unmap(t->staging, 0);
+
+	// start the write
+	if (WriteFile(t->hPipe, t->buf.data(), static_cast<DWORD>(t->buf.size()), NULL, &t->ov))
+		t->state = Target::State::Ready;
+	else if (GetLastError() == ERROR_IO_PENDING)
+		t->state = Target::State::Writing;
+	else
+		t->state = Target::State::Done;
+}
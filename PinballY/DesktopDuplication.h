@@ -0,0 +1,161 @@
+// This file is part of PinballY
+// Copyright 2018 Michael J Roberts | GPL v3 or later | NO WARRANTY
+//
+// Desktop Duplication screen capture source
+//
+// This is an alternative to ffmpeg's gdigrab screen capture for media
+// capture.  gdigrab copies the screen through GDI, which gets slow at
+// high resolutions, and doesn't always see frames from a game's full-
+// screen swap chain.  The DXGI Desktop Duplication API instead gives us
+// each desktop frame as a GPU texture, straight from the compositor.
+//
+// We run the capture on a background thread with our own D3D11 device,
+// created on the adapter that owns the captured monitors.  Each capture
+// target is a rectangle on the desktop, with the rotation and mirroring
+// needed to get the stored media orientation.  For each frame, we render
+// the target area into a texture of the output size with a pixel shader
+// that applies the rotation and mirroring, read the result back, and
+// write the raw BGRA pixels to a named pipe.  ffmpeg reads the pipe as a
+// rawvideo input.  The pipe name and input format options for each
+// target come from GetInputOpts().
+//
+// Frames go out at a fixed rate, repeating the last desktop image when
+// nothing on the screen has changed.  ffmpeg stamps the frames with the
+// wall clock as they arrive, so if ffmpeg falls behind and we have to
+// skip a frame for a target, the video timing stays correct.  A target
+// is finished when ffmpeg closes its end of the pipe, which happens when
+// ffmpeg reaches its time limit or gets a "q" command.
+
+#pragma once
+#include <dxgi1_2.h>
+#include "../Utilities/Pointers.h"
+#include "../Utilities/WinUtil.h"
+
+class DesktopDuplication
+{
+public:
+	DesktopDuplication();
+	~DesktopDuplication();
+
+	// frame rate
+	static const int frameRate = 30;
+
+	// Add a capture target.  'rc' is the area to capture, in desktop
+	// coordinates.  The image is mirrored as specified, then rotated
+	// counter-clockwise by 'rotate' degrees (0, 90, 180, or 270).
+	// Returns false if the area can't be captured, because it's not
+	// entirely on one monitor, or its monitor is on a different video
+	// adapter from the earlier targets.
+	bool AddTarget(const RECT &rc, bool mirrorVert, bool mirrorHorz, int rotate);
+
+	// Start the capture.  This sets up the device and the duplication
+	// interfaces, creates the pipes, and launches the capture thread.
+	// Returns false on failure, with the reason logged.
+	bool Start();
+
+	// Stop the capture, and wait for the thread to exit
+	void Stop();
+
+	// Get the ffmpeg input options for a target, by index in order of
+	// the AddTarget() calls
+	TSTRING GetInputOpts(int index) const;
+
+protected:
+	// Source monitor.  Each monitor with at least one target has its
+	// own duplication interface, and a copy of the latest desktop frame.
+	struct Source
+	{
+		RefPtr<IDXGIOutput1> output;
+		DXGI_OUTPUT_DESC desc;
+
+		// duplication interface and desktop rotation
+		RefPtr<IDXGIOutputDuplication> dup;
+		DXGI_MODE_ROTATION rotation = DXGI_MODE_ROTATION_IDENTITY;
+
+		// copy of the latest frame, and its shader view; these are
+		// created when the first frame arrives
+		RefPtr<ID3D11Texture2D> frame;
+		RefPtr<ID3D11ShaderResourceView> srv;
+	};
+
+	// Capture target
+	struct Target
+	{
+		// capture area, in desktop coordinates, and transforms
+		RECT rc;
+		bool mirrorVert;
+		bool mirrorHorz;
+		int rotate;
+
+		// source index
+		size_t source;
+
+		// output frame size, after rotation
+		int width;
+		int height;
+
+		// constant buffer with the texture coordinate transform
+		RefPtr<ID3D11Buffer> cb;
+
+		// render target, and CPU-readable staging copy
+		RefPtr<ID3D11Texture2D> rt;
+		RefPtr<ID3D11RenderTargetView> rtv;
+		RefPtr<ID3D11Texture2D> staging;
+
+		// output pipe
+		TSTRING pipeName;
+		HandleHolder hPipe;
+		HandleHolder hEvent;
+		OVERLAPPED ov;
+		enum class State
+		{
+			Connecting,    // waiting for ffmpeg to open the pipe
+			Ready,         // ready for the next frame
+			Writing,       // write in progress
+			Done           // pipe closed
+		};
+		State state = State::Connecting;
+
+		// frame buffer for the pipe write
+		std::vector<BYTE> buf;
+	};
+
+	// set up the device, sources, and targets
+	bool Init();
+
+	// create the duplication interface for a source
+	bool InitDuplication(Source *src);
+
+	// set up the texture transform and render target for a target
+	bool InitTarget(Target *t);
+
+	// thread entrypoint
+	static DWORD WINAPI SThreadMain(LPVOID param) { return static_cast<DesktopDuplication*>(param)->ThreadMain(); }
+	DWORD ThreadMain();
+
+	// get the latest frame for a source
+	void AcquireFrame(Source *src);
+
+	// check for completion of a pending pipe operation
+	void UpdatePipeState(Target *t);
+
+	// render a target frame and start writing it to the pipe
+	void SendFrame(Target *t);
+
+	// adapter, device, and shaders
+	RefPtr<IDXGIAdapter1> adapter;
+	RefPtr<ID3D11Device> device;
+	RefPtr<ID3D11DeviceContext> context;
+	RefPtr<ID3D11VertexShader> vs;
+	RefPtr<ID3D11PixelShader> ps;
+	RefPtr<ID3D11SamplerState> sampler;
+	RefPtr<ID3D11RasterizerState> rasterizerState;
+
+	// sources and targets
+	std::vector<std::unique_ptr<Source>> sources;
+	std::vector<std::unique_ptr<Target>> targets;
+
+	// capture thread, and the event that tells it to stop
+	HandleHolder hThread;
+	HandleHolder hStopEvent;
+};
@@ -11,9 +11,22 @@
 // This module provides a simple implementation that computes the Dice
 // Coefficient for a pair of strings.
 //
+// For matching one string against a large list, there's also a packed
+// bigram set representation, which stores each bigram as a 32-bit code
+// in a sorted array, so that two sets can be intersected with a simple
+// merge pass rather than a series of hash lookups.  And BigramIndex
+// adds an inverted index on top of that: it maps each bigram code to
+// the list entries containing it, so a lookup only has to visit the
+// entries that share at least one bigram with the subject string, and
+// can count the bigrams in common for all of them in a single pass
+// over the subject's bigrams.
+//
 
 #pragma once
 #include <unordered_set>
+#include <vector>
+#include <algorithm>
+#include <type_traits>
 
 namespace DiceCoefficient
 {
@@ -99,4 +112,260 @@ namespace DiceCoefficient
 		// divided by the total number of bigrams in the two sets
 		return 2.0f * float(nIntersection) / float(a.size() + b.size());
 	}
+
+	// Packed bigram set.  This stores each bigram as a 32-bit code, with
+	// the first character in the high 16 bits and the second character in
+	// the low 16 bits, in a sorted array with no duplicates.  (The
+	// template parameter only serves to keep sets for different character
+	// types distinct.)
+	template<typename chartype> struct PackedBigramSet : std::vector<UINT32> { };
+
+	// get the packed code for a bigram
+	template<typename chartype>
+	inline UINT32 BigramCode(chartype a, chartype b)
+	{
+		typedef typename std::make_unsigned<chartype>::type uchar;
+		return (static_cast<UINT32>(static_cast<uchar>(a)) << 16) | static_cast<UINT32>(static_cast<uchar>(b));
+	}
+
+	// create a packed set of bigrams in a string
+	template<typename chartype>
+	void BuildPackedBigramSet(PackedBigramSet<chartype> &set, const chartype *a)
+	{
+		// add the codes, including the <null><first char> entry as in
+		// BuildBigramSet()
+		set.clear();
+		set.push_back(BigramCode<chartype>(0, a[0]));
+		for (int i = 0; a[i] != 0; ++i)
+			set.push_back(BigramCode(a[i], a[i + 1]));
+
+		// sort and remove duplicates
+		std::sort(set.begin(), set.end());
+		set.erase(std::unique(set.begin(), set.end()), set.end());
+	}
+
+	template<typename chartype>
+	float DiceCoefficient(const PackedBigramSet<chartype> &a, const PackedBigramSet<chartype> &b)
+	{
+		// an empty set has nothing in common with anything
+		if (a.size() == 0 || b.size() == 0)
+			return 0.0f;
+
+		// count the bigrams in common by merging the sorted code arrays
+		int nIntersection = 0;
+		for (auto pa = a.begin(), pb = b.begin(); pa != a.end() && pb != b.end(); )
+		{
+			if (*pa < *pb)
+				++pa;
+			else if (*pb < *pa)
+				++pb;
+			else
+				++nIntersection, ++pa, ++pb;
+		}
+
+		// figure the coefficient
+		return 2.0f * float(nIntersection) / float(a.size() + b.size());
+	}
+
+	// Inverted bigram index, for finding the best matches for a string
+	// in a list of strings.  Add the list entries with Add(), then call
+	// Build() to build the index before doing any lookups.  Entries are
+	// identified by their index in the order added.  Lookups don't
+	// modify the index, so they can be done from any thread once the
+	// index is built.
+	template<typename chartype>
+	class BigramIndex
+	{
+	public:
+		// search result
+		struct Match
+		{
+			Match(int index, float score) : index(index), score(score) { }
+			int index;     // entry index, in the order added
+			float score;   // Dice coefficient for the entry
+		};
+
+		// add an entry; returns its index
+		int Add(const chartype *str)
+		{
+			sets.emplace_back();
+			BuildPackedBigramSet(sets.back(), str);
+			built = false;
+			return static_cast<int>(sets.size() - 1);
+		}
+
+		// add an entry with a pre-built bigram set (such as one saved in
+		// a cache file); returns its index
+		int Add(PackedBigramSet<chartype> &&set)
+		{
+			sets.emplace_back(std::move(set));
+			built = false;
+			return static_cast<int>(sets.size() - 1);
+		}
+
+		// discard all entries
+		void Clear()
+		{
+			sets.clear();
+			codes.clear();
+			postingStart.clear();
+			postings.clear();
+			built = false;
+		}
+
+		// number of entries
+		size_t Size() const { return sets.size(); }
+
+		// get an entry's bigram set
+		const PackedBigramSet<chartype> &Get(int index) const { return sets[index]; }
+
+		// Build the inverted index.  This must be called after adding
+		// entries, before doing any lookups.
+		void Build()
+		{
+			// collect the (code, entry) pairs for all entries, sorted by code,
+			// then by entry
+			std::vector<std::pair<UINT32, UINT32>> pairs;
+			size_t nPairs = 0;
+			for (auto const &s : sets)
+				nPairs += s.size();
+			pairs.reserve(nPairs);
+			for (UINT32 i = 0; i < static_cast<UINT32>(sets.size()); ++i)
+			{
+				for (auto c : sets[i])
+					pairs.emplace_back(c, i);
+			}
+			std::sort(pairs.begin(), pairs.end());
+
+			// Build the posting lists.  codes[] holds the distinct codes, and
+			// the entries for codes[i] are postings[postingStart[i]] through
+			// postings[postingStart[i+1]-1].
+			codes.clear();
+			postingStart.clear();
+			postings.clear();
+			postings.reserve(pairs.size());
+			for (auto const &p : pairs)
+			{
+				if (codes.size() == 0 || codes.back() != p.first)
+				{
+					codes.push_back(p.first);
+					postingStart.push_back(static_cast<UINT32>(postings.size()));
+				}
+				postings.push_back(p.second);
+			}
+			postingStart.push_back(static_cast<UINT32>(postings.size()));
+			built = true;
+		}
+
+		// Find the 'k' best matches for a bigram set, among the entries
+		// scoring above 'minScore'.  The matches are returned in 'matches',
+		// best first; ties are ordered by entry index.
+		void TopK(const PackedBigramSet<chartype> &query, size_t k, float minScore, std::vector<Match> &matches) const
+		{
+			matches.clear();
+			FindAll(query, minScore, matches);
+
+			auto Better = [](const Match &a, const Match &b) {
+				return a.score > b.score || (a.score == b.score && a.index < b.index); };
+			if (matches.size() > k)
+			{
+				std::partial_sort(matches.begin(), matches.begin() + k, matches.end(), Better);
+				matches.resize(k);
+			}
+			else
+				std::sort(matches.begin(), matches.end(), Better);
+		}
+
+		void TopK(const chartype *str, size_t k, float minScore, std::vector<Match> &matches) const
+		{
+			PackedBigramSet<chartype> query;
+			BuildPackedBigramSet(query, str);
+			TopK(query, k, minScore, matches);
+		}
+
+		// Find the best match for a bigram set, among the entries scoring
+		// above 'minScore'.  On ties, the lowest entry index wins.  Returns
+		// the entry index, or -1 if there's no match above 'minScore'.
+		int Best(const PackedBigramSet<chartype> &query, float minScore, float *pScore = nullptr) const
+		{
+			std::vector<Match> matches;
+			FindAll(query, minScore, matches);
+
+			int best = -1;
+			float bestScore = minScore;
+			for (auto const &m : matches)
+			{
+				if (m.score > bestScore || (m.score == bestScore && best >= 0 && m.index < best))
+				{
+					best = m.index;
+					bestScore = m.score;
+				}
+			}
+
+			if (pScore != nullptr)
+				*pScore = bestScore;
+			return best;
+		}
+
+		int Best(const chartype *str, float minScore, float *pScore = nullptr) const
+		{
+			PackedBigramSet<chartype> query;
+			BuildPackedBigramSet(query, str);
+			return Best(query, minScore, pScore);
+		}
+
+		// Score all entries sharing at least one bigram with the query,
+		// adding the ones above 'minScore' to 'matches', in no particular
+		// order.  (Entries with no bigrams in common score zero, so they
+		// never qualify for a non-negative 'minScore'.)
+		void FindAll(const PackedBigramSet<chartype> &query, float minScore, std::vector<Match> &matches) const
+		{
+			if (!built || query.size() == 0)
+				return;
+
+			// Count the bigrams in common with each entry, by walking the
+			// posting list for each query bigram.  The query codes and the
+			// index codes are both sorted, so we can find each one by
+			// searching forward from the last one found.
+			std::vector<UINT16> counts(sets.size(), 0);
+			std::vector<UINT32> touched;
+			auto cp = codes.begin();
+			for (auto c : query)
+			{
+				cp = std::lower_bound(cp, codes.end(), c);
+				if (cp == codes.end())
+					break;
+				if (*cp != c)
+					continue;
+
+				size_t ci = cp - codes.begin();
+				for (UINT32 p = postingStart[ci]; p < postingStart[ci + 1]; ++p)
+				{
+					UINT32 e = postings[p];
+					if (counts[e]++ == 0)
+						touched.push_back(e);
+				}
+			}
+
+			// figure the coefficient for each entry we visited
+			for (auto e : touched)
+			{
+				float score = 2.0f * float(counts[e]) / float(query.size() + sets[e].size());
+				if (score > minScore)
+					matches.emplace_back(static_cast<int>(e), score);
+			}
+		}
+
+	protected:
+		// bigram sets for the entries
+		std::vector<PackedBigramSet<chartype>> sets;
+
+		// inverted index: distinct codes, and the posting lists
+		std::vector<UINT32> codes;
+		std::vector<UINT32> postingStart;
+		std::vector<UINT32> postings;
+
+		// has the index been built since the last Add()?
+		bool built = false;
+	};
 }
@@ -0,0 +1,342 @@
+// This file is part of PinballY
+// Copyright 2018 Michael J Roberts | GPL v3 or later | NO WARRANTY
+//
+// FFmpeg capability probe
+
+#include "stdafx.h"
+#include <regex>
+#include <sstream>
+#include "../Utilities/FileUtil.h"
+#include "FFmpegProbe.h"
+#include "CaptureEncoder.h"
+#include "LogFile.h"
+
+// statics
+CriticalSection FFmpegProbe::lock;
+bool FFmpegProbe::loaded = false;
+bool FFmpegProbe::valid = false;
+TSTRING FFmpegProbe::keyPath;
+UINT64 FFmpegProbe::keySize = 0;
+FILETIME FFmpegProbe::keyTime = { 0, 0 };
+FFmpegProbe::Capabilities FFmpegProbe::caps;
+HandleHolder FFmpegProbe::hRefreshThread;
+
+// cache file signature line
+static const TCHAR *cacheSignature = _T("PBYFFmpegProbe/1");
+
+// get the cache file name
+static void GetCacheFile(TCHAR path[MAX_PATH])
+{
+	GetDeployedFilePath(path, _T("FFmpegProbeCache.txt"), _T(""));
+}
+
+bool FFmpegProbe::Capabilities::HasEncoder(const CHAR *name) const
+{
+	return std::find(encoders.begin(), encoders.end(), name) != encoders.end();
+}
+
+bool FFmpegProbe::Capabilities::HasInputDevice(const CHAR *name) const
+{
+	return std::find(inputDevices.begin(), inputDevices.end(), name) != inputDevices.end();
+}
+
+void FFmpegProbe::GetFFmpegPath(TCHAR path[MAX_PATH])
+{
+	GetDeployedFilePath(path, _T("ffmpeg\\ffmpeg.exe"), _T("$(SolutionDir)ffmpeg$(64)\\ffmpeg.exe"));
+}
+
+bool FFmpegProbe::GetFileKey(const TCHAR *path, UINT64 &size, FILETIME &mtime)
+{
+	// This only reads the directory entry, so it doesn't set off an
+	// antivirus scan of the program file the way launching it does.
+	WIN32_FILE_ATTRIBUTE_DATA attrs;
+	if (!GetFileAttributesEx(path, GetFileExInfoStandard, &attrs))
+		return false;
+
+	size = (static_cast<UINT64>(attrs.nFileSizeHigh) << 32) | attrs.nFileSizeLow;
+	mtime = attrs.ftLastWriteTime;
+	return true;
+}
+
+bool FFmpegProbe::IsCurrent()
+{
+	TCHAR ffmpeg[MAX_PATH];
+	GetFFmpegPath(ffmpeg);
+	UINT64 size;
+	FILETIME mtime;
+	return valid
+		&& GetFileKey(ffmpeg, size, mtime)
+		&& _tcsicmp(keyPath.c_str(), ffmpeg) == 0
+		&& size == keySize
+		&& CompareFileTime(&mtime, &keyTime) == 0;
+}
+
+void FFmpegProbe::LoadCache()
+{
+	CriticalSectionLocker locker(lock);
+	if (loaded)
+		return;
+	loaded = true;
+
+	// open the cache file; if there isn't one, we'll probe on demand
+	TCHAR path[MAX_PATH];
+	GetCacheFile(path);
+	FILEPtrHolder fp;
+	if (_tfopen_s(&fp, path, _T("rt, ccs=UTF-8")) != 0)
+		return;
+
+	// read the lines
+	Capabilities c;
+	TSTRING p;
+	UINT64 size = 0, time = 0;
+	bool sigOk = false;
+	TCHAR buf[4096];
+	while (_fgetts(buf, countof(buf), fp) != nullptr)
+	{
+		// strip the newline
+		size_t len = _tcslen(buf);
+		while (len != 0 && (buf[len - 1] == '\n' || buf[len - 1] == '\r'))
+			buf[--len] = 0;
+
+		// the first line must be the signature
+		if (!sigOk)
+		{
+			if (_tcscmp(buf, cacheSignature) != 0)
+				return;
+			sigOk = true;
+			continue;
+		}
+
+		// split "name=value"
+		TCHAR *eq = _tcschr(buf, '=');
+		if (eq == nullptr)
+			continue;
+		*eq = 0;
+		const TCHAR *name = buf, *val = eq + 1;
+
+		// split a space-separated list
+		auto List = [val](std::vector<CSTRING> &v)
+		{
+			std::basic_istringstream<TCHAR> s(val);
+			TSTRING item;
+			while (s >> item)
+				v.emplace_back(TCHARToAnsi(item.c_str()));
+		};
+
+		if (_tcscmp(name, _T("path")) == 0)
+			p = val;
+		else if (_tcscmp(name, _T("size")) == 0)
+			size = _tcstoui64(val, nullptr, 10);
+		else if (_tcscmp(name, _T("mtime")) == 0)
+			time = _tcstoui64(val, nullptr, 16);
+		else if (_tcscmp(name, _T("version")) == 0)
+			c.version = TCHARToAnsi(val);
+		else if (_tcscmp(name, _T("encoders")) == 0)
+			List(c.encoders);
+		else if (_tcscmp(name, _T("inputDevices")) == 0)
+			List(c.inputDevices);
+	}
+
+	// install the results if the file had a key
+	if (sigOk && p.length() != 0)
+	{
+		keyPath = p;
+		keySize = size;
+		keyTime.dwLowDateTime = static_cast<DWORD>(time);
+		keyTime.dwHighDateTime = static_cast<DWORD>(time >> 32);
+		caps = std::move(c);
+		valid = true;
+
+		LogFile::Get()->Write(LogFile::CaptureLogging, _T("FFmpeg: loaded cached capabilities for %s (version %hs)\n"),
+			keyPath.c_str(), caps.version.c_str());
+	}
+}
+
+void FFmpegProbe::SaveCache()
+{
+	// Write to a temporary file, then move it into place, so that a
+	// crash while writing can't leave a truncated cache file behind.
+	TCHAR path[MAX_PATH];
+	GetCacheFile(path);
+	TSTRING tmpFile = TSTRING(path) + _T(".tmp");
+	bool ok = false;
+	{
+		FILEPtrHolder fp;
+		if (_tfopen_s(&fp, tmpFile.c_str(), _T("wt, ccs=UTF-8")) != 0)
+			return;
+
+		auto List = [](const std::vector<CSTRING> &v)
+		{
+			TSTRING s;
+			for (auto &item : v)
+			{
+				if (s.length() != 0)
+					s += _T(" ");
+				s += AnsiToTSTRING(item.c_str());
+			}
+			return s;
+		};
+
+		UINT64 time = (static_cast<UINT64>(keyTime.dwHighDateTime) << 32) | keyTime.dwLowDateTime;
+		ok = _ftprintf(fp, _T("%s\npath=%s\nsize=%I64u\nmtime=%I64x\nversion=%hs\nencoders=%s\ninputDevices=%s\n"),
+			cacheSignature, keyPath.c_str(), keySize, time, caps.version.c_str(),
+			List(caps.encoders).c_str(), List(caps.inputDevices).c_str()) > 0;
+	}
+
+	// move the new file into place
+	if (ok)
+		ok = MoveFileEx(tmpFile.c_str(), path, MOVEFILE_REPLACE_EXISTING) != 0;
+	if (!ok)
+		DeleteFile(tmpFile.c_str());
+}
+
+bool FFmpegProbe::RunProbe(const TCHAR *ffmpeg, Capabilities &c)
+{
+	// get the version banner
+	std::string out;
+	if (CaptureEncoder::RunFFmpeg(ffmpeg, _T("-version"), &out, 10000) != 0)
+		return false;
+	static const std::regex versionPat("ffmpeg version (\\S+)", std::regex_constants::icase);
+	std::smatch m;
+	if (std::regex_search(out, m, versionPat))
+		c.version = m[1].str();
+
+	// Parse a list of capabilities, from the "-encoders" or "-devices"
+	// listing.  Both have a legend, then a dashed separator line, then
+	// one line per entry, with the flags, the name, and a description.
+	// The separator is a line of dashes, possibly with leading and
+	// trailing spaces.
+	auto IsSeparator = [](const std::string &line)
+	{
+		size_t i = line.find_first_not_of(" \t\r");
+		size_t j = line.find_last_not_of(" \t\r");
+		return i != std::string::npos && line.find_first_not_of('-', i) > j;
+	};
+	auto ParseList = [ffmpeg, &IsSeparator](const TCHAR *args, const std::regex &pat, std::vector<CSTRING> &v)
+	{
+		std::string out;
+		if (CaptureEncoder::RunFFmpeg(ffmpeg, args, &out, 10000) != 0)
+			return false;
+
+		std::istringstream s(out);
+		std::string line;
+		bool inList = false;
+		std::smatch m;
+		while (std::getline(s, line))
+		{
+			if (!inList)
+				inList = IsSeparator(line);
+			else if (std::regex_search(line, m, pat))
+				v.emplace_back(m[1].str());
+		}
+		return true;
+	};
+
+	// get the encoders and the input (demuxing) devices
+	static const std::regex encoderPat("^\\s*[VAS][A-Z.]{5}\\s+(\\S+)");
+	static const std::regex devicePat("^ D[E ]\\s+(\\S+)");
+	return ParseList(_T("-hide_banner -encoders"), encoderPat, c.encoders)
+		&& ParseList(_T("-hide_banner -devices"), devicePat, c.inputDevices);
+}
+
+DWORD WINAPI FFmpegProbe::RefreshThreadMain(LPVOID)
+{
+	// get the current file key
+	TCHAR ffmpeg[MAX_PATH];
+	GetFFmpegPath(ffmpeg);
+	UINT64 size;
+	FILETIME mtime;
+	if (!GetFileKey(ffmpeg, size, mtime))
+	{
+		LogFile::Get()->Write(LogFile::CaptureLogging, _T("FFmpeg: %s not found\n"), ffmpeg);
+		return 0;
+	}
+
+	// run ffmpeg
+	Capabilities c;
+	DWORD t0 = GetTickCount();
+	if (!RunProbe(ffmpeg, c))
+	{
+		LogFile::Get()->Write(LogFile::CaptureLogging, _T("FFmpeg: unable to run %s to check its capabilities\n"), ffmpeg);
+		return 0;
+	}
+
+	LogFile::Get()->Write(LogFile::CaptureLogging,
+		_T("FFmpeg: probed %s in %u ms: version %hs, %d encoders, %d input devices\n"),
+		ffmpeg, GetTickCount() - t0, c.version.c_str(),
+		static_cast<int>(c.encoders.size()), static_cast<int>(c.inputDevices.size()));
+
+	// install the results and update the cache file
+	CriticalSectionLocker locker(lock);
+	keyPath = ffmpeg;
+	keySize = size;
+	keyTime = mtime;
+	caps = std::move(c);
+	valid = true;
+	SaveCache();
+	return 0;
+}
+
+void FFmpegProbe::RequestRefresh()
+{
+	CriticalSectionLocker locker(lock);
+
+	// make sure we've loaded the cache, and check it against the file
+	LoadCache();
+	if (IsCurrent())
+		return;
+
+	// if a refresh is already running, let it finish
+	if (hRefreshThread != NULL && WaitForSingleObject(hRefreshThread, 0) == WAIT_TIMEOUT)
+		return;
+
+	// start the refresh thread
+	DWORD tid;
+	hRefreshThread = CreateThread(NULL, 0, &RefreshThreadMain, nullptr, 0, &tid);
+	if (hRefreshThread != NULL)
+		SetThreadPriority(hRefreshThread, THREAD_PRIORITY_BELOW_NORMAL);
+}
+
+CSTRING FFmpegProbe::GetVersion()
+{
+	RequestRefresh();
+	CriticalSectionLocker locker(lock);
+	return valid ? caps.version : CSTRING();
+}
+
+bool FFmpegProbe::GetCapabilities(Capabilities &result, DWORD timeout)
+{
+	// start a refresh if needed
+	RequestRefresh();
+
+	// wait for it to finish
+	HANDLE h = NULL;
+	{
+		CriticalSectionLocker locker(lock);
+		if (hRefreshThread != NULL)
+			DuplicateHandle(GetCurrentProcess(), hRefreshThread, GetCurrentProcess(), &h, SYNCHRONIZE, FALSE, 0);
+	}
+	if (h != NULL)
+	{
+		DWORD w = WaitForSingleObject(h, timeout);
+		CloseHandle(h);
+		if (w != WAIT_OBJECT_0)
+			return false;
+	}
+
+	// return the results, if we have them
+	CriticalSectionLocker locker(lock);
+	if (!IsCurrent())
+		return false;
+	result = caps;
+	return true;
+}
+
+void FFmpegProbe::Shutdown()
+{
+	// Give a refresh in progress a moment to finish.  The probe runs are
+	// short, so this only waits at all if we exit right after a capture
+	// setup started one.
+	if (hRefreshThread != NULL)
+		WaitForSingleObject(hRefreshThread, 5000);
+}
@@ -0,0 +1,92 @@
+// This file is part of PinballY
+// Copyright 2018 Michael J Roberts | GPL v3 or later | NO WARRANTY
+//
+// FFmpeg capability probe
+//
+// A few parts of the program need to know what the installed ffmpeg
+// build can do: the About box shows its version, and media capture needs
+// its encoder list (to pick a hardware encoder) and its input device
+// types.  The only way to find out is to run ffmpeg, and ffmpeg.exe is a
+// big program, so on a cold disk, or with an antivirus scanner checking
+// it on every launch, that can take several seconds.
+//
+// So we cache the results in FFmpegProbeCache.txt in the program folder,
+// keyed by the path, size, and modification time of ffmpeg.exe, and only
+// run ffmpeg again when the binary changes.  Loading the cache at startup
+// just reads the small text file.  When the cache is missing or stale,
+// the refresh runs on a background thread, and only when something first
+// asks for the information, which normally means the user is setting up
+// a media capture.
+
+#pragma once
+#include <vector>
+#include "../Utilities/WinUtil.h"
+
+class FFmpegProbe
+{
+public:
+	// ffmpeg capabilities
+	struct Capabilities
+	{
+		CSTRING version;                     // version string, from the "ffmpeg version" banner
+		std::vector<CSTRING> encoders;       // encoder names (e.g., "libx264", "h264_nvenc")
+		std::vector<CSTRING> inputDevices;   // input (demuxing) device types (e.g., "dshow", "gdigrab")
+
+		bool HasEncoder(const CHAR *name) const;
+		bool HasInputDevice(const CHAR *name) const;
+	};
+
+	// Get the path to ffmpeg.exe.  This is always ffmpeg\ffmpeg.exe in a
+	// deployed system, but the development build system has separate
+	// 32-bit and 64-bit copies.
+	static void GetFFmpegPath(TCHAR path[MAX_PATH]);
+
+	// Load the cache file.  Call this at startup.  This doesn't run ffmpeg.
+	static void LoadCache();
+
+	// Start a background refresh if the cached results don't match the
+	// current ffmpeg.exe.  This returns immediately.
+	static void RequestRefresh();
+
+	// Get the version string, or an empty string if we don't know it yet.
+	// This requests a refresh if needed, but doesn't wait for it.
+	static CSTRING GetVersion();
+
+	// Get the capabilities, refreshing them first if needed, and waiting
+	// up to 'timeout' milliseconds for the refresh.  Returns false if the
+	// results aren't available, because ffmpeg couldn't be run or the
+	// wait timed out.  This can block for several seconds, so it should
+	// only be called from background threads.
+	static bool GetCapabilities(Capabilities &caps, DWORD timeout);
+
+	// Shut down: wait briefly for a refresh in progress.  Call at exit.
+	static void Shutdown();
+
+protected:
+	// get the ffmpeg.exe cache key (size and modification time)
+	static bool GetFileKey(const TCHAR *path, UINT64 &size, FILETIME &mtime);
+
+	// do the cached results match the current file?  Call with the lock held.
+	static bool IsCurrent();
+
+	// run ffmpeg and collect the capabilities
+	static bool RunProbe(const TCHAR *ffmpeg, Capabilities &caps);
+
+	// save the cache file
+	static void SaveCache();
+
+	// refresh thread entrypoint
+	static DWORD WINAPI RefreshThreadMain(LPVOID);
+
+	// Results.  These are protected by the lock.
+	static CriticalSection lock;
+	static bool loaded;              // have we loaded the cache file yet?
+	static bool valid;               // do we have results for the key below?
+	static TSTRING keyPath;          // ffmpeg.exe path for the results
+	static UINT64 keySize;           // ffmpeg.exe size for the results
+	static FILETIME keyTime;         // ffmpeg.exe modification time for the results
+	static Capabilities caps;        // the results
+
+	// refresh thread; null if no refresh has been started
+	static HandleHolder hRefreshThread;
+};
@@ -0,0 +1,89 @@
+// This file is part of PinballY
+// Copyright 2018 Michael J Roberts | GPL v3 or later | NO WARRANTY
+//
+// Font cache
+
+#include "stdafx.h"
+#include "../Utilities/GraphicsUtil.h"
+#include "FontCache.h"
+
+// statics
+CacheHitStats FontCache::hitStats;
+std::list<FontCache::Entry> FontCache::entries;
+std::unordered_map<TSTRING, std::list<FontCache::Entry>::iterator> FontCache::index;
+CriticalSection FontCache::lock;
+
+std::shared_ptr<void> FontCache::FindOrCreate(const TSTRING &key, std::function<std::shared_ptr<void>()> create)
+{
+	CriticalSectionLocker locker(lock);
+
+	// look for an existing entry
+	if (auto it = index.find(key); it != index.end())
+	{
+		// found it - move it to the front of the MRU list and return it
+		hitStats.Hit();
+		entries.splice(entries.begin(), entries, it->second);
+		return it->second->obj;
+	}
+
+	// not cached - create a new object
+	hitStats.Miss();
+	auto obj = create();
+	if (obj == nullptr)
+		return obj;
+
+	// Drop the least recently used entry if the cache is full.  Anyone
+	// still using the object keeps their own reference, so this only
+	// deletes it if it's not in use.
+	if (entries.size() >= maxEntries)
+	{
+		index.erase(entries.back().key);
+		entries.pop_back();
+	}
+
+	// add the new entry
+	entries.emplace_front(key, obj);
+	index.emplace(key, entries.begin());
+	return obj;
+}
+
+std::shared_ptr<Gdiplus::Font> FontCache::GetGPFont(const TCHAR *family, int ptSize, int weight, bool italic)
+{
+	// Key on the GDI+ style rather than the raw weight, since every weight
+	// from 700 up maps to the same bold font
+	bool bold = weight >= 700;
+	TSTRING key = MsgFmt(_T("gp.pt.%d.%d%d.%s"), ptSize, bold, italic, family).Get();
+	return std::static_pointer_cast<Gdiplus::Font>(FindOrCreate(key, [family, ptSize, weight, italic]() {
+		return std::shared_ptr<void>(std::shared_ptr<Gdiplus::Font>(CreateGPFont(family, ptSize, weight, italic))); }));
+}
+
+std::shared_ptr<Gdiplus::Font> FontCache::GetGPFontPixHt(const TCHAR *family, int pixHeight, Gdiplus::FontStyle style)
+{
+	TSTRING key = MsgFmt(_T("gp.px.%d.%d.%s"), pixHeight, static_cast<int>(style), family).Get();
+	return std::static_pointer_cast<Gdiplus::Font>(FindOrCreate(key, [family, pixHeight, style]() {
+		return std::shared_ptr<void>(std::shared_ptr<Gdiplus::Font>(CreateGPFontPixHt(family, pixHeight, style))); }));
+}
+
+FontCache::GDIFontRef FontCache::GetGDIFont(const LOGFONT &lf)
+{
+	TSTRING key = MsgFmt(_T("gdi.%ld.%ld.%ld.%ld.%ld.%d.%d.%d.%d.%d.%d.%d.%d.%.*s"),
+		lf.lfHeight, lf.lfWidth, lf.lfEscapement, lf.lfOrientation, lf.lfWeight,
+		lf.lfItalic, lf.lfUnderline, lf.lfStrikeOut, lf.lfCharSet, lf.lfOutPrecision,
+		lf.lfClipPrecision, lf.lfQuality, lf.lfPitchAndFamily,
+		static_cast<int>(countof(lf.lfFaceName)), lf.lfFaceName).Get();
+	return std::static_pointer_cast<GDIFontRef::element_type>(FindOrCreate(key, [&lf]() -> std::shared_ptr<void>
+	{
+		HFONT hFont = CreateFontIndirect(&lf);
+		if (hFont == NULL)
+			return nullptr;
+
+		return GDIFontRef(hFont, [](HFONT h) { DeleteObject(h); });
+	}));
+}
+
+void FontCache::Clear()
+{
+	CriticalSectionLocker locker(lock);
+	index.clear();
+	entries.clear();
+}
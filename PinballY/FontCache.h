@@ -0,0 +1,79 @@
+// This file is part of PinballY
+// Copyright 2018 Michael J Roberts | GPL v3 or later | NO WARRANTY
+//
+// Font cache
+//
+// Most of our text drawing goes through GDI+ fonts, and most of the
+// drawing code creates its fonts on the spot: each popup creates its
+// fonts every time it's drawn, and the font preferences recreate theirs
+// whenever the settings are reloaded.  Creating a GDI+ font isn't free,
+// since it means looking up the family by name, possibly working through
+// a list of names and style variations to find one that's installed
+// (see CreateGPFont()).  This cache keeps one shared font object per
+// descriptor for the whole process, so that the same face is only
+// instantiated once.
+//
+// Fonts are handed out as std::shared_ptr references, so a font stays
+// alive as long as anyone's using it, even if the cache has dropped it
+// in the meantime.  The cache keeps the most recently used entries, up
+// to a fixed limit.
+//
+// GDI fonts (HFONT) are cached the same way, keyed by the LOGFONT.
+// DirectWrite text formats already have a shared cache of their own,
+// in DirectWriteUtils::GetTextFormat().
+//
+// A GDI+ object can't be used on two threads at the same time, so the
+// cached fonts are only for drawing on the UI thread.  Code that draws
+// on a background thread should create its own fonts.
+
+#pragma once
+#include <list>
+#include <memory>
+#include <unordered_map>
+#include <gdiplus.h>
+#include "../Utilities/WinUtil.h"
+#include "CacheStats.h"
+
+class FontCache
+{
+public:
+	// Get a GDI+ font by point size, as with CreateGPFont()
+	static std::shared_ptr<Gdiplus::Font> GetGPFont(const TCHAR *family, int ptSize, int weight, bool italic);
+
+	// Get a GDI+ font by pixel height, as with CreateGPFontPixHt()
+	static std::shared_ptr<Gdiplus::Font> GetGPFontPixHt(const TCHAR *family, int pixHeight, Gdiplus::FontStyle style);
+
+	// Get a GDI font.  The font is deleted when the last reference is
+	// released, so the caller must not delete the handle.
+	typedef std::shared_ptr<std::remove_pointer<HFONT>::type> GDIFontRef;
+	static GDIFontRef GetGDIFont(const LOGFONT &lf);
+
+	// Clear the cache.  The application must call this at exit, before
+	// shutting down GDI+.
+	static void Clear();
+
+	// hit statistics, for the performance overlay
+	static CacheHitStats hitStats;
+
+protected:
+	// Find an entry, or create it via the callback if it's not in the
+	// cache.  Entries of all types share the cache, so each entry holds
+	// an untyped reference, and each type's keys have their own prefix.
+	static std::shared_ptr<void> FindOrCreate(const TSTRING &key, std::function<std::shared_ptr<void>()> create);
+
+	// Cache entry
+	struct Entry
+	{
+		Entry(const TSTRING &key, std::shared_ptr<void> obj) : key(key), obj(obj) { }
+		TSTRING key;
+		std::shared_ptr<void> obj;
+	};
+
+	// Entries, in most-recently-used order, with an index by key
+	static std::list<Entry> entries;
+	static std::unordered_map<TSTRING, std::list<Entry>::iterator> index;
+	static const size_t maxEntries = 128;
+
+	// cache lock
+	static CriticalSection lock;
+};
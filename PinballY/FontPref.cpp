@@ -1,6 +1,7 @@
 #include "stdafx.h"
 #include "../Utilities/Config.h"
 #include "FontPref.h"
+#include "FontCache.h"
 
 void FontPref::Parse(const TCHAR *text, const TCHAR *globalDefaultFamily, bool useDefaults)
 {
@@ -136,7 +137,7 @@ void FontPref::ParseConfig(const TCHAR *varname, const TCHAR *globalDefaultFamil
 Gdiplus::Font* FontPref::Get()
 {
 	if (font == nullptr)
-		font.reset(CreateGPFont(family.c_str(), ptSize, weight, italic));
+		font = FontCache::GetGPFont(family.c_str(), ptSize, weight, italic);
 
 	return font.get();
 }
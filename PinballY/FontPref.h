@@ -72,6 +72,8 @@ struct FontPref
 	operator Gdiplus::Font*() { return Get(); }
 	Gdiplus::Font* operator->() { return Get(); }
 
-	// cached font
-	std::unique_ptr<Gdiplus::Font> font;
+	// Cached font.  This is a reference to the shared font from the
+	// FontCache, so a settings reload that leaves the font unchanged
+	// gets the same font object back.
+	std::shared_ptr<Gdiplus::Font> font;
 };
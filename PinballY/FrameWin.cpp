@@ -13,6 +13,7 @@
 #include "Application.h"
 #include "MouseButtons.h"
 #include "LogFile.h"
+#include "FontCache.h"
 
 #pragma comment(lib, "Dwmapi.lib")
 #pragma comment(lib, "Uxtheme.lib")
@@ -1100,6 +1101,10 @@ void FrameWin::OnMove(POINT pos)
 
 	// save position changes to the config
 	WindowPosToConfig();
+
+	// if we've moved to another monitor, check its video adapter
+	if (auto d3dView = dynamic_cast<D3DView*>(view.Get()); d3dView != nullptr)
+		d3dView->CheckRenderAdapter();
 }
 
 void FrameWin::OnResize(int width, int height)
@@ -1495,15 +1500,14 @@ void FrameWin::PaintCaption(HDC hdc)
 				DttOpts.dwFlags = DTT_COMPOSITED | DTT_GLOWSIZE;
 				DttOpts.iGlowSize = 15;
 
-				// Select the theme font
+				// Select the theme font.  This comes from the shared font
+				// cache, so we don't create a new font on every paint.
 				LOGFONT lgFont;
-				HFONT hFont = NULL;
+				FontCache::GDIFontRef hFont;
 				HFONT hFontOld = NULL;
-				if (SUCCEEDED(GetThemeSysFont(hTheme, TMT_CAPTIONFONT, &lgFont)))
-				{
-					hFont = CreateFontIndirect(&lgFont);
-					hFontOld = (HFONT)SelectObject(hdcPaint, hFont);
-				}
+				if (SUCCEEDED(GetThemeSysFont(hTheme, TMT_CAPTIONFONT, &lgFont))
+					&& (hFont = FontCache::GetGDIFont(lgFont)) != nullptr)
+					hFontOld = (HFONT)SelectObject(hdcPaint, hFont.get());
 
 				// Draw the caption
 				RECT rcPaint = rcClient;
@@ -1522,10 +1526,7 @@ void FrameWin::PaintCaption(HDC hdc)
 
 				// clean up the temporary DC
                 if (hFontOld != NULL)
-                {
                     SelectObject(hdcPaint, hFontOld);
-                    DeleteObject(hFont);
-                }
                 SelectObject(hdcPaint, hbmOld);
 				DeleteObject(hbm);
 			}
@@ -0,0 +1,194 @@
+// This file is part of PinballY
+// Copyright 2018 Michael J Roberts | GPL v3 or later | NO WARRANTY
+//
+// GPU Timer
+
+#include "stdafx.h"
+#include "GPUTimer.h"
+#include "D3D.h"
+
+GPUTimer::GPUTimer() : curSet(0), inFrame(false)
+{
+	Reset();
+}
+
+void GPUTimer::Reset()
+{
+	nFrames = 0;
+	total_ms = 0.0;
+	max_ms = 0.0f;
+	groupTotals.clear();
+}
+
+void GPUTimer::ReleaseQueries()
+{
+	for (auto &q : querySets)
+	{
+		q.disjoint = nullptr;
+		for (auto &t : q.ts)
+			t = nullptr;
+		q.nMarks = 0;
+		q.pending = false;
+	}
+	inFrame = false;
+}
+
+void GPUTimer::BeginFrame()
+{
+	// read back any completed results
+	Collect();
+
+	// if the next query set is still waiting for results, skip this frame
+	QuerySet &q = querySets[curSet];
+	inFrame = false;
+	if (q.pending)
+		return;
+
+	// create the disjoint query if we haven't already
+	if (q.disjoint == nullptr)
+	{
+		D3D11_QUERY_DESC desc = { D3D11_QUERY_TIMESTAMP_DISJOINT, 0 };
+		if (FAILED(D3D::Get()->GetDevice()->CreateQuery(&desc, &q.disjoint)))
+			return;
+	}
+
+	// start the disjoint query, and start the frame with an unnamed group
+	{
+		D3D::DeviceContextLocker ctx;
+		ctx->Begin(q.disjoint);
+	}
+	q.nMarks = 0;
+	inFrame = true;
+	Mark("");
+}
+
+void GPUTimer::Mark(const char *group)
+{
+	// ignore this if we're not timing the frame, we're out of marks, or
+	// the group isn't changing
+	QuerySet &q = querySets[curSet];
+	if (!inFrame || q.nMarks >= maxMarks
+		|| (q.nMarks != 0 && strcmp(q.groups[q.nMarks - 1], group) == 0))
+		return;
+
+	// timestamp the start of the group
+	if (Timestamp(q, q.nMarks))
+		q.groups[q.nMarks++] = group;
+}
+
+void GPUTimer::EndFrame()
+{
+	// ignore this if we're not timing the frame
+	if (!inFrame)
+		return;
+
+	// timestamp the end of the last group, and end the disjoint query
+	QuerySet &q = querySets[curSet];
+	Timestamp(q, q.nMarks);
+	{
+		D3D::DeviceContextLocker ctx;
+		ctx->End(q.disjoint);
+	}
+
+	// the set is now awaiting results; move on to the next set
+	q.pending = true;
+	inFrame = false;
+	curSet = (curSet + 1) % nQuerySets;
+}
+
+bool GPUTimer::Timestamp(QuerySet &q, int index)
+{
+	// create the query if we haven't already
+	if (q.ts[index] == nullptr)
+	{
+		D3D11_QUERY_DESC desc = { D3D11_QUERY_TIMESTAMP, 0 };
+		if (FAILED(D3D::Get()->GetDevice()->CreateQuery(&desc, &q.ts[index])))
+			return false;
+	}
+
+	// issue the timestamp
+	D3D::DeviceContextLocker ctx;
+	ctx->End(q.ts[index]);
+	return true;
+}
+
+void GPUTimer::Collect()
+{
+	// check the pending query sets, oldest first
+	D3D::DeviceContextLocker ctx;
+	for (int i = 0; i < nQuerySets; ++i)
+	{
+		QuerySet &q = querySets[(curSet + i) % nQuerySets];
+		if (!q.pending)
+			continue;
+
+		// Check the disjoint query.  If it's not ready, the later sets
+		// won't be either, so we can stop here.  Don't flush; we'll check
+		// again on the next frame.
+		D3D11_QUERY_DATA_TIMESTAMP_DISJOINT dj;
+		if (ctx->GetData(q.disjoint, &dj, sizeof(dj), D3D11_ASYNC_GETDATA_DONOTFLUSH) != S_OK)
+			break;
+
+		// If any of the timestamp queries couldn't be created, the frame
+		// is incomplete, so discard it and free the set for reuse.
+		bool complete = q.nMarks != 0;
+		for (int j = 0; j <= q.nMarks && complete; ++j)
+			complete = q.ts[j] != nullptr;
+		if (!complete)
+		{
+			q.pending = false;
+			continue;
+		}
+
+		// read the timestamps
+		UINT64 ts[maxMarks + 1];
+		bool ok = true;
+		for (int j = 0; j <= q.nMarks && ok; ++j)
+			ok = ctx->GetData(q.ts[j], &ts[j], sizeof(ts[j]), D3D11_ASYNC_GETDATA_DONOTFLUSH) == S_OK;
+		if (!ok)
+			break;
+
+		// the set is now free for reuse
+		q.pending = false;
+
+		// if the timestamps were disjoint (e.g., due to a GPU clock change),
+		// the results are meaningless, so discard them
+		if (dj.Disjoint || dj.Frequency == 0)
+			continue;
+
+		// add the frame time to the totals
+		double toMs = 1000.0 / double(dj.Frequency);
+		float frame_ms = float(double(ts[q.nMarks] - ts[0]) * toMs);
+		++nFrames;
+		total_ms += frame_ms;
+		if (frame_ms > max_ms)
+			max_ms = frame_ms;
+
+		// add the group times to the totals
+		for (int j = 0; j < q.nMarks; ++j)
+		{
+			// skip the unnamed group at the start of the frame
+			if (q.groups[j][0] == 0)
+				continue;
+
+			// find or add the group total
+			auto it = std::find_if(groupTotals.begin(), groupTotals.end(),
+				[&q, j](const GroupTotal &g) { return strcmp(g.name, q.groups[j]) == 0; });
+			if (it == groupTotals.end())
+				it = groupTotals.insert(groupTotals.end(), { q.groups[j], 0.0 });
+
+			// add this group's time
+			it->total_ms += double(ts[j + 1] - ts[j]) * toMs;
+		}
+	}
+}
+
+void GPUTimer::GetStats(Stats &stats) const
+{
+	stats.nFrames = nFrames;
+	stats.avg_ms = nFrames != 0 ? float(total_ms / nFrames) : 0.0f;
+	stats.max_ms = max_ms;
+	stats.groups.clear();
+	for (auto &g : groupTotals)
+		stats.groups.push_back({ g.name, nFrames != 0 ? float(g.total_ms / nFrames) : 0.0f });
+}
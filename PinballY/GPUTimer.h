@@ -0,0 +1,112 @@
+// This file is part of PinballY
+// Copyright 2018 Michael J Roberts | GPL v3 or later | NO WARRANTY
+//
+// GPU Timer
+//
+// This measures the GPU time spent rendering a frame, using D3D11
+// timestamp queries.  The caller brackets each frame with BeginFrame()
+// and EndFrame(), and can subdivide the frame into named groups with
+// Mark().  Each Mark() call ends the current group and starts a new
+// one, so the caller can simply mark each sprite with its shader type
+// as it's drawn, and consecutive sprites using the same shader are
+// timed together.
+//
+// GPU queries complete asynchronously, some time after the CPU submits
+// the rendering commands, so we keep a small ring of query sets, and
+// read back the results for each frame a few frames later.  We never
+// wait for a query to complete; if all of the query sets in the ring
+// are still pending when a new frame starts, we simply skip timing
+// that frame.
+//
+// This must only be used on the main UI thread, since it uses the D3D
+// device context.
+
+#pragma once
+#include <vector>
+#include <d3d11_1.h>
+#include "../Utilities/Pointers.h"
+
+class GPUTimer
+{
+public:
+	GPUTimer();
+
+	// Begin/end timing a frame
+	void BeginFrame();
+	void EndFrame();
+
+	// Start a new timing group within the frame.  The group name must be
+	// a static string, since we keep a reference to it until the results
+	// are read back.  This does nothing if the group is the same as the
+	// current group.
+	void Mark(const char *group);
+
+	// Statistics.  These are accumulated over the frames completed since
+	// the last reset.
+	struct Stats
+	{
+		int64_t nFrames;		// number of frames timed
+		float avg_ms;			// average GPU time per frame, in milliseconds
+		float max_ms;			// maximum GPU time per frame
+
+		// average GPU time per frame for each group
+		struct Group
+		{
+			const char *name;
+			float avg_ms;
+		};
+		std::vector<Group> groups;
+	};
+	void GetStats(Stats &stats) const;
+
+	// reset the statistics
+	void Reset();
+
+	// Release the queries, abandoning any pending results.  Call this
+	// when the D3D device is being replaced; the queries are re-created
+	// on the new device as needed.
+	void ReleaseQueries();
+
+protected:
+	// read back the results for completed query sets
+	void Collect();
+
+	// maximum number of group marks per frame
+	static const int maxMarks = 32;
+
+	// Query set for one frame.  The disjoint query brackets the frame
+	// and gives us the timestamp frequency.  Timestamp i marks the start
+	// of group i, and the end of group i-1; the final timestamp marks
+	// the end of the frame.
+	struct QuerySet
+	{
+		QuerySet() : nMarks(0), pending(false) { }
+		RefPtr<ID3D11Query> disjoint;
+		RefPtr<ID3D11Query> ts[maxMarks + 1];
+		const char *groups[maxMarks];
+		int nMarks;
+		bool pending;
+	};
+
+	// ring of query sets, and the index of the set for the frame in progress
+	static const int nQuerySets = 4;
+	QuerySet querySets[nQuerySets];
+	int curSet;
+
+	// are we timing the current frame?
+	bool inFrame;
+
+	// issue a timestamp query for the current set
+	bool Timestamp(QuerySet &q, int index);
+
+	// accumulated totals since the last reset
+	int64_t nFrames;
+	double total_ms;
+	float max_ms;
+	struct GroupTotal
+	{
+		const char *name;
+		double total_ms;
+	};
+	std::vector<GroupTotal> groupTotals;
+};
@@ -15,7 +15,11 @@
 #include "GameList.h"
 #include "Application.h"
 #include "LogFile.h"
+#include "MediaFileIndex.h"
+#include "LoaderPool.h"
+#include "BackgroundFileWriter.h"
 #include "DialogResource.h"
+#include "Trace.h"
 
 #include "../Utilities/std_filesystem.h"
 namespace fs = std::filesystem;
@@ -44,6 +48,7 @@ namespace ConfigVars
 	static const TCHAR *CurFilter = _T("GameList.CurrentFilter");
 	static const TCHAR *EmptyCategories = _T("GameList.EmptyCategories");
 	static const TCHAR *PagingMode = _T("GameList.PagingMode");
+	static const TCHAR *LazyXml = _T("GameList.LazyXml");
 };
 
 void GameList::Create()
@@ -157,6 +162,9 @@ void GameList::Init(ErrorHandler &eh)
 	// get the expanded media path
 	mediaPath = GetDataFilePath(ConfigVars::MediaPath, _T("Media"), IDS_DEFAULT_MEDIA_PATH_PROMPT, eh);
 
+	// start indexing the global media folders in the background
+	PrefetchGlobalMedia();
+
 	// Find the game stats database file.  If a path override was set on
 	// the command line, use that, otherwise look in the program folder.
 	auto const &gameStatsPath = Application::Get()->gameStatsPath;
@@ -167,12 +175,25 @@ void GameList::Init(ErrorHandler &eh)
 	else
 		GetDeployedFilePath(statsFile, fname, _T(""));
 
-	// remember it
+	// remember it, and set up its journal alongside it
 	statsDb.SetFile(statsFile);
+	statsDb.SetJournalFile((TSTRING(statsFile) + _T(".journal")).c_str());
 
 	// load the game stats database, if it exists
 	if (FileExists(statsFile))
+	{
+		ULONGLONG t0 = GetTickCount64();
 		statsDb.Read(SilentErrorHandler());
+		Log(_T("Game stats database loaded: %d rows, %d ms\n"),
+			static_cast<int>(statsDb.GetNumRows()), static_cast<int>(GetTickCount64() - t0));
+	}
+
+	// Apply any journaled updates that didn't make it into the file,
+	// such as the play stats from the last session if the power was
+	// switched off before it saved.  The replay marks the database as
+	// dirty, so the next save compacts the journal into the file.
+	if (int nReplayed = statsDb.ReplayJournal(); nReplayed != 0)
+		Log(_T("Game stats journal: %d updates replayed\n"), nReplayed);
 
 	// initialize the stats database
 	size_t nRows = statsDb.GetNumRows();
@@ -257,18 +278,24 @@ void GameList::SaveConfig()
 		cfg->Set(ConfigVars::PagingMode, _T("Default"));
 }
 
-void GameList::SaveStatsDb()
+void GameList::CommitStatsJournal()
 {
-	SilentErrorHandler eh;
-	statsDb.WriteIfDirty(eh);
+	LogFileErrorHandler eh(_T("Game stats journal: "));
+	statsDb.CommitJournal(eh);
 }
 
-void GameList::SaveGameListFiles()
+void GameList::SaveStatsDb()
 {
-	// set up a capturing error handler
-	CapturingErrorHandler eh;
+	// bring the category list text up to date before saving
+	SyncCategoryLists();
+	statsDb.WriteIfDirtyInBackground();
+}
 
+bool GameList::SaveGameListFiles(bool flush)
+{
 	// scan the filter list for systems
+	bool heldBack = false;
+	DWORD now = GetTickCount();
 	for (auto f : filters)
 	{
 		if (auto sys = dynamic_cast<GameSystem*>(f); sys != nullptr)
@@ -277,29 +304,45 @@ void GameList::SaveGameListFiles()
 			// files and save any changes.
 			for (auto &d : sys->dbFiles)
 			{
-				if (d->isDirty)
+				// Check the result of the last background write.  If it
+				// failed, the in-memory data is still the only current copy,
+				// so mark the file dirty again to retry the write.  The failure
+				// might have come before the backup copy was made, so make the
+				// backup on the retry.  In the lazy XML mode, we keep the
+				// document until the write succeeds, since it holds the only
+				// copy of the changes until then.
+				switch (d->writeStatus->load())
+				{
+				case GameDatabaseFile::WritePending:
+					// check again later if the document is waiting for release
+					if (lazyDatabaseXml && !d->keepXml)
+						heldBack = true;
+					break;
+
+				case GameDatabaseFile::WriteFailed:
+					*d->writeStatus = GameDatabaseFile::WriteIdle;
+					d->isDirty = true;
+					d->isBackedUp = false;
+					break;
+
+				case GameDatabaseFile::WriteOK:
+					*d->writeStatus = GameDatabaseFile::WriteIdle;
+					if (lazyDatabaseXml && !d->keepXml && !d->isDirty && d->xmlLoaded)
+						ReleaseDbFileXml(d.get());
+					break;
+				}
+
+				// If the file has had games moved in or out recently, more
+				// moves are likely to follow, so leave it for a later save,
+				// rather than rewriting the whole file for each move.
+				if (d->isDirty && !flush && d->lastMoveTime != 0 && now - d->lastMoveTime < dbMoveSettleTime)
 				{
-					// If the destination folder doesn't exist, create it
-					TCHAR dir[MAX_PATH];
-					_tcscpy_s(dir, d->filename.c_str());
-					PathRemoveFileSpec(dir);
-					if (!DirectoryExists(dir))
-						CreateSubDirectory(dir, NULL, NULL);
-
-					// Write the XML file.  Do this in two stages:  first, write the
-					// contents to a temp file in the same folder, with the same name
-					// as the XML file but with ~ appended to the name.  Then delete
-					// the original file and rename the temp file to replace it.  The
-					// staged procedure is to reduce the chances of corrupting or
-					// losing the original file data: if anything goes wrong while
-					// writing the XML, the temp file is the only thing affected, as
-					// we haven't even touched the original file yet.  We'll only
-					// replace the original file after we're sure that the new file
-					// has been successfully written.
-					TSTRING tmpfile = d->filename + _T("~");
-					std::ofstream os;
-					os.open(tmpfile.c_str());
+					heldBack = true;
+					continue;
+				}
 
+				if (d->isDirty)
+				{
 					// If desired, sort alphabetically by game title
 					if (ConfigManager::GetInstance()->GetBool(_T("SortTableDatabases")))
 					{
@@ -342,109 +385,150 @@ void GameList::SaveGameListFiles()
 						}
 					}
 
-					// Print the XML.  The PinballX game list editor wrote empty tags
-					// as full begin-end tag pairs ("<tag></tag>", rather than using 
-					// the more typical XML empty-tag shorthand "<tag/>".  So we'll
-					// do the same thing just to minimize the amount of change we
-					// introduce when rewriting files.  This will also make sure that
+					// Format the XML in memory.  The PinballX game list editor wrote
+					// empty tags as full begin-end tag pairs ("<tag></tag>", rather
+					// than using the more typical XML empty-tag shorthand "<tag/>".
+					// So we'll do the same thing just to minimize the amount of change
+					// we introduce when rewriting files.  This will also make sure that
 					// the files remain PinballX compatible even after we've mucked
 					// with them, in case someone tries this program and decides to
 					// switch back after all.  (PinballX doesn't seem to have any
 					// problem reading back the "<tag/>" format, but just in case.)
-					rapidxml::print<char>(os, d->doc, rapidxml::print_expand_empty_tags | rapidxml::print_no_apos);
-					os.close();
+					std::string xml;
+					rapidxml::print<char>(std::back_inserter(xml), d->doc, rapidxml::print_expand_empty_tags | rapidxml::print_no_apos);
 
-					// check for errors
-					if (!os.good())
+					// Expand the newlines to CR-LF, as a text-mode file write would.
+					std::vector<BYTE> contents;
+					contents.reserve(xml.length() + xml.length() / 16);
+					for (char c : xml)
 					{
-						// write failed - report a file write error on the temp file
-						eh.Error(MsgFmt(IDS_ERR_WRITEFILE, tmpfile.c_str(), FileErrorMessage(errno).c_str()));
-
-						// Delete the temp file, if possible, but ignore errors.  If
-						// this fails, the worst that happens is that we leave behind
-						// a harmless extra file.  Plus, the name should suggest to the 
-						// user that it's a temp file, as most of the MSFT productivity 
-						// applications use the same naming convention.  So the user
-						// will likely know that they can safely hand-delete it if
-						// they ever even notice that it's there, and if not, that's
-						// fine too; it'll just take up a small amount of disk space
-						// in the meantime.
-						DeleteFile(tmpfile.c_str());
+						if (c == '\n')
+							contents.push_back('\r');
+						contents.push_back(static_cast<BYTE>(c));
 					}
-					else
-					{
-						// Success - replace the original file with the temp file.
-						//
-						// If this is the first time we've written the file during this
-						// session, rename the original file as a backup copy, just in
-						// case anything got screwed up in our update.  Do this only
-						// once per session, as we might save several copies, and it
-						// would defeat the purpose to save our own intermediate
-						// updates as backups.
-						TSTRING backup = d->filename + _T(".bak");
-						bool ok = true;
-						if (d->isBackedUp)
-						{
-							// We've already done a backup, so just delete any
-							// existing copy of the final file.
-							DeleteFile(d->filename.c_str());
-						}
-						else if (FileExists(d->filename.c_str()))
-						{
-							// We haven't done a backup yet, and the original file
-							// exists, so rename it as a backup.  Delete any prior
-							// backup first so that the rename succeeds.
-							DeleteFile(backup.c_str());
-							if (!MoveFile(d->filename.c_str(), backup.c_str()))
-							{
-								// rename original as backup failed
-								WindowsErrorMessage winerr;
-								eh.Error(MsgFmt(IDS_ERR_MOVEFILE, d->filename.c_str(), backup.c_str(), winerr.Get()));
-								ok = false;
-							}
-						}
 
-						// If all is well, rename the temp file as the actual file
-						if (ok)
-						{
-							// note that we've done our backup
-							d->isBackedUp = true;
+					// Queue the write on the background writer.  The writer replaces
+					// the file through a temp file, so that a failure while writing
+					// can't corrupt or lose the original file data.  If this is the
+					// first time we've written the file during this session, keep
+					// the original file as a backup copy, just in case anything got
+					// screwed up in our update.  Do this only once per session, as
+					// we might save several copies, and it would defeat the purpose
+					// to save our own intermediate updates as backups.  The writer's
+					// completion callback records the outcome, which we check on the
+					// next save.
+					*d->writeStatus = GameDatabaseFile::WritePending;
+					BackgroundFileWriter::Write(d->filename.c_str(), std::move(contents),
+						!d->isBackedUp, MsgFmt(IDS_ERR_SAVEGAMELIST),
+						[writeStatus = d->writeStatus](bool ok) {
+							*writeStatus = ok ? GameDatabaseFile::WriteOK : GameDatabaseFile::WriteFailed; });
+
+					// The in-memory data is now committed.  Any error on the write
+					// will be reported when the writer gets to it, and the file will
+					// be marked dirty again on the next save.
+					d->isBackedUp = true;
+					d->isDirty = false;
+
+					// In the lazy XML mode, come back after the write completes to
+					// release the document.
+					if (lazyDatabaseXml && !d->keepXml)
+						heldBack = true;
+				}
+			}
+		}
+	}
 
-							// rename the file
-							if (!MoveFile(tmpfile.c_str(), d->filename.c_str()))
-							{
-								// rename temp as original failed
-								WindowsErrorMessage winerr;
-								eh.Error(MsgFmt(IDS_ERR_MOVEFILE, tmpfile.c_str(), d->filename.c_str(), winerr.Get()));
-								ok = false;
-							}
-						}
+	// tell the caller if there's more to save later
+	return heldBack;
+}
 
-						// check how that all went
-						if (ok)
-						{
-							// success - the on-disk version is now in sync with the
-							// in-memory data
-							d->isDirty = false;
-						}
-						else
-						{
-							// failed - delete the temp file (if it still exists) so 
-							// that we don't leave cruft behind
-							DeleteFile(tmpfile.c_str());
-						}
-					}
-				}
+void GameList::NoteDbFileMove(GameDatabaseFile *dbFile)
+{
+	// GetTickCount() can be 0 at the rollover, but 0 means "no moves"
+	if (dbFile != nullptr)
+		dbFile->lastMoveTime = max(GetTickCount(), 1UL);
+}
+
+bool GameList::LoadDbFileXml(GameDatabaseFile *dbFile)
+{
+	// if the document is already loaded, there's nothing to do
+	if (dbFile->xmlLoaded)
+		return true;
+
+	// If we released the document after a save, the write might still
+	// be pending, so wait for it, to make sure that we read back the
+	// current contents.
+	BackgroundFileWriter::Flush();
+
+	// load the file
+	LogFileErrorHandler eh(_T("Loading table database file on demand: "));
+	TSTRING filename = dbFile->filename;
+	if (!dbFile->Load(filename.c_str(), eh))
+	{
+		dbFile->ReleaseXml();
+		return false;
+	}
+
+	// enumerate the <game> nodes, so that we can find them by ordinal
+	typedef xml_node<char> node;
+	std::vector<node*> nodes;
+	if (node *menu = dbFile->doc.first_node("menu"); menu != nullptr)
+	{
+		for (node *game = menu->first_node("game"); game != 0; game = game->next_sibling("game"))
+			nodes.push_back(game);
+	}
+
+	// Reconnect the file's games to their nodes.  Check each node's name
+	// against the game's table file name, in case the file was modified
+	// outside of the program since we read it; a game whose node doesn't
+	// match is treated as having no XML record.
+	for (auto &g : games)
+	{
+		if (g.dbFile == dbFile && g.gameXmlNodeIndex >= 0)
+		{
+			if (static_cast<size_t>(g.gameXmlNodeIndex) < nodes.size())
+			{
+				node *n = nodes[g.gameXmlNodeIndex];
+				if (auto nameAttr = n->first_attribute("name"); nameAttr != nullptr
+					&& _tcsicmp(AnsiToTSTRING(nameAttr->value()).c_str(), g.filename.c_str()) == 0)
+					g.gameXmlNode = n;
+				else
+					Log(_T("Table database file %s has changed since it was loaded; XML record for %s not found\n"),
+						dbFile->filename.c_str(), g.filename.c_str());
 			}
+			g.gameXmlNodeIndex = -1;
 		}
 	}
 
-	// if we caught any errors, report them
-	if (eh.CountErrors() != 0)
+	// success
+	return true;
+}
+
+void GameList::ReleaseDbFileXml(GameDatabaseFile *dbFile)
+{
+	// note the ordinal of each <game> node in the document
+	typedef xml_node<char> node;
+	std::unordered_map<const node*, int> ordinals;
+	if (node *menu = dbFile->doc.first_node("menu"); menu != nullptr)
+	{
+		int i = 0;
+		for (node *game = menu->first_node("game"); game != 0; game = game->next_sibling("game"), ++i)
+			ordinals.emplace(game, i);
+	}
+
+	// switch the file's games from their nodes to the node ordinals
+	for (auto &g : games)
 	{
-		Application::InUiErrorHandler uieh;
-		uieh.GroupError(ErrorIconType::EIT_Error, MsgFmt(IDS_ERR_SAVEGAMELIST), eh);
+		if (g.dbFile == dbFile)
+		{
+			auto it = g.gameXmlNode != nullptr ? ordinals.find(g.gameXmlNode) : ordinals.end();
+			g.gameXmlNodeIndex = it != ordinals.end() ? it->second : -1;
+			g.gameXmlNode = nullptr;
+		}
 	}
+
+	// release the document
+	dbFile->ReleaseXml();
 }
 
 void GameList::RestoreConfig()
@@ -501,6 +585,9 @@ void GameList::RestoreConfig()
 		wheelPagingFunc = WheelPagingAlphaOnly;
 	else
 		wheelPagingFunc = WheelPagingDefault;
+
+	// the page groups might have changed
+	InvalidatePageGroups();
 }
 
 void GameList::SetLastPlayedNow(GameListItem *game)
@@ -537,7 +624,7 @@ float GameList::GetRating(GameListItem *game)
 		// interpret it as a float and return the value
 		const TCHAR *val = ratingCol->Get(row, nullptr);
 		if (val != nullptr && val[0] != 0)
-			return (float)_ttof(val);
+			return ratingCol->GetFloat(row);
 	}
 
 	// There's no stats database entry, so fall back on the
@@ -600,11 +687,10 @@ GameListItem *GameList::GetGameByID(const TCHAR *id)
 
 GameListItem *GameList::GetByInternalID(LONG id)
 {
-	for (auto &game : byTitle)
-	{
-		if (game->internalID == id)
-			return game;
-	}
+	// look up the game in the ID table
+	if (id >= 0 && static_cast<size_t>(id) < byInternalID.size())
+		return byInternalID[id];
+
 	return nullptr;
 }
 
@@ -645,27 +731,61 @@ int GameList::WheelPagingAlphaOnly(const TCHAR *title)
 }
 
 
+void GameList::BuildPageRuns()
+{
+	// if the table is already up to date, there's nothing to do
+	if (pageRunsValid)
+		return;
+
+	// we need a filter
+	auto filter = curFilter != nullptr ? curFilter : &allGamesFilter;
+
+	// Divide the list into runs of games in the same group.  Adjacent
+	// runs always have different groups, but a group can appear in more
+	// than one run if the filter's sorting order doesn't keep the groups
+	// together.
+	pageRuns.clear();
+	for (int i = 0, cnt = (int)byTitleFiltered.size(); i < cnt; ++i)
+	{
+		int group = filter->GetPageGroup(byTitleFiltered[i]);
+		if (pageRuns.size() == 0 || pageRuns.back().group != group)
+			pageRuns.push_back({ i, group });
+	}
+
+	pageRunsValid = true;
+}
+
+int GameList::FindPageRun(int index) const
+{
+	// find the last run starting at or before the index
+	auto it = std::upper_bound(pageRuns.begin(), pageRuns.end(), index,
+		[](int index, const PageRun &run) { return index < run.start; });
+	return static_cast<int>(it - pageRuns.begin()) - 1;
+}
+
 int GameList::FindNextLetter()
 {
 	// if there's no current game, no search is possible
 	if (curGame < 0)
 		return 0;
 
-	// we need a filter
-	auto filter = curFilter != nullptr ? curFilter : &allGamesFilter;
-
-	// get the current game's group
-	auto oldGroup = filter->GetPageGroup(byTitleFiltered[curGame]);
+	// make sure the page group table is up to date
+	BuildPageRuns();
 
-	// scan ahead from the current game
+	// get the current game's run and group
 	int cnt = (int)byTitleFiltered.size();
-	for (int i = (curGame + 1) % cnt, n = 1; i != curGame; i = (i + 1) % cnt, ++n)
+	int nRuns = (int)pageRuns.size();
+	int curRun = FindPageRun(curGame);
+	int oldGroup = pageRuns[curRun].group;
+
+	// Scan ahead from the current game's run, wrapping at the end of the
+	// list.  The first run that's from a different group, and that isn't
+	// from the "null" group, starts the next page.
+	for (int k = 1; k < nRuns; ++k)
 	{
-		// If this game is from a different group, and it's not from the
-		// "null" group, stop here.
-		auto newGroup = filter->GetPageGroup(byTitleFiltered[i]);
-		if (newGroup != 0 && newGroup != oldGroup)
-			return n;
+		const PageRun &run = pageRuns[(curRun + k) % nRuns];
+		if (run.group != 0 && run.group != oldGroup)
+			return Wrap(run.start - curGame, cnt);
 	}
 
 	// nothing found - stay on the current game
@@ -678,41 +798,70 @@ int GameList::FindPrevLetter()
 	if (curGame < 0)
 		return 0;
 
-	// we need a filter
-	auto filter = curFilter != nullptr ? curFilter : &allGamesFilter;
+	// make sure the page group table is up to date
+	BuildPageRuns();
+
+	// If the whole list is one run, backing up wraps all the way around
+	// to the current game, which makes the target the game after it.
+	int cnt = (int)byTitleFiltered.size();
+	int nRuns = (int)pageRuns.size();
+	if (nRuns <= 1)
+		return 1 - cnt;
 
 	// We want to back up to the start of the current letter group,
 	// or to the start of the previous group if we're already at the
 	// start of a group.  We can accomplish both by searching for the
 	// nearest previous item that's in a different group from the item
 	// just before the current item.  So start by backing up one spot.
-	int cnt = (int)byTitleFiltered.size();
+	// 'i' is the current position, 'r' is its run, and 'n' is the
+	// offset from the current game.
+	int curRun = FindPageRun(curGame);
 	int i = Wrap(curGame - 1, cnt);
+	int r = FindPageRun(i);
 	int n = -1;
 
+	// Back up to the last game of the previous run.  Returns true if
+	// that takes us back into the current game's run from above, which
+	// means that we've wrapped all the way around the list, so that
+	// continuing through the run would bring us to the current game.
+	auto StepBack = [this, &i, &r, &n, cnt, nRuns, curRun]()
+	{
+		n -= i - pageRuns[r].start + 1;
+		i = Wrap(pageRuns[r].start - 1, cnt);
+		r = (r + nRuns - 1) % nRuns;
+		return r == curRun;
+	};
+
+	// Stop at the current game, after wrapping around into its run
+	auto StopAtCurrent = [&i, &n, this]()
+	{
+		n -= i - curGame;
+		return n + 1;
+	};
+
 	// The only snag is that we could now be on a null group, where
 	// we can't stop.  So we have to continue backing up until we're
 	// in a valid group.
-	for (; i != curGame && filter->GetPageGroup(byTitleFiltered[i]) == 0; 
-		i = Wrap(i - 1, cnt), --n);
+	bool wrapped = false;
+	while (pageRuns[r].group == 0)
+	{
+		if ((wrapped = StepBack()) && pageRuns[r].group == 0)
+			return StopAtCurrent();
+	}
 
-	// This game defines our target group.  Now just back up until
-	// we leave the group, at which point the *next* game is the
-	// first in our group.
-	auto targetGroup = filter->GetPageGroup(byTitleFiltered[i]);
-	for (; i != curGame; i = Wrap(i - 1, cnt), --n)
+	// This run defines our target group.  Now just back up until we
+	// leave the group, at which point the *next* game is the first in
+	// our group.  Adjacent runs always have different groups, except
+	// across the wrap from the end of the list back to the start.
+	for (int targetGroup = pageRuns[r].group; !wrapped; )
 	{
-		if (filter->GetPageGroup(byTitleFiltered[i]) != targetGroup)
-		{
-			// we just left the group, so the next game is the one we seek
+		wrapped = StepBack();
+		if (pageRuns[r].group != targetGroup)
 			return n + 1;
-		}
 	}
 
-	// We wrapped back to the current game, so it must be the only
-	// one of its group, and there's only one other group.  So the
-	// first game of the previous group must be the next game.
-	return n + 1;
+	// we're back in the current game's run, so we'll stop at the game
+	return StopAtCurrent();
 }
 
 void GameList::SetGame(int n)
@@ -726,6 +875,266 @@ void GameList::SetGame(int n)
 	curGame = Wrap(curGame + n, cnt);
 }
 
+int GameList::GetFilterOffset(GameListItem *game) const
+{
+	// find the game in the filtered list
+	int cnt = (int)byTitleFiltered.size();
+	if (curGame < 0 || cnt == 0)
+		return -1;
+
+	auto it = std::find(byTitleFiltered.begin(), byTitleFiltered.end(), game);
+	if (it == byTitleFiltered.end())
+		return -1;
+
+	// return the offset from the current game, wrapped to be non-negative
+	return Wrap((int)(it - byTitleFiltered.begin()) - curGame, cnt);
+}
+
+// Split a string into lower-case search words.  Words are runs of
+// letters and digits; apostrophes are dropped rather than treated as
+// separators, so that "Stoker's" indexes as "stokers", which the query
+// "stoker" still finds by prefix.
+static void SplitSearchWords(const TCHAR *str, std::vector<TSTRING> &words)
+{
+	TSTRING word;
+	for (const TCHAR *p = str; ; ++p)
+	{
+		if (*p != 0 && _istalnum(*p))
+			word.push_back(_totlower(*p));
+		else if (*p != 0 && (*p == '\'' || *p == 0x2019))
+			continue;
+		else if (word.length() != 0)
+		{
+			words.emplace_back(word);
+			word.clear();
+		}
+
+		if (*p == 0)
+			break;
+	}
+}
+
+void GameList::UpdateSearchIndex()
+{
+	// Field weights.  The title is what people search for most, so it
+	// counts the most; the manufacturer and year are the usual ways of
+	// narrowing down a title.
+	static const int titleWeight = 3, manufWeight = 2, yearWeight = 2, systemWeight = 1, categoryWeight = 1;
+
+	// check each game against its last indexed state
+	UINT64 sweep = ++searchSweep;
+	for (auto &game : games)
+	{
+		auto &s = searchGames[&game];
+		s.sweep = sweep;
+
+		int row = GetStatsDbRow(&game);
+		UINT64 statsStamp = statsDb.GetRowStamp(row);
+		if (s.words.size() != 0
+			&& s.title == game.title
+			&& s.manufacturer == game.manufacturer
+			&& s.system == game.system
+			&& s.dbFile == game.dbFile
+			&& s.year == game.year
+			&& s.statsDbRow == row
+			&& s.statsStamp == statsStamp)
+			continue;
+
+		// remove the game's old words
+		for (auto &w : s.words)
+		{
+			for (auto r = searchWords.equal_range(w); r.first != r.second; )
+			{
+				if (r.first->second.game == &game)
+					r.first = searchWords.erase(r.first);
+				else
+					++r.first;
+			}
+		}
+		s.words.clear();
+
+		// get the lower-case title, for the title prefix checks
+		TSTRING lcTitle = game.title;
+		std::transform(lcTitle.begin(), lcTitle.end(), lcTitle.begin(), ::_totlower);
+
+		// collect the new words, keeping the best weight for each word
+		std::unordered_map<TSTRING, int> newWords;
+		auto AddField = [&newWords](const TCHAR *str, int weight)
+		{
+			std::vector<TSTRING> w;
+			SplitSearchWords(str, w);
+			for (auto &word : w)
+			{
+				if (auto &cur = newWords[word]; weight > cur)
+					cur = weight;
+			}
+		};
+		AddField(lcTitle.c_str(), titleWeight);
+		if (game.manufacturer != nullptr)
+			AddField(game.manufacturer->manufacturer.c_str(), manufWeight);
+		if (game.system != nullptr)
+			AddField(game.system->displayName.c_str(), systemWeight);
+		if (game.year != 0)
+		{
+			TCHAR year[16];
+			_stprintf_s(year, _T("%d"), game.year);
+			AddField(year, yearWeight);
+		}
+
+		std::list<const GameCategory*> cats;
+		GetCategoryList(&game, cats);
+		for (auto cat : cats)
+			AddField(cat->name.c_str(), categoryWeight);
+
+		// add them to the index
+		s.words.reserve(newWords.size());
+		for (auto &w : newWords)
+		{
+			searchWords.emplace(w.first, SearchWord{ &game, w.second });
+			s.words.emplace_back(w.first);
+		}
+
+		// save the new indexed state
+		s.title = game.title;
+		s.lcTitle = std::move(lcTitle);
+		s.manufacturer = game.manufacturer;
+		s.system = game.system;
+		s.dbFile = game.dbFile;
+		s.year = game.year;
+		s.statsDbRow = row;
+		s.statsStamp = statsStamp;
+		searchTitleIndexValid = false;
+	}
+
+	// remove the games that are no longer in the list
+	for (auto it = searchGames.begin(); it != searchGames.end(); )
+	{
+		if (it->second.sweep != sweep)
+		{
+			for (auto &w : it->second.words)
+			{
+				for (auto r = searchWords.equal_range(w); r.first != r.second; )
+				{
+					if (r.first->second.game == it->first)
+						r.first = searchWords.erase(r.first);
+					else
+						++r.first;
+				}
+			}
+			it = searchGames.erase(it);
+			searchTitleIndexValid = false;
+		}
+		else
+			++it;
+	}
+}
+
+void GameList::SearchGames(const TCHAR *query, size_t maxResults, std::vector<SearchResult> &results)
+{
+	results.clear();
+
+	// split the query into words
+	std::vector<TSTRING> queryWords;
+	SplitSearchWords(query, queryWords);
+	if (queryWords.size() == 0 || maxResults == 0)
+		return;
+
+	// make sure the index is up to date
+	UpdateSearchIndex();
+
+	// Find the games matching each query word.  A game has to match every
+	// word to qualify, so after the first word, we only have to keep track
+	// of games that matched all of the words so far.  A game's score for a
+	// word is the weight of the best field where it matched, plus a little
+	// extra for a whole-word match.
+	struct Match
+	{
+		size_t nWords;
+		float score;
+	};
+	std::unordered_map<GameListItem*, Match> matches;
+	for (size_t i = 0; i < queryWords.size(); ++i)
+	{
+		auto &qw = queryWords[i];
+		std::unordered_map<GameListItem*, float> wordMatches;
+		for (auto it = searchWords.lower_bound(qw);
+			it != searchWords.end() && it->first.compare(0, qw.length(), qw) == 0; ++it)
+		{
+			float score = static_cast<float>(it->second.weight) + (it->first.length() == qw.length() ? 0.5f : 0.0f);
+			if (auto &cur = wordMatches[it->second.game]; score > cur)
+				cur = score;
+		}
+
+		for (auto &w : wordMatches)
+		{
+			if (i == 0)
+				matches.emplace(w.first, Match{ 1, w.second });
+			else if (auto m = matches.find(w.first); m != matches.end() && m->second.nWords == i)
+			{
+				m->second.nWords += 1;
+				m->second.score += w.second;
+			}
+		}
+	}
+
+	// Collect the games that matched all of the words.  Give a bonus to
+	// titles that start with the query, since that's usually what the
+	// user is typing.
+	TSTRING lcQuery;
+	for (auto &qw : queryWords)
+	{
+		if (lcQuery.length() != 0)
+			lcQuery.push_back(' ');
+		lcQuery.append(qw);
+	}
+	for (auto &m : matches)
+	{
+		if (m.second.nWords == queryWords.size())
+		{
+			float score = m.second.score;
+			auto &title = searchGames.at(m.first).lcTitle;
+			if (title.compare(0, queryWords[0].length(), queryWords[0]) == 0)
+				score += 1.0f;
+			if (title.compare(0, lcQuery.length(), lcQuery) == 0)
+				score += 2.0f;
+			results.push_back({ m.first, score });
+		}
+	}
+
+	// If nothing matched, try a fuzzy match on the titles
+	if (results.size() == 0)
+	{
+		if (!searchTitleIndexValid)
+		{
+			searchTitleIndex.Clear();
+			searchTitleGames.clear();
+			for (auto &g : searchGames)
+			{
+				searchTitleIndex.Add(g.second.lcTitle.c_str());
+				searchTitleGames.push_back(g.first);
+			}
+			searchTitleIndex.Build();
+			searchTitleIndexValid = true;
+		}
+
+		std::vector<DiceCoefficient::BigramIndex<TCHAR>::Match> fuzzy;
+		searchTitleIndex.TopK(lcQuery.c_str(), maxResults, 0.4f, fuzzy);
+		for (auto &f : fuzzy)
+			results.push_back({ searchTitleGames[f.index], f.score });
+	}
+
+	// rank the results by score, then by title, and keep the best ones
+	auto Better = [](const SearchResult &a, const SearchResult &b) {
+		return a.score > b.score || (a.score == b.score && lstrcmpi(a.game->title.c_str(), b.game->title.c_str()) < 0); };
+	if (results.size() > maxResults)
+	{
+		std::partial_sort(results.begin(), results.begin() + maxResults, results.end(), Better);
+		results.resize(maxResults);
+	}
+	else
+		std::sort(results.begin(), results.end(), Better);
+}
+
 GameListFilter *GameList::GetFilterById(const TCHAR *id)
 {
 	// make sure the list is up to date
@@ -760,12 +1169,15 @@ GameListFilter *GameList::GetFilterByCommand(int cmdID)
 
 bool GameList::RefreshFilter()
 {
+	Trace::Scope trace("Filter refresh", "gamelist", curFilter->GetFilterTitle());
+
 	// Remember the current selection, if any
 	const GameListItem *oldSel = GetNthGame(0);
 
 	// reset the filter list
 	byTitleFiltered.clear();
 	curGame = -1;
+	InvalidatePageGroups();
 
 	// initialize the filter
 	curFilter->BeforeScan();
@@ -780,32 +1192,61 @@ bool GameList::RefreshFilter()
 	// presume we won't find the old selection in the new filter subset
 	int newIndexOfOldSel = -1;
 
-	// Construct the new list of games that pass the filter
-	auto pfv = Application::Get()->GetPlayfieldView();
-	for (auto game : byTitle)
+	// If the filter's results can be cached, bring its membership cache
+	// up to date.  This only re-tests the games that have changed since
+	// the last time we used the filter, so switching among the built-in
+	// filters doesn't have to run the full filter test on every game.
+	bool cached = curFilter->IsCacheable();
+	if (cached)
 	{
-		// Test the game against the current filter
-		bool include = FilterIncludes(curFilter, game, hideUnconfigured);
+		UpdateFilterRowState();
+		UpdateMembershipCache(curFilter, hideUnconfigured);
+	}
 
-		// Invoke the metafilters
-		for (auto &mf : *metaFilters.get())
-		{
-			// Call the filter if the game has passed the other filters
-			// so far, OR the metafilter reconsiders excluded games.
-			if (include || mf->includeExcluded)
-			{
-				// The result from this metafilter overrides the prior
-				// inclusion status.
-				include = mf->Include(game, include);
-			}
-		}
+	// If the filter uses a standard sort order other than the title
+	// order, note the title index position of each included game, so
+	// that we can reorder the list from the prebuilt sort index.
+	auto sortOrder = curFilter->HasCustomSort() ? GameListFilter::SortOrder::Title : curFilter->GetSortOrder();
+	std::vector<bool> filteredPositions;
+	if (sortOrder != GameListFilter::SortOrder::Title)
+		filteredPositions.resize(byTitle.size(), false);
+
+	// Test each game against the current filter.  Do the whole list in
+	// one pass, rather than interleaving the filter and metafilter tests
+	// game by game, so that filters with a batch interface can test all
+	// of the games in a single call.
+	std::vector<bool> included;
+	if (cached)
+	{
+		included = curFilter->membershipCache.includes;
+	}
+	else
+	{
+		std::vector<int> positions(byTitle.size());
+		for (size_t i = 0; i < positions.size(); ++i)
+			positions[i] = static_cast<int>(i);
+
+		included.resize(byTitle.size());
+		FilterIncludesBatch(curFilter, positions, included, hideUnconfigured);
+	}
 
+	// Apply the metafilters.  The result from each metafilter overrides
+	// the prior inclusion status.
+	for (auto &mf : *metaFilters.get())
+		ApplyMetaFilter(mf, included);
+
+	// Construct the new list of games that pass the filter
+	for (size_t gameIndex = 0; gameIndex < byTitle.size(); ++gameIndex)
+	{
 		// If this game is included, add it to the list
-		if (include)
+		auto game = byTitle[gameIndex];
+		if (included[gameIndex])
 		{
 			// note its new index, and add it to the list
 			int idx = static_cast<int>(byTitleFiltered.size());
 			byTitleFiltered.push_back(game);
+			if (filteredPositions.size() != 0)
+				filteredPositions[gameIndex] = true;
 
 			auto IsLexicallyCloser = [](const TSTRING &newName, const TSTRING &oldName, const TSTRING &refName)
 			{
@@ -881,24 +1322,446 @@ bool GameList::RefreshFilter()
 		// new index
 		GameListItem *pCurGame = curGame != -1 ? byTitleFiltered[curGame] : nullptr;
 
-		// sort the list
-		std::sort(byTitleFiltered.begin(), byTitleFiltered.end(),
-			[this](GameListItem* &a, GameListItem* &b) { return this->curFilter->CustomSortCompare(a, b); });
+		// Sort the list.  Use a stable sort, so that games that compare
+		// as equal stay in title order.
+		curFilter->BeforeSort(byTitleFiltered);
+		std::stable_sort(byTitleFiltered.begin(), byTitleFiltered.end(),
+			[this](const GameListItem *a, const GameListItem *b) { return this->curFilter->CustomSortCompare(a, b); });
+		curFilter->AfterSort();
+
+		// find the new index of the current game
+		curGame = indexOf(byTitleFiltered, pCurGame);
+	}
+	else if (sortOrder != GameListFilter::SortOrder::Title)
+	{
+		// Standard sort order.  Rebuild the list by walking the prebuilt
+		// sort index and picking out the included games, which puts them
+		// in the sort order in a single pass, without sorting.
+		GameListItem *pCurGame = curGame != -1 ? byTitleFiltered[curGame] : nullptr;
+		byTitleFiltered.clear();
+		for (int pos : GetSortIndex(sortOrder, curFilter->IsSortDescending()))
+		{
+			if (filteredPositions[pos])
+				byTitleFiltered.push_back(byTitle[pos]);
+		}
+
+		// find the new index of the current game
+		curGame = indexOf(byTitleFiltered, pCurGame);
+	}
+
+	// count the games that passed the filter
+	Trace::Counter("Games in filter", static_cast<double>(byTitleFiltered.size()));
+
+	// return true if the game selection changed
+	return oldSel != GetNthGame(0);
+}
+
+const std::vector<int> &GameList::GetSortIndex(GameListFilter::SortOrder order, bool descending)
+{
+	// The index is valid if neither the title index nor any of the game
+	// rows have changed since we built it.  Bring the row state up to
+	// date first, so that we can tell.
+	UpdateFilterRowState();
+	auto &idx = sortIndexes[static_cast<int>(order)][descending ? 1 : 0];
+	if (idx.order.size() == byTitle.size()
+		&& idx.titleIndexSerial == titleIndexSerial
+		&& idx.rowSerial == filterRowSerial)
+		return idx.order;
+
+	// For the manufacturer order, rank the manufacturers by name, so
+	// that we only have to compare the names once per manufacturer.
+	std::unordered_map<const GameManufacturer*, int> manufRank;
+	if (order == GameListFilter::SortOrder::Manufacturer)
+	{
+		std::vector<const GameManufacturer*> m;
+		for (auto &it : manufacturers)
+			m.push_back(&it.second);
+		std::sort(m.begin(), m.end(), [](const GameManufacturer *a, const GameManufacturer *b) {
+			return lstrcmpi(a->manufacturer.c_str(), b->manufacturer.c_str()) < 0; });
+		for (size_t i = 0; i < m.size(); ++i)
+			manufRank.emplace(m[i], static_cast<int>(i));
+	}
+
+	// figure each game's sort key
+	struct Key
+	{
+		bool known;		// does the game have a value for the field?
+		double value;	// field value
+	};
+	std::vector<Key> keys(byTitle.size());
+	for (size_t i = 0; i < byTitle.size(); ++i)
+	{
+		auto game = byTitle[i];
+		auto &k = keys[i];
+		switch (order)
+		{
+		case GameListFilter::SortOrder::Year:
+			k = { game->year != 0, static_cast<double>(game->year) };
+			break;
+
+		case GameListFilter::SortOrder::Manufacturer:
+			if (auto it = manufRank.find(game->manufacturer); it != manufRank.end())
+				k = { true, static_cast<double>(it->second) };
+			else
+				k = { false, 0.0 };
+			break;
+
+		case GameListFilter::SortOrder::Rating:
+			{
+				float rating = GetRating(game);
+				k = { rating >= 0.0f, static_cast<double>(rating) };
+			}
+			break;
+
+		case GameListFilter::SortOrder::LastPlayed:
+			{
+				DATE d = GetIndexedDate(DateIndexType::LastPlayed, GetStatsDbRow(game));
+				k = { d != 0.0, d };
+			}
+			break;
+
+		case GameListFilter::SortOrder::PlayCount:
+			k = { true, static_cast<double>(GetPlayCount(game)) };
+			break;
+
+		default:
+			k = { true, static_cast<double>(i) };
+			break;
+		}
+	}
+
+	// Sort the title index positions by key.  Use a stable sort, starting
+	// from the title order, so that ties stay in title order.
+	idx.order.resize(byTitle.size());
+	for (size_t i = 0; i < idx.order.size(); ++i)
+		idx.order[i] = static_cast<int>(i);
+	std::stable_sort(idx.order.begin(), idx.order.end(), [&keys, descending](int a, int b)
+	{
+		const Key &ka = keys[a], &kb = keys[b];
+		if (ka.known != kb.known)
+			return ka.known;
+		if (!ka.known)
+			return false;
+		return descending ? ka.value > kb.value : ka.value < kb.value;
+	});
+
+	// the index is now current
+	idx.titleIndexSerial = titleIndexSerial;
+	idx.rowSerial = filterRowSerial;
+	return idx.order;
+}
+
+DATE GameList::ParseIndexedDate(DateIndexType type, int row)
+{
+	auto col = type == DateIndexType::LastPlayed ? lastPlayedCol : dateAddedCol;
+	return col->GetDate(row);
+}
+
+GameList::DateIndex &GameList::GetDateIndex(DateIndexType type)
+{
+	// build the index on first use
+	auto &idx = dateIndexes[static_cast<int>(type)];
+	if (!idx.built)
+	{
+		int nRows = static_cast<int>(statsDb.GetNumRows());
+		idx.byRow.resize(nRows);
+		idx.sorted.clear();
+		for (int row = 0; row < nRows; ++row)
+		{
+			if ((idx.byRow[row] = ParseIndexedDate(type, row)) != 0.0)
+				idx.sorted.emplace_back(idx.byRow[row], row);
+		}
+		std::sort(idx.sorted.begin(), idx.sorted.end());
+		idx.built = true;
+	}
+	return idx;
+}
+
+void GameList::UpdateDateIndex(DateIndexType type, int row)
+{
+	// if the index hasn't been built yet, it'll pick up the new date
+	// when it is
+	auto &idx = dateIndexes[static_cast<int>(type)];
+	if (!idx.built || row < 0)
+		return;
+
+	// remove the row's old entry from the sorted list
+	if (row < static_cast<int>(idx.byRow.size()))
+	{
+		if (DATE old = idx.byRow[row]; old != 0.0)
+		{
+			auto key = std::make_pair(old, row);
+			if (auto it = std::lower_bound(idx.sorted.begin(), idx.sorted.end(), key); it != idx.sorted.end() && *it == key)
+				idx.sorted.erase(it);
+		}
+	}
+	else
+		idx.byRow.resize(row + 1, 0.0);
+
+	// add the new entry
+	if ((idx.byRow[row] = ParseIndexedDate(type, row)) != 0.0)
+	{
+		auto key = std::make_pair(idx.byRow[row], row);
+		idx.sorted.insert(std::upper_bound(idx.sorted.begin(), idx.sorted.end(), key), key);
+	}
+}
+
+DATE GameList::GetIndexedDate(DateIndexType type, int row)
+{
+	auto &idx = GetDateIndex(type);
+	return row >= 0 && row < static_cast<int>(idx.byRow.size()) ? idx.byRow[row] : 0.0;
+}
+
+void GameList::EnumRowsSince(DateIndexType type, DATE since, std::function<void(int row)> func)
+{
+	auto &idx = GetDateIndex(type);
+	for (auto it = std::lower_bound(idx.sorted.begin(), idx.sorted.end(), std::make_pair(since, INT_MIN)); it != idx.sorted.end(); ++it)
+		func(it->second);
+}
+
+void GameList::UpdateFilterRowState()
+{
+	// if the title index has changed size, start over with a new snapshot
+	if (filterRowState.size() != byTitle.size())
+	{
+		filterRowState.clear();
+		filterRowState.resize(byTitle.size());
+		++titleIndexSerial;
+	}
+
+	// compare each game's current data against the snapshot
+	UINT64 newSerial = filterRowSerial + 1;
+	bool anyChanged = false;
+	for (size_t i = 0; i < byTitle.size(); ++i)
+	{
+		auto game = byTitle[i];
+		auto &s = filterRowState[i];
+		int row = GetStatsDbRow(game);
+		UINT64 statsStamp = statsDb.GetRowStamp(row);
+		bool hidden = game->IsHidden();
+		if (s.serial == 0
+			|| s.system != game->system
+			|| s.manufacturer != game->manufacturer
+			|| s.dbFile != game->dbFile
+			|| s.year != game->year
+			|| s.pbxRating != game->pbxRating
+			|| s.isConfigured != game->isConfigured
+			|| s.hidden != hidden
+			|| s.statsDbRow != row
+			|| s.statsStamp != statsStamp)
+		{
+			s.system = game->system;
+			s.manufacturer = game->manufacturer;
+			s.dbFile = game->dbFile;
+			s.year = game->year;
+			s.pbxRating = game->pbxRating;
+			s.isConfigured = game->isConfigured;
+			s.hidden = hidden;
+			s.statsDbRow = row;
+			s.statsStamp = statsStamp;
+			s.serial = newSerial;
+			anyChanged = true;
+		}
+	}
+
+	// if anything changed, the new serial number is now in use
+	if (anyChanged)
+		filterRowSerial = newSerial;
+}
+
+void GameList::UpdateMembershipCache(GameListFilter *filter, bool hideUnconfigured)
+{
+	auto &c = filter->membershipCache;
+	if (c.titleIndexSerial != titleIndexSerial || c.hideUnconfigured != hideUnconfigured)
+	{
+		// The cache was built for a different title index or setting (or
+		// was never built at all), so test every game.
+		std::vector<int> positions(byTitle.size());
+		for (size_t i = 0; i < positions.size(); ++i)
+			positions[i] = static_cast<int>(i);
+
+		c.includes.resize(byTitle.size());
+		FilterIncludesBatch(filter, positions, c.includes, hideUnconfigured);
+		c.count = static_cast<int>(std::count(c.includes.begin(), c.includes.end(), true));
+	}
+	else if (c.rowSerial != filterRowSerial)
+	{
+		// re-test only the games that have changed since the last update
+		std::vector<int> positions;
+		for (size_t i = 0; i < byTitle.size(); ++i)
+		{
+			if (filterRowState[i].serial > c.rowSerial)
+				positions.push_back(static_cast<int>(i));
+		}
+
+		// adjust the count by the change in the re-tested games
+		auto CountPositions = [&c, &positions]()
+		{
+			int n = 0;
+			for (int pos : positions)
+				n += c.includes[pos] ? 1 : 0;
+			return n;
+		};
+		int before = CountPositions();
+		FilterIncludesBatch(filter, positions, c.includes, hideUnconfigured);
+		c.count += CountPositions() - before;
+	}
+
+	// the cache is now up to date
+	c.titleIndexSerial = titleIndexSerial;
+	c.rowSerial = filterRowSerial;
+	c.hideUnconfigured = hideUnconfigured;
+}
+
+int GameList::GetFilterCount(GameListFilter *filter)
+{
+	std::vector<int> counts;
+	GetFilterCounts({ filter }, counts);
+	return counts[0];
+}
+
+void GameList::GetFilterCounts(const std::vector<GameListFilter*> &filters, std::vector<int> &counts)
+{
+	// bring the per-game change state up to date once for the whole list
+	bool hideUnconfigured = Application::Get()->IsHideUnconfiguredGames();
+	UpdateFilterRowState();
+
+	counts.resize(filters.size());
+	for (size_t i = 0; i < filters.size(); ++i)
+	{
+		auto filter = filters[i];
+		if (filter->IsCacheable())
+		{
+			// update the membership cache incrementally, and use its count
+			filter->BeforeScan();
+			UpdateMembershipCache(filter, hideUnconfigured);
+			filter->AfterScan();
+			counts[i] = filter->membershipCache.count;
+		}
+		else
+		{
+			// not cacheable - count by scanning all of the games
+			int n = 0;
+			EnumGames([&n](GameListItem*) { ++n; }, filter);
+			counts[i] = n;
+		}
+	}
+}
+
+bool GameList::FilterIncludes(GameListFilter *filter, GameListItem *game)
+{
+	return FilterIncludes(filter, game, Application::Get()->IsHideUnconfiguredGames());
+}
+
+void GameList::ApplyMetaFilter(MetaFilter *mf, std::vector<bool> &include)
+{
+	// if the metafilter doesn't do batches, call it for each game
+	if (!mf->HasBatchInclude())
+	{
+		for (size_t i = 0; i < byTitle.size(); ++i)
+		{
+			// Call the filter if the game has passed the other filters
+			// so far, OR the metafilter reconsiders excluded games.
+			if (include[i] || mf->includeExcluded)
+				include[i] = mf->Include(byTitle[i], include[i]);
+		}
+		return;
+	}
+
+	// If the results are cacheable, bring the row state up to date, and
+	// check whether the cache still matches the title index.
+	auto &c = mf->resultCache;
+	bool cacheable = mf->IsCacheable();
+	bool useCache = false;
+	if (cacheable)
+	{
+		UpdateFilterRowState();
+		useCache = c.titleIndexSerial == titleIndexSerial && c.in.size() == byTitle.size();
+	}
+
+	// Collect the games to submit.  Skip games the metafilter doesn't
+	// see (excluded games, unless it reconsiders those), and games whose
+	// cached result is still valid.
+	std::vector<bool> in = include;
+	std::vector<GameListItem*> games;
+	std::vector<int> positions;
+	std::vector<bool> results;
+	for (size_t i = 0; i < byTitle.size(); ++i)
+	{
+		if (!include[i] && !mf->includeExcluded)
+			continue;
+
+		if (useCache && c.in[i] == include[i] && filterRowState[i].serial <= c.rowSerial)
+		{
+			include[i] = c.out[i];
+			continue;
+		}
+
+		games.push_back(byTitle[i]);
+		positions.push_back(static_cast<int>(i));
+		results.push_back(include[i]);
+	}
+
+	// test the batch
+	if (games.size() != 0)
+	{
+		mf->IncludeBatch(games, results);
+		for (size_t i = 0; i < games.size(); ++i)
+			include[positions[i]] = results[i];
+	}
+
+	// update the cache
+	if (cacheable)
+	{
+		c.in = std::move(in);
+		c.out = include;
+		c.titleIndexSerial = titleIndexSerial;
+		c.rowSerial = filterRowSerial;
+	}
+}
 
-		// find the new index of the current game
-		curGame = indexOf(byTitleFiltered, pCurGame);
+void GameList::FilterIncludesBatch(GameListFilter *filter, const std::vector<int> &positions,
+	std::vector<bool> &include, bool hideUnconfigured)
+{
+	// if the filter doesn't do batches, test the games one at a time
+	if (!filter->HasBatchInclude())
+	{
+		for (int pos : positions)
+			include[pos] = FilterIncludes(filter, byTitle[pos], hideUnconfigured);
+		return;
 	}
 
-	// return true if the game selection changed
-	return oldSel != GetNthGame(0);
+	// apply the generic tests, and collect the games that pass them
+	std::vector<GameListItem*> games;
+	std::vector<int> gamePositions;
+	for (int pos : positions)
+	{
+		auto game = byTitle[pos];
+		include[pos] = false;
+		if (PassesGenericFilterTests(filter, game, hideUnconfigured))
+		{
+			games.push_back(game);
+			gamePositions.push_back(pos);
+		}
+	}
+
+	// test the batch through the filter
+	if (games.size() != 0)
+	{
+		std::vector<bool> results(games.size(), false);
+		filter->IncludeBatch(games, results);
+		for (size_t i = 0; i < games.size(); ++i)
+			include[gamePositions[i]] = results[i];
+	}
 }
 
-bool GameList::FilterIncludes(GameListFilter *filter, GameListItem *game)
+bool GameList::FilterIncludes(GameListFilter *filter, GameListItem *game, bool hideUnconfigured)
 {
-	return FilterIncludes(filter, game, Application::Get()->IsHideUnconfiguredGames());
+	// apply the generic tests, then test it via the filter
+	return PassesGenericFilterTests(filter, game, hideUnconfigured) && filter->Include(game);
 }
 
-bool GameList::FilterIncludes(GameListFilter *filter, GameListItem *game, bool hideUnconfigured)
+bool GameList::PassesGenericFilterTests(GameListFilter *filter, GameListItem *game, bool hideUnconfigured)
 {
 	// If this game is hidden or disabled, check to see if the filter passes
 	// hidden games.  If not, skip it.
@@ -920,8 +1783,8 @@ bool GameList::FilterIncludes(GameListFilter *filter, GameListItem *game, bool h
 	if (!game->isConfigured && hideUnconfigured && !filter->IncludeUnconfigured())
 		return false;
 
-	// This game passes the generic tests, so test it via the filter
-	return filter->Include(game);
+	// this game passes the generic tests
+	return true;
 }
 
 DATE GameList::GetLocalMidnightUTC()
@@ -1230,13 +2093,16 @@ bool GameList::InitFromPinballX(ErrorHandler &eh)
 			PathCombine(exe, system->workingPath.c_str(), system->exe.c_str());
 			system->exe = exe;
 
+			// scan the system's table folder, if we haven't already
+			ScanTableFileSets();
+
 			// scan the .XML files for the lists
 			std::error_code ec;
 			for (auto &file : fs::directory_iterator(path, ec))
 			{
 				// check if it's an XML file
 				const wchar_t *fname = file.path().c_str();
-				std::basic_regex<wchar_t> xmlExtPat(L".*\\.xml$", std::regex_constants::icase);
+				static const std::basic_regex<wchar_t> xmlExtPat(L".*\\.xml$", std::regex_constants::icase);
 				if (std::regex_match(fname, xmlExtPat))
 				{
 					// it is - load it
@@ -1252,8 +2118,8 @@ bool GameList::InitFromPinballX(ErrorHandler &eh)
 
 	// scan for enabled systems
 	typedef std::basic_regex<wchar_t> wregex;
-	wregex varPat(L"^\\s*(\\w+)\\s*=\\s*(.*?)\\s*$", std::regex_constants::icase);
-	wregex sectPat(L"^\\s*\\[\\s*(.*?)\\s*\\]\\s*$");
+	static const wregex varPat(L"^\\s*(\\w+)\\s*=\\s*(.*?)\\s*$", std::regex_constants::icase);
+	static const wregex sectPat(L"^\\s*\\[\\s*(.*?)\\s*\\]\\s*$");
 	for (wchar_t *p = ini.get(); *p != 0; )
 	{
 		// find the next line
@@ -1337,6 +2203,11 @@ bool GameList::InitFromConfig(ErrorHandler &eh)
 	TSTRING dbDir = GetDataFilePath(ConfigVars::TableDatabasePath, _T("Databases"), IDS_DEFAULT_TABLEDB_PATH_PROMPT, eh);
 	Log(_T("The main table database folder is %s\n"), dbDir.c_str());
 	
+	// Table database files to load.  We collect these as we set up the
+	// systems, then load them all at once at the end, so that we can
+	// parse them concurrently.
+	std::list<StagedDatabaseFile> stagedFiles;
+
 	// Run through the SystemN variables to see what's populated.
 	ConfigManager *cfg = ConfigManager::GetInstance();
 	for (int n = 0; n <= PinballY::Constants::MaxSystemNum; ++n)
@@ -1406,9 +2277,9 @@ bool GameList::InitFromConfig(ErrorHandler &eh)
 			if (sysClass[0] == 0)
 			{
 				// try to infer the class from the system name
-				std::basic_regex<TCHAR> vpxNamePat(_T("visual\\s*pinball.*(x|10)|vp(x|10).*"), icase);
-				std::basic_regex<TCHAR> vpNamePat(_T("visual\\s*pinball.*|vp.*|physmod.*|vp.*pm.*|visual\\s*pinball\\s.*pm.*"), icase);
-				std::basic_regex<TCHAR> fpNamePat(_T("future\\s*pinball.*|fp.*"), icase);
+				static const std::basic_regex<TCHAR> vpxNamePat(_T("visual\\s*pinball.*(x|10)|vp(x|10).*"), icase);
+				static const std::basic_regex<TCHAR> vpNamePat(_T("visual\\s*pinball.*|vp.*|physmod.*|vp.*pm.*|visual\\s*pinball\\s.*pm.*"), icase);
+				static const std::basic_regex<TCHAR> fpNamePat(_T("future\\s*pinball.*|fp.*"), icase);
 				if (std::regex_match(systemName, vpxNamePat))
 					sysClass = _T("VPX");
 				else if (std::regex_match(systemName, vpNamePat))
@@ -1441,9 +2312,9 @@ bool GameList::InitFromConfig(ErrorHandler &eh)
 			// from the executable
 			if (sysClass[0] == 0 && exe[0] != 0)
 			{
-				std::basic_regex<TCHAR> vpxExePat(_T(".*\\\\vpinballx[^\\\\]*"), icase);
-				std::basic_regex<TCHAR> vpExePat(_T(".*\\\\vpinball[^\\\\]*"), icase);
-				std::basic_regex<TCHAR> fpExePat(_T(".*\\\\future\\s*pinball[^\\\\]*"), icase);
+				static const std::basic_regex<TCHAR> vpxExePat(_T(".*\\\\vpinballx[^\\\\]*"), icase);
+				static const std::basic_regex<TCHAR> vpExePat(_T(".*\\\\vpinball[^\\\\]*"), icase);
+				static const std::basic_regex<TCHAR> fpExePat(_T(".*\\\\future\\s*pinball[^\\\\]*"), icase);
 				if (std::regex_match(exe, vpxExePat))
 					sysClass = _T("VPX");
 				else if (std::regex_match(exe, vpExePat))
@@ -1675,32 +2546,95 @@ bool GameList::InitFromConfig(ErrorHandler &eh)
 				_T("this folder name was explicitly specified in the settings")));
 
 			// Search the system's database directory for .XML files.  These 
-			// contain the table metadata for the system's tables.
+			// contain the table metadata for the system's tables.  Add them
+			// to the list to load once we've set up all of the systems.
 			Log(_T("+ searching folder %s for table database .XML files\n"), sysDbDir);
 			std::error_code ec;
 			for (auto &file : fs::directory_iterator(sysDbDir, ec))
 			{
 				// check if it's an XML file
 				const wchar_t *fname = file.path().c_str();
-				std::basic_regex<wchar_t> xmlExtPat(L".*\\.xml$", std::regex_constants::icase);
+				static const std::basic_regex<wchar_t> xmlExtPat(L".*\\.xml$", std::regex_constants::icase);
 				if (std::regex_match(fname, xmlExtPat))
 				{
-					// it's an XML file - load the table list
-					LogGroup();
-					Log(_T("+ System \"%s\": loading table database file %s\n"), systemName, fname);
-					if (!LoadGameDatabaseFile(fname, databaseDir, system, eh))
-						return false;
+					// it's an XML file - add it to the list
+					Log(_T("+ found table database file %s\n"), fname);
+					stagedFiles.emplace_back(fname, databaseDir, system);
 				}
 			}
 		}
 	}
 
-	// success
-	return true;
+	// scan the table folders for all of the systems
+	ScanTableFileSets();
+
+	// load the table database files for all of the systems
+	return LoadGameDatabaseFiles(stagedFiles, eh);
+}
+
+void GameList::ScanTableFileSets()
+{
+	// Scan the folders concurrently on the loader pool.  The folders for
+	// different systems are often on different disks, and even on the
+	// same disk, having several directory reads outstanding at once lets
+	// a network share or a spun-down hard disk overlap the waits.  Each
+	// task only collects its folder's file names; we add them to the sets
+	// afterwards, in a fixed order (sorted by the set key), so that the
+	// sets and the log come out the same as a sequential scan.  As with
+	// the database files, nPending counts the unfinished tasks plus one
+	// for the submission loop.
+	struct Scan
+	{
+		const TSTRING *key;
+		TableFileSet *tfs;
+		std::vector<TSTRING> files;
+	};
+	std::vector<Scan> scans;
+	for (auto &t : tableFileSets)
+	{
+		if (!t.second.scanned)
+		{
+			t.second.scanned = true;
+			scans.push_back({ &t.first, &t.second });
+		}
+	}
+	std::sort(scans.begin(), scans.end(), [](const Scan &a, const Scan &b) { return *a.key < *b.key; });
+
+	volatile LONG nPending = 1;
+	HandleHolder hDone = CreateEvent(NULL, TRUE, FALSE, NULL);
+	for (auto &s : scans)
+	{
+		InterlockedIncrement(&nPending);
+		auto task = [&s, &nPending, &hDone]()
+		{
+			TableFileSet::ScanFolder(s.tfs->tablePath.c_str(), s.tfs->defExt.c_str(),
+				[&s](const TCHAR *filename) { s.files.emplace_back(filename); });
+			if (InterlockedDecrement(&nPending) == 0)
+				SetEvent(hDone);
+		};
+		if (hDone == NULL || !LoaderPool::Submit(task, LoaderPool::Priority::High))
+			task();
+	}
+
+	// wait for the scans to finish
+	if (InterlockedDecrement(&nPending) != 0)
+		WaitForSingleObject(hDone, INFINITE);
+
+	// add the files to the sets
+	for (auto &s : scans)
+	{
+		for (auto &f : s.files)
+		{
+			Log(_T("++ found file:  %s\n"), f.c_str());
+			s.tfs->AddFile(f.c_str());
+		}
+	}
 }
 
 bool GameList::Load(ErrorHandler &eh)
 {
+	Trace::Scope trace("GameList::Load", "gamelist");
+
 	// initialize from the configuration variables
 	if (!InitFromConfig(eh))
 		return false;
@@ -1957,19 +2891,147 @@ void GameList::BuildTitleIndex()
 	byTitle.clear();
 
 	// create the title index
+	byTitle.reserve(games.size());
 	for (auto &g : games)
 		byTitle.emplace_back(&g);
 
+	// rebuild the internal ID table
+	LONG maxID = 0;
+	for (auto &g : games)
+		maxID = max(maxID, g.internalID);
+	byInternalID.clear();
+	byInternalID.resize(static_cast<size_t>(maxID) + 1, nullptr);
+	for (auto &g : games)
+		byInternalID[g.internalID] = &g;
+
+	// rebuild the attribute indexes
+	gamesBySystem.clear();
+	gamesByManufacturer.clear();
+	gamesByYear.clear();
+	for (auto &g : games)
+	{
+		g.indexedSystem = nullptr;
+		g.indexedManufacturer = nullptr;
+		g.indexedYear = 0;
+		UpdateAttrIndex(&g);
+	}
+
 	// sort the title index
 	SortTitleIndex();
 }
 
+void GameList::UpdateAttrIndex(GameListItem *game)
+{
+	// if the game is already filed under its current keys, there's nothing to do
+	if (game->indexedSystem == game->system
+		&& game->indexedManufacturer == game->manufacturer
+		&& game->indexedYear == game->year)
+		return;
+
+	// remove it from its old keys, and file it under the new ones
+	RemoveFromAttrIndex(game);
+	game->indexedSystem = game->system;
+	game->indexedManufacturer = game->manufacturer;
+	game->indexedYear = game->year;
+
+	// There's no filter for a missing system, manufacturer, or year, so
+	// we don't bother filing the games that lack them.
+	if (game->system != nullptr)
+		gamesBySystem[game->system].emplace(game);
+	if (game->manufacturer != nullptr)
+		gamesByManufacturer[game->manufacturer].emplace(game);
+	if (game->year != 0)
+		gamesByYear[game->year].emplace(game);
+}
+
+void GameList::RemoveFromAttrIndex(GameListItem *game)
+{
+	if (auto it = gamesBySystem.find(game->indexedSystem); it != gamesBySystem.end())
+		it->second.erase(game);
+	if (auto it = gamesByManufacturer.find(game->indexedManufacturer); it != gamesByManufacturer.end())
+		it->second.erase(game);
+	if (auto it = gamesByYear.find(game->indexedYear); it != gamesByYear.end())
+	{
+		it->second.erase(game);
+		if (it->second.size() == 0)
+			gamesByYear.erase(it);
+	}
+}
+
+bool GameList::GetAttrIndexCandidates(GameListFilter *filter, std::vector<GameListItem*> &candidates)
+{
+	// collect the games filed under the filter's key
+	auto AddSet = [&candidates](const std::unordered_set<GameListItem*> &s) {
+		candidates.insert(candidates.end(), s.begin(), s.end());
+	};
+	switch (filter->GetAttrIndexType())
+	{
+	case GameListFilter::AttrIndexType::System:
+		if (auto it = gamesBySystem.find(static_cast<GameSystem*>(filter)); it != gamesBySystem.end())
+			AddSet(it->second);
+		break;
+
+	case GameListFilter::AttrIndexType::Manufacturer:
+		if (auto it = gamesByManufacturer.find(static_cast<GameManufacturer*>(filter)); it != gamesByManufacturer.end())
+			AddSet(it->second);
+		break;
+
+	case GameListFilter::AttrIndexType::Year:
+		{
+			auto df = static_cast<DateFilter*>(filter);
+			for (auto it = gamesByYear.lower_bound(df->yearFrom); it != gamesByYear.end() && it->first <= df->yearTo; ++it)
+				AddSet(it->second);
+		}
+		break;
+
+	default:
+		return false;
+	}
+
+	// put the candidates in title order, to match a scan of the title index
+	std::sort(candidates.begin(), candidates.end(), [this](GameListItem* const &a, GameListItem* const &b) {
+		return titleSortKeys[a->internalID].key < titleSortKeys[b->internalID].key;
+	});
+	return true;
+}
+
 void GameList::SortTitleIndex()
 {
-	// sort the title index alphabetically
-	std::sort(byTitle.begin(), byTitle.end(), [](GameListItem* const &a, GameListItem* const &b) {
-		return lstrcmpi(a->title.c_str(), b->title.c_str()) < 0;
+	// Bring the title sort keys up to date.  Build the keys with the same
+	// locale and flags that lstrcmpi() uses, so that the order is the same
+	// as comparing the titles directly.
+	for (auto g : byTitle)
+	{
+		if (static_cast<size_t>(g->internalID) >= titleSortKeys.size())
+			titleSortKeys.resize(static_cast<size_t>(g->internalID) + 1);
+
+		auto &k = titleSortKeys[g->internalID];
+		size_t hash = std::hash<TSTRING>()(g->title);
+		if (!k.valid || k.titleHash != hash)
+		{
+			k.key.clear();
+			int len = LCMapStringEx(LOCALE_NAME_USER_DEFAULT, LCMAP_SORTKEY | NORM_IGNORECASE,
+				g->title.c_str(), -1, NULL, 0, NULL, NULL, 0);
+			if (len > 0)
+			{
+				k.key.resize(len);
+				LCMapStringEx(LOCALE_NAME_USER_DEFAULT, LCMAP_SORTKEY | NORM_IGNORECASE,
+					g->title.c_str(), -1, reinterpret_cast<LPWSTR>(&k.key[0]), len, NULL, NULL, 0);
+			}
+			k.titleHash = hash;
+			k.valid = true;
+		}
+	}
+
+	// sort the title index alphabetically, by sort key
+	std::sort(byTitle.begin(), byTitle.end(), [this](GameListItem* const &a, GameListItem* const &b) {
+		return titleSortKeys[a->internalID].key < titleSortKeys[b->internalID].key;
 	});
+
+	// the games have new index positions, so the filter caches have to
+	// be rebuilt
+	filterRowState.clear();
+	++titleIndexSerial;
 }
 
 void GameList::EnumGames(std::function<void(GameListItem*)> func)
@@ -1986,11 +3048,25 @@ void GameList::EnumGames(std::function<void(GameListItem*)> func, GameListFilter
 	// initialize the filter
 	filter->BeforeScan();
 
-	// enumerate games that match the filter
-	for (auto &game : byTitle)
+	// Enumerate games that match the filter.  If the filter has an
+	// attribute index, we only have to test the games filed under its
+	// key; otherwise test every game.
+	std::vector<GameListItem*> candidates;
+	if (GetAttrIndexCandidates(filter, candidates))
+	{
+		for (auto game : candidates)
+		{
+			if (FilterIncludes(filter, game, hideUnconfigured))
+				func(game);
+		}
+	}
+	else
 	{
-		if (FilterIncludes(filter, game, hideUnconfigured))
-			func(game);
+		for (auto &game : byTitle)
+		{
+			if (FilterIncludes(filter, game, hideUnconfigured))
+				func(game);
+		}
 	}
 
 	// end the scan
@@ -2102,111 +3178,570 @@ int GameList::RemoveMissingFiles(const TSTRING &path, const TSTRING &ext,
 						{
 							if (&*gi == f->game)
 							{
+								if (static_cast<size_t>(gi->internalID) < byInternalID.size())
+									byInternalID[gi->internalID] = nullptr;
+								RemoveFromAttrIndex(&*gi);
 								games.erase(gi);
 								break;
 							}
 						}
 					}
 
-					// remove the game from the table file set
-					ts.files.erase(missing);
+					// remove the game from the table file set
+					ts.files.erase(missing);
+
+					// count the deletion
+					++nRemoved;
+				}
+			}
+		}
+	}
+
+	// return the number of games we removed
+	return nRemoved;
+}
+
+GameSystem *GameList::CreateSystem(
+	const TCHAR *systemName, int configIndex,
+	const TCHAR *sysDatabaseDir, const TCHAR *tablePath, const TCHAR *defExt)
+{
+	// Look up the system by name
+	auto it = systems.find(configIndex);
+	if (it == systems.end())
+	{
+		// it doesn't exist yet - add it
+		it = systems.emplace(
+			std::piecewise_construct,
+			std::forward_as_tuple(configIndex),
+			std::forward_as_tuple(systemName, configIndex)).first;
+
+		// Figure the system's generic file name.  The generic file
+		// is of the form <database path>\<system dir>\<system dir>.xml.
+		TCHAR genericFileName[MAX_PATH];
+		_tcscpy_s(genericFileName, sysDatabaseDir);
+		PathAppend(genericFileName, PathFindFileName(sysDatabaseDir));
+		_tcscat_s(genericFileName, _T(".xml"));
+
+		// assign it
+		it->second.genericDbFilename = genericFileName;
+	}
+
+	// Get the system
+	GameSystem *system = &it->second;
+
+	// Look up the table file set object for the system's table file pattern
+	TSTRING key = TableFileSet::GetKey(tablePath, defExt);
+	auto itfs = tableFileSets.find(key);
+	if (itfs == tableFileSets.end())
+	{
+		// there's no table file set for this pattern yet - create one
+		itfs = tableFileSets.emplace(
+			std::piecewise_construct,
+			std::forward_as_tuple(key),
+			std::forward_as_tuple(tablePath, defExt)).first;
+	}
+	else if (defExt != nullptr && defExt[0] != 0)
+	{
+		Log(_T("+ This system uses the same table folder as an earlier system (%s\\*%s)\n"),
+			tablePath, defExt);
+	}
+	else
+	{
+		Log(_T("+ NOT scanning for this system's tables files, because its default extension is empty\n"));
+	}
+
+	// cross-reference the system and the table file set
+	TableFileSet *tfs = &itfs->second;
+	tfs->systems.push_back(system);
+	system->tableFileSet = tfs;
+
+	// return the system we found or created
+	return system;
+}
+
+GameSystem *GameList::GetSystem(int configIndex)
+{
+	if (auto it = systems.find(configIndex); it != systems.end())
+		return &it->second;
+	return nullptr;
+}
+
+bool GameList::LoadGameDatabaseFile(
+	const TCHAR *filename, const TCHAR *parentFolder,
+	GameSystem *system, ErrorHandler &eh)
+{
+	// stage the file, then merge it into the list
+	StagedDatabaseFile file(filename, parentFolder, system);
+	StageGameDatabaseFile(file);
+	return MergeGameDatabaseFile(file, eh);
+}
+
+bool GameList::LoadGameDatabaseFiles(std::list<StagedDatabaseFile> &files, ErrorHandler &eh)
+{
+	// Stage the files concurrently on the loader pool.  Staging doesn't
+	// touch anything outside of the staging object, so the files can be
+	// staged in any order.  If the pool is full, stage the file inline.
+	// nPending counts the unfinished tasks, plus one for the submission
+	// loop itself, so that the event can't fire until we've submitted
+	// everything.
+	//
+	// Each file can use its entry from the last session's snapshot, if
+	// it's still current.
+	DatabaseSnapshot snapshot;
+	LoadDatabaseSnapshot(snapshot);
+	lazyDatabaseXml = ConfigManager::GetInstance()->GetBool(ConfigVars::LazyXml, false);
+	volatile LONG nPending = 1;
+	HandleHolder hDone = CreateEvent(NULL, TRUE, FALSE, NULL);
+	for (auto &f : files)
+	{
+		TSTRING key = f.filename;
+		std::transform(key.begin(), key.end(), key.begin(), ::_totlower);
+		if (auto it = snapshot.find(key); it != snapshot.end())
+			f.snapshot = &it->second;
+		f.lazyXml = lazyDatabaseXml;
+
+		InterlockedIncrement(&nPending);
+		auto task = [&f, &nPending, &hDone]()
+		{
+			StageGameDatabaseFile(f);
+			if (InterlockedDecrement(&nPending) == 0)
+				SetEvent(hDone);
+		};
+		if (hDone == NULL || !LoaderPool::Submit(task, LoaderPool::Priority::High))
+			task();
+	}
+
+	// wait for the staging tasks to finish
+	if (InterlockedDecrement(&nPending) != 0)
+		WaitForSingleObject(hDone, INFINITE);
+
+	// Merge the staged files into the game list, in the original order,
+	// so that the results are the same as loading the files one by one.
+	for (auto &f : files)
+	{
+		if (!MergeGameDatabaseFile(f, eh))
+			return false;
+	}
+
+	// Update the snapshot if anything has changed: if we had to extract
+	// the fields for any file, or if a file has been removed.
+	size_t nFromSnapshot = 0;
+	for (auto &f : files)
+		nFromSnapshot += f.fromSnapshot ? 1 : 0;
+	if (nFromSnapshot != files.size() || nFromSnapshot != snapshot.size())
+		SaveDatabaseSnapshot(files);
+
+	// success
+	return true;
+}
+
+// Game database snapshot file layout.  The header is followed by one
+// record per database file, each followed by the file's path, its
+// category name, and then the file's game records.  Each game record is
+// followed by its title (in 8-bit characters), manufacturer, media name,
+// and IPDB ID strings, and then by the name, ROM, table type, and grid
+// position strings (in 8-bit characters, as they appear in the XML).
+// The strings are stored without null terminators.
+struct DatabaseSnapshotHeader
+{
+	char signature[16];
+	UINT32 charSize;
+	UINT32 nFiles;
+};
+struct DatabaseSnapshotFileRecord
+{
+	UINT64 size;
+	FILETIME mtime;
+	UINT32 pathLength;
+	UINT32 nGames;
+	UINT32 hasCategory;
+	UINT32 explicitCategoryName;
+	UINT32 categoryNameLength;
+};
+struct DatabaseSnapshotGameRecord
+{
+	UINT32 nodeIndex;
+	INT32 year;
+	float rating;
+	UINT32 enabled;
+	UINT32 titleLength;
+	UINT32 manufLength;
+	UINT32 mediaNameLength;
+	UINT32 ipdbIdLength;
+	UINT32 nameLength;
+	UINT32 romLength;
+	UINT32 tableTypeLength;
+	UINT32 gridPosLength;
+};
+static const char databaseSnapshotSignature[16] = "PBYGameDbSnap/2";
+
+void GameList::GetDatabaseSnapshotFile(TCHAR path[MAX_PATH])
+{
+	GetDeployedFilePath(path, _T("GameDatabaseSnapshot.dat"), _T(""));
+}
+
+void GameList::LoadDatabaseSnapshot(DatabaseSnapshot &snapshot)
+{
+	TCHAR path[MAX_PATH];
+	GetDatabaseSnapshotFile(path);
+	FILEPtrHolder fp;
+	if (_tfopen_s(&fp, path, _T("rb")) != 0)
+		return;
+
+	// check the header
+	DatabaseSnapshotHeader hdr;
+	if (fread(&hdr, sizeof(hdr), 1, fp) != 1
+		|| memcmp(hdr.signature, databaseSnapshotSignature, sizeof(hdr.signature)) != 0
+		|| hdr.charSize != sizeof(TCHAR))
+		return;
+
+	// string readers
+	auto ReadCStr = [&fp](CSTRING &s, UINT32 len) {
+		s.assign(len, 0);
+		return len == 0 || fread(&s[0], sizeof(char), len, fp) == len; };
+	auto ReadTStr = [&fp](TSTRING &s, UINT32 len) {
+		s.assign(len, 0);
+		return len == 0 || fread(&s[0], sizeof(TCHAR), len, fp) == len; };
+
+	// read the files; discard the whole snapshot if anything is amiss
+	for (UINT32 i = 0; i < hdr.nFiles; ++i)
+	{
+		DatabaseSnapshotFileRecord frec;
+		TSTRING key;
+		TSTRING categoryName;
+		if (fread(&frec, sizeof(frec), 1, fp) != 1
+			|| frec.pathLength == 0 || frec.pathLength >= 32768 || frec.categoryNameLength >= 32768
+			|| !ReadTStr(key, frec.pathLength)
+			|| !ReadTStr(categoryName, frec.categoryNameLength))
+			return snapshot.clear();
+
+		auto &sf = snapshot[key];
+		sf.size = frec.size;
+		sf.mtime = frec.mtime;
+		sf.hasCategory = frec.hasCategory != 0;
+		sf.explicitCategoryName = frec.explicitCategoryName != 0;
+		sf.categoryName = std::move(categoryName);
+		sf.games.reserve(frec.nGames);
+		for (UINT32 j = 0; j < frec.nGames; ++j)
+		{
+			DatabaseSnapshotGameRecord grec;
+			if (fread(&grec, sizeof(grec), 1, fp) != 1
+				|| grec.titleLength >= 32768 || grec.manufLength >= 32768
+				|| grec.mediaNameLength >= 32768 || grec.ipdbIdLength >= 32768
+				|| grec.nameLength >= 32768 || grec.romLength >= 32768
+				|| grec.tableTypeLength >= 32768 || grec.gridPosLength >= 32768)
+				return snapshot.clear();
+
+			auto &g = sf.games.emplace_back();
+			g.nodeIndex = grec.nodeIndex;
+			g.year = grec.year;
+			g.rating = grec.rating;
+			g.enabled = grec.enabled != 0;
+			if (!ReadCStr(g.title, grec.titleLength)
+				|| !ReadTStr(g.manufName, grec.manufLength)
+				|| !ReadTStr(g.mediaName, grec.mediaNameLength)
+				|| !ReadTStr(g.ipdbId, grec.ipdbIdLength)
+				|| !ReadCStr(g.nameText, grec.nameLength)
+				|| !ReadCStr(g.romText, grec.romLength)
+				|| !ReadCStr(g.tableTypeText, grec.tableTypeLength)
+				|| !ReadCStr(g.gridPosText, grec.gridPosLength))
+				return snapshot.clear();
+		}
+	}
+
+	Log(_T("Loaded the game database snapshot (%d files)\n"), static_cast<int>(snapshot.size()));
+}
+
+void GameList::SaveDatabaseSnapshot(const std::list<StagedDatabaseFile> &files)
+{
+	// count the files we can save
+	UINT32 nFiles = 0;
+	for (auto &f : files)
+		nFiles += f.status == StagedDatabaseFile::OK ? 1 : 0;
+
+	// Write to a temporary file, then move it into place, so that a
+	// crash while writing can't leave a truncated snapshot behind.
+	TCHAR path[MAX_PATH];
+	GetDatabaseSnapshotFile(path);
+	TSTRING tmpFile = TSTRING(path) + _T(".tmp");
+	bool ok = false;
+	{
+		FILEPtrHolder fp;
+		if (_tfopen_s(&fp, tmpFile.c_str(), _T("wb")) == 0)
+		{
+			DatabaseSnapshotHeader hdr;
+			memcpy(hdr.signature, databaseSnapshotSignature, sizeof(hdr.signature));
+			hdr.charSize = sizeof(TCHAR);
+			hdr.nFiles = nFiles;
+			ok = fwrite(&hdr, sizeof(hdr), 1, fp) == 1;
+
+			for (auto f = files.begin(); ok && f != files.end(); ++f)
+			{
+				if (f->status != StagedDatabaseFile::OK)
+					continue;
+
+				TSTRING key = f->filename;
+				std::transform(key.begin(), key.end(), key.begin(), ::_totlower);
+				DatabaseSnapshotFileRecord frec;
+				frec.size = f->fileSize;
+				frec.mtime = f->fileTime;
+				frec.pathLength = static_cast<UINT32>(key.length());
+				frec.nGames = static_cast<UINT32>(f->games.size());
+				frec.hasCategory = f->hasCategory ? 1 : 0;
+				frec.explicitCategoryName = f->explicitCategoryName ? 1 : 0;
+				frec.categoryNameLength = static_cast<UINT32>(f->categoryName.length());
+				ok = fwrite(&frec, sizeof(frec), 1, fp) == 1
+					&& fwrite(key.c_str(), sizeof(TCHAR), frec.pathLength, fp) == frec.pathLength
+					&& fwrite(f->categoryName.c_str(), sizeof(TCHAR), frec.categoryNameLength, fp) == frec.categoryNameLength;
+
+				// 8-bit string writer, for the fields that point into the XML
+				// text; a null pointer is saved as an empty string
+				auto WriteXmlStr = [&fp](const char *s, UINT32 len) {
+					return len == 0 || fwrite(s, sizeof(char), len, fp) == len; };
+				auto XmlStrLen = [](const char *s) { return s != nullptr ? static_cast<UINT32>(strlen(s)) : 0; };
+
+				for (auto g = f->games.begin(); ok && g != f->games.end(); ++g)
+				{
+					DatabaseSnapshotGameRecord grec;
+					grec.nodeIndex = g->nodeIndex;
+					grec.year = g->year;
+					grec.rating = g->rating;
+					grec.enabled = g->enabled ? 1 : 0;
+					grec.titleLength = static_cast<UINT32>(g->title.length());
+					grec.manufLength = static_cast<UINT32>(g->manufName.length());
+					grec.mediaNameLength = static_cast<UINT32>(g->mediaName.length());
+					grec.ipdbIdLength = static_cast<UINT32>(g->ipdbId.length());
+					grec.nameLength = XmlStrLen(g->name);
+					grec.romLength = XmlStrLen(g->rom);
+					grec.tableTypeLength = XmlStrLen(g->tableType);
+					grec.gridPosLength = XmlStrLen(g->gridPos);
+					ok = fwrite(&grec, sizeof(grec), 1, fp) == 1
+						&& fwrite(g->title.c_str(), sizeof(char), grec.titleLength, fp) == grec.titleLength
+						&& fwrite(g->manufName.c_str(), sizeof(TCHAR), grec.manufLength, fp) == grec.manufLength
+						&& fwrite(g->mediaName.c_str(), sizeof(TCHAR), grec.mediaNameLength, fp) == grec.mediaNameLength
+						&& fwrite(g->ipdbId.c_str(), sizeof(TCHAR), grec.ipdbIdLength, fp) == grec.ipdbIdLength
+						&& WriteXmlStr(g->name, grec.nameLength)
+						&& WriteXmlStr(g->rom, grec.romLength)
+						&& WriteXmlStr(g->tableType, grec.tableTypeLength)
+						&& WriteXmlStr(g->gridPos, grec.gridPosLength);
+				}
+			}
+		}
+	}
+
+	// move the new file into place
+	if (!ok || !MoveFileEx(tmpFile.c_str(), path, MOVEFILE_REPLACE_EXISTING))
+	{
+		DeleteFile(tmpFile.c_str());
+		Log(_T("Unable to save the game database snapshot file %s\n"), path);
+	}
+}
+
+bool GameList::RestoreFromSnapshot(StagedDatabaseFile &file, rapidxml::xml_node<char> *menu)
+{
+	typedef xml_node<char> node;
+	typedef xml_attribute<char> attr;
+
+	// In the lazy XML mode, there's no parse tree, so point the text
+	// fields at the snapshot's copies.  Do this after copying the whole
+	// list, so that the strings don't move afterwards.
+	if (menu == nullptr)
+	{
+		file.games = file.snapshot->games;
+		for (auto &sg : file.games)
+		{
+			// every <game> node has a name attribute
+			if (sg.nameText.length() == 0)
+			{
+				file.games.clear();
+				return false;
+			}
+
+			sg.name = sg.nameText.c_str();
+			sg.rom = sg.romText.c_str();
+			sg.tableType = sg.tableTypeText.c_str();
+			sg.gridPos = sg.gridPosText.c_str();
+		}
+		return true;
+	}
+
+	// enumerate the <game> nodes, so that we can find them by ordinal
+	std::vector<node*> nodes;
+	for (node *game = menu->first_node("game"); game != 0; game = game->next_sibling("game"))
+		nodes.push_back(game);
+
+	// restore the games
+	for (auto &s : file.snapshot->games)
+	{
+		// find the node; a missing node or name attribute means that the
+		// snapshot doesn't match the file after all
+		attr *nameAttr;
+		if (s.nodeIndex >= nodes.size()
+			|| (nameAttr = nodes[s.nodeIndex]->first_attribute("name")) == nullptr)
+		{
+			file.games.clear();
+			return false;
+		}
+
+		// copy the saved fields
+		auto &sg = file.games.emplace_back(s);
+		sg.node = nodes[s.nodeIndex];
+		sg.name = nameAttr->value();
 
-					// count the deletion
-					++nRemoved;
-				}
-			}
+		// find the fields that point into the XML text
+		for (node *n = sg.node->first_node(); n != 0; n = n->next_sibling())
+		{
+			const char *id = n->name();
+			if (_stricmp(id, "rom") == 0)
+				sg.rom = n->value();
+			else if (_stricmp(id, "gridposition") == 0)
+				sg.gridPos = n->value();
+			else if (_stricmp(id, "type") == 0)
+				sg.tableType = n->value();
 		}
 	}
 
-	// return the number of games we removed
-	return nRemoved;
+	// success
+	return true;
 }
 
-GameSystem *GameList::CreateSystem(
-	const TCHAR *systemName, int configIndex,
-	const TCHAR *sysDatabaseDir, const TCHAR *tablePath, const TCHAR *defExt)
+bool GameList::MergeGameDatabaseFile(StagedDatabaseFile &file, ErrorHandler &eh)
 {
-	// Look up the system by name
-	auto it = systems.find(configIndex);
-	if (it == systems.end())
+	// log the file
+	LogGroup();
+	Log(_T("+ System \"%s\": loading table database file %s\n"), file.system->displayName.c_str(), file.filename.c_str());
+
+	// pass along any errors from the staging phase
+	file.errors.EnumErrors([&eh](const ErrorList::Item &e)
 	{
-		// it doesn't exist yet - add it
-		it = systems.emplace(
-			std::piecewise_construct,
-			std::forward_as_tuple(configIndex),
-			std::forward_as_tuple(systemName, configIndex)).first;
+		if (e.details.length() != 0)
+			eh.SysError(e.message.c_str(), e.details.c_str());
+		else
+			eh.Error(e.message.c_str());
+	});
 
-		// Figure the system's generic file name.  The generic file
-		// is of the form <database path>\<system dir>\<system dir>.xml.
-		TCHAR genericFileName[MAX_PATH];
-		_tcscpy_s(genericFileName, sysDatabaseDir);
-		PathAppend(genericFileName, PathFindFileName(sysDatabaseDir));
-		_tcscat_s(genericFileName, _T(".xml"));
+	// check the staging status
+	switch (file.status)
+	{
+	case StagedDatabaseFile::ParseFailed:
+		Log(_T("++ XML parse failed\n"));
+		return false;
 
-		// assign it
-		it->second.genericDbFilename = genericFileName;
+	case StagedDatabaseFile::NoMenu:
+		Log(_T("++ Root <menu> node not found in XML; assuming this isn't a table database file\n"));
+		return false;
 	}
 
-	// Get the system
-	GameSystem *system = &it->second;
-
-	// Look up the table file set object for the system's table file pattern
-	TSTRING key = TableFileSet::GetKey(tablePath, defExt);
-	auto itfs = tableFileSets.find(key);
-	if (itfs == tableFileSets.end())
-	{
-		// there's no table file set for this pattern yet - create one
-		itfs = tableFileSets.emplace(
-			std::piecewise_construct,
-			std::forward_as_tuple(key),
-			std::forward_as_tuple(tablePath, defExt)).first;
-	}
-	else if (defExt != nullptr && defExt[0] != 0)
-	{
-		Log(_T("+ This system uses a folder that has already been scanned (%s\\*%s)\n"),
-			tablePath, defExt);
-	}
+	// log the category information
+	const TCHAR *categoryName = file.hasCategory ? file.categoryName.c_str() : nullptr;
+	if (categoryName != nullptr)
+		Log(_T("++ This file defines category \"%s\" for the games it contains; %s\n"), 
+			categoryName, 
+			file.explicitCategoryName ?
+			_T("the name comes from the explicit <CategoryName> tag in file") :
+			_T("the category name is based on the XML file name"));
 	else
+		Log(_T("++ This is the main file for this system (it doesn't define a category)\n"));
+
+	// If we found a category name, find or create the category
+	// object
+	GameCategory *category = nullptr;
+	if (categoryName != nullptr)
+		category = FindOrCreateCategory(categoryName);
+
+	// remember the category in the XML source file
+	auto xml = file.xml.get();
+	xml->category = category;
+
+	// add the games
+	GameSystem *system = file.system;
+	for (auto &sg : file.games)
 	{
-		Log(_T("+ NOT scanning for this system's tables files, because its default extension is empty\n"));
+		// look up or create the manufacturer object
+		GameManufacturer *manuf = FindOrAddManufacturer(sg.manufName.c_str());
+
+		// make sure there's an appropriate era filter
+		FindOrAddDateFilter(sg.year);
+
+		// add the entry
+		GameListItem &g = games.emplace_back(
+			sg.mediaName.c_str(), sg.title.c_str(), sg.name, manuf, sg.year, sg.ipdbId.c_str(),
+			sg.tableType, sg.rom, system, sg.enabled, sg.gridPos);
+
+		// log it
+		Log(_T("++ adding game %hs, table file %hs, media file base name %s\n"),
+			sg.title.c_str(), sg.name, sg.mediaName.c_str());
+
+		// remember the table file set for the system, and set the file
+		// entry in the system's table file list (if one exists) to point
+		// back to the game list entry
+		g.tableFileSet = system->tableFileSet;
+		auto tableFile = system->tableFileSet->FindFile(g.filename.c_str(), system->defExt.c_str(), true);
+		tableFile->game = &g;
+
+		// remember the game's XML source location; if the XML isn't loaded
+		// (in the lazy XML mode), note the node ordinal to find it later
+		g.dbFile = xml;
+		g.gameXmlNode = sg.node;
+		if (!xml->xmlLoaded)
+			g.gameXmlNodeIndex = static_cast<int>(sg.nodeIndex);
+
+		// set the PBX rating
+		g.pbxRating = sg.rating;
 	}
 
-	// cross-reference the system and the table file set
-	TableFileSet *tfs = &itfs->second;
-	tfs->systems.push_back(system);
-	system->tableFileSet = tfs;
-
-	// return the system we found or created
-	return system;
-}
+	// Hand over the XML file to the game system object.  The game system object
+	// will own the XML file from now on.  This allows it to rewrite the XML
+	// file if we make any changes, such as adding a new game or moving an
+	// existing game to a different category file.  (Note that "system" here 
+	// refers to the game player program, e.g. VP or FP, *not* to the whole
+	// computer or OS as the term is generally used in more generic contexts.)
+	// The reason that we organize this under the game system object is that the
+	// XML files are likewise organized in the folder hierarchy by game system.
+	system->dbFiles.emplace_back(file.xml.release());
 
-GameSystem *GameList::GetSystem(int configIndex)
-{
-	if (auto it = systems.find(configIndex); it != systems.end())
-		return &it->second;
-	return nullptr;
+	// success 
+	return true;
 }
 
-bool GameList::LoadGameDatabaseFile(
-	const TCHAR *filename, const TCHAR *parentFolder,
-	GameSystem *system, ErrorHandler &eh)
+void GameList::StageGameDatabaseFile(StagedDatabaseFile &file)
 {
-	// set up for logging
-	auto Log = [](const TCHAR *msg, ...)
+	// note the file's size and modification time, for the snapshot
+	WIN32_FILE_ATTRIBUTE_DATA attrs;
+	if (GetFileAttributesEx(file.filename.c_str(), GetFileExInfoStandard, &attrs))
 	{
-		va_list ap;
-		va_start(ap, msg);
-		LogFile::Get()->WriteV(false, LogFile::SystemSetupLogging, msg, ap);
-		va_end(ap);
-	};
-	auto LogGroup = []() { LogFile::Get()->Group(LogFile::SystemSetupLogging); };
+		file.fileSize = (static_cast<UINT64>(attrs.nFileSizeHigh) << 32) | attrs.nFileSizeLow;
+		file.fileTime = attrs.ftLastWriteTime;
+	}
+	else
+		file.snapshot = nullptr;
+
+	// In the lazy XML mode, if the snapshot entry is current, take the
+	// category and the games from the snapshot, and skip loading the
+	// XML until something needs to update it.
+	if (file.lazyXml
+		&& file.snapshot != nullptr
+		&& file.snapshot->size == file.fileSize
+		&& CompareFileTime(&file.snapshot->mtime, &file.fileTime) == 0
+		&& RestoreFromSnapshot(file, nullptr))
+	{
+		file.xml.reset(new GameDatabaseFile());
+		file.xml->filename = file.filename;
+		file.hasCategory = file.snapshot->hasCategory;
+		file.explicitCategoryName = file.snapshot->explicitCategoryName;
+		file.categoryName = file.snapshot->categoryName;
+		file.fromSnapshot = true;
+		file.status = StagedDatabaseFile::OK;
+		return;
+	}
 
 	// read and parse the XML
-	std::unique_ptr<GameDatabaseFile> xml(new GameDatabaseFile());
-	if (!xml->Load(filename, eh))
+	file.xml.reset(new GameDatabaseFile());
+	auto &xml = file.xml;
+	if (!xml->Load(file.filename.c_str(), file.errors))
 	{
-		Log(_T("++ XML parse failed\n"));
-		return false;
+		file.status = StagedDatabaseFile::ParseFailed;
+		return;
 	}
 
 	// make sure it has the root <menu> node
@@ -2215,8 +3750,8 @@ bool GameList::LoadGameDatabaseFile(
 	node *menu = xml->doc.first_node("menu");
 	if (menu == nullptr)
 	{
-		Log(_T("++ Root <menu> node not found in XML; assuming this isn't a table database file\n"));
-		return false;
+		file.status = StagedDatabaseFile::NoMenu;
+		return;
 	}
 
 	// Determine if the file defines a "category".
@@ -2246,16 +3781,18 @@ bool GameList::LoadGameDatabaseFile(
 	// the root filename (that is, minus path prefix and .xml 
 	// suffix) to get the implied category name.
 	TCHAR categoryNameBuf[MAX_PATH];
-	_tcscpy_s(categoryNameBuf, PathFindFileName(filename));
+	_tcscpy_s(categoryNameBuf, PathFindFileName(file.filename.c_str()));
 	PathRemoveExtension(categoryNameBuf);
 
 	// Now check the file name against the parent folder name.  If
 	// it's the same, this is the "generic" list for the system,
 	// which doesn't define a category; otherwise, it implies the 
 	// category name.
-	const TCHAR *categoryName = nullptr;
-	if (_tcsicmp(categoryNameBuf, parentFolder) != 0)
-		categoryName = categoryNameBuf;
+	if (_tcsicmp(categoryNameBuf, file.parentFolder.c_str()) != 0)
+	{
+		file.hasCategory = true;
+		file.categoryName = categoryNameBuf;
+	}
 
 	// There's one more special case, this time of our own making 
 	// rather than a PinballX compatibility point.  Unlike PinballX,
@@ -2266,33 +3803,14 @@ bool GameList::LoadGameDatabaseFile(
 	// tag into the XML file with the new name.  So if we find 
 	// this tag, it overrides the name implied by the filename.
 	// This is true even if the name matches the system name.
-	TSTRING catNameNodeVal;
 	if (node *catNameNode = menu->first_node("CategoryName");
 		catNameNode != nullptr && catNameNode->value() != nullptr)
 	{
-		catNameNodeVal = AnsiToTSTRING(catNameNode->value());
-		categoryName = catNameNodeVal.c_str();
+		file.hasCategory = true;
+		file.categoryName = AnsiToTSTRING(catNameNode->value());
+		file.explicitCategoryName = file.categoryName.length() != 0;
 	}
 
-	// log the category information
-	if (categoryName != nullptr)
-		Log(_T("++ This file defines category \"%s\" for the games it contains; %s\n"), 
-			categoryName, 
-			catNameNodeVal.length() != 0 ? 
-			_T("the name comes from the explicit <CategoryName> tag in file") :
-			_T("the category name is based on the XML file name"));
-	else
-		Log(_T("++ This is the main file for this system (it doesn't define a category)\n"));
-
-	// If we found a category name, find or create the category
-	// object
-	GameCategory *category = nullptr;
-	if (categoryName != nullptr)
-		category = FindOrCreateCategory(categoryName);
-
-	// remember the category in the XML source file
-	xml->category = category;
-
 	// Our schema is based on the PinballX/HyperPin XML schema, with some
 	// added tags of our own.  We originally tried to stick to their schema
 	// exactly, but we've since changed that policy to allow minimal new tags,
@@ -2337,10 +3855,23 @@ bool GameList::LoadGameDatabaseFile(
 	//   from the <description> tag.  On save, we store this only if it's
 	//   different from the implied title in the media name.
 	//
+	// If the snapshot from the last session has the fields for this
+	// version of the file, use the saved fields.
+	if (file.snapshot != nullptr
+		&& file.snapshot->size == file.fileSize
+		&& CompareFileTime(&file.snapshot->mtime, &file.fileTime) == 0
+		&& RestoreFromSnapshot(file, menu))
+	{
+		file.fromSnapshot = true;
+		file.status = StagedDatabaseFile::OK;
+		return;
+	}
+
 	if (node *menu = xml->doc.first_node("menu"); menu != nullptr)
 	{
 		// visit the <game> nodes
-		for (node *game = menu->first_node("game"); game != 0; game = game->next_sibling("game"))
+		UINT32 nodeIndex = 0;
+		for (node *game = menu->first_node("game"); game != 0; game = game->next_sibling("game"), ++nodeIndex)
 		{
 			// pull out the name attribute
 			attr *nameAttr = game->first_attribute("name");
@@ -2499,53 +4030,27 @@ bool GameList::LoadGameDatabaseFile(
 				if (explicitTitle != nullptr)
 					title = explicitTitle;
 
-				// look up or create the manufacturer object
-				GameManufacturer *manuf = FindOrAddManufacturer(manufName.c_str());
-
-				// make sure there's an appropriate era filter
-				FindOrAddDateFilter(year);
-
-				// form the media name based on the description string
-				TSTRING mediaName = GameListItem::CleanMediaName(AnsiToTSTRING(desc).c_str());
-
-				// add the entry
-				GameListItem &g = games.emplace_back(
-					mediaName.c_str(), title.c_str(), name, manuf, year, ipdbId.c_str(),
-					tableType, rom, system, enabled, gridPos);
-
-				// log it
-				Log(_T("++ adding game %hs, table file %hs, media file base name %s\n"),
-					title.c_str(), name, mediaName.c_str());
-
-				// remember the table file set for the system, and set the file
-				// entry in the system's table file list (if one exists) to point
-				// back to the game list entry
-				g.tableFileSet = system->tableFileSet;
-				auto tableFile = system->tableFileSet->FindFile(g.filename.c_str(), system->defExt.c_str(), true);
-				tableFile->game = &g;
-
-				// remember the game's XML source location
-				g.dbFile = xml.get();
-				g.gameXmlNode = game;
-
-				// set the PBX rating
-				g.pbxRating = rating;
+				// stage the entry
+				auto &sg = file.games.emplace_back();
+				sg.name = name;
+				sg.title = std::move(title);
+				sg.manufName = std::move(manufName);
+				sg.mediaName = GameListItem::CleanMediaName(AnsiToTSTRING(desc).c_str());
+				sg.year = year;
+				sg.ipdbId = std::move(ipdbId);
+				sg.tableType = tableType;
+				sg.rom = rom;
+				sg.gridPos = gridPos;
+				sg.enabled = enabled;
+				sg.rating = rating;
+				sg.node = game;
+				sg.nodeIndex = nodeIndex;
 			}
 		}
 	}
 
-	// Hand over the XML file to the game system object.  The game system object
-	// will own the XML file from now on.  This allows it to rewrite the XML
-	// file if we make any changes, such as adding a new game or moving an
-	// existing game to a different category file.  (Note that "system" here 
-	// refers to the game player program, e.g. VP or FP, *not* to the whole
-	// computer or OS as the term is generally used in more generic contexts.)
-	// The reason that we organize this under the game system object is that the
-	// XML files are likewise organized in the folder hierarchy by game system.
-	system->dbFiles.emplace_back(xml.release());
-
-	// success 
-	return true;
+	// success
+	file.status = StagedDatabaseFile::OK;
 }
 
 TSTRING GameList::GetDataFilePath(const TCHAR *configVarName, const TCHAR *defaultFolder,
@@ -2798,8 +4303,10 @@ GameCategory *GameList::FindOrCreateCategory(const TCHAR *name)
 	if (it != categories.end())
 		return it->second.get();
 
-	// create a new category object
+	// create a new category object, and assign it the next ID
 	GameCategory *newcat = new GameCategory(name);
+	newcat->id = static_cast<int>(categoriesById.size());
+	categoriesById.push_back(newcat);
 
 	// add it to the map
 	categories.emplace(
@@ -2885,14 +4392,14 @@ void GameList::RenameCategory(GameCategory *category, const TCHAR *newName)
 				// Try renaming the file.  If the file contains any
 				// path-related characters or outright invalid characters,
 				// don't bother trying.
-				std::basic_regex<TCHAR> invPat(_T("[\\\\/*?+:\"|<>]"));
+				static const std::basic_regex<TCHAR> invPat(_T("[\\\\/*?+:\"|<>]"));
 				if (!std::regex_search(newName, invPat) && MoveFile(f->filename.c_str(), newfname))
 				{
 					// Success - the category name is now implicit in the
 					// filename.  If we previously added a <CategoryName>
 					// tag to the file's contents (see below), we can now
 					// remove it.
-					if (auto root = f->doc.first_node(); root != nullptr)
+					if (auto root = LoadDbFileXml(f.get()) ? f->doc.first_node() : nullptr; root != nullptr)
 					{
 						if (auto node = root->first_node("CategoryName"); node != nullptr)
 						{
@@ -2967,7 +4474,7 @@ void GameList::RenameCategory(GameCategory *category, const TCHAR *newName)
 					// that the category name as shown in the UI always
 					// exactly matches what the user entered, even though 
 					// we couldn't give the file that exact name on disk.
-					if (auto root = f->doc.first_node(); root != nullptr)
+					if (auto root = LoadDbFileXml(f.get()) ? f->doc.first_node() : nullptr; root != nullptr)
 					{
 						auto value = f->doc.allocate_string(TCHARToAnsi(newName).c_str());
 						auto node = root->first_node("CategoryNode");
@@ -2981,20 +4488,61 @@ void GameList::RenameCategory(GameCategory *category, const TCHAR *newName)
 		}
 	}
 
-	// Notify all of the games associated with the category
-	// that we're renaming the category.
-	for (auto &g : games)
+	// The games' membership sets refer to the category by ID, so they
+	// don't change.  But the stats db text for the games in the category
+	// lists it by name, so it has to be rebuilt before the next save.
+	// The reverse index gives us the member rows directly.
+	if (category->id >= 0 && static_cast<size_t>(category->id) < categoryRows.size())
 	{
-		if (IsInCategory(&g, category))
-			OnRenameCategory(&g, category, oldName.c_str());
+		for (int row : categoryRows[category->id])
+			categoryTextDirtyRows.emplace(row);
 	}
+	statsDb.SetDirty();
+
+	// the search index has the old name, so rebuild it on the next search
+	searchWords.clear();
+	searchGames.clear();
+	searchTitleIndexValid = false;
 }
 
 void GameList::DeleteCategory(GameCategory *category)
 {
-	// first, delete the category from all games that include it
-	for (auto &g : games)
-		RemoveCategory(&g, category);
+	// First, delete the category from all games that include it.  Start
+	// with the stats db lists, which the reverse index gives us directly.
+	// Copy the row set, since removing the category updates the index.
+	if (category->id >= 0 && static_cast<size_t>(category->id) < categoryRows.size())
+	{
+		std::unordered_set<int> rows = categoryRows[category->id];
+		for (int row : rows)
+		{
+			if (auto d = dynamic_cast<ParsedCategoryData*>(categoriesCol->GetParsedData(row)); d != nullptr)
+			{
+				RemoveCategoryFromRow(d, row, category->id);
+				RebuildCategoryList(row);
+			}
+		}
+	}
+
+	// Games can also be in the category through their XML file placement.
+	// That only happens if some system has a database file for the
+	// category, so we only have to visit the games when one exists.
+	bool hasCategoryFile = false;
+	for (auto &s : systems)
+	{
+		for (auto &f : s.second.dbFiles)
+		{
+			if (f->category == category)
+				hasCategoryFile = true;
+		}
+	}
+	if (hasCategoryFile)
+	{
+		for (auto &g : games)
+		{
+			if (g.dbFile != nullptr && g.dbFile->category == category && g.system != nullptr)
+				MoveGameToDbFile(&g, nullptr);
+		}
+	}
 
 	// remove the category from the filter list
 	if (auto it = std::find(filters.begin(), filters.end(), category); it != filters.end())
@@ -3140,10 +4688,10 @@ void GameList::MoveGameToDbFile(GameListItem *game, GameDatabaseFile *dbFile)
 		dbFile = GetGenericDbFile(game->system, true);
 
 	// add the game's XML node to the generic file's XML tree
-	if (auto newParent = dbFile->doc.first_node(); newParent != nullptr)
+	if (auto newParent = LoadDbFileXml(dbFile) ? dbFile->doc.first_node() : nullptr; newParent != nullptr)
 	{
 		// get the game's defining node
-		if (auto gameNode = game->gameXmlNode; gameNode != nullptr)
+		if (auto gameNode = game->GetXmlNode(); gameNode != nullptr)
 		{
 			// remove it from its existing document
 			if (gameNode->parent() != nullptr)
@@ -3152,10 +4700,17 @@ void GameList::MoveGameToDbFile(GameListItem *game, GameDatabaseFile *dbFile)
 			// add it to the new document
 			newParent->append_node(gameNode);
 
-			// both the old and new db files now have unsaved changes
+			// Both the old and new db files now have unsaved changes.  The
+			// node's memory belongs to the old file's document, so the old
+			// document has to stay loaded from now on.
 			dbFile->isDirty = true;
-			if (game->dbFile != nullptr)
+			NoteDbFileMove(dbFile);
+			if (game->dbFile != nullptr && game->dbFile != dbFile)
+			{
 				game->dbFile->isDirty = true;
+				game->dbFile->keepXml = true;
+				NoteDbFileMove(game->dbFile);
+			}
 		}
 
 		// set the game's new source file location
@@ -3214,8 +4769,8 @@ void GameList::JustAddCategory(GameListItem *game, const GameCategory *category)
 	if (d == nullptr)
 		categoriesCol->SetParsedData(row, d = new ParsedCategoryData());
 
-	// add the category to the parsed list
-	d->categories.push_back(category);
+	// add the category to the parsed set
+	AddCategoryToRow(d, row, category->id);
 }
 
 
@@ -3245,8 +4800,8 @@ void GameList::JustRemoveCategory(GameListItem *game, const GameCategory *catego
 	auto d = dynamic_cast<ParsedCategoryData*>(categoriesCol->GetParsedData(row));
 	if (d != nullptr)
 	{
-		// found it - remove the category from the list if present
-		d->categories.remove(category);
+		// found it - remove the category from the set if present
+		RemoveCategoryFromRow(d, row, category->id);
 	}
 
 	// Now the tricky part!  If the category was established by the
@@ -3257,23 +4812,6 @@ void GameList::JustRemoveCategory(GameListItem *game, const GameCategory *catego
 		MoveGameToDbFile(game, nullptr);
 }
 
-void GameList::OnRenameCategory(GameListItem *game, const GameCategory *category, const TCHAR * /*oldName*/)
-{
-	// If the game is associated with the category by way of the
-	// stats database "Categories" column, that column in the
-	// game's row already has a pointer to the category object
-	// in its parsed data object, so it already "knows" about
-	// the name change by reference to the category object.
-	// But that means that we have to rebuild the string version
-	// of the column data.  If we don't have a database row or
-	// a category column already, there's no need to add one,
-	// since that means we don't have such a pointer - our
-	// association with the category must come from the XML
-	// file placement instead.
-	if (auto rownum = GetStatsDbRow(game, false); rownum >= 0)
-		RebuildCategoryList(rownum);
-}
-
 void GameList::RebuildCategoryList(int rownum)
 {
 	// ignore this for invalid rows
@@ -3282,13 +4820,43 @@ void GameList::RebuildCategoryList(int rownum)
 
 	// Get the category list.  If there isn't one already, there's
 	// no Categories column in this row, so there's nothing to
-	// rebuild and we can simply skip this.
+	// rebuild and we can simply skip this.  Otherwise, mark the text
+	// as out of date; we'll rebuild it when we save the file.
 	if (auto d = dynamic_cast<ParsedCategoryData*>(categoriesCol->GetParsedData(rownum)); d != nullptr)
 	{
+		d->textDirty = true;
+		categoryTextDirtyRows.emplace(rownum);
+		statsDb.MarkRowChanged(rownum);
+	}
+}
+
+void GameList::AddCategoryToRow(ParsedCategoryData *d, int row, int id)
+{
+	d->categories.Add(id);
+	if (static_cast<size_t>(id) >= categoryRows.size())
+		categoryRows.resize(id + 1);
+	categoryRows[id].emplace(row);
+}
+
+void GameList::RemoveCategoryFromRow(ParsedCategoryData *d, int row, int id)
+{
+	d->categories.Remove(id);
+	if (id >= 0 && static_cast<size_t>(id) < categoryRows.size())
+		categoryRows[id].erase(row);
+}
+
+void GameList::SyncCategoryLists()
+{
+	// rebuild the text for each row that needs it
+	for (int row : categoryTextDirtyRows)
+	{
+		auto d = dynamic_cast<ParsedCategoryData*>(categoriesCol->GetParsedData(row));
+		if (d == nullptr)
+			continue;
+
 		// Build a list of category names
 		std::list<TSTRING> catNames;
-		for (auto cat : d->categories)
-			catNames.emplace_back(cat->name);
+		d->categories.ForEach([this, &catNames](int id) { catNames.emplace_back(categoriesById[id]->name); });
 
 		// Construct the comma-separated list, using CSV format rules
 		TSTRING buf;
@@ -3297,9 +4865,14 @@ void GameList::RebuildCategoryList(int rownum)
 			return true;
 		});
 
-		// set the text list form of the category list
-		categoriesCol->Set(rownum, buf.c_str());
+		// set the text list form of the category list, if it's changed
+		if (const TCHAR *cur = categoriesCol->Get(row, _T("")); _tcscmp(cur, buf.c_str()) != 0)
+			categoriesCol->Set(row, buf.c_str());
+		d->textDirty = false;
 	}
+
+	// the text is now in sync
+	categoryTextDirtyRows.clear();
 }
 
 void GameList::GetCategoryList(GameListItem *game, std::list<const GameCategory*> &cats)
@@ -3308,8 +4881,7 @@ void GameList::GetCategoryList(GameListItem *game, std::list<const GameCategory*
 	if (auto d = dynamic_cast<ParsedCategoryData*>(categoriesCol->GetParsedData(GetStatsDbRow(game, false))); d != nullptr)
 	{
 		// copy the categories to the caller's result list
-		for (auto cat : d->categories)
-			cats.push_back(cat);
+		d->categories.ForEach([this, &cats](int id) { cats.push_back(categoriesById[id]); });
 	}
 
 	// Also add the implicit category set by the XML file where the game
@@ -3323,8 +4895,8 @@ bool GameList::IsInCategory(GameListItem *game, const GameCategory *category)
 	// look up the game's category list in the stats database
 	if (auto d = dynamic_cast<ParsedCategoryData*>(categoriesCol->GetParsedData(GetStatsDbRow(game, false))); d != nullptr)
 	{
-		// We have a stats db entry.  Look for the category in that list.
-		if (auto it = findex(d->categories, category); it != d->categories.end())
+		// We have a stats db entry.  Look for the category in that set.
+		if (d->categories.Test(category->id))
 			return true;
 	}
 
@@ -3339,7 +4911,7 @@ bool GameList::IsUncategorized(GameListItem *game)
 	// Look up the game's category list in the stats database.  If we have an
 	// entry with one or more categories listed, we're not uncategorized.
 	if (auto d = dynamic_cast<ParsedCategoryData*>(categoriesCol->GetParsedData(GetStatsDbRow(game, false)));
-		d != nullptr && d->categories.size() != 0)
+		d != nullptr && !d->categories.IsEmpty())
 		return false;
 
 	// We don't have any stats db category entries, so we're uncategorized
@@ -3363,7 +4935,7 @@ void GameList::ParseCategoryList(int row)
 
 		// add each category to the column data object
 		for (auto &catName : catNames)
-			data->categories.push_back(FindOrCreateCategory(catName.c_str()));
+			AddCategoryToRow(data.get(), row, FindOrCreateCategory(catName.c_str())->id);
 
 		// Store the category data object in the database row.  Note that we
 		// release the pointer to hand over ownership of the memory.
@@ -3459,8 +5031,18 @@ void GameList::ChangeSystem(GameListItem *game, GameSystem *newSystem)
 	// If we're currently associated with a system, our XML record
 	// is in the old system's database file, so the first step is
 	// to remove it from the old XML tree.
-	if (game->system != nullptr && game->gameXmlNode != nullptr && game->gameXmlNode->parent() != nullptr)
+	// The node's memory belongs to the old document, so the old
+	// document has to stay loaded from now on.
+	if (game->system != nullptr && game->GetXmlNode() != nullptr && game->gameXmlNode->parent() != nullptr)
+	{
 		game->gameXmlNode->parent()->remove_node(game->gameXmlNode);
+		if (game->dbFile != nullptr)
+		{
+			game->dbFile->isDirty = true;
+			game->dbFile->keepXml = true;
+			NoteDbFileMove(game->dbFile);
+		}
+	}
 
 	// Get the game's current category list.  The game's database
 	// file location can give it a category, so before we remove
@@ -3474,8 +5056,9 @@ void GameList::ChangeSystem(GameListItem *game, GameSystem *newSystem)
 	// remove the game from its current database file
 	game->dbFile = nullptr;
 
-	// Remember the new system
+	// Remember the new system, and re-file the game under it
 	game->system = newSystem;
+	UpdateAttrIndex(game);
 
 	// If we have a new system, move the XML record into the new
 	// system's database file.
@@ -3542,12 +5125,11 @@ void GameList::ChangeSystem(GameListItem *game, GameSystem *newSystem)
 		// if we have a field now, update it
 		if (d != nullptr)
 		{
-			// clear the stats db list
-			d->categories.clear();
-
-			// copy the new category list into the stats db
+			// replace the stats db set with the new category list
+			d->categories.ForEach([this, row](int id) { categoryRows[id].erase(row); });
+			d->categories = CategorySet();
 			for (auto cat : oldCats)
-				d->categories.push_back(cat);
+				AddCategoryToRow(d, row, cat->id);
 		}
 
 		// rebuild the text list from the parsed list
@@ -3559,7 +5141,7 @@ void GameList::DeleteXml(GameListItem *game)
 {
 	// There's nothing to do if the game isn't in a db file or doesn't
 	// have an XML record.
-	if (game->dbFile == nullptr || game->gameXmlNode == nullptr)
+	if (game->dbFile == nullptr || game->GetXmlNode() == nullptr)
 		return;
 
 	// get the document and parent node
@@ -3603,8 +5185,10 @@ void GameList::DeleteXml(GameListItem *game)
 
 void GameList::FlushToXml(GameListItem *game)
 {
-	// There's nothing to do if the game isn't in a db file
-	if (game->dbFile == nullptr)
+	// There's nothing to do if the game isn't in a db file.  Also stop
+	// if we can't load the file's XML, since saving the document would
+	// replace the file contents with just this game.
+	if (game->dbFile == nullptr || !LoadDbFileXml(game->dbFile))
 		return;
 
 	// If the game doesn't already have an XML record, create one. 
@@ -3612,7 +5196,7 @@ void GameList::FlushToXml(GameListItem *game)
 	// in a database will have no XML until the user edits the
 	// game record and adds it to a system.
 	auto &doc = game->dbFile->doc;
-	auto par = game->gameXmlNode;
+	auto par = game->GetXmlNode();
 	if (par == nullptr)
 	{
 		// create the root game node
@@ -3860,37 +5444,64 @@ bool GameList::FindGlobalMediaFile(TCHAR path[MAX_PATH], const TCHAR *subfolder,
 	TCHAR localMediaPath[MAX_PATH];
 	GetDeployedFilePath(localMediaPath, _T("Media"), _T(""));
 	PathAppend(localMediaPath, subfolder);
-	PathCombine(path, localMediaPath, file);
-	LogFile::Get()->Write(LogFile::MediaFileLogging, _T("Searching for %s in %s.*\n"), file, localMediaPath);
-	if (FindFileUsingExtensions(path, exts, numExts))
-		return true;
+	const TCHAR *dirs[3] = { localMediaPath };
+	size_t nDirs = 1;
 
-	// No luck there.  Look in the <base media folder>\<subfolder> next.
+	// If that fails, look in the <base media folder>\<subfolder> next.
 	// Don't bother doing the file lookup if the path is identical to the
 	// local media path, which it will be if this installation isn't set
 	// up to share media files with HyperPin or PinballX.
 	TCHAR baseMediaPath[MAX_PATH];
 	PathCombine(baseMediaPath, GetMediaPath(), subfolder);
-	PathCombine(path, baseMediaPath, file);
 	if (_tcsicmp(localMediaPath, baseMediaPath) != 0)
-	{
-		LogFile::Get()->Write(LogFile::MediaFileLogging, _T("Searching for %s in %s.*\n"), file, baseMediaPath);
-		if (FindFileUsingExtensions(path, exts, numExts))
-			return true;
-	}
+		dirs[nDirs++] = baseMediaPath;
 
-	// Still not found.  Try the <PinballY>\Assets\<subfolder>, in case this 
-	// item has a built-in default media file.  This is the option of last
+	// Finally, try the <PinballY>\Assets\<subfolder>, in case this item
+	// has a built-in default media file.  This is the option of last
 	// resort, since it's the built-in program option.
-	GetDeployedFilePath(path, _T("Assets"), _T(""));
-	PathAppend(path, subfolder);
-	LogFile::Get()->Write(LogFile::MediaFileLogging, _T("Searching for %s in %s.*\n"), file, path);
-	PathAppend(path, file);
-	if (FindFileUsingExtensions(path, exts, numExts))
-		return true;
+	TCHAR assetsPath[MAX_PATH];
+	GetDeployedFilePath(assetsPath, _T("Assets"), _T(""));
+	PathAppend(assetsPath, subfolder);
+	dirs[nDirs++] = assetsPath;
+
+	// Search the folders through the media file index.  This caches the
+	// result, so a repeated lookup costs a single hash lookup, even for
+	// the optional files that usually don't exist.
+	bool found = MediaFileIndex::FindFirst(path, dirs, nDirs, file, exts, numExts);
+	LogFile::Get()->Write(LogFile::MediaFileLogging, _T("Searching for global media file %s in %s: %s\n"),
+		file, subfolder, found ? path : _T("not found"));
+	return found;
+}
+
+void GameList::PrefetchGlobalMedia()
+{
+	// Snapshot the standard global media subfolders under each of the
+	// locations FindGlobalMediaFile() searches, so that the first UI
+	// sound and default background lookups don't have to wait for the
+	// disk.  System-specific subfolders are left for first use.
+	static const TCHAR *const subfolders[] = {
+		_T("Images"), _T("Videos"), _T("Startup Videos"), _T("Startup Sounds"),
+		_T("Button Sounds"), _T("System Underlays"), _T("System Logos")
+	};
 
-	// no files found
-	return false;
+	TCHAR localMediaPath[MAX_PATH], assetsPath[MAX_PATH];
+	GetDeployedFilePath(localMediaPath, _T("Media"), _T(""));
+	GetDeployedFilePath(assetsPath, _T("Assets"), _T(""));
+	const TCHAR *const roots[] = { localMediaPath, GetMediaPath(), assetsPath };
+
+	std::vector<TSTRING> dirs;
+	for (auto root : roots)
+	{
+		for (auto sub : subfolders)
+		{
+			TCHAR dir[MAX_PATH];
+			PathCombine(dir, root, sub);
+			if (std::find_if(dirs.begin(), dirs.end(), [&dir](const TSTRING &d) { return _tcsicmp(d.c_str(), dir) == 0; }) == dirs.end())
+				dirs.emplace_back(dir);
+		}
+	}
+
+	MediaFileIndex::Prefetch(std::move(dirs));
 }
 
 
@@ -3980,7 +5591,7 @@ GameListItem::GameListItem(
 	// parse the grid position if present
 	if (gridPos != nullptr)
 	{
-		std::regex gridPat("\\s*(\\d+)x(\\d+)\\s*", std::regex_constants::icase);
+		static const std::regex gridPat("\\s*(\\d+)x(\\d+)\\s*", std::regex_constants::icase);
 		std::match_results<const char*> m;
 		if (std::regex_match(gridPos, m, gridPat))
 		{
@@ -4037,11 +5648,23 @@ void GameListItem::SetTitleFromFilename()
 	this->title.assign(filename.c_str(), lenSansExt);
 }
 
+rapidxml::xml_node<char> *GameListItem::GetXmlNode()
+{
+	// if the node isn't connected because the XML isn't loaded, load it
+	if (gameXmlNode == nullptr && gameXmlNodeIndex >= 0 && dbFile != nullptr)
+	{
+		if (auto gl = GameList::Get(); gl != nullptr)
+			gl->LoadDbFileXml(dbFile);
+	}
+	return gameXmlNode;
+}
+
 void GameListItem::CommonInit()
 {
 	// clear fields
 	dbFile = nullptr;
 	gameXmlNode = nullptr;
+	gameXmlNodeIndex = -1;
 	pbxRating = 0;
 	highScoreStatus = Init;
 	tableFileSet = nullptr;
@@ -4667,8 +6290,10 @@ bool GameListItem::GetMediaItems(std::list<TSTRING> &filenames,
 				// before knowing for sure
 				bool include = true;
 
-				// if the GMI_EXISTS flag is set, only include the file if it exists
-				if ((flags & GMI_EXISTS) != 0 && !FileExists(fullName))
+				// If the GMI_EXISTS flag is set, only include the file if it exists.
+				// Check through the media file index, which answers from its folder
+				// snapshot rather than probing the file system for every candidate.
+				if ((flags & GMI_EXISTS) != 0 && !MediaFileIndex::FileExists(fullName))
 					include = false;
 
 				// If GMI_NO_SWF is set, skip it if it's an SWF file.  Note that there's
@@ -4686,7 +6311,7 @@ bool GameListItem::GetMediaItems(std::list<TSTRING> &filenames,
 					bool swf = true;
 
 					// ...but if the file exists, check the contents to be sure
-					if (FileExists(fullName))
+					if (MediaFileIndex::FileExists(fullName))
 					{
 						ImageFileDesc desc;
 						if (GetImageFileInfo(fullName, desc) && desc.imageType != ImageFileDesc::ImageType::SWF)
@@ -4704,9 +6329,9 @@ bool GameListItem::GetMediaItems(std::list<TSTRING> &filenames,
 				// it's older, keep the last item and skip this item.
 				if (include && (flags & GMI_NEWEST) != 0)
 				{
-					// get this file's attributes
-					WIN32_FILE_ATTRIBUTE_DATA attrs;
-					if (GetFileAttributesEx(fullName, GetFileExInfoStandard, &attrs))
+					// get this file's modification time
+					FILETIME ftLastWrite;
+					if (MediaFileIndex::GetFileTime(fullName, ftLastWrite))
 					{
 						// If this is the first file of this group that we've found so far,
 						// include it, since there's nothing newer to consider yet.  If we've
@@ -4714,7 +6339,7 @@ bool GameListItem::GetMediaItems(std::list<TSTRING> &filenames,
 						// the newer item.
 						if (addedToGroup)
 						{
-							if (CompareFileTime(&attrs.ftLastWriteTime, &lastFileTime) > 0)
+							if (CompareFileTime(&ftLastWrite, &lastFileTime) > 0)
 							{
 								// this file is newer - kick out the previous item and keep
 								// this item instead
@@ -4732,7 +6357,7 @@ bool GameListItem::GetMediaItems(std::list<TSTRING> &filenames,
 						// find another item at the same level and need to repeat this test
 						// on the next file
 						if (include)
-							lastFileTime = attrs.ftLastWriteTime;
+							lastFileTime = ftLastWrite;
 					}
 					else
 					{
@@ -4785,7 +6410,7 @@ TSTRING GameListItem::GetDropDestFile(const TCHAR *droppedFile, const MediaType
 {
 	// Split the dropped filename into path, base filename, and
 	// extension elements
-	std::basic_regex<TCHAR> compPat(_T("(?:(.*)\\\\)?([^\\\\]+)(\\.[^\\\\.]+)$"));
+	static const std::basic_regex<TCHAR> compPat(_T("(?:(.*)\\\\)?([^\\\\]+)(\\.[^\\\\.]+)$"));
 	std::match_results<const TCHAR*> m;
 	TSTRING path, baseName, ext;
 	if (std::regex_match(droppedFile, m, compPat))
@@ -4804,7 +6429,7 @@ TSTRING GameListItem::GetDropDestFile(const TCHAR *droppedFile, const MediaType
 	int index = 0;
 	if (t.indexed)
 	{
-		std::basic_regex<TCHAR> indexPat(_T(".*\\s(\\d+)$"));
+		static const std::basic_regex<TCHAR> indexPat(_T(".*\\s(\\d+)$"));
 		if (std::regex_match(baseName.c_str(), m, indexPat))
 			index = _ttoi(m[1].str().c_str());
 	}
@@ -4815,7 +6440,7 @@ TSTRING GameListItem::GetDropDestFile(const TCHAR *droppedFile, const MediaType
 	if (t.pageList != nullptr)
 	{
 		// pull out the last element
-		std::basic_regex<TCHAR> lastElePat(_T("(?:.*\\\\)?([^\\\\]+)$"));
+		static const std::basic_regex<TCHAR> lastElePat(_T("(?:.*\\\\)?([^\\\\]+)$"));
 		if (std::regex_match(path.c_str(), m, lastElePat))
 		{
 			// Validate that it's in the list
@@ -4903,7 +6528,7 @@ void GameListItem::SetHidden(bool f, bool updateDatabases)
 		// when possible.  And if there's no XML node at all, we don't
 		// need to add one - this means that the game is unconfigured
 		// and thus (by definition) has no XML database entry.
-		if (gameXmlNode != nullptr && dbFile != nullptr)
+		if (dbFile != nullptr && GetXmlNode() != nullptr)
 		{
 			// find the <enabled> node
 			if (auto enabledNode = gameXmlNode->first_node("enabled"); enabledNode != nullptr)
@@ -5081,42 +6706,64 @@ void RecencyFilter::BeforeScan()
 	__super::BeforeScan();
 }
 
+bool RecencyFilter::Include(GameListItem *game)
+{
+	// Get the game's indexed date.  The DATE value is a 'double'
+	// representing the number of days since the epoch, with the time
+	// of day as the fractional part, so the start of the interval is
+	// simply the current midnight minus the interval in days.  A zero
+	// date means the game has no valid date, so it's not in any
+	// interval.
+	auto gl = GameList::Get();
+	int row = gl->GetStatsDbRow(game);
+	DATE d = gl->GetIndexedDate(GetDateIndexType(), row);
+	return IncludeIndexed(game, row, d != 0.0 && d >= midnight - days);
+}
+
+void RecencyFilter::IncludeBatch(const std::vector<GameListItem*> &games, std::vector<bool> &include)
+{
+	// Mark the rows with dates in the interval, via a range query on the
+	// date index.  Start a new mark generation for the batch; if the
+	// generation counter wraps, clear the old marks.
+	auto gl = GameList::Get();
+	if (++markGen == 0)
+	{
+		std::fill(marks.begin(), marks.end(), 0);
+		markGen = 1;
+	}
+	gl->EnumRowsSince(GetDateIndexType(), midnight - days, [this](int row)
+	{
+		if (row >= static_cast<int>(marks.size()))
+			marks.resize(row + 1, 0);
+		marks[row] = markGen;
+	});
+
+	// figure each game's result from its row's mark
+	for (size_t i = 0; i < games.size(); ++i)
+	{
+		int row = gl->GetStatsDbRow(games[i]);
+		bool inInterval = row >= 0 && row < static_cast<int>(marks.size()) && marks[row] == markGen;
+		include[i] = IncludeIndexed(games[i], row, inInterval);
+	}
+}
+
 
 // -----------------------------------------------------------------------
 //
 // Recently played filter
 //
 
-bool RecentlyPlayedFilter::Include(GameListItem *game)
+bool RecentlyPlayedFilter::IncludeIndexed(GameListItem *, int, bool inInterval)
 {
-	// Get the game's last played time, as a DateTime value.
-	// Note that this is in UTC.
-	DateTime lastPlayed(GameList::Get()->GetLastPlayed(game));
-
-	// If there's not a valid Last Played value for the game, treat it
-	// as "never played".  That means that this game can't pass any date
-	// inclusion filter, and that it passes every exclusion filter.
-	if (!lastPlayed.IsValid())
-		return exclude;
-
-	// Figure the starting point of the filter interval, by
-	// subtracting the filter's interval in days from the current
-	// midnight.  In concrete terms, the DATE value is actually a
-	// 'double' representing the number of days since the epoch.
-	// The fractional part thus represents the time within the day
-	// as a fraction of 24 hours.  So to do a "days ago" calculation
-	// with an integral number of days, we simply subtract the number
-	// of days from the DATE value.
-	DATE dStart = midnight - days;
-
-	// Determine if the Last Played time is within the interval
-	bool lastPlayedInInterval = lastPlayed.ToVariantDate() >= dStart;
-
-	// Now determine if it passes the filter: if it's an inclusion
-	// filter, it passes if the game was last played in the interval,
-	// otherwise it passes if the game wasn't played in the interval.
-	// That makes it an XOR truth table.
-	return exclude ^ lastPlayedInInterval;
+	// If there's not a valid Last Played value for the game, it's not in
+	// the interval, which treats it as "never played": it can't pass any
+	// date inclusion filter, and it passes every exclusion filter.
+	//
+	// Otherwise, if it's an inclusion filter, it passes if the game was
+	// last played in the interval, and if it's an exclusion filter, it
+	// passes if the game wasn't played in the interval.  That makes it
+	// an XOR truth table.
+	return exclude ^ inInterval;
 }
 
 // -----------------------------------------------------------------------
@@ -5125,11 +6772,9 @@ bool RecentlyPlayedFilter::Include(GameListItem *game)
 //
 bool NeverPlayedFilter::Include(GameListItem *game)
 {
-	// Get the game's last played time, as a DateTime value.  If there's
-	// no valid stored value, the game has never been played, so it
-	// passes the filter.
-	DateTime lastPlayed(GameList::Get()->GetLastPlayed(game));
-	return !lastPlayed.IsValid();
+	// Get the game's last played time.  If there's no valid stored
+	// value, the game has never been played, so it passes the filter.
+	return GameList::Get()->GetLastPlayedDate(game) == 0.0;
 }
 
 // -----------------------------------------------------------------------
@@ -5137,32 +6782,18 @@ bool NeverPlayedFilter::Include(GameListItem *game)
 // Recently added filter
 //
 
-bool RecentlyAddedFilter::Include(GameListItem *game)
+bool RecentlyAddedFilter::IncludeIndexed(GameListItem *game, int row, bool addedDuringInterval)
 {
 	// if the game isn't configured, it doesn't pass any Added Date test
 	if (!game->isConfigured)
 		return false;
 
-	// Get the date/time the game was added, as a DateTime value.
-	// This is in UTC.
-	DateTime added(GameList::Get()->GetDateAdded(game));
-
 	// If there's not a valid Added date, it must have come from a
 	// pre-existing PinballX database.  PBX doesn't track added dates,
 	// so all we can say is that the game was added before our first
 	// run.
-	if (!added.IsValid())
-		added = Application::Get()->GetFirstRunTime();
-
-	// Figure the starting point of the filter interval, by
-	// subtracting the filter's interval in days from the current
-	// midnight.  DATE values are in terms of days since an epoch,
-	// so date arithmetic in whole days is just a matter of
-	// adding/subtracting the number of days.
-	DATE dStart = midnight - days;
-
-	// Determine if the game was added during the interval
-	bool addedDuringInterval = added.ToVariantDate() >= dStart;
+	if (GameList::Get()->GetIndexedDate(DateIndexType::DateAdded, row) == 0.0)
+		addedDuringInterval = Application::Get()->GetFirstRunTime().ToVariantDate() >= midnight - days;
 
 	// Now determine if it passes the filter: if it's an inclusion
 	// filter, it passes if the game was added within the interval,
@@ -5222,7 +6853,11 @@ bool NoCategory::Include(GameListItem *game)
 GameDatabaseFile::GameDatabaseFile() :
 	category(nullptr),
 	isDirty(false),
-	isBackedUp(false)
+	isBackedUp(false),
+	xmlLoaded(false),
+	keepXml(false),
+	lastMoveTime(0),
+	writeStatus(std::make_shared<std::atomic<int>>(WriteIdle))
 {
 }
 
@@ -5230,6 +6865,13 @@ GameDatabaseFile::~GameDatabaseFile()
 {
 }
 
+void GameDatabaseFile::ReleaseXml()
+{
+	doc.clear();
+	sourceText.reset();
+	xmlLoaded = false;
+}
+
 bool GameDatabaseFile::Load(const TCHAR *filename, ErrorHandler &eh)
 {
 	// set the filename
@@ -5299,6 +6941,7 @@ bool GameDatabaseFile::Parse(ErrorHandler &eh)
 	}
 
 	// success
+	xmlLoaded = true;
 	return true;
 }
 
@@ -5310,12 +6953,6 @@ bool GameDatabaseFile::Parse(ErrorHandler &eh)
 TableFileSet::TableFileSet(const TCHAR *tablePath, const TCHAR *defExt) :
 	tablePath(tablePath), defExt(defExt)
 {
-	// build our initial file set from a directory scan
-	ScanFolder(tablePath, defExt, [this](const TCHAR *filename) 
-	{
-		GameList::Log(_T("++ found file:  %s\n"), filename);
-		AddFile(filename);
-	});
 }
 
 void TableFileSet::ScanFolder(const TCHAR *path, const TCHAR *ext,
@@ -5335,19 +6972,40 @@ void TableFileSet::ScanFolder(const TCHAR *path, const TCHAR *ext,
 		// note if we're dealing with the all-file wildcard
 		bool dotStar = (_tcscmp(ext, _T(".*")) == 0);
 
-		// build the list of files in this folder that match *.<defExt>
-		std::error_code ec;
-		for (auto &file : fs::directory_iterator(path, ec))
+		// Get the file list from the folder index if possible.  The index
+		// monitors the folder for changes after the first scan, so this
+		// only goes to the disk the first time through (or when the
+		// folder can't be monitored), rather than every time we re-scan
+		// for new files on application activation.
+		if (MediaFileIndex::EnumFiles(path, [dotStar, ext, &func](const TCHAR *filename)
 		{
-			// skip directories
-			if (file.status().type() == fs::file_type::directory)
-				continue;
+			if (dotStar || tstriEndsWith(filename, ext))
+				func(filename);
+		}))
+			return;
+
+		// The index is disabled, so scan the folder directly, to build the
+		// list of files in this folder that match *.<defExt>.  Use the
+		// basic info level and large fetch buffers, since we only need the
+		// names; that cuts the number of round trips on a network share.
+		WIN32_FIND_DATA fd;
+		HANDLE hFind = FindFirstFileEx((TSTRING(path) + _T("\\*")).c_str(), FindExInfoBasic, &fd,
+			FindExSearchNameMatch, NULL, FIND_FIRST_EX_LARGE_FETCH);
+		if (hFind != INVALID_HANDLE_VALUE)
+		{
+			do
+			{
+				// skip directories
+				if ((fd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0)
+					continue;
 
-			// Match this file to the default extension.  It matches
-			// if either this is the special ".*" wildcard, or the
-			// filename ends with the extension, ignoring case.
-			if (dotStar || tstriEndsWith(file.path().c_str(), ext))
-				func(WSTRINGToTSTRING(file.path().filename().wstring()).c_str());
+				// Match this file to the default extension.  It matches
+				// if either this is the special ".*" wildcard, or the
+				// filename ends with the extension, ignoring case.
+				if (dotStar || tstriEndsWith(fd.cFileName, ext))
+					func(fd.cFileName);
+			} while (FindNextFile(hFind, &fd));
+			FindClose(hFind);
 		}
 	}
 	else
@@ -5603,7 +7261,7 @@ bool MediaType::SaveBackup(const TCHAR *filename, TSTRING &newName, ErrorHandler
 
 	// search the folder for previous backups - <base>.old[n].<ext>
 	int nMax = 0;
-	std::basic_regex<WCHAR> filePat(L"(.*)(\\.old\\[(\\d+)\\])(\\.[^.]+)",	std::regex_constants::icase);
+	static const std::basic_regex<WCHAR> filePat(L"(.*)(\\.old\\[(\\d+)\\])(\\.[^.]+)",	std::regex_constants::icase);
 	std::error_code ec;
 	for (auto &file : fs::directory_iterator(path, ec))
 	{
@@ -5635,7 +7293,12 @@ bool MediaType::SaveBackup(const TCHAR *filename, TSTRING &newName, ErrorHandler
 	// It's possible for the file to vanish between the time 
 	// we take the directory listing and the time we try to
 	// rename it here, so proceed only if it still exists.
-	if (FileExists(filename) && !MoveFile(filename, newName.c_str()))
+	bool ok = !FileExists(filename) || MoveFile(filename, newName.c_str());
+
+	// make sure the media file index sees the rename right away
+	MediaFileIndex::Invalidate(filename);
+
+	if (!ok)
 	{
 		// log the error
 		WindowsErrorMessage winErr;
@@ -4,11 +4,15 @@
 #pragma once
 
 #include <list>
+#include <atomic>
 #include <unordered_map>
+#include <map>
+#include <memory_resource>
 #include "../rapidxml/rapidxml.hpp"
 #include "../Utilities/DateUtil.h"
 #include "Resource.h"
 #include "CSVFile.h"
+#include "DiceCoefficient.h"
 
 class ErrorHandler;
 class GameManufacturer;
@@ -57,6 +61,33 @@ public:
 	// have we backed up the original file during this session?
 	bool isBackedUp;
 
+	// Is the XML document loaded?  In the lazy loading mode (see
+	// GameList::lazyDatabaseXml), a file whose games come from the
+	// database snapshot starts out without its document, and the
+	// document is released again once each save has been written.
+	bool xmlLoaded;
+
+	// Keep the XML document loaded for the rest of the session.  We
+	// set this when a <game> node moves from this document into another
+	// one, since the node's memory still belongs to this document.
+	bool keepXml;
+
+	// Time (GetTickCount) of the last game move into or out of this
+	// file, or 0 if none.  Moves tend to come in batches, such as when
+	// reassigning a series of unconfigured games to a system, so an
+	// ordinary save holds a file back until its moves have settled,
+	// to write it once for the whole batch.  See SaveGameListFiles().
+	DWORD lastMoveTime;
+
+	// Status of the last background write of the file.  This is shared
+	// with the writer's completion callback, which sets the final status
+	// on the writer thread; see GameList::SaveGameListFiles().
+	enum WriteStatus { WriteIdle, WritePending, WriteOK, WriteFailed };
+	std::shared_ptr<std::atomic<int>> writeStatus;
+
+	// release the XML document and its source text
+	void ReleaseXml();
+
 	// XML document
 	rapidxml::xml_document<char> doc;
 
@@ -556,6 +587,13 @@ public:
 	// system (VP, FP, etc)
 	GameSystem *system;
 
+	// System, manufacturer, and year under which the game is currently
+	// filed in the GameList attribute indexes.  GameList::UpdateAttrIndex()
+	// compares these to the live fields to re-file the game after an edit.
+	const GameSystem *indexedSystem = nullptr;
+	const GameManufacturer *indexedManufacturer = nullptr;
+	int indexedYear = 0;
+
 	// Most recent system index chosen for play.  This only applies
 	// to unconfigured games that can be played with multiple systems.
 	// When the user tries to play such a game, the UI displays a
@@ -587,9 +625,26 @@ public:
 	GameDatabaseFile *dbFile;
 
 	// XML <game> node where the game was defined.  This is a pointer
-	// into the parse tree for the dbFile defining the game.
+	// into the parse tree for the dbFile defining the game.  This is
+	// null while the dbFile's XML document isn't loaded, in the lazy
+	// loading mode, so use HasXmlNode() to test for an XML record and
+	// GetXmlNode() to get the node for an update.
 	rapidxml::xml_node<char> *gameXmlNode;
 
+	// Ordinal of the game's <game> node among the <game> nodes in the
+	// dbFile, while the dbFile's XML document isn't loaded.  We use
+	// this to find the node again when the document is reloaded.  -1
+	// means that the game has no XML record, or that the document is
+	// loaded (in which case gameXmlNode is the record).
+	int gameXmlNodeIndex;
+
+	// does the game have an XML record?
+	bool HasXmlNode() const { return gameXmlNode != nullptr || gameXmlNodeIndex >= 0; }
+
+	// Get the XML <game> node, loading the dbFile's XML document if
+	// necessary.  Returns null if the game has no XML record.
+	rapidxml::xml_node<char> *GetXmlNode();
+
 	// Is this game configured?  A configurd game has a database
 	// record; an unconfigured game is one that we found in the file
 	// system with no corresponding database entry.  
@@ -749,6 +804,59 @@ public:
 	// they're otherwise excluded by that option setting.
 	virtual bool IncludeUnconfigured() const { return false; }
 
+	// Can the filter's results be cached?  This is true for filters
+	// whose results depend only on the game's own fields and its stats
+	// database row.  That lets GameList::RefreshFilter keep a cached
+	// membership set for the filter, so that switching to the filter
+	// only has to re-test the games that have changed since the last
+	// time it was used.  Filters that depend on anything else, such as
+	// the current time or Javascript code, must return false, so that
+	// they're tested in full on every scan.
+	virtual bool IsCacheable() const { return false; }
+
+	// Attribute index.  A filter that selects games by system,
+	// manufacturer, or year range can name the GameList reverse index
+	// that covers it.  Enumerating the filter's games then only visits
+	// the games filed under the filter's key, rather than testing the
+	// whole list.  Include() still makes the final decision for each
+	// candidate, so the index only has to be a superset.
+	enum class AttrIndexType { None, System, Manufacturer, Year };
+	virtual AttrIndexType GetAttrIndexType() const { return AttrIndexType::None; }
+
+	// Cached membership set, by game index in the GameList title index.
+	// This is maintained by GameList::RefreshFilter for cacheable filters.
+	struct MembershipCache
+	{
+		// inclusion flag for each game in the title index
+		std::vector<bool> includes;
+
+		// title index serial number the set was built for (0 if the
+		// set has never been built), and the row change serial number
+		// it's up to date with
+		UINT64 titleIndexSerial = 0;
+		UINT64 rowSerial = 0;
+
+		// "Hide Unconfigured Games" setting the set was built with
+		bool hideUnconfigured = false;
+
+		// number of games included, kept in step with 'includes'
+		int count = 0;
+	};
+	MembershipCache membershipCache;
+
+	// Batch selection.  A filter can test a whole set of games in one
+	// call, instead of one Include() call per game, by overriding
+	// HasBatchInclude() to return true and implementing IncludeBatch().
+	// This is for filters with a high per-call overhead, such as
+	// Javascript filters, which otherwise have to call into Javascript
+	// separately for every game on every scan.  IncludeBatch() sets
+	// include[i] to the result for games[i].  The game list only passes
+	// the games that pass the generic hidden/unconfigured tests, and for
+	// a cacheable filter, only the games that have changed since the
+	// last scan.  Include() must still work for single-game tests.
+	virtual bool HasBatchInclude() const { return false; }
+	virtual void IncludeBatch(const std::vector<GameListItem*> & /*games*/, std::vector<bool> & /*include*/) { }
+
 	// Custom sorting.  A filter can provide a sorting function to
 	// override the order of the game list subset presented when the
 	// filter is in effect.  To define a custom sort order, override
@@ -758,6 +866,33 @@ public:
 	virtual bool HasCustomSort() const { return false; }
 	virtual bool CustomSortCompare(const GameListItem *a, const GameListItem *b) const { return true; }
 
+	// Custom sort setup/cleanup.  These are called before and after a
+	// custom sort, with the list of games to be sorted, so that the
+	// filter can prepare whatever per-game data its comparison function
+	// needs once per game, rather than once per comparison.
+	virtual void BeforeSort(const std::vector<GameListItem*> & /*games*/) { }
+	virtual void AfterSort() { }
+
+	// Standard sort order.  A filter can select one of these orders
+	// instead of the default title order, without providing a comparison
+	// function.  The game list keeps a prebuilt index for each order, so
+	// it can apply one on each filter refresh without re-sorting.  Games
+	// with no value for the sort field (no year, manufacturer, rating,
+	// or play date) sort at the end in either direction; ties keep the
+	// title order.  A custom sort takes precedence over this.
+	enum class SortOrder
+	{
+		Title,
+		Year,
+		Manufacturer,
+		Rating,
+		LastPlayed,
+		PlayCount
+	};
+	static const int nSortOrders = 6;
+	virtual SortOrder GetSortOrder() const { return SortOrder::Title; }
+	virtual bool IsSortDescending() const { return false; }
+
 	// Page grouping for the filter.  A filter can provide its own
 	// meaning for the Next Page/Previous Page commands, by defining
 	// a custom grouping function.  Custom grouping goes hand-in-hand
@@ -808,6 +943,7 @@ public:
 	AllGamesFilter() : GameListFilter(_T("[Top]"), _T("3000")) { title.Load(IDS_FILTER_ALL); }
 	virtual const TCHAR *GetFilterTitle() const override { return title.c_str(); }
 	virtual bool Include(GameListItem *) override { return true; }
+	virtual bool IsCacheable() const override { return true; }
 	virtual TSTRING GetFilterId() const override { return _T("All"); }
 
 	TSTRINGEx title;
@@ -820,6 +956,7 @@ public:
 	FavoritesFilter() : GameListFilter(_T("[Top]"), _T("7000")) { title.Load(IDS_FILTER_FAVORITES); }
 	virtual const TCHAR *GetFilterTitle() const override { return title.c_str(); }
 	virtual bool Include(GameListItem *game) override;
+	virtual bool IsCacheable() const override { return true; }
 	virtual TSTRING GetFilterId() const override { return _T("Favorites"); }
 
 	TSTRINGEx title;
@@ -841,6 +978,7 @@ public:
 	virtual const TCHAR *GetMenuTitle() const override { return menuTitle.c_str(); }
 	virtual TSTRING GetFilterId() const override { return _T("Hidden"); }
 	virtual bool Include(GameListItem *game) override;
+	virtual bool IsCacheable() const override { return true; }
 	virtual bool IncludeHidden() const override { return true; }
 
 	TSTRINGEx title;
@@ -870,6 +1008,7 @@ public:
 
 	virtual TSTRING GetFilterId() const override { return _T("Unconfigured"); }
 	virtual bool Include(GameListItem *game) override;
+	virtual bool IsCacheable() const override { return true; }
 	virtual bool IncludeUnconfigured() const override { return true; }
 
 	TSTRINGEx title;
@@ -895,6 +1034,7 @@ public:
 
 	virtual const TCHAR *GetFilterTitle() const override { return title.c_str(); }
 	virtual bool Include(GameListItem *game) override;
+	virtual bool IsCacheable() const override { return true; }
 	virtual TSTRING GetFilterId() const override { return MsgFmt(_T("Rating.%d"), stars).Get(); }
 
 	// number of stars this filter selects for
@@ -918,10 +1058,19 @@ public:
 	// use the category name as the filter name
 	virtual const TCHAR *GetFilterTitle() const override { return name.c_str(); }
 	virtual bool Include(GameListItem *game) override;
+	virtual bool IsCacheable() const override { return true; }
 	virtual TSTRING GetFilterId() const override { return TSTRING(_T("Category.")) + name; }
 
 	// category name
 	TSTRING name;
+
+	// Category ID.  This is a small integer that indexes the category
+	// in the per-game category membership bit sets.  GameList assigns
+	// it when it creates the category; it stays the same if the
+	// category is renamed, and it's never reused.  -1 means that the
+	// category isn't in the category table (as with the Uncategorized
+	// filter, which isn't a real category).
+	int id = -1;
 };
 
 // Category filter for uncategorized games
@@ -958,6 +1107,8 @@ public:
 	virtual const TCHAR *GetFilterTitle() const override { return title.c_str(); }
 	virtual bool Include(GameListItem *game) override
 		{ return game->year >= yearFrom && game->year <= yearTo; }
+	virtual bool IsCacheable() const override { return true; }
+	virtual AttrIndexType GetAttrIndexType() const override { return AttrIndexType::Year; }
 	virtual TSTRING GetFilterId() const override 
 		{ return MsgFmt(_T("YearRange.%d.%d"), yearFrom, yearTo).Get(); }
 
@@ -971,6 +1122,9 @@ public:
 
 // Base recency filter - common base class for the Recently Played
 // and Recently Added filters.
+// Stats database date indexes (see GameList::GetIndexedDate())
+enum class DateIndexType { LastPlayed, DateAdded, NTypes };
+
 class RecencyFilter : public GameListFilter
 {
 public:
@@ -986,6 +1140,22 @@ public:
 	// current day in local time
 	virtual void BeforeScan();
 
+	// Test a game.  The date comes from the game list's date index, so
+	// this doesn't have to look up and parse the date text.
+	virtual bool Include(GameListItem *game) override;
+
+	// Batch test.  This finds the games in the interval with a range
+	// query on the date index, rather than testing each game's date.
+	virtual bool HasBatchInclude() const override { return true; }
+	virtual void IncludeBatch(const std::vector<GameListItem*> &games, std::vector<bool> &include) override;
+
+	// the date index the filter selects on
+	virtual DateIndexType GetDateIndexType() const = 0;
+
+	// Figure the result for a game, given its stats row and whether or
+	// not its indexed date is within the filter interval
+	virtual bool IncludeIndexed(GameListItem *game, int row, bool inInterval) = 0;
+
 	// filter title ("Played This Month", "Not Played in a Month")
 	TSTRING title;
 
@@ -1009,6 +1179,12 @@ public:
 	// Most recent midnight.  We set this up in BeforeScan() to 
 	// cache the time reference point for the current scan.
 	DATE midnight;
+
+	// Interval marks for IncludeBatch(), by stats row.  A row is in the
+	// interval if its mark equals the current generation, which saves
+	// clearing the marks on each batch.
+	std::vector<UINT32> marks;
+	UINT32 markGen = 0;
 };
 
 
@@ -1020,7 +1196,8 @@ public:
 	RecentlyPlayedFilter(const TCHAR *title, const TCHAR *menuTitle, int days, bool exclude) :
 		RecencyFilter(title, menuTitle, exclude ? _T("[!Played]") : _T("[Played]"), days, exclude) { }
 
-	virtual bool Include(GameListItem *game) override;
+	virtual DateIndexType GetDateIndexType() const override { return DateIndexType::LastPlayed; }
+	virtual bool IncludeIndexed(GameListItem *game, int row, bool inInterval) override;
 	virtual TSTRING GetFilterId() const override 
 		{ return MsgFmt(_T("%s.%d"), exclude ? _T("PlayedWithin") : _T("NotPlayedWithin"), days).Get(); }
 
@@ -1036,6 +1213,7 @@ public:
 	{ }
 
 	virtual bool Include(GameListItem *game) override;
+	virtual bool IsCacheable() const override { return true; }
 	virtual TSTRING GetFilterId() const override { return _T("NeverPlayed"); }
 
 	virtual const TCHAR *GetFilterTitle() const override { return title.c_str(); }
@@ -1055,7 +1233,8 @@ public:
 		RecencyFilter(title, menuTitle, exclude ? _T("[!Added]") : _T("[Added]"), days, exclude)
 	{ }
 
-	virtual bool Include(GameListItem *game) override;
+	virtual DateIndexType GetDateIndexType() const override { return DateIndexType::DateAdded; }
+	virtual bool IncludeIndexed(GameListItem *game, int row, bool inInterval) override;
 	virtual TSTRING GetFilterId() const override
 		{ return MsgFmt(_T("%s.%d"), exclude ? _T("AddedWithin") : _T("AddedBefore"), days).Get(); }
 };
@@ -1071,6 +1250,8 @@ public:
 
 	virtual const TCHAR *GetFilterTitle() const override { return filterTitle.c_str(); }
 	virtual bool Include(GameListItem *game) override { return game->manufacturer == this; }
+	virtual bool IsCacheable() const override { return true; }
+	virtual AttrIndexType GetAttrIndexType() const override { return AttrIndexType::Manufacturer; }
 	virtual TSTRING GetFilterId() const override { return TSTRING(_T("Manuf.")) + manufacturer; }
 
 	TSTRING filterTitle;
@@ -1204,6 +1385,10 @@ public:
 
 	TSTRING tablePath;		// full path to the system's table folder
 	TSTRING defExt;			// default extension for the system's tables (with '.')
+
+	// Has the folder been scanned yet?  The initial scan is done by
+	// GameList::ScanTableFileSets(), for all of the sets at once.
+	bool scanned = false;
 };
 
 
@@ -1222,6 +1407,8 @@ public:
 	// filter operations
 	virtual const TCHAR *GetFilterTitle() const override { return filterTitle.c_str(); }
 	virtual bool Include(GameListItem *game) override { return game->system == this; }
+	virtual bool IsCacheable() const override { return true; }
+	virtual AttrIndexType GetAttrIndexType() const override { return AttrIndexType::System; }
 	virtual TSTRING GetFilterId() const override { return TSTRING(_T("System.")) + displayName; }
 
 	TSTRING filterTitle;
@@ -1356,6 +1543,33 @@ public:
 	// Finish a selection run
 	virtual void After() = 0;
 
+	// Batch selection, as in GameListFilter::IncludeBatch().  On entry,
+	// include[i] is the inclusion status of games[i] from the main filter
+	// and the earlier metafilters; on return, it's this metafilter's
+	// result.  The games list only contains the games the metafilter
+	// would be called for individually.
+	virtual bool HasBatchInclude() const { return false; }
+	virtual void IncludeBatch(const std::vector<GameListItem*> & /*games*/, std::vector<bool> & /*include*/) { }
+
+	// Can the batch results be cached?  This is true if the results
+	// depend only on each game's own fields and stats database row, plus
+	// the incoming inclusion status.  The game list then only resubmits
+	// the games that have changed, or whose incoming status has changed,
+	// since the last scan.  This only applies to batch metafilters.
+	virtual bool IsCacheable() const { return false; }
+
+	// Cached batch results, by game index in the GameList title index:
+	// the incoming inclusion status and the result for each game, plus
+	// the title index and row change serial numbers they're valid for.
+	struct ResultCache
+	{
+		std::vector<bool> in;
+		std::vector<bool> out;
+		UINT64 titleIndexSerial = 0;
+		UINT64 rowSerial = 0;
+	};
+	ResultCache resultCache;
+
 	// Should we include games that were excluded by the main
 	// filter or by earlier metafilters when calling select()?
 	// If this is true, we call this filter for all games, 
@@ -1397,8 +1611,30 @@ public:
 	// save the stats database if dirty
 	void SaveStatsDb();
 
-	// save changes to game list (XML) files
-	void SaveGameListFiles();
+	// Commit the stats database journal.  This makes the stats updates
+	// so far durable without rewriting the whole file, so it's cheap
+	// enough to call after each game and each explicit user change.
+	void CommitStatsJournal();
+
+	// Save changes to game list (XML) files.  Unless 'flush' is true,
+	// this holds back files with game moves in the last few moments
+	// (see GameDatabaseFile::lastMoveTime), so that a batch of moves
+	// results in one write per file.  Returns true if any files were
+	// held back, or have lazy-mode documents waiting for their writes
+	// to complete, in which case the caller should save again later.
+	bool SaveGameListFiles(bool flush = false);
+
+	// Settling time for game moves before an ordinary save writes the
+	// affected files, in milliseconds
+	static const DWORD dbMoveSettleTime = 60000;
+
+	// note a game move into or out of a database file
+	static void NoteDbFileMove(GameDatabaseFile *dbFile);
+
+	// Make sure that a database file's XML document is loaded, loading
+	// it if necessary, and reconnect its games to their <game> nodes.
+	// Returns true if the document is loaded.
+	bool LoadDbFileXml(GameDatabaseFile *dbFile);
 
 	// get the media folder path
 	const TCHAR *GetMediaPath() const { return mediaPath.c_str(); }
@@ -1410,6 +1646,9 @@ public:
 	//   <base media folder>\<subfolder>
 	//   <PinballY install folder>\Media\<subfolder>
 	//   <PinballY install folder>\Assets\<subfolder>
+	//
+	// The results, including "not found" results, are cached in the
+	// media file index (see MediaFileIndex::FindFirst()).
 	//   
 	bool FindGlobalMediaFile(TCHAR path[MAX_PATH], const TCHAR *subfolder, const TCHAR *file, 
 		const TCHAR *const *exts, size_t numExts);
@@ -1422,6 +1661,11 @@ public:
 	bool FindGlobalAudioFile(TCHAR path[MAX_PATH], const TCHAR *subfolder, const TCHAR *file);
 	bool FindGlobalWaveFile(TCHAR path[MAX_PATH], const TCHAR *subfolder, const TCHAR *file);
 
+	// Start snapshotting the standard global media folders into the media
+	// file index on a background thread.  Init() calls this once the media
+	// path is known.
+	void PrefetchGlobalMedia();
+
 	// Load all game lists
 	bool Load(ErrorHandler &eh);
 
@@ -1438,6 +1682,149 @@ public:
 		const TCHAR *filename, const TCHAR *parentFolderName,
 		GameSystem *system, ErrorHandler &eh);
 
+	// Staged game database file.  We load a database file in two phases.
+	// The staging phase reads and parses the XML, and extracts the fields
+	// for each game into a staging list.  That's the slow part, and it
+	// doesn't touch anything outside of the staging object, so we can
+	// stage several files at once on background threads.  The merge
+	// phase then adds the staged games to the game list, creating the
+	// categories, manufacturers, and filters they refer to.  This runs
+	// on the main thread, one file at a time, in the original file order,
+	// so that the resulting list is the same as if we had loaded the
+	// files one by one.
+	struct DatabaseSnapshotFile;
+	struct StagedDatabaseFile
+	{
+		StagedDatabaseFile(const TCHAR *filename, const TCHAR *parentFolder, GameSystem *system) :
+			filename(filename), parentFolder(parentFolder), system(system) { }
+
+		// file name, parent folder name, and the system it belongs to
+		TSTRING filename;
+		TSTRING parentFolder;
+		GameSystem *system;
+
+		// staging status
+		enum Status
+		{
+			Pending,         // not staged yet
+			ParseFailed,     // file load or XML parse failed
+			NoMenu,          // no root <menu> node
+			OK               // staged successfully
+		};
+		Status status = Pending;
+
+		// errors captured during staging, to pass along during the merge
+		CapturingErrorHandler errors;
+
+		// size and modification time of the file when we staged it
+		UINT64 fileSize = 0;
+		FILETIME fileTime = { 0, 0 };
+
+		// Snapshot entry for the file from the last session, if any, and
+		// whether we used it.  See DatabaseSnapshotFile.
+		const DatabaseSnapshotFile *snapshot = nullptr;
+		bool fromSnapshot = false;
+
+		// Lazy XML loading mode.  If the snapshot entry is current, we
+		// skip loading the XML, and take all of the fields from the
+		// snapshot.
+		bool lazyXml = false;
+
+		// parsed XML
+		std::unique_ptr<GameDatabaseFile> xml;
+
+		// Category defined by the file, if any, and whether the name came
+		// from an explicit <CategoryName> tag
+		bool hasCategory = false;
+		bool explicitCategoryName = false;
+		TSTRING categoryName;
+
+		// staged games, with the fields extracted from the XML
+		struct Game
+		{
+			const char *name = nullptr;
+			CSTRING title;
+			TSTRING manufName;
+			TSTRING mediaName;
+			int year = 0;
+			TSTRING ipdbId;
+			const char *tableType = nullptr;
+			const char *rom = nullptr;
+			const char *gridPos = nullptr;
+			bool enabled = true;
+			float rating = 0.0f;
+			rapidxml::xml_node<char> *node = nullptr;
+
+			// ordinal of the <game> node among the <game> nodes in the file
+			UINT32 nodeIndex = 0;
+
+			// Copies of the fields that point into the XML text, for a
+			// game restored from the snapshot without loading the XML.
+			// The pointer fields point into these strings in that case.
+			CSTRING nameText;
+			CSTRING romText;
+			CSTRING tableTypeText;
+			CSTRING gridPosText;
+		};
+		std::vector<Game> games;
+	};
+
+	// Game database snapshot.  Extracting the game fields from the XML
+	// takes most of the staging time, mostly in the regex matching for
+	// the title and the <enabled> flag, so we save the extracted fields
+	// for each file in a snapshot file at the end of the load, and use
+	// them on the next start if the file hasn't changed since.  We still
+	// parse the XML, since the game list keeps pointers into the parse
+	// tree for editing, but rapidxml parsing is quick.  The string fields
+	// that point into the XML text (the file name, ROM, table type, and
+	// grid position) are found again from the node, which only takes a
+	// few string compares.  In the lazy XML loading mode, we skip the XML
+	// entirely, and take those fields and the category information from
+	// the snapshot as well.  A snapshot entry is only used if the file's
+	// size and modification time match, so any change to a file,
+	// including our own edits during a session, just makes us extract
+	// its fields from scratch again.
+	struct DatabaseSnapshotFile
+	{
+		UINT64 size = 0;
+		FILETIME mtime = { 0, 0 };
+		bool hasCategory = false;
+		bool explicitCategoryName = false;
+		TSTRING categoryName;
+		std::vector<StagedDatabaseFile::Game> games;
+	};
+	typedef std::unordered_map<TSTRING, DatabaseSnapshotFile> DatabaseSnapshot;
+	static void GetDatabaseSnapshotFile(TCHAR path[MAX_PATH]);
+	static void LoadDatabaseSnapshot(DatabaseSnapshot &snapshot);
+	static void SaveDatabaseSnapshot(const std::list<StagedDatabaseFile> &files);
+
+	// Restore a staged file's games from its snapshot entry.  'menu' is
+	// the root node of the parsed XML, or null in the lazy XML mode, in
+	// which case we take all of the fields from the snapshot.
+	static bool RestoreFromSnapshot(StagedDatabaseFile &file, rapidxml::xml_node<char> *menu);
+
+	// Lazy XML loading mode.  When this is set, a database file whose
+	// snapshot entry is current isn't loaded at all during startup.  We
+	// load its XML document on demand, when an edit needs to update it,
+	// and release it again after saving it.  With big databases, this
+	// saves keeping the full XML text and parse tree in memory for the
+	// whole session.  This is set from the config (GameList.LazyXml).
+	bool lazyDatabaseXml = false;
+
+	// Release a database file's XML document, after noting its games'
+	// node ordinals so that LoadDbFileXml() can reconnect them
+	void ReleaseDbFileXml(GameDatabaseFile *dbFile);
+
+	// Load a list of game database files.  This stages the files
+	// concurrently, then merges them into the list in order.
+	bool LoadGameDatabaseFiles(std::list<StagedDatabaseFile> &files, ErrorHandler &eh);
+
+	// stage a game database file; this can be called from any thread
+	static void StageGameDatabaseFile(StagedDatabaseFile &file);
+
+	// merge a staged game database file into the game list
+	bool MergeGameDatabaseFile(StagedDatabaseFile &file, ErrorHandler &eh);
+
 	// Get the nth game relative to the current game.  0 is the current
 	// game.  1 is the next game (to the "right" in wheel order), 2 is
 	// the next game after that, etc.  -1 is the previous game ("left" 
@@ -1459,6 +1846,38 @@ public:
 	// the previous letter group if we're at the first of a group.
 	int FindPrevLetter();
 
+	// Invalidate the page group table, so that it's rebuilt on the next
+	// paging command.  This is called automatically when the filter is
+	// refreshed or the paging mode changes.
+	void InvalidatePageGroups() { pageRunsValid = false; }
+
+	// Search the games by title, manufacturer, system, year, and
+	// category names, for search-as-you-type interfaces.  The query is
+	// split into words, and a game matches if each query word is a
+	// prefix of some word in the game's fields, ignoring case.  Results
+	// are ranked by score, best first, up to 'maxResults' games; a title
+	// match counts for more than a manufacturer or year match, which in
+	// turn count for more than a system or category match.  If nothing
+	// matches that way, we fall back on a fuzzy title match, so that a
+	// misspelled title still finds something.
+	//
+	// The search index is brought up to date on each search, by checking
+	// each game's fields against the copy saved when it was last indexed,
+	// so games that were added, renamed, or removed since the last search
+	// are picked up without any explicit invalidation.  Only the changed
+	// games are re-indexed.
+	struct SearchResult
+	{
+		GameListItem *game;
+		float score;
+	};
+	void SearchGames(const TCHAR *query, size_t maxResults, std::vector<SearchResult> &results);
+
+	// Get a game's position in the current filter, as an offset from
+	// the current game suitable for passing to SetGame(), or -1 if the
+	// game isn't in the current filter.
+	int GetFilterOffset(GameListItem *game) const;
+
 	// Set the current game.  This switches to the nth game relative to
 	// the current selection.
 	void SetGame(int n);
@@ -1510,6 +1929,20 @@ public:
 	// Get the number of games matching the current filter
 	int GetCurFilterCount() const { return static_cast<int>(byTitleFiltered.size()); }
 
+	// Get the number of games that pass a filter on its own, without the
+	// metafilters, for displays like a "Category (count)" menu.  For the
+	// built-in filters, this comes from the filter's membership cache,
+	// which only re-tests the games that have changed since it was last
+	// brought up to date, so counting doesn't run the filter over the
+	// whole collection each time.  Filters that can't be cached (such as
+	// non-cacheable Javascript filters) are counted with a full scan.
+	int GetFilterCount(GameListFilter *filter);
+
+	// Get the counts for a list of filters.  This is faster than calling
+	// GetFilterCount() for each filter, since it only checks the games
+	// for changes once for the whole list.
+	void GetFilterCounts(const std::vector<GameListFilter*> &filters, std::vector<int> &counts);
+
 	// Test to see if a game is selected by a filter.  Note that this
 	// should be used instead of calling filter->Include() directly, 
 	// as we apply some additional tests.  The "short" version uses
@@ -1517,6 +1950,13 @@ public:
 	bool FilterIncludes(GameListFilter *filter, GameListItem *game);
 	bool FilterIncludes(GameListFilter *filter, GameListItem *game, bool hideUnconfigured);
 
+	// Test a set of games, given by title index position, against a
+	// filter, setting include[pos] for each listed position.  This
+	// applies the same tests as FilterIncludes(), but passes all of the
+	// games to the filter in one batch if the filter supports that.
+	void FilterIncludesBatch(GameListFilter *filter, const std::vector<int> &positions,
+		std::vector<bool> &include, bool hideUnconfigured);
+
 	// columns we use in the database file
 	const CSVFile::Column *gameCol;
 	const CSVFile::Column *lastPlayedCol;
@@ -1532,13 +1972,32 @@ public:
 	const CSVFile::Column *showWhenRunningCol;
 	const CSVFile::Column *audioVolumeCol;
 
+	// Get the game's stats change stamp.  This changes whenever any of
+	// the game's stats fields are updated (see CSVFile::GetRowStamp()),
+	// so a client can tell whether its cached copy of stats-derived
+	// information is still current.  Returns 0 if the game doesn't have
+	// a stats row yet.
+	UINT64 GetStatsStamp(GameListItem *game) { return statsDb.GetRowStamp(GetStatsDbRow(game)); }
+
+	// estimate the memory used by the stats database, for the memory statistics
+	size_t EstimateStatsDbMemory() const { return statsDb.EstimateMemory(); }
+
 	// Get/set the Last Played time
 	const TCHAR *GetLastPlayed(GameListItem *game) 
 	    { return lastPlayedCol->Get(GetStatsDbRow(game)); }
 	void SetLastPlayed(GameListItem *game, const TCHAR *val) 
-	    { lastPlayedCol->Set(GetStatsDbRow(game, true), val); }
+	{
+		int row = GetStatsDbRow(game, true);
+		lastPlayedCol->Set(row, val);
+		UpdateDateIndex(DateIndexType::LastPlayed, row);
+	}
 	void SetLastPlayed(GameListItem *game, DateTime val)
-		{ lastPlayedCol->Set(GetStatsDbRow(game, true), val.ToString().c_str()); }
+		{ SetLastPlayed(game, val.ToString().c_str()); }
+
+	// Get the Last Played time as a variant DATE, or 0 if the game has
+	// never been played.  The parsed value is cached with the field.
+	DATE GetLastPlayedDate(GameListItem *game)
+		{ return lastPlayedCol->GetDate(GetStatsDbRow(game)); }
 
 	// set the last played time to "now"
 	void SetLastPlayedNow(GameListItem *game);
@@ -1547,9 +2006,32 @@ public:
 	const TCHAR *GetDateAdded(GameListItem *game)
 		{ return dateAddedCol->Get(GetStatsDbRow(game)); }
 	void SetDateAdded(GameListItem *game, const TCHAR *val)
-		{ dateAddedCol->Set(GetStatsDbRow(game, true), val); }
+	{
+		int row = GetStatsDbRow(game, true);
+		dateAddedCol->Set(row, val);
+		UpdateDateIndex(DateIndexType::DateAdded, row);
+	}
 	void SetDateAdded(GameListItem *game, DateTime val)
-		{ dateAddedCol->Set(GetStatsDbRow(game, true), val.ToString().c_str()); }
+		{ SetDateAdded(game, val.ToString().c_str()); }
+
+	// Get the Date Added as a variant DATE, or 0 if it's not set
+	DATE GetDateAddedDate(GameListItem *game)
+		{ return dateAddedCol->GetDate(GetStatsDbRow(game)); }
+
+	// Date indexes.  These index the stats database rows by their Last
+	// Played and Date Added dates, so that the recency filters don't
+	// have to look up and parse the date text for each game on each scan.
+	// Each index keeps the parsed date for each row, for constant-time
+	// lookups, and the rows sorted by date, for range queries.  An index
+	// is built on first use, and then updated row by row as the dates
+	// are set through SetLastPlayed() and SetDateAdded().
+	//
+	// Get the indexed date for a stats row, as a variant DATE.  Returns
+	// 0 if the row doesn't exist or has no valid date.
+	DATE GetIndexedDate(DateIndexType type, int row);
+
+	// enumerate the stats rows with indexed dates on or after 'since'
+	void EnumRowsSince(DateIndexType type, DATE since, std::function<void(int row)> func);
 
 	// set the Date Added to "now"
 	 void SetDateAddedNow(GameListItem *game);
@@ -1690,6 +2172,11 @@ public:
 	// game's title, to update the sorting order accordingly.
 	void SortTitleIndex();
 
+	// Re-file a game in the attribute indexes after a change to its
+	// system, manufacturer, or year.  Call this after any edit to those
+	// fields; BuildTitleIndex() re-files all of the games.
+	void UpdateAttrIndex(GameListItem *game);
+
 	// Update the game's system.  This takes care of moving the game's
 	// game's XML record to the new system's database file, or creating
 	// a new record if we don't have one already.
@@ -1851,27 +2338,99 @@ protected:
 	void JustAddCategory(GameListItem *game, const GameCategory *category);
 	void JustRemoveCategory(GameListItem *game, const GameCategory *category);
 
-	// Handle renaming a category.  If this game is associated with the
-	// category, we'll update the stats database entry accordingly.  We'll
-	// also update the source file location if necessary.  This is called
-	// after the name has already been updated in the category object; the
-	// old name is passed in separately in case it's needed.
-	void OnRenameCategory(GameListItem *game, const GameCategory *category, const TCHAR *oldName);
-
 	// parse the Categories column in the stats database
 	void ParseCategoryList(int rownum);
 
-	// Rebuild the category list for a game.  This updates the stats db
-	// row text to match changes in the parsed data object list.
+	// Note a change to the category list for a game.  The membership
+	// bit set is the working copy of the list; the stats db text is only
+	// brought up to date when we save the file, so this just marks the
+	// row's text as out of date, and marks the row as changed so that
+	// the filter caches see the change.
 	void RebuildCategoryList(int rownum);
 
-	// parsed category data object
+	// Bring the stats db Categories text up to date with the parsed
+	// membership sets, for the rows whose sets have changed since the
+	// text was last built.  We call this just before saving the stats db.
+	void SyncCategoryLists();
+
+	// Category membership set.  This is a bit vector indexed by the
+	// GameCategory::id values.
+	class CategorySet
+	{
+	public:
+		bool Test(int id) const
+		{
+			return id >= 0 && static_cast<size_t>(id / 64) < bits.size()
+				&& (bits[id / 64] & (1ULL << (id % 64))) != 0;
+		}
+
+		void Add(int id)
+		{
+			if (static_cast<size_t>(id / 64) >= bits.size())
+				bits.resize(id / 64 + 1, 0);
+			bits[id / 64] |= (1ULL << (id % 64));
+		}
+
+		void Remove(int id)
+		{
+			if (id >= 0 && static_cast<size_t>(id / 64) < bits.size())
+				bits[id / 64] &= ~(1ULL << (id % 64));
+		}
+
+		bool IsEmpty() const
+		{
+			for (auto b : bits)
+			{
+				if (b != 0)
+					return false;
+			}
+			return true;
+		}
+
+		// call func(id) for each member, in ascending ID order
+		template<typename F> void ForEach(F func) const
+		{
+			for (size_t i = 0; i < bits.size(); ++i)
+			{
+				for (int bit = 0; bit < 64 && (bits[i] >> bit) != 0; ++bit)
+				{
+					if ((bits[i] & (1ULL << bit)) != 0)
+						func(static_cast<int>(i * 64 + bit));
+				}
+			}
+		}
+
+	protected:
+		std::vector<UINT64> bits;
+	};
+
+	// Parsed category data object.  'textDirty' is set when the set has
+	// changed since the stats db text was last built from it.
 	class ParsedCategoryData : public CSVFile::Column::ParsedData 
 	{
 	public:
-		std::list<const GameCategory*> categories;
+		CategorySet categories;
+		bool textDirty = false;
 	};
 
+	// Rows whose category text is out of date with the parsed sets.  A
+	// rename changes the text of every row that includes the category,
+	// but not the sets, so it just adds the member rows here and defers
+	// the text rebuild to the next sync.
+	std::unordered_set<int> categoryTextDirtyRows;
+
+	// Reverse category index: the stats db rows whose parsed sets include
+	// each category, indexed by GameCategory::id.  This lets a rename or
+	// delete touch only the member rows instead of scanning every game.
+	// Games that are in a category only through their XML file placement
+	// aren't included, since the file itself records the membership.
+	std::vector<std::unordered_set<int>> categoryRows;
+
+	// Add/remove a category in a row's parsed membership set, keeping
+	// the reverse index in sync
+	void AddCategoryToRow(ParsedCategoryData *d, int row, int id);
+	void RemoveCategoryFromRow(ParsedCategoryData *d, int row, int id);
+
 	// Get a data file path.  This is used for file paths that we can
 	// import from PinballX.  We resolve the path as follows:
 	//
@@ -1957,6 +2516,10 @@ protected:
 	// all categories
 	std::unordered_map<TSTRING, std::unique_ptr<GameCategory>> categories;
 
+	// Categories by ID.  This includes deleted categories, since IDs are
+	// never reused.
+	std::vector<GameCategory*> categoriesById;
+
 	// Deleted categories.  This is a list of category entries that were
 	// deleted through the UI.  We keep these objects alive here rather
 	// than deleting the memory outright as a hedge against errors; any
@@ -1981,11 +2544,28 @@ protected:
 	// doesn't already have one.
 	GameDatabaseFile *GetGenericDbFile(GameSystem *system, bool create);
 
+	// Arena for the per-generation game list data.  The game records,
+	// the manufacturer and decade filters, and the table file sets are
+	// allocated from this arena, so a load makes a small number of large
+	// allocations instead of thousands of small ones, and the whole
+	// generation is released in one step when the GameList is deleted
+	// (at shutdown, or when ReCreate() reloads the list after a settings
+	// change), without leaving the heap fragmented by scattered nodes.
+	// The arena doesn't reuse memory from individual removals, but those
+	// only happen when a table file is deleted during a session, so the
+	// waste is negligible.  The arena isn't thread-safe; like the rest
+	// of the game list, the containers it serves are only modified on
+	// the main thread.
+	//
+	// This has to be declared ahead of the containers that use it, so
+	// that it's constructed before them and destroyed after them.
+	std::pmr::monotonic_buffer_resource arena{ 256 * 1024 };
+
 	// decade filters, by start year
-	std::unordered_map<int, DateFilter> dateFilters;
+	std::pmr::unordered_map<int, DateFilter> dateFilters{ &arena };
 
 	// manufacturers, by manufacturer name
-	std::unordered_map<TSTRING, GameManufacturer> manufacturers;
+	std::pmr::unordered_map<TSTRING, GameManufacturer> manufacturers{ &arena };
 
 	// systems, by config index
 	std::unordered_map<int, GameSystem> systems;
@@ -1993,7 +2573,7 @@ protected:
 	// Table file sets, keyed by filename pattern: "<table path>\*.<defExt>".
 	// The path is canonicalized ('.' and '..' are expanded), and the whole
 	// thing is converted to lower-case for case-insensitive lookup.
-	std::unordered_map<TSTRING, TableFileSet> tableFileSets;
+	std::pmr::unordered_map<TSTRING, TableFileSet> tableFileSets{ &arena };
 
 	// star rating filters, by stars
 	std::unordered_map<int, RatingFilter> ratingFilters;
@@ -2019,14 +2599,206 @@ protected:
 	TSTRING pendingRestoredFilter;
 
 	// game list
-	std::list<GameListItem> games;
+	std::pmr::list<GameListItem> games{ &arena };
 
 	// list index, sorted by title
 	std::vector<GameListItem*> byTitle;
 
+	// Games by internal ID.  Internal IDs are assigned sequentially, so
+	// this is a dense table, indexed directly by ID, with null entries
+	// for unused IDs.  We rebuild it along with the title index.  The
+	// Javascript GameInfo objects look up their games by internal ID on
+	// every property access, so this lookup has to be fast.
+	std::vector<GameListItem*> byInternalID;
+
+	// Attribute indexes: the games with each system, manufacturer, and
+	// year.  These serve the filters that select by those fields (see
+	// GameListFilter::GetAttrIndexType()), so that enumerating one of
+	// those filters costs time in proportion to its result size.  We
+	// rebuild them along with the title index, and UpdateAttrIndex()
+	// keeps them current across edits in between.
+	std::unordered_map<const GameSystem*, std::unordered_set<GameListItem*>> gamesBySystem;
+	std::unordered_map<const GameManufacturer*, std::unordered_set<GameListItem*>> gamesByManufacturer;
+	std::map<int, std::unordered_set<GameListItem*>> gamesByYear;
+
+	// remove a game from the attribute indexes, under its filed keys
+	void RemoveFromAttrIndex(GameListItem *game);
+
+	// Get the candidate games for a filter from its attribute index, in
+	// title order.  Returns false if the filter doesn't use an index.
+	bool GetAttrIndexCandidates(GameListFilter *filter, std::vector<GameListItem*> &candidates);
+
+	// Title sort keys, indexed by internal ID.  These are the locale
+	// sort keys for the titles (LCMapStringEx(LCMAP_SORTKEY)), which
+	// compare with a simple byte comparison in the same order that
+	// lstrcmpi() compares the titles themselves, without the locale
+	// table lookups on every comparison.  Each key remembers a hash of
+	// the title it was built from, so we only rebuild the keys for new
+	// or renamed games on each sort.
+	struct TitleSortKey
+	{
+		bool valid = false;
+		size_t titleHash = 0;
+		std::string key;
+	};
+	std::vector<TitleSortKey> titleSortKeys;
+
 	// filtered index list, sorted by title
 	std::vector<GameListItem*> byTitleFiltered;
 
+	// Page group table for byTitleFiltered, for the Next/Previous Page
+	// commands.  This divides the filtered list into runs of consecutive
+	// games in the same page group, so that a paging command can find
+	// the current game's run by binary search and step from run to run,
+	// instead of calling the filter's page group function on every game
+	// along the way.  We build the table on the first paging command
+	// after each filter refresh, so that we don't call the group function
+	// (which might be Javascript) for every game on filter changes that
+	// don't lead to any paging.
+	struct PageRun
+	{
+		int start;		// index in byTitleFiltered of the first game in the run
+		int group;		// page group ID
+	};
+	std::vector<PageRun> pageRuns;
+	bool pageRunsValid = false;
+
+	// build the page group table if necessary
+	void BuildPageRuns();
+
+	// find the run containing an index in byTitleFiltered
+	int FindPageRun(int index) const;
+
+	// Search index word list.  This maps each lower-case word in each
+	// game's indexed fields to the game and the field weight.  The
+	// multimap keeps the words sorted, so a prefix lookup is a single
+	// lower_bound() followed by a forward scan over the matching words.
+	// Each game has at most one entry per word, with the weight of the
+	// best field containing the word.
+	struct SearchWord
+	{
+		GameListItem *game;
+		int weight;
+	};
+	std::multimap<TSTRING, SearchWord> searchWords;
+
+	// Search index game state.  For each indexed game, this is a copy of
+	// the indexed fields as of the last indexing, so that we can tell when
+	// the game needs to be re-indexed, plus the list of words we added to
+	// the word list for it, so that we can remove them again.  The stats
+	// database row is compared by its change stamp, which covers the
+	// category list.
+	struct SearchGameState
+	{
+		TSTRING title;
+		TSTRING lcTitle;
+		const GameManufacturer *manufacturer = nullptr;
+		GameSystem *system = nullptr;
+		GameDatabaseFile *dbFile = nullptr;
+		int year = 0;
+		int statsDbRow = -1;
+		UINT64 statsStamp = 0;
+		std::vector<TSTRING> words;
+
+		// sweep number of the last update that found the game in the list
+		UINT64 sweep = 0;
+	};
+	std::unordered_map<GameListItem*, SearchGameState> searchGames;
+	UINT64 searchSweep = 0;
+
+	// Fuzzy title index, for the fallback search.  This is rebuilt on
+	// the next fallback search after any change to the word list.
+	DiceCoefficient::BigramIndex<TCHAR> searchTitleIndex;
+	std::vector<GameListItem*> searchTitleGames;
+	bool searchTitleIndexValid = false;
+
+	// bring the search index up to date
+	void UpdateSearchIndex();
+
+	// Title index serial number.  This is incremented each time we
+	// rebuild or re-sort the title index, since that invalidates the
+	// game index positions in the filter membership caches.
+	UINT64 titleIndexSerial = 1;
+
+	// Filter row state.  For each game in the title index, this is a
+	// snapshot of the data that the cacheable filters look at, taken
+	// on the last filter refresh, so that we can tell which games have
+	// changed since a filter's membership cache was brought up to date.
+	// Each filter refresh compares the snapshot against the current
+	// data, and assigns changed rows a new row change serial number.
+	// The game fields are compared directly, including the XML rating,
+	// which the rating filters fall back on for games without a stats
+	// rating; the stats database row is compared by its change stamp,
+	// which covers all of the stats columns, including the categories.
+	struct FilterRowState
+	{
+		GameSystem *system = nullptr;
+		GameManufacturer *manufacturer = nullptr;
+		GameDatabaseFile *dbFile = nullptr;
+		int year = 0;
+		float pbxRating = 0.0f;
+		bool isConfigured = false;
+		bool hidden = false;
+		int statsDbRow = -1;
+		UINT64 statsStamp = 0;
+
+		// row change serial number of the last change to the row
+		UINT64 serial = 0;
+	};
+	std::vector<FilterRowState> filterRowState;
+	UINT64 filterRowSerial = 0;
+
+	// update the filter row state
+	void UpdateFilterRowState();
+
+	// Prebuilt sort indexes, for the standard filter sort orders, in
+	// each direction.  Each index is the list of title index positions
+	// in the sort order.  An index stays valid as long as the title index
+	// and the filter row state haven't changed since it was built, so we
+	// only have to re-sort after something changes that could affect the
+	// order, such as a game being played or re-rated.
+	struct SortIndex
+	{
+		std::vector<int> order;
+		UINT64 titleIndexSerial = 0;
+		UINT64 rowSerial = 0;
+	};
+	SortIndex sortIndexes[GameListFilter::nSortOrders][2];
+
+	// get a sort index, building or rebuilding it if necessary
+	const std::vector<int> &GetSortIndex(GameListFilter::SortOrder order, bool descending);
+
+	// Date index.  'byRow' has the parsed date for each stats row, with
+	// 0 for rows without a valid date, and 'sorted' has the (date, row)
+	// pairs for the rows with dates, in ascending order.
+	struct DateIndex
+	{
+		bool built = false;
+		std::vector<DATE> byRow;
+		std::vector<std::pair<DATE, int>> sorted;
+	};
+	DateIndex dateIndexes[static_cast<int>(DateIndexType::NTypes)];
+
+	// get a date index, building it if necessary
+	DateIndex &GetDateIndex(DateIndexType type);
+
+	// update a row in a date index after setting its date
+	void UpdateDateIndex(DateIndexType type, int row);
+
+	// parse a stats row's date for a date index
+	DATE ParseIndexedDate(DateIndexType type, int row);
+
+	// bring a cacheable filter's membership cache up to date
+	void UpdateMembershipCache(GameListFilter *filter, bool hideUnconfigured);
+
+	// Apply a metafilter to the inclusion status of each game in the
+	// title index.  This uses the metafilter's batch interface and its
+	// result cache, if available.
+	void ApplyMetaFilter(MetaFilter *mf, std::vector<bool> &include);
+
+	// apply the generic hidden/unconfigured tests for a filter
+	bool PassesGenericFilterTests(GameListFilter *filter, GameListItem *game, bool hideUnconfigured);
+
 	// Populate the table list from PinballX.ini.  This reads the system
 	// list information using the PinballX.ini format.
 	bool InitFromPinballX(ErrorHandler &eh);
@@ -2034,6 +2806,12 @@ protected:
 	// Populate the table list from our own config variables.
 	bool InitFromConfig(ErrorHandler &eh);
 
+	// Scan the table folders for the table file sets that haven't been
+	// scanned yet.  This runs after the systems are set up, before the
+	// database files are loaded, so that all of the folders can be
+	// scanned in parallel.
+	void ScanTableFileSets();
+
 	// Media folder path.  We use the HyperPin/PinballX directory tree
 	// structure under this folder.
 	TSTRING mediaPath;
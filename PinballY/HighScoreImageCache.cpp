@@ -0,0 +1,258 @@
+// This file is part of PinballY
+// Copyright 2018 Michael J Roberts | GPL v3 or later | NO WARRANTY
+//
+// High score image cache
+
+#include "stdafx.h"
+#include "HighScoreImageCache.h"
+#include "LogFile.h"
+
+// statics
+bool HighScoreImageCache::enabled = true;
+bool HighScoreImageCache::diskEnabled = false;
+CacheHitStats HighScoreImageCache::hitStats;
+std::list<HighScoreImageCache::CacheItem> HighScoreImageCache::items;
+std::unordered_map<UINT64, std::list<HighScoreImageCache::CacheItem>::iterator> HighScoreImageCache::index;
+size_t HighScoreImageCache::totalBytes = 0;
+CriticalSection HighScoreImageCache::lock;
+
+// Disk cache file layout.  The file header is followed by one image
+// header per image, each followed by the image's pixel data.
+struct HighScoreFileHeader
+{
+	char sig[16];         // signature, highScoreFileSig
+	UINT32 nImages;       // number of images
+};
+struct HighScoreFileImage
+{
+	INT32 spriteType;
+	UINT32 displayTime;
+	RGBQUAD bgColor;
+	UINT32 bgAlpha;
+	BITMAPINFOHEADER bmih;
+	UINT32 pixBytes;
+};
+static const char highScoreFileSig[16] = "PBYHighScore/1";
+
+size_t HighScoreImageCache::PixelBytes(const BITMAPINFOHEADER &bmih)
+{
+	size_t stride = ((static_cast<size_t>(bmih.biWidth) * bmih.biBitCount + 31) / 32) * 4;
+	return stride * static_cast<size_t>(abs(bmih.biHeight));
+}
+
+bool HighScoreImageCache::Find(UINT64 key, std::shared_ptr<const Entry> &entry)
+{
+	if (!enabled)
+		return false;
+
+	CriticalSectionLocker locker(lock);
+	if (auto it = index.find(key); it != index.end())
+	{
+		// move it to the front of the recently used list
+		items.splice(items.begin(), items, it->second);
+		entry = it->second->entry;
+		return true;
+	}
+
+	// not found
+	return false;
+}
+
+bool HighScoreImageCache::Load(UINT64 key, std::shared_ptr<const Entry> &entry)
+{
+	// try the memory cache first
+	if (Find(key, entry))
+	{
+		hitStats.Hit();
+		return true;
+	}
+
+	// try the disk cache
+	if (!enabled)
+		return false;
+	if (!diskEnabled || !ReadFile(key, entry))
+	{
+		hitStats.Miss();
+		return false;
+	}
+
+	// add it to the memory cache for next time
+	AddToMemory(key, entry);
+	hitStats.Hit();
+	return true;
+}
+
+void HighScoreImageCache::Add(UINT64 key, std::shared_ptr<const Entry> entry)
+{
+	if (!enabled || entry == nullptr)
+		return;
+
+	// add it to memory
+	AddToMemory(key, entry);
+
+	// save it to disk if desired
+	if (diskEnabled)
+		WriteFile(key, *entry);
+}
+
+void HighScoreImageCache::AddToMemory(UINT64 key, const std::shared_ptr<const Entry> &entry)
+{
+	// figure the pixel data size
+	size_t bytes = 0;
+	for (auto &i : *entry)
+		bytes += i.pix.size();
+
+	CriticalSectionLocker locker(lock);
+
+	// replace any existing entry for the key
+	if (auto it = index.find(key); it != index.end())
+	{
+		totalBytes -= it->second->bytes;
+		items.erase(it->second);
+		index.erase(it);
+	}
+
+	// add it at the front of the recently used list
+	items.push_front({ key, entry, bytes });
+	index.emplace(key, items.begin());
+	totalBytes += bytes;
+
+	// discard the least recently used entries until we're within the
+	// limit, always keeping the new entry
+	while (totalBytes > maxBytes && items.size() > 1)
+	{
+		auto &last = items.back();
+		totalBytes -= last.bytes;
+		index.erase(last.key);
+		items.pop_back();
+	}
+}
+
+void HighScoreImageCache::Clear()
+{
+	CriticalSectionLocker locker(lock);
+	items.clear();
+	index.clear();
+	totalBytes = 0;
+}
+
+WSTRING HighScoreImageCache::GetCacheFile(UINT64 key)
+{
+	TCHAR folder[MAX_PATH];
+	GetDeployedFilePath(folder, _T("HighScoreCache"), _T(""));
+	return MsgFmt(_T("%s\\%016I64x.hsi"), folder, key).Get();
+}
+
+bool HighScoreImageCache::ReadFile(UINT64 key, std::shared_ptr<const Entry> &entry)
+{
+	// if there's no cache file, there's nothing to load
+	WSTRING cacheFile = GetCacheFile(key);
+	if (!FileExists(cacheFile.c_str()))
+		return false;
+
+	// discard an unusable entry, so that it'll be rebuilt on the next save
+	auto Discard = [&cacheFile](const TCHAR *what)
+	{
+		LogFile::Get()->Write(LogFile::MediaFileLogging,
+			_T("High score image cache: error loading cache file %ws (%s); discarding the entry\n"),
+			cacheFile.c_str(), what);
+		DeleteFileW(cacheFile.c_str());
+		return false;
+	};
+
+	// open the file
+	FILEPtrHolder fp;
+	if (_wfopen_s(&fp, cacheFile.c_str(), L"rb") != 0)
+		return false;
+
+	// read and check the header
+	HighScoreFileHeader hdr;
+	if (fread(&hdr, sizeof(hdr), 1, fp) != 1
+		|| memcmp(hdr.sig, highScoreFileSig, sizeof(highScoreFileSig)) != 0
+		|| hdr.nImages == 0 || hdr.nImages > 256)
+		return Discard(_T("invalid header"));
+
+	// read the images
+	auto newEntry = std::make_shared<Entry>();
+	newEntry->reserve(hdr.nImages);
+	for (UINT32 i = 0; i < hdr.nImages; ++i)
+	{
+		HighScoreFileImage ih;
+		if (fread(&ih, sizeof(ih), 1, fp) != 1
+			|| ih.pixBytes != PixelBytes(ih.bmih))
+			return Discard(_T("invalid image header"));
+
+		auto &img = newEntry->emplace_back();
+		img.spriteType = ih.spriteType;
+		img.displayTime = ih.displayTime;
+		img.bgColor = ih.bgColor;
+		img.bgAlpha = static_cast<BYTE>(ih.bgAlpha);
+		img.bmih = ih.bmih;
+		img.pix.resize(ih.pixBytes);
+		if (fread(img.pix.data(), 1, ih.pixBytes, fp) != ih.pixBytes)
+			return Discard(_T("read error"));
+	}
+
+	// success
+	entry = newEntry;
+	return true;
+}
+
+void HighScoreImageCache::WriteFile(UINT64 key, const Entry &entry)
+{
+	auto Fail = [](const TCHAR *what, DWORD err)
+	{
+		LogFile::Get()->Write(LogFile::MediaFileLogging,
+			_T("High score image cache: error saving cache file (%s, error %lu)\n"), what, err);
+	};
+
+	// make sure the cache folder exists
+	TCHAR folder[MAX_PATH];
+	GetDeployedFilePath(folder, _T("HighScoreCache"), _T(""));
+	if (!DirectoryExists(folder) && !CreateDirectory(folder, NULL))
+		return Fail(_T("CreateDirectory"), GetLastError());
+
+	// set up the header
+	HighScoreFileHeader hdr;
+	memcpy(hdr.sig, highScoreFileSig, sizeof(hdr.sig));
+	hdr.nImages = static_cast<UINT32>(entry.size());
+
+	// Write the file to a temporary name, then move it into place, so
+	// that a reader never sees a partial entry.
+	WSTRING cacheFile = GetCacheFile(key);
+	WSTRING tmpFile = cacheFile + L".tmp";
+	bool ok = false;
+	{
+		FILEPtrHolder fp;
+		if (_wfopen_s(&fp, tmpFile.c_str(), L"wb") == 0)
+		{
+			ok = fwrite(&hdr, sizeof(hdr), 1, fp) == 1;
+			for (auto it = entry.begin(); ok && it != entry.end(); ++it)
+			{
+				HighScoreFileImage ih;
+				ih.spriteType = it->spriteType;
+				ih.displayTime = it->displayTime;
+				ih.bgColor = it->bgColor;
+				ih.bgAlpha = it->bgAlpha;
+				ih.bmih = it->bmih;
+				ih.pixBytes = static_cast<UINT32>(it->pix.size());
+				ok = fwrite(&ih, sizeof(ih), 1, fp) == 1
+					&& fwrite(it->pix.data(), 1, it->pix.size(), fp) == it->pix.size();
+			}
+		}
+	}
+	if (!ok)
+	{
+		DeleteFileW(tmpFile.c_str());
+		return Fail(_T("writing the cache file"), 0);
+	}
+	if (!MoveFileExW(tmpFile.c_str(), cacheFile.c_str(), MOVEFILE_REPLACE_EXISTING))
+	{
+		DWORD err = GetLastError();
+		DeleteFileW(tmpFile.c_str());
+		return Fail(_T("MoveFileEx"), err);
+	}
+
+	LogFile::Get()->Write(LogFile::MediaFileLogging, _T("High score image cache: saved %ws (%d images)\n"),
+		cacheFile.c_str(), static_cast<int>(entry.size()));
+}
@@ -0,0 +1,112 @@
+// This file is part of PinballY
+// Copyright 2018 Michael J Roberts | GPL v3 or later | NO WARRANTY
+//
+// High score image cache
+//
+// This is a cache of the rendered high score slides for the DMD window.
+// Generating the slides takes a fair amount of GDI+ work, especially in
+// the alphanumeric and typewriter styles, so rather than running the
+// generator every time a game is selected, we keep the rendered images
+// for the games we've already visited.  Revisiting a game can then show
+// its high scores immediately.
+//
+// Entries are keyed by a hash of everything that goes into the images:
+// the game ID, the slide text and display times, the display style, the
+// fonts, the colors, and the image size.  A change to any of these (in
+// particular, a new high score) automatically selects a new entry, so
+// the cache never needs explicit invalidation.
+//
+// The memory cache is bounded by the total pixel data size, discarding
+// the least recently used entries first.  The cache can optionally also
+// be saved to disk, in the HighScoreCache folder under the program
+// folder, so that the images survive across sessions.  Stale disk
+// entries are simply left behind; the folder can be deleted at any time
+// to clean them up.
+
+#pragma once
+#include <list>
+#include <vector>
+#include <memory>
+#include <unordered_map>
+#include "CacheStats.h"
+
+class HighScoreImageCache
+{
+public:
+	// Is the cache enabled?  Is the on-disk cache enabled?  These are
+	// set from the configuration.
+	static bool enabled;
+	static bool diskEnabled;
+
+	// Hit statistics for Load(), counting memory and disk hits together
+	static CacheHitStats hitStats;
+
+	// Cached image.  This captures the information needed to reconstruct
+	// a DMDView::HighScoreImage.
+	struct Image
+	{
+		// DMDView::HighScoreImage::SpriteType
+		int spriteType = 0;
+
+		// display time in milliseconds
+		DWORD displayTime = 0;
+
+		// background color and alpha, for the DMD shader
+		RGBQUAD bgColor = { 0, 0, 0, 0 };
+		BYTE bgAlpha = 255;
+
+		// DIB header and pixels
+		BITMAPINFOHEADER bmih;
+		std::vector<BYTE> pix;
+	};
+	typedef std::vector<Image> Entry;
+
+	// Look up an entry in the memory cache.  Returns true and fills in
+	// 'entry' if found.  This can be called from any thread.
+	static bool Find(UINT64 key, std::shared_ptr<const Entry> &entry);
+
+	// Look up an entry, trying the disk cache if it's not in memory.  A
+	// disk entry is added to the memory cache.  This does file I/O, so
+	// it should be called from a background thread.
+	static bool Load(UINT64 key, std::shared_ptr<const Entry> &entry);
+
+	// Add an entry to the memory cache, and save it to the disk cache if
+	// enabled.  This can do file I/O, so it should be called from a
+	// background thread.
+	static void Add(UINT64 key, std::shared_ptr<const Entry> entry);
+
+	// clear the memory cache
+	static void Clear();
+
+	// get the size in bytes of an image's pixel data
+	static size_t PixelBytes(const BITMAPINFOHEADER &bmih);
+
+protected:
+	// add an entry to the memory cache
+	static void AddToMemory(UINT64 key, const std::shared_ptr<const Entry> &entry);
+
+	// get the disk cache file name for a key
+	static WSTRING GetCacheFile(UINT64 key);
+
+	// read/write a disk cache entry
+	static bool ReadFile(UINT64 key, std::shared_ptr<const Entry> &entry);
+	static void WriteFile(UINT64 key, const Entry &entry);
+
+	// Memory cache entries, most recently used first, with an index by
+	// key.
+	struct CacheItem
+	{
+		UINT64 key;
+		std::shared_ptr<const Entry> entry;
+		size_t bytes;
+	};
+	static std::list<CacheItem> items;
+	static std::unordered_map<UINT64, std::list<CacheItem>::iterator> index;
+
+	// total pixel data size in the memory cache, and the limit
+	static size_t totalBytes;
+	static const size_t maxBytes = 64 * 1024 * 1024;
+
+	// lock for the memory cache
+	static CriticalSection lock;
+};
@@ -10,6 +10,7 @@
 #include "PlayfieldView.h"
 #include "DOFClient.h"
 #include "LogFile.h"
+#include "LoaderPool.h"
 
 #include "../Utilities/std_filesystem.h"
 namespace fs = std::filesystem;
@@ -123,10 +124,10 @@ bool HighScores::Init()
 			}
 
 			// Now scan the file
-			std::regex commentPat("\\s*//.*");
-			std::regex sectPat("\\s*\\[(.*)\\]\\s*");
-			std::regex pairPat("([^\\s=][^=]*)=(.*)");
-			std::regex vsnPat("(\\s+\\([^\\)]+\\))+$|[.,:\\(\\)]");
+			static const std::regex commentPat("\\s*//.*");
+			static const std::regex sectPat("\\s*\\[(.*)\\]\\s*");
+			static const std::regex pairPat("([^\\s=][^=]*)=(.*)");
+			static const std::regex vsnPat("(\\s+\\([^\\)]+\\))+$|[.,:\\(\\)]");
 			CSTRING section;
 			for (size_t i = 0, nLines = self->iniLines.size(); i < nLines; ++i)
 			{
@@ -174,15 +175,8 @@ bool HighScores::Init()
 						CSTRING rootName = std::regex_replace(name, vsnPat, "");
 
 						// find or add a fuzzy ROM lookup entry
-						auto it = self->fuzzyRomFind.find(rootName);
-						if (it == self->fuzzyRomFind.end())
-							it = self->fuzzyRomFind.emplace(
-								std::piecewise_construct,
-								std::forward_as_tuple(rootName),
-								std::forward_as_tuple(rootName.c_str())).first;
-
 						// add this NVRAM file to the lookup entry's list
-						it->second.nvFiles.push_back(val);
+						self->fuzzyRomFind[rootName].nvFiles.push_back(val);
 					}
 					else if (section == "paths")
 					{
@@ -213,6 +207,23 @@ bool HighScores::Init()
 			});
 		}
 
+		// build the bigram index for the fuzzy ROM lookup
+		self->fuzzyRomList.reserve(self->fuzzyRomFind.size());
+		for (auto const &f : self->fuzzyRomFind)
+		{
+			self->fuzzyRomIndex.Add(f.first.c_str());
+			self->fuzzyRomList.push_back(&f.second);
+		}
+		self->fuzzyRomIndex.Build();
+
+		// load the NVRAM decoder's score map
+		TCHAR scoreMapFile[MAX_PATH];
+		GetDeployedFilePath(scoreMapFile, _T("NVRAMScoreMap.txt"), _T(""));
+		self->nvramDecoder.Load(scoreMapFile);
+
+		// load the saved PINemHi results
+		self->LoadResultCache();
+
 		// initialization is complete
 		self->inited = true;
 
@@ -524,8 +535,7 @@ bool HighScores::GetNvramFile(TSTRING &nvramPath, TSTRING &nvramFile, const Game
 		// VPinMAME ROM files are stored as .zip files, so the ROM name
 		// in the config might refer to the zip file instead of just the
 		// base name.  Strip any .zip suffix.
-		std::basic_regex<TCHAR> zipPat(_T("\\.zip$"), std::regex_constants::icase);
-		nvramFile = std::regex_replace(nvramFile, zipPat, _T(""));
+		nvramFile = StripSuffixI(nvramFile.c_str(), _T(".zip"));
 
 		// if the name isn't empty and doesn't end in .nv, add the .nv suffix
 		if (nvramFile.length() != 0 && !tstriEndsWith(nvramFile.c_str(), _T(".nv")))
@@ -585,8 +595,7 @@ bool HighScores::GetNvramFile(TSTRING &nvramPath, TSTRING &nvramFile, const Game
 		// the extension replaced with ".fpram".  Start with the game's
 		// filename from the configuration, stripped of the .fp suffix 
 		// if present, then append ".fpram".
-		std::basic_regex<TCHAR> extPat(_T("\\.fp$"), std::regex_constants::icase);
-		nvramFile = std::regex_replace(game->filename, extPat, _T(""));
+		nvramFile = StripSuffixI(game->filename.c_str(), _T(".fp"));
 		nvramFile += _T(".fpram");
 
 		LogFile::Get()->Write(LogFile::HiScoreLogging,
@@ -604,31 +613,16 @@ bool HighScores::GetAllNvramFiles(std::list<TSTRING> &nvList, const TCHAR *gameT
 	// punctuation.
 	TSTRING title = gameTitle;
 	std::transform(title.begin(), title.end(), title.begin(), ::_totlower);
-	std::basic_regex<TCHAR> punctPat(_T("[.,:\\(\\)]"));
-	title = std::regex_replace(title, punctPat, _T(""));
-
-	// get its bigram set
-	DiceCoefficient::BigramSet<CHAR> bigrams;
-	DiceCoefficient::BuildBigramSet(bigrams, TSTRINGToCSTRING(title).c_str());
+	title = StripChars(title.c_str(), _T(".,:()"));
 
 	// search for the best match in the [romfind] list
-	float bestScore = 0.0f;
-	const FuzzyRomEntry *bestMatch = nullptr;
-	for (auto const &f : fuzzyRomFind)
-	{
-		float score = DiceCoefficient::DiceCoefficient(bigrams, f.second.bigrams);
-		if (score > bestScore)
-		{
-			bestScore = score;
-			bestMatch = &f.second;
-		}
-	}
+	int bestMatch = fuzzyRomIndex.Best(TSTRINGToCSTRING(title).c_str(), 0.7f);
 
 	// if we found a good enough match, return its NVRAM list
-	if (bestScore > 0.7f)
+	if (bestMatch >= 0)
 	{
 		// pass back the list
-		for (auto const &f : bestMatch->nvFiles)
+		for (auto const &f : fuzzyRomList[bestMatch]->nvFiles)
 			nvList.emplace_back(CSTRINGToTSTRING(f));
 
 		// success
@@ -660,7 +654,7 @@ bool HighScores::GetScores(GameListItem *game, HWND hwndNotify, NotifyContext *n
 	LogFile::Get()->Write(LogFile::HiScoreLogging,
 		_T("High score retrieval: getting high scores for %s\n"), gameTitle);
 
-	// try PINemHi first
+	// try the NVRAM file first, via our decoder or PINemHi
 	if (GetScoresFromNVRAM(game, hwndNotify, notifyContextPtr))
 		return true;
 
@@ -675,7 +669,18 @@ bool HighScores::GetScores(GameListItem *game, HWND hwndNotify, NotifyContext *n
 }
 
 
-bool HighScores::GetScoresFromNVRAM(GameListItem *game, HWND hwndNotify, std::unique_ptr<NotifyContext> &notifyContext)
+bool HighScores::Prescan(GameListItem *game)
+{
+	// only configured games can have NVRAM files
+	if (game == nullptr || game->system == nullptr)
+		return false;
+
+	std::unique_ptr<NotifyContext> notifyContext;
+	return GetScoresFromNVRAM(game, NULL, notifyContext, true);
+}
+
+bool HighScores::GetScoresFromNVRAM(GameListItem *game, HWND hwndNotify, std::unique_ptr<NotifyContext> &notifyContext,
+	bool prescan)
 {
 	// We can't proceed if initialization hasn't finished yet
 	if (!IsInited())
@@ -712,12 +717,65 @@ bool HighScores::GetScoresFromNVRAM(GameListItem *game, HWND hwndNotify, std::un
 	if (!tstrEndsWith(nvramPath.c_str(), _T("\\")))
 		nvramPath.append(_T("\\"));
 
-	// Enqueue the request.  The command line is simply the name of the 
-	// NVRAM file, but note that PINemHi seems to require the command line
-	// to be constructed with a space before the first token.
-	EnqueueThread(new NVRAMThread(
+	// If we have cached results for the NVRAM file, and the file hasn't
+	// changed since we cached them, use the cached results rather than
+	// running PINemHi again.
+	TSTRING cacheKey = nvramPath + nvramFile;
+	std::transform(cacheKey.begin(), cacheKey.end(), cacheKey.begin(), ::_totlower);
+	WIN32_FILE_ATTRIBUTE_DATA attrs;
+	bool haveAttrs = GetFileAttributesEx(cacheKey.c_str(), GetFileExInfoStandard, &attrs) != 0;
+	UINT64 nvramSize = haveAttrs ? (static_cast<UINT64>(attrs.nFileSizeHigh) << 32) | attrs.nFileSizeLow : 0;
+	if (haveAttrs)
+	{
+		CriticalSectionLocker lock(threadLock);
+		if (auto it = resultCache.find(cacheKey); it != resultCache.end()
+			&& it->second.size == nvramSize && CompareFileTime(&it->second.mtime, &attrs.ftLastWriteTime) == 0)
+		{
+			// a pre-scan has nothing to do if the cache is already fresh
+			if (prescan)
+				return false;
+
+			LogFile::Get()->Write(LogFile::HiScoreLogging,
+				_T("High score retrieval: NVRAM file %s is unchanged; using the cached PINemHi results\n"), cacheKey.c_str());
+			EnqueueThread(new CachedResultThread(this, game, hwndNotify, notifyContext.release(), it->second.results));
+			return true;
+		}
+	}
+
+	// a pre-scan has nothing to do if there's no NVRAM file yet
+	if (prescan && !haveAttrs)
+		return false;
+
+	// Likewise, a pre-scan has nothing to do if our own decoder handles
+	// this ROM, since decoding is fast enough to do on demand
+	bool useDecoder = nvramDecoder.IsSupported(nvramFile.c_str());
+	if (prescan && useDecoder)
+		return false;
+
+	// Set up the PINemHi request.  The command line is simply the name of
+	// the NVRAM file, but note that PINemHi seems to require the command
+	// line to be constructed with a space before the first token.
+	auto thread = new NVRAMThread(
 		MsgFmt(_T(" %s"), nvramFile.c_str()), HighScoreQuery,
-		game, nvramPath, nvramFile, this, pathEntry, hwndNotify, notifyContext.release()));
+		game, nvramPath, nvramFile, this, pathEntry, hwndNotify, notifyContext.release());
+	if (haveAttrs)
+	{
+		thread->cacheKey = cacheKey;
+		thread->nvramSize = nvramSize;
+		thread->nvramTime = attrs.ftLastWriteTime;
+	}
+	thread->prescan = prescan;
+
+	// If our decoder handles this ROM, try it first, keeping the PINemHi
+	// request as the fallback; otherwise just run PINemHi.
+	if (useDecoder)
+	{
+		LogFile::Get()->Write(LogFile::HiScoreLogging,
+			_T("High score retrieval: %s is in the NVRAM score map; using the in-process decoder\n"), nvramFile.c_str());
+		EnqueueThread(new DecoderThread(this, thread));
+	}
+	else
+		EnqueueThread(thread);
 
 	// the request was successfully submitted
 	return true;
@@ -731,8 +789,7 @@ bool HighScores::GetScoresFromFile(GameListItem *game, HWND hwndNotify, std::uni
 
 	// look for a file with the same base name, with the extension replaced
 	// with .pinballyHighScores
-	std::basic_regex<TCHAR> pat(_T("\\.[^.\\\\/:]+$"));
-	TSTRING filename = std::regex_replace(rf.path, pat, _T(".pinballyHighScores"));
+	TSTRING filename = ReplaceFileExt(rf.path.c_str(), _T(".pinballyHighScores"));
 
 	LogFile::Get()->Write(LogFile::HiScoreLogging,
 		_T("High score retrieval: looking for ad hoc scores file %s\n"), filename.c_str());
@@ -774,14 +831,18 @@ void HighScores::EnqueueThread(Thread *thread)
 	// hold the thread lock while manipulating the queue
 	CriticalSectionLocker lock(threadLock);
 
-	// add the new thread
-	threadQueue.emplace_back(thread);
+	// Add the new thread.  Pre-scan threads go at the end of the queue;
+	// anything else goes ahead of any pending pre-scan threads, so that
+	// requests for the games the user is looking at don't have to wait
+	// for the pre-scan to finish.
+	if (thread->prescan)
+		threadQueue.emplace_back(thread);
+	else
+		threadQueue.insert(std::find_if(threadQueue.begin(), threadQueue.end(),
+			[](const Thread *t) { return t->prescan; }), thread);
 
-	// If this is the only queue in the thread, launch it immediately.
-	// If there was already a thread in the queue, it's still running,
-	// so it will take care of starting the next thread when it exits.
-	if (threadQueue.size() == 1)
-		LaunchNextThread(nullptr);
+	// launch it now if there's room
+	LaunchNextThread(nullptr);
 }
 
 void HighScores::LaunchNextThread(Thread *exitingThread)
@@ -789,66 +850,84 @@ void HighScores::LaunchNextThread(Thread *exitingThread)
 	// hold the thread lock while working
 	CriticalSectionLocker lock(threadLock);
 
-	// if a thread is exiting, remove it from the queue
+	// if a thread is exiting, un-count it
 	if (exitingThread != nullptr)
-		threadQueue.remove(exitingThread);
+	{
+		--nRunningThreads;
+		if (exitingThread->UsesPINemHi())
+			--nRunningPINemHi;
+		if (exitingThread->exclusive)
+			exclusiveRunning = false;
+	}
 
-	// get the next thread out of the queue and launch it
-	while (threadQueue.size() != 0)
+	// launch threads from the head of the queue while there's room
+	while (threadQueue.size() != 0 && nRunningThreads < maxConcurrentThreads)
 	{
 		// get the next thread on the queue
 		Thread *thread = threadQueue.front();
 
-		// launch it
-		DWORD tid;
-		HandleHolder hThread(CreateThread(NULL, 0, &Thread::SMain, thread, 0, &tid));
+		// If it runs PINemHi, make sure the INI file is in a suitable
+		// state.  If another thread is rewriting the file, or if this
+		// thread has to rewrite it while other PINemHi threads are
+		// still using it, wait for the running threads to finish.  We
+		// stop at the first thread that has to wait, to keep the
+		// requests in order.
+		bool exclusive = false;
+		if (thread->UsesPINemHi())
+		{
+			if (exclusiveRunning)
+				break;
 
-		// If that succeeded, we're done - simply return and let the
-		// thread launch the next thread in the queue.
-		if (hThread != NULL)
-			return;
+			exclusive = thread->NeedsIniUpdate();
+			if (exclusive && nRunningPINemHi != 0)
+				break;
+		}
 
-		// The thread launch failed, so this request can't be
-		// carried out after all.  Send a notification reply
-		// to the caller to let them know that the request is
-		// finished (unsuccessfully).
-		NotifyInfo ni(thread->queryType, thread->game, thread->notifyContext.get());
-		ni.status = NotifyInfo::ThreadLaunchFailed;
-		::SendMessage(thread->hwndNotify, HSMsgHighScores, 0, reinterpret_cast<LPARAM>(&ni));
-
-		// failed - discard this thread and try the next one
-		delete threadQueue.front();
+		// take it off the queue and count it
 		threadQueue.pop_front();
+		thread->exclusive = exclusive;
+		++nRunningThreads;
+		if (thread->UsesPINemHi())
+			++nRunningPINemHi;
+		if (exclusive)
+			exclusiveRunning = true;
+
+		// launch it on the loader pool
+		if (LoaderPool::Submit([thread]() { Thread::SMain(thread); },
+			thread->prescan ? LoaderPool::Priority::Prefetch : LoaderPool::Priority::Normal))
+			continue;
+
+		// The thread launch failed, so this request can't be
+		// carried out after all.  Un-count it, and send a 
+		// notification reply to the caller to let them know 
+		// that the request is finished (unsuccessfully).
+		--nRunningThreads;
+		if (thread->UsesPINemHi())
+			--nRunningPINemHi;
+		if (exclusive)
+			exclusiveRunning = false;
+
+		if (thread->hwndNotify != NULL)
+		{
+			NotifyInfo ni(thread->queryType, thread->game, thread->notifyContext.get());
+			ni.status = NotifyInfo::ThreadLaunchFailed;
+			::SendMessage(thread->hwndNotify, HSMsgHighScores, 0, reinterpret_cast<LPARAM>(&ni));
+		}
+
+		// discard this thread and try the next one
+		delete thread;
 	}
 }
 
 DWORD HighScores::Thread::SMain(LPVOID param)
 {
-	// For debugging purposes, make sure we're the only PinEMHi thread
-	// running.  We can't launch multiple instances of PinEMHi concurrently
-	// because we have to pass some information to it through its .ini 
-	// file, which is a global resource.  The thread queue mechanism
-	// *should* serialize PinEMHi launches naturally by its very design,
-	// so we don't have to do anything here to do that; but let's just
-	// verify that it's working as expected.
-	static ULONG threadCounter = 0;
-	InterlockedIncrement(&threadCounter);
-	if (threadCounter != 1)
-		OutputDebugString(_T("Warning! Multiple concurrent high score threads detected!\n"));
-
 	// get a unique pointer to the thread, so that we delete it on exit
 	std::unique_ptr<Thread> self(reinterpret_cast<Thread*>(param));
 
 	// run the thread main entrypoint
 	self->Main();
 
-	// we're now down with the PinEMHi launch portion of our job - un-count
-	// the concurrent process launcher
-	InterlockedDecrement(&threadCounter);
-	if (threadCounter != 0)
-		OutputDebugString(_T("Warning! High score background thread counter is not zero at thread exit\n"));
-
-	// before exiting, launch the next thread
+	// before exiting, launch the next threads
 	self->hs->LaunchNextThread(self.get());
 
 	// done
@@ -867,17 +946,24 @@ HighScores::NVRAMThread::NVRAMThread(
 {
 }
 
+bool HighScores::NVRAMThread::NeedsIniUpdate() const
+{
+	return pathEntry != nullptr && pathEntry->path != TSTRINGToCSTRING(nvramPath);
+}
+
 void HighScores::NVRAMThread::Main()
 {
 	// Set up the results object to send to the notifier window.
 	// We'll send a notification whether we succeed or fail.
 	NotifyInfo ni(queryType, game, notifyContext.get());
 
-	// send the result message to the notification window
+	// send the result message to the notification window, if any (there's
+	// no notification window for a pre-scan query)
 	auto SendResult = [&ni, this](NotifyInfo::Status status)
 	{
 		ni.status = status;
-		SendMessage(hwndNotify, HSMsgHighScores, 0, reinterpret_cast<LPARAM>(&ni));
+		if (hwndNotify != NULL)
+			SendMessage(hwndNotify, HSMsgHighScores, 0, reinterpret_cast<LPARAM>(&ni));
 	};
 
 	// Check to see if the current INI file path matches the one we
@@ -899,18 +985,18 @@ void HighScores::NVRAMThread::Main()
 	// object, so it might seem like we should hold the thread lock
 	// here.  We don't actually have to do that, though, because we
 	// only mess with the pathEntry objects within the launcher
-	// threads, and our thread dispatch setup ensures that only one
-	// of these threads is running at a time.
+	// threads, and the dispatcher runs a thread that needs to update
+	// the file exclusively, with no other PINemHi threads running.
 	//
 	// By the same token, the file itself is a shared resource among
 	// the launcher threads, since every invocation of PINemHi will
 	// read the file.  So we can't have one thread updating the file 
-	// while another thread is launching PINemHi.  That's actually the
-	// larger reason that we serialize execution of the launcher
-	// threads: going one at a time ensures that each PINemHi instance
-	// reads the version of the INI file that we prepared for it in 
-	// the same thread and eliminates any confusion about the order
-	// of events.
+	// while another thread is launching PINemHi.  That's the larger
+	// reason for the exclusive dispatch: it ensures that each PINemHi
+	// instance reads the version of the INI file that we prepared for
+	// it, and eliminates any confusion about the order of events.
+	// Threads that don't need to change the file can safely share it,
+	// so those run concurrently.
 	//
 	// If there's no path entry, it means that we're running PINemHi
 	// for a generic query (to get the program version number, for
@@ -963,84 +1049,30 @@ void HighScores::NVRAMThread::Main()
 	GetDeployedFilePath(folder, _T("PINemHi"), _T(""));
 	GetDeployedFilePath(exe, _T("PINemHi\\PINemHi.exe"), _T(""));
 
-	// create a pipe for reading the results
-	HandleHolder hReadPipe, hWritePipe;
-	if (!CreatePipe(&hReadPipe, &hWritePipe, NULL, 0))
-	{
-		SendResult(NotifyInfo::CreatePipeFailed);
-		return;
-	}
-
-	// set up the startup info for the console program
-	STARTUPINFO sinfo;
-	ZeroMemory(&sinfo, sizeof(sinfo));
-	sinfo.cb = sizeof(sinfo);
-	sinfo.dwFlags = STARTF_USESTDHANDLES;
-	sinfo.hStdInput = INVALID_HANDLE_VALUE;
-	sinfo.hStdOutput = hWritePipe;
-	sinfo.hStdError = hWritePipe;
-
-	// don't let the child inherit our end of the stdout pipe
-	SetHandleInformation(hReadPipe, HANDLE_FLAG_INHERIT, 0);
-	SetHandleInformation(hWritePipe, HANDLE_FLAG_INHERIT, HANDLE_FLAG_INHERIT);
-
 	// log the command line
 	LogFile::Get()->Write(LogFile::HiScoreLogging, 
 		_T("PinEMHi command line: \"%s\" %s\n"), exe, cmdline.c_str());
 
-	// Launch the program.  Use CREATE_NO_WINDOW to run it invisibly,
-	// so that we don't get UI cruft from flashing a console window
-	// onto the screen briefly.
-	PROCESS_INFORMATION pinfo;
-	ZeroMemory(&pinfo, sizeof(pinfo));
-	if (!CreateProcess(exe, cmdline.data(), NULL, NULL, TRUE, CREATE_NO_WINDOW,
-		NULL, folder, &sinfo, &pinfo))
-	{
-		// log the error
-		WindowsErrorMessage errmsg;
-		LogFile::Get()->Write(_T("PinEMHi process launch failed: %s"), errmsg.Get());
-
-		// notify the caller and abort
-		SendResult(NotifyInfo::ProcessLaunchFailed);
-		return;
-	}
-
-	// Close our copy of the write end of the pipe.  The child process has
-	// its own inherited handle now; we need to close our end so that Windows
-	// knows no one is going to write anything more to the pipe after the
-	// child process exits; if we kept our end of the handle open, it would
-	// make our ReadFile wait forever, since Windows would hold out hope
-	// that someone might one day write to the open handle.
-	hWritePipe = NULL;
-
-	// Wait for the program to finish - not too long, as it should do its 
-	// work and exit almost immediately.  Ideally it should take just a
-	// few tens of milliseconds to run, but it could take longer just to
-	// launch if the system is busy, so give it a few seconds.
-	if (WaitForSingleObject(pinfo.hProcess, 7500) == WAIT_OBJECT_0)
+	// Launch the program, and wait for it to finish.  We're already on
+	// a worker thread, so we can simply block here.  It shouldn't take
+	// long, as it should do its work and exit almost immediately; ideally
+	// it should take just a few tens of milliseconds to run, but it could
+	// take longer just to launch if the system is busy, so give it a few
+	// seconds.  The output is collected through an overlapped pipe while
+	// the program runs, so we don't have to worry about reading from the
+	// pipe after the process exits (which used to hang now and then).
+	AsyncProcess::Options opts;
+	opts.workingDir = folder;
+	opts.timeout = 7500;
+	RefPtr<AsyncProcess> proc;
+	proc.Attach(AsyncProcess::Start(exe, cmdline.c_str(), opts));
+	proc->Wait();
+
+	switch (proc->GetStatus())
 	{
-		// Success - read the results.  In some cases (about 10% of the time
-		// in my testing), ReadFile hangs indefinitely on this read after we've
-		// already read the last available byte.  It's clearly a race condition
-		// of some kind, but I can't tell what I'm doing wrong.  The main "rule"
-		// here is that we have to close our write handle on the pipe: once all
-		// write handles on the pipe are closed, Windows knows that no further
-		// data can be written to the pipe, hence ReadFile() should return
-		// immediately with zero bytes if the pipe buffer is empty.  Maybe 
-		// PinEMHi doesn't always close *its* end of the pipe, but I don't think 
-		// that should matter, because Windows should force the handle closed 
-		// when the process exits.  Which we know it has, because we wouldn't
-		// have gotten past the Wait on the process handle above otherwise.
-		// The hack solution is to add the PeekNamedPipe(), which tests that
-		// the buffer has bytes available before attempting the read.
-		CHAR buf[4096];
-		DWORD nBytes;
-		while (PeekNamedPipe(hReadPipe, NULL, 0, NULL, &nBytes, NULL) && nBytes != 0
-			&& ReadFile(hReadPipe, buf, sizeof(buf), &nBytes, NULL) && nBytes != 0)
-		{
-			buf[nBytes] = 0;
-			ni.results.append(AnsiToTSTRING(buf));
-		}
+	case AsyncProcess::Status::Exited:
+		// Success - collect the results
+		ni.results = AnsiToTSTRING(proc->GetOutput().c_str());
 
 		// results are from PINemHi
 		ni.source = NotifyInfo::Source::PINemHi;
@@ -1049,25 +1081,66 @@ void HighScores::NVRAMThread::Main()
 		LogFile::Get()->Write(LogFile::HiScoreLogging,
 			_T("PinEMHi completed successfully; results:\n>>>\n%s\n>>>\n"), ni.results.c_str());
 
+		// cache the results, so that we don't have to run PINemHi again
+		// until the NVRAM file changes
+		if (cacheKey.length() != 0 && ni.results.length() != 0)
+		{
+			CriticalSectionLocker lock(hs->threadLock);
+			hs->resultCache[cacheKey] = { nvramSize, nvramTime, ni.results };
+			hs->resultCacheDirty = true;
+		}
+
 		// Notify the callback window of the result
 		SendResult(NotifyInfo::Success);
-	}
-	else
-	{
-		// Timed out - the PinEMHi child process seems to be stuck
+		break;
+
+	case AsyncProcess::Status::Failed:
+		// log the error
+		LogFile::Get()->Write(_T("PinEMHi process launch failed: %s\n"), proc->GetError());
+
+		// notify the caller
+		SendResult(NotifyInfo::ProcessLaunchFailed);
+		break;
+
+	default:
+		// Timed out - the PinEMHi child process seemed to be stuck, so
+		// AsyncProcess killed it
 		LogFile::Get()->Write(LogFile::HiScoreLogging,
 			_T("!! PinEMHi process wait timed out; killing process\n"));
 
-		// Kill it so that we don't leave a zombie process hanging around
-		SaferTerminateProcess(pinfo.hProcess);
-
 		// Notify the callback of the failure
 		SendResult(NotifyInfo::NoReplyFromProcess);
+		break;
+	}
+}
+
+void HighScores::DecoderThread::Main()
+{
+	// try decoding the file
+	TSTRING results;
+	TSTRING path = fallback->nvramPath + fallback->nvramFile;
+	if (!hs->nvramDecoder.Decode(path.c_str(), fallback->nvramFile.c_str(), results))
+	{
+		// The decoder couldn't handle it, so run PINemHi instead.  The
+		// fallback thread carries the notification context, so it takes
+		// over the request from here.
+		LogFile::Get()->Write(LogFile::HiScoreLogging,
+			_T("High score retrieval: in-process decoder failed for %s; falling back on PINemHi\n"), path.c_str());
+		hs->EnqueueThread(fallback.release());
+		return;
 	}
 
-	// close the process handles
-	CloseHandle(pinfo.hThread);
-	CloseHandle(pinfo.hProcess);
+	LogFile::Get()->Write(LogFile::HiScoreLogging,
+		_T("In-process NVRAM decoder completed successfully for %s; results:\n>>>\n%s\n>>>\n"),
+		path.c_str(), results.c_str());
+
+	// send the results
+	NotifyInfo ni(queryType, game, fallback->notifyContext.get());
+	ni.status = NotifyInfo::Success;
+	ni.source = NotifyInfo::Source::Decoder;
+	ni.results = results;
+	if (hwndNotify != NULL)
+		SendMessage(hwndNotify, HSMsgHighScores, 0, reinterpret_cast<LPARAM>(&ni));
 }
 
 void HighScores::FileThread::Main()
@@ -1111,6 +1184,121 @@ void HighScores::FileThread::Main()
 	SendResult(NotifyInfo::Status::Success);
 }
 
+void HighScores::CachedResultThread::Main()
+{
+	// send the cached results, as though they came from PINemHi
+	NotifyInfo ni(queryType, game, notifyContext.get());
+	ni.status = NotifyInfo::Success;
+	ni.source = NotifyInfo::Source::PINemHi;
+	ni.results = results;
+	SendMessage(hwndNotify, HSMsgHighScores, 0, reinterpret_cast<LPARAM>(&ni));
+}
+
+// Result cache file layout.  The header is followed by the entries.
+// Each entry is a record header, followed by the key and results
+// strings (without null terminators).
+struct ResultCacheFileHeader
+{
+	char signature[16];
+	UINT32 charSize;
+	UINT32 nEntries;
+};
+struct ResultCacheFileRecord
+{
+	UINT64 size;
+	FILETIME mtime;
+	UINT32 keyLength;
+	UINT32 resultsLength;
+};
+static const char resultCacheSignature[16] = "PBYHiScoreRes/1";
+
+void HighScores::GetResultCacheFile(TCHAR path[MAX_PATH])
+{
+	GetDeployedFilePath(path, _T("HighScoreResultCache.dat"), _T(""));
+}
+
+void HighScores::LoadResultCache()
+{
+	TCHAR path[MAX_PATH];
+	GetResultCacheFile(path);
+	FILEPtrHolder fp;
+	if (_tfopen_s(&fp, path, _T("rb")) != 0)
+		return;
+
+	// check the header
+	ResultCacheFileHeader hdr;
+	if (fread(&hdr, sizeof(hdr), 1, fp) != 1
+		|| memcmp(hdr.signature, resultCacheSignature, sizeof(hdr.signature)) != 0
+		|| hdr.charSize != sizeof(TCHAR))
+		return;
+
+	// read the entries
+	CriticalSectionLocker lock(threadLock);
+	for (UINT32 i = 0; i < hdr.nEntries; ++i)
+	{
+		ResultCacheFileRecord rec;
+		if (fread(&rec, sizeof(rec), 1, fp) != 1
+			|| rec.keyLength == 0 || rec.keyLength >= 32768 || rec.resultsLength >= 1024*1024)
+			break;
+
+		TSTRING key(rec.keyLength, 0);
+		ResultCacheEntry e{ rec.size, rec.mtime, TSTRING(rec.resultsLength, 0) };
+		if (fread(&key[0], sizeof(TCHAR), rec.keyLength, fp) != rec.keyLength
+			|| (rec.resultsLength != 0 && fread(&e.results[0], sizeof(TCHAR), rec.resultsLength, fp) != rec.resultsLength))
+			break;
+
+		resultCache.emplace(key, std::move(e));
+	}
+
+	LogFile::Get()->Write(LogFile::HiScoreLogging,
+		_T("High score retrieval (init): loaded %d cached PINemHi results\n"), static_cast<int>(resultCache.size()));
+}
+
+void HighScores::SaveResultCache()
+{
+	CriticalSectionLocker lock(threadLock);
+
+	// if nothing has changed, there's nothing to save
+	if (!resultCacheDirty)
+		return;
+
+	// Write to a temporary file, then move it into place, so that a
+	// crash while writing can't leave a truncated cache file behind.
+	TCHAR path[MAX_PATH];
+	GetResultCacheFile(path);
+	TSTRING tmpFile = TSTRING(path) + _T(".tmp");
+	bool ok = false;
+	{
+		FILEPtrHolder fp;
+		if (_tfopen_s(&fp, tmpFile.c_str(), _T("wb")) == 0)
+		{
+			ResultCacheFileHeader hdr;
+			memcpy(hdr.signature, resultCacheSignature, sizeof(hdr.signature));
+			hdr.charSize = sizeof(TCHAR);
+			hdr.nEntries = static_cast<UINT32>(resultCache.size());
+			ok = fwrite(&hdr, sizeof(hdr), 1, fp) == 1;
+
+			for (auto it = resultCache.begin(); ok && it != resultCache.end(); ++it)
+			{
+				ResultCacheFileRecord rec;
+				rec.size = it->second.size;
+				rec.mtime = it->second.mtime;
+				rec.keyLength = static_cast<UINT32>(it->first.length());
+				rec.resultsLength = static_cast<UINT32>(it->second.results.length());
+				ok = fwrite(&rec, sizeof(rec), 1, fp) == 1
+					&& fwrite(it->first.c_str(), sizeof(TCHAR), rec.keyLength, fp) == rec.keyLength
+					&& fwrite(it->second.results.c_str(), sizeof(TCHAR), rec.resultsLength, fp) == rec.resultsLength;
+			}
+		}
+	}
+
+	// move the new file into place
+	if (ok && MoveFileEx(tmpFile.c_str(), path, MOVEFILE_REPLACE_EXISTING))
+		resultCacheDirty = false;
+	else
+		DeleteFile(tmpFile.c_str());
+}
+
 HighScores::NotifyInfo::NotifyInfo(QueryType queryType, GameListItem *game, NotifyContext *notifyContext) :
 	status(Success),
 	queryType(queryType),
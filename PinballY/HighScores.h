@@ -9,10 +9,16 @@
 // the little data files that VPinMAME uses to emulate non-volatile RAM 
 // for ROM-based games; for FP, it uses the equivalent that FP uses to
 // store settings for its scripted games.
+//
+// For the common VPinMAME ROM families, we can also read the scores
+// directly from the NVRAM files with our own decoder (see NVRAMDecoder.h),
+// which saves the cost of launching PINemHi.  We use the decoder for the
+// ROMs in its score map, and fall back on PINemHi for everything else.
 // 
 
 #pragma once
 #include "DiceCoefficient.h"
+#include "NVRAMDecoder.h"
 
 class ErrorHandler;
 class GameListItem;
@@ -127,6 +133,18 @@ public:
 	// guarantee that it will actually succeed.
 	bool GetVersion(HWND hwndNotify, NotifyContext *notifyContext = nullptr);
 
+	// Save the PINemHi result cache, if it has changed.  The application
+	// calls this at exit.
+	void SaveResultCache();
+
+	// Pre-scan a game's NVRAM file, to warm the result cache.  If the
+	// cached results for the game's NVRAM file are missing or stale,
+	// this queues a low-priority PINemHi query for it, with no
+	// notification, so that a later GetScores() request for the game
+	// can be answered from the cache.  Returns true if a query was
+	// queued.
+	bool Prescan(GameListItem *game);
+
 	// type of query
 	enum QueryType
 	{
@@ -168,7 +186,8 @@ public:
 		{
 			None,     // no source/not applicable
 			PINemHi,  // results from PINemHi process
-			File      // results from an ad hoc scores file
+			File,     // results from an ad hoc scores file
+			Decoder   // results from our in-process NVRAM decoder
 		} source = None;
 
 		// interpret the source code into a name string for Javascript
@@ -177,6 +196,7 @@ public:
 			return source == None ? _T("none") :
 				source == PINemHi ? _T("pinemhi") :
 				source == File ? _T("file") :
+				source == Decoder ? _T("nvram") :
 				_T("?");
 		}
 
@@ -194,8 +214,12 @@ protected:
 	// initialization is complete
 	bool inited;
 
-	// Try getting scores from the NVRAM file via PINemHi
-	bool GetScoresFromNVRAM(GameListItem *game, HWND hwndNotify, std::unique_ptr<NotifyContext> &notifyContext);
+	// Try getting scores from the NVRAM file, via our decoder if the
+	// ROM is in its score map, otherwise via PINemHi.  For a
+	// pre-scan, we skip the query if the cached results are fresh, and
+	// otherwise queue the query at low priority with no notification.
+	bool GetScoresFromNVRAM(GameListItem *game, HWND hwndNotify, std::unique_ptr<NotifyContext> &notifyContext,
+		bool prescan = false);
 
 	// Try getting scores from our own ad hoc scores file
 	bool GetScoresFromFile(GameListItem *game, HWND hwndNotify, std::unique_ptr<NotifyContext> &notifyContext);
@@ -240,6 +264,11 @@ protected:
 	PathEntry vpPath;
 	PathEntry fpPath;
 
+	// In-process NVRAM decoder.  The score map is loaded in the
+	// initializer thread, and is read-only after that, so the
+	// background threads can use it without locking.
+	NVRAMDecoder nvramDecoder;
+
 	// [romfind] mappings.  This is the table of mappings from
 	// "friendly" ROM names to NVRAM file names as listed in the
 	// PINemHi INI file.  We collect the table in case the user
@@ -262,15 +291,6 @@ protected:
 	// versions of the ROM.
 	struct FuzzyRomEntry
 	{
-		FuzzyRomEntry(const CHAR *title)
-		{
-			// pre-compute the bigram set from the title
-			DiceCoefficient::BuildBigramSet(bigrams, title);
-		}
-
-		// title bigram set for fuzzy matching
-		DiceCoefficient::BigramSet<CHAR> bigrams;
-
 		// list of associated .nv files
 		std::list<CSTRING> nvFiles;
 	};
@@ -278,9 +298,37 @@ protected:
 	// map of fuzzy-lookup ROM entries, keyed by title
 	std::unordered_map<CSTRING, FuzzyRomEntry> fuzzyRomFind;
 
+	// Bigram index over the fuzzy-lookup titles, for the Dice coefficient
+	// search.  fuzzyRomList gives the map entry for each index entry.
+	// These are built when we load the INI file.
+	DiceCoefficient::BigramIndex<CHAR> fuzzyRomIndex;
+	std::vector<const FuzzyRomEntry*> fuzzyRomList;
+
 	// Lock for resources accessed from the background thread
 	CriticalSection threadLock;
 
+	// PINemHi result cache.  Running PINemHi means launching a process,
+	// which takes long enough to make the scores visibly lag the wheel,
+	// so we keep the results from each NVRAM file, and reuse them for as
+	// long as the file's size and modification time are unchanged.  The
+	// cache is keyed by the lower-case full NVRAM file path, and it's
+	// saved across sessions in HighScoreResultCache.dat in the program
+	// folder.  Protected by threadLock.
+	struct ResultCacheEntry
+	{
+		UINT64 size;
+		FILETIME mtime;
+		TSTRING results;
+	};
+	std::unordered_map<TSTRING, ResultCacheEntry> resultCache;
+	bool resultCacheDirty = false;
+
+	// load the result cache; called from the initializer thread
+	void LoadResultCache();
+
+	// get the result cache file name
+	static void GetResultCacheFile(TCHAR path[MAX_PATH]);
+
 	// Base class for our background threads
 	class Thread
 	{
@@ -300,6 +348,21 @@ protected:
 		static DWORD WINAPI SMain(LPVOID param);
 		virtual void Main() = 0;
 
+		// Does this thread run PINemHi?  Does it need to rewrite the
+		// PINemHi.ini file first?  The dispatcher uses these to decide
+		// which threads can run concurrently.  Called with threadLock
+		// held.
+		virtual bool UsesPINemHi() const { return false; }
+		virtual bool NeedsIniUpdate() const { return false; }
+
+		// Is the thread running with exclusive use of PINemHi?  This is
+		// set by the dispatcher for a thread that rewrites the INI file.
+		bool exclusive = false;
+
+		// Is this a pre-scan query?  Pre-scan queries run at low priority
+		// behind all other requests, and don't send notifications.
+		bool prescan = false;
+
 		// high scores object
 		RefPtr<HighScores> hs;
 
@@ -331,9 +394,18 @@ protected:
 		// main entrypoint
 		virtual void Main() override;
 
+		virtual bool UsesPINemHi() const override { return true; }
+		virtual bool NeedsIniUpdate() const override;
+
 		// Command line to send to PINemHi
 		TSTRING cmdline;
 
+		// Result cache key and NVRAM file attributes, for caching the
+		// results.  The key is empty if the results can't be cached.
+		TSTRING cacheKey;
+		UINT64 nvramSize = 0;
+		FILETIME nvramTime = { 0, 0 };
+
 		// NVRAM path and filename
 		TSTRING nvramPath;
 		TSTRING nvramFile;
@@ -344,6 +416,27 @@ protected:
 		PathEntry *pathEntry;
 	};
 
+	// Background thread to decode the NVRAM file with our in-process
+	// decoder.  This holds a PINemHi thread for the same query as the
+	// fallback: if the decoder can't make sense of the file, we queue
+	// the PINemHi thread instead of sending a result.  The fallback
+	// thread owns the notification context.
+	class DecoderThread : public Thread
+	{
+	public:
+		DecoderThread(HighScores *hs, NVRAMThread *fallback) :
+			Thread(hs, HighScoreQuery, fallback->game, fallback->hwndNotify, nullptr),
+			fallback(fallback)
+		{
+		}
+
+		// main entrypoint
+		virtual void Main() override;
+
+		// PINemHi thread to run if the decoder fails
+		std::unique_ptr<NVRAMThread> fallback;
+	};
+
 	// Background thread to read our ad hoc scores file
 	class FileThread : public Thread
 	{
@@ -362,16 +455,43 @@ protected:
 		TSTRING filename;
 	};
 
+	// Background thread to deliver cached PINemHi results.  The results
+	// are ready immediately, but the caller expects the asynchronous
+	// notification, so we deliver them the same way as a live query.
+	class CachedResultThread : public Thread
+	{
+	public:
+		CachedResultThread(HighScores *hs, GameListItem *game,
+			HWND hwndNotify, NotifyContext *ctx, const TSTRING &results) :
+			Thread(hs, HighScoreQuery, game, hwndNotify, ctx),
+			results(results)
+		{
+		}
+
+		// main entrypoint
+		virtual void Main() override;
+
+		// cached results
+		TSTRING results;
+	};
+
 	// Enqueue a thread
 	void EnqueueThread(Thread *thread);
 
 	// launch the next thread
 	void LaunchNextThread(Thread *exitingThread = nullptr);
 
-	// To simplify concurrent issues in our background threads,
-	// we only run one thread a time.  We queue pending threads
-	// here.  When one thread is about to exit, it launches the
-	// next one from the queue.
+	// Pending threads.  We run up to maxConcurrentThreads at a time,
+	// in queue order, and each thread launches the next ones from the
+	// queue as it exits.  PINemHi reads its NVRAM paths from its .ini
+	// file, which is a global resource, so a thread that has to rewrite
+	// the file runs alone: it waits for the running PINemHi threads to
+	// finish, and holds up the ones behind it until it's done.  Threads
+	// that can use the file as it stands run concurrently.
 	std::list<Thread*> threadQueue;
+	static const int maxConcurrentThreads = 3;
+	int nRunningThreads = 0;
+	int nRunningPINemHi = 0;
+	bool exclusiveRunning = false;
 };
 
@@ -71,6 +71,13 @@ struct PixelInputType
 	float3 normal : NORMAL;
 };
 
+// YUV to RGB conversion matrix, for offset Y'U'V' values (see below)
+static const float3x3 YUVToRGB = {
+	1.164f,  0.000f,  1.596f,
+	1.164f, -0.391f, -0.813f,
+	1.164f,  2.018f,  0.000f
+};
+
 float4 main(PixelInputType input) : SV_TARGET
 {
 	// The standard YUV to RGB conversion formula, for 8-bit (0..255)
@@ -85,29 +92,28 @@ float4 main(PixelInputType input) : SV_TARGET
 	//  B = Y' + 2.018*U'
 	//  
 	// The final R, G, and B values must be clamped to the 0..255 range.
+	//
+	// We work directly in the normalized 0..1 range that the texture
+	// samples come in, rather than scaling to 0..255 and back, so the
+	// offsets are scaled to match, and the conversion reduces to one
+	// matrix multiply plus a saturate.  The three planes are separate
+	// shader resource views, so we sample one value from each view.
+	// The texture coordinates are the same in each view, even though
+	// the U and V planes are half the width and height of the Y plane,
+	// because input.tex uses normalized 0..1 coordinates that are
+	// independent of the texture dimensions.
+	float3 YUV = float3(
+		YTexture.Sample(SampleType, input.tex).r,
+		UTexture.Sample(SampleType, input.tex).r,
+		VTexture.Sample(SampleType, input.tex).r)
+		- float3(16.0f/255.0f, 128.0f/255.0f, 128.0f/255.0f);
+	float3 RGB = saturate(mul(YUVToRGB, YUV));
 
-	// Get Y', U', V', converting from normalized 0..1 range to 0..255.
-	// The three planes are represented as separate shader resource views,
-	// so we sample one value from each view.  The texture coordinates are
-	// the same in each view, even though the U and V planes are half the
-	// width and height of the Y plane, because input.tex uses normalized
-	// 0..1 coordinates that are independent of the texture dimensions.
-	float Y = 1.164f * ((YTexture.Sample(SampleType, input.tex).r * 255.0f) - 16.0f);
-	float U = (UTexture.Sample(SampleType, input.tex).r * 255.0f) - 128.0f;
-	float V = (VTexture.Sample(SampleType, input.tex).r * 255.0f) - 128.0f;
-
-	// Get the A (alpha) value.  No conversion is necessary, as YUVA alpha
-	// is interpreted the same way as RGBA alpha.
-	float A = ATexture.Sample(SampleType, input.tex).r;
-
-	// Figure the RGB conversion, converting the final result back to
-	// the normalized 0..1 range.
-	float4 RGBA = float4(
-		clamp(Y + 1.596f*V, 0, 255.0f) / 255.0f,
-		clamp(Y - 0.813f*V - 0.391f*U, 0, 255.0f) / 255.0f,
-		clamp(Y + 2.018f*U, 0, 255.0f) / 255.0f,
-		clamp(A * alpha, 0, 1));
+	// Get the A (alpha) value and apply the global alpha.  No conversion
+	// is necessary, as YUVA alpha is interpreted the same way as RGBA
+	// alpha.
+	float A = saturate(ATexture.Sample(SampleType, input.tex).r * alpha);
 
-	// return the RGB result
-	return RGBA;
+	// Return the color with premultiplied alpha, to match our blend state
+	return float4(RGB * A, A);
 }
@@ -13,6 +13,7 @@
 #include "shaders/I420ShaderPS.h"
 #include "shaders/I420AShaderPS.h"
 #include "shaders/I444A10ShaderPS.h"
+#include "shaders/NV12ShaderPS.h"
 
 using namespace DirectX;
 
@@ -24,6 +25,12 @@ I420Shader::~I420Shader()
 {
 }
 
+void I420Shader::ReleaseDeviceObjects()
+{
+	cbAlpha = nullptr;
+	__super::ReleaseDeviceObjects();
+}
+
 bool I420Shader::CommonInit(const BYTE *pixelShaderBytes, size_t pixelShaderBytesCnt, const char *idForErrorLog)
 {
 	D3D *d3d = D3D::Get();
@@ -106,6 +113,12 @@ bool I420AShader::Init()
 	return CommonInit(g_psI420AShader, sizeof(g_psI420AShader), "I420AShader");
 }
 
+// NV12 variant
+bool NV12Shader::Init()
+{
+	return CommonInit(g_psNV12Shader, sizeof(g_psNV12Shader), "NV12Shader");
+}
+
 // I444A10 variant
 bool I444A10Shader::Init()
 {
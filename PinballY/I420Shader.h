@@ -18,6 +18,13 @@
 // channel (per-pixel transparency).  The fourth plane is identical
 // to the Y plane (8 bits per pixel).
 //
+// The NV12 shader is another 4:2:0 variation, with the U and V samples
+// interleaved into a single plane, as produced by hardware decoders.
+// It takes two textures: the Y plane in R8_UNORM format, and the U:V
+// plane in R8G8_UNORM format, half the width and height of the Y plane.
+// The same shader handles 10-bit P010 data, using R16_UNORM and
+// R16G16_UNORM textures for the two planes.
+//
 // Note that D3D DXGI 11.1 has native support for YUV formats.  We
 // explicitly and intentionally DO NOT use any of the native DXGI
 // YUV support, because it only exists in 11.1 and later, which
@@ -71,6 +78,8 @@ public:
 	void SetAlpha(float alpha) override;
 
 protected:
+	void ReleaseDeviceObjects() override;
+
 	// common initialization
 	bool CommonInit(const BYTE *pixelShaderBytes, size_t pixelShaderBytesCnt, const char *idForErrorLog);
 
@@ -99,6 +108,16 @@ public:
 protected:
 };
 
+// NV12 shader (YUV 4:2:0, with interleaved U:V plane)
+class NV12Shader : public I420Shader
+{
+public:
+	virtual const char *ID() const { return "NV12Shader"; }
+	virtual bool Init();
+
+protected:
+};
+
 // YUVA 4:4:4:4 10-bit shader (YUV with Alpha, 10-bit pixels)
 class I444A10Shader : public I420Shader
 {
@@ -102,6 +102,9 @@ float4 main(PixelInputType input) : SV_TARGET
 		clamp(Y + 2.018f*U, 0, 255.0f) / 255.0f,
 		alpha);
 
+	// premultiply the alpha, to match our blend state
+	RGBA.xyz *= alpha;
+
 	// return the RGB result
 	return RGBA;
 }
@@ -45,6 +45,13 @@ struct PixelInputType
 	float3 normal : NORMAL;
 };
 
+// YUV to RGB conversion matrix, for offset Y'U'V' values (see below)
+static const float3x3 YUVToRGB = {
+	1.164f,  0.000f,  1.596f,
+	1.164f, -0.391f, -0.813f,
+	1.164f,  2.018f,  0.000f
+};
+
 float4 main(PixelInputType input) : SV_TARGET
 {
 	// The standard YUV to RGB conversion formula, for 8-bit (0..255)
@@ -59,33 +66,26 @@ float4 main(PixelInputType input) : SV_TARGET
 	//  B = Y' + 2.018*U'
 	//  
 	// The final R, G, and B values must be clamped to the 0..255 range.
-
-	// Get Y', U', V', converting from normalized 0..1 range to 0..255.
-	// The three planes are represented as separate shader resource views,
-	// so we sample one value from each view.  The texture coordinates are
-	// the same in each view, even though the U and V planes are half the
-	// width and height of the Y plane, because input.tex uses normalized
-	// 0..1 coordinates that are independent of the texture dimensions.
+	//
+	// As in the 8-bit YUVA shader, we work in the normalized 0..1 range
+	// with scaled offsets, so the conversion is one matrix multiply plus
+	// a saturate.
 	//
 	// Remember that we have to renormalize the samples from the 65535.0f
 	// normalization demoninator that DXGI used when passing us the buffer
 	// to the 1023.0f (10 bit) scale that the original video data uses.
-	float Y = 1.164f * ((YTexture.Sample(SampleType, input.tex).r * 255.0f * 64.0f) - 16.0f);
-	float U = (UTexture.Sample(SampleType, input.tex).r * 255.0f * 64.0f) - 128.0f;
-	float V = (VTexture.Sample(SampleType, input.tex).r * 255.0f * 64.0f) - 128.0f;
-
-	// Get the A (alpha) value.  No conversion is necessary, other than the 
-	// same renormalization we apply to the color channels.
-	float A = ATexture.Sample(SampleType, input.tex).r * 64.0f;
+	float3 YUV = float3(
+		YTexture.Sample(SampleType, input.tex).r,
+		UTexture.Sample(SampleType, input.tex).r,
+		VTexture.Sample(SampleType, input.tex).r) * 64.0f
+		- float3(16.0f/255.0f, 128.0f/255.0f, 128.0f/255.0f);
+	float3 RGB = saturate(mul(YUVToRGB, YUV));
 
-	// Figure the RGB conversion, converting the final result back to
-	// the normalized 0..1 range.
-	float4 RGBA = float4(
-		clamp(Y + 1.596f*V, 0, 255.0f) / 255.0f,
-		clamp(Y - 0.813f*V - 0.391f*U, 0, 255.0f) / 255.0f,
-		clamp(Y + 2.018f*U, 0, 255.0f) / 255.0f,
-		clamp(A * alpha, 0, 1));
+	// Get the A (alpha) value and apply the global alpha.  No conversion
+	// is necessary, other than the same renormalization we apply to the
+	// color channels.
+	float A = saturate(ATexture.Sample(SampleType, input.tex).r * 64.0f * alpha);
 
-	// return the RGB result
-	return RGBA;
+	// Return the color with premultiplied alpha, to match our blend state
+	return float4(RGB * A, A);
 }
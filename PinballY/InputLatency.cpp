@@ -0,0 +1,133 @@
+// This file is part of PinballY
+// Copyright 2018 Michael J Roberts | GPL v3 or later | NO WARRANTY
+//
+// Input latency instrumentation
+
+#include "stdafx.h"
+#include "InputLatency.h"
+#include "LogFile.h"
+#include "Benchmark.h"
+#include "../Utilities/InputManager.h"
+
+// statics
+HiResTimer InputLatency::timer;
+std::vector<InputLatency::Pending> InputLatency::pending;
+InputLatency::Sample InputLatency::samples[InputLatency::maxSamples];
+int InputLatency::nSamples = 0;
+int InputLatency::nextSample = 0;
+
+int64_t InputLatency::GetArrivalTime()
+{
+	// if we're in raw input processing, use the raw input event time
+	auto im = InputManager::GetInstance();
+	if (int64_t t = im->GetRawInputEventTime(); t != 0)
+		return t;
+
+	// Use the last keyboard input time if it's within the last quarter
+	// second.  Anything older isn't the raw input for the current key.
+	int64_t now = timer.GetTime_ticks();
+	if (int64_t t = im->GetLastKeyboardInputTime(); t != 0 && now - t < static_cast<int64_t>(0.25 / timer.GetTickTime_sec()))
+		return t;
+
+	// otherwise, use the current time
+	return now;
+}
+
+void InputLatency::AddPending(const Pending &p)
+{
+	// The caller requests a frame in the window along with the sample,
+	// so samples are normally completed promptly, but rendering can
+	// stall (while the window is hidden, say).  Cap the list so that
+	// stale entries can't accumulate.
+	if (pending.size() >= 64)
+		pending.erase(pending.begin());
+
+	pending.push_back(p);
+}
+
+void InputLatency::OnPresent(HWND hwnd)
+{
+	// complete the samples for this window
+	int64_t now = timer.GetTime_ticks();
+	double tick_ms = timer.GetTickTime_sec() * 1000.0;
+	for (auto it = pending.begin(); it != pending.end(); )
+	{
+		if (it->hwnd == hwnd)
+		{
+			// figure the stage times
+			Sample &s = samples[nextSample];
+			float cmdTotal_ms = static_cast<float>((it->handled - it->dequeue) * tick_ms);
+			s.queue_ms = static_cast<float>((it->dequeue - it->arrival) * tick_ms);
+			s.media_ms = static_cast<float>(it->mediaTicks * tick_ms);
+			s.command_ms = max(cmdTotal_ms - s.media_ms, 0.0f);
+			s.render_ms = static_cast<float>((now - it->handled) * tick_ms);
+			s.total_ms = static_cast<float>((now - it->arrival) * tick_ms);
+
+			// add it to the session benchmark, if one is running
+			if (Benchmark::IsSessionRunning())
+				Benchmark::OnInputLatency(s.total_ms);
+
+			// advance the ring
+			nextSample = (nextSample + 1) % maxSamples;
+			nSamples = min(nSamples + 1, maxSamples);
+
+			// this sample is done
+			it = pending.erase(it);
+		}
+		else
+			++it;
+	}
+}
+
+void InputLatency::GetStats(Stats &stats)
+{
+	stats.nSamples = nSamples;
+
+	// get the values for one field of the samples, sorted
+	std::vector<float> v;
+	auto Sorted = [&v](float Sample::*field)
+	{
+		v.clear();
+		for (int i = 0; i < nSamples; ++i)
+			v.push_back(samples[i].*field);
+		std::sort(v.begin(), v.end());
+	};
+	auto Pct = [&v](float pct) -> float
+	{
+		if (v.size() == 0)
+			return 0.0f;
+		size_t i = static_cast<size_t>(ceil(v.size() * pct / 100.0f));
+		return v[i == 0 ? 0 : min(i, v.size()) - 1];
+	};
+	auto GetStage = [&Sorted, &Pct](Stats::Stage &stage, float Sample::*field)
+	{
+		Sorted(field);
+		stage.p50_ms = Pct(50.0f);
+		stage.p95_ms = Pct(95.0f);
+	};
+
+	// total latency
+	Sorted(&Sample::total_ms);
+	stats.p50_ms = Pct(50.0f);
+	stats.p95_ms = Pct(95.0f);
+	stats.p99_ms = Pct(99.0f);
+	stats.max_ms = v.size() != 0 ? v.back() : 0.0f;
+
+	// stages
+	GetStage(stats.queue, &Sample::queue_ms);
+	GetStage(stats.command, &Sample::command_ms);
+	GetStage(stats.media, &Sample::media_ms);
+	GetStage(stats.render, &Sample::render_ms);
+}
+
+void InputLatency::LogStats()
+{
+	Stats s;
+	GetStats(s);
+	LogFile::Get()->Write(
+		_T("Input latency: %d samples, p50 %.2fms, p95 %.2fms, p99 %.2fms, max %.2fms; ")
+		_T("p50/p95 by stage: queue %.2f/%.2f, command %.2f/%.2f, media %.2f/%.2f, render %.2f/%.2f\n"),
+		s.nSamples, s.p50_ms, s.p95_ms, s.p99_ms, s.max_ms,
+		s.queue.p50_ms, s.queue.p95_ms, s.command.p50_ms, s.command.p95_ms,
+		s.media.p50_ms, s.media.p95_ms, s.render.p50_ms, s.render.p95_ms);
+}
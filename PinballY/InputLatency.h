@@ -0,0 +1,110 @@
+// This file is part of PinballY
+// Copyright 2018 Michael J Roberts | GPL v3 or later | NO WARRANTY
+//
+// Input latency instrumentation
+//
+// This measures the time from the arrival of a button press to the
+// first frame presented in the window that processed the command, so
+// that we can quantify complaints about a "laggy" feel.  Each sample
+// is broken down by stage:
+//
+//   queue    - arrival at the input manager to removal from the key
+//              queue (this includes time waiting for an animation to
+//              finish, since key processing is deferred during animations)
+//   command  - running the command handler, excluding media loading
+//   media    - selection updates (UpdateSelection) during the command,
+//              which is where the new game's media gets loaded
+//   render   - end of command handling to the next Present() in the
+//              window
+//
+// Only initial key presses with the application in the foreground are
+// measured; auto-repeats are generated by our own timers, and commands
+// processed in the background don't render anything.
+//
+// All of this runs on the UI thread.
+
+#pragma once
+#include "HiResTimer.h"
+
+class InputLatency
+{
+public:
+	// get the current time, in HiResTimer ticks
+	static int64_t Now() { return timer.GetTime_ticks(); }
+
+	// Get the arrival time of the input event being processed.  This
+	// uses the input manager's raw input timestamp when called from raw
+	// input processing (as for joystick buttons), or the last raw
+	// keyboard input time if it's recent (for WM_KEYDOWN messages, which
+	// follow the raw input for the same key), otherwise the current time.
+	static int64_t GetArrivalTime();
+
+	// Pending sample, for a command that's been handled but not yet
+	// presented.  Times are in HiResTimer ticks.
+	struct Pending
+	{
+		HWND hwnd;              // window that processed the command
+		int64_t arrival;        // input event arrival
+		int64_t dequeue;        // removed from the key queue
+		int64_t handled;        // command handler finished
+		int64_t mediaTicks;     // time spent in selection updates during the command
+	};
+
+	// Add a pending sample.  The sample is completed on the next
+	// OnPresent() for the same window.  The caller should make sure
+	// that the window renders a new frame, even when damage tracking
+	// finds nothing changed, so that a command with no visible effect
+	// doesn't wait for some later, unrelated frame.
+	static void AddPending(const Pending &p);
+
+	// Are any samples pending?
+	static bool IsPending() { return pending.size() != 0; }
+
+	// Note a frame presentation in the given window.  This completes
+	// the pending samples for the window.
+	static void OnPresent(HWND hwnd);
+
+	// Latency statistics, in milliseconds, over the recent samples
+	struct Stats
+	{
+		int nSamples;           // number of samples included
+		float p50_ms;           // total latency percentiles
+		float p95_ms;
+		float p99_ms;
+		float max_ms;
+
+		// per-stage median and 95th percentile
+		struct Stage { float p50_ms; float p95_ms; };
+		Stage queue;
+		Stage command;
+		Stage media;
+		Stage render;
+	};
+	static void GetStats(Stats &stats);
+
+	// write the statistics to the log file
+	static void LogStats();
+
+protected:
+	// timer
+	static HiResTimer timer;
+
+	// pending samples
+	static std::vector<Pending> pending;
+
+	// Completed samples, in milliseconds.  This is a ring of the most
+	// recent samples, so the statistics reflect recent behavior rather
+	// than the whole session.
+	struct Sample
+	{
+		float queue_ms;
+		float command_ms;
+		float media_ms;
+		float render_ms;
+		float total_ms;
+	};
+	static const int maxSamples = 256;
+	static Sample samples[maxSamples];
+	static int nSamples;
+	static int nextSample;
+};
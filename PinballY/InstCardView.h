@@ -44,7 +44,7 @@ protected:
 	virtual const TCHAR *ShowWhenRunningWindowId() const override { return _T("instcard"); }
 
 	// ConfigManager::Subscriber implementation
-	virtual void OnConfigReload() override { OnConfigChange(); }
+	virtual void OnConfigReload(const ConfigManager::ChangeSet &) override { OnConfigChange(); }
 	void OnConfigChange();
 
 	// are SWF files enabled?
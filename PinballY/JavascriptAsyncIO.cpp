@@ -0,0 +1,517 @@
+// This file is part of PinballY
+// Copyright 2018 Michael J Roberts | GPL v3 or later | NO WARRANTY
+//
+// Javascript asynchronous I/O
+
+#include "stdafx.h"
+#include "../Utilities/FileUtil.h"
+#include "../Utilities/DateUtil.h"
+#include "JavascriptAsyncIO.h"
+#include "LogFile.h"
+
+#pragma comment(lib, "winhttp.lib")
+
+JavascriptAsyncIO::JavascriptAsyncIO(HWND hwndNotify, UINT notifyMsg) :
+	hwndNotify(hwndNotify),
+	notifyMsg(notifyMsg)
+{
+	// set up our thread pool environment, with a cleanup group so that
+	// we can wait for outstanding work at shutdown
+	InitializeThreadpoolEnvironment(&tpEnv);
+	if ((tpCleanupGroup = CreateThreadpoolCleanupGroup()) != NULL)
+		SetThreadpoolCallbackCleanupGroup(&tpEnv, tpCleanupGroup, nullptr);
+}
+
+JavascriptAsyncIO::~JavascriptAsyncIO()
+{
+	// cancel everything outstanding
+	for (auto &r : requests)
+		r.second->Cancel();
+
+	// wait for the pool threads to finish
+	if (tpCleanupGroup != NULL)
+	{
+		CloseThreadpoolCleanupGroupMembers(tpCleanupGroup, FALSE, nullptr);
+		CloseThreadpoolCleanupGroup(tpCleanupGroup);
+	}
+	DestroyThreadpoolEnvironment(&tpEnv);
+
+	// Discard the requests.  This releases their Promises; we don't
+	// bother settling them, since the Javascript session is ending.
+	requests.clear();
+}
+
+JsValueRef JavascriptAsyncIO::Submit(Request *request)
+{
+	// take ownership of the request
+	std::unique_ptr<Request> req(request);
+
+	// create the Promise
+	req->promise.reset(JavascriptEngine::Promise::Create());
+	JsValueRef jspromise = req->promise->GetPromise();
+
+	// assign the ID, and record it on the promise object for cancel()
+	req->id = nextId++;
+	JavascriptEngine::JsObj(jspromise).Set("requestId", req->id);
+
+	// queue the work item
+	auto ctx = new WorkContext{ this, req.get() };
+	if (tpCleanupGroup == NULL || !TrySubmitThreadpoolCallback(&WorkCallback, ctx, &tpEnv))
+	{
+		delete ctx;
+		req->promise->Reject(L"unable to queue the I/O request");
+		return jspromise;
+	}
+
+	// add it to the outstanding list
+	requests.emplace(req->id, std::move(req));
+	return jspromise;
+}
+
+bool JavascriptAsyncIO::Cancel(int id)
+{
+	if (auto it = requests.find(id); it != requests.end())
+	{
+		it->second->Cancel();
+		return true;
+	}
+	return false;
+}
+
+void CALLBACK JavascriptAsyncIO::WorkCallback(PTP_CALLBACK_INSTANCE, PVOID context)
+{
+	// recover the context
+	std::unique_ptr<WorkContext> ctx(static_cast<WorkContext*>(context));
+	auto self = ctx->self;
+	auto req = ctx->request;
+
+	// do the work, unless the request was canceled before we got here
+	if (!req->canceled)
+		req->Run();
+
+	// add it to the completed list, and notify the main window if the
+	// list was empty (the handler collects everything on the list, so
+	// one notification suffices for a batch)
+	CriticalSectionLocker locker(self->lock);
+	bool notify = self->completed.size() == 0;
+	self->completed.push_back(req->id);
+	if (notify)
+		PostMessage(self->hwndNotify, self->notifyMsg, 0, 0);
+}
+
+void JavascriptAsyncIO::OnCompletions()
+{
+	// take the completed list
+	std::list<int> ids;
+	{
+		CriticalSectionLocker locker(lock);
+		ids.swap(completed);
+	}
+
+	// settle each request's promise
+	for (auto id : ids)
+	{
+		auto it = requests.find(id);
+		if (it == requests.end())
+			continue;
+
+		// take the request out of the active list
+		std::unique_ptr<Request> req(std::move(it->second));
+		requests.erase(it);
+
+		try
+		{
+			if (req->canceled)
+				req->promise->Reject(L"canceled");
+			else if (req->error.length() != 0)
+				req->promise->Reject(req->error.c_str());
+			else
+				req->promise->Resolve(req->GetResult());
+		}
+		catch (JavascriptEngine::CallException exc)
+		{
+			exc.Log(_T("asyncIO request completion"));
+		}
+	}
+}
+
+void JavascriptAsyncIO::JsToBytes(std::vector<BYTE> &bytes, JsValueRef val)
+{
+	bytes.clear();
+	if (JavascriptEngine::IsUndefinedOrNull(val))
+		return;
+
+	JsErrorCode err;
+	JsValueType type;
+	if ((err = JsGetValueType(val, &type)) != JsNoError)
+		throw JavascriptEngine::CallException("asyncIO: getting data type", err);
+
+	BYTE *p = nullptr;
+	unsigned int len = 0;
+	if (type == JsArrayBuffer)
+	{
+		if ((err = JsGetArrayBufferStorage(val, &p, &len)) != JsNoError)
+			throw JavascriptEngine::CallException("asyncIO: getting ArrayBuffer data", err);
+		bytes.assign(p, p + len);
+	}
+	else if (type == JsTypedArray || type == JsDataView)
+	{
+		JsTypedArrayType arrayType;
+		int elementSize;
+		if (type == JsTypedArray)
+			err = JsGetTypedArrayStorage(val, &p, &len, &arrayType, &elementSize);
+		else
+			err = JsGetDataViewStorage(val, &p, &len);
+		if (err != JsNoError)
+			throw JavascriptEngine::CallException("asyncIO: getting typed array data", err);
+		bytes.assign(p, p + len);
+	}
+	else
+	{
+		// convert anything else to string, and encode it as UTF-8
+		WSTRING s = JavascriptEngine::JsToNative<WSTRING>(val);
+		int n = WideCharToMultiByte(CP_UTF8, 0, s.c_str(), static_cast<int>(s.length()), NULL, 0, NULL, NULL);
+		bytes.resize(n);
+		if (n != 0)
+			WideCharToMultiByte(CP_UTF8, 0, s.c_str(), static_cast<int>(s.length()), reinterpret_cast<char*>(bytes.data()), n, NULL, NULL);
+	}
+}
+
+JsValueRef JavascriptAsyncIO::CreateArrayBuffer(const std::vector<BYTE> &bytes)
+{
+	JsErrorCode err;
+	JsValueRef buf;
+	BYTE *p;
+	unsigned int len;
+	if ((err = JsCreateArrayBuffer(static_cast<unsigned int>(bytes.size()), &buf)) != JsNoError
+		|| (err = JsGetArrayBufferStorage(buf, &p, &len)) != JsNoError)
+		throw JavascriptEngine::CallException("asyncIO: creating ArrayBuffer", err);
+
+	if (bytes.size() != 0)
+		memcpy(p, bytes.data(), bytes.size());
+	return buf;
+}
+
+WSTRING JavascriptAsyncIO::DecodeText(const std::vector<BYTE> &bytes)
+{
+	const BYTE *p = bytes.data();
+	size_t len = bytes.size();
+
+	// check for a UTF-16 little-endian byte order mark
+	if (len >= 2 && p[0] == 0xFF && p[1] == 0xFE)
+		return WSTRING(reinterpret_cast<const WCHAR*>(p + 2), (len - 2) / sizeof(WCHAR));
+
+	// skip a UTF-8 byte order mark
+	if (len >= 3 && p[0] == 0xEF && p[1] == 0xBB && p[2] == 0xBF)
+		p += 3, len -= 3;
+
+	// try decoding as UTF-8; if that fails, use the ANSI code page
+	UINT codePage = CP_UTF8;
+	DWORD flags = MB_ERR_INVALID_CHARS;
+	int n = MultiByteToWideChar(codePage, flags, reinterpret_cast<const char*>(p), static_cast<int>(len), NULL, 0);
+	if (n == 0 && len != 0)
+	{
+		codePage = CP_ACP;
+		flags = 0;
+		n = MultiByteToWideChar(codePage, flags, reinterpret_cast<const char*>(p), static_cast<int>(len), NULL, 0);
+	}
+
+	WSTRING s;
+	s.resize(n);
+	if (n != 0)
+		MultiByteToWideChar(codePage, flags, reinterpret_cast<const char*>(p), static_cast<int>(len), &s[0], n);
+	return s;
+}
+
+// -----------------------------------------------------------------------
+//
+// Read file
+//
+
+void JavascriptAsyncIO::ReadFileRequest::Run()
+{
+	// open the file
+	HandleHolder hFile = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL,
+		OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (hFile == INVALID_HANDLE_VALUE)
+	{
+		WindowsErrorMessage winErr;
+		error = MsgFmt(_T("readFile: unable to open %ws: %s"), path.c_str(), winErr.Get()).Get();
+		return;
+	}
+
+	// check the size against the limit
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(hFile, &size))
+	{
+		WindowsErrorMessage winErr;
+		error = MsgFmt(_T("readFile: unable to get the size of %ws: %s"), path.c_str(), winErr.Get()).Get();
+		return;
+	}
+	if (static_cast<UINT64>(size.QuadPart) > maxSize)
+	{
+		error = MsgFmt(_T("readFile: %ws is larger than the maximum size (%I64d bytes)"), path.c_str(), static_cast<INT64>(maxSize)).Get();
+		return;
+	}
+
+	// read it in blocks, checking for cancellation between blocks
+	data.resize(static_cast<size_t>(size.QuadPart));
+	size_t ofs = 0;
+	while (ofs < data.size() && !canceled)
+	{
+		DWORD want = static_cast<DWORD>(min(data.size() - ofs, static_cast<size_t>(256 * 1024)));
+		DWORD actual;
+		if (!ReadFile(hFile, data.data() + ofs, want, &actual, NULL))
+		{
+			WindowsErrorMessage winErr;
+			error = MsgFmt(_T("readFile: error reading %ws: %s"), path.c_str(), winErr.Get()).Get();
+			return;
+		}
+
+		// stop at EOF, in case the file shrank since we checked the size
+		if (actual == 0)
+			break;
+		ofs += actual;
+	}
+	data.resize(ofs);
+}
+
+JsValueRef JavascriptAsyncIO::ReadFileRequest::GetResult()
+{
+	return binary ? CreateArrayBuffer(data) : JavascriptEngine::NativeToJs(DecodeText(data));
+}
+
+// -----------------------------------------------------------------------
+//
+// Write file
+//
+
+void JavascriptAsyncIO::WriteFileRequest::Run()
+{
+	// open the file
+	HandleHolder hFile = CreateFileW(path.c_str(), append ? FILE_APPEND_DATA : GENERIC_WRITE, 0, NULL,
+		append ? OPEN_ALWAYS : CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (hFile == INVALID_HANDLE_VALUE)
+	{
+		WindowsErrorMessage winErr;
+		error = MsgFmt(_T("writeFile: unable to open %ws: %s"), path.c_str(), winErr.Get()).Get();
+		return;
+	}
+
+	// write it in blocks, checking for cancellation between blocks
+	size_t ofs = 0;
+	while (ofs < data.size() && !canceled)
+	{
+		DWORD want = static_cast<DWORD>(min(data.size() - ofs, static_cast<size_t>(256 * 1024)));
+		DWORD actual;
+		if (!WriteFile(hFile, data.data() + ofs, want, &actual, NULL))
+		{
+			WindowsErrorMessage winErr;
+			error = MsgFmt(_T("writeFile: error writing %ws: %s"), path.c_str(), winErr.Get()).Get();
+			return;
+		}
+		ofs += actual;
+	}
+}
+
+JsValueRef JavascriptAsyncIO::WriteFileRequest::GetResult()
+{
+	return JavascriptEngine::Get()->GetUndefVal();
+}
+
+// -----------------------------------------------------------------------
+//
+// List directory
+//
+
+void JavascriptAsyncIO::ListDirRequest::Run()
+{
+	WSTRING pattern = path + L"\\*";
+	WIN32_FIND_DATAW fd;
+	HANDLE hFind = FindFirstFileExW(pattern.c_str(), FindExInfoBasic, &fd, FindExSearchNameMatch, NULL, FIND_FIRST_EX_LARGE_FETCH);
+	if (hFind == INVALID_HANDLE_VALUE)
+	{
+		// an empty directory isn't an error
+		DWORD err = GetLastError();
+		if (err != ERROR_FILE_NOT_FOUND)
+			error = MsgFmt(_T("listDir: unable to read %ws: %s"), path.c_str(), WindowsErrorMessage(err).Get()).Get();
+		return;
+	}
+
+	do
+	{
+		// skip the "." and ".." entries
+		if (wcscmp(fd.cFileName, L".") == 0 || wcscmp(fd.cFileName, L"..") == 0)
+			continue;
+
+		entries.push_back({
+			fd.cFileName,
+			(fd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0,
+			(static_cast<UINT64>(fd.nFileSizeHigh) << 32) | fd.nFileSizeLow,
+			fd.ftLastWriteTime });
+	} while (!canceled && FindNextFileW(hFind, &fd));
+
+	FindClose(hFind);
+}
+
+JsValueRef JavascriptAsyncIO::ListDirRequest::GetResult()
+{
+	auto arr = JavascriptEngine::JsObj::CreateArray();
+	for (auto &e : entries)
+	{
+		auto obj = JavascriptEngine::JsObj::CreateObject();
+		obj.Set("name", e.name);
+		obj.Set("isDirectory", e.isDirectory);
+		obj.Set("size", static_cast<double>(e.size));
+		obj.Set("modified", DateTime(e.modified));
+		arr.Push(obj);
+	}
+	return arr.jsobj;
+}
+
+// -----------------------------------------------------------------------
+//
+// HTTP request
+//
+
+JavascriptAsyncIO::HttpRequest::~HttpRequest()
+{
+	if (hRequest != NULL)
+		WinHttpCloseHandle(hRequest);
+	if (hConnect != NULL)
+		WinHttpCloseHandle(hConnect);
+	if (hSession != NULL)
+		WinHttpCloseHandle(hSession);
+}
+
+void JavascriptAsyncIO::HttpRequest::Cancel()
+{
+	// set the cancel flag
+	Request::Cancel();
+
+	// Close the request handle.  This makes any WinHttp call blocked on
+	// the handle in the pool thread return immediately with an error.
+	CriticalSectionLocker locker(handleLock);
+	if (hRequest != NULL)
+	{
+		WinHttpCloseHandle(hRequest);
+		hRequest = NULL;
+	}
+}
+
+void JavascriptAsyncIO::HttpRequest::Run()
+{
+	auto Fail = [this](const TCHAR *what)
+	{
+		// a failure after cancellation is just the cancellation
+		if (!canceled)
+			error = MsgFmt(_T("httpRequest: %s failed for %ws (WinHttp error %lu)"), what, url.c_str(), GetLastError()).Get();
+	};
+
+	// parse the URL
+	URL_COMPONENTS uc;
+	ZeroMemory(&uc, sizeof(uc));
+	uc.dwStructSize = sizeof(uc);
+	uc.dwHostNameLength = (DWORD)-1;
+	uc.dwUrlPathLength = (DWORD)-1;
+	uc.dwExtraInfoLength = (DWORD)-1;
+	if (!WinHttpCrackUrl(url.c_str(), static_cast<DWORD>(url.length()), 0, &uc))
+		return Fail(_T("parsing the URL"));
+	if (uc.nScheme != INTERNET_SCHEME_HTTP && uc.nScheme != INTERNET_SCHEME_HTTPS)
+	{
+		error = MsgFmt(_T("httpRequest: unsupported URL scheme in %ws"), url.c_str()).Get();
+		return;
+	}
+	WSTRING host(uc.lpszHostName, uc.dwHostNameLength);
+	WSTRING object(uc.lpszUrlPath, uc.dwUrlPathLength);
+	object.append(uc.lpszExtraInfo, uc.dwExtraInfoLength);
+
+	// open the session and connection
+	if ((hSession = WinHttpOpen(L"PinballY", WINHTTP_ACCESS_TYPE_DEFAULT_PROXY,
+		WINHTTP_NO_PROXY_NAME, WINHTTP_NO_PROXY_BYPASS, 0)) == NULL)
+		return Fail(_T("WinHttpOpen"));
+	WinHttpSetTimeouts(hSession, timeout, timeout, timeout, timeout);
+	if ((hConnect = WinHttpConnect(hSession, host.c_str(), uc.nPort, 0)) == NULL)
+		return Fail(_T("connecting"));
+
+	// open the request, publishing the handle so that Cancel() can close it
+	HINTERNET hReq = WinHttpOpenRequest(hConnect, method.c_str(), object.c_str(), NULL,
+		WINHTTP_NO_REFERER, WINHTTP_DEFAULT_ACCEPT_TYPES,
+		uc.nScheme == INTERNET_SCHEME_HTTPS ? WINHTTP_FLAG_SECURE : 0);
+	if (hReq == NULL)
+		return Fail(_T("opening the request"));
+	{
+		CriticalSectionLocker locker(handleLock);
+		if (canceled)
+		{
+			WinHttpCloseHandle(hReq);
+			return;
+		}
+		hRequest = hReq;
+	}
+
+	// send the request and wait for the response
+	if (!WinHttpSendRequest(hReq,
+		headers.length() != 0 ? headers.c_str() : WINHTTP_NO_ADDITIONAL_HEADERS, static_cast<DWORD>(headers.length()),
+		body.size() != 0 ? body.data() : WINHTTP_NO_REQUEST_DATA, static_cast<DWORD>(body.size()),
+		static_cast<DWORD>(body.size()), 0))
+		return Fail(_T("sending the request"));
+	if (!WinHttpReceiveResponse(hReq, NULL))
+		return Fail(_T("receiving the response"));
+
+	// get the status code
+	DWORD len = sizeof(status);
+	if (!WinHttpQueryHeaders(hReq, WINHTTP_QUERY_STATUS_CODE | WINHTTP_QUERY_FLAG_NUMBER,
+		WINHTTP_HEADER_NAME_BY_INDEX, &status, &len, WINHTTP_NO_HEADER_INDEX))
+		return Fail(_T("reading the status"));
+
+	// get a text header into a string
+	auto GetTextHeader = [hReq](DWORD info, WSTRING &s)
+	{
+		DWORD bytes = 0;
+		WinHttpQueryHeaders(hReq, info, WINHTTP_HEADER_NAME_BY_INDEX, WINHTTP_NO_OUTPUT_BUFFER, &bytes, WINHTTP_NO_HEADER_INDEX);
+		if (GetLastError() == ERROR_INSUFFICIENT_BUFFER && bytes != 0)
+		{
+			std::vector<WCHAR> buf(bytes / sizeof(WCHAR) + 1);
+			if (WinHttpQueryHeaders(hReq, info, WINHTTP_HEADER_NAME_BY_INDEX, buf.data(), &bytes, WINHTTP_NO_HEADER_INDEX))
+				s.assign(buf.data(), bytes / sizeof(WCHAR));
+		}
+	};
+	GetTextHeader(WINHTTP_QUERY_STATUS_TEXT, statusText);
+	GetTextHeader(WINHTTP_QUERY_RAW_HEADERS_CRLF, responseHeaders);
+
+	// read the body, enforcing the size limit
+	for (;;)
+	{
+		DWORD avail = 0;
+		if (!WinHttpQueryDataAvailable(hReq, &avail))
+			return Fail(_T("reading the response"));
+		if (avail == 0)
+			break;
+
+		if (responseBody.size() + avail > maxSize)
+		{
+			error = MsgFmt(_T("httpRequest: response from %ws is larger than the maximum size (%I64d bytes)"),
+				url.c_str(), static_cast<INT64>(maxSize)).Get();
+			responseBody.clear();
+			return;
+		}
+
+		size_t ofs = responseBody.size();
+		responseBody.resize(ofs + avail);
+		DWORD actual = 0;
+		if (!WinHttpReadData(hReq, responseBody.data() + ofs, avail, &actual))
+			return Fail(_T("reading the response"));
+		responseBody.resize(ofs + actual);
+	}
+}
+
+JsValueRef JavascriptAsyncIO::HttpRequest::GetResult()
+{
+	auto obj = JavascriptEngine::JsObj::CreateObject();
+	obj.Set("status", static_cast<int>(status));
+	obj.Set("statusText", statusText);
+	obj.Set("headers", responseHeaders);
+	obj.Set("body", binary ? CreateArrayBuffer(responseBody) : JavascriptEngine::NativeToJs(DecodeText(responseBody)));
+	return obj.jsobj;
+}
@@ -0,0 +1,225 @@
+// This file is part of PinballY
+// Copyright 2018 Michael J Roberts | GPL v3 or later | NO WARRANTY
+//
+// Javascript asynchronous I/O
+//
+// This implements the native side of the Javascript asyncIO object,
+// which provides Promise-based file and network operations: reading and
+// writing files, listing directories, and HTTP requests.  Each request
+// runs on the Windows thread pool, so a script never puts a disk or
+// network wait into the UI thread.
+//
+// Each request is represented by a Request object, which carries the
+// request parameters, the result, and the Javascript Promise that the
+// script receives.  The Request's Run() method does the actual I/O on a
+// pool thread, working only with native data (never touching Javascript
+// objects, which belong to the UI thread).  When Run() finishes, the
+// request goes on the completed list, and we post a notification to the
+// main window.  The window handler calls OnCompletions(), which builds
+// the Javascript result value and resolves or rejects the Promise on
+// the main thread.  The engine then runs the script's .then() handlers
+// through its normal promise task queue.
+//
+// A request can be canceled via Cancel(), in which case its Promise is
+// rejected with a "canceled" error as soon as the pool thread notices.
+// HTTP requests are interrupted immediately by closing the WinHttp
+// request handle; file requests check the cancel flag between blocks.
+//
+// Response and file sizes are capped (see Request::maxSize), so that a
+// script can't accidentally pull an enormous download into memory.
+
+#pragma once
+#include <atomic>
+#include <list>
+#include <unordered_map>
+#include <winhttp.h>
+#include "JavascriptEngine.h"
+
+class JavascriptAsyncIO
+{
+public:
+	// Create the I/O manager.  Completion notifications are posted to
+	// 'hwndNotify' as 'notifyMsg'.
+	JavascriptAsyncIO(HWND hwndNotify, UINT notifyMsg);
+
+	// Destruction cancels all outstanding requests and waits for the
+	// pool threads to finish with them.  This must be called while the
+	// Javascript engine is still alive, since it releases the requests'
+	// Promise references.
+	~JavascriptAsyncIO();
+
+	// default maximum file/response size
+	static const size_t defaultMaxSize = 16 * 1024 * 1024;
+
+	// Request base class
+	struct Request
+	{
+		Request() { }
+		virtual ~Request() { }
+
+		// Run the request.  This is called on a pool thread, so it must
+		// only use native data.  On failure, set 'error' to the error
+		// message.
+		virtual void Run() = 0;
+
+		// Build the Javascript result value for a successful request.
+		// This is called on the main thread.  May throw CallException.
+		virtual JsValueRef GetResult() = 0;
+
+		// Cancel the request.  Called on the main thread.  Subclasses
+		// can override this to interrupt a blocking operation in
+		// progress, but must call the base class.
+		virtual void Cancel() { canceled = true; }
+
+		// request ID, for Cancel()
+		int id = 0;
+
+		// has the request been canceled?
+		std::atomic<bool> canceled{ false };
+
+		// maximum data size, in bytes
+		size_t maxSize = defaultMaxSize;
+
+		// error message; empty on success
+		WSTRING error;
+
+		// the Promise returned to Javascript
+		std::unique_ptr<JavascriptEngine::Promise> promise;
+	};
+
+	// Read a file, as text (decoded according to its byte order mark,
+	// defaulting to UTF-8) or as binary data (returned as an ArrayBuffer)
+	struct ReadFileRequest : Request
+	{
+		ReadFileRequest(const WCHAR *path, bool binary) : path(path), binary(binary) { }
+		virtual void Run() override;
+		virtual JsValueRef GetResult() override;
+
+		WSTRING path;
+		bool binary;
+		std::vector<BYTE> data;
+	};
+
+	// Write a file.  The data is written exactly as given; the caller
+	// converts text to bytes (as UTF-8) before submitting the request.
+	struct WriteFileRequest : Request
+	{
+		WriteFileRequest(const WCHAR *path, bool append) : path(path), append(append) { }
+		virtual void Run() override;
+		virtual JsValueRef GetResult() override;
+
+		WSTRING path;
+		bool append;
+		std::vector<BYTE> data;
+	};
+
+	// List a directory.  The result is an array of { name, isDirectory,
+	// size, modified } objects.
+	struct ListDirRequest : Request
+	{
+		ListDirRequest(const WCHAR *path) : path(path) { }
+		virtual void Run() override;
+		virtual JsValueRef GetResult() override;
+
+		WSTRING path;
+		struct Entry
+		{
+			WSTRING name;
+			bool isDirectory;
+			UINT64 size;
+			FILETIME modified;
+		};
+		std::list<Entry> entries;
+	};
+
+	// HTTP request.  The result is an object { status, statusText,
+	// headers, body }, with the body as a string (decoded as UTF-8) or
+	// as an ArrayBuffer.
+	struct HttpRequest : Request
+	{
+		HttpRequest() { }
+		virtual ~HttpRequest();
+		virtual void Run() override;
+		virtual JsValueRef GetResult() override;
+		virtual void Cancel() override;
+
+		// request parameters
+		WSTRING url;
+		WSTRING method = L"GET";
+		WSTRING headers;           // additional headers, as "Name: value\r\n" lines
+		std::vector<BYTE> body;    // request body
+		DWORD timeout = 30000;     // send/receive timeout, in milliseconds
+		bool binary = false;       // return the response body as an ArrayBuffer?
+
+		// response
+		DWORD status = 0;
+		WSTRING statusText;
+		WSTRING responseHeaders;
+		std::vector<BYTE> responseBody;
+
+		// WinHttp handles.  The main thread can close the request handle
+		// to cancel a blocking call, so access it only under the lock.
+		CriticalSection handleLock;
+		HINTERNET hSession = NULL;
+		HINTERNET hConnect = NULL;
+		HINTERNET hRequest = NULL;
+	};
+
+	// Submit a request.  This takes ownership of the request object,
+	// creates its Promise, and queues it to the thread pool.  Returns
+	// the Javascript Promise object.  Throws CallException on error.
+	// Called on the main thread.
+	JsValueRef Submit(Request *request);
+
+	// Cancel a request by ID.  Returns true if the request was found.
+	bool Cancel(int id);
+
+	// Process completed requests, resolving or rejecting their Promises.
+	// The window handler for the notification message calls this.
+	void OnCompletions();
+
+	// Get the bytes of a Javascript data value for a write or HTTP
+	// request body.  A string is converted to UTF-8; an ArrayBuffer or
+	// typed array is copied as-is.  Throws CallException on error.
+	static void JsToBytes(std::vector<BYTE> &bytes, JsValueRef val);
+
+protected:
+	// thread pool callback
+	static void CALLBACK WorkCallback(PTP_CALLBACK_INSTANCE instance, PVOID context);
+
+	// create a Javascript ArrayBuffer containing a copy of the given bytes
+	static JsValueRef CreateArrayBuffer(const std::vector<BYTE> &bytes);
+
+	// Decode text from a file or HTTP response.  This uses the byte
+	// order mark if present, otherwise UTF-8, falling back on the local
+	// ANSI code page if the text isn't valid UTF-8.
+	static WSTRING DecodeText(const std::vector<BYTE> &bytes);
+
+	// notification window and message
+	HWND hwndNotify;
+	UINT notifyMsg;
+
+	// Our thread pool environment and cleanup group.  The cleanup group
+	// lets us wait for all outstanding work items at shutdown.
+	TP_CALLBACK_ENVIRON tpEnv;
+	PTP_CLEANUP_GROUP tpCleanupGroup = NULL;
+
+	// Outstanding requests, by ID.  The main thread owns this map; a
+	// request stays here until the main thread processes its completion,
+	// so the pool thread can safely access its Request object while
+	// it's running.
+	std::unordered_map<int, std::unique_ptr<Request>> requests;
+	int nextId = 1;
+
+	// Completed request IDs, waiting for the main thread.  Protected by
+	// the lock.
+	CriticalSection lock;
+	std::list<int> completed;
+
+	// work item context
+	struct WorkContext
+	{
+		JavascriptAsyncIO *self;
+		Request *request;
+	};
+};
@@ -7,6 +7,7 @@
 #include "../Utilities/ComUtil.h"
 #include "../Utilities/DateUtil.h"
 #include "JavascriptEngine.h"
+#include "ScriptBytecodeCache.h"
 #include "LogFile.h"
 #include "DialogResource.h"
 
@@ -22,6 +23,10 @@ namespace fs = std::filesystem;
 // statics
 JavascriptEngine *JavascriptEngine::inst;
 double JavascriptEngine::Task::nextId = 1.0;
+bool JavascriptEngine::profilingEnabled = false;
+double JavascriptEngine::profileBudget = 16.0;
+std::unordered_map<WSTRING, JavascriptEngine::ResolvedModule> JavascriptEngine::resolvedModules;
+std::unordered_map<WSTRING, JavascriptEngine::ModuleSource> JavascriptEngine::moduleSources;
 
 JavascriptEngine::JavascriptEngine()
 {
@@ -336,10 +341,27 @@ void JavascriptEngine::Terminate()
 
 JavascriptEngine::~JavascriptEngine()
 {
+	// write the profile summary, and release the profiled functions
+	if (profilingEnabled)
+		LogProfile();
+	for (auto &it : profileFuncLabels)
+		JsRelease(it.first, nullptr);
+	profileFuncLabels.clear();
+
+	// release the cached property IDs and interned strings
+	for (auto &it : propIdCache)
+		JsRelease(it.second, nullptr);
+	propIdCache.clear();
+	for (auto &it : internedStrings)
+		JsRelease(it.second, nullptr);
+	internedStrings.clear();
+
 	// Explicitly clear the task queue.  Tasks can hold references to
 	// Javascript objects, so we need to delete remaining task queue items
 	// while the engine is still valid.
-	taskQueue.clear();
+	tasksById.clear();
+	readyTasks.clear();
+	timerTasks.clear();
 
 	// Likewise, dispose of all native type cache entries, as these 
 	// hold Javascript object references.
@@ -407,7 +429,86 @@ bool JavascriptEngine::EvalScript(const WCHAR *scriptText, const WCHAR *url, JsV
 	// we're entering Javascript scope
 	JavascriptScope jsc;
 
-	JsErrorCode err;
+	// create a cookie to represent the script
+	auto const *cookie = &sourceCookies.emplace_back(TCHARToWide(url));
+
+	// run the script
+	JsErrorCode err = JsRunScript(scriptText, reinterpret_cast<JsSourceContext>(cookie), TCHARToWCHAR(url), returnVal);
+	return CheckScriptResult(err, _T("JsRunScript"), eh);
+}
+
+bool JavascriptEngine::EvalScriptFile(const TCHAR *path, const WCHAR *url, ErrorHandler &eh)
+{
+	// we're entering Javascript scope
+	JavascriptScope jsc;
+
+	// Get the bytecode cache key before reading the file.  Skip the cache
+	// when debugging, so that the debugger always sees a fresh parse.
+	WSTRING wpath = TCHARToWide(path);
+	ScriptBytecodeCache::Key key;
+	bool useCache = debugService == nullptr && ScriptBytecodeCache::GetKey(wpath.c_str(), key);
+
+	// load the source
+	long len;
+	std::unique_ptr<WCHAR> contents(ReadFileAsWStr(path, eh, len, ReadFileAsStr_NullTerm));
+	if (contents == nullptr)
+		return false;
+
+	// if we're not using the cache, simply run the source
+	if (!useCache)
+		return EvalScript(contents.get(), url, nullptr, eh);
+
+	// create a cookie to represent the script
+	auto const *cookie = &sourceCookies.emplace_back(url);
+
+	// run a serialized script
+	auto RunSerialized = [this, url, cookie](SerializedScript &s) {
+		return JsRunSerializedScript(s.source.get(), s.bytecode.data(),
+			reinterpret_cast<JsSourceContext>(cookie), url, nullptr);
+	};
+
+	// try loading the bytecode from the cache
+	auto &s = serializedScripts.emplace_back();
+	if (ScriptBytecodeCache::Load(wpath.c_str(), key, s.bytecode))
+	{
+		s.source = std::move(contents);
+		JsErrorCode err = RunSerialized(s);
+		if (err != JsErrorBadSerializedScript)
+		{
+			LogFile::Get()->Write(LogFile::JSLogging, _T("[Javascript] Loaded %s from the bytecode cache\n"), path);
+			return CheckScriptResult(err, _T("JsRunSerializedScript"), eh);
+		}
+
+		// the engine rejected the cached entry; discard it and rebuild it
+		LogFile::Get()->Write(LogFile::JSLogging, _T("[Javascript] Bytecode cache entry for %s is invalid; reparsing\n"), path);
+		ScriptBytecodeCache::Discard(wpath.c_str());
+		contents = std::move(s.source);
+	}
+
+	// Serialize the source, save it to the cache, and run the serialized
+	// form.  Running the serialized form saves parsing the source a second
+	// time.  If serialization fails, simply run the source.
+	unsigned int size = 0;
+	if (JsSerializeScript(contents.get(), nullptr, &size) == JsNoError && size != 0)
+	{
+		s.bytecode.resize(size);
+		if (JsSerializeScript(contents.get(), s.bytecode.data(), &size) == JsNoError)
+		{
+			s.bytecode.resize(size);
+			ScriptBytecodeCache::Save(wpath.c_str(), key, s.bytecode);
+			s.source = std::move(contents);
+			return CheckScriptResult(RunSerialized(s), _T("JsRunSerializedScript"), eh);
+		}
+	}
+
+	// run from source
+	serializedScripts.pop_back();
+	JsErrorCode err = JsRunScript(contents.get(), reinterpret_cast<JsSourceContext>(cookie), url, nullptr);
+	return CheckScriptResult(err, _T("JsRunScript"), eh);
+}
+
+bool JavascriptEngine::CheckScriptResult(JsErrorCode err, const TCHAR *where, ErrorHandler &eh)
+{
 	auto Error = [&err, &eh](const TCHAR *where)
 	{
 		MsgFmt details(_T("%s failed: %s"), where, JsErrorToString(err));
@@ -416,13 +517,9 @@ bool JavascriptEngine::EvalScript(const WCHAR *scriptText, const WCHAR *url, JsV
 		return false;
 	};
 
-	// create a cookie to represent the script
-	auto const *cookie = &sourceCookies.emplace_back(TCHARToWide(url));
-
-	// run the script
-	if ((err = JsRunScript(scriptText, reinterpret_cast<JsSourceContext>(cookie), TCHARToWCHAR(url), returnVal)) != JsNoError 
-		&& err != JsErrorScriptException && err != JsErrorScriptCompile)
-		return Error(_T("JsRunScript"));
+	// script exceptions and compile errors are reported as exceptions
+	if (err != JsNoError && err != JsErrorScriptException && err != JsErrorScriptCompile)
+		return Error(where);
 
 	// check for thrown exceptions
 	bool isExc = false;
@@ -979,12 +1076,60 @@ JsErrorCode JavascriptEngine::GetProp(TSTRING &strval, JsValueRef obj, const CHA
 	return JsNoError;
 }
 
+JsErrorCode JavascriptEngine::GetPropertyId(const CHAR *name, JsPropertyIdRef *propId)
+{
+	// if we're not on the engine thread, just create the ID directly
+	if (inst == nullptr || GetCurrentThreadId() != inst->mainThreadId)
+		return JsCreatePropertyId(name, strlen(name), propId);
+
+	// check the cache
+	CSTRING key(name);
+	if (auto it = inst->propIdCache.find(key); it != inst->propIdCache.end())
+	{
+		*propId = it->second;
+		return JsNoError;
+	}
+
+	// create the ID
+	if (JsErrorCode err = JsCreatePropertyId(name, key.length(), propId); err != JsNoError)
+		return err;
+
+	// cache it, if there's room
+	if (inst->propIdCache.size() < maxPropIdCacheSize)
+	{
+		JsAddRef(*propId, nullptr);
+		inst->propIdCache.emplace(std::move(key), *propId);
+	}
+	return JsNoError;
+}
+
+JsValueRef JavascriptEngine::GetInternedString(const WCHAR *str)
+{
+	// check the table
+	WSTRING key(str);
+	if (auto it = internedStrings.find(key); it != internedStrings.end())
+		return it->second;
+
+	// create the string
+	JsValueRef val;
+	if (JsPointerToString(key.c_str(), key.length(), &val) != JsNoError)
+		return undefVal;
+
+	// add it to the table if there's room
+	if (internedStrings.size() < maxInternedStrings)
+	{
+		JsAddRef(val, nullptr);
+		internedStrings.emplace(std::move(key), val);
+	}
+	return val;
+}
+
 JsErrorCode JavascriptEngine::GetProp(JsValueRef &val, JsValueRef obj, const CHAR *propName, const TCHAR* &where)
 {
 	// create the property ID
 	JsErrorCode err;
 	JsPropertyIdRef propId;
-	if ((err = JsCreatePropertyId(propName, strlen(propName), &propId)) != JsNoError)
+	if ((err = GetPropertyId(propName, &propId)) != JsNoError)
 	{
 		where = _T("JsCreatePropertyId");
 		return err;
@@ -1060,7 +1205,7 @@ bool JavascriptEngine::SetProp(JsValueRef obj, const CHAR *prop, JsValueRef val)
 {
 	JsErrorCode err;
 	JsPropertyIdRef propkey;
-	if ((err = JsCreatePropertyId(prop, strlen(prop), &propkey)) != JsNoError
+	if ((err = GetPropertyId(prop, &propkey)) != JsNoError
 		|| (err = JsSetProperty(obj, propkey, val, true)) != JsNoError)
 		return Throw(err, _T("SetProp")), false;
 
@@ -1340,12 +1485,77 @@ void CALLBACK JavascriptEngine::PromiseContinuationCallback(JsValueRef task, voi
 void JavascriptEngine::AddTask(Task *task)
 {
 	// add the task
-	taskQueue.emplace_back(task);
+	EnqueueTask(std::unique_ptr<Task>(task));
 
 	// update the message window timer, if affected
 	UpdateTaskTimer();
 }
 
+void JavascriptEngine::EnqueueTask(std::unique_ptr<Task> &&task)
+{
+	// index it by ID
+	tasksById[task->id] = task.get();
+
+	// Tasks with no ready time (promise continuations, module loads) go
+	// in the FIFO.  Anything with a ready time - a timeout, an interval,
+	// a rescheduled idle or scan task - goes in the timer heap, even if
+	// it's already due, so that RunTasks() can hold it for the next pass
+	// if it was queued during the current one.  A zero-length timeout or
+	// an interval that's already due again would otherwise run over and
+	// over within a single pass until the time limit ran out.
+	UINT64 seq = nextTaskSeq++;
+	if (task->readyTime == 0)
+		readyTasks.push_back({ std::move(task), seq });
+	else
+	{
+		timerTasks.push_back({ std::move(task), seq });
+		std::push_heap(timerTasks.begin(), timerTasks.end(), &TimerTaskAfter);
+	}
+}
+
+JavascriptEngine::Task *JavascriptEngine::FindTask(double id)
+{
+	auto it = tasksById.find(id);
+	return it != tasksById.end() ? it->second : nullptr;
+}
+
+void JavascriptEngine::CancelTask(Task *task)
+{
+	// mark it as canceled
+	if (task->canceled)
+		return;
+	task->canceled = true;
+
+	// If canceled tasks make up most of the timer heap, compact it.  A
+	// script that sets and clears lots of long timeouts would otherwise
+	// grow the heap without bound, since the canceled entries wouldn't
+	// reach the front until their scheduled times.
+	if (++canceledTasks > 64 && canceledTasks > timerTasks.size() / 2)
+	{
+		auto it = std::remove_if(timerTasks.begin(), timerTasks.end(), [this](const QueuedTask &t)
+		{
+			if (!t.task->canceled)
+				return false;
+
+			tasksById.erase(t.task->id);
+			return true;
+		});
+		timerTasks.erase(it, timerTasks.end());
+		std::make_heap(timerTasks.begin(), timerTasks.end(), &TimerTaskAfter);
+		canceledTasks = 0;
+	}
+}
+
+void JavascriptEngine::PopCanceledTimerTasks()
+{
+	while (timerTasks.size() != 0 && timerTasks.front().task->canceled)
+	{
+		std::pop_heap(timerTasks.begin(), timerTasks.end(), &TimerTaskAfter);
+		tasksById.erase(timerTasks.back().task->id);
+		timerTasks.pop_back();
+	}
+}
+
 void JavascriptEngine::UpdateTaskTimer()
 {
 	if (IsTaskPending())
@@ -1379,10 +1589,15 @@ void JavascriptEngine::UpdateTaskTimer()
 
 void JavascriptEngine::EnumTasks(std::function<bool(Task*)> func)
 {
-	for (auto &task : taskQueue)
+	for (auto &t : readyTasks)
 	{
-		if (!func(task.get()))
-			break;
+		if (!func(t.task.get()))
+			return;
+	}
+	for (auto &t : timerTasks)
+	{
+		if (!func(t.task.get()))
+			return;
 	}
 }
 
@@ -1399,12 +1614,13 @@ ULONGLONG JavascriptEngine::GetNextTaskTime()
 	// just very small, it's actually zero.
 	ULONGLONG nextReadyTime = MAXULONGLONG;
 
-	// Now scan the queue looking for tasks with earlier ready times.
-	for (auto const& task : taskQueue)
-	{
-		if (task->readyTime < nextReadyTime)
-			nextReadyTime = task->readyTime;
-	}
+	// Anything in the ready queue is ready now.  Otherwise, the next
+	// time is the time of the first live task in the timer heap.
+	PopCanceledTimerTasks();
+	if (readyTasks.size() != 0)
+		nextReadyTime = 0;
+	else if (timerTasks.size() != 0)
+		nextReadyTime = timerTasks.front().task->readyTime;
 
 	// return the earliest next ready time we found
 	return nextReadyTime;
@@ -1421,41 +1637,54 @@ bool JavascriptEngine::RunTasks()
 		// count the tasks as entering Javascript scope
 		JavascriptScope jsc;
 
-		// scan the task queue
-		for (auto it = taskQueue.begin(); it != taskQueue.end(); )
-		{
-			// remember the next task, in case we remove this one
-			auto nxt = it;
-			nxt++;
-
-			// get the task object
-			Task *task = it->get();
-
-			// presume we'll keep the task
-			bool keep = true;
+		// Only run timer tasks that were queued before this pass started.
+		// An interval rescheduled during the pass, or a zero-length timeout
+		// set by a task, waits for the next pass (EnqueueTask() puts all
+		// timed tasks in the timer heap, so this check covers them).  Ready-queue tasks (promise
+		// continuations) run to completion, as Javascript expects, subject
+		// to the time limit.
+		UINT64 passSeq = nextTaskSeq;
+		ULONGLONG tStart = GetTickCount64();
+		for (;;)
+		{
+			// stop if we've used up our time, as long as we've done something
+			ULONGLONG now = GetTickCount64();
+			if (tasksExecuted && now - tStart >= maxRunTasksTime)
+				break;
 
-			// check the task status
-			if (task->canceled)
+			// take the next ready task: the ready queue first, then the timers
+			std::unique_ptr<Task> task;
+			if (readyTasks.size() != 0)
 			{
-				// The task has been canceled.  Simply delete it from the
-				// queue without invoking it.
-				keep = false;
+				task = std::move(readyTasks.front().task);
+				readyTasks.pop_front();
 			}
-			else if (GetTickCount64() >= task->readyTime)
+			else if (timerTasks.size() != 0 && timerTasks.front().task->readyTime <= now
+				&& timerTasks.front().seq < passSeq)
 			{
-				// The task is ready to run.  Execute it.
-				keep = task->Execute();
+				std::pop_heap(timerTasks.begin(), timerTasks.end(), &TimerTaskAfter);
+				task = std::move(timerTasks.back().task);
+				timerTasks.pop_back();
+			}
+			else
+				break;
 
-				// note that at least one task has been executed
+			// If the task has been canceled, simply delete it without
+			// invoking it.  Otherwise execute it.
+			bool keep = false;
+			if (!task->canceled)
+			{
+				ProfileScope profile(task->ProfileCategory(), task->ProfileFunc(), task->ProfileDetail());
+				keep = task->Execute();
 				tasksExecuted = true;
 			}
 
-			// If we're not keeping the task, remove it
-			if (!keep)
-				taskQueue.erase(it);
-
-			// advance to the next task
-			it = nxt;
+			// requeue the task if it wants to stay scheduled, otherwise
+			// let it be deleted
+			if (keep)
+				EnqueueTask(std::move(task));
+			else
+				tasksById.erase(task->id);
 		}
 	}
 
@@ -1486,6 +1715,173 @@ bool JavascriptEngine::EventTask::Execute()
 	return false;
 }
 
+void JavascriptEngine::EndProfileScope(const ProfileScope &scope)
+{
+	// figure the elapsed time
+	LARGE_INTEGER t1, freq;
+	QueryPerformanceCounter(&t1);
+	QueryPerformanceFrequency(&freq);
+	double ms = static_cast<double>(t1.QuadPart - scope.t0.QuadPart) * 1000.0 / static_cast<double>(freq.QuadPart);
+
+	// build the handler label from the function and detail
+	WSTRING handler;
+	if (scope.func != JS_INVALID_REFERENCE)
+		handler = GetProfileFuncLabel(scope.func);
+	if (scope.detail != nullptr)
+	{
+		if (handler.length() != 0)
+			handler += L" ";
+		handler += scope.detail;
+	}
+	if (handler.length() == 0)
+		handler = L"(native)";
+
+	// add it to the performance trace
+	Trace::Interval(scope.category, "js", scope.t0.QuadPart, t1.QuadPart, handler.c_str());
+
+	// the rest is only for the profile summary
+	if (!profilingEnabled)
+		return;
+
+	// find or create the entry for the category and handler
+	WSTRING key = AnsiToWide(scope.category) + L"|" + handler;
+	auto &e = profileEntries[key];
+	if (e.category == nullptr)
+	{
+		e.category = scope.category;
+		e.handler = handler;
+	}
+
+	// update the statistics
+	e.calls += 1;
+	e.totalMs += ms;
+	e.maxMs = max(e.maxMs, ms);
+
+	// flag it if it went over budget
+	if (profileBudget > 0.0 && ms > profileBudget)
+	{
+		e.overBudget += 1;
+		LogFile::Get()->Write(LogFile::JSLogging, _T("[Javascript] Profile: %hs %ws took %.2f ms (budget %.2f ms)\n"),
+			scope.category, handler.c_str(), ms, profileBudget);
+	}
+}
+
+const WSTRING &JavascriptEngine::GetProfileFuncLabel(JsValueRef func)
+{
+	// use the cached label if we have one
+	if (auto it = profileFuncLabels.find(func); it != profileFuncLabels.end())
+		return it->second;
+
+	// Build the label from the function name, plus the source location,
+	// if available.  The location is only available for script functions,
+	// so native functions and event classes (whose dispatch we profile
+	// via the class constructor) are labeled by name only.
+	WSTRING label;
+	try
+	{
+		JsObj funcObj(func);
+		label = funcObj.Get<WSTRING>("name");
+		if (label.length() == 0)
+			label = L"(anonymous)";
+
+		JsValueRef pos;
+		if (JsDiagGetFunctionPosition(func, &pos) == JsNoError)
+		{
+			JsObj posObj(pos);
+			WSTRING file = posObj.Get<WSTRING>("fileName");
+			if (size_t slash = file.find_last_of(L"/\\"); slash != WSTRING::npos)
+				file.erase(0, slash + 1);
+			if (file.length() != 0)
+			{
+				label += MsgFmt(L" (%s:%d:%d)", file.c_str(),
+					posObj.Get<int>("line") + 1, posObj.Get<int>("column") + 1).Get();
+			}
+		}
+	}
+	catch (CallException)
+	{
+		if (label.length() == 0)
+			label = L"(unknown)";
+	}
+
+	// cache it, keeping a reference on the function
+	JsAddRef(func, nullptr);
+	return profileFuncLabels.emplace(func, label).first->second;
+}
+
+JsValueRef JavascriptEngine::GetProfileSummary()
+{
+	// build the summary object
+	auto summary = JsObj::CreateObject();
+	summary.Set("enabled", profilingEnabled);
+	summary.Set("budget", profileBudget);
+
+	// add the entries, in descending order of total time
+	std::vector<const ProfileEntry*> entries;
+	for (auto &it : profileEntries)
+		entries.push_back(&it.second);
+	std::sort(entries.begin(), entries.end(), [](const ProfileEntry *a, const ProfileEntry *b) { return a->totalMs > b->totalMs; });
+
+	auto arr = JsObj::CreateArray();
+	for (auto e : entries)
+	{
+		auto obj = JsObj::CreateObject();
+		obj.Set("category", AnsiToWide(e->category));
+		obj.Set("handler", e->handler);
+		obj.Set("calls", static_cast<double>(e->calls));
+		obj.Set("totalMs", e->totalMs);
+		obj.Set("avgMs", e->totalMs / static_cast<double>(e->calls));
+		obj.Set("maxMs", e->maxMs);
+		obj.Set("overBudget", static_cast<double>(e->overBudget));
+		arr.Push(obj.jsobj);
+	}
+	summary.Set("entries", arr.jsobj);
+
+	// add the dead object scan statistics
+	auto &ds = deadObjectScanStats;
+	auto scan = JsObj::CreateObject();
+	scan.Set("passes", static_cast<double>(ds.passes));
+	scan.Set("slices", static_cast<double>(ds.slices));
+	scan.Set("restarts", static_cast<double>(ds.restarts));
+	scan.Set("freed", static_cast<double>(ds.freed));
+	scan.Set("totalMs", ds.totalMs);
+	scan.Set("maxSliceMs", ds.maxSliceMs);
+	summary.Set("deadObjectScan", scan.jsobj);
+
+	return summary.jsobj;
+}
+
+void JavascriptEngine::ResetProfile()
+{
+	profileEntries.clear();
+	deadObjectScanStats = DeadObjectScanStats();
+}
+
+void JavascriptEngine::LogProfile()
+{
+	// sort the entries in descending order of total time
+	std::vector<const ProfileEntry*> entries;
+	for (auto &it : profileEntries)
+		entries.push_back(&it.second);
+	std::sort(entries.begin(), entries.end(), [](const ProfileEntry *a, const ProfileEntry *b) { return a->totalMs > b->totalMs; });
+
+	// write the summary
+	auto log = LogFile::Get();
+	log->Group(LogFile::JSLogging);
+	log->Write(LogFile::JSLogging, _T("Javascript profile summary (times in ms; budget %.2f ms)\n"), profileBudget);
+	for (auto e : entries)
+	{
+		log->Write(LogFile::JSLogging, _T(". %hs %ws: %I64u calls, total %.2f, avg %.3f, max %.2f, over budget %I64u\n"),
+			e->category, e->handler.c_str(), e->calls, e->totalMs, e->totalMs / static_cast<double>(e->calls),
+			e->maxMs, e->overBudget);
+	}
+
+	// add the dead object scan statistics
+	auto &ds = deadObjectScanStats;
+	log->Write(LogFile::JSLogging, _T(". dead object scan: %I64u passes, %I64u slices, %I64u restarts, %I64u blocks freed, total %.2f, max slice %.2f\n"),
+		ds.passes, ds.slices, ds.restarts, ds.freed, ds.totalMs, ds.maxSliceMs);
+}
+
 const TCHAR *JavascriptEngine::JsErrorToString(JsErrorCode err)
 {
 	switch (err)
@@ -1623,14 +2019,29 @@ JsErrorCode JavascriptEngine::FetchImportedModuleCommon(
 	const WSTRING &specifier,
 	JsModuleRecord *dependentModuleRecord)
 {
-	// get the normalized filename
+	// Get the normalized filename and file URL, from the resolution
+	// cache if we've seen this specifier from this source before
 	JsErrorCode err;
-	WSTRING fname;
-	if ((err = GetModuleSource(fname, specifier, referencingSourcePath)) != JsNoError)
-		return err;
+	WSTRING fname, fileUrl;
+	WSTRING resolutionKey = referencingSourcePath + L"\n" + specifier;
+	if (auto it = resolvedModules.find(resolutionKey); it != resolvedModules.end())
+	{
+		fname = it->second.fname;
+		fileUrl = it->second.url;
+	}
+	else
+	{
+		// resolve the specifier
+		if ((err = GetModuleSource(fname, specifier, referencingSourcePath)) != JsNoError)
+			return err;
 
-	// get the file URL
-	WSTRING fileUrl = GetFileUrl(fname.c_str());
+		// get the file URL
+		fileUrl = GetFileUrl(fname.c_str());
+
+		// remember the resolution if the file exists
+		if (GetFileAttributesW(fileUrl.c_str() + 8) != INVALID_FILE_ATTRIBUTES)
+			resolvedModules.emplace(resolutionKey, ResolvedModule{ fname, fileUrl });
+	}
 
 	// use the canonicalized URL as the key
 	WSTRING key = fileUrl;
@@ -1723,15 +2134,19 @@ bool JavascriptEngine::ModuleParseTask::Execute()
 
 	// load the script
 	LogFile::Get()->Write(LogFile::JSLogging, _T("[Javascript] Loading module from file %ws\n"), path);
-	long len;
 	LogFileErrorHandler eh(_T(". "));
-	std::unique_ptr<WCHAR> contents(ReadFileAsWStr(WCHARToTCHAR(path), eh, len, 0));
-	if (contents == nullptr)
+	const ModuleSource *source = GetModuleSourceText(path, eh);
+	if (source == nullptr)
 	{
 		LogFile::Get()->Write(LogFile::JSLogging, _T(". Error loading %ws\n"), path);
 		return false;
 	}
 
+	// hold a reference to the text while parsing (the engine takes its
+	// own copy, so we don't need it after that)
+	std::shared_ptr<WCHAR> contents = source->text;
+	long len = source->len;
+
 	// Allocate a cookie.  This is required to give the module a source
 	// context, which ChakraCore uses to identify module source locations
 	// for functions defined therein, in stack traces and other debugging.
@@ -1826,6 +2241,53 @@ bool JavascriptEngine::ModuleEvalTask::Execute()
 	return false;
 }
 
+const JavascriptEngine::ModuleSource *JavascriptEngine::GetModuleSourceText(const WCHAR *path, ErrorHandler &eh)
+{
+	// Get the file stamp before reading the file, so that a change made
+	// while we're reading it won't be mistaken for the version we read
+	UINT64 size = 0, time = 0;
+	bool stamped = ScriptBytecodeCache::GetFileStamp(path, size, time);
+
+	// look for an existing entry
+	WSTRING key = path;
+	std::transform(key.begin(), key.end(), key.begin(), ::towlower);
+	auto it = moduleSources.find(key);
+	if (it != moduleSources.end() && stamped && it->second.size == size && it->second.time == time)
+	{
+		LogFile::Get()->Write(LogFile::JSLogging, _T(". Module source unchanged since last load; reusing it\n"));
+		return &it->second;
+	}
+
+	// read the file
+	long len;
+	std::shared_ptr<WCHAR> text(ReadFileAsWStr(WCHARToTCHAR(path), eh, len, 0), std::default_delete<WCHAR[]>());
+	if (text == nullptr)
+		return nullptr;
+
+	// hash the contents (64-bit FNV-1a, a character at a time)
+	UINT64 hash = 0xcbf29ce484222325ULL;
+	for (const WCHAR *p = text.get(), *end = p + len; p < end; ++p)
+		hash = (hash ^ *p) * 0x100000001b3ULL;
+
+	// if we had an earlier version, note whether it really changed
+	if (it != moduleSources.end())
+	{
+		if (it->second.hash == hash && it->second.len == len)
+			LogFile::Get()->Write(LogFile::JSLogging, _T(". Module file was touched, but its contents are unchanged\n"));
+		else
+			LogFile::Get()->Write(LogFile::JSLogging, _T(". Module file has changed since last load\n"));
+	}
+
+	// store the new entry
+	auto &entry = moduleSources[key];
+	entry.size = size;
+	entry.time = time;
+	entry.hash = hash;
+	entry.text = text;
+	entry.len = len;
+	return &entry;
+}
+
 WSTRING JavascriptEngine::GetFileUrl(const WCHAR *path)
 {
 	// Get the URL, for error messages and debugging.  VS Code requires file:/// URLs
@@ -2822,9 +3284,11 @@ size_t JavascriptEngine::Marshaller::SizeofUnion(JsValueRef jsval, const TCHAR *
 class JavascriptEngine::MarshallToNative : public Marshaller
 {
 public:
-	MarshallToNative(SigParser *sig) : Marshaller(sig) { }
+	// Every native marshalling pass is a potential store into native memory,
+	// so note it for the dead object scanner.
+	MarshallToNative(SigParser *sig) : Marshaller(sig) { inst->NoteNativeWrite(); }
 
-	MarshallToNative(const Marshaller &m) : Marshaller(m) { }
+	MarshallToNative(const Marshaller &m) : Marshaller(m) { inst->NoteNativeWrite(); }
 
 	// Store a value in newly allocated space
 	template<typename T> void Store(T val)
@@ -4912,6 +5376,106 @@ JsValueRef JavascriptEngine::DllImportBind(TSTRING dllName, TSTRING funcName)
 	return ret;
 }
 
+bool JavascriptEngine::CompileDllCallPlan(DllCallPlan &plan, const WCHAR *sigStr, size_t sigLen,
+	JsValueRef *argv, int argc, int firstDllArg)
+{
+	// The signature must have the form (<callingConv><returnType> <args>...)
+	if (sigLen < 4 || sigStr[0] != '(' || sigStr[sigLen - 1] != ')')
+	{
+		inst->Throw(_T("dllImport.call: invalid function signature"));
+		return false;
+	}
+
+	// Check the calling convention.  This is the first letter of the first
+	// token: S[__stdcall], C[__cdecl], F[__fastcall], T[__thiscall],
+	// V[__vectorcall].  x64 has a single native calling convention, so
+	// all of the codes are equivalent there, but x86 only supports the
+	// stack-based conventions.
+	plan.callConv = sigStr[1];
+	switch (plan.callConv)
+	{
+	case 'S':
+	case 'C':
+		break;
+
+#if defined(_M_IX86)
+	case 'F':
+		inst->Throw(_T("dllImport.call: __fastcall calling convention not supported"));
+		return false;
+
+	case 'T':
+		inst->Throw(_T("dllImport.call: __thiscall calling convention not supported"));
+		return false;
+
+	case 'V':
+		inst->Throw(_T("dllImport.call: __vectorcall calling convention not supported"));
+		return false;
+#else
+	case 'F':
+	case 'T':
+	case 'V':
+		break;
+#endif
+
+	default:
+		inst->Throw(_T("dllImport.call: unknown calling convention in function signature"));
+		return false;
+	}
+
+	// find the end of the return value + argument vector portion
+	plan.argvSigEnd = (Marshaller::EndOfArg(sigStr, sigStr + sigLen) - 1) - sigStr;
+
+	// measure the arguments
+	if (!SizeDllCallArgs(plan.argArraySize, &plan.sizeIsStatic, sigStr, plan.argvSigEnd, argv, argc, firstDllArg))
+		return false;
+
+	// success - remember the signature
+	plan.sig.assign(sigStr, sigLen);
+	return true;
+}
+
+bool JavascriptEngine::SizeDllCallArgs(size_t &argArraySize, bool *sizeIsStatic, const WCHAR *sigStr, size_t argvSigEnd,
+	JsValueRef *argv, int argc, int firstDllArg)
+{
+	// Stack argument sizer that notes whether the size depended on any
+	// actual argument values.  The sizer only consults the values for
+	// by-value structs and unions.
+	class PlanSizer : public MarshallStackArgSizer
+	{
+	public:
+		PlanSizer(SigParser *sig, JsValueRef *argv, int argc, int firstArg) :
+			MarshallStackArgSizer(sig, argv, argc, firstArg) { }
+
+		virtual JsValueRef GetCurVal() override
+		{
+			usedArgVals = true;
+			return __super::GetCurVal();
+		}
+
+		bool usedArgVals = false;
+	};
+
+	// Set up a stack argument sizer to measure how much stack space we need
+	// for the native copies of the arguments.  The first type in the function 
+	// signature is the return type, which the sizer skips.
+	SigParser argvSig(sigStr + 2, sigStr + argvSigEnd);
+	PlanSizer stackSizer(&argvSig, argv, argc, firstDllArg);
+	if (!stackSizer.Marshall())
+		return false;
+
+	// Figure the required native argument array size
+	argArraySize = max(stackSizer.nSlots, minArgSlots) * argSlotSize;
+
+	// round up to the next higher alignment boundary
+	argArraySize = ((argArraySize + stackAlign - 1) / stackAlign) * stackAlign;
+
+	// note whether the size can be reused for other calls
+	if (sizeIsStatic != nullptr)
+		*sizeIsStatic = !stackSizer.usedArgVals;
+
+	return true;
+}
+
 // assembler glue functions for DLL calls
 #if defined(_M_X64)
 extern "C" UINT64 DllCallGlue64_RAX(FARPROC func, const void *args, size_t nArgBytes);
@@ -5019,9 +5583,14 @@ JsValueRef JavascriptEngine::DllImportCall(JsValueRef callee, bool isConstructCa
 	// set up a temporary allocator for the marshallers
 	MarshallerContext tempAlloc;
 
+	// the native code can write anywhere in native memory, so note the
+	// write for the dead object scanner
+	inst->NoteNativeWrite();
+
 	// Get the native function object
 	FARPROC funcPtr = nullptr;
-	if (auto dllFuncObj = DllImportData::Recover<DllImportData>(argv[ai], nullptr); dllFuncObj != nullptr)
+	auto dllFuncObj = DllImportData::Recover<DllImportData>(argv[ai], nullptr);
+	if (dllFuncObj != nullptr)
 	{
 		// DLL import function pointer - get the proc address from the import object
 		funcPtr = dllFuncObj->procAddr;
@@ -5054,41 +5623,51 @@ JsValueRef JavascriptEngine::DllImportCall(JsValueRef callee, bool isConstructCa
 	size_t sigLen;
 	if ((err = JsStringToPointer(argv[ai++], &sigStr, &sigLen)) != JsNoError)
 		return inst->Throw(err, _T("dllImport.call"));
+
+	// the rest of the Javascript arguments are the arguments to pass to the DLL
+	int firstDllArg = ai;
+
+	// Get the call plan.  For a DLL import, use the plan cached on the
+	// import object if it was compiled for the same signature, otherwise
+	// compile and cache a new one.  COM vtable calls share the import
+	// object across methods, so they use a temporary plan.
+	DllCallPlan tempPlan;
+	const DllCallPlan *plan = &tempPlan;
+	if (dllFuncObj != nullptr)
+	{
+		if (dllFuncObj->plan == nullptr || !dllFuncObj->plan->Matches(sigStr, sigLen))
+		{
+			std::unique_ptr<DllCallPlan> newPlan(new DllCallPlan());
+			if (!CompileDllCallPlan(*newPlan, sigStr, sigLen, argv, argc, firstDllArg))
+				return inst->undefVal;
+			dllFuncObj->plan.reset(newPlan.release());
+		}
+		plan = dllFuncObj->plan.get();
+	}
+	else if (!CompileDllCallPlan(tempPlan, sigStr, sigLen, argv, argc, firstDllArg))
+		return inst->undefVal;
 		
-	// Set up a signature parser for the function, and a sub-parser with just
-	// the return value + argument vector portion.  That is, the part inside
-	// the parentheses, skipping the calling convention prefix:
+	// Set up a sub-parser with just the return value + argument vector
+	// portion of the signature.  That is, the part inside the parentheses,
+	// skipping the calling convention prefix:
 	//
 	//   (<callingConv><returnType> <arg1> <arg2> ...)
 	//
-	SigParser funcSig(sigStr, sigLen);
-	SigParser argvSig(sigStr + 2, Marshaller::EndOfArg(sigStr, sigStr + sigLen) - 1);
+	SigParser argvSig(sigStr + 2, sigStr + plan->argvSigEnd);
 
-	// the rest of the Javascript arguments are the arguments to pass to the DLL
-	int firstDllArg = ai;
-
-	// Get the calling convention.  This is the first letter of the first token:
-	// S[__stdcall], C[__cdecl], F[__fastcall], T[__thiscall], V[__vectorcall]
-	WCHAR callConv = sigStr[1];
+	// get the calling convention, from the plan
+	WCHAR callConv = plan->callConv;
 
 	// the return value type starts immediately after the calling convention
 	const WCHAR *retType = sigStr + 2;
 
-	// Set up a stack argument sizer to measure how much stack space we need
-	// for the native copies of the arguments.  The first type in the function 
-	// signature is the return type, so skip that.
-	MarshallStackArgSizer stackSizer(&argvSig, argv, argc, firstDllArg);
-
-	// the remaining items in the signature are the argument types - size them
-	if (!stackSizer.Marshall())
+	// Get the native argument array size.  The plan has the size ready
+	// unless it depends on the argument values, in which case we have
+	// to measure the actual arguments.
+	size_t argArraySize = plan->argArraySize;
+	if (!plan->sizeIsStatic && !SizeDllCallArgs(argArraySize, nullptr, sigStr, plan->argvSigEnd, argv, argc, firstDllArg))
 		return inst->undefVal;
 
-	// Figure the required native argument array size
-	size_t argArraySize = max(stackSizer.nSlots, minArgSlots) * argSlotSize;
-
-	// round up to the next higher alignment boundary
-	argArraySize = ((argArraySize + stackAlign - 1) / stackAlign) * stackAlign;
-
 	// allocate the argument array
 	arg_t *argArray = static_cast<arg_t*>(alloca(argArraySize));
 
@@ -5185,16 +5764,8 @@ JsValueRef JavascriptEngine::DllImportCall(JsValueRef callee, bool isConstructCa
 		}
 		break;
 
-	case 'F':
-		return inst->Throw(_T("dllImport.call: __fastcall calling convention not supported"));
-
-	case 'T':
-		return inst->Throw(_T("dllImport.call: __thiscall calling convention not supported"));
-
-	case 'V':
-		return inst->Throw(_T("dllImport.call: __vectorcall calling convention not supported"));
-
 	default:
+		// CompileDllCallPlan() rejects the other calling conventions
 		return inst->Throw(_T("dllImport.call: unknown calling convention in function signature"));
 	}
 
@@ -5504,6 +6075,7 @@ JavascriptEngine::NativePointerData::NativePointerData(void *ptr, size_t size, S
 	// add me to the native pointer map, to keep the underlying native
 	// data block we reference alive in dead object scans
 	inst->nativePointerMap.emplace(this, static_cast<BYTE*>(ptr));
+	inst->NoteNativeWrite();
 }
 
 JavascriptEngine::NativePointerData::~NativePointerData()
@@ -7783,7 +8355,8 @@ JsValueRef CALLBACK JavascriptEngine::ScalarNativeTypeView::Setter(JsValueRef ca
 		// get the data view definition for this setter, from the context
 		auto view = static_cast<const ScalarNativeTypeView*>(ctx);
 
-		// call the virtual setter
+		// call the virtual setter, noting the write for the dead object scanner
+		inst->NoteNativeWrite();
 		view->Set(argv[0], obj->data + view->offset, argv[1]);
 	}
 
@@ -8052,6 +8625,7 @@ JavascriptEngine::NativeTypeWrapper::NativeTypeWrapper(SigParser *sig, size_t si
 			std::piecewise_construct,
 			std::forward_as_tuple(data),
 			std::forward_as_tuple(data, size, this->sig));
+		inst->NoteNativeWrite();
 	}
 	else
 	{
@@ -8254,6 +8828,15 @@ JsValueRef CALLBACK JavascriptEngine::NativeTypeWrapper::AddressOf(JsValueRef ca
 
 void JavascriptEngine::ScheduleDeadObjectScan()
 {
+	// If a pass is already in progress, it might have already traced the
+	// object that triggered this request, so note that we need another
+	// pass when the current one finishes.
+	if (deadObjectScan.active)
+	{
+		deadObjectScan.rescan = true;
+		return;
+	}
+
 	// if a scan isn't already scheduled, schedule one
 	if (!deadObjectScanPending)
 	{
@@ -8271,63 +8854,118 @@ void JavascriptEngine::ScheduleDeadObjectScan()
 	}
 }
 
-void JavascriptEngine::DeadObjectScan()
+void JavascriptEngine::StartDeadObjectScanPass()
 {
-	// we no longer have a pending scan
-	deadObjectScanPending = false;
+	// reset the pass state
+	auto &s = deadObjectScan;
+	s.active = true;
+	s.writeSeq = nativeWriteSeq;
+	s.restarts = 0;
+	s.workQueue.clear();
+	s.slot = 0;
+	s.rescan = false;
 
 	// Build the root set of the scan as the objects reachable from Javascript.
-	std::list<std::pair<BYTE*, NativeDataTracker&>> workQueue;
+	// Count the orphans along the way.
+	size_t orphans = 0;
 	for (auto &it : nativeDataMap)
 	{
 		if ((it.second.isReferenced = it.second.isWrapperAlive) != false)
-			workQueue.emplace_back(it.first, it.second);
+			s.workQueue.emplace_back(&it.second);
+		else
+			++orphans;
 	}
 
-	// trace a pointer
-	auto Trace = [this, &workQueue](BYTE *ptr)
+	// If there are no orphans, nothing can be freed, so there's no need
+	// to trace anything.  This is the common case when the scan was
+	// triggered by a NativePointer going away.
+	if (orphans == 0)
 	{
-		// get the matching element in the map, or the element at the
-		// next higher memory address if there isn't an exact match
-		auto &it = nativeDataMap.lower_bound(ptr);
+		s.workQueue.clear();
+		return;
+	}
 
-		// Check what we found
-		if (it == nativeDataMap.end() || it->first != ptr)
-		{
-			// We didn't match, so lower_bound() will have given us the item
-			// at the next higher address.  Back up to the previous item if
-			// we're not already at the first item.
-			if (it != nativeDataMap.begin())
-				it--;
-		}
+	// Trace references from NativePointer objects
+	for (auto &it : nativePointerMap)
+		DeadObjectScanTrace(it.second);
+}
 
-		// if we have a valid item, check to see if our pointer is within
-		// its bounds
-		if (it != nativeDataMap.end() && ptr >= it->first && ptr < it->first + it->second.size)
+void JavascriptEngine::DeadObjectScanTrace(BYTE *ptr)
+{
+	// get the matching element in the map, or the element at the
+	// next higher memory address if there isn't an exact match
+	auto it = nativeDataMap.lower_bound(ptr);
+
+	// Check what we found
+	if (it == nativeDataMap.end() || it->first != ptr)
+	{
+		// We didn't match, so lower_bound() will have given us the item
+		// at the next higher address.  Back up to the previous item if
+		// we're not already at the first item.
+		if (it != nativeDataMap.begin())
+			it--;
+	}
+
+	// if we have a valid item, check to see if our pointer is within
+	// its bounds
+	if (it != nativeDataMap.end() && ptr >= it->first && ptr < it->first + it->second.size)
+	{
+		// This looks like a pointer into this object.  If the object isn't
+		// already marked as referenced, so mark it, and add it to the work
+		// queue so that we can scan its contents the same way.
+		if (!it->second.isReferenced)
 		{
-			// This looks like a pointer into this object.  If the object isn't
-			// already marked as referenced, so mark it, and add it to the work
-			// queue so that we can scan its contents the same way.
-			if (!it->second.isReferenced)
-			{
-				it->second.isReferenced = true;
-				workQueue.emplace_back(it->first, it->second);
-			}
+			it->second.isReferenced = true;
+			deadObjectScan.workQueue.emplace_back(&it->second);
 		}
+	}
+}
+
+bool JavascriptEngine::DeadObjectScanSlice()
+{
+	// note the starting time, for the slice budget and statistics
+	LARGE_INTEGER t0, freq;
+	QueryPerformanceCounter(&t0);
+	QueryPerformanceFrequency(&freq);
+	auto ElapsedMs = [&t0, &freq]()
+	{
+		LARGE_INTEGER t1;
+		QueryPerformanceCounter(&t1);
+		return static_cast<double>(t1.QuadPart - t0.QuadPart) * 1000.0 / static_cast<double>(freq.QuadPart);
+	};
+	auto EndSlice = [this, &ElapsedMs]()
+	{
+		double ms = ElapsedMs();
+		deadObjectScanStats.slices += 1;
+		deadObjectScanStats.totalMs += ms;
+		deadObjectScanStats.maxSliceMs = max(deadObjectScanStats.maxSliceMs, ms);
 	};
 
-	// Trace references from NativePointer objects
-	for (auto &it : nativePointerMap)
-		Trace(it.second);
+	// Start a new pass if one isn't already under way.  If native memory
+	// might have been written since the pass started, our marks could be
+	// stale, so start over.
+	auto &s = deadObjectScan;
+	if (!s.active)
+		StartDeadObjectScanPass();
+	else if (s.writeSeq != nativeWriteSeq)
+	{
+		int restarts = s.restarts + 1;
+		deadObjectScanStats.restarts += 1;
+		StartDeadObjectScanPass();
+		s.restarts = restarts;
+	}
+
+	// Limit the slice to the time budget, unless we've had to restart
+	// too many times, in which case we finish the pass now.
+	bool bounded = s.restarts < deadObjectScanMaxRestarts;
 
 	// Process the work queue
-	while (workQueue.size() != 0)
+	while (s.workQueue.size() != 0)
 	{
-		// get the bounds of the first element
-		auto &qEle = workQueue.front();
-		BYTE *base = qEle.first;
-		BYTE **p = reinterpret_cast<BYTE**>(base);
-		BYTE **endp = reinterpret_cast<BYTE**>(base + qEle.second.size);
+		// get the bounds of the first element, resuming where we left off
+		NativeDataTracker *t = s.workQueue.front();
+		BYTE **p = reinterpret_cast<BYTE**>(t->data) + s.slot;
+		BYTE **endp = reinterpret_cast<BYTE**>(t->data + t->size);
 
 		// Scan it as an array of pointers.  Pointers will always be aligned
 		// on pointer-size boundaries, so we don't need to worrry about other
@@ -8336,14 +8974,22 @@ void JavascriptEngine::DeadObjectScan()
 		// is because the overall memory block might *not* be aligned on the
 		// pointer size, so we could have a partial last slot.  The odd test
 		// ensures that we have at least one whole slot left to inspect.
-		for (; p + 1 <= endp; ++p)
+		for (; p + 1 <= endp; ++p, ++s.slot)
 		{
+			// check the time budget every so often
+			if (bounded && (s.slot & 0xFF) == 0xFF && ElapsedMs() >= deadObjectScanSliceMs)
+			{
+				EndSlice();
+				return true;
+			}
+
 			// try tracing what's in this slot as a pointer
-			Trace(*p);
+			DeadObjectScanTrace(*p);
 		}
 
 		// we're now done with this work queue element; remove it
-		workQueue.pop_front();
+		s.workQueue.pop_front();
+		s.slot = 0;
 	}
 
 	// All reachable objects should now be marked as referenced.  Objects not
@@ -8359,6 +9005,19 @@ void JavascriptEngine::DeadObjectScan()
 	// Delete the unreachable objects
 	for (auto &it : deadList)
 		nativeDataMap.erase(it);
+
+	// the pass is done
+	s.active = false;
+	deadObjectScanPending = false;
+	deadObjectScanStats.passes += 1;
+	deadObjectScanStats.freed += deadList.size();
+	EndSlice();
+
+	// if another scan was requested during the pass, schedule it
+	if (s.rescan)
+		ScheduleDeadObjectScan();
+
+	return false;
 }
 
 JavascriptEngine::NativeDataTracker::~NativeDataTracker()
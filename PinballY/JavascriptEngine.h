@@ -7,12 +7,14 @@
 
 #pragma once
 #include <map>
+#include <deque>
 #include "../ChakraCore/include/ChakraCore.h"
 #include "../ChakraCore/include/ChakraDebug.h"
 #include "../ChakraCore/include/ChakraDebugService.h"
 #include "../ChakraCore/include/ChakraDebugProtocolHandler.h"
 #include "../Utilities/DateUtil.h"
 #include "../Utilities/ComUtil.h"
+#include "Trace.h"
 
 extern "C" UINT64 JavascriptEngine_CallCallback(void *wrapper, void *argv);
 
@@ -102,6 +104,19 @@ public:
 	// Evaluate a script
 	bool EvalScript(const WCHAR *scriptText, const WCHAR *url, JsValueRef *returnVal, ErrorHandler &eh);
 
+	// Evaluate a script file.  This uses the bytecode cache (see
+	// ScriptBytecodeCache.h) to skip parsing the source when the file
+	// hasn't changed since the last time we loaded it.  The cache is
+	// bypassed when the debugger is active.
+	bool EvalScriptFile(const TCHAR *path, const WCHAR *url, ErrorHandler &eh);
+
+	// Get the runtime's current heap usage in bytes
+	size_t GetRuntimeMemoryUsage() const
+	{
+		size_t usage = 0;
+		return runtime != nullptr && JsGetRuntimeMemoryUsage(runtime, &usage) == JsNoError ? usage : 0;
+	}
+
 	// Load a module
 	bool LoadModule(const TCHAR *url, ErrorHandler &eh);
 
@@ -243,6 +258,68 @@ public:
 	// only write the exception to the log file.
 	JsErrorCode LogAndClearException(ErrorHandler *eh = nullptr, int msgid = 0);
 
+	// Profiling.  When profiling is enabled (with the /jsprofile command
+	// line option), we time each entry from native code into Javascript:
+	// event dispatch, task execution (timeouts, intervals, promises,
+	// module loading), and the filter, metafilter, and other callbacks
+	// that native code invokes directly.  Times are aggregated by entry
+	// category and handler, where the handler is identified by function
+	// name and source location, or by event class for event dispatch.
+	// Times are inclusive of any nested entries.  Any single call that
+	// takes longer than the budget is logged as it happens.  The summary
+	// is written to the log file when the engine shuts down, and can be
+	// retrieved from Javascript via console.getProfile().  The summary
+	// also includes the dead native object scanner's statistics, which
+	// are collected whether or not profiling is enabled.
+	//
+	// The flags are set from the command line before Init().  When
+	// profiling is off, a ProfileScope costs a flag test.  Profile
+	// scopes are also written to the performance trace (see Trace.h)
+	// when tracing is active, whether or not profiling is enabled.
+	static bool profilingEnabled;
+	static double profileBudget;
+
+	// Profile scope.  Create one of these on the stack around a call into
+	// Javascript to time the call.  'category' must be a static string
+	// describing the type of entry; 'func' is the Javascript function
+	// being called, if known, which we use to identify the handler, and
+	// 'detail' is an optional additional description.
+	class ProfileScope
+	{
+	public:
+		ProfileScope(const CHAR *category, JsValueRef func, const WCHAR *detail = nullptr) :
+			category(category), func(func), detail(detail), active((profilingEnabled || Trace::IsEnabled()) && inst != nullptr),
+			heartbeatSlot(Trace::PushHeartbeatScope(category, "js", detail))
+		{
+			if (active)
+				QueryPerformanceCounter(&t0);
+		}
+
+		~ProfileScope()
+		{
+			Trace::PopHeartbeatScope(heartbeatSlot);
+			if (active)
+				inst->EndProfileScope(*this);
+		}
+
+	protected:
+		friend class JavascriptEngine;
+		const CHAR *category;
+		JsValueRef func;
+		const WCHAR *detail;
+		bool active;
+		LARGE_INTEGER t0;
+		int heartbeatSlot;
+	};
+
+	// Get the profile summary as a Javascript object, and reset the
+	// profile counters
+	JsValueRef GetProfileSummary();
+	void ResetProfile();
+
+	// Write the profile summary to the log file
+	void LogProfile();
+
 	// Queued task - timeout, interval, promise completion, module ready, etc
 	struct Task;
 
@@ -255,7 +332,14 @@ public:
 	// Enumerate tasks.  The predicate returns true to continue the enumeration.
 	void EnumTasks(std::function<bool(Task *)>);
 
-	bool IsTaskPending() const { return taskQueue.size() != 0; }
+	// Find a task by ID.  Returns null if there's no such task in the queue.
+	Task *FindTask(double id);
+
+	// Cancel a task.  This marks the task as canceled; it's removed from
+	// the queue the next time the queue processor reaches it.
+	void CancelTask(Task *task);
+
+	bool IsTaskPending() const { return readyTasks.size() != 0 || timerTasks.size() != 0; }
 
 	// Get the scheduled time of the next task.  This is the time in terms
 	// of GetTickCount64() for the next task ready to execute.  This can be
@@ -263,7 +347,10 @@ public:
 	ULONGLONG GetNextTaskTime();
 
 	// Run ready scheduled tasks.  Returns true if any tasks were executed,
-	// false if nothing was ready to run.
+	// false if nothing was ready to run.  This stops after a time limit
+	// (maxRunTasksTime) if there's a lot to do, leaving the remaining
+	// ready tasks for the next timer event, so that a busy script can't
+	// starve the UI.
 	bool RunTasks();
 
 	class CallException : public std::exception 
@@ -307,6 +394,21 @@ public:
 	template<> static WSTRING DefaultReturnValue<WSTRING>() { return L""; }
 	template<> static DateTime DefaultReturnValue<DateTime>() { return DateTime(FILETIME{ 0, 0 }); }
 
+	// Get a property ID by name.  On the main engine thread, this uses
+	// the engine-wide cache, so that hot paths (event dispatch, JsObj
+	// property access) don't have to convert and look up the name on
+	// every call.  Property IDs belong to a runtime, so this must not
+	// be used on another runtime's thread (e.g., a worker).
+	static JsErrorCode GetPropertyId(const CHAR *name, JsPropertyIdRef *propId);
+
+	// Get an interned Javascript string.  This returns the same string
+	// value for each call with the same text, for strings that are
+	// passed frequently to Javascript, such as command and key names in
+	// event arguments.  Javascript strings are immutable, so sharing a
+	// single instance is invisible to scripts.  Returns undefined on
+	// error.
+	JsValueRef GetInternedString(const WCHAR *str);
+
 	// is a value undefined or null?
 	static bool IsUndefinedOrNull(JsValueRef jsval) 
 	{
@@ -492,7 +594,7 @@ public:
 		JsValueRef propNames, lenval;
 		int len;
 		if ((err = JsGetOwnPropertyNames(jsval, &propNames)) != JsNoError
-			|| (err = JsCreatePropertyId("length", 6, &propid)) != JsNoError
+			|| (err = GetPropertyId("length", &propid)) != JsNoError
 			|| (err = JsGetProperty(propNames, propid, &lenval)) != JsNoError
 			|| (err = JsNumberToInt(lenval, &len)) != JsNoError)
 			throw CallException("JsToNative<map> error", err);
@@ -523,7 +625,7 @@ public:
 		JsPropertyIdRef propid;
 		JsValueRef lenval;
 		int len;
-		if ((err = JsCreatePropertyId("length", 6, &propid)) != JsNoError
+		if ((err = GetPropertyId("length", &propid)) != JsNoError
 			|| (err = JsGetProperty(jsval, propid, &lenval)) != JsNoError
 			|| (err = JsNumberToInt(lenval, &len)) != JsNoError)
 			throw CallException("JsToNative<vector> error", err);
@@ -624,7 +726,7 @@ public:
 			JsErrorCode err;
 			JsPropertyIdRef propkey;
 			bool hasProp;
-			return ((err = JsCreatePropertyId(name, strlen(name), &propkey)) == JsNoError
+			return ((err = GetPropertyId(name, &propkey)) == JsNoError
 				&& (err = JsHasProperty(jsobj, propkey, &hasProp)) == JsNoError
 				&& hasProp);
 		}
@@ -637,7 +739,7 @@ public:
 			JsValueRef propval;
 			JsValueType type;
 			JsErrorCode err;
-			if ((err = JsCreatePropertyId(name, strlen(name), &propkey)) != JsNoError
+			if ((err = GetPropertyId(name, &propkey)) != JsNoError
 				|| (err = JsGetProperty(jsobj, propkey, &propval)) != JsNoError
 				|| (err = JsGetValueType(propval, &type)) != JsNoError)
 				throw CallException("JsObj::Get()", err);
@@ -676,7 +778,7 @@ public:
 
 			JsErrorCode err;
 			JsPropertyIdRef propkey;
-			if ((err = JsCreatePropertyId(name, strlen(name), &propkey)) != JsNoError
+			if ((err = GetPropertyId(name, &propkey)) != JsNoError
 				|| (err = JsSetProperty(jsobj, propkey, NativeToJs(val), true)) != JsNoError)
 				throw CallException("JsObj::Set()", err);
 		}
@@ -933,7 +1035,7 @@ public:
 	{
 		JsErrorCode err;
 		JsPropertyIdRef propid;
-		if ((err = JsCreatePropertyId(prop, strlen(prop), &propid)) != JsNoError)
+		if ((err = GetPropertyId(prop, &propid)) != JsNoError)
 			throw CallException("CallMethod: creating property ID", err);
 
 		return CallMethod<ReturnType>(thisval, propid, args...);
@@ -980,6 +1082,9 @@ public:
 	{
 		try
 		{
+			// time the dispatch, by event class
+			ProfileScope profile("event", eventType);
+
 			// create the object, providing the reference to the caller
 			eventObj = CallNew(eventType, args...);
 
@@ -1805,6 +1910,13 @@ public:
 		// be discarded.
 		virtual bool Execute() = 0;
 
+		// Profiling information: the entry category, the Javascript
+		// function the task calls (if any), and an optional detail
+		// description
+		virtual const CHAR *ProfileCategory() const { return "task"; }
+		virtual JsValueRef ProfileFunc() const { return JS_INVALID_REFERENCE; }
+		virtual const WCHAR *ProfileDetail() const { return nullptr; }
+
 		// Each task is assigned a unique ID (serial number) at creation,
 		// to allow for identification in Javascript for purposes like
 		// clearTimeout().
@@ -1830,6 +1942,7 @@ public:
 	struct ModuleTask : Task
 	{
 		ModuleTask(JsModuleRecord module, const WSTRING &path) : module(module), path(path) { }
+		virtual const WCHAR *ProfileDetail() const override { return path.c_str(); }
 
 		JsModuleRecord module;
 		WSTRING path;
@@ -1840,6 +1953,7 @@ public:
 	{
 		ModuleParseTask(JsModuleRecord module, const WSTRING &path) : ModuleTask(module, path) { }
 		virtual bool Execute() override;
+		virtual const CHAR *ProfileCategory() const override { return "module parse"; }
 	};
 
 	// Module eval task
@@ -1847,11 +1961,14 @@ public:
 	{
 		ModuleEvalTask(JsModuleRecord module, const WSTRING &path) : ModuleTask(module, path) { }
 		virtual bool Execute() override;
+		virtual const CHAR *ProfileCategory() const override { return "module eval"; }
 	};
 
 	// Engine idle task
 	struct IdleTask : Task
 	{
+		virtual const CHAR *ProfileCategory() const override { return "engine idle"; }
+
 		virtual bool Execute()
 		{
 			// perform idle tasks
@@ -1883,6 +2000,8 @@ public:
 		// execute the task
 		virtual bool Execute() override;
 
+		virtual JsValueRef ProfileFunc() const override { return func; }
+
 		// the function to call when the event fires
 		JsValueRef func;
 	};
@@ -1891,6 +2010,7 @@ public:
 	struct PromiseTask : EventTask
 	{
 		PromiseTask(JsValueRef func) : EventTask(func) { }
+		virtual const CHAR *ProfileCategory() const override { return "promise"; }
 	};
 
 	// Timeout task
@@ -1900,6 +2020,8 @@ public:
 		{
 			readyTime = GetTickCount64() + (ULONGLONG)dt;
 		}
+
+		virtual const CHAR *ProfileCategory() const override { return "timeout"; }
 	};
 
 	// Interval task
@@ -1910,6 +2032,8 @@ public:
 			readyTime = GetTickCount64() + (ULONGLONG)dt;
 		}
 
+		virtual const CHAR *ProfileCategory() const override { return "interval"; }
+
 		virtual bool Execute() override
 		{
 			// do the basic execution
@@ -1928,7 +2052,9 @@ public:
 		double dt;
 	};
 	
-	// dead native object scan task
+	// Dead native object scan task.  Each execution does one bounded
+	// slice of the scan; the task stays scheduled until the scan pass
+	// is complete.
 	struct DeadObjectScanTask : Task
 	{
 		DeadObjectScanTask(ULONG dt_ms)
@@ -1936,10 +2062,21 @@ public:
 			readyTime = GetTickCount64() + dt_ms;
 		}
 
+		virtual const CHAR *ProfileCategory() const override { return "dead object scan"; }
+
 		virtual bool Execute() override 
 		{ 
-			inst->DeadObjectScan(); 
-			return false; // this is a one-shot task
+			// Run a slice; if the pass isn't finished, run the next slice
+			// on the next task pass.  Schedule it a tick into the future:
+			// a rescheduled timed task is held for the next pass anyway
+			// (see RunTasks()), but this also keeps the next slice from
+			// being due at the start of that pass, ahead of timers that
+			// were waiting.
+			if (!inst->DeadObjectScanSlice())
+				return false;
+
+			readyTime = GetTickCount64() + 1;
+			return true;
 		}
 	};
 
@@ -2100,6 +2237,31 @@ protected:
 	// global singleton instance
 	static JavascriptEngine *inst;
 
+	// Profile data.  Each entry aggregates the calls for one category and
+	// handler; the map key combines the two.
+	struct ProfileEntry
+	{
+		const CHAR *category = nullptr;
+		WSTRING handler;
+		UINT64 calls = 0;
+		double totalMs = 0.0;
+		double maxMs = 0.0;
+		UINT64 overBudget = 0;
+	};
+	std::unordered_map<WSTRING, ProfileEntry> profileEntries;
+
+	// Handler labels for the functions we've profiled.  We keep a
+	// reference on each function in the table, so that a function's
+	// address can't be reused for a different function while the label
+	// is cached.
+	std::unordered_map<JsValueRef, WSTRING> profileFuncLabels;
+
+	// finish a profile scope, recording its time
+	void EndProfileScope(const ProfileScope &scope);
+
+	// get the handler label for a function
+	const WSTRING &GetProfileFuncLabel(JsValueRef func);
+
 	// instance initialization
 	bool InitInstance(ErrorHandler &eh, const MessageWindow &messageWindow, DebugOptions *debug);
 	bool inited = false;
@@ -2127,6 +2289,21 @@ protected:
 	// dispatchEvent property
 	JsPropertyIdRef dispatchEventProp;
 
+	// The thread that owns the runtime.  The engine is created on the
+	// main UI thread, and all Javascript in this runtime runs there.
+	DWORD mainThreadId = GetCurrentThreadId();
+
+	// Property ID cache, for GetPropertyId().  We hold a reference on
+	// each cached ID.  The cache is capped (maxPropIdCacheSize) in case
+	// a script generates an unbounded set of property names through
+	// native code; past the cap, we just create IDs on the fly.
+	std::unordered_map<CSTRING, JsPropertyIdRef> propIdCache;
+	static const size_t maxPropIdCacheSize = 4096;
+
+	// interned strings, for GetInternedString(), with the same capping
+	std::unordered_map<WSTRING, JsValueRef> internedStrings;
+	static const size_t maxInternedStrings = 4096;
+
 	// JS execution context.  This essentially is the container of the "global"
 	// javascript object (that is, the object at the root level of the js namespace
 	// that unqualified function and variable names attach to).
@@ -2200,8 +2377,91 @@ protected:
 	static JsErrorCode GetModuleSource(
 		WSTRING &filename, const WSTRING &specifier, const WSTRING &referencingSourceFile);
 
-	// task queue
-	std::list<std::unique_ptr<Task>> taskQueue;
+	// Resolved module specifiers.  Resolving a specifier means a file
+	// system lookup (to get the exact capitalization of the path, for
+	// the debugger's sake), and a helper module can be imported from
+	// many places, so we remember each resolution, keyed by the
+	// referencing source path and the specifier.  The result only
+	// depends on the file's name, so it stays valid across engine
+	// resets.  We only record resolutions for files that exist, since
+	// the canonical name of a missing file can't be determined yet.
+	struct ResolvedModule
+	{
+		WSTRING fname;               // normalized filename
+		WSTRING url;                 // canonical file URL
+	};
+	static std::unordered_map<WSTRING, ResolvedModule> resolvedModules;
+
+	// Module source registry.  This keeps the source text of each module
+	// we've loaded, keyed by the case-folded canonical path, along with
+	// the file stamp (size and modification time) and a content hash.
+	// The engine's module records belong to a single runtime, so an
+	// engine reset has to create and parse the modules again, but it
+	// can reuse the source text as long as the file stamp still matches,
+	// saving the file read and character set conversion.  The hash lets
+	// us tell when a module that looks changed is actually the same as
+	// the version we have, so that the reload log only reports genuine
+	// changes.  ChakraCore makes its own copy of the source when parsing
+	// a module, so the text can be shared freely.
+	//
+	// Note that ChakraCore has no serialized form for modules (see
+	// ScriptBytecodeCache.h), so the source still has to be parsed once
+	// per runtime.
+	struct ModuleSource
+	{
+		UINT64 size = 0;             // file size at last read
+		UINT64 time = 0;             // file modification time at last read
+		UINT64 hash = 0;             // content hash
+		std::shared_ptr<WCHAR> text; // source text
+		long len = 0;                // length of the text, in WCHARs
+	};
+	static std::unordered_map<WSTRING, ModuleSource> moduleSources;
+
+	// Get the source text for a module, from the registry if it's
+	// current, otherwise by reading the file.  Returns null if the file
+	// can't be read.
+	static const ModuleSource *GetModuleSourceText(const WCHAR *path, ErrorHandler &eh);
+
+	// Task queues.  Tasks that are ready to run when queued, such as
+	// promise continuations and module loads, go in a simple FIFO,
+	// which runs in order.  Tasks scheduled for a future time, such as
+	// timeouts and intervals, go in a min-heap ordered by ready time
+	// (and queuing order, for equal times), so that finding the next
+	// ready task doesn't require scanning the whole queue.  Canceled
+	// tasks are left in place and discarded when they reach the front;
+	// the heap is compacted if canceled tasks come to dominate it.
+	struct QueuedTask
+	{
+		std::unique_ptr<Task> task;
+		UINT64 seq;
+	};
+	std::deque<QueuedTask> readyTasks;
+	std::vector<QueuedTask> timerTasks;
+
+	// heap order for the timer queue: true if 'a' runs after 'b'
+	static bool TimerTaskAfter(const QueuedTask &a, const QueuedTask &b)
+	{
+		return a.task->readyTime > b.task->readyTime
+			|| (a.task->readyTime == b.task->readyTime && a.seq > b.seq);
+	}
+
+	// add a task to the appropriate queue
+	void EnqueueTask(std::unique_ptr<Task> &&task);
+
+	// discard canceled tasks from the front of the timer heap
+	void PopCanceledTimerTasks();
+
+	// next task queuing sequence number
+	UINT64 nextTaskSeq = 1;
+
+	// queued tasks by ID, for FindTask()
+	std::unordered_map<double, Task*> tasksById;
+
+	// number of tasks canceled since the last timer heap compaction
+	size_t canceledTasks = 0;
+
+	// maximum time for a RunTasks() pass, in milliseconds
+	static const ULONGLONG maxRunTasksTime = 20;
 
 	// next available task ID
 	double nextTaskID = 1.0;
@@ -2227,6 +2487,21 @@ protected:
 	};
 	std::list<SourceCookie> sourceCookies;
 
+	// Serialized scripts.  The engine references the source text and the
+	// bytecode of a script run with JsRunSerializedScript() directly, for
+	// the lifetime of the runtime, so we keep them here until the instance
+	// is destroyed.
+	struct SerializedScript
+	{
+		std::unique_ptr<WCHAR> source;
+		std::vector<BYTE> bytecode;
+	};
+	std::list<SerializedScript> serializedScripts;
+
+	// Check the result of running a script, logging any errors and
+	// thrown exceptions
+	bool CheckScriptResult(JsErrorCode err, const TCHAR *where, ErrorHandler &eh);
+
 	// List of Javascript callback wrappers.  We don't need to use this list
 	// while running; it's only needed so that we can delete the wrappers at
 	// window destruction time.
@@ -2251,6 +2526,45 @@ protected:
 	    { return LookUpNativeType(WSTRING(p, len), sig, silent); }
 	bool LookUpNativeType(const WSTRING &s, std::wstring_view &sig, bool silent = false);
 
+	// Compiled call plan for a DLL function signature.  DllImportCall()
+	// builds this on the first call through a binding, validating the
+	// signature and measuring the native argument array, and caches it
+	// on the DllImportData.  Later calls with the same signature reuse
+	// the plan, so that they go straight to marshalling the arguments.
+	struct DllCallPlan
+	{
+		bool Matches(const WCHAR *s, size_t len) const { return sig.length() == len && wmemcmp(sig.c_str(), s, len) == 0; }
+
+		// the signature the plan was compiled from
+		WSTRING sig;
+
+		// calling convention code (S, C, F, T, V)
+		WCHAR callConv = 0;
+
+		// end of the return value + argument vector portion of the
+		// signature, as an offset from the start of the signature
+		size_t argvSigEnd = 0;
+
+		// native argument array size, in bytes, including alignment
+		size_t argArraySize = 0;
+
+		// Is the argument array size independent of the argument values?
+		// This is false if the signature has by-value struct or union
+		// arguments, since a struct with a flexible array member takes its
+		// size from the actual value.  In that case we have to re-measure
+		// the arguments on each call.
+		bool sizeIsStatic = true;
+	};
+
+	// Compile a call plan.  Returns false, with a Javascript exception
+	// set, if the signature is invalid.
+	static bool CompileDllCallPlan(DllCallPlan &plan, const WCHAR *sigStr, size_t sigLen,
+		JsValueRef *argv, int argc, int firstDllArg);
+
+	// Measure the native argument array size for a call
+	static bool SizeDllCallArgs(size_t &argArraySize, bool *sizeIsStatic, const WCHAR *sigStr, size_t argvSigEnd,
+		JsValueRef *argv, int argc, int firstDllArg);
+
 	// External object data representing a DLL entrypoint.  We use this
 	// because there's no good way to represent a FARPROC in a Javascript
 	// native type, given that a FARPROC could be 64 bits.  The DLL and
@@ -2265,6 +2579,9 @@ protected:
 		FARPROC procAddr;
 		TSTRING dllName;
 		TSTRING funcName;
+
+		// cached call plan, compiled on the first call
+		std::unique_ptr<DllCallPlan> plan;
 	};
 
 	class SigParser;
@@ -3052,8 +3369,73 @@ protected:
 	// schedule a dead object scan
 	void ScheduleDeadObjectScan();
 
-	// Do a dead object scan
-	void DeadObjectScan();
+	// The dead object scan runs incrementally, in bounded time slices, so
+	// that a large native object population doesn't stall the UI thread.
+	// Between slices, Javascript can run and modify native memory, which
+	// could move a pointer from a block we haven't scanned yet into one
+	// we already have.  To keep the conservative trace sound, every path
+	// that can store into native memory (native object setters, argument
+	// marshalling, DLL calls, NativePointer creation, new allocations)
+	// bumps the native write sequence number.  If the sequence number
+	// changes between slices, the pass starts over.  After a few
+	// restarts, we finish the pass in a single slice, so that a script
+	// that's constantly writing native data can't starve the scan.
+	struct DeadObjectScanState
+	{
+		// is a pass in progress?
+		bool active = false;
+
+		// native write sequence number at the start of the pass
+		UINT64 writeSeq = 0;
+
+		// number of times the current pass has restarted
+		int restarts = 0;
+
+		// Blocks waiting to be scanned.  NativeDataTracker references are
+		// stable, since we only remove map entries in the final sweep.
+		std::deque<NativeDataTracker*> workQueue;
+
+		// pointer slot index of the next slot to scan in the front block
+		size_t slot = 0;
+
+		// has another scan been requested since this pass started?
+		bool rescan = false;
+	};
+	DeadObjectScanState deadObjectScan;
+
+	// slice time budget (milliseconds) and restart limit
+	static constexpr double deadObjectScanSliceMs = 2.0;
+	static const int deadObjectScanMaxRestarts = 4;
+
+	// native write sequence number
+	UINT64 nativeWriteSeq = 0;
+
+	// note a possible store into native memory
+	void NoteNativeWrite() { ++nativeWriteSeq; }
+
+	// Scan statistics, reported in the profile summary
+	struct DeadObjectScanStats
+	{
+		UINT64 passes = 0;       // completed passes
+		UINT64 slices = 0;       // slices executed
+		UINT64 restarts = 0;     // passes restarted due to native writes
+		UINT64 freed = 0;        // native blocks deleted
+		double totalMs = 0.0;    // total time in scan slices
+		double maxSliceMs = 0.0; // longest single slice
+	};
+	DeadObjectScanStats deadObjectScanStats;
+
+	// Do one slice of a dead object scan.  Returns true if the pass is
+	// still in progress, false when it's done.
+	bool DeadObjectScanSlice();
+
+	// start a new dead object scan pass
+	void StartDeadObjectScanPass();
+
+	// Trace a pointer for the dead object scan.  If the pointer points
+	// into an unmarked block in the native data map, this marks the block
+	// as referenced and adds it to the work queue.
+	void DeadObjectScanTrace(BYTE *ptr);
 
 
 	// Native type wrapper object.  This corresponds to the NativeObject
@@ -0,0 +1,567 @@
+// This file is part of PinballY
+// Copyright 2018 Michael J Roberts | GPL v3 or later | NO WARRANTY
+//
+// Javascript worker
+
+#include "stdafx.h"
+#include "../Utilities/FileUtil.h"
+#include "JavascriptWorker.h"
+#include "LogFile.h"
+
+JavascriptWorker::JavascriptWorker(int id, const WSTRING &scriptFile, HWND hwndNotify, UINT notifyMsg) :
+	id(id),
+	scriptFile(scriptFile),
+	hwndNotify(hwndNotify),
+	notifyMsg(notifyMsg)
+{
+}
+
+JavascriptWorker::~JavascriptWorker()
+{
+	// Stop the thread and wait for it to exit.  The wait has to be
+	// unbounded, since the thread uses this object until it returns.
+	// Terminate() interrupts any running script code, and the thread
+	// checks for the request between tasks, so it won't take long.
+	Terminate();
+	if (hThread != NULL)
+		WaitForSingleObject(hThread, INFINITE);
+}
+
+bool JavascriptWorker::Start()
+{
+	// create the wake event
+	hWakeEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
+	if (hWakeEvent == NULL)
+		return false;
+
+	// launch the thread
+	DWORD tid;
+	hThread = CreateThread(NULL, 0, &SThreadMain, this, 0, &tid);
+	return hThread != NULL;
+}
+
+void JavascriptWorker::PostToWorker(const WSTRING &json)
+{
+	CriticalSectionLocker locker(lock);
+	inbox.push_back(json);
+	if (hWakeEvent != NULL)
+		SetEvent(hWakeEvent);
+}
+
+void JavascriptWorker::Terminate()
+{
+	CriticalSectionLocker locker(lock);
+	terminateRequested = true;
+
+	// interrupt any running script code
+	if (runtime != nullptr)
+		JsDisableRuntimeExecution(runtime);
+
+	// wake up the thread so that it notices the request
+	if (hWakeEvent != NULL)
+		SetEvent(hWakeEvent);
+}
+
+void JavascriptWorker::GetMessages(std::list<Message> &messages)
+{
+	CriticalSectionLocker locker(lock);
+	messages.splice(messages.end(), outbox);
+}
+
+void JavascriptWorker::PostToMain(Message::Type type, const WSTRING &text)
+{
+	CriticalSectionLocker locker(lock);
+
+	// Notify the main window if this is the first message in the outbox.
+	// The window collects all of the pending messages when it handles the
+	// notification, so we only need one notification per batch.
+	bool notify = outbox.size() == 0;
+	outbox.push_back({ type, text });
+	if (notify)
+		PostMessage(hwndNotify, notifyMsg, 0, 0);
+}
+
+WSTRING JavascriptWorker::JsonStringify(JsValueRef val)
+{
+	JsErrorCode err;
+	JsValueRef global, json, stringify, result;
+	JsPropertyIdRef jsonProp, stringifyProp;
+	if ((err = JsGetGlobalObject(&global)) != JsNoError
+		|| (err = JsCreatePropertyId("JSON", 4, &jsonProp)) != JsNoError
+		|| (err = JsGetProperty(global, jsonProp, &json)) != JsNoError
+		|| (err = JsCreatePropertyId("stringify", 9, &stringifyProp)) != JsNoError
+		|| (err = JsGetProperty(json, stringifyProp, &stringify)) != JsNoError)
+		throw JavascriptEngine::CallException("JSON.stringify lookup", err);
+
+	JsValueRef argv[] = { json, val };
+	if ((err = JsCallFunction(stringify, argv, static_cast<unsigned short>(countof(argv)), &result)) != JsNoError)
+		throw JavascriptEngine::CallException("JSON.stringify", err);
+
+	// undefined (e.g., for a function value) stringifies as undefined;
+	// pass it as null
+	if (JavascriptEngine::IsUndefinedOrNull(result))
+		return L"null";
+
+	return JavascriptEngine::JsToNative<WSTRING>(result);
+}
+
+JsValueRef JavascriptWorker::JsonParse(const WSTRING &json)
+{
+	JsErrorCode err;
+	JsValueRef global, jsonObj, parse, str, result;
+	JsPropertyIdRef jsonProp, parseProp;
+	if ((err = JsGetGlobalObject(&global)) != JsNoError
+		|| (err = JsCreatePropertyId("JSON", 4, &jsonProp)) != JsNoError
+		|| (err = JsGetProperty(global, jsonProp, &jsonObj)) != JsNoError
+		|| (err = JsCreatePropertyId("parse", 5, &parseProp)) != JsNoError
+		|| (err = JsGetProperty(jsonObj, parseProp, &parse)) != JsNoError
+		|| (err = JsPointerToString(json.c_str(), json.length(), &str)) != JsNoError)
+		throw JavascriptEngine::CallException("JSON.parse lookup", err);
+
+	JsValueRef argv[] = { jsonObj, str };
+	if ((err = JsCallFunction(parse, argv, static_cast<unsigned short>(countof(argv)), &result)) != JsNoError)
+		throw JavascriptEngine::CallException("JSON.parse", err);
+
+	return result;
+}
+
+DWORD JavascriptWorker::ThreadMain()
+{
+	// create the runtime and context
+	JsRuntimeHandle rt;
+	if (JsErrorCode err = JsCreateRuntime(JsRuntimeAttributeAllowScriptInterrupt, nullptr, &rt); err != JsNoError)
+	{
+		PostToMain(Message::Type::Error, MsgFmt(_T("Error creating the worker runtime: %s"), JavascriptEngine::JsErrorToString(err)).Get());
+		PostToMain(Message::Type::Closed, L"");
+		return 0;
+	}
+	{
+		CriticalSectionLocker locker(lock);
+		runtime = rt;
+
+		// if termination was requested before we got here, interrupt immediately
+		if (terminateRequested)
+			JsDisableRuntimeExecution(runtime);
+	}
+
+	// Run the worker, in a scope of its own, so that everything that
+	// references Javascript objects is cleaned up before we dispose of
+	// the runtime
+	if (JsCreateContext(rt, &context) == JsNoError && JsSetCurrentContext(context) == JsNoError
+		&& JsSetPromiseContinuationCallback(&PromiseContinuation, this) == JsNoError
+		&& DefineGlobals())
+	{
+		// load the script
+		LogFile::Get()->Write(LogFile::JSLogging, _T("[Javascript] Worker %d: loading %ws\n"), id, scriptFile.c_str());
+		long len;
+		LogFileErrorHandler eh(_T("[Javascript] Worker: "), LogFile::JSLogging);
+		std::unique_ptr<WCHAR> contents(ReadFileAsWStr(scriptFile.c_str(), eh, len, ReadFileAsStr_NullTerm));
+		if (contents == nullptr)
+		{
+			PostToMain(Message::Type::Error, MsgFmt(_T("Unable to load worker script %ws"), scriptFile.c_str()).Get());
+		}
+		else
+		{
+			// run the script's top level
+			WSTRING url = JavascriptEngine::GetFileUrl(scriptFile.c_str());
+			JsValueRef result;
+			if (JsRunScript(contents.get(), 0, url.c_str(), &result) != JsNoError)
+				ReportException();
+			RunPromiseTasks();
+
+			// process messages and timers until the script closes or we're terminated
+			for (;;)
+			{
+				// check for termination
+				{
+					CriticalSectionLocker locker(lock);
+					if (terminateRequested)
+						break;
+				}
+				if (closing)
+					break;
+
+				// deliver the incoming messages
+				std::deque<WSTRING> messages;
+				{
+					CriticalSectionLocker locker(lock);
+					messages.swap(inbox);
+				}
+				for (auto &m : messages)
+				{
+					JsValueRef global, handler;
+					JsPropertyIdRef prop;
+					JsGetGlobalObject(&global);
+					JsCreatePropertyId("onmessage", 9, &prop);
+					if (JsGetProperty(global, prop, &handler) == JsNoError && !JavascriptEngine::IsUndefinedOrNull(handler))
+					{
+						try
+						{
+							JsValueRef event, data;
+							JsPropertyIdRef dataProp;
+							if (JsCreateObject(&event) == JsNoError
+								&& JsCreatePropertyId("data", 4, &dataProp) == JsNoError)
+							{
+								data = JsonParse(m);
+								JsSetProperty(event, dataProp, data, true);
+								CallWorkerFunc(handler, event);
+							}
+						}
+						catch (JavascriptEngine::CallException exc)
+						{
+							ReportException();
+						}
+					}
+					RunPromiseTasks();
+				}
+
+				// run the timers that are ready
+				for (auto it = timers.begin(); it != timers.end() && !closing; )
+				{
+					ULONGLONG now = GetTickCount64();
+					if (it->readyTime > now)
+					{
+						++it;
+						continue;
+					}
+
+					// Call the function.  For an interval, reschedule it; for a
+					// timeout, remove it first, so that clearTimeout() within
+					// the callback doesn't find it.
+					JsValueRef func = it->func;
+					if (it->interval != 0)
+					{
+						it->readyTime = now + it->interval;
+						CallWorkerFunc(func, JS_INVALID_REFERENCE);
+						RunPromiseTasks();
+
+						// the callback might have modified the list, so start over
+						it = timers.begin();
+					}
+					else
+					{
+						timers.erase(it);
+						CallWorkerFunc(func, JS_INVALID_REFERENCE);
+						JsRelease(func, nullptr);
+						RunPromiseTasks();
+						it = timers.begin();
+					}
+				}
+
+				// wait for the next timer or an incoming message
+				DWORD timeout = INFINITE;
+				ULONGLONG now = GetTickCount64();
+				for (auto &t : timers)
+					timeout = min(timeout, t.readyTime > now ? static_cast<DWORD>(t.readyTime - now) : 0);
+				WaitForSingleObject(hWakeEvent, timeout);
+			}
+		}
+
+		// release the timers and pending promise tasks
+		for (auto &t : timers)
+			JsRelease(t.func, nullptr);
+		timers.clear();
+		for (auto &t : promiseTasks)
+			JsRelease(t, nullptr);
+		promiseTasks.clear();
+	}
+
+	// dispose of the runtime
+	{
+		CriticalSectionLocker locker(lock);
+		JsSetCurrentContext(JS_INVALID_REFERENCE);
+		JsDisposeRuntime(runtime);
+		runtime = nullptr;
+	}
+
+	// let the main context know we're done
+	LogFile::Get()->Write(LogFile::JSLogging, _T("[Javascript] Worker %d: exiting\n"), id);
+	PostToMain(Message::Type::Closed, L"");
+	return 0;
+}
+
+bool JavascriptWorker::DefineGlobals()
+{
+	JsValueRef global;
+	if (JsGetGlobalObject(&global) != JsNoError)
+		return false;
+
+	auto Define = [this](JsValueRef obj, const char *name, JsNativeFunction func)
+	{
+		JsValueRef funcObj;
+		JsPropertyIdRef prop;
+		return JsCreateFunction(func, this, &funcObj) == JsNoError
+			&& JsCreatePropertyId(name, strlen(name), &prop) == JsNoError
+			&& JsSetProperty(obj, prop, funcObj, true) == JsNoError;
+	};
+
+	// create the console object
+	JsValueRef console;
+	JsPropertyIdRef consoleProp;
+	if (JsCreateObject(&console) != JsNoError
+		|| JsCreatePropertyId("console", 7, &consoleProp) != JsNoError
+		|| JsSetProperty(global, consoleProp, console, true) != JsNoError)
+		return false;
+
+	return Define(global, "postMessage", &JsPostMessage)
+		&& Define(global, "close", &JsClose)
+		&& Define(global, "setTimeout", &JsSetTimeout)
+		&& Define(global, "setInterval", &JsSetInterval)
+		&& Define(global, "clearTimeout", &JsClearTimer)
+		&& Define(global, "clearInterval", &JsClearTimer)
+		&& Define(global, "readFile", &JsReadFile)
+		&& Define(console, "log", &JsConsoleLog);
+}
+
+void JavascriptWorker::CallWorkerFunc(JsValueRef func, JsValueRef arg)
+{
+	JsValueRef global, result;
+	JsGetGlobalObject(&global);
+	JsValueRef argv[] = { global, arg };
+	unsigned short argc = arg != JS_INVALID_REFERENCE ? 2 : 1;
+	if (JsCallFunction(func, argv, argc, &result) != JsNoError)
+		ReportException();
+}
+
+void JavascriptWorker::RunPromiseTasks()
+{
+	while (promiseTasks.size() != 0 && !closing)
+	{
+		JsValueRef task = promiseTasks.front();
+		promiseTasks.pop_front();
+		CallWorkerFunc(task, JS_INVALID_REFERENCE);
+		JsRelease(task, nullptr);
+	}
+}
+
+void JavascriptWorker::ReportException()
+{
+	// get and clear the exception; if there isn't one, there's nothing to report
+	bool hasExc = false;
+	JsValueRef exc;
+	if (JsHasException(&hasExc) != JsNoError || !hasExc || JsGetAndClearException(&exc) != JsNoError)
+		return;
+
+	// use the stack trace if available, otherwise the string value
+	WSTRING msg;
+	try
+	{
+		JsPropertyIdRef stackProp;
+		JsValueRef stack;
+		JsValueType type;
+		if (JsCreatePropertyId("stack", 5, &stackProp) == JsNoError
+			&& JsGetValueType(exc, &type) == JsNoError && type == JsError
+			&& JsGetProperty(exc, stackProp, &stack) == JsNoError
+			&& !JavascriptEngine::IsUndefinedOrNull(stack))
+			msg = JavascriptEngine::JsToNative<WSTRING>(stack);
+		else
+			msg = JavascriptEngine::JsToNative<WSTRING>(exc);
+	}
+	catch (JavascriptEngine::CallException)
+	{
+		msg = L"Unknown exception";
+	}
+
+	LogFile::Get()->Write(LogFile::JSLogging, _T("[Javascript] Worker %d: uncaught exception: %ws\n"), id, msg.c_str());
+	PostToMain(Message::Type::Error, msg);
+}
+
+JsValueRef CALLBACK JavascriptWorker::JsPostMessage(JsValueRef callee, bool isConstructCall, JsValueRef *argv, unsigned short argc, void *ctx)
+{
+	auto self = static_cast<JavascriptWorker*>(ctx);
+	JsValueRef undef;
+	JsGetUndefinedValue(&undef);
+	try
+	{
+		self->PostToMain(Message::Type::Data, argc >= 2 ? JsonStringify(argv[1]) : L"null");
+	}
+	catch (JavascriptEngine::CallException exc)
+	{
+		// JSON.stringify() failures leave the exception set for the caller
+	}
+	return undef;
+}
+
+JsValueRef CALLBACK JavascriptWorker::JsClose(JsValueRef callee, bool isConstructCall, JsValueRef *argv, unsigned short argc, void *ctx)
+{
+	static_cast<JavascriptWorker*>(ctx)->closing = true;
+	JsValueRef undef;
+	JsGetUndefinedValue(&undef);
+	return undef;
+}
+
+JsValueRef JavascriptWorker::AddTimer(JsValueRef *argv, unsigned short argc, bool repeat)
+{
+	// get the function and interval
+	JsValueRef ret;
+	JsValueType type;
+	if (argc < 2 || JsGetValueType(argv[1], &type) != JsNoError || type != JsFunction)
+	{
+		JsValueRef msg, exc;
+		JsPointerToString(L"setTimeout/setInterval: function required", 41, &msg);
+		JsCreateTypeError(msg, &exc);
+		JsSetException(exc);
+		JsGetUndefinedValue(&ret);
+		return ret;
+	}
+	double dt = argc >= 3 ? JavascriptEngine::JsToNative<double>(argv[2], 0.0) : 0.0;
+	if (dt < 0.0 || isnan(dt))
+		dt = 0.0;
+
+	// intervals must be at least 1ms, so that an interval can't starve the thread
+	ULONGLONG interval = repeat ? max(static_cast<ULONGLONG>(dt), 1ULL) : 0;
+
+	// add the timer
+	double id = nextTimerId++;
+	JsAddRef(argv[1], nullptr);
+	timers.push_back({ id, GetTickCount64() + static_cast<ULONGLONG>(dt), interval, argv[1] });
+
+	JsDoubleToNumber(id, &ret);
+	return ret;
+}
+
+JsValueRef CALLBACK JavascriptWorker::JsSetTimeout(JsValueRef callee, bool isConstructCall, JsValueRef *argv, unsigned short argc, void *ctx)
+{
+	return static_cast<JavascriptWorker*>(ctx)->AddTimer(argv, argc, false);
+}
+
+JsValueRef CALLBACK JavascriptWorker::JsSetInterval(JsValueRef callee, bool isConstructCall, JsValueRef *argv, unsigned short argc, void *ctx)
+{
+	return static_cast<JavascriptWorker*>(ctx)->AddTimer(argv, argc, true);
+}
+
+JsValueRef CALLBACK JavascriptWorker::JsClearTimer(JsValueRef callee, bool isConstructCall, JsValueRef *argv, unsigned short argc, void *ctx)
+{
+	auto self = static_cast<JavascriptWorker*>(ctx);
+	if (argc >= 2)
+	{
+		double id = JavascriptEngine::JsToNative<double>(argv[1], 0.0);
+		auto it = std::find_if(self->timers.begin(), self->timers.end(), [id](const Timer &t) { return t.id == id; });
+		if (it != self->timers.end())
+		{
+			JsRelease(it->func, nullptr);
+			self->timers.erase(it);
+		}
+	}
+
+	JsValueRef undef;
+	JsGetUndefinedValue(&undef);
+	return undef;
+}
+
+JsValueRef CALLBACK JavascriptWorker::JsReadFile(JsValueRef callee, bool isConstructCall, JsValueRef *argv, unsigned short argc, void *ctx)
+{
+	JsValueRef ret;
+	JsGetUndefinedValue(&ret);
+	if (argc < 2)
+		return ret;
+
+	try
+	{
+		// read the file
+		WSTRING path = JavascriptEngine::JsToNative<WSTRING>(argv[1]);
+		long len;
+		CapturingErrorHandler eh;
+		std::unique_ptr<WCHAR> contents(ReadFileAsWStr(path.c_str(), eh, len, 0));
+		if (contents == nullptr)
+		{
+			// throw an error with the file error message
+			WSTRING msg = MsgFmt(_T("readFile: unable to read %ws"), path.c_str()).Get();
+			JsValueRef msgval, exc;
+			JsPointerToString(msg.c_str(), msg.length(), &msgval);
+			JsCreateError(msgval, &exc);
+			JsSetException(exc);
+			return ret;
+		}
+
+		// return the contents as a string
+		JsPointerToString(contents.get(), len, &ret);
+	}
+	catch (JavascriptEngine::CallException)
+	{
+	}
+	return ret;
+}
+
+JsValueRef CALLBACK JavascriptWorker::JsConsoleLog(JsValueRef callee, bool isConstructCall, JsValueRef *argv, unsigned short argc, void *ctx)
+{
+	// concatenate the arguments, space-separated
+	WSTRING msg;
+	for (unsigned short i = 1; i < argc; ++i)
+	{
+		if (i > 1)
+			msg += L" ";
+		try
+		{
+			msg += JavascriptEngine::JsToNative<WSTRING>(argv[i]);
+		}
+		catch (JavascriptEngine::CallException)
+		{
+			msg += L"?";
+		}
+	}
+
+	auto self = static_cast<JavascriptWorker*>(ctx);
+	LogFile::Get()->Write(LogFile::JSLogging, _T("[Javascript] Worker %d: %ws\n"), self->id, msg.c_str());
+
+	JsValueRef undef;
+	JsGetUndefinedValue(&undef);
+	return undef;
+}
+
+void CALLBACK JavascriptWorker::PromiseContinuation(JsValueRef task, void *ctx)
+{
+	// queue the task, keeping a reference on it until it runs
+	JsAddRef(task, nullptr);
+	static_cast<JavascriptWorker*>(ctx)->promiseTasks.push_back(task);
+}
+
+JavascriptWorker::MessageTask::MessageTask(JsValueRef workerObj, const Message &msg) :
+	workerObj(workerObj),
+	msg(msg)
+{
+	JsAddRef(workerObj, nullptr);
+}
+
+JavascriptWorker::MessageTask::~MessageTask()
+{
+	JsRelease(workerObj, nullptr);
+}
+
+bool JavascriptWorker::MessageTask::Execute()
+{
+	// figure the handler for the message type
+	const CHAR *handlerName = msg.type == Message::Type::Data ? "onmessage" :
+		msg.type == Message::Type::Error ? "onerror" : "onclose";
+
+	auto js = JavascriptEngine::Get();
+	try
+	{
+		// get the handler; if there isn't one, ignore the message
+		JavascriptEngine::JsObj obj(workerObj);
+		JsValueRef handler = obj.Get<JsValueRef>(handlerName);
+		if (js->IsFalsy(handler))
+			return false;
+
+		// build the event object
+		auto event = JavascriptEngine::JsObj::CreateObject();
+		event.Set("target", workerObj);
+		if (msg.type == Message::Type::Data)
+			event.Set("data", JsonParse(msg.text));
+		else if (msg.type == Message::Type::Error)
+			event.Set("message", msg.text);
+
+		// call the handler
+		JsValueRef argv[] = { workerObj, event.jsobj }, result;
+		JsCallFunction(handler, argv, static_cast<unsigned short>(countof(argv)), &result);
+		if (js->HasException())
+			js->LogAndClearException();
+	}
+	catch (JavascriptEngine::CallException exc)
+	{
+		exc.Log(_T("Worker message handler"));
+	}
+
+	// this is a one-shot task
+	return false;
+}
@@ -0,0 +1,183 @@
+// This file is part of PinballY
+// Copyright 2018 Michael J Roberts | GPL v3 or later | NO WARRANTY
+//
+// Javascript worker
+//
+// A worker runs a script in its own ChakraCore runtime, on a background
+// thread, so that long-running work (parsing a large data file, say, or
+// computing statistics over the game list) doesn't block rendering and
+// input on the main UI thread.  This is modeled on the Web Worker API.
+//
+// The worker's native surface is deliberately small, since none of the
+// main context's objects can be touched from another thread:
+//
+//   postMessage(value)     - send a message to the main context
+//   onmessage = func       - handler for messages from the main context;
+//                            called with an event object { data }
+//   close()                - end the worker
+//   setTimeout/clearTimeout, setInterval/clearInterval
+//   readFile(path)         - read a text file, returning a string
+//   console.log(...)       - write to the log file
+//
+// Messages are passed as JSON text, so only JSON-compatible data can be
+// transferred, and each side parses each message into a fresh object.
+//
+// On the main side, messages from the worker are queued as Javascript
+// engine tasks (see MessageTask), so they're delivered through the same
+// task queue as timeouts and promise completions.  The worker thread
+// posts a notification message to the main window when it adds to its
+// outbox; the window handler then queues the tasks.
+
+#pragma once
+#include <deque>
+#include <list>
+#include "JavascriptEngine.h"
+
+class JavascriptWorker
+{
+public:
+	// Create a worker for the given script file.  The worker posts
+	// 'notifyMsg' to 'hwndNotify' when it has messages for the main
+	// context.  Call Start() to launch the thread.
+	JavascriptWorker(int id, const WSTRING &scriptFile, HWND hwndNotify, UINT notifyMsg);
+
+	// Destruction terminates the worker thread, if it's still running,
+	// and waits for it to exit.
+	~JavascriptWorker();
+
+	// launch the worker thread
+	bool Start();
+
+	// Send a message to the worker, as JSON text.  Called on the main
+	// thread.
+	void PostToWorker(const WSTRING &json);
+
+	// Terminate the worker.  This interrupts any script code running on
+	// the worker thread.
+	void Terminate();
+
+	// Message from the worker to the main context
+	struct Message
+	{
+		enum class Type
+		{
+			Data,     // postMessage() data, as JSON text
+			Error,    // uncaught error, with the error message text
+			Closed    // the worker has exited
+		};
+		Type type;
+		WSTRING text;
+	};
+
+	// Retrieve the pending messages from the worker.  Called on the main
+	// thread.
+	void GetMessages(std::list<Message> &messages);
+
+	// Main-context task to deliver a message to the Javascript worker
+	// object's onmessage, onerror, or onclose handler
+	struct MessageTask : JavascriptEngine::Task
+	{
+		MessageTask(JsValueRef workerObj, const Message &msg);
+		virtual ~MessageTask();
+		virtual bool Execute() override;
+		virtual const CHAR *ProfileCategory() const override { return "worker message"; }
+
+		JsValueRef workerObj;
+		Message msg;
+	};
+
+	// JSON conversions in the current context.  These throw
+	// JavascriptEngine::CallException on error.
+	static WSTRING JsonStringify(JsValueRef val);
+	static JsValueRef JsonParse(const WSTRING &json);
+
+	// worker ID, for the main context
+	int id;
+
+protected:
+	// thread entrypoint
+	static DWORD WINAPI SThreadMain(LPVOID param) { return static_cast<JavascriptWorker*>(param)->ThreadMain(); }
+	DWORD ThreadMain();
+
+	// set up the worker's global functions
+	bool DefineGlobals();
+
+	// run pending promise continuations
+	void RunPromiseTasks();
+
+	// call a function on the worker thread, reporting any exception
+	void CallWorkerFunc(JsValueRef func, JsValueRef arg);
+
+	// report the current exception on the worker thread to the main context
+	void ReportException();
+
+	// add a message to the outbox, and notify the main window
+	void PostToMain(Message::Type type, const WSTRING &text);
+
+	// native callbacks for the worker's global functions
+	static JsValueRef CALLBACK JsPostMessage(JsValueRef callee, bool isConstructCall, JsValueRef *argv, unsigned short argc, void *ctx);
+	static JsValueRef CALLBACK JsClose(JsValueRef callee, bool isConstructCall, JsValueRef *argv, unsigned short argc, void *ctx);
+	static JsValueRef CALLBACK JsSetTimeout(JsValueRef callee, bool isConstructCall, JsValueRef *argv, unsigned short argc, void *ctx);
+	static JsValueRef CALLBACK JsSetInterval(JsValueRef callee, bool isConstructCall, JsValueRef *argv, unsigned short argc, void *ctx);
+	static JsValueRef CALLBACK JsClearTimer(JsValueRef callee, bool isConstructCall, JsValueRef *argv, unsigned short argc, void *ctx);
+	static JsValueRef CALLBACK JsReadFile(JsValueRef callee, bool isConstructCall, JsValueRef *argv, unsigned short argc, void *ctx);
+	static JsValueRef CALLBACK JsConsoleLog(JsValueRef callee, bool isConstructCall, JsValueRef *argv, unsigned short argc, void *ctx);
+	static void CALLBACK PromiseContinuation(JsValueRef task, void *ctx);
+
+	// common handler for setTimeout and setInterval
+	JsValueRef AddTimer(JsValueRef *argv, unsigned short argc, bool repeat);
+
+	// script file
+	WSTRING scriptFile;
+
+	// notification window and message
+	HWND hwndNotify;
+	UINT notifyMsg;
+
+	//
+	// Worker thread state.  These are only accessed on the worker thread.
+	//
+
+	// worker context
+	JsContextRef context = JS_INVALID_REFERENCE;
+
+	// timers
+	struct Timer
+	{
+		double id;
+		ULONGLONG readyTime;
+		ULONGLONG interval;    // repeat interval for setInterval(), 0 for setTimeout()
+		JsValueRef func;
+	};
+	std::list<Timer> timers;
+	double nextTimerId = 1.0;
+
+	// pending promise continuations
+	std::deque<JsValueRef> promiseTasks;
+
+	// has the script called close()?
+	bool closing = false;
+
+	//
+	// Shared state.  These are protected by the lock.
+	//
+	CriticalSection lock;
+
+	// runtime handle; this is set while the runtime exists, so that the
+	// main thread can interrupt it
+	JsRuntimeHandle runtime = nullptr;
+
+	// messages from the main context to the worker, as JSON text
+	std::deque<WSTRING> inbox;
+
+	// messages from the worker to the main context
+	std::list<Message> outbox;
+
+	// has the main thread requested termination?
+	bool terminateRequested = false;
+
+	// thread handle, and the event that wakes the thread when a message
+	// arrives or termination is requested
+	HandleHolder hThread;
+	HandleHolder hWakeEvent;
+};
@@ -0,0 +1,97 @@
+// This file is part of PinballY
+// Copyright 2018 Michael J Roberts | GPL v3 or later | NO WARRANTY
+//
+// Game launch timeline
+
+#include "stdafx.h"
+#include <algorithm>
+#include "LaunchTimeline.h"
+#include "LogFile.h"
+
+// statics
+bool LaunchTimeline::active = false;
+int64_t LaunchTimeline::tOrigin = 0;
+int64_t LaunchTimeline::freq = 1;
+DWORD LaunchTimeline::mainThreadId = 0;
+std::vector<LaunchTimeline::Record> LaunchTimeline::records;
+CriticalSection LaunchTimeline::lock;
+
+void LaunchTimeline::Begin()
+{
+	CriticalSectionLocker locker(lock);
+	LARGE_INTEGER f;
+	QueryPerformanceFrequency(&f);
+	freq = f.QuadPart;
+	tOrigin = Trace::Now();
+	mainThreadId = GetCurrentThreadId();
+	records.clear();
+	active = true;
+}
+
+LaunchTimeline::Phase::Phase(const CHAR *name) :
+	trace(name, "launch"), name(name), t0(Trace::Now()), active(LaunchTimeline::active)
+{
+}
+
+void LaunchTimeline::Phase::End()
+{
+	if (active)
+	{
+		active = false;
+		AddRecord(name, t0, Trace::Now());
+	}
+	trace.End();
+}
+
+void LaunchTimeline::AddRecord(const CHAR *name, int64_t t0, int64_t t1)
+{
+	// Only keep phases that started within the current timeline.  A
+	// monitor thread left over from a prior launch could still be
+	// finishing its last phase when a new launch begins.
+	CriticalSectionLocker locker(lock);
+	if (active && t0 >= tOrigin)
+		records.push_back({ name, t0, t1, GetCurrentThreadId() });
+}
+
+void LaunchTimeline::Finish(const TCHAR *title)
+{
+	// stop recording, and take the records
+	std::vector<Record> recs;
+	{
+		CriticalSectionLocker locker(lock);
+		if (!active)
+			return;
+
+		active = false;
+		recs.swap(records);
+	}
+
+	// trace the overall launch time
+	int64_t tEnd = Trace::Now();
+	Trace::Interval("Launch timeline", "launch", tOrigin, tEnd, title);
+
+	// sort by starting time
+	std::stable_sort(recs.begin(), recs.end(), [](const Record &a, const Record &b) { return a.t0 < b.t0; });
+
+	// Log the timeline.  Along with the elapsed time, show the time that
+	// the UI thread spent in the listed phases, since that's the part of
+	// the launch that holds up the running game overlay.
+	auto lf = LogFile::Get();
+	double uiBusy_ms = 0.0;
+	for (auto &r : recs)
+	{
+		if (r.tid == mainThreadId)
+			uiBusy_ms += Ms(r.t1) - Ms(r.t0);
+	}
+	lf->Group();
+	lf->Write(_T("Launch timeline for %s: %.0f ms from Play to Running mode, %.0f ms in UI thread phases\n"),
+		title, Ms(tEnd), uiBusy_ms);
+	lf->Write(_T("     start        end   duration\n"));
+	for (auto &r : recs)
+	{
+		lf->Write(_T("  %9.1f  %9.1f  %9.1f  %hs%s\n"),
+			Ms(r.t0), Ms(r.t1), Ms(r.t1) - Ms(r.t0), r.name,
+			r.tid != mainThreadId ? _T(" [game monitor thread]") : _T(""));
+	}
+	lf->Group();
+}
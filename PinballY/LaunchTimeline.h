@@ -0,0 +1,98 @@
+// This file is part of PinballY
+// Copyright 2018 Michael J Roberts | GPL v3 or later | NO WARRANTY
+//
+// Game launch timeline
+//
+// This measures where the time goes between the user selecting Play and
+// the game window appearing.  A launch runs through a series of steps
+// split between the UI thread (saving files, the Javascript launch
+// events, shutting down DOF and the real DMD, setting up the running
+// game overlay) and the game monitor thread (the Run Before commands,
+// creating the process, waiting for it to start up, and finding its
+// window).  Each step is marked with a Phase object, which records its
+// start and end times relative to the start of the launch.
+//
+// The timeline starts when the launch is initiated, and is written to
+// the log when the playfield view switches to Running mode.  A launch
+// that fails or is canceled simply doesn't log; the next launch starts
+// a new timeline.
+//
+// Phases can overlap, since the two threads run concurrently, and the
+// GameLaunch.Overlap setting deliberately lets some of the UI thread
+// staging work run in parallel with the monitor thread's steps.  The
+// log shows the thread for each phase so that the overlap is visible.
+//
+// Phases are also written to the performance trace (see Trace.h).
+// Phase names must be static strings.
+
+#pragma once
+#include <stdint.h>
+#include <vector>
+#include "../Utilities/WinUtil.h"
+#include "Trace.h"
+
+class LaunchTimeline
+{
+public:
+	// Start a new timeline, discarding any unfinished prior timeline.
+	// Call this on the UI thread when initiating a launch.
+	static void Begin();
+
+	// Is a timeline being recorded?
+	static bool IsActive() { return active; }
+
+	// Launch phase.  Create one of these on the stack to time the
+	// enclosing scope (or until End() is called).  Phases outside of
+	// a launch are only traced.
+	class Phase
+	{
+	public:
+		Phase(const CHAR *name);
+		~Phase() { End(); }
+
+		// end the phase explicitly
+		void End();
+
+	protected:
+		Trace::Scope trace;
+		const CHAR *name;
+		int64_t t0;
+		bool active;
+	};
+
+	// Finish the timeline and write it to the log.  'title' is the game
+	// title for the log.  Call on the UI thread when the game is running.
+	static void Finish(const TCHAR *title);
+
+protected:
+	// recorded phase
+	struct Record
+	{
+		const CHAR *name;   // phase name
+		int64_t t0;         // start time, QPC ticks
+		int64_t t1;         // end time, QPC ticks
+		DWORD tid;          // thread ID
+	};
+
+	// add a record
+	static void AddRecord(const CHAR *name, int64_t t0, int64_t t1);
+
+	// convert QPC ticks to milliseconds from the start of the launch
+	static double Ms(int64_t t) { return static_cast<double>(t - tOrigin) * 1000.0 / static_cast<double>(freq); }
+
+	// are we recording?
+	static bool active;
+
+	// starting time and QPC frequency
+	static int64_t tOrigin;
+	static int64_t freq;
+
+	// UI thread ID
+	static DWORD mainThreadId;
+
+	// recorded phases
+	static std::vector<Record> records;
+
+	// lock, for phases recorded on the game monitor thread
+	static CriticalSection lock;
+};
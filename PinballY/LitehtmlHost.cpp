@@ -6,6 +6,7 @@
 
 #include "stdafx.h"
 #include "LitehtmlHost.h"
+#include "FontCache.h"
 
 // HRGN holder, for automatically deleting regions as they go out of scope
 struct HRGNHolder
@@ -52,6 +53,10 @@ LitehtmlHost::~LitehtmlHost()
 		DeleteObject(clipRegionStack.back());
 		clipRegionStack.pop_back();
 	}
+
+	// release the measuring context before its DC
+	measuringGraphics.reset();
+	measuringDC.reset();
 }
 
 
@@ -107,12 +112,27 @@ litehtml::uint_ptr LitehtmlHost::create_font(
 	litehtml::font_style italic,
 	unsigned int decoration, litehtml::font_metrics* fm) 
 {
-	// create the font, using a null HDC to create it for a DIB
-	int gpStyleBits = (weight >= 700 ? Gdiplus::FontStyleBold : Gdiplus::FontStyleRegular);
-	if (italic == litehtml::font_style::fontStyleItalic) gpStyleBits |= Gdiplus::FontStyleItalic;
-	if ((decoration & litehtml::font_decoration_underline) != 0) gpStyleBits |= Gdiplus::FontStyleUnderline;
-	if ((decoration & litehtml::font_decoration_linethrough) != 0) gpStyleBits |= Gdiplus::FontStyleStrikeout;
-	auto font = CreateGPFontPixHt(faceName, size, static_cast<Gdiplus::FontStyle>(gpStyleBits), NULL);
+	// Look for a cached font with the same descriptor.  Note that we
+	// key on the Gdiplus style bits rather than the raw litehtml values,
+	// since any weight from 700 up maps to the same bold font.
+	bool bold = weight >= 700;
+	bool isItalic = italic == litehtml::font_style::fontStyleItalic;
+	bool underline = (decoration & litehtml::font_decoration_underline) != 0;
+	bool strikeout = (decoration & litehtml::font_decoration_linethrough) != 0;
+	TSTRING key = MsgFmt(_T("%d.%d%d%d%d.%s"), size, bold, isItalic, underline, strikeout, faceName).Get();
+	if (auto it = fontCache.find(key); it != fontCache.end())
+	{
+		*fm = it->second.metrics;
+		it->second.refCnt += 1;
+		return reinterpret_cast<litehtml::uint_ptr>(it->second.font.get());
+	}
+
+	// get the font from the shared font cache, at the reference DIB dpi
+	int gpStyleBits = (bold ? Gdiplus::FontStyleBold : Gdiplus::FontStyleRegular);
+	if (isItalic) gpStyleBits |= Gdiplus::FontStyleItalic;
+	if (underline) gpStyleBits |= Gdiplus::FontStyleUnderline;
+	if (strikeout) gpStyleBits |= Gdiplus::FontStyleStrikeout;
+	auto font = FontCache::GetGPFontPixHt(faceName, size, static_cast<Gdiplus::FontStyle>(gpStyleBits));
 
 	// get the font family information
 	Gdiplus::FontFamily family;
@@ -149,14 +169,29 @@ litehtml::uint_ptr LitehtmlHost::create_font(
 	// and comparing against the true font metrics).
 	fm->x_height = static_cast<int>(font->GetSize() / 2.0f);
 
+	// add it to the cache
+	auto &entry = fontCache[key];
+	entry.font = font;
+	entry.metrics = *fm;
+	entry.refCnt = 1;
+
 	// cast the Gdiplus::Font pointer to an opaque uint_ptr to pass back to litehtml
-	return reinterpret_cast<litehtml::uint_ptr>(font);
+	return reinterpret_cast<litehtml::uint_ptr>(font.get());
 }
 
 void LitehtmlHost::delete_font(litehtml::uint_ptr hFont)
 {
-	// reinterpret the font handle as a Gdiplus::Font pointer, and delete the object
-	delete reinterpret_cast<Gdiplus::Font*>(hFont);
+	// The font belongs to the cache, so just release the document's
+	// reference.  We keep the object itself for reuse.
+	auto pFont = reinterpret_cast<Gdiplus::Font*>(hFont);
+	for (auto &f : fontCache)
+	{
+		if (f.second.font.get() == pFont)
+		{
+			f.second.refCnt -= 1;
+			break;
+		}
+	}
 }
 
 int LitehtmlHost::text_width(const litehtml::tchar_t* text, litehtml::uint_ptr hFont)
@@ -164,17 +199,31 @@ int LitehtmlHost::text_width(const litehtml::tchar_t* text, litehtml::uint_ptr h
 	// get the font
 	auto pFont = reinterpret_cast<Gdiplus::Font*>(hFont);
 
-	// set up a Gdiplus context on a memory DC
-	MemoryDC memdc;
-	Gdiplus::Graphics g(memdc);
+	// check for a cached measurement
+	TextWidthKey key{ pFont, text };
+	if (auto it = textWidthCache.find(key); it != textWidthCache.end())
+		return it->second;
+
+	// set up the Gdiplus measuring context on a memory DC, if we haven't already
+	if (measuringGraphics == nullptr)
+	{
+		measuringDC.reset(new MemoryDC());
+		measuringGraphics.reset(new Gdiplus::Graphics(*measuringDC));
+	}
 
 	// measure the bounding box of the string with origin 0,0
 	Gdiplus::PointF origin(0.0f, 0.0f);
 	Gdiplus::RectF bbox;
-	g.MeasureString(text, static_cast<INT>(_tcslen(text)), pFont, origin, measuringFormat.get(), &bbox);
+	measuringGraphics->MeasureString(text, static_cast<INT>(key.text.length()), pFont, origin, measuringFormat.get(), &bbox);
+
+	// cache the result
+	int w = static_cast<int>(bbox.Width);
+	if (textWidthCache.size() >= maxTextWidthCache)
+		textWidthCache.clear();
+	textWidthCache.emplace(std::move(key), w);
 
 	// return the width of the bounding box
-	return static_cast<int>(bbox.Width);
+	return w;
 }
 
 void LitehtmlHost::draw_text(litehtml::uint_ptr hdc, const litehtml::tchar_t* text, litehtml::uint_ptr hFont, litehtml::web_color color, const litehtml::position& pos)
@@ -104,6 +104,45 @@ protected:
 	// StringFormat for measuring text
 	std::unique_ptr<Gdiplus::StringFormat> measuringFormat;
 
+	// Measuring context.  litehtml calls text_width() once per word during
+	// layout, so we keep a memory DC and Gdiplus context around for the
+	// measurements rather than setting them up on every call.
+	std::unique_ptr<MemoryDC> measuringDC;
+	std::unique_ptr<Gdiplus::Graphics> measuringGraphics;
+
+	// Font cache.  litehtml creates a font for every distinct style in each
+	// document it parses, and deletes the fonts when the document is
+	// destroyed.  An overlay that's rebuilt on every update would thus
+	// recreate the same handful of fonts over and over, so we keep each
+	// font object (along with its metrics) for the lifetime of the host,
+	// and hand out the cached object for repeated descriptors.  The entry's
+	// reference count tracks live users, but we don't delete the font when
+	// the count reaches zero, since it's likely to be requested again.
+	struct FontCacheEntry
+	{
+		std::shared_ptr<Gdiplus::Font> font;
+		litehtml::font_metrics metrics;
+		int refCnt = 0;
+	};
+	std::unordered_map<TSTRING, FontCacheEntry> fontCache;
+
+	// Text width cache, keyed by font object and string.  The same words
+	// recur throughout a document, and the layout of an unchanged document
+	// measures exactly the same strings again, so this saves most of the
+	// MeasureString calls.  The cache is simply cleared when it gets big.
+	struct TextWidthKey
+	{
+		const Gdiplus::Font *font;
+		TSTRING text;
+		bool operator==(const TextWidthKey &other) const { return font == other.font && text == other.text; }
+	};
+	struct TextWidthKeyHash
+	{
+		size_t operator()(const TextWidthKey &key) const { return std::hash<TSTRING>()(key.text) ^ std::hash<const void*>()(key.font); }
+	};
+	std::unordered_map<TextWidthKey, int, TextWidthKeyHash> textWidthCache;
+	static const size_t maxTextWidthCache = 8192;
+
 	// Do we have any non-zero corner radii in a border_radiuses descriptor?
 	static bool IsNonZeroCornerRadii(const litehtml::border_radiuses &br)
 	{
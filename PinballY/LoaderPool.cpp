@@ -0,0 +1,148 @@
+// This file is part of PinballY
+// Copyright 2018 Michael J Roberts | GPL v3 or later | NO WARRANTY
+//
+// Loader thread pool
+
+#include "stdafx.h"
+#include "LoaderPool.h"
+
+// statics
+std::list<std::function<void()>> LoaderPool::queues[LoaderPool::nPriorities];
+size_t LoaderPool::queueDepth = 0;
+HandleHolder LoaderPool::hSemaphore;
+std::vector<HANDLE> LoaderPool::threads;
+bool LoaderPool::started = false;
+bool LoaderPool::shuttingDown = false;
+CriticalSection LoaderPool::lock;
+
+bool LoaderPool::Start()
+{
+	// if we've already started, there's nothing to do
+	if (started)
+		return threads.size() != 0;
+
+	// only try once
+	started = true;
+
+	// create the work semaphore
+	hSemaphore = CreateSemaphore(NULL, 0, LONG_MAX, NULL);
+	if (hSemaphore == NULL)
+		return false;
+
+	// Figure the pool size.  Use half of the logical processors, so that
+	// we leave room for the UI thread and the video decoders, but use at
+	// least two threads, so that one slow load doesn't hold up the rest,
+	// and no more than four, since the loads are mostly I/O bound anyway.
+	SYSTEM_INFO si;
+	GetSystemInfo(&si);
+	int nThreads = max(2, min(4, static_cast<int>(si.dwNumberOfProcessors) / 2));
+
+	// launch the threads
+	for (int i = 0; i < nThreads; ++i)
+	{
+		DWORD tid;
+		HANDLE hThread = CreateThread(NULL, 0, &ThreadMain, nullptr, CREATE_SUSPENDED, &tid);
+		if (hThread == NULL)
+			break;
+
+		// bump down the priority so that the loading doesn't glitch the UI
+		SetThreadPriority(hThread, THREAD_PRIORITY_BELOW_NORMAL);
+		ResumeThread(hThread);
+		threads.push_back(hThread);
+	}
+
+	// we're in business if we launched at least one thread
+	return threads.size() != 0;
+}
+
+bool LoaderPool::Submit(std::function<void()> task, Priority priority)
+{
+	CriticalSectionLocker locker(lock);
+
+	// refuse the task if we're shutting down, the queue is full, or
+	// the pool isn't running
+	if (shuttingDown || queueDepth >= maxQueueDepth || !Start())
+		return false;
+
+	// queue it, and wake a worker
+	queues[static_cast<int>(priority)].emplace_back(std::move(task));
+	++queueDepth;
+	ReleaseSemaphore(hSemaphore, 1, NULL);
+	return true;
+}
+
+size_t LoaderPool::GetQueueDepth()
+{
+	CriticalSectionLocker locker(lock);
+	return queueDepth;
+}
+
+size_t LoaderPool::GetThreadCount()
+{
+	CriticalSectionLocker locker(lock);
+	Start();
+	return threads.size();
+}
+
+void LoaderPool::Shutdown()
+{
+	// discard the pending tasks, and tell the threads to exit
+	{
+		CriticalSectionLocker locker(lock);
+		shuttingDown = true;
+		for (auto &q : queues)
+			q.clear();
+		queueDepth = 0;
+
+		// wake up all of the threads so that they see the exit flag
+		if (hSemaphore != NULL)
+			ReleaseSemaphore(hSemaphore, static_cast<LONG>(threads.size()), NULL);
+	}
+
+	// wait briefly for the running tasks to finish
+	if (threads.size() != 0)
+		WaitForMultipleObjects(static_cast<DWORD>(threads.size()), threads.data(), TRUE, 5000);
+
+	// close the thread handles
+	for (auto h : threads)
+		CloseHandle(h);
+	threads.clear();
+}
+
+DWORD WINAPI LoaderPool::ThreadMain(LPVOID)
+{
+	// the image loaders use WIC, which requires COM
+	CoInitializeEx(NULL, COINIT_MULTITHREADED);
+
+	for (;;)
+	{
+		// wait for work
+		WaitForSingleObject(hSemaphore, INFINITE);
+
+		// take the oldest task at the highest available priority
+		std::function<void()> task;
+		{
+			CriticalSectionLocker locker(lock);
+			if (shuttingDown)
+				break;
+
+			for (auto &q : queues)
+			{
+				if (q.size() != 0)
+				{
+					task = std::move(q.front());
+					q.pop_front();
+					--queueDepth;
+					break;
+				}
+			}
+		}
+
+		// run it
+		if (task)
+			task();
+	}
+
+	CoUninitialize();
+	return 0;
+}
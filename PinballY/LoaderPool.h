@@ -0,0 +1,85 @@
+// This file is part of PinballY
+// Copyright 2018 Michael J Roberts | GPL v3 or later | NO WARRANTY
+//
+// Loader thread pool
+//
+// This is a small, fixed-size pool of worker threads for background
+// media loading and other asynchronous work that used to launch a new
+// OS thread for every request.  When the wheel scrolls quickly, we can
+// start dozens of image loads per second, so it's much cheaper to keep
+// a few threads around and feed them from a queue.
+//
+// Tasks are queued by priority.  Workers always take the oldest task
+// at the highest priority available, so loads for the current game's
+// media go ahead of prefetch loads for the neighboring games.
+//
+// The queue is bounded.  If it's full, Submit() returns false, and the
+// caller should carry out the task inline instead.  That's the same
+// fallback the callers already used when a thread launch failed, so
+// it doesn't require any new error handling.
+//
+// The workers run at below-normal priority, so that loading doesn't
+// glitch the UI, and each is initialized for multithreaded COM, since
+// the image loaders use WIC.
+
+#pragma once
+#include <list>
+#include <vector>
+#include <functional>
+
+class LoaderPool
+{
+public:
+	// Task priorities, highest first
+	enum class Priority
+	{
+		High,		// media for the current selection
+		Normal,		// ordinary loads
+		Prefetch	// speculative loads for media that might be needed soon
+	};
+
+	// Submit a task.  Returns true if the task was queued, false if not,
+	// in which case the caller should perform the task inline.  This can
+	// be called from any thread.
+	static bool Submit(std::function<void()> task, Priority priority = Priority::Normal);
+
+	// Shut down the pool.  This discards any queued tasks that haven't
+	// started yet, and waits briefly for the running tasks to finish.
+	// The application calls this at exit.
+	static void Shutdown();
+
+	// get the number of queued tasks that haven't started yet
+	static size_t GetQueueDepth();
+
+	// get the number of worker threads, starting the pool if necessary
+	static size_t GetThreadCount();
+
+protected:
+	// start the worker threads, if we haven't already
+	static bool Start();
+
+	// worker thread entrypoint
+	static DWORD WINAPI ThreadMain(LPVOID);
+
+	// task queues, one per priority level
+	static const int nPriorities = 3;
+	static std::list<std::function<void()>> queues[nPriorities];
+
+	// total number of queued tasks, and the queue limit
+	static size_t queueDepth;
+	static const size_t maxQueueDepth = 256;
+
+	// Work semaphore.  We release one count per queued task, so the
+	// count is the number of tasks available for the workers to take.
+	static HandleHolder hSemaphore;
+
+	// worker thread handles
+	static std::vector<HANDLE> threads;
+
+	// status flags
+	static bool started;
+	static bool shuttingDown;
+
+	// lock for the queues and status
+	static CriticalSection lock;
+};
@@ -11,6 +11,7 @@
 
 // statics
 LogFile *LogFile::inst = nullptr;
+LPTOP_LEVEL_EXCEPTION_FILTER LogFile::prevCrashFilter = nullptr;
 
 LogFile::LogFile() :
 	enabledFeatures(BaseLogging),
@@ -25,6 +26,17 @@ LogFile::LogFile() :
 	h = CreateFile(fname, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, NULL,
 		CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
 
+	// Set up the ring buffer and start the writer thread.  If we can't
+	// start the thread for some reason, we'll fall back on writing to
+	// the file directly.
+	ring.reset(new CHAR[ringSize]);
+	hWorkEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
+	if (hWorkEvent != NULL)
+	{
+		DWORD tid;
+		hWriterThread = CreateThread(NULL, 0, &SWriterThreadMain, this, 0, &tid);
+	}
+
 	// the start of the file counts as preceded by an infinite
 	// amount of blank space, for group separator purposes
 	nNewlines = 2;
@@ -39,13 +51,38 @@ LogFile::~LogFile()
 {
 	Group();
 	WriteTimestamp(_T("PinballY session ending\n\n"));
+
+	// tell the writer thread to finish up, and wait for it to exit
+	if (hWriterThread != NULL)
+	{
+		writerExit = true;
+		SetEvent(hWorkEvent);
+		WaitForSingleObject(hWriterThread, 5000);
+	}
 }
 
 // initialize
 void LogFile::Init()
 {
 	if (inst == nullptr)
+	{
 		inst = new LogFile();
+
+		// install the crash filter, so that we don't lose the messages
+		// still in the buffer if the program crashes
+		prevCrashFilter = SetUnhandledExceptionFilter(&CrashFilter);
+	}
+}
+
+LONG WINAPI LogFile::CrashFilter(EXCEPTION_POINTERS *ex)
+{
+	// flush the log, but don't wait too long, since the writer thread
+	// might itself be the source of the trouble
+	if (inst != nullptr)
+		inst->Flush(2000);
+
+	// pass the exception along to the previous filter, if any
+	return prevCrashFilter != nullptr ? prevCrashFilter(ex) : EXCEPTION_CONTINUE_SEARCH;
 }
 
 // terminate
@@ -53,6 +90,7 @@ void LogFile::Shutdown()
 {
 	if (inst != nullptr)
 	{
+		SetUnhandledExceptionFilter(prevCrashFilter);
 		delete inst;
 		inst = nullptr;
 	}
@@ -64,10 +102,10 @@ void LogFile::InitConfig()
 	ConfigManager::GetInstance()->Subscribe(this);
 
 	// load the current configuration
-	OnConfigReload();
+	OnConfigChange();
 }
 
-void LogFile::OnConfigReload()
+void LogFile::OnConfigChange()
 {
 	// clear the feature enable mask, except for base logging (which
 	// is always enabled)
@@ -137,17 +175,20 @@ void LogFile::WriteV(bool timestamp, DWORD features, const TCHAR *fmt, va_list a
 	if (h != NULL && h != INVALID_HANDLE_VALUE 
 		&& ((enabledFeatures | tempFeatures) & features) != 0)
 	{
-		// write the timestamp if desired
+		// add the timestamp if desired
+		TSTRINGEx s;
 		if (timestamp)
 		{
-			DateTime d;
-			WriteStr(d.FormatLocalDateTime().c_str());
-			WriteStr(_T(": "));
+			s = DateTime::FormatCurrentLocalDateTime();
+			s += _T(": ");
 		}
 
-		// format the message and write it out
-		TSTRINGEx s;
-		s.FormatV(fmt, ap);
+		// Format the message and write it out.  Write the timestamp and
+		// message together, so that they can't be separated by another
+		// thread's output.
+		TSTRINGEx msg;
+		msg.FormatV(fmt, ap);
+		s += msg;
 		WriteStr(s.c_str());
 	}
 }
@@ -160,31 +201,182 @@ void LogFile::WriteStr(const TCHAR *s)
 
 void LogFile::WriteStrA(const CHAR *s)
 {
-	// convert C-style newlines to DOS-style CR-LF sequences
-	static std::basic_regex<CHAR> nl("\r\n|\n\r|\n");
-	CSTRING c = std::regex_replace(s, nl, "\r\n");
+	// Convert C-style newlines to DOS-style CR-LF sequences.  Treat
+	// CR-LF and LF-CR pairs as single newlines, and a bare LF as a
+	// newline; leave bare CRs alone.  Count the newlines at the end
+	// of the string as we go, for Group().
+	size_t len = strlen(s);
+	CSTRING c;
+	c.reserve(len + len / 8 + 2);
+	int trailingNewlines = 0;
+	bool allNewlines = true;
+	for (const CHAR *p = s; *p != 0; ++p)
+	{
+		if ((p[0] == '\r' && p[1] == '\n') || (p[0] == '\n' && p[1] == '\r'))
+		{
+			c.append("\r\n", 2);
+			++trailingNewlines;
+			++p;
+		}
+		else if (p[0] == '\n')
+		{
+			c.append("\r\n", 2);
+			++trailingNewlines;
+		}
+		else
+		{
+			c.push_back(*p);
+			trailingNewlines = 0;
+			allNewlines = false;
+		}
+	}
 
-	// hold the lock while writing
-	CriticalSectionLocker locker(lock);
+	// If the writer thread is running, add the text to the ring buffer.
+	// Otherwise write it to the file directly.  Either way, update the
+	// ending newline count in the same order as the text goes into the
+	// file, so that concurrent writers can't interleave the update.
+	if (hWriterThread != NULL)
+	{
+		Enqueue(c.c_str(), c.length(), trailingNewlines, allNewlines);
+	}
+	else
+	{
+		CriticalSectionLocker locker(lock);
+		DWORD bytesWritten = 0;
+		WriteFile(h, c.c_str(), (DWORD)c.length(), &bytesWritten, NULL);
+		UpdateNewlines(trailingNewlines, allNewlines);
+	}
+}
+
+void LogFile::UpdateNewlines(int trailingNewlines, bool allNewlines)
+{
+	if (allNewlines)
+		nNewlines += trailingNewlines;
+	else
+		nNewlines = trailingNewlines;
+}
 
-	// write the file
-	DWORD bytesWritten = 0;
-	WriteFile(h, c.c_str(), (DWORD)c.length(), &bytesWritten, NULL);
+void LogFile::Enqueue(const CHAR *p, size_t len, int trailingNewlines, bool allNewlines)
+{
+	// Wait strategy for the spin loops below.  Spin briefly, since the
+	// thread we're waiting for is usually just finishing a memcpy; then
+	// yield, and finally sleep.  The sleep matters if the thread we're
+	// waiting for has lower priority than we do and has been preempted,
+	// since neither spinning nor yielding would let it run.
+	auto Backoff = [](int &spins)
+	{
+		if (++spins < 64)
+			YieldProcessor();
+		else if (spins < 128)
+			SwitchToThread();
+		else
+			Sleep(1);
+	};
 
-	// Count ending newlines.  Note that all newlines in the string
-	// should be in DOS CR-LF format, so we shouldn't need to worry
-	// about other formats at this point.
-	for (const CHAR *p = c.c_str(); *p != 0; ++p)
+	while (len != 0)
 	{
-		char cur = *p;
-		char nxt = *(p + 1);
-		if ((cur == '\r' && nxt == '\n'))
+		// Reserve space for as much as we can write in one go.  Break up
+		// anything longer than a quarter of the buffer, so that a huge
+		// message can't wait forever for more space than exists.
+		size_t n = min(len, ringSize / 4);
+		UINT64 start = reservePos.load();
+		for (int spins = 0; ; )
 		{
-			++nNewlines;
-			++p;
+			// if the buffer is full, wake the writer and wait for it to
+			// make some room
+			if (start + n - readPos.load(std::memory_order_acquire) > ringSize)
+			{
+				SetEvent(hWorkEvent);
+				Backoff(spins);
+				start = reservePos.load();
+				continue;
+			}
+
+			// try claiming the space
+			if (reservePos.compare_exchange_weak(start, start + n))
+				break;
 		}
-		else
-			nNewlines = 0;
+
+		// copy the text, wrapping at the end of the buffer
+		size_t ofs = static_cast<size_t>(start % ringSize);
+		size_t first = min(n, ringSize - ofs);
+		memcpy(ring.get() + ofs, p, first);
+		memcpy(ring.get(), p + first, n - first);
+
+		// Publish it.  Space is published in the order it was reserved,
+		// so wait for any writers ahead of us to finish their copies.
+		for (int spins = 0; commitPos.load(std::memory_order_acquire) != start; )
+			Backoff(spins);
+
+		// It's our turn to commit, so the writers ahead of us have all
+		// updated the newline count.  Update it for the message on its
+		// last chunk, before letting the next writer commit.
+		if (n == len)
+			UpdateNewlines(trailingNewlines, allNewlines);
+		commitPos.store(start + n, std::memory_order_release);
+
+		// wake the writer early if the buffer is more than half full
+		if (start + n - readPos.load(std::memory_order_acquire) > ringSize / 2)
+			SetEvent(hWorkEvent);
+
+		// on to the next chunk
+		p += n;
+		len -= n;
+	}
+}
+
+DWORD LogFile::WriterThreadMain()
+{
+	for (;;)
+	{
+		// Wait for a wakeup signal, or for the batch interval to elapse.
+		// The interval is short enough that the file stays reasonably
+		// current for anyone watching it.
+		WaitForSingleObject(hWorkEvent, 50);
+
+		// write out whatever has accumulated
+		WriteBuffered();
+
+		// exit if the log is shutting down and we've written everything
+		if (writerExit && readPos.load() == commitPos.load())
+			return 0;
+	}
+}
+
+void LogFile::WriteBuffered()
+{
+	UINT64 begin = readPos.load();
+	UINT64 end = commitPos.load(std::memory_order_acquire);
+	if (end != begin)
+	{
+		// write the published span, in two pieces if it wraps
+		size_t ofs = static_cast<size_t>(begin % ringSize);
+		size_t n = static_cast<size_t>(end - begin);
+		size_t first = min(n, ringSize - ofs);
+		DWORD bytesWritten = 0;
+		WriteFile(h, ring.get() + ofs, (DWORD)first, &bytesWritten, NULL);
+		if (n > first)
+			WriteFile(h, ring.get(), (DWORD)(n - first), &bytesWritten, NULL);
+
+		// release the space
+		readPos.store(end, std::memory_order_release);
+	}
+}
+
+void LogFile::Flush(DWORD timeout)
+{
+	if (hWriterThread == NULL)
+		return;
+
+	// wait until the writer has caught up with everything published so
+	// far, signaling it to make sure it doesn't sit out its interval
+	UINT64 target = commitPos.load(std::memory_order_acquire);
+	ULONGLONG tEnd = GetTickCount64() + timeout;
+	while (readPos.load(std::memory_order_acquire) < target 
+		&& (timeout == INFINITE || GetTickCount64() < tEnd))
+	{
+		SetEvent(hWorkEvent);
+		Sleep(1);
 	}
 }
 
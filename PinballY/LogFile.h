@@ -4,7 +4,17 @@
 // Log file interface.  The log file is global to the app, so there's
 // one singleton instance.
 //
+// Writing to the log doesn't wait for the disk.  Messages go into an
+// in-memory ring buffer, which a background thread drains to the file
+// in batches.  Writers from any thread reserve space in the buffer
+// with an atomic compare-and-swap, copy in their text, and then publish
+// it in reservation order, so there's no lock on the write path.  The
+// buffer is flushed on shutdown, and from an unhandled exception filter
+// if the program crashes, so that the messages leading up to a crash
+// make it to the file.
+//
 #pragma once
+#include <atomic>
 #include "../Utilities/Config.h"
 #include "../Utilities/LogError.h"
 
@@ -82,19 +92,67 @@ public:
 	// set in the feature enable mask.
 	void Group(DWORD feature = BaseLogging);
 
+	// Flush buffered messages to the file.  This waits (up to the
+	// timeout) until the writer thread has written everything that was
+	// in the buffer at the time of the call.
+	void Flush(DWORD timeout = INFINITE);
+
 protected:
 	LogFile();
 	~LogFile();
 
 	// config file notifications
-	virtual void OnConfigReload() override;
+	virtual void OnConfigReload(const ConfigManager::ChangeSet &) override { OnConfigChange(); }
+
+	// update internal variables for a config change
+	void OnConfigChange();
+
+	// Add text to the ring buffer.  The newline information is for
+	// UpdateNewlines(), which we call when the text is committed.
+	void Enqueue(const CHAR *p, size_t len, int trailingNewlines, bool allNewlines);
+
+	// Update the ending newline count for a new message.  Callers must
+	// serialize this in file order: with the ring buffer, by calling it
+	// in commit order, otherwise under the lock.
+	void UpdateNewlines(int trailingNewlines, bool allNewlines);
 
-	// critical section for writing
+	// writer thread
+	static DWORD WINAPI SWriterThreadMain(LPVOID param) { return static_cast<LogFile*>(param)->WriterThreadMain(); }
+	DWORD WriterThreadMain();
+
+	// write everything published in the ring buffer to the file; called
+	// only on the writer thread (or after it exits)
+	void WriteBuffered();
+
+	// unhandled exception filter, to flush the log on a crash
+	static LONG WINAPI CrashFilter(EXCEPTION_POINTERS *ex);
+	static LPTOP_LEVEL_EXCEPTION_FILTER prevCrashFilter;
+
+	// critical section for the feature flags, and for writing directly
+	// to the file if the writer thread isn't running
 	CriticalSection lock;
 
 	// OS file handle for the log file
 	HandleHolder h;
 
+	// Ring buffer.  The positions are running byte counts, which we
+	// reduce modulo the buffer size to get buffer offsets.  Writers
+	// reserve space by advancing reservePos, and publish it, in order,
+	// by advancing commitPos; the writer thread consumes up to commitPos
+	// and advances readPos.
+	static const size_t ringSize = 1024 * 1024;
+	std::unique_ptr<CHAR[]> ring;
+	std::atomic<UINT64> reservePos{ 0 };
+	std::atomic<UINT64> commitPos{ 0 };
+	std::atomic<UINT64> readPos{ 0 };
+
+	// Writer thread, and the event that wakes it early.  The thread
+	// wakes up periodically on its own, so writers only signal the
+	// event when the buffer is filling up or a flush is requested.
+	HandleHolder hWriterThread;
+	HandleHolder hWorkEvent;
+	std::atomic<bool> writerExit{ false };
+
 	// Feature enable mask.  This is a bitwise combination of feature
 	// flags determining which features are enabled for logging.
 	DWORD enabledFeatures;
@@ -111,7 +169,7 @@ protected:
 	// of this for the Group() function, so that we know how many 
 	// newlines we need to add to ensure there's a blank line at the
 	// end of the output.
-	int nNewlines;
+	std::atomic<int> nNewlines;
 };
 
 
@@ -0,0 +1,424 @@
+// This file is part of PinballY
+// Copyright 2018 Michael J Roberts | GPL v3 or later | NO WARRANTY
+//
+// Media drop installer
+
+#include "stdafx.h"
+#include "../Utilities/FileUtil.h"
+#include "MediaDropInstaller.h"
+#include "GameList.h"
+#include "MediaFileIndex.h"
+#include "SevenZipIfc.h"
+#include "LogFile.h"
+#include "Trace.h"
+#include "Resource.h"
+
+MediaDropInstaller::MediaDropInstaller(HWND hwndNotify, UINT notifyMsg) :
+	hwndNotify(hwndNotify), notifyMsg(notifyMsg)
+{
+}
+
+MediaDropInstaller::~MediaDropInstaller()
+{
+	// tell the thread to stop, and wait for it to clean up
+	if (hThread != NULL)
+	{
+		cancel = true;
+		WaitForSingleObject(hThread, INFINITE);
+	}
+
+	// release any streams we marshaled but never got to unmarshal
+	for (auto &s : sources)
+	{
+		if (s.marshaled != nullptr)
+			s.marshaled->Release();
+	}
+}
+
+void MediaDropInstaller::Add(const TCHAR *filename, IStream *stream, int zipIndex,
+	const TCHAR *destFile, const MediaType *mediaType, bool exists)
+{
+	// find the source, or add a new one; each directly dropped file is
+	// its own source
+	Source *source = nullptr;
+	if (zipIndex >= 0)
+	{
+		for (auto &s : sources)
+		{
+			if (s.isArchive && s.stream == stream && s.filename == filename)
+			{
+				source = &s;
+				break;
+			}
+		}
+	}
+	if (source == nullptr)
+		source = &sources.emplace_back(filename, stream, zipIndex >= 0);
+
+	// add the item
+	items.emplace_back(filename, zipIndex, destFile, mediaType, exists, source);
+}
+
+bool MediaDropInstaller::Start()
+{
+	// Marshal the streams for the worker thread.  This is only needed
+	// for sources that aren't plain files on disk; the worker opens its
+	// own streams on those, which is better than going through a proxy
+	// that would do all of the reads back on this thread.
+	for (auto &s : sources)
+	{
+		if (s.stream != nullptr && !IsDiskFile(s.filename.c_str()))
+		{
+			HRESULT hr = CoMarshalInterThreadInterfaceInStream(IID_IStream, s.stream, &s.marshaled);
+			if (FAILED(hr))
+			{
+				s.marshaled = nullptr;
+				LogFile::Get()->Write(_T("Media drop: unable to marshal the stream for %s (error %lx)\n"),
+					s.filename.c_str(), static_cast<long>(hr));
+			}
+		}
+	}
+
+	// start the thread
+	DWORD tid;
+	hThread = CreateThread(NULL, 0, &SThreadMain, this, 0, &tid);
+	if (hThread == NULL)
+	{
+		WindowsErrorMessage err;
+		LogFile::Get()->Write(_T("Media drop: unable to start the installer thread (error %d: %s)\n"),
+			err.GetCode(), err.Get());
+		return false;
+	}
+
+	// Run below normal priority, so that the decoders don't compete with
+	// the UI.  The work is mostly I/O-bound anyway.
+	SetThreadPriority(hThread, THREAD_PRIORITY_BELOW_NORMAL);
+	return true;
+}
+
+void MediaDropInstaller::GetProgress(UINT64 &done, UINT64 &total)
+{
+	CriticalSectionLocker locker(lock);
+	done = bytesDone + bytesCur;
+	total = max(bytesTotal, done);
+}
+
+DWORD MediaDropInstaller::ThreadMain()
+{
+	// COM is required for the streams
+	CoInitializeEx(NULL, COINIT_MULTITHREADED);
+	Trace::Scope trace("Media drop install", "media");
+	ULONGLONG t0 = GetTickCount64();
+
+	// get the worker thread's copies of the streams
+	for (auto &s : sources)
+	{
+		if (s.marshaled != nullptr)
+		{
+			CoGetInterfaceAndReleaseStream(s.marshaled, IID_IStream, reinterpret_cast<void**>(&s.workerStream));
+			s.marshaled = nullptr;
+		}
+	}
+
+	// Back up the existing files and create the folders.  Do this for
+	// all of the items before we start copying, so that the old files
+	// are out of the way by the time the new ones arrive.
+	for (auto &item : items)
+		Prepare(item);
+
+	// install the files from each source in turn
+	for (auto &s : sources)
+	{
+		if (cancel)
+			break;
+
+		if (s.isArchive)
+		{
+			ExtractArchive(s);
+		}
+		else
+		{
+			for (auto &item : items)
+			{
+				if (item.source == &s && item.state == Item::Ready)
+				{
+					if (IsDiskFile(item.filename.c_str()))
+						CopyDiskFile(item);
+					else
+						CopyStream(item, s.workerStream);
+				}
+			}
+		}
+	}
+
+	// Restore the backups for anything we didn't install, because it
+	// failed or we were cancelled.  Ignore any errors that occur in that
+	// attempt, as we've already logged errors for this operation and we
+	// don't want to overload the user with alerts.  The user should be
+	// able to sort out the mess easily enough if the un-re-name fails by
+	// manually inspecting the media folder.
+	for (auto &item : items)
+	{
+		if (item.state != Item::Done && item.backupName.length() != 0)
+			MoveFile(item.backupName.c_str(), item.destFile.c_str());
+	}
+
+	// log the results
+	UINT64 done, total;
+	GetProgress(done, total);
+	LogFile::Get()->Write(_T("Media drop: %s %d of %d file(s), %I64u bytes, in %I64u ms\n"),
+		cancel ? _T("cancelled after installing") : _T("installed"),
+		nInstalled, static_cast<int>(items.size()), done, GetTickCount64() - t0);
+
+	// release the streams, and let the main window know we're done
+	for (auto &s : sources)
+		s.workerStream = nullptr;
+	trace.End();
+	if (!cancel)
+		PostMessage(hwndNotify, notifyMsg, 0, 0);
+
+	CoUninitialize();
+	return 0;
+}
+
+void MediaDropInstaller::Prepare(Item &item)
+{
+	// back up any existing file
+	if (item.exists && !item.mediaType->SaveBackup(item.destFile.c_str(), item.backupName, eh))
+	{
+		item.backupName.clear();
+		item.state = Item::Failed;
+		return;
+	}
+
+	// make sure the destination folder exists
+	const TCHAR *slash = _tcsrchr(item.destFile.c_str(), '\\');
+	if (slash != nullptr)
+	{
+		// extract the path portion
+		TSTRING path(item.destFile.c_str(), slash - item.destFile.c_str());
+
+		// if the folder doesn't exist, try creating it
+		if (!DirectoryExists(path.c_str())
+			&& !CreateSubDirectory(path.c_str(), _T(""), NULL))
+		{
+			WindowsErrorMessage winErr;
+			eh.SysError(MsgFmt(IDS_ERR_DROP_MKDIR, item.mediaType->nameStr.c_str(), path.c_str()),
+				winErr.Get());
+			item.state = Item::Failed;
+			return;
+		}
+	}
+
+	// ready to go
+	item.state = Item::Ready;
+}
+
+void MediaDropInstaller::OnItemDone(Item &item, bool ok)
+{
+	if (ok)
+	{
+		// set the file's modify time to now, so that we know this
+		// is the most recently installed file
+		TouchFile(item.destFile.c_str());
+		item.state = Item::Done;
+		++nInstalled;
+	}
+	else
+		item.state = Item::Failed;
+
+	// make sure the media file index sees the new file right away
+	MediaFileIndex::Invalidate(item.destFile.c_str());
+}
+
+void MediaDropInstaller::CopyDiskFile(Item &item)
+{
+	// Get the file size.  Use unbuffered I/O for large files: for those,
+	// the file cache only adds a second copy of every byte, and evicts
+	// more useful data (like our textures and videos) to make room.
+	// Small files are faster through the cache.
+	WIN32_FILE_ATTRIBUTE_DATA attrs;
+	UINT64 size = 0;
+	if (GetFileAttributesEx(item.filename.c_str(), GetFileExInfoStandard, &attrs))
+		size = (static_cast<UINT64>(attrs.nFileSizeHigh) << 32) | attrs.nFileSizeLow;
+	DWORD flags = size >= unbufferedCopyThreshold ? COPY_FILE_NO_BUFFERING : 0;
+
+	// count it in the total
+	{
+		CriticalSectionLocker locker(lock);
+		bytesTotal += size;
+	}
+
+	// Progress routine.  Update the byte counts, and stop if we've been
+	// cancelled.  CopyFileEx deletes the partial file on cancellation.
+	auto progress = [](LARGE_INTEGER /*totalSize*/, LARGE_INTEGER transferred,
+		LARGE_INTEGER, LARGE_INTEGER, DWORD, DWORD, HANDLE, HANDLE, LPVOID lpData) -> DWORD
+	{
+		auto self = static_cast<MediaDropInstaller*>(lpData);
+		CriticalSectionLocker locker(self->lock);
+		self->bytesCur = transferred.QuadPart;
+		return self->cancel ? PROGRESS_CANCEL : PROGRESS_CONTINUE;
+	};
+
+	// copy the file
+	bool ok = CopyFileEx(item.filename.c_str(), item.destFile.c_str(), progress, this, NULL, flags) != 0;
+	WindowsErrorMessage winErr;
+
+	// count the bytes as done
+	{
+		CriticalSectionLocker locker(lock);
+		bytesDone += ok ? size : bytesCur;
+		bytesCur = 0;
+	}
+
+	// report errors, other than cancellation
+	if (!ok && winErr.GetCode() != ERROR_REQUEST_ABORTED)
+	{
+		eh.Error(MsgFmt(IDS_ERR_DROP_COPY,
+			item.mediaType->nameStr.c_str(),
+			item.filename.c_str(), item.destFile.c_str(), winErr.Get()));
+	}
+
+	OnItemDone(item, ok);
+}
+
+void MediaDropInstaller::CopyStream(Item &item, IStream *stream)
+{
+	// no stream available - log an error
+	if (stream == nullptr)
+	{
+		eh.Error(MsgFmt(IDS_ERR_DROP_COPY,
+			item.mediaType->nameStr.c_str(),
+			item.filename.c_str(), item.destFile.c_str(), _T("no source stream available")));
+		OnItemDone(item, false);
+		return;
+	}
+
+	// create a stream on the destination file
+	RefPtr<IStream> destStream;
+	const TCHAR *where = _T("creating output stream");
+	HRESULT hr = SHCreateStreamOnFileEx(item.destFile.c_str(),
+		STGM_CREATE | STGM_WRITE | STGM_SHARE_EXCLUSIVE,
+		FILE_ATTRIBUTE_NORMAL, TRUE, nullptr, &destStream);
+
+	// figure the size of the source stream
+	ULARGE_INTEGER sz;
+	if (SUCCEEDED(hr))
+	{
+		where = _T("getting source size");
+		hr = stream->Seek({ 0, 0 }, STREAM_SEEK_END, &sz);
+	}
+
+	// seek back to the start
+	if (SUCCEEDED(hr))
+	{
+		where = _T("seeking to start of source stream");
+		hr = stream->Seek({ 0, 0 }, STREAM_SEEK_SET, nullptr);
+	}
+
+	// copy the stream
+	ULARGE_INTEGER actualRead = { 0, 0 }, actualWrite = { 0, 0 };
+	if (SUCCEEDED(hr))
+	{
+		where = _T("copying data");
+		{
+			CriticalSectionLocker locker(lock);
+			bytesTotal += sz.QuadPart;
+		}
+		hr = stream->CopyTo(destStream, sz, &actualRead, &actualWrite);
+		CriticalSectionLocker locker(lock);
+		bytesDone += actualWrite.QuadPart;
+	}
+
+	// we're done with the output file
+	destStream = nullptr;
+
+	// report errors
+	bool ok = false;
+	if (!SUCCEEDED(hr))
+	{
+		WindowsErrorMessage winErr(hr);
+		eh.Error(MsgFmt(IDS_ERR_DROP_COPY,
+			item.mediaType->nameStr.c_str(),
+			item.filename.c_str(), item.destFile.c_str(), winErr.Get()));
+	}
+	else if (actualRead.QuadPart != sz.QuadPart || actualWrite.QuadPart != sz.QuadPart)
+	{
+		MsgFmt details(_T("not all byts were copied (file size %I64u, read %I64u, wrote %I64u"),
+			sz.QuadPart, actualRead.QuadPart, actualWrite.QuadPart);
+		eh.Error(MsgFmt(IDS_ERR_DROP_COPY,
+			item.mediaType->nameStr.c_str(),
+			item.filename.c_str(), item.destFile.c_str(), details.Get()));
+	}
+	else
+	{
+		// success
+		ok = true;
+	}
+
+	OnItemDone(item, ok);
+}
+
+void MediaDropInstaller::ExtractArchive(Source &source)
+{
+	// Collect the items to extract from this archive.  Note that we
+	// extract each item into its destination file, ignoring the name
+	// stored in the archive, since we want to make sure the installed
+	// file matches the game's media file name.  The destination name
+	// already takes into account the proper media folder, page subfolder,
+	// and index number, as applicable.
+	std::vector<SevenZipArchive::ExtractItem> extractItems;
+	std::vector<Item*> itemMap;
+	for (auto &item : items)
+	{
+		if (item.source == &source && item.state == Item::Ready)
+		{
+			extractItems.emplace_back(static_cast<UINT32>(item.zipIndex), item.destFile.c_str());
+			itemMap.push_back(&item);
+		}
+	}
+	if (extractItems.size() == 0)
+		return;
+
+	// progress callback - update the byte counts, and check for cancellation
+	auto progress = [this](UINT64 done, UINT64 total)
+	{
+		CriticalSectionLocker locker(lock);
+		bytesTotal = bytesDone + total;
+		bytesCur = done;
+		return !cancel;
+	};
+
+	// file completion callback
+	auto fileDone = [this, &itemMap](size_t i, bool ok) { OnItemDone(*itemMap[i], ok); };
+
+	// If the archive is a file on disk, open our own streams on it and
+	// extract the independent parts in parallel.  The work is mostly
+	// disk-bound beyond a few threads, so don't go overboard.  If we
+	// only have a stream, extract through the stream on this thread.
+	if (IsDiskFile(source.filename.c_str()))
+	{
+		SYSTEM_INFO si;
+		GetSystemInfo(&si);
+		int nThreads = max(1, min(4, static_cast<int>(si.dwNumberOfProcessors) - 1));
+		SevenZipArchive::ExtractParallel(source.filename.c_str(), extractItems, nThreads, progress, fileDone, eh);
+	}
+	else
+	{
+		SevenZipArchive arch;
+		if (arch.OpenArchive(source.filename.c_str(), source.workerStream, eh))
+			arch.Extract(extractItems, progress, fileDone, eh);
+	}
+
+	// count the bytes as done
+	CriticalSectionLocker locker(lock);
+	bytesDone += bytesCur;
+	bytesCur = 0;
+
+	// anything that didn't get a completion callback failed
+	for (auto item : itemMap)
+	{
+		if (item->state == Item::Ready)
+			item->state = Item::Failed;
+	}
+}
@@ -0,0 +1,159 @@
+// This file is part of PinballY
+// Copyright 2018 Michael J Roberts | GPL v3 or later | NO WARRANTY
+//
+// Media drop installer
+//
+// When the user drops media files or a Media Pack onto the window, the
+// playfield view works out where each file goes, and then hands the list
+// to this object to do the actual copying.  A Media Pack can be hundreds
+// of megabytes of video, so the copying and extraction runs on a
+// background thread, to keep the UI responsive while it's going on.
+//
+// Directly dropped files on disk are copied with CopyFileEx, bypassing
+// the file cache for large files, so that a multi-gigabyte video copied
+// to a network media folder doesn't flush everything else out of memory.
+//
+// Archive entries are extracted directly into their destination media
+// folders, in a single batch per archive, rather than one entry at a
+// time.  That matters a great deal for solid archives (7z, solid RAR),
+// where extracting a single entry means decoding the solid block from
+// the beginning up to that entry.  When the archive is a file on disk,
+// independent parts of the archive (separate ZIP entries, separate 7z
+// solid blocks) are decoded in parallel.
+//
+// The media file index is updated as each file arrives.  When the whole
+// job is finished, we post a notification message to the main window,
+// which collects the results via GetResults().  Destroying the object
+// cancels the job, restoring any files that were backed up but not yet
+// replaced.
+
+#pragma once
+#include <vector>
+#include <list>
+#include "../Utilities/Pointers.h"
+#include "../Utilities/WinUtil.h"
+#include "../Utilities/LogError.h"
+#include "../Utilities/FileUtil.h"
+
+struct MediaType;
+
+class MediaDropInstaller : public RefCounted
+{
+public:
+	// Create the installer.  Completion is posted to 'hwndNotify' as
+	// 'notifyMsg'.
+	MediaDropInstaller(HWND hwndNotify, UINT notifyMsg);
+
+	// Add a file.  'filename' is the source file, or the archive file
+	// for an entry in a Media Pack, in which case 'zipIndex' is the
+	// entry index; for a directly dropped file, 'zipIndex' is -1.
+	// 'stream' is the source file stream.  'exists' means that there's
+	// an existing file at 'destFile', which we'll back up first.
+	void Add(const TCHAR *filename, IStream *stream, int zipIndex,
+		const TCHAR *destFile, const MediaType *mediaType, bool exists);
+
+	// Get the number of files added
+	size_t GetCount() const { return items.size(); }
+
+	// start the background thread
+	bool Start();
+
+	// Get the results.  Call this after the completion notification.
+	int GetResults(const CapturingErrorHandler* &errors) const
+	{
+		errors = &eh;
+		return nInstalled;
+	}
+
+	// Get the current progress, in bytes
+	void GetProgress(UINT64 &done, UINT64 &total);
+
+protected:
+	// destruction cancels the job and waits for the thread to exit
+	~MediaDropInstaller();
+
+	// Source stream.  Several items can come from the same archive, so
+	// we keep one entry per distinct source.  The UI thread's streams
+	// can belong to a drag-and-drop data object, which lives in the UI
+	// thread's apartment, so we marshal them over to the worker thread.
+	struct Source
+	{
+		Source(const TCHAR *filename, IStream *stream, bool isArchive) :
+			filename(filename), stream(stream, RefCounted::DoAddRef), isArchive(isArchive) { }
+
+		TSTRING filename;              // file name
+		RefPtr<IStream> stream;        // UI thread's stream
+		IStream *marshaled = nullptr;  // marshaled stream, for the worker thread
+		RefPtr<IStream> workerStream;  // worker thread's stream
+		bool isArchive;                // is this an archive?
+	};
+	std::list<Source> sources;
+
+	// file to install
+	struct Item
+	{
+		Item(const TCHAR *filename, int zipIndex, const TCHAR *destFile,
+			const MediaType *mediaType, bool exists, Source *source) :
+			filename(filename), zipIndex(zipIndex), destFile(destFile),
+			mediaType(mediaType), exists(exists), source(source) { }
+
+		TSTRING filename;              // source file (or archive file)
+		int zipIndex;                  // archive entry index, or -1 for a direct file
+		TSTRING destFile;              // destination file
+		const MediaType *mediaType;    // media type
+		bool exists;                   // is there an existing file to back up?
+		Source *source;                // source stream
+
+		TSTRING backupName;            // backup file name, if we backed up an existing file
+		enum { Pending, Ready, Done, Failed } state = Pending;
+	};
+	std::vector<Item> items;
+
+	// worker thread entrypoint
+	static DWORD WINAPI SThreadMain(LPVOID param) { return static_cast<MediaDropInstaller*>(param)->ThreadMain(); }
+	DWORD ThreadMain();
+
+	// back up the existing file and set up the folder for an item
+	void Prepare(Item &item);
+
+	// Is the source a file on disk?  This is false for a file that's
+	// only available as a stream, such as a virtual file dragged out
+	// of a browser or a ZIP folder; those have bare names with no path.
+	static bool IsDiskFile(const TCHAR *filename)
+		{ return !PathIsRelative(filename) && FileExists(filename); }
+
+	// Copy a directly dropped file from disk.  This uses CopyFileEx,
+	// unbuffered for large files, so that a big video doesn't get
+	// pushed through the file cache on its way to the media folder.
+	void CopyDiskFile(Item &item);
+
+	// copy a directly dropped file from its stream
+	void CopyStream(Item &item, IStream *stream);
+
+	// extract the items from an archive
+	void ExtractArchive(Source &source);
+
+	// mark an item as finished
+	void OnItemDone(Item &item, bool ok);
+
+	// notification window and message
+	HWND hwndNotify;
+	UINT notifyMsg;
+
+	// worker thread
+	HandleHolder hThread;
+
+	// Shared state.  These are protected by the lock.
+	CriticalSection lock;
+	UINT64 bytesDone = 0;          // bytes completed in finished sources
+	UINT64 bytesCur = 0;           // bytes completed in the current source
+	UINT64 bytesTotal = 0;         // estimated total bytes
+	volatile bool cancel = false;  // the job has been cancelled
+
+	// minimum size for unbuffered file copies
+	static const UINT64 unbufferedCopyThreshold = 32 * 1024 * 1024;
+
+	// results
+	CapturingErrorHandler eh;
+	int nInstalled = 0;
+};
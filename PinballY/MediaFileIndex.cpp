@@ -0,0 +1,591 @@
+// This file is part of PinballY
+// Copyright 2018 Michael J Roberts | GPL v3 or later | NO WARRANTY
+//
+// Media file index
+
+#include "stdafx.h"
+#include "MediaFileIndex.h"
+#include "LogFile.h"
+
+// statics
+bool MediaFileIndex::enabled = true;
+std::unordered_map<TSTRING, std::unique_ptr<MediaFileIndex::Folder>> MediaFileIndex::folders;
+HandleHolder MediaFileIndex::hThread;
+bool MediaFileIndex::threadStarted = false;
+bool MediaFileIndex::shuttingDown = false;
+CriticalSection MediaFileIndex::lock;
+std::unordered_map<TSTRING, TSTRING> MediaFileIndex::lookups;
+UINT64 MediaFileIndex::changeSerial = 0;
+UINT64 MediaFileIndex::lookupSerial = 0;
+HandleHolder MediaFileIndex::hPrefetchThread;
+CacheHitStats MediaFileIndex::lookupHitStats;
+
+MediaFileIndex::Folder::~Folder()
+{
+	if (hDir != INVALID_HANDLE_VALUE)
+		CloseHandle(hDir);
+}
+
+bool MediaFileIndex::FileExists(const TCHAR *path)
+{
+	return Lookup(path, nullptr);
+}
+
+bool MediaFileIndex::GetFileTime(const TCHAR *path, FILETIME &mtime)
+{
+	return Lookup(path, &mtime);
+}
+
+bool MediaFileIndex::Lookup(const TCHAR *path, FILETIME *mtime)
+{
+	// Split the path into the folder and file name.  If the index is
+	// disabled, or there's no folder part, use the file system directly.
+	const TCHAR *name = _tcsrchr(path, '\\');
+	if (!enabled || shuttingDown || name == nullptr)
+	{
+		WIN32_FILE_ATTRIBUTE_DATA attrs;
+		if (!GetFileAttributesEx(path, GetFileExInfoStandard, &attrs)
+			|| (attrs.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0)
+			return false;
+
+		if (mtime != nullptr)
+			*mtime = attrs.ftLastWriteTime;
+		return true;
+	}
+
+	// get the lower-case file name
+	TSTRING nameKey(name + 1);
+	std::transform(nameKey.begin(), nameKey.end(), nameKey.begin(), ::_totlower);
+
+	CriticalSectionLocker locker(lock);
+
+	// look up the file in the folder snapshot
+	Folder *folder = GetFolder(path, name - path);
+	if (auto f = folder->files.find(nameKey); f != folder->files.end())
+	{
+		if (mtime != nullptr)
+			*mtime = f->second.mtime;
+		return true;
+	}
+
+	// not found
+	return false;
+}
+
+bool MediaFileIndex::EnumFiles(const TCHAR *dir, std::function<void(const TCHAR *name)> func)
+{
+	// if the index is disabled, the caller has to scan the folder
+	if (!enabled || shuttingDown)
+		return false;
+
+	// drop any trailing path separator, to match the folder keys that
+	// Lookup() derives from file paths
+	size_t dirLen = _tcslen(dir);
+	while (dirLen > 0 && dir[dirLen - 1] == '\\')
+		--dirLen;
+
+	// Copy the names out of the snapshot, so that we don't hold the lock
+	// while the caller processes them.
+	std::vector<TSTRING> names;
+	auto CopyNames = [&names](const Folder *folder)
+	{
+		names.reserve(folder->files.size());
+		for (auto &f : folder->files)
+			names.emplace_back(f.second.name);
+	};
+
+	// If the snapshot is current, use it as is.  Otherwise, read the
+	// folder outside of the lock, so that callers scanning different
+	// folders on different threads can do their disk reads in parallel,
+	// and install the new file list when we're done.
+	TSTRING path;
+	bool current;
+	{
+		CriticalSectionLocker locker(lock);
+		Folder *folder = FindFolder(dir, dirLen);
+		current = IsCurrent(folder);
+		if (current)
+			CopyNames(folder);
+		else
+			path = folder->path;
+	}
+	if (!current)
+	{
+		FileMap files;
+		bool exists = ReadFolder(path.c_str(), files);
+
+		CriticalSectionLocker locker(lock);
+		Folder *folder = FindFolder(dir, dirLen);
+		SetFiles(folder, std::move(files), exists);
+		CopyNames(folder);
+	}
+
+	// pass them to the callback
+	for (auto &n : names)
+		func(n.c_str());
+
+	return true;
+}
+
+bool MediaFileIndex::FindFirst(TCHAR path[MAX_PATH], const TCHAR *const *dirs, size_t nDirs,
+	const TCHAR *file, const TCHAR *const *exts, size_t nExts)
+{
+	// search the folders in order, trying each extension in each folder
+	auto Search = [path, dirs, nDirs, file, exts, nExts]()
+	{
+		for (size_t i = 0; i < nDirs; ++i)
+		{
+			PathCombine(path, dirs[i], file);
+			size_t rootLen = _tcslen(path);
+			for (size_t j = 0; j < nExts; ++j)
+			{
+				if (rootLen + _tcslen(exts[j]) < MAX_PATH)
+				{
+					_tcscpy_s(path + rootLen, MAX_PATH - rootLen, exts[j]);
+					if (FileExists(path))
+						return true;
+				}
+			}
+		}
+		return false;
+	};
+
+	// if the index is disabled, search the file system directly every time
+	if (!enabled || shuttingDown)
+		return Search();
+
+	// build the cache key
+	TSTRING key;
+	for (size_t i = 0; i < nDirs; ++i)
+		key.append(dirs[i]).append(_T("|"));
+	key.append(file);
+	for (size_t i = 0; i < nExts; ++i)
+		key.append(_T("|")).append(exts[i]);
+	std::transform(key.begin(), key.end(), key.begin(), ::_totlower);
+
+	// check for a cached result, discarding the cache first if anything
+	// has changed since it was populated
+	UINT64 startSerial;
+	{
+		CriticalSectionLocker locker(lock);
+		if (lookupSerial != changeSerial)
+		{
+			lookups.clear();
+			lookupSerial = changeSerial;
+		}
+
+		if (auto it = lookups.find(key); it != lookups.end())
+		{
+			lookupHitStats.Hit();
+			if (it->second.length() == 0)
+				return false;
+
+			_tcscpy_s(path, MAX_PATH, it->second.c_str());
+			return true;
+		}
+		startSerial = changeSerial;
+	}
+
+	// Not cached - do the search.  Cache the result, unless something
+	// changed while we were searching, in which case the result might
+	// already be stale.
+	lookupHitStats.Miss();
+	bool found = Search();
+	CriticalSectionLocker locker(lock);
+	if (changeSerial == startSerial)
+		lookups.emplace(key, found ? path : _T(""));
+
+	return found;
+}
+
+void MediaFileIndex::ClearLookupCache()
+{
+	CriticalSectionLocker locker(lock);
+	lookups.clear();
+}
+
+void MediaFileIndex::Prefetch(std::vector<TSTRING> &&dirs)
+{
+	// if the index is disabled, there's nothing to prefetch into
+	if (!enabled || shuttingDown)
+		return;
+
+	// wait for any previous prefetch to finish
+	if (hPrefetchThread != NULL)
+	{
+		WaitForSingleObject(hPrefetchThread, INFINITE);
+		hPrefetchThread.Clear();
+	}
+
+	// Launch the thread.  If it fails to start, the folders will just be
+	// read on first use.
+	auto ctx = new std::vector<TSTRING>(std::move(dirs));
+	DWORD tid;
+	hPrefetchThread = CreateThread(NULL, 0, &PrefetchThreadMain, ctx, 0, &tid);
+	if (hPrefetchThread == NULL)
+		delete ctx;
+	else
+		SetThreadPriority(hPrefetchThread, THREAD_PRIORITY_BELOW_NORMAL);
+}
+
+DWORD WINAPI MediaFileIndex::PrefetchThreadMain(LPVOID lParam)
+{
+	// Snapshot each folder.  EnumFiles() does the disk reads outside of
+	// the lock, so this doesn't hold up lookups on the UI thread.
+	std::unique_ptr<std::vector<TSTRING>> dirs(static_cast<std::vector<TSTRING>*>(lParam));
+	for (auto &dir : *dirs)
+	{
+		if (shuttingDown)
+			break;
+
+		EnumFiles(dir.c_str(), [](const TCHAR*) { });
+	}
+
+	return 0;
+}
+
+MediaFileIndex::Folder *MediaFileIndex::FindFolder(const TCHAR *dir, size_t dirLen)
+{
+	// get the lower-case folder path
+	TSTRING dirKey(dir, dirLen);
+	std::transform(dirKey.begin(), dirKey.end(), dirKey.begin(), ::_totlower);
+
+	// find or create the folder snapshot
+	auto it = folders.find(dirKey);
+	if (it == folders.end())
+		it = folders.emplace(dirKey, std::make_unique<Folder>(TSTRING(dir, dirLen).c_str())).first;
+	return it->second.get();
+}
+
+MediaFileIndex::Folder *MediaFileIndex::GetFolder(const TCHAR *dir, size_t dirLen)
+{
+	// find the folder, and re-scan it if the snapshot isn't current
+	Folder *folder = FindFolder(dir, dirLen);
+	if (!IsCurrent(folder))
+		Scan(folder);
+
+	return folder;
+}
+
+bool MediaFileIndex::IsCurrent(const Folder *folder)
+{
+	// The snapshot is current if it's valid, and either the folder is
+	// monitored or the snapshot hasn't expired yet.
+	return folder->valid && (folder->watched || GetTickCount64() - folder->scanTime <= unwatchedExpiration);
+}
+
+bool MediaFileIndex::ReadFolder(const TCHAR *path, FileMap &files)
+{
+	// enumerate the folder
+	WIN32_FIND_DATA fd;
+	HANDLE hFind = FindFirstFileEx((TSTRING(path) + _T("\\*")).c_str(), FindExInfoBasic, &fd,
+		FindExSearchNameMatch, NULL, FIND_FIRST_EX_LARGE_FETCH);
+	if (hFind == INVALID_HANDLE_VALUE)
+		return false;
+
+	do
+	{
+		if ((fd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) == 0)
+		{
+			TSTRING key(fd.cFileName);
+			std::transform(key.begin(), key.end(), key.begin(), ::_totlower);
+			files.emplace(key, Folder::File{ fd.ftLastWriteTime, fd.cFileName });
+		}
+	} while (FindNextFile(hFind, &fd));
+	FindClose(hFind);
+	return true;
+}
+
+void MediaFileIndex::Scan(Folder *folder)
+{
+	FileMap files;
+	bool exists = ReadFolder(folder->path.c_str(), files);
+	SetFiles(folder, std::move(files), exists);
+}
+
+void MediaFileIndex::SetFiles(Folder *folder, FileMap &&files, bool exists)
+{
+	// If this replaces an earlier snapshot, and the set of files has
+	// changed, the cached FindFirst() results might be out of date.  (A
+	// first snapshot can't affect any cached results, since any lookup
+	// in the folder would have taken the snapshot.)
+	if (folder->scanTime != 0)
+	{
+		bool changed = files.size() != folder->files.size();
+		for (auto it = files.begin(); !changed && it != files.end(); ++it)
+			changed = folder->files.find(it->first) == folder->files.end();
+		if (changed)
+			++changeSerial;
+	}
+
+	// install the new file list; the snapshot is now valid
+	folder->files = std::move(files);
+	folder->valid = true;
+	folder->scanTime = GetTickCount64();
+
+	LogFile::Get()->Write(LogFile::MediaFileLogging, _T("Media file index: scanned %s, %d files\n"),
+		folder->path.c_str(), static_cast<int>(folder->files.size()));
+
+	// If the folder exists and we're not monitoring it yet, start
+	// monitoring it.  The monitor thread has to open the directory
+	// and issue the notification reads itself, since the completion
+	// routines run on the thread that issues the read.
+	if (exists && !folder->watchStarted)
+	{
+		// start the monitor thread if we haven't already
+		if (!threadStarted)
+		{
+			threadStarted = true;
+			DWORD tid;
+			hThread = CreateThread(NULL, 0, &ThreadMain, nullptr, 0, &tid);
+			if (hThread != NULL)
+				SetThreadPriority(hThread, THREAD_PRIORITY_BELOW_NORMAL);
+		}
+
+		// ask the thread to start monitoring the folder
+		if (hThread != NULL && QueueUserAPC(&StartWatchAPC, hThread, reinterpret_cast<ULONG_PTR>(folder)))
+			folder->watchStarted = true;
+	}
+}
+
+void MediaFileIndex::Invalidate(const TCHAR *path)
+{
+	if (const TCHAR *name = _tcsrchr(path, '\\'); name != nullptr)
+	{
+		TSTRING dirKey(path, name - path);
+		std::transform(dirKey.begin(), dirKey.end(), dirKey.begin(), ::_totlower);
+
+		CriticalSectionLocker locker(lock);
+		if (auto it = folders.find(dirKey); it != folders.end())
+			it->second->valid = false;
+		++changeSerial;
+	}
+}
+
+void MediaFileIndex::Rename(const TCHAR *oldPath, const TCHAR *newPath)
+{
+	const TCHAR *oldName = _tcsrchr(oldPath, '\\');
+	const TCHAR *newName = _tcsrchr(newPath, '\\');
+	if (oldName == nullptr || newName == nullptr)
+		return;
+
+	// get the lower-case folder keys and file name keys
+	auto Lower = [](TSTRING s) { std::transform(s.begin(), s.end(), s.begin(), ::_totlower); return s; };
+	TSTRING oldDirKey = Lower(TSTRING(oldPath, oldName - oldPath));
+	TSTRING newDirKey = Lower(TSTRING(newPath, newName - newPath));
+	TSTRING oldKey = Lower(oldName + 1);
+	TSTRING newKey = Lower(newName + 1);
+
+	CriticalSectionLocker locker(lock);
+
+	// move the entry if both snapshots are current and the old one has it
+	auto oldDir = folders.find(oldDirKey);
+	auto newDir = folders.find(newDirKey);
+	if (oldDir != folders.end() && newDir != folders.end()
+		&& IsCurrent(oldDir->second.get()) && IsCurrent(newDir->second.get()))
+	{
+		auto &oldFiles = oldDir->second->files;
+		if (auto f = oldFiles.find(oldKey); f != oldFiles.end())
+		{
+			Folder::File file = { f->second.mtime, newName + 1 };
+			oldFiles.erase(f);
+			newDir->second->files[newKey] = file;
+			++changeSerial;
+			return;
+		}
+	}
+
+	// we can't update the snapshots in place, so re-scan on the next lookup
+	if (oldDir != folders.end())
+		oldDir->second->valid = false;
+	if (newDir != folders.end())
+		newDir->second->valid = false;
+	++changeSerial;
+}
+
+void MediaFileIndex::InvalidateAll()
+{
+	CriticalSectionLocker locker(lock);
+	for (auto &f : folders)
+		f.second->valid = false;
+	++changeSerial;
+}
+
+void CALLBACK MediaFileIndex::StartWatchAPC(ULONG_PTR param)
+{
+	auto folder = reinterpret_cast<Folder*>(param);
+
+	// open the directory for change monitoring
+	HANDLE hDir = CreateFile(folder->path.c_str(), FILE_LIST_DIRECTORY,
+		FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL,
+		OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED, NULL);
+
+	CriticalSectionLocker locker(lock);
+	if (shuttingDown || hDir == INVALID_HANDLE_VALUE)
+	{
+		if (hDir != INVALID_HANDLE_VALUE)
+			CloseHandle(hDir);
+		return;
+	}
+
+	// start the first read
+	folder->hDir = hDir;
+	folder->watched = Watch(folder);
+
+	// If the notifications aren't available, the snapshot will expire
+	// on the usual unmonitored schedule instead.
+	if (!folder->watched)
+	{
+		LogFile::Get()->Write(LogFile::MediaFileLogging,
+			_T("Media file index: change notifications aren't available for %s; it will be re-scanned periodically\n"),
+			folder->path.c_str());
+	}
+}
+
+bool MediaFileIndex::Watch(Folder *folder)
+{
+	// The OVERLAPPED event handle isn't used with completion routines,
+	// so we can use it to carry the folder pointer.
+	ZeroMemory(&folder->ov, sizeof(folder->ov));
+	folder->ov.hEvent = reinterpret_cast<HANDLE>(folder);
+	folder->pending = ReadDirectoryChangesW(folder->hDir, folder->buf, sizeof(folder->buf), FALSE,
+		FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_LAST_WRITE | FILE_NOTIFY_CHANGE_SIZE,
+		NULL, &folder->ov, &OnChange) != 0;
+	return folder->pending;
+}
+
+void CALLBACK MediaFileIndex::OnChange(DWORD err, DWORD bytes, LPOVERLAPPED ov)
+{
+	auto folder = reinterpret_cast<Folder*>(ov->hEvent);
+
+	CriticalSectionLocker locker(lock);
+
+	// the read is no longer outstanding
+	folder->pending = false;
+
+	// stop if the read was cancelled for shutdown
+	if (shuttingDown || err == ERROR_OPERATION_ABORTED)
+		return;
+
+	// If the read failed, or the notification buffer overflowed (which
+	// is indicated by a zero byte count), we've lost track of the folder
+	// contents, so invalidate the snapshot.  Otherwise, apply the changes
+	// to the snapshot.
+	if (err != ERROR_SUCCESS || bytes == 0)
+	{
+		folder->valid = false;
+		++changeSerial;
+	}
+	else if (folder->valid)
+	{
+		for (auto fni = reinterpret_cast<const FILE_NOTIFY_INFORMATION*>(folder->buf); ;
+			fni = reinterpret_cast<const FILE_NOTIFY_INFORMATION*>(reinterpret_cast<const BYTE*>(fni) + fni->NextEntryOffset))
+		{
+			// get the file name, and its lower-case key
+			WSTRING wname(fni->FileName, fni->FileNameLength / sizeof(WCHAR));
+			TSTRING fname = WSTRINGToTSTRING(wname);
+			TSTRING key = fname;
+			std::transform(key.begin(), key.end(), key.begin(), ::_totlower);
+
+			switch (fni->Action)
+			{
+			case FILE_ACTION_REMOVED:
+			case FILE_ACTION_RENAMED_OLD_NAME:
+				if (folder->files.erase(key) != 0)
+					++changeSerial;
+				break;
+
+			case FILE_ACTION_ADDED:
+			case FILE_ACTION_MODIFIED:
+			case FILE_ACTION_RENAMED_NEW_NAME:
+				// get the new file time
+				{
+					WIN32_FILE_ATTRIBUTE_DATA attrs;
+					TSTRING full = folder->path + _T("\\") + key;
+					if (GetFileAttributesEx(full.c_str(), GetFileExInfoStandard, &attrs))
+					{
+						if ((attrs.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) == 0)
+						{
+							if (folder->files.find(key) == folder->files.end())
+								++changeSerial;
+							folder->files[key] = { attrs.ftLastWriteTime, fname };
+						}
+					}
+					else if (folder->files.erase(key) != 0)
+						++changeSerial;
+				}
+				break;
+			}
+
+			// stop at the last entry
+			if (fni->NextEntryOffset == 0)
+				break;
+		}
+	}
+
+	// issue the next read
+	folder->watched = Watch(folder);
+}
+
+DWORD WINAPI MediaFileIndex::ThreadMain(LPVOID)
+{
+	// Wait in an alertable state, so that the APCs and change notification
+	// completion routines can run, until we're told to shut down.
+	while (!shuttingDown)
+		SleepEx(INFINITE, TRUE);
+
+	// cancel the outstanding reads
+	{
+		CriticalSectionLocker locker(lock);
+		for (auto &f : folders)
+		{
+			if (f.second->pending)
+				CancelIo(f.second->hDir);
+		}
+	}
+
+	// Let the cancelled reads complete, so that the system is done with
+	// the buffers before the snapshots are deleted.  The completion
+	// routines only run here, so there's no need to check the pending
+	// flags under the lock.
+	for (ULONGLONG t0 = GetTickCount64(); GetTickCount64() - t0 < 1000; )
+	{
+		bool anyPending = false;
+		for (auto &f : folders)
+			anyPending |= f.second->pending;
+
+		if (!anyPending)
+			break;
+
+		SleepEx(10, TRUE);
+	}
+
+	return 0;
+}
+
+void MediaFileIndex::Shutdown()
+{
+	// tell the thread to exit, and wake it up
+	{
+		CriticalSectionLocker locker(lock);
+		shuttingDown = true;
+	}
+
+	// let any prefetch in progress finish its current folder
+	if (hPrefetchThread != NULL)
+		WaitForSingleObject(hPrefetchThread, 5000);
+
+	if (hThread != NULL)
+	{
+		QueueUserAPC(&WakeAPC, hThread, 0);
+
+		// If the thread doesn't exit, leave the snapshots in place, since
+		// a notification read might still be using one of the buffers.
+		if (WaitForSingleObject(hThread, 5000) != WAIT_OBJECT_0)
+			return;
+	}
+
+	// discard the snapshots
+	CriticalSectionLocker locker(lock);
+	folders.clear();
+}
@@ -0,0 +1,232 @@
+// This file is part of PinballY
+// Copyright 2018 Michael J Roberts | GPL v3 or later | NO WARRANTY
+//
+// Media file index
+//
+// This is an in-memory index of the files in the media folders, for
+// the media file lookups in GameListItem::GetMediaItems().  A lookup
+// for a single media item can check dozens of candidate names (every
+// page folder, every index value for indexed types, and every file
+// extension for the type), and we do lookups for several media types
+// every time the wheel moves.  Each check is a separate file system
+// query, which is quick on a local SSD, but can stall the UI for a
+// noticeable time on a hard disk that's spun down, or on a network
+// share.
+//
+// The index keeps one snapshot per folder: a map of the (lower-case)
+// file names to their modification times.  We take the snapshot the
+// first time a lookup touches the folder, by enumerating the folder
+// once, and then answer all later lookups in the folder from memory.
+// A background thread keeps the snapshots current by monitoring each
+// indexed folder through ReadDirectoryChangesW(), so files that the
+// user adds, deletes, or renames through Windows Explorer show up
+// without any explicit refresh.  If a folder can't be monitored (some
+// network file systems don't support change notifications, and we
+// can't monitor a folder that doesn't exist yet), its snapshot simply
+// expires after a few seconds, and we re-scan it on the next lookup.
+//
+// Change notifications are asynchronous, so code that modifies media
+// files itself should call Invalidate() afterwards, to make sure that
+// an immediate lookup sees the change.
+//
+// The game list also uses the index for the table file folders, through
+// EnumFiles().  The new file scan that runs each time the application
+// comes to the foreground would otherwise enumerate every table folder
+// on every activation, which can take seconds on a network share; with
+// the folders monitored, the scan only compares the in-memory snapshot
+// against the game list, so it only sees the changes that the monitor
+// has already collected.
+//
+// The global media lookups (GameList::FindGlobalMediaFile(), for the UI
+// sounds, default backgrounds, startup videos, and so on) go through
+// FindFirst(), which searches a list of folders for a root name with a
+// list of extensions, and caches the result.  Most of these lookups are
+// for optional files that don't exist, and the same lookups repeat every
+// time a button sound plays or a default background is needed, so the
+// cache keeps the negative results as well, making a repeated lookup a
+// single hash lookup.  The cached results are discarded whenever any
+// indexed folder's contents change.  A folder that doesn't exist can't
+// be monitored, so to pick up newly created folders, the application
+// also discards the cached results each time it comes to the foreground,
+// since that's when the user has had a chance to change things through
+// Explorer.
+
+#pragma once
+#include <unordered_map>
+#include <memory>
+#include <functional>
+#include "CacheStats.h"
+
+class MediaFileIndex
+{
+public:
+	// Is the index enabled?  This is set from the configuration.  When
+	// the index is disabled, the lookups go directly to the file system.
+	static bool enabled;
+
+	// Does the file exist?  This can be called from any thread.
+	static bool FileExists(const TCHAR *path);
+
+	// Get a file's modification time.  Returns false if the file
+	// doesn't exist.  This can be called from any thread.
+	static bool GetFileTime(const TCHAR *path, FILETIME &mtime);
+
+	// Enumerate the files in a folder, by their names as they appear in
+	// the directory (not converted to lower-case).  This snapshots the
+	// folder and starts monitoring it, if it isn't already indexed.  The
+	// callback is invoked outside of the index lock.  Returns false if
+	// the index is disabled, in which case the caller should scan the
+	// folder itself.  This can be called from any thread.
+	static bool EnumFiles(const TCHAR *dir, std::function<void(const TCHAR *name)> func);
+
+	// Invalidate the snapshot for the folder containing the given file,
+	// so that the next lookup re-scans the folder.
+	static void Invalidate(const TCHAR *path);
+
+	// Note that a file was renamed.  If we have current snapshots of
+	// both folders, this moves the file's entry to its new name in
+	// place, keeping its modification time (which a rename doesn't
+	// change), so that the renamed file can be found without re-scanning
+	// either folder.  Otherwise, it just invalidates the two folders.
+	static void Rename(const TCHAR *oldPath, const TCHAR *newPath);
+
+	// invalidate all snapshots
+	static void InvalidateAll();
+
+	// Search a list of folders for a file with the given root name and
+	// any of the given extensions.  The folders are searched in order,
+	// trying each extension in order in each folder, and the first match
+	// is returned in 'path'.  The result is cached, whether or not a file
+	// is found.  This can be called from any thread.
+	static bool FindFirst(TCHAR path[MAX_PATH], const TCHAR *const *dirs, size_t nDirs,
+		const TCHAR *file, const TCHAR *const *exts, size_t nExts);
+
+	// Discard the cached FindFirst() results
+	static void ClearLookupCache();
+
+	// Snapshot the given folders on a background thread, so that the
+	// first lookups in them don't have to wait for the disk.
+	static void Prefetch(std::vector<TSTRING> &&dirs);
+
+	// hit statistics for the FindFirst() result cache
+	static CacheHitStats lookupHitStats;
+
+	// Shut down the index.  This stops the monitor thread and discards
+	// the snapshots.  The application calls this at exit.
+	static void Shutdown();
+
+protected:
+	// Folder snapshot
+	struct Folder
+	{
+		Folder(const TCHAR *path) : path(path) { ZeroMemory(&ov, sizeof(ov)); }
+		~Folder();
+
+		// folder path
+		TSTRING path;
+
+		// files in the folder, keyed by lower-case name
+		struct File
+		{
+			FILETIME mtime;		// modification time
+			TSTRING name;		// name as it appears in the directory
+		};
+		std::unordered_map<TSTRING, File> files;
+
+		// Is the snapshot valid?  This is cleared when we need to re-scan
+		// the folder.
+		bool valid = false;
+
+		// time of the snapshot, for the expiration of unmonitored folders
+		ULONGLONG scanTime = 0;
+
+		// Monitoring status.  'watched' is set while a change notification
+		// request is active on the folder.  'pending' is set while a read
+		// is outstanding, so that we know when it's safe to release the
+		// buffer.
+		bool watched = false;
+		bool watchStarted = false;
+		volatile bool pending = false;
+
+		// directory handle and notification buffer for the monitor
+		HANDLE hDir = INVALID_HANDLE_VALUE;
+		OVERLAPPED ov;
+		DWORD buf[4096];
+	};
+
+	// Look up a file.  Returns true if the file exists, filling in its
+	// modification time if 'mtime' is non-null.
+	static bool Lookup(const TCHAR *path, FILETIME *mtime);
+
+	// Find or create the snapshot for a folder, without scanning it.
+	// The caller must hold the lock.
+	static Folder *FindFolder(const TCHAR *dir, size_t dirLen);
+
+	// Get the snapshot for a folder, creating it or re-scanning it as
+	// needed.  The caller must hold the lock.
+	static Folder *GetFolder(const TCHAR *dir, size_t dirLen);
+
+	// is a folder's snapshot current (valid and not expired)?
+	static bool IsCurrent(const Folder *folder);
+
+	// Read a folder's file list from the disk.  Returns false if the
+	// folder doesn't exist.  This doesn't touch the snapshots, so the
+	// caller doesn't need to hold the lock.
+	typedef std::unordered_map<TSTRING, Folder::File> FileMap;
+	static bool ReadFolder(const TCHAR *path, FileMap &files);
+
+	// scan a folder into its snapshot
+	static void Scan(Folder *folder);
+
+	// Install a new file list in a snapshot, and start monitoring the
+	// folder if it exists and we're not already monitoring it.  The
+	// caller must hold the lock.
+	static void SetFiles(Folder *folder, FileMap &&files, bool exists);
+
+	// prefetch thread entrypoint
+	static DWORD WINAPI PrefetchThreadMain(LPVOID lParam);
+
+	// start monitoring a folder; called on the monitor thread
+	static void CALLBACK StartWatchAPC(ULONG_PTR param);
+
+	// issue the next change notification read on a folder
+	static bool Watch(Folder *folder);
+
+	// change notification completion routine
+	static void CALLBACK OnChange(DWORD err, DWORD bytes, LPOVERLAPPED ov);
+
+	// monitor thread entrypoint
+	static DWORD WINAPI ThreadMain(LPVOID);
+
+	// wake-up APC for the monitor thread
+	static void CALLBACK WakeAPC(ULONG_PTR) { }
+
+	// snapshots, keyed by lower-case folder path
+	static std::unordered_map<TSTRING, std::unique_ptr<Folder>> folders;
+
+	// monitor thread
+	static HandleHolder hThread;
+	static bool threadStarted;
+	static bool shuttingDown;
+
+	// lock for the snapshots
+	static CriticalSection lock;
+
+	// FindFirst() results, keyed by the lower-case folder list, root
+	// name, and extension list.  The value is the path found, or an empty
+	// string if there's no match.
+	static std::unordered_map<TSTRING, TSTRING> lookups;
+
+	// Change serial number.  This is incremented whenever an indexed
+	// folder's contents change, or a snapshot is explicitly invalidated,
+	// which invalidates the FindFirst() results.  'lookupSerial' is the
+	// serial number the current results are based on.
+	static UINT64 changeSerial;
+	static UINT64 lookupSerial;
+
+	// prefetch thread
+	static HandleHolder hPrefetchThread;
+
+	// expiration time for unmonitored snapshots, in milliseconds
+	static const ULONGLONG unwatchedExpiration = 5000;
+};
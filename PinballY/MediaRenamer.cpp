@@ -0,0 +1,135 @@
+// This file is part of PinballY
+// Copyright 2018 Michael J Roberts | GPL v3 or later | NO WARRANTY
+//
+// Media file renamer
+
+#include "stdafx.h"
+#include "../Utilities/GraphicsUtil.h"
+#include "MediaRenamer.h"
+#include "MediaFileIndex.h"
+#include "LogFile.h"
+#include "Resource.h"
+
+MediaRenamer::~MediaRenamer()
+{
+	// wait for the thread to finish; the renames are quick enough that
+	// it's better to let them complete than to leave a partial set
+	Wait();
+}
+
+bool MediaRenamer::Start(HWND hwndNotify, UINT notifyMsg)
+{
+	// remember the notification target
+	this->hwndNotify = hwndNotify;
+	this->notifyMsg = notifyMsg;
+
+	// start the thread
+	DWORD tid;
+	hThread = CreateThread(NULL, 0, &SThreadMain, this, 0, &tid);
+	if (hThread == NULL)
+	{
+		WindowsErrorMessage err;
+		LogFile::Get()->Write(_T("Media rename: unable to start the rename thread (error %d: %s)\n"),
+			err.GetCode(), err.Get());
+		return false;
+	}
+
+	return true;
+}
+
+DWORD MediaRenamer::ThreadMain()
+{
+	// do the renames, and let the main window know we're done
+	ok = Run(eh);
+	done = true;
+	PostMessage(hwndNotify, notifyMsg, 0, 0);
+	return 0;
+}
+
+bool MediaRenamer::Rename(const TSTRING &oldName, const TSTRING &newName, WindowsErrorMessage &err)
+{
+	if (!MoveFile(oldName.c_str(), newName.c_str()))
+	{
+		err.Reset();
+		return false;
+	}
+
+	// update the caches in place
+	MediaFileIndex::Rename(oldName.c_str(), newName.c_str());
+	ImageFileInfoCache::Rename(oldName.c_str(), newName.c_str());
+	return true;
+}
+
+bool MediaRenamer::Run(ErrorHandler &eh)
+{
+	// Rename files.  Do a few retries for any files with sharing
+	// conflicts, in case the conflict is coming from our own video
+	// or Flash player background threads: we might be able to clear
+	// up any such conflicts by waiting a moment for the background
+	// locks to clear.  Stop at the first other error, since the whole
+	// set is going to be rolled back anyway.
+	std::list<const RenameList::value_type*> done, pending;
+	for (auto &f : renameList)
+		pending.push_back(&f);
+
+	const int maxTries = 3;
+	bool failed = false;
+	for (int tries = 0; !failed && pending.size() != 0; ++tries)
+	{
+		// pause before each retry to give the lock holder a chance to finish
+		if (tries != 0)
+			Sleep(250);
+
+		// run through the pending list
+		for (auto it = pending.begin(); it != pending.end(); )
+		{
+			auto f = *it;
+			WindowsErrorMessage winErr;
+			if (Rename(f->first, f->second, winErr))
+			{
+				// success - move it to the completed list
+				done.push_front(f);
+				it = pending.erase(it);
+			}
+			else if (tries < maxTries && winErr.GetCode() == ERROR_SHARING_VIOLATION)
+			{
+				// sharing violation - leave it in the list for the next round
+				++it;
+			}
+			else
+			{
+				// other error - log it and stop
+				eh.Error(MsgFmt(IDS_ERR_MOVEFILE, f->first.c_str(), f->second.c_str(), winErr.Get()));
+				failed = true;
+				break;
+			}
+		}
+	}
+
+	// if everything worked, we're done
+	if (!failed)
+	{
+		LogFile::Get()->Write(LogFile::MediaFileLogging,
+			_T("Media rename: renamed %d file(s)\n"), static_cast<int>(done.size()));
+		return true;
+	}
+
+	// Roll back the completed renames, most recent first.  The original
+	// names were free a moment ago, so these should only fail if
+	// something else grabbed a name in the meantime.
+	rolledBack = true;
+	for (auto f : done)
+	{
+		WindowsErrorMessage winErr;
+		if (!Rename(f->second, f->first, winErr))
+		{
+			eh.Error(MsgFmt(IDS_ERR_MOVEFILE, f->second.c_str(), f->first.c_str(), winErr.Get()));
+			rolledBack = false;
+		}
+	}
+
+	LogFile::Get()->Write(LogFile::MediaFileLogging,
+		_T("Media rename: renaming failed; %d completed rename(s) %s\n"),
+		static_cast<int>(done.size()), rolledBack ? _T("rolled back") : _T("couldn't all be rolled back"));
+	return false;
+}
@@ -0,0 +1,104 @@
+// This file is part of PinballY
+// Copyright 2018 Michael J Roberts | GPL v3 or later | NO WARRANTY
+//
+// Media file renamer
+//
+// When a game's media name changes, GameListItem::UpdateMediaName()
+// works out which existing media files go with the old name, and this
+// object renames them to match the new name.  The renames are done as a
+// transaction: if any file can't be renamed, the files that were already
+// renamed are put back under their old names, so that the game's media
+// don't end up split between the two names.
+//
+// A game can have dozens of media files, and on a network share each
+// rename can take a noticeable amount of time, so the renames can run
+// on a background thread, with a notification message posted to a
+// window on completion.  The renames can also be run synchronously on
+// the caller's thread, for callers that need the result immediately.
+//
+// Each rename updates the media file index and the image file info
+// cache in place, since a rename doesn't change the file contents or
+// modification time; the renamed files can be found and displayed
+// without re-scanning the media folders or re-reading the files.
+
+#pragma once
+#include <list>
+#include <atomic>
+#include "../Utilities/Pointers.h"
+#include "../Utilities/WinUtil.h"
+#include "../Utilities/LogError.h"
+
+class MediaRenamer : public RefCounted
+{
+public:
+	// Rename list: old and new name pairs, as generated by
+	// GameListItem::UpdateMediaName()
+	typedef std::list<std::pair<TSTRING, TSTRING>> RenameList;
+
+	MediaRenamer(const RenameList &renameList) : renameList(renameList) { }
+
+	// Do the renames on the caller's thread.  Returns true if all of
+	// the files were renamed.  On failure, the errors are logged to the
+	// error handler, and any files already renamed are restored to
+	// their original names.
+	bool Run(ErrorHandler &eh);
+
+	// Start the renames on a background thread.  Completion is posted
+	// to 'hwndNotify' as 'notifyMsg'.
+	bool Start(HWND hwndNotify, UINT notifyMsg);
+
+	// Has the background thread finished its work?  This tests the
+	// 'done' flag rather than the thread handle, since the completion
+	// message is posted just before the thread exits, so the window can
+	// receive it while the thread is still technically running.
+	bool IsDone() const { return hThread == NULL || done; }
+
+	// Wait for the background thread to finish
+	void Wait() { if (hThread != NULL) WaitForSingleObject(hThread, INFINITE); }
+
+	// Get the results of a background run.  Call this after the
+	// completion notification.  Returns true if all of the files were
+	// renamed.  'rolledBack' is set if the renames failed, and all of
+	// the renamed files were successfully restored to their old names.
+	bool GetResults(const CapturingErrorHandler* &errors, bool &rolledBack) const
+	{
+		errors = &eh;
+		rolledBack = this->rolledBack;
+		return ok;
+	}
+
+	// Caller context.  The playfield view uses these to find the game
+	// on completion, and to restore its media name if the renames fail.
+	LONG gameID = 0;
+	TSTRING oldMediaName;
+
+protected:
+	// destruction waits for the thread to exit
+	~MediaRenamer();
+
+	// worker thread entrypoint
+	static DWORD WINAPI SThreadMain(LPVOID param) { return static_cast<MediaRenamer*>(param)->ThreadMain(); }
+	DWORD ThreadMain();
+
+	// rename one file, updating the media index and image info cache
+	static bool Rename(const TSTRING &oldName, const TSTRING &newName, WindowsErrorMessage &err);
+
+	// files to rename
+	RenameList renameList;
+
+	// notification window and message
+	HWND hwndNotify = NULL;
+	UINT notifyMsg = 0;
+
+	// worker thread
+	HandleHolder hThread;
+
+	// background results
+	CapturingErrorHandler eh;
+	bool ok = false;
+	bool rolledBack = false;
+
+	// Set by the thread when the results are ready, just before it
+	// posts the completion message
+	std::atomic<bool> done{ false };
+};
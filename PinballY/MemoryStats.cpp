@@ -0,0 +1,100 @@
+// This file is part of PinballY
+// Copyright 2018 Michael J Roberts | GPL v3 or later | NO WARRANTY
+//
+// Memory accounting
+
+#include "stdafx.h"
+#include <psapi.h>
+#include "../Utilities/Config.h"
+#include "MemoryStats.h"
+#include "TextureBudget.h"
+#include "GameList.h"
+#include "JavascriptEngine.h"
+#include "LogFile.h"
+
+// statics
+MemoryStats::Counter MemoryStats::counters[NSubsystems] = { };
+UINT_PTR MemoryStats::logTimerId = 0;
+int MemoryStats::logInterval = 0;
+
+const CHAR *MemoryStats::GetName(Subsystem s)
+{
+	static const CHAR *const names[] = {
+		"sprites", "video", "audio", "js", "dmd", "stats", "config"
+	};
+	static_assert(countof(names) == NSubsystems, "subsystem name list doesn't match the Subsystem enum");
+	return s >= 0 && s < NSubsystems ? names[s] : "?";
+}
+
+void MemoryStats::GetSnapshot(Snapshot &s)
+{
+	// start with the running counters
+	for (int i = 0; i < NSubsystems; ++i)
+	{
+		s.subsystems[i].cpuBytes = counters[i].cpuBytes;
+		s.subsystems[i].gpuBytes = counters[i].gpuBytes;
+	}
+
+	// add the queried and estimated subsystems
+	if (auto js = JavascriptEngine::Get(); js != nullptr)
+		s.subsystems[Javascript].cpuBytes += js->GetRuntimeMemoryUsage();
+	if (auto gl = GameList::Get(); gl != nullptr)
+		s.subsystems[GameStats].cpuBytes += gl->EstimateStatsDbMemory();
+	if (auto cfg = ConfigManager::GetInstance(); cfg != nullptr)
+		s.subsystems[Config].cpuBytes += cfg->EstimateMemory();
+
+	// get the process totals
+	PROCESS_MEMORY_COUNTERS_EX pmc;
+	pmc.cb = sizeof(pmc);
+	if (GetProcessMemoryInfo(GetCurrentProcess(), reinterpret_cast<PROCESS_MEMORY_COUNTERS*>(&pmc), sizeof(pmc)))
+	{
+		s.privateBytes = pmc.PrivateUsage;
+		s.workingSet = pmc.WorkingSetSize;
+	}
+	s.textureBytes = TextureBudget::GetTotalBytes();
+}
+
+TSTRING MemoryStats::Format(const Snapshot &s)
+{
+	auto MB = [](INT64 bytes) { return static_cast<double>(bytes) / (1024.0 * 1024.0); };
+
+	TSTRING txt = MsgFmt(_T("Mem MB: private %.1f, working set %.1f, textures %.1f"),
+		MB(s.privateBytes), MB(s.workingSet), MB(s.textureBytes)).Get();
+	for (int i = 0; i < NSubsystems; ++i)
+	{
+		auto const &u = s.subsystems[i];
+		txt += MsgFmt(_T(" | %hs %.1f"), GetName(static_cast<Subsystem>(i)), MB(u.cpuBytes)).Get();
+		if (u.gpuBytes != 0)
+			txt += MsgFmt(_T("+%.1fg"), MB(u.gpuBytes)).Get();
+	}
+	return txt;
+}
+
+void MemoryStats::Log()
+{
+	Snapshot s;
+	GetSnapshot(s);
+	LogFile::Get()->WriteTimestamp(_T("%s\n"), Format(s).c_str());
+}
+
+void MemoryStats::SetLogInterval(int seconds)
+{
+	// if the interval hasn't changed, leave the timer running on its current schedule
+	if (seconds == logInterval && (logTimerId != 0) == (seconds > 0))
+		return;
+
+	if (logTimerId != 0)
+	{
+		KillTimer(NULL, logTimerId);
+		logTimerId = 0;
+	}
+
+	logInterval = seconds;
+	if (seconds > 0)
+		logTimerId = SetTimer(NULL, 0, static_cast<UINT>(seconds) * 1000, &LogTimerProc);
+}
+
+void CALLBACK MemoryStats::LogTimerProc(HWND, UINT, UINT_PTR, DWORD)
+{
+	Log();
+}
@@ -0,0 +1,90 @@
+// This file is part of PinballY
+// Copyright 2018 Michael J Roberts | GPL v3 or later | NO WARRANTY
+//
+// Memory accounting
+//
+// When a long-running session's memory use grows, the process totals
+// alone don't say which part of the program is responsible.  This keeps
+// a per-subsystem breakdown of system memory (CPU) and texture memory
+// (GPU), for the subsystems that own most of the memory in a normal
+// session.
+//
+// Most of the numbers are running counters, which each subsystem updates
+// as it allocates and frees its buffers.  The texture numbers come from
+// the TextureBudget sentinels, which tag each texture with the subsystem
+// it belongs to.  A few subsystems keep their data in structures where
+// counters would mean touching every update path, so for those (the
+// Javascript heap, the game stats database, and the config settings) we
+// query or estimate the size when taking a snapshot.
+//
+// The breakdown is shown in the performance overlay (the FPS display),
+// is available to Javascript via mainWindow.getMemoryStats(), and is
+// written to the log periodically, according to Log.MemoryInterval.
+
+#pragma once
+
+class MemoryStats
+{
+public:
+	// subsystems
+	enum Subsystem
+	{
+		Sprites,         // sprite textures and GDI drawing surfaces
+		VideoFrames,     // video player frame buffers and frame textures
+		AudioCache,      // cached sound effects (AudioManager)
+		Javascript,      // Javascript runtime heap
+		DMDImages,       // DMD high score images and real DMD slide show frames
+		GameStats,       // game stats database (GameStats.csv)
+		Config,          // config settings
+		NSubsystems
+	};
+
+	// get the display name for a subsystem
+	static const CHAR *GetName(Subsystem s);
+
+	// update the running counters
+	static void AddCPU(Subsystem s, INT64 bytes) { InterlockedAdd64(&counters[s].cpuBytes, bytes); }
+	static void AddGPU(Subsystem s, INT64 bytes) { InterlockedAdd64(&counters[s].gpuBytes, bytes); }
+
+	// memory usage snapshot
+	struct Usage
+	{
+		INT64 cpuBytes = 0;
+		INT64 gpuBytes = 0;
+	};
+	struct Snapshot
+	{
+		Usage subsystems[NSubsystems];
+		INT64 privateBytes = 0;      // process private bytes
+		INT64 workingSet = 0;        // process working set
+		INT64 textureBytes = 0;      // total tracked texture memory
+	};
+
+	// Take a snapshot.  This must be called on the UI thread, since it
+	// queries the Javascript runtime and walks UI thread data structures.
+	static void GetSnapshot(Snapshot &s);
+
+	// Format a snapshot as one line of text, for the log and the overlay
+	static TSTRING Format(const Snapshot &s);
+
+	// write a snapshot to the log
+	static void Log();
+
+	// Set the periodic log interval in seconds; 0 disables the log.
+	// Call from the UI thread.
+	static void SetLogInterval(int seconds);
+
+protected:
+	// running counters
+	struct Counter
+	{
+		volatile INT64 cpuBytes;
+		volatile INT64 gpuBytes;
+	};
+	static Counter counters[NSubsystems];
+
+	// periodic log timer
+	static UINT_PTR logTimerId;
+	static int logInterval;
+	static void CALLBACK LogTimerProc(HWND, UINT, UINT_PTR, DWORD);
+};
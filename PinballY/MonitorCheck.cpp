@@ -27,7 +27,7 @@ MonitorCheck::~MonitorCheck()
 bool MonitorCheck::WaitForMonitors(const TCHAR *str, DWORD extra_wait_ms)
 {
 	// try matching the "N monitors, M seconds" pattern
-	std::basic_regex<TCHAR> pat(_T("\\s*(\\d+)\\s*monitors?\\s*[\\s,]\\s*(\\d+)\\s*seconds?\\s*"), std::regex_constants::icase);
+	static const std::basic_regex<TCHAR> pat(_T("\\s*(\\d+)\\s*monitors?\\s*[\\s,]\\s*(\\d+)\\s*seconds?\\s*"), std::regex_constants::icase);
 	std::match_results<const TCHAR *> m;
 	if (std::regex_match(str, m, pat))
 	{
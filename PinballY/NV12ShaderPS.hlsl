@@ -0,0 +1,66 @@
+// This file is part of PinballY
+// Copyright 2018 Michael J Roberts | GPL v3 or later | NO WARRANTY
+//
+// YUV 4:2:0 with interleaved chroma (VLC FOURCC 'NV12')
+//
+// NV12 is the native output format of the D3D11 hardware video
+// decoders.  It's the same 4:2:0 sampling as I420, but the U and V
+// samples are interleaved into a single plane, as U:V byte pairs.
+//
+// Use this shader by preparing the Y plane as a DXGI_FORMAT_R8_UNORM
+// texture, with one byte per pixel of the final image, and the U:V
+// plane as a DXGI_FORMAT_R8G8_UNORM texture, with one U:V pair per
+// 2x2 pixel block.  The U:V texture is half the width and height of
+// the Y texture.  Bind the two resource views to the shader in order
+// Y, UV, and render.
+//
+// This shader also handles P010, the 10-bit version of NV12.  P010
+// has the same layout with 16 bits per sample, with the 10 significant
+// bits in the high bits of each 16-bit word.  Bind the planes as
+// DXGI_FORMAT_R16_UNORM and DXGI_FORMAT_R16G16_UNORM textures, and the
+// UNORM normalization yields the same 0..1 range as the 8-bit formats,
+// so no adjustment is needed in the shader.
+//
+// The conversion is otherwise identical to the I420 shader; see
+// I420ShaderPS.hlsl for details.
+
+Texture2D<float> YTexture;
+Texture2D<float2> UVTexture;
+SamplerState SampleType;
+
+cbuffer AlphaBufferType
+{
+	float alpha;
+	float3 padding;
+}
+
+struct PixelInputType
+{
+	float4 position : SV_POSITION;
+	float2 tex : TEXCOORD0;
+	float3 normal : NORMAL;
+};
+
+float4 main(PixelInputType input) : SV_TARGET
+{
+	// Get Y', U', V', converting from normalized 0..1 range to 0..255.
+	// U and V come from the red and green channels of the U:V plane.
+	float Y = 1.164f * ((YTexture.Sample(SampleType, input.tex).r * 255.0f) - 16.0f);
+	float2 UV = (UVTexture.Sample(SampleType, input.tex).rg * 255.0f) - 128.0f;
+	float U = UV.r;
+	float V = UV.g;
+
+	// Figure the RGB conversion, converting the final result back to
+	// the normalized 0..1 range.
+	float4 RGBA = float4(
+		clamp(Y + 1.596f*V, 0, 255.0f) / 255.0f,
+		clamp(Y - 0.813f*V - 0.391f*U, 0, 255.0f) / 255.0f,
+		clamp(Y + 2.018f*U, 0, 255.0f) / 255.0f,
+		alpha);
+
+	// premultiply the alpha, to match our blend state
+	RGBA.xyz *= alpha;
+
+	// return the RGB result
+	return RGBA;
+}
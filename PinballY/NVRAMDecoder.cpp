@@ -0,0 +1,345 @@
+// This file is part of PinballY
+// Copyright 2018 Michael J Roberts | GPL v3 or later | NO WARRANTY
+//
+// In-process NVRAM high score decoder
+
+#include "stdafx.h"
+#include <regex>
+#include "../Utilities/FileUtil.h"
+#include "NVRAMDecoder.h"
+#include "LogFile.h"
+
+bool NVRAMDecoder::Load(const TCHAR *filename)
+{
+	// load the file
+	long len;
+	std::unique_ptr<BYTE> data(ReadFileAsStr(filename, SilentErrorHandler(), len,
+		ReadFileAsStr_NullTerm | ReadFileAsStr_NewlineTerm));
+	if (data == nullptr)
+	{
+		LogFile::Get()->Write(LogFile::HiScoreLogging,
+			_T("High score retrieval (init): NVRAM score map %s not loaded; all NVRAM queries will use PINemHi\n"), filename);
+		return false;
+	}
+
+	// log a syntax error
+	int lineNo = 0;
+	auto Error = [&lineNo, filename](const TCHAR *msg) {
+		LogFile::Get()->Write(LogFile::HiScoreLogging,
+			_T("High score retrieval (init): %s(%d): %s\n"), filename, lineNo, msg);
+	};
+
+	// parse a field format
+	static const std::basic_regex<TCHAR> fieldPat(_T("(bcd|nibble|ascii|nibble2)\\s+(\\d+)"), std::regex_constants::icase);
+	auto ParseField = [&Error](const TSTRING &val, Field &f, bool score) -> bool
+	{
+		std::match_results<TSTRING::const_iterator> m;
+		if (!std::regex_match(val, m, fieldPat))
+		{
+			Error(_T("invalid field format; expected <encoding> <length>"));
+			return false;
+		}
+
+		TSTRING enc = m[1].str();
+		std::transform(enc.begin(), enc.end(), enc.begin(), ::_totlower);
+		f.enc = enc == _T("bcd") ? Encoding::BCD : enc == _T("nibble") ? Encoding::Nibble :
+			enc == _T("ascii") ? Encoding::ASCII : Encoding::Nibble2;
+		f.len = _ttoi(m[2].str().c_str());
+
+		// scores are numeric, and initials are characters
+		bool numeric = f.enc == Encoding::BCD || f.enc == Encoding::Nibble;
+		if (numeric != score)
+		{
+			Error(score ? _T("scores must use BCD or nibble encoding") : _T("initials must use ASCII or nibble2 encoding"));
+			return false;
+		}
+		if (f.len < 1 || f.len > 16)
+		{
+			Error(_T("field length out of range"));
+			return false;
+		}
+		return true;
+	};
+
+	// parse an offset - hex with a 0x prefix, or decimal
+	auto ParseOffset = [](const TSTRING &s) -> long {
+		return tstriStartsWith(s.c_str(), _T("0x")) ? _tcstol(s.c_str() + 2, nullptr, 16) : _ttol(s.c_str());
+	};
+
+	// scan the lines
+	static const std::basic_regex<TCHAR> blankPat(_T("\\s*(#.*)?"));
+	static const std::basic_regex<TCHAR> sectPat(_T("\\s*\\[\\s*(family|rom)\\s+([^\\]]*?)\\s*\\]\\s*"), std::regex_constants::icase);
+	static const std::basic_regex<TCHAR> pairPat(_T("\\s*([^\\s=]+)\\s*=\\s*(.*?)\\s*"));
+	static const std::basic_regex<TCHAR> entryPat(_T("([^|]*?)\\s*\\|\\s*(-|0x[0-9a-f]+|\\d+)\\s*\\|\\s*(0x[0-9a-f]+|\\d+)"), std::regex_constants::icase);
+	Format *family = nullptr;
+	std::shared_ptr<Rom> rom;
+	bool inSection = false;
+	for (const CHAR *p = reinterpret_cast<const CHAR*>(data.get()); *p != 0; )
+	{
+		// pull out the next line
+		const CHAR *start = p;
+		for (; *p != 0 && *p != '\n' && *p != '\r'; ++p);
+		TSTRING line = AnsiToTSTRING(CSTRING(start, p - start).c_str());
+		if (*p == '\r' && *(p + 1) == '\n')
+			++p;
+		if (*p != 0)
+			++p;
+		++lineNo;
+
+		// skip blank lines and comments
+		if (std::regex_match(line, blankPat))
+			continue;
+
+		// check for a section header
+		std::match_results<TSTRING::const_iterator> m;
+		if (std::regex_match(line, m, sectPat))
+		{
+			TSTRING type = m[1].str(), names = m[2].str();
+			std::transform(type.begin(), type.end(), type.begin(), ::_totlower);
+			std::transform(names.begin(), names.end(), names.begin(), ::_totlower);
+			inSection = true;
+			family = nullptr;
+			rom = nullptr;
+			if (type == _T("family"))
+			{
+				// start a new family, with the default format
+				family = &(families[names] = Format());
+			}
+			else
+			{
+				// start a new ROM, shared among all of the names listed
+				rom = std::make_shared<Rom>();
+				for (auto &name : StrSplit<TSTRING>(names.c_str(), ','))
+				{
+					TSTRING n = TrimString<TSTRING>(name.c_str());
+					if (n.length() != 0)
+						roms[n] = rom;
+				}
+			}
+			continue;
+		}
+
+		// everything else should be a name=value pair within a section
+		if (!std::regex_match(line, m, pairPat))
+		{
+			Error(_T("syntax error; expected [section] or name=value"));
+			continue;
+		}
+		if (!inSection)
+		{
+			Error(_T("name=value pair outside of a [family] or [rom] section"));
+			continue;
+		}
+
+		// if the section was rejected, skip its contents
+		if (family == nullptr && rom == nullptr)
+			continue;
+
+		TSTRING name = m[1].str(), val = m[2].str();
+		std::transform(name.begin(), name.end(), name.begin(), ::_totlower);
+		Format &fmt = family != nullptr ? *family : rom->format;
+		if (name == _T("score"))
+			ParseField(val, fmt.score, true);
+		else if (name == _T("initials"))
+			ParseField(val, fmt.initials, false);
+		else if (name == _T("separator"))
+			fmt.separator = val.length() != 0 ? val[0] : 0;
+		else if (rom == nullptr)
+			Error(_T("invalid setting for a [family] section"));
+		else if (name == _T("family"))
+		{
+			// copy the family format
+			std::transform(val.begin(), val.end(), val.begin(), ::_totlower);
+			if (auto it = families.find(val); it != families.end())
+				rom->format = it->second;
+			else
+			{
+				// the entry can't be decoded without its format, so drop it
+				Error(_T("undefined family; this ROM entry will be ignored"));
+				for (auto it2 = roms.begin(); it2 != roms.end(); )
+					it2 = it2->second == rom ? roms.erase(it2) : std::next(it2);
+				rom = nullptr;
+			}
+		}
+		else if (name == _T("size"))
+			rom->size = ParseOffset(val);
+		else if (name == _T("title"))
+			rom->groups.push_back({ val, { } });
+		else if (name == _T("entry"))
+		{
+			std::match_results<TSTRING::const_iterator> me;
+			if (!std::regex_match(val, me, entryPat))
+			{
+				Error(_T("invalid entry; expected <label> | <initials offset> | <score offset>"));
+				continue;
+			}
+
+			// add it to the current group, starting an untitled group if necessary
+			if (rom->groups.size() == 0)
+				rom->groups.push_back({ _T(""), { } });
+			rom->groups.back().entries.push_back({
+				me[1].str(), me[2].str() == _T("-") ? -1 : ParseOffset(me[2].str()), ParseOffset(me[3].str()) });
+		}
+		else
+			Error(_T("invalid setting for a [rom] section"));
+	}
+
+	LogFile::Get()->Write(LogFile::HiScoreLogging,
+		_T("High score retrieval (init): NVRAM score map loaded, %d families, %d ROMs\n"),
+		static_cast<int>(families.size()), static_cast<int>(roms.size()));
+	return true;
+}
+
+const NVRAMDecoder::Rom *NVRAMDecoder::FindRom(const TCHAR *nvramFile) const
+{
+	// the key is the lower-case file name, minus the .nv suffix
+	TSTRING key = StripSuffixI(nvramFile, _T(".nv"));
+	std::transform(key.begin(), key.end(), key.begin(), ::_totlower);
+	auto it = roms.find(key);
+	return it != roms.end() ? it->second.get() : nullptr;
+}
+
+long NVRAMDecoder::FieldSize(const Field &f)
+{
+	return f.enc == Encoding::Nibble2 ? f.len * 2 : f.len;
+}
+
+bool NVRAMDecoder::DecodeScore(const BYTE *p, const Field &f, TCHAR separator, TSTRING &result)
+{
+	// Collect the digits, skipping leading zeroes.  Some boards fill the
+	// unused leading digits with $F, so treat those as leading zeroes as
+	// well, but any other non-decimal digit means that this isn't a score.
+	TSTRING digits;
+	auto AddDigit = [&digits](int d) -> bool
+	{
+		if (d == 0x0F && digits.length() == 0)
+			return true;
+		if (d > 9)
+			return false;
+		if (d != 0 || digits.length() != 0)
+			digits.push_back(static_cast<TCHAR>('0' + d));
+		return true;
+	};
+	for (int i = 0; i < f.len; ++i)
+	{
+		if (f.enc == Encoding::BCD ? !AddDigit(p[i] >> 4) || !AddDigit(p[i] & 0x0F) : !AddDigit(p[i] & 0x0F))
+			return false;
+	}
+	if (digits.length() == 0)
+		digits = _T("0");
+
+	// format it with the digit group separators
+	result.clear();
+	for (size_t i = 0; i < digits.length(); ++i)
+	{
+		if (separator != 0 && i != 0 && (digits.length() - i) % 3 == 0)
+			result.push_back(separator);
+		result.push_back(digits[i]);
+	}
+	return true;
+}
+
+bool NVRAMDecoder::DecodeInitials(const BYTE *p, const Field &f, TSTRING &result)
+{
+	result.clear();
+	for (int i = 0; i < f.len; ++i)
+	{
+		// get the character; treat nulls as spaces
+		int c = f.enc == Encoding::Nibble2 ? ((p[i*2] & 0x0F) << 4) | (p[i*2 + 1] & 0x0F) : p[i];
+		if (c == 0)
+			c = ' ';
+
+		// anything unprintable means that we're not looking at initials
+		if (c < 0x20 || c > 0x7E)
+			return false;
+
+		result.push_back(static_cast<TCHAR>(c));
+	}
+
+	// trim trailing spaces
+	while (result.length() != 0 && result.back() == ' ')
+		result.pop_back();
+	return true;
+}
+
+bool NVRAMDecoder::Decode(const TCHAR *path, const TCHAR *nvramFile, TSTRING &results) const
+{
+	// find the map entry
+	const Rom *rom = FindRom(nvramFile);
+	if (rom == nullptr)
+		return false;
+
+	// load the NVRAM file
+	long len;
+	std::unique_ptr<BYTE> data(ReadFileAsStr(path, SilentErrorHandler(), len, 0));
+	if (data == nullptr)
+		return false;
+
+	// if the map specifies a size, make sure it matches; a different
+	// size probably means a different memory layout
+	if (rom->size != 0 && rom->size != len)
+	{
+		LogFile::Get()->Write(LogFile::HiScoreLogging,
+			_T("+ NVRAM decoder: %s is %ld bytes, but the score map expects %ld bytes\n"), path, len, rom->size);
+		return false;
+	}
+
+	// decode the groups
+	const BYTE *p = data.get();
+	long scoreSize = FieldSize(rom->format.score);
+	long initialsSize = FieldSize(rom->format.initials);
+	results.clear();
+	for (auto &g : rom->groups)
+	{
+		// separate groups with a blank line
+		if (results.length() != 0)
+			results.append(_T("\n"));
+
+		// add the title
+		if (g.title.length() != 0)
+		{
+			results.append(g.title);
+			results.append(_T("\n"));
+		}
+
+		// add the entries
+		for (auto &e : g.entries)
+		{
+			// make sure the fields are within the file
+			if (e.scoreOfs < 0 || e.scoreOfs + scoreSize > len
+				|| (e.initialsOfs >= 0 && e.initialsOfs + initialsSize > len))
+			{
+				LogFile::Get()->Write(LogFile::HiScoreLogging,
+					_T("+ NVRAM decoder: score map offset is past the end of %s\n"), path);
+				return false;
+			}
+
+			// decode the fields
+			TSTRING score, initials;
+			if (!DecodeScore(p + e.scoreOfs, rom->format.score, rom->format.separator, score)
+				|| (e.initialsOfs >= 0 && !DecodeInitials(p + e.initialsOfs, rom->format.initials, initials)))
+			{
+				LogFile::Get()->Write(LogFile::HiScoreLogging,
+					_T("+ NVRAM decoder: %s doesn't contain a valid score table at the mapped offsets\n"), path);
+				return false;
+			}
+
+			// add the line, in PINemHi's "label initials score" format
+			TSTRING line = e.label;
+			for (auto const *s : { &initials, &score })
+			{
+				if (s->length() != 0)
+				{
+					if (line.length() != 0)
+						line.append(_T(" "));
+					line.append(*s);
+				}
+			}
+			results.append(line);
+			results.append(_T("\n"));
+		}
+	}
+
+	// an empty map entry doesn't count as a successful decode
+	return results.length() != 0;
+}
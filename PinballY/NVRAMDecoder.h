@@ -0,0 +1,122 @@
+// This file is part of PinballY
+// Copyright 2018 Michael J Roberts | GPL v3 or later | NO WARRANTY
+//
+// In-process NVRAM high score decoder
+//
+// Reading the high scores through PINemHi means launching a process for
+// every query, which costs a noticeable fraction of a second once the
+// process creation overhead and anti-virus scanning are counted.  For
+// the ROM families whose score tables have a simple fixed layout - WPC,
+// System 11, Data East/Sega, and Stern Whitestar/SAM - we can read the
+// scores straight out of the NVRAM file instead.
+//
+// The decoder is driven by a data file, NVRAMScoreMap.txt in the program
+// folder, which gives the score encodings for each ROM family, and the
+// score and initials offsets for each ROM.  See the comments at the top
+// of that file for the format.  The decoder's output follows PINemHi's
+// text format, so the results can be used interchangeably.
+//
+// ROMs that aren't in the map aren't supported, and the caller should
+// fall back on PINemHi for those.  A decode also fails if the NVRAM data
+// doesn't look like a valid score table (non-decimal BCD digits, say, or
+// unprintable initials), which protects against bad map entries and ROM
+// revisions with a different memory layout; the caller should fall back
+// on PINemHi in that case, too.
+
+#pragma once
+#include <vector>
+#include <memory>
+#include <unordered_map>
+
+class NVRAMDecoder
+{
+public:
+	// Load the score map file.  Returns true if the file was loaded.
+	// This isn't thread-safe, so it must be called before the decoder
+	// is used on any other threads.
+	bool Load(const TCHAR *filename);
+
+	// Is the given NVRAM file name (e.g., "afm_113b.nv") in the map?
+	bool IsSupported(const TCHAR *nvramFile) const { return FindRom(nvramFile) != nullptr; }
+
+	// Decode the given NVRAM file.  'path' is the full path to the file,
+	// and 'nvramFile' is the file name, which selects the ROM map entry.
+	// On success, fills in 'results' with the PINemHi-format score text
+	// and returns true.  Returns false if the ROM isn't supported, the
+	// file can't be read, or the data fails validation.
+	bool Decode(const TCHAR *path, const TCHAR *nvramFile, TSTRING &results) const;
+
+protected:
+	// field encoding
+	enum class Encoding
+	{
+		BCD,     // packed BCD, two digits per byte, most significant first
+		Nibble,  // one BCD digit per byte, in the low 4 bits (4-bit CMOS RAM)
+		ASCII,   // one character per byte
+		Nibble2  // one character per two bytes, high nibble first (4-bit CMOS RAM)
+	};
+
+	// Field format.  For a score, the length is the number of bytes;
+	// for initials, it's the number of characters.
+	struct Field
+	{
+		Encoding enc;
+		int len;
+	};
+
+	// ROM family format
+	struct Format
+	{
+		Field score = { Encoding::BCD, 4 };
+		Field initials = { Encoding::ASCII, 3 };
+
+		// digit group separator for formatting the scores
+		TCHAR separator = ',';
+	};
+
+	// Score table entry.  The initials offset is -1 if the entry has
+	// no initials.
+	struct Entry
+	{
+		TSTRING label;
+		long initialsOfs;
+		long scoreOfs;
+	};
+
+	// Group of entries under one caption ("GRAND CHAMPION", "HIGHEST
+	// SCORES", etc)
+	struct Group
+	{
+		TSTRING title;
+		std::vector<Entry> entries;
+	};
+
+	// ROM map entry
+	struct Rom
+	{
+		Format format;
+
+		// expected NVRAM file size, or 0 if the size isn't checked
+		long size = 0;
+
+		// score table groups
+		std::vector<Group> groups;
+	};
+
+	// find the map entry for an NVRAM file name
+	const Rom *FindRom(const TCHAR *nvramFile) const;
+
+	// decode fields; these return false if the data isn't valid
+	static bool DecodeScore(const BYTE *p, const Field &f, TCHAR separator, TSTRING &result);
+	static bool DecodeInitials(const BYTE *p, const Field &f, TSTRING &result);
+
+	// size of a field in the NVRAM data, in bytes
+	static long FieldSize(const Field &f);
+
+	// families, keyed by lower-case name
+	std::unordered_map<TSTRING, Format> families;
+
+	// ROMs, keyed by lower-case ROM name (the NVRAM file name minus
+	// the .nv suffix).  Several ROM revisions can share an entry.
+	std::unordered_map<TSTRING, std::shared_ptr<Rom>> roms;
+};
@@ -7,6 +7,7 @@
 #include <timeapi.h>
 #include <d3d11_1.h>
 #include <DirectXMath.h>
+#include <algorithm>
 #include "PerfMon.h"
 
 #pragma comment(lib, "pdh.lib")
@@ -30,6 +31,11 @@ PerfMon::PerfMon(float rolling_period_seconds)
 	// remember the rolling average time
 	this->rolling_period_sec = rolling_period_seconds;
 
+	// clear the frame time histogram
+	frameStart = now;
+	frameBudget_ms = 1000.0f / 60.0f;
+	ResetFrameTimes();
+
 	// initialize a CPU performance query
 	hCpuQuery = 0;
 	hCpuCounter = 0;
@@ -141,6 +147,106 @@ float PerfMon::GetRollingFPS()
 	return float((nFrames - rolling[curRolling].n0) / dt);
 }
 
+float PerfMon::EndFrameTime()
+{
+	// figure the elapsed time for the frame, in milliseconds
+	float dt_ms = float(timer.TicksToUs(timer.GetTime_ticks() - frameStart) / 1000.0);
+
+	// add it to the histogram, using the last bin for anything over the maximum
+	int bin = int(dt_ms * frameTimeBinsPerMs);
+	if (bin < 0)
+		bin = 0;
+	else if (bin >= nFrameTimeBins)
+		bin = nFrameTimeBins - 1;
+	++frameTimeHist[bin];
+
+	// count it, and note if it's a new maximum or over the budget
+	++nFrameTimes;
+	if (dt_ms > frameTimeMaxRecorded_ms)
+		frameTimeMaxRecorded_ms = dt_ms;
+	if (dt_ms > frameBudget_ms)
+		++nFramesOverBudget;
+
+	// add it to the recent frame time ring
+	recentFrameTimes[recentPos] = dt_ms;
+	recentPos = (recentPos + 1) % nRecentFrameTimes;
+	return dt_ms;
+}
+
+int PerfMon::GetRecentFrameTimes(float *buf, int maxCount) const
+{
+	// figure how many we have, up to the ring size
+	int n = static_cast<int>(min(nFrameTimes, static_cast<int64_t>(nRecentFrameTimes)));
+	if (n > maxCount)
+		n = maxCount;
+
+	// copy them out, oldest first
+	int src = recentPos - n;
+	if (src < 0)
+		src += nRecentFrameTimes;
+	for (int i = 0; i < n; ++i, src = (src + 1) % nRecentFrameTimes)
+		buf[i] = recentFrameTimes[src];
+
+	return n;
+}
+
+void PerfMon::GetRecentFrameTimeStats(FrameTimeStats &stats) const
+{
+	// get the recent frames, sorted by time
+	float times[nRecentFrameTimes];
+	int n = GetRecentFrameTimes(times, nRecentFrameTimes);
+	std::sort(times, times + n);
+
+	// figure the statistics
+	auto Percentile = [&times, n](float pct) { return n == 0 ? 0.0f : times[min(n - 1, int(ceil(n * pct / 100.0f)) - 1)]; };
+	stats.nFrames = n;
+	stats.nOverBudget = times + n - std::upper_bound(times, times + n, frameBudget_ms);
+	stats.budget_ms = frameBudget_ms;
+	stats.p50_ms = Percentile(50.0f);
+	stats.p95_ms = Percentile(95.0f);
+	stats.p99_ms = Percentile(99.0f);
+	stats.max_ms = n == 0 ? 0.0f : times[n - 1];
+}
+
+void PerfMon::ResetFrameTimes()
+{
+	ZeroMemory(frameTimeHist, sizeof(frameTimeHist));
+	nFrameTimes = 0;
+	nFramesOverBudget = 0;
+	frameTimeMaxRecorded_ms = 0.0f;
+	recentPos = 0;
+}
+
+float PerfMon::GetFrameTimePercentile(float pct) const
+{
+	// if we don't have any frames, there's no percentile
+	if (nFrameTimes == 0)
+		return 0.0f;
+
+	// Find the bin containing the target rank, and return the upper 
+	// end of the bin's range.  If the rank falls in the last bin, which
+	// is open-ended, the best we can do is the maximum.
+	int64_t target = int64_t(ceil(nFrameTimes * pct / 100.0f));
+	int64_t n = 0;
+	for (int i = 0; i < nFrameTimeBins - 1; ++i)
+	{
+		if ((n += frameTimeHist[i]) >= target)
+			return min(float(i + 1) / frameTimeBinsPerMs, frameTimeMaxRecorded_ms);
+	}
+	return frameTimeMaxRecorded_ms;
+}
+
+void PerfMon::GetFrameTimeStats(FrameTimeStats &stats) const
+{
+	stats.nFrames = nFrameTimes;
+	stats.nOverBudget = nFramesOverBudget;
+	stats.budget_ms = frameBudget_ms;
+	stats.p50_ms = GetFrameTimePercentile(50.0f);
+	stats.p95_ms = GetFrameTimePercentile(95.0f);
+	stats.p99_ms = GetFrameTimePercentile(99.0f);
+	stats.max_ms = frameTimeMaxRecorded_ms;
+}
+
 bool PerfMon::GetCPUMetrics(CPUMetrics &metrics)
 {
 	// we can only proceed if we have 
@@ -19,6 +19,9 @@ public:
 	// count a frame
 	inline void CountFrame() { ++nFrames; }
 
+	// get the total number of frames counted
+	int64_t GetFrameCount() const { return nFrames; }
+
 	// Get the instantaneous frames per second.  If the minimum time has
 	// elapsed, resets the cycle, fills in result with the current FPS
 	// rate, and returns true.  If the minimum time hasn't elapsed, simply
@@ -30,6 +33,45 @@ public:
 	// on the internal counters.
 	float GetRollingFPS();
 
+	// Frame time measurement.  Call BeginFrameTime() at the start of
+	// rendering a frame and EndFrameTime() when the frame is complete.
+	// This records the elapsed time for the frame in the frame time
+	// histogram, and returns it, in milliseconds.
+	inline void BeginFrameTime() { frameStart = timer.GetTime_ticks(); }
+	float EndFrameTime();
+
+	// Frame time statistics.  The percentiles are derived from the
+	// histogram, so they're accurate to the histogram bin width.
+	struct FrameTimeStats
+	{
+		int64_t nFrames;		// number of frames recorded
+		int64_t nOverBudget;	// number of frames over the frame time budget
+		float budget_ms;		// frame time budget, in milliseconds
+		float p50_ms;			// median frame time, in milliseconds
+		float p95_ms;			// 95th percentile frame time
+		float p99_ms;			// 99th percentile frame time
+		float max_ms;			// longest frame time
+	};
+
+	// Get the frame time statistics accumulated since the last reset
+	void GetFrameTimeStats(FrameTimeStats &stats) const;
+
+	// Reset the frame time statistics
+	void ResetFrameTimes();
+
+	// Get the most recent frame times, oldest first, for the frame time
+	// graph.  Fills in up to maxCount entries, in milliseconds, and
+	// returns the number filled in.
+	int GetRecentFrameTimes(float *buf, int maxCount) const;
+
+	// number of recent frame times we keep for the graph
+	static const int nRecentFrameTimes = 120;
+
+	// Get the frame time statistics for the recent frames only.  Unlike
+	// GetFrameTimeStats(), this reflects the current load, regardless of
+	// when the statistics were last reset.
+	void GetRecentFrameTimeStats(FrameTimeStats &stats) const;
+
 	// CPU metrics object
 	struct CPUMetrics
 	{
@@ -77,6 +119,37 @@ protected:
 	// time in seconds for the rolling average
 	float rolling_period_sec;
 
+	// Frame time histogram.  Each bin covers a fixed slice of time, up
+	// to a maximum time; frames longer than the maximum go in the last
+	// bin.  A fixed-size histogram lets us record every frame without
+	// any memory allocation, and find the percentiles without sorting.
+	static const int frameTimeBinsPerMs = 4;
+	static const int frameTimeMax_ms = 250;
+	static const int nFrameTimeBins = frameTimeMax_ms * frameTimeBinsPerMs + 1;
+	uint32_t frameTimeHist[nFrameTimeBins];
+
+	// start time of the frame in progress
+	int64_t frameStart;
+
+	// number of frames recorded in the histogram, and the number over budget
+	int64_t nFrameTimes;
+	int64_t nFramesOverBudget;
+
+	// longest frame time recorded, in milliseconds
+	float frameTimeMaxRecorded_ms;
+
+	// Recent frame times, in milliseconds, as a ring buffer.  'recentPos'
+	// is the index where the next frame time goes.
+	float recentFrameTimes[nRecentFrameTimes];
+	int recentPos;
+
+	// Frame time budget, in milliseconds.  This is the time available
+	// per frame at a 60 Hz refresh rate.
+	float frameBudget_ms;
+
+	// get the frame time at the given percentile of the histogram
+	float GetFrameTimePercentile(float pct) const;
+
 	// CPU performance query handle
 	HQUERY hCpuQuery;
 
@@ -11,6 +11,12 @@
 
 #pragma comment(lib, "setupapi.lib")
 
+// statics
+CriticalSection PinscapeDevice::completionLock;
+std::list<std::function<void()>> PinscapeDevice::completions;
+HWND PinscapeDevice::hwndNotify = NULL;
+UINT PinscapeDevice::notifyMsg = 0;
+
 void PinscapeDevice::FindDevices(std::list<PinscapeDevice> &devices)
 {
 	// get the list of devices matching the HID class GUID
@@ -63,7 +69,7 @@ void PinscapeDevice::FindDevices(std::list<PinscapeDevice> &devices)
 				continue;
 
 			// check for a match to our product name pattern
-			std::basic_regex<TCHAR> pspat(_T(".*\\bpinscape controller\\b.*"), std::regex_constants::icase);
+			static const std::basic_regex<TCHAR> pspat(_T(".*\\bpinscape controller\\b.*"), std::regex_constants::icase);
 			if (std::regex_match(name, pspat))
 			{
 				// It's a Pinscape device.  Search the existing list to see
@@ -193,8 +199,9 @@ PinscapeDevice::PinscapeDevice(
 		std::unique_ptr<BYTE> buf(ReadStatusReport());
 		if (buf != nullptr)
 		{
-			// note the plunger status
+			// note the plunger and Night Mode status
 			plungerEnabled = buf.get()[1] & 0x01;
+			nightMode = (buf.get()[1] & 0x02) != 0;
 		}
 		else
 		{
@@ -213,28 +220,155 @@ PinscapeDevice::PinscapeDevice(
 		// query the firmware build ID
 		QueryBuildId(firmwareVersion.date, firmwareVersion.time, firmwareVersion.s);
 	}
+
+	// If the device is valid, start its I/O thread.  From here on,
+	// all access to the device goes through the thread.
+	if (isValid)
+	{
+		DWORD tid;
+		hWakeEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
+		if (hWakeEvent != NULL)
+			hThread = CreateThread(NULL, 0, &SThreadMain, this, 0, &tid);
+
+		// we can't use the device without its thread
+		if (hThread == NULL)
+			isValid = false;
+	}
 }
 
 PinscapeDevice::~PinscapeDevice()
 {
+	// stop the device thread
+	if (hThread != NULL)
+	{
+		// discard any requests that haven't started yet, and tell the
+		// thread to exit
+		{
+			CriticalSectionLocker locker(requestLock);
+			requests.clear();
+			exitThread = true;
+		}
+		SetEvent(hWakeEvent);
+
+		// Wait for it to exit.  A request in progress might have to run
+		// out its USB timeouts first, but those are all bounded, so this
+		// won't wait forever.  We can't proceed until the thread is done,
+		// since it's using our member variables.
+		WaitForSingleObject(hThread, INFINITE);
+	}
+}
+
+void PinscapeDevice::SetNotifyWindow(HWND hwnd, UINT msg)
+{
+	CriticalSectionLocker locker(completionLock);
+	hwndNotify = hwnd;
+	notifyMsg = msg;
 }
 
-bool PinscapeDevice::IsNightMode()
+void PinscapeDevice::PostRequest(std::function<void()> request)
 {
-	// Read a status report
-	std::unique_ptr<BYTE> buf(ReadStatusReport());
-	if (buf == nullptr)
-		return false;
+	// ignore requests for invalid devices
+	if (hThread == NULL)
+		return;
+
+	// queue the request and wake the thread
+	CriticalSectionLocker locker(requestLock);
+	requests.emplace_back(request);
+	SetEvent(hWakeEvent);
+}
 
-	// Night Mode is indicated by bit 0x02 of the first byte
-	// in the status report packet
-	return buf.get()[1] & 0x02;
+void PinscapeDevice::PostCompletion(std::function<void()> completion)
+{
+	CriticalSectionLocker locker(completionLock);
+	completions.emplace_back(completion);
+
+	// Notify the main window.  Only post a notification for the first
+	// item added to an empty queue; ProcessCompletions() takes every
+	// item in the queue on each call, so there's no need to flood the
+	// window with redundant messages.
+	if (completions.size() == 1 && hwndNotify != NULL)
+		PostMessage(hwndNotify, notifyMsg, 0, 0);
 }
 
-void PinscapeDevice::SetNightMode(bool f)
+void PinscapeDevice::ProcessCompletions()
 {
-	// send the Set Night Mode request (special request 8)
-	SpecialRequest(8, f ? 1 : 0);
+	// Take the whole queue.  Run the callbacks outside of the lock,
+	// since a callback might queue new requests.
+	std::list<std::function<void()>> list;
+	{
+		CriticalSectionLocker locker(completionLock);
+		list.swap(completions);
+	}
+
+	for (auto &c : list)
+		c();
+}
+
+DWORD PinscapeDevice::ThreadMain()
+{
+	for (;;)
+	{
+		// get the next request
+		std::function<void()> request;
+		{
+			CriticalSectionLocker locker(requestLock);
+			if (exitThread)
+				return 0;
+
+			if (requests.size() != 0)
+			{
+				request = requests.front();
+				requests.pop_front();
+			}
+		}
+
+		// run the request, or wait for one to arrive
+		if (request != nullptr)
+			request();
+		else
+			WaitForSingleObject(hWakeEvent, INFINITE);
+	}
+}
+
+void PinscapeDevice::QueryNightMode(NightModeCallback callback)
+{
+	PostRequest([this, callback]()
+	{
+		// Read a status report.  Night Mode is indicated by bit 0x02
+		// of the first byte in the status report packet.
+		std::unique_ptr<BYTE> buf(ReadStatusReport());
+		bool ok = buf != nullptr;
+		if (ok)
+			nightMode = (buf.get()[1] & 0x02) != 0;
+
+		// report the result
+		if (callback != nullptr)
+			PostCompletion([callback, ok, nm = IsNightMode()]() { callback(ok, nm); });
+	});
+}
+
+void PinscapeDevice::SetNightMode(bool f, std::function<void(bool ok)> callback)
+{
+	// update the cached status
+	nightMode = f;
+
+	PostRequest([this, f, callback]()
+	{
+		// Send the Set Night Mode request (special request 8).  There's
+		// no reply for this request, so we can only tell whether or not
+		// the write succeeded.
+		std::unique_ptr<BYTE> buf(new BYTE[outputReportLength]);
+		buf.get()[0] = CMD_REPORT_ID;
+		buf.get()[1] = 0x41;		// Pinscape special request
+		buf.get()[2] = 8;			// Set Night Mode
+		buf.get()[3] = f ? 1 : 0;
+		ZeroMemory(buf.get() + 4, outputReportLength - 4);
+		bool ok = WriteUSB(buf.get());
+
+		// report the result
+		if (callback != nullptr)
+			PostCompletion([callback, ok]() { callback(ok); });
+	});
 }
 
 bool PinscapeDevice::QueryDeviceIdString(TSTRING &s, int n)
@@ -3,8 +3,28 @@
 //
 // Pinscape device interface.  This provides access to the USB HID
 // interface for Pinscape Controller units.
+//
+// Once a device object is set up, all of its USB I/O is carried out
+// on a background thread belonging to the device.  A Pinscape unit
+// that's slow to respond (or has stopped responding) can take the
+// full read/write timeouts on every request, so doing the I/O on the
+// UI thread would freeze the whole frontend for the duration.  The
+// public request methods instead queue the request to the device
+// thread and return immediately.  When the request is done, its
+// completion callback is called back on the main UI thread: the
+// device thread queues the completion and posts a notification to
+// the window set via SetNotifyWindow(), which calls
+// ProcessCompletions() to run the callbacks.
+//
+// The device thread handles requests one at a time, so each request
+// has exclusive use of the HID handle.  A request that expects a
+// reply matches it against the request by way of its reply filter,
+// skipping any unrelated reports (such as the periodic joystick
+// status reports) that arrive in the meantime.
 
 #pragma once
+#include <atomic>
+#include <deque>
 
 class PinscapeDevice
 {
@@ -30,11 +50,67 @@ public:
 	// to other software as an LedWiz.
 	int LedWizUnitNo() const { return ledWizUnitNo; }
 
-	// Get/set Night Mode for the unit
-	bool IsNightMode();
-	void SetNightMode(bool f);
+	// Night Mode status.  This returns the last known status, as
+	// read from the device at setup, updated by SetNightMode(), and
+	// refreshed by QueryNightMode().  It doesn't access the device.
+	bool IsNightMode() const { return nightMode; }
+
+	// Query the current Night Mode status from the device.  This
+	// updates the cached IsNightMode() status and then calls the
+	// callback, if provided, on the main thread.  'ok' is false if
+	// the device didn't respond, in which case the cached status
+	// is unchanged.
+	typedef std::function<void(bool ok, bool nightMode)> NightModeCallback;
+	void QueryNightMode(NightModeCallback callback = nullptr);
+
+	// Set Night Mode.  The cached status is updated immediately, and
+	// the request is sent to the device asynchronously.  The optional
+	// callback is called on the main thread when the request has been
+	// sent; 'ok' indicates whether or not the write succeeded.
+	void SetNightMode(bool f, std::function<void(bool ok)> callback = nullptr);
+
+	// Set the window that receives completion notifications.  The
+	// device threads post 'msg' to this window whenever they add a
+	// completion to the queue, and the window handler responds by
+	// calling ProcessCompletions().
+	static void SetNotifyWindow(HWND hwnd, UINT msg);
+
+	// Run the queued completion callbacks.  Call on the main thread.
+	static void ProcessCompletions();
 
 protected:
+	// Queue a request to the device thread.  The request function
+	// runs on the device thread, so it can freely perform blocking
+	// USB I/O, but it mustn't touch anything belonging to the UI.
+	void PostRequest(std::function<void()> request);
+
+	// Queue a completion callback to run on the main thread
+	static void PostCompletion(std::function<void()> completion);
+
+	// device thread entrypoint
+	static DWORD WINAPI SThreadMain(LPVOID param) { return static_cast<PinscapeDevice*>(param)->ThreadMain(); }
+	DWORD ThreadMain();
+
+	// device thread handle, and the event that wakes it when a
+	// request is queued or the thread is asked to exit
+	HandleHolder hThread;
+	HandleHolder hWakeEvent;
+
+	// Request queue.  Protected by the request lock.
+	CriticalSection requestLock;
+	std::deque<std::function<void()>> requests;
+	bool exitThread = false;
+
+	// Completion queue, shared among all devices, and the notification
+	// window.  Protected by the completion lock.
+	static CriticalSection completionLock;
+	static std::list<std::function<void()>> completions;
+	static HWND hwndNotify;
+	static UINT notifyMsg;
+
+	// last known Night Mode status
+	std::atomic<bool> nightMode{ false };
+
 	// query CPU information
 	bool QueryCpuId(TSTRING &cpuId) { return QueryDeviceIdString(cpuId, 1); }
 	bool QueryOpenSdaId(TSTRING &openSdaId) { return QueryDeviceIdString(openSdaId, 2); }
@@ -36,23 +36,41 @@
 #include "InstCardView.h"
 #include "Camera.h"
 #include "TextDraw.h"
+#include "FontCache.h"
 #include "VersionInfo.h"
 #include "Sprite.h"
+#include "AnimClock.h"
 #include "Application.h"
 #include "MouseButtons.h"
 #include "AudioManager.h"
 #include "DOFClient.h"
 #include "AudioVideoPlayer.h"
 #include "VLCAudioVideoPlayer.h"
+#include "LoaderPool.h"
 #include "HighScores.h"
 #include "RefTableList.h"
+#include "CaptureTimeStats.h"
 #include "VPFileReader.h"
+#include "VPTableInfoIndex.h"
 #include "MediaDropTarget.h"
 #include "SevenZipIfc.h"
 #include "RealDMD.h"
 #include "VPinMAMEIfc.h"
 #include "DialogWithSavedPos.h"
 #include "LogFile.h"
+#include "TextureBudget.h"
+#include "MediaFileIndex.h"
+#include "InputLatency.h"
+#include "MemoryStats.h"
+#include "ScriptLog.h"
+#include "PinscapeDevice.h"
+#include "Trace.h"
+#include "StartupTimeline.h"
+#include "LaunchTimeline.h"
+#include "StartupTasks.h"
+#include "SessionRecorder.h"
+#include "Benchmark.h"
+#include "FFmpegProbe.h"
 #include "../OptionsDialog/OptionsDialogExports.h"
 #include "JavascriptEngine.h"
 
@@ -101,6 +119,7 @@ namespace ConfigVars
 	static const TCHAR *AttractModeSwitchTime = _T("AttractMode.SwitchTime");
 	static const TCHAR *AttractModeHideWheelImages = _T("AttractMode.HideWheelImages");
 	static const TCHAR *AttractModeHideInfoBox = _T("AttractMode.HideInfoBox");
+	static const TCHAR *AttractModeLowPowerFrameRate = _T("AttractMode.LowPowerFrameRate");
 	static const TCHAR *PlayfieldWinPrefix = _T("PlayfieldWindow");
 	static const TCHAR *GameTimeout = _T("GameTimeout");
 	static const TCHAR *ExitKeyMode = _T("ExitMenu.ExitKeyMode");
@@ -125,6 +144,7 @@ namespace ConfigVars
 	static const TCHAR *LaunchFocusDelay = _T("LaunchFocus.Delay");
 
 	static const TCHAR *PlayfieldStretch = _T("Playfield.Stretch");
+	static const TCHAR *PlayfieldPrefetch = _T("Playfield.Prefetch");
 
 	static const TCHAR *InfoBoxShow = _T("InfoBox.Show");
 	static const TCHAR *InfoBoxTitle = _T("InfoBox.Title");
@@ -186,6 +206,9 @@ namespace ConfigVars
 	static const TCHAR *DOFEnable = _T("DOF.Enable");
 
 	static const TCHAR *TopmostDuringGameLaunch = _T("PlayfieldWindow.TopmostDuringGameLaunch");
+	static const TCHAR *YieldResourcesToGame = _T("YieldResourcesToGame");
+	static const TCHAR *GameLaunchOverlap = _T("GameLaunch.Overlap");
+	static const TCHAR *GameLaunchReleaseVideos = _T("GameLaunch.ReleaseVideos");
 
 	static const TCHAR *CaptureSkipLayoutMessage = _T("Capture.SkipLayoutMessage");
 	static const TCHAR *CaptureManualStartStopButtons = _T("Capture.ManualStartStopButton");
@@ -210,6 +233,15 @@ namespace ConfigVars
 // include the capture-related variables
 #include "CaptureConfigVars.h"
 
+// Cached handles for the variables that we read directly on key and
+// menu events, rather than loading into members in OnConfigChange()
+namespace ConfigVarHandles
+{
+	static ConfigManager::Var<bool> ExitMenuEnabled(ConfigVars::ExitMenuEnabled, true);
+	static ConfigManager::Var<bool> ShowOpMenuInExitMenu(ConfigVars::ShowOpMenuInExitMenu, false);
+	static ConfigManager::Var<bool> CaptureSkipLayoutMessage(ConfigVars::CaptureSkipLayoutMessage, false);
+};
+
 // Wheel animation time
 static const DWORD wheelTime = 260;
 static const DWORD fastWheelTime = 50;
@@ -326,6 +358,18 @@ PlayfieldView::~PlayfieldView()
 	// The user-defined filter list also contains Javascript object references,
 	// so clear it explicitly.
 	javascriptFilters.clear();
+
+	// likewise the GameInfo object cache
+	ClearJsGameInfoCache();
+
+	// terminate the Javascript workers
+	ClearJsWorkers();
+
+	// cancel outstanding asyncIO requests
+	jsAsyncIO.reset();
+
+	// cancel any media drop installation in progress
+	mediaDropInstaller = nullptr;
 }
 
 // Create our window
@@ -650,7 +694,10 @@ void PlayfieldView::InitJavascript()
 
 		// create and initialize the javascript engine
 		LogFile::Get()->Write(LogFile::JSLogging, _T(". Main script file exists; initializing Javascript engine\n"));
-		if (!JavascriptEngine::Init(eh, messageWindow, &debugOpts))
+		StartupTimeline::Phase enginePhase("Javascript engine setup");
+		bool engineOk = JavascriptEngine::Init(eh, messageWindow, &debugOpts);
+		enginePhase.End();
+		if (!engineOk)
 		{
 			LogFile::Get()->Write(LogFile::JSLogging, _T(". Javascript engine initialization failed; Javascript disabled for this session\n"));
 			return;
@@ -689,18 +736,15 @@ void PlayfieldView::InitJavascript()
 				// get the file:/// URL for the path
 				WSTRING url = js->GetFileUrl(path);
 
-				// load the file
-				long len;
-				std::unique_ptr<WCHAR> contents(ReadFileAsWStr(path, eh, len, ReadFileAsStr_NullTerm));
-				if (contents == nullptr)
-					return false;
-
-				// evaluate the script
-				return js->EvalScript(contents.get(), url.c_str(), nullptr, eh);
+				// load and evaluate the script, via the bytecode cache
+				return js->EvalScriptFile(path, url.c_str(), eh);
 			};
 
-			if (!LoadSysScript(_T("scripts\\system\\CParser.js"))
-				|| !LoadSysScript(_T("scripts\\system\\SystemClasses.js")))
+			StartupTimeline::Phase sysScriptPhase("Javascript system scripts");
+			bool sysScriptsOk = LoadSysScript(_T("scripts\\system\\CParser.js"))
+				&& LoadSysScript(_T("scripts\\system\\SystemClasses.js"));
+			sysScriptPhase.End();
+			if (!sysScriptsOk)
 			{
 				LogFile::Get()->Write(LogFile::JSLogging, _T(". Error loading system scripts; Javascript disabled for this session\n"));
 				return;
@@ -839,6 +883,15 @@ void PlayfieldView::InitJavascript()
 				|| !GetObj(jsCustomWindowClass, "CustomWindow"))
 				return;
 
+			// The PerfBudgetEvent class is optional, so that an older copy of
+			// the system scripts doesn't disable Javascript for the session.
+			// If it's missing, we simply don't fire the event.
+			if (JsValueType t; js->GetGlobProp(jsPerfBudgetEvent, "PerfBudgetEvent", where) == JsNoError
+				&& JsGetValueType(jsPerfBudgetEvent, &t) == JsNoError && t == JsFunction)
+				JsAddRef(jsPerfBudgetEvent, nullptr);
+			else
+				jsPerfBudgetEvent = JS_INVALID_REFERENCE;
+
 			// Initialize generic properties for a js window object.  Note that this has
 			// to wait until after binding the DLL import subsystem, since we depend upon
 			// the native HANDLE object type.
@@ -874,7 +927,8 @@ void PlayfieldView::InitJavascript()
 			}
 
 			// set up the console methods
-			if (!js->DefineObjPropFunc(jsConsole, "console", "_log", &PlayfieldView::JsConsoleLog, this, eh))
+			if (!js->DefineObjPropFunc(jsConsole, "console", "_log", &PlayfieldView::JsConsoleLog, this, eh)
+				|| !js->DefineObjPropFunc(jsConsole, "console", "getProfile", &PlayfieldView::JsConsoleGetProfile, this, eh))
 				return;
 
 			// set up logfile methods
@@ -897,6 +951,8 @@ void PlayfieldView::InitJavascript()
 			// set up mainWindow methods
 			if (!js->DefineObjPropFunc(jsMainWindow, "mainWindow", "message", &PlayfieldView::JsMessage, this, eh)
 				|| !js->DefineObjPropFunc(jsMainWindow, "mainWindow", "getUIMode", &PlayfieldView::JsGetUIMode, this, eh)
+				|| !js->DefineObjPropFunc(jsMainWindow, "mainWindow", "getMemoryStats", &PlayfieldView::JsGetMemoryStats, this, eh)
+				|| !js->DefineObjPropFunc(jsMainWindow, "mainWindow", "getPerfStats", &PlayfieldView::JsGetPerfStats, this, eh)
 				|| !js->DefineObjPropFunc(jsMainWindow, "mainWindow", "getActiveWindow", &PlayfieldView::JsGetActiveWindow, this, eh)
 				|| !js->DefineObjPropFunc(jsMainWindow, "mainWindow", "doCommand", &PlayfieldView::JsDoCommand, this, eh)
 				|| !js->DefineObjPropFunc(jsMainWindow, "mainWindow", "doButtonCommand", &PlayfieldView::JsDoButtonCommand, this, eh)
@@ -1012,6 +1068,34 @@ void PlayfieldView::InitJavascript()
 				return;
 			}
 
+			// Create the Worker constructor and prototype
+			JsValueRef workerConstructor;
+			where = _T("JsCreateFunction");
+			if (!js->DefineObjPropFunc(js->GetGlobalObject(), "global", "Worker", &JsWorkerConstructor, this, eh)
+				|| (err = js->GetProp(workerConstructor, js->GetGlobalObject(), "Worker", where)) != JsNoError
+				|| (err = js->GetProp(jsWorkerProto, workerConstructor, "prototype", where)) != JsNoError
+				|| !js->DefineObjMethod(jsWorkerProto, "Worker", "postMessage", &PlayfieldView::JsWorkerPostMessage, this, eh)
+				|| !js->DefineObjMethod(jsWorkerProto, "Worker", "terminate", &PlayfieldView::JsWorkerTerminate, this, eh))
+			{
+				LogFile::Get()->Write(LogFile::JSLogging, _T(". error initializing Worker: js error code %d, %s\n"), err, where);
+				return;
+			}
+
+			// Create the asyncIO object
+			jsAsyncIO.reset(new JavascriptAsyncIO(hWnd, PFVMsgJsAsyncIODone));
+			JsValueRef asyncIO;
+			if ((err = JsCreateObject(&asyncIO)) != JsNoError
+				|| (err = js->SetReadonlyProp(js->GetGlobalObject(), "asyncIO", asyncIO, where)) != JsNoError
+				|| !js->DefineObjPropFunc(asyncIO, "asyncIO", "readFile", &PlayfieldView::JsAsyncReadFile, this, eh)
+				|| !js->DefineObjPropFunc(asyncIO, "asyncIO", "writeFile", &PlayfieldView::JsAsyncWriteFile, this, eh)
+				|| !js->DefineObjPropFunc(asyncIO, "asyncIO", "listDir", &PlayfieldView::JsAsyncListDir, this, eh)
+				|| !js->DefineObjPropFunc(asyncIO, "asyncIO", "httpRequest", &PlayfieldView::JsAsyncHttpRequest, this, eh)
+				|| !js->DefineObjPropFunc(asyncIO, "asyncIO", "cancel", &PlayfieldView::JsAsyncCancel, this, eh))
+			{
+				LogFile::Get()->Write(LogFile::JSLogging, _T(". error initializing asyncIO: js error code %d, %s\n"), err, where);
+				return;
+			}
+
 			// Set up the game list methods.  These are nominally on the gameList Javascript
 			// object, but the actual implementations are still PlayfieldView:: methods.  We
 			// implement the methods here because the actual GameList instance can be deleted
@@ -1025,14 +1109,17 @@ void PlayfieldView::InitJavascript()
 				|| !js->DefineObjPropFunc(jsGameList, "gameList", "getGame", &PlayfieldView::JsGetGame, this, eh)
 				|| !js->DefineObjPropFunc(jsGameList, "gameList", "getAllGames", &PlayfieldView::JsGetAllGames, this, eh)
 				|| !js->DefineObjPropFunc(jsGameList, "gameList", "getGameCount", &PlayfieldView::JsGetGameCount, this, eh)
+				|| !js->DefineObjPropFunc(jsGameList, "gameList", "search", &PlayfieldView::JsSearchGames, this, eh)
 				|| !js->DefineObjPropFunc(jsGameList, "gameList", "getWheelGame", &PlayfieldView::JsGetWheelGame, this, eh)
 				|| !js->DefineObjPropFunc(jsGameList, "gameList", "getAllWheelGames", &PlayfieldView::JsGetAllWheelGames, this, eh)
+				|| !js->DefineObjPropFunc(jsGameList, "gameList", "getGameData", &PlayfieldView::JsGetGameData, this, eh)
 				|| !js->DefineObjPropFunc(jsGameList, "gameList", "getWheelCount", &PlayfieldView::JsGetWheelCount, this, eh)
 				|| !js->DefineObjPropFunc(jsGameList, "gameList", "getCurFilter", &PlayfieldView::JsGetCurFilter, this, eh)
 				|| !js->DefineObjPropFunc(jsGameList, "gameList", "setCurFilter", &PlayfieldView::JsSetCurFilter, this, eh)
 				|| !js->DefineObjPropFunc(jsGameList, "gameList", "refreshFilter", &PlayfieldView::JsRefreshFilter, this, eh)
 				|| !js->DefineObjPropFunc(jsGameList, "gameList", "getFilterInfo", &PlayfieldView::JsGetFilterInfo, this, eh)
 				|| !js->DefineObjPropFunc(jsGameList, "gameList", "getAllFilters", &PlayfieldView::JsGetAllFilters, this, eh)
+				|| !js->DefineObjPropFunc(jsGameList, "gameList", "getFilterCounts", &PlayfieldView::JsGetFilterCounts, this, eh)
 				|| !js->DefineObjPropFunc(jsGameList, "gameList", "createFilter", &PlayfieldView::JsCreateFilter, this, eh)
 				|| !js->DefineObjPropFunc(jsGameList, "gameList", "createMetaFilter", &PlayfieldView::JsCreateMetaFilter, this, eh)
 				|| !js->DefineObjPropFunc(jsGameList, "gameList", "removeMetaFilter", &PlayfieldView::JsRemoveMetaFilter, this, eh)
@@ -1103,9 +1190,9 @@ void PlayfieldView::InitJavascript()
 				|| !AddGameInfoGetter<bool>("isConfigured", [](GameListItem *game) { return game->isConfigured; }, eh)
 				|| !AddGameInfoGetter<bool>("isHidden", [](GameListItem *game) { return game->IsHidden() || GameList::Get()->IsHidden(game); }, eh)
 				|| !AddGameInfoStatsGetter<JsValueRef>("lastPlayed",
-					[](GameListItem *game) { auto d = GameList::Get()->GetLastPlayed(game); return d != nullptr && d[0] != 0 ? JE::NativeToJs(DateTime(d)) : JsUndef; }, eh)
+					[](GameListItem *game) { auto d = GameList::Get()->GetLastPlayedDate(game); return d != 0.0 ? JE::NativeToJs(DateTime(d)) : JsUndef; }, eh)
 				|| !AddGameInfoStatsGetter<JsValueRef>("dateAdded",
-					[](GameListItem *game) { auto d = GameList::Get()->GetDateAdded(game); return d != nullptr && d[0] != 0 ? JE::NativeToJs(DateTime(d)) : JsUndef; }, eh)
+					[](GameListItem *game) { auto d = GameList::Get()->GetDateAddedDate(game); return d != 0.0 ? JE::NativeToJs(DateTime(d)) : JsUndef; }, eh)
 				|| !AddGameInfoStatsGetter<JsValueRef>("highScoreStyle",
 					[](GameListItem *game) { auto hs = GameList::Get()->GetHighScoreStyle(game); return hs != nullptr ? JE::NativeToJs(hs) : JsUndef; }, eh)
 				|| !AddGameInfoStatsGetter<double>("playCount", [](GameListItem *game) { return static_cast<double>(GameList::Get()->GetPlayCount(game)); }, eh)
@@ -1172,7 +1259,8 @@ void PlayfieldView::InitJavascript()
 
 			// Set up the FilterInfo methods
 			if (!js->DefineObjMethod(jsFilterInfo, "FilterInfo", "getGames", &PlayfieldView::JsFilterInfoGetGames, this, eh)
-				|| !js->DefineObjMethod(jsFilterInfo, "FilterInfo", "testGame", &PlayfieldView::JsFilterInfoTestGame, this, eh))
+				|| !js->DefineObjMethod(jsFilterInfo, "FilterInfo", "testGame", &PlayfieldView::JsFilterInfoTestGame, this, eh)
+				|| !js->DefineObjMethod(jsFilterInfo, "FilterInfo", "getCount", &PlayfieldView::JsFilterInfoGetCount, this, eh))
 				return;
 
 			// Set up the JoystickInfo methods
@@ -1303,6 +1391,7 @@ void PlayfieldView::InitJavascript()
 			// Execute the user script.  This sets up event handlers for
 			// any events the script wants to be notified about.
 			LogFile::Get()->Write(LogFile::JSLogging, _T(". Loading main script file %s\n"), jsmain);
+			StartupTimeline::Phase mainScriptPhase("Javascript main script");
 			if (!js->LoadModule(jsmain, eh))
 				return;
 
@@ -1321,6 +1410,10 @@ void PlayfieldView::InitJavascript()
 			// number of iterations.
 			for (int iters = 0; iters < 100 && js->RunTasks(); ++iters);
 
+			// start the frame budget checks, if the scripts can receive the event
+			if (jsPerfBudgetEvent != JS_INVALID_REFERENCE)
+				SetTimer(hWnd, perfBudgetTimerID, 1000, NULL);
+
 			// We successfully initialized the javascript engine and loaded
 			// the user script.
 			cleanup.success = true;
@@ -1363,7 +1456,8 @@ bool PlayfieldView::InitJsWinObj(FrameWin *frame, JsValueRef jswinobj, const CHA
 		|| !js->DefineObjPropFunc(jswinobj, name, "setWindowPos", &FrameWin::JsSetWindowPos, frame, eh)
 		|| !js->DefineObjPropFunc(jswinobj, name, "setWindowState", &FrameWin::JsSetWindowState, frame, eh)
 		|| !js->DefineObjPropFunc(jswinobj, name, "createDrawingLayer", &BaseView::JsCreateDrawingLayer, view, eh)
-		|| !js->DefineObjPropFunc(jswinobj, name, "removeDrawingLayer", &BaseView::JsRemoveDrawingLayer, view, eh))
+		|| !js->DefineObjPropFunc(jswinobj, name, "removeDrawingLayer", &BaseView::JsRemoveDrawingLayer, view, eh)
+		|| !js->DefineObjPropFunc(jswinobj, name, "getFrameStats", &BaseView::JsGetFrameStats, view, eh))
 		return false;
 
 	// set up the SecondaryView methods, if this is a SecondaryView
@@ -1429,6 +1523,10 @@ void PlayfieldView::FireVideoEndEvent(JsValueRef drawingLayerObj, bool looping)
 
 bool PlayfieldView::FireMediaSyncBeginEvent(BaseView *view, GameListItem *game)
 {
+	// note the start of the sync for the session benchmark
+	if (Benchmark::IsSessionRunning())
+		Benchmark::OnMediaSync(view->GetConfigVarPrefix(), nullptr);
+
 	bool ret = true;
 	if (auto js = JavascriptEngine::Get(); js != nullptr)
 		ret = js->FireEvent(view->GetJsSelf(), jsMediaSyncBeginEvent, BuildJsGameInfo(game));
@@ -1472,10 +1570,35 @@ bool PlayfieldView::FireMediaSyncLoadEvent(BaseView *view, GameListItem *game,
 
 void PlayfieldView::FireMediaSyncEndEvent(BaseView *view, GameListItem *game, const TCHAR *disposition)
 {
+	if (Benchmark::IsSessionRunning())
+		Benchmark::OnMediaSync(view->GetConfigVarPrefix(), disposition);
+
 	if (auto js = JavascriptEngine::Get(); js != nullptr)
 		js->FireEvent(view->GetJsSelf(), jsMediaSyncEndEvent, BuildJsGameInfo(game), disposition);
 }
 
+void PlayfieldView::FirePerfBudgetEvent(BaseView *view)
+{
+	if (auto js = JavascriptEngine::Get(); js != nullptr && jsPerfBudgetEvent != JS_INVALID_REFERENCE
+		&& view->GetJsSelf() != JS_INVALID_REFERENCE)
+	{
+		PerfMon::FrameTimeStats ft;
+		view->GetRecentFrameTimeStats(ft);
+		js->FireEvent(view->GetJsSelf(), jsPerfBudgetEvent, view->IsOverFrameBudget(),
+			static_cast<double>(ft.p95_ms), static_cast<double>(ft.budget_ms));
+	}
+}
+
+void PlayfieldView::CheckFrameBudgets()
+{
+	auto app = Application::Get();
+	for (auto win : { app->GetPlayfieldWin(), app->GetBackglassWin(), app->GetDMDWin(), app->GetTopperWin(), app->GetInstCardWin() })
+	{
+		if (auto view = win != nullptr ? dynamic_cast<BaseView*>(win->GetView()) : nullptr; view != nullptr && view->CheckFrameBudget())
+			FirePerfBudgetEvent(view);
+	}
+}
+
 
 bool PlayfieldView::FireCommandEvent(int cmd)
 {
@@ -1580,7 +1703,9 @@ bool PlayfieldView::FireCommandButtonEvent(const QueuedKey &key)
 				(key.mode ? jsCommandButtonDownEvent : jsCommandButtonUpEvent);
 
 			// fire it
-			ret = js->FireEvent(jsMainWindow, event, key.cmd->name, key.mode == KeyRepeat || key.mode == KeyBgRepeat);
+			// fire it, using the interned string for the command name, since
+			// this fires on every autorepeat of a held button
+			ret = js->FireEvent(jsMainWindow, event, js->GetInternedString(key.cmd->name), key.mode == KeyRepeat || key.mode == KeyBgRepeat);
 		}
 	}
 
@@ -1650,10 +1775,11 @@ bool PlayfieldView::FireKeyEvent(int vkey, bool down, int repeatCount, bool bg)
 			(down ? jsKeyBgDownEvent : jsKeyBgUpEvent) :
 			(down ? jsKeyDownEvent : jsKeyUpEvent);
 
-		// dispatch the javsacript event
+		// dispatch the javsacript event, using interned strings for the
+		// key names, since these repeat with every autorepeat event
 		ret = js->FireEvent(jsMainWindow, eventType, vkey,
-			TSTRING(jsKey, jsKeyLen).c_str(), label.jsEventCode, label.jsEventLocation, 
-			repeatCount, bg);
+			js->GetInternedString(TSTRING(jsKey, jsKeyLen).c_str()), js->GetInternedString(label.jsEventCode),
+			label.jsEventLocation, repeatCount, bg);
 	}
 	return ret;
 }
@@ -1744,7 +1870,7 @@ void PlayfieldView::JsMessage(TSTRING msg, TSTRING typ)
 
 void PlayfieldView::JsLog(TSTRING msg)
 {
-	LogFile::Get()->Write(_T("[Script] %s\n"), msg.c_str());
+	ScriptLog::Write(ScriptLog::LogFileChannel, nullptr, msg);
 }
 
 void PlayfieldView::JsOutputDebugString(TSTRING msg)
@@ -1761,15 +1887,9 @@ double PlayfieldView::JsSetTimeout(JsValueRef func, double dt)
 
 void PlayfieldView::JsClearTimeout(double id)
 {
-	JavascriptEngine::Get()->EnumTasks([id](JavascriptEngine::Task *task)
-	{
-		if (auto tt = dynamic_cast<JavascriptEngine::TimeoutTask*>(task); tt != nullptr && tt->id == id)
-		{
-			tt->canceled = true;
-			return false;
-		}
-		return true;
-	});
+	auto js = JavascriptEngine::Get();
+	if (auto tt = dynamic_cast<JavascriptEngine::TimeoutTask*>(js->FindTask(id)); tt != nullptr)
+		js->CancelTask(tt);
 }
 
 double PlayfieldView::JsSetInterval(JsValueRef func, double dt)
@@ -1781,22 +1901,31 @@ double PlayfieldView::JsSetInterval(JsValueRef func, double dt)
 
 void PlayfieldView::JsClearInterval(double id)
 {
-	JavascriptEngine::Get()->EnumTasks([id](JavascriptEngine::Task *task)
-	{
-		if (auto it = dynamic_cast<JavascriptEngine::IntervalTask*>(task); it != nullptr && it->id == id)
-		{
-			it->canceled = true;
-			return false;
-		}
-		return true;
-	});
+	auto js = JavascriptEngine::Get();
+	if (auto it = dynamic_cast<JavascriptEngine::IntervalTask*>(js->FindTask(id)); it != nullptr)
+		js->CancelTask(it);
 }
 
 void PlayfieldView::JsConsoleLog(TSTRING level, TSTRING message)
 {
-	OutputDebugString(MsgFmt(_T("console.log(%s): %s\n"), level.c_str(), message.c_str()));
-	if (auto js = JavascriptEngine::Get(); js != nullptr)
-		js->DebugConsoleLog(level.c_str(), message.c_str());
+	ScriptLog::Write(ScriptLog::ConsoleChannel, level.c_str(), message);
+}
+
+JsValueRef PlayfieldView::JsConsoleGetProfile(bool reset)
+{
+	auto js = JavascriptEngine::Get();
+	try
+	{
+		JsValueRef summary = js->GetProfileSummary();
+		if (reset)
+			js->ResetProfile();
+
+		return summary;
+	}
+	catch (JavascriptEngine::CallException exc)
+	{
+		return js->Throw(exc.jsErrorCode, CHARToTCHAR(exc.what()));
+	}
 }
 
 JsValueRef PlayfieldView::JsGetUIMode()
@@ -1857,6 +1986,90 @@ JsValueRef PlayfieldView::JsGetUIMode()
 	return obj;
 }
 
+JsValueRef PlayfieldView::JsGetMemoryStats()
+{
+	JsValueRef obj = JS_INVALID_REFERENCE;
+	if (auto js = JavascriptEngine::Get(); js != nullptr && js->CreateObj(obj))
+	{
+		// take a snapshot
+		MemoryStats::Snapshot ms;
+		MemoryStats::GetSnapshot(ms);
+
+		// set the process totals
+		js->SetProp(obj, "privateBytes", static_cast<double>(ms.privateBytes));
+		js->SetProp(obj, "workingSet", static_cast<double>(ms.workingSet));
+		js->SetProp(obj, "textureBytes", static_cast<double>(ms.textureBytes));
+
+		// add a { cpu, gpu } object for each subsystem
+		for (int i = 0; i < MemoryStats::NSubsystems; ++i)
+		{
+			JsValueRef sub;
+			if (js->CreateObj(sub))
+			{
+				js->SetProp(sub, "cpu", static_cast<double>(ms.subsystems[i].cpuBytes));
+				js->SetProp(sub, "gpu", static_cast<double>(ms.subsystems[i].gpuBytes));
+				js->SetProp(obj, MemoryStats::GetName(static_cast<MemoryStats::Subsystem>(i)), sub);
+			}
+		}
+	}
+
+	return obj;
+}
+
+JsValueRef PlayfieldView::JsGetPerfStats()
+{
+	auto js = JavascriptEngine::Get();
+	try
+	{
+		using JsObj = JavascriptEngine::JsObj;
+		auto obj = JsObj::CreateObject();
+
+		// CPU load, from the playfield window's performance monitor
+		PerfMon::CPUMetrics cpu;
+		if (GetCPUMetrics(cpu))
+		{
+			auto cpuObj = JsObj::CreateObject();
+			cpuObj.Set("load", cpu.cpuLoad);
+			auto cores = JsObj::CreateArray();
+			for (int i = 0; i < cpu.nCpus; ++i)
+				cores.Push(cpu.coreLoad[i]);
+			cpuObj.Set("cores", cores.jsobj);
+			obj.Set("cpu", cpuObj.jsobj);
+		}
+
+		// media loading and playback load
+		obj.Set("mediaQueueDepth", static_cast<int>(LoaderPool::GetQueueDepth()));
+		std::vector<VLCAudioVideoPlayer::PlaybackStats> ps;
+		VLCAudioVideoPlayer::GetPlaybackStats(ps);
+		obj.Set("videosPlaying", static_cast<int>(ps.size()));
+
+		// memory counters
+		obj.Set("memory", JsGetMemoryStats());
+
+		// frame statistics for each window, keyed by the window object name
+		auto views = JsObj::CreateObject();
+		auto app = Application::Get();
+		auto AddView = [&views](FrameWin *win, const CHAR *name)
+		{
+			if (auto view = win != nullptr ? dynamic_cast<BaseView*>(win->GetView()) : nullptr; view != nullptr)
+				views.Set(name, view->JsGetFrameStats());
+		};
+		AddView(app->GetPlayfieldWin(), "mainWindow");
+		AddView(app->GetBackglassWin(), "backglassWindow");
+		AddView(app->GetDMDWin(), "dmdWindow");
+		AddView(app->GetTopperWin(), "topperWindow");
+		AddView(app->GetInstCardWin(), "instCardWindow");
+		obj.Set("views", views.jsobj);
+
+		return obj.jsobj;
+	}
+	catch (JavascriptEngine::CallException exc)
+	{
+		exc.Log(_T("mainWindow.getPerfStats()"));
+		return js->Throw(exc.jsErrorCode, _T("mainWindow.getPerfStats()"));
+	}
+}
+
 JsValueRef PlayfieldView::JsGetActiveWindow()
 {
 	// test a window to see if it's the active window; if so, sets jsobj to
@@ -1896,7 +2109,7 @@ JsValueRef PlayfieldView::JsGetKeyCommand(JavascriptEngine::JsObj desc)
 	{
 		// get the key type
 		WSTRING type = desc.Get<WSTRING>("type");
-		std::list<const KeyCommand*> *list = nullptr;
+		const CommandList *list = nullptr;
 		if (type == L"key")
 		{
 			// keyboard key - look it up by virtual key code or 
@@ -1916,16 +2129,14 @@ JsValueRef PlayfieldView::JsGetKeyCommand(JavascriptEngine::JsObj desc)
 			}
 
 			// look up the command list by vkey
-			if (auto it = vkeyToCommand.find(vkey); it != vkeyToCommand.end())
-				list = &it->second;
+			list = GetVkeyCommands(vkey);
 		}
 		else if (type == L"joystick")
 		{
 			// joystick button - get the joystick unit and button
 			int unit = desc.Get<int>("unit");
 			int button = desc.Get<int>("button");
-			if (auto it = jsCommands.find(JsCommandKey(unit, button)); it != jsCommands.end())
-				list = &it->second;
+			list = GetJsCommands(unit, button);
 		}
 
 		// If we found a list, return it as an array of command name strings.
@@ -2167,6 +2378,7 @@ template<typename T>
 bool PlayfieldView::AddGameInfoGetter(const CHAR *propName, T (*func)(GameListItem*), ErrorHandler &eh)
 {
 	typedef T funcType(GameListItem*);
+	gameInfoPropFuncs[propName] = [func](GameListItem *game) { return JavascriptEngine::NativeToJs(func(game)); };
 	return JavascriptEngine::Get()->DefineGetterSetter(jsGameInfo, "GameInfo", propName,
 		JavascriptEngine::Get()->CreateAndSaveMethodWrapper<funcType, T>(&PlayfieldView::JsGameInfoGetter, func), nullptr, eh);
 }
@@ -2198,6 +2410,7 @@ template<typename T>
 bool PlayfieldView::AddGameInfoStatsGetter(const CHAR *propName, T (*func)(GameListItem*), ErrorHandler &eh)
 {
 	typedef T funcType(GameListItem *);
+	gameInfoPropFuncs[propName] = [func](GameListItem *game) { return JavascriptEngine::NativeToJs(func(game)); };
 	return JavascriptEngine::Get()->DefineGetterSetter(jsGameInfo, "GameInfo", propName,
 		JavascriptEngine::Get()->CreateAndSaveMethodWrapper<funcType, JsValueRef>(&PlayfieldView::JsGameInfoStatsGetter, func), nullptr, eh);
 }
@@ -2208,16 +2421,58 @@ JsValueRef PlayfieldView::BuildJsGameInfo(const GameListItem *game)
 	if (!IsGameValid(game))
 		return JavascriptEngine::Get()->GetNullVal();
 
+	// If we have a cached object for the game that's still current, and
+	// the engine hasn't collected it yet, reuse it
+	UINT64 statsStamp = GameList::Get()->GetStatsStamp(const_cast<GameListItem*>(game));
+	if (auto it = jsGameInfoCache.find(game->internalID); it != jsGameInfoCache.end())
+	{
+		JsValueRef val = JS_INVALID_REFERENCE;
+		if (it->second.game == game && it->second.statsStamp == statsStamp
+			&& JsGetWeakReferenceValue(it->second.ref, &val) == JsNoError && val != JS_INVALID_REFERENCE)
+			return val;
+
+		// it's stale or collected - discard it
+		JsRelease(it->second.ref, nullptr);
+		jsGameInfoCache.erase(it);
+	}
+
 	// create a GameInfo object for the results
 	auto obj = JavascriptEngine::JsObj::CreateObjectWithPrototype(jsGameInfo);
 
 	// populate the properties
 	obj.Set("id", game->internalID);
 
+	// cache it
+	JsWeakRef ref;
+	if (JsCreateWeakReference(obj.jsobj, &ref) == JsNoError)
+	{
+		JsAddRef(ref, nullptr);
+		jsGameInfoCache.emplace(game->internalID, JsGameInfoCacheEntry{ ref, game, statsStamp });
+	}
+
 	// return the populated object
 	return obj.jsobj;
 }
 
+void PlayfieldView::InvalidateJsGameInfo(const GameListItem *game)
+{
+	if (game != nullptr)
+	{
+		if (auto it = jsGameInfoCache.find(game->internalID); it != jsGameInfoCache.end())
+		{
+			JsRelease(it->second.ref, nullptr);
+			jsGameInfoCache.erase(it);
+		}
+	}
+}
+
+void PlayfieldView::ClearJsGameInfoCache()
+{
+	for (auto &it : jsGameInfoCache)
+		JsRelease(it.second.ref, nullptr);
+	jsGameInfoCache.clear();
+}
+
 template<typename T>
 T PlayfieldView::JsGameSysInfoGetter(T (*func)(GameSystem*), JsValueRef self)
 {
@@ -2515,6 +2770,47 @@ JsValueRef PlayfieldView::JsGetAllGames()
 	}
 }
 
+JsValueRef PlayfieldView::JsSearchGames(WSTRING query, JsValueRef options)
+{
+	auto js = JavascriptEngine::Get();
+	try
+	{
+		// get options
+		int maxResults = 20;
+		if (!js->IsUndefinedOrNull(options))
+		{
+			JavascriptEngine::JsObj optionsObj(options);
+			if (optionsObj.Has("maxResults")) maxResults = optionsObj.Get<int>("maxResults");
+		}
+
+		// run the search
+		auto gl = GameList::Get();
+		std::vector<GameList::SearchResult> results;
+		gl->SearchGames(WSTRINGToTSTRING(query).c_str(), maxResults > 0 ? maxResults : 0, results);
+
+		// Build the result array.  Each element has the GameInfo object,
+		// the score, and the game's position on the wheel relative to the
+		// current game (suitable for setWheelGame()), or -1 if the game
+		// isn't in the current filter.
+		auto arr = JavascriptEngine::JsObj::CreateArray();
+		for (auto &r : results)
+		{
+			auto ele = JavascriptEngine::JsObj::CreateObject();
+			ele.Set("game", BuildJsGameInfo(r.game));
+			ele.Set("score", r.score);
+			ele.Set("wheelIndex", gl->GetFilterOffset(r.game));
+			arr.Push(ele.jsobj);
+		}
+
+		// return the array
+		return arr.jsobj;
+	}
+	catch (JavascriptEngine::CallException exc)
+	{
+		return js->Throw(exc.jsErrorCode, CHARToTCHAR(exc.what()));
+	}
+}
+
 int PlayfieldView::JsGetWheelCount()
 {
 	return GameList::Get()->GetCurFilterCount();
@@ -2583,6 +2879,73 @@ void PlayfieldView::JsSetWheelGame(int n, JsValueRef options)
 	}
 }
 
+JsValueRef PlayfieldView::JsGetGameData(JsValueRef options)
+{
+	auto js = JavascriptEngine::Get();
+	try
+	{
+		// get options
+		bool wheel = false;
+		std::vector<std::pair<CSTRING, const std::function<JsValueRef(GameListItem*)>*>> props;
+		if (!js->IsUndefinedOrNull(options))
+		{
+			JavascriptEngine::JsObj optionsObj(options);
+			if (optionsObj.Has("wheel")) wheel = optionsObj.Get<bool>("wheel");
+			if (optionsObj.Has("props"))
+			{
+				JavascriptEngine::JsObj propsObj(optionsObj.Get<JsValueRef>("props"));
+				for (int i = 0, n = propsObj.Get<int>("length"); i < n; ++i)
+				{
+					CSTRING name = WSTRINGToCSTRING(propsObj.GetAtIndex<WSTRING>(i));
+					auto it = gameInfoPropFuncs.find(name);
+					if (it == gameInfoPropFuncs.end())
+						return js->Throw(MsgFmt(_T("getGameData: invalid property name \"%hs\""), name.c_str()));
+					props.emplace_back(it->first, &it->second);
+				}
+			}
+		}
+
+		// by default, include all properties
+		if (props.size() == 0)
+		{
+			for (auto &it : gameInfoPropFuncs)
+				props.emplace_back(it.first, &it.second);
+		}
+
+		// build the data object for a game
+		auto arr = JavascriptEngine::JsObj::CreateArray();
+		auto AddGame = [&arr, &props](GameListItem *game)
+		{
+			auto ele = JavascriptEngine::JsObj::CreateObject();
+			ele.Set("id", game->internalID);
+			for (auto &p : props)
+				ele.Set(p.first.c_str(), (*p.second)(game));
+			arr.Push(ele.jsobj);
+		};
+
+		// populate the array from the wheel, starting at the current game,
+		// or from the master game list
+		auto gl = GameList::Get();
+		if (wheel)
+		{
+			for (int i = 0, n = gl->GetCurFilterCount(); i < n; ++i)
+			{
+				if (auto game = gl->GetNthGame(i); IsGameValid(game))
+					AddGame(game);
+			}
+		}
+		else
+			gl->EnumGames(AddGame);
+
+		// return the array
+		return arr.jsobj;
+	}
+	catch (JavascriptEngine::CallException exc)
+	{
+		return js->Throw(exc.jsErrorCode, CHARToTCHAR(exc.what()));
+	}
+}
+
 JsValueRef PlayfieldView::JsGetAllWheelGames()
 {
 	auto js = JavascriptEngine::Get();
@@ -3091,6 +3454,7 @@ JsValueRef PlayfieldView::JsGameInfoUpdate(JsValueRef self, JsValueRef descval,
 		if (year.isDefined)
 		{
 			gl->FindOrAddDateFilter(game->year = year.value);
+			gl->UpdateAttrIndex(game);
 			rebuildDb = true;
 		}
 
@@ -3109,6 +3473,7 @@ JsValueRef PlayfieldView::JsGameInfoUpdate(JsValueRef self, JsValueRef descval,
 		if (manufacturer.isDefined)
 		{
 			game->manufacturer = gl->FindOrAddManufacturer(manufacturer.value.c_str());
+			gl->UpdateAttrIndex(game);
 			rebuildDb = true;
 		}
 
@@ -3229,6 +3594,7 @@ void PlayfieldView::JsGameInfoErase(JsValueRef self)
 
 		// delete the game's XML entry
 		gl->DeleteXml(game);
+		InvalidateJsGameInfo(game);
 	
 		// do a full UI refresh, in case this affects the current game display
 		// or filter selection
@@ -3498,7 +3864,9 @@ PlayfieldView::JavascriptFilter::JavascriptFilter(
 	const TSTRING &group, const TSTRING &sortKey,
 	bool includeHidden, bool includeUnconfigured,
 	JsValueRef before, JsValueRef after,
-	JsValueRef customSortFunc, JsValueRef customPagingFunc) :
+	JsValueRef customSortFunc, JsValueRef customPagingFunc,
+	JsValueRef selectBatchFunc, bool cacheable,
+	JsValueRef sortKeyFunc, JsValueRef sortKeysFunc) :
 	GameListFilter(group.c_str(), sortKey.c_str()),
 	func(func),
 	id(_T("User.") + id),
@@ -3510,7 +3878,11 @@ PlayfieldView::JavascriptFilter::JavascriptFilter(
 	beforeScanFunc(before),
 	afterScanFunc(after),
 	customSortFunc(customSortFunc),
-	customPagingFunc(customPagingFunc)
+	customPagingFunc(customPagingFunc),
+	selectBatchFunc(selectBatchFunc),
+	cacheable(cacheable),
+	sortKeyFunc(sortKeyFunc),
+	sortKeysFunc(sortKeysFunc)
 {
 	// maintain an external reference on the functions
 	JsAddRef(func, nullptr);
@@ -3518,6 +3890,9 @@ PlayfieldView::JavascriptFilter::JavascriptFilter(
 	if (after != JS_INVALID_REFERENCE) JsAddRef(after, nullptr);
 	if (customSortFunc != JS_INVALID_REFERENCE) JsAddRef(customSortFunc, nullptr);
 	if (customPagingFunc != JS_INVALID_REFERENCE) JsAddRef(customPagingFunc, nullptr);
+	if (selectBatchFunc != JS_INVALID_REFERENCE) JsAddRef(selectBatchFunc, nullptr);
+	if (sortKeyFunc != JS_INVALID_REFERENCE) JsAddRef(sortKeyFunc, nullptr);
+	if (sortKeysFunc != JS_INVALID_REFERENCE) JsAddRef(sortKeysFunc, nullptr);
 }
 
 PlayfieldView::JavascriptFilter::~JavascriptFilter()
@@ -3527,15 +3902,54 @@ PlayfieldView::JavascriptFilter::~JavascriptFilter()
 	if (afterScanFunc != JS_INVALID_REFERENCE) JsRelease(afterScanFunc, nullptr);
 	if (customSortFunc != JS_INVALID_REFERENCE) JsRelease(customSortFunc, nullptr);
 	if (customPagingFunc != JS_INVALID_REFERENCE) JsRelease(customPagingFunc, nullptr);
+	if (selectBatchFunc != JS_INVALID_REFERENCE) JsRelease(selectBatchFunc, nullptr);
+	if (sortKeyFunc != JS_INVALID_REFERENCE) JsRelease(sortKeyFunc, nullptr);
+	if (sortKeysFunc != JS_INVALID_REFERENCE) JsRelease(sortKeysFunc, nullptr);
 }
 
 bool PlayfieldView::JavascriptFilter::CustomSortCompare(const GameListItem *a, const GameListItem *b) const
 {
+	// if we have a sort key function, compare the extracted keys
+	if (sortKeyFunc != JS_INVALID_REFERENCE || sortKeysFunc != JS_INVALID_REFERENCE)
+	{
+		static const SortKey noKey;
+		auto GetKey = [this](const GameListItem *game) -> const SortKey&
+		{
+			auto it = sortKeyCache.find(game);
+			return it != sortKeyCache.end() ? it->second : noKey;
+		};
+		const SortKey &ka = GetKey(a), &kb = GetKey(b);
+
+		// games without keys go at the end, in either direction
+		if (ka.type == SortKey::Type::None || kb.type == SortKey::Type::None)
+			return ka.type != SortKey::Type::None && kb.type == SortKey::Type::None;
+
+		// numbers sort before strings; otherwise compare the values
+		int cmp;
+		if (ka.type != kb.type)
+			cmp = ka.type == SortKey::Type::Number ? -1 : 1;
+		else if (ka.type == SortKey::Type::Number)
+			cmp = ka.num < kb.num ? -1 : ka.num > kb.num ? 1 : 0;
+		else
+			cmp = _wcsicmp(ka.str.c_str(), kb.str.c_str());
+
+		return sortDescending ? cmp > 0 : cmp < 0;
+	}
+
 	auto js = JavascriptEngine::Get();
 	auto pfv = Application::Get()->GetPlayfieldView();
 	try
 	{
-		return js->CallFunc<double>(customSortFunc, pfv->BuildJsGameInfo(a), pfv->BuildJsGameInfo(b)) < 0.0;
+		// use the cached game info objects if available
+		auto GetInfo = [this, pfv](const GameListItem *game)
+		{
+			if (auto it = sortInfoCache.find(game); it != sortInfoCache.end())
+				return it->second;
+			return pfv->BuildJsGameInfo(game);
+		};
+		JsValueRef infoA = GetInfo(a), infoB = GetInfo(b);
+		JavascriptEngine::ProfileScope profile("filter compareForSort", customSortFunc);
+		return js->CallFunc<double>(customSortFunc, infoA, infoB) < 0.0;
 	}
 	catch (JavascriptEngine::CallException exc)
 	{
@@ -3544,6 +3958,108 @@ bool PlayfieldView::JavascriptFilter::CustomSortCompare(const GameListItem *a, c
 	}
 }
 
+PlayfieldView::JavascriptFilter::SortKey PlayfieldView::JavascriptFilter::MakeSortKey(JsValueRef val)
+{
+	SortKey key;
+	JsValueType type;
+	if (JsGetValueType(val, &type) != JsNoError)
+		return key;
+
+	switch (type)
+	{
+	case JsUndefined:
+	case JsNull:
+		// no key
+		break;
+
+	case JsNumber:
+	case JsBoolean:
+		// numeric key; treat NaN as no key
+		key.num = JavascriptEngine::JsToNative<double>(val);
+		if (!isnan(key.num))
+			key.type = SortKey::Type::Number;
+		break;
+
+	default:
+		// use the string value of anything else
+		key.str = JavascriptEngine::JsToNative<WSTRING>(val);
+		key.type = SortKey::Type::String;
+		break;
+	}
+
+	return key;
+}
+
+void PlayfieldView::JavascriptFilter::BeforeSort(const std::vector<GameListItem*> &games)
+{
+	auto js = JavascriptEngine::Get();
+	auto pfv = Application::Get()->GetPlayfieldView();
+
+	// If there's a batch sort key function, get all of the keys in one
+	// call.  The function receives an array of game IDs, and returns an
+	// array (or typed array) of keys, in the same order.
+	if (sortKeysFunc != JS_INVALID_REFERENCE)
+	{
+		try
+		{
+			JsValueRef ids = CreateJsGameIdArray(games);
+			JavascriptEngine::ProfileScope profile("filter sortKeysFor", sortKeysFunc);
+			JavascriptEngine::JsObj keys(js->CallFunc<JsValueRef>(sortKeysFunc, ids));
+			sortKeyCache.reserve(games.size());
+			for (size_t i = 0; i < games.size(); ++i)
+				sortKeyCache.emplace(games[i], MakeSortKey(keys.GetAtIndex<JsValueRef>(static_cast<int>(i))));
+		}
+		catch (JavascriptEngine::CallException exc)
+		{
+			exc.Log(_T("User-defined filter sortKeys()"));
+		}
+		return;
+	}
+
+	// If there's a per-game sort key function, call it once per game
+	if (sortKeyFunc != JS_INVALID_REFERENCE)
+	{
+		try
+		{
+			sortKeyCache.reserve(games.size());
+			for (auto game : games)
+			{
+				JsValueRef info = pfv->BuildJsGameInfo(game);
+				JavascriptEngine::ProfileScope profile("filter sortKeyFor", sortKeyFunc);
+				sortKeyCache.emplace(game, MakeSortKey(js->CallFunc<JsValueRef>(sortKeyFunc, info)));
+			}
+		}
+		catch (JavascriptEngine::CallException exc)
+		{
+			exc.Log(_T("User-defined filter sortKey()"));
+		}
+		return;
+	}
+
+	// build the game info object for each game, keeping a reference on
+	// each one for the duration of the sort
+	sortInfoCache.reserve(games.size());
+	for (auto game : games)
+	{
+		if (JsValueRef info = pfv->BuildJsGameInfo(game); info != JS_INVALID_REFERENCE)
+		{
+			JsAddRef(info, nullptr);
+			sortInfoCache.emplace(game, info);
+		}
+	}
+}
+
+void PlayfieldView::JavascriptFilter::AfterSort()
+{
+	// discard the sort keys
+	sortKeyCache.clear();
+
+	// release the cached game info objects
+	for (auto &it : sortInfoCache)
+		JsRelease(it.second, nullptr);
+	sortInfoCache.clear();
+}
+
 int PlayfieldView::JavascriptFilter::GetPageGroup(const GameListItem *game) const
 {
 	// if there's no custom page group function, use the standard handling 
@@ -3555,7 +4071,9 @@ int PlayfieldView::JavascriptFilter::GetPageGroup(const GameListItem *game) cons
 	auto pfv = Application::Get()->GetPlayfieldView();
 	try
 	{
-		return js->CallFunc<int>(customPagingFunc, pfv->BuildJsGameInfo(game));
+		JsValueRef info = pfv->BuildJsGameInfo(game);
+		JavascriptEngine::ProfileScope profile("filter pageGroup", customPagingFunc);
+		return js->CallFunc<int>(customPagingFunc, info);
 	}
 	catch (JavascriptEngine::CallException exc)
 	{
@@ -3584,6 +4102,38 @@ int PlayfieldView::JsCreateFilter(JavascriptEngine::JsObj desc)
 		auto after = desc.Get<JsValueRef>("after");
 		auto customSortFunc = desc.Get<JsValueRef>("compareForSort");
 		auto customPagingFunc = desc.Get<JsValueRef>("pageGroup");
+		auto sortBy = desc.Get<WSTRING>("sortBy");
+		bool sortDescending = desc.Get<bool>("sortDescending");
+		auto selectBatch = desc.Get<JsValueRef>("selectBatch");
+		bool cacheable = desc.Get<bool>("cacheable");
+		auto sortKeyFunc = desc.Get<JsValueRef>("sortKeyFor");
+		auto sortKeysFunc = desc.Get<JsValueRef>("sortKeysFor");
+
+		// figure the standard sort order
+		static const struct
+		{
+			const WCHAR *name;
+			GameListFilter::SortOrder order;
+		} sortOrders[] = {
+			{ L"title", GameListFilter::SortOrder::Title },
+			{ L"year", GameListFilter::SortOrder::Year },
+			{ L"manufacturer", GameListFilter::SortOrder::Manufacturer },
+			{ L"rating", GameListFilter::SortOrder::Rating },
+			{ L"lastPlayed", GameListFilter::SortOrder::LastPlayed },
+			{ L"playCount", GameListFilter::SortOrder::PlayCount },
+		};
+		auto sortOrder = GameListFilter::SortOrder::Title;
+		if (sortBy.length() != 0)
+		{
+			auto it = std::find_if(std::begin(sortOrders), std::end(sortOrders),
+				[&sortBy](const auto &s) { return _wcsicmp(s.name, sortBy.c_str()) == 0; });
+			if (it == std::end(sortOrders))
+			{
+				js->Throw(MsgFmt(_T("createFilter: invalid sortBy value \"%ws\""), sortBy.c_str()));
+				return 0;
+			}
+			sortOrder = it->order;
+		}
 		
 		// use the title as the default sort key and menu title
 		if (sortKey.length() == 0)
@@ -3610,6 +4160,12 @@ int PlayfieldView::JsCreateFilter(JavascriptEngine::JsObj desc)
 			customSortFunc = JS_INVALID_REFERENCE;
 		if (js->IsFalsy(customPagingFunc))
 			customPagingFunc = JS_INVALID_REFERENCE;
+		if (js->IsFalsy(selectBatch))
+			selectBatch = JS_INVALID_REFERENCE;
+		if (js->IsFalsy(sortKeyFunc))
+			sortKeyFunc = JS_INVALID_REFERENCE;
+		if (js->IsFalsy(sortKeysFunc))
+			sortKeysFunc = JS_INVALID_REFERENCE;
 
 		// add it to our map 
 		JavascriptFilter *filter = &javascriptFilters.emplace(
@@ -3617,8 +4173,11 @@ int PlayfieldView::JsCreateFilter(JavascriptEngine::JsObj desc)
 			std::forward_as_tuple(id),
 			std::forward_as_tuple(
 				select, id, title, menuTitle, group, sortKey, includeHidden, includeUnconfig, 
-				before, after, customSortFunc, customPagingFunc)
+				before, after, customSortFunc, customPagingFunc, selectBatch, cacheable,
+				sortKeyFunc, sortKeysFunc)
 		).first->second;
+		filter->sortOrder = sortOrder;
+		filter->sortDescending = sortDescending;
 
 		// create the live filter
 		if (gl->AddUserDefinedFilter(filter))
@@ -3645,6 +4204,7 @@ void PlayfieldView::JavascriptFilter::BeforeScan()
 		try
 		{
 			JsValueRef argv[] = { JavascriptEngine::Get()->GetGlobalObject() }, result;
+			JavascriptEngine::ProfileScope profile("filter before", beforeScanFunc);
 			JsCallFunction(beforeScanFunc, argv, static_cast<unsigned short>(countof(argv)), &result);
 		}
 		catch (JavascriptEngine::CallException exc)
@@ -3661,6 +4221,7 @@ void PlayfieldView::JavascriptFilter::AfterScan()
 		try
 		{
 			JsValueRef argv[] = { JavascriptEngine::Get()->GetGlobalObject() }, result;
+			JavascriptEngine::ProfileScope profile("filter after", afterScanFunc);
 			JsCallFunction(afterScanFunc, argv, static_cast<unsigned short>(countof(argv)), &result);
 		}
 		catch (JavascriptEngine::CallException exc)
@@ -3673,6 +4234,16 @@ void PlayfieldView::JavascriptFilter::AfterScan()
 bool PlayfieldView::JavascriptFilter::Include(GameListItem *game)
 {
 	auto js = JavascriptEngine::Get();
+
+	// if there's only a batch function, test the game as a batch of one
+	if (selectBatchFunc != JS_INVALID_REFERENCE && js->IsFalsy(func))
+	{
+		std::vector<GameListItem*> games{ game };
+		std::vector<bool> include{ false };
+		IncludeBatch(games, include);
+		return include[0];
+	}
+
 	try
 	{
 		// get the javascript version of the game info object
@@ -3682,6 +4253,7 @@ bool PlayfieldView::JavascriptFilter::Include(GameListItem *game)
 		// call the callback function
 		JsValueRef argv[] = { js->GetGlobalObject(), jsgame }, result, boolval;
 		bool b;
+		JavascriptEngine::ProfileScope profile("filter select", func);
 		if (JsCallFunction(func, argv, static_cast<unsigned short>(countof(argv)), &result) == JsNoError
 			&& JsConvertValueToBoolean(result, &boolval) == JsNoError
 			&& JsBooleanToBool(boolval, &b) == JsNoError)
@@ -3697,17 +4269,142 @@ bool PlayfieldView::JavascriptFilter::Include(GameListItem *game)
 	}
 }
 
-JsValueRef PlayfieldView::JsFilterInfoGetGames(JsValueRef self)
+void PlayfieldView::JavascriptFilter::IncludeBatch(const std::vector<GameListItem*> &games, std::vector<bool> &include)
 {
-	auto js = JavascriptEngine::Get();
-	auto gl = GameList::Get();
 	try
 	{
-		// get the filter ID from self
-		JavascriptEngine::JsObj selfobj(self);
-		auto id = selfobj.Get<WSTRING>("id");
+		CallJsBatchSelect(selectBatchFunc, games, include, false);
+	}
+	catch (JavascriptEngine::CallException exc)
+	{
+		// on error, simply filter out the games
+		exc.Log(_T("User-defined filter selectBatch()"));
+		std::fill(include.begin(), include.end(), false);
+	}
+}
 
-		// look up the filter
+JsValueRef PlayfieldView::CreateJsGameIdArray(const std::vector<GameListItem*> &games)
+{
+	JsErrorCode err;
+	JsValueRef ids;
+	ChakraBytePtr buf = nullptr;
+	unsigned int buflen;
+	unsigned int n = static_cast<unsigned int>(games.size());
+	if ((err = JsCreateTypedArray(JsArrayTypeInt32, JS_INVALID_REFERENCE, 0, n, &ids)) != JsNoError
+		|| (err = JsGetTypedArrayStorage(ids, &buf, &buflen, nullptr, nullptr)) != JsNoError)
+		throw JavascriptEngine::CallException("Creating the game ID array", err);
+
+	auto idp = reinterpret_cast<INT32*>(buf);
+	for (unsigned int i = 0; i < n; ++i)
+		idp[i] = games[i]->internalID;
+
+	return ids;
+}
+
+void PlayfieldView::CallJsBatchSelect(JsValueRef func, const std::vector<GameListItem*> &games,
+	std::vector<bool> &include, bool passIncluded)
+{
+	auto js = JavascriptEngine::Get();
+	JsErrorCode err;
+	unsigned int n = static_cast<unsigned int>(games.size());
+
+	// Build the game ID array.  We pass IDs rather than game info objects,
+	// since building the objects is a large part of the cost of the
+	// per-game calls; the script can look up the details it needs with
+	// gameList.getGameData() or gameList.getGame().
+	JsValueRef ids = CreateJsGameIdArray(games);
+	ChakraBytePtr buf = nullptr;
+	unsigned int buflen;
+
+	// call the function, with the inclusion flags if desired
+	JsValueRef result;
+	JavascriptEngine::ProfileScope profile(passIncluded ? "metafilter selectBatch" : "filter selectBatch", func);
+	if (passIncluded)
+	{
+		JsValueRef flags;
+		if ((err = JsCreateTypedArray(JsArrayTypeUint8, JS_INVALID_REFERENCE, 0, n, &flags)) != JsNoError
+			|| (err = JsGetTypedArrayStorage(flags, &buf, &buflen, nullptr, nullptr)) != JsNoError)
+			throw JavascriptEngine::CallException("selectBatch: creating the inclusion flag array", err);
+
+		for (unsigned int i = 0; i < n; ++i)
+			buf[i] = include[i] ? 1 : 0;
+
+		result = js->CallFunc<JsValueRef>(func, ids, flags);
+	}
+	else
+		result = js->CallFunc<JsValueRef>(func, ids);
+
+	// anything the result doesn't mention is excluded
+	std::fill(include.begin(), include.end(), false);
+
+	// interpret the result according to its type
+	JsValueType type;
+	if ((err = JsGetValueType(result, &type)) != JsNoError)
+		throw JavascriptEngine::CallException("selectBatch: getting result type", err);
+
+	if (type == JsTypedArray)
+	{
+		// typed array mask: one element per game, non-zero means accepted
+		JsTypedArrayType arrType;
+		int eleSize;
+		if ((err = JsGetTypedArrayStorage(result, &buf, &buflen, &arrType, &eleSize)) != JsNoError)
+			throw JavascriptEngine::CallException("selectBatch: getting result array storage", err);
+
+		unsigned int nEle = min(n, buflen / static_cast<unsigned int>(eleSize));
+		for (unsigned int i = 0; i < nEle; ++i)
+		{
+			const BYTE *p = buf + i * eleSize;
+			include[i] = std::any_of(p, p + eleSize, [](BYTE b) { return b != 0; });
+		}
+	}
+	else if (type == JsArray)
+	{
+		// an empty array accepts nothing
+		JavascriptEngine::JsObj arr(result);
+		int len = arr.Get<int>("length");
+		if (len == 0)
+			return;
+
+		// check the element type to see if it's a mask or an ID list
+		JsValueType eleType;
+		if ((err = JsGetValueType(arr.GetAtIndex<JsValueRef>(0), &eleType)) != JsNoError)
+			throw JavascriptEngine::CallException("selectBatch: getting result element type", err);
+
+		if (eleType == JsBoolean)
+		{
+			// boolean mask, one element per game
+			int nEle = min(static_cast<int>(n), len);
+			for (int i = 0; i < nEle; ++i)
+				include[i] = arr.GetAtIndex<bool>(i);
+		}
+		else
+		{
+			// list of accepted game IDs
+			std::unordered_set<LONG> accepted;
+			for (int i = 0; i < len; ++i)
+				accepted.emplace(arr.GetAtIndex<int>(i));
+
+			for (unsigned int i = 0; i < n; ++i)
+				include[i] = accepted.find(games[i]->internalID) != accepted.end();
+		}
+	}
+	else if (type != JsUndefined && type != JsNull)
+	{
+		throw JavascriptEngine::CallException("selectBatch: the result must be an array or typed array", JsErrorInvalidArgument);
+	}
+}
+
+JsValueRef PlayfieldView::JsFilterInfoGetGames(JsValueRef self)
+{
+	auto js = JavascriptEngine::Get();
+	auto gl = GameList::Get();
+	try
+	{
+		// get the filter ID from self
+		JavascriptEngine::JsObj selfobj(self);
+		auto id = selfobj.Get<WSTRING>("id");
+
+		// look up the filter
 		auto filter = gl->GetFilterById(id.c_str());
 		if (filter == nullptr)
 			return js->GetNullVal();
@@ -3727,6 +4424,70 @@ JsValueRef PlayfieldView::JsFilterInfoGetGames(JsValueRef self)
 	}
 }
 
+JsValueRef PlayfieldView::JsFilterInfoGetCount(JsValueRef self)
+{
+	auto js = JavascriptEngine::Get();
+	auto gl = GameList::Get();
+	try
+	{
+		// get the filter ID from self
+		JavascriptEngine::JsObj selfobj(self);
+		auto id = selfobj.Get<WSTRING>("id");
+
+		// look up the filter
+		auto filter = gl->GetFilterById(id.c_str());
+		if (filter == nullptr)
+			return js->GetNullVal();
+
+		// return the count
+		return JavascriptEngine::NativeToJs(gl->GetFilterCount(filter));
+	}
+	catch (JavascriptEngine::CallException exc)
+	{
+		return js->Throw(exc.jsErrorCode, CHARToTCHAR(exc.what()));
+	}
+}
+
+JsValueRef PlayfieldView::JsGetFilterCounts(JsValueRef group)
+{
+	auto js = JavascriptEngine::Get();
+	auto gl = GameList::Get();
+	try
+	{
+		// If a menu group name was given, count the filters in that group
+		// (e.g., "[Cat]" for the categories), otherwise count them all
+		JsValueType type;
+		bool allGroups = JsGetValueType(group, &type) != JsNoError || type == JsUndefined || type == JsNull;
+		TSTRING groupName = allGroups ? _T("") : JavascriptEngine::JsToNative<TSTRING>(group);
+		std::vector<GameListFilter*> filters;
+		for (auto f : gl->GetFilters())
+		{
+			if (allGroups || f->menuGroup == groupName)
+				filters.push_back(f);
+		}
+
+		// get the counts in one batch
+		std::vector<int> counts;
+		gl->GetFilterCounts(filters, counts);
+
+		// Return them as an object keyed by filter ID.  Set the properties
+		// by wide-character name, since the IDs include category and
+		// manufacturer names.
+		auto obj = JavascriptEngine::JsObj::CreateObject();
+		for (size_t i = 0; i < filters.size(); ++i)
+		{
+			JsPropertyIdRef propkey;
+			if (JsGetPropertyIdFromName(filters[i]->GetFilterId().c_str(), &propkey) == JsNoError)
+				JsSetProperty(obj.jsobj, propkey, JavascriptEngine::NativeToJs(counts[i]), true);
+		}
+		return obj.jsobj;
+	}
+	catch (JavascriptEngine::CallException exc)
+	{
+		return js->Throw(exc.jsErrorCode, CHARToTCHAR(exc.what()));
+	}
+}
+
 bool PlayfieldView::JsFilterInfoTestGame(JsValueRef self, JsValueRef game)
 {
 	auto js = JavascriptEngine::Get();
@@ -3762,13 +4523,20 @@ int PlayfieldView::JsCreateMetaFilter(JavascriptEngine::JsObj desc)
 	auto js = JavascriptEngine::Get();
 	try
 	{
+		// get the batch selection function, if any
+		auto selectBatch = desc.Get<JsValueRef>("selectBatch");
+		if (js->IsFalsy(selectBatch))
+			selectBatch = JS_INVALID_REFERENCE;
+
 		// create the new filter object from the descriptor
 		auto &mf = javascriptMetaFilters.emplace_back(new JavascriptMetafilter(
 			desc.Get<JsValueRef>("before"),
 			desc.Get<JsValueRef>("select"),
 			desc.Get<JsValueRef>("after"),
+			selectBatch,
 			desc.Get<int>("priority"),
-			desc.Get<bool>("includeExcluded")));
+			desc.Get<bool>("includeExcluded"),
+			desc.Get<bool>("cacheable")));
 
 		// assign an ID 
 		mf->id = nextMetaFilterId++;
@@ -3823,7 +4591,10 @@ void PlayfieldView::JavascriptMetafilter::Before()
 	try
 	{
 		if (!js->IsUndefinedOrNull(before))
+		{
+			JavascriptEngine::ProfileScope profile("metafilter before", before);
 			js->CallFunc<void>(before);
+		}
 	}
 	catch (JavascriptEngine::CallException exc)
 	{
@@ -3837,7 +4608,10 @@ void PlayfieldView::JavascriptMetafilter::After()
 	try
 	{
 		if (!js->IsUndefinedOrNull(after))
+		{
+			JavascriptEngine::ProfileScope profile("metafilter after", after);
 			js->CallFunc<void>(after);
+		}
 	}
 	catch (JavascriptEngine::CallException exc)
 	{
@@ -3849,9 +4623,21 @@ bool PlayfieldView::JavascriptMetafilter::Include(GameListItem *game, bool inclu
 {
 	auto js = JavascriptEngine::Get();
 	auto pfv = Application::Get()->GetPlayfieldView();
+
+	// if there's only a batch function, test the game as a batch of one
+	if (selectBatch != JS_INVALID_REFERENCE && js->IsFalsy(select))
+	{
+		std::vector<GameListItem*> games{ game };
+		std::vector<bool> results{ include };
+		IncludeBatch(games, results);
+		return results[0];
+	}
+
 	try
 	{
-		return js->CallFunc<bool>(select, pfv->BuildJsGameInfo(game), include);
+		JsValueRef info = pfv->BuildJsGameInfo(game);
+		JavascriptEngine::ProfileScope profile("metafilter select", select);
+		return js->CallFunc<bool>(select, info, include);
 	}
 	catch (JavascriptEngine::CallException exc)
 	{
@@ -3860,6 +4646,19 @@ bool PlayfieldView::JavascriptMetafilter::Include(GameListItem *game, bool inclu
 	}
 }
 
+void PlayfieldView::JavascriptMetafilter::IncludeBatch(const std::vector<GameListItem*> &games, std::vector<bool> &include)
+{
+	try
+	{
+		CallJsBatchSelect(selectBatch, games, include, true);
+	}
+	catch (JavascriptEngine::CallException exc)
+	{
+		exc.Log(_T("User-defined metafilter selectBatch()"));
+		std::fill(include.begin(), include.end(), false);
+	}
+}
+
 void PlayfieldView::OnAppActivationChange(bool foreground)
 {
 	// kill any keyboard/joystick auto-repeat action whenever we 
@@ -3903,6 +4702,9 @@ bool PlayfieldView::OnCreate(CREATESTRUCT *cs)
 	// inherit the default handling
 	bool ret = __super::OnCreate(cs);
 
+	// receive Pinscape device request completions
+	PinscapeDevice::SetNotifyWindow(hWnd, PFVMsgPinscapeDone);
+
 	// Set a timer to do some extra initialization in a moment, to
 	// allow the UI to stabilize.
 	SetTimer(hWnd, startupTimerID, 1000, 0);
@@ -4162,8 +4964,11 @@ bool PlayfieldView::OnTimer(WPARAM timer, LPARAM callback)
 		return true;
 
 	case animTimerID:
-		// animation update timer
-		UpdateAnimation();
+		// Animation fallback timer.  The render loop normally drives the
+		// animation (see OnAnimationFrame), so we only need to step it
+		// here if the window hasn't rendered lately, as when it's hidden.
+		if (GetTickCount() - lastRenderTime >= AnimTimerInterval)
+			UpdateAnimation();
 		return true;
 
 	case audioFadeoutTimerID:
@@ -4183,8 +4988,10 @@ bool PlayfieldView::OnTimer(WPARAM timer, LPARAM callback)
 		return true;
 
 	case infoBoxFadeTimerID:
-		// Info box fade timer - update the fade animation
-		UpdateInfoBoxAnimation();
+		// Info box fade fallback timer - as with the main animation
+		// timer, only step the fade if the render loop isn't doing it
+		if (GetTickCount() - lastRenderTime >= AnimTimerInterval)
+			UpdateInfoBoxAnimation();
 		return true;
 
 	case infoBoxSyncTimerID:
@@ -4252,6 +5059,7 @@ bool PlayfieldView::OnTimer(WPARAM timer, LPARAM callback)
 	case restoreDOFAndDMDTimerID:
 		// If DOF is enabled, start reinitializing the DOF client.  This fires 
 		// off a background thread, so DOF won't be ready immediately.
+		StartupTasks::Join("DOF startup");
 		if (ConfigManager::GetInstance()->GetBool(ConfigVars::DOFEnable, true))
 			DOFClient::Init();
 
@@ -4292,7 +5100,10 @@ bool PlayfieldView::OnTimer(WPARAM timer, LPARAM callback)
 		return true;
 
 	case cleanupTimerID:
-		// process pending audio/video player deletions
+		// Process pending audio/video player deletions.  The retirement
+		// worker notifies us as each player becomes ready, so this only
+		// picks up stragglers that were still referenced elsewhere at
+		// the time.
 		AudioVideoPlayer::ProcessDeletionQueue();
 
 		// If we're in Pause Game mode, and there's no menu and no popup 
@@ -4386,6 +5197,34 @@ bool PlayfieldView::OnTimer(WPARAM timer, LPARAM callback)
 		// this is a one-shot
 		KillTimer(hWnd, timer);
 		break;
+
+	case perfBudgetTimerID:
+		// check the views against their frame budgets
+		CheckFrameBudgets();
+		break;
+
+	case attractLowPowerTimerID:
+		// the attract mode transition is over - drop to the low-power rate
+		KillTimer(hWnd, timer);
+		if (attractMode.IsLowPower())
+			D3DView::SetLowPowerFrameRate(attractMode.lowPowerFrameRate);
+		break;
+
+	case playfieldPrefetchTimerID:
+		// update the neighbor prefetch list; this is a one-shot
+		KillTimer(hWnd, timer);
+		UpdatePlayfieldPrefetch();
+		break;
+
+	case nvramPrescanTimerID:
+		// pre-scan the next batch of NVRAM files
+		NvramPrescanBatch();
+		break;
+
+	case popupPrerenderTimerID:
+		// pre-render the next popup; this stops the timer when done
+		PrerenderPopups();
+		break;
 	}
 
 	// use the default handling
@@ -4398,30 +5237,8 @@ bool PlayfieldView::OnCommand(int cmd, int source, HWND hwndControl)
 	switch (cmd)
 	{
 	case ID_SYNC_ALL_VIEWS:
-		// sync the backglass, and do a deferred sync on the DMD
-		if (auto bg = Application::Get()->GetBackglassView(); bg != nullptr)
-			bg->SyncCurrentGame();
-
-		// sync the simulated DMD window
-		if (auto dmd = Application::Get()->GetDMDView(); dmd != nullptr)
-			dmd->SyncCurrentGame();
-
-		// while we're at it, sync the real DMD, if we're using one
-		if (realDMD != nullptr)
-			realDMD->UpdateGame();
-
-		// sync the topper
-		if (auto topper = Application::Get()->GetTopperView(); topper != nullptr)
-			topper->SyncCurrentGame();
-
-		// sync the instruction card
-		if (auto inst = Application::Get()->GetInstCardView(); inst != nullptr)
-			inst->SyncCurrentGame();
-
-		// sync all custom views
-		CustomView::SyncAllCustomViews();
-
-		// done
+		// sync all of the secondary windows in one coordinated pass
+		SyncAllViews();
 		return true;
 
 	case ID_SYNC_BACKGLASS:
@@ -4564,8 +5381,7 @@ void PlayfieldView::JsDoButtonCommand(WSTRING cmd, bool down, int repeatCount)
 			(down ? repeatCount != 0 ? KeyRepeat : KeyDown : KeyUp));
 
 		// make a single-element list with the command
-		std::list<const KeyCommand*> commands;
-		commands.emplace_back(&it->second);
+		CommandList commands(1, &it->second);
 
 		// queue the key
 		ProcessKeyPress(hWnd, mode, repeatCount, bg, true, commands);
@@ -4838,7 +5654,7 @@ bool PlayfieldView::OnCommandImpl(int cmd, int source, HWND hwndControl)
 
 	case ID_CAPTURE_LAYOUT_SKIP:
 		ConfigManager::GetInstance()->SetBool(ConfigVars::CaptureSkipLayoutMessage,
-			!ConfigManager::GetInstance()->GetBool(ConfigVars::CaptureSkipLayoutMessage, false));
+			!ConfigVarHandles::CaptureSkipLayoutMessage.Get());
 		CaptureLayoutPrompt(0, true);
 		return true;
 		break;
@@ -5207,10 +6023,10 @@ bool PlayfieldView::HandleKeyEvent(BaseWin *win, UINT msg, WPARAM wParam, LPARAM
 		return false;
 
 	// determine if we have a handler
-	if (auto it = vkeyToCommand.find(vkey); it != vkeyToCommand.end())
+	if (auto cmds = GetVkeyCommands(vkey); cmds != nullptr)
 	{
 		// We found a handler for the key.  Process the key press.
-		ProcessKeyPress(win->GetHWnd(), mode, 0, false, false, it->second);
+		ProcessKeyPress(win->GetHWnd(), mode, 0, false, false, *cmds);
 
 		// the key event was handled
 		return true;
@@ -5222,23 +6038,86 @@ bool PlayfieldView::HandleKeyEvent(BaseWin *win, UINT msg, WPARAM wParam, LPARAM
 
 // Add a key press to the queue and process it
 void PlayfieldView::ProcessKeyPress(HWND hwndSrc, KeyPressType mode, int repeatCount, bool bg, bool scripted, 
-	std::list<const KeyCommand*> cmds)
+	const CommandList &cmds)
 {
+	// Measure latency for initial foreground key presses from the input
+	// devices.  Auto-repeats come from our own timers, and background
+	// commands don't render anything.
+	int64_t arrivalTime = (mode == KeyDown && !scripted) ? InputLatency::GetArrivalTime() : 0;
+
+	// record the event if we're recording the session
+	if (!scripted && SessionRecorder::IsRecording())
+	{
+		std::vector<const TCHAR*> names;
+		for (auto c : cmds)
+			names.push_back(c->name);
+		SessionRecorder::Record(mode, repeatCount, bg, names);
+	}
+
 	// add each command to the key queue
 	for (auto c : cmds)
+	{
 		keyQueue.emplace_back(hwndSrc, mode, repeatCount, bg, scripted, c);
+		keyQueue.back().arrivalTime = arrivalTime;
+	}
 
 	// If a wheel animation is in progress, skip directly to the end
 	// of the animation on any new key-down event.  This makes the
 	// UI more responsive by not forcing the user to wait through 
 	// each wheel animation step.
 	if (mode == KeyDown && wheelAnimMode == WheelAnimNormal)
-		wheelAnimStartTime = GetTickCount() - wheelTime;
+		wheelAnimStartTime = AnimClock::Now() - wheelTime;
 
 	// process the command queue
 	ProcessKeyQueue();
 }
 
+void PlayfieldView::PlaybackKeyEvent(int mode, int repeatCount, bool bg, const std::vector<TSTRING> &cmds)
+{
+	// look up the commands, skipping any that no longer exist
+	CommandList commands;
+	for (auto const &name : cmds)
+	{
+		if (auto it = commandsByName.find(name); it != commandsByName.end())
+			commands.push_back(&it->second);
+	}
+
+	// process the key press
+	if (commands.size() != 0)
+		ProcessKeyPress(hWnd, static_cast<KeyPressType>(mode), repeatCount, bg, false, commands);
+}
+
+void PlayfieldView::ResetForPlayback()
+{
+	// switch to the All Games filter
+	auto gl = GameList::Get();
+	gl->SetFilter(gl->GetAllGamesFilter());
+
+	// select the first game by title
+	GameListItem *first = nullptr;
+	gl->EnumGames([&first](GameListItem *game) { if (first == nullptr) first = game; });
+	if (int ofs = first != nullptr ? gl->GetFilterOffset(first) : -1; ofs > 0)
+		gl->SetGame(ofs);
+
+	// update the display, and restart the attract mode idle timing
+	UpdateSelection(true);
+	UpdateAllStatusText();
+	attractMode.Reset(this);
+}
+
+const CHAR *PlayfieldView::GetUIPhase() const
+{
+	if (Application::Get()->IsGameActive())
+		return "game";
+	if (attractMode.active)
+		return "attract";
+	if (curMenu != nullptr)
+		return "menu";
+	if (popupSprite != nullptr)
+		return "popup";
+	return "wheel";
+}
+
 void PlayfieldView::ShowHelp(const TCHAR *section)
 {
 	// Build the full help file name - <install folder>\Help\section.html
@@ -5278,7 +6157,7 @@ void PlayfieldView::ShowAboutBox()
 		// draw the title
 		const TCHAR *title = Application::Get()->Title;
 		Gdiplus::SolidBrush br(Gdiplus::Color(0xff, 0x40, 0x40, 0x40));
-		std::unique_ptr<Gdiplus::Font> titleFont(CreateGPFont(_T("Segoe UI"), 48, 400, false));
+		std::shared_ptr<Gdiplus::Font> titleFont(FontCache::GetGPFont(_T("Segoe UI"), 48, 400, false));
 		Gdiplus::PointF origin(margin, margin);
 		GPDrawStringAdv(g, title, titleFont.get(), &br, origin, bbox);
 
@@ -5286,8 +6165,8 @@ void PlayfieldView::ShowAboutBox()
 		origin.Y += 8;
 
 		// draw the version string
-		std::unique_ptr<Gdiplus::Font> verFont(CreateGPFont(_T("Segoe UI"), 24, 400, false));
-		std::unique_ptr<Gdiplus::Font> smallFont(CreateGPFont(_T("Segoe UI"), 14, 400, false));
+		std::shared_ptr<Gdiplus::Font> verFont(FontCache::GetGPFont(_T("Segoe UI"), 24, 400, false));
+		std::shared_ptr<Gdiplus::Font> smallFont(FontCache::GetGPFont(_T("Segoe UI"), 14, 400, false));
 		GPDrawStringAdv(g, MsgFmt(_T("Version %hs"), G_VersionInfo.fullVerWithStat),
 			verFont.get(), &br, origin, bbox);
 		GPDrawStringAdv(g, MsgFmt(_T("Build %d (%s, %hs)"),
@@ -5295,7 +6174,7 @@ void PlayfieldView::ShowAboutBox()
 			smallFont.get(), &br, origin, bbox);
 
 		// add the DOF version if present
-		std::unique_ptr<Gdiplus::Font> smallerFont(CreateGPFont(_T("Segoe UI"), 12, 400, false));
+		std::shared_ptr<Gdiplus::Font> smallerFont(FontCache::GetGPFont(_T("Segoe UI"), 12, 400, false));
 		if (DOFClient *dof = DOFClient::Get(); dof != nullptr && DOFClient::IsReady())
 			GPDrawStringAdv(g, MsgFmt(_T("DirectOutput Framework %s"), dof->GetDOFVersion()),
 				smallerFont.get(), &br, origin, bbox);
@@ -5311,8 +6190,8 @@ void PlayfieldView::ShowAboutBox()
 				smallerFont.get(), &br, origin, bbox);
 
 		// add the ffmpeg version if available
-		if (const char *ffmpegVer = Application::Get()->GetFFmpegVersion(); ffmpegVer != nullptr)
-			GPDrawStringAdv(g, MsgFmt(_T("FFmpeg version %hs"), ffmpegVer),
+		if (CSTRING ffmpegVer = Application::Get()->GetFFmpegVersion(); ffmpegVer.length() != 0)
+			GPDrawStringAdv(g, MsgFmt(_T("FFmpeg version %hs"), ffmpegVer.c_str()),
 				smallerFont.get(), &br, origin, bbox);
 		
 		// add the ChakraCore version if we're using Javascript
@@ -5473,6 +6352,9 @@ void PlayfieldView::PlayGame(int cmd, DWORD launchFlags, int systemIndex)
 void PlayfieldView::PlayGame(int cmd, DWORD launchFlags, GameListItem *game, GameSystem *system,
 	const std::list<std::pair<CSTRING, TSTRING>> *overrides)
 {
+	// start the launch timeline
+	LaunchTimeline::Begin();
+
 	// If desired, collect a credit on launch
 	if ((launchFlags & Application::LaunchFlags::ConsumeCredit) != 0)
 	{
@@ -5511,8 +6393,17 @@ void PlayfieldView::PlayGame(int cmd, DWORD launchFlags, GameListItem *game, Gam
 	// Program launchs also tend to be fairly slow, so this is also a
 	// good reason to do a save now - the few milliseconds needed to
 	// write our files won't be noticeable against the backdrop of a
-	// whole process launch.
-	Application::SaveFiles();
+	// whole process launch.  Wait for the background writes, so that
+	// the files are safely on disk before the game starts.  Under the
+	// launch overlap policy, the game monitor thread does the waiting,
+	// just before it creates the game process, so that the writes can
+	// proceed in parallel with the rest of the launch setup.
+	LaunchTimeline::Phase savePhase("save files");
+	if (launchOverlap)
+		Application::SaveFiles(true);
+	else
+		Application::FlushFiles();
+	savePhase.End();
 
 	// Clear any cached high score information, in case the user
 	// sets a new high score on this run.  That will ensure that
@@ -5575,6 +6466,7 @@ void PlayfieldView::LaunchQueuedGame()
 {
 	// Find the next launchable game in the queue.  Keep going until we
 	// find a game we can launch, or we exhaust the queue.
+	LaunchTimeline::Phase prelaunchPhase("prelaunch event");
 	GameListItem *game = nullptr;
 	GameSystem *sys = nullptr;
 	for (;;)
@@ -5621,29 +6513,53 @@ void PlayfieldView::LaunchQueuedGame()
 		}
 	}
 
-	// Before launching, shut down our DOF interface, so that the game
-	// can take it over while running.
-	dof.SetRomContext(_T(""));
-	dof.SetUIContext(L"");
-	DOFClient::Shutdown(false);
+	prelaunchPhase.End();
 
-	// Also shut down the real DMD, so that the game can take it over.
-	// Skip this if the real DMD is set to stay active during the game.
-	if (realDMD != nullptr && !realDMD->ShowMediaWhenRunning(game, sys))
+	// Shut down our DOF interface, so that the game can take it over
+	// while running, and the real DMD, unless it's set to stay active
+	// during the game.  We normally do this before launching, but under
+	// the launch overlap policy, we do it after starting the game monitor
+	// thread, so that it can run the RunBeforePre command in the meantime.
+	// The monitor thread waits for us to finish before going on to the
+	// RunBefore steps and the process launch, so the game will still find
+	// the devices released.
+	auto ReleaseDevices = [this, game, sys]()
 	{
-		realDMD->BeginRunningGameMode(game, sys);
-		realDMD.reset(nullptr);
-	}
+		LaunchTimeline::Phase dofPhase("DOF shutdown");
+		dof.SetRomContext(_T(""));
+		dof.SetUIContext(L"");
+		StartupTasks::Join("DOF startup");
+		DOFClient::Shutdown(false);
+		dofPhase.End();
+
+		if (realDMD != nullptr && !realDMD->ShowMediaWhenRunning(game, sys))
+		{
+			LaunchTimeline::Phase dmdPhase("real DMD shutdown");
+			realDMD->BeginRunningGameMode(game, sys);
+			realDMD.reset(nullptr);
+		}
+	};
+	if (!launchOverlap)
+		ReleaseDevices();
 
 	// kill any pending return-from-game timers, as we're going into a new game
 	KillTimer(hWnd, restoreDOFAndDMDTimerID);
 
 	// try launching the game
 	Application::InUiErrorHandler eh;
-	if (Application::Get()->LaunchNextQueuedGame(eh))
+	bool launched = Application::Get()->LaunchNextQueuedGame(eh);
+
+	// finish the device staging, and let the monitor thread proceed
+	if (launchOverlap)
+		ReleaseDevices();
+	Application::Get()->NoteFrontendStaged();
+
+	if (launched)
 	{
 		// show the "game running" popup in the main window
+		LaunchTimeline::Phase overlayPhase("running game overlay");
 		BeginRunningGameMode(game, sys);
+		overlayPhase.End();
 
 		// play the generic Launch button sound
 		PlayButtonSound(_T("Launch"));
@@ -5656,9 +6572,20 @@ void PlayfieldView::LaunchQueuedGame()
 			// we need to use an A/V player for it instead of the low-level
 			// Sound Manager, because the latter can only handle uncompressed
 			// PCM formats like WAV.  Launch audio clips are typically MP3s.
+			// Use the player we preloaded when the game was selected, if
+			// it's for the same file; otherwise open a new one.
 			SilentErrorHandler eh;
-			RefPtr<AudioVideoPlayer> player(new VLCAudioVideoPlayer(hWnd, hWnd, true));
-			if (player->Open(audio.c_str(), eh))
+			RefPtr<AudioVideoPlayer> player;
+			if (launchAudioPreload != nullptr && launchAudioPreloadFile == audio)
+				player.Attach(launchAudioPreload.Detach());
+			else
+			{
+				player.Attach(new VLCAudioVideoPlayer(hWnd, hWnd, true));
+				if (!player->Open(audio.c_str(), eh))
+					player = nullptr;
+			}
+			launchAudioPreloadFile.clear();
+			if (player != nullptr)
 			{
 				// set the volume level to the global video level
 				int vol = Application::Get()->GetVideoVolume();
@@ -5946,15 +6873,27 @@ void PlayfieldView::ShowFlyer(int pageNumber)
 	// figure the corresponding pixel size
 	SIZE pixSize = { (int)(normalizedSize.x * szLayout.cx), (int)(normalizedSize.y * szLayout.cy) };
 
-	// load the image at the calculated size
-    Application::InUiErrorHandler eh;
-	popupSprite.Attach(new Sprite());
-	if (!popupSprite->Load(flyer->c_str(), normalizedSize, pixSize, hWnd, eh))
+	// Use the cached sprite if we've shown this page recently at the same
+	// size, as when paging back and forth through the flyers; otherwise
+	// load the image at the calculated size, and add it to the cache.
+	TSTRING cacheKey = MsgFmt(_T("flyer|%s|%dx%d"), flyer->c_str(), pixSize.cx, pixSize.cy).Get();
+	if (Sprite *cached = popupCache.Get(cacheKey); cached != nullptr)
 	{
-		popupSprite = nullptr;
-		UpdateDrawingList();
-		ShowQueuedError();
-		return;
+		popupSprite = cached;
+		popupSprite->alpha = 1.0f;
+	}
+	else
+	{
+		Application::InUiErrorHandler eh;
+		popupSprite.Attach(new Sprite());
+		if (!popupSprite->Load(flyer->c_str(), normalizedSize, pixSize, hWnd, eh))
+		{
+			popupSprite = nullptr;
+			UpdateDrawingList();
+			ShowQueuedError();
+			return;
+		}
+		popupCache.Add(cacheKey, popupSprite, static_cast<INT64>(pixSize.cx) * pixSize.cy * 4);
 	}
 
 	// remember the new flyer page
@@ -6010,7 +6949,11 @@ void PlayfieldView::UpdateRateGameDialog()
 	// set up the info box
 	const int width = 600, height = 480;
 	Application::InUiErrorHandler eh;
-	popupSprite.Attach(new Sprite());
+
+	// If the dialog is already showing, redraw into its existing sprite,
+	// so that the update only has to upload the part that changed.
+	if (popupSprite == nullptr || popupType != PopupRateGame)
+		popupSprite.Attach(new Sprite());
 	if (!popupSprite->Load(width, height, [gl, game, this, width, height](HDC hdc, HBITMAP)
 	{
 		// set up a GDI+ drawing context
@@ -6281,9 +7224,11 @@ void PlayfieldView::UpdateAudioVolumeDialog()
 	// draw once off-screen to figure the height
 	DrawOffScreen(width, height, [&](HDC hdc, HBITMAP hbmp, const void*, const BITMAPINFO&) { Draw(hdc, hbmp); });
 
-	// draw it for real
+	// draw it for real, reusing the existing sprite if the dialog is
+	// already showing
 	Application::InUiErrorHandler eh;
-	popupSprite.Attach(new Sprite());
+	if (popupSprite == nullptr || popupType != PopupGameAudioVolume)
+		popupSprite.Attach(new Sprite());
 	if (!popupSprite->Load(width, height, Draw, eh, _T("Game Audio Volume Dialog")))
 	{
 		popupSprite = nullptr;
@@ -6543,8 +7488,9 @@ void PlayfieldView::JsShowPopup(JavascriptEngine::JsObj contents)
 }
 
 PlayfieldView::JsDrawingContext::JsDrawingContext(
-	PlayfieldView *pfv, Gdiplus::Graphics &g, float width, float height, float borderWidth) :
+	PlayfieldView *pfv, Gdiplus::Graphics *g, ID2D1RenderTarget *d2d, float width, float height, float borderWidth) :
 	g(g),
+	d2d(d2d),
 	width(width),
 	height(height),
 	borderWidth(static_cast<float>(borderWidth)),
@@ -6586,7 +7532,7 @@ void PlayfieldView::JsDrawingContext::InitFont()
 {
 	// create a font object if we don't already have one
 	if (font == nullptr)
-		font.reset(CreateGPFont(fontName.c_str(), fontPtSize, fontWeight, fontItalic));
+		font = FontCache::GetGPFont(fontName.c_str(), fontPtSize, fontWeight, fontItalic);
 
 	// If there's still no font, create a default font. 
 	if (font == nullptr)
@@ -6597,7 +7543,7 @@ void PlayfieldView::JsDrawingContext::InitFont()
 		int weight = fontWeight >= 100 && fontWeight <= 900 ? fontWeight : 400;
 
 		// create the font
-		font.reset(CreateGPFont(_T("Tahoma"), ptSize, weight, fontItalic));
+		font = FontCache::GetGPFont(_T("Tahoma"), ptSize, weight, fontItalic);
 	}
 
 	// create a brush if we don't already have one
@@ -6605,61 +7551,227 @@ void PlayfieldView::JsDrawingContext::InitFont()
 		textBrush.reset(new Gdiplus::SolidBrush(textColor));
 }
 
-void PlayfieldView::JsDrawDrawText(TSTRING text)
+void PlayfieldView::JsDrawingContext::InitTextFormat()
 {
-	// validate the drawing context
-	auto js = JavascriptEngine::Get();
-	if (jsDC == nullptr)
-		return js->Throw(_T("Drawing operation is not valid now")), static_cast<void>(0);
-
-	// initialize drawing resources
-	jsDC->InitFont();
+	// if we already have a text format, there's nothing to do
+	if (textFormat != nullptr)
+		return;
 
-	// set up a text formatter with the current alignment
-	Gdiplus::StringFormat f = Gdiplus::StringFormat::GenericTypographic();
-	f.SetAlignment(jsDC->textAlignHorz);
-	f.SetLineAlignment(jsDC->textAlignVert);
-	f.SetFormatFlags(
-		(f.GetFormatFlags() | Gdiplus::StringFormatFlags::StringFormatFlagsMeasureTrailingSpaces)
-		& ~Gdiplus::StringFormatFlagsLineLimit);
+	// create a text format from the given specs
+	auto dwFactory = DirectWriteUtils::Get()->GetDWriteFactory();
+	auto Create = [this, dwFactory](const TCHAR *name, int ptSize, int weight)
+	{
+		return SUCCEEDED(dwFactory->CreateTextFormat(name, nullptr, static_cast<DWRITE_FONT_WEIGHT>(weight),
+			fontItalic ? DWRITE_FONT_STYLE_ITALIC : DWRITE_FONT_STYLE_NORMAL, DWRITE_FONT_STRETCH_NORMAL,
+			static_cast<float>(ptSize) * 96.0f / 72.0f, L"", &textFormat));
+	};
 
-	// Figure the layout area
-	Gdiplus::RectF rcLayout(
-		jsDC->textOrigin.X,
-		jsDC->textOrigin.Y,
-		jsDC->textBounds.GetRight() - jsDC->textOrigin.X,
-		jsDC->textBounds.GetBottom() - jsDC->textOrigin.Y);
+	// Try the current font specs.  If that fails, fall back on Tahoma, with
+	// reasonable defaults for the size and weight if they look crazy, as in
+	// InitFont().
+	if (!Create(fontName.c_str(), fontPtSize, fontWeight))
+	{
+		int ptSize = fontPtSize >= 4 && fontPtSize < 400 ? fontPtSize : 24;
+		int weight = fontWeight >= 100 && fontWeight <= 900 ? fontWeight : 400;
+		Create(_T("Tahoma"), ptSize, weight);
+	}
 
-	// if the text ends in a newline, note it, but don't include it in the text
-	// we send to DrawString
-	INT len = static_cast<INT>(text.length());
-	bool newline;
-	if ((newline = (len > 0 && text[len-1] == '\n')) != false)
-		--len;
+	// use the same wrapping as GDI+
+	if (textFormat != nullptr)
+		textFormat->SetWordWrapping(DWRITE_WORD_WRAPPING_WRAP);
+}
 
-	// draw the text
-	jsDC->g.DrawString(text.c_str(), len, jsDC->font.get(), rcLayout, &f, jsDC->textBrush.get());
+ID2D1SolidColorBrush *PlayfieldView::JsDrawingContext::GetBrush(const Gdiplus::Color &color)
+{
+	// convert the color
+	D2D1_COLOR_F c = D2D1::ColorF(
+		static_cast<float>(color.GetR()) / 255.0f, static_cast<float>(color.GetG()) / 255.0f,
+		static_cast<float>(color.GetB()) / 255.0f, static_cast<float>(color.GetA()) / 255.0f);
 
-	// Advance the text origin.  If the text ended in a newline, advance the
-	// vertical offset by the line height and move the horizontal offset to
-	// the left of the text layout box.  Otherwise, advance the horizontal
-	// offset by the text width.
-	Gdiplus::RectF bbox;
-	jsDC->g.MeasureString(text.c_str(), len, jsDC->font.get(), rcLayout, &bbox);
-	if (newline)
-	{
-		jsDC->textOrigin.X = jsDC->textBounds.X;
-		jsDC->textOrigin.Y += bbox.Height;
-	}
+	// create the brush on the first use, and just update its color thereafter
+	if (d2dBrush == nullptr)
+		d2d->CreateSolidColorBrush(c, &d2dBrush);
 	else
-	{
-		jsDC->textOrigin.X += bbox.Width;
-	}
+		d2dBrush->SetColor(c);
+
+	return d2dBrush;
 }
 
-void PlayfieldView::JsDrawSetFont(JsValueRef name, JsValueRef pointSize, JsValueRef weight, JsValueRef italic)
+bool PlayfieldView::JsDrawingContext::CreateTextLayout(RefPtr<IDWriteTextLayout> &layout, 
+	const WCHAR *text, UINT32 len, float layoutWidth, float layoutHeight,
+	Gdiplus::StringAlignment horz, Gdiplus::StringAlignment vert)
 {
-	// validate the drawing context
+	// make sure we have a text format
+	InitTextFormat();
+	if (textFormat == nullptr)
+		return false;
+
+	// set the alignment
+	textFormat->SetTextAlignment(
+		horz == Gdiplus::StringAlignmentNear ? DWRITE_TEXT_ALIGNMENT_LEADING :
+		horz == Gdiplus::StringAlignmentFar ? DWRITE_TEXT_ALIGNMENT_TRAILING :
+		DWRITE_TEXT_ALIGNMENT_CENTER);
+	textFormat->SetParagraphAlignment(
+		vert == Gdiplus::StringAlignmentNear ? DWRITE_PARAGRAPH_ALIGNMENT_NEAR :
+		vert == Gdiplus::StringAlignmentFar ? DWRITE_PARAGRAPH_ALIGNMENT_FAR :
+		DWRITE_PARAGRAPH_ALIGNMENT_CENTER);
+
+	// Get the layout.  The layout cache matches formats by their settings,
+	// including the alignment, so it's fine that we change the alignment on
+	// our private format between calls, and repeated draws of the same
+	// text in new drawing contexts still find the cached layout.
+	layout = nullptr;
+	return SUCCEEDED(DirectWriteUtils::Get()->GetTextLayout(
+		&layout, text, len, textFormat, fmaxf(layoutWidth, 0.0f), fmaxf(layoutHeight, 0.0f)));
+}
+
+Gdiplus::Graphics *PlayfieldView::JsDrawingContext::GetGraphics()
+{
+	// for GDI+ drawing, use the caller's graphics context
+	if (d2d == nullptr)
+		return g;
+
+	// for Direct2D drawing, open the GDI interop DC if it's not already open
+	if (gdiInteropGraphics == nullptr)
+	{
+		HDC hdc = NULL;
+		if (gdiInterop == nullptr)
+			d2d->QueryInterface(__uuidof(ID2D1GdiInteropRenderTarget), reinterpret_cast<void**>(&gdiInterop));
+		if (gdiInterop == nullptr || !SUCCEEDED(gdiInterop->GetDC(D2D1_DC_INITIALIZE_MODE_COPY, &hdc)))
+			return nullptr;
+
+		gdiInteropGraphics.reset(new Gdiplus::Graphics(hdc));
+	}
+
+	return gdiInteropGraphics.get();
+}
+
+void PlayfieldView::JsDrawingContext::EndGdi()
+{
+	// if the GDI interop DC is open, flush GDI+ drawing and close it
+	if (gdiInteropGraphics != nullptr)
+	{
+		gdiInteropGraphics->Flush();
+		gdiInteropGraphics.reset();
+		gdiInterop->ReleaseDC(nullptr);
+	}
+}
+
+ID2D1Bitmap *PlayfieldView::GetJsD2DImage(ID2D1RenderTarget *target, const TCHAR *path)
+{
+	// get the file's modification time, to detect updates
+	WIN32_FILE_ATTRIBUTE_DATA attrs;
+	if (!GetFileAttributesEx(path, GetFileExInfoStandard, &attrs))
+		return nullptr;
+
+	// use the cached copy if it's still current
+	if (auto it = jsD2DImageCache.find(path); it != jsD2DImageCache.end()
+		&& CompareFileTime(&it->second.modified, &attrs.ftLastWriteTime) == 0)
+		return it->second.bitmap;
+
+	// load the image through WIC, converting to premultiplied BGRA for Direct2D
+	auto wic = DirectWriteUtils::Get()->GetWICFactory();
+	RefPtr<IWICBitmapDecoder> decoder;
+	RefPtr<IWICBitmapFrameDecode> frame;
+	RefPtr<IWICFormatConverter> converter;
+	RefPtr<ID2D1Bitmap> bitmap;
+	if (!SUCCEEDED(wic->CreateDecoderFromFilename(path, nullptr, GENERIC_READ, WICDecodeMetadataCacheOnDemand, &decoder))
+		|| !SUCCEEDED(decoder->GetFrame(0, &frame))
+		|| !SUCCEEDED(wic->CreateFormatConverter(&converter))
+		|| !SUCCEEDED(converter->Initialize(frame, GUID_WICPixelFormat32bppPBGRA, WICBitmapDitherTypeNone, nullptr, 0.0f, WICBitmapPaletteTypeMedianCut))
+		|| !SUCCEEDED(target->CreateBitmapFromWicBitmap(converter, nullptr, &bitmap)))
+		return nullptr;
+
+	// if the cache has grown too large, start over
+	if (jsD2DImageCache.size() >= maxJsD2DImageCache)
+		jsD2DImageCache.clear();
+
+	// add it to the cache
+	auto &e = jsD2DImageCache[path];
+	e.bitmap = bitmap;
+	e.modified = attrs.ftLastWriteTime;
+	return e.bitmap;
+}
+
+void PlayfieldView::JsDrawDrawText(TSTRING text)
+{
+	// validate the drawing context
+	auto js = JavascriptEngine::Get();
+	if (jsDC == nullptr)
+		return js->Throw(_T("Drawing operation is not valid now")), static_cast<void>(0);
+
+	// Figure the layout area
+	Gdiplus::RectF rcLayout(
+		jsDC->textOrigin.X,
+		jsDC->textOrigin.Y,
+		jsDC->textBounds.GetRight() - jsDC->textOrigin.X,
+		jsDC->textBounds.GetBottom() - jsDC->textOrigin.Y);
+
+	// if the text ends in a newline, note it, but don't include it in the text
+	// we send to DrawString
+	INT len = static_cast<INT>(text.length());
+	bool newline;
+	if ((newline = (len > 0 && text[len-1] == '\n')) != false)
+		--len;
+
+	// Advance the text origin.  If the text ended in a newline, advance the
+	// vertical offset by the line height and move the horizontal offset to
+	// the left of the text layout box.  Otherwise, advance the horizontal
+	// offset by the text width.
+	auto Advance = [this, newline](float width, float height)
+	{
+		if (newline)
+		{
+			jsDC->textOrigin.X = jsDC->textBounds.X;
+			jsDC->textOrigin.Y += height;
+		}
+		else
+		{
+			jsDC->textOrigin.X += width;
+		}
+	};
+
+	// if we're drawing through Direct2D, draw a DirectWrite text layout
+	if (jsDC->d2d != nullptr)
+	{
+		jsDC->EndGdi();
+		RefPtr<IDWriteTextLayout> layout;
+		if (jsDC->CreateTextLayout(layout, text.c_str(), static_cast<UINT32>(len), rcLayout.Width, rcLayout.Height,
+			jsDC->textAlignHorz, jsDC->textAlignVert))
+		{
+			jsDC->d2d->DrawTextLayout({ rcLayout.X, rcLayout.Y }, layout, jsDC->GetBrush(jsDC->textColor),
+				D2D1_DRAW_TEXT_OPTIONS_ENABLE_COLOR_FONT);
+
+			DWRITE_TEXT_METRICS tm;
+			if (SUCCEEDED(layout->GetMetrics(&tm)))
+				Advance(tm.widthIncludingTrailingWhitespace, tm.height);
+		}
+		return;
+	}
+
+	// initialize drawing resources
+	jsDC->InitFont();
+
+	// set up a text formatter with the current alignment
+	Gdiplus::StringFormat f = Gdiplus::StringFormat::GenericTypographic();
+	f.SetAlignment(jsDC->textAlignHorz);
+	f.SetLineAlignment(jsDC->textAlignVert);
+	f.SetFormatFlags(
+		(f.GetFormatFlags() | Gdiplus::StringFormatFlags::StringFormatFlagsMeasureTrailingSpaces)
+		& ~Gdiplus::StringFormatFlagsLineLimit);
+
+	// draw the text
+	jsDC->g->DrawString(text.c_str(), len, jsDC->font.get(), rcLayout, &f, jsDC->textBrush.get());
+
+	// advance the text origin past the text
+	Gdiplus::RectF bbox;
+	jsDC->g->MeasureString(text.c_str(), len, jsDC->font.get(), rcLayout, &bbox);
+	Advance(bbox.Width, bbox.Height);
+}
+
+void PlayfieldView::JsDrawSetFont(JsValueRef name, JsValueRef pointSize, JsValueRef weight, JsValueRef italic)
+{
+	// validate the drawing context
 	auto js = JavascriptEngine::Get();
 	if (jsDC == nullptr)
 		return js->Throw(_T("Drawing operation is not valid now")), static_cast<void>(0);
@@ -6677,6 +7789,7 @@ void PlayfieldView::JsDrawSetFont(JsValueRef name, JsValueRef pointSize, JsValue
 
 	// clear the previous font
 	jsDC->font.reset();
+	jsDC->textFormat = nullptr;
 }
 
 bool PlayfieldView::JsDrawSetFontFromPrefs(WSTRING varname)
@@ -6768,18 +7881,35 @@ void PlayfieldView::JsDrawDrawImage(TSTRING filename, float x, float y, JsValueR
 	x += jsDC->borderWidth;
 	y += jsDC->borderWidth;
 
-	// load the file
-	std::unique_ptr<Gdiplus::Image> image(new Gdiplus::Image(path));
-	if (image == nullptr)
-		return js->Throw(_T("Unable to load image file")), static_cast<void>(0);
+	// Load the file.  For Direct2D drawing, use the cached bitmap for the
+	// file; otherwise load it as a GDI+ image.
+	std::unique_ptr<Gdiplus::Image> image;
+	ID2D1Bitmap *bitmap = nullptr;
+	UINT imageWidth, imageHeight;
+	if (jsDC->d2d != nullptr)
+	{
+		if ((bitmap = GetJsD2DImage(jsDC->d2d, path)) == nullptr)
+			return;
+
+		auto sz = bitmap->GetPixelSize();
+		imageWidth = sz.width;
+		imageHeight = sz.height;
+	}
+	else
+	{
+		image.reset(new Gdiplus::Image(path));
+		if (image == nullptr)
+			return js->Throw(_T("Unable to load image file")), static_cast<void>(0);
+
+		imageWidth = image->GetWidth();
+		imageHeight = image->GetHeight();
+	}
 
 	// Figure the drawing width and height.  If both dimensions are unspecified,
 	// use the native image size.  If one dimension is unspecified, figure the
 	// unspecified dimension such that it preserves the image's native aspect
 	// ratio given the specified dimension.  If both are specified, use the 
 	// exact dimensions given.
-	UINT imageWidth = image->GetWidth();
-	UINT imageHeight = image->GetHeight();
 	float drawWidth = static_cast<float>(imageWidth);
 	float drawHeight = static_cast<float>(imageHeight);
 	JsErrorCode err;
@@ -6810,7 +7940,15 @@ void PlayfieldView::JsDrawDrawImage(TSTRING filename, float x, float y, JsValueR
 	}
 
 	// draw the image
-	jsDC->g.DrawImage(image.get(), Gdiplus::RectF(x, y, drawWidth, drawHeight), 
+	if (bitmap != nullptr)
+	{
+		jsDC->EndGdi();
+		jsDC->d2d->DrawBitmap(bitmap, D2D1::RectF(x, y, x + drawWidth, y + drawHeight), 
+			1.0f, D2D1_BITMAP_INTERPOLATION_MODE_LINEAR,
+			D2D1::RectF(0.0f, 0.0f, static_cast<float>(imageWidth), static_cast<float>(imageHeight)));
+		return;
+	}
+	jsDC->g->DrawImage(image.get(), Gdiplus::RectF(x, y, drawWidth, drawHeight), 
 		0.0f, 0.0f, static_cast<float>(imageWidth), static_cast<float>(imageHeight),
 		Gdiplus::Unit::UnitPixel);
 }
@@ -6912,14 +8050,34 @@ JsValueRef PlayfieldView::JsDrawMeasureText(TSTRING text)
 	if (jsDC == nullptr)
 		return js->Throw(_T("Drawing operation is not valid now"));
 
-	// initialize drawing resources
-	jsDC->InitFont();
-
 	// measure the text
-	Gdiplus::StringFormat f = Gdiplus::StringFormat::GenericTypographic();
-	f.SetFormatFlags(f.GetFormatFlags() | Gdiplus::StringFormatFlags::StringFormatFlagsMeasureTrailingSpaces);
 	Gdiplus::RectF bbox;
-	jsDC->g.MeasureString(text.c_str(), static_cast<INT>(text.length()), jsDC->font.get(), jsDC->textOrigin, &f, &bbox);
+	if (jsDC->d2d != nullptr)
+	{
+		// Direct2D mode - measure through a DirectWrite layout with no
+		// effective size limit, aligned at the text origin
+		RefPtr<IDWriteTextLayout> layout;
+		DWRITE_TEXT_METRICS tm;
+		if (jsDC->CreateTextLayout(layout, text.c_str(), static_cast<UINT32>(text.length()), 100000.0f, 100000.0f,
+			Gdiplus::StringAlignmentNear, Gdiplus::StringAlignmentNear)
+			&& SUCCEEDED(layout->GetMetrics(&tm)))
+		{
+			bbox = Gdiplus::RectF(jsDC->textOrigin.X + tm.left, jsDC->textOrigin.Y + tm.top,
+				tm.widthIncludingTrailingWhitespace, tm.height);
+		}
+		else
+			bbox = Gdiplus::RectF(jsDC->textOrigin.X, jsDC->textOrigin.Y, 0.0f, 0.0f);
+	}
+	else
+	{
+		// initialize drawing resources
+		jsDC->InitFont();
+
+		// measure the text
+		Gdiplus::StringFormat f = Gdiplus::StringFormat::GenericTypographic();
+		f.SetFormatFlags(f.GetFormatFlags() | Gdiplus::StringFormatFlags::StringFormatFlagsMeasureTrailingSpaces);
+		jsDC->g->MeasureString(text.c_str(), static_cast<INT>(text.length()), jsDC->font.get(), jsDC->textOrigin, &f, &bbox);
+	}
 
 	// return the bounding rectangle, adjusting from our global coordinates
 	// to the interior of the border area
@@ -6951,11 +8109,20 @@ void PlayfieldView::JsDrawFillRect(float x, float y, float width, float height,
 	x += jsDC->borderWidth;
 	y += jsDC->borderWidth;
 
+	// for Direct2D drawing, fill through the context's solid brush
+	if (jsDC->d2d != nullptr)
+	{
+		jsDC->EndGdi();
+		jsDC->d2d->FillRectangle(D2D1::RectF(x, y, x + width, y + height), 
+			jsDC->GetBrush(JsToGPColor(argb, jsDC->defaultAlpha)));
+		return;
+	}
+
 	// create a brush
 	Gdiplus::SolidBrush br(JsToGPColor(argb, jsDC->defaultAlpha));
 
 	// fill the rectangle
-	jsDC->g.FillRectangle(&br, x, y, width, height);
+	jsDC->g->FillRectangle(&br, x, y, width, height);
 }
 
 void PlayfieldView::JsDrawFrameRect(float x, float y, float width, float height, float frameWidth, JsValueRef argb)
@@ -6969,11 +8136,21 @@ void PlayfieldView::JsDrawFrameRect(float x, float y, float width, float height,
 	x += jsDC->borderWidth;
 	y += jsDC->borderWidth;
 
+	// For Direct2D drawing, draw a one-pixel frame, offset to the pixel
+	// centers so that it covers the same pixels as the GDI+ pen.
+	if (jsDC->d2d != nullptr)
+	{
+		jsDC->EndGdi();
+		jsDC->d2d->DrawRectangle(D2D1::RectF(x + 0.5f, y + 0.5f, x + width + 0.5f, y + height + 0.5f),
+			jsDC->GetBrush(JsToGPColor(argb, jsDC->defaultAlpha)), 1.0f);
+		return;
+	}
+
 	// create a pen
 	Gdiplus::Pen pen(JsToGPColor(argb, jsDC->defaultAlpha));
 
 	// draw the frame
-	jsDC->g.DrawRectangle(&pen, x, y, width, height);
+	jsDC->g->DrawRectangle(&pen, x, y, width, height);
 }
 
 int PlayfieldView::JsDrawGetDefaultAlpha() const
@@ -7298,9 +8475,14 @@ void PlayfieldView::JsStyledTextDraw(JsValueRef self, JsValueRef dc, JavascriptE
 		GetRect(rcLayout, jsrcLayout);
 		GetRect(rcClip, jsrcClip);
 
+		// get the GDI+ context (through GDI interop, if drawing via Direct2D)
+		auto g = jsDC->GetGraphics();
+		if (g == nullptr)
+			return;
+
 		// draw it
 		auto dw = DirectWriteUtils::Get();
-		dw->RenderStyledText(jsDC->g, &st->st, rcLayout, rcClip, LogFileErrorHandler());
+		dw->RenderStyledText(*g, &st->st, rcLayout, rcClip, LogFileErrorHandler());
 	}
 	catch (JavascriptEngine::CallException exc)
 	{
@@ -7362,17 +8544,76 @@ JsValueRef PlayfieldView::JsStyledTextMeasure(JsValueRef self, float width)
 // drawing context.
 
 
+// HTML document cache entry.  This holds a parsed document, along
+// with the parameters of its current layout and its last rendered
+// image, so that we can skip the layout and rasterization steps when
+// a document is drawn again with the same parameters.
+struct PlayfieldView::HtmlDocCacheEntry
+{
+	// source text and its hash
+	WSTRING source;
+	size_t hash;
+
+	// Litehtml document.  This contains the parsed HTML and layout information.
+	std::shared_ptr<litehtml::document> doc;
+
+	// Parameters of the current layout: the surface size we presented
+	// for media queries, and the rendering width.  Zero if the document
+	// hasn't been laid out yet.
+	int surfaceWidth = 0;
+	int surfaceHeight = 0;
+	int renderWidth = 0;
+
+	// Lay out the document for the given parameters, if it's not already
+	// laid out that way.  Returns true if we performed a new layout, in
+	// which case any rendered image is out of date.
+	bool Render(LitehtmlHost *host, int surfWidth, int surfHeight, int width)
+	{
+		// if the layout is current, there's nothing to do
+		if (renderWidth != 0 && surfWidth == surfaceWidth && surfHeight == surfaceHeight && width == renderWidth)
+			return false;
+
+		// lay it out
+		host->SetSurfaceSize(surfWidth, surfHeight);
+		doc->media_changed();
+		doc->render(width);
+
+		// remember the new parameters
+		surfaceWidth = surfWidth;
+		surfaceHeight = surfHeight;
+		renderWidth = width;
+		return true;
+	}
+
+	// Rendered image, and the parameters it was drawn with: the layout
+	// origin relative to the image's top left, which is the top left of
+	// the clipping area, and the clipping area size.  The image covers
+	// the clipping area exactly.
+	std::unique_ptr<Gdiplus::Bitmap> raster;
+	int rasterDx = 0, rasterDy = 0;
+	int rasterWidth = 0, rasterHeight = 0;
+
+	// Is the entry still in the cache?  An entry dropped from the cache
+	// stays alive as long as HtmlLayout objects refer to it, but we only
+	// keep rendered images for cached entries, since the image memory is
+	// budgeted across the cache.
+	bool cached = true;
+
+	INT64 RasterBytes() const { return raster != nullptr ? static_cast<INT64>(rasterWidth) * rasterHeight * 4 : 0; }
+};
+
 // HtmlLayout - Javascript External Object.  This is the object
 // passed back to Javascript when creating an HtmlLayout object.
-// This encapsulates a litehtml::document object containing the
-// parsed DOM tree.
+// This refers to the document cache entry for the parsed DOM tree,
+// which might be shared with other HtmlLayout objects created from
+// the same source text.
 class JsHtmlLayout : public JavascriptEngine::ExternalObject 
 {
 public:
-	JsHtmlLayout(std::shared_ptr<litehtml::document> &doc) : doc(doc) { }
+	JsHtmlLayout(std::shared_ptr<PlayfieldView::HtmlDocCacheEntry> &entry) : entry(entry) { }
 
-	// Litehtml document.  This contains the parsed HTML and layout information.
-	std::shared_ptr<litehtml::document> doc;
+	// document cache entry
+	std::shared_ptr<PlayfieldView::HtmlDocCacheEntry> entry;
 };
 
 
@@ -7412,16 +8653,53 @@ JsValueRef CALLBACK PlayfieldView::JsHtmlLayoutConstructor(
 		}
 	}
 
-	// create a litehtml document from the text
-	auto doc = litehtml::document::createFromString(txt.c_str(), pfv->litehtmlHost, &pfv->litehtmlHost->litehtmlContext);
+	// Look for a cached document parsed from the same text.  The master
+	// style sheet is fixed for the life of the host, so the source text
+	// alone determines the document.
+	size_t hash = std::hash<WSTRING>()(txt);
+	auto &cache = pfv->htmlDocCache;
+	auto it = std::find_if(cache.begin(), cache.end(), [hash, &txt](const std::shared_ptr<HtmlDocCacheEntry> &e) {
+		return e->hash == hash && e->source == txt; });
+
+	std::shared_ptr<HtmlDocCacheEntry> entry;
+	if (it != cache.end())
+	{
+		// found it - move it to the front of the MRU list
+		entry = *it;
+		cache.splice(cache.begin(), cache, it);
+	}
+	else
+	{
+		// create a litehtml document from the text
+		auto doc = litehtml::document::createFromString(txt.c_str(), pfv->litehtmlHost, &pfv->litehtmlHost->litehtmlContext);
+
+		// if that failed, throw an error
+		if (doc == nullptr)
+			return js->Throw(_T("Error parsing HTML"));
+
+		// set up the cache entry
+		entry = std::make_shared<HtmlDocCacheEntry>();
+		entry->source = std::move(txt);
+		entry->hash = hash;
+		entry->doc = doc;
 
-	// if that failed, throw an error
-	if (doc == nullptr)
-		return js->Throw(_T("Error parsing HTML"));
+		// Add it to the cache, dropping the least recently used entry if
+		// the cache is full.  Any HtmlLayout objects still referencing the
+		// old entry keep it alive, but we discard its rendered image, since
+		// we only account for images in cached entries.
+		if (cache.size() >= maxHtmlDocCache)
+		{
+			pfv->htmlRasterBytes -= cache.back()->RasterBytes();
+			cache.back()->raster.reset();
+			cache.back()->cached = false;
+			cache.pop_back();
+		}
+		cache.emplace_front(entry);
+	}
 
 	// create the Javascript cover object
 	JsValueRef jsobj;
-	auto jst = new JsHtmlLayout(doc);
+	auto jst = new JsHtmlLayout(entry);
 	if (auto err = js->CreateExternalObjectWithPrototype(jsobj, pfv->jsHtmlLayoutProto, jst); err != JsNoError)
 		return js->Throw(err);
 
@@ -7460,19 +8738,77 @@ void PlayfieldView::JsHtmlLayoutDraw(JsValueRef self, JsValueRef dc, JavascriptE
 		GetRect(rcClip, jsrcClip);
 
         // make sure we have a litehtml parsed document object
-		if (layout->doc == nullptr)
+		auto entry = layout->entry.get();
+		if (entry == nullptr || entry->doc == nullptr)
 			return;
 
-		// render the document to the desired width
-		litehtmlHost->SetSurfaceSize(static_cast<int>(rcLayout.Width), static_cast<int>(rcLayout.Height));
-		layout->doc->media_changed();
-		layout->doc->render(static_cast<int>(rcLayout.Width));
+		// Render the document to the desired width.  This is a no-op if
+		// it's already laid out the same way; if not, the new layout
+		// invalidates the rendered image.
+		if (entry->Render(litehtmlHost.get(), static_cast<int>(rcLayout.Width), static_cast<int>(rcLayout.Height), static_cast<int>(rcLayout.Width)))
+		{
+			htmlRasterBytes -= entry->RasterBytes();
+			entry->raster.reset();
+		}
 
-		// draw it
-		litehtml::position lclip(
-			static_cast<int>(rcClip.X), static_cast<int>(rcClip.Y), 
-			static_cast<int>(rcClip.Width), static_cast<int>(rcClip.Height));
-		layout->doc->draw(reinterpret_cast<litehtml::uint_ptr>(&jsDC->g), static_cast<int>(rcLayout.X), static_cast<int>(rcLayout.Y), &lclip);
+		// get the GDI+ context (through GDI interop, if drawing via Direct2D)
+		auto g = jsDC->GetGraphics();
+		if (g == nullptr)
+			return;
+
+		// figure the clipping area and the layout origin relative to it
+		int clipX = static_cast<int>(rcClip.X), clipY = static_cast<int>(rcClip.Y);
+		int clipWidth = static_cast<int>(rcClip.Width), clipHeight = static_cast<int>(rcClip.Height);
+		int dx = static_cast<int>(rcLayout.X) - clipX, dy = static_cast<int>(rcLayout.Y) - clipY;
+		if (clipWidth <= 0 || clipHeight <= 0)
+			return;
+
+		// if the entry has been dropped from the cache, just draw directly
+		if (!entry->cached)
+		{
+			litehtml::position lclip(clipX, clipY, clipWidth, clipHeight);
+			entry->doc->draw(reinterpret_cast<litehtml::uint_ptr>(g), static_cast<int>(rcLayout.X), static_cast<int>(rcLayout.Y), &lclip);
+			return;
+		}
+
+		// If the rendered image doesn't match the current parameters, draw
+		// the document into a new image.  Scripts tend to redraw the same
+		// overlay over and over, so this lets the repeat draws skip the
+		// litehtml rasterization and just copy the finished pixels.
+		if (entry->raster == nullptr || entry->rasterDx != dx || entry->rasterDy != dy
+			|| entry->rasterWidth != clipWidth || entry->rasterHeight != clipHeight)
+		{
+			htmlRasterBytes -= entry->RasterBytes();
+			entry->raster.reset(new Gdiplus::Bitmap(clipWidth, clipHeight, PixelFormat32bppPARGB));
+			entry->rasterDx = dx;
+			entry->rasterDy = dy;
+			entry->rasterWidth = clipWidth;
+			entry->rasterHeight = clipHeight;
+
+			// draw the document into the image, with the target context's rendering modes
+			{
+				Gdiplus::Graphics gr(entry->raster.get());
+				gr.SetTextRenderingHint(g->GetTextRenderingHint());
+				gr.SetSmoothingMode(g->GetSmoothingMode());
+				litehtml::position lclip(0, 0, clipWidth, clipHeight);
+				entry->doc->draw(reinterpret_cast<litehtml::uint_ptr>(&gr), dx, dy, &lclip);
+			}
+
+			// count the new image, and trim images from the least recently
+			// used cache entries if we're over budget
+			htmlRasterBytes += entry->RasterBytes();
+			for (auto it = htmlDocCache.rbegin(); it != htmlDocCache.rend() && htmlRasterBytes > maxHtmlRasterBytes; ++it)
+			{
+				if (it->get() != entry)
+				{
+					htmlRasterBytes -= (*it)->RasterBytes();
+					(*it)->raster.reset();
+				}
+			}
+		}
+
+		// draw the image
+		g->DrawImage(entry->raster.get(), clipX, clipY, clipWidth, clipHeight);
 	}
 	catch (JavascriptEngine::CallException exc)
 	{
@@ -7491,18 +8827,21 @@ JsValueRef PlayfieldView::JsHtmlLayoutMeasure(JsValueRef self, int width)
 			return js->GetUndefVal();
 
 		// make sure we have a litehtml parsed HTML document
-		if (layout->doc == nullptr)
+		auto entry = layout->entry.get();
+		if (entry == nullptr || entry->doc == nullptr)
 			return js->GetUndefVal();
 
-		// render the document to the desired width
-		litehtmlHost->SetSurfaceSize(width, 4096);
-		layout->doc->media_changed();
-		layout->doc->render(width);
+		// render the document to the desired width, if it's not already laid out that way
+		if (entry->Render(litehtmlHost.get(), width, 4096, width))
+		{
+			htmlRasterBytes -= entry->RasterBytes();
+			entry->raster.reset();
+		}
 		
 		// return the document size
 		JavascriptEngine::JsObj retLayout(JavascriptEngine::JsObj::CreateObject());
-		retLayout.Set("width", layout->doc->width());
-		retLayout.Set("height", layout->doc->height());
+		retLayout.Set("width", entry->doc->width());
+		retLayout.Set("height", entry->doc->height());
 		return retLayout.jsobj;
 	}
 	catch (JavascriptEngine::CallException exc)
@@ -7511,6 +8850,309 @@ JsValueRef PlayfieldView::JsHtmlLayoutMeasure(JsValueRef self, int width)
 	}
 }
 
+// Javascript Worker external object.  This just records the worker ID;
+// the worker itself is owned by the jsWorkers map.
+class JsWorkerObj : public JavascriptEngine::ExternalObject
+{
+public:
+	JsWorkerObj(int id) : id(id) { }
+	int id;
+};
+
+JsValueRef CALLBACK PlayfieldView::JsWorkerConstructor(
+	JsValueRef callee, bool isConstructCall, JsValueRef *argv, unsigned short argc, void *ctx)
+{
+	// get the javascript engine context and the playfield view
+	auto js = JavascriptEngine::Get();
+	auto pfv = static_cast<PlayfieldView*>(ctx);
+
+	// this can only be called as a constructor
+	if (!isConstructCall)
+		return js->Throw(_T("Worker() can only be called as a constructor (with 'new')"));
+
+	try
+	{
+		// get the script file name
+		if (argc < 2 || js->IsUndefinedOrNull(argv[1]))
+			return js->Throw(_T("new Worker(): script file name is required"));
+		WSTRING filename = JavascriptEngine::JsToNative<WSTRING>(argv[1]);
+
+		// if the path is relative, make it relative to the scripts folder
+		WSTRING path = filename;
+		if (PathIsRelative(filename.c_str()))
+		{
+			TCHAR folder[MAX_PATH];
+			GetDeployedFilePath(folder, _T("scripts"), _T(""));
+			path = MsgFmt(_T("%s\\%ws"), folder, filename.c_str()).Get();
+		}
+		if (!FileExists(path.c_str()))
+			return js->Throw(MsgFmt(_T("new Worker(): script file %ws not found"), path.c_str()));
+
+		// create the Javascript cover object
+		int id = pfv->nextJsWorkerId++;
+		JsValueRef ret;
+		if (auto err = js->CreateExternalObjectWithPrototype(ret, pfv->jsWorkerProto, new JsWorkerObj(id)); err != JsNoError)
+			return js->Throw(err);
+
+		JavascriptEngine::JsObj obj(ret);
+		obj.Set("id", id);
+
+		// create and launch the worker
+		std::unique_ptr<JavascriptWorker> worker(new JavascriptWorker(id, path, pfv->hWnd, PFVMsgJsWorkerMessage));
+		if (!worker->Start())
+			return js->Throw(_T("new Worker(): unable to start the worker thread"));
+
+		// Add it to the active list.  Keep a reference on the object for
+		// as long as the worker is running, so that it's still around to
+		// receive the worker's messages.
+		JsAddRef(ret, nullptr);
+		pfv->jsWorkers.emplace(id, JsWorkerEntry{ std::move(worker), ret });
+
+		// return the cover object
+		return ret;
+	}
+	catch (JavascriptEngine::CallException exc)
+	{
+		return js->Throw(exc.jsErrorCode, CHARToTCHAR(exc.what()));
+	}
+}
+
+void PlayfieldView::JsWorkerPostMessage(JsValueRef self, JsValueRef msg)
+{
+	auto js = JavascriptEngine::Get();
+	try
+	{
+		// recover the external object from Javascript
+		auto obj = JsWorkerObj::Recover<JsWorkerObj>(self, _T("Worker.postMessage"));
+		if (obj == nullptr)
+			return;
+
+		// if the worker has exited, messages are simply discarded
+		if (auto it = jsWorkers.find(obj->id); it != jsWorkers.end())
+			it->second.worker->PostToWorker(JavascriptWorker::JsonStringify(msg));
+	}
+	catch (JavascriptEngine::CallException exc)
+	{
+		js->Throw(exc.jsErrorCode, CHARToTCHAR(exc.what()));
+	}
+}
+
+void PlayfieldView::JsWorkerTerminate(JsValueRef self)
+{
+	// Ask the worker to terminate.  This interrupts any code running on
+	// the worker thread; the worker's Closed message will arrive when the
+	// thread exits, at which point we'll remove it from the active list.
+	if (auto obj = JsWorkerObj::Recover<JsWorkerObj>(self, _T("Worker.terminate")); obj != nullptr)
+	{
+		if (auto it = jsWorkers.find(obj->id); it != jsWorkers.end())
+			it->second.worker->Terminate();
+	}
+}
+
+void PlayfieldView::OnJsWorkerMessages()
+{
+	auto js = JavascriptEngine::Get();
+	if (js == nullptr)
+		return;
+
+	// collect the messages from each worker, and queue them as tasks
+	bool anyTasks = false;
+	for (auto it = jsWorkers.begin(); it != jsWorkers.end(); )
+	{
+		std::list<JavascriptWorker::Message> messages;
+		it->second.worker->GetMessages(messages);
+
+		bool closed = false;
+		for (auto &m : messages)
+		{
+			js->AddTask(new JavascriptWorker::MessageTask(it->second.obj, m));
+			anyTasks = true;
+			if (m.type == JavascriptWorker::Message::Type::Closed)
+				closed = true;
+		}
+
+		// If the worker has exited, remove it from the list.  The tasks
+		// we just queued keep their own references on the object.
+		if (closed)
+		{
+			JsRelease(it->second.obj, nullptr);
+			it = jsWorkers.erase(it);
+		}
+		else
+			++it;
+	}
+
+	// run the tasks
+	if (anyTasks)
+		js->RunTasks();
+}
+
+void PlayfieldView::ClearJsWorkers()
+{
+	// deleting each worker terminates its thread and waits for it to exit
+	for (auto &w : jsWorkers)
+	{
+		w.second.worker.reset();
+		JsRelease(w.second.obj, nullptr);
+	}
+	jsWorkers.clear();
+}
+
+TSTRING PlayfieldView::ResolveJsAsyncPath(const TSTRING &path)
+{
+	// if the path is relative, make it relative to the program folder
+	if (PathIsRelative(path.c_str()))
+	{
+		TCHAR buf[MAX_PATH];
+		GetDeployedFilePath(buf, path.c_str(), _T(""));
+		return buf;
+	}
+	return path;
+}
+
+void PlayfieldView::ApplyJsAsyncOptions(JavascriptAsyncIO::Request *req, JsValueRef options)
+{
+	if (JavascriptEngine::IsUndefinedOrNull(options))
+		return;
+
+	JavascriptEngine::JsObj obj(options);
+	if (obj.Has("maxSize"))
+		req->maxSize = static_cast<size_t>(max(obj.Get<double>("maxSize"), 0.0));
+}
+
+JsValueRef PlayfieldView::JsAsyncReadFile(TSTRING path, JsValueRef options)
+{
+	auto js = JavascriptEngine::Get();
+	try
+	{
+		// read as text unless the options say binary
+		bool binary = false;
+		if (!js->IsUndefinedOrNull(options))
+			binary = JavascriptEngine::JsObj(options).Get<bool>("binary");
+
+		auto req = new JavascriptAsyncIO::ReadFileRequest(ResolveJsAsyncPath(path).c_str(), binary);
+		std::unique_ptr<JavascriptAsyncIO::Request> holder(req);
+		ApplyJsAsyncOptions(req, options);
+		return jsAsyncIO->Submit(holder.release());
+	}
+	catch (JavascriptEngine::CallException exc)
+	{
+		return js->Throw(exc.jsErrorCode, CHARToTCHAR(exc.what()));
+	}
+}
+
+JsValueRef PlayfieldView::JsAsyncWriteFile(TSTRING path, JsValueRef data, JsValueRef options)
+{
+	auto js = JavascriptEngine::Get();
+	try
+	{
+		bool append = false;
+		if (!js->IsUndefinedOrNull(options))
+			append = JavascriptEngine::JsObj(options).Get<bool>("append");
+
+		auto req = new JavascriptAsyncIO::WriteFileRequest(ResolveJsAsyncPath(path).c_str(), append);
+		std::unique_ptr<JavascriptAsyncIO::Request> holder(req);
+		JavascriptAsyncIO::JsToBytes(req->data, data);
+		return jsAsyncIO->Submit(holder.release());
+	}
+	catch (JavascriptEngine::CallException exc)
+	{
+		return js->Throw(exc.jsErrorCode, CHARToTCHAR(exc.what()));
+	}
+}
+
+JsValueRef PlayfieldView::JsAsyncListDir(TSTRING path)
+{
+	auto js = JavascriptEngine::Get();
+	try
+	{
+		return jsAsyncIO->Submit(new JavascriptAsyncIO::ListDirRequest(ResolveJsAsyncPath(path).c_str()));
+	}
+	catch (JavascriptEngine::CallException exc)
+	{
+		return js->Throw(exc.jsErrorCode, CHARToTCHAR(exc.what()));
+	}
+}
+
+JsValueRef PlayfieldView::JsAsyncHttpRequest(JsValueRef options)
+{
+	auto js = JavascriptEngine::Get();
+	try
+	{
+		auto req = new JavascriptAsyncIO::HttpRequest();
+		std::unique_ptr<JavascriptAsyncIO::Request> holder(req);
+
+		// the argument is either a URL string or a descriptor object
+		JsValueType type;
+		if (JsGetValueType(options, &type) == JsNoError && type == JsString)
+		{
+			req->url = JavascriptEngine::JsToNative<WSTRING>(options);
+		}
+		else
+		{
+			JavascriptEngine::JsObj obj(options);
+			req->url = obj.Get<WSTRING>("url");
+			if (obj.Has("method"))
+				req->method = obj.Get<WSTRING>("method");
+			if (obj.Has("body"))
+				JavascriptAsyncIO::JsToBytes(req->body, obj.Get<JsValueRef>("body"));
+			if (obj.Has("timeout"))
+				req->timeout = static_cast<DWORD>(max(obj.Get<double>("timeout"), 0.0));
+			if (obj.Has("binary"))
+				req->binary = obj.Get<bool>("binary");
+
+			// headers are given as an object of name: value pairs
+			if (obj.Has("headers"))
+			{
+				JavascriptEngine::JsObj headers(obj.Get<JsValueRef>("headers"));
+				JavascriptEngine::JsObj names(JavascriptEngine::JsObj::CreateArray());
+				JsGetOwnPropertyNames(headers.jsobj, &names.jsobj);
+				int n = names.Get<int>("length");
+				for (int i = 0; i < n; ++i)
+				{
+					WSTRING name = names.GetAtIndex<WSTRING>(i);
+					JsPropertyIdRef propId;
+					JsValueRef val;
+					if (JsErrorCode err = JsGetPropertyIdFromName(name.c_str(), &propId); err != JsNoError
+						|| (err = JsGetProperty(headers.jsobj, propId, &val)) != JsNoError)
+						throw JavascriptEngine::CallException("asyncIO.httpRequest: reading headers", err);
+					req->headers += name + L": " + JavascriptEngine::JsToNative<WSTRING>(val) + L"\r\n";
+				}
+			}
+
+			ApplyJsAsyncOptions(req, options);
+		}
+
+		if (req->url.length() == 0)
+			return js->Throw(_T("asyncIO.httpRequest: url is required"));
+
+		return jsAsyncIO->Submit(holder.release());
+	}
+	catch (JavascriptEngine::CallException exc)
+	{
+		return js->Throw(exc.jsErrorCode, CHARToTCHAR(exc.what()));
+	}
+}
+
+bool PlayfieldView::JsAsyncCancel(JsValueRef promise)
+{
+	auto js = JavascriptEngine::Get();
+	try
+	{
+		// the request ID is stored on the promise
+		if (js->IsUndefinedOrNull(promise))
+			return false;
+
+		JavascriptEngine::JsObj obj(promise);
+		return obj.Has("requestId") && jsAsyncIO->Cancel(obj.Get<int>("requestId"));
+	}
+	catch (JavascriptEngine::CallException exc)
+	{
+		js->Throw(exc.jsErrorCode, CHARToTCHAR(exc.what()));
+		return false;
+	}
+}
+
 
 // -----------------------------------------------------------------------
 
@@ -7688,7 +9330,7 @@ void PlayfieldView::DrawInfoBoxCommon(const GameListItem *game,
 // create a font for drawing arrows
 struct ArrowFont
 {
-	ArrowFont(int ptSize) : font(CreateGPFont(_T("Wingdings 3, Webdings"), ptSize, 400, false))
+	ArrowFont(int ptSize) : font(FontCache::GetGPFont(_T("Wingdings 3, Webdings"), ptSize, 400, false))
 	{
 		// determine which font we actually loaded
 		Gdiplus::FontFamily family;
@@ -7720,34 +9362,167 @@ struct ArrowFont
 		}
 	}
 
-	Gdiplus::Font *get() { return font.get(); }
+	Gdiplus::Font *get() { return font.get(); }
+
+	std::shared_ptr<Gdiplus::Font> font;
+	TCHAR fontName[LF_FACESIZE];
+
+	const TCHAR *menuArrowUp, *menuArrowDown, *menuArrowLeft, *menuArrowRight;
+	TCHAR *subMenuArrow;
+};
+
+void PlayfieldView::ShowGameInfo()
+{
+	// fire an event first, abort on cancel
+	const WCHAR *popupName = L"game info";
+	if (!FirePopupEvent(true, popupName))
+		return;
+
+	// ignore it if there's no game selection
+	GameList *gl = GameList::Get();
+	GameListItem *game = gl->GetNthGame(0);
+	if (!IsGameValid(game))
+		return;
+
+	// Request high score information for this game.  This is an
+	// asynchronous operation; we'll rebuild the sprite with the
+	// high score data when we receive it.
+	RequestHighScores(game, true);
+
+	// If a high scores popup is showing, we must be switching "pages"
+	// between high scores and game info.  Try to keep the popup size the
+	// same by using the existing popup's height as a minimum height for
+	// the new one.  We can't use a pre-rendered box in this case, since
+	// those are drawn at their natural height.
+	Application::InUiErrorHandler eh;
+	if (popupType == PopupHighScores)
+	{
+		popupSprite.Attach(RenderGameInfo(game, (int)(popupSprite->loadSize.y * 1920.0f), eh));
+	}
+	else if (Sprite *cached = popupCache.Get(GetGameInfoCacheKey(game)); cached != nullptr)
+	{
+		// use the pre-rendered box
+		popupSprite = cached;
+		popupSprite->alpha = 1.0f;
+	}
+	else
+	{
+		// render it, and keep it in the cache in case it's needed again
+		popupSprite.Attach(RenderGameInfo(game, 0, eh));
+		if (popupSprite != nullptr)
+			popupCache.Add(GetGameInfoCacheKey(game), popupSprite, GetPopupCacheBytes(popupSprite));
+	}
+
+	// if that failed, give up
+	if (popupSprite == nullptr)
+	{
+		UpdateDrawingList();
+		ShowQueuedError();
+		return;
+	}
+
+	// adjust it to the canonical popup position
+	AdjustSpritePosition(popupSprite);
 
-	std::unique_ptr<Gdiplus::Font> font;
-	TCHAR fontName[LF_FACESIZE];
+	// Start the animation.  We can do a direct switch between Game Info
+	// and High Scores without animation.
+	static const PopupDesc replaceTypes[] = { 
+		{ PopupGameInfo },
+		{ PopupHighScores },
+		{ PopupNone }
+	};
+	StartPopupAnimation(PopupGameInfo, popupName, true, replaceTypes);
 
-	const TCHAR *menuArrowUp, *menuArrowDown, *menuArrowLeft, *menuArrowRight;
-	TCHAR *subMenuArrow;
-};
+	// put the new sprite in the drawing list
+	UpdateDrawingList();
 
-void PlayfieldView::ShowGameInfo()
+	// Signal a Game Information event in DOF
+	QueueDOFPulse(L"PBYGameInfo");
+}
+
+TSTRING PlayfieldView::GetGameInfoCacheKey(GameListItem *game)
 {
-	// fire an event first, abort on cancel
-	const WCHAR *popupName = L"game info";
-	if (!FirePopupEvent(true, popupName))
+	// Build a key from the game's identity and the data that the box
+	// displays that can change while the program is running.  The rest
+	// of the content (title, manufacturer, files) is fixed for a given
+	// game list item, and the fonts and colors only change on a settings
+	// reload, which clears the cache.
+	GameList *gl = GameList::Get();
+	const TCHAR *lastPlayed = gl->GetLastPlayed(game);
+	const TCHAR *dateAdded = gl->GetDateAdded(game);
+	return MsgFmt(_T("info|%ld|%g|%d|%d|%s|%s|%d|%d|%d"),
+		game->internalID, gl->GetRating(game), gl->GetPlayCount(game), gl->GetPlayTime(game),
+		lastPlayed != nullptr ? lastPlayed : _T(""), dateAdded != nullptr ? dateAdded : _T(""),
+		gl->IsFavorite(game) ? 1 : 0, game->highScores.size() != 0 ? 1 : 0,
+		DOFClient::Get() != nullptr && DOFClient::IsReady() ? 1 : 0).Get();
+}
+
+INT64 PlayfieldView::GetPopupCacheBytes(Sprite *sprite)
+{
+	// popups are rendered at the reference 1920-pixel scale
+	return static_cast<INT64>(sprite->loadSize.x * 1920.0f) * static_cast<INT64>(sprite->loadSize.y * 1920.0f) * 4;
+}
+
+void PlayfieldView::PrerenderPopups()
+{
+	// The pre-rendered content is expendable, so don't add to it if we're
+	// over the texture budget, or while a game is running.
+	if ((TextureBudget::GetBudget() != 0 && TextureBudget::GetTotalBytes() >= TextureBudget::GetBudget())
+		|| runningGameMode != None)
+	{
+		KillTimer(hWnd, popupPrerenderTimerID);
 		return;
+	}
 
-	// ignore it if there's no game selection
+	// Pre-render for the current game first, then the neighbors on each
+	// side.  Do one Game Info box per call, so that we don't tie up the
+	// UI thread for too long at a stretch; the timer calls us again for
+	// the next one.
 	GameList *gl = GameList::Get();
-	GameListItem *game = gl->GetNthGame(0);
-	if (!IsGameValid(game))
-		return;
+	for (int n : { 0, 1, -1 })
+	{
+		GameListItem *game = gl->GetNthGame(n);
+		if (!IsGameValid(game) || (n != 0 && game == gl->GetNthGame(0)))
+			continue;
 
-	// Request high score information for this game.  This is an
-	// asynchronous operation; we'll rebuild the sprite with the
-	// high score data when we receive it.
-	RequestHighScores(game, true);
+		// Pre-load the first instruction card, in the window that will
+		// display it.  The image decoding runs on the loader pool, so this
+		// doesn't count against our unit of work for this call.
+		std::list<TSTRING> cards;
+		if (game->GetMediaItems(cards, GameListItem::instructionCardImageType) && cards.size() != 0)
+		{
+			BaseView *destView = nullptr;
+			if (instCardLoc == _T("backglass"))
+				destView = Application::Get()->GetBackglassView();
+			else if (instCardLoc == _T("topper"))
+				destView = Application::Get()->GetTopperView();
+			if (destView == nullptr || !IsWindow(destView->GetHWnd()) || !IsWindowVisible(destView->GetHWnd()))
+				destView = this;
+
+			destView->PrefetchInstructionCard(cards.front().c_str());
+		}
+
+		// render the Game Info box, if we haven't already
+		TSTRING key = GetGameInfoCacheKey(game);
+		if (!popupCache.Contains(key))
+		{
+			RefPtr<Sprite> sprite(RenderGameInfo(game, 0, SilentErrorHandler()));
+			if (sprite != nullptr)
+				popupCache.Add(key, sprite, GetPopupCacheBytes(sprite));
+
+			// that's our unit of work for this call
+			return;
+		}
+	}
+
+	// everything is up to date - stop the timer
+	KillTimer(hWnd, popupPrerenderTimerID);
+}
 
+Sprite *PlayfieldView::RenderGameInfo(GameListItem *game, int minHeight, ErrorHandler &eh)
+{
 	// info box drawing function
+	GameList *gl = GameList::Get();
 	int width = 972, height = 2000;
 	int pass = 1;
 	auto Draw = [gl, game, this, width, &height, &pass](HDC hdc, HBITMAP)
@@ -7770,7 +9545,7 @@ void PlayfieldView::ShowGameInfo()
 		Gdiplus::SolidBrush smallerTextBr(GPColorFromCOLORREF(popupSmallTextColor));
 		Gdiplus::SolidBrush detailsBr(GPColorFromCOLORREF(popupDetailTextColor));
 
-		std::unique_ptr<Gdiplus::Font> symFont(CreateGPFont(_T("Wingdings"), detailsFont.ptSize, 400, false));
+		std::shared_ptr<Gdiplus::Font> symFont(FontCache::GetGPFont(_T("Wingdings"), detailsFont.ptSize, 400, false));
 		ArrowFont arrowFont(18);
 
 		//
@@ -7938,43 +9713,16 @@ void PlayfieldView::ShowGameInfo()
 	Draw(memdc, NULL);
 
 	// set a minimum height
-	height = max(500, height);
-
-	// If a high scores popup is showing, we must be switching "pages"
-	// between high scores and game info.  Try to keep the popup size the
-	// same by using the existing popup's height as a minimum height for
-	// the new one.
-	if (popupType == PopupHighScores)
-		height = max(height, (int)(popupSprite->loadSize.y * 1920.0f));
+	height = max(max(500, minHeight), height);
 
 	// Set up the info box at the computed height
-	Application::InUiErrorHandler eh;
-	popupSprite.Attach(new Sprite());
-	if (!popupSprite->Load(width, height, Draw, eh, _T("Game Info box")))
-	{
-		popupSprite = nullptr;
-		UpdateDrawingList();
-		ShowQueuedError();
-		return;
-	}
-
-	// adjust it to the canonical popup position
-	AdjustSpritePosition(popupSprite);
-
-	// Start the animation.  We can do a direct switch between Game Info
-	// and High Scores without animation.
-	static const PopupDesc replaceTypes[] = { 
-		{ PopupGameInfo },
-		{ PopupHighScores },
-		{ PopupNone }
-	};
-	StartPopupAnimation(PopupGameInfo, popupName, true, replaceTypes);
-
-	// put the new sprite in the drawing list
-	UpdateDrawingList();
+	RefPtr<Sprite> sprite(new Sprite());
+	if (!sprite->Load(width, height, Draw, eh, _T("Game Info box")))
+		return nullptr;
 
-	// Signal a Game Information event in DOF
-	QueueDOFPulse(L"PBYGameInfo");
+	// return the sprite, adding a reference on behalf of the caller
+	sprite->AddRef();
+	return sprite;
 }
 
 void PlayfieldView::ShowHighScores()
@@ -7997,7 +9745,7 @@ void PlayfieldView::ShowHighScores()
 
 	// set up the default font
 	int textFontPts = highScoreFont.ptSize;
-	std::unique_ptr<Gdiplus::Font> textFont(CreateGPFont(
+	std::shared_ptr<Gdiplus::Font> textFont(FontCache::GetGPFont(
 		highScoreFont.family.c_str(), textFontPts, highScoreFont.weight, highScoreFont.italic));
 
 	// drawing function
@@ -8067,7 +9815,7 @@ void PlayfieldView::ShowHighScores()
 
 		// reduce the font size slightly and try again
 		textFontPts -= 4;
-		textFont.reset(CreateGPFont(highScoreFont.family.c_str(), textFontPts, highScoreFont.weight, highScoreFont.italic));
+		textFont = FontCache::GetGPFont(highScoreFont.family.c_str(), textFontPts, highScoreFont.weight, highScoreFont.italic);
 	}
 
 	// set a minimum height, so that the box doesn't look too squat for
@@ -8222,34 +9970,57 @@ void PlayfieldView::RequestHighScores(GameListItem *game, bool notifyJavascript)
 	}
 }
 
-void PlayfieldView::ReceiveHighScores(const HighScores::NotifyInfo *ni)
+void PlayfieldView::OnHighScoreSysReady()
 {
-	switch (ni->queryType)
+	// flag that the high score system is ready
+	hiScoreSysReady = true;
+
+	// If there's anything in the high score request queue, send a request
+	// for each item now.  We need to do this with a separate list of the
+	// game IDs, since the original list can be modified in place by
+	// RequestHighScores().
 	{
-	case HighScores::Initialized:
-		// the high scores system has finished initializing - flag it
-		hiScoreSysReady = true;
+		// build a safe copy of the list
+		std::vector<LONG> ids;
+		ids.reserve(highScoresReadyList.size());
+		for (auto &c : highScoresReadyList)
+			ids.push_back(c->gameID);
 
-		// If there's anything in the high score request queue, send a request
-		// for each item now.  We need to do this with a separate list of the
-		// game IDs, since the original list can be modified in place by
-		// RequestHighScores().
-		{
-			// build a safe copy of the list
-			std::vector<LONG> ids;
-			ids.reserve(highScoresReadyList.size());
-			for (auto &c : highScoresReadyList)
-				ids.push_back(c->gameID);
+		// Request high scores for each list entry.  Don't notify Javascript,
+		// as whoever added this item to the list in the first place should
+		// have notified Javascript at that point.
+		for (auto id : ids)
+			RequestHighScores(GameList::Get()->GetByInternalID(id), false);
+	}
+
+	// Request high scores for the current game, now that it's possible
+	RequestHighScores(GameList::Get()->GetNthGame(0), true);
 
-			// Request high scores for each list entry.  Don't notify Javascript,
-			// as whoever added this item to the list in the first place should
-			// have notified Javascript at that point.
-			for (auto id : ids)
-				RequestHighScores(GameList::Get()->GetByInternalID(id), false);
+	// Start the background NVRAM pre-scan for all games.  The current
+	// game's request above goes ahead of the pre-scan queries.
+	{
+		auto gl = GameList::Get();
+		int n = gl->GetAllGamesCount();
+		nvramPrescanQueue.clear();
+		nvramPrescanQueue.reserve(n);
+		for (int i = 0; i < n; ++i)
+		{
+			if (auto game = gl->GetAllGamesAt(i); game != nullptr && game->system != nullptr)
+				nvramPrescanQueue.push_back(game->internalID);
 		}
+		if (nvramPrescanQueue.size() != 0)
+			SetTimer(hWnd, nvramPrescanTimerID, 50, NULL);
+	}
+}
 
-		// Request high scores for the current game, now that it's possible
-		RequestHighScores(GameList::Get()->GetNthGame(0), true);
+void PlayfieldView::ReceiveHighScores(const HighScores::NotifyInfo *ni)
+{
+	switch (ni->queryType)
+	{
+	case HighScores::Initialized:
+		// The high scores system has finished initializing.  Start using
+		// it as soon as DOF startup is complete.
+		StartupTasks::WhenDone("DOF startup", [this]() { OnHighScoreSysReady(); });
 		break;
 
 	case HighScores::ProgramVersionQuery:
@@ -8257,7 +10028,7 @@ void PlayfieldView::ReceiveHighScores(const HighScores::NotifyInfo *ni)
 		// in the results and store it away for About Box use
 		if (ni->status == HighScores::NotifyInfo::Success)
 		{
-			std::basic_regex<TCHAR> verPat(_T("\\bversion\\s+([\\d.]+)"), std::regex_constants::icase);
+			static const std::basic_regex<TCHAR> verPat(_T("\\bversion\\s+([\\d.]+)"), std::regex_constants::icase);
 			std::match_results<const TCHAR *> m;
 			if (std::regex_search(ni->results.c_str(), m, verPat))
 				pinEmHiVersion = m[1].str();
@@ -8296,7 +10067,7 @@ void PlayfieldView::ReceiveHighScores(const HighScores::NotifyInfo *ni)
 			}
 
 			// update any notification callbacks
-			OnHighScoresReady(ni->gameID, success, L"pinemhi");
+			OnHighScoresReady(ni->gameID, success, ni->GetSourceName());
 		}
 		break;
 	}
@@ -8475,6 +10246,15 @@ void PlayfieldView::ProcessKeyQueue()
 		QueuedKey key = keyQueue.front();
 		keyQueue.pop_front();
 
+		// start the latency timing for the command, if we're measuring it
+		int64_t dequeueTime = 0;
+		if (key.arrivalTime != 0)
+		{
+			dequeueTime = InputLatency::Now();
+			latencyTiming = true;
+			latencyMediaTicks = 0;
+		}
+
 		// Check the command for special handling
 		const TCHAR *dofEffect = nullptr;
 		auto c = key.cmd;
@@ -8524,6 +10304,16 @@ void PlayfieldView::ProcessKeyQueue()
 			(this->*key.cmd->func)(key);
 		}
 
+		// If we're measuring latency, the sample is now waiting for the
+		// next frame.  Make sure we render one, even if the command had
+		// no visible effect.
+		if (latencyTiming)
+		{
+			InputLatency::AddPending({ hWnd, key.arrivalTime, dequeueTime, InputLatency::Now(), latencyMediaTicks });
+			InvalidateRender();
+			latencyTiming = false;
+		}
+
 		// this counts as a key event for attract mode idle purposes
 		attractMode.OnKeyEvent(this);
 	}
@@ -8539,11 +10329,20 @@ bool PlayfieldView::IsGameValid(const GameListItem *game)
 
 void PlayfieldView::OnGameListRebuild()
 {
+	// the game objects have all been replaced, so discard the cached
+	// Javascript GameInfo objects
+	ClearJsGameInfoCache();
+
 	UpdateSelection(true);
 }
 
 void PlayfieldView::UpdateSelection(bool fireEvents)
 {
+	Trace::Scope trace("Update selection", "media");
+
+	// note the starting time if we're measuring a command's latency
+	int64_t latencyT0 = latencyTiming ? InputLatency::Now() : 0;
+
 	// Get the current selection
 	GameListItem *curGame = GameList::Get()->GetNthGame(0);
 
@@ -8572,10 +10371,65 @@ void PlayfieldView::UpdateSelection(bool fireEvents)
 
 	// refresh the sprite list with the new wheel images
 	UpdateDrawingList();
+
+	// Update the playfield prefetch list after a short delay, so that we
+	// don't start loading media for each game we pass through while the
+	// wheel is spinning.
+	if (playfieldPrefetchCount > 0)
+		SetTimer(hWnd, playfieldPrefetchTimerID, 750, NULL);
+
+	// likewise for the pre-rendered popups
+	SetTimer(hWnd, popupPrerenderTimerID, 500, NULL);
+
+	// count the time as media loading for the latency measurement
+	if (latencyTiming)
+		latencyMediaTicks += InputLatency::Now() - latencyT0;
+}
+
+void PlayfieldView::PreloadLaunchAudio(GameListItem *game)
+{
+	// Find the game's launch audio.  Skip this in attract mode, since
+	// the selection changes constantly, and the game has to be selected
+	// again (ending attract mode) before it can be launched anyway.
+	TSTRING audio;
+	if (game == nullptr || !IsGameValid(game) || attractMode.active
+		|| !game->GetMediaItem(audio, GameListItem::launchAudioType))
+		audio.clear();
+
+	// if we already have this clip loaded, there's nothing to do
+	if (launchAudioPreload != nullptr && launchAudioPreloadFile == audio)
+		return;
+
+	// discard the previous clip
+	if (launchAudioPreload != nullptr)
+	{
+		launchAudioPreload->Shutdown();
+		launchAudioPreload = nullptr;
+	}
+	launchAudioPreloadFile.clear();
+
+	// Open the new clip, if any.  This sets up the media and a player
+	// (usually from the player pool) without starting playback, so the
+	// clip sits ready until the game is launched.
+	if (audio.length() != 0)
+	{
+		RefPtr<AudioVideoPlayer> player(new VLCAudioVideoPlayer(hWnd, hWnd, true));
+		if (player->Open(audio.c_str(), SilentErrorHandler()))
+		{
+			launchAudioPreload.Attach(player.Detach());
+			launchAudioPreloadFile = audio;
+
+			// pre-read the file in the background, so that playback
+			// doesn't wait for the disk either
+			LoaderPool::Submit([audio]() { PrereadFile(audio.c_str(), 16 * 1024 * 1024); }, LoaderPool::Priority::Prefetch);
+		}
+	}
 }
 
 void PlayfieldView::LoadIncomingPlayfieldMedia(GameListItem *game)
 {
+	Trace::Scope trace("Playfield media load", "media", game != nullptr ? game->title.c_str() : nullptr);
+
 	// Send a MediaSyncBegin event
 	FireMediaSyncBeginEvent(this, game);
 
@@ -8626,6 +10480,9 @@ void PlayfieldView::LoadIncomingPlayfieldMedia(GameListItem *game)
 	// remember the new game
 	incomingPlayfield.game = game;
 
+	// get the game's launch audio ready
+	PreloadLaunchAudio(game);
+
 	// if there's a game, try loading its playfield media
 	Application::InUiErrorHandler uieh;
 	TSTRING video, image, defaultVideo, defaultImage, audio;
@@ -8636,9 +10493,7 @@ void PlayfieldView::LoadIncomingPlayfieldMedia(GameListItem *game)
 		// Retrieve the playfield video path and static image path.
 		// We'll use the video if present and fall back on the static
 		// image if it's not available or we can't load it.
-		if (videosEnabled)
-			game->GetMediaItem(video, GameListItem::playfieldVideoType);
-		game->GetMediaItem(image, GameListItem::playfieldImageType);
+		GetPlayfieldMediaFiles(game, video, image);
 
 		// get the default video and image, in case we need a fallback
 		TCHAR buf[MAX_PATH];
@@ -8742,63 +10597,8 @@ void PlayfieldView::LoadIncomingPlayfieldMedia(GameListItem *game)
 		SIZE szLayout = this->szLayout;
 		auto load = [hWnd, video, image, szLayout, videosEnabled, volumePct](BaseView*, VideoSprite *sprite)
 		{
-			// nothing loaded yet
-			bool ok = false;
-
-			// initialize it to fully transparent so we can cross-fade into it
-			sprite->alpha = 0;
-
-			// First try loading a playfield video.  Load it at the full window
-			// height (1.0) and width.  We'll scale the video when we get its format.
 			Application::AsyncErrorHandler eh;
-			if (video.length() != 0
-				&& sprite->LoadVideo(video, hWnd, { 1.0f, 1.0f }, eh, _T("Playfield Video"), true, volumePct))
-				ok = true;
-
-			// If there's no video, try a static image
-			auto LoadImage = [szLayout, &sprite, &eh, hWnd](const TCHAR *path)
-			{
-				// Get the image's native size, and figure the aspect
-				// ratio.  Playfield images are always stored "sideways",
-				// so the nominal width is the display height.  We display
-				// playfield images at 1.0 times the viewport height, so
-				// we just need to figure the relative width.
-				ImageFileDesc imageDesc;
-				GetImageFileInfo(path, imageDesc, true);
-				float cx = imageDesc.dispSize.cx != 0 ? float(imageDesc.dispSize.cy) / float(imageDesc.dispSize.cx) : 0.5f;
-				POINTF normSize = { 1.0f, cx };
-
-				// figure the corresponding pixel size
-				SIZE pixSize = { (int)(normSize.y * szLayout.cy), (int)(normSize.x * szLayout.cx) };
-
-				// load the image into a new sprite
-				return sprite->Load(path, normSize, pixSize, hWnd, eh);
-			};
-			if (!ok && image.length() != 0)
-				ok = LoadImage(image.c_str());
-
-			// if we didn't find any media to load, and videos are enabled, try the
-			// default playfield video
-			TCHAR defaultVideo[MAX_PATH];
-			if (!ok && videosEnabled && GameList::Get()->FindGlobalVideoFile(defaultVideo, _T("Videos"), _T("Default Playfield")))
-				ok = sprite->LoadVideo(defaultVideo, hWnd, { 1.0f, 1.0f }, eh, _T("Playfield Default Video"), true, volumePct);
-
-			// if we *still* didn't find anything, try the default playfield image
-			TCHAR defaultImage[MAX_PATH];
-			if (!ok && GameList::Get()->FindGlobalImageFile(defaultImage, _T("Images"), _T("Default Playfield")))
-				ok = LoadImage(defaultImage);
-
-			// HyperPin/PBX playfield images are oriented sideways, with the bottom at
-			// the left.  Rotate 90 degrees counter-clockwise to orient it vertically.
-			// The actual display will of course orient it according to the camera
-			// view, but it makes things easier to think about if we orient all
-			// graphics the "normal" way internally.  (Note that CCW is positive on
-			// the Z axis, since D3D coordinates are left-handed.)
-			sprite->rotation.z = XM_PI / 2.0f;
-			sprite->UpdateWorld();
-
-			// return the result
-			return ok;
+			return LoadPlayfieldSprite(sprite, hWnd, szLayout, video, image, videosEnabled, volumePct, eh);
 		};
 
 		// Asynchronous loader completion
@@ -8818,8 +10618,10 @@ void PlayfieldView::LoadIncomingPlayfieldMedia(GameListItem *game)
 			}
 		};
 
-		// Kick off the asynchronous load
-		playfieldLoader.AsyncLoad(false, load, done);
+		// Kick off the asynchronous load, unless we already have the
+		// media from the neighbor prefetch
+		if (!AdoptPrefetchedPlayfield(game, video, image, volumePct))
+			playfieldLoader.AsyncLoad(false, load, done);
 
 		// Tell the event sentry that we've initiated media loading.  The
 		// loader is responsible for sending the Media Sync End event, so
@@ -9045,8 +10847,16 @@ bool PlayfieldView::LoadUnderlay(const TCHAR *filename, const UnderlayOptions *o
 	if (currentUnderlay.sprite != nullptr)
 		currentUnderlay.sprite->alpha = 1.0f - alpha;
 
-	// start the crossfade timer
-	SetTimer(hWnd, underlayFadeTimerID, UnderlayFadeInterval, NULL);
+	// Start the crossfade timer, unless the new image is still loading
+	// in the background.  Large underlay images can take a while to
+	// decode, so rather than fading out the old underlay to an empty
+	// space in the meantime, hold the fade where it is until the new
+	// image is ready to display.  The first-frame notification starts
+	// the fade at that point.
+	if (filename[0] == 0 || incomingUnderlay.sprite->IsFrameReady())
+		SetTimer(hWnd, underlayFadeTimerID, UnderlayFadeInterval, NULL);
+	else
+		KillTimer(hWnd, underlayFadeTimerID);
 
 	// success
 	return true;
@@ -9434,19 +11244,189 @@ void PlayfieldView::MuteTableAudio(bool mute)
 		currentPlayfield.audio->Mute(mute);
 }
 
+void PlayfieldView::GetPlayfieldMediaFiles(GameListItem *game, TSTRING &video, TSTRING &image)
+{
+	if (Application::Get()->IsEnableVideo())
+		game->GetMediaItem(video, GameListItem::playfieldVideoType);
+	game->GetMediaItem(image, GameListItem::playfieldImageType);
+}
+
+bool PlayfieldView::LoadPlayfieldSprite(VideoSprite *sprite, HWND hWnd, SIZE szLayout,
+	const TSTRING &video, const TSTRING &image, bool videosEnabled, int volumePct,
+	ErrorHandler &eh)
+{
+	// nothing loaded yet
+	bool ok = false;
+
+	// initialize it to fully transparent so we can cross-fade into it
+	sprite->alpha = 0;
+
+	// First try loading a playfield video.  Load it at the full window
+	// height (1.0) and width.  We'll scale the video when we get its format.
+	if (video.length() != 0
+		&& sprite->LoadVideo(video, hWnd, { 1.0f, 1.0f }, eh, _T("Playfield Video"), true, volumePct, false, true))
+		ok = true;
+
+	// If there's no video, try a static image
+	auto LoadImage = [szLayout, &sprite, &eh, hWnd](const TCHAR *path)
+	{
+		// Get the image's native size, and figure the aspect
+		// ratio.  Playfield images are always stored "sideways",
+		// so the nominal width is the display height.  We display
+		// playfield images at 1.0 times the viewport height, so
+		// we just need to figure the relative width.
+		ImageFileDesc imageDesc;
+		GetImageFileInfo(path, imageDesc, true);
+		float cx = imageDesc.dispSize.cx != 0 ? float(imageDesc.dispSize.cy) / float(imageDesc.dispSize.cx) : 0.5f;
+		POINTF normSize = { 1.0f, cx };
+
+		// figure the corresponding pixel size
+		SIZE pixSize = { (int)(normSize.y * szLayout.cy), (int)(normSize.x * szLayout.cx) };
+
+		// load the image into a new sprite
+		return sprite->Load(path, normSize, pixSize, hWnd, eh);
+	};
+	if (!ok && image.length() != 0)
+		ok = LoadImage(image.c_str());
+
+	// if we didn't find any media to load, and videos are enabled, try the
+	// default playfield video
+	TCHAR defaultVideo[MAX_PATH];
+	if (!ok && videosEnabled && GameList::Get()->FindGlobalVideoFile(defaultVideo, _T("Videos"), _T("Default Playfield")))
+		ok = sprite->LoadVideo(defaultVideo, hWnd, { 1.0f, 1.0f }, eh, _T("Playfield Default Video"), true, volumePct, false, true);
+
+	// if we *still* didn't find anything, try the default playfield image
+	TCHAR defaultImage[MAX_PATH];
+	if (!ok && GameList::Get()->FindGlobalImageFile(defaultImage, _T("Images"), _T("Default Playfield")))
+		ok = LoadImage(defaultImage);
+
+	// HyperPin/PBX playfield images are oriented sideways, with the bottom at
+	// the left.  Rotate 90 degrees counter-clockwise to orient it vertically.
+	// The actual display will of course orient it according to the camera
+	// view, but it makes things easier to think about if we orient all
+	// graphics the "normal" way internally.  (Note that CCW is positive on
+	// the Z axis, since D3D coordinates are left-handed.)
+	sprite->rotation.z = XM_PI / 2.0f;
+	sprite->UpdateWorld();
+
+	// return the result
+	return ok;
+}
+
+bool PlayfieldView::AdoptPrefetchedPlayfield(GameListItem *game, const TSTRING &video, const TSTRING &image, int volumePct)
+{
+	// Look for prefetched media for the game, loaded from the same files.
+	// The files could differ if the game's media changed since we loaded
+	// the prefetch entry, or if Javascript substituted different files in
+	// the MediaSyncLoad event.
+	auto it = std::find_if(playfieldPrefetch.begin(), playfieldPrefetch.end(),
+		[game, &video, &image](const PrefetchedPlayfield &p) { return p.game == game && p.video == video && p.image == image; });
+	if (it == playfieldPrefetch.end())
+		return false;
+
+	// take the sprite out of the prefetch list
+	RefPtr<VideoSprite> sprite = it->sprite;
+	playfieldPrefetch.erase(it);
+
+	// The video, if any, is already running at zero volume (or paused,
+	// in the low-power attract mode profile), so resume it, and set the
+	// game's volume and the current muting status
+	if (auto v = sprite->GetVideoPlayer(); v != nullptr)
+	{
+		v->SetPause(false);
+		v->SetVolume(volumePct);
+		v->Mute(Application::Get()->IsMuteVideosNow());
+	}
+
+	// Make it the incoming sprite, and scale it to the window.  If its
+	// first frame is already decoded, this starts the cross-fade right
+	// away; otherwise the first-frame notification starts it as usual.
+	incomingPlayfield.sprite = sprite;
+	ScaleSprites();
+	IncomingPlayfieldMediaDone(sprite);
+	return true;
+}
+
+void PlayfieldView::UpdatePlayfieldPrefetch()
+{
+	// Note the neighbors of the current selection.  In attract mode, the
+	// game that the next attract mode switch will land on comes first.
+	// In the low-power profile, that's the only game we load, since the
+	// wheel neighbors won't be needed until the user returns.
+	std::list<GameListItem*> neighbors;
+	if (attractMode.active)
+	{
+		if (auto game = GameList::Get()->GetNthGame(attractMode.nextOffset); IsGameValid(game)
+			&& game != GameList::Get()->GetNthGame(0))
+			neighbors.push_back(game);
+	}
+	for (int i = 1; i <= (attractMode.IsLowPower() ? 0 : playfieldPrefetchCount); ++i)
+	{
+		for (int n : { i, -i })
+		{
+			if (auto game = GameList::Get()->GetNthGame(n); IsGameValid(game)
+				&& game != GameList::Get()->GetNthGame(0)
+				&& std::find(neighbors.begin(), neighbors.end(), game) == neighbors.end())
+				neighbors.push_back(game);
+		}
+	}
+
+	// discard prefetched media for games that are no longer neighbors
+	playfieldPrefetch.remove_if([&neighbors](const PrefetchedPlayfield &p) {
+		return std::find(neighbors.begin(), neighbors.end(), p.game) == neighbors.end(); });
+
+	// Load media for the new neighbors, nearest first.  Stop if we're over
+	// the texture memory budget, since prefetched media is expendable.
+	bool videosEnabled = Application::Get()->IsEnableVideo();
+	for (auto game : neighbors)
+	{
+		// skip games we've already prefetched
+		if (std::find_if(playfieldPrefetch.begin(), playfieldPrefetch.end(),
+			[game](const PrefetchedPlayfield &p) { return p.game == game; }) != playfieldPrefetch.end())
+			continue;
+
+		// stop if we're over the texture budget
+		if (TextureBudget::GetBudget() != 0 && TextureBudget::GetTotalBytes() >= TextureBudget::GetBudget())
+			break;
+
+		// get the game's media files
+		TSTRING video, image;
+		GetPlayfieldMediaFiles(game, video, image);
+
+		// Load the media at zero volume.  We'll set the real volume when
+		// the game becomes the selection.  Use a silent error handler,
+		// since we'll just try again with the normal loader (and report
+		// any errors then) if this doesn't work.
+		RefPtr<VideoSprite> sprite(new VideoSprite());
+		LoadPlayfieldSprite(sprite, hWnd, szLayout, video, image, videosEnabled, 0, SilentErrorHandler());
+		playfieldPrefetch.emplace_back(game, video, image, sprite);
+	}
+}
+
 void PlayfieldView::IncomingPlayfieldMediaDone(VideoSprite *sprite)
 {
 	// set the new sprite
 	incomingPlayfield.sprite = sprite;
 	incomingPlayfieldLoadTime = GetTickCount();
 
+	// If the video is showing a poster frame, lay out the sprite at the
+	// poster's aspect ratio, which is the video's frame size, so that we
+	// don't have to wait for the player to report the format.  As with
+	// the format notification, the nominal 'x' dimension is the height.
+	if (SIZE sz = sprite->GetPosterFrameSize(); sprite->HasPosterFrame() && sz.cx != 0)
+	{
+		sprite->loadSize.y = static_cast<float>(sz.cy) / static_cast<float>(sz.cx);
+		sprite->ReCreateMesh();
+		ScaleSprites();
+	}
+
 	// update the drawing list
 	UpdateDrawingList();
 
 	// Start the cross-fade.  Exception: if there's a video, and it hasn't 
 	// started playing yet, defer the cross-fade until we get notification
-	// that playback has started.
-	if (sprite->GetVideoPlayer() == nullptr || sprite->GetVideoPlayer()->IsFrameReady())
+	// that playback has started.  A poster frame counts as started.
+	if (sprite->GetVideoPlayer() == nullptr || sprite->IsFrameReady())
 		StartPlayfieldCrossfade();
 }
 
@@ -9476,6 +11456,9 @@ void PlayfieldView::OnEnableVideos(bool enable)
 	Check(currentPlayfield);
 	Check(incomingPlayfield);
 
+	// discard the prefetched media, since it was loaded under the old setting
+	playfieldPrefetch.clear();
+
 	// reload the media if necessary
 	if (reload)
 	{
@@ -9499,17 +11482,56 @@ void PlayfieldView::OnUpdateVideoMute(bool mute)
 
 Sprite *PlayfieldView::LoadWheelImage(const GameListItem *game)
 {
+	// get the path for the wheel image
+	TSTRING path;
+	bool havePath = IsGameValid(game) && game->GetMediaItem(path, GameListItem::wheelImageType);
+
+	// Figure the cache key.  For an image file, the source is the file
+	// path, qualified by its modification time; for a synthesized title
+	// image, it's the title.
+	LONG gameId = game != nullptr ? game->internalID : 0;
+	FILETIME mtime = { 0, 0 };
+	TSTRING source;
+	if (havePath)
+	{
+		source = path;
+		MediaFileIndex::GetFileTime(path.c_str(), mtime);
+	}
+	else if (game != nullptr)
+		source = _T("title:") + game->title;
+
+	// Check the cache.  Skip any entry whose sprite is already in the
+	// wheel, since a sprite can only be at one wheel position at a time;
+	// that can happen when the game list is shorter than the wheel.
+	for (auto it = wheelImageCache.begin(); it != wheelImageCache.end(); ++it)
+	{
+		if (it->Matches(gameId, szLayout, source, mtime)
+			&& std::find_if(wheelImages.begin(), wheelImages.end(),
+				[it](const RefPtr<Sprite> &s) { return s.Get() == it->sprite.Get(); }) == wheelImages.end())
+		{
+			// move it to the front of the LRU list
+			wheelImageCache.splice(wheelImageCache.begin(), wheelImageCache, it);
+
+			// Reset the current wheel alpha, in case we're in a fade, and
+			// return a new reference to the caller.  The caller sets the
+			// position.
+			Sprite *sprite = it->sprite;
+			sprite->alpha = wheelAlpha;
+			sprite->AddRef();
+			return sprite;
+		}
+	}
+
 	// create the sprite
 	Sprite *sprite = new Sprite();
 
 	// set the current wheel alpha, in case we're in a fade
 	sprite->alpha = wheelAlpha;
 
-	// get the path for the wheel image
-	TSTRING path;
+	// load the wheel image
 	bool ok = false;
     Application::InUiErrorHandler eh;
-	if (IsGameValid(game) && game->GetMediaItem(path, GameListItem::wheelImageType))
+	if (havePath)
 	{
 		// Get the image's native size.  Figure the sprite size based on
 		// a fixed width, scaling as always to the height, using 1920 pixels
@@ -9531,8 +11553,18 @@ Sprite *PlayfieldView::LoadWheelImage(const GameListItem *game)
 		// figure the corresponding pixel size
 		SIZE pixSize = { (int)(width * szLayout.cx), (int)(height * szLayout.cy) };
 
-		// Load the image
-		ok = sprite->Load(path.c_str(), normSize, pixSize, hWnd, eh);
+		// Load the image.  Use the wheel atlas if possible; this will fall
+		// back on a normal load if the image isn't suitable for the atlas.
+		// Wheel images shrink as they move away from the center, so ask
+		// for mips in case we end up with a standalone texture.
+		sprite->genMips = true;
+
+		// Load the current game's wheel image ahead of the adjacent
+		// games' images, which we load in anticipation of the wheel
+		// moving.
+		sprite->loadPriority = (game == GameList::Get()->GetNthGame(0)) ?
+			LoaderPool::Priority::High : LoaderPool::Priority::Prefetch;
+		ok = sprite->LoadIntoAtlas(path.c_str(), normSize, pixSize, GetWheelAtlas(), hWnd, eh);
 	}
 
 	// if we didn't load a sprite, synthesize a default image
@@ -9553,14 +11585,14 @@ Sprite *PlayfieldView::LoadWheelImage(const GameListItem *game)
 			Gdiplus::Graphics g(hdc);
 
 			// measure the title string and figure the origin for centering it
-			std::unique_ptr<Gdiplus::Font> font;
+			std::shared_ptr<Gdiplus::Font> font;
 			Gdiplus::RectF rcLayout(0, 0, float(width), 0);
 			Gdiplus::RectF bbox;
 			int ptsize = wheelFont.ptSize;
 			do
 			{
 				// create the font at this size
-				font.reset(CreateGPFont(wheelFont.family.c_str(), ptsize, wheelFont.weight, wheelFont.italic));
+				font = FontCache::GetGPFont(wheelFont.family.c_str(), ptsize, wheelFont.weight, wheelFont.italic);
 
 				// measure it
 				g.MeasureString(title, -1, font.get(), rcLayout, &bbox);
@@ -9597,10 +11629,34 @@ Sprite *PlayfieldView::LoadWheelImage(const GameListItem *game)
 		}, eh, _T("default wheel image"));
 	}
 
+	// add it to the cache, dropping the least recently used entry if full
+	wheelImageCache.emplace_front(gameId, szLayout, source, mtime, sprite);
+	if (wheelImageCache.size() > maxWheelImageCacheSize)
+		wheelImageCache.pop_back();
+
 	// return the new sprite
 	return sprite;
 }
 
+TextureAtlas *PlayfieldView::GetWheelAtlas()
+{
+	// Figure the atlas cell size for the current layout.  This is the
+	// largest pixel size that LoadWheelImage() will ask for: 0.44 of
+	// the layout width by 0.25 of the layout height.
+	SIZE cellSize = { (int)(0.44f * szLayout.cx), (int)(0.25f * szLayout.cy) };
+	if (cellSize.cx <= 0 || cellSize.cy <= 0)
+		return nullptr;
+
+	// if we don't have an atlas yet, or the cell size has changed, create a new one
+	if (wheelAtlas == nullptr
+		|| wheelAtlas->GetCellSize().cx != cellSize.cx
+		|| wheelAtlas->GetCellSize().cy != cellSize.cy)
+		wheelAtlas.Attach(new TextureAtlas(cellSize));
+
+	// return the atlas
+	return wheelAtlas;
+}
+
 // Update a wheel image position.  'n' is the position on the wheel,
 // with 0 representing the center position.  'progress' is the position
 // in the animation sequence; 0.0f represents the idle state or the
@@ -9620,8 +11676,10 @@ void PlayfieldView::SetWheelImagePos(Sprite *image, int n, float progress)
 	theta -= progress * wheel.angle * fabs(float(animWheelDistance));
 
 	// calculate the new position
-	image->offset.x = wheel.radius * sinf(theta);
-	image->offset.y = wheel.yCenter + wheel.radius * cosf(theta);
+	float sinTheta, cosTheta;
+	XMScalarSinCos(&sinTheta, &cosTheta, theta);
+	image->offset.x = wheel.radius * sinTheta;
+	image->offset.y = wheel.yCenter + wheel.radius * cosTheta;
 	image->offset.z = 0.0f;
 
 	// For images at the center or transitioning to/from the center spot,
@@ -9856,8 +11914,14 @@ void PlayfieldView::ClearMedia()
 	// clear the info box
 	infoBox.Clear();
 
-	// remove all wheel images
+	// Drop the preloaded launch audio, so that we don't hold a player
+	// on the file.  (Callers clear the media before renaming or deleting
+	// media files.)
+	PreloadLaunchAudio(nullptr);
+
+	// remove all wheel images, including the cached ones
 	wheelImages.clear();
+	wheelImageCache.clear();
 	animAddedToWheel = 0;
 
 	// update the drawing list for the change
@@ -9917,6 +11981,13 @@ void PlayfieldView::BeginRunningGameMode(GameListItem *game, GameSystem *)
 			SWP_NOMOVE | SWP_NOSIZE | SWP_NOACTIVATE);
 	}
 
+	// Discard the prefetched playfield media, so that its videos don't
+	// compete with the game for resources.  We'll prefetch again when we
+	// update the selection after the game exits.
+	KillTimer(hWnd, playfieldPrefetchTimerID);
+	playfieldPrefetch.clear();
+	KillTimer(hWnd, popupPrerenderTimerID);
+
 	// create the running game sprites
 	runningGameBkgPopup.Attach(new VideoSprite());
 	runningGameBkgPopup->alpha = 0.0f;
@@ -10089,8 +12160,90 @@ void PlayfieldView::EnterRunFreezeMode()
 	if (runningGameBkgIsVideo)
 		runningGameBkgPopup = nullptr;
 
-	// update the drawing list for the sprite changes
-	UpdateDrawingList();
+	// If we're yielding resources to the game, release everything that
+	// isn't needed to display the running game overlay: the wheel icons
+	// and all of the cached sprites.  We'll rebuild all of this when the
+	// game exits.
+	if (yieldResourcesToGame)
+	{
+		wheelImages.clear();
+		wheelImageCache.clear();
+		animAddedToWheel = 0;
+		popupCache.Clear();
+		menuCache.clear();
+		upperStatus.spriteCache.clear();
+		lowerStatus.spriteCache.clear();
+		attractModeStatus.spriteCache.clear();
+		resourcesYielded = true;
+	}
+
+	// update the drawing list for the sprite changes
+	UpdateDrawingList();
+
+	// now release the shared resources, once our own references are gone
+	if (resourcesYielded)
+		Application::Get()->YieldResourcesToGame();
+}
+
+void PlayfieldView::ReleaseDeviceResources()
+{
+	// close any menus and popups, and release the wheel and the cached
+	// sprites, as when yielding resources to a running game
+	CloseMenusAndPopups();
+	wheelImages.clear();
+	wheelImageCache.clear();
+	animAddedToWheel = 0;
+	popupCache.Clear();
+	menuCache.clear();
+	upperStatus.spriteCache.clear();
+	lowerStatus.spriteCache.clear();
+	attractModeStatus.spriteCache.clear();
+	wheelAtlas = nullptr;
+	creditsSprite = nullptr;
+	UpdateDrawingList();
+
+	// release the base class resources
+	__super::ReleaseDeviceResources();
+}
+
+bool PlayfieldView::RestoreDeviceResources()
+{
+	// restore the base class resources
+	if (!__super::RestoreDeviceResources())
+		return false;
+
+	// Rebuild the wheel and reload the media for all of the windows.  If
+	// a game is running, do this when it exits, the same way we restore
+	// resources yielded to the game.
+	if (runningGameMsgPopup != nullptr)
+		resourcesYielded = true;
+	else
+		UpdateSelection(false);
+
+	return true;
+}
+
+void PlayfieldView::NvramPrescanBatch()
+{
+	// Process a batch of games from the end of the queue.  The order
+	// doesn't matter, since the pre-scan queries all go behind any
+	// interactive requests anyway.
+	auto gl = GameList::Get();
+	auto hs = Application::Get()->highScores.Get();
+	for (int i = 0; i < 10 && nvramPrescanQueue.size() != 0; ++i)
+	{
+		LONG id = nvramPrescanQueue.back();
+		nvramPrescanQueue.pop_back();
+		if (auto game = gl->GetByInternalID(id); game != nullptr)
+			hs->Prescan(game);
+	}
+
+	// stop the timer when the queue is exhausted
+	if (nvramPrescanQueue.size() == 0)
+	{
+		KillTimer(hWnd, nvramPrescanTimerID);
+		std::vector<LONG>().swap(nvramPrescanQueue);
+	}
 }
 
 void PlayfieldView::EndRunningGameMode()
@@ -10125,8 +12278,18 @@ void PlayfieldView::EndRunningGameMode()
 	// Clear the keyboard queue
 	keyQueue.clear();
 
-	// sync the playfield
-	SyncPlayfield(SyncEndGame);
+	// Sync the playfield.  If we released our resources to the game,
+	// do a full selection update instead, to rebuild the wheel along
+	// with the playfield media.  That loads the current game's media
+	// first, then the wheel, and restarts the prefetch and popup
+	// pre-rendering timers to rebuild the caches in the background.
+	if (resourcesYielded)
+	{
+		resourcesYielded = false;
+		UpdateSelection(false);
+	}
+	else
+		SyncPlayfield(SyncEndGame);
 
 	// Restore the other windows
 	Application::Get()->EndRunningGameMode();
@@ -10146,6 +12309,12 @@ void PlayfieldView::EndRunningGameMode()
 	auto game = GameList::Get()->GetByInternalID(runningGameID);
 	FireLaunchOverlayEvent(jsLaunchOverlayHideEvent, game);
 
+	// The game has probably just updated its NVRAM file, so pre-scan
+	// it now to refresh the cached high scores, unless a request for
+	// the game's scores is already under way.
+	if (game != nullptr && hiScoreSysReady && game->highScoreStatus == GameListItem::HighScoreStatus::Init)
+		Application::Get()->highScores->Prescan(game);
+
 	// remove the popup
 	StartAnimTimer(runningGamePopupStartTime);
 	runningGamePopupMode = RunningGamePopupClose;
@@ -10240,11 +12409,12 @@ void PlayfieldView::SendToBackForResumeGame()
 	SendWin(app->GetInstCardView());
 }
 
-void PlayfieldView::JsDraw(Sprite *sprite, int width, int height, JsValueRef drawFunc)
+void PlayfieldView::JsDraw(Sprite *sprite, int width, int height, JsValueRef drawFunc, bool gpu)
 {
-	// set up the native draw function, which will invoke the JS
-	// drawing callback
-	auto Draw = [&](Gdiplus::Graphics &g)
+	// Set up the native draw function, which will invoke the JS drawing
+	// callback.  The surface is either a GDI+ Graphics object or a Direct2D
+	// render target.
+	auto Draw = [&](auto &&surface)
 	{
 		// remember any prior drawing context
 		auto oldJsDC = jsDC.release();
@@ -10252,7 +12422,7 @@ void PlayfieldView::JsDraw(Sprite *sprite, int width, int height, JsValueRef dra
 		// Set up the native interface for the Javascript drawing context for 
 		// the callback.  Note that this object is static, which is fine, since 
 		// it only has to exist for the duration of the callback invocation.
-		jsDC.reset(new JsDrawingContext(this, g, static_cast<float>(width), static_cast<float>(height), 0));
+		jsDC.reset(new JsDrawingContext(this, surface, static_cast<float>(width), static_cast<float>(height), 0));
 
 		// invoke the callback - drawFunc(drawingContext)
 		auto js = JavascriptEngine::Get();
@@ -10260,10 +12430,31 @@ void PlayfieldView::JsDraw(Sprite *sprite, int width, int height, JsValueRef dra
 		if (JsErrorCode err = JsCallFunction(drawFunc, argv, static_cast<unsigned short>(countof(argv)), &result); err != JsNoError)
 			js->Throw(err, _T("drawing callback"));
 
-		// restore the prior drawing context
+		// close out any GDI interop drawing, and restore the prior context
+		jsDC->EndGdi();
 		jsDC.reset(oldJsDC);
 	};
 
+	// If the caller asked for GPU drawing, draw through Direct2D directly
+	// into the sprite's texture.  If we can't set up the Direct2D surface,
+	// fall back on GDI+ drawing.  Don't retry with GDI+ if the callback
+	// already ran, though, since the script might not expect to be called
+	// twice.
+	if (gpu)
+	{
+		bool drawn = false;
+		bool ok = sprite->LoadD2D(width, height, [&](ID2D1RenderTarget *target) { drawn = true; Draw(target); },
+			LogFileErrorHandler(), _T("mainWindow.drawingLayer.draw (Direct2D)"));
+
+		// Direct2D bitmaps are specific to the render target, so drop the
+		// image cache if the target failed
+		if (!ok)
+			jsD2DImageCache.clear();
+
+		if (ok || drawn)
+			return;
+	}
+
 	// do the drawing
 	sprite->Load(width, height, Draw, SilentErrorHandler(), _T("mainWindow.launchOverlay.draw"));
 }
@@ -10304,6 +12495,9 @@ bool PlayfieldView::OnUserMessage(UINT msg, WPARAM wParam, LPARAM lParam)
 			// presume that we'll return TRUE in the LRESULT to continue the launch
 			curMsg->lResult = TRUE;
 
+			// time the events for the launch timeline
+			LaunchTimeline::Phase phase("RunBefore events");
+
 			// fire Javascript "runbeforepre"; abort the launch if the event is canceled
 			if (!FireLaunchEvent(jsRunBeforePreEvent, report->gameInternalID, report->launchCmd))
 			{
@@ -10354,6 +12548,9 @@ bool PlayfieldView::OnUserMessage(UINT msg, WPARAM wParam, LPARAM lParam)
 			// get the launch report
 			auto report = reinterpret_cast<LaunchReport*>(lParam);
 
+			// time the switch to Running mode for the launch timeline
+			LaunchTimeline::Phase runningPhase("running mode");
+
 			// if we were set to topmost, move our window behind the game window
 			// (or to the bottom of the stack if the launch thread didn't identify
 			// a game window)
@@ -10417,6 +12614,10 @@ bool PlayfieldView::OnUserMessage(UINT msg, WPARAM wParam, LPARAM lParam)
 			// going, which is when it matters that we reduce our footprint.
 			SetTimer(hWnd, runFreezeTimerID, 5000, NULL);
 			runFreezeTimerPending = true;
+
+			// the game is running - log the launch timeline
+			runningPhase.End();
+			LaunchTimeline::Finish(game != nullptr ? game->title.c_str() : _T("(unknown game)"));
 		}
 		return true;
 
@@ -10449,6 +12650,9 @@ bool PlayfieldView::OnUserMessage(UINT msg, WPARAM wParam, LPARAM lParam)
 
 					// add it to the cumulative play time in the database
 					gl->SetPlayTime(game, gl->GetPlayTime(game) + seconds);
+
+					// commit the session's stats to the journal
+					gl->CommitStatsJournal();
 				}
 			}
 
@@ -10636,6 +12840,53 @@ bool PlayfieldView::OnUserMessage(UINT msg, WPARAM wParam, LPARAM lParam)
 			js->OnDebugMessageQueued();
 		break;
 
+	case PFVMsgJsWorkerMessage:
+		// A Javascript worker thread has posted messages for the main
+		// context.  Queue them for delivery to the Worker objects.
+		OnJsWorkerMessages();
+		return true;
+
+	case PFVMsgJsAsyncIODone:
+		// Javascript asyncIO requests have completed on the thread pool.
+		// Settle their promises, and run the resulting promise tasks.
+		if (jsAsyncIO != nullptr)
+		{
+			jsAsyncIO->OnCompletions();
+			if (auto js = JavascriptEngine::Get(); js != nullptr)
+				js->RunTasks();
+		}
+		return true;
+
+	case PFVMsgPinscapeDone:
+		// Pinscape device requests have completed on the device threads
+		PinscapeDevice::ProcessCompletions();
+		return true;
+
+	case PFVMsgCaptureEncodeDone:
+		// a deferred capture encoding pass has completed
+		OnCaptureEncodeDone();
+		return true;
+
+	case PFVMsgStartupTaskDone:
+		// a background startup task has completed
+		StartupTasks::OnUiMessage();
+		return true;
+
+	case PFVMsgMediaDropDone:
+		// background media drop installation has completed
+		OnMediaDropDone();
+		return true;
+
+	case PFVMsgMediaRenameDone:
+		// background media file renaming has completed
+		OnMediaRenameDone();
+		return true;
+
+	case PFVMsgPlayerRetired:
+		// the retirement worker has shut down an audio/video player
+		AudioVideoPlayer::ProcessDeletionQueue();
+		return true;
+
 	case PFVMsgTakeFocusPostLaunch:
 		// After a game launch thread exits, it sends us this messages a
 		// few times at brief intervals (3x at 1-second intervals currently).
@@ -10693,10 +12944,29 @@ bool PlayfieldView::OnAppMessage(UINT msg, WPARAM wParam, LPARAM lParam)
 			};
 			if (UpdateFormat(incomingPlayfield.sprite) || UpdateFormat(currentPlayfield.sprite))
 				ScaleSprites();
+			else
+			{
+				// check for a prefetched playfield video; these get scaled
+				// when they become the incoming playfield
+				for (auto &p : playfieldPrefetch)
+				{
+					if (UpdateFormat(p.sprite))
+						break;
+				}
+			}
 		}
 		break;
 
 	case AVPMsgFirstFrameReady:
+		// If the incoming underlay image has finished loading, start its
+		// crossfade.  Still images don't have distinct media cookies, so
+		// this can share a notification with an incoming playfield image;
+		// check it separately, and go by whether the sprite is ready.
+		if (incomingUnderlay.sprite != nullptr
+			&& incomingUnderlay.sprite->GetMediaCookie() == wParam
+			&& incomingUnderlay.sprite->IsFrameReady())
+			SetTimer(hWnd, underlayFadeTimerID, UnderlayFadeInterval, NULL);
+
 		// First frame of a video is ready to display.  If this is the
 		// incoming playfield video player, start the cross-fade for the
 		// new playfield.  The WPARAM gives the player cookie, so check
@@ -10704,10 +12974,30 @@ bool PlayfieldView::OnAppMessage(UINT msg, WPARAM wParam, LPARAM lParam)
 		// sure this notification is for the current playfield.  This is
 		// asynchronous, so it's possible that we could have already
 		// switched to a new playfield by the time this notification
-		// arrives.
+		// arrives.  If the sprite showed a poster frame, the cross-fade
+		// already started when the load finished.
 		if (incomingPlayfield.sprite != nullptr 
 			&& incomingPlayfield.sprite->GetMediaCookie() == wParam)
-			StartPlayfieldCrossfade();
+		{
+			if (!incomingPlayfield.sprite->HasPosterFrame())
+				StartPlayfieldCrossfade();
+		}
+		else if (attractMode.IsLowPower())
+		{
+			// In the low-power attract mode profile, pause a prefetched
+			// video once its first frame is ready, so that it doesn't
+			// keep decoding off screen until the switch.  The switch
+			// resumes it when it becomes the incoming playfield.
+			for (auto &p : playfieldPrefetch)
+			{
+				if (p.sprite->GetMediaCookie() == wParam)
+				{
+					if (auto v = p.sprite->GetVideoPlayer(); v != nullptr)
+						v->SetPause(true);
+					break;
+				}
+			}
+		}
 		break;
 
 	case AVPMsgEndOfPresentation:
@@ -10840,7 +13130,7 @@ void PlayfieldView::ShowQueuedError()
 	// set up a font for the error text
 	MemoryDC memdc;
 	Gdiplus::Graphics g(memdc);
-	std::unique_ptr<Gdiplus::Font> font(CreateGPFont(_T("Segoe UI"), 22, 400, false));
+	std::shared_ptr<Gdiplus::Font> font(FontCache::GetGPFont(_T("Segoe UI"), 22, 400, false));
 
 	// figure the height of the error list
 	int ht = 0;
@@ -11124,6 +13414,42 @@ void PlayfieldView::ShowMenu(const std::list<MenuItemDesc> &items, const WCHAR *
 	// remember the page of the menu being displayed
 	menuPage = pageno;
 
+	// If we've shown the same menu recently, reuse its sprites
+	TSTRING cacheKey = GetMenuCacheKey(m, pageno);
+	if (Menu *cached = GetCachedMenu(cacheKey, menuPage); cached != nullptr)
+	{
+		// Take the new descriptor list, since the event handler and the
+		// caller's selection apply to this showing.
+		cached->descs = m->descs;
+		m = cached;
+
+		// Set the initial selection.  The rendered items don't depend on
+		// the selection, so it's not part of the cache key; find the item
+		// for the selected descriptor by command ID.
+		m->selected = m->items.end();
+		for (auto &d : m->descs)
+		{
+			if (d.selected)
+			{
+				for (auto it = m->items.begin(); it != m->items.end(); ++it)
+				{
+					if (it->cmd == d.cmd)
+					{
+						m->Select(it);
+						break;
+					}
+				}
+				d.selected = false;
+				break;
+			}
+		}
+
+		// start from the beginning of the opening animation, and display it
+		UpdateMenuAnimation(m, true, 0.0f);
+		ActivateMenu(m, items, flags);
+		return;
+	}
+
 	// set the initial animation for the incoming menu to the start of the sequence
 	UpdateMenuAnimation(m, true, 0.0f);
 
@@ -11138,7 +13464,7 @@ void PlayfieldView::ShowMenu(const std::list<MenuItemDesc> &items, const WCHAR *
 		| Gdiplus::StringFormatFlagsMeasureTrailingSpaces);
 
 	// set up our main text font and checkmark font
-	std::unique_ptr<Gdiplus::Font> symfont(CreateGPFont(_T("Wingdings"), menuFont.ptSize, 400, false));
+	std::shared_ptr<Gdiplus::Font> symfont(FontCache::GetGPFont(_T("Wingdings"), menuFont.ptSize, 400, false));
 	ArrowFont arrowFont(menuFont.ptSize);
 
 	// checkmark and bullet characters in Wingdings
@@ -11524,6 +13850,15 @@ void PlayfieldView::ShowMenu(const std::list<MenuItemDesc> &items, const WCHAR *
 	}, eh, _T("menu items")))
 		return;
 
+	// keep the sprites in case the same menu is shown again
+	AddMenuToCache(cacheKey, m, menuPage);
+
+	// display it
+	ActivateMenu(m, items, flags);
+}
+
+void PlayfieldView::ActivateMenu(Menu *m, const std::list<MenuItemDesc> &items, DWORD flags)
+{
 	// Select the first item if we didn't already select something else
 	if (m->selected == m->items.end())
 		m->Select(m->items.begin());
@@ -11564,6 +13899,63 @@ void PlayfieldView::ShowMenu(const std::list<MenuItemDesc> &items, const WCHAR *
 	dof.SetUIContext(L"PBYMenu");
 }
 
+TSTRING PlayfieldView::GetMenuCacheKey(const Menu *m, int pageno)
+{
+	// The rendered menu depends on the ID and flags, the page, and the
+	// descriptors, except for the selection, which only positions the
+	// highlight.
+	TSTRING key = MsgFmt(_T("%s|%lx|%d"), m->id.c_str(), m->flags, pageno).Get();
+	for (auto &d : m->descs)
+	{
+		key += MsgFmt(_T("|%d:%d%d%d%d:"), d.cmd, d.checked, d.radioChecked, d.hasSubmenu, d.stayOpen).Get();
+		key += d.text;
+	}
+	return key;
+}
+
+PlayfieldView::Menu *PlayfieldView::GetCachedMenu(const TSTRING &key, int &page)
+{
+	for (auto it = menuCache.begin(); it != menuCache.end(); ++it)
+	{
+		if ((*it)->key == key)
+		{
+			// if it was evicted, or it's already on display, it's no use to the caller
+			Menu *m = (*it)->menu;
+			if (m == nullptr || m == curMenu || m == newMenu)
+				break;
+
+			// move it to the front of the list, and note the use
+			if (it != menuCache.begin())
+				menuCache.splice(menuCache.begin(), menuCache, it);
+			menuCache.front()->Touch();
+			page = menuCache.front()->page;
+			return m;
+		}
+	}
+
+	// not found
+	return nullptr;
+}
+
+void PlayfieldView::AddMenuToCache(const TSTRING &key, Menu *m, int page)
+{
+	// remove any existing entry for the key
+	menuCache.remove_if([&key](const std::unique_ptr<MenuCacheEntry> &e) { return e->key == key; });
+
+	// make room for the new entry
+	while (menuCache.size() >= maxMenuCache && menuCache.size() != 0)
+		menuCache.pop_back();
+
+	// add the new entry at the front
+	menuCache.emplace_front(new MenuCacheEntry(key, m, page));
+}
+
+INT64 PlayfieldView::MenuCacheEntry::GetEvictableBytes() const
+{
+	return menu != nullptr ?
+		GetPopupCacheBytes(menu->sprBkg) + GetPopupCacheBytes(menu->sprItems) + GetPopupCacheBytes(menu->sprHilite) : 0;
+}
+
 void PlayfieldView::AccelerateCloseMenu()
 {
 	if (curMenu != nullptr && newMenu == nullptr && menuAnimMode == MenuAnimClose)
@@ -11850,10 +14242,20 @@ void PlayfieldView::UpdateDrawingList()
 	if (dropTargetSprite != nullptr)
 		AddToDrawingList(dropTargetSprite);
 
+	// add the media benchmark item
+	if (benchmarkSprite != nullptr)
+		AddToDrawingList(benchmarkSprite);
+
 	// rescale sprites that vary by window size
 	ScaleSprites();
 }
 
+void PlayfieldView::SetBenchmarkSprite(Sprite *sprite)
+{
+	benchmarkSprite = sprite;
+	UpdateDrawingList();
+}
+
 void PlayfieldView::ScaleSprites()
 {
 	// The instruction card and flyer popups scale to fill 95% of
@@ -11913,6 +14315,98 @@ void PlayfieldView::StartPlayfieldCrossfade()
 	OnBeginMediaSync();
 }
 
+void PlayfieldView::SyncAllViews()
+{
+	Trace::Scope trace("Sync all views", "media");
+
+	// Collect the windows in priority order.  Keep a reference on each,
+	// in case a Javascript event handler closes a custom window while
+	// we're working through the list.
+	auto app = Application::Get();
+	std::vector<RefPtr<SecondaryView>> views;
+	auto Add = [&views](SecondaryView *v) { if (v != nullptr) views.emplace_back(v, RefCounted::DoAddRef); };
+	Add(app->GetBackglassView());
+	Add(app->GetDMDView());
+	Add(app->GetTopperView());
+	Add(app->GetInstCardView());
+	CustomView::ForEachCustomView([&Add](CustomView *cv) { Add(cv); return true; });
+
+	// Set up a batch job for each window that will load new media.  The
+	// batch state is shared with the pool tasks, since a task that we
+	// end up running ourselves might still be sitting in the pool queue
+	// after we return.
+	struct Batch
+	{
+		struct Job
+		{
+			SecondaryView *view = nullptr;
+			SecondaryView::MediaFiles media;
+			volatile LONG claimed = 0;
+		};
+		std::vector<Job> jobs;
+		volatile LONG remaining = 0;
+		HandleHolder hDone;
+	};
+	auto batch = std::make_shared<Batch>();
+	batch->jobs.resize(views.size());
+	size_t nJobs = 0;
+	for (auto &v : views)
+	{
+		if (GameListItem *game = v->GetGameToSync(); game != nullptr)
+		{
+			auto &job = batch->jobs[nJobs++];
+			job.view = v;
+			job.media.game = game;
+		}
+	}
+
+	// Resolve the media for all of the windows as a batch.  Queue each job
+	// on the loader pool at high priority, and then work through the list
+	// ourselves as well, so that we don't sit idle if the pool is busy.
+	// Whichever thread claims a job first runs it.
+	if (nJobs != 0)
+	{
+		batch->remaining = static_cast<LONG>(nJobs);
+		batch->hDone = CreateEvent(NULL, TRUE, FALSE, NULL);
+		auto Run = [](Batch *b, Batch::Job &job)
+		{
+			if (InterlockedExchange(&job.claimed, 1) == 0)
+			{
+				job.view->ResolveMediaFiles(job.media);
+				if (InterlockedDecrement(&b->remaining) == 0 && b->hDone != NULL)
+					SetEvent(b->hDone);
+			}
+		};
+		for (size_t i = 1; i < nJobs; ++i)
+			LoaderPool::Submit([batch, i, Run]() { Run(batch.get(), batch->jobs[i]); }, LoaderPool::Priority::High);
+		for (size_t i = 0; i < nJobs; ++i)
+			Run(batch.get(), batch->jobs[i]);
+
+		// wait for any jobs still running on pool threads
+		if (batch->remaining != 0 && batch->hDone != NULL)
+			WaitForSingleObject(batch->hDone, INFINITE);
+
+		// hand the media to the windows
+		for (size_t i = 0; i < nJobs; ++i)
+			batch->jobs[i].view->SetResolvedMedia(std::move(batch->jobs[i].media));
+	}
+
+	// Now sync the windows in priority order.  Each window still fires its
+	// own Javascript media sync events, but with its files already in hand.
+	for (auto &v : views)
+	{
+		v->SyncCurrentGame();
+
+		// sync the real DMD, if we're using one, along with the DMD window
+		if (v == app->GetDMDView() && realDMD != nullptr)
+			realDMD->UpdateGame();
+	}
+
+	// sync the real DMD even if there's no DMD window
+	if (app->GetDMDView() == nullptr && realDMD != nullptr)
+		realDMD->UpdateGame();
+}
+
 void PlayfieldView::OnBeginMediaSync()
 {
 	// if we're in simultaneous sync mode, sync the other windows immediately
@@ -11934,18 +14428,21 @@ void PlayfieldView::OnBeginMediaSync()
 }
 
 // Start the animation timer if it's not already running
-const DWORD AnimTimerInterval = 8;
 void PlayfieldView::StartAnimTimer(DWORD &startTime)
 {
 	// start the animation timer if it's not already running
 	StartAnimTimer();
 
 	// note the starting time for the animation mode
-	startTime = GetTickCount();
+	startTime = AnimClock::Now();
 }
 
 void PlayfieldView::StartAnimTimer()
 {
+	// ask the render loop for per-frame animation updates
+	StartAnimationFrames();
+
+	// start the fallback timer
 	if (!isAnimTimerRunning)
 	{
 		SetTimer(hWnd, animTimerID, AnimTimerInterval, 0);
@@ -11953,6 +14450,18 @@ void PlayfieldView::StartAnimTimer()
 	}
 }
 
+bool PlayfieldView::OnAnimationFrame()
+{
+	// step the main animation and the info box fade at the frame time
+	if (isAnimTimerRunning)
+		UpdateAnimation();
+	if (infoBoxFading)
+		UpdateInfoBoxAnimation();
+
+	// keep the frame updates coming as long as either is still running
+	return isAnimTimerRunning || infoBoxFading;
+}
+
 void PlayfieldView::UpdateInfoBox()
 {
 	// start the timer to check for an update
@@ -12150,9 +14659,11 @@ void PlayfieldView::SyncInfoBox()
 			MemoryDC memdc;
 			Draw(memdc, NULL);
 			
-			// create the new sprite
+			// create the new sprite, or redraw the old one if one is still
+			// showing (it's usually the same size, so it can keep its texture)
 			Application::InUiErrorHandler eh;
-			infoBox.sprite.Attach(new Sprite());
+			if (infoBox.sprite == nullptr)
+				infoBox.sprite.Attach(new Sprite());
 			infoBox.sprite->Load(width, height, Draw, eh, _T("Info Box"));
 
 			// move it up towards the top of the screen
@@ -12161,8 +14672,7 @@ void PlayfieldView::SyncInfoBox()
 
 			// start the fade-in animation
 			infoBox.sprite->alpha = 0;
-			SetTimer(hWnd, infoBoxFadeTimerID, AnimTimerInterval, 0);
-			infoBoxStartTime = GetTickCount();
+			StartInfoBoxFade();
 		}
 		else
 		{
@@ -12179,8 +14689,7 @@ void PlayfieldView::SyncInfoBox()
 	else if (infoBox.sprite != nullptr && infoBox.sprite->alpha == 0.0f)
 	{
 		// start the fade
-		SetTimer(hWnd, infoBoxFadeTimerID, AnimTimerInterval, 0);
-		infoBoxStartTime = GetTickCount();
+		StartInfoBoxFade();
 	}
 
 	// we've completed the update, so remove the sync timer
@@ -12192,38 +14701,48 @@ void PlayfieldView::HideInfoBox()
 	if (infoBox.sprite != 0)
 	{
 		infoBox.sprite->alpha = 0;
-		KillTimer(hWnd, infoBoxFadeTimerID);
+		EndInfoBoxFade();
 		KillTimer(hWnd, infoBoxSyncTimerID);
 	}
 }
 
+void PlayfieldView::StartInfoBoxFade()
+{
+	// note the start time, and ask the render loop for frame updates
+	infoBoxStartTime = AnimClock::Now();
+	infoBoxFading = true;
+	StartAnimationFrames();
+
+	// start the fallback timer
+	SetTimer(hWnd, infoBoxFadeTimerID, AnimTimerInterval, 0);
+}
+
+void PlayfieldView::EndInfoBoxFade()
+{
+	infoBoxFading = false;
+	KillTimer(hWnd, infoBoxFadeTimerID);
+}
+
 // update the info box animation
 void PlayfieldView::UpdateInfoBoxAnimation()
 {
-	static DWORD lastTimer;
-	DWORD thisTimer = GetTickCount();
-	lastTimer = thisTimer;
-
 	// make sure there's an info box to update
 	if (infoBox.sprite == nullptr)
 	{
-		KillTimer(hWnd, infoBoxFadeTimerID);
+		EndInfoBoxFade();
 		return;
 	}
 
 	// figure the progress
 	const float infoBoxAnimTime = 250.0f;
-	float progress = fminf(1.0f, float(GetTickCount() - infoBoxStartTime) / infoBoxAnimTime);
+	float progress = fminf(1.0f, float(AnimClock::Now() - infoBoxStartTime) / infoBoxAnimTime);
 
 	// update the fade
 	infoBox.sprite->alpha = progress;
 
 	// end the animation if we've reached the end of the fade
 	if (progress == 1.0f)
-	{
-		lastTimer = 0;
-		KillTimer(hWnd, infoBoxFadeTimerID);
-	}
+		EndInfoBoxFade();
 }
 
 bool PlayfieldView::LoadSystemLogo(Gdiplus::Image* &image, const GameSystem *system)
@@ -12274,38 +14793,56 @@ bool PlayfieldView::GetSystemLogo(TSTRING &result, const GameSystem *system)
 	// This allows matching a generic "Visual Pinball.png" file
 	// to "Visual Pinball 9.2" and other similar versioned system
 	// names.
-	WSTRING prefixMatch;
+	TSTRING prefixMatch;
 
-	// scan files in the media folder
-	namespace fs = std::filesystem;
-	std::error_code ec;
-	for (auto &f : fs::directory_iterator(folder, ec))
+	// check a file in the folder
+	bool exactMatch = false;
+	auto Check = [&folder, system, &result, &prefixMatch, &exactMatch](const TCHAR *name)
 	{
-		// only consider ordinary files with appropriate image extensions
-		static const std::basic_regex<WCHAR> extPat(_T("(.*)\\.(png)"), std::regex_constants::icase);
-		std::match_results<std::wstring::const_iterator> m;
-		WSTRING path = f.path().filename().wstring();
-		if (f.status().type() == fs::file_type::regular
-			&& std::regex_match(path, m, extPat))
-		{
-			// check for an exact match
-			TSTRING basename = WSTRINGToTSTRING(m[1].str());
-			if (_tcsicmp(basename.c_str(), system->displayName.c_str()) == 0)
-			{
-				result = WideToTSTRING(f.path().c_str());
-				return true;
-			}
+		// only consider files with appropriate image extensions
+		static const std::basic_regex<TCHAR> extPat(_T("(.*)\\.(png)"), std::regex_constants::icase);
+		std::match_results<const TCHAR*> m;
+		if (exactMatch || !std::regex_match(name, m, extPat))
+			return;
 
-			// check for a prefix match
-			if (tstriStartsWith(system->displayName.c_str(), basename.c_str()))
-				prefixMatch = f.path().c_str();
+		// check for an exact match
+		TCHAR path[MAX_PATH];
+		PathCombine(path, folder, name);
+		TSTRING basename = m[1].str();
+		if (_tcsicmp(basename.c_str(), system->displayName.c_str()) == 0)
+		{
+			result = path;
+			exactMatch = true;
+			return;
+		}
+
+		// check for a prefix match
+		if (tstriStartsWith(system->displayName.c_str(), basename.c_str()))
+			prefixMatch = path;
+	};
+
+	// Scan the files in the media folder.  Use the media file index if
+	// possible, so that we only have to read the folder once; if the
+	// index is disabled, scan the folder directly.
+	if (!MediaFileIndex::EnumFiles(folder, Check))
+	{
+		namespace fs = std::filesystem;
+		std::error_code ec;
+		for (auto &f : fs::directory_iterator(folder, ec))
+		{
+			if (f.status().type() == fs::file_type::regular)
+				Check(WSTRINGToTSTRING(f.path().filename().wstring()).c_str());
 		}
 	}
 
+	// use the exact match if we found one
+	if (exactMatch)
+		return true;
+
 	// no exact match found; if we found a prefix match, use that
 	if (prefixMatch.length() != 0)
 	{
-		result = WSTRINGToTSTRING(prefixMatch);
+		result = prefixMatch;
 		return true;
 	}
 
@@ -12647,7 +15184,7 @@ void PlayfieldView::UpdateAnimation()
 	if (popupAnimMode != PopupAnimNone && popupSprite != nullptr)
 	{
 		// figure the elapsed time
-		DWORD dt = GetTickCount() - popupAnimStartTime;
+		DWORD dt = AnimClock::Now() - popupAnimStartTime;
 
 		// check the mode
 		if (popupAnimMode == PopupAnimOpen)
@@ -12699,7 +15236,7 @@ void PlayfieldView::UpdateAnimation()
 	if (runningGamePopupMode != RunningGamePopupNone && runningGameMsgPopup != nullptr)
 	{
 		// update the fade
-		DWORD dt = GetTickCount() - runningGamePopupStartTime;
+		DWORD dt = AnimClock::Now() - runningGamePopupStartTime;
 		float progress = fminf(1.0f, float(dt) / float(popupOpenTime));
 		float alpha = (runningGamePopupMode == RunningGamePopupOpen ? progress : 1.0f - progress);
 		runningGameMsgPopup->alpha = alpha;
@@ -12714,7 +15251,22 @@ void PlayfieldView::UpdateAnimation()
 			switch (runningGamePopupMode)
 			{
 			case RunningGamePopupOpen:
-				// opening - nothing to do
+				// Opening.  If the overlay is the default opaque fill, it now
+				// hides the playfield media completely, so there's no reason
+				// to keep decoding the playfield video behind it while the
+				// game loads.  Release it now, rather than waiting for run
+				// freeze mode, if the launch policy says so.  We'll reload
+				// the playfield when the game exits.
+				if (launchReleaseVideos && runningGameBkgIsDefault && runningGameMode == RunningGameMode::Starting)
+				{
+					auto IsVideo = [](const GameMedia<VideoSprite> &m) { return m.sprite != nullptr && m.sprite->IsVideo(); };
+					if (IsVideo(currentPlayfield) || IsVideo(incomingPlayfield))
+					{
+						currentPlayfield.Clear();
+						incomingPlayfield.Clear();
+						updateDrawingList = true;
+					}
+				}
 				break;
 
 			case RunningGamePopupClose:
@@ -12739,7 +15291,7 @@ void PlayfieldView::UpdateAnimation()
 	if (wheelAnimMode != WheelAnimNone && animAddedToWheel != 0)
 	{
 		// note the time since the animation started
-		DWORD dt = GetTickCount() - wheelAnimStartTime;
+		DWORD dt = AnimClock::Now() - wheelAnimStartTime;
 
 		// note the direction we're going
 		int dn = animWheelDistance > 0 ? 1 : -1;
@@ -12782,7 +15334,7 @@ void PlayfieldView::UpdateAnimation()
 	if (menuAnimMode != MenuAnimNone)
 	{
 		// note the time
-		DWORD dt = GetTickCount() - menuAnimStartTime;
+		DWORD dt = AnimClock::Now() - menuAnimStartTime;
 
 		// check the mode
 		if (menuAnimMode == MenuAnimOpen)
@@ -13043,10 +15595,10 @@ bool PlayfieldView::OnRawInputEvent(UINT rawInputCode, RAWINPUT *raw, DWORD dwSi
 			if (FireKeyEvent(vkey, down, rawInputRepeat.repeatCount, true))
 			{
 				// look up the command; if we find a match, process the key press
-				if (auto it = vkeyToCommand.find(vkey); it != vkeyToCommand.end())
+				if (auto cmds = GetVkeyCommands(vkey); cmds != nullptr)
 				{
 					// process the key press
-					ProcessKeyPress(hWnd, keyType, rawInputRepeat.repeatCount, true, false, it->second);
+					ProcessKeyPress(hWnd, keyType, rawInputRepeat.repeatCount, true, false, *cmds);
 				}
 			}
 		}
@@ -13078,10 +15630,10 @@ bool PlayfieldView::OnJoystickButtonChange(
 		return false;
 
 	// look up the button in the command table
-	if (auto it = jsCommands.find(JsCommandKey(js->logjs->index, button)); it != jsCommands.end())
+	if (auto cmds = GetJsCommands(js->logjs->index, button); cmds != nullptr)
 	{
 		// process the key press
-		ProcessKeyPress(hWnd, mode, 0, !foreground, false, it->second);
+		ProcessKeyPress(hWnd, mode, 0, !foreground, false, *cmds);
 
 		// if it's a key-press event, start auto-repeat; otherwise cancel
 		// any existing auto-repeat
@@ -13169,9 +15721,9 @@ void PlayfieldView::OnKbAutoRepeatTimer()
 			if (FireKeyEvent(kbAutoRepeat.vkey, true, kbAutoRepeat.repeatCount, kbAutoRepeat.repeatMode == KeyBgRepeat))
 			{
 				// look up the button in the command table
-				if (auto it = vkeyToCommand.find(kbAutoRepeat.vkey); it != vkeyToCommand.end())
+				if (auto cmds = GetVkeyCommands(kbAutoRepeat.vkey); cmds != nullptr)
 					ProcessKeyPress(hWnd, kbAutoRepeat.repeatMode, kbAutoRepeat.repeatCount, 
-						kbAutoRepeat.repeatMode == KeyBgRepeat, false, it->second);
+						kbAutoRepeat.repeatMode == KeyBgRepeat, false, *cmds);
 			}
 		}
 
@@ -13217,9 +15769,9 @@ void PlayfieldView::OnJoyAutoRepeatTimer()
 				joyAutoRepeat.repeatCount, joyAutoRepeat.repeatMode == KeyBgRepeat))
 			{
 				// look up the button in the command table
-				if (auto it = jsCommands.find(JsCommandKey(joyAutoRepeat.unit, joyAutoRepeat.button)); it != jsCommands.end())
+				if (auto cmds = GetJsCommands(joyAutoRepeat.unit, joyAutoRepeat.button); cmds != nullptr)
 					ProcessKeyPress(hWnd, joyAutoRepeat.repeatMode, joyAutoRepeat.repeatCount,
-						joyAutoRepeat.repeatMode == KeyBgRepeat, false, it->second);
+						joyAutoRepeat.repeatMode == KeyBgRepeat, false, *cmds);
 			}
 		}
 
@@ -13321,6 +15873,45 @@ void PlayfieldView::OnWheelAutoRepeatTimer()
 	(this->*wheelAutoRepeat.key.cmd->func)(wheelAutoRepeat.key);
 }
 
+int PlayfieldView::CoalesceWheelSteps(const QueuedKey &key)
+{
+	// If the wheel auto-repeat is already running for this command,
+	// the device repeats in the queue are going to be ignored anyway,
+	// and the timer takes care of looking ahead for the Key Up, so
+	// leave the queue alone.
+	if (wheelAutoRepeat.active && wheelAutoRepeat.key.cmd->func == key.cmd->func)
+		return 1;
+
+	// Find the run of queued events for the same command.  Only take
+	// the run through its last Key Down or Repeat event: a trailing
+	// Key Up has to stay in the queue, so that it's still there to
+	// stop the wheel auto-repeat that the caller is about to start.
+	auto IsStep = [](const QueuedKey &k) { return k.mode == KeyDown || k.mode == KeyRepeat; };
+	size_t runLength = 0, i = 0;
+	for (auto it = keyQueue.begin(); it != keyQueue.end() && it->cmd->func == key.cmd->func
+		&& (IsStep(*it) || it->mode == KeyUp); ++it, ++i)
+	{
+		if (IsStep(*it))
+			runLength = i + 1;
+	}
+
+	// Consume the run.  Each new Key Down counts as a step; the device
+	// repeats count for nothing, since the wheel auto-repeat timer
+	// replaces them, the same as in ProcessKeyQueue().  We still give
+	// scripts their command button events for each key, and a step
+	// that a script cancels isn't counted.
+	int steps = 1;
+	for (; runLength != 0 && keyQueue.size() != 0; --runLength)
+	{
+		QueuedKey k = keyQueue.front();
+		keyQueue.pop_front();
+		if ((k.scripted || FireCommandButtonEvent(k)) && k.mode == KeyDown)
+			++steps;
+	}
+
+	return steps;
+}
+
 void PlayfieldView::JsSetWheelAutoRepeatRate(int ms)
 {
 	// This is only effective when auto-repeat is running
@@ -13431,19 +16022,36 @@ int PlayfieldView::GetCaptureManualGoButtonNameResId() const
 	return IDS_CAPSTAT_BTN_FLIPPERS;
 }
 
-void PlayfieldView::OnConfigChange()
+void PlayfieldView::OnConfigChange(const ConfigManager::ChangeSet &changes)
 {
 	ConfigManager *cfg = ConfigManager::GetInstance();
 
 	// get the playfield stretch mode
 	stretchPlayfield = cfg->GetBool(ConfigVars::PlayfieldStretch, false);
 
+	// the pre-rendered popups and cached menus depend on the fonts and
+	// colors, so start over
+	popupCache.Clear();
+	menuCache.clear();
+
+	// the wheel font and title colors affect the cached wheel icons
+	if (changes.Has(ConfigVars::DefaultFontFamily) || changes.Has(ConfigVars::WheelFont)
+		|| changes.Has(ConfigVars::WheelTitleColor) || changes.Has(ConfigVars::WheelTitleShadowColor))
+		wheelImageCache.clear();
+
+	// get the neighbor prefetch count, and drop any entries beyond it
+	playfieldPrefetchCount = Application::IsLowMemoryMode() ? 0 : max(0, cfg->GetInt(ConfigVars::PlayfieldPrefetch, 1));
+	playfieldPrefetch.clear();
+
 	// load the attract mode settings
 	attractMode.enabled = cfg->GetBool(ConfigVars::AttractModeEnabled, true);
 	attractMode.idleTime = cfg->GetInt(ConfigVars::AttractModeIdleTime, 60) * 1000;
 	attractMode.switchTime = cfg->GetInt(ConfigVars::AttractModeSwitchTime, 5) * 1000;
 	attractMode.hideWheelImages = cfg->GetBool(ConfigVars::AttractModeHideWheelImages, true);
 	attractMode.hideInfoBox = cfg->GetBool(ConfigVars::AttractModeHideInfoBox, true);
+	attractMode.lowPowerFrameRate = max(0, cfg->GetInt(ConfigVars::AttractModeLowPowerFrameRate, 0));
+	if (!attractMode.IsLowPower())
+		D3DView::SetLowPowerFrameRate(0);
 
 	// Get the default font.  If it's undefined or "*", use the system default.
 	if (auto df = cfg->Get(ConfigVars::DefaultFontFamily, _T("*")); _tcscmp(df, _T("*")) != 0)
@@ -13496,8 +16104,12 @@ void PlayfieldView::OnConfigChange()
 	// load the media capture mode defaults
 	RestoreLastCaptureModes();
 
-	// reload the status lines
-	InitStatusLines();
+	// reload the status lines, if any of their settings changed
+	if (changes.Has(ConfigVars::DefaultFontFamily) || changes.Has(ConfigVars::StatusFont)
+		|| changes.Has(ConfigVars::StatusLineTextColor) || changes.Has(ConfigVars::StatusLineShadowColor)
+		|| changes.HasPrefix(_T("StatusLine.")) || changes.HasPrefix(_T("UpperStatus."))
+		|| changes.HasPrefix(_T("LowerStatus.")) || changes.HasPrefix(_T("AttractMode.StatusLine")))
+		InitStatusLines();
 
 	// load the game timeout setting
 	gameTimeout = cfg->GetInt(ConfigVars::GameTimeout, 0) * 1000;
@@ -13545,6 +16157,13 @@ void PlayfieldView::OnConfigChange()
 	// topmost during launch?
 	isTopmostDuringLaunch = cfg->GetBool(ConfigVars::TopmostDuringGameLaunch, false);
 
+	// release resources to the game while it's running?
+	yieldResourcesToGame = cfg->GetBool(ConfigVars::YieldResourcesToGame, false);
+
+	// game launch overlap policy
+	launchOverlap = cfg->GetBool(ConfigVars::GameLaunchOverlap, true);
+	launchReleaseVideos = cfg->GetBool(ConfigVars::GameLaunchReleaseVideos, true);
+
 	// Wheel layout parameters.  Coordinates are in D3D space, where
 	// the middle of the window is (0,0) and the top left is (-.5,+.5).
 	// The wheel is drawn as a circle with center (window horizontal
@@ -13641,6 +16260,11 @@ void PlayfieldView::OnConfigChange()
 	muteAutoRepeatButtons = cfg->GetBool(ConfigVars::MuteAutoRepeatButtons, false);
 	buttonVolume = cfg->GetInt(ConfigVars::ButtonVolume, 100);
 
+	// the media folders might have changed, so look up the button sound
+	// files again
+	buttonSoundPaths.clear();
+	PreloadButtonSounds();
+
 	// load the capture Manual Go button setting
 	const TCHAR *capbtns = cfg->Get(ConfigVars::CaptureManualStartStopButtons, _T("flippers"));
 	captureManualGoButton = CaptureManualGoButton::Flippers;
@@ -13678,7 +16302,8 @@ void PlayfieldView::OnConfigChange()
 
 	// Clear the keyboard and joystick command tables so we can 
 	// rebuild them
-	vkeyToCommand.clear();
+	for (auto &l : vkeyToCommand)
+		l.clear();
 	jsCommands.clear();
 
 	// clear the key list for each command
@@ -13816,29 +16441,26 @@ void PlayfieldView::OnConfigChange()
 
 void PlayfieldView::AddJsCommand(int unit, int button, const KeyCommand &cmd)
 {
-	// look up the unit:button key in the command table
-	int key = JsCommandKey(unit, button);
-	auto it = jsCommands.find(key);
+	// ignore buttons outside of the table range
+	if (unit < 0 || button < 0 || button >= nJsButtonCommands)
+		return;
 
-	// if it's not in the table already, emplace it
-	if (it == jsCommands.end())
-		it = jsCommands.emplace(std::piecewise_construct, std::forward_as_tuple(key), std::forward_as_tuple()).first;
+	// add the unit's button array if we don't have one yet
+	if (unit >= static_cast<int>(jsCommands.size()))
+		jsCommands.resize(unit + 1);
+	if (jsCommands[unit] == nullptr)
+		jsCommands[unit].reset(new CommandList[nJsButtonCommands]);
 
-	// now add the function to the list of associated functions
-	it->second.emplace_back(&cmd);
+	// add the function to the list of associated functions
+	jsCommands[unit][button].emplace_back(&cmd);
 }
 
 void PlayfieldView::AddVkeyCommand(int vkey, const KeyCommand &cmd)
 {
-	// look up the vkey in the command table
-	auto it = vkeyToCommand.find(vkey);
-
-	// if it's not in the table already, emplace it
-	if (it == vkeyToCommand.end())
-		it = vkeyToCommand.emplace(std::piecewise_construct, std::forward_as_tuple(vkey), std::forward_as_tuple()).first;
-
-	// now add the function to the list of associated functions
-	it->second.emplace_back(&cmd);
+	// add the function to the key's list of associated functions, if
+	// it's a valid key code
+	if (vkey >= 0 && vkey < nVkeyCommands)
+		vkeyToCommand[vkey].emplace_back(&cmd);
 }
 
 void PlayfieldView::OnJoystickAdded(JoystickManager::PhysicalJoystick *js, bool logicalIsNew)
@@ -13860,7 +16482,7 @@ void PlayfieldView::OnJoystickAdded(JoystickManager::PhysicalJoystick *js, bool
 				&& btn.devType == InputManager::Button::TypeJS
 				&& (btn.unit == js->logjs->index || btn.unit == -1))
 			{
-				AddJsCommand(btn.unit, btn.code, keyCmd);
+				AddJsCommand(js->logjs->index, btn.code, keyCmd);
 			}
 		});
 	}
@@ -14045,7 +16667,10 @@ void PlayfieldView::DoSelect(bool usingExitKey)
 			GameList *gl = GameList::Get();
 			GameListItem *game = gl->GetNthGame(0);
 			if (IsGameValid(game))
+			{
 				gl->SetRating(game, workingRating);
+				gl->CommitStatsJournal();
+			}
 
 			// use the "select" sound effect to indicate success
 			sound = _T("Select");
@@ -14413,7 +17038,7 @@ void PlayfieldView::CmdExit(const QueuedKey &key)
 			// treat this as a Select button, to show the game control menu
 			CmdSelect(key);
 		}
-		else if (ConfigManager::GetInstance()->GetBool(ConfigVars::ExitMenuEnabled, true))
+		else if (ConfigVarHandles::ExitMenuEnabled.Get())
 		{
 			// nothing's showing - bring up the Exit menu
 			OnCommand(ID_SHOW_EXIT_MENU, 0, NULL);
@@ -14428,7 +17053,7 @@ void PlayfieldView::ShowExitMenu()
 	md.emplace_back(LoadStringT(IDS_MENU_SHUTDOWN), ID_SHUTDOWN);
 
 	// add the Operator Meu command if desired
-	if (ConfigManager::GetInstance()->GetBool(ConfigVars::ShowOpMenuInExitMenu, false))
+	if (ConfigVarHandles::ShowOpMenuInExitMenu.Get())
 	{
 		md.emplace_back(_T(""), -1);
 		md.emplace_back(LoadStringT(IDS_MENU_OPERATOR), ID_OPERATOR_MENU);
@@ -14456,12 +17081,48 @@ void PlayfieldView::PlayButtonSound(const TCHAR *effectName, float volume)
 	if (!muteButtons)
 	{
 		// look up the effect file
-		TCHAR path[MAX_PATH];
-		if (auto gl = GameList::Get(); gl != nullptr && gl->FindGlobalWaveFile(path, _T("Button Sounds"), effectName))
+		if (const TSTRING &path = GetButtonSoundPath(effectName); path.length() != 0)
 		{
 			// play back the file, combining the caller's volume level and the global
 			// button volume setting
-			AudioManager::Get()->PlayFile(path, volume*buttonVolume / 100);
+			AudioManager::Get()->PlayFile(path.c_str(), volume*buttonVolume / 100);
+		}
+	}
+}
+
+const TSTRING &PlayfieldView::GetButtonSoundPath(const TCHAR *effectName)
+{
+	// use the cached result if we've looked this one up before
+	if (auto it = buttonSoundPaths.find(effectName); it != buttonSoundPaths.end())
+		return it->second;
+
+	// Search for the file.  If there's no game list yet, we can't tell
+	// where the media folders are, so don't cache the negative result.
+	static const TSTRING none;
+	auto gl = GameList::Get();
+	if (gl == nullptr)
+		return none;
+
+	TCHAR path[MAX_PATH];
+	bool found = gl->FindGlobalWaveFile(path, _T("Button Sounds"), effectName);
+	return buttonSoundPaths.emplace(effectName, found ? path : _T("")).first->second;
+}
+
+void PlayfieldView::PreloadButtonSounds()
+{
+	// the standard button and event sounds
+	static const TCHAR *const names[] = {
+		_T("Select"), _T("Deselect"), _T("Next"), _T("Prev"),
+		_T("Launch"), _T("AddCredit"), _T("CoinIn")
+	};
+
+	// look up each file and load it
+	if (auto am = AudioManager::Get(); am != nullptr && GameList::Get() != nullptr)
+	{
+		for (auto name : names)
+		{
+			if (const TSTRING &path = GetButtonSoundPath(name); path.length() != 0)
+				am->Preload(path.c_str());
 		}
 	}
 }
@@ -14601,9 +17262,11 @@ void PlayfieldView::DoCmdNext(const QueuedKey &key)
 	}
 	else
 	{
-		// Base mode - go to the next game
+		// Base mode - go to the next game, along with any further
+		// Next presses that backed up in the queue
+		int steps = CoalesceWheelSteps(key);
 		QueueDOFPulse(L"PBYWheelNext");
-		SwitchToGame(1, key.mode == KeyRepeat, true, true);
+		SwitchToGame(steps, key.mode == KeyRepeat || steps > 1, true, true);
 
 		// start wheel auto-repeat if it's not already running
 		repeatModeSentry.keep = true;
@@ -14739,9 +17402,11 @@ void PlayfieldView::DoCmdPrev(const QueuedKey &key)
 	}
 	else
 	{
-		// base mode - go to the previous game
+		// base mode - go to the previous game, along with any further
+		// Prev presses that backed up in the queue
+		int steps = CoalesceWheelSteps(key);
 		QueueDOFPulse(L"PBYWheelPrev");
-		SwitchToGame(-1, key.mode == KeyRepeat, true, true);
+		SwitchToGame(-steps, key.mode == KeyRepeat || steps > 1, true, true);
 
 		// start wheel auto-repeat if it's not already running
 		repeatModeSentry.keep = true;
@@ -15312,7 +17977,7 @@ void PlayfieldView::ShowOperatorMenu()
 	md.emplace_back(_T(""), -1);
 
 	// if the Exit menu is disabled, show the Exit options
-	if (!ConfigManager::GetInstance()->GetBool(ConfigVars::ExitMenuEnabled, true))
+	if (!ConfigVarHandles::ExitMenuEnabled.Get())
 	{
 		md.emplace_back(LoadStringT(IDS_MENU_EXIT), ID_EXIT);
 		md.emplace_back(LoadStringT(IDS_MENU_SHUTDOWN), ID_SHUTDOWN);
@@ -15349,7 +18014,7 @@ void PlayfieldView::ShowGameSetupMenu()
 
 	// basic game commands - edit, delete, categories
 	md.emplace_back(LoadStringT(IDS_MENU_EDIT_GAME_INFO), ID_EDIT_GAME_INFO);
-	if (game->gameXmlNode != nullptr)
+	if (game->HasXmlNode())
 		md.emplace_back(LoadStringT(IDS_MENU_DEL_GAME_INFO), ID_DEL_GAME_INFO);
 	md.emplace_back(LoadStringT(IDS_MENU_HIDE_GAME), ID_HIDE_GAME,
 		gl->IsHidden(game) || game->IsHidden() ? MenuChecked : 0);
@@ -15360,7 +18025,7 @@ void PlayfieldView::ShowGameSetupMenu()
 	md.emplace_back(LoadStringT(IDS_MENU_CAPTURE_MEDIA), ID_CAPTURE_MEDIA);
 
 	// include batch capture only if the game has been configured
-	if (game->gameXmlNode != nullptr)
+	if (game->HasXmlNode())
 	{
 		if (gl->IsMarkedForCapture(game))
 			md.emplace_back(LoadStringT(IDS_MENU_MARKED_BATCH), ID_MARK_FOR_BATCH_CAPTURE, MenuChecked);
@@ -16003,6 +18668,9 @@ void PlayfieldView::EditGameInfo()
 			GetText(IDC_CB_MANUF, manuf);
 			game->manufacturer = gl->FindOrAddManufacturer(manuf.c_str());
 
+			// re-file the game in the year and manufacturer indexes
+			gl->UpdateAttrIndex(game);
+
 			// Update the Date Added
 			TSTRING dateAddedStr;
 			GetText(IDC_TXT_DATE_ADDED, dateAddedStr);
@@ -16013,7 +18681,7 @@ void PlayfieldView::EditGameInfo()
 			// Update the grid position
 			TSTRING gridPos;
 			GetText(IDC_CB_GRIDPOS, gridPos);
-			std::basic_regex<TCHAR> gridPat(_T("\\s*(\\d+)\\s*x\\s*(\\d+)\\s*"), std::regex_constants::icase);
+			static const std::basic_regex<TCHAR> gridPat(_T("\\s*(\\d+)\\s*x\\s*(\\d+)\\s*"), std::regex_constants::icase);
 			std::match_results<TSTRING::const_iterator> m;
 			if (std::regex_match(gridPos, m, gridPat))
 			{
@@ -16067,6 +18735,7 @@ void PlayfieldView::EditGameInfo()
 
 			// Check for media item renaming
 			std::list<std::pair<TSTRING, TSTRING>> mediaRenameList;
+			TSTRING oldMediaName = game->mediaName;
 			bool mediaNameChanged = game->UpdateMediaName(&mediaRenameList, newMediaName.c_str());
 			bool mediaFilesRenamed = false;
 			if (mediaNameChanged && mediaRenameList.size() != 0)
@@ -16075,15 +18744,11 @@ void PlayfieldView::EditGameInfo()
 				if (MessageBox(hDlg, LoadStringT(IDS_RENAME_MEDIA_PROMPT).c_str(),
 					LoadStringT(IDS_APP_TITLE), MB_YESNO | MB_ICONQUESTION) == IDYES)
 				{
-					// yes - do the renaming
+					// Yes - do the renaming.  This runs in the background;
+					// if it fails, the playfield view reports the errors and
+					// restores the old media name.
 					mediaFilesRenamed = true;
-					CapturingErrorHandler ceh;
-					if (!pfv->ApplyGameChangesRenameMediaFiles(game, mediaRenameList, ceh))
-					{
-						// one or more renaming errors occurred - report them as a group
-						InteractiveErrorHandler ieh;
-						ieh.GroupError(ErrorIconType::EIT_Error, LoadStringT(IDS_ERR_RENAME_MEDIA).c_str(), ceh);
-					}
+					pfv->ApplyGameChangesRenameMediaFilesAsync(game, oldMediaName.c_str(), mediaRenameList);
 				}
 			}
 
@@ -16207,7 +18872,7 @@ void PlayfieldView::EditGameInfo()
 			if (Application::Get()->highScores->GetAllNvramFiles(nvList, title))
 			{
 				// Add each .nv file in the list
-				std::basic_regex<TCHAR> nvPat(_T("\\.nv$"));
+				static const std::basic_regex<TCHAR> nvPat(_T("\\.nv$"));
 				for (auto &nv : nvList)
 				{
 					// The NVRAM files for VPinMAME games are the same as the
@@ -16304,8 +18969,7 @@ void PlayfieldView::EditGameInfo()
 
 			// store the title, with certain special characters removed
 			// (\xAE = "(R)" trademark symbol, \x99 = "TM" symbol)
-			std::basic_regex<TCHAR> stripPat(_T("[\xAE\x99]"));
-			TSTRING title = std::regex_replace(selTable->name, stripPat, _T(""));
+			TSTRING title = StripChars(selTable->name.c_str(), _T("\xAE\x99"));
 			SetDlgItemText(hDlg, IDC_CB_TITLE, title.c_str());
 		}
 
@@ -16565,11 +19229,23 @@ void PlayfieldView::EditGameInfo()
 				// the time to fill in the field properly, it's a much more
 				// reliable way to identify the game than a fuzzy filename
 				// match.
+				//
+				// Check the metadata index first, since that saves opening
+				// the file if the indexer has already read it.
+				VPTableInfoIndex::Info vpInfo;
 				VPFileReader vpr;
 				if (tstriEndsWith(gamePath, _T(".vpt")) || tstriEndsWith(gamePath, _T(".vpx")))
 				{
-					// read the VP file
-					if (SUCCEEDED(vpr.Read(gamePath, false)))
+					// look up the indexed metadata, or read the VP file
+					if (VPTableInfoIndex::Lookup(gamePath, vpInfo))
+					{
+						if (vpInfo.tableName.length() != 0)
+						{
+							nameToMatch = vpInfo.tableName.c_str();
+							isFilename = false;
+						}
+					}
+					else if (SUCCEEDED(vpr.ReadTableInfo(gamePath)))
 					{
 						// We successfully loaded the file.  If there's a "Table
 						// Name" field in the metadata, use that as the name to
@@ -16658,92 +19334,91 @@ bool PlayfieldView::ApplyGameChangesRenameMediaFiles(
 	GameListItem *game,
 	const std::list<std::pair<TSTRING, TSTRING>> &mediaRenameList, ErrorHandler &eh)
 {
-	// presume success
-	bool ok = true;
-
 	// If we're updating files for the current game, clear table 
 	// media from all windows, to minimize the chances of a sharing
 	// conflict that would prevent renaming.
 	if (game == GameList::Get()->GetNthGame(0))
 		Application::Get()->ClearMedia();
 
-	// Set up a unique pointer to the caller's rename list.  Since
-	// the caller owns this memory, our deleter for this pointer does
-	// nothing.  The reason we need the unique_ptr at all is that we
-	// switch curList to a locally allocated retry list if we find
-	// retry items, so we'll need to delete that when it goes out of
-	// scope.
-	using ListType = std::list<std::pair<TSTRING, TSTRING>>;
-	using ListPtr = std::unique_ptr<const ListType, void(*)(const ListType*)>;
-	ListPtr curList(&mediaRenameList, [](auto p) {});
-
-	// Rename files.  Do a few retries for any files with sharing
-	// conflicts, in case the conflict is coming from our own video
-	// or Flash player background threads: we might be able to clear
-	// up any such conflicts by waiting a couple of seconds for the
-	// background locks to clear.
-	const int maxTries = 3;
-	for (int tries = 0; ; ++tries)
+	// do the renames
+	RefPtr<MediaRenamer> renamer(new MediaRenamer(mediaRenameList));
+	return renamer->Run(eh);
+}
+
+void PlayfieldView::ApplyGameChangesRenameMediaFilesAsync(
+	GameListItem *game, const TCHAR *oldMediaName,
+	const std::list<std::pair<TSTRING, TSTRING>> &mediaRenameList)
+{
+	// If a previous rename is still running, let it finish first, so
+	// that the two sets can't interleave.  Report its results now,
+	// since its completion message will find the new renamer instead.
+	if (mediaRenamer != nullptr)
 	{
-		// Create a new list to hold items requiring retries.  This is
-		// a locally allocated object, so its deleter actually deletes it.
-		auto retryList = new ListType();
-		ListPtr retryListPtr(retryList, [](auto p) { delete p; });
+		mediaRenamer->Wait();
+		OnMediaRenameDone();
+	}
 
-		// run through the file list
-		for (auto &f : *curList.get())
-		{
-			// try the rename
-			if (!MoveFile(f.first.c_str(), f.second.c_str()))
-			{
-				// failed - get the error
-				WindowsErrorMessage winErr;
-
-				// If it's a sharing violation, and we haven't retried
-				// too many times already, throw it in the retry list
-				// to try again on the next round.  Otherwise just record
-				// the error and move on.
-				if (tries < maxTries && winErr.GetCode() == ERROR_SHARING_VIOLATION)
-				{
-					// sharing violation - just add it to the retry list in case
-					// it's our own lock for audio/video playback
-					retryList->push_back(f);
-				}
-				else
-				{
-					// other error - log it 
-					eh.Error(MsgFmt(IDS_ERR_MOVEFILE, f.first.c_str(), f.second.c_str(), winErr.Get()));
-					ok = false;
-				}
-			}
-		}
+	// clear media for the current game, to minimize sharing conflicts
+	if (game == GameList::Get()->GetNthGame(0))
+		Application::Get()->ClearMedia();
 
-		// If the retry list is empty, we're done.  Note that we don't
-		// check tries against maxTries here, since it's not necessary:
-		// the retry list won't get populated if we're on the last try.
-		// It's safer (in terms of code correctness) not to do the
-		// redundant check, since that's a good way to cause off-by-one
-		// errors and the like.
-		if (retryList->size() == 0)
-			break;
+	// Set up the renamer.  Remember the game by ID rather than by
+	// pointer, in case the game list is reloaded while we're working.
+	RefPtr<MediaRenamer> renamer(new MediaRenamer(mediaRenameList));
+	renamer->gameID = game->internalID;
+	renamer->oldMediaName = oldMediaName;
 
-		// Pause briefly before the retry, to give whoever's holding
-		// the file lock a chance to finish what they're doing.  The
-		// whole point of the retry is that we might be conflicting
-		// with our own threads, so we shouldn't need to wait long:
-		// we've already removed all of media objects explicitly via
-		// the earlier call to Application::ClearMedia(), so the only
-		// self-locking should be against background threads that
-		// didn't exit instantly.  And we don't want to pause long
-		// enough to freeze the UI noticeably.
-		Sleep(250);
+	// start it in the background; if that fails, do the work here
+	if (renamer->Start(hWnd, PFVMsgMediaRenameDone))
+	{
+		mediaRenamer = renamer;
+		return;
+	}
+
+	CapturingErrorHandler ceh;
+	if (!renamer->Run(ceh))
+	{
+		InteractiveErrorHandler ieh;
+		ieh.GroupError(ErrorIconType::EIT_Error, LoadStringT(IDS_ERR_RENAME_MEDIA).c_str(), ceh);
+	}
+}
+
+void PlayfieldView::OnMediaRenameDone()
+{
+	// make sure there's a renamer, and that it's actually finished
+	if (mediaRenamer == nullptr || !mediaRenamer->IsDone())
+		return;
+
+	// take ownership of the renamer
+	RefPtr<MediaRenamer> renamer(mediaRenamer.Detach());
+
+	// get the results
+	const CapturingErrorHandler *errors;
+	bool rolledBack;
+	if (!renamer->GetResults(errors, rolledBack))
+	{
+		// If the files were all restored to their old names, restore
+		// the game's media name to match, so that the game stays with
+		// its media.  Otherwise, some files are under each name, so
+		// there's no right answer; leave the new name in place.
+		auto game = GameList::Get()->GetByInternalID(renamer->gameID);
+		if (rolledBack && game != nullptr)
+		{
+			game->UpdateMediaName(nullptr, renamer->oldMediaName.c_str());
+			ApplyGameChangesToDatabase(game);
+			SetTimer(hWnd, fullRefreshTimerID, 0, NULL);
+		}
 
-		// replace the work list with the retry list
-		curList.swap(retryListPtr);
+		// report the errors
+		InteractiveErrorHandler ieh;
+		ieh.GroupError(ErrorIconType::EIT_Error,
+			LoadStringT(rolledBack ? IDS_ERR_RENAME_MEDIA_ROLLED_BACK : IDS_ERR_RENAME_MEDIA).c_str(), *errors);
 	}
 
-	// return the status
-	return ok;
+	// reload the media, to pick up the files under their final names
+	if (auto game = GameList::Get()->GetNthGame(0); game != nullptr && game->internalID == renamer->gameID)
+		Application::Get()->ClearMedia();
+	UpdateSelection(false);
 }
 
 void PlayfieldView::ApplyGameChangesToDatabase(GameListItem *game)
@@ -16753,6 +19428,9 @@ void PlayfieldView::ApplyGameChangesToDatabase(GameListItem *game)
 	gl->FlushToXml(game);
 	gl->FlushGameIdChange(game);
 
+	// discard the game's cached Javascript GameInfo object
+	InvalidateJsGameInfo(game);
+
 	// re-sort the title list
 	gl->SortTitleIndex();
 
@@ -17657,6 +20335,9 @@ void PlayfieldView::DelMediaFile()
 		// try deleting the file
 		if (DeleteFile(showMedia.file.c_str()))
 		{
+			// make sure the media file index sees the deletion right away
+			MediaFileIndex::Invalidate(showMedia.file.c_str());
+
 			// success - sync media and re-show the media menu
 			SyncPlayfield(SyncDelMedia);
 			UpdateSelection(false);
@@ -17709,7 +20390,7 @@ bool PlayfieldView::CanAddMedia(GameListItem *game)
 void PlayfieldView::CaptureLayoutPrompt(int cmd, bool reshow)
 {
 	// note the current "skip" status
-	bool skip = ConfigManager::GetInstance()->GetBool(ConfigVars::CaptureSkipLayoutMessage, false);
+	bool skip = ConfigVarHandles::CaptureSkipLayoutMessage.Get();
 
 	// if we're initially showing the menu, record the command and check
 	// to see if we can skip the menu entirely
@@ -17748,6 +20429,11 @@ void PlayfieldView::CaptureMediaSetup()
 	if (!CanAddMedia(game))
 		return;
 
+	// The capture will need the ffmpeg capabilities, so start checking
+	// them in the background now, if the cached results are out of date,
+	// while the user works through the capture menus.
+	FFmpegProbe::RequestRefresh();
+
 	// build the capture list for this game
 	InitCaptureList(game);
 
@@ -18104,10 +20790,12 @@ void PlayfieldView::DisplayCaptureMenu(bool updating, int selectedCmd, CaptureMe
 	ShowMenu(md, menuID, flags);
 }
 
-int PlayfieldView::EstimateCaptureTime(GameListItem *game)
+int PlayfieldView::EstimateCaptureTime(GameListItem *game, int *encodeTime)
 {
 	// Start with nothing on the clock
 	int timeEst = 0;
+	if (encodeTime != nullptr)
+		*encodeTime = 0;
 
 	// Add a time allowance for each media type selected.  Images don't 
 	// require any fixed wait time, since they just need one video frame,
@@ -18115,8 +20803,32 @@ int PlayfieldView::EstimateCaptureTime(GameListItem *game)
 	// account for the overhead of launching ffmpeg.
 	auto config = ConfigManager::GetInstance();
 	bool twoPass = config->GetInt(ConfigVars::CaptureTwoPassEncoding, false);
-	const int imageTime = 2;
+	bool singlePass = config->GetBool(ConfigVars::CaptureSinglePass, false);
+	const float imageTime = 2.0f;
 	const int defaultVideoTime = 30;
+
+	// The fixed allowances above, and the launch and encoding allowances
+	// below, are only the starting points.  We record the actual timings
+	// of past captures per system and media type, so use their averages
+	// where we have them.  The timings depend on the game's system; in
+	// single capture mode, that's the current game's system.
+	auto stats = Application::Get()->captureTimeStats.get();
+	GameListItem *sysGame = game != nullptr ? game : GameList::Get()->GetNthGame(0);
+	const TCHAR *sys = sysGame != nullptr && sysGame->system != nullptr ? sysGame->system->displayName.c_str() : _T("");
+	auto Average = [stats, sys](const MediaType &mediaType, CaptureTimeStats::Phase phase, float defaultVal) {
+		return stats->GetAverage(sys, mediaType.configId, phase, defaultVal);
+	};
+
+	// In single-pass mode, the automatically timed videos are captured
+	// together, so the group only adds its longest video time, plus the
+	// largest of the items' overheads
+	int singlePassTime = 0;
+	float singlePassOverhead = 0.0f;
+	float est = 0.0f;
+	float encodeEst = 0.0f;
+	auto IsManual = [config](const TCHAR *cfgvar) {
+		return cfgvar != nullptr && _tcsicmp(config->Get(cfgvar, _T("auto")), _T("manual")) == 0;
+	};
 	for (auto &cap : captureList)
 	{
 		// If a game was specified, and we're in batch capture mode, check
@@ -18148,9 +20860,17 @@ int PlayfieldView::EstimateCaptureTime(GameListItem *game)
 			// should at least be on the right order of magnitude.
 			if (auto cfgvar = cap.mediaType.captureTimeConfigVar; cfgvar != nullptr)
 			{
-				// use the video time
+				// use the video time, plus the capture overhead
 				int videoTime = config->GetInt(cfgvar, defaultVideoTime);
-				timeEst += videoTime;
+				float overhead = Average(cap.mediaType, CaptureTimeStats::Phase::Capture, 0.0f);
+				if (singlePass && cap.mediaType.IsVideo()
+					&& !IsManual(cap.mediaType.captureStartConfigVar) && !IsManual(cap.mediaType.captureStopConfigVar))
+				{
+					singlePassTime = max(singlePassTime, videoTime);
+					singlePassOverhead = max(singlePassOverhead, overhead);
+				}
+				else
+					est += videoTime + overhead;
 
 				// If we're using two-pass encoding, add time for the second
 				// pass.  Use a factor of 1.5 of the video running time as a
@@ -18163,14 +20883,19 @@ int PlayfieldView::EstimateCaptureTime(GameListItem *game)
 				// if it were, the machine would be too underpowered to run
 				// any of the common pinball software, so probably isn't
 				// running PinballY).  So we'll take the middle of that
-				// band (1x to 2x) as our estimate.
-				if (twoPass)
-					timeEst += videoTime * 3 / 2;
+				// band (1x to 2x) as our estimate, until we have measured
+				// encoding times.  For a pipelined batch, this goes to the
+				// caller's separate background encoding time instead, using
+				// the measured times for the background encoders.
+				if (twoPass && encodeTime != nullptr)
+					encodeEst += videoTime * Average(cap.mediaType, CaptureTimeStats::Phase::DeferredEncode, 1.5f);
+				else if (twoPass)
+					est += videoTime * Average(cap.mediaType, CaptureTimeStats::Phase::Encode, 1.5f);
 			}
 			else
 			{
 				// use the image time
-				timeEst += imageTime;
+				est += Average(cap.mediaType, CaptureTimeStats::Phase::Capture, imageTime);
 			}
 			break;
 
@@ -18182,17 +20907,73 @@ int PlayfieldView::EstimateCaptureTime(GameListItem *game)
 		}
 	}
 
-	// If the time estimate is non-zero, add a few seconds for the game
-	// launch.  Don't do this if the estimate is exactly zero, as it means
-	// that nothing is selected, so we can skip the entire capture process
-	// for this game.
-	if (timeEst != 0)
-		timeEst += 5;
+	// add the single-pass group time
+	if (singlePassTime != 0)
+		est += singlePassTime + singlePassOverhead;
+
+	// If the time estimate is non-zero, add time for the game launch: the
+	// system's average launch time, or a few seconds if we haven't timed
+	// any launches yet.  Don't do this if the estimate is exactly zero, as
+	// it means that nothing is selected, so we can skip the entire capture
+	// process for this game.
+	if (est != 0.0f)
+		est += stats->GetAverage(sys, _T(""), CaptureTimeStats::Phase::Launch, 5.0f);
+
+	// round to whole seconds
+	timeEst = static_cast<int>(ceilf(est));
+	if (encodeTime != nullptr)
+		*encodeTime = static_cast<int>(ceilf(encodeEst));
 
 	// return the time estimate in seconds
 	return timeEst;
 }
 
+bool PlayfieldView::IsBatchCapturePipelined() const
+{
+	auto cfg = ConfigManager::GetInstance();
+	return cfg->GetBool(ConfigVars::CaptureTwoPassEncoding, false)
+		&& cfg->GetBool(ConfigVars::CaptureDeferredEncoding, false);
+}
+
+int PlayfieldView::EstimateBatchCaptureTime(int &nGames)
+{
+	// For a pipelined batch, figure the number of background encoders
+	bool pipelined = IsBatchCapturePipelined();
+	int nEncoders = max(ConfigManager::GetInstance()->GetInt(ConfigVars::CaptureDeferredEncodingThreads, 1), 1);
+
+	// Run through the games.  The captures run back to back, so the
+	// capture clock simply adds up each game's time.  In a pipelined
+	// batch, each game's second passes go into the encode queue when
+	// its capture finishes, and start on the first encoder to become
+	// free.  The batch is done when the last capture and the last
+	// encoding pass are both done.
+	nGames = 0;
+	int captureClock = 0;
+	std::vector<int> encoderFree(nEncoders, 0);
+	EnumBatchCaptureGames([this, pipelined, &nGames, &captureClock, &encoderFree](GameListItem *game)
+	{
+		// only count the game if the time is non-zero, as a zero time
+		// means that no media were selected for the game
+		int encodeTime = 0;
+		if (int t = EstimateCaptureTime(game, pipelined ? &encodeTime : nullptr); t != 0)
+		{
+			// count the game, and add its capture time plus the startup wait
+			++nGames;
+			captureClock += t + captureStartupDelay;
+
+			// queue its encoding passes
+			if (encodeTime != 0)
+			{
+				auto e = std::min_element(encoderFree.begin(), encoderFree.end());
+				*e = max(*e, captureClock) + encodeTime;
+			}
+		}
+	});
+
+	// the batch ends when the captures and the encoders are all done
+	return max(captureClock, *std::max_element(encoderFree.begin(), encoderFree.end()));
+}
+
 TSTRINGEx PlayfieldView::FormatCaptureTimeEstimate(int t)
 {
 	// Adjust the time to a round number, since it's really a very
@@ -18312,6 +21093,9 @@ void PlayfieldView::CaptureMediaGo()
 
 void PlayfieldView::OnCaptureDone(const CaptureDoneReport *report)
 {
+	// make sure the media file index sees the captured files right away
+	MediaFileIndex::InvalidateAll();
+
 	// on a successful capture, remove any "mark for capture" flag
 	// from the game
 	if (report->ok)
@@ -18341,6 +21125,28 @@ void PlayfieldView::OnCaptureDone(const CaptureDoneReport *report)
 	}
 }
 
+void PlayfieldView::OnCaptureEncodeDone()
+{
+	// make sure the media file index sees the new files
+	MediaFileIndex::InvalidateAll();
+
+	// if there's no batch encode queue, the batch already ended
+	auto q = batchCaptureMode.encodeQueue.Get();
+	if (q == nullptr)
+		return;
+
+	// The game monitor counted each deferred item as a success when it
+	// was queued, so back out any items where the encoding failed.
+	int nOk, nFailed;
+	q->GetResults(nOk, nFailed);
+	batchCaptureMode.nMediaItemsOk -= nFailed;
+
+	// if we were waiting for the queue to finish the batch, and it's
+	// now empty, end the batch
+	if (batchCaptureMode.finishing && q->GetPending() == 0)
+		ExitBatchCapture();
+}
+
 void PlayfieldView::ShowMediaSearchMenu()
 {
 	// The game has to be configured before we can add media items
@@ -18450,7 +21256,7 @@ static bool GetImpliedGameName(TSTRING &gameName, const TCHAR *fname, const Medi
 		}
 
 		// try matching .../Media Type Dir/Page Dir/Game Name.ext 
-		std::basic_regex<TCHAR> dirPat(MsgFmt(_T(".*\\\\%s%s([^\\\\]*)"), mediaType->subdir, pageDir.c_str()),
+		auto &dirPat = GetCachedRegex(MsgFmt(_T(".*\\\\%s%s([^\\\\]*)"), mediaType->subdir, pageDir.c_str()).Get(),
 			std::regex_constants::icase);
 		if (std::regex_match(fname, m, dirPat))
 		{
@@ -18468,8 +21274,8 @@ static bool GetImpliedGameName(TSTRING &gameName, const TCHAR *fname, const Medi
 
 	// try various patterns with the type name embedded in the filename
 	auto icase = std::regex_constants::icase;
-	std::basic_regex<TCHAR> pat1(MsgFmt(_T("(?:.*\\\\)?%s?(?:\\s+(?!-)|\\s*-\\s*)([^\\\\]+?)"), mediaType->subdir), icase);
-	std::basic_regex<TCHAR> pat2(MsgFmt(_T("(?:.*\\\\)?([^\\\\]+?)(?:\\s+(?!-)|\\s*-\\s*)%s?(\\.[^\\\\]+)"), mediaType->subdir), icase);
+	auto &pat1 = GetCachedRegex(MsgFmt(_T("(?:.*\\\\)?%s?(?:\\s+(?!-)|\\s*-\\s*)([^\\\\]+?)"), mediaType->subdir).Get(), icase);
+	auto &pat2 = GetCachedRegex(MsgFmt(_T("(?:.*\\\\)?([^\\\\]+?)(?:\\s+(?!-)|\\s*-\\s*)%s?(\\.[^\\\\]+)"), mediaType->subdir).Get(), icase);
 	if (std::regex_match(fname, m, pat1))
 	{
 		gameName = m[1].str();
@@ -18744,7 +21550,7 @@ void PlayfieldView::EndFileDrop()
 		// same functional slot (e.g., playfield video) are effectively
 		// duplicates for our purposes, even though the file system 
 		// stores the files separately.
-		std::basic_regex<TCHAR> extPat(_T("\\.[^.\\\\]+$"));
+		static const std::basic_regex<TCHAR> extPat(_T("\\.[^.\\\\]+$"));
 		TSTRING baseName = std::regex_replace(d.destFile, extPat, _T(""));
 
 		// check if this file is already in the map
@@ -18786,7 +21592,7 @@ void PlayfieldView::EndFileDrop()
 	// convert the whole thing to lower-case.
 	auto NameToKey = [](const TSTRING &name)
 	{
-		std::basic_regex<TCHAR> punctPat(_T("\\W+"));
+		static const std::basic_regex<TCHAR> punctPat(_T("\\W+"));
 		TSTRING s = std::regex_replace(name, punctPat, _T(" "));
 		std::transform(s.begin(), s.end(), s.begin(), ::_totlower);
 		return s;
@@ -18922,151 +21728,61 @@ void PlayfieldView::MediaDropGo()
 		return;
 	}
 
-	// compile a list of errors as we go
-	CapturingErrorHandler eh;
+	// If a previous drop is still being installed, wait for it to
+	// finish.
+	if (mediaDropInstaller != nullptr)
+	{
+		SetTimer(hWnd, mediaDropTimerID, 250, NULL);
+		return;
+	}
 
-	// work though the drop list
-	int nInstalled = 0;
+	// Hand the drop list over to the installer.  Skip the items with
+	// status "skip" or "keep existing".
+	RefPtr<MediaDropInstaller> installer(new MediaDropInstaller(hWnd, PFVMsgMediaDropDone));
 	for (auto &d : dropList)
 	{
-		// if the status is "skip" or "keep existing", skip it
-		if (d.status == IDS_MEDIA_DROP_SKIP || d.status == IDS_MEDIA_DROP_KEEP)
-			continue;
-
-		// back up any existing file
-		TSTRING backupName;
-		if (d.exists && !d.mediaType->SaveBackup(d.destFile.c_str(), backupName, eh))
-			continue;
-
-		// make sure the destination folder exists
-		const TCHAR *slash = _tcsrchr(d.destFile.c_str(), '\\');
-		if (slash != nullptr)
-		{
-			// extract the path portion
-			TSTRING path(d.destFile.c_str(), slash - d.destFile.c_str());
-
-			// if the folder doesn't exist, try creating it
-			if (!DirectoryExists(path.c_str())
-				&& !CreateSubDirectory(path.c_str(), _T(""), NULL))
-			{
-				WindowsErrorMessage winErr;
-				eh.SysError(MsgFmt(IDS_ERR_DROP_MKDIR, d.mediaType->nameStr.c_str(), path.c_str()),
-					winErr.Get());
-				continue;
-			}
-		}
+		if (d.status != IDS_MEDIA_DROP_SKIP && d.status != IDS_MEDIA_DROP_KEEP)
+			installer->Add(d.filename.c_str(), d.stream, d.zipIndex, d.destFile.c_str(), d.mediaType, d.exists);
+	}
 
-		// determine the file source
-		bool ok = false;
-		if (d.zipIndex >= 0)
-		{
-			// It's an entry in a ZIP file (or other recognized archive type).  
-			// Extract it to the destination file.
-			// 
-			// Note that we extract the file into d.destFile, ignoring the name
-			// stored in the archive, since we want to make sure the installed 
-			// file matches the game's media file name.  The destination name 
-			// already takes into account the proper media folder, page subfolder,
-			// and index number, as applicable.  We figured all of that out when
-			// we first built the drop list.  We also ignore the path of the
-			// archive entry at this point, since our mission is to install the
-			// file in the proper media database folder for the media type.  The
-			// path information from the archive isn't lost, though, since it 
-			// played a role in determining which type of media this entry 
-			// represents, which in turn determines the final output folder.
-			SevenZipArchive arch;
-			if (arch.OpenArchive(d.filename.c_str(), d.stream, eh)
-				&& arch.Extract(d.zipIndex, d.destFile.c_str(), eh))
-			{
-				// success - count the file installed
-				++nInstalled;
-				ok = true;
+	// forget the target game
+	mediaDropTargetGame = nullptr;
 
-				// set the file's modify time to now, so that we know this
-				// is the most recently installed file
-				TouchFile(d.destFile.c_str());
-			}
-		}
-		else
-		{
-			// It's a directly dropped file.  Copy the file out of the IStream.
-			if (d.stream != nullptr)
-			{
-				// create a stream on the destination file
-				RefPtr<IStream> destStream;
-				const TCHAR *where = _T("creating output stream");
-				HRESULT hr = SHCreateStreamOnFileEx(d.destFile.c_str(),
-					STGM_CREATE | STGM_WRITE | STGM_SHARE_EXCLUSIVE,
-					FILE_ATTRIBUTE_NORMAL, TRUE, nullptr, &destStream);
-
-				// figure the size of the source stream
-				ULARGE_INTEGER sz;
-				if (SUCCEEDED(hr))
-				{
-					where = _T("getting source size");
-					hr = d.stream->Seek({ 0, 0 }, STREAM_SEEK_END, &sz);
-				}
+	// if there's nothing to install, we're done
+	if (installer->GetCount() == 0)
+	{
+		ShowErrorAutoDismiss(5000, ErrorIconType::EIT_Information,
+			LoadStringT(IDS_MEDIA_DROP_ALL_SKIPPED));
+		UpdateSelection(false);
+		return;
+	}
 
-				// seek back to the start
-				if (SUCCEEDED(hr))
-				{
-					where = _T("seeking to start of source stream");
-					hr = d.stream->Seek({ 0, 0 }, STREAM_SEEK_SET, nullptr);
-				}
+	// start the installer thread
+	if (!installer->Start())
+	{
+		ShowError(ErrorIconType::EIT_Error, LoadStringT(IDS_ERR_DROP_FAILED));
+		UpdateSelection(false);
+		return;
+	}
 
-				// copy the stream
-				ULARGE_INTEGER actualRead = { 0, 0 }, actualWrite = { 0, 0 };
-				if (SUCCEEDED(hr))
-				{
-					where = _T("copying data");
-					hr = d.stream->CopyTo(destStream, sz, &actualRead, &actualWrite);
-				}
+	// let the user know it's under way
+	mediaDropInstaller = installer;
+	ShowErrorAutoDismiss(2500, ErrorIconType::EIT_Information, LoadStringT(IDS_MEDIA_DROP_STARTED));
+}
 
-				// report errors
-				if (!SUCCEEDED(hr))
-				{
-					WindowsErrorMessage winErr(hr);
-					eh.Error(MsgFmt(IDS_ERR_DROP_COPY,
-						d.mediaType->nameStr.c_str(),
-						d.filename.c_str(), d.destFile.c_str(), winErr.Get()));
-				}
-				else if (actualRead.QuadPart != sz.QuadPart || actualWrite.QuadPart != sz.QuadPart)
-				{
-					MsgFmt details(_T("not all byts were copied (file size %I64u, read %I64u, wrote %I64u"),
-						sz.QuadPart, actualRead.QuadPart, actualWrite.QuadPart);
-					eh.Error(MsgFmt(IDS_ERR_DROP_COPY,
-						d.mediaType->nameStr.c_str(),
-						d.filename.c_str(), d.destFile.c_str(), details.Get()));
-				}
-				else
-				{
-					// success - count the file installed
-					++nInstalled;
-					ok = true;
-				}
-			}
-			else
-			{
-				// no stream available - log an error
-				eh.Error(MsgFmt(IDS_ERR_DROP_COPY,
-					d.mediaType->nameStr.c_str(),
-					d.filename.c_str(), d.destFile.c_str(), _T("no source stream available")));
-			}
-		}
+void PlayfieldView::OnMediaDropDone()
+{
+	// make sure there's an installer
+	if (mediaDropInstaller == nullptr)
+		return;
 
-		// If it failed, and we renamed the original file as a backup
-		// copy, undo the rename.  Ignore any errors that occur in that
-		// attempt, as we've already logged errors for this operation
-		// and we don't want to overload the user with alerts.  The
-		// user should be able to sort out the mess easily enough if
-		// the un-re-name fails by manually inspecting the media folder.
-		if (!ok && d.exists)
-			MoveFile(backupName.c_str(), d.destFile.c_str());
-	}
+	// get the results
+	const CapturingErrorHandler *eh;
+	int nInstalled = mediaDropInstaller->GetResults(eh);
 
 	// report the results
-	if (eh.CountErrors() != 0)
-		ShowError(ErrorIconType::EIT_Error, LoadStringT(IDS_ERR_DROP_FAILED), &eh);
+	if (eh->CountErrors() != 0)
+		ShowError(ErrorIconType::EIT_Error, LoadStringT(IDS_ERR_DROP_FAILED), eh);
 	else if (nInstalled != 0)
 		ShowErrorAutoDismiss(nInstalled == 1 ? 2500 : 5000, ErrorIconType::EIT_Information, 
 			LoadStringT(IDS_MEDIA_DROP_SUCCESS));
@@ -19074,11 +21790,11 @@ void PlayfieldView::MediaDropGo()
 		ShowErrorAutoDismiss(5000, ErrorIconType::EIT_Information, 
 			LoadStringT(IDS_MEDIA_DROP_ALL_SKIPPED));
 
+	// we're done with the installer
+	mediaDropInstaller = nullptr;
+
 	// Make sure the on-screen media are updated with the new media
 	UpdateSelection(false);
-
-	// forget the target game
-	mediaDropTargetGame = nullptr;
 }
 
 void PlayfieldView::InvertMediaDropState(int cmd)
@@ -19199,6 +21915,9 @@ void PlayfieldView::DisplayDropMediaMenu(bool updating, int selectedCmd)
 // game list filter (e.g., 70s Tables, Williams Tables, etc).
 void PlayfieldView::BatchCaptureStep1()
 {
+	// start checking the ffmpeg capabilities, as for a single capture
+	FFmpegProbe::RequestRefresh();
+
 	// build the menu
 	std::list<MenuItemDesc> md;
 	md.emplace_back(LoadStringT(IDS_BATCH_CAPTURE_PROMPT), -1);
@@ -19295,7 +22014,7 @@ void PlayfieldView::EnumBatchCaptureGames(std::function<void(GameListItem*)> fun
 	{
 		// we can only capture media for games configured with bibliographic info
 		// and valid systems
-		if (game->gameXmlNode != nullptr && game->system != nullptr)
+		if (game->HasXmlNode() && game->system != nullptr)
 			func(game);
 	}, filter);
 }
@@ -19304,26 +22023,7 @@ void PlayfieldView::BatchCaptureStep4()
 {
 	// count games and estimate the running time
 	int nGames = 0;
-	int totalTime = 0;
-	EnumBatchCaptureGames([&nGames, &totalTime, this](GameListItem *game)
-	{
-		// get the time estimate for this game
-		int t = EstimateCaptureTime(game);
-
-		// only count the game if the time is non-zero, as a zero time
-		// means that no media were selected for the game
-		if (t != 0)
-		{
-			// count the game
-			++nGames;
-
-			// count the total time
-			totalTime += t;
-
-			// add the startup wait time
-			totalTime += ConfigManager::GetInstance()->GetInt(ConfigVars::CaptureStartupDelay, 5);
-		}
-	});
+	int totalTime = EstimateBatchCaptureTime(nGames);
 
 	// format the time estimate
 	auto totalTimeStr = FormatCaptureTimeEstimate(totalTime);
@@ -19358,9 +22058,9 @@ void PlayfieldView::BatchCaptureView()
 		g.FillRectangle(&bkgBr, 0, 0, width, height);
 
 		// set up resources for text drawing
-		std::unique_ptr<Gdiplus::Font> gameTitleFont(CreateGPFont(popupFont.family.c_str(), 16, 400, popupFont.italic));
-		std::unique_ptr<Gdiplus::Font> detailsFont(CreateGPFont(popupFont.family.c_str(), 12, 400, popupFont.italic));
-		std::unique_ptr<Gdiplus::Font> mediaItemFont(CreateGPFont(popupFont.family.c_str(), 14, 400, popupFont.italic));
+		std::shared_ptr<Gdiplus::Font> gameTitleFont(FontCache::GetGPFont(popupFont.family.c_str(), 16, 400, popupFont.italic));
+		std::shared_ptr<Gdiplus::Font> detailsFont(FontCache::GetGPFont(popupFont.family.c_str(), 12, 400, popupFont.italic));
+		std::shared_ptr<Gdiplus::Font> mediaItemFont(FontCache::GetGPFont(popupFont.family.c_str(), 14, 400, popupFont.italic));
 		Gdiplus::SolidBrush gameTitleBr(Gdiplus::Color(255, 255, 255));
 		Gdiplus::SolidBrush detailsBr(Gdiplus::Color(128, 128, 128));
 		Gdiplus::SolidBrush mediaItemBr(Gdiplus::Color(220, 220, 220));
@@ -19517,7 +22217,7 @@ void PlayfieldView::UpdateBatchCaptureView()
 
 		// draw a title bar at the top
 		auto title = LoadStringT(IDS_CAPPREVIEW_TITLE);
-		std::unique_ptr<Gdiplus::Font> titleFont(CreateGPFont(popupFont.family.c_str(), 20, 700, popupFont.italic));
+		std::shared_ptr<Gdiplus::Font> titleFont(FontCache::GetGPFont(popupFont.family.c_str(), 20, 700, popupFont.italic));
 		Gdiplus::SolidBrush titleBr(Gdiplus::Color(0, 0, 0));
 		Gdiplus::SolidBrush titleBkg(frameColor);
 		Gdiplus::RectF bbox;
@@ -19530,7 +22230,7 @@ void PlayfieldView::UpdateBatchCaptureView()
 		if (srcHeight > maxHeight)
 		{
 			auto instr = LoadStringT(IDS_CAPPREVIEW_INSTRS);
-			std::unique_ptr<Gdiplus::Font> instrFont(CreateGPFont(popupFont.family.c_str(), 16, 400, popupFont.italic));
+			std::shared_ptr<Gdiplus::Font> instrFont(FontCache::GetGPFont(popupFont.family.c_str(), 16, 400, popupFont.italic));
 			g.MeasureString(instr, -1, instrFont.get(), Gdiplus::PointF(0.0f, 0.0f), &centerFmt, &bbox);
 			Gdiplus::RectF rcInstr(0.0f, (float)height - bbox.Height*1.4f, (float)width, bbox.Height*1.4f);
 			g.FillRectangle(&titleBkg, rcInstr);
@@ -19572,16 +22272,8 @@ void PlayfieldView::BatchCaptureGo()
 	SaveLastCaptureModes();
 
 	// Add up the total time for the whole batch
-	int totalTime = 0;
 	int nGames = 0;
-	EnumBatchCaptureGames([this, &totalTime, &nGames](GameListItem *game) 
-	{
-		if (auto t = EstimateCaptureTime(game); t != 0)
-		{
-			totalTime += t + captureStartupDelay;
-			++nGames;
-		}
-	});
+	int totalTime = EstimateBatchCaptureTime(nGames);
 
 	// if the total time is zero, nothing is selected for capture - fail now
 	if (totalTime == 0)
@@ -19596,10 +22288,22 @@ void PlayfieldView::BatchCaptureGo()
 	// caution...
 	Application::Get()->ClearLaunchQueue();
 
+	// If we're pipelining the batch, set up the background encoding
+	// queue for the games' second passes
+	bool pipelined = IsBatchCapturePipelined();
+	batchCaptureMode.encodeQueue = nullptr;
+	if (pipelined)
+	{
+		auto cfg = ConfigManager::GetInstance();
+		batchCaptureMode.encodeQueue.Attach(new CaptureEncodeQueue(hWnd, PFVMsgCaptureEncodeDone,
+			cfg->GetInt(ConfigVars::CaptureDeferredEncodingThreads, 1),
+			cfg->GetInt(ConfigVars::CaptureDeferredEncodingCpuLimit, 50)));
+	}
+
 	// Queue capture for all games in the capture list
 	int nCurGame = 1;
 	int remainingTime = totalTime;
-	EnumBatchCaptureGames([this, &totalTime, &remainingTime, &nGames, &nCurGame](GameListItem *game)
+	EnumBatchCaptureGames([this, pipelined, &totalTime, &remainingTime, &nGames, &nCurGame](GameListItem *game)
 	{
 		// build the capture list for the game
 		std::list<Application::LaunchCaptureItem> capList;
@@ -19622,11 +22326,15 @@ void PlayfieldView::BatchCaptureGo()
 		{
 			// enqueue this launch
 			Application::BatchCaptureInfo bci(nCurGame, nGames, remainingTime, totalTime);
+			bci.encodeQueue = batchCaptureMode.encodeQueue;
 			Application::Get()->QueueLaunch(ID_CAPTURE_GO, Application::LaunchFlags::StdCaptureFlags,
 				game, game->system, &capList, captureStartupDelay, &bci);
 
-			// deduct this from the remaining time
-			remainingTime -= EstimateCaptureTime(game) + captureStartupDelay;
+			// Deduct this from the remaining time.  In a pipelined batch,
+			// the game's encoding runs in the background, so only its
+			// capture time comes off the clock.
+			int encodeTime;
+			remainingTime -= EstimateCaptureTime(game, pipelined ? &encodeTime : nullptr) + captureStartupDelay;
 			++nCurGame;
 		}
 	});
@@ -19647,9 +22355,27 @@ void PlayfieldView::BatchCaptureNextGame()
 	// if we haven't canceled the whole operation, and the application
 	// still has more queued games, launch the next one
 	if (!batchCaptureMode.cancel && Application::Get()->IsGameQueuedForLaunch())
+	{
+		LaunchTimeline::Begin();
 		LaunchQueuedGame();
+	}
+	else if (auto q = batchCaptureMode.encodeQueue.Get(); q != nullptr && q->GetPending() != 0)
+	{
+		// The captures are done, but there are still encoding passes in
+		// the background queue.  Let the user know, and finish the batch
+		// when the queue empties out.  Note that we let the queue finish
+		// even if the batch was canceled, since the passes are for games
+		// that were already captured.
+		if (!batchCaptureMode.finishing)
+		{
+			batchCaptureMode.finishing = true;
+			ShowError(ErrorIconType::EIT_Information, MsgFmt(IDS_BATCH_CAPTURE_FINISHING, q->GetPending()));
+		}
+	}
 	else
+	{
 		ExitBatchCapture();
+	}
 }
 
 void PlayfieldView::EnterBatchCapture()
@@ -19718,6 +22444,14 @@ void PlayfieldView::ExitBatchCapture()
 	// around.
 	Application::Get()->ClearLaunchQueue();
 
+	// collect any final encoding results from the background queue
+	if (auto q = batchCaptureMode.encodeQueue.Get(); q != nullptr)
+	{
+		int nOk, nFailed;
+		q->GetResults(nOk, nFailed);
+		batchCaptureMode.nMediaItemsOk -= nFailed;
+	}
+
 	// determine if we attempted all of the games in the capture list
 	bool ok = (batchCaptureMode.nMediaItemsOk == batchCaptureMode.nMediaItemsPlanned
 		&& batchCaptureMode.nGamesOk == batchCaptureMode.nGamesPlanned);
@@ -19812,6 +22546,25 @@ void PlayfieldView::CmdSettings(const QueuedKey &key)
 		ShowSettingsDialog();
 }
 
+void PlayfieldView::PreloadSettingsDialog()
+{
+	// Load the DLL.  We don't need to keep the handle, since the module
+	// stays loaded for the rest of the session: ShowSettingsDialog() will
+	// get the same module when it loads the DLL again.
+	HMODULE dll = LoadLibrary(_T("OptionsDialog.dll"));
+	if (dll == NULL)
+		return;
+
+	// check the interface version, the same way ShowSettingsDialog() does
+	auto getVer = reinterpret_cast<decltype(GetOptionsDialogVersion)*>(GetProcAddress(dll, "GetOptionsDialogVersion"));
+	if (getVer == NULL || getVer() != PINBALLY_OPTIONS_DIALOG_IFC_VSN)
+		return;
+
+	// run the preloader, if the DLL has one
+	if (auto preload = reinterpret_cast<decltype(PreloadOptionsDialog)*>(GetProcAddress(dll, "PreloadOptionsDialog")); preload != NULL)
+		preload();
+}
+
 void PlayfieldView::ShowSettingsDialog()
 {
 	// don't allow this when a game is running
@@ -19821,6 +22574,9 @@ void PlayfieldView::ShowSettingsDialog()
 		return;
 	}
 
+	// make sure the background preload is finished before using the DLL
+	StartupTasks::Join("Options dialog preload");
+
 	// if we haven't already loaded the options dialog DLL function, do so now
 	static HMODULE dll = NULL;
 	static decltype(ShowOptionsDialog)* showOptionsDialog = NULL;
@@ -20043,9 +22799,11 @@ void PlayfieldView::StatusLine::Init(
 	ConfigManager *cfg = ConfigManager::GetInstance();
 	dispTime = cfg->GetInt(MsgFmt(_T("%s.UpdateTime"), cfgVar), dispTime);
 
-	// clear any existing messages
+	// clear any existing messages, and forget the rendered messages, since
+	// the fonts and colors might have changed
 	items.clear();
 	curItem = items.end();
+	spriteCache.clear();
 
 	// get my message list
 	const TCHAR *messages = cfg->Get(MsgFmt(_T("%s.Messages"), cfgVar), nullptr);
@@ -20270,7 +23028,44 @@ void PlayfieldView::StatusLine::AddSprites(std::list<RefPtr<Sprite>> &sprites)
 
 bool PlayfieldView::StatusItem::NeedsUpdate(PlayfieldView *pfv)
 {
-	return sprite == nullptr || ExpandText(pfv) != dispText;
+	return sprite == nullptr || GetExpandedText(pfv) != dispText;
+}
+
+const TSTRING &PlayfieldView::StatusItem::GetExpandedText(PlayfieldView *pfv)
+{
+	// expand the text if we haven't yet, or if any of its sources have changed
+	SourceState cur = GetSourceState(pfv);
+	if (!expanded || !(cur == lastSources))
+	{
+		lastExpandedText = ExpandText(pfv);
+		lastSources = cur;
+		expanded = true;
+	}
+	return lastExpandedText;
+}
+
+PlayfieldView::StatusItem::SourceState PlayfieldView::StatusItem::GetSourceState(PlayfieldView *pfv) const
+{
+	// Fill in the sources that the template uses.  The game's stats stamp
+	// covers the rating, play count, play time, and last played date; the
+	// rest of the game data we display is fixed for a given game.
+	SourceState s;
+	GameList *gl = GameList::Get();
+	if ((sources & SrcGame) != 0)
+	{
+		s.game = gl->GetNthGame(0);
+		if (IsGameValid(s.game))
+			s.gameStatsStamp = gl->GetStatsStamp(s.game);
+	}
+	if ((sources & SrcFilter) != 0)
+	{
+		s.filter = gl->GetCurFilter();
+		s.filterCount = gl->GetCurFilterCount();
+	}
+	if ((sources & SrcCredits) != 0)
+		s.credits = pfv->GetEffectiveCredits();
+
+	return s;
 }
 
 std::list<PlayfieldView::StatusItem>::iterator PlayfieldView::StatusLine::NextItem()
@@ -20288,165 +23083,228 @@ std::list<PlayfieldView::StatusItem>::iterator PlayfieldView::StatusLine::NextIt
 	return (next == items.end() ? items.begin() : next);
 }
 
+void PlayfieldView::StatusItem::SetSrcText(const TSTRING &txt)
+{
+	// store the text and start a new template
+	srcText = txt;
+	segments.clear();
+	sources = 0;
+	expanded = false;
+
+	// add a literal segment
+	auto AddLiteral = [this](TSTRING::const_iterator start, TSTRING::const_iterator end)
+	{
+		if (start != end)
+		{
+			segments.emplace_back();
+			segments.back().text.assign(start, end);
+		}
+	};
+
+	// Split the text into literal and macro segments.  A macro looks like
+	// [name], or [name:section...] with up to three ':' sections, which
+	// give the singular/plural forms for count variables or the format
+	// picture for date variables.
+	static const std::basic_regex<TCHAR> pat(_T("\\[([\\w.]+)((:[^\\]:]*)?(:[^\\]:]*)?(:[^\\]]*)?)\\]"));
+	TSTRING::const_iterator last = srcText.cbegin();
+	for (std::regex_iterator<TSTRING::const_iterator> it(srcText.cbegin(), srcText.cend(), pat), end; it != end; ++it)
+	{
+		auto &m = *it;
+
+		// add the literal text leading up to the macro
+		AddLiteral(last, m[0].first);
+		last = m[0].second;
+
+		// add the macro, with the variable name in lower-case for matching
+		segments.emplace_back();
+		Segment &seg = segments.back();
+		seg.text = m[0].str();
+		seg.var = m[1].str();
+		std::transform(seg.var.begin(), seg.var.end(), seg.var.begin(), ::_totlower);
+		seg.suffix = m[2].str();
+		seg.hasForms = m[3].matched && m[4].matched;
+		seg.hasForm0 = m[5].matched;
+		if (seg.hasForms)
+		{
+			seg.form1 = m[3].str().substr(1);
+			seg.form2 = m[4].str().substr(1);
+			if (seg.hasForm0)
+				seg.form0 = m[5].str().substr(1);
+		}
+
+		// note the data source it draws on
+		if (_tcsncmp(seg.var.c_str(), _T("game."), 5) == 0)
+			sources |= SrcGame;
+		else if (_tcsncmp(seg.var.c_str(), _T("filter."), 7) == 0)
+			sources |= SrcFilter;
+		else if (seg.var == _T("credits"))
+			sources |= SrcCredits;
+	}
+
+	// add the literal text after the last macro
+	AddLiteral(last, srcText.cend());
+}
+
 TSTRING PlayfieldView::StatusItem::ExpandText(PlayfieldView *pfv)
 {
-	// Get the current game list selection and filter, for macro expansion
+	// concatenate the literal segments and macro expansions
+	TSTRING txt;
+	for (auto const &seg : segments)
+		txt += seg.var.empty() ? seg.text : ExpandMacro(seg, pfv);
+
+	return txt;
+}
+
+TSTRING PlayfieldView::StatusItem::ExpandMacro(const Segment &seg, PlayfieldView *pfv)
+{
+	// Get the current game list selection and filter
 	GameList *gl = GameList::Get();
 	GameListItem *game = gl->GetNthGame(0);
 	const GameListFilter *filter = gl->GetCurFilter();
 
-	// Get my new message text, expanding macros
-	std::basic_regex<TCHAR> pat(_T("\\[([\\w.]+)((:[^\\]:]*)?(:[^\\]:]*)?(:[^\\]]*)?)\\]"));
-	return regex_replace(srcText, pat, [gl, game, filter, pfv](const std::match_results<TSTRING::const_iterator> &m) -> TSTRING
+	// Check for ":" suffix strings.  These are used for the singular/plural
+	// forms for count variables, and for date format pictures for date variables.
+	if (seg.suffix.length() != 0)
 	{
-		// pull out the variable name, in lower-case for matching
-		TSTRING v = m[1].str().c_str();
-		std::transform(v.begin(), v.end(), v.begin(), ::_totlower);
-
-		// Check for ":" suffix strings.  These are used for the singular/plural
-		// forms for count variables, and for date format pictures for date variables.
-		if (m[2].length() != 0)
+		// Check for count variables.  For these, we must match at least
+		// two ":" sections.
+		if (seg.hasForms)
 		{
-			// Check for count variables.  For these, we must match at least
-			// two ":" sections.
-			if (m[3].matched && m[4].matched)
-			{
-				auto PluralFormat = [&m](float n)
-				{
-					// substitute the appropriate section
-					if (n == 0.0f && m[5].matched)
-						return m[5].str().substr(1);
-					else if (n > 0.0f && n <= 1.0f)
-						return m[3].str().substr(1);
-					else
-						return m[4].str().substr(1);
-				};
-
-				if (v == _T("filter.count"))
-					return PluralFormat(static_cast<float>(GameList::Get()->GetCurFilterCount()));
-				else if (v == _T("credits"))
-					return PluralFormat(pfv->GetEffectiveCredits());
-				else if (v == _T("game.playcount"))
-					return PluralFormat(IsGameValid(game) ? static_cast<float>(gl->GetPlayCount(game)) : 0.0f);
-			}
-
-			// Check for date variables
-			auto XlatLitChars = [](TSTRING &s, bool xlatPct) {
-				const static std::basic_regex<TCHAR> litCharPat(_T("%[()!%]"));
-				return regex_replace(s, litCharPat, [xlatPct](const std::match_results<TSTRING::const_iterator>& m) -> TSTRING {
-					TCHAR c = m[0].str()[1];
-					return c == '(' ? _T("[") :
-						c == ')' ? _T("]") :
-						c == '!' ? _T("|") :
-						c == '%' ? (xlatPct ? _T("%") : _T("%%")) :
-						TSTRING(c, 1);
-				});
-			};
-			auto DateFormat = [&m, &XlatLitChars](const TCHAR *str) -> TSTRING
+			auto PluralFormat = [&seg](float n)
 			{
-				// separate the format string into <date mask>|<never> sections
-				TSTRING format = m[2].str().substr(1);
-				TSTRING never;
-				const TCHAR *bar = _tcschr(format.c_str(), '|');
-				if (bar != nullptr)
-				{
-					never = bar + 1;
-					format = format.substr(0, bar - format.c_str());
-				}
-
-				// convert to a DateTime and check if it's valid
-				DateTime d(str);
-				if (d.IsValid())
-				{
-					// it's a valid date value - convert to a struct tm
-					tm tm;
-					d.ToStructTm(tm);
-
-					// Apply the string format.  Substitute our additional literal
-					// character sequences first, but leave %% sequences intact, since
-					// they'll be handled by _tcsftime().
-					TCHAR dbuf[512];
-					_tcsftime(dbuf, countof(dbuf), XlatLitChars(format, false).c_str(), &tm);
-
-					// return the formatted string
-					return dbuf;
-				}
-				else if (bar != nullptr)
-				{
-					// Invalid date, and there's a custom "never" string - use it, 
-					// applying literal character substitutions.
-					return XlatLitChars(never, true);
-				}
+				// substitute the appropriate section
+				if (n == 0.0f && seg.hasForm0)
+					return seg.form0;
+				else if (n > 0.0f && n <= 1.0f)
+					return seg.form1;
 				else
-				{
-					// invalid date and no custom "never" string - use the default "never"
-					return LoadStringT(IDS_LAST_PLAYED_NEVER);
-				}
+					return seg.form2;
 			};
-			if (v == _T("game.lastplayed") && IsGameValid(game))
-				return DateFormat(gl->GetLastPlayed(game));
-		}
-
-		// it's an ordinary substitution
-		if (v == _T("game.title"))
-			return game != nullptr ? game->title : _T("?");
-		else if (v == _T("game.manuf"))
-			return IsGameValid(game) && game->manufacturer != nullptr ? game->manufacturer->manufacturer : LoadStringT(IDS_NO_MANUFACTURER);
-		else if (v == _T("game.year"))
-			return IsGameValid(game) && game->year != 0 ? MsgFmt(_T("%d"), game->year).Get() : LoadStringT(IDS_NO_YEAR);
-		else if (v == _T("game.system"))
-			return IsGameValid(game) && game->system != nullptr ? game->system->displayName : LoadStringT(IDS_NO_SYSTEM);
-		else if (v == _T("game.rating"))
-			return pfv->StarsAsText(IsGameValid(game) ? gl->GetRating(game) : -1);
-		else if (v == _T("game.typecode"))
-			return IsGameValid(game) ? game->tableType : LoadStringT(IDS_NO_TABLE_TYPE);
-		else if (v == _T("game.typename"))
+
+			if (seg.var == _T("filter.count"))
+				return PluralFormat(static_cast<float>(GameList::Get()->GetCurFilterCount()));
+			else if (seg.var == _T("credits"))
+				return PluralFormat(pfv->GetEffectiveCredits());
+			else if (seg.var == _T("game.playcount"))
+				return PluralFormat(IsGameValid(game) ? static_cast<float>(gl->GetPlayCount(game)) : 0.0f);
+		}
+
+		// Check for date variables
+		auto XlatLitChars = [](TSTRING &s, bool xlatPct) {
+			const static std::basic_regex<TCHAR> litCharPat(_T("%[()!%]"));
+			return regex_replace(s, litCharPat, [xlatPct](const std::match_results<TSTRING::const_iterator>& m) -> TSTRING {
+				TCHAR c = m[0].str()[1];
+				return c == '(' ? _T("[") :
+					c == ')' ? _T("]") :
+					c == '!' ? _T("|") :
+					c == '%' ? (xlatPct ? _T("%") : _T("%%")) :
+					TSTRING(c, 1);
+			});
+		};
+		auto DateFormat = [&seg, &XlatLitChars](const TCHAR *str) -> TSTRING
 		{
-			if (IsGameValid(game))
+			// separate the format string into <date mask>|<never> sections
+			TSTRING format = seg.suffix.substr(1);
+			TSTRING never;
+			const TCHAR *bar = _tcschr(format.c_str(), '|');
+			if (bar != nullptr)
 			{
-				if (auto it = pfv->tableTypeNameMap.find(game->tableType); it != pfv->tableTypeNameMap.end())
-					return WSTRINGToTSTRING(it->second);
+				never = bar + 1;
+				format = format.substr(0, bar - format.c_str());
 			}
-			return LoadStringT(IDS_NO_TABLE_TYPE);
-		}
-		else if (v == _T("game.playcount"))
-		{
-			if (IsGameValid(game))
+
+			// convert to a DateTime and check if it's valid
+			DateTime d(str);
+			if (d.IsValid())
 			{
-				TCHAR buf[20];
-				_stprintf_s(buf, _T("%d"), gl->GetPlayCount(game));
-				return buf;
+				// it's a valid date value - convert to a struct tm
+				tm tm;
+				d.ToStructTm(tm);
+
+				// Apply the string format.  Substitute our additional literal
+				// character sequences first, but leave %% sequences intact, since
+				// they'll be handled by _tcsftime().
+				TCHAR dbuf[512];
+				_tcsftime(dbuf, countof(dbuf), XlatLitChars(format, false).c_str(), &tm);
+
+				// return the formatted string
+				return dbuf;
 			}
-			return LoadStringT(IDS_NO_PLAY_COUNT);
-		}
-		else if (v == _T("game.playtime"))
-			return IsGameValid(game) ? pfv->PlayTimeAsText(gl->GetPlayTime(game)) : LoadStringT(IDS_NO_PLAY_TIME);
-		else if (v == _T("game.lastplayed"))
-		{
-			if (IsGameValid(game))
+			else if (bar != nullptr)
 			{
-				DateTime d(gl->GetLastPlayed(game));
-				if (d.IsValid())
-					return d.FormatLocalDateTime(DATE_LONGDATE, TIME_NOSECONDS);
+				// Invalid date, and there's a custom "never" string - use it, 
+				// applying literal character substitutions.
+				return XlatLitChars(never, true);
+			}
+			else
+			{
+				// invalid date and no custom "never" string - use the default "never"
 				return LoadStringT(IDS_LAST_PLAYED_NEVER);
 			}
-			return LoadStringT(IDS_NO_LAST_PLAYED);
-		}
-		else if (v == _T("game.tablefilename"))
-			return IsGameValid(game) ? game->filename : LoadStringT(IDS_NO_TABLE_FILE);
-		else if (v == _T("filter.title"))
-			return filter->GetFilterTitle();
-		else if (v == _T("filter.count"))
-			return MsgFmt(_T("%d"), GameList::Get()->GetCurFilterCount()).Get();
-		else if (v == _T("credits"))
-			return FormatFraction(pfv->GetEffectiveCredits());
-		else if (v == _T("lb"))
-			return _T("[");
-		else if (v == _T("rb"))
-			return _T("]");
-		else
-			return m[0].str(); // no match - return the full original text
-	});
+		};
+		if (seg.var == _T("game.lastplayed") && IsGameValid(game))
+			return DateFormat(gl->GetLastPlayed(game));
+	}
+
+	// it's an ordinary substitution
+	if (seg.var == _T("game.title"))
+		return game != nullptr ? game->title : _T("?");
+	else if (seg.var == _T("game.manuf"))
+		return IsGameValid(game) && game->manufacturer != nullptr ? game->manufacturer->manufacturer : LoadStringT(IDS_NO_MANUFACTURER);
+	else if (seg.var == _T("game.year"))
+		return IsGameValid(game) && game->year != 0 ? MsgFmt(_T("%d"), game->year).Get() : LoadStringT(IDS_NO_YEAR);
+	else if (seg.var == _T("game.system"))
+		return IsGameValid(game) && game->system != nullptr ? game->system->displayName : LoadStringT(IDS_NO_SYSTEM);
+	else if (seg.var == _T("game.rating"))
+		return pfv->StarsAsText(IsGameValid(game) ? gl->GetRating(game) : -1);
+	else if (seg.var == _T("game.typecode"))
+		return IsGameValid(game) ? game->tableType : LoadStringT(IDS_NO_TABLE_TYPE);
+	else if (seg.var == _T("game.typename"))
+	{
+		if (IsGameValid(game))
+		{
+			if (auto it = pfv->tableTypeNameMap.find(game->tableType); it != pfv->tableTypeNameMap.end())
+				return WSTRINGToTSTRING(it->second);
+		}
+		return LoadStringT(IDS_NO_TABLE_TYPE);
+	}
+	else if (seg.var == _T("game.playcount"))
+	{
+		if (IsGameValid(game))
+		{
+			TCHAR buf[20];
+			_stprintf_s(buf, _T("%d"), gl->GetPlayCount(game));
+			return buf;
+		}
+		return LoadStringT(IDS_NO_PLAY_COUNT);
+	}
+	else if (seg.var == _T("game.playtime"))
+		return IsGameValid(game) ? pfv->PlayTimeAsText(gl->GetPlayTime(game)) : LoadStringT(IDS_NO_PLAY_TIME);
+	else if (seg.var == _T("game.lastplayed"))
+	{
+		if (IsGameValid(game))
+		{
+			DateTime d(gl->GetLastPlayed(game));
+			if (d.IsValid())
+				return d.FormatLocalDateTime(DATE_LONGDATE, TIME_NOSECONDS);
+			return LoadStringT(IDS_LAST_PLAYED_NEVER);
+		}
+		return LoadStringT(IDS_NO_LAST_PLAYED);
+	}
+	else if (seg.var == _T("game.tablefilename"))
+		return IsGameValid(game) ? game->filename : LoadStringT(IDS_NO_TABLE_FILE);
+	else if (seg.var == _T("filter.title"))
+		return filter->GetFilterTitle();
+	else if (seg.var == _T("filter.count"))
+		return MsgFmt(_T("%d"), GameList::Get()->GetCurFilterCount()).Get();
+	else if (seg.var == _T("credits"))
+		return FormatFraction(pfv->GetEffectiveCredits());
+	else if (seg.var == _T("lb"))
+		return _T("[");
+	else if (seg.var == _T("rb"))
+		return _T("]");
+	else
+		return seg.text; // no match - return the full original text
 }
 
 void PlayfieldView::FireStatusLineEvent(JsValueRef statusLineObj, const TSTRING &srcText, TSTRING &expandedText)
@@ -20461,7 +23319,7 @@ void PlayfieldView::FireStatusLineEvent(JsValueRef statusLineObj, const TSTRING
 
 			// replace the expanded text with the text in the event object
 			JavascriptEngine::JsObj eventObj(eventObjVal);
-			if (eventObj.Has(L"expandedText"))
+			if (eventObj.Has("expandedText"))
 				expandedText = eventObj.Get<TSTRING>("expandedText");
 		}
 		catch (JavascriptEngine::CallException exc)
@@ -20475,7 +23333,7 @@ void PlayfieldView::FireStatusLineEvent(JsValueRef statusLineObj, const TSTRING
 void PlayfieldView::StatusItem::Update(PlayfieldView *pfv, StatusLine *sl, float y)
 {
 	// get my new display text
-	TSTRING newDispText = ExpandText(pfv);
+	TSTRING newDispText = GetExpandedText(pfv);
 	
 	// fire the Javascript event
 	pfv->FireStatusLineEvent(sl->jsobj, this->srcText, newDispText);
@@ -20488,9 +23346,22 @@ void PlayfieldView::StatusItem::Update(PlayfieldView *pfv, StatusLine *sl, float
 	// store the new expanded text
 	dispText = newDispText;
 
+	// if we've already rendered this message, reuse the cached sprite
+	FontPref &statusFont = pfv->statusFont;
+	const int width = 1080, height = 75;
+	TSTRING cacheKey = MsgFmt(_T("%s|%d|%d|%d|%06lx|%06lx|"), statusFont.family.c_str(), statusFont.ptSize, statusFont.weight,
+		statusFont.italic ? 1 : 0, pfv->statusLineTextColor, pfv->statusLineShadowColor).Get() + dispText;
+	if (auto it = sl->spriteCache.find(cacheKey); it != sl->spriteCache.end())
+	{
+		sprite = it->second;
+		sprite->offset.y = -0.5f + float(height/2)/1920.f + y;
+		sprite->UpdateWorld();
+		pfv->UpdateDrawingList();
+		return;
+	}
+
 	// create the new sprite
 	sprite.Attach(new Sprite());
-	const int width = 1080, height = 75;
 	Application::InUiErrorHandler eh;
 	sprite->Load(width, height, [this, pfv, width, height](HDC hdc, HBITMAP)
 	{
@@ -20516,6 +23387,11 @@ void PlayfieldView::StatusItem::Update(PlayfieldView *pfv, StatusLine *sl, float
 		g.Flush();
 	}, eh, _T("Status Message"));
 
+	// add it to the cache, starting over if the cache is full
+	if (sl->spriteCache.size() >= StatusLine::maxSpriteCache)
+		sl->spriteCache.clear();
+	sl->spriteCache[cacheKey] = sprite;
+
 	// set it up in the proper location
 	sprite->offset.y = -0.5f + float(height/2)/1920.f + y;
 	sprite->UpdateWorld();
@@ -20605,7 +23481,7 @@ void PlayfieldView::StatusLine::JsSetText(int index, TSTRING txt)
 		if (i == index)
 		{
 			// this is the one - update it
-			s->srcText = txt;
+			s->SetSrcText(txt);
 
 			// if it's the current display item, refresh the display
 			if (s == curItem)
@@ -20707,15 +23583,15 @@ void PlayfieldView::AttractMode::OnTimer(PlayfieldView *pfv)
 	// so this is a good time to sneak in a save. 
 	if (savePending && dt > 15000)
 	{
-		// save files
-		Application::SaveFiles();
-
-		// Clear the "save pending" flag.  We only need to check
-		// this once per idle period, since there will be no new
-		// changes to commit until the user does something to cause
-		// a change.  That will require user interaction, which will
-		// reset the idle timer and reset the "save pending" flag.
-		savePending = false;
+		// Save files, and clear the "save pending" flag.  We only
+		// need to check this once per idle period, since there will
+		// be no new changes to commit until the user does something
+		// to cause a change.  That will require user interaction,
+		// which will reset the idle timer and reset the "save pending"
+		// flag.  The exception is game database files held back while
+		// a batch of game moves settles; keep checking until those
+		// have been written.
+		savePending = Application::SaveFiles();
 	}
 
 	// check the mode
@@ -20724,21 +23600,12 @@ void PlayfieldView::AttractMode::OnTimer(PlayfieldView *pfv)
 		// check to see if the auto game switch time has elapsed
 		if (dt > switchTime)
 		{
-			// Select a new game, randomly 1..10 games.  Note that this only
-			// goes forwards on the wheel, but if it were desirable we could
-			// just as well go backwards at random as well.  However, if we
-			// do want to use a +/- range, it's better to have some bias in
-			// one direction or the other (say, -5..+10), because a uniform
-			// window (e.g., -5..+5) will tend to do a "random walk" that
-			// averages out over time to no excursion from the starting point.
-			// It seems more interesting to jump around the whole wheel as
-			// attract mode progresses.   I actually don't think a +/- range
-			// is all that necessary simply because the wheel is a *wheel*,
-			// in that we'll cycle back to the "A" games after getting past
-			// the "Z" games.  So we'll end up going backwards, in a way,
-			// even with a forward-only random range.
-			int d = int(roundf((float(rand()) / float(RAND_MAX))*9.0f + 1.0f));
-			pfv->SwitchToGame(d, false, false, true);
+			// Switch to the game we chose at the last switch, and choose
+			// the next one, so that its media can load in the meantime.
+			// Run at the normal frame rate for the transition.
+			pfv->SwitchToGame(nextOffset, false, false, true);
+			nextOffset = RandomSwitchOffset();
+			pfv->OnAttractModeSwitch();
 
 			// reset the timer
 			t0 = GetTickCount();
@@ -20802,16 +23669,35 @@ void PlayfieldView::AttractMode::OnTimer(PlayfieldView *pfv)
 			// a while longer still before the user returns, so it's
 			// a good idea to commit changes now, in case there's a
 			// power loss or crash or something during the potentially
-			// long idle time to come.
+			// long idle time to come.  That includes any game database
+			// files held back for a batch of game moves.
 			if (savePending)
 			{
-				Application::SaveFiles();
+				Application::SaveFiles(true);
 				savePending = false;
 			}
 		}
 	}
 }
 
+int PlayfieldView::AttractMode::RandomSwitchOffset()
+{
+	// Select a new game, randomly 1..10 games.  Note that this only
+	// goes forwards on the wheel, but if it were desirable we could
+	// just as well go backwards at random as well.  However, if we
+	// do want to use a +/- range, it's better to have some bias in
+	// one direction or the other (say, -5..+10), because a uniform
+	// window (e.g., -5..+5) will tend to do a "random walk" that
+	// averages out over time to no excursion from the starting point.
+	// It seems more interesting to jump around the whole wheel as
+	// attract mode progresses.   I actually don't think a +/- range
+	// is all that necessary simply because the wheel is a *wheel*,
+	// in that we'll cycle back to the "A" games after getting past
+	// the "Z" games.  So we'll end up going backwards, in a way,
+	// even with a forward-only random range.
+	return int(roundf((float(rand()) / float(RAND_MAX))*9.0f + 1.0f));
+}
+
 void PlayfieldView::AttractMode::OnKeyEvent(PlayfieldView *pfv)
 {
 	// reset attract mode on any keystroke
@@ -20839,8 +23725,9 @@ void PlayfieldView::AttractMode::Reset(PlayfieldView *pfv)
 
 void PlayfieldView::AttractMode::StartAttractMode(PlayfieldView *pfv)
 {
-	// enter active mode
+	// enter active mode, and choose the first game to switch to
 	active = true;
+	nextOffset = RandomSwitchOffset();
 
 	// notify DOF
 	pfv->QueueDOFPulse(L"PBYScreenSaverStart");
@@ -20896,6 +23783,25 @@ void PlayfieldView::OnStartAttractMode()
 	// rebuild the display list - the list of visible layers can change in
 	// attract mode (e.g., we hide the wheel images)
 	UpdateDrawingList();
+
+	// start the low-power cycle and the preload for the first switch
+	OnAttractModeSwitch();
+}
+
+void PlayfieldView::OnAttractModeSwitch()
+{
+	// Run at the normal frame rate through the transition, and drop to
+	// the low-power rate when the timer fires
+	if (attractMode.IsLowPower())
+	{
+		D3DView::SetLowPowerFrameRate(0);
+		SetTimer(hWnd, attractLowPowerTimerID, AttractMode::lowPowerTransitionTime, NULL);
+	}
+
+	// Preload the media for the next attract mode game.  Do this after
+	// the usual prefetch delay, so that the loading doesn't compete with
+	// the transition to the game we just switched to.
+	SetTimer(hWnd, playfieldPrefetchTimerID, 750, NULL);
 }
 
 void PlayfieldView::OnEndAttractMode()
@@ -20903,6 +23809,18 @@ void PlayfieldView::OnEndAttractMode()
 	// set the DOF status to Wheel mode
 	dof.SetUIContext(L"PBYWheel");
 
+	// Return to the normal frame rates, resume any prefetched videos we
+	// paused, and go back to prefetching the wheel neighbors
+	KillTimer(hWnd, attractLowPowerTimerID);
+	D3DView::SetLowPowerFrameRate(0);
+	for (auto &p : playfieldPrefetch)
+	{
+		if (auto v = p.sprite->GetVideoPlayer(); v != nullptr)
+			v->SetPause(false);
+	}
+	if (playfieldPrefetchCount > 0)
+		SetTimer(hWnd, playfieldPrefetchTimerID, 750, NULL);
+
 	// restore status line updates
 	DisableStatusLine();
 	EnableStatusLine();
@@ -20956,6 +23874,18 @@ void PlayfieldView::ShowDOFClientInitErrors()
 	}
 }
 
+void PlayfieldView::OnDOFStartupReady()
+{
+	// show any DOF client errors
+	ShowDOFClientInitErrors();
+
+	// send any context settings made while DOF was loading
+	dof.OnDOFReady();
+
+	// sync the current game context
+	dof.SyncSelectedGame();
+}
+
 void PlayfieldView::QueueDOFPulse(const WCHAR *name, bool fromJs)
 {
 	// Skip this if DOF isn't ready
@@ -8,6 +8,8 @@
 
 #pragma once
 
+#include <d2d1.h>
+#include <dwrite.h>
 #include "../Utilities/Config.h"
 #include "../Utilities/Joystick.h"
 #include "../Utilities/KeyInput.h"
@@ -26,6 +28,11 @@
 #include "HighScores.h"
 #include "GameList.h"
 #include "JavascriptEngine.h"
+#include "JavascriptWorker.h"
+#include "JavascriptAsyncIO.h"
+#include "CaptureEncodeQueue.h"
+#include "MediaDropInstaller.h"
+#include "MediaRenamer.h"
 #include "FontPref.h"
 
 class Sprite;
@@ -66,6 +73,18 @@ public:
 	// Show any errors from DOF Client initialization
 	void ShowDOFClientInitErrors();
 
+	// Finish the UI side of the DOF setup at startup.  The startup task
+	// scheduler calls this when the background DOF initialization is done.
+	void OnDOFStartupReady();
+
+	// Preload the button sound effects.  This looks up the sound files
+	// and loads them into the audio manager, so that the first press of
+	// each button doesn't have to wait for the file search and load.
+	// The application calls this at startup once the game list (which
+	// determines the media folders) is loaded, and we call it again on
+	// a config reload.
+	void PreloadButtonSounds();
+
 	// Update keyboard shortcut listings in a menu.  We call this when
 	// creating a menu and again whenever the keyboard preferences are
 	// updated.  The parent window can also call this to update Player
@@ -103,6 +122,12 @@ public:
 	// Show the settings dialog
 	void ShowSettingsDialog();
 
+	// Preload the settings dialog DLL and its slow-to-gather data.  This
+	// runs on a background thread at startup (see the "Options dialog
+	// preload" startup task).  Errors are ignored here, since they'll be
+	// reported when the user actually tries to open the dialog.
+	static void PreloadSettingsDialog();
+
 	// Is the settings dialog running?
 	bool IsSettingsDialogOpen() const { return settingsDialogOpen; }
 
@@ -144,6 +169,24 @@ public:
 	// configurtion status for Topmost During Game Launch
 	bool isTopmostDuringLaunch = false;
 
+	// Yield resources to the game.  If this option is set, run freeze
+	// mode also releases the wheel images, cached sprites, and textures,
+	// trims the swap chains, and empties the working set, to give the
+	// running game as much video and physical memory as possible.
+	// resourcesYielded is set while the resources are released.
+	bool yieldResourcesToGame = false;
+	bool resourcesYielded = false;
+
+	// Game launch overlap policy, from the GameLaunch.* settings.  With
+	// launchOverlap set, we start the game monitor thread before shutting
+	// down DOF and the real DMD, and only queue the file saves rather than
+	// waiting for them; the monitor thread waits for both before it starts
+	// the game.  With launchReleaseVideos set, we release the playfield
+	// video as soon as the opaque running game overlay has faded in, rather
+	// than keeping it decoding behind the overlay until run freeze mode.
+	bool launchOverlap = true;
+	bool launchReleaseVideos = true;
+
 	// flag: we applied the pre-run topmost status
 	bool preRunTopmostApplied = false;
 
@@ -315,12 +358,20 @@ public:
 	// load multiple videos at once.
 	bool IsSimultaneousSync() const { return simultaneousSync; }
 
+	// Sync all of the secondary windows to the current game at once, for
+	// simultaneous sync mode.  This is a coordinated pass: we first
+	// resolve the media files for all of the windows as a batch, on the
+	// loader pool, and then sync each window in priority order (backglass,
+	// DMD, topper, instruction card, custom windows) with its media
+	// already in hand.
+	void SyncAllViews();
+
 	// Get the configured crossfade time (in milliseconds)
 	DWORD GetCrossfadeTime() const { return crossfadeTime; }
 
 	// Invoke a Javascript drawing callback to draw into the given Gdiplus 
 	// context
-	void JsDraw(Sprite *sprite, int width, int height, JsValueRef drawFunc);
+	void JsDraw(Sprite *sprite, int width, int height, JsValueRef drawFunc, bool gpu = false);
 
 	// Fire a Javascript end-of-video event
 	void FireVideoEndEvent(JsValueRef drawingLayerObj, bool looping);
@@ -331,6 +382,31 @@ public:
 		TSTRING *video, TSTRING *image, TSTRING *defaultVideo, TSTRING *defaultImage);
 	void FireMediaSyncEndEvent(BaseView *view, GameListItem *game, const TCHAR *disposition);
 
+	// Fire a Javascript PerfBudgetEvent for a view that entered or left
+	// the over-budget state
+	void FirePerfBudgetEvent(BaseView *view);
+
+	// Set the benchmark sprite.  The media benchmark (see Benchmark.h)
+	// uses this to display each item under test through the normal
+	// rendering path.  The sprite goes on top of everything else.  Pass
+	// null to remove it.
+	void SetBenchmarkSprite(Sprite *sprite);
+
+	// Play back a recorded key event.  The session benchmark uses this to
+	// replay a session recording (see SessionRecorder.h).  'mode' is a
+	// KeyPressType value, and 'cmds' lists the command names.  The event
+	// is processed as though it came from an input device.
+	void PlaybackKeyEvent(int mode, int repeatCount, bool bg, const std::vector<TSTRING> &cmds);
+
+	// Reset the UI to a fixed starting point for a session playback: the
+	// All Games filter, with the first game by title selected.
+	void ResetForPlayback();
+
+	// Get the name of the current UI state, for the session benchmark's
+	// per-phase statistics: "game" (a game is running), "attract",
+	// "menu", "popup", or "wheel".  This is a static string.
+	const CHAR *GetUIPhase() const;
+
 protected:
 	// destruction - called internally when the reference count reaches zero
 	~PlayfieldView();
@@ -338,7 +414,7 @@ protected:
 	// ConfigManager::Subscriber implementation
 	virtual void OnConfigPreSave() override;
 	virtual void OnConfigPostSave(bool succeeded) override;
-	virtual void OnConfigReload() override { OnConfigChange(); }
+	virtual void OnConfigReload(const ConfigManager::ChangeSet &changes) override { OnConfigChange(changes); }
 
 	TSTRING defaultFontFamily;                // default font family for all fonts
 	FontPref popupTitleFont{ 48 };      // title font for popups
@@ -445,6 +521,12 @@ protected:
 	// window creation
 	virtual bool OnCreate(CREATESTRUCT *cs) override;
 
+	// D3D device recovery.  We release the wheel, the menus and popups,
+	// and the sprite caches along with the base class resources, and
+	// rebuild them with a full selection update.
+	virtual void ReleaseDeviceResources() override;
+	virtual bool RestoreDeviceResources() override;
+
 	// process a command
 	virtual bool OnCommand(int cmd, int source, HWND hwndControl) override;
 
@@ -514,8 +596,11 @@ protected:
 	};
 	std::unordered_map<int, JavascriptJoystickAxisEventEnabler> javascriptJoystickAxisEventEnablers;
 
-	// set internal variables according to the config settings
-	void OnConfigChange();
+	// Set internal variables according to the config settings.  'changes'
+	// is the set of changed variables; we use this to skip rebuilding
+	// derived resources (such as the status lines and the cached wheel
+	// images) whose settings haven't changed.
+	void OnConfigChange(const ConfigManager::ChangeSet &changes = ConfigManager::ChangeSet::everything);
 
 	// is the settings dialog open?
 	bool settingsDialogOpen;
@@ -562,6 +647,11 @@ protected:
 	static const int wheelFadeTimerID = 131;      // fading the wheel in or out
 	static const int forceToFgTimerID = 132;      // press-and-hold EXIT GAME button to bring app to foreground
 	static const int wheelRepeatTimerID = 133;    // wheel navigation repeat timer
+	static const int playfieldPrefetchTimerID = 134; // neighbor playfield media prefetch
+	static const int nvramPrescanTimerID = 135;   // NVRAM high score pre-scan batches
+	static const int popupPrerenderTimerID = 136; // pre-rendering popups for the games around the selection
+	static const int attractLowPowerTimerID = 137; // attract mode low-power stage after a game switch
+	static const int perfBudgetTimerID = 138;     // frame budget checks for the Javascript PerfBudgetEvent
 
 	// update the selection to match the game list
 	void UpdateSelection(bool fireEvents);
@@ -579,6 +669,27 @@ protected:
 	// so we don't have to do anything special for thread safety.
 	void IncomingPlayfieldMediaDone(VideoSprite *sprite);
 
+	// Get the playfield video and image files for a game.  The video
+	// is left empty if videos are disabled.
+	void GetPlayfieldMediaFiles(GameListItem *game, TSTRING &video, TSTRING &image);
+
+	// Load playfield media into a sprite.  This tries the video first,
+	// then the image, then the default video and image.  This is the
+	// common loader for the incoming playfield and the prefetch list.
+	static bool LoadPlayfieldSprite(VideoSprite *sprite, HWND hWnd, SIZE szLayout,
+		const TSTRING &video, const TSTRING &image, bool videosEnabled, int volumePct,
+		ErrorHandler &eh);
+
+	// Update the playfield prefetch list for the current selection.  This
+	// discards prefetched media for games that are no longer neighbors of
+	// the selection, and loads media for the new neighbors.
+	void UpdatePlayfieldPrefetch();
+
+	// Adopt prefetched media as the incoming playfield, if we have a
+	// prefetch entry for the game loaded from the given files.  Returns
+	// true if so, false if the media has to be loaded normally.
+	bool AdoptPrefetchedPlayfield(GameListItem *game, const TSTRING &video, const TSTRING &image, int volumePct);
+
 	// Load a wheel image
 	Sprite *LoadWheelImage(const GameListItem *game);
 
@@ -604,6 +715,30 @@ protected:
 	void PlayGame(int cmd, DWORD launchFlags, int systemIndex = -1);
 	void ShowFlyer(int pageNumber = 0);
 	void ShowGameInfo();
+
+	// Render the Game Info box for a game into a new sprite, with the
+	// given minimum height in pixels.  Returns the new sprite, or null
+	// on failure.
+	Sprite *RenderGameInfo(GameListItem *game, int minHeight, ErrorHandler &eh);
+
+	// Get the popup cache key for a game's Game Info box
+	TSTRING GetGameInfoCacheKey(GameListItem *game);
+
+	// approximate texture size of a popup sprite, for the cache
+	static INT64 GetPopupCacheBytes(Sprite *sprite);
+
+	// Pre-render popups for the games around the selection.  This does
+	// one Game Info box per call, and kills the popup pre-render timer
+	// when everything is up to date.
+	void PrerenderPopups();
+
+	// Pre-rendered popup cache.  When the selection settles, we render
+	// the Game Info boxes for the current game and its neighbors into
+	// this cache (and pre-load their instruction cards in the window
+	// that will show them), so that the popups appear without a delay.
+	// Flyer pages also go here as they're shown, so that paging back
+	// and forth through a game's flyers doesn't reload the images.
+	SpriteCache popupCache{ 8 };
 	void ShowInstructionCard(int cardNumber = 0);
 	void RateGame();
 	void ShowHighScores();
@@ -655,6 +790,23 @@ protected:
 	// has the high score system finished initializing yet?
 	bool hiScoreSysReady = false;
 
+	// Start using the high score system.  This runs when the high score
+	// system has initialized and DOF startup is complete, since the NVRAM
+	// file lookups can use the ROM names from the DOF config.
+	void OnHighScoreSysReady();
+
+	// Games remaining to be pre-scanned for high scores, by internal ID.
+	// At startup, we pre-scan every game's NVRAM file in the background,
+	// so that the PINemHi results are already in the high score result
+	// cache when the user first visits each game.  We walk the list a
+	// few games at a time on a timer, since the game list can only be
+	// accessed from the UI thread; the PINemHi queries themselves run
+	// on the loader pool, at low priority.
+	std::vector<LONG> nvramPrescanQueue;
+
+	// pre-scan the next batch of games in the NVRAM pre-scan queue
+	void NvramPrescanBatch();
+
 	// High score request object.  This is an abstract interface that
 	// can be implemented to do extra work on receiving high score results.
 	class HighScoresReadyCallback
@@ -778,12 +930,29 @@ protected:
 	// files that need to be renamed, use GameList::UpdateMediaName(), which
 	// figures the new media name and locates any affected files.  Returns true
 	// if all renames succeed, false on error.  Any errors are logged to the 
-	// provided error handler.
+	// provided error handler.  The renames are all-or-nothing: if any file
+	// can't be renamed, the files already renamed are restored.
 	bool ApplyGameChangesRenameMediaFiles(
 		GameListItem *game,
 		const std::list<std::pair<TSTRING, TSTRING>> &mediaRenameList,
 		ErrorHandler &eh);
 
+	// Rename media files in the background.  This does the same work as
+	// ApplyGameChangesRenameMediaFiles(), on a background thread, so that
+	// the UI stays responsive while the files are renamed.  The caller
+	// should apply the new media name to the database right away, as
+	// though the renames had succeeded; if they fail and are rolled back,
+	// OnMediaRenameDone() restores 'oldMediaName' and reports the errors.
+	void ApplyGameChangesRenameMediaFilesAsync(
+		GameListItem *game, const TCHAR *oldMediaName,
+		const std::list<std::pair<TSTRING, TSTRING>> &mediaRenameList);
+
+	// Background media rename completed
+	void OnMediaRenameDone();
+
+	// Background media renamer in progress, if any
+	RefPtr<MediaRenamer> mediaRenamer;
+
 	// Apply changes made to a game's in-memory records to the database.
 	void ApplyGameChangesToDatabase(GameListItem *game);
 
@@ -827,6 +996,9 @@ protected:
 	// process a capture done report from the launch thread
 	void OnCaptureDone(const CaptureDoneReport *report);
 
+	// process a deferred encoding completion from the batch encode queue
+	void OnCaptureEncodeDone();
+
 	// Media capture list.  This represents the items selected for
 	// screen-shot capture in the menu UI.
 	struct CaptureItem
@@ -933,7 +1105,22 @@ protected:
 	// captures, we calculate the time according to the existence
 	// of media for this specific game.  Returns the time estimate
 	// in seconds.
-	int EstimateCaptureTime(GameListItem *game = nullptr);
+	//
+	// If 'encodeTime' is non-null, the caller is planning a pipelined
+	// batch capture, where the second pass of a two-pass capture runs in
+	// the background.  In this case, the second-pass time is returned
+	// separately in *encodeTime, rather than included in the result.
+	int EstimateCaptureTime(GameListItem *game = nullptr, int *encodeTime = nullptr);
+
+	// Estimate the total running time for the current batch capture
+	// selection, in seconds, and count the games with work to do.  For a
+	// pipelined batch, this models the background encoders running
+	// alongside the captures of the following games.
+	int EstimateBatchCaptureTime(int &nGames);
+
+	// Is the batch capture pipelined?  This is the case when two-pass
+	// encoding and deferred encoding are both enabled.
+	bool IsBatchCapturePipelined() const;
 
 	// Format a capture time estimate to a printable string
 	static TSTRINGEx FormatCaptureTimeEstimate(int t);
@@ -1071,8 +1258,18 @@ protected:
 
 	// Add the media from the drop list.  This is invoked when the
 	// user clicks the "go" option from the drop confirmation menu.
+	// The files are installed on a background thread, by the media
+	// drop installer; OnMediaDropDone() reports the results.
 	void MediaDropGo();
 
+	// Media drop installation completed
+	void OnMediaDropDone();
+
+	// Media drop installer for the drop in progress, if any.  Only one
+	// installation runs at a time; a second drop waits for the first
+	// to finish.
+	RefPtr<MediaDropInstaller> mediaDropInstaller;
+
 	// Check to see if we can add media to the game.  This checks to
 	// see if the game's manufacturer, system, and year are configured.
 	// If so, it simply returns true to indicate that media can be
@@ -1152,11 +1349,14 @@ protected:
 			nMediaItemsAttempted = 0;
 			nMediaItemsOk = 0;
 			cancelPending = cancel = false;
+			finishing = false;
 		}
 
 		void Exit()
 		{
 			active = false;
+			finishing = false;
+			encodeQueue = nullptr;
 		}
 
 		// batch capture mode is active
@@ -1178,6 +1378,14 @@ protected:
 		int nMediaItemsPlanned;
 		int nMediaItemsAttempted;
 		int nMediaItemsOk;
+
+		// Deferred encoding queue, for a pipelined batch.  The games'
+		// second passes run here in the background.
+		RefPtr<CaptureEncodeQueue> encodeQueue;
+
+		// All of the games have been captured, and we're waiting for the
+		// encode queue to finish before ending the batch
+		bool finishing = false;
 		
 	} batchCaptureMode;
 
@@ -1274,10 +1482,21 @@ protected:
 	// text, and if it differs, we replace the sprite.  This lets
 	// us reuse sprites for as long as they're valid, while still
 	// updating them as needed.
+	//
+	// The source text is parsed into a template of literal segments and
+	// macro segments when it's set, so that expanding it doesn't have to
+	// scan the text again.  The template also records which data sources
+	// its macros draw on (the game selection and its stats, the filter,
+	// the credit balance), and we keep a snapshot of those sources as of
+	// the last expansion, so that checking whether the item needs an
+	// update only has to expand the text when one of them has changed.
 	struct StatusLine;
 	struct StatusItem
 	{
-		StatusItem(const TCHAR *srcText) : srcText(srcText) { }
+		StatusItem(const TCHAR *srcText) { SetSrcText(srcText); }
+
+		// set the source text, parsing it into the template
+		void SetSrcText(const TSTRING &txt);
 
 		// Update the item's sprite if necessary
 		void Update(PlayfieldView *pfv, StatusLine *sl, float y);
@@ -1288,10 +1507,64 @@ protected:
 		// expand macros in my text
 		TSTRING ExpandText(PlayfieldView *pfv);
 
-		TSTRING srcText;         // source text, which might contain {xxx} macros
+		// Get the expanded text, reusing the last expansion if the data
+		// sources haven't changed since
+		const TSTRING &GetExpandedText(PlayfieldView *pfv);
+
+		TSTRING srcText;         // source text, which might contain [xxx] macros
 		TSTRING dispText;        // display text, with macros expanded
 		RefPtr<Sprite> sprite;   // sprite
 
+		// Template segment.  A literal segment has an empty variable name.
+		// For a macro segment, 'text' is the full original macro text, which
+		// is the expansion if the variable name isn't recognized.
+		struct Segment
+		{
+			TSTRING text;        // literal text, or the original macro text
+			TSTRING var;         // variable name, in lower case
+			TSTRING suffix;      // ":" suffix sections, including the leading ':'
+			TSTRING form1;       // singular form (first ':' section), for counts
+			TSTRING form2;       // plural form (second ':' section)
+			TSTRING form0;       // zero form (third ':' section)
+			bool hasForms = false;   // are there at least two ':' sections?
+			bool hasForm0 = false;   // is there a third ':' section?
+		};
+		std::vector<Segment> segments;
+
+		// expand a macro segment
+		TSTRING ExpandMacro(const Segment &seg, PlayfieldView *pfv);
+
+		// data sources the template depends upon (SrcXxx bits)
+		static const DWORD SrcGame = 0x0001;
+		static const DWORD SrcFilter = 0x0002;
+		static const DWORD SrcCredits = 0x0004;
+		DWORD sources = 0;
+
+		// Source snapshot as of the last expansion.  Only the sources the
+		// template depends upon are filled in.
+		struct SourceState
+		{
+			GameListItem *game = nullptr;
+			UINT64 gameStatsStamp = 0;
+			const GameListFilter *filter = nullptr;
+			int filterCount = 0;
+			float credits = 0.0f;
+
+			bool operator==(const SourceState &s) const
+			{
+				return game == s.game && gameStatsStamp == s.gameStatsStamp
+					&& filter == s.filter && filterCount == s.filterCount
+					&& credits == s.credits;
+			}
+		};
+		SourceState GetSourceState(PlayfieldView *pfv) const;
+		SourceState lastSources;
+
+		// Text from the last expansion, before the Javascript event had a
+		// chance to change it.  This is valid if 'expanded' is set.
+		TSTRING lastExpandedText;
+		bool expanded = false;
+
 		// Is this item temporary?  A temporary item is removed from the
 		// list after being displayed once.
 		bool isTemp = false;
@@ -1376,6 +1649,19 @@ protected:
 
 		// Horizontal slide distance while fading
 		float fadeSlide;
+
+		// Rendered message cache.  Status lines usually cycle through a
+		// small, fixed set of messages, so we keep the sprite for each
+		// message we've rendered, keyed by the expanded text plus the font
+		// and colors, and reuse it when the same message comes around
+		// again.  Items showing the same message share a sprite, which
+		// is fine since only the current item is ever displayed.
+		std::unordered_map<TSTRING, RefPtr<Sprite>> spriteCache;
+
+		// maximum number of cache entries; we clear the cache and start
+		// over when it fills up, so that messages with ever-changing
+		// text (clocks, counters) can't grow it without bound
+		static const size_t maxSpriteCache = 32;
 	};
 
 	// Are the status line messages enabled?
@@ -1433,6 +1719,31 @@ protected:
 	// asynchronous loader for the playfield sprite
 	AsyncSpriteLoader playfieldLoader;
 
+	// Playfield prefetch list.  To let the cross-fade start immediately
+	// when the wheel moves, we keep the playfield media for the games on
+	// either side of the current selection loaded in the background, with
+	// the videos running muted, so that their first frames are already
+	// decoded.  When one of these games becomes the selection, we adopt
+	// its prefetched sprite as the incoming playfield rather than loading
+	// the media from scratch.  Each entry records the media files it was
+	// loaded from, so that we don't use a stale entry if the game's media
+	// changed in the meantime.
+	struct PrefetchedPlayfield
+	{
+		PrefetchedPlayfield(GameListItem *game, const TSTRING &video, const TSTRING &image, VideoSprite *sprite) :
+			game(game), video(video), image(image), sprite(sprite, RefCounted::DoAddRef) { }
+
+		GameListItem *game;
+		TSTRING video;
+		TSTRING image;
+		RefPtr<VideoSprite> sprite;
+	};
+	std::list<PrefetchedPlayfield> playfieldPrefetch;
+
+	// Number of games to prefetch on each side of the selection.  Zero
+	// disables prefetching.
+	int playfieldPrefetchCount = 1;
+
 	// Underlay enabled
 	bool underlayEnabled = true;
 
@@ -1532,6 +1843,48 @@ protected:
 	// switch animations, we add the next game on the incoming side.
 	std::list<RefPtr<Sprite>> wheelImages;
 
+	// Wheel icon texture atlas.  Wheel images from still image files
+	// are rasterized at their display size and packed into this atlas,
+	// so that scrolling through the wheel only has to copy each new 
+	// icon into a free cell, rather than allocating a new texture for
+	// every icon that comes into view.  The cell size depends on the
+	// window layout, so we create a new atlas when the layout changes;
+	// the old one is discarded when the last icon using it is released.
+	RefPtr<TextureAtlas> wheelAtlas;
+
+	// get the wheel icon atlas for the current layout
+	TextureAtlas *GetWheelAtlas();
+
+	// Wheel icon cache.  UpdateSelection() rebuilds the whole wheel,
+	// which happens on every filter change, layout change, and return
+	// from a game, so we keep a small LRU cache of recently built wheel
+	// sprites to let a rebuild reuse the icons it already has, rather
+	// than reloading every image file and re-rendering every synthesized
+	// title image.  The key identifies everything the icon's appearance
+	// depends on: the game, the layout size, and the source file and its
+	// modification time, or the title text for a synthesized icon.  The
+	// font and color settings also affect the synthesized icons, so we
+	// clear the cache on configuration changes.
+	struct WheelImageCacheEntry
+	{
+		WheelImageCacheEntry(LONG gameId, SIZE layout, const TSTRING &source, const FILETIME &mtime, Sprite *sprite) :
+			gameId(gameId), layout(layout), source(source), mtime(mtime), sprite(sprite, RefCounted::DoAddRef) { }
+
+		LONG gameId;
+		SIZE layout;
+		TSTRING source;
+		FILETIME mtime;
+		RefPtr<Sprite> sprite;
+
+		bool Matches(LONG id, SIZE sz, const TSTRING &src, const FILETIME &ft) const
+		{
+			return gameId == id && layout.cx == sz.cx && layout.cy == sz.cy
+				&& source == src && CompareFileTime(&mtime, &ft) == 0;
+		}
+	};
+	std::list<WheelImageCacheEntry> wheelImageCache;
+	static const size_t maxWheelImageCacheSize = 64;
+
 	// wheel fade in/out
 	void AnimateWheelFade();
 	bool wheelVisible = true;
@@ -1731,6 +2084,9 @@ protected:
 	RefPtr<Sprite> creditsSprite;
 	DWORD creditsStartTime;
 
+	// media benchmark item under test, if any
+	RefPtr<Sprite> benchmarkSprite;
+
 	// update/remove the credits display
 	void OnCreditsDispTimer();
 
@@ -1774,6 +2130,19 @@ protected:
 	};
 	std::unordered_map<DWORD, ActiveAudio> activeAudio;
 
+	// Preloaded launch audio clip.  We open a player for the selected
+	// game's launch audio when the game is selected, so that the clip
+	// can start playing the moment the game launches, rather than
+	// waiting for the player to open the file.  'launchAudioPreloadFile'
+	// is the clip's file, for checking that it's still the right one
+	// at launch time.
+	RefPtr<AudioVideoPlayer> launchAudioPreload;
+	TSTRING launchAudioPreloadFile;
+
+	// Preload the launch audio for a newly selected game, discarding
+	// any clip preloaded for the previous selection
+	void PreloadLaunchAudio(GameListItem *game);
+
 	// update audio fading - runs on the audio fadeout timer
 	void UpdateAudioFadeout();
 
@@ -1884,6 +2253,46 @@ protected:
 	// the old menu finishes.
 	RefPtr<Menu> newMenu;
 
+	// Recently shown menus.  Reopening a menu with the same contents (the
+	// main menu after backing out of a submenu, or a page of a paged menu
+	// that was already visited) reuses its rendered sprites instead of
+	// drawing the GDI+ bitmaps again.  Entries are keyed by the menu's
+	// content (see GetMenuCacheKey()), most recently used first, and
+	// register with the texture budget as evictable.  The fonts and
+	// colors aren't part of the key, so a settings reload clears the
+	// cache.
+	struct MenuCacheEntry : TextureBudget::Evictable
+	{
+		MenuCacheEntry(const TSTRING &key, Menu *menu, int page) :
+			key(key), menu(menu, RefCounted::DoAddRef), page(page) { }
+		~MenuCacheEntry() { Unregister(); }
+
+		virtual INT64 GetEvictableBytes() const override;
+		virtual void Evict() override { menu = nullptr; }
+
+		TSTRING key;
+		RefPtr<Menu> menu;
+		int page;          // page shown, after wrapping the requested page number
+	};
+	std::list<std::unique_ptr<MenuCacheEntry>> menuCache;
+	static const size_t maxMenuCache = 6;
+
+	// build the cache key for a menu, from its descriptors and page number
+	static TSTRING GetMenuCacheKey(const Menu *m, int pageno);
+
+	// Look up a cached menu.  Returns null if there's no live entry, or
+	// if the entry is for the current or pending menu, since those
+	// sprites are in use for their own animations.  On success, fills
+	// in the page number shown.
+	Menu *GetCachedMenu(const TSTRING &key, int &page);
+
+	// add a menu to the cache
+	void AddMenuToCache(const TSTRING &key, Menu *m, int page);
+
+	// Display a menu whose sprites are ready.  This selects the initial
+	// item and starts the transition from the current menu.
+	void ActivateMenu(Menu *m, const std::list<MenuItemDesc> &items, DWORD flags);
+
 	// Current menu's item descriptor list
 	std::list<MenuItemDesc> curMenuDesc;
 
@@ -1990,9 +2399,21 @@ protected:
 	// the timer is running, and starts it if not.  In any case, we
 	// fill in startTime with the current time, as the reference time
 	// for the current animation.
+	//
+	// The animation is stepped from the render loop, once per frame, at
+	// the frame's AnimClock time (see OnAnimationFrame).  The Windows
+	// timer is only a slow fallback that keeps the animation moving
+	// when the window isn't rendering, so that animations still run to
+	// completion and fire their end-of-animation actions.
 	void StartAnimTimer();
 	void StartAnimTimer(DWORD &startTime);
 
+	// fallback animation timer interval
+	static const DWORD AnimTimerInterval = 50;
+
+	// per-frame animation update, from the render loop
+	virtual bool OnAnimationFrame() override;
+
 	// is the animation timer running?
 	bool isAnimTimerRunning;
 
@@ -2015,6 +2436,10 @@ protected:
 	// idle mode - showing a menu, showing a popup, switching games, etc.
 	void HideInfoBox();
 
+	// start/end the info box fade
+	void StartInfoBoxFade();
+	void EndInfoBoxFade();
+
 	// update the info box animation
 	void UpdateInfoBoxAnimation();
 
@@ -2068,8 +2493,9 @@ protected:
 	// Incoming playfield load time.  This is
 	DWORD incomingPlayfieldLoadTime;
 
-	// Game info box fade start time
+	// Game info box fade start time, and fade-in-progress flag
 	DWORD infoBoxStartTime;
+	bool infoBoxFading = false;
 
 	// running game popup start time and animation mode
 	DWORD runningGamePopupStartTime;
@@ -2113,8 +2539,30 @@ protected:
 			savePending = true;
 			hideWheelImages = false;
 			hideInfoBox = true;
+			nextOffset = 1;
+			lowPowerFrameRate = 0;
 		}
 
+		// Low-power frame rate, or zero to disable the low-power profile.
+		// When enabled, all windows drop to this frame rate between game
+		// switches.  Each switch runs at the normal rate for the length
+		// of the transition (lowPowerTransitionTime), so that the wheel
+		// animation and cross-fades stay smooth, and then drops back to
+		// the low rate until the next switch.
+		int lowPowerFrameRate;
+		static const DWORD lowPowerTransitionTime = 2500;
+
+		// Is the low-power profile in effect?
+		bool IsLowPower() const { return active && lowPowerFrameRate != 0; }
+
+		// Wheel offset of the next game we'll switch to.  We choose this
+		// at the previous switch, rather than at the switch itself, so
+		// that we can preload the game's media in the meantime.
+		int nextOffset;
+
+		// choose a random wheel offset for the next switch
+		static int RandomSwitchOffset();
+
 		// should we hide wheel images while in attract mode?
 		bool hideWheelImages;
 
@@ -2208,9 +2656,22 @@ protected:
 	void OnStartAttractMode();
 	void OnEndAttractMode();
 
+	// Handle an attract mode game switch (or the initial entry).  This
+	// starts the low-power cycle for the switch, if that's enabled, and
+	// schedules the preload for the next switch.
+	void OnAttractModeSwitch();
+
 	// Play a button or event sound effect
 	void PlayButtonSound(const TCHAR *effectName, float volume = 1.0f);
 
+	// Button sound file paths, by effect name.  Searching the media
+	// folders for the file on every button press would add file system
+	// latency to every sound, so we look up each name once and keep the
+	// result.  An empty path means that the sound doesn't exist.  This
+	// is cleared on a config reload, since the media folders can change.
+	std::unordered_map<TSTRING, TSTRING> buttonSoundPaths;
+	const TSTRING &GetButtonSoundPath(const TCHAR *effectName);
+
 	// Play a button or event sound effect, respecting the auto-repeat-mute
 	// option if this is a repeated key.
 	void PlayButtonSoundRpt(const TCHAR *effectName, int repeatCount, float volume = 1.0f);
@@ -2557,6 +3018,9 @@ protected:
 	};
 	std::unordered_map<TSTRING, KeyCommand> commandsByName;
 
+	// List of commands assigned to a key or button
+	typedef std::vector<const KeyCommand*> CommandList;
+
 	// "No Command" command
 	static const KeyCommand NoCommand;
 
@@ -2564,8 +3028,20 @@ protected:
 	// menu command IDs.
 	std::unordered_map<TSTRING, int> commandNameToMenuID;
 
-	// Keyboard command dispatch table
-	std::unordered_map<int, std::list<const KeyCommand*>> vkeyToCommand;
+	// Keyboard command dispatch table.  This is a dense array indexed
+	// by VK_xxx or VKE_xxx code, so that each key event takes a single
+	// array index to find its commands.  The VKE_xxx codes cover the
+	// extended keys that we distinguish by scan code, so this covers
+	// the scan code mapping as well.  We rebuild this on each config
+	// change.
+	static const int nVkeyCommands = VKE_LAST + 1;
+	CommandList vkeyToCommand[nVkeyCommands];
+
+	// get the command list for a key, or null if it has no commands
+	const CommandList *GetVkeyCommands(int vkey) const
+	{
+		return vkey >= 0 && vkey < nVkeyCommands && vkeyToCommand[vkey].size() != 0 ? &vkeyToCommand[vkey] : nullptr;
+	}
 
 	// Capture "Manual Go" button mode.
 	enum CaptureManualGoButton
@@ -2621,12 +3097,20 @@ protected:
 		bool bg;                // background mode
 		bool scripted;          // originated from a script
 		const KeyCommand *cmd;  // command
+		int64_t arrivalTime = 0; // input arrival time, for latency measurement (see InputLatency); 0 if not measured
 	};
 	std::list<QueuedKey> keyQueue;
 
+	// Latency measurement for the key command being processed.  While
+	// a measured command is running, UpdateSelection() adds its running
+	// time to latencyMediaTicks, so that we can report media loading
+	// separately from the rest of the command handling.
+	bool latencyTiming = false;
+	int64_t latencyMediaTicks = 0;
+
 	// Add a key press to the queue and process it
 	void ProcessKeyPress(HWND hwndSrc, KeyPressType mode, int repeatCount,
-		bool bg, bool scripted, std::list<const KeyCommand*> cmds);
+		bool bg, bool scripted, const CommandList &cmds);
 
 	// Process the key queue.  On a keyboard event, we add the key
 	// to the queue and call this routine; we also call it whenever
@@ -2775,35 +3259,49 @@ protected:
 	// Wheel auto-repeat timer handler
 	void OnWheelAutoRepeatTimer();
 
+	// Coalesce queued wheel steps.  When the UI falls behind the
+	// input, the key queue can back up with further presses of the
+	// same Next/Prev command.  Rather than animating through each
+	// intermediate game in turn, the base-mode wheel handlers call
+	// this to pull the backlog off the front of the queue and move
+	// directly to the final position in one multi-step switch.
+	// Returns the total number of steps to move, including the
+	// current key.
+	int CoalesceWheelSteps(const QueuedKey &key);
+
 	// Stop keyboard and joystick auto-repeat timers.  We call this
 	// whenever a new joystick button or key press occurs, to stop
 	// any previous auto-repeat.
 	void StopAutoRepeat();
 
-	// Joystick command dispatch table.  This maps keys generated
-	// by JsCommandKey() to command handler function pointers.
+	// Joystick command dispatch table.  This has a dense button
+	// array for each logical joystick unit, indexed by button number,
+	// like the keyboard table above.  Units are added as commands are
+	// assigned to them.
 	//
-	// Note that this table contains no entries here with the
-	// unit number encoded as -1, representing generic buttons 
-	// that match any joystick.  Instead, for each command
-	// assigned to a unit -1 button, we create a separate entry
-	// for the same command in each actual joystick unit.  That
-	// means we can find every command in one lookup, whether
-	// assigned to a particular joystick or to any joysticks.
-	//
-	// Unordered_map takes slightly longer for a lookup operation
-	// than a simple array does (such as we use for keyboard key 
-	// dispatch above), but it's still very fast - about 120ns
-	// per lookup on average on my 4th gen i7.  That's negligible
-	// for a joystick event, so I don't think anything more complex
-	// is justified.
-	std::unordered_map<int, std::list<const KeyCommand*>> jsCommands;
-
-	// add a command to the map
+	// Note that this table contains no entries for unit -1,
+	// representing generic buttons that match any joystick.
+	// Instead, for each command assigned to a unit -1 button, we
+	// create a separate entry for the same command in each actual
+	// joystick unit.  That means we can find every command in one
+	// lookup, whether assigned to a particular joystick or to any
+	// joysticks.
+	static const int nJsButtonCommands = 256;
+	std::vector<std::unique_ptr<CommandList[]>> jsCommands;
+
+	// add a command to the table
 	void AddJsCommand(int unit, int button, const KeyCommand &cmd);
 
-	// create a key for the jsCommands table
-	static inline int JsCommandKey(int unit, int button) { return (unit << 8) | button; }
+	// get the command list for a joystick button, or null if it has no commands
+	const CommandList *GetJsCommands(int unit, int button) const
+	{
+		if (unit < 0 || unit >= static_cast<int>(jsCommands.size()) || jsCommands[unit] == nullptr
+			|| button < 0 || button >= nJsButtonCommands)
+			return nullptr;
+
+		auto &l = jsCommands[unit][button];
+		return l.size() != 0 ? &l : nullptr;
+	}
 
 	// Javascript JoystickInfo methods
 	bool JsJoystickInfoButton(JsValueRef self, int button);
@@ -2984,6 +3482,7 @@ protected:
 	JsValueRef jsMediaSyncBeginEvent = JS_INVALID_REFERENCE;
 	JsValueRef jsMediaSyncLoadEvent = JS_INVALID_REFERENCE;
 	JsValueRef jsMediaSyncEndEvent = JS_INVALID_REFERENCE;
+	JsValueRef jsPerfBudgetEvent = JS_INVALID_REFERENCE;
 
 	// Fire javascript events.  These return true if the caller should
 	// proceed with the event, false if the script wanted to block the
@@ -3067,9 +3566,22 @@ protected:
 	// for higher level formatting features).
 	void JsConsoleLog(TSTRING level, TSTRING message);
 
+	// Javascript console.getProfile(reset): get the profiler summary,
+	// optionally resetting the counters
+	JsValueRef JsConsoleGetProfile(bool reset);
+
 	// Javascript UI mode query
 	JsValueRef JsGetUIMode();
 
+	// Javascript memory statistics query
+	JsValueRef JsGetMemoryStats();
+
+	// Javascript performance statistics query
+	JsValueRef JsGetPerfStats();
+
+	// check the views against the frame budget, for PerfBudgetEvent
+	void CheckFrameBudgets();
+
 	// Get the active UI window
 	JsValueRef JsGetActiveWindow();
 
@@ -3133,11 +3645,56 @@ protected:
 	// only valid for the duration of the js drawing callback.
 	struct JsDrawingContext
 	{
+		// create a context for drawing into a GDI+ graphics context
 		JsDrawingContext(PlayfieldView *pfv, Gdiplus::Graphics &g, 
-			float width, float height, float borderWidth);
+			float width, float height, float borderWidth) :
+			JsDrawingContext(pfv, &g, nullptr, width, height, borderWidth) { }
+
+		// create a context for drawing into a Direct2D render target
+		JsDrawingContext(PlayfieldView *pfv, ID2D1RenderTarget *d2d,
+			float width, float height, float borderWidth) :
+			JsDrawingContext(pfv, nullptr, d2d, width, height, borderWidth) { }
+
+		~JsDrawingContext() { EndGdi(); }
 
-		// graphics context
-		Gdiplus::Graphics &g;
+		// GDI+ graphics context, for a GDI+ drawing; null for Direct2D
+		Gdiplus::Graphics *g;
+
+		// Direct2D render target, for a Direct2D drawing; null for GDI+
+		ID2D1RenderTarget *d2d;
+
+		// Get a GDI+ graphics context for operations that only have GDI+
+		// implementations (StyledText and HtmlLayout drawing).  For GDI+
+		// drawing, this is simply 'g'.  For Direct2D drawing, this opens a
+		// GDI interop DC on the render target, which stays open until the
+		// next Direct2D operation.  Returns null if the DC isn't available.
+		Gdiplus::Graphics *GetGraphics();
+
+		// Close the GDI interop DC, if it's open.  Direct2D can't draw
+		// while the DC is open, so each Direct2D operation calls this
+		// first.
+		void EndGdi();
+
+		// GDI interop, while the DC is open
+		RefPtr<ID2D1GdiInteropRenderTarget> gdiInterop;
+		std::unique_ptr<Gdiplus::Graphics> gdiInteropGraphics;
+
+		// Direct2D text format for the current font, and the solid brush
+		// we use for all Direct2D fills and text, created on demand
+		RefPtr<IDWriteTextFormat> textFormat;
+		RefPtr<ID2D1SolidColorBrush> d2dBrush;
+
+		// create the text format from the current font specs if we don't
+		// already have one
+		void InitTextFormat();
+
+		// get the Direct2D brush, set to the given color
+		ID2D1SolidColorBrush *GetBrush(const Gdiplus::Color &color);
+
+		// Create a Direct2D text layout for text in the current format,
+		// with the given alignment.  Returns true on success.
+		bool CreateTextLayout(RefPtr<IDWriteTextLayout> &layout, const WCHAR *text, UINT32 len,
+			float width, float height, Gdiplus::StringAlignment horz, Gdiplus::StringAlignment vert);
 
 		// drawing area dimensions, including the border space
 		float width;
@@ -3165,7 +3722,7 @@ protected:
 		void InitFont();
 
 		// currently selected drawing objects
-		std::unique_ptr<Gdiplus::Font> font;
+		std::shared_ptr<Gdiplus::Font> font;
 		std::unique_ptr<Gdiplus::Brush> textBrush;
 
 		// text wrapping boundaries
@@ -3193,9 +3750,33 @@ protected:
 		// needed to do it.  But for now we don't have any practical need 
 		// for that, so keep it simple by using the static.
 		JavascriptEngine::JsObj jsobj;
+
+	protected:
+		JsDrawingContext(PlayfieldView *pfv, Gdiplus::Graphics *g, ID2D1RenderTarget *d2d,
+			float width, float height, float borderWidth);
 	};
 	std::unique_ptr<JsDrawingContext> jsDC;
 
+	// Direct2D bitmaps for drawImage() sources, for drawing contexts that
+	// draw through Direct2D, keyed by file path.  Loading and decoding an
+	// image on every drawImage() call is the main cost of a script that
+	// redraws a layer on every frame, so we keep the decoded bitmaps.  All
+	// of the drawing layer render targets share the same D3D device, so a
+	// bitmap created for one can be drawn into any of them.  We check the
+	// file's modification time on each use, so that an updated file is
+	// reloaded.
+	struct JsD2DImage
+	{
+		RefPtr<ID2D1Bitmap> bitmap;
+		FILETIME modified;
+	};
+	std::unordered_map<TSTRING, JsD2DImage> jsD2DImageCache;
+	static const size_t maxJsD2DImageCache = 64;
+
+	// get a drawImage() source as a Direct2D bitmap, loading it if it's
+	// not already in the cache; returns null if the file can't be loaded
+	ID2D1Bitmap *GetJsD2DImage(ID2D1RenderTarget *target, const TCHAR *path);
+
 	// Javascript StyledText objects
 	JsValueRef jsStyledTextProto;
 	static JsValueRef CALLBACK JsStyledTextConstructor(JsValueRef callee, bool isConstructCall, JsValueRef *argv, unsigned short argc, void *ctx);
@@ -3209,9 +3790,65 @@ protected:
 	void JsHtmlLayoutDraw(JsValueRef self, JsValueRef jsdc, JavascriptEngine::JsObj rcLayout, JavascriptEngine::JsObj rcClip);
 	JsValueRef JsHtmlLayoutMeasure(JsValueRef self, int width);
 
+	// Javascript Worker objects.  Each Javascript Worker object is an
+	// external object whose native data is just the worker ID; the
+	// worker itself lives in the jsWorkers map until its thread exits,
+	// along with a reference to the Javascript object, so that the
+	// object stays alive to receive messages from the worker even if
+	// the script drops its own references.
+	JsValueRef jsWorkerProto;
+	static JsValueRef CALLBACK JsWorkerConstructor(JsValueRef callee, bool isConstructCall, JsValueRef *argv, unsigned short argc, void *ctx);
+	void JsWorkerPostMessage(JsValueRef self, JsValueRef msg);
+	void JsWorkerTerminate(JsValueRef self);
+	struct JsWorkerEntry
+	{
+		std::unique_ptr<JavascriptWorker> worker;
+		JsValueRef obj;
+	};
+	std::unordered_map<int, JsWorkerEntry> jsWorkers;
+	int nextJsWorkerId = 1;
+
+	// process pending messages from the workers
+	void OnJsWorkerMessages();
+
+	// terminate all workers and release their objects
+	void ClearJsWorkers();
+
+	// Javascript asyncIO object.  The methods return Promises that are
+	// settled when the request completes on the thread pool.
+	std::unique_ptr<JavascriptAsyncIO> jsAsyncIO;
+	JsValueRef JsAsyncReadFile(TSTRING path, JsValueRef options);
+	JsValueRef JsAsyncWriteFile(TSTRING path, JsValueRef data, JsValueRef options);
+	JsValueRef JsAsyncListDir(TSTRING path);
+	JsValueRef JsAsyncHttpRequest(JsValueRef options);
+	bool JsAsyncCancel(JsValueRef promise);
+
+	// resolve a relative asyncIO file path against the program folder
+	static TSTRING ResolveJsAsyncPath(const TSTRING &path);
+
+	// apply the common asyncIO request options
+	static void ApplyJsAsyncOptions(JavascriptAsyncIO::Request *req, JsValueRef options);
+
 	// litehtml host interface
 	std::shared_ptr<LitehtmlHost> litehtmlHost;
 
+	// Parsed HTML document cache.  Overlay scripts commonly rebuild the
+	// same HtmlLayout text on every update, so we keep the recently parsed
+	// documents, keyed by their source text, and share the parsed DOM (and
+	// its layout and rendered image) among HtmlLayout objects created from
+	// identical text.  Kept in most-recently-used order.  (The entry type
+	// is private to PlayfieldView.cpp.)
+	struct HtmlDocCacheEntry;
+	friend class JsHtmlLayout;
+	std::list<std::shared_ptr<HtmlDocCacheEntry>> htmlDocCache;
+	static const size_t maxHtmlDocCache = 16;
+
+	// Total size of the rendered images held by the document cache
+	// entries, and the limit.  When we exceed the limit, we discard the
+	// images for the least recently used entries.
+	INT64 htmlRasterBytes = 0;
+	static const INT64 maxHtmlRasterBytes = 32 * 1024 * 1024;
+
 	// Enter/exit attract mode via javascript
 	void JsStartAttractMode() { attractMode.StartAttractMode(this); }
 	void JsEndAttractMode() { attractMode.EndAttractMode(this); }
@@ -3255,6 +3892,11 @@ protected:
 	template<typename T>
 	bool AddGameInfoStatsGetter(const CHAR *propName, T (*func)(GameListItem*), ErrorHandler &eh);
 
+	// GameInfo property value functions, by property name.  The getter
+	// setup functions above populate this alongside the prototype
+	// getters, for the bulk data call, JsGetGameData().
+	std::map<CSTRING, std::function<JsValueRef(GameListItem*)>> gameInfoPropFuncs;
+
 	// expand a game system variable
 	WSTRING JsExpandSysVar(JsValueRef self, WSTRING str, JsValueRef game);
 	
@@ -3268,6 +3910,29 @@ protected:
 	// internal game info object builder
 	JsValueRef BuildJsGameInfo(const GameListItem *game);
 
+	// GameInfo object cache.  The GameInfo object itself only holds the
+	// game's internal ID; everything else comes from the prototype's
+	// getters, so one object per game can be shared by all callers.
+	// Reusing objects saves scripts that look up the same games over and
+	// over (status line scripts, filter callbacks) from creating a new
+	// object every time.  We keep only weak references, so the engine
+	// can still collect objects that scripts aren't holding.  An entry
+	// is discarded when the game's stats change, when the game is edited,
+	// and when the game list is rebuilt, so that a script that stores its
+	// own properties on a GameInfo object doesn't see them outlive the
+	// data they were derived from.
+	struct JsGameInfoCacheEntry
+	{
+		JsWeakRef ref;
+		const GameListItem *game;
+		UINT64 statsStamp;
+	};
+	std::unordered_map<int, JsGameInfoCacheEntry> jsGameInfoCache;
+
+	// invalidate a game's cached GameInfo object/all cached objects
+	void InvalidateJsGameInfo(const GameListItem *game);
+	void ClearJsGameInfoCache();
+
 	// GameInfo methods
 	JsValueRef JsGetHighScores(JsValueRef self);
 	void JsSetHighScores(JsValueRef self, JsValueRef scores);
@@ -3290,11 +3955,23 @@ protected:
 	JsValueRef JsGetGame(int n);
 	JsValueRef JsGetAllGames();
 
+	// search the game list; returns an array of {game, score, wheelIndex}
+	JsValueRef JsSearchGames(WSTRING query, JsValueRef options);
+
 	// get the number of games on the wheel/nth game on the wheel/array of wheel games
 	int JsGetWheelCount();
 	JsValueRef JsGetWheelGame(int n);
 	JsValueRef JsGetAllWheelGames();
 
+	// Get plain data objects for all games, or all wheel games, in a single
+	// call.  The options can select the wheel games ('wheel: true') and the
+	// properties to include ('props: [names]'; by default, all GameInfo
+	// properties).  Each element has the game's 'id' plus the requested
+	// properties, as plain values, so a script that reads the same few
+	// properties across the whole list avoids a native getter call per
+	// property per game.
+	JsValueRef JsGetGameData(JsValueRef options);
+
 	// set the current wheel selection
 	void JsSetWheelGame(int n, JsValueRef options);
 
@@ -3322,6 +3999,8 @@ protected:
 	// FilterInfo methods
 	JsValueRef JsFilterInfoGetGames(JsValueRef self);
 	bool JsFilterInfoTestGame(JsValueRef self, JsValueRef game);
+	JsValueRef JsFilterInfoGetCount(JsValueRef self);
+	JsValueRef JsGetFilterCounts(JsValueRef ids);
 
 	// create/remove a metafilter
 	int JsCreateMetaFilter(JavascriptEngine::JsObj desc);
@@ -3360,7 +4039,9 @@ protected:
 			const TSTRING &group, const TSTRING &sortKey,
 			bool includeHidden, bool includeUnconfigured,
 			JsValueRef before, JsValueRef after,
-			JsValueRef customSortFunc, JsValueRef customPagingFunc);
+			JsValueRef customSortFunc, JsValueRef customPagingFunc,
+			JsValueRef selectBatchFunc, bool cacheable,
+			JsValueRef sortKeyFunc, JsValueRef sortKeysFunc);
 
 		~JavascriptFilter();
 
@@ -3375,6 +4056,16 @@ protected:
 		virtual bool IncludeHidden() const override { return includeHidden; }
 		virtual bool IncludeUnconfigured() const override { return includeUnconfigured; }
 
+		// batch selection, via the 'selectBatch' function
+		virtual bool HasBatchInclude() const override { return selectBatchFunc != JS_INVALID_REFERENCE; }
+		virtual void IncludeBatch(const std::vector<GameListItem*> &games, std::vector<bool> &include) override;
+
+		// Can the results be cached?  This is set from the 'cacheable'
+		// descriptor property, for filters that only look at the games'
+		// own properties and stats.
+		virtual bool IsCacheable() const override { return cacheable; }
+		bool cacheable;
+
 		// the Javascript function implementing the filter, BeforeScan, and
 		// AfterScan methods
 		JsValueRef func;
@@ -3396,17 +4087,76 @@ protected:
 		bool includeUnconfigured;
 
 		// custom sorting and grouping/paging
-		virtual bool HasCustomSort() const override { return customSortFunc != JS_INVALID_REFERENCE; }
+		virtual bool HasCustomSort() const override {
+			return customSortFunc != JS_INVALID_REFERENCE || sortKeyFunc != JS_INVALID_REFERENCE || sortKeysFunc != JS_INVALID_REFERENCE;
+		}
 		virtual bool CustomSortCompare(const GameListItem *a, const GameListItem *b) const override;
+		virtual void BeforeSort(const std::vector<GameListItem*> &games) override;
+		virtual void AfterSort() override;
 		virtual int GetPageGroup(const GameListItem *game) const override;
 
+		// Standard sort order, for a filter without a custom sort function;
+		// set from the 'sortBy' and 'sortDescending' descriptor properties
+		virtual SortOrder GetSortOrder() const override { return sortOrder; }
+		virtual bool IsSortDescending() const override { return sortDescending; }
+		SortOrder sortOrder = SortOrder::Title;
+		bool sortDescending = false;
+
+		// Game info objects for the games being sorted, built once per game
+		// in BeforeSort(), so that the comparison function doesn't have to
+		// build two new objects on every comparison.  We hold a reference
+		// on each object until AfterSort().
+		std::unordered_map<const GameListItem*, JsValueRef> sortInfoCache;
+
 		// custom sorting function
 		JsValueRef customSortFunc = JS_INVALID_REFERENCE;
 
+		// Sort key functions.  As an alternative to a comparison function,
+		// the filter can provide a function that returns a sort key for a
+		// game, or a batch function that returns the keys for an array of
+		// game IDs.  Either one is called once per game, in BeforeSort(),
+		// and the sort then compares the keys natively, rather than calling
+		// into Javascript for every comparison.  These take precedence over
+		// the comparison function.
+		JsValueRef sortKeyFunc = JS_INVALID_REFERENCE;
+		JsValueRef sortKeysFunc = JS_INVALID_REFERENCE;
+
+		// Extracted sort key.  Numeric keys sort before string keys;
+		// strings compare without regard to case.  Games without a key
+		// (undefined or null) sort at the end.
+		struct SortKey
+		{
+			enum class Type { None, Number, String } type = Type::None;
+			double num = 0.0;
+			WSTRING str;
+		};
+		static SortKey MakeSortKey(JsValueRef val);
+
+		// sort keys for the games being sorted, built in BeforeSort()
+		std::unordered_map<const GameListItem*, SortKey> sortKeyCache;
+
 		// custom page grouping function
 		JsValueRef customPagingFunc = JS_INVALID_REFERENCE;
+
+		// batch selection function
+		JsValueRef selectBatchFunc = JS_INVALID_REFERENCE;
 	};
 
+	// Call a Javascript batch selection function, for a filter or
+	// metafilter.  The function receives an Int32Array with the IDs of
+	// the candidate games, plus, if 'passIncluded' is true, a Uint8Array
+	// with the incoming inclusion status of each game (for metafilters).
+	// It can return either a mask, as an array of booleans or a typed
+	// array with one element per candidate, or an array of the IDs of
+	// the accepted games.  On return, include[i] is the result for
+	// games[i].  Throws CallException on a Javascript error.
+	static void CallJsBatchSelect(JsValueRef func, const std::vector<GameListItem*> &games,
+		std::vector<bool> &include, bool passIncluded);
+
+	// Create an Int32Array of game IDs, for the batch filter functions.
+	// Throws CallException on error.
+	static JsValueRef CreateJsGameIdArray(const std::vector<GameListItem*> &games);
+
 	// all user-defined filters, by ID
 	std::unordered_map<TSTRING, JavascriptFilter> javascriptFilters;
 
@@ -3415,15 +4165,18 @@ protected:
 	{
 	public:
 		JavascriptMetafilter(JsValueRef before, JsValueRef select, JsValueRef after,
-			int priority, bool includeExcluded) :
+			JsValueRef selectBatch, int priority, bool includeExcluded, bool cacheable) :
 			MetaFilter(priority, includeExcluded),
 			before(before),
 			select(select),
-			after(after)
+			after(after),
+			selectBatch(selectBatch),
+			cacheable(cacheable)
 		{
 			JsAddRef(before, nullptr);
 			JsAddRef(select, nullptr);
 			JsAddRef(after, nullptr);
+			if (selectBatch != JS_INVALID_REFERENCE) JsAddRef(selectBatch, nullptr);
 		}
 
 		virtual ~JavascriptMetafilter()
@@ -3431,18 +4184,28 @@ protected:
 			JsRelease(before, nullptr);
 			JsRelease(select, nullptr);
 			JsRelease(after, nullptr);
+			if (selectBatch != JS_INVALID_REFERENCE) JsRelease(selectBatch, nullptr);
 		}
 
 		// implementation of the virtual interface
 		virtual void Before() override;
 		virtual void After() override;
 		virtual bool Include(GameListItem *game, bool include) override;
+		virtual bool HasBatchInclude() const override { return selectBatch != JS_INVALID_REFERENCE; }
+		virtual void IncludeBatch(const std::vector<GameListItem*> &games, std::vector<bool> &include) override;
+		virtual bool IsCacheable() const override { return cacheable; }
 
 		// before/select/after Javascript functions
 		JsValueRef before;
 		JsValueRef select;
 		JsValueRef after;
 
+		// batch selection function, or JS_INVALID_REFERENCE if none
+		JsValueRef selectBatch;
+
+		// can the batch results be cached?
+		bool cacheable;
+
 		// ID, for Javascript code to address the filter (e.g., for deletion)
 		int id;
 	};
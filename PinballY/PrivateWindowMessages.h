@@ -56,6 +56,14 @@ const UINT PFVMsgPlayElevReqd = WM_USER + 211;      // WPARAM = TCHAR *systemNam
 const UINT PFVMsgJsDebugMessage = WM_USER + 212;    // Javascript debug request received from debugger UI
 const UINT PFVMsgTakeFocusPostLaunch = WM_USER + 213; // take focus after game launch exits
 const UINT PFVMsgAdminExitGame = WM_USER + 214;     // Exit Game event from Admin Host
+const UINT PFVMsgJsWorkerMessage = WM_USER + 215;   // Javascript worker has messages for the main context
+const UINT PFVMsgJsAsyncIODone = WM_USER + 216;     // Javascript asyncIO requests have completed
+const UINT PFVMsgPinscapeDone = WM_USER + 217;      // Pinscape device requests have completed
+const UINT PFVMsgCaptureEncodeDone = WM_USER + 218; // deferred capture encoding pass has completed
+const UINT PFVMsgStartupTaskDone = WM_USER + 219;   // a background startup task has completed
+const UINT PFVMsgMediaDropDone = WM_USER + 220;     // background media drop installation has completed
+const UINT PFVMsgPlayerRetired = WM_USER + 221;     // retired audio/video players are ready to delete
+const UINT PFVMsgMediaRenameDone = WM_USER + 222;   // background media file renaming has completed
 
 
 // PFVShowMessage parameters struct
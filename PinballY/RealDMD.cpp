@@ -47,6 +47,8 @@ namespace ConfigVars
 	static const TCHAR *MirrorHorz = _T("RealDMD.MirrorHorz");
 	static const TCHAR *MirrorVert = _T("RealDMD.MirrorVert");
 	static const TCHAR *Gamma = _T("RealDMD.GrayscaleGamma");
+	static const TCHAR *SuppressDuplicates = _T("RealDMD.SuppressDuplicateFrames");
+	static const TCHAR *KeepaliveInterval = _T("RealDMD.KeepaliveInterval");
 }
 
 // -----------------------------------------------------------------------
@@ -91,11 +93,23 @@ RealDMD::RealDMD() :
 	// create the writer thread event
 	hWriterEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
 
+	// allocate the video frame buffers
+	videoQueue.reserve(nVideoFrames);
+	videoFree.reserve(nVideoFrames);
+	for (auto &f : videoFrames)
+	{
+		f.reset(new VideoFrame());
+		videoFree.push_back(f.get());
+	}
+
+	// allocate the last-frame buffer for the keepalive refresh
+	lastSentPix.reset(new BYTE[dmdWidth * dmdHeight * 3]);
+
 	// create an empty slide
 	size_t emptyBufSize = dmdWidth * dmdHeight;
 	std::unique_ptr<BYTE> emptyBuf(new BYTE[emptyBufSize]);
 	ZeroMemory(emptyBuf.get(), emptyBufSize);
-	emptySlide.Attach(new Slide(DMD_COLOR_MONO16, emptyBuf.release(), 0, Slide::EmptySlide));
+	emptySlide.Attach(new Slide(DMD_COLOR_MONO16, emptyBuf.release(), emptyBufSize, 0, Slide::EmptySlide));
 
 	// initialize gamma from the settings
 	UpdateGamma();
@@ -259,6 +273,11 @@ bool RealDMD::Init(ErrorHandler &eh)
 	mirrorHorz = cfg->GetBool(ConfigVars::MirrorHorz, false);
 	mirrorVert = cfg->GetBool(ConfigVars::MirrorVert, false);
 
+	// load the duplicate frame suppression settings
+	suppressDuplicates = cfg->GetBool(ConfigVars::SuppressDuplicates, true);
+	keepaliveInterval = static_cast<DWORD>(max(0, cfg->GetInt(ConfigVars::KeepaliveInterval, 5000)));
+	lastSentValid = false;
+
 	// Send an initial empty frame.  This clears any leftover display
 	// cruft, and also forces the virtual DMD window to open if it's 
 	// going to open.  The virtual DMD can have side effects on the
@@ -479,17 +498,20 @@ bool RealDMD::LoadDLL(ErrorHandler &eh)
 				*eol = 0;
 
 				// check the pattern
+				static const std::basic_regex<WCHAR> commentPat(L"\\s*;.*");
+				static const std::basic_regex<WCHAR> sectPat(L"\\s*\\[\\s*([^\\]]*?)\\s*\\]\\s*");
+				static const std::basic_regex<WCHAR> pairPat(L"\\s*([^=]*?)\\s*=\\s*(.*?)\\s*");
 				std::match_results<const WCHAR*> m;
-				if (std::regex_match(p, std::basic_regex<WCHAR>(L"\\s*;.*")))
+				if (std::regex_match(p, commentPat))
 				{
 					// comment line - ignore it
 				}
-				else if (std::regex_match(p, m, std::basic_regex<WCHAR>(L"\\s*\\[\\s*([^\\]]*?)\\s*\\]\\s*")))
+				else if (std::regex_match(p, m, sectPat))
 				{
 					// it's a section marker
 					sect = m[1].str();
 				}
-				else if (std::regex_match(p, m, std::basic_regex<WCHAR>(L"\\s*([^=]*?)\\s*=\\s*(.*?)\\s*")))
+				else if (std::regex_match(p, m, pairPat))
 				{
 					// It's a name=value line.  If we're in the [virtualdmd]
 					// section, check for enabled=(true|false); if we find 
@@ -683,6 +705,9 @@ void RealDMD::OpenSession()
 
 			// the session is now open
 			sessionOpen = true;
+
+			// the new session doesn't have any frame displayed yet
+			lastSentValid = false;
 		}
 
 		// Set a dummy ROM initially.  dmd-extensions will crash in some
@@ -1121,7 +1146,7 @@ void RealDMD::UpdateGame()
 							}
 
 							// add it to the slide show, and start playback
-							slideShow.emplace_back(new Slide(imageColorSpace, gray.release(),
+							slideShow.emplace_back(new Slide(imageColorSpace, gray.release(), dmdBytes,
 								imageDisplayTime, Slide::MediaSlide));
 							StartSlideShow();
 						}
@@ -1143,7 +1168,7 @@ void RealDMD::UpdateGame()
 
 							// add the image to the slide show
 							slideShow.emplace_back(new Slide(imageColorSpace, reinterpret_cast<BYTE*>(buf2.release()),
-								imageDisplayTime, Slide::MediaSlide));
+								dmdWidth * dmdHeight * sizeof(rgb24), imageDisplayTime, Slide::MediaSlide));
 							StartSlideShow();
 						}
 						break;
@@ -1391,6 +1416,15 @@ void RealDMD::SendWriterFrame(Slide *slide)
 	CriticalSectionLocker locker(writeFrameLock);
 	writerFrame = slide;
 
+	// The slide supersedes any video frames still waiting in the queue,
+	// so discard them.  Otherwise the writer would take the newest queued
+	// frame on its next pass and write it over the slide, and the
+	// keepalive refresh would then keep resending that stale frame.
+	for (auto f : videoQueue)
+		videoFree.push_back(f);
+	videoFramesDropped += videoQueue.size();
+	videoQueue.clear();
+
 	// wake up the writer thread
 	SetEvent(hWriterEvent);
 }
@@ -1400,11 +1434,21 @@ DWORD RealDMD::WriterThreadMain()
 	// keep going until the 'quit' event is signaled
 	for (;;)
 	{
+		// Figure the wait timeout.  If we're doing keepalive refreshes,
+		// wake up in time for the next one.
+		DWORD timeout = INFINITE;
+		if (keepaliveInterval != 0 && lastSentValid)
+		{
+			ULONGLONG elapsed = GetTickCount64() - lastSentTime;
+			timeout = elapsed >= keepaliveInterval ? 0 : static_cast<DWORD>(keepaliveInterval - elapsed);
+		}
+
 		// wait for an event
-		switch (WaitForSingleObject(hWriterEvent, INFINITE))
+		switch (WaitForSingleObject(hWriterEvent, timeout))
 		{
 		case WAIT_OBJECT_0:
 		case WAIT_ABANDONED:
+		case WAIT_TIMEOUT:
 			break;
 
 		default:
@@ -1422,12 +1466,13 @@ DWORD RealDMD::WriterThreadMain()
 			// get the latest video frame and settings data
 			RefPtr<Slide> frame;
 			std::unique_ptr<GameSettings> settings;
+			VideoFrame *videoFrame = nullptr;
 			{
 				// lock the queue
 				CriticalSectionLocker frameLocker(writeFrameLock);
 
 				// if we have no work to do, we're done for this round
-				if (writerFrame == nullptr && writerSettings == nullptr)
+				if (writerFrame == nullptr && writerSettings == nullptr && videoQueue.size() == 0)
 					break;
 
 				// grab the pending video frame, taking over its reference count
@@ -1435,6 +1480,18 @@ DWORD RealDMD::WriterThreadMain()
 
 				// grab the pending settings
 				settings.reset(writerSettings.release());
+
+				// Grab the newest queued video frame.  Any older frames are
+				// stale by now, so drop them.
+				if (videoQueue.size() != 0)
+				{
+					videoFrame = videoQueue.back();
+					videoQueue.pop_back();
+					for (auto f : videoQueue)
+						videoFree.push_back(f);
+					videoFramesDropped += videoQueue.size();
+					videoQueue.clear();
+				}
 			}
 
 			// send the settings to the device
@@ -1450,6 +1507,10 @@ DWORD RealDMD::WriterThreadMain()
 				CriticalSectionLocker dmdLocker(dmdLock);
 				if (sessionOpen)
 					PM_GameSettings_(settings->gameName.c_str(), GEN_WPC95, settings->opts);
+
+				// the device might reset its display for the new settings, so
+				// make sure the next frame goes through
+				lastSentValid = false;
 			}
 
 			// send the video frame to the device
@@ -1457,70 +1518,63 @@ DWORD RealDMD::WriterThreadMain()
 			{
 				CriticalSectionLocker dmdLocker(dmdLock);
 				if (sessionOpen)
-				{
-					switch (frame->colorSpace)
-					{
-					case DMD_COLOR_MONO4:
-						Render_4_Shades_(dmdWidth, dmdHeight, frame->pix.get());
-						break;
-
-					case DMD_COLOR_MONO16:
-						Render_16_Shades_(dmdWidth, dmdHeight, frame->pix.get());
-						break;
+					RenderFrame(frame->colorSpace, frame->pix.get(), true);
+			}
 
-					case DMD_COLOR_RGB:
-						// *** Dmd-Extensions bug #176 workaround ***
-						//
-						// There's a bug in dmd-extensions that makes it drop an RGB
-						// frame if the last RGB frame contained the same pixels, EVEN
-						// IF an intervening frame of a different format was displayed.
-						// (See https://github.com/freezy/dmd-extensions/issues/176.)
-						//
-						// The case we're particularly concerned with is when we're
-						// alternating the display between fixed images in MONO16 and
-						// RGB format, which can happen we have PNG/JPEG media for the
-						// game alternating with generated high-score images.  In this
-						// case, the PNG/JPEG media slide has the same pixels on each
-						// iteration, which makes dmd-ext drop it.  To work around this,
-						// we can very slightly change the pixel data in the source
-						// buffer on each iteration to defeat the buggy "same pixels"
-						// check in dmd-ext.  Flipping the low-order bit of an RGB
-						// component of one pixel won't have any visible effect -
-						// you can't typically see the difference between blue=74
-						// and blue=75, say.  We'll use the blue component because the
-						// human eye has the poorest color resolution in blue, but it
-						// wouldn't really matter if we chose green or red, as the eye
-						// can't resolve color well enough in any component to be able
-						// to distinguish this degree of change.
-						//
-						// To ensure that every consecutive RGB frame is different, no
-						// matter the source, we'll simply replace the low bit in the B
-						// component of the top left pixel in each frame with a bit value
-						// that reverses on every successive frame.
-						//
-						// If this is fixed in a future dmd-extensions, we can do a
-						// version/feature test on the DLL we're attached to and make
-						// the workaround conditional on it:
-						// if (workaround_required)
-						{
-							// invert the low bit in the static counter
-							static BYTE b = 0x00;
-							b ^= 0x01;
+			// send the video frame to the device
+			if (videoFrame != nullptr)
+			{
+				// time the device write
+				LARGE_INTEGER t0, t1, freq;
+				bool sent = false;
+				QueryPerformanceCounter(&t0);
+				{
+					// NB: we don't worry about the dmd-extensions bug (search for #176
+					// in RenderFrame()) for video, as a video will typically present a
+					// new frame so quickly that a single dropped frame shouldn't be
+					// noticed.
+					CriticalSectionLocker dmdLocker(dmdLock);
+					if (sessionOpen)
+						sent = RenderFrame(videoFrame->colorSpace, videoFrame->pix, false);
+				}
+				QueryPerformanceCounter(&t1);
+				QueryPerformanceFrequency(&freq);
+				double ms = static_cast<double>(t1.QuadPart - t0.QuadPart) * 1000.0 / static_cast<double>(freq.QuadPart);
 
-							// replace the low bit in pixel #0's blue component
-							BYTE *p = frame->pix.get() + 2;
-							*p = (*p & 0xFE) | b;
-						}
+				// return the buffer
+				{
+					CriticalSectionLocker frameLocker(writeFrameLock);
+					videoFree.push_back(videoFrame);
+				}
 
-						// Render the frame
-						Render_RGB24_(dmdWidth, dmdHeight, reinterpret_cast<rgb24*>(frame->pix.get()));
-						break;
-					}
+				// update the statistics, logging them every 30 seconds
+				if (sent)
+				{
+					++videoFramesWritten;
+					videoWriteTotal_ms += ms;
+					videoWriteMax_ms = max(videoWriteMax_ms, ms);
 				}
+				if (videoStatsTime == 0)
+					videoStatsTime = GetTickCount64();
+				else if (GetTickCount64() - videoStatsTime > 30000)
+					LogVideoOutputStats();
 			}
 		}
+
+		// If the keepalive interval has elapsed since the last frame we
+		// sent, resend it, for devices that blank the display when they
+		// don't receive any data for a while.
+		if (keepaliveInterval != 0 && lastSentValid && GetTickCount64() - lastSentTime >= keepaliveInterval)
+		{
+			CriticalSectionLocker dmdLocker(dmdLock);
+			if (sessionOpen)
+				RenderFrame(lastSentColorSpace, lastSentPix.get(), true, true);
+		}
 	}
 
+	// log the final video statistics
+	LogVideoOutputStats();
+
 	// done (thread return value isn't used)
 	return 0;
 }
@@ -1628,7 +1682,7 @@ void RealDMD::GenerateHighScoreGraphics()
 
 			// add this screen to our list, transferring ownership of the pixel
 			// buffer to the list
-			slideShow.emplace_back(new Slide(DMD_COLOR_MONO16, pix.release(), 3500, Slide::HighScoreSlide));
+			slideShow.emplace_back(new Slide(DMD_COLOR_MONO16, pix.release(), dmdBytes, 3500, Slide::HighScoreSlide));
 
 			// count the slides we added
 			++nSlides;
@@ -1673,193 +1727,656 @@ bool RealDMD::SupportsRGBDisplay() const
 // same size as the native DMD, so we simply map the frame
 // pixels to DMD pixels one-to-one.
 //
-void RealDMD::PresentVideoFrame(int width, int height, const BYTE *y, const BYTE *u, const BYTE *v)
+// -----------------------------------------------------------------------
+//
+// Video frame conversion.  These kernels convert a decoded I420 video
+// frame to the device format, for each frame we present.  The frame is
+// either at the native 128x32 size, or at the double 256x64 size used
+// for PinballX-style DMD videos, where each DMD pixel is stored as a
+// 2x2 block; for the latter, we take the brightest pixel in each block.
+//
+// The SSE2 versions are used wherever SSE2 is part of the target
+// instruction set, which is always the case on x64, and on x86 with
+// the compiler's default /arch:SSE2.  The scalar versions are the
+// fallback for other targets, and the reference for the benchmark.
+// There's no AVX2 version: a DMD frame is only 4096 pixels, so the
+// SSE2 loops are already short enough that the wider vectors wouldn't
+// be worth a run-time CPU dispatch.
+//
+
+#if defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define DMD_VIDEO_SSE2 1
+#include <emmintrin.h>
+#endif
+
+// video frame source description
+struct VideoFrameSrc
+{
+	const BYTE *y, *u, *v;		// I420 planes
+	bool doubleSize;			// 256x64 frame, with 2x2 blocks per DMD pixel
+	bool mirrorHorz;			// mirror the output horizontally
+	bool mirrorVert;			// mirror the output vertically
+};
+
+static void ConvertMono16Scalar(const VideoFrameSrc &src, const BYTE *gammaMap, UINT8 *gray)
 {
 	// Figure the output buffer pointers according to the mirroring
 	// settings.
 	int dstStartRow = 0, dstStartCol = 0, dstRowInc = 1, dstColInc = 1;
-	if (mirrorVert)
-		dstStartRow = 31, dstRowInc = -1;
-	if (mirrorHorz)
-		dstStartCol = 127, dstColInc = -1;
-
-	// prepare the buffer according to the device color space we're
-	// rendering to
-	switch (videoColorSpace)
+	if (src.mirrorVert)
+		dstStartRow = dmdHeight - 1, dstRowInc = -1;
+	if (src.mirrorHorz)
+		dstStartCol = dmdWidth - 1, dstColInc = -1;
+
+	// The Y plane is conveniently in 8-bit luma format, so all we have
+	// to do is shift all of the pixel luma values right by four bits to
+	// get 4-bit luma.  We can ignore the U and V planes in this mode.
+	const BYTE *y = src.y;
+	for (int row = 0; row < dmdHeight; ++row)
 	{
-	case DMD_COLOR_MONO16:
-		// 16-bit monochrome mode.  The Y plane is conveniently in
-		// 8-bit luma format, at the native device size of 128x32, so
-		// all we have to do is shift all of the pixel luma values 
-		// right by four bits to get 4-bit luma.  We can ignore the U 
-		// and V planes in this mode.
-		if (width == 256 && height == 64)
+		UINT8 *dst = gray + dstStartRow*dmdWidth + dstStartCol;
+		dstStartRow += dstRowInc;
+		if (src.doubleSize)
 		{
-			// Double-size frame.  These should follow the convention
-			// where each DMD pixel is stored as a 2x2 block of video
-			// pixels, so that the video has the same visible pixel
-			// structure as a DMD when played back on a video device.
-			// Look for the maximum pixel value in each block, and
-			// render that in 16-shade grayscale.
-			UINT8 gray[dmdWidth * dmdHeight];
-			UINT8 *dst;
-			for (int row = 0; row < dmdHeight; ++row, y += dmdWidth*2)
+			for (int col = 0; col < dmdWidth; ++col, y += 2)
 			{
-				dst = gray + dstStartRow*dmdWidth + dstStartCol;
-				dstStartRow += dstRowInc;
-				for (int col = 0; col < dmdWidth; ++col, y += 2)
-				{
-					// get the 2x2 pixel block at this position
-					BYTE a = y[0], b = y[1], c = y[dmdWidth*2], d = y[dmdWidth*2 + 1];
+				// get the 2x2 pixel block at this position
+				BYTE a = y[0], b = y[1], c = y[dmdWidth*2], d = y[dmdWidth*2 + 1];
 
-					// take the maximum of these values
-					if (b > a) a = b;
-					if (c > a) a = c;
-					if (d > a) a = d;
+				// take the maximum of these values
+				if (b > a) a = b;
+				if (c > a) a = c;
+				if (d > a) a = d;
 
-					// downconvert from 8 bits to 4 bits
-					*dst = (gammaMap[a] >> 4) & 0x0F;
-					dst += dstColInc;
-				}
+				// downconvert from 8 bits to 4 bits
+				*dst = (gammaMap[a] >> 4) & 0x0F;
+				dst += dstColInc;
 			}
 
-			// display it
-			CriticalSectionLocker dmdLocker(dmdLock);
-			Render_16_Shades_(dmdWidth, dmdHeight, gray);
+			// skip the second source row of the blocks
+			y += dmdWidth*2;
 		}
-		else if (width == dmdWidth && height == dmdHeight)
+		else
 		{
-			// native size frame - convert from 8-bit luma to 4-bit luma
-			UINT8 gray[dmdWidth * dmdHeight];
-			UINT8 *dst;
-			for (int row = 0; row < dmdHeight; ++row)
+			for (int col = 0; col < dmdWidth; ++col)
 			{
-				dst = gray + dstStartRow*dmdWidth + dstStartCol;
-				dstStartRow += dstRowInc;
-				for (int col = 0; col < dmdWidth; ++col)
-				{
-					*dst = (gammaMap[*y++] >> 4) & 0x0F;
-					dst += dstColInc;
-				}
+				*dst = (gammaMap[*y++] >> 4) & 0x0F;
+				dst += dstColInc;
 			}
-
-			// display it
-			CriticalSectionLocker dmdLocker(dmdLock);
-			Render_16_Shades_(dmdWidth, dmdHeight, gray);
 		}
-		break;
+	}
+}
 
-	case DMD_COLOR_RGB:
-		if (width == dmdWidth*2 && height == dmdHeight*2)
+static void ConvertRGBScalar(const VideoFrameSrc &src, rgb24 *rgb)
+{
+	// Figure the output buffer pointers according to the mirroring
+	// settings.
+	int dstStartRow = 0, dstStartCol = 0, dstRowInc = 1, dstColInc = 1;
+	if (src.mirrorVert)
+		dstStartRow = dmdHeight - 1, dstRowInc = -1;
+	if (src.mirrorHorz)
+		dstStartCol = dmdWidth - 1, dstColInc = -1;
+
+	const BYTE *y = src.y, *u = src.u, *v = src.v;
+	for (int row = 0; row < dmdHeight; ++row)
+	{
+		rgb24 *dst = rgb + dstStartRow*dmdWidth + dstStartCol;
+		dstStartRow += dstRowInc;
+		for (int col = 0; col < dmdWidth; ++col)
 		{
-			// Double-size frame.  Pick out the brightest pixel from
-			// each 2x2 block.
-			rgb24 rgb[dmdWidth * dmdHeight];
-			rgb24 *dst;
-			for (int row = 0; row < dmdHeight; ++row, y += dmdWidth*2)
+			int yy, uu, vv;
+			if (src.doubleSize)
 			{
-				dst = rgb + dstStartRow*dmdWidth + dstStartCol;
-				dstStartRow += dstRowInc;
-				for (int col = 0; col < dmdWidth; ++col, y += 2, ++u, ++v)
-				{
-					// get the 2x2 pixel block at this position
-					BYTE a = y[0], b = y[1], c = y[dmdWidth*2], d = y[dmdWidth*2 + 1];
-					int ofs = 0;
-
-					// take the maximum of these values
-					if (b > a) a = b;
-					if (c > a) a = c;
-					if (d > a) a = d;
-
-					// By some amazing coincidence, the U and V planes are 
-					// already subsampled in 2x2 blocks, so whichever pixel
-					// we just picked out, the U and V samples are the same.
-					// Calculate the RGB value using the standard formula:
-					//
-					//  Y' = 1.164*(Y-16)
-					//  U' = U - 128
-					//  V' = V - 128
-					//
-					//  R = Y' + 1.596*V'
-					//  G = Y' - 0.813*V' - 0.391*U'
-					//  B = Y' + 2.018*U'
-					//
-					// For efficiency, do the calculations in base-65536
-					// fixed-point representation.
-					int yp = (a - 16)*76284;
-					int up = (*u - 128);
-					int vp = (*v - 128);
-					int rr = (yp + 104595*vp) >> 16;
-					int gg = (yp - 53281*vp - 25625*up) >> 16;
-					int bb = (yp + 132252*up) >> 16;
-
-					// Clamp the results to 0..255
-					rr = max(rr, 0);
-					gg = max(gg, 0);
-					bb = max(bb, 0);
-					dst->red = min(rr, 255);
-					dst->green = min(gg, 255);
-					dst->blue = min(bb, 255);
-
-					dst += dstColInc;
-				}
+				// get the 2x2 pixel block at this position
+				BYTE a = y[0], b = y[1], c = y[dmdWidth*2], d = y[dmdWidth*2 + 1];
+				y += 2;
+
+				// take the maximum of these values
+				if (b > a) a = b;
+				if (c > a) a = c;
+				if (d > a) a = d;
+				yy = a;
+
+				// By some amazing coincidence, the U and V planes are 
+				// already subsampled in 2x2 blocks, so whichever pixel
+				// we just picked out, the U and V samples are the same.
+				uu = *u++;
+				vv = *v++;
+			}
+			else
+			{
+				// Get the Y, U and V values for this pixel.  The U and V
+				// planes are subsampled in 2x2 blocks, so we need to figure
+				// the U/V index accordingly.
+				yy = *y++;
+				int uvIdx = (row/2)*dmdWidth/2 + col/2;
+				uu = u[uvIdx];
+				vv = v[uvIdx];
 			}
 
-			// display it
-			// NB: we don't worry about the dmd-extensions bug (search for #176 above)
-			// for video, as a video will typically present a new frame so quickly that
-			// a single dropped frame shouldn't be noticed.
-			CriticalSectionLocker dmdLocker(dmdLock);
-			Render_RGB24_(dmdWidth, dmdHeight, rgb);
+			// Calculate the RGB value using the standard formula:
+			//
+			//  Y' = 1.164*(Y-16)
+			//  U' = U - 128
+			//  V' = V - 128
+			//
+			//  R = Y' + 1.596*V'
+			//  G = Y' - 0.813*V' - 0.391*U'
+			//  B = Y' + 2.018*U'
+			//
+			// For efficiency, do the calculations in base-65536
+			// fixed-point representation.
+			int yp = (yy - 16)*76284;
+			int up = (uu - 128);
+			int vp = (vv - 128);
+			int rr = (yp + 104595*vp) >> 16;
+			int gg = (yp - 53281*vp - 25625*up) >> 16;
+			int bb = (yp + 132252*up) >> 16;
+
+			// clamp the results to 0..255 and store the RGB pixel
+			rr = max(rr, 0);
+			gg = max(gg, 0);
+			bb = max(bb, 0);
+			dst->red = min(rr, 255);
+			dst->green = min(gg, 255);
+			dst->blue = min(bb, 255);
+
+			dst += dstColInc;
 		}
-		else if (width == dmdWidth && height == dmdHeight)
+
+		// skip the second source row of the blocks
+		if (src.doubleSize)
+			y += dmdWidth*2;
+	}
+}
+
+#ifdef DMD_VIDEO_SSE2
+
+// Get one output row of luma values.  For a double-size frame, this
+// takes the maximum of each 2x2 block, 16 output pixels at a time.
+// 'out' must be 16-byte aligned.  Returns the source pointer for the
+// next row.
+static const BYTE *GetLumaRowSSE2(const BYTE *y, bool doubleSize, BYTE *out)
+{
+	if (!doubleSize)
+	{
+		memcpy(out, y, dmdWidth);
+		return y + dmdWidth;
+	}
+
+	const __m128i lowBytes = _mm_set1_epi16(0x00FF);
+	for (int col = 0; col < dmdWidth; col += 16)
+	{
+		// take the maximum of the two source rows
+		const BYTE *p = y + col*2;
+		__m128i m0 = _mm_max_epu8(
+			_mm_loadu_si128(reinterpret_cast<const __m128i*>(p)),
+			_mm_loadu_si128(reinterpret_cast<const __m128i*>(p + dmdWidth*2)));
+		__m128i m1 = _mm_max_epu8(
+			_mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 16)),
+			_mm_loadu_si128(reinterpret_cast<const __m128i*>(p + dmdWidth*2 + 16)));
+
+		// take the maximum of each horizontal pair, leaving it in the
+		// low byte of each 16-bit lane, and pack the results
+		m0 = _mm_and_si128(_mm_max_epu8(m0, _mm_srli_epi16(m0, 8)), lowBytes);
+		m1 = _mm_and_si128(_mm_max_epu8(m1, _mm_srli_epi16(m1, 8)), lowBytes);
+		_mm_store_si128(reinterpret_cast<__m128i*>(out + col), _mm_packus_epi16(m0, m1));
+	}
+
+	// the blocks span two source rows
+	return y + dmdWidth*4;
+}
+
+// reverse the 16 bytes of a vector
+static inline __m128i Reverse16SSE2(__m128i x)
+{
+	x = _mm_or_si128(_mm_slli_epi16(x, 8), _mm_srli_epi16(x, 8));
+	x = _mm_shufflelo_epi16(x, _MM_SHUFFLE(0, 1, 2, 3));
+	x = _mm_shufflehi_epi16(x, _MM_SHUFFLE(0, 1, 2, 3));
+	return _mm_shuffle_epi32(x, _MM_SHUFFLE(1, 0, 3, 2));
+}
+
+static void ConvertMono16SSE2(const VideoFrameSrc &src, const BYTE *gammaMap, UINT8 *gray)
+{
+	alignas(16) BYTE luma[dmdWidth];
+	const BYTE *y = src.y;
+	for (int row = 0; row < dmdHeight; ++row)
+	{
+		y = GetLumaRowSSE2(y, src.doubleSize, luma);
+
+		// Gamma-correct and downconvert to 4 bits.  The gamma map is an
+		// arbitrary table, so this part stays scalar.
+		for (int col = 0; col < dmdWidth; ++col)
+			luma[col] = (gammaMap[luma[col]] >> 4) & 0x0F;
+
+		// store the row, mirroring as needed
+		UINT8 *dst = gray + (src.mirrorVert ? dmdHeight - 1 - row : row)*dmdWidth;
+		if (src.mirrorHorz)
 		{
-			// native size frame - convert from YUV to RGB
-			rgb24 rgb[dmdWidth * dmdHeight];
-			rgb24 *dst;
-			for (int row = 0; row < dmdHeight; ++row)
+			for (int col = 0; col < dmdWidth; col += 16)
 			{
-				dst = rgb + dstStartRow*dmdWidth + dstStartCol;
-				dstStartRow += dstRowInc;
-				for (int col = 0; col < dmdWidth; ++col)
-				{
-					// Get the Y, U and V values for this pixel.  The U and V
-					// planes are subsampled in 2x2 blocks, so we need to figure
-					// the U/V index accordingly.
-					int yy = *y++;
-					int uvIdx = (row/2)*dmdWidth/2 + col/2;
-					int uu = u[uvIdx];
-					int vv = v[uvIdx];
-
-					// do the YUV -> RGB conversion
-					int yp = (yy - 16)*76284;
-					int up = (uu - 128);
-					int vp = (vv - 128);
-					int rr = (yp + 104595*vp) >> 16;
-					int gg = (yp - 53281*vp - 25625*up) >> 16;
-					int bb = (yp + 132252*up) >> 16;
-
-					// clamp the results to 0..255 and store the RGB pixel
-					rr = max(rr, 0);
-					gg = max(gg, 0);
-					bb = max(bb, 0);
-					dst->red = min(rr, 255);
-					dst->green = min(gg, 255);
-					dst->blue = min(bb, 255);
-
-					dst += dstColInc;
-				}
+				__m128i x = _mm_load_si128(reinterpret_cast<const __m128i*>(luma + col));
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + dmdWidth - 16 - col), Reverse16SSE2(x));
+			}
+		}
+		else
+			memcpy(dst, luma, dmdWidth);
+	}
+}
+
+// Convert 8 pixels from YUV to RGB.  The inputs are 16-bit lanes with
+// Y-16, U-128 and V-128.  This uses the same base-65536 fixed-point
+// formula as the scalar code, with each coefficient split into a
+// multiple of 65536, which becomes a shift, plus a remainder that fits
+// in 16 bits for _mm_madd_epi16, so the results match exactly.
+//
+//   76284 = 65536 + 10748
+//  104595 = 131072 - 26477
+//   53281 = 65536 - 12255
+//  132252 = 131072 + 1180
+//
+static inline void YUVToRGB8SSE2(__m128i y, __m128i u, __m128i v, BYTE *r, BYTE *g, BYTE *b)
+{
+	auto Pair = [](int lo, int hi) {
+		return _mm_set1_epi32(static_cast<int>((static_cast<UINT32>(static_cast<UINT16>(hi)) << 16) | static_cast<UINT16>(lo)));
+	};
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i kR = Pair(10748, -26477), kG = Pair(10748, 12255), kGu = Pair(-25625, 0), kB = Pair(10748, 1180);
+
+	// Figure four pixels.  Interleaving a zero below a 16-bit lane gives
+	// the lane's value times 65536 in a 32-bit lane.
+	auto Figure4 = [&](__m128i yv, __m128i yu, __m128i y16, __m128i u16, __m128i v16, __m128i u0, __m128i &rr, __m128i &gg, __m128i &bb)
+	{
+		rr = _mm_add_epi32(_mm_add_epi32(y16, _mm_slli_epi32(v16, 1)), _mm_madd_epi16(yv, kR));
+		gg = _mm_add_epi32(_mm_sub_epi32(y16, v16), _mm_add_epi32(_mm_madd_epi16(yv, kG), _mm_madd_epi16(u0, kGu)));
+		bb = _mm_add_epi32(_mm_add_epi32(y16, _mm_slli_epi32(u16, 1)), _mm_madd_epi16(yu, kB));
+		rr = _mm_srai_epi32(rr, 16);
+		gg = _mm_srai_epi32(gg, 16);
+		bb = _mm_srai_epi32(bb, 16);
+	};
+	__m128i r0, g0, b0, r1, g1, b1;
+	Figure4(_mm_unpacklo_epi16(y, v), _mm_unpacklo_epi16(y, u), _mm_unpacklo_epi16(zero, y),
+		_mm_unpacklo_epi16(zero, u), _mm_unpacklo_epi16(zero, v), _mm_unpacklo_epi16(u, zero), r0, g0, b0);
+	Figure4(_mm_unpackhi_epi16(y, v), _mm_unpackhi_epi16(y, u), _mm_unpackhi_epi16(zero, y),
+		_mm_unpackhi_epi16(zero, u), _mm_unpackhi_epi16(zero, v), _mm_unpackhi_epi16(u, zero), r1, g1, b1);
+
+	// pack to bytes, clamping to 0..255
+	__m128i rv = _mm_packs_epi32(r0, r1), gv = _mm_packs_epi32(g0, g1), bv = _mm_packs_epi32(b0, b1);
+	_mm_storel_epi64(reinterpret_cast<__m128i*>(r), _mm_packus_epi16(rv, rv));
+	_mm_storel_epi64(reinterpret_cast<__m128i*>(g), _mm_packus_epi16(gv, gv));
+	_mm_storel_epi64(reinterpret_cast<__m128i*>(b), _mm_packus_epi16(bv, bv));
+}
+
+static void ConvertRGBSSE2(const VideoFrameSrc &src, rgb24 *rgb)
+{
+	alignas(16) BYTE luma[dmdWidth], rr[dmdWidth], gg[dmdWidth], bb[dmdWidth];
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i c16 = _mm_set1_epi16(16), c128 = _mm_set1_epi16(128);
+	const BYTE *y = src.y;
+	for (int row = 0; row < dmdHeight; ++row)
+	{
+		// Get the luma row, and the chroma rows.  In a double-size frame,
+		// the chroma planes have one sample per output pixel; at the native
+		// size, they have one sample per 2x2 block.
+		y = GetLumaRowSSE2(y, src.doubleSize, luma);
+		const BYTE *u = src.doubleSize ? src.u + row*dmdWidth : src.u + (row/2)*(dmdWidth/2);
+		const BYTE *v = src.doubleSize ? src.v + row*dmdWidth : src.v + (row/2)*(dmdWidth/2);
+
+		// convert 8 pixels at a time
+		for (int col = 0; col < dmdWidth; col += 8)
+		{
+			__m128i u8, v8;
+			if (src.doubleSize)
+			{
+				u8 = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(u + col));
+				v8 = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(v + col));
+			}
+			else
+			{
+				// load four samples and double each one
+				int uu, vv;
+				memcpy(&uu, u + col/2, 4);
+				memcpy(&vv, v + col/2, 4);
+				u8 = _mm_cvtsi32_si128(uu);
+				v8 = _mm_cvtsi32_si128(vv);
+				u8 = _mm_unpacklo_epi8(u8, u8);
+				v8 = _mm_unpacklo_epi8(v8, v8);
 			}
 
-			// Display the frame.
-			// NB: we don't worry about the dmd-extensions bug (search for #176 above)
-			// for video, as a video will typically present a new frame so quickly that
-			// a single dropped frame shouldn't be noticed.
+			__m128i yw = _mm_sub_epi16(_mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(luma + col)), zero), c16);
+			__m128i uw = _mm_sub_epi16(_mm_unpacklo_epi8(u8, zero), c128);
+			__m128i vw = _mm_sub_epi16(_mm_unpacklo_epi8(v8, zero), c128);
+			YUVToRGB8SSE2(yw, uw, vw, rr + col, gg + col, bb + col);
+		}
+
+		// interleave the channels into the output row, mirroring as needed
+		rgb24 *dst = rgb + (src.mirrorVert ? dmdHeight - 1 - row : row)*dmdWidth;
+		int dstCol = src.mirrorHorz ? dmdWidth - 1 : 0, dstColInc = src.mirrorHorz ? -1 : 1;
+		for (int col = 0; col < dmdWidth; ++col, dstCol += dstColInc)
+		{
+			dst[dstCol].red = rr[col];
+			dst[dstCol].green = gg[col];
+			dst[dstCol].blue = bb[col];
+		}
+	}
+}
+
+#endif // DMD_VIDEO_SSE2
+
+// convert using the best available kernel
+static void ConvertMono16(const VideoFrameSrc &src, const BYTE *gammaMap, UINT8 *gray)
+{
+#ifdef DMD_VIDEO_SSE2
+	ConvertMono16SSE2(src, gammaMap, gray);
+#else
+	ConvertMono16Scalar(src, gammaMap, gray);
+#endif
+}
+
+static void ConvertRGB(const VideoFrameSrc &src, rgb24 *rgb)
+{
+#ifdef DMD_VIDEO_SSE2
+	ConvertRGBSSE2(src, rgb);
+#else
+	ConvertRGBScalar(src, rgb);
+#endif
+}
+
+void RealDMD::BenchmarkVideoConversion()
+{
+#ifdef DMD_VIDEO_SSE2
+	// Make up a double-size I420 frame with arbitrary contents.  The
+	// native-size tests use the first part of the same buffers.
+	const int w = dmdWidth*2, h = dmdHeight*2;
+	std::unique_ptr<BYTE[]> frame(new BYTE[w*h + 2*(w/2)*(h/2)]);
+	UINT32 seed = 12345;
+	for (int i = 0; i < w*h + 2*(w/2)*(h/2); ++i)
+	{
+		seed = seed*1103515245 + 12345;
+		frame[i] = static_cast<BYTE>(seed >> 16);
+	}
+	const BYTE *y = frame.get();
+
+	LARGE_INTEGER freq;
+	QueryPerformanceFrequency(&freq);
+	auto Time = [&freq](std::function<void()> func)
+	{
+		const int nIters = 1000;
+		LARGE_INTEGER t0, t1;
+		QueryPerformanceCounter(&t0);
+		for (int i = 0; i < nIters; ++i)
+			func();
+		QueryPerformanceCounter(&t1);
+		return static_cast<double>(t1.QuadPart - t0.QuadPart) * 1.0e6 / static_cast<double>(freq.QuadPart) / nIters;
+	};
+
+	for (int mode = 0; mode < 8; ++mode)
+	{
+		// set up the source for this test
+		bool doubleSize = (mode & 1) != 0;
+		int cw = doubleSize ? w : dmdWidth, ch = doubleSize ? h : dmdHeight;
+		const BYTE *u = y + cw*ch, *v = u + (cw/2)*(ch/2);
+		VideoFrameSrc src = { y, u, v, doubleSize, (mode & 2) != 0, (mode & 4) != 0 };
+
+		// time the two kernels for each format, and check that they agree
+		UINT8 gray[2][dmdWidth * dmdHeight];
+		rgb24 rgb[2][dmdWidth * dmdHeight];
+		double mono16Scalar = Time([&]() { ConvertMono16Scalar(src, gammaMap, gray[0]); });
+		double mono16SSE2 = Time([&]() { ConvertMono16SSE2(src, gammaMap, gray[1]); });
+		double rgbScalar = Time([&]() { ConvertRGBScalar(src, rgb[0]); });
+		double rgbSSE2 = Time([&]() { ConvertRGBSSE2(src, rgb[1]); });
+		bool match = memcmp(gray[0], gray[1], sizeof(gray[0])) == 0 && memcmp(rgb[0], rgb[1], sizeof(rgb[0])) == 0;
+
+		Log(_T("DMD video conversion benchmark, %s%s%s: mono16 %.1fus scalar, %.1fus SSE2; RGB %.1fus scalar, %.1fus SSE2%s\n"),
+			src.doubleSize ? _T("256x64") : _T("128x32"),
+			src.mirrorHorz ? _T(", mirror horz") : _T(""), src.mirrorVert ? _T(", mirror vert") : _T(""),
+			mono16Scalar, mono16SSE2, rgbScalar, rgbSSE2, match ? _T("") : _T(" ** RESULTS DIFFER **"));
+	}
+#endif
+}
+
+void RealDMD::PresentVideoFrame(int width, int height, const BYTE *y, const BYTE *u, const BYTE *v)
+{
+	// If DMD logging is enabled, run the conversion benchmark on the
+	// first frame of the session.
+	if (!videoBenchmarkDone)
+	{
+		videoBenchmarkDone = true;
+		if (LogFile::Get()->IsFeatureEnabled(LogFile::DmdLogging))
+			BenchmarkVideoConversion();
+	}
+
+	// We can only handle frames at the native device size of 128x32, or
+	// at the double size.  Double-size frames should follow the PinballX
+	// convention where each DMD pixel is stored as a 2x2 block of video
+	// pixels, so that the video has the same visible pixel structure as
+	// a DMD when played back on a video device.
+	VideoFrameSrc src = { y, u, v, false, mirrorHorz, mirrorVert };
+	if (width == dmdWidth*2 && height == dmdHeight*2)
+		src.doubleSize = true;
+	else if (width != dmdWidth || height != dmdHeight)
+		return;
+
+	// Get a buffer for the frame.  If they're all in use, recycle the
+	// oldest queued frame, since the device is evidently falling behind.
+	VideoFrame *f = nullptr;
+	{
+		CriticalSectionLocker locker(writeFrameLock);
+		if (videoFree.size() != 0)
+		{
+			f = videoFree.back();
+			videoFree.pop_back();
+		}
+		else if (videoQueue.size() != 0)
+		{
+			f = videoQueue.front();
+			videoQueue.erase(videoQueue.begin());
+			++videoFramesDropped;
+		}
+		else
+		{
+			// the writer holds the only buffers - drop this frame
+			++videoFramesDropped;
+			return;
+		}
+	}
+
+	// convert the frame according to the device color space we're
+	// rendering to
+	f->colorSpace = videoColorSpace;
+	switch (videoColorSpace)
+	{
+	case DMD_COLOR_MONO16:
+		// convert to 16-shade grayscale
+		ConvertMono16(src, gammaMap, f->pix);
+		break;
+
+	case DMD_COLOR_RGB:
+		// convert to RGB
+		ConvertRGB(src, reinterpret_cast<rgb24*>(f->pix));
+		break;
+
+	default:
+		f->colorSpace = DMD_COLOR_MONO16;
+		ZeroMemory(f->pix, dmdWidth * dmdHeight);
+		break;
+	}
+
+	// send it to the writer thread
+	QueueVideoFrame(f);
+}
+
+void RealDMD::QueueVideoFrame(VideoFrame *f)
+{
+	// if there's no writer thread, write the frame directly
+	if (hWriterThread == NULL)
+	{
+		{
 			CriticalSectionLocker dmdLocker(dmdLock);
-			Render_RGB24_(dmdWidth, dmdHeight, rgb);
+			RenderFrame(f->colorSpace, f->pix, false);
+		}
+
+		CriticalSectionLocker locker(writeFrameLock);
+		videoFree.push_back(f);
+		return;
+	}
+
+	// add it to the queue, dropping the oldest frames if the queue is full
+	{
+		CriticalSectionLocker locker(writeFrameLock);
+		while (videoQueue.size() >= maxQueuedVideoFrames)
+		{
+			videoFree.push_back(videoQueue.front());
+			videoQueue.erase(videoQueue.begin());
+			++videoFramesDropped;
 		}
+		videoQueue.push_back(f);
+	}
+
+	// wake up the writer thread
+	SetEvent(hWriterEvent);
+}
+
+size_t RealDMD::FrameBytes(ColorSpace colorSpace)
+{
+	return colorSpace == DMD_COLOR_RGB ? dmdWidth * dmdHeight * 3 : dmdWidth * dmdHeight;
+}
+
+UINT64 RealDMD::HashFrame(ColorSpace colorSpace, const BYTE *pix, size_t len)
+{
+	// FNV-1a, 64 bits at a time.  The frame sizes are always multiples
+	// of 8 bytes.
+	UINT64 h = 14695981039346656037ULL ^ static_cast<UINT64>(colorSpace);
+	const UINT64 prime = 1099511628211ULL;
+	for (size_t i = 0; i < len; i += 8)
+	{
+		UINT64 w;
+		memcpy(&w, pix + i, 8);
+
+		// For RGB frames, ignore the low bit of the first pixel's blue
+		// component, since the #176 workaround in RenderFrame() changes
+		// it on every send.
+		if (i == 0 && colorSpace == DMD_COLOR_RGB)
+			w &= ~0x10000ULL;
+
+		h = (h ^ w) * prime;
+	}
+	return h;
+}
+
+bool RealDMD::RenderFrame(ColorSpace colorSpace, BYTE *pix, bool rgbWorkaround, bool force)
+{
+	// If this frame is identical to the last one we sent, skip it.  The
+	// keepalive refresh passes 'force' to send it anyway.
+	size_t len = FrameBytes(colorSpace);
+	UINT64 hash = HashFrame(colorSpace, pix, len);
+	if (suppressDuplicates && !force && lastSentValid && colorSpace == lastSentColorSpace && hash == lastSentHash)
+	{
+		++duplicatesSkipped;
+		return false;
+	}
+
+	switch (colorSpace)
+	{
+	case DMD_COLOR_MONO4:
+		Render_4_Shades_(dmdWidth, dmdHeight, pix);
+		break;
+
+	case DMD_COLOR_MONO16:
+		Render_16_Shades_(dmdWidth, dmdHeight, pix);
+		break;
+
+	case DMD_COLOR_RGB:
+		// *** Dmd-Extensions bug #176 workaround ***
+		//
+		// There's a bug in dmd-extensions that makes it drop an RGB
+		// frame if the last RGB frame contained the same pixels, EVEN
+		// IF an intervening frame of a different format was displayed.
+		// (See https://github.com/freezy/dmd-extensions/issues/176.)
+		//
+		// The case we're particularly concerned with is when we're
+		// alternating the display between fixed images in MONO16 and
+		// RGB format, which can happen we have PNG/JPEG media for the
+		// game alternating with generated high-score images.  In this
+		// case, the PNG/JPEG media slide has the same pixels on each
+		// iteration, which makes dmd-ext drop it.  To work around this,
+		// we can very slightly change the pixel data in the source
+		// buffer on each iteration to defeat the buggy "same pixels"
+		// check in dmd-ext.  Flipping the low-order bit of an RGB
+		// component of one pixel won't have any visible effect -
+		// you can't typically see the difference between blue=74
+		// and blue=75, say.  We'll use the blue component because the
+		// human eye has the poorest color resolution in blue, but it
+		// wouldn't really matter if we chose green or red, as the eye
+		// can't resolve color well enough in any component to be able
+		// to distinguish this degree of change.
+		//
+		// To ensure that every consecutive RGB frame is different, no
+		// matter the source, we'll simply replace the low bit in the B
+		// component of the top left pixel in each frame with a bit value
+		// that reverses on every successive frame.
+		//
+		// If this is fixed in a future dmd-extensions, we can do a
+		// version/feature test on the DLL we're attached to and make
+		// the workaround conditional on it:
+		// if (workaround_required)
+		//
+		// Note that the duplicate frame check ignores this bit, so the
+		// workaround doesn't defeat the duplicate suppression.  The caller
+		// can skip the workaround for video, where the frames change so
+		// often that it doesn't matter.
+		if (rgbWorkaround)
+		{
+			// invert the low bit in the static counter
+			static BYTE b = 0x00;
+			b ^= 0x01;
+
+			// replace the low bit in pixel #0's blue component
+			BYTE *p = pix + 2;
+			*p = (*p & 0xFE) | b;
+		}
+
+		// Render the frame
+		Render_RGB24_(dmdWidth, dmdHeight, reinterpret_cast<rgb24*>(pix));
 		break;
 	}
+
+	// remember the frame, for the duplicate check and the keepalive refresh
+	if (pix != lastSentPix.get())
+		memcpy(lastSentPix.get(), pix, len);
+	lastSentColorSpace = colorSpace;
+	lastSentHash = hash;
+	lastSentTime = GetTickCount64();
+	lastSentValid = true;
+	return true;
+}
+
+void RealDMD::LogVideoOutputStats()
+{
+	UINT64 dropped;
+	{
+		CriticalSectionLocker locker(writeFrameLock);
+		dropped = videoFramesDropped;
+		videoFramesDropped = 0;
+	}
+
+	if (videoFramesWritten != 0 || dropped != 0)
+	{
+		Log(_T("DMD video output: %I64u frames written, %I64u dropped; device write time avg %.2fms, max %.2fms\n"),
+			videoFramesWritten, dropped,
+			videoFramesWritten != 0 ? videoWriteTotal_ms / static_cast<double>(videoFramesWritten) : 0.0,
+			videoWriteMax_ms);
+	}
+
+	if (duplicatesSkipped != 0)
+	{
+		Log(_T("DMD output: %I64u duplicate frames skipped\n"), duplicatesSkipped);
+		duplicatesSkipped = 0;
+	}
+
+	videoFramesWritten = 0;
+	videoWriteTotal_ms = videoWriteMax_ms = 0.0;
+	videoStatsTime = GetTickCount64();
 }
 
 void RealDMD::VideoEndOfPresentation(WPARAM cookie)
@@ -1897,7 +2414,7 @@ void RealDMD::VideoLoopNeeded(WPARAM cookie)
 			videoPlayer->Stop(seh);
 			StartSlideShow();
 		}
-		else
+		else if (!videoPlayer->IsLoopHandledInPlayer())
 			videoPlayer->Replay(seh);
 	}
 }
@@ -6,6 +6,7 @@
 #pragma once
 #include "VLCAudioVideoPlayer.h"
 #include "DmdDeviceDll.h"
+#include "MemoryStats.h"
 
 class ErrorHandler;
 class GameListItem;
@@ -214,6 +215,12 @@ protected:
 	bool mirrorHorz;
 	bool mirrorVert;
 
+	// Video frame conversion benchmark.  When DMD logging is enabled,
+	// we time the SIMD frame conversion kernels against the scalar
+	// versions on the first video frame, and log the results.
+	void BenchmarkVideoConversion();
+	bool videoBenchmarkDone = false;
+
 	// Monochrome base color for the current game, from the 
 	// VPinMAME settings for the game's ROM.
 	COLORREF baseColor;
@@ -270,20 +277,25 @@ protected:
 			HighScoreSlide   // generated high score screen
 		} slideType;
 
-		Slide(ColorSpace colorSpace, BYTE *pix, DWORD displayTime, SlideType slideType) :
+		Slide(ColorSpace colorSpace, BYTE *pix, size_t nBytes, DWORD displayTime, SlideType slideType) :
 			colorSpace(colorSpace),
 			pix(pix),
+			nBytes(static_cast<INT64>(nBytes)),
 			displayTime(displayTime),
 			slideType(slideType)
 		{
+			MemoryStats::AddCPU(MemoryStats::DMDImages, this->nBytes);
 		}
 
+		~Slide() { MemoryStats::AddCPU(MemoryStats::DMDImages, -nBytes); }
+
 		// The image's color type - this selects the device DLL
 		// function that we use to display it
 		ColorSpace colorSpace;
 
-		// Pixel array for the image
+		// Pixel array for the image, and its size in bytes
 		std::unique_ptr<BYTE> pix;
+		INT64 nBytes;
 
 		// display time for this image, in milliseconds
 		DWORD displayTime;
@@ -315,6 +327,70 @@ protected:
 	};
 	std::unique_ptr<GameSettings> writerSettings;
 
+	// Video frame queue.  Video frames arrive on the libvlc decoder
+	// thread, and some DLL implementations block for several
+	// milliseconds on each device write (for USB or serial I/O), which
+	// would stall the decoder if we wrote the frames directly.  So we
+	// convert each frame into one of a small, fixed set of buffers and
+	// queue it for the writer thread.  The queue is bounded: if the
+	// device falls behind, we drop the oldest queued frames, and the
+	// writer always sends the newest frame available, discarding any
+	// older ones that are still waiting.  The lists are protected by
+	// writeFrameLock.
+	struct VideoFrame
+	{
+		ColorSpace colorSpace;
+		BYTE pix[128 * 32 * 3];		// large enough for a 128x32 RGB frame
+	};
+	static const int nVideoFrames = 4;
+	static const size_t maxQueuedVideoFrames = 2;
+	std::unique_ptr<VideoFrame> videoFrames[nVideoFrames];
+	std::vector<VideoFrame*> videoQueue;	// frames waiting to be written, oldest first
+	std::vector<VideoFrame*> videoFree;		// buffers available for new frames
+
+	// queue a converted video frame for the writer thread
+	void QueueVideoFrame(VideoFrame *f);
+
+	// Video output statistics.  We log these periodically while video
+	// is playing, and when the writer thread exits.  The drop count is
+	// protected by writeFrameLock; the write times are only accessed on
+	// the writer thread.
+	UINT64 videoFramesWritten = 0;
+	UINT64 videoFramesDropped = 0;
+	double videoWriteTotal_ms = 0.0;
+	double videoWriteMax_ms = 0.0;
+	ULONGLONG videoStatsTime = 0;
+	void LogVideoOutputStats();
+
+	// Duplicate frame suppression.  Most DMD content (still images,
+	// high score slides, title text) doesn't change from one frame to
+	// the next, so there's no need to send the device a frame that's
+	// identical to the last one we sent.  We keep a hash of the last
+	// frame sent, and skip any new frame that matches it.  Some devices
+	// blank the display if they don't receive any data for a while, so
+	// we still resend the last frame at the keepalive interval.  These
+	// are all accessed only on the writer thread, under dmdLock.
+	bool suppressDuplicates = true;
+	DWORD keepaliveInterval = 5000;		// milliseconds; 0 disables the refresh
+	bool lastSentValid = false;
+	ColorSpace lastSentColorSpace = DMD_COLOR_MONO16;
+	UINT64 lastSentHash = 0;
+	ULONGLONG lastSentTime = 0;
+	std::unique_ptr<BYTE[]> lastSentPix;
+	UINT64 duplicatesSkipped = 0;
+
+	// Send a frame to the device, unless it duplicates the last frame
+	// sent.  'rgbWorkaround' applies the dmd-extensions #176 workaround
+	// to RGB frames (see the implementation).  The caller must hold
+	// dmdLock.  Returns true if the frame was sent.
+	bool RenderFrame(ColorSpace colorSpace, BYTE *pix, bool rgbWorkaround, bool force = false);
+
+	// hash a frame's pixels, for the duplicate check
+	static UINT64 HashFrame(ColorSpace colorSpace, const BYTE *pix, size_t len);
+
+	// get the size of a frame's pixel data for the given color space
+	static size_t FrameBytes(ColorSpace colorSpace);
+
 	// send a frame to the writer
 	void SendWriterFrame(Slide *slide);
 
@@ -66,11 +66,11 @@ void RefTableList::GetFilenameMatches(const TCHAR *filename, int n, std::list<Ta
 	lcName = std::regex_replace(lcName, extPat, _T(""));
 
 	// build the bigram set for the name
-	DiceCoefficient::BigramSet<TCHAR> bg;
-	DiceCoefficient::BuildBigramSet(bg, lcName.c_str());
+	DiceCoefficient::PackedBigramSet<TCHAR> bg;
+	DiceCoefficient::BuildPackedBigramSet(bg, lcName.c_str());
 
 	// get the number of rows in the reference list
-	size_t nRows = nameBigrams.size();
+	size_t nRows = nameIndex.Size();
 
 	// If the target name has any parenthetical suffixes, remove them.
 	// It's common for table files to have names that either conform to
@@ -86,7 +86,7 @@ void RefTableList::GetFilenameMatches(const TCHAR *filename, int n, std::list<Ta
 	// match results by removing them.  Yet another common add-on
 	// is "FS" (for full-screen).
 	TSTRING baseName;
-	std::basic_regex<TCHAR> suffixPat(_T("(.+?)(\\s*\\(.*|[\\s_\\-.]vp[89x].*|[\\s_\\-.]fs[\\s_\\-.].*)"));
+	static const std::basic_regex<TCHAR> suffixPat(_T("(.+?)(\\s*\\(.*|[\\s_\\-.]vp[89x].*|[\\s_\\-.]fs[\\s_\\-.].*)"));
 	std::match_results<const TCHAR*> m;
 	if (std::regex_match(lcName.c_str(), m, suffixPat))
 		baseName = m[1].str();
@@ -94,76 +94,84 @@ void RefTableList::GetFilenameMatches(const TCHAR *filename, int n, std::list<Ta
 		baseName = lcName;
 
 	// get the bigram set for the base name
-	DiceCoefficient::BigramSet<TCHAR> bgBase;
-	DiceCoefficient::BuildBigramSet(bgBase, baseName.c_str());
+	DiceCoefficient::PackedBigramSet<TCHAR> bgBase;
+	DiceCoefficient::BuildPackedBigramSet(bgBase, baseName.c_str());
 
 	// there's nothing to do if the ref list is empty
 	if (nRows == 0)
 		return;
 
-	// working search results list
-	struct Result
+	// Working score list, indexed by row, with the list of rows we've
+	// scored so far.  Only the rows that share a bigram with the name or
+	// base name, or that match the initials, get a non-zero score.
+	std::vector<float> scores(nRows, 0.0f);
+	std::vector<int> scoredRows;
+	auto AddScore = [&scores, &scoredRows](int row, float score)
 	{
-		Result(int idx, float score) : idx(idx), score(score) { }
-		int idx;           // CSV row index of the match
-		float score;       // match score
+		if (scores[row] == 0.0f)
+			scoredRows.push_back(row);
+		scores[row] = max(scores[row], score);
 	};
-	std::vector<Result> searchResults;
-	searchResults.reserve(nRows);
 
-	// go through the table list and look for matches
-	float highScore = 0.0f;
-	for (size_t i = 0; i < nRows; ++i)
+	// Figure the match strength for the name and the shortened version of
+	// the name against the name and alternate name of each candidate row,
+	// using the highest of the scores for each row.
+	std::vector<DiceCoefficient::BigramIndex<TCHAR>::Match> matches;
+	for (auto index : { &nameIndex, &altNameIndex })
 	{
-		// figure the match strength for this item
-		float score = DiceCoefficient::DiceCoefficient(bg, nameBigrams[i]);
-
-		// figure the match strength for the shortened version of the name, and
-		// use this score if it's higher than the original
-		float score2 = DiceCoefficient::DiceCoefficient(bgBase, nameBigrams[i]);
-		score = max(score, score2);
-
-		// try again with the name against the alternate name
-		score2 = DiceCoefficient::DiceCoefficient(bg, altNameBigrams[i]);
-		score = max(score, score2);
-
-		// try once again the base name against the alt name
-		score2 = DiceCoefficient::DiceCoefficient(bgBase, altNameBigrams[i]);
-		score = max(score, score2);
-
-		// Try matching the base name to the initials.  This isn't a bigram 
-		// match, just a substring match, but we need a score on the 0-1.0
-		// scale for comparison purposes.  Score it based on the number of
-		// initials.  Don't try to match based on a single initial at all.
-		const TCHAR *initials = initialsCol->Get((int)i, _T(""));
-		size_t nInitials = _tcslen(initials);
-		if (nInitials > 1 && (lcName == initials || baseName == initials))
+		for (auto query : { &bg, &bgBase })
 		{
-			float score2 = float(nInitials) * 0.2f;
-			score2 = min(1.0f, score2);
-			score = max(score, score2);
+			matches.clear();
+			index->FindAll(*query, 0.0f, matches);
+			for (auto const &m : matches)
+				AddScore(m.index, m.score);
 		}
+	}
 
-		// Try the same thing with the initials with a "T" prefix, for "The".
-		// We strip out "The" from the reference titles when building the
-		// initials string, but the "standard" initials for a very few games
-		// include the "T" from "The" in the initials, such as "The Addams
-		// Family".
-		TSTRING initialsWithT = _T("t");
-		initialsWithT += initials;
-		if (lcName == initialsWithT || baseName == initialsWithT)
+	// Try matching the base name to the initials.  This isn't a bigram 
+	// match, just a substring match, but we need a score on the 0-1.0
+	// scale for comparison purposes.  Score it based on the number of
+	// initials.  Don't try to match based on a single initial at all.
+	auto MatchInitials = [this, &AddScore](const TSTRING &key, size_t nExtra)
+	{
+		for (auto range = initialsMap.equal_range(key); range.first != range.second; ++range.first)
 		{
-			float score2 = float(nInitials + 1) * 0.2f;
-			score2 = min(1.0f, score2);
-			score = max(score, score2);
+			size_t nInitials = range.first->first.length();
+			if (nInitials > 1 || nExtra != 0)
+				AddScore(range.first->second, min(1.0f, float(nInitials + nExtra) * 0.2f));
 		}
+	};
+	MatchInitials(lcName, 0);
+	if (baseName != lcName)
+		MatchInitials(baseName, 0);
+
+	// Try the same thing with the initials with a "T" prefix, for "The".
+	// We strip out "The" from the reference titles when building the
+	// initials string, but the "standard" initials for a very few games
+	// include the "T" from "The" in the initials, such as "The Addams
+	// Family".
+	if (lcName.length() != 0 && lcName[0] == 't')
+		MatchInitials(lcName.substr(1), 1);
+	if (baseName != lcName && baseName.length() != 0 && baseName[0] == 't')
+		MatchInitials(baseName.substr(1), 1);
 
-		// add it to the results, using the highest score we came up with
-		searchResults.emplace_back((int)i, score);
+	// working search results list
+	struct Result
+	{
+		Result(int idx, float score) : idx(idx), score(score) { }
+		int idx;           // CSV row index of the match
+		float score;       // match score
+	};
+	std::vector<Result> searchResults;
+	searchResults.reserve(scoredRows.size());
 
-		// note the highest score so far
-		if (score > highScore)
-			highScore = score;
+	// collect the results, noting the highest score
+	float highScore = 0.0f;
+	for (auto row : scoredRows)
+	{
+		searchResults.emplace_back(row, scores[row]);
+		if (scores[row] > highScore)
+			highScore = scores[row];
 	}
 
 	// if we didn't come up with any matches, we're done
@@ -184,7 +192,7 @@ void RefTableList::GetFilenameMatches(const TCHAR *filename, int n, std::list<Ta
 	{
 		// stop if we've filled out the list, or this item's score 
 		// is too far below the top item's score
-		if ((int)lst.size() >= n || it.score < highScore - 0.3f)
+		if ((int)finalResults.size() >= n || it.score < highScore - 0.3f)
 			break;
 
 		// add this item to the results
@@ -227,11 +235,11 @@ void RefTableList::GetTitleFragmentMatches(const TCHAR *title, int n, std::list<
 	std::transform(lcName.begin(), lcName.end(), lcName.begin(), _totlower);
 
 	// build the bigram set for the name
-	DiceCoefficient::BigramSet<TCHAR> bg;
-	DiceCoefficient::BuildBigramSet(bg, lcName.c_str());
+	DiceCoefficient::PackedBigramSet<TCHAR> bg;
+	DiceCoefficient::BuildPackedBigramSet(bg, lcName.c_str());
 
 	// get the number of rows in the reference list
-	size_t nRows = nameBigrams.size();
+	size_t nRows = nameIndex.Size();
 
 	// there's nothing to do if the ref list is empty
 	if (nRows == 0)
@@ -246,31 +254,47 @@ void RefTableList::GetTitleFragmentMatches(const TCHAR *title, int n, std::list<
 		bool isLeading;    // is this a leading substring of the name?
 	};
 	std::vector<Result> searchResults;
-	searchResults.reserve(nRows);
 
-	// go through the table list and look for matches
-	float highScore = 0.0f;
-	for (size_t i = 0; i < nRows; ++i)
+	// Figure the match strength for the name against the name and the
+	// alternate name of each candidate row, using the higher score.
+	// resultIndex maps each row to its entry in the result list.
+	std::vector<int> resultIndex(nRows, -1);
+	auto AddResult = [&searchResults, &resultIndex](int row, float score, bool isLeading)
 	{
-		// figure the match strength for this item
-		float score = DiceCoefficient::DiceCoefficient(bg, nameBigrams[i]);
-
-		// try again with the name against the alternate name
-		float score2 = DiceCoefficient::DiceCoefficient(bg, altNameBigrams[i]);
-		score = max(score, score2);
-
-		// Note if this is a leading substring of the name or sort key. 
-		// Check the sort key so that we match a fragment like "addams family",
-		// where the initial "the" in the regular name has been elided.
-		bool isLeading = tstriStartsWith(nameCol->Get(static_cast<int>(i)), title)
-			|| tstriStartsWith(sortKeyCol->Get(static_cast<int>(i)), title);
+		if (int &r = resultIndex[row]; r < 0)
+		{
+			r = static_cast<int>(searchResults.size());
+			searchResults.emplace_back(row, score, isLeading);
+		}
+		else
+		{
+			searchResults[r].score = max(searchResults[r].score, score);
+			searchResults[r].isLeading |= isLeading;
+		}
+	};
+	std::vector<DiceCoefficient::BigramIndex<TCHAR>::Match> matches;
+	for (auto index : { &nameIndex, &altNameIndex })
+	{
+		matches.clear();
+		index->FindAll(bg, 0.0f, matches);
+		for (auto const &m : matches)
+			AddResult(m.index, m.score, false);
+	}
 
-		// add it to the results, using the highest score we came up with
-		searchResults.emplace_back((int)i, score, isLeading);
+	// Note the rows where this is a leading substring of the name or sort
+	// key.  Check the sort key so that we match a fragment like "addams
+	// family", where the initial "the" in the regular name has been elided.
+	std::vector<int> leadingRows;
+	FindPrefixMatches(lcName, leadingRows);
+	for (auto row : leadingRows)
+		AddResult(row, 0.0f, true);
 
-		// note the highest score so far
-		if (score > highScore)
-			highScore = score;
+	// note the highest score
+	float highScore = 0.0f;
+	for (auto const &r : searchResults)
+	{
+		if (r.score > highScore)
+			highScore = r.score;
 	}
 
 	// if we didn't come up with any matches, we're done
@@ -311,6 +335,20 @@ void RefTableList::GetTitleFragmentMatches(const TCHAR *title, int n, std::list<
 	}
 }
 
+void RefTableList::FindPrefixMatches(const TSTRING &lcPrefix, std::vector<int> &rows)
+{
+	// find the first key at or after the prefix, then visit keys until
+	// we reach one that doesn't start with the prefix
+	std::unordered_set<int> seen;
+	for (auto it = std::lower_bound(prefixIndex.begin(), prefixIndex.end(), lcPrefix,
+		[](const std::pair<TSTRING, int> &a, const TSTRING &b) { return a.first < b; });
+		it != prefixIndex.end() && it->first.compare(0, lcPrefix.length(), lcPrefix) == 0; ++it)
+	{
+		if (seen.insert(it->second).second)
+			rows.push_back(it->second);
+	}
+}
+
 RefTableList::Table::Table(RefTableList *rtl, int row)
 {
 	listName = rtl->listNameCol->Get(row, _T(""));
@@ -368,10 +406,9 @@ void RefTableList::Init()
 		static const std::basic_regex<TCHAR> trimPat(_T("^(the|a|an)?\\s+|\\s+(,\\s+(the|a|an))?$"));
 		static const std::basic_regex<TCHAR> initPat(_T("(\\w)\\w+\\s*"));
 
-		// Build the bigram sets and sorting keys
+		// Build the bigram indices, search keys, and sorting keys
 		size_t nRows = self->csvFile.GetNumRows();
-		self->nameBigrams.reserve(nRows);
-		self->altNameBigrams.reserve(nRows);
+		self->prefixIndex.reserve(nRows * 2);
 		for (size_t i = 0; i < nRows; ++i)
 		{
 			// get the row number as an integer
@@ -381,20 +418,24 @@ void RefTableList::Init()
 			TSTRING name = self->nameCol->Get(rownum, _T(""));
 			std::transform(name.begin(), name.end(), name.begin(), _totlower);
 
-			// Emplace a new row in the bigram set vector, and build
-			// the bigram set for the title into the vector entry.
-			self->nameBigrams.emplace_back();
-			DiceCoefficient::BuildBigramSet(self->nameBigrams.back(), name.c_str());
+			// Add the name to the bigram index.  The index entries are in
+			// the same order as the rows, so the entry index is the row number.
+			self->nameIndex.Add(name.c_str());
 
 			// likewise for the AltName bigrams
 			TSTRING altName = self->altNameCol->Get(rownum, _T(""));
 			std::transform(altName.begin(), altName.end(), altName.begin(), _totlower);
-			self->altNameBigrams.emplace_back();
-			DiceCoefficient::BuildBigramSet(self->altNameBigrams.back(), altName.c_str());
+			self->altNameIndex.Add(altName.c_str());
 
 			// Synthesize the sorting key
 			self->MakeSortKey(rownum);
 
+			// add the name and sort key to the leading substring index
+			TSTRING sortKey = self->sortKeyCol->Get(rownum, _T(""));
+			std::transform(sortKey.begin(), sortKey.end(), sortKey.begin(), _totlower);
+			self->prefixIndex.emplace_back(name, rownum);
+			self->prefixIndex.emplace_back(sortKey, rownum);
+
 			// Synthesize the list name
 			self->MakeListName(rownum);
 
@@ -408,8 +449,9 @@ void RefTableList::Init()
 			initName = std::regex_replace(initName, trimPat, _T(""));
 			initName = std::regex_replace(initName, initPat, _T("$1"));
 
-			// store it
+			// store it, and add it to the initials map
 			self->initialsCol->Set(rownum, initName.c_str());
+			self->initialsMap.emplace(initName, rownum);
 
 			// if it has an IPDB ID, add it to the IPDB map
 			const TCHAR *ipdbId = self->ipdbIdCol->Get(rownum, nullptr);
@@ -417,6 +459,11 @@ void RefTableList::Init()
 				self->ipdbIdMap.emplace(ipdbId, rownum);
 		}
 
+		// build the search indices
+		self->nameIndex.Build();
+		self->altNameIndex.Build();
+		std::sort(self->prefixIndex.begin(), self->prefixIndex.end());
+
 		// Build the sorted row order vector.  Start by populating it with 
 		// all of the row numbers.
 		auto &sr = self->sortedRows;
@@ -451,11 +498,11 @@ void RefTableList::MakeSortKey(int row)
 	std::transform(manuf.begin(), manuf.end(), manuf.begin(), _totlower);
 
 	// remove enclosing quotes
-	std::basic_regex<TCHAR> quotePat(_T("^([\"'])(.*)\\1$|^[\x84\x93](.*)\x94$"));
+	static const std::basic_regex<TCHAR> quotePat(_T("^([\"'])(.*)\\1$|^[\x84\x93](.*)\x94$"));
 	name = std::regex_replace(name, quotePat, _T("$2$3"));
 
 	// move "The" and "A" prefixes to the end
-	std::basic_regex<TCHAR> articlePat(_T("^(the|a|an)\\s+(.*)$"));
+	static const std::basic_regex<TCHAR> articlePat(_T("^(the|a|an)\\s+(.*)$"));
 	name = std::regex_replace(name, articlePat, _T("$2, $1"));
 
 	// now build the full key
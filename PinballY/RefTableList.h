@@ -119,11 +119,27 @@ protected:
 	// underlying CSV file data
 	CSVFile csvFile;
 
-	// Bigram sets for the Name, AltName, and Initials fields.  The 
-	// table is static, so we just build these vectors in parallel, 
-	// indexed by the row numbers in the CSV file data.
-	std::vector<DiceCoefficient::BigramSet<TCHAR>> nameBigrams;
-	std::vector<DiceCoefficient::BigramSet<TCHAR>> altNameBigrams;
+	// Bigram indices for the Name and AltName fields.  The table is
+	// static, so we just build these in parallel, with the index entries
+	// in the same order as the rows in the CSV file data.  The indices
+	// let a match query score only the rows that share a bigram with
+	// the query string, rather than scanning the whole table.
+	DiceCoefficient::BigramIndex<TCHAR> nameIndex;
+	DiceCoefficient::BigramIndex<TCHAR> altNameIndex;
+
+	// Initials map.  This maps the synthesized Initials field values to
+	// row numbers, for the exact initials matches in the filename search.
+	std::unordered_multimap<TSTRING, int> initialsMap;
+
+	// Leading substring index.  This contains the lower-case Name and
+	// SortKey fields for all rows, paired with the row numbers, sorted
+	// by the strings, so that we can find all of the rows with a given
+	// leading substring with a binary search.
+	std::vector<std::pair<TSTRING, int>> prefixIndex;
+
+	// Find the rows whose Name or SortKey field starts with the given
+	// lower-case string.  Each row is added only once.
+	void FindPrefixMatches(const TSTRING &lcPrefix, std::vector<int> &rows);
 
 	// IPDB ID map.  This maps IPDB ID keys to row numbers in the CSV.
 	std::unordered_map<TSTRING, int> ipdbIdMap;
@@ -133,6 +133,7 @@
 #define IDS_BATCH_CAPTURE_VIEW          329
 #define IDS_BATCH_CAPTURE_KEEP          330
 #define IDS_BATCH_CAPTURE_REPLACE       331
+#define IDS_BATCH_CAPTURE_FINISHING     332
 
 
 #define IDS_RATE_GAME_PROMPT            360
@@ -385,6 +386,8 @@
 #define IDS_ERR_AUDIOPLAYERSYSERR       717
 #define IDS_ERR_INVAL_IPDB_ID           718
 #define IDS_ERR_INVAL_MEDIA_NAME        719
+#define IDS_ERR_CAP_ITEM_QUEUED         720
+#define IDS_ERR_RENAME_MEDIA_ROLLED_BACK 721
 
 #define IDS_PLAYED_WITHIN               800
 #define IDS_NOT_PLAYED_WITHIN           801
@@ -462,6 +465,7 @@
 #define IDS_MEDIA_DROP_REPLACE_PROMPT   923
 #define IDS_MEDIA_DROP_REPLACE_YES      924
 #define IDS_MEDIA_DROP_REPLACE_NO       925
+#define IDS_MEDIA_DROP_STARTED          926
 
 #define IDS_ROMCOMBO_DEFAULT_EMPTY      930
 #define IDS_ROMCOMBO_DEFAULT_NAME       931
@@ -0,0 +1,160 @@
+// This file is part of PinballY
+// Copyright 2018 Michael J Roberts | GPL v3 or later | NO WARRANTY
+//
+// Javascript bytecode cache
+
+#include "stdafx.h"
+#include "../Utilities/FileUtil.h"
+#include "ScriptBytecodeCache.h"
+#include "LogFile.h"
+
+// Cache file layout.  The header is followed by the script path (as
+// pathLen WCHARs, without a null terminator) and then the bytecode.
+struct ScriptCacheFileHeader
+{
+	char sig[16];         // signature, scriptCacheFileSig
+	UINT32 ptrSize;       // sizeof(void*) for the build that wrote the entry
+	UINT32 pathLen;       // length of the script path, in WCHARs
+	UINT64 sourceSize;    // key fields
+	UINT64 sourceTime;
+	UINT64 engineSize;
+	UINT64 engineTime;
+	UINT32 codeBytes;     // size of the bytecode
+};
+static const char scriptCacheFileSig[16] = "PBYScriptCache1";
+
+bool ScriptBytecodeCache::GetFileStamp(const WCHAR *path, UINT64 &size, UINT64 &time)
+{
+	WIN32_FILE_ATTRIBUTE_DATA attrs;
+	if (!GetFileAttributesExW(path, GetFileExInfoStandard, &attrs))
+		return false;
+
+	size = (static_cast<UINT64>(attrs.nFileSizeHigh) << 32) | attrs.nFileSizeLow;
+	time = (static_cast<UINT64>(attrs.ftLastWriteTime.dwHighDateTime) << 32) | attrs.ftLastWriteTime.dwLowDateTime;
+	return true;
+}
+
+bool ScriptBytecodeCache::GetKey(const WCHAR *path, Key &key)
+{
+	// get the engine DLL stamp
+	WCHAR engine[MAX_PATH];
+	HMODULE hmod = GetModuleHandleW(L"ChakraCore.dll");
+	if (hmod == NULL || GetModuleFileNameW(hmod, engine, countof(engine)) == 0
+		|| !GetFileStamp(engine, key.engineSize, key.engineTime))
+		return false;
+
+	// get the source file stamp
+	return GetFileStamp(path, key.sourceSize, key.sourceTime);
+}
+
+WSTRING ScriptBytecodeCache::GetCacheFile(const WCHAR *path)
+{
+	// name the file after a hash of the case-folded path
+	WSTRING lcPath = path;
+	std::transform(lcPath.begin(), lcPath.end(), lcPath.begin(), ::towlower);
+	UINT64 hash = std::hash<WSTRING>()(lcPath);
+
+	TCHAR folder[MAX_PATH];
+	GetDeployedFilePath(folder, _T("ScriptCache"), _T(""));
+	return MsgFmt(_T("%s\\%016I64x.jsc"), folder, hash).Get();
+}
+
+bool ScriptBytecodeCache::Load(const WCHAR *path, const Key &key, std::vector<BYTE> &bytecode)
+{
+	// if there's no cache file, there's nothing to load
+	WSTRING cacheFile = GetCacheFile(path);
+	FILEPtrHolder fp;
+	if (_wfopen_s(&fp, cacheFile.c_str(), L"rb") != 0)
+		return false;
+
+	// read and check the header
+	ScriptCacheFileHeader hdr;
+	if (fread(&hdr, sizeof(hdr), 1, fp) != 1
+		|| memcmp(hdr.sig, scriptCacheFileSig, sizeof(scriptCacheFileSig)) != 0
+		|| hdr.ptrSize != sizeof(void*)
+		|| hdr.sourceSize != key.sourceSize
+		|| hdr.sourceTime != key.sourceTime
+		|| hdr.engineSize != key.engineSize
+		|| hdr.engineTime != key.engineTime
+		|| hdr.pathLen > 32768
+		|| hdr.codeBytes == 0)
+		return false;
+
+	// make sure it's for the same script, in case of a hash collision
+	std::vector<WCHAR> entryPath(hdr.pathLen);
+	if (fread(entryPath.data(), sizeof(WCHAR), hdr.pathLen, fp) != hdr.pathLen
+		|| _wcsnicmp(entryPath.data(), path, hdr.pathLen) != 0
+		|| path[hdr.pathLen] != 0)
+		return false;
+
+	// read the bytecode
+	bytecode.resize(hdr.codeBytes);
+	if (fread(bytecode.data(), 1, hdr.codeBytes, fp) != hdr.codeBytes)
+	{
+		bytecode.clear();
+		return false;
+	}
+
+	// success
+	return true;
+}
+
+void ScriptBytecodeCache::Save(const WCHAR *path, const Key &key, const std::vector<BYTE> &bytecode)
+{
+	auto Fail = [](const TCHAR *what, DWORD err)
+	{
+		LogFile::Get()->Write(LogFile::JSLogging,
+			_T("[Javascript] Bytecode cache: error saving cache file (%s, error %lu)\n"), what, err);
+	};
+
+	// make sure the cache folder exists
+	TCHAR folder[MAX_PATH];
+	GetDeployedFilePath(folder, _T("ScriptCache"), _T(""));
+	if (!DirectoryExists(folder) && !CreateDirectory(folder, NULL))
+		return Fail(_T("CreateDirectory"), GetLastError());
+
+	// set up the header
+	ScriptCacheFileHeader hdr;
+	memcpy(hdr.sig, scriptCacheFileSig, sizeof(hdr.sig));
+	hdr.ptrSize = sizeof(void*);
+	hdr.pathLen = static_cast<UINT32>(wcslen(path));
+	hdr.sourceSize = key.sourceSize;
+	hdr.sourceTime = key.sourceTime;
+	hdr.engineSize = key.engineSize;
+	hdr.engineTime = key.engineTime;
+	hdr.codeBytes = static_cast<UINT32>(bytecode.size());
+
+	// Write the file to a temporary name, then move it into place, so
+	// that a reader never sees a partial entry.
+	WSTRING cacheFile = GetCacheFile(path);
+	WSTRING tmpFile = cacheFile + L".tmp";
+	bool ok = false;
+	{
+		FILEPtrHolder fp;
+		if (_wfopen_s(&fp, tmpFile.c_str(), L"wb") == 0)
+		{
+			ok = fwrite(&hdr, sizeof(hdr), 1, fp) == 1
+				&& fwrite(path, sizeof(WCHAR), hdr.pathLen, fp) == hdr.pathLen
+				&& fwrite(bytecode.data(), 1, bytecode.size(), fp) == bytecode.size();
+		}
+	}
+	if (!ok)
+	{
+		DeleteFileW(tmpFile.c_str());
+		return Fail(_T("writing the cache file"), 0);
+	}
+	if (!MoveFileExW(tmpFile.c_str(), cacheFile.c_str(), MOVEFILE_REPLACE_EXISTING))
+	{
+		DWORD err = GetLastError();
+		DeleteFileW(tmpFile.c_str());
+		return Fail(_T("MoveFileEx"), err);
+	}
+
+	LogFile::Get()->Write(LogFile::JSLogging, _T("[Javascript] Bytecode cache: saved %ws (%d bytes)\n"),
+		path, static_cast<int>(bytecode.size()));
+}
+
+void ScriptBytecodeCache::Discard(const WCHAR *path)
+{
+	DeleteFileW(GetCacheFile(path).c_str());
+}
@@ -0,0 +1,65 @@
+// This file is part of PinballY
+// Copyright 2018 Michael J Roberts | GPL v3 or later | NO WARRANTY
+//
+// Javascript bytecode cache
+//
+// This is a disk cache of the ChakraCore serialized (pre-parsed) form of
+// our script files, so that we don't have to parse and compile the same
+// scripts from source on every launch.  The serialized form is produced
+// by JsSerializeScript(), and can be run with JsRunSerializedScript(),
+// which skips the parsing step entirely.
+//
+// Entries are stored in the ScriptCache folder under the program folder,
+// one file per script.  Each entry records the script's full path, its
+// size and modification time, and the size and modification time of the
+// ChakraCore DLL, since the serialized format is specific to the engine
+// build.  An entry is only used when all of these still match, so the
+// cache never needs explicit invalidation; a stale entry is simply
+// replaced the next time the script is loaded.  The folder can be
+// deleted at any time.
+//
+// Note that this only applies to classic scripts (the system scripts).
+// ChakraCore's JSRT API has no serialized form for ES6 modules, so the
+// main script and its imports are always parsed from source.
+
+#pragma once
+#include <vector>
+
+class ScriptBytecodeCache
+{
+public:
+	// Cache key.  This identifies the version of the source file and the
+	// engine that a bytecode entry was built from.
+	struct Key
+	{
+		UINT64 sourceSize = 0;
+		UINT64 sourceTime = 0;
+		UINT64 engineSize = 0;
+		UINT64 engineTime = 0;
+	};
+
+	// Get the current key for a script file.  Returns false if the file
+	// or the engine DLL can't be found.  Get the key before reading the
+	// source file, so that a change made while we're reading it won't
+	// be mistaken for the version we read.
+	static bool GetKey(const WCHAR *path, Key &key);
+
+	// Load the cached bytecode for a script.  Returns true and fills in
+	// 'bytecode' if there's a cache entry matching the key.
+	static bool Load(const WCHAR *path, const Key &key, std::vector<BYTE> &bytecode);
+
+	// Save the bytecode for a script.  Errors are logged but otherwise
+	// ignored, since the cache is only an optimization.
+	static void Save(const WCHAR *path, const Key &key, const std::vector<BYTE> &bytecode);
+
+	// Discard the cache entry for a script.  We use this when the engine
+	// rejects a cached entry.
+	static void Discard(const WCHAR *path);
+
+	// get the size and modification time of a file
+	static bool GetFileStamp(const WCHAR *path, UINT64 &size, UINT64 &time);
+
+protected:
+	// get the cache file name for a script
+	static WSTRING GetCacheFile(const WCHAR *path);
+};
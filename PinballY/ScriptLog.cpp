@@ -0,0 +1,110 @@
+// This file is part of PinballY
+// Copyright 2018 Michael J Roberts | GPL v3 or later | NO WARRANTY
+//
+// Script log output
+
+#include "stdafx.h"
+#include "ScriptLog.h"
+#include "JavascriptEngine.h"
+#include "LogFile.h"
+
+// statics
+std::unordered_map<TSTRING, ScriptLog::Bucket> ScriptLog::buckets;
+int ScriptLog::rateLimit = 50;
+UINT_PTR ScriptLog::summaryTimerId = 0;
+
+void ScriptLog::SetRateLimit(int messagesPerSecond)
+{
+	rateLimit = max(0, messagesPerSecond);
+}
+
+void ScriptLog::Refill(Bucket &b, ULONGLONG now)
+{
+	// add tokens at the rate limit per second, up to one second's worth
+	b.tokens = min(static_cast<double>(rateLimit), b.tokens + static_cast<double>(now - b.lastRefill) * rateLimit / 1000.0);
+	b.lastRefill = now;
+}
+
+void ScriptLog::Write(Channel channel, const TCHAR *level, const TSTRING &msg)
+{
+	// with no rate limit, just write it
+	if (rateLimit == 0)
+	{
+		Output(channel, level, msg);
+		return;
+	}
+
+	// Find the bucket.  A new bucket starts out full, so that a level
+	// can always write its first burst.
+	TSTRING key = channel == LogFileChannel ? _T("logfile") : MsgFmt(_T("console.%s"), level).Get();
+	ULONGLONG now = GetTickCount64();
+	auto it = buckets.find(key);
+	if (it == buckets.end())
+	{
+		it = buckets.emplace(key, Bucket()).first;
+		it->second.tokens = rateLimit;
+		it->second.lastRefill = now;
+	}
+	Bucket &b = it->second;
+
+	// if there's no room for the message, count it and drop it
+	Refill(b, now);
+	if (b.tokens < 1.0)
+	{
+		// start the summary timer when the first message is dropped
+		if (b.suppressed++ == 0 && summaryTimerId == 0)
+			summaryTimerId = SetTimer(NULL, 0, 1000, &SummaryTimerProc);
+		return;
+	}
+
+	// write the message
+	b.tokens -= 1.0;
+	Output(channel, level, msg);
+}
+
+void ScriptLog::Output(Channel channel, const TCHAR *level, const TSTRING &msg)
+{
+	if (channel == LogFileChannel)
+	{
+		LogFile::Get()->Write(_T("[Script] %s\n"), msg.c_str());
+	}
+	else
+	{
+		// send it to the debugger, and to the log file if Javascript logging is enabled
+		OutputDebugString(MsgFmt(_T("console.log(%s): %s\n"), level, msg.c_str()));
+		if (auto js = JavascriptEngine::Get(); js != nullptr)
+			js->DebugConsoleLog(level, msg.c_str());
+		LogFile::Get()->Write(LogFile::JSLogging, _T("[Script console.%s] %s\n"), level, msg.c_str());
+	}
+}
+
+void ScriptLog::WriteSummary(const TSTRING &key, Bucket &b)
+{
+	if (b.suppressed != 0)
+	{
+		LogFile::Get()->Write(_T("[Script] %I64u %s messages suppressed (over the limit of %d per second)\n"),
+			b.suppressed, key.c_str(), rateLimit);
+		b.suppressed = 0;
+	}
+}
+
+void CALLBACK ScriptLog::SummaryTimerProc(HWND, UINT, UINT_PTR, DWORD)
+{
+	// Write the summaries for the levels that dropped messages since the
+	// last tick.  Stop the timer when a whole tick goes by without any.
+	bool any = false;
+	for (auto &it : buckets)
+	{
+		if (it.second.suppressed != 0)
+		{
+			WriteSummary(it.first, it.second);
+			any = true;
+		}
+	}
+
+	if (!any)
+	{
+		KillTimer(NULL, summaryTimerId);
+		summaryTimerId = 0;
+	}
+}
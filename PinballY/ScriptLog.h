@@ -0,0 +1,79 @@
+// This file is part of PinballY
+// Copyright 2018 Michael J Roberts | GPL v3 or later | NO WARRANTY
+//
+// Script log output
+//
+// Javascript can write messages through console.log() (and its siblings
+// console.info(), console.warn(), etc), and through logfile.log().  A
+// script that logs from a per-frame or per-game callback can generate
+// thousands of messages a second, which floods the log file and the
+// debugger console, and ties up the UI thread (where all Javascript runs)
+// formatting and writing text that no one could read anyway.  So we rate
+// limit the output, separately for each console level and for the log
+// file.  Each level can write a burst of up to the rate limit's worth of
+// messages, refilled continuously at the rate limit per second; anything
+// over that is counted and dropped.  Once a second while messages are
+// being dropped, we write a summary noting how many were suppressed.
+//
+// A dropped message costs only the counter update: we don't format the
+// output text until we know the message will be written.  Messages that
+// are written go through the normal log file writer, which buffers them
+// in memory and writes them to disk on its own thread (see LogFile.h).
+
+#pragma once
+#include <unordered_map>
+
+class ScriptLog
+{
+public:
+	// output channels
+	enum Channel
+	{
+		ConsoleChannel,    // console.log() and friends
+		LogFileChannel     // logfile.log()
+	};
+
+	// Write a message.  'level' is the console level name ("log", "warn",
+	// etc); it's ignored for the log file channel.  This must be called
+	// on the UI thread.
+	static void Write(Channel channel, const TCHAR *level, const TSTRING &msg);
+
+	// Set the rate limit, in messages per second per level.  0 means
+	// no limit.  This is set from the configuration.
+	static void SetRateLimit(int messagesPerSecond);
+
+protected:
+	// write a message that passed the rate limit check
+	static void Output(Channel channel, const TCHAR *level, const TSTRING &msg);
+
+	// Rate limit bucket for a level
+	struct Bucket
+	{
+		// tokens available, and the time of the last refill
+		double tokens = 0;
+		ULONGLONG lastRefill = 0;
+
+		// number of messages suppressed since the last summary
+		UINT64 suppressed = 0;
+	};
+
+	// refill a bucket for the elapsed time
+	static void Refill(Bucket &b, ULONGLONG now);
+
+	// write the suppression summary for a bucket, if it has suppressed messages
+	static void WriteSummary(const TSTRING &key, Bucket &b);
+
+	// Buckets, keyed by channel and level ("console.log", "logfile", etc).
+	// These are only accessed on the UI thread.
+	static std::unordered_map<TSTRING, Bucket> buckets;
+
+	// rate limit, in messages per second
+	static int rateLimit;
+
+	// Summary timer.  This runs while any bucket has suppressed messages,
+	// writing the summaries once a second, so that a sustained flood adds
+	// one line per second rather than one per message, and the summary
+	// still gets written after a flood stops.
+	static UINT_PTR summaryTimerId;
+	static void CALLBACK SummaryTimerProc(HWND, UINT, UINT_PTR, DWORD);
+};
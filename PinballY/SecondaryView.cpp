@@ -20,6 +20,8 @@
 #include "Application.h"
 #include "PlayfieldView.h"
 #include "MediaDropTarget.h"
+#include "Trace.h"
+#include "MediaFileIndex.h"
 
 using namespace DirectX;
 
@@ -28,6 +30,10 @@ SecondaryView::SecondaryView(int contextMenuId, const TCHAR *winConfigVarPrefix)
 	: BaseView(contextMenuId, winConfigVarPrefix),
 	backgroundLoader(this)
 {
+	// Secondary windows are often hidden (a topper that isn't installed,
+	// or a DMD window on a setup with a real DMD), so don't create the
+	// swap chain until the window actually renders.
+	deferSwapChain = true;
 }
 
 void SecondaryView::GetMediaFiles(const GameListItem *game,
@@ -163,6 +169,16 @@ bool SecondaryView::OnTimer(WPARAM timer, LPARAM callback)
 	return __super::OnTimer(timer, callback);
 }
 
+bool SecondaryView::OnAnimationFrame()
+{
+	// update the animation, and stop the fallback timer when it's done
+	bool running = UpdateAnimation();
+	if (!running)
+		KillTimer(hWnd, animTimerID);
+
+	return running;
+}
+
 bool SecondaryView::UpdateAnimation()
 {
 	// if we have an incoming backglass, fade it in
@@ -220,6 +236,9 @@ void SecondaryView::OnShowHideFrameWindow(bool show)
 		// handle the change
 		OnChangeBackgroundImage();
 	}
+
+	// release the swap chain if the window stays hidden for a while
+	UpdateSwapChainReleaseTimer(show);
 }
 
 void SecondaryView::SyncCurrentGame()
@@ -248,28 +267,16 @@ void SecondaryView::SyncCurrentGame()
 	};
 	Syncer syncer(this);
 
+	// take any media resolved in advance by the coordinated sync pass
+	MediaFiles resolved = std::move(resolvedMedia);
+	resolvedMedia.game = nullptr;
+
 	// do nothing if minimized or hidden
 	if (!IsWindowVisible(hWnd) || IsIconic(hWnd))
 		return;
 
 	// Get the game to display, according to the current mode
-	auto gl = GameList::Get();
-	GameListItem *game = nullptr;
-	if (Application::Get()->IsGameProcessRunning())
-	{
-		// Running game mode.  Show media for the running game,
-		// but only if the game is specifically designated for
-		// media display in this window.
-		game = gl->GetByInternalID(Application::Get()->GetRunningGameId());
-		auto system = gl->GetSystem(Application::Get()->GetRunningGameSystem());
-		if (!ShowMediaWhenRunning(game, system))
-			game = nullptr;
-	}
-	else
-	{
-		// normal wheel mode - show the currently selected game
-		game = gl->GetNthGame(0);
-	}
+	GameListItem *game = GetCurrentModeGame();
 
 	// fill in the syncer watchdog with the seleted game
 	syncer.game = game;
@@ -298,12 +305,58 @@ void SecondaryView::SyncCurrentGame()
 	currentImageIndex = 0;
 
 	// load the current game's media
-	syncer.loadStarted = LoadCurrentGameMedia(game, true);
+	syncer.loadStarted = LoadCurrentGameMedia(game, true, &resolved);
+}
+
+GameListItem *SecondaryView::GetCurrentModeGame()
+{
+	auto gl = GameList::Get();
+	if (Application::Get()->IsGameProcessRunning())
+	{
+		// Running game mode.  Show media for the running game,
+		// but only if the game is specifically designated for
+		// media display in this window.
+		GameListItem *game = gl->GetByInternalID(Application::Get()->GetRunningGameId());
+		auto system = gl->GetSystem(Application::Get()->GetRunningGameSystem());
+		return ShowMediaWhenRunning(game, system) ? game : nullptr;
+	}
+	else
+	{
+		// normal wheel mode - show the currently selected game
+		return gl->GetNthGame(0);
+	}
+}
+
+GameListItem *SecondaryView::GetGameToSync()
+{
+	// apply the same tests as SyncCurrentGame(), short of the events
+	if (!IsWindowVisible(hWnd) || IsIconic(hWnd))
+		return nullptr;
+
+	GameListItem *game = GetCurrentModeGame();
+	if (game == nullptr
+		|| (incomingBackground.sprite != nullptr && game == incomingBackground.game)
+		|| (incomingBackground.sprite == nullptr && currentBackground.sprite != nullptr && currentBackground.game == game))
+		return nullptr;
+
+	return game;
 }
 
+void SecondaryView::ResolveMediaFiles(MediaFiles &m)
+{
+	// Look up the files as of the first page, since that's where the
+	// sync resets paged media.  The UI thread is waiting for the batch,
+	// so nothing else is using the page index in the meantime.
+	int savedImageIndex = currentImageIndex;
+	currentImageIndex = 0;
+	GetMediaFiles(m.game, m.video, m.image, m.defaultVideo, m.defaultImage);
+	currentImageIndex = savedImageIndex;
+}
 
-bool SecondaryView::LoadCurrentGameMedia(GameListItem *game, bool fireEvents)
+bool SecondaryView::LoadCurrentGameMedia(GameListItem *game, bool fireEvents, const MediaFiles *resolved)
 {
+	Trace::Scope trace("Secondary media load", "media", game != nullptr ? game->title.c_str() : nullptr);
+
 	// we haven't initiated the load yet
 	bool loadStarted = false;
 
@@ -313,9 +366,18 @@ bool SecondaryView::LoadCurrentGameMedia(GameListItem *game, bool fireEvents)
 	// combine it with the global video volume setting
 	volPct = volPct * Application::Get()->GetVideoVolume() / 100;
 
-	// get the media files
+	// get the media files, using the pre-resolved set if we have one
+	// for this game
 	TSTRING video, image, defaultVideo, defaultImage;
-	GetMediaFiles(game, video, image, defaultVideo, defaultImage);
+	if (resolved != nullptr && resolved->game == game && game != nullptr && currentImageIndex == 0)
+	{
+		video = resolved->video;
+		image = resolved->image;
+		defaultVideo = resolved->defaultVideo;
+		defaultImage = resolved->defaultImage;
+	}
+	else
+		GetMediaFiles(game, video, image, defaultVideo, defaultImage);
 
 	// note whether or not videos are enabled
 	bool videosEnabled = Application::Get()->IsEnableVideo();
@@ -327,42 +389,26 @@ bool SecondaryView::LoadCurrentGameMedia(GameListItem *game, bool fireEvents)
 		defaultVideo.clear();
 	}
 
-	// If there's no incoming game, and the new media file matches the media
-	// file for the current sprite, leave the current one as-is.  This can
-	// happen when both the current and incoming games use the same default
-	// background.  Only bother checking in the case of video; for images,
-	// a re-load won't be visible.  With videos, a re-load would start the
-	// video over from the beginning, so it's nicer to leave it running
-	// uninterrupted.
-	bool isSameVideo = false;
-	if (videosEnabled
-		&& incomingBackground.sprite == nullptr
+	// If there's no incoming game, and the new media matches what the
+	// current sprite is displaying, leave the current one as-is.  This
+	// happens when consecutive games use the same default or system-wide
+	// background, such as a system with no per-table topper media.  A
+	// reload would cost a full decode and a crossfade to an identical
+	// image, and with videos, it would start the video over from the
+	// beginning, so it's nicer to leave it running uninterrupted.  We
+	// take the new game as the current game, since the window's side
+	// effects (such as the DMD high score images) go with the game.
+	if (incomingBackground.sprite == nullptr
 		&& currentBackground.sprite != nullptr
-		&& currentBackground.sprite->GetVideoPlayer() != nullptr)
+		&& currentBackground.media.Matches(GetExpectedMediaKey(video, image, defaultVideo, defaultImage)))
 	{
-		// get the current video path
-		if (const TCHAR *oldPath = currentBackground.sprite->GetVideoPlayer()->GetMediaPath(); oldPath != nullptr)
+		if (currentBackground.game != game)
 		{
-			// figure out which new video we're going to use
-			const TCHAR *newPath = nullptr;
-			if (video.length() != 0)
-				newPath = video.c_str();
-			else if (image.length() != 0)
-				newPath = nullptr;  // we're using the image, not a video
-			else if (defaultVideo.length() != 0)
-				newPath = defaultVideo.c_str();
-
-			// check if they're the same
-			if (newPath != nullptr && _tcsicmp(newPath, oldPath) == 0)
-				isSameVideo = true;
+			currentBackground.game = game;
+			OnChangeBackgroundImage();
 		}
 	}
-
-	// presume that we'll skip any load attempt
-	const TCHAR *disposition = _T("skip");
-
-	// now load the new video or image if it's not the same as the old one
-	if (!isSameVideo)
+	else
 	{
 		// Fire the Media Sync Begin event.  If the event handler calls preventDefault,
 		// cancel the media sync.
@@ -373,18 +419,33 @@ bool SecondaryView::LoadCurrentGameMedia(GameListItem *game, bool fireEvents)
 		// set up to load the sprite asynchronously
 		HWND hWnd = this->hWnd;
 		SIZE szLayout = this->szLayout;
-		auto load = [hWnd, video, image, defaultImage, defaultVideo, szLayout, videosEnabled, volPct](BaseView*, VideoSprite *sprite)
+		bool shareDecode = CanShareBackgroundVideo();
+		auto loaded = std::make_shared<MediaKey>();
+		auto load = [hWnd, video, image, defaultImage, defaultVideo, szLayout, videosEnabled, volPct, shareDecode, loaded](BaseView*, VideoSprite *sprite)
 		{
 			// presume failure
 			bool ok = false;
 
+			// note the media key for the file we end up loading
+			auto Loaded = [&loaded, szLayout](const TSTRING &path, bool video)
+			{
+				loaded->path = path;
+				loaded->video = video;
+				loaded->szLayout = szLayout;
+				if (!MediaFileIndex::GetFileTime(path.c_str(), loaded->mtime))
+					loaded->mtime = { 0, 0 };
+			};
+
 			// start at zero alpha, for the cross-fade
 			sprite->alpha = 0;
 
 			// try the video first, unless videos are disabled
 			Application::AsyncErrorHandler eh;
 			if (video.length() != 0 && videosEnabled)
-				ok = sprite->LoadVideo(video.c_str(), hWnd, { 1.0f, 1.0f }, eh, _T("Background Video"), true, volPct);
+			{
+				if (ok = sprite->LoadVideo(video.c_str(), hWnd, { 1.0f, 1.0f }, eh, _T("Background Video"), true, volPct, shareDecode, true); ok)
+					Loaded(video, true);
+			}
 
 			// try the image if that didn't work
 			if (!ok && image.length() != 0)
@@ -401,7 +462,9 @@ bool SecondaryView::LoadCurrentGameMedia(GameListItem *game, bool fireEvents)
 					
 				// try loading the image
 				CapturingErrorHandler ceh;
-				if (!(ok = sprite->Load(image.c_str(), normalizedSize, szLayout, hWnd, ceh)))
+				if (ok = sprite->Load(image.c_str(), normalizedSize, szLayout, hWnd, ceh); ok)
+					Loaded(image, false);
+				else
 				{
 					// if this is an SWF file, log the error specially
 					if (haveDesc && desc.imageType == ImageFileDesc::ImageType::SWF)
@@ -413,17 +476,23 @@ bool SecondaryView::LoadCurrentGameMedia(GameListItem *game, bool fireEvents)
 
 			// try the default video if we still don't have anything
 			if (!ok && videosEnabled && defaultVideo.length() != 0)
-				ok = sprite->LoadVideo(defaultVideo.c_str(), hWnd, { 1.0f, 1.0f }, eh, _T("Default background video"), volPct);
+			{
+				if (ok = sprite->LoadVideo(defaultVideo.c_str(), hWnd, { 1.0f, 1.0f }, eh, _T("Default background video"), true, volPct, shareDecode, true); ok)
+					Loaded(defaultVideo, true);
+			}
 
 			// load a default image if we didn't load anything custom
 			if (!ok)
-				ok = sprite->Load(defaultImage.c_str(), { 1.0f, 1.0f }, szLayout, hWnd, eh);
+			{
+				if (ok = sprite->Load(defaultImage.c_str(), { 1.0f, 1.0f }, szLayout, hWnd, eh); ok)
+					Loaded(defaultImage, false);
+			}
 
 			// return the result
 			return ok;
 		};
 
-		auto done = [this, game](BaseView *view, VideoSprite *sprite, bool loadResult)
+		auto done = [this, game, loaded](BaseView *view, VideoSprite *sprite, bool loadResult)
 		{
 			// check the load result
 			if (loadResult)
@@ -431,6 +500,7 @@ bool SecondaryView::LoadCurrentGameMedia(GameListItem *game, bool fireEvents)
 				// successfully initiated media load - set the new sprite
 				incomingBackground.sprite = sprite;
 				incomingBackground.game = game;
+				incomingBackground.media = *loaded;
 
 				// update the drawing list for the change in sprites
 				UpdateDrawingList();
@@ -462,12 +532,42 @@ bool SecondaryView::LoadCurrentGameMedia(GameListItem *game, bool fireEvents)
 	return loadStarted;
 }
 
+SecondaryView::MediaKey SecondaryView::GetExpectedMediaKey(const TSTRING &video, const TSTRING &image,
+	const TSTRING &defaultVideo, const TSTRING &defaultImage) const
+{
+	// The load tries the files in order, taking the first one that loads,
+	// so the first non-empty one is what we expect to display.  The video
+	// names are already cleared if videos are disabled.
+	MediaKey k;
+	if (video.length() != 0)
+	{
+		k.path = video;
+		k.video = true;
+	}
+	else if (image.length() != 0)
+		k.path = image;
+	else if (defaultVideo.length() != 0)
+	{
+		k.path = defaultVideo;
+		k.video = true;
+	}
+	else
+		k.path = defaultImage;
+
+	// add the file time and the load options
+	k.szLayout = szLayout;
+	if (k.path.length() != 0 && !MediaFileIndex::GetFileTime(k.path.c_str(), k.mtime))
+		k.path.clear();
+
+	return k;
+}
+
 void SecondaryView::StartBackgroundCrossfade()
 {
 	// set up the crossfade
 	auto pfv = Application::Get()->GetPlayfieldView();
 	DWORD crossFadeTime = pfv != nullptr ? pfv->GetCrossfadeTime() : 120;
-	SetTimer(hWnd, animTimerID, animTimerInterval, 0);
+	StartAnimation();
 	incomingBackground.sprite->StartFade(1, crossFadeTime);
 }
 
@@ -672,8 +772,10 @@ bool SecondaryView::OnAppMessage(UINT msg, WPARAM wParam, LPARAM lParam)
 	{
 	case AVPMsgFirstFrameReady:
 		// If this is the incoming background's video player, start the
-		// cross-fade for the new background.
-		if (incomingBackground.sprite != nullptr && incomingBackground.sprite->GetMediaCookie() == wParam)
+		// cross-fade for the new background.  If the sprite showed a poster
+		// frame, the cross-fade already started when the load finished.
+		if (incomingBackground.sprite != nullptr && incomingBackground.sprite->GetMediaCookie() == wParam
+			&& !incomingBackground.sprite->HasPosterFrame())
 			StartBackgroundCrossfade();
 		break;
 	}
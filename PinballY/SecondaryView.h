@@ -23,6 +23,31 @@ public:
 	// sync with the current selection in the global game list
 	void SyncCurrentGame();
 
+	// Media files for a game's background, as found by GetMediaFiles()
+	struct MediaFiles
+	{
+		GameListItem *game = nullptr;
+		TSTRING video, image, defaultVideo, defaultImage;
+	};
+
+	// Get the game that SyncCurrentGame() would display now, if it would
+	// load new media for it.  Returns null if the window is hidden, if
+	// there's no game to show, or if the game is already displayed or
+	// loading.  This is for the coordinated sync pass (see
+	// PlayfieldView::SyncAllViews()), to decide which windows need their
+	// media resolved.
+	GameListItem *GetGameToSync();
+
+	// Resolve the media files for m.game, for the first page of paged
+	// media.  This only reads the game list and media file index, so the
+	// coordinated sync pass can run it on a loader pool thread, while the
+	// UI thread waits for the batch.
+	void ResolveMediaFiles(MediaFiles &m);
+
+	// Supply the media resolved by the coordinated sync pass, for use by
+	// the next SyncCurrentGame() call if it's for the same game
+	void SetResolvedMedia(MediaFiles &&m) { resolvedMedia = std::move(m); }
+
 	// update our menu
 	virtual void UpdateMenu(HMENU hMenu, BaseWin *fromWin) override;
 
@@ -91,14 +116,25 @@ protected:
 
 	// Load the current game's media.  If fireEvents is true, we'll
 	// fire the Javascript MediaSyncLoad event.  Returns true if a
-	// load was initiated, false if not.
-	//
-	// 
-	bool LoadCurrentGameMedia(GameListItem *game, bool fireEvents);
+	// load was initiated, false if not.  If 'resolved' is provided,
+	// and it's for the same game, we use its media files rather than
+	// looking them up again.
+	bool LoadCurrentGameMedia(GameListItem *game, bool fireEvents, const MediaFiles *resolved = nullptr);
+
+	// get the game to show according to the current mode (the selected
+	// game, or the running game if it's designated for this window)
+	GameListItem *GetCurrentModeGame();
+
+	// media resolved in advance by the coordinated sync pass, if any
+	MediaFiles resolvedMedia;
 
 	// Handle a change of current background image
 	virtual void OnChangeBackgroundImage() { }
 
+	// Can our background video share its decoder with the same video
+	// playing in another window?  See VideoSprite::sharedDecoding.
+	virtual bool CanShareBackgroundVideo() const { return true; }
+
 	// Get my default per-system image/video name.  These are the default
 	// media items to use for all games of this system.
 	virtual const TCHAR *GetDefaultSystemImage() const = 0;
@@ -135,6 +171,18 @@ protected:
 	// running after this call, false if not.
 	virtual bool UpdateAnimation();
 
+	// Per-frame animation update, from the render loop.  This steps the
+	// animation at the frame time; the animation timer is just a fallback
+	// for when the window isn't rendering.
+	virtual bool OnAnimationFrame() override;
+
+	// start the animation (frame updates plus the fallback timer)
+	void StartAnimation()
+	{
+		StartAnimationFrames();
+		SetTimer(hWnd, animTimerID, animTimerInterval, 0);
+	}
+
 	// process a command
 	virtual bool OnCommand(int cmd, int source, HWND hwndControl) override;
 
@@ -153,6 +201,33 @@ protected:
 	// Animation timer interval (milliseconds)
 	static const DWORD animTimerInterval = 15;
 
+	// Displayed media key.  This identifies the file loaded into a
+	// background sprite, along with the options that affect how it was
+	// loaded, so that we can tell when a new game would load the same
+	// thing.  The path is empty if we don't know what was loaded.
+	struct MediaKey
+	{
+		void Clear() { path.clear(); }
+		bool Matches(const MediaKey &k) const
+		{
+			return path.length() != 0
+				&& _tcsicmp(path.c_str(), k.path.c_str()) == 0
+				&& CompareFileTime(&mtime, &k.mtime) == 0
+				&& video == k.video
+				&& (video || (szLayout.cx == k.szLayout.cx && szLayout.cy == k.szLayout.cy));
+		}
+
+		TSTRING path;                   // media file path
+		FILETIME mtime = { 0, 0 };      // file modification time when loaded
+		bool video = false;             // loaded as a video?
+		SIZE szLayout = { 0, 0 };       // layout size, for images
+	};
+
+	// Figure the media key for the file that a load with the given files
+	// would display first
+	MediaKey GetExpectedMediaKey(const TSTRING &video, const TSTRING &image,
+		const TSTRING &defaultVideo, const TSTRING &defaultImage) const;
+
 	// Current and incoming background images.  We keep the two so that 
 	// we can animate a cross-fade when switching to a new image.
 	struct
@@ -161,9 +236,11 @@ protected:
 		{
 			game = nullptr;
 			sprite = nullptr;
+			media.Clear();
 		}
 		GameListItem *game;				// game list item
 		RefPtr<VideoSprite> sprite;		// sprite
+		MediaKey media;                 // media displayed in the sprite
 	}
 	currentBackground, incomingBackground;
 
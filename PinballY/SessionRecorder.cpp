@@ -0,0 +1,176 @@
+// This file is part of PinballY
+// Copyright 2018 Michael J Roberts | GPL v3 or later | NO WARRANTY
+//
+// Session recorder
+
+#include "stdafx.h"
+#include <regex>
+#include "../Utilities/FileUtil.h"
+#include "SessionRecorder.h"
+#include "LogFile.h"
+#include "VersionInfo.h"
+
+// global singleton
+SessionRecorder *SessionRecorder::inst = nullptr;
+
+// Key press mode names.  The values match PlayfieldView::KeyPressType.
+const SessionRecorder::ModeName SessionRecorder::modeNames[] = {
+	{ "down", 0x01, false },
+	{ "repeat", 0x03, false },
+	{ "up", 0x00, false },
+	{ "bgdown", 0x10, true },
+	{ "bgrepeat", 0x30, true },
+	{ "bgup", 0x00, true },
+};
+
+bool SessionRecorder::ParseOption(const TCHAR *arg)
+{
+	std::match_results<const TCHAR*> m;
+	if (!std::regex_match(arg, m, std::basic_regex<TCHAR>(_T("/recordsession:(.+)"), std::regex_constants::icase)))
+		return false;
+
+	// create the singleton, and note the file name; we open the file
+	// when recording starts
+	if (inst == nullptr)
+		inst = new SessionRecorder();
+	inst->filename = m[1].str();
+	return true;
+}
+
+void SessionRecorder::Start()
+{
+	if (inst == nullptr || inst->fp != nullptr)
+		return;
+
+	// open the file
+	if (_tfopen_s(&inst->fp, inst->filename.c_str(), _T("w, ccs=UTF-8")) != 0)
+	{
+		inst->fp = nullptr;
+		LogFile::Get()->Write(_T("Session recorder: unable to create %s\n"), inst->filename.c_str());
+		return;
+	}
+
+	// write the header
+	SYSTEMTIME st;
+	GetLocalTime(&st);
+	_ftprintf(inst->fp, _T("# PinballY session recording\n# version %hs, %04d-%02d-%02d %02d:%02d:%02d\n")
+		_T("# <time> <mode> <repeat count> <commands>\n"),
+		G_VersionInfo.fullVer, st.wYear, st.wMonth, st.wDay, st.wHour, st.wMinute, st.wSecond);
+	fflush(inst->fp);
+
+	// start the clock
+	inst->t0 = inst->timer.GetTime_seconds();
+	LogFile::Get()->Write(_T("Session recorder: recording key commands to %s\n"), inst->filename.c_str());
+}
+
+void SessionRecorder::Record(int mode, int repeatCount, bool bg, const std::vector<const TCHAR*> &cmds)
+{
+	if (!IsRecording() || cmds.size() == 0)
+		return;
+
+	// find the mode name
+	const CHAR *modeName = nullptr;
+	for (auto const &n : modeNames)
+	{
+		if (n.mode == mode && n.bg == bg)
+		{
+			modeName = n.name;
+			break;
+		}
+	}
+	if (modeName == nullptr)
+		return;
+
+	// build the command list
+	TSTRING lst;
+	for (auto c : cmds)
+	{
+		if (lst.length() != 0)
+			lst += ',';
+		lst += c;
+	}
+
+	// Write the event.  Flush after each one, so that the file is
+	// complete up to the last event if the program exits abnormally.
+	double t = (inst->timer.GetTime_seconds() - inst->t0) * 1000.0;
+	_ftprintf(inst->fp, _T("%.1f %hs %d %s\n"), t, modeName, repeatCount, lst.c_str());
+	fflush(inst->fp);
+	++inst->nEvents;
+}
+
+void SessionRecorder::Shutdown()
+{
+	if (inst == nullptr)
+		return;
+
+	if (inst->fp != nullptr)
+	{
+		fclose(inst->fp);
+		LogFile::Get()->Write(_T("Session recorder: %d events written to %s\n"), inst->nEvents, inst->filename.c_str());
+	}
+
+	delete inst;
+	inst = nullptr;
+}
+
+bool SessionRecorder::Load(const TCHAR *filename, std::vector<Event> &events, ErrorHandler &eh)
+{
+	FILEPtrHolder fp;
+	if (_tfopen_s(&fp, filename, _T("r, ccs=UTF-8")) != 0)
+	{
+		eh.Error(MsgFmt(_T("Unable to open session recording %s"), filename));
+		return false;
+	}
+
+	TCHAR buf[1024];
+	for (int lineNum = 1; _fgetts(buf, countof(buf), fp) != nullptr; ++lineNum)
+	{
+		// skip blank lines and comments
+		const TCHAR *p = buf;
+		while (_istspace(*p))
+			++p;
+		if (*p == 0 || *p == '#')
+			continue;
+
+		// parse the fields
+		double t;
+		TCHAR mode[16], cmds[1000];
+		int repeatCount;
+		if (_stscanf_s(p, _T("%lf %15s %d %999s"), &t, mode, static_cast<unsigned>(countof(mode)),
+			&repeatCount, cmds, static_cast<unsigned>(countof(cmds))) != 4)
+		{
+			eh.Error(MsgFmt(_T("%s, line %d: invalid event format"), filename, lineNum));
+			return false;
+		}
+
+		// look up the mode
+		auto m = std::find_if(std::begin(modeNames), std::end(modeNames),
+			[&mode](const ModeName &n) { return _tcsicmp(CHARToTCHAR(n.name), mode) == 0; });
+		if (m == std::end(modeNames))
+		{
+			eh.Error(MsgFmt(_T("%s, line %d: invalid event mode \"%s\""), filename, lineNum, mode));
+			return false;
+		}
+
+		// add the event, splitting out the commands
+		auto &e = events.emplace_back();
+		e.t = t;
+		e.mode = m->mode;
+		e.repeatCount = repeatCount;
+		e.bg = m->bg;
+		for (const TCHAR *c = cmds; *c != 0; )
+		{
+			const TCHAR *start = c;
+			while (*c != 0 && *c != ',')
+				++c;
+			if (c != start)
+				e.cmds.emplace_back(start, c - start);
+			if (*c == ',')
+				++c;
+		}
+	}
+
+	// make sure the events are in time order
+	std::stable_sort(events.begin(), events.end(), [](const Event &a, const Event &b) { return a.t < b.t; });
+	return true;
+}
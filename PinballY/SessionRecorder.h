@@ -0,0 +1,99 @@
+// This file is part of PinballY
+// Copyright 2018 Michael J Roberts | GPL v3 or later | NO WARRANTY
+//
+// Session recorder
+//
+// Running the program with /RecordSession:<file> records the key
+// commands processed during the session, with time stamps, so that the
+// session can be replayed later by the session benchmark (see the
+// 'session' option in Benchmark.h).  This lets us capture a realistic
+// cabinet session - wheel navigation, filter changes, menu use, attract
+// mode, a game launch and return - and play it back the same way on
+// every build, to compare the frame times and latencies.
+//
+// We record at the command level, at PlayfieldView::ProcessKeyPress(),
+// after the keys and buttons have been mapped to commands.  That makes
+// a recording independent of the cabinet's key assignments, so it can
+// be replayed on any machine.  Every event that reaches the command
+// queue is recorded, including the auto-repeats (which come from our
+// own timers, so they can't be regenerated on playback without the
+// physical key), and the background events while a game is running.
+// Commands generated by scripts aren't recorded, since the scripts
+// will generate them again on playback.
+//
+// The file is plain text, written as we go, so that a session is still
+// usable if the program exits abnormally.  Each event is one line:
+//
+//   <time> <mode> <repeat count> <command>[,<command>...]
+//
+// The time is in milliseconds from the start of the session (the point
+// where startup is complete), and the mode is one of "down", "repeat",
+// "up", "bgdown", "bgrepeat", or "bgup" (the "bg" modes are for events
+// received while the application is in the background, as when a game
+// is running).  Lines starting with '#' are comments.
+
+#pragma once
+#include <vector>
+#include "HiResTimer.h"
+
+class SessionRecorder
+{
+public:
+	// Recorded event
+	struct Event
+	{
+		double t;                   // time from the start of the session, in milliseconds
+		int mode;                   // PlayfieldView::KeyPressType
+		int repeatCount;            // repeat count
+		bool bg;                    // background event
+		std::vector<TSTRING> cmds;  // command names
+	};
+
+	// Parse a command line option.  Returns true if it's a /RecordSession
+	// option, in which case we enable recording.
+	static bool ParseOption(const TCHAR *arg);
+
+	// are we recording?
+	static bool IsRecording() { return inst != nullptr && inst->fp != nullptr; }
+
+	// Start recording.  Call this from the UI thread when startup is
+	// complete; event times are relative to this point.
+	static void Start();
+
+	// Record a key event.  'cmds' is the list of command names.
+	static void Record(int mode, int repeatCount, bool bg, const std::vector<const TCHAR*> &cmds);
+
+	// Stop recording and close the file.  Call at program exit.
+	static void Shutdown();
+
+	// Load a recording.  Returns true on success.
+	static bool Load(const TCHAR *filename, std::vector<Event> &events, ErrorHandler &eh);
+
+protected:
+	SessionRecorder() { }
+
+	// global singleton
+	static SessionRecorder *inst;
+
+	// names of the key press modes, for the file format
+	struct ModeName
+	{
+		const CHAR *name;
+		int mode;
+		bool bg;
+	};
+	static const ModeName modeNames[];
+
+	// output file name
+	TSTRING filename;
+
+	// output file, once recording has started
+	FILE *fp = nullptr;
+
+	// number of events recorded
+	int nEvents = 0;
+
+	// session timer
+	HiResTimer timer;
+	double t0 = 0.0;
+};
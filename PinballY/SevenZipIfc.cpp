@@ -411,11 +411,158 @@ bool SevenZipArchive::EnumFiles(std::function<void(UINT32 idx, const WCHAR *path
 }
 
 bool SevenZipArchive::Extract(UINT32 idx, const TCHAR *destFile, ErrorHandler &eh)
+{
+	// extract it as a batch of one
+	std::vector<ExtractItem> items;
+	items.emplace_back(idx, destFile);
+	return Extract(items, nullptr, nullptr, eh);
+}
+
+// -----------------------------------------------------------------------
+//
+// Buffered output file stream.  7-Zip's decoders hand us the output in
+// whatever size chunks they happen to produce, which can be as small as
+// a few KB.  COutFileStream passes each chunk straight through to
+// WriteFile, so a big video file turns into thousands of small writes.
+// This version collects the output in a large buffer and writes it in
+// big sequential pieces, and preallocates the file when the size is
+// known, so that the file system can lay it out contiguously.
+//
+
+class BufferedOutFileStream : public ISequentialOutStream, public CMyUnknownImp
+{
+public:
+	BufferedOutFileStream() { }
+
+	MY_UNKNOWN_IMP1(ISequentialOutStream)
+
+	// open the file; 'sizeHint' is the expected size, or 0 if unknown
+	bool Open(const TCHAR *fname, UINT64 sizeHint)
+	{
+		// create the file
+		h = CreateFile(fname, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, 
+			FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+		if (h == INVALID_HANDLE_VALUE)
+			return false;
+
+		// preallocate the space, if we know the size; this is only a
+		// hint, so ignore errors
+		if (sizeHint != 0)
+		{
+			FILE_ALLOCATION_INFO fai;
+			fai.AllocationSize.QuadPart = sizeHint;
+			SetFileInformationByHandle(h, FileAllocationInfo, &fai, sizeof(fai));
+		}
+
+		// allocate the buffer - no bigger than the file, if we know its size
+		bufSize = sizeHint != 0 && sizeHint < maxBufSize ? static_cast<UINT32>(sizeHint) : maxBufSize;
+		buf.reset(new BYTE[bufSize]);
+		bufUsed = 0;
+		writeError = false;
+		return true;
+	}
+
+	// ISequentialOutStream
+	STDMETHOD(Write)(const void *data, UInt32 size, UInt32 *processedSize)
+	{
+		if (processedSize != nullptr)
+			*processedSize = 0;
+		if (h == NULL || h == INVALID_HANDLE_VALUE || writeError)
+			return E_FAIL;
+
+		const BYTE *p = static_cast<const BYTE*>(data);
+		UInt32 rem = size;
+		while (rem != 0)
+		{
+			// If the buffer is empty and this chunk is at least as big as
+			// the buffer, write it directly.  Otherwise copy as much as
+			// will fit into the buffer, and flush the buffer when full.
+			if (bufUsed == 0 && rem >= bufSize)
+			{
+				DWORD actual;
+				if (!WriteFile(h, p, rem, &actual, NULL) || actual != rem)
+					return WriteFailed();
+				rem = 0;
+			}
+			else
+			{
+				UInt32 copy = min(rem, bufSize - bufUsed);
+				memcpy(buf.get() + bufUsed, p, copy);
+				bufUsed += copy;
+				p += copy;
+				rem -= copy;
+				if (bufUsed == bufSize && !Flush())
+					return WriteFailed();
+			}
+		}
+
+		if (processedSize != nullptr)
+			*processedSize = size;
+		return S_OK;
+	}
+
+	// Close the file, setting the modified time if provided.  Returns
+	// false if any writes failed.
+	bool Close(const FILETIME *modTime)
+	{
+		bool ok = Flush() && !writeError;
+		if (modTime != nullptr && (modTime->dwHighDateTime != 0 || modTime->dwLowDateTime != 0))
+			SetFileTime(h, NULL, NULL, modTime);
+		h = NULL;
+		buf.reset();
+		return ok;
+	}
+
+protected:
+	virtual ~BufferedOutFileStream() { }
+
+	// flush the buffer
+	bool Flush()
+	{
+		if (bufUsed != 0)
+		{
+			DWORD actual;
+			if (!WriteFile(h, buf.get(), bufUsed, &actual, NULL) || actual != bufUsed)
+			{
+				writeError = true;
+				return false;
+			}
+			bufUsed = 0;
+		}
+		return true;
+	}
+
+	// note a write error
+	HRESULT WriteFailed()
+	{
+		writeError = true;
+		return HRESULT_FROM_WIN32(GetLastError());
+	}
+
+	// file handle
+	HandleHolder h;
+
+	// write buffer
+	static const UInt32 maxBufSize = 1024 * 1024;
+	std::unique_ptr<BYTE[]> buf;
+	UInt32 bufSize = 0;
+	UInt32 bufUsed = 0;
+
+	// has a write failed?
+	bool writeError = false;
+};
+
+bool SevenZipArchive::Extract(const std::vector<ExtractItem> &items,
+	ProgressFunc progress, FileDoneFunc fileDone, ErrorHandler &eh)
 {
 	// we need an open archive to proceed
 	if (archive == nullptr)
 		return false;
 
+	// if there's nothing to extract, there's nothing to do
+	if (items.size() == 0)
+		return true;
+
 	// set up the extraction callback object
 	class ExtractCallback :
 		public IArchiveExtractCallback,
@@ -423,29 +570,53 @@ bool SevenZipArchive::Extract(UINT32 idx, const TCHAR *destFile, ErrorHandler &e
 		public CMyUnknownImp
 	{
 	public:
-		ExtractCallback(SevenZipArchive *arch, const TCHAR *destFile, ErrorHandler &eh) :
+		ExtractCallback(SevenZipArchive *arch, const std::vector<ExtractItem> &items,
+			ProgressFunc &progress, FileDoneFunc &fileDone, ErrorHandler &eh) :
 			arch(arch),
-			destFile(destFile),
+			items(items),
+			progress(progress),
+			fileDone(fileDone),
 			eh(eh),
-			nErrors(0)
+			nErrors(0),
+			fileErrors(0),
+			curItem(-1),
+			total(0),
+			cancelled(false)
 		{
+			// index the items by archive entry index
+			for (size_t i = 0; i < items.size(); ++i)
+				itemMap.emplace(items[i].idx, i);
+
 			// clear the file time and attributes
-			fileInfo.modTime.dwLowDateTime = 0;
-			fileInfo.modTime.dwHighDateTime = 0;
-			fileInfo.attr = INVALID_FILE_ATTRIBUTES;
+			ClearFileInfo();
 		}
 
 		MY_UNKNOWN_IMP1(ICryptoGetTextPassword)
 
-			// IProgress
-			STDMETHOD(SetTotal)(UInt64) { return S_OK; }
-		STDMETHOD(SetCompleted)(const UInt64 *) { return S_OK; }
+		// IProgress
+		STDMETHOD(SetTotal)(UInt64 total) 
+		{
+			this->total = total;
+			return S_OK; 
+		}
+		STDMETHOD(SetCompleted)(const UInt64 *completed)
+		{
+			// pass it to the caller's progress callback, and cancel the
+			// extraction if the callback says so
+			if (progress != nullptr && completed != nullptr && !progress(*completed, total))
+			{
+				cancelled = true;
+				return E_ABORT;
+			}
+			return S_OK;
+		}
 
 		// IArchiveExtractCallback
 		STDMETHOD(GetStream)(UInt32 index, ISequentialOutStream **pOutStream, Int32 askExtractMode)
 		{
 			// clear any previous output streams
 			*pOutStream = NULL;
+			curItem = -1;
 
 			// get the name of the entry we're trying to extract
 			NWindows::NCOM::CPropVariant nameProp;
@@ -457,7 +628,17 @@ bool SevenZipArchive::Extract(UINT32 idx, const TCHAR *destFile, ErrorHandler &e
 			if (askExtractMode != NArchive::NExtract::NAskMode::kExtract)
 				return S_OK;
 
+			// Find the item.  Solid archives can ask about entries we
+			// didn't request, for the other files in a solid block; we
+			// simply don't provide a stream for those, which tells the
+			// decoder to discard the data.
+			auto it = itemMap.find(index);
+			if (it == itemMap.end())
+				return S_OK;
+			const TSTRING &destFile = items[it->second].destFile;
+
 			// get the original file attributes from the archive
+			ClearFileInfo();
 			NWindows::NCOM::CPropVariant attrProp;
 			if (SUCCEEDED(arch->archive->GetProperty(index, kpidAttrib, &attrProp))
 				&& attrProp.vt == VT_UI4)
@@ -469,19 +650,37 @@ bool SevenZipArchive::Extract(UINT32 idx, const TCHAR *destFile, ErrorHandler &e
 				&& modTimeProp.vt == VT_FILETIME)
 				fileInfo.modTime = modTimeProp.filetime;
 
+			// get the uncompressed size, for preallocating the file
+			UINT64 size = 0;
+			NWindows::NCOM::CPropVariant sizeProp;
+			if (SUCCEEDED(arch->archive->GetProperty(index, kpidSize, &sizeProp))
+				&& sizeProp.vt == VT_UI8)
+				size = sizeProp.uhVal.QuadPart;
+
 			// create the output stream (NB - the assignment adds a reference)
-			outStream = new COutFileStream();
+			outStream = new BufferedOutFileStream();
 
-			// open the file
-			if (!outStream->Open(destFile.c_str(), CREATE_ALWAYS))
+			// Open the file.  If that fails, log the error and skip this
+			// file, but keep going with the rest of the batch.
+			if (!outStream->Open(destFile.c_str(), size))
 			{
-				eh.Error(MsgFmt(IDS_ERR_7Z_EXTRACT_OPEN_OUTPUT, arch->filename.c_str(), destFile.c_str()));
-				return E_ABORT;
+				WindowsErrorMessage winErr;
+				++nErrors;
+				eh.SysError(MsgFmt(IDS_ERR_7Z_EXTRACT_OPEN_OUTPUT, arch->filename.c_str(), destFile.c_str()),
+					winErr.Get());
+				outStream = nullptr;
+				if (fileDone != nullptr)
+					fileDone(it->second, false);
+				return S_OK;
 			}
 
 			// add a reference on behalf of the caller, and pass the stream back
 			(*pOutStream = outStream)->AddRef();
 
+			// this is now the current item
+			curItem = static_cast<int>(it->second);
+			fileErrors = 0;
+
 			// success
 			return S_OK;
 		}
@@ -493,6 +692,11 @@ bool SevenZipArchive::Extract(UINT32 idx, const TCHAR *destFile, ErrorHandler &e
 
 		STDMETHOD(SetOperationResult)(Int32 resultEOperationResult)
 		{
+			// ignore results for entries we're not extracting
+			if (curItem < 0)
+				return S_OK;
+
+			const TSTRING &destFile = items[curItem].destFile;
 			const char *detail = "other error";
 			switch (resultEOperationResult)
 			{
@@ -502,7 +706,7 @@ bool SevenZipArchive::Extract(UINT32 idx, const TCHAR *destFile, ErrorHandler &e
 
 			case NArchive::NExtract::NOperationResult::kWrongPassword:
 				// password error
-				++nErrors;
+				++fileErrors;
 				eh.Error(MsgFmt(IDS_ERR_7Z_WRONG_PASSWORD, arch->filename.c_str()));
 				break;
 
@@ -520,44 +724,65 @@ bool SevenZipArchive::Extract(UINT32 idx, const TCHAR *destFile, ErrorHandler &e
 				// can't be fixed by user action.  We provide details for these in the
 				// usual "system error" format, since they might be useful to the
 				// developers but won't be helpful to most users.
-				++nErrors;
+				++fileErrors;
 				eh.SysError(
 					MsgFmt(IDS_ERR_7Z_EXTRACT_FAILED, arch->filename.c_str(), entryName.c_str(), destFile.c_str()),
 					MsgFmt(_T("7z.dll extract failed: %hs"), detail));
 			}
 
-			// if we have a stream, finalize it
-			if (outStream != nullptr)
-			{
-				// set the original modified time on the output stream
-				if (fileInfo.modTime.dwHighDateTime != 0 || fileInfo.modTime.dwLowDateTime != 0)
-					outStream->SetMTime(&fileInfo.modTime);
+			// finalize the stream
+			FinishFile();
+			return S_OK;
+		}
 
-				// close the stream
-				outStream->Close();
+		// Finish the current file.  The archive reader normally does this
+		// through SetOperationResult, but if the extraction is aborted in
+		// the middle of a file, we have to clean up the partial file.
+		void FinishFile()
+		{
+			if (curItem < 0 || outStream == nullptr)
+				return;
 
-				// set the original file attributes
-				if (fileInfo.attr != INVALID_FILE_ATTRIBUTES)
-				{
-					// check for Posix flags
-					DWORD attr = fileInfo.attr;
-					if ((attr & 0xF0000000) != 0)
-						attr &= 0x3FFF;
+			// close the stream, setting the original modified time
+			const TSTRING &destFile = items[curItem].destFile;
+			if (!outStream->Close(&fileInfo.modTime) && fileErrors == 0)
+			{
+				WindowsErrorMessage winErr;
+				++fileErrors;
+				eh.SysError(
+					MsgFmt(IDS_ERR_7Z_EXTRACT_FAILED, arch->filename.c_str(), entryName.c_str(), destFile.c_str()),
+					MsgFmt(_T("error writing output file: %s"), winErr.Get()));
+			}
 
-					// set the attributes on the file
-					SetFileAttributes(destFile.c_str(), attr);
-				}
+			// set the original file attributes
+			if (fileInfo.attr != INVALID_FILE_ATTRIBUTES)
+			{
+				// check for Posix flags
+				DWORD attr = fileInfo.attr;
+				if ((attr & 0xF0000000) != 0)
+					attr &= 0x3FFF;
 
-				// we're done with the stream
-				outStream = nullptr;
+				// set the attributes on the file
+				SetFileAttributes(destFile.c_str(), attr);
+			}
+
+			// we're done with the stream
+			outStream = nullptr;
 
-				// if errors occurred, delete the file - we don't want to leave
-				// behind an empty or corrupted file
-				if (nErrors != 0)
-					DeleteFile(destFile.c_str());
+			// if errors occurred, delete the file - we don't want to leave
+			// behind an empty or corrupted file
+			bool ok = fileErrors == 0;
+			if (!ok)
+			{
+				nErrors += fileErrors;
+				DeleteFile(destFile.c_str());
 			}
 
-			return S_OK;
+			// let the caller know this file is done
+			if (fileDone != nullptr)
+				fileDone(curItem, ok);
+
+			curItem = -1;
 		}
 
 		// ICryptoGetTextPassword
@@ -566,14 +791,26 @@ bool SevenZipArchive::Extract(UINT32 idx, const TCHAR *destFile, ErrorHandler &e
 			return RunPasswordDialog(pbstrPassword, arch->filename.c_str(), WSTRINGToTSTRING(entryName).c_str());
 		}
 
+		void ClearFileInfo()
+		{
+			fileInfo.modTime.dwLowDateTime = 0;
+			fileInfo.modTime.dwHighDateTime = 0;
+			fileInfo.attr = INVALID_FILE_ATTRIBUTES;
+		}
+
 		// source archive object
 		SevenZipArchive *arch;
 
-		// destination file
-		TSTRING destFile;
+		// items to extract, and the item list index for each archive index
+		const std::vector<ExtractItem> &items;
+		std::unordered_map<UInt32, size_t> itemMap;
+
+		// caller's callbacks
+		ProgressFunc &progress;
+		FileDoneFunc &fileDone;
 
 		// output stream
-		RefPtr<COutFileStream> outStream;
+		RefPtr<BufferedOutFileStream> outStream;
 
 		// name of entry being extracted
 		WSTRING entryName;
@@ -581,8 +818,18 @@ bool SevenZipArchive::Extract(UINT32 idx, const TCHAR *destFile, ErrorHandler &e
 		// error handler
 		ErrorHandler &eh;
 
-		// error count
+		// error count, for the whole batch and for the current file
 		int nErrors;
+		int fileErrors;
+
+		// current item index in the list, or -1 if none
+		int curItem;
+
+		// total bytes to extract, as reported by the archive reader
+		UInt64 total;
+
+		// was the extraction cancelled through the progress callback?
+		bool cancelled;
 
 		struct
 		{
@@ -591,13 +838,31 @@ bool SevenZipArchive::Extract(UINT32 idx, const TCHAR *destFile, ErrorHandler &e
 		} fileInfo;
 	};
 	RefPtr<ExtractCallback> cb;
-	cb = new ExtractCallback(this, destFile, eh);
+	cb = new ExtractCallback(this, items, progress, fileDone, eh);
+
+	// Set up the object indices.  The archive readers require these to
+	// be in ascending order.
+	std::vector<UInt32> indices;
+	indices.reserve(items.size());
+	for (auto &item : items)
+		indices.push_back(item.idx);
+	std::sort(indices.begin(), indices.end());
+	indices.erase(std::unique(indices.begin(), indices.end()), indices.end());
+
+	// extract the items
+	HRESULT hr = archive->Extract(indices.data(), static_cast<UInt32>(indices.size()), false, cb);
+
+	// if we stopped in the middle of a file, clean it up
+	if (cb->curItem >= 0)
+	{
+		++cb->fileErrors;
+		cb->FinishFile();
+	}
 
-	// set up the object indices
-	UInt32 indices[] = { idx };
+	// cancellation isn't an error
+	if (cb->cancelled)
+		return false;
 
-	// extract the item
-	HRESULT hr = archive->Extract(indices, countof(indices), false, cb);
 	if (!SUCCEEDED(hr))
 	{
 		// log a separate generic error if the callback didn't already log
@@ -605,7 +870,7 @@ bool SevenZipArchive::Extract(UINT32 idx, const TCHAR *destFile, ErrorHandler &e
 		if (cb->nErrors == 0)
 		{
 			eh.SysError(
-				MsgFmt(IDS_ERR_7Z_EXTRACT_FAILED, filename.c_str(), cb->entryName.c_str(), destFile),
+				MsgFmt(IDS_ERR_7Z_EXTRACT_FAILED, filename.c_str(), cb->entryName.c_str(), items.front().destFile.c_str()),
 				MsgFmt(_T("7z.dll!IInArchive::Extract failed, HRESULT %lx"), (long)hr));
 		}
 
@@ -621,3 +886,203 @@ bool SevenZipArchive::Extract(UINT32 idx, const TCHAR *destFile, ErrorHandler &e
 	return true;
 }
 
+bool SevenZipArchive::ExtractParallel(const TCHAR *fname, const std::vector<ExtractItem> &items,
+	int maxThreads, ProgressFunc progress, FileDoneFunc fileDone, ErrorHandler &eh)
+{
+	// open a stream on the archive file
+	auto OpenStream = [fname](RefPtr<IStream> &stream) {
+		return SUCCEEDED(SHCreateStreamOnFileEx(fname, STGM_READ | STGM_SHARE_DENY_WRITE,
+			0, FALSE, nullptr, &stream));
+	};
+
+	// open the archive, to figure out how to divide up the work
+	RefPtr<IStream> stream;
+	SevenZipArchive arch;
+	if (!OpenStream(stream))
+	{
+		WindowsErrorMessage winErr;
+		eh.SysError(MsgFmt(IDS_ERR_7Z_OPEN_FILE, fname), winErr.Get());
+		return false;
+	}
+	if (!arch.OpenArchive(fname, stream, eh))
+		return false;
+
+	// Check whether the archive is solid.  In a non-solid archive, each
+	// file is compressed on its own, so every file can be decoded
+	// independently.  In a solid archive, the files within a solid block
+	// have to be decoded in sequence, but separate blocks are independent.
+	// Only 7z tells us the block numbers; for other solid formats (RAR),
+	// the whole archive has to be treated as one block.
+	NWindows::NCOM::CPropVariant solidProp;
+	bool solid = SUCCEEDED(arch.archive->GetArchiveProperty(kpidSolid, &solidProp))
+		&& solidProp.vt == VT_BOOL && solidProp.boolVal != VARIANT_FALSE;
+
+	// Group the items by block, and total up the size of each group.
+	// An encrypted entry means a possible password prompt, which we
+	// don't want to pop up on several threads at once, so treat that
+	// as a single block as well.
+	struct Group
+	{
+		UINT64 size = 0;
+		std::vector<size_t> items;
+	};
+	std::unordered_map<UINT64, Group> groupMap;
+	bool single = false;
+	for (size_t i = 0; i < items.size(); ++i)
+	{
+		UINT32 idx = items[i].idx;
+		NWindows::NCOM::CPropVariant encProp, blockProp, sizeProp;
+		if (SUCCEEDED(arch.archive->GetProperty(idx, kpidEncrypted, &encProp))
+			&& encProp.vt == VT_BOOL && encProp.boolVal != VARIANT_FALSE)
+			single = true;
+
+		UINT64 block = idx;
+		if (solid)
+		{
+			if (SUCCEEDED(arch.archive->GetProperty(idx, kpidBlock, &blockProp)) && blockProp.vt == VT_UI4)
+				block = blockProp.ulVal;
+			else
+				single = true;
+		}
+
+		auto &g = groupMap[block];
+		g.items.push_back(i);
+		if (SUCCEEDED(arch.archive->GetProperty(idx, kpidSize, &sizeProp)) && sizeProp.vt == VT_UI8)
+			g.size += sizeProp.uhVal.QuadPart;
+	}
+
+	// figure the number of threads: no more than the number of groups
+	int nThreads = min(maxThreads, static_cast<int>(groupMap.size()));
+
+	// if we can't split things up, just do a single batch extraction
+	// with the archive we already have open
+	if (single || nThreads <= 1)
+		return arch.Extract(items, progress, fileDone, eh);
+
+	// Divide the groups among the threads, balancing the sizes: assign
+	// each group, largest first, to the thread with the least work so far.
+	std::vector<Group*> groups;
+	for (auto &g : groupMap)
+		groups.push_back(&g.second);
+	std::sort(groups.begin(), groups.end(), [](const Group *a, const Group *b) { return a->size > b->size; });
+
+	struct Worker
+	{
+		std::vector<ExtractItem> items;     // this thread's share of the items
+		std::vector<size_t> itemIndex;      // index of each item in the caller's list
+		UINT64 size = 0;                    // total size of the assigned groups
+		UINT64 done = 0;                    // bytes extracted so far
+		UINT64 total = 0;                   // total bytes for this thread
+		CapturingErrorHandler eh;           // errors logged on this thread
+		bool ok = false;                    // result
+		std::function<void()> run;          // thread body
+	};
+	std::vector<Worker> workers(nThreads);
+	for (auto g : groups)
+	{
+		auto w = std::min_element(workers.begin(), workers.end(), [](const Worker &a, const Worker &b) { return a.size < b.size; });
+		w->size += g->size;
+		for (size_t i : g->items)
+		{
+			w->items.push_back(items[i]);
+			w->itemIndex.push_back(i);
+		}
+	}
+
+	// We're done with our scanning copy of the archive.  Each thread
+	// opens its own copy, since the archive readers aren't thread-safe.
+	arch.archive->Close();
+	arch.archive = nullptr;
+	stream = nullptr;
+
+	// Shared state.  The callbacks are serialized through the lock.  The
+	// overall progress is the sum of the threads' progress.
+	CriticalSection lock;
+	volatile bool cancel = false;
+	for (auto &w : workers)
+	{
+		Worker *wp = &w;
+		w.run = [wp, &workers, &lock, &cancel, &progress, &fileDone, &OpenStream, fname]()
+		{
+			// open our own copy of the archive
+			RefPtr<IStream> stream;
+			SevenZipArchive arch;
+			if (!OpenStream(stream))
+			{
+				WindowsErrorMessage winErr;
+				wp->eh.SysError(MsgFmt(IDS_ERR_7Z_OPEN_FILE, fname), winErr.Get());
+				return;
+			}
+			if (!arch.OpenArchive(fname, stream, wp->eh))
+				return;
+
+			// extract our items
+			wp->ok = arch.Extract(wp->items,
+				[wp, &workers, &lock, &cancel, &progress](UINT64 done, UINT64 total)
+			{
+				CriticalSectionLocker locker(lock);
+				wp->done = done;
+				wp->total = total;
+				if (progress != nullptr && !cancel)
+				{
+					UINT64 sumDone = 0, sumTotal = 0;
+					for (auto &w : workers)
+					{
+						sumDone += w.done;
+						sumTotal += max(w.total, w.size);
+					}
+					if (!progress(sumDone, sumTotal))
+						cancel = true;
+				}
+				return !cancel;
+			},
+				[wp, &lock, &fileDone](size_t item, bool ok)
+			{
+				CriticalSectionLocker locker(lock);
+				if (fileDone != nullptr)
+					fileDone(wp->itemIndex[item], ok);
+			}, wp->eh);
+		};
+	}
+
+	// start the threads
+	std::vector<HANDLE> threads;
+	for (auto &w : workers)
+	{
+		DWORD tid;
+		HANDLE h = CreateThread(NULL, 0, [](LPVOID lParam) -> DWORD
+		{
+			static_cast<Worker*>(lParam)->run();
+			return 0;
+		}, &w, 0, &tid);
+
+		// if we couldn't create the thread, do this part of the work
+		// on the current thread instead
+		if (h != NULL)
+			threads.push_back(h);
+		else
+			w.run();
+	}
+
+	// wait for the threads to finish
+	if (threads.size() != 0)
+		WaitForMultipleObjects(static_cast<DWORD>(threads.size()), threads.data(), TRUE, INFINITE);
+	for (auto h : threads)
+		CloseHandle(h);
+
+	// pass along the threads' errors
+	bool ok = !cancel;
+	for (auto &w : workers)
+	{
+		ok &= w.ok;
+		w.eh.EnumErrors([&eh](const ErrorList::Item &item) {
+			if (item.details.length() != 0)
+				eh.SysError(item.message.c_str(), item.details.c_str());
+			else
+				eh.Error(item.message.c_str());
+		});
+	}
+
+	// return the combined result
+	return ok;
+}
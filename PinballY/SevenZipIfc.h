@@ -23,6 +23,48 @@ public:
 	// extract the file at the given index
 	bool Extract(UINT32 idx, const TCHAR *destFile, ErrorHandler &eh);
 
+	// Batch extraction item: an entry index, and the file to extract
+	// it into
+	struct ExtractItem
+	{
+		ExtractItem(UINT32 idx, const TCHAR *destFile) : idx(idx), destFile(destFile) { }
+		UINT32 idx;
+		TSTRING destFile;
+	};
+
+	// Batch extraction progress callback.  This receives the number of
+	// bytes extracted so far and the total for the batch, and returns
+	// true to continue or false to cancel.
+	using ProgressFunc = std::function<bool(UINT64 done, UINT64 total)>;
+
+	// Batch extraction file completion callback.  This is called as
+	// each file is finished, with the file's index in the item list
+	// and its status.  A file that failed has already been deleted.
+	using FileDoneFunc = std::function<void(size_t item, bool ok)>;
+
+	// Extract a batch of files.  This extracts all of the items in a
+	// single pass over the archive, which is much faster than a series
+	// of single-file extractions for a solid archive, since each of
+	// those would have to decode the solid block from the beginning.
+	// The callbacks are optional.  Returns true if all of the files
+	// were extracted successfully.  Cancellation returns false without
+	// logging an error.
+	bool Extract(const std::vector<ExtractItem> &items,
+		ProgressFunc progress, FileDoneFunc fileDone, ErrorHandler &eh);
+
+	// Extract a batch of files from an archive file on disk, using up
+	// to 'maxThreads' threads.  The items are divided into groups that
+	// can be decoded independently - individual files for formats that
+	// compress each file separately, like ZIP, or solid blocks for 7z -
+	// and each thread opens its own copy of the archive and extracts
+	// its share of the groups.  Falls back on a single-threaded batch
+	// extraction when the archive can't be split up (a solid RAR file,
+	// an encrypted archive, or a single solid block).  The callbacks
+	// are serialized, so they don't need their own locking, but they
+	// can be called on any of the threads.
+	static bool ExtractParallel(const TCHAR *fname, const std::vector<ExtractItem> &items,
+		int maxThreads, ProgressFunc progress, FileDoneFunc fileDone, ErrorHandler &eh);
+
 protected:
 	// 7z.dll archive reader object
 	RefPtr<IInArchive> archive;
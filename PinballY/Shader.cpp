@@ -26,16 +26,25 @@ Shader::Shader()
 Shader::~Shader()
 {
 	// release our shaders and input layout
-	if (vs != 0) vs->Release();
-	if (ps != 0) ps->Release();
-	if (gs != 0) gs->Release();
-	if (layout != 0) layout->Release();
+	Shader::ReleaseDeviceObjects();
 
 	// Note that we don't have to delete our texture or
 	// model object lists, because they keep only weak
 	// references to their objects.
 }
 
+void Shader::ReleaseDeviceObjects()
+{
+	if (vs != 0) vs->Release();
+	if (ps != 0) ps->Release();
+	if (gs != 0) gs->Release();
+	if (layout != 0) layout->Release();
+	vs = 0;
+	ps = 0;
+	gs = 0;
+	layout = 0;
+}
+
 bool Shader::CreateInputLayout(
 	D3D *d3d, 
 	D3D11_INPUT_ELEMENT_DESC *layoutDesc, int layoutDescCount,
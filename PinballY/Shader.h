@@ -69,18 +69,41 @@ public:
 	// initialize - override per subclass
 	virtual bool Init() = 0;
 
+	// Re-initialize after the D3D device has been replaced (see
+	// D3D::RecreateDevice()).  This rebuilds the device objects in place,
+	// since the drawing objects hold plain pointers to their shaders.
+	bool Reinit() { ReleaseDeviceObjects(); return Init(); }
+
 	// Prepare for drawing via the shader.  This loads our shader
 	// programs into the GPU.
 	void PrepareForRendering(Camera *camera);
 
+	// Forget the current prepared shader, so that the next shader used
+	// is fully prepared.  Call this after the device context state has
+	// been reset.
+	static void InvalidatePreparedShader() { currentPreparedShader = nullptr; }
+
 	// set input buffers for pixel and vertex shaders
 	virtual void SetShaderInputs(Camera *camera) = 0;
 
 	// Set the alpha transparency level for the current rendering, if the
-	// shader supports it.
+	// shader supports it.  Note that the D3D blend state expects the
+	// pixel shaders to output premultiplied alpha, so shaders that read
+	// straight-alpha sources must premultiply their results.
 	virtual void SetAlpha(float alpha) = 0;
 
+	// Set the alpha transparency level for rendering a texture with
+	// premultiplied alpha, as Direct2D and our image loaders produce.
+	// Shaders that don't distinguish premultiplied textures just apply
+	// the alpha.
+	virtual void SetPremultipliedAlpha(float alpha) { SetAlpha(alpha); }
+
 protected:
+	// Release the device objects.  Subclasses with their own device
+	// objects (such as constant buffers) override this to release those
+	// as well, calling the base class version.
+	virtual void ReleaseDeviceObjects();
+
 	// Create the input layout
 	bool CreateInputLayout(
 		D3D *d3d,
@@ -8,6 +8,7 @@
 #include "../Utilities/GraphicsUtil.h"
 #include "../Utilities/ComUtil.h"
 #include "../Utilities/SWFParser.h"
+#include "../Utilities/DirectWriteUtil.h"
 #include "../DirectXTK/Inc/DDSTextureLoader.h"
 #include "../DirectXTK/Inc/WICTextureLoader.h"
 #include "../DirectXTex/DirectXTex/DirectXTex.h"
@@ -15,27 +16,142 @@
 #include "Sprite.h"
 #include "Shader.h"
 #include "TextureShader.h"
+#include "TextureBudget.h"
+#include "TextureCache.h"
+#include "MediaFileIndex.h"
 #include "Application.h"
 #include "FlashClient/FlashClient.h"
 #include "LogFile.h"
+#include "AnimClock.h"
 #include <png.h>
+#include <unordered_map>
 
 #pragma comment(lib, "libpng.lib")
 
 using namespace DirectX;
 
+// statics
+size_t Sprite::animStreamingThreshold = 64 * 1024 * 1024;
+
+// limit image loads to the window size (low-memory profile)
+bool Sprite::limitToWindowSize = false;
+
+// shared still images
+bool Sprite::sharedImages = true;
+std::unordered_map<TSTRING, RefPtr<Sprite::LoadContext>> Sprite::sharedImageTable;
+CriticalSection Sprite::sharedImageLock;
+
+// Create a WIC stream over a memory-mapped file.  The stream reads the
+// view in place, without copying it, so the caller must keep the view
+// alive for as long as the stream, or a decoder reading from it, exists.
+static HRESULT CreateViewStream(IWICImagingFactory *pWIC, MappedFile *view, IWICStream **stream)
+{
+	HRESULT hr;
+	RefPtr<IWICStream> s;
+	if (FAILED(hr = pWIC->CreateStream(&s))
+		|| FAILED(hr = s->InitializeFromMemory(const_cast<BYTE*>(view->GetData()), static_cast<DWORD>(view->GetSize()))))
+		return hr;
+
+	*stream = s.Detach();
+	return S_OK;
+}
+
 Sprite::Sprite()
 {
 	alpha = 1.0f;
 	offset = { 0.0f, 0.0f, 0.0f };
 	scale = { 1.0f, 1.0f, 1.0f };
 	rotation = { 0.0f, 0.0f, 0.0f };
+	loadSize = { 0.0f, 0.0f };
+	meshSize = { 0.0f, 0.0f };
 	UpdateWorld();
 }
 
 Sprite::~Sprite()
 {
+	// cancel any background load still in progress
+	if (loadContext != nullptr)
+		loadContext->cancelled = true;
+
 	DetachFlash();
+	ReleaseLoadContext();
+}
+
+void Sprite::ReleaseLoadContext()
+{
+	// if the context isn't in the shared image table, just drop it
+	if (loadContext == nullptr || loadContext->sharedKey.length() == 0)
+	{
+		loadContext = nullptr;
+		return;
+	}
+
+	// Drop our reference, and remove the table entry if that leaves the
+	// table's reference as the only one.  We hold the lock, so no other
+	// sprite can pick up the context from the table in the meantime.
+	CriticalSectionLocker locker(sharedImageLock);
+	LoadContext *ctx = loadContext;
+	loadContext = nullptr;
+	if (auto it = sharedImageTable.find(ctx->sharedKey); it != sharedImageTable.end() && it->second == ctx)
+	{
+		ULONG refs = ctx->AddRef();
+		ctx->Release();
+		if (refs == 2)
+			sharedImageTable.erase(it);
+	}
+}
+
+void Sprite::ReleaseSharedImages()
+{
+	CriticalSectionLocker locker(sharedImageLock);
+	for (auto &e : sharedImageTable)
+		e.second->sharedKey.clear();
+	sharedImageTable.clear();
+}
+
+bool Sprite::AdoptSharedImage(const TSTRING &key, POINTF normalizedSize, ErrorHandler &eh, const WCHAR *filename)
+{
+	// Look for an entry that has finished loading and has been displayed.
+	// Don't adopt a context that's still loading: its owner gets the
+	// first-frame notification when it's ready, but we wouldn't.
+	RefPtr<LoadContext> ctx;
+	{
+		CriticalSectionLocker locker(sharedImageLock);
+		auto it = sharedImageTable.find(key);
+		if (it == sharedImageTable.end())
+			return false;
+
+		LoadContext *c = it->second;
+		if (c->readyState != LoadContext::ReadyState::Ready || c->tv.rv == nullptr
+			|| c->animation != nullptr || !c->IsCurrentDevice())
+			return false;
+
+		ctx = c;
+	}
+
+	// create the mesh, and use the shared context as our own
+	if (!CreateMesh(normalizedSize, eh, MsgFmt(_T("file \"%ws\""), filename)))
+		return false;
+
+	loadContext = ctx;
+	return true;
+}
+
+void Sprite::AddSharedImage(const TSTRING &key)
+{
+	CriticalSectionLocker locker(sharedImageLock);
+
+	// If there's an existing entry, take it out of the table.  It stays
+	// with the sprites already using it.
+	if (auto it = sharedImageTable.find(key); it != sharedImageTable.end())
+	{
+		it->second->sharedKey.clear();
+		sharedImageTable.erase(it);
+	}
+
+	// add our context
+	loadContext->sharedKey = key;
+	sharedImageTable.emplace(key, loadContext);
 }
 
 void Sprite::DetachFlash()
@@ -50,12 +166,34 @@ void Sprite::DetachFlash()
 
 void Sprite::UpdateWorld()
 {
-	// Apply world transformations - scale, rotate, translate
-	world = XMMatrixIdentity();
-	world = XMMatrixMultiply(world, XMMatrixScaling(scale.x, scale.y, scale.z));
-	world = XMMatrixMultiply(world, XMMatrixRotationRollPitchYaw(rotation.x, rotation.y, rotation.z));
-	world = XMMatrixMultiply(world, XMMatrixTranslation(offset.x, offset.y, offset.z));
+	// Apply world transformations - mesh size, scale, rotate, translate.
+	// The mesh size scaling maps the shared unit quad to our rectangle
+	// size in local coordinates.
+	//
+	// Most sprites aren't rotated, and the ones that move every frame
+	// (the wheel icons during a spin, popups and menus during their
+	// transitions) are among them, so build the scale-and-translate
+	// matrix directly in that case, rather than going through the
+	// general rotation and matrix products.
+	float sx = meshSize.x * scale.x, sy = meshSize.y * scale.y;
+	if (rotation.x == 0.0f && rotation.y == 0.0f && rotation.z == 0.0f)
+	{
+		world = XMMatrixSet(
+			sx, 0.0f, 0.0f, 0.0f,
+			0.0f, sy, 0.0f, 0.0f,
+			0.0f, 0.0f, scale.z, 0.0f,
+			offset.x, offset.y, offset.z, 1.0f);
+	}
+	else
+	{
+		world = XMMatrixScaling(sx, sy, scale.z);
+		world = XMMatrixMultiply(world, XMMatrixRotationRollPitchYaw(rotation.x, rotation.y, rotation.z));
+		world = XMMatrixMultiply(world, XMMatrixTranslation(offset.x, offset.y, offset.z));
+	}
 	worldT = XMMatrixTranspose(world);
+
+	// the new transform will have to be rendered
+	renderDirty = true;
 }
 
 bool Sprite::Load(const WCHAR *filename, POINTF normalizedSize, SIZE pixSize, HWND msgHwnd, ErrorHandler &eh)
@@ -69,8 +207,30 @@ bool Sprite::Load(const WCHAR *filename, POINTF normalizedSize, SIZE pixSize, HW
 	// set up a new load context
 	loadContext.Attach(new LoadContext());
 
+	// In the low-memory profile, limit the texture to the window size.
+	// Use the larger window dimension as the limit for both directions,
+	// since the sprite might be rotated on the screen.
+	if (RECT rc; limitToWindowSize && msgHwnd != NULL && GetClientRect(msgHwnd, &rc) && pixSize.cx > 0 && pixSize.cy > 0)
+	{
+		int lim = max(rc.right - rc.left, rc.bottom - rc.top);
+		if (lim > 0 && (pixSize.cx > lim || pixSize.cy > lim))
+		{
+			float scale = float(lim) / float(max(pixSize.cx, pixSize.cy));
+			pixSize = { max(1, (int)(pixSize.cx * scale)), max(1, (int)(pixSize.cy * scale)) };
+		}
+	}
+
+	// Map the file into memory.  The format sniffer, the orientation
+	// metadata reader, and the decoder all read from this one view, so
+	// the file is only opened once, and its headers are only read from
+	// disk once.  If the file can't be mapped (it's empty, say), skip
+	// straight to the WIC loader, which will report the error.
+	RefPtr<MappedFile> view(new MappedFile());
+	if (!view->Open(filename))
+		view = nullptr;
+
 	// Try to determine the image type from the file contents
-	if (ImageFileDesc desc; GetImageFileInfo(filename, desc, true, true))
+	if (ImageFileDesc desc; view != nullptr && GetImageFileInfo(filename, view->GetData(), view->GetSize(), desc, true, true))
 	{
 		// If it's an SWF, WIC can't handle it - we have to load it through
 		// our Flash client site object
@@ -79,9 +239,9 @@ bool Sprite::Load(const WCHAR *filename, POINTF normalizedSize, SIZE pixSize, HW
 
 		// If it's a GIF or APNG, we need to load it specially in case it's animated
 		if (desc.imageType == ImageFileDesc::ImageType::GIF)
-			return LoadGIF(filename, normalizedSize, pixSize, eh);
+			return LoadGIF(filename, view, normalizedSize, pixSize, eh);
 		else if (desc.imageType == ImageFileDesc::ImageType::APNG)
-			return LoadAPNG(filename, normalizedSize, pixSize, eh);
+			return LoadAPNG(filename, view, normalizedSize, pixSize, eh);
 
 		// The WIC loader ignores orientation metadata (such as JPEG Exif data), so
 		// we have to do some special work if it's rotated or reflected.
@@ -89,10 +249,15 @@ bool Sprite::Load(const WCHAR *filename, POINTF normalizedSize, SIZE pixSize, HW
 		{
 			// Load it as a bitmap.  Note that the final bitmap is at the DISPLAY size,
 			// which might be rotated from the source size.
-			return Load(desc.dispSize.cx, desc.dispSize.cy, [&desc, filename](Gdiplus::Graphics &g)
+			return Load(desc.dispSize.cx, desc.dispSize.cy, [&desc, &view](Gdiplus::Graphics &g)
 			{
-				// load the image 
-				std::unique_ptr<Gdiplus::Bitmap> bitmap(Gdiplus::Bitmap::FromFile(filename));
+				// load the image from the mapped file
+				bool isWIC2;
+				RefPtr<IWICStream> stream;
+				auto pWIC = GetWICFactory(isWIC2);
+				if (pWIC == nullptr || FAILED(CreateViewStream(pWIC, view, &stream)))
+					return;
+				std::unique_ptr<Gdiplus::Bitmap> bitmap(Gdiplus::Bitmap::FromStream(stream));
 
 				// Set up the drawing port with the origin at the center of the final
 				// view size, to make the rotation and reflection transforms easier to
@@ -114,12 +279,248 @@ bool Sprite::Load(const WCHAR *filename, POINTF normalizedSize, SIZE pixSize, HW
 		}
 	}
 
+	// It's a plain still image, so check for a copy on display in another
+	// sprite that we can share.  The key includes the file's modification
+	// time, so that a replaced file doesn't match the old copy.
+	TSTRING sharedKey;
+	if (FILETIME ft; sharedImages && MediaFileIndex::GetFileTime(filename, ft))
+	{
+		sharedKey = MsgFmt(_T("%ws|%dx%d|%d|%08lx%08lx"), filename, pixSize.cx, pixSize.cy,
+			genMips ? 1 : 0, ft.dwHighDateTime, ft.dwLowDateTime).Get();
+		std::transform(sharedKey.begin(), sharedKey.end(), sharedKey.begin(), ::_totlower);
+		if (AdoptSharedImage(sharedKey, normalizedSize, eh, filename))
+			return true;
+	}
+
 	// It's didn't require special handling, so we'll just let DirectxTk 
 	// load it directly via WIC.
-	return LoadWICTexture(filename, normalizedSize, eh);
+	if (!LoadWICTexture(filename, normalizedSize, pixSize, eh, view))
+		return false;
+
+	// offer the image for sharing with other sprites once it's displayed
+	if (sharedKey.length() != 0)
+		AddSharedImage(sharedKey);
+
+	return true;
+}
+
+bool Sprite::LoadIntoAtlas(const WCHAR *filename, POINTF normalizedSize, SIZE pixSize,
+	TextureAtlas *atlas, HWND msgHwnd, ErrorHandler &eh)
+{
+	// The atlas can only handle still images that fit its cells.  WIC
+	// ignores orientation metadata, so leave reoriented images to the
+	// regular loader as well.  Use the regular loader for anything we
+	// can't handle.
+	ImageFileDesc desc;
+	if (atlas == nullptr || pixSize.cx <= 0 || pixSize.cy <= 0 || !atlas->Fits(pixSize)
+		|| !GetImageFileInfo(filename, desc, true, true) || desc.oriented
+		|| (desc.imageType != ImageFileDesc::ImageType::PNG && desc.imageType != ImageFileDesc::ImageType::JPEG))
+		return Load(filename, normalizedSize, pixSize, msgHwnd, eh);
+
+	// release any previous resources
+	Clear();
+
+	// remember the message window
+	this->msgHwnd = msgHwnd;
+
+	// set up a new load context, in the Loading state
+	loadContext.Attach(new LoadContext());
+	loadContext->readyState = LoadContext::ReadyState::Loading;
+	loadContext->atlas = atlas;
+
+	// set up the thread context
+	struct ThreadContext
+	{
+		ThreadContext(LoadContext *loadContext, const WCHAR *filename, SIZE pixSize) :
+			loadContext(loadContext, RefCounted::DoAddRef),
+			filename(filename),
+			pixSize(pixSize)
+		{ }
+
+		RefPtr<LoadContext> loadContext;
+		WSTRING filename;
+		SIZE pixSize;
+	};
+	std::unique_ptr<ThreadContext> ctx(new ThreadContext(loadContext, filename, pixSize));
+
+	auto ThreadMain = [](LPVOID params) -> DWORD
+	{
+		// get the context - we own it and must discard it when done, so use a unique_ptr
+		std::unique_ptr<ThreadContext> ctx(static_cast<ThreadContext*>(params));
+
+		// if the sprite has already abandoned the load, skip it
+		if (ctx->loadContext->cancelled)
+			return 0;
+
+		// load the source image
+		std::unique_ptr<Gdiplus::Bitmap> src(Gdiplus::Bitmap::FromFile(ctx->filename.c_str()));
+		if (src == nullptr || src->GetLastStatus() != Gdiplus::Ok)
+		{
+			LogFileErrorHandler eh;
+			eh.SysError(
+				MsgFmt(IDS_ERR_IMGLOAD, ctx->filename.c_str()),
+				_T("Sprite::LoadIntoAtlas: Gdiplus::Bitmap::FromFile failed"));
+			return 0;
+		}
+
+		// check again for cancellation before rescaling the image
+		if (ctx->loadContext->cancelled)
+			return 0;
+
+		// Set up a pixel buffer at the target size, and wrap it in a
+		// GDI+ bitmap.  32bpp ARGB in GDI+ has the same memory layout
+		// as DXGI BGRA, so we can copy the result directly into the
+		// atlas texture.  Use the premultiplied format, to match our
+		// blend state.
+		int width = ctx->pixSize.cx, height = ctx->pixSize.cy;
+		std::unique_ptr<BYTE[]> pixels(new BYTE[width * height * 4]());
+		{
+			Gdiplus::Bitmap dst(width, height, width * 4, PixelFormat32bppPARGB, pixels.get());
+			Gdiplus::Graphics g(&dst);
+
+			// Draw the image scaled to the target size.  Use high-quality
+			// resampling, and set the wrap mode to mirror at the edges, so
+			// that the filter doesn't blend transparent pixels from outside
+			// the image into the border.
+			g.SetInterpolationMode(Gdiplus::InterpolationModeHighQualityBicubic);
+			g.SetPixelOffsetMode(Gdiplus::PixelOffsetModeHighQuality);
+			Gdiplus::ImageAttributes attrs;
+			attrs.SetWrapMode(Gdiplus::WrapModeTileFlipXY);
+			g.DrawImage(src.get(), Gdiplus::Rect(0, 0, width, height),
+				0, 0, src->GetWidth(), src->GetHeight(), Gdiplus::UnitPixel, &attrs);
+			g.Flush();
+		}
+
+		// hand the pixels over to the renderer
+		ctx->loadContext->atlasPixels = std::move(pixels);
+		ctx->loadContext->atlasPixSize = ctx->pixSize;
+		ctx->loadContext->premultipliedAlpha = true;
+		ctx->loadContext->readyState = LoadContext::ReadyState::Loaded;
+		return 0;
+	};
+
+	// create the mesh
+	if (!CreateMesh(normalizedSize, eh, MsgFmt(_T("file \"%ws\""), filename)))
+		return false;
+
+	// Queue the load on the loader pool.  If that succeeded, release the
+	// context object to the task; otherwise do the work inline.  Either
+	// way, the thread routine takes ownership of the context.
+	if (LoaderPool::Submit([ThreadMain, p = ctx.get()]() { ThreadMain(p); }, loadPriority))
+		ctx.release();
+	else
+		ThreadMain(ctx.release());
+
+	// success
+	return true;
+}
+
+bool Sprite::StoreAtlasImage()
+{
+	// get the pixel size
+	int width = loadContext->atlasPixSize.cx, height = loadContext->atlasPixSize.cy;
+
+	// try adding the image to the atlas
+	LogFileErrorHandler eh;
+	loadContext->atlasSlot.Attach(loadContext->atlas->Add(loadContext->atlasPixels.get(), width, height, eh));
+	if (loadContext->atlasSlot != nullptr)
+	{
+		// success - use the atlas page texture, with the image's texture rectangle
+		loadContext->tv.texture = loadContext->atlasSlot->GetTexture();
+		loadContext->tv.rv = loadContext->atlasSlot->GetShaderResourceView();
+		loadContext->texRect = loadContext->atlasSlot->GetTexRect();
+	}
+	else
+	{
+		// The atlas couldn't take it, so create a separate texture 
+		// for the image instead
+		BITMAPINFO bmi;
+		ZeroMemory(&bmi, sizeof(bmi));
+		bmi.bmiHeader.biSize = sizeof(BITMAPINFOHEADER);
+		bmi.bmiHeader.biPlanes = 1;
+		bmi.bmiHeader.biBitCount = 32;
+		bmi.bmiHeader.biWidth = width;
+		bmi.bmiHeader.biHeight = -height;
+		bmi.bmiHeader.biCompression = BI_RGB;
+		if (!CreateTextureFromBitmapStatic(bmi, loadContext->atlasPixels.get(), eh, _T("atlas image"), &loadContext->tv))
+			return false;
+	}
+
+	// we're done with the pixels and the atlas reference
+	loadContext->atlasPixels.reset();
+	loadContext->atlas = nullptr;
+	return true;
+}
+
+// Load a WIC image into a texture via DirectXTex, scaling it down first
+// to fit the given size limit, if non-zero, and optionally generating a
+// full mip chain.  If the image has any transparency, the texture is
+// premultiplied, before it's scaled or mipped, so that the filtering
+// doesn't pick up the colors of the invisible pixels; 'premultiplied'
+// is set to indicate which kind of texture we created.  The DirectXTK
+// WIC loader can't do either of those things on a loader thread (it can
+// only generate mips via the device context, and it never premultiplies),
+// so we do the work on the CPU.
+static HRESULT CreateDirectXTexWICTexture(const WCHAR *filename, MappedFile *view, size_t maxSize, bool genMips,
+	const volatile bool &cancelled, ID3D11Resource **texture, ID3D11ShaderResourceView **rv, bool &premultiplied)
+{
+	// load the image, from the mapped view if we have one
+	HRESULT hr;
+	TexMetadata meta;
+	ScratchImage src;
+	if (FAILED(hr = view != nullptr ?
+		LoadFromWICMemory(view->GetData(), view->GetSize(), WIC_FLAGS_IGNORE_SRGB, &meta, src) :
+		LoadFromWICFile(filename, WIC_FLAGS_IGNORE_SRGB, &meta, src)))
+		return hr;
+
+	// stop if the load has been cancelled
+	if (cancelled)
+		return E_ABORT;
+
+	// premultiply the alpha, if the image has any transparency
+	ScratchImage *cur = &src;
+	ScratchImage pmAlpha;
+	premultiplied = false;
+	if (HasAlpha(meta.format) && !src.IsAlphaAllOpaque())
+	{
+		if (FAILED(hr = PremultiplyAlpha(*src.GetImage(0, 0, 0), TEX_PMALPHA_DEFAULT, pmAlpha)))
+			return hr;
+		cur = &pmAlpha;
+		premultiplied = true;
+	}
+
+	// scale it down to the size limit, preserving the aspect ratio
+	ScratchImage resized;
+	size_t longer = max(meta.width, meta.height);
+	if (maxSize != 0 && longer > maxSize)
+	{
+		size_t width = max(size_t(1), (meta.width * maxSize + longer - 1) / longer);
+		size_t height = max(size_t(1), (meta.height * maxSize + longer - 1) / longer);
+		if (FAILED(hr = Resize(*cur->GetImage(0, 0, 0), width, height, TEX_FILTER_DEFAULT, resized)))
+			return hr;
+		cur = &resized;
+	}
+
+	// generate the mip chain, if desired
+	ScratchImage mips;
+	if (cancelled)
+		return E_ABORT;
+	if (genMips)
+	{
+		if (FAILED(hr = GenerateMipMaps(*cur->GetImage(0, 0, 0), TEX_FILTER_DEFAULT, 0, mips)))
+			return hr;
+		cur = &mips;
+	}
+
+	// create the texture and view
+	ID3D11Device *device = D3D::Get()->GetDevice();
+	if (FAILED(hr = CreateTexture(device, cur->GetImages(), cur->GetImageCount(), cur->GetMetadata(), texture)))
+		return hr;
+	return device->CreateShaderResourceView(*texture, nullptr, rv);
 }
 
-bool Sprite::LoadWICTexture(const WCHAR *filename, POINTF normalizedSize, ErrorHandler &eh)
+bool Sprite::LoadWICTexture(const WCHAR *filename, POINTF normalizedSize, SIZE pixSize, ErrorHandler &eh,
+	MappedFile *view)
 {
 	// WIC file loading can be kind of slow for large image files.
 	// Do the loading in a thread.
@@ -128,27 +529,96 @@ bool Sprite::LoadWICTexture(const WCHAR *filename, POINTF normalizedSize, ErrorH
 	// set up the thread context
 	struct ThreadContext
 	{
-		ThreadContext(LoadContext *loadContext, const WCHAR *filename) :
+		ThreadContext(LoadContext *loadContext, const WCHAR *filename, MappedFile *view, SIZE pixSize, bool genMips) :
 			loadContext(loadContext, RefCounted::DoAddRef),
-			filename(filename)
+			filename(filename),
+			view(view, RefCounted::DoAddRef),
+			pixSize(pixSize),
+			genMips(genMips)
 		{ }
 
 		RefPtr<LoadContext> loadContext;
 		WSTRING filename;
+		RefPtr<MappedFile> view;
+		SIZE pixSize;
+		bool genMips;
 	};
-	std::unique_ptr<ThreadContext> ctx(new ThreadContext(loadContext, filename));
+	std::unique_ptr<ThreadContext> ctx(new ThreadContext(loadContext, filename, view, pixSize, genMips));
 
 	auto ThreadMain = [](LPVOID params) -> DWORD
 	{
 		// get the context - we own it and must discard it when done, so use a unique_ptr
 		std::unique_ptr<ThreadContext> ctx(static_cast<ThreadContext*>(params));
 
-		// create the WIC texture
-		HRESULT hr = CreateWICTextureFromFileEx(D3D::Get()->GetDevice(), ctx->filename.c_str(),
-			0, D3D11_USAGE_DEFAULT, D3D11_BIND_SHADER_RESOURCE, 0, 0, WIC_LOADER_IGNORE_SRGB,
-			&ctx->loadContext->tv.texture, &ctx->loadContext->tv.rv);
+		// if the sprite has already abandoned the load, skip it
+		if (ctx->loadContext->cancelled)
+			return 0;
+
+		// if there's a compressed copy in the texture cache, use that
+		if (TextureCache::Load(ctx->filename.c_str(), ctx->pixSize, ctx->genMips,
+			&ctx->loadContext->tv.texture, &ctx->loadContext->tv.rv, &ctx->loadContext->premultipliedAlpha))
+		{
+			ctx->loadContext->readyState = LoadContext::ReadyState::Loaded;
+			return 0;
+		}
+
+		// Map the file, if the caller didn't already.  The size check and
+		// the decoder both read from the view.  If the file can't be mapped,
+		// go through the file-based WIC loader, so that it reports the error.
+		if (ctx->view == nullptr)
+		{
+			RefPtr<MappedFile> view(new MappedFile());
+			if (view->Open(ctx->filename.c_str()))
+				ctx->view = view;
+		}
+		const BYTE *data = ctx->view != nullptr ? ctx->view->GetData() : nullptr;
+		long dataLen = ctx->view != nullptr ? ctx->view->GetSize() : 0;
+
+		// Figure the texture size limit.  There's no point in uploading
+		// more pixels than we'll display, so if the display size is known,
+		// and the image is larger, scale it down at load time.  Scale
+		// uniformly by the larger of the horizontal and vertical ratios,
+		// so that the texture has at least as many pixels as the display
+		// area in both directions, even if the sprite stretches the image
+		// to a different aspect ratio.  The WIC loaders take the limit as
+		// the maximum size of the longer dimension.
+		size_t maxSize = 0;
+		ImageFileDesc desc;
+		bool haveDesc = GetImageFileInfo(ctx->filename.c_str(), data, dataLen, desc);
+		if (ctx->pixSize.cx > 0 && ctx->pixSize.cy > 0 && haveDesc && desc.size.cx > 0 && desc.size.cy > 0)
+		{
+			float scale = max(float(ctx->pixSize.cx) / float(desc.size.cx), float(ctx->pixSize.cy) / float(desc.size.cy));
+			if (scale < 1.0f)
+				maxSize = static_cast<size_t>(ceilf(float(max(desc.size.cx, desc.size.cy)) * scale));
+		}
+
+		// Create the WIC texture, with mips if desired.  Anything that
+		// might have transparency goes through DirectXTex, so that we can
+		// premultiply the alpha.  JPEG images are always opaque, so they
+		// can stay on the DirectXTK loader, unless they need mips.
+		HRESULT hr;
+		bool opaqueFormat = haveDesc && desc.imageType == ImageFileDesc::ImageType::JPEG;
+		bool premultiplied = false;
+		if (ctx->genMips || !opaqueFormat)
+			hr = CreateDirectXTexWICTexture(ctx->filename.c_str(), ctx->view, maxSize, ctx->genMips, ctx->loadContext->cancelled,
+				&ctx->loadContext->tv.texture, &ctx->loadContext->tv.rv, premultiplied);
+		else if (data != nullptr)
+			hr = CreateWICTextureFromMemoryEx(D3D::Get()->GetDevice(), data, dataLen,
+				maxSize, D3D11_USAGE_DEFAULT, D3D11_BIND_SHADER_RESOURCE, 0, 0, WIC_LOADER_IGNORE_SRGB,
+				&ctx->loadContext->tv.texture, &ctx->loadContext->tv.rv);
+		else
+			hr = CreateWICTextureFromFileEx(D3D::Get()->GetDevice(), ctx->filename.c_str(),
+				maxSize, D3D11_USAGE_DEFAULT, D3D11_BIND_SHADER_RESOURCE, 0, 0, WIC_LOADER_IGNORE_SRGB,
+				&ctx->loadContext->tv.texture, &ctx->loadContext->tv.rv);
+
+		// we're done with the file contents
+		ctx->view = nullptr;
 
-		if (FAILED(hr))
+		if (hr == E_ABORT)
+		{
+			// cancelled - the sprite no longer wants the result
+		}
+		else if (FAILED(hr))
 		{
 			WindowsErrorMessage winMsg(hr);
 			LogFileErrorHandler eh;
@@ -158,8 +628,17 @@ bool Sprite::LoadWICTexture(const WCHAR *filename, POINTF normalizedSize, ErrorH
 		}
 		else
 		{
+			// count it in the texture memory budget
+			TextureBudget::Track(ctx->loadContext->tv.texture);
+
 			// resource is loaded
+			ctx->loadContext->premultipliedAlpha = premultiplied;
 			ctx->loadContext->readyState = LoadContext::ReadyState::Loaded;
+
+			// add it to the texture cache for next time, unless the sprite
+			// has already abandoned it
+			if (!ctx->loadContext->cancelled)
+				TextureCache::Add(ctx->filename.c_str(), ctx->pixSize, ctx->genMips);
 		}
 		
 		return 0;
@@ -169,16 +648,13 @@ bool Sprite::LoadWICTexture(const WCHAR *filename, POINTF normalizedSize, ErrorH
 	if (!CreateMesh(normalizedSize, eh, MsgFmt(_T("file \"%ws\""), filename)))
 		return false;
 
-	// kick off the loader thread
-	DWORD tid;
-	HandleHolder hThread(CreateThread(0, 0, ThreadMain, ctx.get(), 0, &tid));
-
-	// if the thread startup succeeded, release the context object to the thread;
-	// otherwise try doing the work inline
-	if (hThread != nullptr)
+	// Queue the load on the loader pool.  If that succeeded, release the
+	// context object to the task; otherwise do the work inline.  Either
+	// way, the thread routine takes ownership of the context.
+	if (LoaderPool::Submit([ThreadMain, p = ctx.get()]() { ThreadMain(p); }, loadPriority))
 		ctx.release();
 	else
-		ThreadMain(ctx.get());
+		ThreadMain(ctx.release());
 
 	// success
 	return true;
@@ -232,9 +708,40 @@ bool Sprite::LoadSWF(const WCHAR *filename, POINTF normalizedSize, SIZE pixSize,
 			// get the context - we own it and must discard it when done, so use a unique_ptr
 			std::unique_ptr<ThreadContext> ctx(static_cast<ThreadContext*>(params));
 
+			// if the sprite has already abandoned the load, skip it
+			if (ctx->loadContext->cancelled)
+				return 0;
+
 			// set up the SWF loader
 			std::unique_ptr<SWFLoaderState> loader(new SWFLoaderState(ctx->pixSize));
 
+			// If there's a cached copy of the rasterized frames, use that
+			// instead of rendering the frames again.
+			auto &animFrames = ctx->loadContext->animFrames;
+			{
+				DWORD frameDelay;
+				std::vector<UINT> sequence;
+				std::vector<TextureCache::FrameTexture> textures;
+				if (TextureCache::LoadFrames(ctx->filename.c_str(), ctx->pixSize, frameDelay, sequence, textures))
+				{
+					// set up the animation frames
+					for (auto i : sequence)
+					{
+						auto af = animFrames.emplace_back(new AnimFrame()).get();
+						af->dt = frameDelay;
+						af->tv.texture = textures[i].texture;
+						af->tv.rv = textures[i].rv;
+					}
+
+					// initialize the animation, and mark the resource as loaded
+					loader->parser.reset();
+					ctx->loadContext->curAnimFrame = 0;
+					ctx->loadContext->animation.reset(loader.release());
+					ctx->loadContext->readyState = LoadContext::ReadyState::Loaded;
+					return 0;
+				}
+			}
+
 			// since we're running in the background, we can't display errors
 			// interactively, so log them
 			LogFileErrorHandler leh;
@@ -244,13 +751,32 @@ bool Sprite::LoadSWF(const WCHAR *filename, POINTF normalizedSize, SIZE pixSize,
 			if (!loader->parser->Load(ctx->filename.c_str(), leh, true))
 				return false;
 
+			// Set up a frame set to save in the texture cache, if it's enabled.
+			// We collect the distinct frame images for the cache as we go.
+			std::unique_ptr<TextureCache::FrameSet> frameSet;
+			size_t frameSetBytes = 0;
+			if (TextureCache::enabled)
+			{
+				frameSet.reset(new TextureCache::FrameSet());
+				frameSet->width = ctx->pixSize.cx;
+				frameSet->height = ctx->pixSize.cy;
+				frameSet->frameDelay = loader->parser->GetFrameDelay();
+			}
+
+			// Distinct frames, keyed by a hash of the pixels, with the index
+			// of the first animation frame showing each image.  Many SWF
+			// animations hold the same image over a long run of frames, so
+			// we let the repeated frames share one texture.
+			std::unordered_map<UINT64, size_t> distinctFrames;
+
 			// generate frames
 			for (;;)
 			{
 				// render the current frame
 				bool ok = true;
 				DrawOffScreen(ctx->pixSize.cx, ctx->pixSize.cy,
-					[&ctx, &loader, &ok](HDC hdc, HBITMAP hbitmap, const void *dibits, const BITMAPINFO &bmi)
+					[&ctx, &loader, &ok, &animFrames, &distinctFrames, &frameSet, &frameSetBytes](
+						HDC hdc, HBITMAP hbitmap, const void *dibits, const BITMAPINFO &bmi)
 				{
 					// render the current SWF display list into the DC
 					LogFileErrorHandler leh;
@@ -258,30 +784,81 @@ bool Sprite::LoadSWF(const WCHAR *filename, POINTF normalizedSize, SIZE pixSize,
 					if (ok)
 					{
 						// create the animation frame
-						auto af = ctx->loadContext->animFrames.emplace_back(new AnimFrame()).get();
+						auto af = animFrames.emplace_back(new AnimFrame()).get();
 
 						// set the delay time for the frame - SWF has a fixed frame rate for the
 						// whole sequence
 						af->dt = loader->parser->GetFrameDelay();
 
+						// hash the pixels (64-bit FNV-1a)
+						size_t nBytes = static_cast<size_t>(bmi.bmiHeader.biWidth) * abs(bmi.bmiHeader.biHeight) * 4;
+						UINT64 hash = 0xcbf29ce484222325ULL;
+						for (auto p = static_cast<const BYTE*>(dibits), end = p + nBytes; p < end; ++p)
+							hash = (hash ^ *p) * 0x100000001b3ULL;
+
+						// if it's the same as an earlier frame, share its texture
+						if (auto it = distinctFrames.find(hash); it != distinctFrames.end())
+						{
+							auto &prv = animFrames[it->second]->tv;
+							af->tv.texture = prv.texture;
+							af->tv.rv = prv.rv;
+							if (frameSet != nullptr)
+								frameSet->sequence.emplace_back(frameSet->sequence[it->second]);
+							return;
+						}
+
 						// create the texture
 						ok = Sprite::CreateTextureFromBitmapStatic(bmi, dibits, leh, _T("Sprite::SWFLoaderState::CreateAnimFrame"), &af->tv);
+						if (ok)
+							distinctFrames.emplace(hash, animFrames.size() - 1);
+
+						// Add the image to the frame set.  If the set gets too big,
+						// give up on caching this file.
+						if (ok && frameSet != nullptr)
+						{
+							if ((frameSetBytes += nBytes) > TextureCache::maxFrameSetBytes)
+								frameSet.reset();
+							else
+							{
+								frameSet->sequence.emplace_back(static_cast<UINT>(frameSet->images.size()));
+								auto &img = frameSet->images.emplace_back(new BYTE[nBytes]);
+								memcpy(img.get(), dibits, nBytes);
+							}
+						}
 					}
 				});
 
+				// if rendering failed, don't cache the incomplete frame set
+				if (!ok)
+					frameSet.reset();
+
 				// stop if we're at EOF
 				if (loader->parser->AtEof())
 					break;
 
-				// load the next frame from the SWF file
+				// stop if the sprite has abandoned the load
+				if (ctx->loadContext->cancelled)
+					return 0;
+
+				// load the next frame from the SWF file; if that fails, we
+				// don't have the complete animation, so don't cache it
 				if (!loader->parser->ParseFrame(leh))
+				{
+					frameSet.reset();
 					break;
+				}
 			}
 
 			// we're done with the parser - free it up, since it's holding
 			// the whole SWF file in memory
 			loader->parser.reset();
 
+			// save the frames in the texture cache, unless the sprite has
+			// abandoned the load (in which case we might not have all of
+			// the frames)
+			if (frameSet != nullptr && !ctx->loadContext->cancelled)
+				TextureCache::AddFrames(ctx->filename.c_str(), ctx->pixSize, frameSet.release());
+
 			// initialize the animation
 			ctx->loadContext->curAnimFrame = 0;
 			ctx->loadContext->animation.reset(loader.release());
@@ -297,16 +874,13 @@ bool Sprite::LoadSWF(const WCHAR *filename, POINTF normalizedSize, SIZE pixSize,
 		if (!CreateMesh(normalizedSize, eh, MsgFmt(_T("file \"%ws\""), filename)))
 			return false;
 
-		// kick off the loader thread
-		DWORD tid;
-		HandleHolder hThread(CreateThread(0, 0, ThreadMain, ctx.get(), 0, &tid));
-
-		// if the thread startup succeeded, release the context object to the thread;
-		// otherwise try doing the work inline
-		if (hThread != nullptr)
+		// Queue the load on the loader pool.  If that succeeded, release the
+		// context object to the task; otherwise do the work inline.  Either
+		// way, the thread routine takes ownership of the context.
+		if (LoaderPool::Submit([ThreadMain, p = ctx.get()]() { ThreadMain(p); }, loadPriority))
 			ctx.release();
 		else
-			ThreadMain(ctx.get());
+			ThreadMain(ctx.release());
 
 		// success
 		return true;
@@ -368,52 +942,84 @@ void Sprite::SWFLoaderState::DecodeNext(LoadContext *)
 }
 
 // Load a PNG, with animation support
-bool Sprite::LoadAPNG(const WCHAR *filename, POINTF normalizedSize, SIZE pixSize, ErrorHandler &eh)
+bool Sprite::LoadAPNG(const WCHAR *filename, MappedFile *view, POINTF normalizedSize, SIZE pixSize, ErrorHandler &eh)
 {
 	// Try interpreting it as an animated PNG through the incremental
 	// loader context.  If that succeeds, the loader context will be
 	// set up to load frames on demand.  If not, we'll simply fall back
 	// on the generic WIC loader, to attempt to load the file as a
 	// contentional single-frame PNG or some other image type.
+	//
+	// If the animation is too big to keep all of its frames, play it
+	// in streaming mode.  In that case, the first frame goes into the
+	// sprite's main texture, and the loader becomes the frame source
+	// for the stream, so that the stream picks up at the second frame.
 	std::unique_ptr<APNGLoaderState> loader(new APNGLoaderState());
-	if (loader->Init(this, filename, normalizedSize, pixSize))
+	bool ok = loader->Init(view);
+	bool streaming = ok && IsStreamedAnimation(loader->rcFull.right, loader->rcFull.bottom, loader->acTL.numFrames);
+	if (ok)
+		ok = streaming ? loader->CreateTexture(D3D11_USAGE_DEFAULT, &loadContext->tv) : loader->CreateAnimFrame(loadContext);
+
+	if (ok)
 	{
 		// create the mesh
 		if (!CreateMesh(normalizedSize, eh, MsgFmt(_T("file \"%ws\""), filename)))
 			return false;
 
-		// transfer ownership of the loader to the Sprite
-		loadContext->animation.reset(loader.release());
-
 		// initialize the animation
 		animRunning = true;
 		loadContext->curAnimFrame = 0;
-		loadContext->curAnimFrameEndTime = GetTickCount64() + loadContext->animFrames[0]->dt;
+		loadContext->curAnimFrameEndTime = GetTickCount64() + loader->GetFrameTime();
+
+		if (streaming)
+		{
+			// set up the stream, with the loader as the initial source
+			LogFile::Get()->Write(LogFile::MediaFileLogging, _T("Animated PNG %ws: %u frames, streaming playback\n"),
+				filename, loader->acTL.numFrames);
+			loader->curFrameDelivered = true;
+			RefPtr<AnimStream> stream(new AnimStream(loader.release(), [fname = WSTRING(filename)]() -> AnimSource*
+			{
+				std::unique_ptr<APNGLoaderState> src(new APNGLoaderState());
+				return src->Init(fname.c_str()) ? src.release() : nullptr;
+			}));
+			loadContext->animation.reset(new StreamingAnimation(stream));
+			stream->Refill();
+		}
+		else
+		{
+			// transfer ownership of the loader to the Sprite
+			loadContext->animation.reset(loader.release());
+		}
 
 		// success
 		return true;
 	}
 	else
 	{
-		// It's not an animated PNG - use the basic WIC loader.
-		// Explicitly discard the APNG loader state first, to make sure
-		// we don't have an open handle to the file that could conflict
-		// with the WIC loader opening it.
+		// It's not an animated PNG - use the basic WIC loader, which can
+		// decode it from the same mapped view.
 		loader.reset();
-		return LoadWICTexture(filename, normalizedSize, eh);
+		return LoadWICTexture(filename, normalizedSize, pixSize, eh, view);
 	}
 }
 
 // Initialize the Animated PNG incremental loader
-bool Sprite::APNGLoaderState::Init(Sprite *sprite, const WCHAR *filename, POINTF normalizedSize, SIZE pixSize)
+bool Sprite::APNGLoaderState::Init(const WCHAR *filename)
 {
-	// open the file
-	if (_tfopen_s(&fp, filename, _T("rb")) != 0)
-		return false;
+	// map the file
+	RefPtr<MappedFile> view(new MappedFile());
+	return view->Open(filename) && Init(view);
+}
+
+bool Sprite::APNGLoaderState::Init(MappedFile *view)
+{
+	// start reading at the beginning of the file
+	this->view = view;
+	pos = 0;
 
 	// Check that it's a PNG; if not, fail
 	BYTE sig[8];
-	if (fread(sig, 1, 8, fp) != 8 || png_sig_cmp(sig, 0, 8) != 0)
+	if (!Read(sig, 8) || png_sig_cmp(sig, 0, 8) != 0)
 		return false;
 
 	// Read the IHDR chunk; if it's not an IHDR, fail
@@ -437,14 +1043,23 @@ bool Sprite::APNGLoaderState::Init(Sprite *sprite, const WCHAR *filename, POINTF
 	if (!ReadThroughNextFrame() || !isAnimated)
 		return false;
 
-	// Create first snimation frame
-	if (!CreateAnimFrame(sprite->loadContext))
-		return false;
+	// decode the rest of the frames in parallel, if possible
+	StartParallelDecode();
 
 	// success
 	return true;
 }
 
+Sprite::APNGLoaderState::~APNGLoaderState()
+{
+	// tell any frame jobs still in the loader pool queue to skip the work
+	if (decodeInfo != nullptr)
+		decodeInfo->cancelled = true;
+
+	// tear down the serial decoder, if it's active
+	EndProcessing();
+}
+
 void Sprite::APNGLoaderState::DecodeNext(LoadContext *ctx)
 {
 	// read through the next frame
@@ -452,43 +1067,49 @@ void Sprite::APNGLoaderState::DecodeNext(LoadContext *ctx)
 		CreateAnimFrame(ctx);
 }
 
-bool Sprite::APNGLoaderState::CreateAnimFrame(LoadContext *ctx)
+bool Sprite::APNGLoaderState::DecodeNext(StreamFrame &frame)
 {
+	// Read through the next frame, unless the current frame hasn't been
+	// delivered yet, which is the case for the first frame of a freshly
+	// initialized source.
+	if (curFrameDelivered && (eof || !ReadThroughNextFrame()))
+		return false;
+
 	// make sure there's a current frame
+	curFrameDelivered = true;
 	if (frameCur.data == nullptr)
 		return false;
 
-	// set up the D3D texture descriptor
-	D3D11_TEXTURE2D_DESC txd = CD3D11_TEXTURE2D_DESC(
-		DXGI_FORMAT_R8G8B8A8_UNORM, frameCur.width, frameCur.height, 1, 1,
-		D3D11_BIND_SHADER_RESOURCE, D3D11_USAGE_DYNAMIC, D3D11_CPU_ACCESS_WRITE,
-		1, 0, 0);
-
-	// set up the subresource descriptor
-	D3D11_SUBRESOURCE_DATA srd;
-	ZeroMemory(&srd, sizeof(srd));
-	srd.pSysMem = frameCur.data.get();
-	srd.SysMemPitch = frameCur.width * 4;
-	srd.SysMemSlicePitch = srd.SysMemPitch * frameCur.height;
-
-	// set up the shader resource view
-	D3D11_SHADER_RESOURCE_VIEW_DESC svd;
-	svd.Format = txd.Format;
-	svd.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2D;
-	svd.Texture2D.MipLevels = txd.MipLevels;
-	svd.Texture2D.MostDetailedMip = 0;
+	// copy it into the stream frame
+	UINT rowPitch = frameCur.width * 4;
+	frame.pixels.reset(new (std::nothrow) BYTE[rowPitch * frameCur.height]);
+	if (frame.pixels == nullptr)
+		return false;
 
-	// add an animation frame
-	auto af = ctx->animFrames.emplace_back(new AnimFrame()).get();
+	memcpy(frame.pixels.get(), frameCur.data.get(), rowPitch * frameCur.height);
+	frame.rowPitch = rowPitch;
+	frame.dt = GetFrameTime();
+	return true;
+}
 
+DWORD Sprite::APNGLoaderState::GetFrameTime() const
+{
 	// Figure the display time.  APNG expresses the time in seconds,
 	// as a fraction (numerator divided by denominator) of two 16-bit.
 	// ints.  If the denominator is 0, the implied denominator is 100.
 	// Refigure it as a number of milliseconds.
-	af->dt = static_cast<DWORD>((frameCur.delayNum * 1000) / (frameCur.delayDen == 0 ? 100 : frameCur.delayDen));
+	return static_cast<DWORD>((frameCur.delayNum * 1000) / (frameCur.delayDen == 0 ? 100 : frameCur.delayDen));
+}
+
+bool Sprite::APNGLoaderState::CreateTexture(D3D11_USAGE usage, TextureAndView *tv)
+{
+	// make sure there's a current frame
+	if (frameCur.data == nullptr)
+		return false;
 
 	// create the texture
-	HRESULT hr = D3D::Get()->CreateTexture2D(&txd, &srd, &svd, &af->tv.rv, &af->tv.texture);
+	HRESULT hr = Sprite::CreateFrameTexture(DXGI_FORMAT_R8G8B8A8_UNORM, frameCur.width, frameCur.height,
+		frameCur.data.get(), frameCur.width * 4, usage, tv);
 	if (!SUCCEEDED(hr))
 	{
 		// log the error
@@ -496,10 +1117,7 @@ bool Sprite::APNGLoaderState::CreateAnimFrame(LoadContext *ctx)
 		LogFileErrorHandler eh;
 		eh.SysError(
 			MsgFmt(IDS_ERR_IMGCREATE, _T("Rendering Animated PNG frame")),
-			MsgFmt(_T("Sprite::APNGLoaderState::CreateAnimFrame, CreateTexture2D failed, HRESULT %lx: %s"), (long)hr, winMsg.Get()));
-
-		// discard the aborted frame
-		ctx->animFrames.pop_back();
+			MsgFmt(_T("Sprite::APNGLoaderState::CreateTexture, CreateTexture2D failed, HRESULT %lx: %s"), (long)hr, winMsg.Get()));
 
 		// return failure
 		return false;
@@ -509,6 +1127,23 @@ bool Sprite::APNGLoaderState::CreateAnimFrame(LoadContext *ctx)
 	return true;
 }
 
+bool Sprite::APNGLoaderState::CreateAnimFrame(LoadContext *ctx)
+{
+	// add an animation frame
+	auto af = ctx->animFrames.emplace_back(new AnimFrame()).get();
+	af->dt = GetFrameTime();
+
+	// create the texture; discard the frame if that fails
+	if (!CreateTexture(D3D11_USAGE_DYNAMIC, &af->tv))
+	{
+		ctx->animFrames.pop_back();
+		return false;
+	}
+
+	// success
+	return true;
+}
+
 static inline bool IsValidPngIdByte(DWORD b)
 {
 	return b >= 65 && b <= 122 && (b <= 90 || b >= 97);
@@ -546,8 +1181,12 @@ bool Sprite::APNGLoaderState::ReadThroughNextFrame()
 		break;
 	}
 
+	// if the frames are being decoded in parallel, take the next one from its job
+	if (decodeInfo != nullptr)
+		return ReadNextParallelFrame();
+
 	// process the file until finishing the next frame or reaching EOF
-	while (!feof(fp)) 
+	while (pos < view->GetSize()) 
 	{
 		// read the next chunk
 		Chunk chunk;
@@ -766,17 +1405,331 @@ bool Sprite::APNGLoaderState::ReadThroughNextFrame()
 	return false;
 }
 
-// PNG chunk header reader.  This reads just the chunk length and ID.
-// Returns the ID.
-DWORD Sprite::APNGLoaderState::ReadChunkSizeAndID(Chunk &chunk)
+// Shared decoding information for the parallel frame jobs.  This is
+// immutable once the jobs start, except for the cancellation flag.
+struct Sprite::APNGLoaderState::DecodeInfo
 {
-	// read the chunk length
-	if (fread(chunk.header, 1, 8, fp) == 8)
-	{
-		// save the size
-		chunk.size = png_get_uint_32(chunk.header) + 12;
+	// the mapped file
+	RefPtr<MappedFile> view;
 
-		// return the ID
+	// IHDR chunk, and the full image size
+	BYTE IHDR[25];
+	UINT fullWidth, fullHeight;
+
+	// pre-IDAT info chunks (PLTE, tRNS, etc), concatenated
+	std::vector<BYTE> infoData;
+
+	// set when the loader is destroyed, to skip jobs that haven't started
+	volatile bool cancelled = false;
+};
+
+// Parallel frame decoding job
+struct Sprite::APNGLoaderState::FrameJob
+{
+	FrameJob() : hDone(CreateEvent(NULL, TRUE, FALSE, NULL)) { }
+
+	// Frame control data.  rawWidth and rawHeight are the frame size
+	// in the fcTL, which is the size of the compressed image; the
+	// composition rectangle is clipped to the full frame.
+	UINT rawWidth, rawHeight;
+	UINT x, y, width, height;
+	UINT delayNum, delayDen;
+	BYTE dop, bop;
+
+	// offset and size of each fdAT chunk holding the frame's data
+	struct DataChunk
+	{
+		long ofs;
+		UINT size;
+	};
+	std::vector<DataChunk> chunks;
+
+	// Job state.  Whoever moves the state from Pending to Running does
+	// the work - either a loader pool thread or the frame consumer.
+	static const LONG Pending = 0;
+	static const LONG Running = 1;
+	volatile LONG state = Pending;
+
+	// completion event, and the result
+	HandleHolder hDone;
+	bool ok = false;
+
+	// decoded frame, at the raw frame size
+	APNGFrame frame;
+};
+
+void Sprite::APNGLoaderState::StartParallelDecode()
+{
+	// Only bother if there's a pool to share the work with, and we're
+	// positioned at the start of a frame's data: the serial reader has
+	// just read the next frame's fcTL, and set up libpng for it.
+	if (eof || !hasIDAT || png == nullptr || LoaderPool::GetThreadCount() < 2)
+		return;
+
+	// Index the rest of the file's frames.  The first job is for the
+	// frame whose fcTL we've already read.
+	std::vector<std::shared_ptr<FrameJob>> jobs;
+	auto NewJob = [this](UINT rawWidth, UINT rawHeight, UINT x, UINT y, UINT delayNum, UINT delayDen, BYTE dop, BYTE bop)
+	{
+		auto job = std::make_shared<FrameJob>();
+		job->rawWidth = rawWidth;
+		job->rawHeight = rawHeight;
+
+		// clip the frame rectangle to the full frame, as the serial reader does
+		job->x = min(x, static_cast<UINT>(rcFull.right));
+		job->y = min(y, static_cast<UINT>(rcFull.bottom));
+		job->width = min(rawWidth, static_cast<UINT>(rcFull.right) - job->x);
+		job->height = min(rawHeight, static_cast<UINT>(rcFull.bottom) - job->y);
+		job->delayNum = delayNum;
+		job->delayDen = delayDen;
+		job->dop = dop;
+		job->bop = bop;
+		return job;
+	};
+	auto job = NewJob(png_get_uint_32(IHDR.data.get() + 8), png_get_uint_32(IHDR.data.get() + 12),
+		fcTL.x, fcTL.y, fcTL.delayNum, fcTL.delayDen, fcTL.dop, fcTL.bop);
+
+	// Scan the chunk headers.  A frame ends at the next fcTL or at the
+	// IEND; frames without any data are dropped, as in the serial reader.
+	// If the file is truncated, the frame in progress is dropped.
+	const BYTE *p = view->GetData();
+	long fileSize = view->GetSize();
+	for (long ofs = pos; ofs + 8 <= fileSize; )
+	{
+		// get the chunk size and ID, and make sure the whole chunk is present
+		INT64 chunkSize = static_cast<INT64>(png_get_uint_32(p + ofs)) + 12;
+		DWORD id = png_get_uint_32(p + ofs + 4);
+		if (ofs + chunkSize > fileSize)
+			break;
+
+		if (id == ID_fdAT && chunkSize >= 16)
+		{
+			// frame data - add it to the current frame
+			job->chunks.push_back({ ofs, static_cast<UINT>(chunkSize) });
+		}
+		else if (id == ID_fcTL || id == ID_IEND)
+		{
+			// end of the current frame
+			if (job->chunks.size() != 0)
+				jobs.emplace_back(job);
+
+			// stop at the IEND
+			if (id == ID_IEND)
+				break;
+
+			// start the next frame
+			if (chunkSize < 38)
+				break;
+			const BYTE *c = p + ofs;
+			job = NewJob(png_get_uint_32(c + 12), png_get_uint_32(c + 16), png_get_uint_32(c + 20), png_get_uint_32(c + 24),
+				png_get_uint_16(c + 28), png_get_uint_16(c + 30), c[32], c[33]);
+		}
+
+		// on to the next chunk
+		ofs += static_cast<long>(chunkSize);
+	}
+
+	// if there's only one frame left, it's not worth the trouble
+	if (jobs.size() < 2)
+		return;
+
+	// Set up the shared decoding information.  Our IHDR has been patched
+	// with the current frame size, but each job patches its own copy with
+	// its own frame size anyway.
+	auto info = std::make_shared<DecodeInfo>();
+	info->view = view;
+	memcpy(info->IHDR, IHDR.data.get(), 25);
+	info->fullWidth = rcFull.right;
+	info->fullHeight = rcFull.bottom;
+	for (auto &chunk : infoChunks)
+		info->infoData.insert(info->infoData.end(), chunk.data.get(), chunk.data.get() + chunk.size);
+
+	// we're done with the serial decoder
+	png_destroy_read_struct(&png, &pInfo, nullptr);
+	frameRaw.data.reset();
+	frameRaw.rows.reset();
+
+	// switch to parallel decoding, and start the first jobs
+	decodeInfo = info;
+	frameJobs = std::move(jobs);
+	QueueFrameJobs();
+}
+
+void Sprite::APNGLoaderState::QueueFrameJobs()
+{
+	// Keep one job per pool thread running ahead of the consumer.  That
+	// keeps every worker busy without holding too many decoded frames in
+	// memory at once.
+	size_t limit = min(frameJobs.size(), nextJob + LoaderPool::GetThreadCount());
+	for (; nextJobToQueue < limit; ++nextJobToQueue)
+	{
+		// If the queue is full, leave the job pending; the consumer will
+		// run it inline when it gets there.
+		std::shared_ptr<FrameJob> job = frameJobs[nextJobToQueue];
+		std::shared_ptr<DecodeInfo> info = decodeInfo;
+		LoaderPool::Submit([job, info]()
+		{
+			if (InterlockedCompareExchange(&job->state, FrameJob::Running, FrameJob::Pending) == FrameJob::Pending)
+				RunFrameJob(info.get(), job.get());
+		});
+	}
+}
+
+bool Sprite::APNGLoaderState::ReadNextParallelFrame()
+{
+	// stop if we've consumed all of the frames
+	if (nextJob >= frameJobs.size())
+	{
+		eof = true;
+		return false;
+	}
+
+	// take the next job, and keep the pool busy with the following ones
+	std::shared_ptr<FrameJob> job = std::move(frameJobs[nextJob++]);
+	QueueFrameJobs();
+
+	// run the job here if no one has started it yet, otherwise wait for it
+	if (InterlockedCompareExchange(&job->state, FrameJob::Running, FrameJob::Pending) == FrameJob::Pending)
+		RunFrameJob(decodeInfo.get(), job.get());
+	else
+		WaitForSingleObject(job->hDone, INFINITE);
+
+	// if the decoding failed, end the animation here, as the serial reader does
+	if (!job->ok)
+	{
+		eof = true;
+		return false;
+	}
+
+	// If the frame's disposal op is PREVIOUS, save the current frame
+	// before composing the new one, so that we can revert it afterwards
+	if (job->dop == DOP_PREV)
+		framePrev.Copy(frameCur);
+
+	// compose the frame
+	ComposeFrame(frameCur.rows.get(), job->frame.rows.get(), job->bop, job->x, job->y, job->width, job->height);
+	frameCur.delayNum = job->delayNum;
+	frameCur.delayDen = job->delayDen;
+
+	// remember the disposal settings
+	disposal.dop = job->dop;
+	disposal.x = job->x;
+	disposal.y = job->y;
+	disposal.width = job->width;
+	disposal.height = job->height;
+
+	// if that was the last frame, we're at the end of the file
+	if (nextJob >= frameJobs.size())
+		eof = true;
+
+	// the frame is ready
+	return true;
+}
+
+void Sprite::APNGLoaderState::RunFrameJob(const DecodeInfo *info, FrameJob *job)
+{
+	job->ok = !info->cancelled && DecodeFrameJob(info, job);
+	SetEvent(job->hDone);
+}
+
+bool Sprite::APNGLoaderState::DecodeFrameJob(const DecodeInfo *info, FrameJob *job)
+{
+	// The frame can't be larger than the full image.  (The serial reader
+	// would overrun its frame buffer in this case, so it's not a valid
+	// file in any case.)
+	if (job->rawWidth == 0 || job->rawHeight == 0 || job->rawWidth > info->fullWidth || job->rawHeight > info->fullHeight)
+		return false;
+
+	// allocate the raw frame buffer at the frame size
+	job->frame.Init(job->rawWidth, job->rawHeight, job->delayNum, job->delayDen);
+
+	// patch a copy of the IHDR with the frame size
+	BYTE ihdr[25];
+	memcpy(ihdr, info->IHDR, 25);
+	png_save_uint_32(ihdr + 8, job->rawWidth);
+	png_save_uint_32(ihdr + 12, job->rawHeight);
+
+	// create the libpng reading context and info struct
+	png_structp png = png_create_read_struct(PNG_LIBPNG_VER_STRING, nullptr, nullptr, nullptr);
+	png_infop pInfo = png != nullptr ? png_create_info_struct(png) : nullptr;
+	if (pInfo == nullptr)
+	{
+		png_destroy_read_struct(&png, nullptr, nullptr);
+		return false;
+	}
+
+	// set up libpng's C-setjmp-style exception handler
+	if (setjmp(png_jmpbuf(png)))
+	{
+		png_destroy_read_struct(&png, &pInfo, nullptr);
+		return false;
+	}
+
+	// initialize reading, as in StartProcessing()
+	png_set_crc_action(png, PNG_CRC_QUIET_USE, PNG_CRC_QUIET_USE);
+	png_set_progressive_read_fn(png, &job->frame, &InfoCallback, &RowCallback, nullptr);
+
+	// process the PNG file header, the IHDR, and the shared info chunks
+	BYTE header[8] = { 137, 80, 78, 71, 13, 10, 26, 10 };
+	png_process_data(png, pInfo, header, 8);
+	png_process_data(png, pInfo, ihdr, 25);
+	if (info->infoData.size() != 0)
+		png_process_data(png, pInfo, const_cast<BYTE*>(info->infoData.data()), info->infoData.size());
+
+	// Process the fdAT chunks as IDAT chunks.  An fdAT is an IDAT with a
+	// four-byte sequence number inserted after the ID, so feed libpng an
+	// IDAT header 4 bytes shorter, then the remainder of the fdAT after
+	// the sequence number, directly from the mapped file.
+	const BYTE *fileData = info->view->GetData();
+	for (size_t i = 0; i < job->chunks.size(); ++i)
+	{
+		const FrameJob::DataChunk &c = job->chunks[i];
+		BYTE idat[8];
+		png_save_uint_32(idat, c.size - 16);
+		memcpy(idat + 4, "IDAT", 4);
+		png_process_data(png, pInfo, idat, 8);
+		png_process_data(png, pInfo, const_cast<BYTE*>(fileData + c.ofs + 12), c.size - 12);
+	}
+
+	// process the image end chunk
+	BYTE endChunk[12] = { 0, 0, 0, 0, 73, 69, 78, 68, 174, 66, 96, 130 };
+	png_process_data(png, pInfo, endChunk, 12);
+
+	// tear down the libpng context objects
+	png_destroy_read_struct(&png, &pInfo, nullptr);
+
+	// success
+	return true;
+}
+
+// Read from the mapped file
+bool Sprite::APNGLoaderState::Read(BYTE *buf, size_t len)
+{
+	// if the read would pass the end of the file, stop at the end and fail
+	size_t avail = static_cast<size_t>(view->GetSize() - pos);
+	if (len > avail)
+	{
+		pos = view->GetSize();
+		return false;
+	}
+
+	// copy the data and advance the read position
+	memcpy(buf, view->GetData() + pos, len);
+	pos += static_cast<long>(len);
+	return true;
+}
+
+// PNG chunk header reader.  This reads just the chunk length and ID.
+// Returns the ID.
+DWORD Sprite::APNGLoaderState::ReadChunkSizeAndID(Chunk &chunk)
+{
+	// read the chunk length
+	if (Read(chunk.header, 8))
+	{
+		// save the size
+		chunk.size = png_get_uint_32(chunk.header) + 12;
+
+		// return the ID
 		return png_get_uint_32(chunk.header + 4);
 	}
 
@@ -794,21 +1747,21 @@ void Sprite::APNGLoaderState::ReadChunkContents(Chunk &chunk)
 	memcpy(chunk.data.get(), chunk.header, 8);
 	
 	// read the rest of the chunk
-	fread(chunk.data.get() + 8, 1, chunk.size - 8, fp);
+	Read(chunk.data.get() + 8, chunk.size - 8);
 }
 
 // Skip the rest of a chunk
 void Sprite::APNGLoaderState::SkipChunkContents(Chunk &chunk)
 {
 	// skip the rest of the chunk after the 8 header bytes we've already read
-	fseek(fp, chunk.size - 8, SEEK_CUR);
+	pos = static_cast<long>(min(static_cast<INT64>(pos) + chunk.size - 8, static_cast<INT64>(view->GetSize())));
 }
 
 // PNG chunk reader
 DWORD Sprite::APNGLoaderState::ReadChunk(Chunk &chunk)
 {
 	// read the chunk length
-	if (fread(chunk.header, 1, 4, fp) == 4)
+	if (Read(chunk.header, 4))
 	{
 		// set up the Chunk descriptor and allocate space for the contents
 		chunk.size = png_get_uint_32(chunk.header) + 12;
@@ -818,7 +1771,7 @@ DWORD Sprite::APNGLoaderState::ReadChunk(Chunk &chunk)
 		memcpy(chunk.data.get(), chunk.header, 4);
 
 		// read the remainder
-		if (fread(chunk.data.get() + 4, 1, chunk.size - 4, fp) == chunk.size - 4)
+		if (Read(chunk.data.get() + 4, chunk.size - 4))
 			return png_get_uint_32(chunk.data.get() + 4);
 	}
 
@@ -1050,7 +2003,7 @@ static void BlendGIFRect(const Image &composed, const Image &raw, const RECT &de
 }
 
 // Load a GIF, with animation support
-bool Sprite::LoadGIF(const WCHAR *filename, POINTF normalizedSize, SIZE pixSize, ErrorHandler &eh)
+bool Sprite::LoadGIF(const WCHAR *filename, MappedFile *view, POINTF normalizedSize, SIZE pixSize, ErrorHandler &eh)
 {
 	// system errors
 	HRESULT hr = E_FAIL;
@@ -1068,9 +2021,12 @@ bool Sprite::LoadGIF(const WCHAR *filename, POINTF normalizedSize, SIZE pixSize,
 	if (pWIC == nullptr)
 		return (hr = E_NOINTERFACE), SysErr("Unable to get WIC factory");
 
-	// create the image decoder
+	// create the image decoder, reading from the mapped file
+	RefPtr<IWICStream> stream;
 	RefPtr<IWICBitmapDecoder> decoder;
-	if (FAILED(hr = pWIC->CreateDecoderFromFilename(filename, nullptr, GENERIC_READ, WICDecodeMetadataCacheOnDemand, &decoder)))
+	if (FAILED(hr = CreateViewStream(pWIC, view, &stream)))
+		return SysErr("Unable to create stream on file data");
+	if (FAILED(hr = pWIC->CreateDecoderFromStream(stream, nullptr, WICDecodeMetadataCacheOnDemand, &decoder)))
 		return SysErr("Unable to create bitmap decoder");
 
 	// read the frame count
@@ -1081,7 +2037,7 @@ bool Sprite::LoadGIF(const WCHAR *filename, POINTF normalizedSize, SIZE pixSize,
 	// If the frame count is zero or one, there's no need to do anything
 	// fancy for animation support.  We can just use the regular WIC loader.
 	if (nFrames <= 1)
-		return LoadWICTexture(filename, normalizedSize, eh);
+		return LoadWICTexture(filename, normalizedSize, pixSize, eh, view);
 
 	// get the file format
 	GUID containerFormat;
@@ -1091,7 +2047,7 @@ bool Sprite::LoadGIF(const WCHAR *filename, POINTF normalizedSize, SIZE pixSize,
 	// verify that it's a GIF file - if it's not, load it using
 	// the basic WIC image file loader instead
 	if (memcmp(&containerFormat, &GUID_ContainerFormatGif, sizeof(GUID)) != 0)
-		return LoadWICTexture(filename, normalizedSize, eh);
+		return LoadWICTexture(filename, normalizedSize, pixSize, eh, view);
 
 	// get the metadata reader
 	RefPtr<IWICMetadataQueryReader> meta;
@@ -1153,39 +2109,194 @@ bool Sprite::LoadGIF(const WCHAR *filename, POINTF normalizedSize, SIZE pixSize,
 
 	// Set up the frame decoder state
 	std::unique_ptr<GIFLoaderState> loader(new GIFLoaderState());
-	loader->Init(pWIC, decoder, width, height, nFrames, bgColor, filename);
+	loader->Init(pWIC, decoder, view, width, height, nFrames, bgColor, filename);
 
 	// create the mesh
 	if (!CreateMesh(normalizedSize, eh, MsgFmt(_T("file \"%ws\""), filename)))
 		return false;
 
-	// decode the first frame; if that doesn't leave us with one frame in the 
-	// frame list, the decoding failed, so fail the whole load
-	loader->DecodeFrame(loadContext);
-	if (loadContext->animFrames.size() == 0)
-		return false;
+	// If the animation is too big to keep all of its frames, play it in
+	// streaming mode.  Otherwise, decode the frames incrementally into the
+	// frame list as playback proceeds.
+	if (IsStreamedAnimation(width, height, nFrames))
+	{
+		// Decode the first frame into the sprite's main texture.  The
+		// renderer copies each later frame into the same texture as it
+		// comes up, so it needs default usage, for UpdateSubresource().
+		LONG delay;
+		if (!loader->ComposeNextFrame(delay))
+			return false;
+
+		auto img = loader->lastImage->GetImage(0, 0, 0);
+		if (FAILED(hr = CreateFrameTexture(DXGI_FORMAT_B8G8R8A8_UNORM,
+			static_cast<UINT>(img->width), static_cast<UINT>(img->height),
+			img->pixels, static_cast<UINT>(img->rowPitch), D3D11_USAGE_DEFAULT, &loadContext->tv)))
+			return SysErr("Unable to create animation texture");
 
-	// Initialize the animation
-	animRunning = true;
-	loadContext->curAnimFrame = 0;
+		// We're done with the UI thread's decoder.  The stream sources
+		// open their own decoders on the loader pool.
+		loader.reset();
+
+		// Set up the stream.  The initial source skips the first frame,
+		// since we've already displayed it; the sources for later passes
+		// start at the first frame.
+		LogFile::Get()->Write(LogFile::MediaFileLogging, _T("Animated GIF %ws: %u frames, streaming playback\n"),
+			filename, nFrames);
+		auto NewSource = [width, height, nFrames, bgColor, fname = WSTRING(filename)](UINT skipFrames)
+		{
+			auto src = new GIFLoaderState();
+			src->Init(nullptr, nullptr, nullptr, width, height, nFrames, bgColor, fname.c_str());
+			src->skipFrames = skipFrames;
+			return src;
+		};
+		RefPtr<AnimStream> stream(new AnimStream(NewSource(1), [NewSource]() -> AnimSource* { return NewSource(0); }));
+		loadContext->animation.reset(new StreamingAnimation(stream));
+		stream->Refill();
+
+		// initialize the animation
+		animRunning = true;
+		loadContext->curAnimFrame = 0;
+		loadContext->curAnimFrameEndTime = GetTickCount64() + delay;
+	}
+	else
+	{
+		// decode the first frame; if that doesn't leave us with one frame in the 
+		// frame list, the decoding failed, so fail the whole load
+		loader->DecodeFrame(loadContext);
+		if (loadContext->animFrames.size() == 0)
+			return false;
+
+		// Initialize the animation
+		animRunning = true;
+		loadContext->curAnimFrame = 0;
+
+		// transfer ownership of the loader to the load context
+		loadContext->animation.reset(loader.release());
+	}
 
 	// allocate a media player cookie, so that we can generate AVPXxx messages
 	// related to the playback
 	animCookie = AudioVideoPlayer::AllocMediaCookie();
 
-	// transfer ownership of the loader to the load context
-	loadContext->animation.reset(loader.release());
+	// success
+	return true;
+}
+
+bool Sprite::GIFLoaderState::Open()
+{
+	// get the WIC factory
+	bool isWIC2;
+	if ((pWIC = GetWICFactory(isWIC2)) == nullptr)
+		return false;
+
+	// map the file, if we don't already have a view
+	if (view == nullptr)
+	{
+		RefPtr<MappedFile> v(new MappedFile());
+		if (v->Open(filename.c_str()))
+			view = v;
+	}
+
+	// create the image decoder, reading from the view
+	HRESULT hr;
+	RefPtr<IWICStream> stream;
+	if (view == nullptr)
+		hr = HRESULT_FROM_WIN32(ERROR_OPEN_FAILED);
+	else if (SUCCEEDED(hr = CreateViewStream(pWIC, view, &stream)))
+		hr = pWIC->CreateDecoderFromStream(stream, nullptr, WICDecodeMetadataCacheOnDemand, &decoder);
+	if (FAILED(hr))
+	{
+		LogFileErrorHandler eh;
+		WindowsErrorMessage sysErr(hr);
+		eh.SysError(MsgFmt(IDS_ERR_IMGLOAD, filename.c_str()),
+			MsgFmt(_T("GIF frame decoder: Unable to create bitmap decoder (HRESULT %lx: %s)"), hr, sysErr.Get()));
+		Clear();
+		return false;
+	}
 
 	// success
 	return true;
 }
 
+bool Sprite::GIFLoaderState::DecodeNext(StreamFrame &frame)
+{
+	// open the decoder if we haven't already
+	if (decoder == nullptr && (nFrames == 0 || !Open()))
+		return false;
+
+	for (;;)
+	{
+		// stop at the end of the animation
+		if (iFrame >= nFrames || decoder == nullptr)
+			return false;
+
+		// decode the next frame
+		LONG delay;
+		if (!ComposeNextFrame(delay))
+			return false;
+
+		// if we're skipping this frame, go on to the next one
+		if (skipFrames != 0)
+		{
+			--skipFrames;
+			continue;
+		}
+
+		// copy the frame into the stream frame
+		auto img = lastImage->GetImage(0, 0, 0);
+		frame.pixels.reset(new (std::nothrow) BYTE[img->slicePitch]);
+		if (frame.pixels == nullptr)
+			return false;
+
+		memcpy(frame.pixels.get(), img->pixels, img->slicePitch);
+		frame.rowPitch = static_cast<UINT>(img->rowPitch);
+		frame.dt = static_cast<DWORD>(delay);
+		return true;
+	}
+}
+
 void Sprite::GIFLoaderState::DecodeFrame(LoadContext *ctx)
 {
 	// if we've decoded the last frame, we're done
 	if (iFrame >= nFrames)
 		return;
 
+	// decode the frame
+	LONG delay;
+	if (!ComposeNextFrame(delay))
+		return;
+
+	// Create a D3D texture and shader resource view for the frame
+	{
+		// get the image data
+		auto imageData = lastImage->GetImage(0, 0, 0);
+
+		// create an animation frame
+		auto animFrame = ctx->animFrames.emplace_back(new AnimFrame()).get();
+		animFrame->dt = static_cast<DWORD>(delay);
+
+		// create the texture and resource view
+		HRESULT hr;
+		if (FAILED(hr = CreateFrameTexture(DXGI_FORMAT_B8G8R8A8_UNORM,
+			static_cast<UINT>(imageData->width), static_cast<UINT>(imageData->height),
+			imageData->pixels, static_cast<UINT>(imageData->rowPitch), D3D11_USAGE_DYNAMIC, &animFrame->tv)))
+		{
+			LogFileErrorHandler eh;
+			WindowsErrorMessage sysErr(hr);
+			eh.SysError(MsgFmt(IDS_ERR_IMGLOAD, filename.c_str()),
+				MsgFmt(_T("GIF frame decoder: CreateTexture2D failed (HRESULT %lx: %s)"), hr, sysErr.Get()));
+			Clear();
+			return;
+		}
+	}
+
+	// if we're done, clear resources
+	if (iFrame >= nFrames)
+		Clear();
+}
+
+bool Sprite::GIFLoaderState::ComposeNextFrame(LONG &delay)
+{
 	// log any errors
 	HRESULT hr;
 	auto SysErr = [this, &hr](const CHAR *details)
@@ -1198,19 +2309,20 @@ void Sprite::GIFLoaderState::DecodeFrame(LoadContext *ctx)
 
 		// clear resources to stop further decoding
 		Clear();
+		return false;
 	};
 
 	// create a scratch image frame
-	std::unique_ptr<ScratchImage> image(new (std::nothrow) ScratchImage);
+	std::shared_ptr<ScratchImage> image(new (std::nothrow) ScratchImage);
 	if (image == nullptr)
 		return (hr = E_OUTOFMEMORY), SysErr("Unable to allocate frame memory");
 
 	// initialize the frame, using the previous frame if we have one,
 	// otherwise a blank background
-	if (disposal == DM_PREVIOUS)
-		hr = image->InitializeFromImage(*frames[prevFrame]->GetImage(0, 0, 0));
-	else if (iFrame > 0)
-		hr = image->InitializeFromImage(*frames[iFrame - 1]->GetImage(0, 0, 0));
+	if (disposal == DM_PREVIOUS && prevImage != nullptr)
+		hr = image->InitializeFromImage(*prevImage->GetImage(0, 0, 0));
+	else if (iFrame > 0 && lastImage != nullptr)
+		hr = image->InitializeFromImage(*lastImage->GetImage(0, 0, 0));
 	else
 		hr = image->Initialize2D(DXGI_FORMAT_B8G8R8A8_UNORM, rcFull.right, rcFull.bottom, 1, 1);
 
@@ -1245,7 +2357,7 @@ void Sprite::GIFLoaderState::DecodeFrame(LoadContext *ctx)
 	// Try getting the metadata for this frame.  It's not an error
 	// if we can't get the reader, as the frame might not have any
 	// metadata.
-	LONG delay = 0;
+	delay = 0;
 	RefPtr<IWICMetadataQueryReader> meta;
 	if (SUCCEEDED(decodedFrame->GetMetadataQueryReader(&meta)))
 	{
@@ -1322,56 +2434,128 @@ void Sprite::GIFLoaderState::DecodeFrame(LoadContext *ctx)
 		BlendGIFRect(*composedImage, *img, rcSub);
 	}
 
-	// if we're not reverting to the previous frame, this frame
-	// will be the previous frame for the next frame with 
-	// disposal method DM_PREVIOUS
+	// This is now the last frame, for composing the next frame.  If
+	// we're not reverting to the previous frame, this frame will also
+	// be the previous frame for the next frame with disposal method
+	// DM_PREVIOUS.
+	lastImage = image;
 	if (disposal != DM_PREVIOUS)
-		prevFrame = iFrame;
+		prevImage = image;
 
-	// Create a D3D texture and shader resource view for the frame
-	{
-		// get the image data
-		auto imageData = image->GetImage(0, 0, 0);
+	// advance to the next frame
+	++iFrame;
 
-		// create an animation frame
-		auto animFrame = ctx->animFrames.emplace_back(new AnimFrame()).get();
-		animFrame->dt = static_cast<DWORD>(delay);
+	// success
+	return true;
+}
 
-		// set up the D3D texture descriptor
-		D3D11_TEXTURE2D_DESC txd = CD3D11_TEXTURE2D_DESC(
-			DXGI_FORMAT_B8G8R8A8_UNORM,
-			static_cast<UINT>(imageData->width), static_cast<UINT>(imageData->height),
-			1, 1, D3D11_BIND_SHADER_RESOURCE, D3D11_USAGE_DYNAMIC, D3D11_CPU_ACCESS_WRITE,
-			1, 0, 0);
+HRESULT Sprite::CreateFrameTexture(DXGI_FORMAT format, UINT width, UINT height,
+	const void *pixels, UINT rowPitch, D3D11_USAGE usage, TextureAndView *tv)
+{
+	// set up the D3D texture descriptor
+	D3D11_TEXTURE2D_DESC txd = CD3D11_TEXTURE2D_DESC(
+		format, width, height, 1, 1, D3D11_BIND_SHADER_RESOURCE, usage,
+		usage == D3D11_USAGE_DYNAMIC ? D3D11_CPU_ACCESS_WRITE : 0,
+		1, 0, 0);
 
-		// set up the subresource descriptor
-		D3D11_SUBRESOURCE_DATA srd;
-		ZeroMemory(&srd, sizeof(srd));
-		srd.pSysMem = imageData->pixels;
-		srd.SysMemPitch = static_cast<UINT>(imageData->rowPitch);
-		srd.SysMemSlicePitch = static_cast<UINT>(imageData->slicePitch);
+	// set up the subresource descriptor
+	D3D11_SUBRESOURCE_DATA srd;
+	ZeroMemory(&srd, sizeof(srd));
+	srd.pSysMem = pixels;
+	srd.SysMemPitch = rowPitch;
+	srd.SysMemSlicePitch = rowPitch * height;
 
-		// set up the shader resource view
-		D3D11_SHADER_RESOURCE_VIEW_DESC svd;
-		svd.Format = txd.Format;
-		svd.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2D;
-		svd.Texture2D.MipLevels = txd.MipLevels;
-		svd.Texture2D.MostDetailedMip = 0;
+	// set up the shader resource view
+	D3D11_SHADER_RESOURCE_VIEW_DESC svd;
+	svd.Format = txd.Format;
+	svd.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2D;
+	svd.Texture2D.MipLevels = txd.MipLevels;
+	svd.Texture2D.MostDetailedMip = 0;
 
-		// create the texture and resource view
-		if (FAILED(hr = D3D::Get()->CreateTexture2D(&txd, &srd, &svd, &animFrame->tv.rv, &animFrame->tv.texture)))
-			return SysErr("CreateTexture2D failed");
+	// create the texture and resource view
+	return D3D::Get()->CreateTexture2D(&txd, &srd, &svd, &tv->rv, &tv->texture);
+}
+
+std::unique_ptr<Sprite::StreamFrame> Sprite::AnimStream::Pop()
+{
+	CriticalSectionLocker locker(lock);
+	if (frames.size() == 0)
+		return nullptr;
+
+	std::unique_ptr<StreamFrame> frame(frames.front().release());
+	frames.pop_front();
+	return frame;
+}
+
+const Sprite::StreamFrame *Sprite::AnimStream::Peek()
+{
+	CriticalSectionLocker locker(lock);
+	return frames.size() != 0 ? frames.front().get() : nullptr;
+}
+
+void Sprite::AnimStream::Refill()
+{
+	// Only start a task when the queue is down to half full, so that
+	// each task decodes a batch of frames.  (There's nothing to do if
+	// a task is already running, since it'll keep going until the
+	// queue is full.)
+	{
+		CriticalSectionLocker locker(lock);
+		if (decoding || failed || cancelled || frames.size() > aheadCount / 2)
+			return;
+
+		decoding = true;
 	}
 
-	// Add the image to the results, to facilitate composing subsequent frames
-	frames.emplace_back(std::move(image));
+	// Queue the task, adding a reference on its behalf.  If the pool
+	// can't take it, we'll try again on the next render; playback just
+	// stays on the current frame in the meantime.
+	AddRef();
+	if (!LoaderPool::Submit([p = this]() { p->Fill(); p->Release(); }))
+	{
+		{
+			CriticalSectionLocker locker(lock);
+			decoding = false;
+		}
+		Release();
+	}
+}
 
-	// advance to the next frame
-	++iFrame;
+void Sprite::AnimStream::Fill()
+{
+	for (;;)
+	{
+		// stop when the queue is full, or the sprite has discarded the animation
+		{
+			CriticalSectionLocker locker(lock);
+			if (cancelled || frames.size() >= aheadCount)
+			{
+				decoding = false;
+				return;
+			}
+		}
 
-	// if we're done, clear resources
-	if (iFrame >= nFrames)
-		Clear();
+		// Decode the next frame.  At the end of the animation, open a new
+		// source to start over from the first frame.
+		std::unique_ptr<StreamFrame> frame(new StreamFrame());
+		bool ok = source != nullptr && source->DecodeNext(*frame);
+		if (!ok)
+		{
+			source.reset(reopen());
+			ok = source != nullptr && source->DecodeNext(*frame);
+			frame->loopStart = true;
+		}
+
+		// add the frame to the queue, or give up if even a new source failed
+		CriticalSectionLocker locker(lock);
+		if (!ok)
+		{
+			failed = true;
+			decoding = false;
+			return;
+		}
+		frames.emplace_back(std::move(frame));
+	}
 }
 
 bool Sprite::CreateStagingTexture(int pixWidth, int pixHeight, ErrorHandler &eh)
@@ -1393,6 +2577,9 @@ bool Sprite::CreateStagingTexture(int pixWidth, int pixHeight, ErrorHandler &eh)
 		return false;
 	}
 
+	// count it in the texture memory budget
+	TextureBudget::Track(stagingTexture);
+
 	// success
 	return true;
 }
@@ -1413,23 +2600,267 @@ bool Sprite::Load(int pixWidth, int pixHeight, std::function<void(Gdiplus::Graph
 	}, eh, descForErrors);
 }
 
+bool Sprite::LoadD2D(int pixWidth, int pixHeight, std::function<void(ID2D1RenderTarget*)> drawingFunc,
+	ErrorHandler &eh, const TCHAR *descForErrors)
+{
+	// we need the Direct2D factory
+	auto dw = DirectWriteUtils::Get();
+	ID2D1Factory *factory = dw != nullptr ? dw->GetD2DFactory() : nullptr;
+	if (factory == nullptr)
+		return false;
+
+	// error handler - discards the surface, since a failed render target
+	// generally has to be re-created
+	auto HRError = [this, &eh, descForErrors](const TCHAR *what, HRESULT hr)
+	{
+		WindowsErrorMessage winMsg(hr);
+		eh.SysError(
+			MsgFmt(IDS_ERR_IMGCREATE, descForErrors),
+			MsgFmt(_T("Sprite::LoadD2D, %s failed, HRESULT %lx: %s"), what, (long)hr, winMsg.Get()));
+		d2dSurface.Reset();
+		return false;
+	};
+
+	// set up a new surface, unless we can reuse the one from last time
+	HRESULT hr;
+	if (d2dSurface.target == nullptr || d2dSurface.width != pixWidth || d2dSurface.height != pixHeight
+		|| d2dSurface.loadContext == nullptr || !d2dSurface.loadContext->IsCurrentDevice())
+	{
+		// discard any old surface
+		d2dSurface.Reset();
+
+		// Create the texture.  It has to be usable as both a render target
+		// and a shader resource, and has to be GDI-compatible so that the
+		// drawing function can use GDI interop.
+		RefPtr<LoadContext> ctx(new LoadContext());
+		D3D11_TEXTURE2D_DESC txd = CD3D11_TEXTURE2D_DESC(
+			DXGI_FORMAT_B8G8R8A8_UNORM, pixWidth, pixHeight, 1, 1,
+			D3D11_BIND_SHADER_RESOURCE | D3D11_BIND_RENDER_TARGET, D3D11_USAGE_DEFAULT, 0,
+			1, 0, D3D11_RESOURCE_MISC_GDI_COMPATIBLE);
+		D3D11_SHADER_RESOURCE_VIEW_DESC svd;
+		svd.Format = txd.Format;
+		svd.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2D;
+		svd.Texture2D.MipLevels = txd.MipLevels;
+		svd.Texture2D.MostDetailedMip = 0;
+		if (FAILED(hr = D3D::Get()->CreateTexture2D(&txd, nullptr, &svd, &ctx->tv.rv, &ctx->tv.texture)))
+			return HRError(_T("CreateTexture2D"), hr);
+
+		// create a Direct2D render target on the texture's DXGI surface
+		RefPtr<IDXGISurface> surface;
+		if (FAILED(hr = ctx->tv.texture->QueryInterface(__uuidof(IDXGISurface), reinterpret_cast<void**>(&surface))))
+			return HRError(_T("QueryInterface(IDXGISurface)"), hr);
+
+		D2D1_RENDER_TARGET_PROPERTIES props = D2D1::RenderTargetProperties(
+			D2D1_RENDER_TARGET_TYPE_DEFAULT, D2D1::PixelFormat(DXGI_FORMAT_B8G8R8A8_UNORM, D2D1_ALPHA_MODE_PREMULTIPLIED),
+			96.0f, 96.0f, D2D1_RENDER_TARGET_USAGE_GDI_COMPATIBLE);
+		if (FAILED(hr = factory->CreateDxgiSurfaceRenderTarget(surface, &props, &d2dSurface.target)))
+			return HRError(_T("CreateDxgiSurfaceRenderTarget"), hr);
+
+		// Direct2D renders with premultiplied alpha
+		ctx->premultipliedAlpha = true;
+
+		// remember the new surface
+		d2dSurface.loadContext = ctx;
+		d2dSurface.width = pixWidth;
+		d2dSurface.height = pixHeight;
+	}
+
+	// Do the drawing.  Direct2D uses the D3D immediate context, so hold
+	// the context lock while drawing.
+	RefPtr<ID2D1RenderTarget> target(d2dSurface.target, RefCounted::DoAddRef);
+	{
+		D3D::DeviceContextLocker devctx;
+		target->BeginDraw();
+		target->SetTransform(D2D1::Matrix3x2F::Identity());
+		target->Clear(D2D1::ColorF(0, 0.0f));
+		drawingFunc(target);
+		hr = target->EndDraw();
+	}
+	if (FAILED(hr))
+		return HRError(_T("EndDraw"), hr);
+
+	// make the surface's context our current context
+	stagingTexture = nullptr;
+	loadContext = d2dSurface.loadContext;
+	loadContext->cancelled = false;
+	renderDirty = true;
+
+	// create the mesh, scaled to our reference 1920-pixel height
+	return CreateMesh({ float(pixWidth) / 1920.0f, float(pixHeight) / 1920.0f }, eh, descForErrors);
+}
+
 bool Sprite::Load(int pixWidth, int pixHeight, std::function<void(HDC, HBITMAP)> drawingFunc,
 	ErrorHandler &eh, const TCHAR *descForErrors)
 {
-	// set up a bitmap and do the off-screen drawing
-	bool ret;
-	DrawOffScreen(pixWidth, pixHeight, [this, &ret, &drawingFunc, &eh, descForErrors]
-	    (HDC hdc, HBITMAP hbmp, const void *dibits, const BITMAPINFO &bmi)
+	// clear the old staging texture, if any
+	stagingTexture = nullptr;
+
+	// If the last drawing surface was a different size, discard it.
+	// Otherwise we can reuse its texture.
+	bool reuse = (gdiSurface.loadContext != nullptr && gdiSurface.loadContext->IsCurrentDevice()
+		&& gdiSurface.width == pixWidth && gdiSurface.height == pixHeight);
+	if (!reuse)
 	{
-		// invoke the caller's drawing function
-		drawingFunc(hdc, hbmp);
+		gdiSurface.Reset();
+		gdiSurface.width = pixWidth;
+		gdiSurface.height = pixHeight;
+	}
 
-		// load the sprite texture from the memory bitmap
-		ret = Load(bmi, dibits, eh, descForErrors);
-	});
+	// do the drawing
+	bool ret = false;
+	if (reuse)
+	{
+		// We're redrawing at the same size, so keep the off-screen bitmap 
+		// from here on.  Create it if this is the first redraw, otherwise
+		// clear it, so that the caller sees the same blank bitmap as with
+		// a newly created one.
+		MemoryDC memdc;
+		if (gdiSurface.dib.hbitmap == NULL)
+		{
+			if ((gdiSurface.dib.hbitmap = memdc.CreateDIB(pixWidth, pixHeight, gdiSurface.dib.dibits, gdiSurface.dib.bmi)) == NULL)
+			{
+				gdiSurface.Reset();
+				eh.SysError(
+					MsgFmt(IDS_ERR_IMGCREATE, descForErrors),
+					_T("Sprite::Load, CreateDIBSection failed"));
+				return false;
+			}
+			gdiSurface.dibBytes = static_cast<INT64>(pixWidth) * pixHeight * 4;
+			MemoryStats::AddCPU(MemoryStats::Sprites, gdiSurface.dibBytes);
+		}
+		else
+		{
+			memdc.oldbmp = SelectObject(memdc, gdiSurface.dib.hbitmap);
+			ZeroMemory(gdiSurface.dib.dibits, pixWidth * pixHeight * 4);
+		}
 
-	// return the result
-	return ret;
+		// invoke the caller's drawing function, and make sure GDI is done
+		// with the bitmap before we read the pixels
+		drawingFunc(memdc, gdiSurface.dib.hbitmap);
+		GdiFlush();
+
+		// update the texture from the bitmap
+		ret = UploadGdiSurface(gdiSurface.dib.bmi, gdiSurface.dib.dibits, eh, descForErrors);
+	}
+	else
+	{
+		// first drawing at this size - draw into a temporary bitmap
+		DrawOffScreen(pixWidth, pixHeight, [this, &ret, &drawingFunc, &eh, descForErrors]
+			(HDC hdc, HBITMAP hbmp, const void *dibits, const BITMAPINFO &bmi)
+		{
+			// invoke the caller's drawing function
+			drawingFunc(hdc, hbmp);
+			GdiFlush();
+
+			// create the texture from the memory bitmap
+			ret = UploadGdiSurface(bmi, dibits, eh, descForErrors);
+		});
+	}
+
+	// if that failed, forget the surface
+	if (!ret)
+	{
+		gdiSurface.Reset();
+		return false;
+	}
+
+	// switch to the surface's load context
+	loadContext = gdiSurface.loadContext;
+	loadContext->cancelled = false;
+
+	// create the mesh, scaled to our reference 1920-pixel height
+	return CreateMesh({ float(pixWidth) / 1920.0f, float(pixHeight) / 1920.0f }, eh, descForErrors);
+}
+
+bool Sprite::UploadGdiSurface(const BITMAPINFO &bmi, const void *dibits, ErrorHandler &eh, const TCHAR *descForErrors)
+{
+	// Hash each row of pixels, and note the range of rows that changed
+	// since the last upload.  For a new surface, every row is new.
+	int width = gdiSurface.width, height = gdiSurface.height;
+	bool newSurface = gdiSurface.rowHash.size() != static_cast<size_t>(height);
+	if (newSurface)
+		gdiSurface.rowHash.resize(height);
+
+	int top = height, bottom = 0;
+	const UINT64 *p = static_cast<const UINT64*>(dibits);
+	size_t rowWords = (static_cast<size_t>(width) * 4) / sizeof(UINT64);
+	size_t rowBytes = static_cast<size_t>(width) * 4;
+	for (int y = 0; y < height; ++y)
+	{
+		// FNV-1a style hash over the row, eight bytes at a time, with the
+		// odd pixel at the end of an odd-width row folded in separately
+		UINT64 h = 14695981039346656037ULL;
+		for (size_t i = 0; i < rowWords; ++i)
+			h = (h ^ *p++) * 1099511628211ULL;
+		if (rowBytes % sizeof(UINT64) != 0)
+		{
+			h = (h ^ *reinterpret_cast<const UINT32*>(p)) * 1099511628211ULL;
+			p = reinterpret_cast<const UINT64*>(reinterpret_cast<const UINT32*>(p) + 1);
+		}
+
+		// note if it changed
+		if (newSurface || h != gdiSurface.rowHash[y])
+		{
+			gdiSurface.rowHash[y] = h;
+			top = min(top, y);
+			bottom = y + 1;
+		}
+	}
+
+	// if we don't have a texture yet, create it
+	if (gdiSurface.loadContext == nullptr)
+	{
+		RefPtr<LoadContext> ctx(new LoadContext());
+
+		// Set up the texture.  Use default usage rather than dynamic, so
+		// that we can update a sub-rectangle via UpdateSubresource.
+		D3D11_TEXTURE2D_DESC txd = CD3D11_TEXTURE2D_DESC(
+			DXGI_FORMAT_B8G8R8A8_UNORM, width, height, 1, 1,
+			D3D11_BIND_SHADER_RESOURCE, D3D11_USAGE_DEFAULT, 0, 1, 0, 0);
+
+		D3D11_SUBRESOURCE_DATA srd;
+		ZeroMemory(&srd, sizeof(srd));
+		srd.pSysMem = dibits;
+		srd.SysMemPitch = static_cast<UINT>(rowBytes);
+		srd.SysMemSlicePitch = srd.SysMemPitch * height;
+
+		D3D11_SHADER_RESOURCE_VIEW_DESC svd;
+		svd.Format = txd.Format;
+		svd.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2D;
+		svd.Texture2D.MipLevels = txd.MipLevels;
+		svd.Texture2D.MostDetailedMip = 0;
+
+		HRESULT hr = D3D::Get()->CreateTexture2D(&txd, &srd, &svd, &ctx->tv.rv, &ctx->tv.texture);
+		if (!SUCCEEDED(hr))
+		{
+			WindowsErrorMessage winMsg(hr);
+			eh.SysError(
+				MsgFmt(IDS_ERR_IMGCREATE, descForErrors),
+				MsgFmt(_T("Sprite::Load, CreateTexture2D failed, HRESULT %lx: %s"), (long)hr, winMsg.Get()));
+			return false;
+		}
+
+		gdiSurface.loadContext = ctx;
+		renderDirty = true;
+	}
+	else if (top < bottom)
+	{
+		// upload the changed band of rows
+		D3D11_BOX box = { 0, static_cast<UINT>(top), 0, static_cast<UINT>(width), static_cast<UINT>(bottom), 1 };
+		D3D::DeviceContextLocker ctx;
+		ctx->UpdateSubresource(gdiSurface.loadContext->tv.texture, 0, &box,
+			static_cast<const BYTE*>(dibits) + rowBytes * top, static_cast<UINT>(rowBytes), 0);
+		renderDirty = true;
+	}
+	else if (loadContext.Get() != gdiSurface.loadContext.Get())
+	{
+		// nothing changed in the pixels, but we're switching back to the
+		// surface from some other load, so the window still needs a redraw
+		renderDirty = true;
+	}
+
+	// success
+	return true;
 }
 
 bool Sprite::Load(HDC hdc, HBITMAP hbitmap, ErrorHandler &eh, const TCHAR *descForErrors)
@@ -1497,6 +2928,9 @@ bool Sprite::CreateTextureFromBitmap(const BITMAPINFO &bmi, const void *dibits,
 	// set up a new load context
 	loadContext.Attach(new LoadContext());
 
+	// the new texture will have to be rendered
+	renderDirty = true;
+
 	// create the texture and load it into the new load context
 	return CreateTextureFromBitmapStatic(bmi, dibits, eh, descForErrors, &loadContext->tv);
 }
@@ -1551,80 +2985,93 @@ void Sprite::ReCreateMesh()
 
 bool Sprite::CreateMesh(POINTF sz, ErrorHandler &eh, const TCHAR *descForErrors)
 {
-	// remove any prior resources
-	vertexBuffer = nullptr;
-	indexBuffer = nullptr;
-
-	// get the D3D interface
-	D3D *d3d = D3D::Get();
-
-	// vertex list for our rectangle
-	const CommonVertex v[] = {
-		{ XMFLOAT4(-sz.x / 2.0f, sz.y / 2.0f, 0.0f, 0.0f), XMFLOAT2(0.0f, 0.0f), XMFLOAT3(0, 1, 0) },  // top left
-		{ XMFLOAT4(sz.x / 2.0f, sz.y / 2.0f, 0.0f, 0.0f), XMFLOAT2(1.0f, 0.0f), XMFLOAT3(0, 1, 0) },   // top right
-		{ XMFLOAT4(sz.x / 2.0f, -sz.y / 2.0f, 0.0f, 0.0f), XMFLOAT2(1.0f, 1.0f), XMFLOAT3(0, 1, 0) },   // bottom right
-		{ XMFLOAT4(-sz.x / 2.0f, -sz.y / 2.0f, 0.0f, 0.0f), XMFLOAT2(0.0f, 1.0f), XMFLOAT3(0, 1, 0) }  // bottom left
-	};
-
-	// index list for a rectangle
-	static const WORD flIndex[] = {
-		0, 1, 2,	// top face 1
-		2, 3, 0		// top face 2
-	};
-
-	// set up the vertex buffer descriptor
-	D3D11_BUFFER_DESC bd;
-	ZeroMemory(&bd, sizeof(bd));
-	bd.Usage = D3D11_USAGE_DEFAULT;
-	bd.ByteWidth = (UINT)(sizeof(CommonVertex) * 4);
-	bd.BindFlags = D3D11_BIND_VERTEX_BUFFER;
-
-	// set up the subresource descriptor
-	D3D11_SUBRESOURCE_DATA sd;
-	ZeroMemory(&sd, sizeof(sd));
-	sd.pSysMem = v;
-
-	// create the vertex buffer
-	HRESULT hr = d3d->CreateBuffer(&bd, &sd, &vertexBuffer, "Sprite::vertexBuffer");
-	if (!SUCCEEDED(hr))
+	// make sure the shared quad mesh is available
+	if (!D3D::Get()->IsUnitQuadAvailable())
 	{
-		WindowsErrorMessage winMsg(hr);
 		eh.SysError(
 			MsgFmt(IDS_ERR_IMGMESH, descForErrors),
-			MsgFmt(_T("D3D CreateBuffer(vertices) failed, HRESULT %lx: %s"), (long)hr, winMsg.Get()));
+			_T("D3D shared quad mesh buffers not available"));
 		return false;
 	}
 
-	// create the index buffer
-	bd.Usage = D3D11_USAGE_DEFAULT;
-	bd.ByteWidth = (UINT)(sizeof(WORD) * countof(flIndex));
-	bd.BindFlags = D3D11_BIND_INDEX_BUFFER;
-	bd.CPUAccessFlags = 0;
-	sd.pSysMem = flIndex;
-	hr = d3d->CreateBuffer(&bd, &sd, &indexBuffer, "Sprite::indexBuffer");
-	if (!SUCCEEDED(hr))
-	{
-		WindowsErrorMessage winMsg(hr);
-		eh.SysError(
-			MsgFmt(IDS_ERR_IMGMESH, descForErrors),
-			MsgFmt(_T("D3D CreateBuffer(indices) failed, HRESULT %lx: %s"), (long)hr, winMsg.Get()));
-		return false;
-	}
+	// All sprites share the D3D unit quad mesh, so there's nothing to
+	// create here.  We just note the rectangle size, which we apply to
+	// the quad through the world transform.
+	meshSize = sz;
+	hasMesh = true;
+	UpdateWorld();
 
 	// remember the load size
 	loadSize = sz;
 
+	// the new mesh will have to be rendered
+	renderDirty = true;
+
 	// success
 	return true;
 }
 
+bool Sprite::IsRenderDirty() const
+{
+	// check for explicit changes, and for changes to the public alpha
+	// or load context since the last render
+	if (renderDirty || alpha != lastRenderAlpha || loadContext.Get() != lastRenderContext)
+		return true;
+
+	// if there's no load context, there's nothing to draw, and nothing
+	// has changed since we last drew nothing
+	if (loadContext == nullptr)
+		return false;
+
+	// If a background load just finished, we need to draw the new image
+	if (loadContext->readyState == LoadContext::ReadyState::Loaded)
+		return true;
+
+	// if a fade is in progress, the alpha changes on every frame
+	if (fadeDir != 0)
+		return true;
+
+	// check for a Flash object update
+	if (flashSite != nullptr && flashSite->NeedsRedraw())
+		return true;
+
+	// check for a running animation that's due for its next frame
+	if (loadContext->animation != nullptr && animRunning && loadContext->readyState == LoadContext::ReadyState::Ready
+		&& GetTickCount64() >= loadContext->curAnimFrameEndTime)
+		return true;
+
+	// nothing has changed
+	return false;
+}
+
+void Sprite::SaveRenderState()
+{
+	renderDirty = false;
+	lastRenderAlpha = alpha;
+	lastRenderContext = loadContext.Get();
+}
+
 void Sprite::Render(Camera *camera)
 {
+	// Note the state we're rendering, for dirty tracking.  We count
+	// this as a render even if we end up drawing nothing, since the
+	// window will accurately reflect our current state either way.
+	SaveRenderState();
+
 	// If there's no loader context, or it's not ready, we don't have 
 	// anything to render
 	if (loadContext == nullptr || loadContext->readyState == LoadContext::ReadyState::Loading)
 		return;
 
+	// If the D3D device has been replaced since the context was created,
+	// its textures belong to the old device, so drop them.  The sprite's
+	// owner reloads it when it next syncs its media.
+	if (!loadContext->IsCurrentDevice())
+	{
+		loadContext = nullptr;
+		return;
+	}
+
 	// Check if the context is newly ready
 	if (loadContext->readyState == LoadContext::ReadyState::Loaded)
 	{
@@ -1634,6 +3081,15 @@ void Sprite::Render(Camera *camera)
 		if (loadContext->animation != nullptr && loadContext->animFrames.size() != 0)
 			loadContext->curAnimFrameEndTime = GetTickCount64() + loadContext->animFrames.front()->dt;
 
+		// If this is an atlas load, copy the decoded image into the atlas.
+		// This has to be done here rather than in the loader thread, since
+		// it uses the device context.
+		if (loadContext->atlasPixels != nullptr && !StoreAtlasImage())
+		{
+			loadContext = nullptr;
+			return;
+		}
+
 		// notify the message window that the first frame is ready
 		if (msgHwnd != NULL)
 			::PostMessage(msgHwnd, AVPMsgFirstFrameReady, animCookie, 0);
@@ -1740,8 +3196,55 @@ void Sprite::Render(Camera *camera)
 	// Assume we'll use the still-frame shader resource view
 	ID3D11ShaderResourceView *rvToRender = loadContext->tv.rv;
 
-	// check for animation
-	if (loadContext->animation != nullptr)
+	// check for animation, streaming or regular
+	if (auto stream = loadContext->animation != nullptr ? loadContext->animation->GetStream() : nullptr; stream != nullptr)
+	{
+		// Advance through the frames that have come due, as for a regular
+		// animation (below).  We only need to upload the last one, since
+		// zero-delay frames are never displayed on their own.  If the
+		// decoder hasn't caught up, stay on the current frame until the
+		// next frame is ready.
+		UINT64 now = GetTickCount64();
+		std::unique_ptr<StreamFrame> frame;
+		while (animRunning && now >= loadContext->curAnimFrameEndTime)
+		{
+			// check the next frame
+			auto next = stream->Peek();
+			if (next == nullptr)
+				break;
+
+			// if it starts a new pass through the animation, we've reached
+			// the end of the loop
+			if (next->loopStart)
+			{
+				// post an end-of-loop message, as for a regular animation
+				if (msgHwnd != NULL)
+					::PostMessage(msgHwnd, animLooping ? AVPMsgLoopNeeded : AVPMsgEndOfPresentation, animCookie, 0);
+
+				// if we're not looping, pause on the current (last) frame
+				if (!animLooping)
+				{
+					animRunning = false;
+					break;
+				}
+			}
+
+			// take the frame, and figure its end time
+			frame = stream->Pop();
+			loadContext->curAnimFrameEndTime = now + frame->dt;
+		}
+
+		// copy the new frame into the texture
+		if (frame != nullptr)
+		{
+			D3D::DeviceContextLocker devctx;
+			devctx->UpdateSubresource(loadContext->tv.texture, 0, nullptr, frame->pixels.get(), frame->rowPitch, 0);
+		}
+
+		// keep the decoder ahead of playback
+		stream->Refill();
+	}
+	else if (loadContext->animation != nullptr)
 	{
 		// If the animation is running, check if it's time to advance to the 
 		// next frame.  We might have to advance past multiple frames, because
@@ -1797,7 +3300,10 @@ void Sprite::Render(Camera *camera)
 	// prepare my shader
 	Shader *ts = GetShader();
 	ts->PrepareForRendering(camera);
-	ts->SetAlpha(UpdateFade());
+	if (loadContext->premultipliedAlpha)
+		ts->SetPremultipliedAlpha(UpdateFade());
+	else
+		ts->SetAlpha(UpdateFade());
 
 	// load our texture into the pixel shader
 	D3D::Get()->PSSetShaderResources(0, 1, &rvToRender);
@@ -1806,6 +3312,19 @@ void Sprite::Render(Camera *camera)
 	RenderMesh();
 }
 
+bool Sprite::IsAnimated() const
+{
+	return fadeDir != 0
+		|| flashSite != nullptr
+		|| (loadContext != nullptr && loadContext->animation != nullptr && animRunning);
+}
+
+const char *Sprite::GetShaderID() const
+{
+	Shader *s = GetShader();
+	return s != nullptr ? s->ID() : "";
+}
+
 Shader *Sprite::GetShader() const
 {
 	// return the basic Texture Shader by default
@@ -1814,21 +3333,21 @@ Shader *Sprite::GetShader() const
 
 void Sprite::RenderMesh()
 {
-	// we can only proceed if we have valid vertex and index buffers
-	if (vertexBuffer == nullptr || indexBuffer == nullptr)
+	// we can only proceed if we have a mesh
+	if (!hasMesh)
 		return;
 
 	// get the D3D context
 	D3D *d3d = D3D::Get();
 
-	// set the vertex buffer
-	d3d->IASetVertexBuffer(vertexBuffer, sizeof(CommonVertex));
+	// set the shared unit quad vertex and index buffers
+	d3d->IASetUnitQuad();
 
-	// set the index buffer
-	d3d->IASetIndexBuffer(indexBuffer);
-
-	// load our world coordinates
-	d3d->UpdateWorldTransform(worldT);
+	// load our world coordinates and texture rectangle
+	if (loadContext != nullptr)
+		d3d->UpdateWorldTransform(worldT, loadContext->texRect);
+	else
+		d3d->UpdateWorldTransform(worldT);
 
 	// draw the vertex list
 	d3d->DrawIndexed(6);
@@ -1836,10 +3355,11 @@ void Sprite::RenderMesh()
 
 void Sprite::StartFade(int dir, DWORD milliseconds)
 {
+	renderDirty = true;
 	alpha = dir > 0 ? 0.0f : 1.0f;
 	fadeDone = false;
 	fadeDir = dir;
-	fadeStartTime = GetTickCount();
+	fadeStartTime = AnimClock::Now();
 	fadeDuration = milliseconds;
 }
 
@@ -1849,7 +3369,7 @@ float Sprite::UpdateFade()
 	if (fadeDir != 0)
 	{
 		// figure the delta since the starting time, as a fraction of the total time
-		DWORD dt = GetTickCount() - fadeStartTime;
+		DWORD dt = AnimClock::Now() - fadeStartTime;
 		float progress = fminf(1.0f, float(dt) / float(fadeDuration));
 
 		// adjust the alpha on a linear ramp
@@ -1894,9 +3414,11 @@ void Sprite::AdviseWindowSize(SIZE szLayout)
 
 void Sprite::Clear()
 {
-	// clear the animation frame list
+	// cancel any background load still in progress, and clear the
+	// animation frame list
 	if (loadContext != nullptr)
 	{
+		loadContext->cancelled = true;
 		loadContext->curAnimFrame = 0;
 		loadContext->animFrames.clear();
 		loadContext->animation = nullptr;
@@ -1910,7 +3432,9 @@ void Sprite::Clear()
 	DetachFlash();
 
 	// release D3D resources
-	vertexBuffer = nullptr;
-	indexBuffer = nullptr;
-	loadContext = nullptr;
+	hasMesh = false;
+	ReleaseLoadContext();
+
+	// the window will have to be redrawn without our old contents
+	renderDirty = true;
 }
@@ -26,8 +26,13 @@
 //
 
 #pragma once
+#include <unordered_map>
 #include <png.h>
+#include <d2d1.h>
 #include "D3D.h"
+#include "TextureAtlas.h"
+#include "LoaderPool.h"
+#include "MemoryStats.h"
 
 class Camera;
 class FlashClientSite;
@@ -53,6 +58,17 @@ public:
 	// messages aren't needed for this image site.
 	bool Load(const WCHAR *filename, POINTF normalizedSize, SIZE pixSize, HWND msgHwnd, ErrorHandler &eh);
 
+	// Load a texture file into a texture atlas.  This works like the
+	// file loader above, but rather than creating a separate texture at
+	// the native size of the image, it rasterizes the image at the given
+	// pixel size and stores it in a cell of the shared atlas texture.
+	// This is only applicable to still images (PNG, JPEG) that fit the
+	// atlas cell size; for anything else, we fall back on the normal
+	// file loader.  The image is decoded in a background thread, and
+	// copied into the atlas on the first render.
+	bool LoadIntoAtlas(const WCHAR *filename, POINTF normalizedSize, SIZE pixSize, 
+		TextureAtlas *atlas, HWND msgHwnd, ErrorHandler &eh);
+
 	// Load from an HBITMAP
 	bool Load(HDC hdc, HBITMAP hbitmap, ErrorHandler &eh, const TCHAR *descForErrors);
 
@@ -65,6 +81,14 @@ public:
 	// The off-screen bitmap for drawing is created with the given pixel
 	// width and height; we scale the sprite to our normalized screen 
 	// dimensions (1920-pixel screen height).
+	//
+	// If the last load was a drawing load at the same size, we redraw
+	// into the same texture, uploading only the band of rows that changed
+	// since the last drawing.  A sprite that's redrawn repeatedly (a
+	// popup that updates a line of text, say) also keeps its off-screen
+	// bitmap, so that it doesn't reallocate anything on each redraw.  As
+	// with a new bitmap, the bitmap is cleared to all zeroes before each
+	// call to the drawing function.
 	bool Load(int pixWidth, int pixHeight, std::function<void(HDC, HBITMAP)> drawingFunc,
 		ErrorHandler &eh, const TCHAR *descForErrors);
 
@@ -72,6 +96,19 @@ public:
 	bool Load(int pixWidth, int pixHeight, std::function<void(Gdiplus::Graphics &g)> drawingFunc,
 		ErrorHandler &eh, const TCHAR *descForErrors);
 
+	// Load by drawing into a Direct2D render target.  The render target
+	// draws directly into the sprite's texture on the GPU, which avoids
+	// the off-screen bitmap and the texture upload of the GDI paths.  If
+	// the last load was a Direct2D load at the same size, we draw into
+	// the same texture again rather than creating a new one, so a sprite
+	// that's redrawn on every frame doesn't churn through textures.  The
+	// render target is GDI-compatible, so the drawing function can use
+	// ID2D1GdiInteropRenderTarget for GDI or GDI+ drawing.  Returns true
+	// on success.  On failure, the drawing function might not have been
+	// called at all, if we couldn't set up the render target.
+	bool LoadD2D(int pixWidth, int pixHeight, std::function<void(ID2D1RenderTarget *target)> drawingFunc,
+		ErrorHandler &eh, const TCHAR *descForErrors);
+
 	// Render the sprite
 	virtual void Render(Camera *camera);
 
@@ -82,6 +119,36 @@ public:
 	// Is the first frame ready for display?
 	virtual bool IsFrameReady() const { return loadContext != nullptr && loadContext->readyState == LoadContext::ReadyState::Ready; }
 
+	// Is a background load still in progress?  This goes false when the
+	// loader thread finishes creating the texture, which is before the
+	// first render makes the frame ready.
+	bool IsLoadPending() const { return loadContext != nullptr && loadContext->readyState == LoadContext::ReadyState::Loading; }
+
+	// Has the sprite's appearance changed since it was last rendered?
+	// The view uses this to skip redrawing a window when nothing in its
+	// drawing list has changed since the last Present.  This returns
+	// true for anything that would make the next Render() draw pixels
+	// differently: a new load, a transform or alpha change, a fade in
+	// progress, an animation frame that's due, or a newly completed
+	// background load.
+	virtual bool IsRenderDirty() const;
+
+	// Explicitly mark the sprite as needing a redraw.  Most changes are
+	// detected automatically, but code that alters the rendered image
+	// through some side channel (e.g., shader parameters) can use this
+	// to make sure the containing view picks up the change.
+	void SetRenderDirty() { renderDirty = true; }
+
+	// Is the sprite's appearance changing continuously?  This returns
+	// true while a video or animation is playing or a fade is in
+	// progress.  The view uses this for adaptive frame rate control, to
+	// tell a window full of still images from one with moving content.
+	virtual bool IsAnimated() const;
+
+	// Get the ID of the shader used to render the sprite.  This is for
+	// instrumentation, to group sprites by shader type.
+	const char *GetShaderID() const;
+
 	// image load size, in normalized coordinates (window height = 1.0)
 	POINTF loadSize;
 
@@ -99,6 +166,53 @@ public:
 	// global alpha transparency
 	float alpha;
 
+	// Generate mipmaps when loading image files.  Set this before loading
+	// for sprites that are displayed at varying scales, such as the wheel
+	// images, which shrink as they move away from the center position.
+	// The mip levels keep the reduced-size renderings properly filtered.
+	bool genMips = false;
+
+	// Priority for asynchronous loads on the loader pool.  Set this to
+	// High for media for the current selection, or Prefetch for media
+	// loaded in anticipation of a possible future selection.
+	LoaderPool::Priority loadPriority = LoaderPool::Priority::Normal;
+
+	// Animation streaming threshold, in bytes.  An animated GIF or APNG
+	// whose frames would take more than this much memory if we kept them
+	// all as textures is played in streaming mode instead: the frames are
+	// decoded on the loader pool a few frames ahead of playback, and each
+	// frame is copied into the sprite's texture as it comes up, so the
+	// memory use doesn't grow with the length of the animation.  Shorter
+	// animations keep all of their frames, so that they loop without any
+	// further decoding.  Zero disables streaming.  This is set from the
+	// configuration.
+	static size_t animStreamingThreshold;
+
+	// Limit image loads to the window size.  When set (by the low-memory
+	// profile), loading an image file clamps the requested pixel size so
+	// that neither dimension exceeds the larger dimension of the message
+	// window's client area, even for callers that ask for the image's
+	// native size.  This keeps a 4K backglass image on a 1080p monitor
+	// from taking four times the texture memory it can actually use.
+	static bool limitToWindowSize;
+
+	// Shared still images.  When the same image file is on display in
+	// more than one place at the same pixel size (the same logo in two
+	// custom media windows, say, or a backglass image repeated in a
+	// custom window), the sprites can share one texture rather than each
+	// decoding and uploading its own copy.  When this is enabled, a file
+	// load that finds the same image already loaded and displayed in
+	// another sprite simply adopts its texture.  This only applies to
+	// plain still images, since animated and Flash media update their
+	// textures as they play.  This is set from the configuration.
+	static bool sharedImages;
+
+	// Release the shared image table's references.  Sprites already
+	// sharing an image keep it; this just stops new loads from finding
+	// it.  Call this when releasing resources in bulk, such as when
+	// yielding resources to a running game.
+	static void ReleaseSharedImages();
+
 	// Start a fade
 	void StartFade(int dir, DWORD milliseconds);
 
@@ -124,7 +238,10 @@ public:
 	void ReCreateMesh();
 
 	// Clear the sprite.  This frees any exeternal resources currently 
-	// in use, such as video playback streams.
+	// in use, such as video playback streams.  Any background load
+	// that's still in progress is cancelled.  This keeps the drawing 
+	// surfaces from the last GDI and Direct2D drawing loads, if any, so
+	// that a sprite that's cleared and redrawn can reuse them.
 	virtual void Clear();
 
 	// Play/Stop an image or video.  This has no effect (and is harmless)
@@ -166,18 +283,25 @@ protected:
 	bool LoadSWF(const WCHAR *filename, POINTF normalizedSize, SIZE pixSize, ErrorHandler &eh);
 
 	// Load a GIF image file.  The regular Load(filename,...) method calls
-	// this when it detects GIF contents.
-	bool LoadGIF(const WCHAR *filename, POINTF normalizedSize, SIZE pixSize, ErrorHandler &eh);
+	// this when it detects GIF contents.  'view' is the memory-mapped file
+	// contents, which the decoder reads instead of re-opening the file.
+	bool LoadGIF(const WCHAR *filename, MappedFile *view, POINTF normalizedSize, SIZE pixSize, ErrorHandler &eh);
 
 	// Load an animated PNG image file.  The regular Load(filename,...) method calls
-	// this when it detects PNG contents.
-	bool LoadAPNG(const WCHAR *filename, POINTF normalizedSize, SIZE pixSize, ErrorHandler &eh);
+	// this when it detects PNG contents.  'view' is the mapped file contents.
+	bool LoadAPNG(const WCHAR *filename, MappedFile *view, POINTF normalizedSize, SIZE pixSize, ErrorHandler &eh);
 
 	// Load a texture from an image file using WIC.  This does a direct
 	// WIC load, which handles the common image formats (JPEG, PNG, GIF),
 	// but doesn't have support for orientation metadata or multi-frame
-	// animated GIFs.
-	bool LoadWICTexture(const WCHAR *filename, POINTF normalizedSize, ErrorHandler &eh);
+	// animated GIFs.  If the display size is known, and the image is
+	// larger, the image is scaled down to the display size at load time.
+	// If the compressed texture cache is enabled, this loads the cached
+	// copy when available, and otherwise adds the file to the cache for
+	// next time.  If the caller has already mapped the file, it can pass
+	// the view, to save the loader thread from opening the file again.
+	bool LoadWICTexture(const WCHAR *filename, POINTF normalizedSize, SIZE pixSize, ErrorHandler &eh,
+		MappedFile *view = nullptr);
 
 	// Texture + Shader Resource View.  This pair forms the basic
 	// D3D rendering object for a bitmap.
@@ -201,11 +325,32 @@ protected:
 	// create the staging texture
 	bool CreateStagingTexture(int pixWidth, int pixHeight, ErrorHandler &eh);
 
+	// Store the pending image for an atlas load in the atlas.  This is
+	// called from the renderer when an atlas load finishes.
+	bool StoreAtlasImage();
+
+	// Record the state we're about to render, for IsRenderDirty() 
+	// comparisons on subsequent frames.  Subclasses that override
+	// Render() call this when they draw without going through the
+	// base class rendering.
+	void SaveRenderState();
+
+	// Render dirty tracking.  renderDirty is set explicitly by the
+	// operations that change the sprite's appearance (loading, 
+	// transform updates, fades), and cleared on each render.  The
+	// remaining items are a snapshot of the state at the last render,
+	// to detect changes made directly to public members (such as
+	// 'alpha') or through a reload.  The pointers are for comparison
+	// only and must never be dereferenced.
+	bool renderDirty = true;
+	float lastRenderAlpha = -1.0f;
+	const void *lastRenderContext = nullptr;
+
 	// Alpha fade parameters.  A sprite can manage a fade in/out when
 	// rendering.  The caller simply provides the total fade time and
 	// direction.  fadeDir is positive for a fade-in, negative for a
 	// fade-out, and zero if no fade is in progress.  The times are in
-	// milliseconds, using GetTickCount().
+	// milliseconds, on the animation clock (see AnimClock.h).
 	int fadeDir;
 	DWORD fadeStartTime;
 	DWORD fadeDuration;
@@ -213,14 +358,16 @@ protected:
 	// the last fade has completed
 	bool fadeDone;
 
-	// Vertex and index lists.  Our sprites are always rectangular, 
-	// so they consist of four vertices and two triangles.
-	CommonVertex vertex[4];
-	WORD index[6];
-
-	// Vertex and index buffers
-	RefPtr<ID3D11Buffer> vertexBuffer;
-	RefPtr<ID3D11Buffer> indexBuffer;
+	// Mesh status.  Our sprites are always rectangular, so rather than
+	// creating separate vertex and index buffers for each sprite, we
+	// render every sprite with the shared unit quad mesh from the D3D
+	// object, scaled to the rectangle size through the world transform.
+	// meshSize is the rectangle size set in CreateMesh(); this is kept
+	// separately from loadSize because callers can change loadSize
+	// directly, and that shouldn't affect rendering until the mesh is
+	// re-created.
+	bool hasMesh = false;
+	POINTF meshSize;
 
 	// Flash client site, for SWF objects
 	RefPtr<FlashClientSite> flashSite;
@@ -242,13 +389,123 @@ protected:
 		TextureAndView tv;
 	};
 
+	// create a texture for an animation frame
+	static HRESULT CreateFrameTexture(DXGI_FORMAT format, UINT width, UINT height,
+		const void *pixels, UINT rowPitch, D3D11_USAGE usage, TextureAndView *tv);
+
 	// Animation loader interface.  This is the abstract base class
 	// for the various animation formats (GIF, APNG, SWF).
 	struct LoadContext;
+	struct AnimStream;
 	struct Animation
 	{
 		virtual ~Animation() { }
 		virtual void DecodeNext(LoadContext *) = 0;
+
+		// get the frame stream, if this is a streaming animation
+		virtual AnimStream *GetStream() { return nullptr; }
+	};
+
+	// should an animation with the given dimensions be streamed?
+	static bool IsStreamedAnimation(UINT width, UINT height, UINT nFrames)
+	{
+		return animStreamingThreshold != 0
+			&& static_cast<UINT64>(width) * height * 4 * nFrames > animStreamingThreshold;
+	}
+
+	// Streaming animation frame.  This holds a decoded frame's pixels
+	// while it waits in the stream queue for its turn on screen.
+	struct StreamFrame
+	{
+		// time to display this frame, in milliseconds
+		DWORD dt = 0;
+
+		// is this the first frame of a new pass through the animation?
+		bool loopStart = false;
+
+		// pixels, in the sprite texture's format, and the row pitch in bytes
+		std::unique_ptr<BYTE[]> pixels;
+		UINT rowPitch = 0;
+	};
+
+	// Streaming animation frame source.  The GIF and APNG decoders
+	// implement this to feed their frames into a stream, in order.  A
+	// source is only used on the stream's decoder task.
+	struct AnimSource
+	{
+		virtual ~AnimSource() { }
+
+		// decode the next frame; returns false at the end of the animation
+		// or on error
+		virtual bool DecodeNext(StreamFrame &frame) = 0;
+	};
+
+	// Animation frame stream.  The decoder task on the loader pool keeps
+	// a short queue of decoded frames ahead of playback, and the renderer
+	// takes them off the front of the queue as they come due.  When the
+	// source reaches the end of the animation, we open a fresh source to
+	// start over from the first frame, rather than keeping the frames
+	// from the first pass.  The stream is reference-counted, since it's
+	// shared between the sprite and the decoder task, so that the task
+	// can finish harmlessly if the sprite discards the animation while
+	// the task is running.
+	struct AnimStream : RefCounted
+	{
+		AnimStream(AnimSource *source, std::function<AnimSource*()> reopen) :
+			source(source), reopen(reopen) { }
+
+		// Take the next frame off the queue.  Returns null if the decoder
+		// hasn't caught up yet.  Called on the UI thread.
+		std::unique_ptr<StreamFrame> Pop();
+
+		// Look at the next frame without removing it.  Called on the UI
+		// thread; the frame stays valid until the UI thread pops it.
+		const StreamFrame *Peek();
+
+		// Queue a decoder task, if the queue is running low and a task
+		// isn't already running.  Called on the UI thread.
+		void Refill();
+
+		// decoder task
+		void Fill();
+
+		// current frame source
+		std::unique_ptr<AnimSource> source;
+
+		// open a new source, positioned at the first frame
+		std::function<AnimSource*()> reopen;
+
+		// decoded frames waiting for display
+		std::list<std::unique_ptr<StreamFrame>> frames;
+
+		// number of frames to keep decoded ahead of playback
+		static const size_t aheadCount = 6;
+
+		// is a decoder task queued or running?
+		bool decoding = false;
+
+		// Has decoding failed?  We stop filling the queue if so, and
+		// playback stays on the last frame we got.
+		bool failed = false;
+
+		// cancellation flag - set when the sprite discards the animation
+		volatile bool cancelled = false;
+
+		// lock for the queue and status
+		CriticalSection lock;
+	};
+
+	// Streaming animation player.  The load context holds this as its
+	// animation object.  The frames are decoded on the loader pool, so
+	// there's nothing to do in DecodeNext().
+	struct StreamingAnimation : Animation
+	{
+		StreamingAnimation(AnimStream *stream) : stream(stream, RefCounted::DoAddRef) { }
+		virtual ~StreamingAnimation() { stream->cancelled = true; }
+		virtual void DecodeNext(LoadContext *) override { }
+		virtual AnimStream *GetStream() override { return stream; }
+
+		RefPtr<AnimStream> stream;
 	};
 
 	// Deferred loader context.  Loading images can take a noticable
@@ -264,8 +521,20 @@ protected:
 	// happily updates its context, which we no longer care about.
 	// The context is harmlessly deleted when the loader releases
 	// its last reference.
+	//
+	// When we abandon a context that's still loading, we set its
+	// cancellation flag.  The background loaders check the flag at
+	// checkpoints between their decoding stages, and stop as soon as
+	// they see it, so that a rapid series of superseded loads (such
+	// as when scrolling quickly through the wheel) doesn't keep the
+	// disk and CPU busy with work whose results we'll just discard.
+	// A load that was still queued on the loader pool stops before
+	// it does any work at all.
 	struct LoadContext : RefCounted
 	{
+		// cancellation flag - set when the sprite abandons the context
+		volatile bool cancelled = false;
+
 		// Object loading state.  For synchronously loaded objects,
 		// this starts out as Ready and stays Ready.  For objects
 		// loaded on a background thread, this starts off as Loading,
@@ -297,8 +566,56 @@ protected:
 
 		// ending time of the current frame, in system ticks
 		UINT64 curAnimFrameEndTime = 0;
+
+		// Texture coordinate rectangle, as { u0, v0, du, dv }.  This
+		// is the whole texture for a normal load, or the image's cell
+		// for an atlas image.
+		DirectX::XMFLOAT4 texRect = { 0.0f, 0.0f, 1.0f, 1.0f };
+
+		// Texture atlas for an atlas load, the slot where the image is
+		// stored, and the decoded pixels waiting to be copied into the
+		// atlas.  The loader thread decodes the image into the pixel
+		// buffer, and the renderer copies it into the atlas (which it
+		// has to do on the UI thread, since it uses the device context).
+		RefPtr<TextureAtlas> atlas;
+		RefPtr<TextureAtlas::Slot> atlasSlot;
+		std::unique_ptr<BYTE[]> atlasPixels;
+		SIZE atlasPixSize = { 0, 0 };
+
+		// Does the texture use premultiplied alpha?  This is the case
+		// for textures drawn with Direct2D, and for still images, which
+		// the loaders premultiply (see LoadWICTexture()).
+		bool premultipliedAlpha = false;
+
+		// D3D device generation the context's textures were created on.
+		// If the device has been replaced since (see D3D::RecreateDevice()),
+		// the textures are no longer usable.
+		UINT deviceGeneration = D3D::Get()->GetDeviceGeneration();
+		bool IsCurrentDevice() const { return deviceGeneration == D3D::Get()->GetDeviceGeneration(); }
+
+		// shared image table key, if the context is in the table
+		TSTRING sharedKey;
 	};
 
+	// Shared image table (see sharedImages).  The table holds a reference
+	// on each context, keyed by the lower-case file name, pixel size, mip
+	// mode, and file modification time.  The entry is removed when the
+	// last sprite using the context lets go of it.  Loads can run on
+	// background threads, so the table is protected by a lock.
+	static std::unordered_map<TSTRING, RefPtr<LoadContext>> sharedImageTable;
+	static CriticalSection sharedImageLock;
+
+	// Try adopting a shared image for a file load.  Returns true if we
+	// found one, in which case the load is complete.
+	bool AdoptSharedImage(const TSTRING &key, POINTF normalizedSize, ErrorHandler &eh, const WCHAR *filename);
+
+	// add our load context to the shared image table under the given key
+	void AddSharedImage(const TSTRING &key);
+
+	// Drop our reference on the load context, removing it from the shared
+	// image table if we were the last sprite using it
+	void ReleaseLoadContext();
+
 	// If we have an animated image, we'll allocate a media cookie
 	// for it, as though it were using a video or audio player.
 	// This lets us generate AVP messages related to the animation
@@ -314,6 +631,58 @@ protected:
 	// current loading context
 	RefPtr<LoadContext> loadContext;
 
+	// Direct2D drawing surface, from the last LoadD2D().  This holds the
+	// load context with the render target texture, and the render target
+	// that draws into it.
+	struct D2DSurface
+	{
+		RefPtr<LoadContext> loadContext;
+		RefPtr<ID2D1RenderTarget> target;
+		int width = 0;
+		int height = 0;
+
+		void Reset()
+		{
+			loadContext = nullptr;
+			target = nullptr;
+			width = height = 0;
+		}
+	};
+	D2DSurface d2dSurface;
+
+	// GDI drawing surface, from the last GDI drawing Load().  This holds
+	// the load context with the texture, and a hash of each pixel row as
+	// of the last upload, so that a redraw can find the rows that changed.
+	// The off-screen bitmap is only kept once the sprite has been redrawn
+	// at the same size, so that the many sprites that are only drawn once
+	// don't hold onto a system memory copy of their pixels.
+	struct GdiSurface
+	{
+		RefPtr<LoadContext> loadContext;
+		DIBitmap dib;
+		int width = 0;
+		int height = 0;
+		std::vector<UINT64> rowHash;
+		INT64 dibBytes = 0;  // off-screen bitmap size, for the memory statistics
+
+		~GdiSurface() { Reset(); }
+
+		void Reset()
+		{
+			loadContext = nullptr;
+			dib.Clear();
+			width = height = 0;
+			rowHash.clear();
+			MemoryStats::AddCPU(MemoryStats::Sprites, -dibBytes);
+			dibBytes = 0;
+		}
+	};
+	GdiSurface gdiSurface;
+
+	// Upload a GDI drawing surface bitmap to the surface texture,
+	// creating the texture if necessary
+	bool UploadGdiSurface(const BITMAPINFO &bmi, const void *dibits, ErrorHandler &eh, const TCHAR *descForErrors);
+
 	// Message HWND.  This is the target window for any AVPxxx 
 	// messages we generate for animated media.
 	HWND msgHwnd;
@@ -379,7 +748,7 @@ protected:
 	// normally put into local variables controlling a loop
 	// and put them into a struct.  That's what this struct
 	// is about.
-	struct GIFLoaderState : Animation
+	struct GIFLoaderState : Animation, AnimSource
 	{
 		// Animation interface implementation
 		virtual ~GIFLoaderState() { Clear(); }
@@ -390,18 +759,32 @@ protected:
 				DecodeFrame(ctx);
 		}
 
+		// AnimSource implementation, for streaming playback
+		virtual bool DecodeNext(StreamFrame &frame) override;
+
+		// Open the file decoder.  A streaming source opens its own decoder
+		// on the decoder task's thread, since the loader pool threads are
+		// in a different COM apartment from the UI thread.  The decoder
+		// reads from the mapped view if we have one, otherwise it maps
+		// the file.
+		bool Open();
+
+		// Number of frames to decode without delivering them to the stream.
+		// This lets the stream's first source skip the frame that the
+		// sprite already displayed from the initial load.
+		UINT skipFrames = 0;
+
 		// initialize
-		void Init(IWICImagingFactory *pWIC, IWICBitmapDecoder *decoder, 
+		void Init(IWICImagingFactory *pWIC, IWICBitmapDecoder *decoder, MappedFile *view,
 			UINT width, UINT height, UINT nFrames, WICColor bgColor, const WCHAR *filename)
 		{
 			this->pWIC = pWIC;
 			this->decoder = decoder;
+			this->view = view;
 			this->rcFull = { 0, 0, static_cast<LONG>(width), static_cast<LONG>(height) };
 			this->nFrames = nFrames;
 			this->bgColor = bgColor;
 			this->filename = filename;
-
-			this->frames.reserve(nFrames);
 		}
 
 		// clear - releases resources when we're done
@@ -409,16 +792,21 @@ protected:
 		{
 			iFrame = nFrames = 0;
 			filename = _T("");
-			frames.clear();
+			lastImage.reset();
+			prevImage.reset();
 			pWIC = nullptr;
 			decoder = nullptr;
+			view = nullptr;
 		}
 
 		// WIC factory
 		RefPtr<IWICImagingFactory> pWIC;
 
-		// file decoder
+		// File decoder, and the mapped file contents it reads from.
+		// The decoder reads frames on demand, so we have to keep the
+		// view for as long as we keep the decoder.
 		RefPtr<IWICBitmapDecoder> decoder;
+		RefPtr<MappedFile> view;
 
 		// sprite file name, for error reporting
 		WSTRING filename;
@@ -432,18 +820,14 @@ protected:
 		// current frame number
 		UINT iFrame = 0;
 
-		// "Previous" frame number, for frame disposal purposes.
-		// One of the disposal codes is "revert to previous"; this
-		// keeps track of the frame that refers to.
-		UINT prevFrame = 0;
-
-		// Image frame history.  GIF specifies each frame
-		// as a difference from a previous frame, so we 
-		// need to keep a history of recent frames.  We
-		// actually only need the current frame and one
-		// prior frame, so we could make this more
-		// efficient, but for now we'll keep all frames.
-		std::vector<std::unique_ptr<DirectX::ScratchImage>> frames;
+		// Image frame history.  GIF specifies each frame as a
+		// difference from a previous frame, so we need to keep the
+		// last frame we composed, plus the "previous" frame for a
+		// frame with the "revert to previous" disposal code, which
+		// is the last frame that didn't use that code itself.  The
+		// two are often the same image, hence the shared pointers.
+		std::shared_ptr<DirectX::ScratchImage> lastImage;
+		std::shared_ptr<DirectX::ScratchImage> prevImage;
 
 		// GIF "Disposal" code for the prior frame
 		enum disposal_t {
@@ -459,32 +843,53 @@ protected:
 		// sub-frame rectangle for the current frame
 		RECT rcSub = { 0, 0, 0, 0 };
 
-		// Decode the next GIF frame
+		// Decode the next GIF frame, adding it to the context's frame list
 		void DecodeFrame(LoadContext *ctx);
+
+		// Decode and compose the next GIF frame into lastImage, and get
+		// its display time in milliseconds.  Returns false on error.
+		bool ComposeNextFrame(LONG &delay);
 	};
 
 	// Animated PNG incremental frame reader.  This is the PNG
 	// counterpart of the GIF frame reader: it keeps track of the
-	// read position in an open PNG file so that we can read one
+	// read position in a mapped PNG file so that we can read one
 	// frame at a time on demand.
-	struct APNGLoaderState : Animation
+	struct APNGLoaderState : Animation, AnimSource
 	{
 		// Animation interface implementation
-		virtual ~APNGLoaderState() { EndProcessing(); }
+		virtual ~APNGLoaderState();
 		virtual void DecodeNext(LoadContext *ctx) override;
 
-		// Initialize.  This opens the file and scans for the animated
-		// PNG marker chunk.  Returns true if we successfully identify
-		// this as an animated PNG, false if not.  On a false return,
-		// no errors are generated; the caller should simply fall back
-		// on the generic WIC loader, on the assumption that it's a
-		// conventional single-frame PNG file, an invalid PNG file, or
-		// some other image type - in any of those cases, the WIC loader
-		// can determine what to do with the file;
-		bool Init(Sprite *sprite, const WCHAR *filename, POINTF normalizedSize, SIZE pixSize);
-
-		// file handle
-		FILEPtrHolder fp;
+		// AnimSource implementation, for streaming playback
+		virtual bool DecodeNext(StreamFrame &frame) override;
+
+		// Initialize.  This opens the file, scans for the animated PNG
+		// marker chunk, and reads the first frame into frameCur.  Returns
+		// true if we successfully identify this as an animated PNG, false
+		// if not.  On a false return, no errors are generated; the caller
+		// should simply fall back on the generic WIC loader, on the
+		// assumption that it's a conventional single-frame PNG file, an
+		// invalid PNG file, or some other image type - in any of those
+		// cases, the WIC loader can determine what to do with the file.
+		// The first form maps the file; the second reads from a view
+		// that the caller has already mapped.
+		bool Init(const WCHAR *filename);
+		bool Init(MappedFile *view);
+
+		// Has frameCur been delivered to a stream yet?  A source that's
+		// freshly initialized has the first frame waiting in frameCur.
+		bool curFrameDelivered = false;
+
+		// mapped file contents, and the current read position
+		RefPtr<MappedFile> view;
+		long pos = 0;
+
+		// Read from the current position.  If the read would go past the
+		// end of the file, this moves the position to the end and fails,
+		// so that the chunk scanner sees the end of the file, as with
+		// fread() and feof().
+		bool Read(BYTE *buf, size_t len);
 
 		// sprite file name, for error reporting
 		WSTRING filename;
@@ -657,6 +1062,34 @@ protected:
 		// successfully found an image frame.
 		bool ReadThroughNextFrame();
 
+		// Parallel frame decoding.  Each APNG frame is a separately
+		// compressed image, so the expensive part of the work - inflating
+		// and unfiltering the pixel data - can be done for several frames
+		// at once.  After the first frame is read, StartParallelDecode()
+		// indexes the data chunks for the rest of the frames, and from then
+		// on, ReadThroughNextFrame() takes each frame from a decode job
+		// running ahead on the loader pool.  Composing the frames (the
+		// disposal and blend operations) still happens in order, as each
+		// frame is consumed.  If a job hasn't started by the time its frame
+		// is needed, the consumer simply runs it inline.
+		struct DecodeInfo;
+		struct FrameJob;
+		void StartParallelDecode();
+		bool ReadNextParallelFrame();
+		void QueueFrameJobs();
+		static bool DecodeFrameJob(const DecodeInfo *info, FrameJob *job);
+		static void RunFrameJob(const DecodeInfo *info, FrameJob *job);
+
+		// shared decoding information for the frame jobs
+		std::shared_ptr<DecodeInfo> decodeInfo;
+
+		// frame jobs, in file order; consumed entries are cleared
+		std::vector<std::shared_ptr<FrameJob>> frameJobs;
+
+		// next job to consume, and next job to submit to the loader pool
+		size_t nextJob = 0;
+		size_t nextJobToQueue = 0;
+
 		// Compose a frame
 		void ComposeFrame(BYTE **dst, const BYTE *const *src, UINT bop, UINT x, UINT y, UINT width, UINT height);
 
@@ -696,5 +1129,11 @@ protected:
 
 		// create an animation frame and add it to the sprite's frame list
 		bool CreateAnimFrame(LoadContext *ctx);
+
+		// create a texture from the current frame
+		bool CreateTexture(D3D11_USAGE usage, TextureAndView *tv);
+
+		// get the display time for the current frame, in milliseconds
+		DWORD GetFrameTime() const;
 	};
 };
@@ -0,0 +1,62 @@
+// This file is part of PinballY
+// Copyright 2018 Michael J Roberts | GPL v3 or later | NO WARRANTY
+//
+// Pre-rendered sprite cache
+
+#include "stdafx.h"
+#include "SpriteCache.h"
+
+// statics
+CacheHitStats SpriteCache::hitStats;
+
+SpriteCache::Entry::Entry(const TSTRING &key, Sprite *sprite, INT64 bytes) :
+	key(key), sprite(sprite, RefCounted::DoAddRef), bytes(bytes)
+{
+}
+
+Sprite *SpriteCache::Get(const TSTRING &key)
+{
+	for (auto it = entries.begin(); it != entries.end(); ++it)
+	{
+		if ((*it)->key == key)
+		{
+			// if it was evicted, it's no use to the caller
+			if ((*it)->sprite == nullptr)
+				break;
+
+			// move it to the front of the list, and note the use
+			if (it != entries.begin())
+				entries.splice(entries.begin(), entries, it);
+			entries.front()->Touch();
+			hitStats.Hit();
+			return entries.front()->sprite;
+		}
+	}
+
+	// not found
+	hitStats.Miss();
+	return nullptr;
+}
+
+bool SpriteCache::Contains(const TSTRING &key) const
+{
+	for (auto &e : entries)
+	{
+		if (e->key == key)
+			return e->sprite != nullptr;
+	}
+	return false;
+}
+
+void SpriteCache::Add(const TSTRING &key, Sprite *sprite, INT64 bytes)
+{
+	// remove any existing entry for the key
+	entries.remove_if([&key](const std::unique_ptr<Entry> &e) { return e->key == key; });
+
+	// make room for the new entry
+	while (entries.size() >= maxEntries && entries.size() != 0)
+		entries.pop_back();
+
+	// add the new entry at the front
+	entries.emplace_front(new Entry(key, sprite, bytes));
+}
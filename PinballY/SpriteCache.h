@@ -0,0 +1,71 @@
+// This file is part of PinballY
+// Copyright 2018 Michael J Roberts | GPL v3 or later | NO WARRANTY
+//
+// Pre-rendered sprite cache
+//
+// This is a small in-memory cache of sprites that we render ahead of
+// time, such as the Game Info box and instruction card for the games
+// around the current wheel selection, so that the popup can appear
+// immediately when the user asks for it.  Entries are keyed by a
+// caller-defined string, which should capture everything the sprite's
+// appearance depends upon, so that a stale entry simply never matches.
+//
+// The cache holds at most a fixed number of entries, discarding the
+// least recently used entry to make room for a new one.  Each entry
+// also registers with the texture budget as an evictable object, so
+// when texture memory is short, the budget enforcer can release cold
+// entries across all of the caches, in LRU order.  An evicted entry
+// stays in the list with no sprite until it's reused or pushed out.
+//
+// The cache is only accessed on the UI thread.
+
+#pragma once
+#include <list>
+#include <memory>
+#include "TextureBudget.h"
+#include "Sprite.h"
+#include "CacheStats.h"
+
+class SpriteCache
+{
+public:
+	SpriteCache(size_t maxEntries) : maxEntries(maxEntries) { }
+
+	// Look up an entry.  Returns the sprite (without adding a reference)
+	// if found, or null if there's no entry or it has been evicted.  This
+	// counts as a use of the entry for LRU purposes.
+	Sprite *Get(const TSTRING &key);
+
+	// is there a live entry for the key?
+	bool Contains(const TSTRING &key) const;
+
+	// Add a sprite, replacing any existing entry for the key.  'bytes'
+	// is the sprite's approximate texture size, for the budget.
+	void Add(const TSTRING &key, Sprite *sprite, INT64 bytes);
+
+	// discard all entries
+	void Clear() { entries.clear(); }
+
+	// hit statistics for Get(), combined across all of the caches
+	static CacheHitStats hitStats;
+
+protected:
+	struct Entry : TextureBudget::Evictable
+	{
+		Entry(const TSTRING &key, Sprite *sprite, INT64 bytes);
+		~Entry() { Unregister(); }
+
+		virtual INT64 GetEvictableBytes() const override { return sprite != nullptr ? bytes : 0; }
+		virtual void Evict() override { sprite = nullptr; }
+
+		TSTRING key;
+		RefPtr<Sprite> sprite;
+		INT64 bytes;
+	};
+
+	// entries, most recently used first
+	std::list<std::unique_ptr<Entry>> entries;
+
+	// maximum number of entries
+	size_t maxEntries;
+};
@@ -0,0 +1,161 @@
+// This file is part of PinballY
+// Copyright 2018 Michael J Roberts | GPL v3 or later | NO WARRANTY
+//
+// Startup task scheduler
+
+#include "stdafx.h"
+#include "StartupTasks.h"
+#include "StartupTimeline.h"
+#include "LogFile.h"
+
+// statics
+std::list<std::unique_ptr<StartupTasks::Task>> StartupTasks::tasks;
+HWND StartupTasks::hwndUi = NULL;
+UINT StartupTasks::uiMsg = 0;
+CriticalSection StartupTasks::uiLock;
+
+void StartupTasks::Add(const CHAR *name, std::vector<const CHAR*> deps,
+	std::function<void()> run, std::function<void()> onDone)
+{
+	// set up the task
+	auto task = new Task(name, run);
+	tasks.emplace_back(task);
+	if (onDone != nullptr)
+		task->onDone.emplace_back(onDone);
+
+	// resolve the dependencies
+	for (auto dep : deps)
+	{
+		if (auto t = Find(dep); t != nullptr)
+			task->deps.push_back(t);
+	}
+
+	// create the completion event (manual reset, so that any number of
+	// waiters see it)
+	task->hDoneEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+
+	// launch the worker thread
+	DWORD tid;
+	task->hThread = CreateThread(NULL, 0, &ThreadMain, task, 0, &tid);
+
+	// if the thread launch failed, just run the task inline
+	if (task->hThread == NULL)
+	{
+		LogFile::Get()->Write(_T("Startup: unable to start a thread for %hs; running it on the main thread\n"), name);
+		ThreadMain(task);
+	}
+}
+
+StartupTasks::Task *StartupTasks::Find(const CHAR *name)
+{
+	for (auto &t : tasks)
+	{
+		if (strcmp(t->name, name) == 0)
+			return t.get();
+	}
+	return nullptr;
+}
+
+DWORD WINAPI StartupTasks::ThreadMain(LPVOID lParam)
+{
+	auto task = static_cast<Task*>(lParam);
+
+	// wait for the dependencies
+	for (auto dep : task->deps)
+		WaitForSingleObject(dep->hDoneEvent, INFINITE);
+
+	// run the task, timing it for the startup timeline
+	{
+		StartupTimeline::Phase phase(task->name);
+		task->run();
+	}
+
+	// signal completion
+	SetEvent(task->hDoneEvent);
+
+	// notify the UI window, if it's set up yet
+	CriticalSectionLocker locker(uiLock);
+	if (hwndUi != NULL)
+		PostMessage(hwndUi, uiMsg, 0, 0);
+
+	return 0;
+}
+
+void StartupTasks::Join(const CHAR *name)
+{
+	if (auto task = Find(name); task != nullptr)
+	{
+		WaitForSingleObject(task->hDoneEvent, INFINITE);
+		Dispatch(task);
+	}
+}
+
+bool StartupTasks::IsDone(const CHAR *name)
+{
+	auto task = Find(name);
+	return task == nullptr || WaitForSingleObject(task->hDoneEvent, 0) == WAIT_OBJECT_0;
+}
+
+void StartupTasks::WhenDone(const CHAR *name, std::function<void()> fn)
+{
+	if (auto task = Find(name); task != nullptr && !task->dispatched)
+		task->onDone.emplace_back(fn);
+	else
+		fn();
+}
+
+void StartupTasks::SetUiWindow(HWND hwnd, UINT msg)
+{
+	CriticalSectionLocker locker(uiLock);
+	hwndUi = hwnd;
+	uiMsg = msg;
+
+	// post a message right away, to pick up any tasks that finished
+	// before the window was set
+	if (hwnd != NULL)
+		PostMessage(hwnd, msg, 0, 0);
+}
+
+void StartupTasks::OnUiMessage()
+{
+	for (auto &t : tasks)
+	{
+		if (!t->dispatched && WaitForSingleObject(t->hDoneEvent, 0) == WAIT_OBJECT_0)
+			Dispatch(t.get());
+	}
+}
+
+void StartupTasks::Dispatch(Task *task)
+{
+	if (!task->dispatched)
+	{
+		// Mark it as dispatched first, so that a callback that joins 
+		// the same task doesn't recurse.  Callbacks can also add more
+		// callbacks via WhenDone(), which will run them immediately now
+		// that the task is marked.
+		task->dispatched = true;
+		std::list<std::function<void()>> callbacks;
+		callbacks.swap(task->onDone);
+		for (auto &cb : callbacks)
+			cb();
+	}
+}
+
+void StartupTasks::Shutdown()
+{
+	// stop sending completion messages
+	{
+		CriticalSectionLocker locker(uiLock);
+		hwndUi = NULL;
+	}
+
+	// wait for the threads to finish
+	for (auto &t : tasks)
+	{
+		if (t->hThread != NULL)
+			WaitForSingleObject(t->hThread, INFINITE);
+	}
+
+	// discard the tasks
+	tasks.clear();
+}
@@ -0,0 +1,103 @@
+// This file is part of PinballY
+// Copyright 2018 Michael J Roberts | GPL v3 or later | NO WARRANTY
+//
+// Startup task scheduler
+//
+// This runs the independent parts of program startup concurrently on
+// background threads, so that slow subsystems don't hold up the UI.
+// Each task has a name, a list of other tasks it depends on, a body
+// that runs on a worker thread, and optional completion callbacks that
+// run on the UI thread after the body finishes.
+//
+// A task's body starts as soon as all of its dependencies have finished.
+// The UI thread finds out about finished tasks in one of two ways:
+//
+//  - Join(name) waits for the task to finish.  Use this before any code
+//    that needs the task's results, so that the UI code that depends on
+//    a task doesn't need to know whether or not it's done yet.
+//
+//  - Once the main window is open, the scheduler posts a message to it
+//    as each task finishes (see SetUiWindow()), and the window calls
+//    OnUiMessage() to run the completion callbacks.
+//
+// Either way, a task's completion callbacks run exactly once, on the UI
+// thread.  A task name that was never added counts as complete, so
+// Join() and WhenDone() can be used freely outside of startup.
+//
+// Task bodies are timed as phases on the startup timeline (see
+// StartupTimeline.h).  Task names must be static strings.
+
+#pragma once
+#include <functional>
+#include <list>
+#include <memory>
+#include <vector>
+#include "../Utilities/WinUtil.h"
+
+class StartupTasks
+{
+public:
+	// Add a task.  The body runs on a new worker thread once the named
+	// dependencies have finished; the dependencies must have been added
+	// already.  'onDone', if provided, runs on the UI thread when the
+	// task is joined or its completion message arrives.
+	static void Add(const CHAR *name, std::vector<const CHAR*> deps, 
+		std::function<void()> run, std::function<void()> onDone = nullptr);
+
+	// Wait for a task to finish, and run its completion callbacks if
+	// they haven't run yet.  Call this on the UI thread only.
+	static void Join(const CHAR *name);
+
+	// Is the task finished?  This is true for a task that was never added.
+	static bool IsDone(const CHAR *name);
+
+	// Run a callback on the UI thread when a task has finished.  If it's
+	// already finished and its completion callbacks have run, this runs
+	// the callback immediately.
+	static void WhenDone(const CHAR *name, std::function<void()> fn);
+
+	// Set the window to notify as tasks finish.  When a task finishes, we
+	// post 'msg' to the window, and the window should call OnUiMessage().
+	static void SetUiWindow(HWND hwnd, UINT msg);
+
+	// Handle a completion message in the UI window
+	static void OnUiMessage();
+
+	// Wait for all tasks to finish and discard them.  This is called at
+	// program exit.
+	static void Shutdown();
+
+protected:
+	struct Task
+	{
+		Task(const CHAR *name, std::function<void()> run) : name(name), run(run) { }
+
+		const CHAR *name;                          // task name
+		std::vector<Task*> deps;                   // dependencies
+		std::function<void()> run;                 // body, run on the worker thread
+		std::list<std::function<void()>> onDone;   // completion callbacks, run on the UI thread
+		HandleHolder hThread;                      // worker thread
+		HandleHolder hDoneEvent;                   // set when the body finishes
+		bool dispatched = false;                   // have the completion callbacks run?
+	};
+
+	// find a task by name; returns null if there's no such task
+	static Task *Find(const CHAR *name);
+
+	// worker thread entrypoint
+	static DWORD WINAPI ThreadMain(LPVOID lParam);
+
+	// run a finished task's completion callbacks, if we haven't already
+	static void Dispatch(Task *task);
+
+	// Tasks.  These are only added and removed on the UI thread, so
+	// the list itself doesn't need locking; the worker threads only 
+	// access their own tasks and their dependencies' events, which
+	// stay put until Shutdown() joins the threads.
+	static std::list<std::unique_ptr<Task>> tasks;
+
+	// UI window and completion message
+	static HWND hwndUi;
+	static UINT uiMsg;
+	static CriticalSection uiLock;
+};
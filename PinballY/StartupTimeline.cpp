@@ -0,0 +1,313 @@
+// This file is part of PinballY
+// Copyright 2018 Michael J Roberts | GPL v3 or later | NO WARRANTY
+//
+// Startup timeline profiler
+
+#include "stdafx.h"
+#include <unordered_map>
+#include <algorithm>
+#include "../Utilities/FileUtil.h"
+#include "../Utilities/DateUtil.h"
+#include "StartupTimeline.h"
+#include "CSVFile.h"
+#include "LogFile.h"
+#include "VersionInfo.h"
+
+// statics
+bool StartupTimeline::active = false;
+int64_t StartupTimeline::tOrigin = 0;
+int64_t StartupTimeline::freq = 1;
+DWORD StartupTimeline::mainThreadId = 0;
+thread_local int StartupTimeline::depth = 0;
+std::vector<StartupTimeline::Record> StartupTimeline::records;
+std::vector<StartupTimeline::Window> StartupTimeline::windows;
+int64_t StartupTimeline::tFirstFrameWait = 0;
+CriticalSection StartupTimeline::lock;
+
+void StartupTimeline::Begin()
+{
+	LARGE_INTEGER f;
+	QueryPerformanceFrequency(&f);
+	freq = f.QuadPart;
+	tOrigin = Trace::Now();
+	mainThreadId = GetCurrentThreadId();
+	active = true;
+}
+
+StartupTimeline::Phase::Phase(const CHAR *name, const WCHAR *detail) :
+	trace(name, "startup", detail), name(name), t0(Trace::Now()), active(StartupTimeline::active)
+{
+	if (active)
+		++depth;
+}
+
+void StartupTimeline::Phase::End()
+{
+	if (active)
+	{
+		active = false;
+		--depth;
+		AddRecord(name, t0, Trace::Now(), depth);
+	}
+	trace.End();
+}
+
+void StartupTimeline::AddRecord(const CHAR *name, int64_t t0, int64_t t1, int depth)
+{
+	CriticalSectionLocker locker(lock);
+	if (active)
+		records.push_back({ name, t0, t1, depth, GetCurrentThreadId() });
+}
+
+void StartupTimeline::ExpectFirstFrame(HWND hwnd, const CHAR *name)
+{
+	if (active && hwnd != NULL)
+		windows.emplace_back(hwnd, name);
+}
+
+void StartupTimeline::WaitForFirstFrames()
+{
+	if (!active)
+		return;
+
+	// if there's nothing to wait for, we're done now
+	tFirstFrameWait = Trace::Now();
+	if (windows.size() == 0)
+		Finish(tFirstFrameWait);
+}
+
+void StartupTimeline::OnPresent(HWND hwnd)
+{
+	// ignore frames presented before we started waiting (these can
+	// happen during startup, if a message box runs a modal loop)
+	if (!active || tFirstFrameWait == 0)
+		return;
+
+	// record the window's first frame
+	int64_t now = Trace::Now();
+	bool done = true;
+	for (auto &w : windows)
+	{
+		if (w.hwnd == hwnd && !w.presented)
+		{
+			w.presented = true;
+			AddRecord(w.name, tFirstFrameWait, now, 0);
+		}
+		done &= w.presented;
+	}
+
+	// finish up when all of the windows have presented, or when we've
+	// waited too long
+	if (done)
+	{
+		Finish(now);
+	}
+	else if (static_cast<double>(now - tFirstFrameWait) * 1000.0 / static_cast<double>(freq) > firstFrameTimeout_ms)
+	{
+		for (auto &w : windows)
+		{
+			if (!w.presented)
+				LogFile::Get()->Write(_T("Startup timeline: %hs never arrived\n"), w.name);
+		}
+		Finish(now);
+	}
+}
+
+void StartupTimeline::Finish(int64_t tEnd)
+{
+	// stop recording, and take the records
+	std::vector<Record> recs;
+	{
+		CriticalSectionLocker locker(lock);
+		active = false;
+		recs.swap(records);
+	}
+	windows.clear();
+
+	// trace the overall startup time
+	Trace::Interval("Startup", "startup", tOrigin, tEnd);
+
+	// sort by starting time, and by nesting depth for phases that start
+	// at the same time
+	std::stable_sort(recs.begin(), recs.end(), [](const Record &a, const Record &b) {
+		return a.t0 < b.t0 || (a.t0 == b.t0 && a.depth < b.depth); });
+
+	// log the timeline
+	auto lf = LogFile::Get();
+	double total_ms = Ms(tEnd);
+	lf->Group();
+	lf->Write(_T("Startup timeline: %.0f ms from program start to the last first frame\n"), total_ms);
+	lf->Write(_T("     start        end   duration\n"));
+	for (auto &r : recs)
+	{
+		lf->Write(_T("  %9.1f  %9.1f  %9.1f  %hs%hs%s\n"),
+			Ms(r.t0), Ms(r.t1), Ms(r.t1) - Ms(r.t0), std::string(r.depth * 2, ' ').c_str(), r.name,
+			r.tid != mainThreadId ? _T(" [background thread]") : _T(""));
+	}
+
+	// Find the critical path.  Work backwards from the end: at each step,
+	// take the top-level phase that ended last before the current point.
+	// If several phases ended at about the same time, take the one that
+	// started first; this follows the path through a background phase
+	// rather than through the main thread's wait for it.
+	const int64_t tol = freq / 500;
+	std::vector<const Record*> path;
+	std::vector<bool> used(recs.size());
+	double untracked_ms = 0.0;
+	for (int64_t t = tEnd; ; )
+	{
+		// find the latest ending time before the current point
+		int64_t maxEnd = INT64_MIN;
+		for (size_t i = 0; i < recs.size(); ++i)
+		{
+			if (recs[i].depth == 0 && !used[i] && recs[i].t1 <= t + tol)
+				maxEnd = max(maxEnd, recs[i].t1);
+		}
+
+		// if there are no more phases, count the rest as untracked
+		if (maxEnd == INT64_MIN)
+		{
+			untracked_ms += Ms(t);
+			break;
+		}
+
+		// among the phases that ended about then, take the earliest start
+		size_t best = recs.size();
+		for (size_t i = 0; i < recs.size(); ++i)
+		{
+			if (recs[i].depth == 0 && !used[i] && recs[i].t1 <= t + tol && recs[i].t1 >= maxEnd - tol
+				&& (best == recs.size() || recs[i].t0 < recs[best].t0))
+				best = i;
+		}
+
+		// add it to the path, counting any gap as untracked time
+		if (recs[best].t1 < t)
+			untracked_ms += Ms(t) - Ms(recs[best].t1);
+		used[best] = true;
+		path.push_back(&recs[best]);
+		t = min(t, recs[best].t0);
+	}
+
+	// log the critical path, in forward order
+	TSTRINGEx pathStr;
+	for (auto it = path.rbegin(); it != path.rend(); ++it)
+	{
+		if (pathStr.length() != 0)
+			pathStr += _T(" > ");
+		pathStr += MsgFmt(_T("%hs %.0f ms"), (*it)->name, Ms((*it)->t1) - Ms((*it)->t0)).Get();
+	}
+	lf->Write(_T("Critical path: %s; untracked time %.0f ms\n"), pathStr.c_str(), untracked_ms);
+
+	// total up the time for each phase name, for the history
+	std::vector<std::pair<const CHAR*, double>> phaseTimes;
+	for (auto &r : recs)
+	{
+		auto it = std::find_if(phaseTimes.begin(), phaseTimes.end(), [&r](const std::pair<const CHAR*, double> &p) {
+			return strcmp(p.first, r.name) == 0; });
+		if (it == phaseTimes.end())
+			it = phaseTimes.emplace(phaseTimes.end(), r.name, 0.0);
+		it->second += Ms(r.t1) - Ms(r.t0);
+	}
+
+	// compare against past sessions, and save this one
+	UpdateHistory(phaseTimes, total_ms);
+	lf->Group();
+}
+
+void StartupTimeline::UpdateHistory(const std::vector<std::pair<const CHAR*, double>> &phaseTimes, double total_ms)
+{
+	// load the history file - <program folder>\StartupTimes.csv
+	CSVFile csv;
+	auto dateCol = csv.DefineColumn(_T("Date"));
+	auto versionCol = csv.DefineColumn(_T("Version"));
+	auto totalCol = csv.DefineColumn(_T("Total"));
+	auto phasesCol = csv.DefineColumn(_T("Phases"));
+	TCHAR fname[MAX_PATH];
+	GetDeployedFilePath(fname, _T("StartupTimes.csv"), _T(""));
+	csv.SetFile(fname);
+	if (FileExists(fname))
+		csv.Read(SilentErrorHandler());
+
+	// parse a row's phase list, "name=ms;name=ms;..."
+	auto ParsePhases = [phasesCol](int row, std::unordered_map<TSTRING, double> &m)
+	{
+		for (auto &p : TSTRINGEx(phasesCol->Get(row, _T(""))).Split(';'))
+		{
+			if (size_t eq = p.find('='); eq != TSTRING::npos)
+				m[p.substr(0, eq)] = _ttof(p.c_str() + eq + 1);
+		}
+	};
+
+	// Compare this session against the average of a set of past rows.
+	// We only mention phases that changed by at least 50 ms and 10%, to
+	// keep the list down to the differences that matter.
+	auto lf = LogFile::Get();
+	auto Compare = [&](const TCHAR *label, const std::vector<int> &rows)
+	{
+		if (rows.size() == 0)
+			return;
+
+		// average the past totals and phase times
+		double n = static_cast<double>(rows.size());
+		double avgTotal = 0.0;
+		std::unordered_map<TSTRING, double> avg;
+		for (int row : rows)
+		{
+			avgTotal += totalCol->GetFloat(row, 0.0f) / n;
+			std::unordered_map<TSTRING, double> m;
+			ParsePhases(row, m);
+			for (auto &p : m)
+				avg[p.first] += p.second / n;
+		}
+
+		lf->Write(_T("Compared with %s: total %.0f ms vs %.0f ms (%+.0f ms)\n"),
+			label, total_ms, avgTotal, total_ms - avgTotal);
+		for (auto &p : phaseTimes)
+		{
+			if (auto it = avg.find(AnsiToTSTRING(p.first)); it != avg.end())
+			{
+				double delta = p.second - it->second;
+				if (fabs(delta) >= 50.0 && fabs(delta) >= it->second * 0.1)
+					lf->Write(_T("    %hs: %.0f ms vs %.0f ms (%+.0f ms)\n"), p.first, p.second, it->second, delta);
+			}
+		}
+	};
+
+	// compare against the recent sessions with this version
+	TSTRING version = AnsiToTSTRING(G_VersionInfo.fullVerWithStat);
+	std::vector<int> sameVersion;
+	for (int i = static_cast<int>(csv.GetNumRows()) - 1; i >= 0 && static_cast<int>(sameVersion.size()) < historyWindow; --i)
+	{
+		if (version == versionCol->Get(i, _T("")))
+			sameVersion.push_back(i);
+	}
+	Compare(MsgFmt(_T("the last %d session(s) of this version"), static_cast<int>(sameVersion.size())), sameVersion);
+
+	// compare against the most recent other version
+	TSTRING otherVersion;
+	std::vector<int> prevVersion;
+	for (int i = static_cast<int>(csv.GetNumRows()) - 1; i >= 0 && static_cast<int>(prevVersion.size()) < historyWindow; --i)
+	{
+		const TCHAR *v = versionCol->Get(i, _T(""));
+		if (otherVersion.length() == 0 && version != v)
+			otherVersion = v;
+		if (otherVersion.length() != 0 && otherVersion == v)
+			prevVersion.push_back(i);
+	}
+	Compare(MsgFmt(_T("version %s (%d session(s))"), otherVersion.c_str(), static_cast<int>(prevVersion.size())), prevVersion);
+
+	// add this session
+	TSTRING phases;
+	for (auto &p : phaseTimes)
+	{
+		if (phases.length() != 0)
+			phases += _T(";");
+		phases += MsgFmt(_T("%hs=%.1f"), p.first, p.second).Get();
+	}
+	int row = csv.CreateRow();
+	dateCol->Set(row, DateTime().ToString().c_str());
+	versionCol->Set(row, version.c_str());
+	totalCol->Set(row, static_cast<float>(total_ms));
+	phasesCol->Set(row, phases.c_str());
+	csv.WriteIfDirtyInBackground();
+}
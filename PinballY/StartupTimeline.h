@@ -0,0 +1,140 @@
+// This file is part of PinballY
+// Copyright 2018 Michael J Roberts | GPL v3 or later | NO WARRANTY
+//
+// Startup timeline profiler
+//
+// This measures where the time goes during program startup.  The main
+// startup steps are marked with Phase objects, which record the start
+// and end times of each phase, relative to the start of the program.
+// Phases can nest (the Javascript engine setup is part of Javascript
+// initialization, for example), and they can run on background threads
+// (DOF initialization, for example).
+//
+// Startup counts as complete when every visible window has presented
+// its first frame.  At that point, we write the timeline to the log,
+// along with the critical path: the chain of top-level phases, working
+// back from the last first frame, that determined the total startup
+// time.  Background phases only show up on the critical path if the
+// main thread had to wait for them, since that's the only way they can
+// delay the first frames.
+//
+// Each session's phase times are also saved in StartupTimes.csv in the
+// program folder, with the program version, and compared against the
+// recent sessions with the same version and against the most recent
+// prior version, so that regressions stand out.
+//
+// Phases are also written to the performance trace (see Trace.h).
+// Phase names must be static strings.
+
+#pragma once
+#include <stdint.h>
+#include <vector>
+#include "../Utilities/WinUtil.h"
+#include "Trace.h"
+
+class StartupTimeline
+{
+public:
+	// Start the timeline.  Call this at the very start of the program.
+	static void Begin();
+
+	// Is the timeline still recording?
+	static bool IsActive() { return active; }
+
+	// Startup phase.  Create one of these on the stack to time the
+	// enclosing scope (or until End() is called).  Phases created after
+	// startup is complete, as for a config reload, are only traced.
+	class Phase
+	{
+	public:
+		Phase(const CHAR *name, const WCHAR *detail = nullptr);
+		~Phase() { End(); }
+
+		// end the phase explicitly
+		void End();
+
+	protected:
+		Trace::Scope trace;
+		const CHAR *name;
+		int64_t t0;
+		bool active;
+	};
+
+	// Expect a first frame from a window.  Call this for each visible
+	// window once the windows are open.  'name' is a static phase name
+	// for the window's first frame.
+	static void ExpectFirstFrame(HWND hwnd, const CHAR *name);
+
+	// Start waiting for the first frames.  Call this after setting up
+	// the expected windows, just before entering the message loop.
+	static void WaitForFirstFrames();
+
+	// Note a frame presentation in a window.  This is called from the
+	// D3D view after each Present() while the timeline is active.
+	static void OnPresent(HWND hwnd);
+
+protected:
+	// recorded phase
+	struct Record
+	{
+		const CHAR *name;   // phase name
+		int64_t t0;         // start time, QPC ticks
+		int64_t t1;         // end time, QPC ticks
+		int depth;          // nesting depth on its thread
+		DWORD tid;          // thread ID
+	};
+
+	// add a record
+	static void AddRecord(const CHAR *name, int64_t t0, int64_t t1, int depth);
+
+	// finish the timeline: log the results and save the history
+	static void Finish(int64_t tEnd);
+
+	// log the comparisons against past sessions, and add this session
+	// to the history file
+	static void UpdateHistory(const std::vector<std::pair<const CHAR*, double>> &phaseTimes, double total_ms);
+
+	// convert QPC ticks to milliseconds from the start of the program
+	static double Ms(int64_t t) { return static_cast<double>(t - tOrigin) * 1000.0 / static_cast<double>(freq); }
+
+	// are we still recording?
+	static bool active;
+
+	// starting time and QPC frequency
+	static int64_t tOrigin;
+	static int64_t freq;
+
+	// main (UI) thread ID
+	static DWORD mainThreadId;
+
+	// phase nesting depth on the current thread
+	static thread_local int depth;
+
+	// recorded phases
+	static std::vector<Record> records;
+
+	// windows we're waiting on for first frames
+	struct Window
+	{
+		Window(HWND hwnd, const CHAR *name) : hwnd(hwnd), name(name) { }
+		HWND hwnd;
+		const CHAR *name;
+		bool presented = false;
+	};
+	static std::vector<Window> windows;
+
+	// time we started waiting for first frames, or 0 if we haven't yet
+	static int64_t tFirstFrameWait;
+
+	// Maximum time to wait for the first frames.  A window that's been
+	// minimized, or covered by a game that started from the command line,
+	// might not render for a long time, so we give up after a while and
+	// log what we have.
+	static const int firstFrameTimeout_ms = 30000;
+
+	// number of past sessions to average for the comparisons
+	static const int historyWindow = 10;
+
+	// lock, for phases recorded on background threads
+	static CriticalSection lock;
+};
@@ -20,6 +20,9 @@ using namespace DirectX;
 // TextDraw - text drawing handler
 //
 
+// statics
+std::unordered_map<TSTRING, TextDraw::SharedFont> TextDraw::sharedFonts;
+
 TextDraw::TextDraw()
 {
 	shader = 0;
@@ -30,9 +33,15 @@ TextDraw::~TextDraw()
 	// clear the text item list
 	Clear();
 
-	// clear the font cache
+	// release our shared font references
 	for (auto it = fontCache.begin(); it != fontCache.end(); ++it)
-		delete it->second;
+	{
+		if (auto sf = sharedFonts.find(it->first); sf != sharedFonts.end() && --sf->second.refCnt == 0)
+		{
+			delete sf->second.font;
+			sharedFonts.erase(sf);
+		}
+	}
 	fontCache.clear();
 
 	// delete our text shader
@@ -54,19 +63,143 @@ void TextDraw::Render(Camera *camera)
 {
 	D3D *d3d = D3D::Get();
 
+	// the window now reflects the current item list
+	dirty = false;
+
+	// Build the batch.  Gather the quads for all of the items, and note
+	// the runs of consecutive items that share a font and color, since
+	// each run can be drawn with a single call.
+	struct Run
+	{
+		ID3D11ShaderResourceView *srv;
+		XMFLOAT4 color;
+		UINT firstQuad;
+		UINT nQuads;
+	};
+	std::vector<Run> runs;
+	batchVertices.clear();
+	for (auto item : items)
+	{
+		UINT firstQuad = static_cast<UINT>(batchVertices.size() / 4);
+		item->AppendVertices(batchVertices);
+		UINT nQuads = static_cast<UINT>(batchVertices.size() / 4) - firstQuad;
+		if (nQuads == 0)
+			continue;
+
+		auto &c = item->GetColor();
+		if (runs.size() != 0 && runs.back().srv == item->GetShaderResourceView()
+			&& memcmp(&runs.back().color, &c, sizeof(c)) == 0)
+			runs.back().nQuads += nQuads;
+		else
+			runs.push_back({ item->GetShaderResourceView(), c, firstQuad, nQuads });
+	}
+
+	// if there's nothing to draw, we're done
+	UINT nQuads = static_cast<UINT>(batchVertices.size() / 4);
+	if (nQuads == 0 || !ReserveBatch(nQuads))
+		return;
+
+	// upload the vertices
+	{
+		D3D::DeviceContextLocker ctx;
+		D3D11_MAPPED_SUBRESOURCE m;
+		if (FAILED(ctx->Map(batchVertexBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &m)))
+			return;
+		memcpy(m.pData, batchVertices.data(), batchVertices.size() * sizeof(TextVertexType));
+		ctx->Unmap(batchVertexBuffer, 0);
+	}
+
 	// turn off the depth stencil
 	d3d->SetUseDepthStencil(false);
 
 	// set up rendering the shader
 	shader->PrepareForRendering(camera);
 
-	// draw each item in the list
-	for (auto it = items.begin(); it != items.end(); ++it)
-		(*it)->Render(shader);
+	// the vertices are already in window coordinates
+	d3d->UpdateWorldTransform(XMMatrixIdentity());
+
+	// load the batch buffers
+	d3d->SetTriangleTopology();
+	d3d->IASetVertexBuffer(batchVertexBuffer, sizeof(TextVertexType));
+	d3d->IASetIndexBuffer(batchIndexBuffer);
+
+	// draw the runs
+	for (auto &run : runs)
+	{
+		d3d->PSSetShaderResources(0, 1, &run.srv);
+		shader->SetColor(run.color);
+		d3d->DrawIndexed(run.nQuads * 6, run.firstQuad * 6);
+	}
+}
+
+bool TextDraw::ReserveBatch(UINT nQuads)
+{
+	// if we already have room, there's nothing to do
+	if (nQuads <= batchQuadCapacity)
+		return true;
+
+	// The indices are WORDs, so we can address at most 64K vertices,
+	// or 16K quads.  That's far more text than we ever display at once.
+	const UINT maxQuads = 65536 / 4;
+	if (nQuads > maxQuads)
+		return false;
+
+	// grow in powers of two, to minimize reallocations
+	UINT newCapacity = batchQuadCapacity != 0 ? batchQuadCapacity : 64;
+	while (newCapacity < nQuads)
+		newCapacity *= 2;
+	newCapacity = min(newCapacity, maxQuads);
+
+	// create the dynamic vertex buffer
+	D3D *d3d = D3D::Get();
+	D3D11_BUFFER_DESC bd;
+	ZeroMemory(&bd, sizeof(bd));
+	bd.Usage = D3D11_USAGE_DYNAMIC;
+	bd.ByteWidth = newCapacity * 4 * sizeof(TextVertexType);
+	bd.BindFlags = D3D11_BIND_VERTEX_BUFFER;
+	bd.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+	RefPtr<ID3D11Buffer> vb;
+	if (FAILED(d3d->CreateBuffer(&bd, &vb, "TextDraw::batchVertexBuffer")))
+		return false;
+
+	// build the index list - two triangles per quad
+	std::vector<WORD> indices;
+	indices.reserve(newCapacity * 6);
+	for (UINT i = 0, nv = 0; i < newCapacity; ++i, nv += 4)
+	{
+		indices.push_back(static_cast<WORD>(nv + 0));
+		indices.push_back(static_cast<WORD>(nv + 1));
+		indices.push_back(static_cast<WORD>(nv + 2));
+		indices.push_back(static_cast<WORD>(nv + 2));
+		indices.push_back(static_cast<WORD>(nv + 3));
+		indices.push_back(static_cast<WORD>(nv + 0));
+	}
+
+	// create the index buffer
+	ZeroMemory(&bd, sizeof(bd));
+	bd.Usage = D3D11_USAGE_IMMUTABLE;
+	bd.ByteWidth = static_cast<UINT>(indices.size() * sizeof(WORD));
+	bd.BindFlags = D3D11_BIND_INDEX_BUFFER;
+	D3D11_SUBRESOURCE_DATA sd;
+	ZeroMemory(&sd, sizeof(sd));
+	sd.pSysMem = indices.data();
+	RefPtr<ID3D11Buffer> ib;
+	if (FAILED(d3d->CreateBuffer(&bd, &sd, &ib, "TextDraw::batchIndexBuffer")))
+		return false;
+
+	// success - switch to the new buffers
+	batchVertexBuffer.Attach(vb.Detach());
+	batchIndexBuffer.Attach(ib.Detach());
+	batchQuadCapacity = newCapacity;
+	return true;
 }
 
 void TextDraw::Clear()
 {
+	// if there's anything in the list, removing it changes the display
+	if (items.size() != 0)
+		dirty = true;
+
 	// discard the meshes in our list
 	while (items.size() != 0)
 	{
@@ -98,6 +231,14 @@ TextDrawFont *TextDraw::GetFont(const TCHAR *filename, ErrorHandler &handler)
 	if (it != fontCache.end())
 		return it->second;
 
+	// if another TextDraw has already loaded it, share that copy
+	if (auto sf = sharedFonts.find(filename); sf != sharedFonts.end())
+	{
+		sf->second.refCnt += 1;
+		fontCache.emplace(std::make_pair(filename, sf->second.font));
+		return sf->second.font;
+	}
+
 	// it's not in the cache - load it
 	TextDrawFont *font = new TextDrawFont();
 	if (!font->Load(filename, handler))
@@ -106,7 +247,8 @@ TextDrawFont *TextDraw::GetFont(const TCHAR *filename, ErrorHandler &handler)
 		return 0;
 	}
 
-	// add it to the cache and return it
+	// add it to the caches and return it
+	sharedFonts.emplace(filename, SharedFont{ font, 1 });
 	fontCache.emplace(std::make_pair(filename, font));
 	return font;
 }
@@ -122,16 +264,11 @@ TextDrawItem::TextDrawItem()
 	refCnt = 1;
 
 	// clear pointers
-	vertexBuffer = 0;
-	indexBuffer = 0;
-	indexCount = 0;
 	shaderResourceView = 0;
 }
 
 TextDrawItem::~TextDrawItem()
 {
-	if (vertexBuffer != 0) vertexBuffer->Release();
-	if (indexBuffer != 0) indexBuffer->Release();
 	if (shaderResourceView != 0)
 		shaderResourceView->Release();
 }
@@ -147,64 +284,32 @@ HRESULT TextDrawItem::Load(
 	this->rotation = rotation;
 	this->color = color;
 
-	// update the world matrix
-	RecalcWorld();
-
 	// remember the new font texture
 	ID3D11ShaderResourceView *oldsrv = shaderResourceView;
 	shaderResourceView = font->GetShaderResourceView();
-
-	// release old resources
-	if (indexBuffer != 0)
-	{
-		indexBuffer->Release();
-		indexBuffer = 0;
-	}
-	if (vertexBuffer != 0)
-	{
-		vertexBuffer->Release();
-		vertexBuffer = 0;
-	}
 	if (oldsrv != 0)
 		oldsrv->Release();
 
-	// load the buffer via the font
-	return font->CreateBuffers(text, &vertexBuffer, &indexBuffer, &indexCount);
-}
-
-void TextDrawItem::Render(TextShader *shader)
-{
-	// set the font texture
-	D3D *d3d = D3D::Get();
-	d3d->PSSetShaderResources(0, 1, &shaderResourceView);
-
-	// set our color in the shader
-	shader->SetColor(color);
-
-	// load our world transform for the vertex shader
-	d3d->UpdateWorldTransform(world);
-
-	// load our vertex and index buffers
-	d3d->SetTriangleTopology();
-	d3d->IASetVertexBuffer(vertexBuffer, sizeof(TextVertexType));
-	d3d->IASetIndexBuffer(indexBuffer);
-
-	// draw
-	d3d->DrawIndexed((INT)indexCount);
+	// build the glyph quads via the font
+	vertices.clear();
+	return font->BuildQuads(text, vertices);
 }
 
-void TextDrawItem::RecalcWorld()
+void TextDrawItem::AppendVertices(std::vector<TextVertexType> &batch) const
 {
-	// Figure our world translation matrix for our current rotation and
-	// position.  Note that the position is set in a window-like coordinate
-	// system where +X is right and +Y is down.  The D3D Y axis is the other
-	// way around, so we need to use the negative Y value.  The camera view
-	// automatically places the coordinate system origin at top left, so we
-	// don't need to worry about the view size or orientation here.
-	world = XMMatrixIdentity();
-	world = XMMatrixMultiply(world, XMMatrixRotationZ(rotation));
-	world = XMMatrixMultiply(world, XMMatrixTranslation(pos.x, -pos.y, 0));
-	world = XMMatrixTranspose(world);
+	// Transform each vertex for our current rotation and position.  Note
+	// that the position is set in a window-like coordinate system where +X
+	// is right and +Y is down.  The D3D Y axis is the other way around, so
+	// we need to use the negative Y value.  The camera view automatically
+	// places the coordinate system origin at top left, so we don't need to
+	// worry about the view size or orientation here.
+	float c = cosf(rotation), s = sinf(rotation);
+	for (auto &v : vertices)
+	{
+		batch.push_back({
+			XMFLOAT4(v.position.x*c - v.position.y*s + pos.x, v.position.x*s + v.position.y*c - pos.y, 0, 0),
+			v.texCoord });
+	}
 }
 
 
@@ -219,6 +324,7 @@ TextDrawFont::TextDrawFont()
 	nGlyphs = 0;
 	glyphs = 0;
 	shaderResourceView = 0;
+	ZeroMemory(lowGlyphs, sizeof(lowGlyphs));
 }
 
 TextDrawFont::~TextDrawFont()
@@ -244,6 +350,7 @@ bool TextDrawFont::Load(const TCHAR *filename, ErrorHandler &handler)
 	}
 	defaultGlyph = 0;
 	glyphMap.clear();
+	measureCache.clear();
 
 	// check the signature
 	static const char sig[] = "DXTKfont";
@@ -325,27 +432,22 @@ bool TextDrawFont::Load(const TCHAR *filename, ErrorHandler &handler)
 	if (it != glyphMap.end())
 		defaultGlyph = it->second;
 
+	// build the direct lookup table for the low character codes
+	for (uint32_t i = 0; i < countof(lowGlyphs); ++i)
+	{
+		auto git = glyphMap.find(i);
+		lowGlyphs[i] = git != glyphMap.end() ? git->second : defaultGlyph;
+	}
+
 	// success
 	return true;
 }
 
-HRESULT TextDrawFont::CreateBuffers(
-	const TCHAR *text,
-	ID3D11Buffer **vertexBuffer, ID3D11Buffer **indexBuffer, size_t *indexCount)
+HRESULT TextDrawFont::BuildQuads(const TCHAR *text, std::vector<TextVertexType> &vertices) const
 {
-	D3D *d3d = D3D::Get();
-	HRESULT hr;
-
-	// start with empty vertex and index lists
-	std::vector<TextVertexType> vertices;
-	std::vector<WORD> indices;
-
 	// start at the top left corner
 	float x = 0, y = 0;
 
-	// no vertices in the list yet
-	int nv = 0;
-
 	// add each character
 	for (const TCHAR *p = text; *p != 0; ++p)
 	{
@@ -362,8 +464,7 @@ HRESULT TextDrawFont::CreateBuffers(
 			continue;
 
 		// look up the glyph
-		auto it = glyphMap.find(*p);
-		Glyph *g = it != glyphMap.end() ? it->second : defaultGlyph;
+		const Glyph *g = FindGlyph(*p);
 
 		// we must have a glyph to proceed
 		if (g == 0)
@@ -395,57 +496,22 @@ HRESULT TextDrawFont::CreateBuffers(
 			vertices.push_back({ XMFLOAT4(right, top, 0, 0), XMFLOAT2(u1, v0) });
 			vertices.push_back({ XMFLOAT4(right, bottom, 0, 0), XMFLOAT2(u1, v1) });
 			vertices.push_back({ XMFLOAT4(left, bottom, 0, 0), XMFLOAT2(u0, v1) });
-
-			// create the index list
-			indices.push_back(nv + 0);
-			indices.push_back(nv + 1);
-			indices.push_back(nv + 2);
-			indices.push_back(nv + 2);
-			indices.push_back(nv + 3);
-			indices.push_back(nv + 0);
-
-			// advance the vertex counter
-			nv += 4;
 		}
 
 		// advance by the character width
 		x += advance;
 	}
 
-	// set up the vertex buffer descriptor
-	D3D11_BUFFER_DESC bd;
-	ZeroMemory(&bd, sizeof(bd));
-	bd.Usage = D3D11_USAGE_DEFAULT;
-	bd.ByteWidth = (UINT)(sizeof(TextVertexType)*vertices.size());
-	bd.BindFlags = D3D11_BIND_VERTEX_BUFFER;
-
-	// set up the subresource descriptor
-	D3D11_SUBRESOURCE_DATA sd;
-	ZeroMemory(&sd, sizeof(sd));
-	sd.pSysMem = vertices.data();
-
-	// create the vertex buffer
-	if (FAILED(hr = d3d->CreateBuffer(&bd, &sd, vertexBuffer, "TextDraw::vertexBuffer")))
-		return hr;
-
-	// set up the index buffer descriptor
-	bd.Usage = D3D11_USAGE_DEFAULT;
-	bd.ByteWidth = (UINT)(sizeof(WORD) * indices.size());
-	bd.BindFlags = D3D11_BIND_INDEX_BUFFER;
-	bd.CPUAccessFlags = 0;
-	sd.pSysMem = indices.data();
-	if (FAILED(hr = d3d->CreateBuffer(&bd, &sd, indexBuffer, "TextDraw::indexBuffer")))
-		return hr;
-
-	// remember the index count
-	*indexCount = indices.size();
-
 	// success
 	return S_OK;
 }
 
 POINTF TextDrawFont::MeasureText(const TCHAR *text) const
 {
+	// check the cache
+	if (auto it = measureCache.find(text); it != measureCache.end())
+		return it->second;
+
 	// start at the top left corner
 	float x = 0, y = 0;
 
@@ -465,8 +531,7 @@ POINTF TextDrawFont::MeasureText(const TCHAR *text) const
 			continue;
 
 		// look up the glyph
-		auto it = glyphMap.find(*p);
-		Glyph *g = it != glyphMap.end() ? it->second : defaultGlyph;
+		const Glyph *g = FindGlyph(*p);
 
 		// skip missing characters
 		if (g == 0)
@@ -476,6 +541,11 @@ POINTF TextDrawFont::MeasureText(const TCHAR *text) const
 		x += g->xOffset + (g->subrect.right - g->subrect.left) + g->xAdvance;
 	}
 
+	// cache the result
+	if (measureCache.size() >= maxMeasureCache)
+		measureCache.clear();
+	measureCache.emplace(text, POINTF{ x, y });
+
 	// return the result
 	return { x, y };
 }
@@ -7,6 +7,15 @@
 // The coordinate system for text items mimics normal window
 // coordinates.  The origin is at the top left of the window, +X
 // is to the right, and +Y is down.
+//
+// Each font is a single texture containing all of its glyphs, with
+// the per-glyph metrics from the font file.  Text items keep their
+// glyph quads in CPU memory; at render time, TextDraw gathers the
+// quads for all of its items into one dynamic vertex buffer, and
+// draws each run of consecutive items sharing a font and color with
+// a single draw call.  This keeps overlays that are rebuilt on every
+// frame (such as the FPS display) from creating new GPU buffers for
+// every string.
 
 #pragma once
 
@@ -45,15 +54,17 @@ public:
 		return shaderResourceView;
 	}
 
-	// Create a drawing list for a string
-	HRESULT CreateBuffers(
-		const TCHAR *text,
-		ID3D11Buffer **vertexBuffer, ID3D11Buffer **indexBuffer, size_t *indexCount);
+	// Build the glyph quads for a string.  This appends four vertices
+	// per visible character to the vertex list, in the order top left,
+	// top right, bottom right, bottom left, relative to the top left of
+	// the string.
+	HRESULT BuildQuads(const TCHAR *text, std::vector<TextVertexType> &vertices) const;
 
 	// get the line height
 	float GetLineHeight() const { return lineSpacing; }
 
-	// measure text
+	// Measure text.  Results are cached by string, since callers tend
+	// to measure the same strings repeatedly as they lay out displays.
 	POINTF MeasureText(const TCHAR *text) const;
 
 protected:
@@ -78,6 +89,26 @@ protected:
 	// glyph hash
 	std::unordered_map<uint32_t, Glyph *> glyphMap;
 
+	// Direct lookup table for character codes 0-255.  These cover nearly
+	// all of the text we display, so this saves a hash lookup for most
+	// characters.  Characters without glyphs map to the default glyph.
+	Glyph *lowGlyphs[256];
+
+	// look up a glyph, returning the default glyph if it's not found
+	const Glyph *FindGlyph(TCHAR c) const
+	{
+		if (static_cast<unsigned int>(c) < countof(lowGlyphs))
+			return lowGlyphs[static_cast<unsigned int>(c)];
+
+		auto it = glyphMap.find(c);
+		return it != glyphMap.end() ? it->second : defaultGlyph;
+	}
+
+	// MeasureText cache.  We simply clear this when it fills up, since
+	// the working set of strings is usually small.
+	mutable std::unordered_map<TSTRING, POINTF> measureCache;
+	static const size_t maxMeasureCache = 256;
+
 	// default character
 	Glyph *defaultGlyph;
 
@@ -88,8 +119,8 @@ protected:
 	ID3D11ShaderResourceView *shaderResourceView;
 };
 
-// Text item.  This is a D3D triangle list for a string of text.
-class TextDrawItem : public Align16
+// Text item.  This is a list of glyph quads for a string of text.
+class TextDrawItem
 {
 public:
 	TextDrawItem();
@@ -109,14 +140,12 @@ public:
 	{
 		pos.x = x;
 		pos.y = y;
-		RecalcWorld();
 	}
 
 	// set the rotation
 	void SetRotation(float r)
 	{
 		rotation = r;
-		RecalcWorld();
 	}
 
 	// set the color
@@ -125,7 +154,13 @@ public:
 		this->color = color;
 	}
 
-	void Render(TextShader *shader);
+	// get the color and font texture, for batching
+	const DirectX::XMFLOAT4 &GetColor() const { return color; }
+	ID3D11ShaderResourceView *GetShaderResourceView() const { return shaderResourceView; }
+
+	// Append our glyph quads to a batch vertex list, transformed to
+	// window coordinates for our current position and rotation.
+	void AppendVertices(std::vector<TextVertexType> &batch) const;
 
 protected:
 	// reference count
@@ -144,21 +179,11 @@ protected:
 	// reference counting
 	~TextDrawItem();
 
-	// recalculate the world matrix for a change in position or rotation
-	void RecalcWorld();
-
-	// vertex buffer
-	ID3D11Buffer *vertexBuffer;
-
-	// index buffer
-	ID3D11Buffer *indexBuffer;
-	size_t indexCount;
+	// glyph quads, relative to the top left of the string
+	std::vector<TextVertexType> vertices;
 
 	// font texture
 	ID3D11ShaderResourceView *shaderResourceView;
-
-	// world transform matrix
-	DirectX::XMMATRIX world;
 };
 
 // TextDraw - create an instance of this to manage a collection of
@@ -186,11 +211,15 @@ public:
 	{
 		item->AddRef();
 		items.push_back(item); 
+		dirty = true;
 	}
 
 	// Render
 	void Render(Camera *camera);
 
+	// Has the item list changed since the last render?
+	bool IsDirty() const { return dirty; }
+
 	// Look up a font, loading it into our cache if it's not already present
 	TextDrawFont *GetFont(const TCHAR *filename, ErrorHandler &handler);
 
@@ -198,9 +227,35 @@ protected:
 	// Shader
 	TextShader *shader;
 
-	// font cache
+	// fonts we're using, by filename
 	std::unordered_map<TSTRING, TextDrawFont *> fontCache;
 
+	// Shared font table.  Every window loads the same font files, so we
+	// keep one copy of each font for the whole process, with a count of
+	// the TextDraw objects using it.  A font is deleted when the last
+	// TextDraw using it is deleted, which also happens when all of the
+	// windows release their resources on a D3D device loss.
+	struct SharedFont
+	{
+		TextDrawFont *font;
+		int refCnt;
+	};
+	static std::unordered_map<TSTRING, SharedFont> sharedFonts;
+
 	// active text item list
 	std::vector<TextDrawItem *> items;
+
+	// the item list has changed since the last render
+	bool dirty = true;
+
+	// Batch vertex list, and the dynamic vertex buffer we upload it to
+	// for rendering.  The index buffer contains the fixed two-triangle
+	// pattern for each quad, so it only changes when the capacity grows.
+	std::vector<TextVertexType> batchVertices;
+	RefPtr<ID3D11Buffer> batchVertexBuffer;
+	RefPtr<ID3D11Buffer> batchIndexBuffer;
+	UINT batchQuadCapacity = 0;
+
+	// make sure the batch buffers can hold the given number of quads
+	bool ReserveBatch(UINT nQuads);
 };
@@ -17,5 +17,8 @@ struct PixelInputType
 
 float4 PS(PixelInputType input) : SV_TARGET
 {
-	return Texture.Sample(TextureSampler, input.texCoord) * color;
+	// apply the color, and premultiply the alpha, to match our blend state
+	float4 c = Texture.Sample(TextureSampler, input.texCoord) * color;
+	c.xyz *= c.w;
+	return c;
 }
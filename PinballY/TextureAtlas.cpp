@@ -0,0 +1,176 @@
+// This file is part of PinballY
+// Copyright 2018 Michael J Roberts | GPL v3 or later | NO WARRANTY
+//
+// Texture Atlas
+
+#include "stdafx.h"
+#include "TextureAtlas.h"
+#include "D3D.h"
+
+using namespace DirectX;
+
+TextureAtlas::TextureAtlas(SIZE cellSize, int pageSize) :
+	cellSize(cellSize),
+	pageSize(pageSize)
+{
+	// figure the number of cells that fit on a page, counting the
+	// gutters, with a minimum of one, so that we at least do something
+	// sensible if the cell size is larger than the page
+	cellsAcross = max(1, pageSize / max(1, (int)cellSize.cx + 2*gutter));
+	cellsDown = max(1, pageSize / max(1, (int)cellSize.cy + 2*gutter));
+}
+
+TextureAtlas::Slot *TextureAtlas::Add(const BYTE *pixels, int width, int height, ErrorHandler &eh)
+{
+	// the image has to fit our cells
+	if (width <= 0 || height <= 0 || !Fits({ width, height })
+		|| width + 2*gutter > pageSize || height + 2*gutter > pageSize)
+		return nullptr;
+
+	// note the use, for LRU eviction
+	Touch();
+
+	// find a page with a free cell, adding a new page if necessary
+	CriticalSectionLocker locker(lock);
+	int pageIndex = 0;
+	for (; pageIndex < (int)pages.size() 
+		&& (pages[pageIndex]->texture == nullptr || pages[pageIndex]->freeCells.size() == 0); ++pageIndex);
+	if (pageIndex == (int)pages.size() && (pageIndex = AddPage(eh)) < 0)
+		return nullptr;
+
+	// take the next free cell on the page
+	Page *page = pages[pageIndex].get();
+	int cellIndex = page->freeCells.back();
+	page->freeCells.pop_back();
+
+	// figure the pixel position of the image on the page, inside the gutter
+	int x = (cellIndex % cellsAcross) * (cellSize.cx + 2*gutter) + gutter;
+	int y = (cellIndex / cellsAcross) * (cellSize.cy + 2*gutter) + gutter;
+
+	// Build a copy of the image with the gutter around it, repeating
+	// the edge pixels into the gutter
+	int gw = width + 2*gutter, gh = height + 2*gutter;
+	std::unique_ptr<UINT32[]> buf(new UINT32[gw * gh]);
+	const UINT32 *src = reinterpret_cast<const UINT32*>(pixels);
+	for (int row = 0; row < gh; ++row)
+	{
+		const UINT32 *srow = src + min(max(row - gutter, 0), height - 1) * width;
+		UINT32 *drow = buf.get() + row * gw;
+		for (int col = 0; col < gw; ++col)
+			drow[col] = srow[min(max(col - gutter, 0), width - 1)];
+	}
+
+	// copy the pixels into the cell, including the gutter
+	D3D11_BOX box = { (UINT)(x - gutter), (UINT)(y - gutter), 0, (UINT)(x + width + gutter), (UINT)(y + height + gutter), 1 };
+	{
+		D3D::DeviceContextLocker ctx;
+		ctx->UpdateSubresource(page->texture, 0, &box, buf.get(), gw * 4, gw * gh * 4);
+	}
+
+	// Figure the texture coordinate rectangle for the image, inset by
+	// half a texel on each side, so that the filter footprint at the
+	// edges stays within the image and its gutter
+	float fPage = float(pageSize);
+	XMFLOAT4 texRect((float(x) + 0.5f) / fPage, (float(y) + 0.5f) / fPage,
+		float(width - 1) / fPage, float(height - 1) / fPage);
+
+	// create the slot
+	return new Slot(this, pageIndex, cellIndex, page->texture, page->rv, texRect);
+}
+
+int TextureAtlas::AddPage(ErrorHandler &eh)
+{
+	// set up the texture descriptor
+	D3D11_TEXTURE2D_DESC txd = CD3D11_TEXTURE2D_DESC(
+		DXGI_FORMAT_B8G8R8A8_UNORM, pageSize, pageSize, 1, 1,
+		D3D11_BIND_SHADER_RESOURCE, D3D11_USAGE_DEFAULT, 0, 1, 0, 0);
+
+	// set up the shader resource view descriptor
+	D3D11_SHADER_RESOURCE_VIEW_DESC svd;
+	svd.Format = txd.Format;
+	svd.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2D;
+	svd.Texture2D.MipLevels = txd.MipLevels;
+	svd.Texture2D.MostDetailedMip = 0;
+
+	// reuse an evicted page entry if there is one, otherwise add a new entry
+	int pageIndex = 0;
+	for (; pageIndex < (int)pages.size() && pages[pageIndex]->texture != nullptr; ++pageIndex);
+	if (pageIndex == (int)pages.size())
+		pages.emplace_back(new Page());
+	Page *page = pages[pageIndex].get();
+
+	// create the texture
+	HRESULT hr = D3D::Get()->CreateTexture2D(&txd, nullptr, &svd, &page->rv, &page->texture);
+	if (!SUCCEEDED(hr))
+	{
+		WindowsErrorMessage winMsg(hr);
+		eh.SysError(
+			MsgFmt(IDS_ERR_IMGCREATE, _T("texture atlas page")),
+			MsgFmt(_T("TextureAtlas::AddPage, CreateTexture2D failed, HRESULT %lx: %s"), (long)hr, winMsg.Get()));
+		page->rv = nullptr;
+		page->texture = nullptr;
+		return -1;
+	}
+
+	// Populate the free list.  We allocate from the back, so populate
+	// it in reverse order, to fill the page from the top left.
+	page->freeCells.clear();
+	for (int i = cellsAcross * cellsDown; i > 0; --i)
+		page->freeCells.push_back(i - 1);
+
+	// return the page index
+	return pageIndex;
+}
+
+INT64 TextureAtlas::GetEvictableBytes() const
+{
+	// count the empty pages
+	CriticalSectionLocker locker(lock);
+	INT64 bytes = 0;
+	for (auto &page : pages)
+	{
+		if (IsPageEmpty(page.get()))
+			bytes += GetPageBytes();
+	}
+	return bytes;
+}
+
+void TextureAtlas::Evict()
+{
+	// release the empty pages
+	CriticalSectionLocker locker(lock);
+	for (auto &page : pages)
+	{
+		if (IsPageEmpty(page.get()))
+		{
+			page->rv = nullptr;
+			page->texture = nullptr;
+			page->freeCells.clear();
+		}
+	}
+}
+
+void TextureAtlas::FreeCell(int pageIndex, int cellIndex)
+{
+	CriticalSectionLocker locker(lock);
+	if (pageIndex >= 0 && pageIndex < (int)pages.size())
+		pages[pageIndex]->freeCells.push_back(cellIndex);
+}
+
+TextureAtlas::Slot::Slot(TextureAtlas *atlas, int pageIndex, int cellIndex,
+	ID3D11Resource *texture, ID3D11ShaderResourceView *rv,
+	const XMFLOAT4 &texRect) :
+	atlas(atlas, RefCounted::DoAddRef),
+	pageIndex(pageIndex),
+	cellIndex(cellIndex),
+	texture(texture, RefCounted::DoAddRef),
+	rv(rv, RefCounted::DoAddRef),
+	texRect(texRect)
+{
+}
+
+TextureAtlas::Slot::~Slot()
+{
+	// return our cell to the atlas
+	atlas->FreeCell(pageIndex, cellIndex);
+}
@@ -0,0 +1,161 @@
+// This file is part of PinballY
+// Copyright 2018 Michael J Roberts | GPL v3 or later | NO WARRANTY
+//
+// Texture Atlas
+//
+// A texture atlas packs a number of small images into a few large
+// shared textures.  This is useful for sets of images that come and
+// go frequently, such as the wheel icons, where creating a new D3D
+// texture for every image would mean a steady churn of small video
+// memory allocations.  With the atlas, a new image is just a copy
+// into a free cell of an existing texture.
+//
+// The atlas is divided into pages, each of which is one large texture.
+// Each page is divided into a grid of fixed-size cells, and each image
+// occupies one cell.  All of the cells in an atlas are the same size,
+// which is set when the atlas is created; the caller should choose the
+// size to fit the largest image it expects to store.  Images smaller
+// than the cell size are stored at their own size in the top left of
+// the cell.  We allocate new pages as needed when the existing pages
+// fill up.
+//
+// Each cell has a gutter around it, filled by repeating the image's
+// edge pixels, and the texture coordinate rectangle is inset by half
+// a texel.  This keeps bilinear filtering and scaled rendering from
+// blending the neighboring images into the edges of an image.
+//
+// Each stored image is represented by a Slot object, which gives the
+// page's texture and shader resource view, plus the texture coordinate
+// rectangle for the image within the page.  Slots are reference-counted;
+// the cell is returned to the free list when the last reference to its
+// slot is released.  Each slot holds a reference to the atlas, so the
+// atlas stays alive as long as any of its slots are in use.
+//
+// Pages that become completely empty are kept around for reuse, since
+// a scrolling wheel tends to free and refill cells continuously.  The
+// atlas registers with the texture budget as an evictable cache, so 
+// that the empty pages can be released when texture memory is short.
+
+#pragma once
+#include <vector>
+#include <memory>
+#include <d3d11_1.h>
+#include <DirectXMath.h>
+#include "../Utilities/Pointers.h"
+#include "TextureBudget.h"
+
+class ErrorHandler;
+
+class TextureAtlas : public RefCounted, public TextureBudget::Evictable
+{
+public:
+	// Create an atlas with the given cell size, in pixels.  The page
+	// size is the width and height of each page texture.
+	TextureAtlas(SIZE cellSize, int pageSize = 2048);
+
+	// Atlas slot.  This represents one image stored in the atlas.
+	class Slot : public RefCounted
+	{
+		friend class TextureAtlas;
+
+	public:
+		// Get the page texture and shader resource view.  Note that these
+		// represent the whole page, so the image must be rendered using
+		// the texture coordinate rectangle.
+		ID3D11Resource *GetTexture() const { return texture; }
+		ID3D11ShaderResourceView *GetShaderResourceView() const { return rv; }
+
+		// Get the texture coordinate rectangle, as { u0, v0, du, dv }.
+		// This maps the normal 0..1 texture coordinates to the image's
+		// cell within the page.
+		const DirectX::XMFLOAT4 &GetTexRect() const { return texRect; }
+
+	protected:
+		Slot(TextureAtlas *atlas, int pageIndex, int cellIndex,
+			ID3D11Resource *texture, ID3D11ShaderResourceView *rv,
+			const DirectX::XMFLOAT4 &texRect);
+
+		// return the cell to the atlas on destruction
+		virtual ~Slot();
+
+		// the atlas we belong to, and our page and cell index
+		RefPtr<TextureAtlas> atlas;
+		int pageIndex;
+		int cellIndex;
+
+		// the page texture and resource view
+		RefPtr<ID3D11Resource> texture;
+		RefPtr<ID3D11ShaderResourceView> rv;
+
+		// texture coordinate rectangle
+		DirectX::XMFLOAT4 texRect;
+	};
+
+	// Add an image to the atlas.  The pixels are in 32-bit BGRA format,
+	// packed with a row stride of 4*width bytes, top-down.  The image
+	// must fit within the cell size.  Returns a new slot for the image,
+	// with a reference count on behalf of the caller, or null on failure.
+	// This must be called on the main UI thread, since it updates the
+	// page texture through the device context.
+	Slot *Add(const BYTE *pixels, int width, int height, ErrorHandler &eh);
+
+	// get the cell size
+	SIZE GetCellSize() const { return cellSize; }
+
+	// Does an image of the given size fit in our cells?
+	bool Fits(SIZE sz) const { return sz.cx <= cellSize.cx && sz.cy <= cellSize.cy; }
+
+	// TextureBudget::Evictable implementation.  The evictable data is
+	// the set of pages that are allocated but entirely empty.
+	virtual INT64 GetEvictableBytes() const override;
+	virtual void Evict() override;
+
+protected:
+	~TextureAtlas() { Unregister(); }
+
+	// release a cell - called from the slot destructor
+	void FreeCell(int pageIndex, int cellIndex);
+
+	// Add a new page, or re-create an evicted page.  Returns the index
+	// of the page, or -1 on failure.
+	int AddPage(ErrorHandler &eh);
+
+	// bytes per page texture
+	INT64 GetPageBytes() const { return static_cast<INT64>(pageSize) * pageSize * 4; }
+
+	// cell size, in pixels
+	SIZE cellSize;
+
+	// gutter width around each cell, in pixels
+	static const int gutter = 1;
+
+	// page size (width and height), in pixels
+	int pageSize;
+
+	// number of cells across and down each page
+	int cellsAcross;
+	int cellsDown;
+
+	// Atlas page
+	struct Page
+	{
+		// The page texture and its shader resource view.  These are null
+		// if the page has been evicted; the page entry stays in the list
+		// (since the slots refer to pages by index), and we reuse it when
+		// we need a new page.
+		RefPtr<ID3D11Resource> texture;
+		RefPtr<ID3D11ShaderResourceView> rv;
+
+		// indices of the free cells on this page
+		std::vector<int> freeCells;
+	};
+	std::vector<std::unique_ptr<Page>> pages;
+
+	// is the given page allocated but entirely empty?
+	bool IsPageEmpty(const Page *page) const 
+		{ return page->texture != nullptr && (int)page->freeCells.size() == cellsAcross * cellsDown; }
+
+	// Lock for the page list and free lists.  Slots can be released on
+	// any thread, so we protect the free lists with a lock.
+	mutable CriticalSection lock;
+};
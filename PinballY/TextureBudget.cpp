@@ -0,0 +1,197 @@
+// This file is part of PinballY
+// Copyright 2018 Michael J Roberts | GPL v3 or later | NO WARRANTY
+//
+// Texture memory budget
+
+#include "stdafx.h"
+#include "TextureBudget.h"
+#include "MemoryStats.h"
+
+// statics
+volatile INT64 TextureBudget::totalBytes = 0;
+volatile LONG TextureBudget::textureCount = 0;
+INT64 TextureBudget::budget = 0;
+std::list<TextureBudget::Evictable*> TextureBudget::evictables;
+CriticalSection TextureBudget::lock;
+
+// Private data GUID for our sentinel objects
+// {6B0E4C1D-5F43-4C7A-9D2B-8E1F3A7C5B90}
+static const GUID GUID_TextureMemorySentinel =
+{ 0x6b0e4c1d, 0x5f43, 0x4c7a, { 0x9d, 0x2b, 0x8e, 0x1f, 0x3a, 0x7c, 0x5b, 0x90 } };
+
+// Texture memory sentinel.  We attach one of these to each tracked
+// texture as D3D private data.  D3D holds a reference to it for as
+// long as the texture exists, and releases it when the texture is
+// destroyed, at which point we remove the texture's bytes from the
+// running total.
+class TextureMemorySentinel : public IUnknown
+{
+public:
+	TextureMemorySentinel(INT64 bytes, MemoryStats::Subsystem subsystem) :
+		refCnt(1), bytes(bytes), subsystem(subsystem) { }
+
+	// IUnknown implementation
+	ULONG STDMETHODCALLTYPE AddRef() override { return InterlockedIncrement(&refCnt); }
+	ULONG STDMETHODCALLTYPE Release() override
+	{
+		ULONG ret = InterlockedDecrement(&refCnt);
+		if (ret == 0)
+		{
+			TextureBudget::OnRelease(bytes, static_cast<MemoryStats::Subsystem>(subsystem));
+			delete this;
+		}
+		return ret;
+	}
+	HRESULT STDMETHODCALLTYPE QueryInterface(REFIID riid, void **ppv) override
+	{
+		if (riid == IID_IUnknown)
+		{
+			*ppv = static_cast<IUnknown*>(this);
+			AddRef();
+			return S_OK;
+		}
+
+		*ppv = nullptr;
+		return E_NOINTERFACE;
+	}
+
+	// charge the texture to a different subsystem
+	void SetSubsystem(MemoryStats::Subsystem s)
+	{
+		// move the bytes from the old subsystem to the new one
+		auto old = static_cast<MemoryStats::Subsystem>(InterlockedExchange(&subsystem, static_cast<LONG>(s)));
+		if (old != s)
+		{
+			MemoryStats::AddGPU(old, -bytes);
+			MemoryStats::AddGPU(s, bytes);
+		}
+	}
+
+protected:
+	virtual ~TextureMemorySentinel() { }
+
+	// reference count
+	ULONG refCnt;
+
+	// number of bytes in the texture
+	INT64 bytes;
+
+	// MemoryStats subsystem that the texture is charged to
+	volatile LONG subsystem;
+};
+
+void TextureBudget::Track(ID3D11Resource *texture, MemoryStats::Subsystem subsystem)
+{
+	// ignore null textures
+	if (texture == nullptr)
+		return;
+
+	// if it's already tracked, there's nothing to do
+	UINT size = 0;
+	if (SUCCEEDED(texture->GetPrivateData(GUID_TextureMemorySentinel, &size, nullptr)) && size != 0)
+		return;
+
+	// only 2D textures are tracked for now
+	RefPtr<ID3D11Texture2D> t2d;
+	if (FAILED(texture->QueryInterface(IID_PPV_ARGS(&t2d))))
+		return;
+
+	// Figure the size.  Count a full mip chain as 4/3 of the base level,
+	// which is close enough for budgeting purposes.
+	D3D11_TEXTURE2D_DESC desc;
+	t2d->GetDesc(&desc);
+	INT64 bytes = static_cast<INT64>(desc.Width) * desc.Height * desc.ArraySize
+		* DirectX::BitsPerPixel(desc.Format) / 8;
+	if (desc.MipLevels != 1)
+		bytes = bytes * 4 / 3;
+
+	// attach the sentinel; D3D adds its own reference, so we can drop ours
+	RefPtr<TextureMemorySentinel> sentinel(new TextureMemorySentinel(bytes, subsystem));
+	if (SUCCEEDED(texture->SetPrivateDataInterface(GUID_TextureMemorySentinel, sentinel)))
+	{
+		InterlockedAdd64(&totalBytes, bytes);
+		InterlockedIncrement(&textureCount);
+		MemoryStats::AddGPU(subsystem, bytes);
+	}
+}
+
+void TextureBudget::SetSubsystem(ID3D11Resource *texture, MemoryStats::Subsystem subsystem)
+{
+	// get the sentinel; GetPrivateData returns a reference on it
+	IUnknown *unk = nullptr;
+	UINT size = sizeof(unk);
+	if (texture != nullptr && SUCCEEDED(texture->GetPrivateData(GUID_TextureMemorySentinel, &size, &unk)) && unk != nullptr)
+	{
+		RefPtr<IUnknown> holder(unk);
+		static_cast<TextureMemorySentinel*>(unk)->SetSubsystem(subsystem);
+	}
+}
+
+void TextureBudget::OnRelease(INT64 bytes, MemoryStats::Subsystem subsystem)
+{
+	InterlockedAdd64(&totalBytes, -bytes);
+	InterlockedDecrement(&textureCount);
+	MemoryStats::AddGPU(subsystem, -bytes);
+}
+
+void TextureBudget::Enforce()
+{
+	// if there's no budget, or we're within the budget, there's nothing to do
+	if (budget == 0 || totalBytes <= budget)
+		return;
+
+	// Evict cached data in LRU order until we're within the budget
+	CriticalSectionLocker locker(lock);
+	while (totalBytes > budget)
+	{
+		// find the least recently used evictable with anything to evict
+		Evictable *lru = nullptr;
+		for (auto e : evictables)
+		{
+			if (e->GetEvictableBytes() != 0 && (lru == nullptr || e->lastUseTime < lru->lastUseTime))
+				lru = e;
+		}
+
+		// if there's nothing left to evict, we've done all we can
+		if (lru == nullptr)
+			break;
+
+		// Evict it.  If that didn't free anything, stop, so that we don't
+		// loop forever on an evictable that can't make progress.
+		INT64 before = lru->GetEvictableBytes();
+		lru->Evict();
+		if (lru->GetEvictableBytes() >= before)
+			break;
+	}
+}
+
+void TextureBudget::EvictAll()
+{
+	CriticalSectionLocker locker(lock);
+	for (auto e : evictables)
+	{
+		if (e->GetEvictableBytes() != 0)
+			e->Evict();
+	}
+}
+
+TextureBudget::Evictable::Evictable() : lastUseTime(GetTickCount64())
+{
+	CriticalSectionLocker locker(TextureBudget::lock);
+	TextureBudget::evictables.push_back(this);
+}
+
+TextureBudget::Evictable::~Evictable()
+{
+	Unregister();
+}
+
+void TextureBudget::Evictable::Unregister()
+{
+	CriticalSectionLocker locker(TextureBudget::lock);
+	if (registered)
+	{
+		TextureBudget::evictables.remove(this);
+		registered = false;
+	}
+}
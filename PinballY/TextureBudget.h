@@ -0,0 +1,124 @@
+// This file is part of PinballY
+// Copyright 2018 Michael J Roberts | GPL v3 or later | NO WARRANTY
+//
+// Texture memory budget
+//
+// This is a central registry for video memory used by textures.  It
+// keeps a running total of the bytes allocated for every texture we
+// create through D3D::CreateTexture2D() (and any other textures that
+// are explicitly registered via Track()), and enforces an optional
+// budget on the total.
+//
+// The accounting is automatic: when a texture is registered, we attach
+// a small sentinel object to it as D3D private data.  D3D releases the
+// sentinel when the texture is destroyed, which tells us to remove the
+// texture's bytes from the total.  This means that we don't have to
+// find every place where a texture reference is dropped.
+//
+// The budget is enforced by evicting cold cached data.  Components that
+// keep textures around for possible future use (such as the texture
+// atlas pages) can register as Evictable objects.  When the total goes
+// over the budget, we ask the evictables to release their cached data,
+// in least-recently-used order, until we're back within the budget or
+// we run out of things to evict.  Textures that are actually in use for
+// display are never evicted; the budget is a soft limit that only
+// governs how much cached data we keep around.
+
+#pragma once
+#include <list>
+#include <d3d11_1.h>
+#include "MemoryStats.h"
+
+class TextureBudget
+{
+public:
+	// Register a texture for accounting.  This is called automatically
+	// for textures created through D3D::CreateTexture2D(); call it
+	// explicitly for textures created by other means.  It's harmless
+	// to call this more than once for the same texture.  'subsystem'
+	// is the MemoryStats subsystem to charge the texture to.
+	static void Track(ID3D11Resource *texture, MemoryStats::Subsystem subsystem = MemoryStats::Sprites);
+
+	// Charge a tracked texture to a different MemoryStats subsystem.
+	// This is for code that creates its textures through the common
+	// D3D::CreateTexture2D() path, which charges them to sprites.
+	static void SetSubsystem(ID3D11Resource *texture, MemoryStats::Subsystem subsystem);
+
+	// get the total bytes currently allocated for tracked textures
+	static INT64 GetTotalBytes() { return totalBytes; }
+
+	// get the number of tracked textures currently allocated
+	static LONG GetTextureCount() { return textureCount; }
+
+	// Get/set the budget, in bytes.  Zero means unlimited.
+	static INT64 GetBudget() { return budget; }
+	static void SetBudget(INT64 bytes) { budget = bytes; }
+
+	// Enforce the budget.  If the total is over the budget, this asks
+	// the registered evictables to release cached data until we're back
+	// within the budget.  This is called periodically from the main UI
+	// thread; it must only be called on the UI thread, since releasing
+	// textures can implicitly access the D3D device context.
+	static void Enforce();
+
+	// Evict all cached data from every registered evictable, regardless
+	// of the budget.  This is for releasing video memory to a running
+	// game.  UI thread only, as with Enforce().
+	static void EvictAll();
+
+	// Evictable cache interface.  Objects that keep cached textures
+	// that can be discarded when memory is short implement this, and
+	// register while they exist.
+	//
+	// Each subclass destructor must call Unregister() before anything
+	// else.  The base class destructor does it too, but that's too late
+	// to be safe on its own: by then the subclass members have already
+	// been destroyed, and Enforce() could call into the half-destroyed
+	// object on another thread in the meantime.
+	class Evictable
+	{
+	public:
+		Evictable();
+		virtual ~Evictable();
+
+		// Remove the object from the registry.  This waits for any
+		// eviction in progress to finish.  It's harmless to call this
+		// more than once.
+		void Unregister();
+
+		// Get the number of bytes that Evict() would free
+		virtual INT64 GetEvictableBytes() const = 0;
+
+		// Release cached data.  This is always called on the UI thread.
+		virtual void Evict() = 0;
+
+		// Note a use of the cache, for LRU ordering
+		void Touch() { lastUseTime = GetTickCount64(); }
+
+		// last use time, in system ticks
+		UINT64 lastUseTime;
+
+	private:
+		// are we in the registry?
+		bool registered = true;
+	};
+
+protected:
+	friend class TextureMemorySentinel;
+
+	// note a texture release - called from the sentinel
+	static void OnRelease(INT64 bytes, MemoryStats::Subsystem subsystem);
+
+	// total bytes and count of tracked textures
+	static volatile INT64 totalBytes;
+	static volatile LONG textureCount;
+
+	// budget in bytes, or zero if unlimited
+	static INT64 budget;
+
+	// registered evictables
+	static std::list<Evictable*> evictables;
+
+	// lock for the evictable list
+	static CriticalSection lock;
+};
@@ -0,0 +1,658 @@
+// This file is part of PinballY
+// Copyright 2018 Michael J Roberts | GPL v3 or later | NO WARRANTY
+//
+// Compressed texture cache
+
+#include "stdafx.h"
+#include "../DirectXTK/Inc/DDSTextureLoader.h"
+#include "../DirectXTex/DirectXTex/DirectXTex.h"
+#include "TextureCache.h"
+#include "TextureBudget.h"
+#include "FFmpegProbe.h"
+#include "CaptureEncoder.h"
+#include "D3D.h"
+#include "LogFile.h"
+
+using namespace DirectX;
+
+// statics
+bool TextureCache::enabled = false;
+CacheHitStats TextureCache::hitStats;
+bool TextureCache::posterFrames = true;
+DWORD TextureCache::posterFrameTime = 0;
+CacheHitStats TextureCache::posterHitStats;
+std::list<TextureCache::Request> TextureCache::queue;
+HandleHolder TextureCache::hThread;
+bool TextureCache::threadRunning = false;
+bool TextureCache::shuttingDown = false;
+CriticalSection TextureCache::lock;
+
+// Frame set cache file header.  The header is followed by the frame
+// sequence (one UINT32 image index per frame), and then by the images,
+// as a DDS texture array with one slice per distinct image.
+struct FrameFileHeader
+{
+	char sig[16];         // signature, frameFileSig
+	UINT32 nFrames;       // number of frames in the sequence
+	UINT32 nImages;       // number of distinct images
+	UINT32 frameDelay;    // display time per frame, in milliseconds
+};
+static const char frameFileSig[16] = "PBYFrameSet/1";
+
+bool TextureCache::GetCacheFile(WSTRING &cacheFile, const WCHAR *filename, SIZE pixSize, bool mips,
+	const WCHAR *ext, UINT64 variant)
+{
+	// get the source file's size and modification time
+	WIN32_FILE_ATTRIBUTE_DATA attrs;
+	if (!GetFileAttributesExW(filename, GetFileExInfoStandard, &attrs))
+		return false;
+
+	// Build the key: a 64-bit FNV-1a hash of the case-folded path, the
+	// file size and modification time, the display size, and the mips flag.
+	UINT64 hash = 0xcbf29ce484222325ULL;
+	auto Mix = [&hash](const void *p, size_t len)
+	{
+		for (auto b = static_cast<const BYTE*>(p); len != 0; --len, ++b)
+			hash = (hash ^ *b) * 0x100000001b3ULL;
+	};
+	for (const WCHAR *p = filename; *p != 0; ++p)
+	{
+		WCHAR c = towlower(*p);
+		Mix(&c, sizeof(c));
+	}
+	Mix(&attrs.nFileSizeHigh, sizeof(attrs.nFileSizeHigh));
+	Mix(&attrs.nFileSizeLow, sizeof(attrs.nFileSizeLow));
+	Mix(&attrs.ftLastWriteTime, sizeof(attrs.ftLastWriteTime));
+	Mix(&pixSize, sizeof(pixSize));
+	Mix(&mips, sizeof(mips));
+	if (variant != 0)
+		Mix(&variant, sizeof(variant));
+
+	// the cache file lives in the TextureCache folder under the program folder
+	TCHAR folder[MAX_PATH];
+	GetDeployedFilePath(folder, _T("TextureCache"), _T(""));
+	cacheFile = MsgFmt(_T("%s\\%016I64x.%ws"), folder, hash, ext).Get();
+	return true;
+}
+
+bool TextureCache::Load(const WCHAR *filename, SIZE pixSize, bool mips,
+	ID3D11Resource **texture, ID3D11ShaderResourceView **view, bool *premultiplied)
+{
+	// if the cache is disabled, or there's no cache file, there's nothing to load
+	WSTRING cacheFile;
+	if (!enabled)
+		return false;
+	if (!GetCacheFile(cacheFile, filename, pixSize, mips) || !FileExists(cacheFile.c_str()))
+	{
+		hitStats.Miss();
+		return false;
+	}
+
+	// load the DDS file
+	if (!LoadDDS(cacheFile, filename, texture, view, premultiplied))
+	{
+		hitStats.Miss();
+		return false;
+	}
+
+	hitStats.Hit();
+	return true;
+}
+
+bool TextureCache::LoadDDS(const WSTRING &cacheFile, const WCHAR *filename,
+	ID3D11Resource **texture, ID3D11ShaderResourceView **view, bool *premultiplied)
+{
+	DDS_ALPHA_MODE alphaMode = DDS_ALPHA_MODE_UNKNOWN;
+	HRESULT hr = CreateDDSTextureFromFileEx(D3D::Get()->GetDevice(), cacheFile.c_str(),
+		0, D3D11_USAGE_DEFAULT, D3D11_BIND_SHADER_RESOURCE, 0, 0, false, texture, view, &alphaMode);
+	if (FAILED(hr))
+	{
+		// The entry is unusable - it might have been truncated by a crash
+		// while writing, for example.  Delete it so that it'll be rebuilt
+		// on the next load.
+		LogFile::Get()->Write(LogFile::MediaFileLogging,
+			_T("Texture cache: error loading cache file %ws for %ws (HRESULT %lx); discarding the entry\n"),
+			cacheFile.c_str(), filename, static_cast<long>(hr));
+		DeleteFileW(cacheFile.c_str());
+		return false;
+	}
+
+	// count it in the texture memory budget
+	TextureBudget::Track(*texture);
+
+	// tell the caller how the alpha is stored
+	if (premultiplied != nullptr)
+		*premultiplied = (alphaMode == DDS_ALPHA_MODE_PREMULTIPLIED);
+	return true;
+}
+
+bool TextureCache::GetPosterCacheFile(WSTRING &cacheFile, const WCHAR *filename)
+{
+	// Poster frames are stored at the video's native size, with no mips.
+	// Include the frame time in the key, so that changing the setting
+	// selects new entries.  (Offset it by one so that time zero still
+	// counts as a variant.)
+	return GetCacheFile(cacheFile, filename, { 0, 0 }, false, L"poster.dds", static_cast<UINT64>(posterFrameTime) + 1);
+}
+
+bool TextureCache::LoadPoster(const WCHAR *filename, ID3D11Resource **texture, ID3D11ShaderResourceView **view)
+{
+	// if poster frames are disabled, or there's no cache file, there's nothing to load
+	WSTRING cacheFile;
+	if (!enabled || !posterFrames)
+		return false;
+	if (!GetPosterCacheFile(cacheFile, filename) || !FileExists(cacheFile.c_str()))
+	{
+		posterHitStats.Miss();
+		return false;
+	}
+
+	// load the DDS file
+	if (!LoadDDS(cacheFile, filename, texture, view))
+	{
+		posterHitStats.Miss();
+		return false;
+	}
+
+	posterHitStats.Hit();
+	return true;
+}
+
+void TextureCache::AddPoster(const WCHAR *filename)
+{
+	// ignore this if the cache or poster frames are disabled
+	if (!enabled || !posterFrames)
+		return;
+
+	// figure the cache file name
+	WSTRING cacheFile;
+	if (!GetPosterCacheFile(cacheFile, filename))
+		return;
+
+	// queue the request
+	Request req{ filename, cacheFile, { 0, 0 }, false };
+	req.poster = true;
+	req.frameTime = posterFrameTime;
+	Queue(std::move(req));
+}
+
+bool TextureCache::LoadFrames(const WCHAR *filename, SIZE pixSize, DWORD &frameDelay,
+	std::vector<UINT> &sequence, std::vector<FrameTexture> &textures)
+{
+	// if the cache is disabled, or there's no cache file, there's nothing to load
+	WSTRING cacheFile;
+	if (!enabled)
+		return false;
+	if (!GetCacheFile(cacheFile, filename, pixSize, false, L"frames") || !FileExists(cacheFile.c_str()))
+	{
+		hitStats.Miss();
+		return false;
+	}
+
+	// discard an unusable entry, so that it'll be rebuilt on the next load
+	auto Discard = [&cacheFile, filename, &sequence, &textures](const TCHAR *what, HRESULT hr)
+	{
+		LogFile::Get()->Write(LogFile::MediaFileLogging,
+			_T("Texture cache: error loading frame cache file %ws for %ws (%s, HRESULT %lx); discarding the entry\n"),
+			cacheFile.c_str(), filename, what, static_cast<long>(hr));
+		DeleteFileW(cacheFile.c_str());
+		sequence.clear();
+		textures.clear();
+		hitStats.Miss();
+		return false;
+	};
+
+	// read the file
+	long len = 0;
+	std::unique_ptr<BYTE[]> buf;
+	{
+		FILEPtrHolder fp;
+		if (_wfopen_s(&fp, cacheFile.c_str(), L"rb") != 0)
+		{
+			hitStats.Miss();
+			return false;
+		}
+
+		fseek(fp, 0, SEEK_END);
+		len = ftell(fp);
+		fseek(fp, 0, SEEK_SET);
+		if (len < static_cast<long>(sizeof(FrameFileHeader)))
+			return Discard(_T("file too short"), E_FAIL);
+
+		buf.reset(new (std::nothrow) BYTE[len]);
+		if (buf == nullptr)
+		{
+			hitStats.Miss();
+			return false;
+		}
+		if (fread(buf.get(), 1, len, fp) != static_cast<size_t>(len))
+			return Discard(_T("read error"), E_FAIL);
+	}
+
+	// check the header
+	auto hdr = reinterpret_cast<const FrameFileHeader*>(buf.get());
+	size_t seqBytes = static_cast<size_t>(hdr->nFrames) * sizeof(UINT32);
+	if (memcmp(hdr->sig, frameFileSig, sizeof(frameFileSig)) != 0
+		|| hdr->nFrames == 0 || hdr->nImages == 0
+		|| seqBytes > static_cast<size_t>(len) - sizeof(FrameFileHeader))
+		return Discard(_T("invalid header"), E_FAIL);
+
+	// read the sequence
+	auto seq = reinterpret_cast<const UINT32*>(buf.get() + sizeof(FrameFileHeader));
+	sequence.assign(seq, seq + hdr->nFrames);
+	for (auto i : sequence)
+	{
+		if (i >= hdr->nImages)
+			return Discard(_T("invalid frame sequence"), E_FAIL);
+	}
+
+	// load the images
+	HRESULT hr;
+	TexMetadata meta;
+	ScratchImage images;
+	const BYTE *dds = buf.get() + sizeof(FrameFileHeader) + seqBytes;
+	if (FAILED(hr = LoadFromDDSMemory(dds, static_cast<size_t>(len - (dds - buf.get())), DDS_FLAGS_NONE, &meta, images)))
+		return Discard(_T("LoadFromDDSMemory"), hr);
+	if (meta.arraySize != hdr->nImages)
+		return Discard(_T("wrong image count"), E_FAIL);
+
+	// create a texture for each image
+	for (UINT i = 0; i < hdr->nImages; ++i)
+	{
+		auto img = images.GetImage(0, i, 0);
+		D3D11_TEXTURE2D_DESC txd = CD3D11_TEXTURE2D_DESC(
+			meta.format, static_cast<UINT>(meta.width), static_cast<UINT>(meta.height), 1, 1,
+			D3D11_BIND_SHADER_RESOURCE, D3D11_USAGE_DEFAULT, 0, 1, 0, 0);
+
+		D3D11_SUBRESOURCE_DATA srd;
+		ZeroMemory(&srd, sizeof(srd));
+		srd.pSysMem = img->pixels;
+		srd.SysMemPitch = static_cast<UINT>(img->rowPitch);
+		srd.SysMemSlicePitch = static_cast<UINT>(img->slicePitch);
+
+		D3D11_SHADER_RESOURCE_VIEW_DESC svd;
+		svd.Format = txd.Format;
+		svd.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2D;
+		svd.Texture2D.MipLevels = 1;
+		svd.Texture2D.MostDetailedMip = 0;
+
+		auto &t = textures.emplace_back();
+		if (FAILED(hr = D3D::Get()->CreateTexture2D(&txd, &srd, &svd, &t.rv, &t.texture)))
+			return Discard(_T("CreateTexture2D"), hr);
+
+		// count it in the texture memory budget
+		TextureBudget::Track(t.texture);
+	}
+
+	// success
+	frameDelay = hdr->frameDelay;
+	hitStats.Hit();
+	return true;
+}
+
+void TextureCache::AddFrames(const WCHAR *filename, SIZE pixSize, FrameSet *frames)
+{
+	// take ownership of the frame set
+	std::shared_ptr<FrameSet> fs(frames);
+
+	// ignore this if the cache is disabled, or the frame set is empty
+	if (!enabled || fs->images.size() == 0 || fs->sequence.size() == 0)
+		return;
+
+	// figure the cache file name
+	WSTRING cacheFile;
+	if (!GetCacheFile(cacheFile, filename, pixSize, false, L"frames"))
+		return;
+
+	// queue the request
+	Queue({ filename, cacheFile, pixSize, false, fs });
+}
+
+void TextureCache::Add(const WCHAR *filename, SIZE pixSize, bool mips)
+{
+	// ignore this if the cache is disabled
+	if (!enabled)
+		return;
+
+	// figure the cache file name
+	WSTRING cacheFile;
+	if (!GetCacheFile(cacheFile, filename, pixSize, mips))
+		return;
+
+	// queue the request
+	Queue({ filename, cacheFile, pixSize, mips });
+}
+
+void TextureCache::Queue(Request &&req)
+{
+	CriticalSectionLocker locker(lock);
+
+	// ignore it if we're shutting down, or it's already queued
+	if (shuttingDown
+		|| std::find_if(queue.begin(), queue.end(), [&req](const Request &r) { return r.cacheFile == req.cacheFile; }) != queue.end())
+		return;
+
+	// queue the request
+	queue.emplace_back(std::move(req));
+
+	// start the thread if it's not already running
+	if (!threadRunning)
+	{
+		DWORD tid;
+		hThread = CreateThread(0, 0, ThreadMain, nullptr, 0, &tid);
+		if (hThread != nullptr)
+		{
+			SetThreadPriority(hThread, THREAD_PRIORITY_BELOW_NORMAL);
+			threadRunning = true;
+		}
+		else
+			queue.clear();
+	}
+}
+
+void TextureCache::Shutdown()
+{
+	// discard pending requests, and tell the thread to stop
+	HANDLE h = NULL;
+	{
+		CriticalSectionLocker locker(lock);
+		shuttingDown = true;
+		queue.clear();
+		if (threadRunning)
+			h = hThread;
+	}
+
+	// wait briefly for the thread to finish its current file
+	if (h != NULL)
+		WaitForSingleObject(h, 5000);
+}
+
+DWORD WINAPI TextureCache::ThreadMain(LPVOID)
+{
+	// WIC requires COM
+	CoInitializeEx(NULL, COINIT_MULTITHREADED);
+
+	for (;;)
+	{
+		// get the next request
+		Request req;
+		{
+			CriticalSectionLocker locker(lock);
+			if (shuttingDown || queue.size() == 0)
+			{
+				threadRunning = false;
+				break;
+			}
+			req = queue.front();
+			queue.pop_front();
+		}
+
+		// transcode it, if another load didn't beat us to it
+		if (!FileExists(req.cacheFile.c_str()))
+		{
+			if (req.frames != nullptr)
+				TranscodeFrames(req.filename, req.cacheFile, *req.frames);
+			else if (req.poster)
+				ExtractPoster(req.filename, req.cacheFile, req.frameTime);
+			else
+				Transcode(req.filename, req.cacheFile, req.pixSize, req.mips);
+		}
+	}
+
+	CoUninitialize();
+	return 0;
+}
+
+void TextureCache::Transcode(const WSTRING &filename, const WSTRING &cacheFile, SIZE pixSize, bool mips)
+{
+	auto Fail = [&filename](const TCHAR *where, HRESULT hr)
+	{
+		LogFile::Get()->Write(LogFile::MediaFileLogging,
+			_T("Texture cache: unable to cache %ws: %s failed, HRESULT %lx\n"),
+			filename.c_str(), where, static_cast<long>(hr));
+	};
+
+	// load the source image
+	HRESULT hr;
+	ScratchImage src;
+	if (FAILED(hr = LoadFromWICFile(filename.c_str(), WIC_FLAGS_IGNORE_SRGB, nullptr, src)))
+		return Fail(_T("LoadFromWICFile"), hr);
+
+	// convert it to RGBA if necessary
+	ScratchImage *cur = &src;
+	ScratchImage conv;
+	if (cur->GetMetadata().format != DXGI_FORMAT_R8G8B8A8_UNORM)
+	{
+		if (FAILED(hr = Convert(*cur->GetImage(0, 0, 0), DXGI_FORMAT_R8G8B8A8_UNORM,
+			TEX_FILTER_DEFAULT, TEX_THRESHOLD_DEFAULT, conv)))
+			return Fail(_T("Convert"), hr);
+		cur = &conv;
+	}
+
+	// Premultiply the alpha, if the image has any transparency, to match
+	// the sprite loader.  This has to happen before scaling the image and
+	// generating the mips, so that the filtering doesn't pick up the
+	// colors of the invisible pixels.
+	bool opaque = cur->IsAlphaAllOpaque();
+	ScratchImage pmAlpha;
+	if (!opaque)
+	{
+		if (FAILED(hr = PremultiplyAlpha(*cur->GetImage(0, 0, 0), TEX_PMALPHA_DEFAULT, pmAlpha)))
+			return Fail(_T("PremultiplyAlpha"), hr);
+		cur = &pmAlpha;
+	}
+
+	// Figure the stored size.  Use the display size if it's smaller
+	// than the source image, since there's no point in keeping pixels
+	// that we'll never show; otherwise keep the source size.  Either
+	// way, round up to a multiple of the 4x4 compression block size,
+	// as D3D requires for block-compressed textures.  The sprite mesh
+	// determines the display size, so the texture can be stretched
+	// slightly without affecting the layout.
+	size_t width = cur->GetMetadata().width, height = cur->GetMetadata().height;
+	if (pixSize.cx > 0 && pixSize.cy > 0 && static_cast<size_t>(pixSize.cx) < width && static_cast<size_t>(pixSize.cy) < height)
+		width = pixSize.cx, height = pixSize.cy;
+	width = (width + 3) / 4 * 4;
+	height = (height + 3) / 4 * 4;
+
+	// resize if necessary
+	ScratchImage resized;
+	if (width != cur->GetMetadata().width || height != cur->GetMetadata().height)
+	{
+		if (FAILED(hr = Resize(*cur->GetImage(0, 0, 0), width, height, TEX_FILTER_DEFAULT, resized)))
+			return Fail(_T("Resize"), hr);
+		cur = &resized;
+	}
+
+	// generate the mip chain, if desired
+	ScratchImage mipChain;
+	if (mips)
+	{
+		if (FAILED(hr = GenerateMipMaps(*cur->GetImage(0, 0, 0), TEX_FILTER_DEFAULT, 0, mipChain)))
+			return Fail(_T("GenerateMipMaps"), hr);
+		cur = &mipChain;
+	}
+
+	// Compress it.  Use BC1 for fully opaque images, since it's half the
+	// size of BC7 and gives good results without alpha; use BC7 for
+	// anything with transparency.
+	ScratchImage compressed;
+	DXGI_FORMAT format = opaque ? DXGI_FORMAT_BC1_UNORM : DXGI_FORMAT_BC7_UNORM;
+	if (FAILED(hr = Compress(cur->GetImages(), cur->GetImageCount(), cur->GetMetadata(),
+		format, TEX_COMPRESS_BC7_QUICK, TEX_THRESHOLD_DEFAULT, compressed)))
+		return Fail(_T("Compress"), hr);
+
+	// Mark premultiplied entries in the file header, so that the loader
+	// can tell them apart from the straight entries that older versions
+	// wrote.  The alpha mode is only stored in the DX10 header extension.
+	TexMetadata meta = compressed.GetMetadata();
+	DWORD ddsFlags = DDS_FLAGS_NONE;
+	if (!opaque)
+	{
+		meta.SetAlphaMode(TEX_ALPHA_MODE_PREMULTIPLIED);
+		ddsFlags = DDS_FLAGS_FORCE_DX10_EXT | DDS_FLAGS_FORCE_DX10_EXT_MISC2;
+	}
+
+	// make sure the cache folder exists
+	TCHAR folder[MAX_PATH];
+	GetDeployedFilePath(folder, _T("TextureCache"), _T(""));
+	if (!DirectoryExists(folder) && !CreateDirectory(folder, NULL))
+		return Fail(_T("CreateDirectory"), HRESULT_FROM_WIN32(GetLastError()));
+
+	// Save it to a temporary file, then move it into place, so that a
+	// reader never sees a partially written entry.
+	WSTRING tmpFile = cacheFile + L".tmp";
+	if (FAILED(hr = SaveToDDSFile(compressed.GetImages(), compressed.GetImageCount(), meta,
+		ddsFlags, tmpFile.c_str())))
+	{
+		DeleteFileW(tmpFile.c_str());
+		return Fail(_T("SaveToDDSFile"), hr);
+	}
+	if (!MoveFileExW(tmpFile.c_str(), cacheFile.c_str(), MOVEFILE_REPLACE_EXISTING))
+	{
+		hr = HRESULT_FROM_WIN32(GetLastError());
+		DeleteFileW(tmpFile.c_str());
+		return Fail(_T("MoveFileEx"), hr);
+	}
+
+	LogFile::Get()->Write(LogFile::MediaFileLogging, _T("Texture cache: cached %ws as %ws (%s, %dx%d)\n"),
+		filename.c_str(), cacheFile.c_str(), format == DXGI_FORMAT_BC1_UNORM ? _T("BC1") : _T("BC7"),
+		static_cast<int>(width), static_cast<int>(height));
+}
+
+void TextureCache::ExtractPoster(const WSTRING &filename, const WSTRING &cacheFile, DWORD frameTime)
+{
+	// we need ffmpeg to decode the frame
+	TCHAR ffmpeg[MAX_PATH];
+	FFmpegProbe::GetFFmpegPath(ffmpeg);
+	if (!FileExists(ffmpeg))
+	{
+		LogFile::Get()->Write(LogFile::MediaFileLogging,
+			_T("Texture cache: unable to extract a poster frame from %ws: %s not found\n"), filename.c_str(), ffmpeg);
+		return;
+	}
+
+	// make sure the cache folder exists
+	TCHAR folder[MAX_PATH];
+	GetDeployedFilePath(folder, _T("TextureCache"), _T(""));
+	if (!DirectoryExists(folder) && !CreateDirectory(folder, NULL))
+		return;
+
+	// Extract the frame into a PNG file next to the cache entry.  Put the
+	// seek ahead of the input, so that ffmpeg seeks in the container
+	// rather than decoding everything up to the frame time.
+	WSTRING frameFile = cacheFile + L".png";
+	TSTRINGEx args;
+	args.Format(_T("-nostdin -v error -ss %.3f -i \"%ws\" -frames:v 1 -an -y \"%ws\""),
+		static_cast<double>(frameTime) / 1000.0, filename.c_str(), frameFile.c_str());
+	if (CaptureEncoder::RunFFmpeg(ffmpeg, args.c_str(), nullptr, 15000) != 0 || !FileExists(frameFile.c_str()))
+	{
+		// This can happen if the frame time is past the end of a short
+		// video.  There's nothing more we can do; the video will just
+		// load without a poster frame.
+		LogFile::Get()->Write(LogFile::MediaFileLogging,
+			_T("Texture cache: unable to extract a poster frame from %ws at %.3f seconds\n"),
+			filename.c_str(), static_cast<double>(frameTime) / 1000.0);
+		DeleteFileW(frameFile.c_str());
+		return;
+	}
+
+	// compress it into the cache, at its native size, and discard the PNG
+	Transcode(frameFile, cacheFile, { 0, 0 }, false);
+	DeleteFileW(frameFile.c_str());
+}
+
+void TextureCache::TranscodeFrames(const WSTRING &filename, const WSTRING &cacheFile, const FrameSet &frames)
+{
+	auto Fail = [&filename](const TCHAR *where, HRESULT hr)
+	{
+		LogFile::Get()->Write(LogFile::MediaFileLogging,
+			_T("Texture cache: unable to cache frames for %ws: %s failed, HRESULT %lx\n"),
+			filename.c_str(), where, static_cast<long>(hr));
+	};
+
+	// set up a texture array with one slice per distinct image
+	HRESULT hr;
+	ScratchImage src;
+	size_t nImages = frames.images.size();
+	if (FAILED(hr = src.Initialize2D(DXGI_FORMAT_B8G8R8A8_UNORM, frames.width, frames.height, nImages, 1)))
+		return Fail(_T("Initialize2D"), hr);
+
+	// copy the images
+	for (size_t i = 0; i < nImages; ++i)
+	{
+		auto img = src.GetImage(0, i, 0);
+		const BYTE *srcRow = frames.images[i].get();
+		BYTE *dstRow = img->pixels;
+		for (UINT row = 0; row < frames.height; ++row, srcRow += frames.width * 4, dstRow += img->rowPitch)
+			memcpy(dstRow, srcRow, frames.width * 4);
+	}
+
+	// round the size up to a multiple of the compression block size, as
+	// for a still image
+	ScratchImage *cur = &src;
+	ScratchImage resized;
+	size_t width = (frames.width + 3) / 4 * 4, height = (frames.height + 3) / 4 * 4;
+	if (width != frames.width || height != frames.height)
+	{
+		if (FAILED(hr = Resize(cur->GetImages(), cur->GetImageCount(), cur->GetMetadata(), width, height, TEX_FILTER_DEFAULT, resized)))
+			return Fail(_T("Resize"), hr);
+		cur = &resized;
+	}
+
+	// compress it, using BC1 if all of the images are opaque, otherwise BC7
+	ScratchImage compressed;
+	DXGI_FORMAT format = cur->IsAlphaAllOpaque() ? DXGI_FORMAT_BC1_UNORM : DXGI_FORMAT_BC7_UNORM;
+	if (FAILED(hr = Compress(cur->GetImages(), cur->GetImageCount(), cur->GetMetadata(),
+		format, TEX_COMPRESS_BC7_QUICK, TEX_THRESHOLD_DEFAULT, compressed)))
+		return Fail(_T("Compress"), hr);
+
+	// encode the DDS data
+	Blob dds;
+	if (FAILED(hr = SaveToDDSMemory(compressed.GetImages(), compressed.GetImageCount(), compressed.GetMetadata(),
+		DDS_FLAGS_NONE, dds)))
+		return Fail(_T("SaveToDDSMemory"), hr);
+
+	// make sure the cache folder exists
+	TCHAR folder[MAX_PATH];
+	GetDeployedFilePath(folder, _T("TextureCache"), _T(""));
+	if (!DirectoryExists(folder) && !CreateDirectory(folder, NULL))
+		return Fail(_T("CreateDirectory"), HRESULT_FROM_WIN32(GetLastError()));
+
+	// set up the header
+	FrameFileHeader hdr;
+	memcpy(hdr.sig, frameFileSig, sizeof(hdr.sig));
+	hdr.nFrames = static_cast<UINT32>(frames.sequence.size());
+	hdr.nImages = static_cast<UINT32>(nImages);
+	hdr.frameDelay = frames.frameDelay;
+
+	// Write the header, sequence, and images to a temporary file, then
+	// move it into place, so that a reader never sees a partial entry.
+	WSTRING tmpFile = cacheFile + L".tmp";
+	bool ok = false;
+	{
+		FILEPtrHolder fp;
+		if (_wfopen_s(&fp, tmpFile.c_str(), L"wb") == 0)
+		{
+			std::vector<UINT32> seq(frames.sequence.begin(), frames.sequence.end());
+			ok = fwrite(&hdr, sizeof(hdr), 1, fp) == 1
+				&& fwrite(seq.data(), sizeof(UINT32), seq.size(), fp) == seq.size()
+				&& fwrite(dds.GetBufferPointer(), 1, dds.GetBufferSize(), fp) == dds.GetBufferSize();
+		}
+	}
+	if (!ok)
+	{
+		DeleteFileW(tmpFile.c_str());
+		return Fail(_T("writing the cache file"), E_FAIL);
+	}
+	if (!MoveFileExW(tmpFile.c_str(), cacheFile.c_str(), MOVEFILE_REPLACE_EXISTING))
+	{
+		hr = HRESULT_FROM_WIN32(GetLastError());
+		DeleteFileW(tmpFile.c_str());
+		return Fail(_T("MoveFileEx"), hr);
+	}
+
+	LogFile::Get()->Write(LogFile::MediaFileLogging, _T("Texture cache: cached frames for %ws as %ws (%s, %dx%d, %d frames, %d distinct)\n"),
+		filename.c_str(), cacheFile.c_str(), format == DXGI_FORMAT_BC1_UNORM ? _T("BC1") : _T("BC7"),
+		static_cast<int>(width), static_cast<int>(height), static_cast<int>(hdr.nFrames), static_cast<int>(nImages));
+}
@@ -0,0 +1,205 @@
+// This file is part of PinballY
+// Copyright 2018 Michael J Roberts | GPL v3 or later | NO WARRANTY
+//
+// Compressed texture cache
+//
+// This is an on-disk cache of still images, transcoded to GPU block-
+// compressed formats.  Still media (wheel images, backglass images,
+// DMD stills, instruction cards, etc) are normally decoded from PNG or
+// JPEG through WIC every time they're loaded, and then uploaded to the
+// GPU as uncompressed RGBA.  When the cache is enabled, we transcode
+// each such image, in the background, into a DDS file in BC1 format
+// (for fully opaque images) or BC7 format (for images with alpha), at
+// the size at which it's displayed.  On subsequent loads, we can read
+// the DDS file directly, which skips the image decoding entirely, and
+// uses 4x (BC7) to 8x (BC1) less video memory than the RGBA texture.
+//
+// Cache entries are keyed by the source file's path, size, and
+// modification time, plus the display size, so any change to the
+// source file automatically invalidates its old cache entry.  Stale
+// entries are simply left behind; the cache folder can be deleted at
+// any time to clean them up.
+//
+// Transcoding runs on a single background thread, since block
+// compression is CPU-intensive, and we don't want to compete with
+// the rendering and video decoding more than necessary.
+//
+// The cache also stores rasterized animation frame sets, for the SWF
+// (Flash) media that our internal renderer rasterizes frame by frame
+// at load time.  Complex vector art can take a long time to render,
+// so we save the rendered frames, compressed, in a single cache file
+// for the source file and display size; later loads just read back
+// the textures.  Only the distinct frames are stored, along with the
+// sequence that maps each animation frame to its image, since most
+// SWF media in practice are static images or short loops where most
+// of the frames are identical.
+//
+// Finally, the cache stores poster frames for videos.  A video sprite
+// has nothing to show until the player presents its first frame, which
+// can take a noticeable fraction of a second, so the window would
+// otherwise have to wait for the player before it can start the cross-
+// fade to the new media.  When poster frames are enabled, we extract a
+// still frame from each video in the background (via ffmpeg), and
+// compress it like any other cached image.  A video sprite with a
+// cached poster frame shows it immediately, so the cross-fade can start
+// right away, and the player takes over when its first frame is ready.
+
+#pragma once
+#include <list>
+#include <vector>
+#include <memory>
+#include <d3d11_1.h>
+#include "CacheStats.h"
+
+class TextureCache
+{
+public:
+	// Is the cache enabled?  This is set from the configuration.
+	static bool enabled;
+
+	// Hit statistics, for the Load() and LoadFrames() lookups.  These
+	// aren't counted when the cache is disabled.
+	static CacheHitStats hitStats;
+
+	// Are video poster frames enabled?  And the time into the video of
+	// the frame to extract, in milliseconds.  These are set from the
+	// configuration.  Poster frames also require the cache as a whole
+	// to be enabled.
+	static bool posterFrames;
+	static DWORD posterFrameTime;
+
+	// hit statistics for the poster frame lookups
+	static CacheHitStats posterHitStats;
+
+	// Try loading a cached texture for the given image file, for display
+	// at the given pixel size, with or without mips.  Returns true and
+	// fills in the texture and view if a fresh cache entry exists, false
+	// if not.  If 'premultiplied' is provided, it's set to indicate if
+	// the texture has premultiplied alpha.  (Images with transparency are
+	// stored premultiplied; entries written by older versions, and opaque
+	// images, are straight.)  This can be called from any thread.
+	static bool Load(const WCHAR *filename, SIZE pixSize, bool mips,
+		ID3D11Resource **texture, ID3D11ShaderResourceView **view, bool *premultiplied = nullptr);
+
+	// Add an image file to the cache, for display at the given pixel
+	// size, with or without mips.  This queues the file for transcoding
+	// on the background thread, and returns immediately.  This can be
+	// called from any thread.
+	static void Add(const WCHAR *filename, SIZE pixSize, bool mips);
+
+	// Rasterized animation frame set, for adding to the cache
+	struct FrameSet
+	{
+		// frame size in pixels
+		UINT width = 0;
+		UINT height = 0;
+
+		// display time per frame, in milliseconds
+		DWORD frameDelay = 0;
+
+		// distinct frame images, as top-down 32-bit BGRA pixels
+		std::vector<std::unique_ptr<BYTE[]>> images;
+
+		// distinct image index for each frame of the animation
+		std::vector<UINT> sequence;
+	};
+
+	// Texture for a cached frame image
+	struct FrameTexture
+	{
+		RefPtr<ID3D11Resource> texture;
+		RefPtr<ID3D11ShaderResourceView> rv;
+	};
+
+	// Try loading a cached frame set for the given file, rasterized at
+	// the given pixel size.  Returns true and fills in the frame delay,
+	// the frame sequence, and the textures for the distinct images if a
+	// fresh cache entry exists, false if not.  This can be called from
+	// any thread.
+	static bool LoadFrames(const WCHAR *filename, SIZE pixSize, DWORD &frameDelay,
+		std::vector<UINT> &sequence, std::vector<FrameTexture> &textures);
+
+	// Add a frame set to the cache.  This takes ownership of the frame
+	// set, and queues it for compression on the background thread.  This
+	// can be called from any thread.
+	static void AddFrames(const WCHAR *filename, SIZE pixSize, FrameSet *frames);
+
+	// Try loading the cached poster frame for a video file.  Returns true
+	// and fills in the texture and view if a fresh cache entry exists,
+	// false if not.  The texture is at the video's native frame size.
+	// This can be called from any thread.
+	static bool LoadPoster(const WCHAR *filename, ID3D11Resource **texture, ID3D11ShaderResourceView **view);
+
+	// Add a video's poster frame to the cache.  This queues the frame
+	// extraction on the background thread, and returns immediately.
+	// This can be called from any thread.
+	static void AddPoster(const WCHAR *filename);
+
+	// Maximum frame set size we'll cache, in bytes of uncompressed pixels
+	// for the distinct images.  The loader has to hold the images in
+	// memory until the background thread compresses them, so we don't
+	// try to cache anything bigger than this.
+	static const size_t maxFrameSetBytes = 256 * 1024 * 1024;
+
+	// Shut down the cache.  This discards any pending requests, and
+	// waits for the background thread to finish its current file.
+	static void Shutdown();
+
+protected:
+	// Get the cache file name for an image file at a given display size.
+	// 'variant' distinguishes different renditions of the same source at
+	// the same size (such as poster frames at different times); it's only
+	// included in the key if it's non-zero.  Returns false if the source
+	// file can't be found.
+	static bool GetCacheFile(WSTRING &cacheFile, const WCHAR *filename, SIZE pixSize, bool mips,
+		const WCHAR *ext = L"dds", UINT64 variant = 0);
+
+	// load a DDS cache file; returns false if it's not usable
+	static bool LoadDDS(const WSTRING &cacheFile, const WCHAR *filename,
+		ID3D11Resource **texture, ID3D11ShaderResourceView **view, bool *premultiplied = nullptr);
+
+	// get the poster frame cache file name for a video
+	static bool GetPosterCacheFile(WSTRING &cacheFile, const WCHAR *filename);
+
+	// transcode a file into the cache
+	static void Transcode(const WSTRING &filename, const WSTRING &cacheFile, SIZE pixSize, bool mips);
+
+	// compress a frame set into the cache
+	static void TranscodeFrames(const WSTRING &filename, const WSTRING &cacheFile, const FrameSet &frames);
+
+	// extract a video poster frame into the cache
+	static void ExtractPoster(const WSTRING &filename, const WSTRING &cacheFile, DWORD frameTime);
+
+	// background thread entrypoint
+	static DWORD WINAPI ThreadMain(LPVOID);
+
+	// pending transcoding request
+	struct Request
+	{
+		WSTRING filename;
+		WSTRING cacheFile;
+		SIZE pixSize;
+		bool mips;
+
+		// frame set, for a frame set request
+		std::shared_ptr<FrameSet> frames;
+
+		// is this a poster frame request?  If so, the poster frame time.
+		bool poster = false;
+		DWORD frameTime = 0;
+	};
+	static std::list<Request> queue;
+
+	// queue a request, starting the background thread if necessary
+	static void Queue(Request &&req);
+
+	// background thread handle, and running flag
+	static HandleHolder hThread;
+	static bool threadRunning;
+
+	// shutting down - the thread exits as soon as possible when set
+	static bool shuttingDown;
+
+	// lock for the queue and thread status
+	static CriticalSection lock;
+};
@@ -22,6 +22,12 @@ TextureShader::~TextureShader()
 {
 }
 
+void TextureShader::ReleaseDeviceObjects()
+{
+	cbAlpha = nullptr;
+	__super::ReleaseDeviceObjects();
+}
+
 bool TextureShader::Init()
 {
 	D3D *d3d = D3D::Get();
@@ -71,7 +77,14 @@ bool TextureShader::Init()
 void TextureShader::SetAlpha(float alpha)
 {
 	D3D *d3d = D3D::Get();
-	AlphaBufferType cb = { alpha };
+	AlphaBufferType cb = { alpha, 0.0f };
+	d3d->UpdateResource(cbAlpha, &cb);
+}
+
+void TextureShader::SetPremultipliedAlpha(float alpha)
+{
+	D3D *d3d = D3D::Get();
+	AlphaBufferType cb = { alpha, 1.0f };
 	d3d->UpdateResource(cbAlpha, &cb);
 }
 
@@ -25,13 +25,17 @@ public:
 
 	// set the alpha value in the shader resource
 	void SetAlpha(float alpha) override;
+	void SetPremultipliedAlpha(float alpha) override;
 
 protected:
+	void ReleaseDeviceObjects() override;
+
 	// alpha buffer type - must match the layout in TextureShaderPS.hlsl
 	struct AlphaBufferType
 	{
 		float alpha;
-		DirectX::XMFLOAT3 padding;
+		float premultiplied;
+		DirectX::XMFLOAT2 padding;
 	};
 
 	// pixel shader input
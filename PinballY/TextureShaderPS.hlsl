@@ -9,7 +9,8 @@ SamplerState SampleType;
 cbuffer AlphaBufferType
 {
 	float alpha;
-	float3 padding;
+	float premultiplied;
+	float2 padding;
 }
 
 struct PixelInputType
@@ -25,8 +26,16 @@ float4 main(PixelInputType input) : SV_TARGET
 	float4 textureColor;
 	textureColor = shaderTexture.Sample(SampleType, input.tex);
 
-	// apply the global alpha
-	textureColor.w *= alpha;
+	// Our blend state expects premultiplied alpha.  Most textures are
+	// premultiplied at load time (and Direct2D renders that way in the
+	// first place), but some sources, such as RGBA video frames, still
+	// provide straight alpha, so premultiply those here.
+	if (premultiplied == 0)
+		textureColor.xyz *= textureColor.w;
+
+	// apply the global alpha, which scales all channels of a
+	// premultiplied color
+	textureColor *= alpha;
 
 	// Discard fully transparent pixels (w=0 -> 0% transparency).  This allows us to draw objects
 	// that use transparency only for cropping purposes in any order.  Since we're not writing
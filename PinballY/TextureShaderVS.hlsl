@@ -14,6 +14,7 @@ cbuffer MatrixBuffer
 cbuffer MatrixBuffer
 {
 	matrix worldMatrix;
+	float4 texRect;		// texture coordinate rectangle { u0, v0, du, dv }
 };
 
 
@@ -44,8 +45,10 @@ PixelInputType main(VertexInputType input)
 	output.position = mul(output.position, viewMatrix);
 	output.position = mul(output.position, projectionMatrix);
 
-	// Store the texture coordinates for the pixel shader.
-	output.tex = input.tex;
+	// Store the texture coordinates for the pixel shader, mapped into the
+	// texture rectangle.  This is normally the whole texture, {0, 0, 1, 1},
+	// but can select a sub-region for images in a texture atlas.
+	output.tex = input.tex * texRect.zw + texRect.xy;
 
 	// Calculate the normal vector against the world matrix only.
 	output.normal = mul(input.normal, (float3x3)worldMatrix);
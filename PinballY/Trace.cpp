@@ -0,0 +1,275 @@
+// This file is part of PinballY
+// Copyright 2018 Michael J Roberts | GPL v3 or later | NO WARRANTY
+//
+// Structured performance tracing
+
+#include "stdafx.h"
+#include <TraceLoggingProvider.h>
+#include <winmeta.h>
+#include "../Utilities/FileUtil.h"
+#include "Trace.h"
+#include "LogFile.h"
+
+// ETW provider: "PinballY" {29AB4D8F-DC8D-4148-95AA-21086D176991}
+TRACELOGGING_DEFINE_PROVIDER(
+	traceProvider, "PinballY",
+	(0x29ab4d8f, 0xdc8d, 0x4148, 0x95, 0xaa, 0x21, 0x08, 0x6d, 0x17, 0x69, 0x91));
+
+// statics
+bool Trace::jsonEnabled = true;
+int64_t Trace::tStart = 0;
+int64_t Trace::freq = 1;
+std::vector<Trace::Event> Trace::events;
+bool Trace::overflow = false;
+CriticalSection Trace::lock;
+WatchdogHeartbeat *Trace::heartbeat = nullptr;
+
+void Trace::Init()
+{
+	// start the clock
+	LARGE_INTEGER f;
+	QueryPerformanceFrequency(&f);
+	freq = f.QuadPart;
+	tStart = Now();
+
+	// register the ETW provider
+	TraceLoggingRegister(traceProvider);
+}
+
+void Trace::Shutdown()
+{
+	// write the JSON file
+	if (jsonEnabled)
+		WriteChromeJson();
+
+	// unregister the provider
+	TraceLoggingUnregister(traceProvider);
+}
+
+void Trace::EnableChromeJson(bool enable)
+{
+	CriticalSectionLocker locker(lock);
+	jsonEnabled = enable;
+
+	// if it's disabled, discard anything we've buffered so far
+	if (!enable)
+	{
+		events.clear();
+		events.shrink_to_fit();
+	}
+}
+
+bool Trace::IsEnabled()
+{
+	return jsonEnabled || TraceLoggingProviderEnabled(traceProvider, 0, 0);
+}
+
+void Trace::AddEvent(Event &&e)
+{
+	CriticalSectionLocker locker(lock);
+	if (!jsonEnabled)
+		return;
+
+	if (events.size() < maxEvents)
+		events.emplace_back(std::move(e));
+	else
+		overflow = true;
+}
+
+void Trace::Interval(const CHAR *name, const CHAR *category, int64_t t0, int64_t t1, const WCHAR *detail)
+{
+	if (TraceLoggingProviderEnabled(traceProvider, 0, 0))
+	{
+		TraceLoggingWrite(traceProvider, "Interval",
+			TraceLoggingString(name, "Name"),
+			TraceLoggingString(category, "Category"),
+			TraceLoggingWideString(detail != nullptr ? detail : L"", "Detail"),
+			TraceLoggingFloat64(static_cast<double>(t1 - t0) * 1000.0 / static_cast<double>(freq), "DurationMs"));
+	}
+
+	if (jsonEnabled)
+		AddEvent(Event('X', name, category, t0, t1, 0.0, detail));
+}
+
+void Trace::Counter(const CHAR *name, double value)
+{
+	if (TraceLoggingProviderEnabled(traceProvider, 0, 0))
+	{
+		TraceLoggingWrite(traceProvider, "Counter",
+			TraceLoggingString(name, "Name"),
+			TraceLoggingFloat64(value, "Value"));
+	}
+
+	if (jsonEnabled)
+	{
+		int64_t t = Now();
+		AddEvent(Event('C', name, "counter", t, t, value, nullptr));
+	}
+}
+
+Trace::Scope::Scope(const CHAR *name, const CHAR *category, const WCHAR *detail) :
+	name(name), category(category), t0(0), activityId(), etwActive(false), active(IsEnabled()),
+	heartbeatSlot(PushHeartbeatScope(name, category, detail))
+{
+	if (active)
+	{
+		// keep a copy of the detail string, since the caller's copy might
+		// not last as long as we do
+		if (detail != nullptr)
+			this->detail = detail;
+
+		// write the ETW Start event, with a new activity ID to tie it to
+		// the matching Stop event
+		if (TraceLoggingProviderEnabled(traceProvider, 0, 0))
+		{
+			EventActivityIdControl(EVENT_ACTIVITY_CTRL_CREATE_ID, &activityId);
+			etwActive = true;
+			TraceLoggingWriteActivity(traceProvider, "Scope", &activityId, NULL,
+				TraceLoggingOpcode(WINEVENT_OPCODE_START),
+				TraceLoggingString(name, "Name"),
+				TraceLoggingString(category, "Category"),
+				TraceLoggingWideString(this->detail.c_str(), "Detail"));
+		}
+
+		// note the starting time
+		t0 = Now();
+	}
+}
+
+void Trace::Scope::End()
+{
+	// remove our heartbeat scope
+	PopHeartbeatScope(heartbeatSlot);
+	heartbeatSlot = -1;
+
+	if (active)
+	{
+		int64_t t1 = Now();
+		active = false;
+
+		// write the ETW Stop event, if we wrote a Start event
+		if (etwActive)
+		{
+			TraceLoggingWriteActivity(traceProvider, "Scope", &activityId, NULL,
+				TraceLoggingOpcode(WINEVENT_OPCODE_STOP),
+				TraceLoggingString(name, "Name"),
+				TraceLoggingString(category, "Category"));
+		}
+
+		// record it for the JSON file
+		if (jsonEnabled)
+			AddEvent(Event('X', name, category, t0, t1, 0.0, detail.c_str()));
+	}
+}
+
+int Trace::DoPushHeartbeatScope(const CHAR *name, const CHAR *category, const WCHAR *detail)
+{
+	// Fill in the entry if there's room, then bump the depth.  The
+	// watchdog only reads entries below the depth, so setting the
+	// depth last keeps it from seeing a half-written entry.
+	int slot = heartbeat->depth;
+	if (slot < WatchdogHeartbeat::MaxScopes)
+	{
+		auto &s = heartbeat->scopes[slot];
+		strncpy_s(s.name, name, _TRUNCATE);
+		strncpy_s(s.category, category, _TRUNCATE);
+		wcsncpy_s(s.detail, detail != nullptr ? detail : L"", _TRUNCATE);
+		MemoryBarrier();
+	}
+	heartbeat->depth = slot + 1;
+	return slot;
+}
+
+void Trace::WriteChromeJson()
+{
+	CriticalSectionLocker locker(lock);
+	if (events.size() == 0)
+		return;
+
+	// write a string as a JSON string literal
+	std::string json;
+	auto String = [&json](const CHAR *s)
+	{
+		json.push_back('"');
+		for (; *s != 0; ++s)
+		{
+			switch (*s)
+			{
+			case '"':
+				json.append("\\\"");
+				break;
+
+			case '\\':
+				json.append("\\\\");
+				break;
+
+			default:
+				if (static_cast<unsigned char>(*s) < 0x20)
+				{
+					char buf[8];
+					sprintf_s(buf, "\\u%04x", static_cast<unsigned char>(*s));
+					json.append(buf);
+				}
+				else
+					json.push_back(*s);
+				break;
+			}
+		}
+		json.push_back('"');
+	};
+
+	// convert QPC ticks to microseconds since the start of the trace
+	auto Us = [](int64_t t) { return static_cast<double>(t - tStart) * 1000000.0 / static_cast<double>(freq); };
+
+	// build the file contents
+	DWORD pid = GetCurrentProcessId();
+	json.reserve(events.size() * 128);
+	json.append("{\"traceEvents\":[\n");
+	for (size_t i = 0; i < events.size(); ++i)
+	{
+		auto &e = events[i];
+		char buf[128];
+		json.append("{\"name\":");
+		String(e.name);
+		json.append(",\"cat\":");
+		String(e.category);
+		sprintf_s(buf, ",\"ph\":\"%c\",\"ts\":%.3f,\"pid\":%lu,\"tid\":%lu", e.ph, Us(e.t0), pid, e.tid);
+		json.append(buf);
+		if (e.ph == 'X')
+		{
+			sprintf_s(buf, ",\"dur\":%.3f", Us(e.t1) - Us(e.t0));
+			json.append(buf);
+			if (e.detail.length() != 0)
+			{
+				json.append(",\"args\":{\"detail\":");
+				String(WideToAnsi(e.detail.c_str(), CP_UTF8).c_str());
+				json.append("}");
+			}
+		}
+		else if (e.ph == 'C')
+		{
+			sprintf_s(buf, ",\"args\":{\"value\":%g}", e.value);
+			json.append(buf);
+		}
+		json.append(i + 1 < events.size() ? "},\n" : "}\n");
+	}
+	json.append("],\"displayTimeUnit\":\"ms\"}\n");
+
+	// write the file - <program folder>\PinballY.trace.json
+	TCHAR fname[MAX_PATH];
+	GetExeFilePath(fname, countof(fname));
+	PathAppend(fname, _T("PinballY.trace.json"));
+	HandleHolder h(CreateFile(fname, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL));
+	DWORD actual = 0;
+	if (h != NULL && h != INVALID_HANDLE_VALUE
+		&& WriteFile(h, json.data(), static_cast<DWORD>(json.length()), &actual, NULL))
+	{
+		LogFile::Get()->Write(_T("Trace: wrote %d events to %s%s\n"), static_cast<int>(events.size()), fname,
+			overflow ? _T(" (the event buffer filled up, so later events were dropped)") : _T(""));
+	}
+	else
+	{
+		WindowsErrorMessage err;
+		LogFile::Get()->Write(_T("Trace: error writing %s (error %d: %s)\n"), fname, err.GetCode(), err.Get());
+	}
+}
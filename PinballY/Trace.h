@@ -0,0 +1,170 @@
+// This file is part of PinballY
+// Copyright 2018 Michael J Roberts | GPL v3 or later | NO WARRANTY
+//
+// Structured performance tracing
+//
+// This records begin/end events and counters for the main phases of
+// the program's work - startup, game list loading, media loading, video
+// startup, filter refreshes, Javascript handlers, game launches, and
+// media capture - so that slow spots can be analyzed with real tools
+// rather than by reading log file timestamps.
+//
+// Events go to two places:
+//
+//  - An ETW TraceLogging provider named "PinballY", with GUID
+//    {29AB4D8F-DC8D-4148-95AA-21086D176991}.  Scopes are written as
+//    Start/Stop activity pairs, so WPA shows them as regions that can
+//    be lined up against the CPU, GPU, and disk activity in the same
+//    trace.  To capture the events, add the provider GUID to a WPR
+//    profile, or start a session for it with xperf
+//    (xperf -start PinballY -on <guid> -f PinballY.etl).
+//
+//    ETW events cost almost nothing when no session is listening.
+//
+//  - Optionally, a Chrome trace-format JSON file, PinballY.trace.json
+//    in the program folder, which can be loaded into Perfetto or
+//    chrome://tracing.  This is enabled by the config variable
+//    Trace.ChromeJson.  Events are buffered in memory and written when
+//    the program exits.  Buffering starts when the program starts, so
+//    that the startup phases are included; if the config file says
+//    that JSON output is off, the buffer is discarded when the config
+//    is loaded.
+//
+// Times are in QueryPerformanceCounter ticks.  Names and categories
+// must be static strings, since the JSON recorder keeps the pointers.
+//
+// Separately from the tracing proper, scopes on the UI thread are also
+// recorded in the Watchdog heartbeat block, if there is one, whether or
+// not tracing is enabled, so that a hang report can say what the UI
+// thread was doing when it stopped (see WatchdogHeartbeat.h).
+
+#pragma once
+#include <stdint.h>
+#include <vector>
+#include "../Utilities/WinUtil.h"
+#include "../Utilities/WatchdogHeartbeat.h"
+
+class Trace
+{
+public:
+	// Initialize - registers the ETW provider and starts the clock
+	static void Init();
+
+	// Shut down - writes the JSON file, if enabled, and unregisters
+	// the ETW provider
+	static void Shutdown();
+
+	// Enable or disable JSON output
+	static void EnableChromeJson(bool enable);
+
+	// Is tracing active?  This is true if JSON output is enabled or an
+	// ETW session is listening to our provider.
+	static bool IsEnabled();
+
+	// get the current time in QPC ticks
+	static int64_t Now()
+	{
+		LARGE_INTEGER t;
+		QueryPerformanceCounter(&t);
+		return t.QuadPart;
+	}
+
+	// Record an interval that was timed by the caller.  This is for
+	// spans that don't fit in a single function scope, such as a video
+	// player's time from opening the file to presenting the first frame.
+	static void Interval(const CHAR *name, const CHAR *category, int64_t t0, int64_t t1, const WCHAR *detail = nullptr);
+
+	// Record a counter value
+	static void Counter(const CHAR *name, double value);
+
+	// Set the Watchdog heartbeat block for recording the UI thread's
+	// active scopes.  Call this from the UI thread.
+	static void SetHeartbeat(WatchdogHeartbeat *hb) { heartbeat = hb; }
+
+	// Push/pop a UI thread scope in the heartbeat block.  Push returns
+	// the scope's slot, or -1 if we're not recording scopes for this
+	// thread.  Pop takes the slot returned from Push.  Scopes normally
+	// nest, but if they end out of order, ending an outer scope also
+	// drops the inner ones.
+	static int PushHeartbeatScope(const CHAR *name, const CHAR *category, const WCHAR *detail)
+	{
+		return heartbeat != nullptr && GetCurrentThreadId() == heartbeat->uiThreadId ?
+			DoPushHeartbeatScope(name, category, detail) : -1;
+	}
+	static void PopHeartbeatScope(int slot)
+	{
+		if (slot >= 0 && heartbeat != nullptr && slot < heartbeat->depth)
+			heartbeat->depth = slot;
+	}
+
+	// Scoped event.  Create one of these on the stack to trace the time
+	// until it goes out of scope (or until End() is called).  'detail'
+	// is an optional description of the item being processed, such as a
+	// game title or file name; we make a private copy.
+	class Scope
+	{
+	public:
+		Scope(const CHAR *name, const CHAR *category, const WCHAR *detail = nullptr);
+		~Scope() { End(); }
+
+		// end the scope explicitly
+		void End();
+
+	protected:
+		const CHAR *name;
+		const CHAR *category;
+		WSTRING detail;
+		int64_t t0;
+		GUID activityId;
+		bool etwActive;
+		bool active;
+
+		// Watchdog heartbeat scope slot, or -1 if none
+		int heartbeatSlot;
+	};
+
+protected:
+	// Watchdog heartbeat block, if any
+	static WatchdogHeartbeat *heartbeat;
+
+	// push a scope into the heartbeat block
+	static int DoPushHeartbeatScope(const CHAR *name, const CHAR *category, const WCHAR *detail);
+
+	// buffered JSON event
+	struct Event
+	{
+		Event(CHAR ph, const CHAR *name, const CHAR *category, int64_t t0, int64_t t1, double value, const WCHAR *detail) :
+			ph(ph), name(name), category(category), t0(t0), t1(t1), value(value),
+			tid(GetCurrentThreadId()), detail(detail != nullptr ? detail : L"") { }
+
+		CHAR ph;                // Chrome trace event type: 'X' = complete, 'C' = counter
+		const CHAR *name;       // event name
+		const CHAR *category;   // category
+		int64_t t0;             // start time, QPC ticks
+		int64_t t1;             // end time, QPC ticks
+		double value;           // counter value
+		DWORD tid;              // thread ID
+		WSTRING detail;         // detail description
+	};
+
+	// add an event to the JSON buffer
+	static void AddEvent(Event &&e);
+
+	// write the JSON file
+	static void WriteChromeJson();
+
+	// JSON output enabled
+	static bool jsonEnabled;
+
+	// starting time and QPC frequency
+	static int64_t tStart;
+	static int64_t freq;
+
+	// Buffered JSON events.  We stop recording when the buffer reaches
+	// the limit, so that a long session doesn't eat unbounded memory;
+	// the most interesting events are usually early on anyway.
+	static const size_t maxEvents = 1000000;
+	static std::vector<Event> events;
+	static bool overflow;
+	static CriticalSection lock;
+};
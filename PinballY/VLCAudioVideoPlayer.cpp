@@ -36,8 +36,13 @@
 #include "D3D.h"
 #include "Sprite.h"
 #include "TextureShader.h"
+#include "LogFile.h"
 #include "I420Shader.h"
 #include "Application.h"
+#include "LoaderPool.h"
+#include "Trace.h"
+#include "StartupTimeline.h"
+#include "TextureBudget.h"
 
 
 // The VLC public API depends on the Posix type ssize_t ("signed size_t"),
@@ -109,19 +114,26 @@ typedef SSIZE_T ssize_t;
 
 // Define pointers the libvlc entrypoints we use
 #define LIBVLC_ENTRYPOINT(func) static decltype(func) *func##_;
+LIBVLC_ENTRYPOINT(libvlc_audio_set_callbacks)
+LIBVLC_ENTRYPOINT(libvlc_audio_set_format_callbacks)
 LIBVLC_ENTRYPOINT(libvlc_audio_set_mute)
 LIBVLC_ENTRYPOINT(libvlc_audio_set_volume)
 LIBVLC_ENTRYPOINT(libvlc_errmsg)
 LIBVLC_ENTRYPOINT(libvlc_event_attach)
+LIBVLC_ENTRYPOINT(libvlc_event_detach)
 LIBVLC_ENTRYPOINT(libvlc_get_version)
 LIBVLC_ENTRYPOINT(libvlc_media_add_option)
 LIBVLC_ENTRYPOINT(libvlc_media_player_event_manager)
 LIBVLC_ENTRYPOINT(libvlc_media_player_release)
+LIBVLC_ENTRYPOINT(libvlc_media_player_new)
 LIBVLC_ENTRYPOINT(libvlc_media_player_new_from_media)
 LIBVLC_ENTRYPOINT(libvlc_media_player_play)
+LIBVLC_ENTRYPOINT(libvlc_media_player_set_media)
+LIBVLC_ENTRYPOINT(libvlc_media_player_set_pause)
 LIBVLC_ENTRYPOINT(libvlc_media_player_set_time)
 LIBVLC_ENTRYPOINT(libvlc_media_player_stop)
 LIBVLC_ENTRYPOINT(libvlc_media_new_path)
+LIBVLC_ENTRYPOINT(libvlc_media_add_option)
 LIBVLC_ENTRYPOINT(libvlc_media_release)
 LIBVLC_ENTRYPOINT(libvlc_new)
 LIBVLC_ENTRYPOINT(libvlc_release)
@@ -139,6 +151,11 @@ static bool libvlcOk = false;
 // libvlc DLL handle
 static HMODULE hmoduleLibvlc = NULL;
 
+// Lock for loading the DLLs and creating the libvlc instance.  These
+// can happen on a startup task thread (see PrewarmInstance()) as well
+// as on the UI thread.
+static CriticalSection libvlcInitLock;
+
 #ifdef _WIN64
 #define VLC_ROOT_DIR _T("VLC64")
 #else
@@ -148,6 +165,8 @@ static HMODULE hmoduleLibvlc = NULL;
 // Import the libvlc entrypoints
 static bool LoadLibvlc(ErrorHandler &eh)
 {
+	CriticalSectionLocker locker(libvlcInitLock);
+
 	// do nothing if we've already loaded VLC
 	if (libvlcLoaded)
 		return hmoduleLibvlc != NULL;
@@ -202,19 +221,26 @@ static bool LoadLibvlc(ErrorHandler &eh)
     if ((func##_ = reinterpret_cast<decltype(func)*>(GetProcAddress(hmoduleLibvlc, #func))) == nullptr) \
 		return Failure(_T("Unable to bind libvlc function ") _T(#func) _T("()"));
 
+	LIBVLC_BIND(libvlc_audio_set_callbacks)
+	LIBVLC_BIND(libvlc_audio_set_format_callbacks)
 	LIBVLC_BIND(libvlc_audio_set_mute)
 	LIBVLC_BIND(libvlc_audio_set_volume)
     LIBVLC_BIND(libvlc_errmsg)
     LIBVLC_BIND(libvlc_event_attach)
+    LIBVLC_BIND(libvlc_event_detach)
 	LIBVLC_BIND(libvlc_get_version)
 	LIBVLC_BIND(libvlc_media_add_option)
     LIBVLC_BIND(libvlc_media_player_event_manager)
     LIBVLC_BIND(libvlc_media_player_release)
+    LIBVLC_BIND(libvlc_media_player_new)
     LIBVLC_BIND(libvlc_media_player_new_from_media)
     LIBVLC_BIND(libvlc_media_player_play)
+    LIBVLC_BIND(libvlc_media_player_set_media)
+    LIBVLC_BIND(libvlc_media_player_set_pause)
     LIBVLC_BIND(libvlc_media_player_set_time)
     LIBVLC_BIND(libvlc_media_player_stop)
     LIBVLC_BIND(libvlc_media_new_path)
+    LIBVLC_BIND(libvlc_media_add_option)
     LIBVLC_BIND(libvlc_media_release)
     LIBVLC_BIND(libvlc_new)
     LIBVLC_BIND(libvlc_release)
@@ -236,6 +262,25 @@ static bool LoadLibvlc(ErrorHandler &eh)
 // statics
 libvlc_instance_t *VLCAudioVideoPlayer::vlcInst = nullptr;
 bool VLCAudioVideoPlayer::initFailed = false;
+bool VLCAudioVideoPlayer::useTextureRing = true;
+bool VLCAudioVideoPlayer::hardwareDecoding = false;
+bool VLCAudioVideoPlayer::gaplessLooping = true;
+int VLCAudioVideoPlayer::playerPoolSize = 4;
+bool VLCAudioVideoPlayer::useSharedMixer = true;
+bool VLCAudioVideoPlayer::downscaleToWindow = true;
+int VLCAudioVideoPlayer::scalerMode = 2;
+std::list<libvlc_media_player_t*> VLCAudioVideoPlayer::idlePlayers;
+bool VLCAudioVideoPlayer::warmingPool = false;
+bool VLCAudioVideoPlayer::poolShutdown = false;
+CriticalSection VLCAudioVideoPlayer::poolLock;
+UINT64 VLCAudioVideoPlayer::statsVideos = 0;
+UINT64 VLCAudioVideoPlayer::statsPooled = 0;
+double VLCAudioVideoPlayer::statsLast_ms = 0.0;
+double VLCAudioVideoPlayer::statsTotal_ms = 0.0;
+double VLCAudioVideoPlayer::statsMax_ms = 0.0;
+std::list<VLCAudioVideoPlayer*> VLCAudioVideoPlayer::livePlayers;
+CriticalSection VLCAudioVideoPlayer::livePlayersLock;
+CriticalSection VLCAudioVideoPlayer::statsLock;
 
 const char *VLCAudioVideoPlayer::GetLibVersion()
 {
@@ -272,10 +317,23 @@ VLCAudioVideoPlayer::VLCAudioVideoPlayer(HWND hwndVideo, HWND hwndEvent, bool au
 	// creating small textures instead of decoding at full size, but
 	// that might actually be worse for overall performance because it
 	// would VLC to rescale the images.
+
+	// add it to the live player list
+	CriticalSectionLocker locker(livePlayersLock);
+	livePlayers.push_back(this);
 }
 
 void VLCAudioVideoPlayer::OnAppExit()
 {
+	// release the idle players, and stop any further pool warm-up
+	{
+		CriticalSectionLocker locker(poolLock);
+		poolShutdown = true;
+		for (auto p : idlePlayers)
+			libvlc_media_player_release_(p);
+		idlePlayers.clear();
+	}
+
     // if we created a libvlc instance, release it
     if (vlcInst != nullptr)
     {
@@ -288,6 +346,10 @@ VLCAudioVideoPlayer::~VLCAudioVideoPlayer()
 {
 	// Shut down VLC
 	Shutdown();
+
+	// remove it from the live player list
+	CriticalSectionLocker locker(livePlayersLock);
+	livePlayers.remove(this);
 }
 
 void VLCAudioVideoPlayer::Shutdown()
@@ -297,12 +359,7 @@ void VLCAudioVideoPlayer::Shutdown()
 		Stop(SilentErrorHandler());
 
 	// release the VLC objects
-	if (player != nullptr)
-	{
-		CriticalSectionLocker lock(playerLock);
-		libvlc_media_player_release_(player);
-		player = nullptr;
-	}
+	ReleasePlayer();
 	if (media != nullptr)
 	{
 		libvlc_media_release_(media);
@@ -310,6 +367,123 @@ void VLCAudioVideoPlayer::Shutdown()
 	}
 }
 
+void VLCAudioVideoPlayer::PrewarmInstance()
+{
+	CriticalSectionLocker locker(libvlcInitLock);
+
+	// Load the DLLs.  We're not on the UI thread, so capture any errors
+	// instead of displaying them, and reset the load status on failure,
+	// so that the UI thread's first attempt reports the error.
+	if (!libvlcLoaded)
+	{
+		CapturingErrorHandler ceh;
+		if (!LoadLibvlc(ceh))
+		{
+			libvlcLoaded = false;
+			return;
+		}
+	}
+
+	// create the instance, if we haven't already; on failure, clear the
+	// failure flag for the same reason as above
+	if (libvlcOk && vlcInst == nullptr)
+	{
+		CapturingErrorHandler ceh;
+		if (!InitVLCInstance(ceh))
+			initFailed = false;
+	}
+}
+
+bool VLCAudioVideoPlayer::InitVLCInstance(ErrorHandler &eh)
+{
+	// if another thread created the instance while we were waiting for
+	// the lock, there's nothing to do
+	CriticalSectionLocker locker(libvlcInitLock);
+	if (vlcInst != nullptr)
+		return true;
+
+	// Set some special options:
+	//
+	// --no-lua - disable LUA support.  LUA is a scripting language,
+	// which we have no use for.  Disabling it speeds up the DLL 
+	// loading.
+	//
+	// --deinterlace=0 - disable the de-interlacing filter.  It
+	// would be nicer if we could leave this enabled, but VLC's
+	// deinterlacing filter currently (as of 3.0.8) has a huge
+	// limitation, which is that it doesn't handle any formats with
+	// alpha channel (transparency) information.  Alpha support is
+	// necessary for video layering.  Interlacing is commonly used
+	// for broadcast media, but is rare for computer media, so I
+	// don't think it'll be a significant limitation to remove the
+	// filter.  If anyone runs into problems with unplayable videos
+	// that turns out to be due to interlacing, they could run them
+	// through ffmpeg to deinterlace them, or if that's a problem
+	// for some reason, we could add a global program option to
+	// enable this.
+	//
+	// --verbose=0 --quiet - disable as much logging as we can.
+	// libvlc generates tons of OutputDebugString messages, which
+	// waste CPU time and clutter the debugger console in dev
+	// builds.  There's no way to disable most of them, but
+	// these options are supposed to at least reduce them.  In
+	// practice, unfortunately, not by much.
+	//
+	// --swscale-mode=N - select the software scaler's algorithm.  This
+	// is the scaler that libvlc uses when we ask for frames smaller
+	// than the native video size (see GetTargetFrameSize()).
+	// 
+	char swscaleArg[32];
+	sprintf_s(swscaleArg, "--swscale-mode=%d", scalerMode);
+	const char *args[] = {
+		"--no-lua",
+		"--deinterlace=0",
+		"--verbose=-1",
+		"--quiet",
+		swscaleArg,
+	};
+	// Start the shared audio mixer, if enabled.  We do this here, ahead
+	// of creating any players, so that every player makes the same choice
+	// between the mixer and libvlc's own audio output; pooled players
+	// keep their audio callbacks from one owner to the next.
+	if (useSharedMixer)
+	{
+		StartupTimeline::Phase mixerPhase("Audio mixer init");
+		AudioMixer::Init();
+	}
+
+	StartupTimeline::Phase phase("VLC instance setup");
+	vlcInst = libvlc_new_(countof(args), args);
+	phase.End();
+	if (vlcInst == nullptr)
+	{
+		// VLC init failed.  If this has happened before, don't
+		// bother showing another message; just fail silently.
+		// One initialization failure usually means we'll never
+		// be able to initialize, so there's no benefit in showing
+		// the same error every time we try to load a video.
+		if (!initFailed)
+		{
+			// remember the initialization failure in case we try again
+			initFailed = true;
+
+			// Show an error.  We usually can't get more details from
+			// VLC when we can't load VLC in the first place, but give
+			// it a shot on the off chance.
+			const char *errmsg = libvlc_errmsg_();
+			eh.SysError(LoadStringT(IDS_ERR_VIDEOPLAYERSYSERR),
+				errmsg != nullptr ? MsgFmt(_T("Error initializing libvlc: %hs"), errmsg) :
+				_T("Error initializing libvlc"));
+		}
+		return false;
+	}
+
+	// Start filling the idle player pool, so that the next videos we
+	// open don't have to wait for new player instances.
+	WarmPlayerPool();
+	return true;
+}
+
 bool VLCAudioVideoPlayer::OpenWithTarget(const TCHAR *path, ErrorHandler &eh, TargetDevice target)
 {
 	// remember the media object
@@ -319,13 +493,16 @@ bool VLCAudioVideoPlayer::OpenWithTarget(const TCHAR *path, ErrorHandler &eh, Ta
 	if (!libvlcOk)
 		return false;
 
+	// trace the open
+	Trace::Scope trace("Video open", "video", path);
+
 	// release any existing media player
-	if (player != nullptr)
-	{
-		CriticalSectionLocker lock(playerLock);
-		libvlc_media_player_release_(player);
-		player = nullptr;
-	}
+	ReleasePlayer();
+
+	// start the startup time measurement
+	LARGE_INTEGER t0;
+	QueryPerformanceCounter(&t0);
+	openTicks = t0.QuadPart;
 
 	// release any existing media object
 	if (media != nullptr)
@@ -339,66 +516,12 @@ bool VLCAudioVideoPlayer::OpenWithTarget(const TCHAR *path, ErrorHandler &eh, Ta
 	do
 	{
 		// create the VLC instance if we haven't already
-		if (vlcInst == nullptr)
-		{
-			// Set some special options:
-			//
-			// --no-lua - disable LUA support.  LUA is a scripting language,
-			// which we have no use for.  Disabling it speeds up the DLL 
-			// loading.
-			//
-			// --deinterlace=0 - disable the de-interlacing filter.  It
-			// would be nicer if we could leave this enabled, but VLC's
-			// deinterlacing filter currently (as of 3.0.8) has a huge
-			// limitation, which is that it doesn't handle any formats with
-			// alpha channel (transparency) information.  Alpha support is
-			// necessary for video layering.  Interlacing is commonly used
-			// for broadcast media, but is rare for computer media, so I
-			// don't think it'll be a significant limitation to remove the
-			// filter.  If anyone runs into problems with unplayable videos
-			// that turns out to be due to interlacing, they could run them
-			// through ffmpeg to deinterlace them, or if that's a problem
-			// for some reason, we could add a global program option to
-			// enable this.
-			//
-			// --verbose=0 --quiet - disable as much logging as we can.
-			// libvlc generates tons of OutputDebugString messages, which
-			// waste CPU time and clutter the debugger console in dev
-			// builds.  There's no way to disable most of them, but
-			// these options are supposed to at least reduce them.  In
-			// practice, unfortunately, not by much.
-			// 
-			static const char *args[] = {
-				"--no-lua",
-				"--deinterlace=0",
-				"--verbose=-1",
-				"--quiet",
-			};
-			if ((vlcInst = libvlc_new_(countof(args), args)) == nullptr)
-			{
-				// VLC init failed.  If this has happened before, don't
-				// bother showing another message; just fail silently.
-				// One initialization failure usually means we'll never
-				// be able to initialize, so there's no benefit in showing
-				// the same error every time we try to load a video.
-				if (!initFailed)
-				{
-					// remember the initialization failure in case we try again
-					initFailed = true;
-
-					// Show an error.  We usually can't get more details from
-					// VLC when we can't load VLC in the first place, but give
-					// it a shot on the off chance.
-					const char *errmsg = libvlc_errmsg_();
-					eh.SysError(LoadStringT(IDS_ERR_VIDEOPLAYERSYSERR),
-						errmsg != nullptr ? MsgFmt(_T("Error initializing libvlc: %hs"), errmsg) :
-						_T("Error initializing libvlc"));
-				}
-				break;
-			}
-		}
+		if (vlcInst == nullptr && !InitVLCInstance(eh))
+			break;
 
-		// Create a media item from the file path
+		// Create a media item from the file path.  The new media doesn't
+		// have an input-repeat option yet.
+		repeatOption = false;
 		if ((media = libvlc_media_new_path_(vlcInst, WideToAnsi(path, CP_UTF8).c_str())) == nullptr)
 		{
 			eh.SysError(LoadStringT(IDS_ERR_VIDEOPLAYERSYSERR),
@@ -406,19 +529,45 @@ bool VLCAudioVideoPlayer::OpenWithTarget(const TCHAR *path, ErrorHandler &eh, Ta
 			break;
 		}
 
-		// create a media player for the media item
-		if ((player = libvlc_media_player_new_from_media_(media)) == nullptr)
+		// If hardware decoding is enabled, ask libvlc to use the D3D11
+		// video acceleration decoder.  libvlc copies the decoded frames
+		// back to system memory in the decoder's native NV12 layout, which
+		// we pass straight through to the NV12 shader (see OnVideoSetFormat).
+		// This only applies to regular video windows; the DMD target does
+		// its own conversion to a tiny I420 frame, so there's nothing to
+		// gain there.
+		if (hardwareDecoding && target == VideoTarget)
+			libvlc_media_add_option_(media, ":avcodec-hw=d3d11va");
+
+		// get a media player for the media item, from the idle pool if
+		// possible, since creating a new player is fairly slow
+		{
+			CriticalSectionLocker lock(playerLock);
+			player = AcquirePlayer(pooledPlayer);
+		}
+		if (player == nullptr)
 		{
 			eh.SysError(LoadStringT(IDS_ERR_VIDEOPLAYERSYSERR),
 				MsgFmt(_T("Creating media player for %s: %hs"), path, libvlc_errmsg_()));
 			break;
 		}
+		libvlc_media_player_set_media_(player, media);
 
-		// set the initial volume
-		libvlc_audio_set_volume_(player, volume);
+		// Route the audio through the shared mixer, if it's running;
+		// otherwise set the initial volume on the player.  With the mixer,
+		// the player's own volume stays at 100%, and we apply our volume
+		// as the gain on the mixer source.
+		if (AudioMixer::Get() != nullptr)
+		{
+			libvlc_audio_set_callbacks_(player, &OnAudioPlay, &OnAudioPause, &OnAudioResume, &OnAudioFlush, &OnAudioDrain, this);
+			libvlc_audio_set_format_callbacks_(player, &OnAudioSetup, &OnAudioCleanup);
+		}
+		else
+			libvlc_audio_set_volume_(player, volume);
 
 		// register for events
 		libvlc_event_attach_(libvlc_media_player_event_manager_(player), libvlc_MediaPlayerEndReached, &OnMediaPlayerEndReached, this);
+		libvlc_event_attach_(libvlc_media_player_event_manager_(player), libvlc_MediaPlayerPositionChanged, &OnMediaPlayerPositionChanged, this);
 
 		// Set up the decoding callbacks.  Choose the set according to the
 		// target device type.
@@ -435,6 +584,9 @@ bool VLCAudioVideoPlayer::OpenWithTarget(const TCHAR *path, ErrorHandler &eh, Ta
 			break;
 		}
 
+		// top up the idle pool for the next video
+		WarmPlayerPool();
+
 		// success
 		ok = true;
 
@@ -443,12 +595,8 @@ bool VLCAudioVideoPlayer::OpenWithTarget(const TCHAR *path, ErrorHandler &eh, Ta
 	// on failure, delete any half-baked objects we created
 	if (!ok)
 	{
-		if (player != nullptr)
-		{
-			CriticalSectionLocker lock(playerLock);
-			libvlc_media_player_release_(player);
-			player = nullptr;
-		}
+		openTicks = 0;
+		ReleasePlayer();
 		if (media != nullptr)
 		{
 			libvlc_media_release_(media);
@@ -460,6 +608,162 @@ bool VLCAudioVideoPlayer::OpenWithTarget(const TCHAR *path, ErrorHandler &eh, Ta
 	return ok;
 }
 
+libvlc_media_player_t *VLCAudioVideoPlayer::AcquirePlayer(bool &fromPool)
+{
+	// take an idle player from the pool if there's one available
+	{
+		CriticalSectionLocker locker(poolLock);
+		if (idlePlayers.size() != 0)
+		{
+			libvlc_media_player_t *p = idlePlayers.front();
+			idlePlayers.pop_front();
+			fromPool = true;
+			return p;
+		}
+	}
+
+	// the pool is empty, so create a new player
+	fromPool = false;
+	return libvlc_media_player_new_(vlcInst);
+}
+
+void VLCAudioVideoPlayer::ReleasePlayer()
+{
+	if (player == nullptr)
+		return;
+
+	CriticalSectionLocker lock(playerLock);
+
+	// Detach our event handler, so that the player can't call back into
+	// this object after the player is handed to another object.
+	libvlc_event_detach_(libvlc_media_player_event_manager_(player), libvlc_MediaPlayerEndReached, &OnMediaPlayerEndReached, this);
+	libvlc_event_detach_(libvlc_media_player_event_manager_(player), libvlc_MediaPlayerPositionChanged, &OnMediaPlayerPositionChanged, this);
+
+	// If there's room in the idle pool, stop the player, detach the
+	// media, and park it in the pool for reuse.  The next owner sets up
+	// its own callbacks before playing anything, and the player can't
+	// invoke the old ones while it's stopped.
+	bool pooled = false, room;
+	{
+		CriticalSectionLocker locker(poolLock);
+		room = !poolShutdown && static_cast<int>(idlePlayers.size()) < playerPoolSize;
+	}
+	if (room)
+	{
+		libvlc_media_player_stop_(player);
+		libvlc_media_player_set_media_(player, nullptr);
+
+		CriticalSectionLocker locker(poolLock);
+		if (!poolShutdown && static_cast<int>(idlePlayers.size()) < playerPoolSize)
+		{
+			idlePlayers.emplace_back(player);
+			pooled = true;
+		}
+	}
+
+	// if we didn't pool it, release it
+	if (!pooled)
+		libvlc_media_player_release_(player);
+
+	player = nullptr;
+}
+
+void VLCAudioVideoPlayer::WarmPlayerPool()
+{
+	// if the pool is already full, or a warm-up task is already running,
+	// there's nothing to do
+	{
+		CriticalSectionLocker locker(poolLock);
+		if (warmingPool || poolShutdown || vlcInst == nullptr
+			|| static_cast<int>(idlePlayers.size()) >= playerPoolSize)
+			return;
+
+		warmingPool = true;
+	}
+
+	// Create the players on the loader pool, at prefetch priority, since
+	// they're only for the benefit of videos we haven't asked for yet.
+	// The players are created under the pool lock, so that OnAppExit()
+	// can't release the libvlc instance out from under us.
+	auto task = []()
+	{
+		for (;;)
+		{
+			CriticalSectionLocker locker(poolLock);
+			if (poolShutdown || static_cast<int>(idlePlayers.size()) >= playerPoolSize)
+				break;
+
+			libvlc_media_player_t *p = libvlc_media_player_new_(vlcInst);
+			if (p == nullptr)
+				break;
+
+			idlePlayers.emplace_back(p);
+		}
+
+		CriticalSectionLocker locker(poolLock);
+		warmingPool = false;
+	};
+	if (!LoaderPool::Submit(task, LoaderPool::Priority::Prefetch))
+	{
+		// The loader pool is busy.  Don't do the work inline, since the
+		// point is to keep player creation off the UI thread; AcquirePlayer()
+		// will simply create players on demand until the next attempt.
+		CriticalSectionLocker locker(poolLock);
+		warmingPool = false;
+	}
+}
+
+void VLCAudioVideoPlayer::RecordStartupTime()
+{
+	// only count the first frame after an Open
+	if (openTicks == 0)
+		return;
+
+	LARGE_INTEGER now, freq;
+	QueryPerformanceCounter(&now);
+	QueryPerformanceFrequency(&freq);
+	double ms = static_cast<double>(now.QuadPart - openTicks) * 1000.0 / static_cast<double>(freq.QuadPart);
+	Trace::Interval("Video first frame", "video", openTicks, now.QuadPart, mediaPath.c_str());
+	openTicks = 0;
+
+	CriticalSectionLocker locker(statsLock);
+	statsVideos += 1;
+	if (pooledPlayer)
+		statsPooled += 1;
+	statsLast_ms = ms;
+	statsTotal_ms += ms;
+	statsMax_ms = max(statsMax_ms, ms);
+}
+
+void VLCAudioVideoPlayer::GetStartupStats(StartupStats &stats)
+{
+	CriticalSectionLocker locker(statsLock);
+	stats.nVideos = statsVideos;
+	stats.nPooled = statsPooled;
+	stats.last_ms = statsLast_ms;
+	stats.avg_ms = statsVideos != 0 ? statsTotal_ms / static_cast<double>(statsVideos) : 0.0;
+	stats.max_ms = statsMax_ms;
+}
+
+void VLCAudioVideoPlayer::GetPlaybackStats(std::vector<PlaybackStats> &stats)
+{
+	// report the players that are currently playing
+	CriticalSectionLocker locker(livePlayersLock);
+	stats.clear();
+	for (auto p : livePlayers)
+	{
+		if (p->isPlaying)
+			stats.push_back({ p->mediaPath, static_cast<UINT64>(p->framesDecoded), static_cast<UINT64>(p->framesDropped) });
+	}
+}
+
+void VLCAudioVideoPlayer::ResetStartupStats()
+{
+	CriticalSectionLocker locker(statsLock);
+	statsVideos = statsPooled = 0;
+	statsLast_ms = statsTotal_ms = statsMax_ms = 0.0;
+}
+
 bool VLCAudioVideoPlayer::Play(ErrorHandler &eh)
 {
 	// proceed only if there's a player
@@ -479,7 +783,10 @@ bool VLCAudioVideoPlayer::Play(ErrorHandler &eh)
 
 	// Set muting mode and volume.  The libvlc documentation says that the muting
 	// function is unreliable, so we'll just set the volume to zero insetad.
-	libvlc_audio_set_volume_(player, muted ? 0 : volume);
+	ApplyVolume();
+
+	// set up in-player looping according to the current looping mode
+	ApplyRepeatOption();
 
 	// start playback
 	libvlc_media_player_play_(player);
@@ -494,8 +801,10 @@ bool VLCAudioVideoPlayer::Play(ErrorHandler &eh)
 	// also occur on the first play, and in that case it might be using
 	// uninitialized data that on some machines manifests as a muted
 	// first play.  So we'll do our explicit volume setting the first
-	// time through as well.
-	LaunchVolInitThread();
+	// time through as well.  (None of this applies with the shared
+	// mixer, since we don't use the libvlc volume at all in that case.)
+	if (AudioMixer::Get() == nullptr)
+		LaunchVolInitThread();
 
 	// success
 	return true;
@@ -516,6 +825,7 @@ bool VLCAudioVideoPlayer::Replay(ErrorHandler &eh)
 	libvlc_media_player_set_time_(player, 0);
 
 	// start playback
+	ApplyRepeatOption();
 	libvlc_media_player_play_(player);
 
 	// playback (re-)started
@@ -530,8 +840,10 @@ bool VLCAudioVideoPlayer::Replay(ErrorHandler &eh)
 	// varies from machine to machine and by phase of the moon.  It's not
 	// acceptble to take a 30-50ms delay here, as that would stall the UI for
 	// a noticeable period.  Instead, set up a background thread to do the 
-	// work after a suitable delay.
-	LaunchVolInitThread();
+	// work after a suitable delay.  The shared mixer is immune, since it
+	// applies our volume itself.
+	if (AudioMixer::Get() == nullptr)
+		LaunchVolInitThread();
 
 	// success
 	return true;
@@ -601,6 +913,13 @@ bool VLCAudioVideoPlayer::Stop(ErrorHandler &eh)
 	return true;
 }
 
+void VLCAudioVideoPlayer::SetPause(bool pause)
+{
+	// pause or resume the player, if it's running
+	if (player != nullptr && isPlaying)
+		libvlc_media_player_set_pause_(player, pause ? 1 : 0);
+}
+
 void VLCAudioVideoPlayer::Mute(bool f)
 {
 	// remember the new muting mode internally
@@ -610,29 +929,174 @@ void VLCAudioVideoPlayer::Mute(bool f)
 	// function (libvlc_audio_set_mute) isn't reliable (the documentation
 	// says so and experience bears this out; it sometimes works but often
 	// doesn't).  Setting the volume to zero seems more reliable.
-	if (player != nullptr)
-		libvlc_audio_set_volume_(player, muted ? 0 : volume);
+	ApplyVolume();
 }
 
 void VLCAudioVideoPlayer::SetVolume(int pctVol)
 {
 	volume = pctVol;
-	if (player != nullptr)
+	ApplyVolume();
+}
+
+void VLCAudioVideoPlayer::ApplyVolume()
+{
+	if (AudioMixer::Get() != nullptr)
+	{
+		// set the gain on the mixer source, if the stream is running; if
+		// not, the source picks up the current volume when it's created
+		CriticalSectionLocker locker(mixerLock);
+		if (mixerSource != nullptr)
+			mixerSource->SetVolume(muted ? 0.0f : static_cast<float>(volume) / 100.0f, volumeFade_ms);
+	}
+	else if (player != nullptr)
 		libvlc_audio_set_volume_(player, muted ? 0 : volume);
 }
 
+int VLCAudioVideoPlayer::OnAudioSetup(void **opaque, char *format, unsigned *rate, unsigned *channels)
+{
+	// if the mixer isn't running, fail the setup, which just leaves the
+	// stream silent
+	auto self = static_cast<VLCAudioVideoPlayer*>(*opaque);
+	auto mixer = AudioMixer::Get();
+	if (mixer == nullptr)
+		return -1;
+
+	// Ask for float samples at the device rate, in mono or stereo, so
+	// that libvlc's converter does all of the format work in one pass.
+	memcpy(format, "FL32", 4);
+	*rate = mixer->GetSampleRate();
+	*channels = *channels == 1 ? 1 : 2;
+
+	// create the mixer source, at the current volume
+	CriticalSectionLocker locker(self->mixerLock);
+	if (self->mixerSource != nullptr)
+		self->mixerSource->Close();
+	self->mixerSource.Attach(mixer->CreateSource(*rate, *channels,
+		self->muted ? 0.0f : static_cast<float>(self->volume) / 100.0f));
+	return 0;
+}
+
+void VLCAudioVideoPlayer::OnAudioCleanup(void *opaque)
+{
+	// close the source; the mixer drops it once it plays out
+	auto self = static_cast<VLCAudioVideoPlayer*>(opaque);
+	CriticalSectionLocker locker(self->mixerLock);
+	if (self->mixerSource != nullptr)
+	{
+		self->mixerSource->Close();
+		self->mixerSource = nullptr;
+	}
+}
+
+void VLCAudioVideoPlayer::OnAudioPlay(void *opaque, const void *samples, unsigned count, int64_t)
+{
+	if (auto s = static_cast<VLCAudioVideoPlayer*>(opaque)->mixerSource.Get(); s != nullptr)
+		s->Write(static_cast<const float*>(samples), count);
+}
+
+void VLCAudioVideoPlayer::OnAudioPause(void *opaque, int64_t)
+{
+	if (auto s = static_cast<VLCAudioVideoPlayer*>(opaque)->mixerSource.Get(); s != nullptr)
+		s->Pause(true);
+}
+
+void VLCAudioVideoPlayer::OnAudioResume(void *opaque, int64_t)
+{
+	if (auto s = static_cast<VLCAudioVideoPlayer*>(opaque)->mixerSource.Get(); s != nullptr)
+		s->Pause(false);
+}
+
+void VLCAudioVideoPlayer::OnAudioFlush(void *opaque, int64_t)
+{
+	if (auto s = static_cast<VLCAudioVideoPlayer*>(opaque)->mixerSource.Get(); s != nullptr)
+		s->Flush();
+}
+
+void VLCAudioVideoPlayer::OnAudioDrain(void *opaque)
+{
+	// wait for the buffered samples to play out, so that the end of the
+	// track isn't cut off
+	if (auto s = static_cast<VLCAudioVideoPlayer*>(opaque)->mixerSource.Get(); s != nullptr)
+		s->Drain(AudioMixer::sourceBuffer_ms * 2);
+}
+
 void VLCAudioVideoPlayer::SetLooping(bool f)
 {
-	// remember the new looping mode
+	// Remember the new looping mode.  If we're looping inside the
+	// player, the input-repeat option stays in effect until the next
+	// Play() or Replay(); if looping is turned off in the meantime, we
+	// stop the playback at the next wrap-around instead.
 	looping = f;
 }
 
+void VLCAudioVideoPlayer::ApplyRepeatOption()
+{
+	// Set the input-repeat option to match the looping mode, if it's
+	// changed.  There's no way to remove a media option, but a later
+	// setting of the same option overrides an earlier one.
+	bool repeat = looping && gaplessLooping;
+	if (media != nullptr && repeat != repeatOption)
+	{
+		libvlc_media_add_option_(media, repeat ? ":input-repeat=65535" : ":input-repeat=0");
+		repeatOption = repeat;
+	}
+
+	// start the position tracking over
+	lastPosition = 0.0f;
+}
+
+void VLCAudioVideoPlayer::GetTargetFrameSize(unsigned *width, unsigned *height) const
+{
+	// skip this if downscaling is disabled, or we don't know the size
+	RECT rc;
+	if (!downscaleToWindow || *width == 0 || *height == 0
+		|| hwndVideo == NULL || !GetClientRect(hwndVideo, &rc))
+		return;
+
+	// get the window size
+	unsigned cx = static_cast<unsigned>(rc.right - rc.left);
+	unsigned cy = static_cast<unsigned>(rc.bottom - rc.top);
+	if (cx == 0 || cy == 0)
+		return;
+
+	// Figure the scale.  We don't know how the view will orient the video
+	// (playfield videos are rotated 90 degrees, for example), so match
+	// the long side of the video to the long side of the window, and the
+	// short side to the short side, and take the larger of the two ratios
+	// so that the scaled frame covers the window in both directions.
+	double longRatio = static_cast<double>(max(cx, cy)) / static_cast<double>(max(*width, *height));
+	double shortRatio = static_cast<double>(min(cx, cy)) / static_cast<double>(min(*width, *height));
+	double scale = max(longRatio, shortRatio);
+
+	// Only scale down, and only if it saves a worthwhile amount, since
+	// scaling costs something in itself.
+	if (scale > 0.8)
+		return;
+
+	// figure the new size, rounding to even dimensions for the sub-sampled
+	// chroma planes
+	unsigned newWidth = (static_cast<unsigned>(*width * scale) + 1) & ~1U;
+	unsigned newHeight = (static_cast<unsigned>(*height * scale) + 1) & ~1U;
+	LogFile::Get()->Write(LogFile::MediaFileLogging, _T("Video: decoding %s at %ux%u (native size %ux%u)\n"),
+		mediaPath.c_str(), newWidth, newHeight, *width, *height);
+
+	*width = max(newWidth, 2U);
+	*height = max(newHeight, 2U);
+}
+
 unsigned int VLCAudioVideoPlayer::OnVideoSetFormat(void **opaque, char *chroma,
 	unsigned *width, unsigned *height, unsigned *pitches, unsigned *lines)
 {
 	// get the 'this' pointer
 	auto self = reinterpret_cast<VLCAudioVideoPlayer*>(*opaque);
 
+	// If the video is larger than the window, have libvlc scale it down
+	// to the window size.  Everything below works in terms of the adjusted
+	// size, so this reduces the buffer sizes and the per-frame copies and
+	// uploads, as well as the format size we report to the event window.
+	// Note that libvlc's own scaler does the work, in the decoder pipeline.
+	self->GetTargetFrameSize(width, height);
+
 	// plane descriptions, to be set according to the format
 	int nPlanes = 0;
 	FrameBuffer::Plane planes[4];
@@ -837,6 +1301,58 @@ unsigned int VLCAudioVideoPlayer::OnVideoSetFormat(void **opaque, char *chroma,
 			// let's not add another shader for this.
 			memcpy(chroma, "YA0L", 4);
 		}
+		else if (memcmp(chroma, "P010", 4) == 0)
+		{
+			// P010 - the 10-bit version of NV12, which the decoders (and
+			// hardware decoders in particular) produce for 10-bit sources
+			// such as HDR HEVC.  Pass it straight through rather than
+			// having libvlc convert it down to 8-bit I420 on the CPU.
+			//
+			// The layout is the same as NV12, except that each sample takes
+			// two bytes, with the 10 significant bits in the high bits of
+			// the little-endian 16-bit word.  Since the low bits are zero,
+			// R16_UNORM normalizes the samples to the correct 0..1 range
+			// without any adjustment, so the NV12 shader works unchanged.
+			nPlanes = 2;
+			pitches[0] = (*width * 2 + 127) / 128 * 128;
+			pitches[1] = ((*width + 1) / 2 * 4 + 127) / 128 * 128;
+			planes[0].textureDesc = CD3D11_TEXTURE2D_DESC(
+				DXGI_FORMAT_R16_UNORM, *width, lines[0], 1, 1,
+				D3D11_BIND_SHADER_RESOURCE, D3D11_USAGE_IMMUTABLE, 0, 1, 0, 0);
+			planes[1].textureDesc = CD3D11_TEXTURE2D_DESC(
+				DXGI_FORMAT_R16G16_UNORM, (*width + 1) / 2, lines[1], 1, 1,
+				D3D11_BIND_SHADER_RESOURCE, D3D11_USAGE_IMMUTABLE, 0, 1, 0, 0);
+
+			// use the NV12 shader
+			shader = Application::Get()->nv12Shader.get();
+		}
+		else if (hardwareDecoding || memcmp(chroma, "NV12", 4) == 0)
+		{
+			// Regular non-alpha format, with hardware decoding or with a
+			// decoder that natively produces NV12.  Use NV12, which is the
+			// native output format of the D3D11 hardware decoders and many
+			// software decoders.  This lets libvlc copy the decoded frames
+			// straight into our buffers, without a CPU pass to split the
+			// chroma into separate planes, and uses one less texture per
+			// frame than I420.
+			//
+			// NV12 has two planes.  The Y plane is the same as in I420.  The
+			// second plane interleaves the U and V samples, one U:V byte pair
+			// per 2x2 pixel block, so it's half the height of the Y plane and
+			// the same width in bytes.  We set that up as a two-channel R8G8
+			// texture for the shader.
+			nPlanes = 2;
+			pitches[1] = ((*width + 1) / 2 * 2 + 127) / 128 * 128;
+			planes[1].textureDesc = CD3D11_TEXTURE2D_DESC(
+				DXGI_FORMAT_R8G8_UNORM, (*width + 1) / 2, lines[1], 1, 1,
+				D3D11_BIND_SHADER_RESOURCE, D3D11_USAGE_IMMUTABLE, 0, 1, 0, 0);
+
+			// set the libvlc output format to NV12
+			memcpy(chroma, "NV12", 4);
+
+			// use the NV12 shader
+			shader = Application::Get()->nv12Shader.get();
+		}
 		else
 		{
 			// Regular non-alpha format.  Force the output format to
@@ -890,7 +1406,7 @@ unsigned int VLCAudioVideoPlayer::OnVideoSetFormat(void **opaque, char *chroma,
 		}
 
 		// allocate the pixel array
-		f->pixBuf.reset(static_cast<BYTE*>(_mm_malloc(bufsize, 128)));
+		f->AllocPixBuf(bufsize, 128);
 		if (f->pixBuf == nullptr)
 			return 0;
 	}
@@ -980,6 +1496,9 @@ void VLCAudioVideoPlayer::OnVideoFrameUnlock(void *opaque, void *pictureId, void
 
 	// the buffer now has a valid decoded frame
 	f->status = FrameBuffer::Valid;
+
+	// count it
+	InterlockedIncrement64(&reinterpret_cast<VLCAudioVideoPlayer*>(opaque)->framesDecoded);
 }
 
 void VLCAudioVideoPlayer::OnVideoFramePresent(void *opaque, void *pictureId)
@@ -1010,7 +1529,11 @@ void VLCAudioVideoPlayer::OnVideoFramePresent(void *opaque, void *pictureId)
 		// contention by deferring that check until we actually need
 		// to write into a buffer.
 		if (self->presentedFrame != nullptr && self->presentedFrame != f)
+		{
+			// the renderer never took this frame, so it was dropped
 			self->presentedFrame->status = FrameBuffer::Free;
+			InterlockedIncrement64(&self->framesDropped);
+		}
 
 		// this is now the presented frame
 		self->presentedFrame = f;
@@ -1024,10 +1547,94 @@ void VLCAudioVideoPlayer::OnVideoFramePresent(void *opaque, void *pictureId)
 	if (!self->firstFramePresented)
 	{
 		// send the 'first frame' message
-		PostMessage(self->hwndEvent, AVPMsgFirstFrameReady, (WPARAM)self->cookie, 0);
+		self->PostFirstFrameReady();
 
 		// we've now presented the first frame
 		self->firstFramePresented = true;
+
+		// record the startup time statistics
+		self->RecordStartupTime();
+	}
+}
+
+void VLCAudioVideoPlayer::PostFirstFrameReady()
+{
+	PostMessage(hwndEvent, AVPMsgFirstFrameReady, (WPARAM)cookie, 0);
+	for (auto h : extraEventWindows)
+		PostMessage(h, AVPMsgFirstFrameReady, (WPARAM)cookie, 0);
+}
+
+void VLCAudioVideoPlayer::AddEventWindow(HWND hwnd)
+{
+	CriticalSectionLocker locker(lock);
+	extraEventWindows.push_back(hwnd);
+}
+
+void VLCAudioVideoPlayer::RemoveEventWindow(HWND hwnd)
+{
+	CriticalSectionLocker locker(lock);
+
+	// If it's the main event window, promote the first additional
+	// window to take its place, so that the loop and end-of-playback
+	// events still reach a window that's using the player.  Otherwise
+	// just remove it from the additional window list.
+	if (hwnd == hwndEvent)
+	{
+		if (extraEventWindows.size() != 0)
+		{
+			hwndEvent = extraEventWindows.front();
+			extraEventWindows.erase(extraEventWindows.begin());
+		}
+	}
+	else if (auto it = std::find(extraEventWindows.begin(), extraEventWindows.end(), hwnd); it != extraEventWindows.end())
+		extraEventWindows.erase(it);
+}
+
+void VLCAudioVideoPlayer::OnMediaPlayerPositionChanged(const libvlc_event_t *event, void *opaque)
+{
+	// get the 'this' pointer
+	auto self = reinterpret_cast<VLCAudioVideoPlayer*>(opaque);
+
+	// note the new position
+	float pos = event->u.media_player_position_changed.new_position;
+	float prv = self->lastPosition;
+	self->lastPosition = pos;
+
+	// If we're looping inside the player, and the position jumped back
+	// from near the end to near the start, the input just wrapped around.
+	// libvlc doesn't send an end-of-media event for an input repeat, so
+	// this is our only indication.
+	if (self->repeatOption && pos + 0.5f < prv)
+	{
+		if (self->looping)
+		{
+			// Tell the event window that we looped.  This is just a
+			// notification (for Javascript events and the like), since
+			// the playback has already restarted.
+			PostMessage(self->hwndEvent, AVPMsgLoopNeeded, (WPARAM)self->cookie, 0);
+		}
+		else
+		{
+			// Looping was turned off after playback started.  Stop the
+			// playback, as though we'd reached the end normally.  We can't
+			// call back into libvlc from its event thread, so do the stop
+			// on the loader pool.
+			self->isPlaying = false;
+			PostMessage(self->hwndEvent, AVPMsgEndOfPresentation, (WPARAM)self->cookie, 0);
+
+			self->AddRef();
+			auto task = [self]()
+			{
+				{
+					CriticalSectionLocker lock(self->playerLock);
+					if (self->player != nullptr && !self->isPlaying)
+						libvlc_media_player_stop_(self->player);
+				}
+				self->Release();
+			};
+			if (!LoaderPool::Submit(task, LoaderPool::Priority::Normal))
+				self->Release();
+		}
 	}
 }
 
@@ -1060,6 +1667,49 @@ void VLCAudioVideoPlayer::OnMediaPlayerEndReached(const libvlc_event_t *event, v
 //
 // Render the current frame onto a sprite
 //
+ID3D11ShaderResourceView *VLCAudioVideoPlayer::UploadToRing(RingTexture &rt, const FrameBuffer::Plane &plane,
+	const void *pixels, const D3D11_SHADER_RESOURCE_VIEW_DESC &srvd)
+{
+	// If the ring texture doesn't exist yet, or it doesn't match the
+	// frame format, create a new one, initialized with the frame data.
+	const auto &fd = plane.textureDesc;
+	if (rt.texture == nullptr
+		|| rt.desc.Width != fd.Width || rt.desc.Height != fd.Height || rt.desc.Format != fd.Format)
+	{
+		// release the old texture
+		rt.srv = nullptr;
+		rt.texture = nullptr;
+
+		// Set up the descriptor for the frame format, but with DEFAULT
+		// usage rather than IMMUTABLE, so that we can update it.
+		rt.desc = fd;
+		rt.desc.Usage = D3D11_USAGE_DEFAULT;
+
+		// create the texture
+		D3D11_SUBRESOURCE_DATA srd;
+		srd.pSysMem = pixels;
+		srd.SysMemPitch = plane.rowPitch;
+		srd.SysMemSlicePitch = 0;
+		D3D11_SHADER_RESOURCE_VIEW_DESC srvdCopy = srvd;
+		if (FAILED(D3D::Get()->CreateTexture2D(&rt.desc, &srd, &srvdCopy, &rt.srv, &rt.texture)))
+		{
+			rt.srv = nullptr;
+			rt.texture = nullptr;
+		}
+		else
+			TextureBudget::SetSubsystem(rt.texture, MemoryStats::VideoFrames);
+	}
+	else
+	{
+		// the existing texture matches the format - just update its contents
+		D3D::DeviceContextLocker ctx;
+		ctx->UpdateSubresource(rt.texture, 0, nullptr, pixels, plane.rowPitch, 0);
+	}
+
+	// return the resource view
+	return rt.srv;
+}
+
 bool VLCAudioVideoPlayer::Render(Camera *camera, Sprite *sprite)
 {
 	// Lock the current presentation frame.  Note that we only have
@@ -1071,6 +1721,23 @@ bool VLCAudioVideoPlayer::Render(Camera *camera, Sprite *sprite)
 	// frame buffers (such as decoding into other frame buffers)
 	// concurrently while we're doing the rendering.
 	RefPtr<FrameBuffer> newFrame;
+
+	// if the D3D device has been replaced, discard our old device's textures
+	if (UINT gen = D3D::Get()->GetDeviceGeneration(); gen != deviceGeneration)
+	{
+		for (auto &v : shaderResourceView)
+			v = nullptr;
+		for (auto &ring : textureRing)
+		{
+			for (auto &rt : ring)
+			{
+				rt.texture = nullptr;
+				rt.srv = nullptr;
+			}
+		}
+		deviceGeneration = gen;
+	}
+
 	{
 		// lock against concurrent access by the VLC background threads
 		CriticalSectionLocker locker(renderLock);
@@ -1100,19 +1767,42 @@ bool VLCAudioVideoPlayer::Render(Camera *camera, Sprite *sprite)
 		D3D11_SUBRESOURCE_DATA srd;
 		srd.SysMemSlicePitch = 0;
 		nPlanes = newFrame->nPlanes;
+		auto &ring = textureRing[textureRingIndex];
 		for (int i = 0; i < nPlanes; ++i)
 		{
 			// get the plane
 			auto &plane = newFrame->planes[i];
-
-			// create the new texture and view
-			shaderResourceView[i] = nullptr;
-			srd.pSysMem = newFrame->pixBuf.get() + plane.bufOfs;
-			srd.SysMemPitch = plane.rowPitch;
+			const BYTE *pixels = newFrame->pixBuf.get() + plane.bufOfs;
 			srvd.Format = plane.textureDesc.Format;
-			D3D::Get()->CreateTexture2D(&plane.textureDesc, &srd, &srvd, &shaderResourceView[i], NULL);
+
+			// In texture ring mode, upload the plane into the next ring
+			// texture.  Otherwise, create the new texture and view.
+			if (useTextureRing)
+			{
+				shaderResourceView[i] = UploadToRing(ring[i], plane, pixels, srvd);
+			}
+			else
+			{
+				shaderResourceView[i] = nullptr;
+				srd.pSysMem = pixels;
+				srd.SysMemPitch = plane.rowPitch;
+				D3D::Get()->CreateTexture2D(&plane.textureDesc, &srd, &srvd, &shaderResourceView[i], NULL);
+				if (shaderResourceView[i] != nullptr)
+				{
+					RefPtr<ID3D11Resource> tex;
+					shaderResourceView[i]->GetResource(&tex);
+					TextureBudget::SetSubsystem(tex, MemoryStats::VideoFrames);
+				}
+			}
 		}
 
+		// advance to the next ring entry for the next frame
+		if (++textureRingIndex >= TextureRingSize)
+			textureRingIndex = 0;
+
+		// count the frame, for sprites sharing the player
+		++frameSerial;
+
 		// this frame can now be reused for a new decoded frame
 		newFrame->status = FrameBuffer::Free;
 	}
@@ -1223,7 +1913,7 @@ unsigned int VLCAudioVideoPlayer::OnDMDSetFormat(void **opaque, char *chroma,
 		}
 
 		// allocate the pixel buffer
-		f->pixBuf.reset(static_cast<BYTE*>(_mm_malloc(ofs, 16)));
+		f->AllocPixBuf(ofs, 16);
 		if (f->pixBuf == nullptr)
 			return 0;
 	}
@@ -1270,9 +1960,12 @@ void VLCAudioVideoPlayer::OnDMDFramePresent(void *opaque, void *pictureId)
 	if (!self->firstFramePresented)
 	{
 		// send the 'first frame' message
-		PostMessage(self->hwndEvent, AVPMsgFirstFrameReady, (WPARAM)self->cookie, 0);
+		self->PostFirstFrameReady();
 
 		// we've now presented the first frame
 		self->firstFramePresented = true;
+
+		// record the startup time statistics
+		self->RecordStartupTime();
 	}
 }
@@ -11,7 +11,10 @@
 
 #pragma once
 #include <malloc.h>
+#include <list>
 #include "AudioVideoPlayer.h"
+#include "AudioMixer.h"
+#include "MemoryStats.h"
 
 struct libvlc_instance_t;
 struct libvlc_event_t;
@@ -37,6 +40,92 @@ public:
 	// Get the libvlc version number
 	static const char *GetLibVersion();
 
+	// Load libvlc and create the global libvlc instance, if we haven't
+	// already.  This runs as a startup task, so that the first video
+	// doesn't have to wait for the VLC plugins to load.  Errors aren't
+	// reported here; the first video open reports them.
+	static void PrewarmInstance();
+
+	// Global texture ring upload mode.  When set, each player keeps a
+	// small ring of reusable textures for uploading decoded frames to
+	// the GPU, rather than creating a new texture for every frame.
+	static bool useTextureRing;
+
+	// Global hardware decoding mode.  When set, we ask libvlc to decode
+	// videos with D3D11 video acceleration where the hardware supports
+	// it, and to deliver the frames in NV12 format.  libvlc 3 can't hand
+	// us the decoder's GPU surfaces directly, so the frames still make a
+	// round trip through system memory, but this takes the decoding and
+	// the chroma plane conversion off of the CPU.
+	static bool hardwareDecoding;
+
+	// Global gapless looping mode.  When set, looping videos loop inside
+	// libvlc's input (via the input-repeat option), rather than stopping
+	// at the end and waiting for the UI thread to restart them, which
+	// shows a visible pause when the UI is busy.
+	static bool gaplessLooping;
+
+	// Global decoder-side downscaling mode.  When set, and a video's
+	// native frame size is larger than the window it's playing in, we
+	// ask libvlc to scale the frames down to the window size in the
+	// decoder pipeline, so that we don't copy and upload pixels that
+	// can't be displayed anyway.  This takes effect when a video's
+	// format is negotiated, so it applies to videos opened after the
+	// setting changes.
+	static bool downscaleToWindow;
+
+	// Scaler quality for the downscaling, as a libvlc swscale mode
+	// (0 = fast bilinear, 1 = bilinear, 2 = bicubic).  libvlc only
+	// reads this when we create the libvlc instance, so it applies
+	// from the next program start.
+	static int scalerMode;
+
+	// Idle player pool size.  Creating a libvlc media player object is
+	// a noticeable part of the time it takes to start a new video, and
+	// we start new videos in several windows (playfield, backglass, DMD,
+	// topper) every time the wheel selection changes.  So rather than
+	// creating a new libvlc player for every video and destroying it
+	// afterwards, we keep a small pool of idle players, which new videos
+	// take over and retired videos return.  We also create the idle
+	// players in advance, on the loader pool, as soon as the libvlc
+	// instance is set up.  This is set from the configuration; zero
+	// disables the pool.
+	static int playerPoolSize;
+
+	// Global shared mixer mode.  When set, we have libvlc hand us each
+	// player's decoded audio through its audio callbacks, and play it
+	// through the shared WASAPI mixer (see AudioMixer.h), rather than
+	// letting every player open its own output stream.  The mixer is
+	// started along with the libvlc instance, so this applies from the
+	// next program start.
+	static bool useSharedMixer;
+
+	// Video startup statistics.  We measure the time from Open() to the
+	// presentation of the first frame for each video, which covers the
+	// player setup, the media file open, and the decoder startup.
+	struct StartupStats
+	{
+		UINT64 nVideos;       // number of videos measured
+		UINT64 nPooled;       // number of those that used a pooled player
+		double last_ms;       // startup time of the most recent video
+		double avg_ms;        // average startup time
+		double max_ms;        // longest startup time
+	};
+	static void GetStartupStats(StartupStats &stats);
+	static void ResetStartupStats();
+
+	// Playback statistics for the active players.  'decoded' counts the
+	// frames the decoder has written into our buffers, and 'dropped'
+	// counts the frames that were presented and then replaced by a newer
+	// frame before the renderer got around to uploading them.
+	struct PlaybackStats
+	{
+		TSTRING path;         // media file path
+		UINT64 decoded;       // frames decoded
+		UINT64 dropped;       // frames dropped before display
+	};
+	static void GetPlaybackStats(std::vector<PlaybackStats> &stats);
+
 	// Open a file path for playback.  This opens the video with a
 	// standard video display target.
 	virtual bool Open(const TCHAR *path, ErrorHandler &eh) override
@@ -81,6 +170,9 @@ public:
 	virtual bool Replay(ErrorHandler &eh) override;
 	virtual bool Stop(ErrorHandler &eh) override;
 
+	// pause/resume playback
+	virtual void SetPause(bool pause) override;
+
 	// Is playback running?
 	virtual bool IsPlaying() const override { return isPlaying; }
 
@@ -92,9 +184,23 @@ public:
 	// the caller is doing.
 	virtual bool IsFrameReady() const override { return firstFramePresented; }
 
+	// Is a new frame waiting to be rendered?  The decoder thread sets
+	// presentedFrame when it presents a frame, and the renderer takes
+	// it over on the next render, so a non-null presentedFrame means
+	// that there's a frame we haven't drawn yet.
+	virtual bool IsFrameAvailable() const override { return presentedFrame != nullptr; }
+
+	// get the frame serial number
+	virtual UINT64 GetFrameSerial() const override { return frameSerial; }
+
+	// add/remove additional event windows, for shared players
+	virtual void AddEventWindow(HWND hwnd) override;
+	virtual void RemoveEventWindow(HWND hwnd) override;
+
 	// Set looping playback mode
 	virtual void SetLooping(bool f) override;
 	virtual bool IsLooping() const override { return looping; }
+	virtual bool IsLoopHandledInPlayer() const override { return repeatOption && looping; }
 
 	// Mute audio
 	virtual void Mute(bool f) override;
@@ -133,6 +239,66 @@ protected:
 	// Open with the given target
 	bool OpenWithTarget(const TCHAR *path, ErrorHandler &eh, TargetDevice target);
 
+	// Figure the decoding size for a video target.  If downscaling is
+	// enabled and the native frame size is larger than the video
+	// window, this reduces width and height to the smallest size that
+	// still covers the window at the same aspect ratio.
+	void GetTargetFrameSize(unsigned *width, unsigned *height) const;
+
+	// Create the global libvlc instance, if we haven't already
+	static bool InitVLCInstance(ErrorHandler &eh);
+
+	// Release our libvlc player.  If there's room in the idle pool, we
+	// stop the player, detach it from the media and from our callbacks,
+	// and return it to the pool; otherwise we release it.
+	void ReleasePlayer();
+
+	// Take a player from the idle pool, or create a new one if the pool
+	// is empty
+	static libvlc_media_player_t *AcquirePlayer(bool &fromPool);
+
+	// Queue a task on the loader pool to fill the idle pool up to the
+	// configured size, if it's not already full
+	static void WarmPlayerPool();
+
+	// shutting down - stops the pool warm-up task
+	static bool poolShutdown;
+
+	// idle players
+	static std::list<libvlc_media_player_t*> idlePlayers;
+
+	// is a pool warm-up task queued or running?
+	static bool warmingPool;
+
+	// lock for the idle player pool
+	static CriticalSection poolLock;
+
+	// Open time, as a performance counter value, for the startup time
+	// statistics.  This is zero once we've recorded the startup time.
+	INT64 openTicks = 0;
+
+	// did the current media use a pooled player?
+	bool pooledPlayer = false;
+
+	// record the startup time for the first frame presented
+	void RecordStartupTime();
+
+	// startup statistics totals
+	static UINT64 statsVideos;
+	static UINT64 statsPooled;
+	static double statsLast_ms;
+	static double statsTotal_ms;
+	static double statsMax_ms;
+	static CriticalSection statsLock;
+
+	// All existing player objects, for the playback statistics
+	static std::list<VLCAudioVideoPlayer*> livePlayers;
+	static CriticalSection livePlayersLock;
+
+	// frame counters for the playback statistics
+	volatile LONG64 framesDecoded = 0;
+	volatile LONG64 framesDropped = 0;
+
 	// media path
 	TSTRING mediaPath;
 
@@ -141,6 +307,7 @@ protected:
 
 	// VLC event callbacks
 	static void OnMediaPlayerEndReached(const libvlc_event_t *event, void *opaque);
+	static void OnMediaPlayerPositionChanged(const libvlc_event_t *event, void *opaque);
 
 	// frame decoding callbacks - regular video target mode
 	static unsigned int OnVideoSetFormat(void **opaque, char *chroma,
@@ -163,10 +330,47 @@ protected:
 	// do we loop playback?
 	bool looping;
 
+	// Is the input-repeat option in effect on the current media?  We
+	// set the option according to the looping mode each time playback
+	// starts, since a media option only takes effect when the input
+	// starts.
+	bool repeatOption = false;
+	void ApplyRepeatOption();
+
+	// last playback position reported by libvlc, for detecting when
+	// in-player looping wraps around to the start
+	volatile float lastPosition = 0.0f;
+
 	// audio volume (linear scale, 0..100) and muting status
 	volatile int volume;
 	volatile bool muted;
 
+	// Apply the current volume and muting status.  With the shared
+	// mixer, this sets the gain on our mixer source; otherwise it sets
+	// the libvlc player volume.
+	void ApplyVolume();
+
+	// Shared mixer source for the current audio stream.  The libvlc audio
+	// thread creates this when the stream format is set up, and closes it
+	// when the stream ends.  The lock protects the pointer against access
+	// from the UI thread; the audio callbacks run on the thread that set
+	// it, so they can use it directly.
+	RefPtr<AudioMixer::Source> mixerSource;
+	CriticalSection mixerLock;
+
+	// Fade time for volume changes on the mixer source.  This is just
+	// long enough to keep a volume step from clicking.
+	static const DWORD volumeFade_ms = 20;
+
+	// audio callbacks, for the shared mixer
+	static int OnAudioSetup(void **opaque, char *format, unsigned *rate, unsigned *channels);
+	static void OnAudioCleanup(void *opaque);
+	static void OnAudioPlay(void *opaque, const void *samples, unsigned count, int64_t pts);
+	static void OnAudioPause(void *opaque, int64_t pts);
+	static void OnAudioResume(void *opaque, int64_t pts);
+	static void OnAudioFlush(void *opaque, int64_t pts);
+	static void OnAudioDrain(void *opaque);
+
 	// Audio volume/mute initializer.  libvlc has an odd quirk (bug?)
 	// where it resets the audio volume to unmuted/100% on replay,
 	// *in the player thread*.  That means that the timing of the reset
@@ -219,6 +423,16 @@ protected:
 
 		~FrameBuffer()
 		{
+			MemoryStats::AddCPU(MemoryStats::VideoFrames, -static_cast<INT64>(pixBufSize));
+		}
+
+		// allocate the pixel buffer, replacing any previous buffer
+		void AllocPixBuf(size_t size, size_t align)
+		{
+			MemoryStats::AddCPU(MemoryStats::VideoFrames, -static_cast<INT64>(pixBufSize));
+			pixBuf.reset(static_cast<BYTE*>(_mm_malloc(size, align)));
+			pixBufSize = pixBuf != nullptr ? size : 0;
+			MemoryStats::AddCPU(MemoryStats::VideoFrames, static_cast<INT64>(pixBufSize));
 		}
 
 		// frame status
@@ -247,6 +461,7 @@ protected:
 		// callback, which tells us the size and pixel format of the frame
 		// so that we can allocate buffers.
 		std::unique_ptr<BYTE, decltype(&_aligned_free)> pixBuf;
+		size_t pixBufSize = 0;
 
 		// Shader to use for rendering this frame
 		Shader *shader;
@@ -287,6 +502,37 @@ protected:
 	int nPlanes;
 	RefPtr<ID3D11ShaderResourceView> shaderResourceView[4];
 
+	// Upload texture ring.  In texture ring mode, rather than creating
+	// new textures for each frame, we keep a small ring of DEFAULT usage
+	// textures, one per plane per ring entry, and fill them with
+	// UpdateSubresource.  We only re-create a texture when the frame
+	// format changes.  We cycle through several entries rather than
+	// reusing a single set, so that we're not overwriting a texture 
+	// that the GPU might still be reading for the previous frame.
+	//
+	// Note that this doesn't have the shared-memory problem described
+	// above for 'usage dynamic' textures, since DEFAULT textures live
+	// in ordinary video memory.
+	struct RingTexture
+	{
+		RefPtr<ID3D11Resource> texture;
+		RefPtr<ID3D11ShaderResourceView> srv;
+		D3D11_TEXTURE2D_DESC desc;
+	};
+	static const int TextureRingSize = 3;
+	RingTexture textureRing[TextureRingSize][4];
+	int textureRingIndex = 0;
+
+	// D3D device generation of our textures.  If the device is replaced
+	// (see D3D::RecreateDevice()), we discard the textures and re-create
+	// them on the new device with the next frame.
+	UINT deviceGeneration = 0;
+
+	// Upload a plane into the texture ring, returning the shader 
+	// resource view for the updated texture
+	ID3D11ShaderResourceView *UploadToRing(RingTexture &rt, const FrameBuffer::Plane &plane,
+		const void *pixels, const D3D11_SHADER_RESOURCE_VIEW_DESC &srvd);
+
 	// Critical section locker for the rendering pointers.  This
 	// controls access to presentedFrame and renderFrame.  We use
 	// this separate lock for these two items, because they're the
@@ -307,6 +553,17 @@ protected:
 	// has the first frame been presented yet?
 	bool firstFramePresented;
 
+	// Post the first-frame notification to the event windows.  The
+	// caller must hold 'lock'.
+	void PostFirstFrameReady();
+
+	// Additional event windows, for a player shared among windows.
+	// Protected by 'lock'.
+	std::vector<HWND> extraEventWindows;
+
+	// number of frames uploaded for rendering
+	UINT64 frameSerial = 0;
+
 	// Critical section lock, for protecting items that can be
 	// accessed by background threads
 	CriticalSection lock;
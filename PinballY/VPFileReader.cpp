@@ -87,49 +87,7 @@ HRESULT VPFileReader::Read(const WCHAR *filename, bool getScript)
 		return HRESULT_FROM_WIN32(GetLastError());
 
 	// Read the Table Info stream
-	RefPtr<IStorage> infoStg;
-	if (SUCCEEDED(hr = stg->OpenStorage(L"TableInfo", NULL, STGM_DIRECT | STGM_READ | STGM_SHARE_EXCLUSIVE, NULL, 0, &infoStg)))
-	{
-		auto ReadValue = [&infoStg](const WCHAR *name, std::unique_ptr<WCHAR> &value)
-		{
-			// open the stream by name
-			RefPtr<IStream> stream;
-			HRESULT hr = infoStg->OpenStream(name, NULL, STGM_DIRECT | STGM_READ | STGM_SHARE_EXCLUSIVE, 0, &stream);
-			if (FAILED(hr))
-				return hr;
-
-			// get the content size
-			STATSTG ss;
-			stream->Stat(&ss, STATFLAG_NONAME);
-			DWORD byteLen = ss.cbSize.LowPart;
-			DWORD charLen = byteLen / sizeof(WCHAR);
-
-			// allocate a buffer
-			value.reset(new WCHAR[charLen + 1]);
-
-			// read it
-			ULONG read;
-			if (FAILED(hr = stream->Read(value.get(), byteLen, &read)))
-				return hr;
-
-			// null-terminate it
-			value.get()[charLen] = 0;
-
-			// success
-			return S_OK;
-		};
-
-		// Read the values
-		ReadValue(L"TableName", tableName);
-		ReadValue(L"TableVersion", tableVersion);
-		ReadValue(L"ReleaseDate", releaseDate);
-		ReadValue(L"AuthorName", authorName);
-		ReadValue(L"AuthorEmail", authorEmail);
-		ReadValue(L"AuthorWebSite", authorWebSite);
-		ReadValue(L"TableBlurb", blurb);
-		ReadValue(L"TableDescription", description);
-		ReadValue(L"Rules", rules);
-	}
+	ReadTableInfo(stg);
 
 	// open the main "Game" substorage
 	RefPtr<IStorage> dataStg;
@@ -231,3 +189,69 @@ HRESULT VPFileReader::Read(const WCHAR *filename, bool getScript)
 	// success
 	return S_OK;
 }
+
+HRESULT VPFileReader::ReadTableInfo(const WCHAR *filename)
+{
+	// make sure we have a non-null filename
+	if (filename == nullptr)
+		return E_POINTER;
+
+	// Open the file in direct (non-transacted) read mode.  We only read
+	// a few small streams, so there's no need for the transaction copy.
+	RefPtr<IStorage> stg;
+	HRESULT hr = StgOpenStorage(filename, NULL, STGM_DIRECT | STGM_READ | STGM_SHARE_DENY_WRITE, NULL, 0, &stg);
+	if (FAILED(hr))
+		return hr;
+
+	// read the metadata
+	ReadTableInfo(stg);
+	return S_OK;
+}
+
+void VPFileReader::ReadTableInfo(IStorage *stg)
+{
+	// open the Table Info storage
+	RefPtr<IStorage> infoStg;
+	if (SUCCEEDED(stg->OpenStorage(L"TableInfo", NULL, STGM_DIRECT | STGM_READ | STGM_SHARE_EXCLUSIVE, NULL, 0, &infoStg)))
+	{
+		auto ReadValue = [&infoStg](const WCHAR *name, std::unique_ptr<WCHAR> &value)
+		{
+			// open the stream by name
+			RefPtr<IStream> stream;
+			HRESULT hr = infoStg->OpenStream(name, NULL, STGM_DIRECT | STGM_READ | STGM_SHARE_EXCLUSIVE, 0, &stream);
+			if (FAILED(hr))
+				return hr;
+
+			// get the content size
+			STATSTG ss;
+			stream->Stat(&ss, STATFLAG_NONAME);
+			DWORD byteLen = ss.cbSize.LowPart;
+			DWORD charLen = byteLen / sizeof(WCHAR);
+
+			// allocate a buffer
+			value.reset(new WCHAR[charLen + 1]);
+
+			// read it
+			ULONG read;
+			if (FAILED(hr = stream->Read(value.get(), byteLen, &read)))
+				return hr;
+
+			// null-terminate it
+			value.get()[charLen] = 0;
+
+			// success
+			return S_OK;
+		};
+
+		// Read the values
+		ReadValue(L"TableName", tableName);
+		ReadValue(L"TableVersion", tableVersion);
+		ReadValue(L"ReleaseDate", releaseDate);
+		ReadValue(L"AuthorName", authorName);
+		ReadValue(L"AuthorEmail", authorEmail);
+		ReadValue(L"AuthorWebSite", authorWebSite);
+		ReadValue(L"TableBlurb", blurb);
+		ReadValue(L"TableDescription", description);
+		ReadValue(L"Rules", rules);
+	}
+}
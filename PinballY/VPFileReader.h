@@ -11,6 +11,11 @@ public:
 
 	HRESULT Read(const WCHAR *filename, bool getScript);
 
+	// Read only the Table Info metadata.  This skips the game data
+	// stream entirely, so it doesn't touch the script or the images,
+	// which makes it suitable for bulk scans of the table folders.
+	HRESULT ReadTableInfo(const WCHAR *filename);
+
 	// Version loaded from the file
 	INT32 fileVersion;
 
@@ -51,4 +56,7 @@ public:
 		INT32   reserved[2];
 	} protection;
 
+protected:
+	// read the Table Info storage values
+	void ReadTableInfo(IStorage *stg);
 };
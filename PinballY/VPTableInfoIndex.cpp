@@ -0,0 +1,216 @@
+// This file is part of PinballY
+// Copyright 2018 Michael J Roberts | GPL v3 or later | NO WARRANTY
+//
+// Visual Pinball table metadata index
+
+#include "stdafx.h"
+#include <algorithm>
+#include "../Utilities/FileUtil.h"
+#include "VPTableInfoIndex.h"
+#include "VPFileReader.h"
+#include "MediaFileIndex.h"
+#include "GameList.h"
+#include "LogFile.h"
+
+// statics
+bool VPTableInfoIndex::enabled = true;
+std::unordered_map<TSTRING, VPTableInfoIndex::Entry> VPTableInfoIndex::entries;
+CSVFile VPTableInfoIndex::csv;
+CSVFile::Column *VPTableInfoIndex::pathCol = nullptr;
+CSVFile::Column *VPTableInfoIndex::mtimeCol = nullptr;
+CSVFile::Column *VPTableInfoIndex::tableNameCol = nullptr;
+CSVFile::Column *VPTableInfoIndex::tableVersionCol = nullptr;
+CSVFile::Column *VPTableInfoIndex::releaseDateCol = nullptr;
+CSVFile::Column *VPTableInfoIndex::authorNameCol = nullptr;
+bool VPTableInfoIndex::loaded = false;
+std::list<TSTRING> VPTableInfoIndex::queue;
+HandleHolder VPTableInfoIndex::hThread;
+volatile bool VPTableInfoIndex::shutdown = false;
+CriticalSection VPTableInfoIndex::lock;
+
+TSTRING VPTableInfoIndex::Key(const TCHAR *path)
+{
+	TSTRING key(path);
+	std::transform(key.begin(), key.end(), key.begin(), ::_totlower);
+	return key;
+}
+
+void VPTableInfoIndex::Load()
+{
+	if (loaded)
+		return;
+	loaded = true;
+
+	// define the columns
+	pathCol = csv.DefineColumn(_T("Path"));
+	mtimeCol = csv.DefineColumn(_T("Modified"));
+	tableNameCol = csv.DefineColumn(_T("Table Name"));
+	tableVersionCol = csv.DefineColumn(_T("Table Version"));
+	releaseDateCol = csv.DefineColumn(_T("Release Date"));
+	authorNameCol = csv.DefineColumn(_T("Author"));
+
+	// load the file - <program folder>\VPTableInfo.csv
+	TCHAR fname[MAX_PATH];
+	GetDeployedFilePath(fname, _T("VPTableInfo.csv"), _T(""));
+	csv.SetFile(fname);
+	if (FileExists(fname))
+		csv.Read(SilentErrorHandler());
+
+	// index the rows
+	for (int i = 0, n = static_cast<int>(csv.GetNumRows()); i < n; ++i)
+	{
+		entries[Key(pathCol->Get(i, _T("")))] = { _tcstoui64(mtimeCol->Get(i, _T("0")), nullptr, 16), i };
+	}
+}
+
+bool VPTableInfoIndex::Lookup(const TCHAR *path, Info &info)
+{
+	// get the file's current modification time
+	FILETIME ft;
+	if (!enabled || !MediaFileIndex::GetFileTime(path, ft))
+		return false;
+	UINT64 mtime = (static_cast<UINT64>(ft.dwHighDateTime) << 32) | ft.dwLowDateTime;
+
+	// look up the entry, and make sure it's current
+	CriticalSectionLocker locker(lock);
+	if (!loaded)
+		return false;
+	auto it = entries.find(Key(path));
+	if (it == entries.end() || it->second.mtime != mtime)
+		return false;
+
+	// return the metadata
+	int row = it->second.row;
+	info.tableName = tableNameCol->Get(row, _T(""));
+	info.tableVersion = tableVersionCol->Get(row, _T(""));
+	info.releaseDate = releaseDateCol->Get(row, _T(""));
+	info.authorName = authorNameCol->Get(row, _T(""));
+	return true;
+}
+
+void VPTableInfoIndex::UpdateFromGameList()
+{
+	if (!enabled)
+		return;
+
+	// collect the VP files from the table file sets
+	std::list<TSTRING> files;
+	GameList::Get()->EnumTableFileSets([&files](const TableFileSet &tfs)
+	{
+		for (auto &f : tfs.files)
+		{
+			const TCHAR *name = f.second.filename.c_str();
+			if (tstriEndsWith(name, _T(".vpx")) || tstriEndsWith(name, _T(".vpt")))
+			{
+				TCHAR path[MAX_PATH];
+				PathCombine(path, tfs.tablePath.c_str(), name);
+				files.emplace_back(path);
+			}
+		}
+	});
+
+	// add them to the queue
+	CriticalSectionLocker locker(lock);
+	queue.splice(queue.end(), files);
+
+	// start the indexer thread, if it's not already running
+	if (hThread != NULL && WaitForSingleObject(hThread, 0) == WAIT_OBJECT_0)
+		hThread = NULL;
+	if (hThread == NULL && queue.size() != 0 && !shutdown)
+	{
+		DWORD tid;
+		hThread = CreateThread(NULL, 0, &ThreadMain, nullptr, 0, &tid);
+	}
+}
+
+DWORD WINAPI VPTableInfoIndex::ThreadMain(LPVOID)
+{
+	// run at background priority, for both CPU and I/O, so that the
+	// scan doesn't compete with the UI or a running game
+	SetThreadPriority(GetCurrentThread(), THREAD_MODE_BACKGROUND_BEGIN);
+
+	// initialize COM on this thread, for the Structured Storage access
+	CoInitializeEx(NULL, COINIT_MULTITHREADED);
+
+	// load the cache file
+	{
+		CriticalSectionLocker locker(lock);
+		Load();
+	}
+
+	// process the queue
+	int nRead = 0;
+	while (!shutdown)
+	{
+		// get the next file
+		TSTRING path;
+		{
+			CriticalSectionLocker locker(lock);
+			if (queue.size() == 0)
+				break;
+			path = queue.front();
+			queue.pop_front();
+		}
+
+		// get its modification time; skip it if it's gone
+		FILETIME ft;
+		if (!MediaFileIndex::GetFileTime(path.c_str(), ft))
+			continue;
+		UINT64 mtime = (static_cast<UINT64>(ft.dwHighDateTime) << 32) | ft.dwLowDateTime;
+
+		// skip it if the cache entry is current
+		TSTRING key = Key(path.c_str());
+		{
+			CriticalSectionLocker locker(lock);
+			if (auto it = entries.find(key); it != entries.end() && it->second.mtime == mtime)
+				continue;
+		}
+
+		// Read the metadata.  If the read fails, store an empty entry
+		// anyway, so that we don't keep retrying a file that we can't
+		// parse; it'll be retried if the file changes.
+		VPFileReader vpr;
+		vpr.ReadTableInfo(path.c_str());
+		++nRead;
+
+		// update the cache
+		CriticalSectionLocker locker(lock);
+		int row;
+		if (auto it = entries.find(key); it != entries.end())
+			row = it->second.row;
+		else
+			row = csv.CreateRow();
+		entries[key] = { mtime, row };
+
+		auto Set = [row](CSVFile::Column *col, const std::unique_ptr<WCHAR> &val) {
+			col->Set(row, val != nullptr ? WideToTSTRING(val.get()).c_str() : _T("")); };
+		pathCol->Set(row, path.c_str());
+		mtimeCol->Set(row, MsgFmt(_T("%016I64x"), mtime));
+		Set(tableNameCol, vpr.tableName);
+		Set(tableVersionCol, vpr.tableVersion);
+		Set(releaseDateCol, vpr.releaseDate);
+		Set(authorNameCol, vpr.authorName);
+	}
+
+	// save the updates
+	if (nRead != 0)
+	{
+		LogFile::Get()->Write(_T("VP table info index: read metadata from %d new or changed table file(s)\n"), nRead);
+		CriticalSectionLocker locker(lock);
+		csv.WriteIfDirtyInBackground();
+	}
+
+	CoUninitialize();
+	return 0;
+}
+
+void VPTableInfoIndex::Shutdown()
+{
+	// stop the indexer thread
+	shutdown = true;
+	if (hThread != NULL)
+	{
+		WaitForSingleObject(hThread, 5000);
+		hThread = NULL;
+	}
+}
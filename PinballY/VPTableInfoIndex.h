@@ -0,0 +1,101 @@
+// This file is part of PinballY
+// Copyright 2018 Michael J Roberts | GPL v3 or later | NO WARRANTY
+//
+// Visual Pinball table metadata index
+//
+// VP table files can carry "Table Info" metadata (table name, version,
+// release date, author) that the table author enters in the VP editor.
+// The metadata is a much better guide to a table's identity than its
+// filename, but reading it means opening the file's Structured Storage,
+// which we don't want to do for hundreds of files every time the user
+// sets up new tables.
+//
+// This index keeps a cache of the metadata for the VP table files in
+// the table folders, stored in VPTableInfo.csv in the program folder.
+// Entries are keyed by the file's full path and validated against its
+// modification time, so a changed file is re-read automatically.  A
+// low-priority background thread walks the table files at startup and
+// after each new file scan, reading only the Table Info streams of the
+// files that are new or changed since the last pass (see
+// VPFileReader::ReadTableInfo()).  Lookups are then a memory access.
+
+#pragma once
+#include <list>
+#include <unordered_map>
+#include "../Utilities/WinUtil.h"
+#include "CSVFile.h"
+
+class VPTableInfoIndex
+{
+public:
+	// Is the index enabled?  This is set from the configuration.
+	static bool enabled;
+
+	// table metadata
+	struct Info
+	{
+		TSTRING tableName;
+		TSTRING tableVersion;
+		TSTRING releaseDate;
+		TSTRING authorName;
+	};
+
+	// Look up a file's metadata.  Returns true if the index has a
+	// current entry for the file (one that matches the file's current
+	// modification time), false if the caller has to read the file
+	// itself.  An entry can be current with empty fields, if the table
+	// author didn't fill them in.  This can be called from any thread.
+	static bool Lookup(const TCHAR *path, Info &info);
+
+	// Queue all of the VP table files in the game list's table folders
+	// for indexing, and start the indexer thread if it's not already
+	// running.  Files already in the index with current entries are
+	// quickly skipped.  Call this on the UI thread, after loading the
+	// game list or adding new files.
+	static void UpdateFromGameList();
+
+	// Shut down: stop the indexer thread and save any pending updates
+	static void Shutdown();
+
+protected:
+	// indexer thread entrypoint
+	static DWORD WINAPI ThreadMain(LPVOID lParam);
+
+	// load the cache file; the caller must hold the lock
+	static void Load();
+
+	// get the map key for a file
+	static TSTRING Key(const TCHAR *path);
+
+	// cache entry
+	struct Entry
+	{
+		UINT64 mtime;   // file modification time, as a FILETIME value
+		int row;        // CSV file row
+	};
+
+	// cache entries, keyed by lower-case path
+	static std::unordered_map<TSTRING, Entry> entries;
+
+	// cache file
+	static CSVFile csv;
+	static CSVFile::Column *pathCol;
+	static CSVFile::Column *mtimeCol;
+	static CSVFile::Column *tableNameCol;
+	static CSVFile::Column *tableVersionCol;
+	static CSVFile::Column *releaseDateCol;
+	static CSVFile::Column *authorNameCol;
+
+	// has the cache file been loaded?
+	static bool loaded;
+
+	// files waiting to be checked
+	static std::list<TSTRING> queue;
+
+	// indexer thread, and shutdown flag
+	static HandleHolder hThread;
+	static volatile bool shutdown;
+
+	// lock for everything above
+	static CriticalSection lock;
+};
@@ -6,6 +6,17 @@
 #include "Application.h"
 #include "AudioVideoPlayer.h"
 #include "VLCAudioVideoPlayer.h"
+#include "TextureCache.h"
+#include "LogFile.h"
+
+// statics
+bool VideoSprite::sharedDecoding = true;
+
+// concurrent video player limit
+int VideoSprite::maxPlayers = 0;
+volatile LONG VideoSprite::openPlayers = 0;
+std::unordered_map<TSTRING, VideoSprite::SharedDecode> VideoSprite::sharedDecodes;
+CriticalSection VideoSprite::sharedDecodeLock;
 
 VideoSprite::VideoSprite()
 {
@@ -18,85 +29,68 @@ VideoSprite::~VideoSprite()
 
 void VideoSprite::ReleaseVideoPlayer()
 {
-	if (videoPlayer != nullptr)
+	// if we opened the player, it no longer counts against the limit
+	if (countedPlayer)
 	{
-		// Shutdown thread.  When we're ready to discard the underlying
-		// video, we start a low-priority thread to do the video player
-		// shutdown.  We do this on a separate thread to avoid a UI stall
-		// while waiting for the playback to stop.  The "stop" call to
-		// libvlc can take a noticeable amount of time to return, 
-		// presumably because it's explicitly waiting for its own
-		// background playback threads to exit.  
-		//
-		// We want to do the video "stop" call on the background thread,
-		// but we don't want to do the actual object deletion there; we
-		// want the deletion itself to occur on the main thread.  This
-		// is out of an abundance of caution about D3D threading.  The
-		// video player probably owns some shader resource view objects,
-		// and based on testing, releasing those can trigger implicit
-		// calls into the D3D11 Device Context.  DC calls are required
-		// to be single-threaded.  My own machines don't actually seem
-		// to have a problem with releasing the objects on a separate
-		// thread, but I suspect that some configurations might; the
-		// degree of thread safety here might be implementation-specific
-		// in the D3D11 hardware drivers.  Best not to risk it.  To get
-		// the actual object deletion back on the main thread, we use
-		// a queue of video players pending deletion.
-		class ShutdownThread
+		InterlockedDecrement(&openPlayers);
+		countedPlayer = false;
+	}
+
+	// If the player is in the shared decoder table, remove our window
+	// from its entry.  If other sprites are still using the player,
+	// simply drop our reference, and leave the shutdown to the last
+	// sprite to let go of it.
+	if (sharedKey.length() != 0)
+	{
+		CriticalSectionLocker locker(sharedDecodeLock);
+		bool inUse = false;
+		if (auto it = sharedDecodes.find(sharedKey); it != sharedDecodes.end())
 		{
-		public:
-			ShutdownThread(AudioVideoPlayer *vp) : vp(vp) 
-			{ 
-				// add the player to the pending deletion list
-				vp->SetPendingDeletion();
-
-				// create the thread, but don't start it yet
-				HandleHolder hThread = CreateThread(NULL, 0, &ShutdownThread::SMain, this, CREATE_SUSPENDED, &tid);
-				if (hThread != NULL)
-				{
-					// set it to low priority and kick it off
-					SetThreadPriority(hThread, BELOW_NORMAL_PRIORITY_CLASS);
-					ResumeThread(hThread);
-				}
-				else
-				{
-					// couldn't start the thread - do the thread work inline
-					SMain(this);
-				}
-			}
-
-		protected:
-            // Thread entrypoint
-			static DWORD WINAPI SMain(LPVOID lParam)
-            {
-                // get 'self'
-                auto self = static_cast<ShutdownThread*>(lParam);
-                
-                // explicitly shut down the video player
-				self->vp->Shutdown();
-                
-				// delete 'self'
-				delete self;
-				return 0;
-			}
-
-			// the video player we're disposing of
-			RefPtr<AudioVideoPlayer> vp;
-
-			// my thread ID
-			DWORD tid;
-		};
-
-		// transfer the video player to a shutdown thread object
-		new ShutdownThread(videoPlayer.Detach());
+			auto &w = it->second.windows;
+			if (auto wit = std::find(w.begin(), w.end(), sharedHwnd); wit != w.end())
+				w.erase(wit);
+
+			if (w.size() != 0)
+				inUse = true;
+			else
+				sharedDecodes.erase(it);
+		}
+		sharedKey.clear();
+
+		if (inUse && videoPlayer != nullptr)
+		{
+			videoPlayer->RemoveEventWindow(sharedHwnd);
+			videoPlayer = nullptr;
+			return;
+		}
+	}
+
+	if (videoPlayer != nullptr)
+	{
+		// Retire the player.  This shuts down playback on the retirement
+		// worker thread, to avoid a UI stall while libvlc waits for its
+		// playback threads to exit.  The object deletion itself comes back
+		// to the main thread through the pending deletion queue, out of an
+		// abundance of caution about D3D threading: the player owns shader
+		// resource views, and releasing those can trigger implicit calls
+		// into the D3D11 Device Context, which is single-threaded.
+		AudioVideoPlayer::Retire(videoPlayer.Detach());
 	}
 }
 
 bool VideoSprite::LoadVideo(
 	const TSTRING &filename, HWND hwnd, POINTF sz,
 	ErrorHandler &eh, const TCHAR *descForErrors,
-	bool play, int volumePct)
+	bool play, int volumePct, bool shareDecode, bool posterFrame)
 {
+	// forget any poster frame from a previous load
+	if (hasPosterFrame)
+	{
+		ReleaseLoadContext();
+		hasPosterFrame = false;
+		posterFrameSize = { 0, 0 };
+	}
+
 	// Check for GIF files.  Perversely, libvlc can't play animated
 	// GIFs, but our regular image sprite loader can!  Libvlc actually
 	// can *load* animated GIFs, it won't animate them - it just shows
@@ -123,6 +117,56 @@ bool VideoSprite::LoadVideo(
 		return __super::Load(filename.c_str(), sz, desc.dispSize, hwnd, eh);
 	}
 
+	// Check for a player that's already playing the same file in
+	// another window.  We only share with other windows, since a new
+	// sprite in the same window is usually replacing the old one, and
+	// the two fade their volumes in opposite directions.
+	TSTRING key;
+	if (shareDecode && sharedDecoding && play)
+	{
+		key = filename;
+		std::transform(key.begin(), key.end(), key.begin(), ::_totlower);
+
+		CriticalSectionLocker locker(sharedDecodeLock);
+		if (auto it = sharedDecodes.find(key); it != sharedDecodes.end()
+			&& it->second.player->IsPlaying()
+			&& std::find(it->second.windows.begin(), it->second.windows.end(), hwnd) == it->second.windows.end())
+		{
+			// take a reference on the shared player
+			RefPtr<AudioVideoPlayer> v(it->second.player, RefCounted::DoAddRef);
+
+			// discard any previous video player
+			ReleaseVideoPlayer();
+
+			// subscribe to the shared player
+			it->second.windows.push_back(hwnd);
+			v->AddEventWindow(hwnd);
+			videoPlayer = v;
+			sharedKey = key;
+			sharedHwnd = hwnd;
+
+			LogFile::Get()->Write(LogFile::MediaFileLogging,
+				_T("Video: sharing the decoder for %s with %d other window(s)\n"),
+				filename.c_str(), static_cast<int>(it->second.windows.size() - 1));
+
+			// create the mesh
+			CreateMesh(sz, eh, descForErrors);
+			return true;
+		}
+	}
+
+	// Check the concurrent player limit.  A player we already own doesn't
+	// count, since we'll release it when the new one replaces it.  When
+	// we're at the limit, simply fail without an error; the callers all
+	// fall back on still images when a video doesn't load.
+	if (maxPlayers != 0 && openPlayers - (countedPlayer ? 1 : 0) >= maxPlayers)
+	{
+		LogFile::Get()->Write(LogFile::MediaFileLogging,
+			_T("Video: skipping %s; the limit of %d concurrent video players is in use\n"),
+			filename.c_str(), maxPlayers);
+		return false;
+	}
+
 	// create a new video player
 	RefPtr<AudioVideoPlayer> v(new VLCAudioVideoPlayer(hwnd, hwnd, false));
 
@@ -146,31 +190,105 @@ bool VideoSprite::LoadVideo(
 	// discard any previous video player and store the new one
 	ReleaseVideoPlayer();
 	videoPlayer = v;
+	countedPlayer = true;
+	InterlockedIncrement(&openPlayers);
+
+	// if sharing is allowed, offer the new player to other windows
+	if (key.length() != 0)
+	{
+		CriticalSectionLocker locker(sharedDecodeLock);
+		if (sharedDecodes.find(key) == sharedDecodes.end())
+		{
+			auto &s = sharedDecodes[key];
+			s.player = v;
+			s.windows.push_back(hwnd);
+			sharedKey = key;
+			sharedHwnd = hwnd;
+		}
+	}
 
 	// create the mesh
 	CreateMesh(sz, eh, descForErrors);
 
+	// Show the poster frame while the player starts up, if desired.  (A
+	// shared player is already playing, so it doesn't need one.)
+	if (posterFrame)
+		LoadPosterFrame(filename);
+
 	// success 
 	return true;
 }
 
+void VideoSprite::LoadPosterFrame(const TSTRING &filename)
+{
+	// try loading the cached frame; if there isn't one, queue it for next time
+	WSTRING wfilename = TSTRINGToWSTRING(filename);
+	TextureAndView tv;
+	if (!TextureCache::LoadPoster(wfilename.c_str(), &tv.texture, &tv.rv))
+	{
+		TextureCache::AddPoster(wfilename.c_str());
+		return;
+	}
+
+	// note the frame size
+	RefPtr<ID3D11Texture2D> tex2d;
+	if (SUCCEEDED(tv.texture->QueryInterface(__uuidof(ID3D11Texture2D), reinterpret_cast<void**>(&tex2d))))
+	{
+		D3D11_TEXTURE2D_DESC desc;
+		tex2d->GetDesc(&desc);
+		posterFrameSize = { static_cast<LONG>(desc.Width), static_cast<LONG>(desc.Height) };
+	}
+
+	// install it as the static image, ready for display
+	ReleaseLoadContext();
+	loadContext.Attach(new LoadContext());
+	loadContext->tv = tv;
+	hasPosterFrame = true;
+	SetRenderDirty();
+}
+
 // Render the video
 void VideoSprite::Render(Camera *camera)
 {
 	// update the fade
 	UpdateFade();
 
+	// note the player we're rendering, for dirty tracking
+	lastRenderPlayer = videoPlayer.Get();
+
 	// If we have a video, try rendering through the video player
 	if (videoPlayer != nullptr && videoPlayer->Render(camera, this))
+	{
+		lastRenderFrameSerial = videoPlayer->GetFrameSerial();
+		SaveRenderState();
+
+		// the video has taken over, so we're done with the poster frame
+		if (hasPosterFrame && loadContext != nullptr)
+			ReleaseLoadContext();
 		return;
+	}
 
 	// No video or no video frame - render the static image instead,
 	// if we have one
 	__super::Render(camera);
 }
 
+bool VideoSprite::IsRenderDirty() const
+{
+	// if the player has changed, or it has a new frame ready, we need
+	// to draw it
+	if (videoPlayer.Get() != lastRenderPlayer
+		|| (videoPlayer != nullptr && (videoPlayer->IsFrameAvailable() || videoPlayer->GetFrameSerial() != lastRenderFrameSerial)))
+		return true;
+
+	// check the base class conditions
+	return __super::IsRenderDirty();
+}
+
 void VideoSprite::Clear()
 {
 	ClearVideo();
+	hasPosterFrame = false;
+	posterFrameSize = { 0, 0 };
 	__super::Clear();
 }
@@ -7,6 +7,7 @@
 // playback.
 
 #pragma once
+#include <unordered_map>
 #include "Sprite.h"
 #include "AudioVideoPlayer.h"
 
@@ -17,15 +18,58 @@ class VideoSprite : public Sprite
 public:
 	VideoSprite();
 
+	// Shared decoding.  Some media packs use the same video file in
+	// several windows at once (the same loop video for the backglass
+	// and the topper, say).  Decoding the file separately for each
+	// window doubles the decoder CPU load for no visible benefit, so
+	// when the caller allows it, a sprite loading a video file that's
+	// already playing in another window subscribes to the existing
+	// player instead of opening a new one.  Each sprite still has its
+	// own mesh, geometry, and fade; only the decoded frames are shared.
+	// This is set from the configuration.
+	static bool sharedDecoding;
+
+	// Maximum number of video players open at once, across all windows,
+	// or zero for no limit.  Each libvlc player carries its own decoder
+	// buffers and frame textures, so this is the main lever on memory use
+	// for video-heavy setups.  A video load that would go over the limit
+	// fails, and the caller falls back on its still image.  Players shared
+	// across windows (see sharedDecoding) count once.  This is set by the
+	// low-memory profile.
+	static int maxPlayers;
+
 	// Load a video.  'width' and 'height' give the size of the sprite
 	// in our normalized coordinates, where 1.0 is the height of the
 	// window.
+	//
+	// If 'shareDecode' is true, and the same file is already playing
+	// in a sharable sprite in another window, we share that sprite's
+	// player rather than opening a new one.  Callers should only allow
+	// this for looping background videos, since the playback controls
+	// (play, stop, volume) apply to the shared player as a whole.
+	//
+	// If 'posterFrame' is true, and the texture cache has a poster frame
+	// for the video (see TextureCache.h), we show the poster frame until
+	// the player presents its first frame.  If there's no poster frame
+	// yet, we queue one for extraction, for the next time the video is
+	// loaded.
 	bool LoadVideo(const TSTRING &filename, HWND hwnd, POINTF normalizedSize, 
 		ErrorHandler &eh, const TCHAR *descForErrors, 
-		bool play = true, int volumePct = 100);
-
-	// is the first frame ready?
-	virtual bool IsFrameReady() const { return videoPlayer != nullptr && videoPlayer->IsFrameReady(); }
+		bool play = true, int volumePct = 100, bool shareDecode = false,
+		bool posterFrame = false);
+
+	// Is the first frame ready?  A poster frame counts, since it's ready
+	// for display as soon as the load finishes.
+	virtual bool IsFrameReady() const
+		{ return (videoPlayer != nullptr && videoPlayer->IsFrameReady()) || hasPosterFrame; }
+
+	// Did the last video load show a poster frame?  If so, the frame was
+	// ready at load time, so the caller doesn't need to wait for the
+	// player's first frame notification.  The poster frame size gives the
+	// video's frame size, for setting up the layout before the player
+	// reports the format.
+	bool HasPosterFrame() const { return hasPosterFrame; }
+	SIZE GetPosterFrameSize() const { return posterFrameSize; }
 
 	// Clear resources
 	virtual void Clear() override;
@@ -36,6 +80,14 @@ public:
 	// Render the video
 	virtual void Render(Camera *camera) override;
 
+	// Has the sprite changed since the last render?  In addition to the
+	// base class checks, this checks for a newly decoded video frame.
+	virtual bool IsRenderDirty() const override;
+
+	// A playing video counts as animated
+	virtual bool IsAnimated() const override
+		{ return (videoPlayer != nullptr && videoPlayer->IsPlaying()) || __super::IsAnimated(); }
+
 	// Do we have a video?
 	bool IsVideo() const { return videoPlayer != nullptr; }
 
@@ -70,10 +122,12 @@ public:
 	virtual DWORD GetMediaCookie() const override
 		{ return videoPlayer != nullptr ? videoPlayer->GetCookie() : __super::GetMediaCookie(); }
 
-	// service an AVPMsgLoopNeeded message
+	// Service an AVPMsgLoopNeeded message.  If the player loops by
+	// itself, the message is only a notification, so there's nothing
+	// to do.
 	virtual void ServiceLoopNeededMessage(ErrorHandler &eh) override
 	{
-		if (videoPlayer != nullptr)
+		if (videoPlayer != nullptr && !videoPlayer->IsLoopHandledInPlayer())
 			videoPlayer->Replay(eh);
 	}
 
@@ -90,4 +144,50 @@ protected:
 
 	// video player
 	RefPtr<AudioVideoPlayer> videoPlayer;
+
+	// Video player at the last render, for dirty tracking.  This is for
+	// comparison only; never dereference it.
+	const void *lastRenderPlayer = nullptr;
+
+	// player frame serial number at the last render, for dirty tracking
+	UINT64 lastRenderFrameSerial = 0;
+
+	// Shared decoder table entry.  The table doesn't hold a reference
+	// on the player; the sharing sprites do.  The entry is removed when
+	// the last sprite releases the player.
+	struct SharedDecode
+	{
+		AudioVideoPlayer *player;
+
+		// windows of the sprites using the player
+		std::vector<HWND> windows;
+	};
+
+	// shared decoders, keyed by lower-case file name
+	static std::unordered_map<TSTRING, SharedDecode> sharedDecodes;
+
+	// lock for the shared decoder table (loads can run on background threads)
+	static CriticalSection sharedDecodeLock;
+
+	// If we're sharing our player, the shared decoder table key and our
+	// window.  The key is empty if the player isn't in the table.
+	TSTRING sharedKey;
+	HWND sharedHwnd = NULL;
+
+	// Number of players open against the maxPlayers limit.  Loads can run
+	// on background threads, so this is updated with interlocked access.
+	static volatile LONG openPlayers;
+
+	// does our player count against the limit?
+	bool countedPlayer = false;
+
+	// Poster frame status.  The poster frame is loaded as the base sprite
+	// texture, which the renderer shows until the player has a frame.  We
+	// release the texture once the video takes over, but the flag stays
+	// set until the next load.
+	bool hasPosterFrame = false;
+	SIZE posterFrameSize = { 0, 0 };
+
+	// load the poster frame for a video, if there is one
+	void LoadPosterFrame(const TSTRING &filename);
 };
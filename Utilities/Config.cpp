@@ -5,6 +5,7 @@
 
 #include "stdafx.h"
 #include <vector>
+#include <algorithm>
 #include <regex>
 #include <ShlObj.h>
 #include <Shlwapi.h>
@@ -17,6 +18,9 @@
 // global singleton
 ConfigManager *ConfigManager::inst = 0;
 
+// change set covering everything
+const ConfigManager::ChangeSet ConfigManager::ChangeSet::everything;
+
 // Standard config file descriptor
 const ConfigFileDesc MainConfigFileDesc = {
 	nullptr,                        // store the file in the deployment folder
@@ -34,6 +38,9 @@ void ConfigManager::Init()
 
 void ConfigManager::Shutdown()
 {
+	if (inst != nullptr)
+		inst->ReportLookupCounts();
+
 	delete inst;
 	inst = 0;
 }
@@ -192,10 +199,21 @@ bool ConfigManager::Reload()
 
 bool ConfigManager::LoadFrom(const TCHAR *filename)
 {
-	// Clear out any previous configuration
+	// Save the old values, so that we can figure out what changed
+	std::unordered_map<TSTRING, TSTRING> oldVals;
+	bool hadOldVals = loaded;
+	for (auto &v : vars)
+	{
+		if (!v.second->erased)
+			oldVals.emplace(v.first, v.second->value);
+	}
+
+	// Clear out any previous configuration.  This invalidates all
+	// entry pointers cached in Var<T> handles.
 	contents.clear();
 	vars.clear();
 	arrays.clear();
+	++generation;
 
 	// Open the file
 	long filelen;
@@ -284,9 +302,31 @@ bool ConfigManager::LoadFrom(const TCHAR *filename)
 		// we're clean after loading
 		dirty = false;
 
+		// Figure the change set.  A variable is changed if it's new, if
+		// its value is different, or if it's no longer present.
+		reloadChanges.keys.clear();
+		reloadChanges.all = !hadOldVals;
+		if (hadOldVals)
+		{
+			for (auto &v : vars)
+			{
+				if (auto it = oldVals.find(v.first); it == oldVals.end())
+					reloadChanges.keys.emplace(v.first);
+				else
+				{
+					if (it->second != v.second->value)
+						reloadChanges.keys.emplace(v.first);
+					oldVals.erase(it);
+				}
+			}
+			for (auto &v : oldVals)
+				reloadChanges.keys.emplace(v.first);
+		}
+		loaded = true;
+
 		// notify subscribers
 		for (auto s : subscribers)
-			s->OnConfigReload();
+			s->OnConfigReload(reloadChanges);
 
 		// success
 		return true;
@@ -446,9 +486,114 @@ void ConfigManager::LogFileWarning(int lineno, const TCHAR *msg, ...)
 	delete[] buf;
 }
 
+size_t ConfigManager::EstimateMemory() const
+{
+	// figure a list node as the line object plus two pointers
+	size_t bytes = 0;
+	for (auto const &l : contents)
+	{
+		bytes += sizeof(ConfigLine) + 2 * sizeof(void*)
+			+ (l.text.capacity() + l.name.capacity() + l.value.capacity()) * sizeof(TCHAR);
+	}
+
+	// figure a hash map entry as the key/value pair plus a node pointer
+	for (auto const &v : vars)
+		bytes += sizeof(v) + sizeof(void*) + v.first.capacity() * sizeof(TCHAR);
+	for (auto const &a : arrays)
+	{
+		bytes += sizeof(a) + sizeof(void*) + a.first.capacity() * sizeof(TCHAR);
+		for (auto const &e : a.second)
+			bytes += sizeof(e) + sizeof(void*) + (e.first.capacity() + e.second.capacity()) * sizeof(TCHAR);
+	}
+
+	return bytes;
+}
+
+#ifdef _DEBUG
+// Count a string-keyed lookup, for the debug lookup summary
+void ConfigManager::CountLookup(const TCHAR *name) const
+{
+	CriticalSectionLocker locker(lookupCountLock);
+	if (lookupCountStart == 0)
+		lookupCountStart = GetTickCount();
+	++lookupCounts[name];
+}
+
+void ConfigManager::ReportLookupCounts() const
+{
+	CriticalSectionLocker locker(lookupCountLock);
+	if (lookupCounts.size() == 0)
+		return;
+
+	// sort the names by count, busiest first
+	std::vector<std::pair<const TSTRING*, int>> v;
+	int total = 0;
+	for (auto &it : lookupCounts)
+	{
+		v.emplace_back(&it.first, it.second);
+		total += it.second;
+	}
+	std::sort(v.begin(), v.end(), [](const auto &a, const auto &b) { return a.second > b.second; });
+
+	// write the total, the rate, and the top few names
+	DWORD dt = GetTickCount() - lookupCountStart;
+	TSTRING msg = MsgFmt(_T("Config: %d string-keyed lookups in %.1f seconds (%.1f/s):"),
+		total, dt / 1000.0, dt != 0 ? total * 1000.0 / dt : 0.0).Get();
+	for (size_t i = 0; i < v.size() && i < 5; ++i)
+		msg += MsgFmt(_T(" %s (%d)"), v[i].first->c_str(), v[i].second).Get();
+	msg += _T("\n");
+	OutputDebugString(msg.c_str());
+
+	// start a new count
+	lookupCounts.clear();
+	lookupCountStart = 0;
+}
+#endif
+
+bool ConfigManager::ChangeSet::Has(const TCHAR *name) const
+{
+	if (all)
+		return true;
+
+	for (auto &k : keys)
+	{
+		if (_tcsicmp(k.c_str(), name) == 0)
+			return true;
+	}
+	return false;
+}
+
+bool ConfigManager::ChangeSet::HasPrefix(const TCHAR *prefix) const
+{
+	if (all)
+		return true;
+
+	size_t len = _tcslen(prefix);
+	for (auto &k : keys)
+	{
+		if (_tcsnicmp(k.c_str(), prefix, len) == 0)
+			return true;
+	}
+	return false;
+}
+
+bool ConfigManager::ChangeSet::Only(std::function<bool(const TSTRING &name)> pred) const
+{
+	if (all)
+		return false;
+
+	for (auto &k : keys)
+	{
+		if (!pred(k))
+			return false;
+	}
+	return true;
+}
+
 // Get a value
 const TCHAR *ConfigManager::Get(const TCHAR *name, const TCHAR *defval) const
 {
+	CountLookup(name);
 	auto it = vars.find(name);
 	return it == vars.end() || it->second->erased ? defval : it->second->value.c_str();
 }
@@ -457,6 +602,7 @@ const TCHAR *ConfigManager::Get(const TCHAR *name, const TCHAR *defval) const
 bool ConfigManager::GetBool(const TCHAR *name, bool defval) const
 {
 	// look up the variable; if not found, return the default value
+	CountLookup(name);
 	auto it = vars.find(name);
 	if (it == vars.end() || it->second->erased)
 		return defval;
@@ -482,6 +628,7 @@ void ConfigManager::SetBool(const TCHAR *name, bool val)
 // get a value as an int
 int ConfigManager::GetInt(const TCHAR *name, int defval) const
 {
+	CountLookup(name);
 	auto it = vars.find(name);
 	return it == vars.end() || it->second->erased ? defval : ToInt(it->second->value.c_str());
 }
@@ -502,6 +649,7 @@ void ConfigManager::Set(const TCHAR *name, int val)
 // get a value as a float
 float ConfigManager::GetFloat(const TCHAR *name, float defval) const
 {
+	CountLookup(name);
 	auto it = vars.find(name);
 	return it == vars.end() || it->second->erased ? defval : ToFloat(it->second->value.c_str());
 }
@@ -523,6 +671,7 @@ void ConfigManager::SetFloat(const TCHAR *name, float val)
 // get a value as a color
 COLORREF ConfigManager::GetColor(const TCHAR *name, COLORREF defval) const
 {
+	CountLookup(name);
 	auto it = vars.find(name);
 	return it == vars.end() || it->second->erased ? defval : ToColor(it->second->value.c_str(), defval);
 }
@@ -577,6 +726,7 @@ void ConfigManager::SetArrayEle(const TCHAR *name, const TCHAR *index, int val)
 // get a value as a RECT
 RECT ConfigManager::GetRect(const TCHAR *name, RECT defval) const
 {
+	CountLookup(name);
 	auto it = vars.find(name);
 	return it == vars.end() || it->second->erased ? defval : ToRect(it->second->value.c_str());
 }
@@ -627,6 +777,9 @@ void ConfigManager::AddVariable(const TCHAR *name, ConfigLine *line)
 	// add it to the variable map
 	vars.emplace(name, line);
 
+	// a new name might resolve a Var<T> handle that didn't find it before
+	++generation;
+
 	// check if it's an array variable
 	const TCHAR *br = _tcschr(name, '[');
 	if (br != 0)
@@ -685,6 +838,9 @@ void ConfigManager::Set(std::unordered_map<TSTRING, ConfigLine *>::iterator it,
 
 		// it's no longer erased
 		it->second->erased = false;
+
+		// note the change for cached copies
+		++it->second->version;
 	}
 	else
 	{
@@ -720,6 +876,7 @@ void ConfigManager::Delete(const TCHAR *name)
 	if (auto it = vars.find(name); it != vars.end())
 	{
 		it->second->erased = true;
+		++it->second->version;
 		dirty = true;
 	}
 }
@@ -732,6 +889,7 @@ void ConfigManager::Delete(std::function<bool(const TSTRING &)> match)
 		if (!it->erased && it->name.length() != 0 && match(it->name))
 		{
 			it->erased = true;
+			++it->version;
 			dirty = true;
 		}
 	}
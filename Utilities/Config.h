@@ -14,6 +14,7 @@
 #include <unordered_map>
 #include <unordered_set>
 #include <functional>
+#include "WinUtil.h"
 
 // Configuration file description.  This specifies the file system
 // location and name of the file.
@@ -110,6 +111,11 @@ public:
 	// Flag: this variable has been erased.  This line won't be saved
 	// to the file.
 	bool erased;
+
+	// Change counter.  This is incremented each time the value is set
+	// or erased, so that a cached copy of the value (see ConfigManager::
+	// Var) can tell whether it's still current without re-parsing it.
+	UINT32 version = 0;
 };
 
 // Configuration manager
@@ -156,13 +162,69 @@ public:
 	// Do we have unsaved changes?
 	bool IsDirty() const { return dirty; }
 
+	// Estimate the memory used by the in-memory settings, in bytes.  This
+	// is an approximation of the container overhead, for the memory
+	// statistics.
+	size_t EstimateMemory() const;
+
+	// Write a summary of the string-keyed lookups since the last report
+	// to the debugger output, with the busiest names, and start a new
+	// count.  This is a no-op in release builds.  We also report at
+	// shutdown.
+#ifdef _DEBUG
+	void ReportLookupCounts() const;
+#else
+	void ReportLookupCounts() const { }
+#endif
+
+	// Change set.  When the file is reloaded, we compare the new
+	// contents against the old, and pass subscribers the set of
+	// variables that were added, removed, or changed.  This is what
+	// lets a subscriber rebuild only the parts of its state that depend
+	// on the changed variables, rather than everything.  On the initial
+	// load, or on any other reload where the old values aren't meaningful,
+	// 'all' is set, meaning that all variables should be treated as
+	// changed.
+	//
+	// Name comparisons are case-insensitive, for the benefit of hand
+	// edits to the settings file.
+	class ChangeSet
+	{
+	public:
+		// treat everything as changed
+		bool all = true;
+
+		// names of the changed variables, when 'all' isn't set
+		std::unordered_set<TSTRING> keys;
+
+		// is the set empty?
+		bool IsEmpty() const { return !all && keys.size() == 0; }
+
+		// did the given variable change?
+		bool Has(const TCHAR *name) const;
+
+		// did any variable starting with the given prefix change?
+		bool HasPrefix(const TCHAR *prefix) const;
+
+		// Does every changed variable satisfy the callback?  This is
+		// always false when 'all' is set.
+		bool Only(std::function<bool(const TSTRING &name)> pred) const;
+
+		// a change set covering everything, for initial loads
+		static const ChangeSet everything;
+	};
+
+	// get the change set from the last reload
+	const ChangeSet &GetReloadChanges() const { return reloadChanges; }
+
 	// Update subscriber.  This registers an object to notify on certain
 	// config change events.
 	class Subscriber
 	{
 	public:
-		// Configuration file has been reloaded
-		virtual void OnConfigReload() { }
+		// Configuration file has been reloaded.  'changes' is the set of
+		// variables that changed.
+		virtual void OnConfigReload(const ChangeSet &changes) { }
 
 		// Configuration file pre/post save events
 		virtual void OnConfigPreSave() { }
@@ -193,6 +255,75 @@ public:
 	COLORREF GetColor(const TCHAR *name, COLORREF defval = RGB(0, 0, 0)) const;
 	RECT GetRect(const TCHAR *name, RECT defval = { 0, 0, 0, 0 }) const;
 
+	// Typed, cached variable handle.  This provides fast access to a
+	// variable from code that reads it frequently, such as per-frame
+	// or per-event code.  The handle resolves the key to the variable's
+	// entry on the first access, and caches the parsed value.  Each
+	// later access only has to check that the cached copy is current,
+	// which takes a couple of integer comparisons rather than a string
+	// hash lookup and a parse.
+	//
+	// The cache is invalidated automatically when the variable is set
+	// or deleted (via the per-line version counter), when a new variable
+	// is added (since that might be the one we're looking for), and when
+	// the file is reloaded.  So a handle can safely be kept for the life
+	// of the program, typically as a static.
+	//
+	// T can be bool, int, float, or COLORREF.  Like the rest of the
+	// config manager, handles are meant to be used on the main thread.
+	template<typename T> class Var
+	{
+	public:
+		Var(const TCHAR *name, T defval) : name(name), defval(defval), value(defval) { }
+
+		// get the value
+		T Get() const
+		{
+			ConfigManager *cfg = ConfigManager::GetInstance();
+			if (cfg == nullptr)
+				return defval;
+
+			if (cfg != this->cfg || generation != cfg->generation
+				|| (line != nullptr && line->version != lineVersion))
+				Resolve(cfg);
+
+			return value;
+		}
+		operator T() const { return Get(); }
+
+		// get the variable name
+		const TCHAR *GetName() const { return name; }
+
+	protected:
+		// look up the variable and refresh the cached value
+		void Resolve(ConfigManager *cfg) const
+		{
+			auto it = cfg->vars.find(name);
+			line = it != cfg->vars.end() ? it->second : nullptr;
+			lineVersion = line != nullptr ? line->version : 0;
+			value = line != nullptr && !line->erased ? FromStr(line->value.c_str(), defval) : defval;
+			generation = cfg->generation;
+			this->cfg = cfg;
+		}
+
+		// variable name and default value
+		const TCHAR *name;
+		T defval;
+
+		// cached value, and the state it was resolved against
+		mutable T value;
+		mutable const ConfigLine *line = nullptr;
+		mutable UINT32 lineVersion = 0;
+		mutable UINT64 generation = 0;
+		mutable const ConfigManager *cfg = nullptr;
+	};
+
+	// Typed conversions, for Var<T>
+	static bool FromStr(const TCHAR *val, bool) { return ToBool(val); }
+	static int FromStr(const TCHAR *val, int) { return ToInt(val); }
+	static float FromStr(const TCHAR *val, float) { return ToFloat(val); }
+	static COLORREF FromStr(const TCHAR *val, COLORREF defval) { return ToColor(val, defval); }
+
 	// Convert from string to the various datatypes
 	static const TCHAR *ToStr(const TCHAR *val) { return val; }
 	static bool ToBool(const TCHAR *val);
@@ -259,6 +390,28 @@ protected:
 	// add a variable to our map
 	void AddVariable(const TCHAR *name, ConfigLine *line);
 
+	// Variable map generation.  This is incremented whenever the map
+	// changes in a way that could change the entry a name resolves to:
+	// when the file is reloaded (which discards all of the old entries),
+	// and when a new variable is added.  Var<T> handles check this to
+	// tell when their cached entry pointers have to be looked up again.
+	UINT64 generation = 1;
+
+	// Count a string-keyed lookup.  In debug builds, this keeps a count
+	// of lookups per variable name, for ReportLookupCounts(), to help find
+	// hot callers that should use a Var<T> handle instead.  The getters
+	// are called from background threads as well as the UI thread, so
+	// the counts are protected by a lock.  This compiles to nothing in
+	// release builds.
+#ifdef _DEBUG
+	void CountLookup(const TCHAR *name) const;
+	mutable std::unordered_map<TSTRING, int> lookupCounts;
+	mutable DWORD lookupCountStart = 0;
+	mutable CriticalSection lookupCountLock;
+#else
+	void CountLookup(const TCHAR *) const { }
+#endif
+
 	// filename
 	TSTRING filename;
 
@@ -292,6 +445,13 @@ protected:
 	// do we have unsaved changes?
 	bool dirty;
 
+	// Has a file been loaded yet?  The first load treats everything
+	// as changed, since there are no previous values to compare.
+	bool loaded = false;
+
+	// changes from the last reload
+	ChangeSet reloadChanges;
+
 	// Notification subscribers
 	std::list<Subscriber *> subscribers;
 };
@@ -15,22 +15,67 @@ DateTime::DateTime()
 // create a new DateTime representing a time in YYYYMMDDHHMMSS format
 DateTime::DateTime(const TCHAR *str)
 {
+	// Try the fast path for our exact storage format first, since that's
+	// what nearly every caller passes us.  Fall back on the scanf parser
+	// for anything looser (short fields, leading spaces, etc).
 	SYSTEMTIME st;
 	ZeroMemory(&ft, sizeof(ft));
 	ZeroMemory(&st, sizeof(st));
-	if (str != nullptr && _stscanf_s(str, _T("%04hd%02hd%02hd%02hd%02hd%02hd"),
-		&st.wYear, &st.wMonth, &st.wDay, &st.wHour, &st.wMinute, &st.wSecond) == 6)
+	if (str != nullptr
+		&& (ParseStorageFormat(str, st)
+			|| _stscanf_s(str, _T("%04hd%02hd%02hd%02hd%02hd%02hd"),
+				&st.wYear, &st.wMonth, &st.wDay, &st.wHour, &st.wMinute, &st.wSecond) == 6))
 		SystemTimeToFileTime(&st, &ft);
 }
 
+bool DateTime::ParseStorageFormat(const TCHAR *str, SYSTEMTIME &st)
+{
+	// read an n-digit field, advancing the pointer
+	auto Field = [&str](int nDigits, WORD &val)
+	{
+		int acc = 0;
+		for (int i = 0; i < nDigits; ++i, ++str)
+		{
+			if (*str < '0' || *str > '9')
+				return false;
+			acc = acc * 10 + (*str - '0');
+		}
+		val = static_cast<WORD>(acc);
+		return true;
+	};
+
+	// the string must consist of exactly the fourteen digits
+	SYSTEMTIME t;
+	ZeroMemory(&t, sizeof(t));
+	if (!Field(4, t.wYear) || !Field(2, t.wMonth) || !Field(2, t.wDay)
+		|| !Field(2, t.wHour) || !Field(2, t.wMinute) || !Field(2, t.wSecond)
+		|| *str != 0)
+		return false;
+
+	st = t;
+	return true;
+}
+
 TSTRING DateTime::ToString() const
 {
 	SYSTEMTIME st;
 	FileTimeToSystemTime(&ft, &st);
 
-	TCHAR buf[128];
-	_stprintf_s(buf, _T("%04d%02d%02d%02d%02d%02d"),
-		st.wYear, st.wMonth, st.wDay, st.wHour, st.wMinute, st.wSecond);
+	// Format the fields directly as digits.  This is the inverse of
+	// ParseStorageFormat(), and is called for every date we store.
+	TCHAR buf[15];
+	auto Field = [&buf](int ofs, int nDigits, int val)
+	{
+		for (int i = ofs + nDigits - 1; i >= ofs; --i, val /= 10)
+			buf[i] = static_cast<TCHAR>('0' + val % 10);
+	};
+	Field(0, 4, st.wYear);
+	Field(4, 2, st.wMonth);
+	Field(6, 2, st.wDay);
+	Field(8, 2, st.wHour);
+	Field(10, 2, st.wMinute);
+	Field(12, 2, st.wSecond);
+	buf[14] = 0;
 
 	return buf;
 }
@@ -62,6 +107,29 @@ TSTRING DateTime::FormatLocalDateTime(DWORD dateFlags, DWORD timeFlags) const
 	return MsgFmt(_T("%s, %s"), date, time).Get();
 }
 
+TSTRING DateTime::FormatCurrentLocalDateTime()
+{
+	// The formatted string only changes once a second, so there's no
+	// need to go through the time zone conversion and the locale
+	// formatting for every call.  Keep the last result, along with the
+	// second it represents, for each thread.
+	static thread_local ULONGLONG cachedSecond = ~0ULL;
+	static thread_local TSTRING cachedStr;
+
+	FILETIME now;
+	GetSystemTimeAsFileTime(&now);
+	ULARGE_INTEGER ull;
+	ull.LowPart = now.dwLowDateTime;
+	ull.HighPart = now.dwHighDateTime;
+	ULONGLONG second = ull.QuadPart / 10000000ULL;
+	if (second != cachedSecond)
+	{
+		cachedStr = DateTime(now).FormatLocalDateTime();
+		cachedSecond = second;
+	}
+	return cachedStr;
+}
+
 TSTRING DateTime::FormatLocalDate(DWORD flags) const
 {
 	// Convert the internal UTC timestamp to a SYSTEMTIME struct
@@ -89,10 +157,19 @@ bool DateTime::Parse(const TCHAR *str)
 		SystemTimeToFileTime(&utcDate, &ft);
 	};
 
+	// check for our own storage format first, since it's the most common
+	// case, and we can parse it without the regex matchers
+	if (SYSTEMTIME d; ParseStorageFormat(str, d))
+	{
+		Store(d);
+		return true;
+	}
+
 	// check for computer-style formats: YYYYMMDD-HHMMSS and the like
 	typedef std::basic_regex<TCHAR> R;
 	std::match_results<const TCHAR *> m;
-	if (std::regex_match(str, m, R(_T("\\s*(\\d\\d\\d\\d)-?(\\d\\d)-?(\\d\\d)([:\\-]?(\\d\\d):?(\\d\\d)(:?\\d\\d)?)?\\s*"))))
+	static const R computerFormatPat(_T("\\s*(\\d\\d\\d\\d)-?(\\d\\d)-?(\\d\\d)([:\\-]?(\\d\\d):?(\\d\\d)(:?\\d\\d)?)?\\s*"));
+	if (std::regex_match(str, m, computerFormatPat))
 	{
 		// extract the fields
 		SYSTEMTIME d;
@@ -148,7 +225,8 @@ bool DateTime::Parse(const TCHAR *str)
 
 		// try various date formats
 		std::match_results<const TCHAR *> m;
-		if (std::regex_match(str, m, R(_T("\\s*(\\d\\d\\d\\d)[\\-/.,](\\d\\d?)[\\-/.,](\\d\\d?)\\b(.*)"))))
+		static const R ymdPat(_T("\\s*(\\d\\d\\d\\d)[\\-/.,](\\d\\d?)[\\-/.,](\\d\\d?)\\b(.*)"));
+		if (std::regex_match(str, m, ymdPat))
 		{
 			// YYYY-MM-DD
 			int yy = _ttoi(m[1].str().c_str());
@@ -166,7 +244,8 @@ bool DateTime::Parse(const TCHAR *str)
 		}
 		
 		// MM, DD, YY/YYYY fields in any order, with typical separators.
-		if (std::regex_match(str, m, R(_T("\\s*(\\d{1,4})([\\-/.,])(\\d{1,4})\\2(\\d{1,4})\\b(.*)"))))
+		static const R anyOrderPat(_T("\\s*(\\d{1,4})([\\-/.,])(\\d{1,4})\\2(\\d{1,4})\\b(.*)"));
+		if (std::regex_match(str, m, anyOrderPat))
 		{
 			do
 			{
@@ -292,7 +371,8 @@ bool DateTime::Parse(const TCHAR *str)
 		typedef std::basic_regex<TCHAR> R;
 		std::match_results<const TCHAR *> m;
 		TSTRING timePart;
-		if (std::regex_match(str, m, R(_T("\\s*(\\d\\d?)[:.](\\d\\d)([:.](\\d\\d))?(\\s*([aApP][mM]?))?\\b(.*)"))))
+		static const R timePat(_T("\\s*(\\d\\d?)[:.](\\d\\d)([:.](\\d\\d))?(\\s*([aApP][mM]?))?\\b(.*)"));
+		if (std::regex_match(str, m, timePat))
 		{
 			// get the hour, minute, and second
 			int hh = _ttoi(m[1].str().c_str());
@@ -323,7 +403,8 @@ bool DateTime::Parse(const TCHAR *str)
 	// trim delimiters from a string
 	auto TrimDelims = [](TSTRING &s)
 	{
-		s = std::regex_replace(s, R(_T("^[\\s.,;:@\\-]+")), _T(""));
+		static const R leadingDelimPat(_T("^[\\s.,;:@\\-]+"));
+		s = std::regex_replace(s, leadingDelimPat, _T(""));
 	};
 
 	// Try starting with a time value.
@@ -332,15 +332,15 @@ HRESULT DirectWriteUtils::StyledText::SpanStyle::MeasureText(
 	if (factory == nullptr)
 		return E_FAIL;
 
-	// create a text format
+	// get the text format
 	HRESULT hr;
 	RefPtr<IDWriteTextFormat> format;
-	if (!SUCCEEDED(hr = factory->CreateTextFormat(face.c_str(), nullptr, weight, style, stretch, size, locale, &format)))
+	if (!SUCCEEDED(hr = DirectWriteUtils::Get()->GetTextFormat(&format, face.c_str(), weight, style, stretch, size)))
 		return hr;
 
-	// create a text layout
+	// get the text layout
 	RefPtr<IDWriteTextLayout> layout;
-	if (!SUCCEEDED(hr = factory->CreateTextLayout(str, static_cast<UINT32>(len), format, maxWidth, maxHeight, &layout)))
+	if (!SUCCEEDED(hr = DirectWriteUtils::Get()->GetTextLayout(&layout, str, static_cast<UINT32>(len), format, maxWidth, maxHeight)))
 		return hr;
 
 	// measure the layout
@@ -418,14 +418,8 @@ HRESULT DirectWriteUtils::StyledText::Span::CreateTextFormat()
 	if (format != nullptr)
 		return S_OK;
 
-	auto factory = DirectWriteUtils::Get()->GetDWriteFactory();
-	auto locale = DirectWriteUtils::Get()->locale;
-	if (factory == nullptr)
-		return E_FAIL;
-
-	return factory->CreateTextFormat(
-		style.face.c_str(), nullptr, style.weight, style.style,
-		style.stretch, style.size, locale, &format);
+	return DirectWriteUtils::Get()->GetTextFormat(&format,
+		style.face.c_str(), style.weight, style.style, style.stretch, style.size);
 }
 
 void DirectWriteUtils::StyledText::CreateTextLayout(ErrorHandler &eh)
@@ -447,8 +441,8 @@ void DirectWriteUtils::StyledText::CreateTextLayout(ErrorHandler &eh)
 	RefPtr<IDWriteTextFormat> format;
 	HRESULT hr;
 	auto &s0 = spans.size() != 0 ? spans.front().style : defaultStyle;
-	if (!SUCCEEDED(hr = dwFactory->CreateTextFormat(s0.face.c_str(), NULL,
-		s0.weight, s0.style, s0.stretch, s0.size, dw->locale, &format)))
+	if (!SUCCEEDED(hr = dw->GetTextFormat(&format, s0.face.c_str(),
+		s0.weight, s0.style, s0.stretch, s0.size)))
 	{
 		eh.SysError(_T("Error creating styled text layout"), MsgFmt(_T("CreateTextFormat, HRESULT=%lx"), hr));
 		return;
@@ -457,7 +451,9 @@ void DirectWriteUtils::StyledText::CreateTextLayout(ErrorHandler &eh)
 	// Create the layout with the format for the first range.  Note that
 	// there's no need to separately set the font style information that's
 	// part of the Text Format, since that initially applies to the entire
-	// text range,  including the first run.
+	// text range,  including the first run.  We create this layout directly
+	// rather than going through the layout cache, since we apply the span
+	// styles to it below.
 	if (!SUCCEEDED(hr = dwFactory->CreateTextLayout(
 		plainText.c_str(), static_cast<UINT32>(plainText.length()),
 		format, 1000.0f, 1000.0f, &layout)))
@@ -649,7 +645,7 @@ void DirectWriteUtils::RenderStyledText(Gdiplus::Graphics &g, StyledText *txt,
 						{
 							// set up a layout for the text range
 							RefPtr<IDWriteTextLayout> boxLayout;
-							if (!SUCCEEDED(dwFactory->CreateTextLayout(txt->plainText.c_str() + h.textPosition, h.length, span.format, h.width, h.height, &boxLayout))
+							if (!SUCCEEDED(GetTextLayout(&boxLayout, txt->plainText.c_str() + h.textPosition, h.length, span.format, h.width, h.height))
 								|| !SUCCEEDED(boxLayout->GetOverhangMetrics(&om)))
 								om = { 0.0f, 0.0f, 0.0f, 0.0f };
 						}
@@ -782,7 +778,7 @@ bool DirectWriteUtils::MeasureStyledText(Gdiplus::RectF &rcPositioning, Gdiplus:
 						{
 							// set up a layout for the text range
 							RefPtr<IDWriteTextLayout> boxLayout;
-							if (!SUCCEEDED(dwFactory->CreateTextLayout(txt->plainText.c_str() + h.textPosition, h.length, span.format, h.width, h.height, &boxLayout))
+							if (!SUCCEEDED(GetTextLayout(&boxLayout, txt->plainText.c_str() + h.textPosition, h.length, span.format, h.width, h.height))
 								|| !SUCCEEDED(boxLayout->GetOverhangMetrics(&om)))
 								om = { 0.0f, 0.0f, 0.0f, 0.0f };
 						}
@@ -869,23 +865,20 @@ void DirectWriteUtils::Draw(Gdiplus::Graphics &g, const TCHAR *txt, Gdiplus::Fon
 	family.GetFamilyName(fontName);
 	float fontSz = font->GetSize();
 
-	// set up a default text format
+	// Set up a default text format.  This uses the default alignment,
+	// leading horizontally and near vertically.  (The format comes from
+	// the shared cache, so we can't change its settings.)
 	RefPtr<IDWriteTextFormat> baseFormat;
-	if (!SUCCEEDED(hr = dwFactory->CreateTextFormat(fontName, NULL,
+	if (!SUCCEEDED(hr = GetTextFormat(&baseFormat, fontName,
 		DWRITE_FONT_WEIGHT_NORMAL, DWRITE_FONT_STYLE_NORMAL, DWRITE_FONT_STRETCH_NORMAL,
-		fontSz * 96.0f / static_cast<float>(GetDeviceCaps(gphdc, LOGPIXELSY)),
-		locale, &baseFormat)))
+		fontSz * 96.0f / static_cast<float>(GetDeviceCaps(gphdc, LOGPIXELSY)))))
 		return HRError(_T("CreateTextFormat (default base format)"));
 
-	// set default alignment
-	baseFormat->SetTextAlignment(DWRITE_TEXT_ALIGNMENT_LEADING);
-	baseFormat->SetParagraphAlignment(DWRITE_PARAGRAPH_ALIGNMENT_NEAR);
-
 	// set up a text layout
 	RefPtr<IDWriteTextLayout> layout;
-	if (!SUCCEEDED(hr = dwFactory->CreateTextLayout(
+	if (!SUCCEEDED(hr = GetTextLayout(&layout,
 		TCHARToWCHAR(txt), static_cast<UINT32>(_tcslen(txt)),
-		baseFormat, rc.Width, rc.Height, &layout)))
+		baseFormat, rc.Width, rc.Height)))
 		return HRError(_T("CreateTextLayout"));
 
 	// create a DC render target
@@ -914,6 +907,110 @@ void DirectWriteUtils::Draw(Gdiplus::Graphics &g, const TCHAR *txt, Gdiplus::Fon
 		return HRError(_T("EndDraw"));
 }
 
+HRESULT DirectWriteUtils::GetTextFormat(IDWriteTextFormat **ppFormat, const WCHAR *face,
+	DWRITE_FONT_WEIGHT weight, DWRITE_FONT_STYLE style, DWRITE_FONT_STRETCH stretch, float size)
+{
+	*ppFormat = nullptr;
+	if (dwFactory == nullptr)
+		return E_FAIL;
+
+	// look for a cached format with the same descriptor
+	CriticalSectionLocker locker(cacheLock);
+	WSTRING key = MsgFmt(L"%d.%d.%d.%a.%s", static_cast<int>(weight), static_cast<int>(style),
+		static_cast<int>(stretch), size, face).Get();
+	if (auto it = formatCacheIndex.find(key); it != formatCacheIndex.end())
+	{
+		// found it - move it to the front of the MRU list and return it
+		cacheStats.formatHits += 1;
+		formatCache.splice(formatCache.begin(), formatCache, it->second);
+		(*ppFormat = it->second->format)->AddRef();
+		return S_OK;
+	}
+
+	// not cached - create a new format
+	cacheStats.formatMisses += 1;
+	RefPtr<IDWriteTextFormat> format;
+	HRESULT hr;
+	if (!SUCCEEDED(hr = dwFactory->CreateTextFormat(face, nullptr, weight, style, stretch, size, locale, &format)))
+		return hr;
+
+	// drop the least recently used entry if the cache is full
+	if (formatCache.size() >= maxFormatCache)
+	{
+		formatCacheIndex.erase(formatCache.back().key);
+		formatCache.pop_back();
+	}
+
+	// add the new entry
+	formatCache.emplace_front();
+	formatCache.front().key = key;
+	formatCache.front().format = format;
+	formatCacheIndex.emplace(std::move(key), formatCache.begin());
+
+	// return the new format
+	*ppFormat = format.Detach();
+	return S_OK;
+}
+
+HRESULT DirectWriteUtils::GetTextLayout(IDWriteTextLayout **ppLayout, const WCHAR *str, UINT32 len,
+	IDWriteTextFormat *format, float maxWidth, float maxHeight)
+{
+	*ppLayout = nullptr;
+	if (dwFactory == nullptr || format == nullptr)
+		return E_FAIL;
+
+	// look for a cached layout
+	CriticalSectionLocker locker(cacheLock);
+	LayoutCacheKey key{ WSTRING(str, len), GetFormatDescriptor(format), maxWidth, maxHeight };
+	if (auto it = layoutCacheIndex.find(key); it != layoutCacheIndex.end())
+	{
+		// found it - move it to the front of the MRU list and return it
+		cacheStats.layoutHits += 1;
+		layoutCache.splice(layoutCache.begin(), layoutCache, it->second);
+		(*ppLayout = it->second->layout)->AddRef();
+		return S_OK;
+	}
+
+	// not cached - create a new layout
+	cacheStats.layoutMisses += 1;
+	RefPtr<IDWriteTextLayout> layout;
+	HRESULT hr;
+	if (!SUCCEEDED(hr = dwFactory->CreateTextLayout(str, len, format, maxWidth, maxHeight, &layout)))
+		return hr;
+
+	// drop the least recently used entry if the cache is full
+	if (layoutCache.size() >= maxLayoutCache)
+	{
+		layoutCacheIndex.erase(layoutCache.back().key);
+		layoutCache.pop_back();
+	}
+
+	// add the new entry
+	layoutCache.emplace_front();
+	layoutCache.front().key = key;
+	layoutCache.front().layout = layout;
+	layoutCacheIndex.emplace(std::move(key), layoutCache.begin());
+
+	// return the new layout
+	*ppLayout = layout.Detach();
+	return S_OK;
+}
+
+WSTRING DirectWriteUtils::GetFormatDescriptor(IDWriteTextFormat *format)
+{
+	// get the font family name
+	WCHAR family[LF_FACESIZE * 2] = L"";
+	if (format->GetFontFamilyNameLength() < countof(family))
+		format->GetFontFamilyName(family, countof(family));
+
+	// combine the font and paragraph settings with the family name
+	return MsgFmt(L"%d.%d.%d.%a.%d.%d.%d.%s",
+		static_cast<int>(format->GetFontWeight()), static_cast<int>(format->GetFontStyle()),
+		static_cast<int>(format->GetFontStretch()), format->GetFontSize(),
+		static_cast<int>(format->GetTextAlignment()), static_cast<int>(format->GetParagraphAlignment()),
+		static_cast<int>(format->GetWordWrapping()), family).Get();
+}
+
 DirectWriteUtils::DirectWriteUtils(ErrorHandler &eh)
 {
 	HRESULT hr = S_OK;
@@ -5,9 +5,12 @@
 #include <dwrite.h>
 #include <d2d1.h>
 #include <wincodec.h>
+#include <list>
+#include <unordered_map>
 #include "Pointers.h"
 #include "ComUtil.h"
 #include "LogError.h"
+#include "WinUtil.h"
 
 // device-independent pixels per printer's point unit
 const float dipsPerPoint = 0.0138889f * 96.0f;
@@ -26,8 +29,39 @@ public:
 	// get the WIC factory
 	IWICImagingFactory *GetWICFactory() const { return wicFactory; }
 
+	// get the Direct2D factory
+	ID2D1Factory *GetD2DFactory() const { return d2dFactory; }
+
 	// draw formatted text
 	void Draw(Gdiplus::Graphics &g, const TCHAR *txt, Gdiplus::Font *font, Gdiplus::RectF &rc, ErrorHandler &eh);
+
+	// Get a Text Format object for a font descriptor, using a cached
+	// object if available.  The returned format is shared with other
+	// callers, so it must not be modified.  The caller receives a new
+	// reference on success.
+	HRESULT GetTextFormat(IDWriteTextFormat **ppFormat, const WCHAR *face,
+		DWRITE_FONT_WEIGHT weight, DWRITE_FONT_STYLE style, DWRITE_FONT_STRETCH stretch, float size);
+
+	// Get a Text Layout object for a string, using a cached object if one
+	// exists for the same text, format, and layout box.  Formats are
+	// matched by their settings (font, alignment, and wrapping) rather
+	// than by object identity, so a caller can use a private format object
+	// that it modifies between calls, and separate but equivalent format
+	// objects share cache entries.  The layout is shared with other
+	// callers, so it must not be modified.  The caller receives a new
+	// reference on success.
+	HRESULT GetTextLayout(IDWriteTextLayout **ppLayout, const WCHAR *str, UINT32 len,
+		IDWriteTextFormat *format, float maxWidth, float maxHeight);
+
+	// Text Format and Text Layout cache statistics
+	struct CacheStats
+	{
+		UINT64 formatHits = 0;
+		UINT64 formatMisses = 0;
+		UINT64 layoutHits = 0;
+		UINT64 layoutMisses = 0;
+	};
+	CacheStats GetCacheStats() { CriticalSectionLocker locker(cacheLock); return cacheStats; }
 	
 	// Base class for custom inline objects
 	class InlineObject : public IDWriteInlineObject, public RefCounted
@@ -294,4 +328,59 @@ protected:
 
 	// default system locale name
 	WCHAR locale[LOCALE_NAME_MAX_LENGTH];
+
+	// Text Format cache.  Each distinct font descriptor gets one format
+	// object, which we keep in most-recently-used order, discarding the
+	// oldest when the cache fills up.
+	struct FormatCacheEntry
+	{
+		WSTRING key;
+		RefPtr<IDWriteTextFormat> format;
+	};
+	std::list<FormatCacheEntry> formatCache;
+	std::unordered_map<WSTRING, std::list<FormatCacheEntry>::iterator> formatCacheIndex;
+	static const size_t maxFormatCache = 64;
+
+	// Text Layout cache.  Layouts are keyed by the text, a descriptor
+	// string for the format settings, and the layout box size.
+	struct LayoutCacheKey
+	{
+		WSTRING text;
+		WSTRING format;
+		float maxWidth;
+		float maxHeight;
+
+		bool operator==(const LayoutCacheKey &k) const
+		{
+			return maxWidth == k.maxWidth && maxHeight == k.maxHeight && format == k.format && text == k.text;
+		}
+	};
+	struct LayoutCacheKeyHash
+	{
+		size_t operator()(const LayoutCacheKey &k) const
+		{
+			size_t h = std::hash<WSTRING>()(k.text);
+			h = h * 31 + std::hash<WSTRING>()(k.format);
+			h = h * 31 + std::hash<float>()(k.maxWidth);
+			return h * 31 + std::hash<float>()(k.maxHeight);
+		}
+	};
+	struct LayoutCacheEntry
+	{
+		LayoutCacheKey key;
+		RefPtr<IDWriteTextLayout> layout;
+	};
+
+	// get the layout cache descriptor string for a format
+	static WSTRING GetFormatDescriptor(IDWriteTextFormat *format);
+	std::list<LayoutCacheEntry> layoutCache;
+	std::unordered_map<LayoutCacheKey, std::list<LayoutCacheEntry>::iterator, LayoutCacheKeyHash> layoutCacheIndex;
+	static const size_t maxLayoutCache = 256;
+
+	// cache statistics
+	CacheStats cacheStats;
+
+	// Cache lock.  The DirectWrite factory is usable from any thread, so
+	// we protect the caches to make the cached versions equally safe.
+	CriticalSection cacheLock;
 };
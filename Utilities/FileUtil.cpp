@@ -40,6 +40,31 @@ bool TouchFile(const TCHAR *filename)
 	return ok;
 }
 
+// Pre-read a file into the file cache
+bool PrereadFile(const TCHAR *filename, UINT64 maxBytes)
+{
+	// open the file for sequential reading
+	HandleHolder hFile = CreateFile(filename, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+		NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (hFile == NULL || hFile == INVALID_HANDLE_VALUE)
+		return false;
+
+	// read it in large chunks, up to the limit or the end of the file
+	const DWORD chunkSize = 256 * 1024;
+	std::unique_ptr<BYTE[]> buf(new BYTE[chunkSize]);
+	for (UINT64 total = 0; total < maxBytes; )
+	{
+		DWORD actual = 0;
+		DWORD cur = static_cast<DWORD>(min(static_cast<UINT64>(chunkSize), maxBytes - total));
+		if (!ReadFile(hFile, buf.get(), cur, &actual, NULL) || actual == 0)
+			break;
+		total += actual;
+	}
+
+	// success
+	return true;
+}
+
 // Create a subdirectory, including intermediate directories as needed.
 BOOL CreateSubDirectory(
 	const TCHAR *fullPathToCreate,
@@ -296,6 +321,52 @@ wchar_t *ReadFileAsWStr(const TCHAR *filename, class ErrorHandler &handler,
 	return wbuf;
 }
 
+// -----------------------------------------------------------------------
+//
+// Memory-mapped file
+//
+bool MappedFile::Open(const TCHAR *filename)
+{
+	// release any previous view
+	Close();
+
+	// Open the file.  Allow other processes to read and delete it, as
+	// the buffered file readers do.
+	HandleHolder hFile(CreateFile(filename, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE,
+		NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL));
+	if (hFile == INVALID_HANDLE_VALUE)
+		return false;
+
+	// Get the size.  Windows can't map an empty file, and our callers
+	// work in terms of 'long' sizes, so reject anything over 2GB.
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(hFile, &fileSize) || fileSize.QuadPart == 0 || fileSize.QuadPart > LONG_MAX)
+		return false;
+
+	// create the mapping and map the whole file
+	HandleHolder hMap(CreateFileMapping(hFile, NULL, PAGE_READONLY, 0, 0, NULL));
+	if (hMap == NULL)
+		return false;
+
+	if ((data = static_cast<const BYTE*>(MapViewOfFile(hMap, FILE_MAP_READ, 0, 0, 0))) == nullptr)
+		return false;
+
+	// success - the view keeps the file open, so we can let the
+	// handles close
+	size = static_cast<long>(fileSize.QuadPart);
+	return true;
+}
+
+void MappedFile::Close()
+{
+	if (data != nullptr)
+	{
+		UnmapViewOfFile(data);
+		data = nullptr;
+		size = 0;
+	}
+}
+
 // -----------------------------------------------------------------------
 //
 // Get a module file name
@@ -9,6 +9,7 @@
 #include <varargs.h>
 #include <vector>
 #include <iterator>
+#include "Pointers.h"
 
 // -----------------------------------------------------------------------
 //
@@ -43,6 +44,16 @@ inline bool DirectoryExists(const TCHAR *filename)
 //
 bool TouchFile(const TCHAR *filename);
 
+// -----------------------------------------------------------------------
+//
+// Pre-read a file into the system file cache, so that a later open
+// doesn't have to wait for the disk.  This reads up to 'maxBytes' from
+// the start of the file and discards the data.  Returns false if the
+// file can't be opened.  This is meant for background threads, since
+// it blocks for the duration of the reads.
+//
+bool PrereadFile(const TCHAR *filename, UINT64 maxBytes);
+
 // -----------------------------------------------------------------------
 //
 // Create a subdirectory, including all intermediate directories
@@ -194,6 +205,38 @@ protected:
 	BYTE *p;
 };
 
+// Read-only memory-mapped file.  This maps the whole file into memory,
+// so that several readers can parse the same contents - a format sniffer
+// and a decoder, say - without each one opening and reading the file
+// separately.  The object is reference-counted, so that the view can be
+// handed off to a background thread, or kept by a decoder that reads
+// the file incrementally.
+//
+// The file handle is closed as soon as the view is mapped, but Windows
+// keeps the file open until the view is unmapped, so the file can't be
+// replaced in the meantime.  Holders should release the view when done.
+class MappedFile : public RefCounted
+{
+public:
+	MappedFile() { }
+	~MappedFile() { Close(); }
+
+	// Open and map a file.  Returns false if the file can't be opened,
+	// or is empty (which Windows won't map) or larger than 2GB.
+	bool Open(const TCHAR *filename);
+
+	// unmap the view
+	void Close();
+
+	// get the file contents
+	const BYTE *GetData() const { return data; }
+	long GetSize() const { return size; }
+
+protected:
+	const BYTE *data = nullptr;
+	long size = 0;
+};
+
 
 // -----------------------------------------------------------------------
 // 
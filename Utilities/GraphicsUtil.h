@@ -105,8 +105,57 @@ struct ImageFileDesc
 	} imageType;
 };
 bool GetImageFileInfo(const TCHAR *filename, ImageFileDesc &desc, bool readOrientation = false, bool readAPNG = false);
+
+// Get the image information for a file that the caller has already
+// loaded into memory.  This works like GetImageFileInfo(), including
+// the cache lookup, but parses the in-memory copy on a cache miss
+// rather than re-reading the file.
+bool GetImageFileInfo(const TCHAR *filename, const BYTE *imageData, long len,
+	ImageFileDesc &desc, bool readOrientation = false, bool readAPNG = false);
+
 bool GetImageBufInfo(const BYTE *imageData, long len, ImageFileDesc &desc, bool readOrientation = false, bool readAPNG = false);
 
+// Image file information cache.  GetImageFileInfo() keeps the result
+// for each file it parses, keyed by the file's path and modification
+// time, so that repeated queries for the same file (which happen every
+// time the wheel is rebuilt, for example) don't have to re-read the
+// file's headers.  The application can save the cache to disk at exit
+// and load it at startup, so that files from earlier sessions don't
+// have to be parsed again, either.  Each lookup checks the entry
+// against the file's current modification time, so a changed file is
+// re-parsed automatically.
+class ImageFileInfoCache
+{
+public:
+	// Load the cache from a file.  A missing or invalid file is
+	// ignored, since it just means that we start with an empty cache.
+	static void Load(const TCHAR *filename);
+
+	// Save the cache to a file, if it has changed since it was loaded
+	static void Save(const TCHAR *filename);
+
+	// Set the file time provider.  By default, we get each file's
+	// modification time from the file system.  The application can
+	// supply its own source, such as an in-memory directory index, to
+	// avoid even that I/O.  The function returns false if the file
+	// doesn't exist.
+	using FileTimeProvider = bool(*)(const TCHAR *filename, FILETIME &mtime);
+	static void SetFileTimeProvider(FileTimeProvider func) { fileTimeProvider = func; }
+
+	// Note that a file was renamed.  This moves the file's entry, if
+	// any, to the new name, so that the renamed file doesn't have to
+	// be parsed again.  Renaming preserves the modification time, so
+	// the entry stays valid for the file under its new name.
+	static void Rename(const TCHAR *oldName, const TCHAR *newName);
+
+protected:
+	friend bool GetImageFileInfo(const TCHAR *filename, const BYTE *imageData, long len,
+		ImageFileDesc &desc, bool readOrientation, bool readAPNG);
+
+	// current file time provider
+	static FileTimeProvider fileTimeProvider;
+};
+
 
 // Off-screen GDI drawing.  This sets up a memory context, creates a
 // 32-bit RGBA DIB (device-independent bitmap) of the given size, 
@@ -354,14 +403,18 @@ void HSLtoRGB(BYTE h, BYTE s, BYTE l, BYTE &r, BYTE &g, BYTE &b);
 // the X and Y radii of the effect.
 namespace Gdiplus
 {
+	// Both routines use SSE2 kernels where the target supports them.
+	// 'forceScalar' selects the plain C++ kernels instead, as a reference
+	// for testing the vector versions; the results are identical.
+	//
 	// Dilation with pre-set structuring elements.  This routine uses a
 	// naive algorithm with no SE decomposition, so it's quite slow for
 	// large radii.
 	enum DilationMode { DilationModeRect, DilationModeDisc, DilationModeDiamond };
-	Bitmap *DilationEffect(Bitmap *bitmap, UINT rx, UINT ry, DilationMode mode);
+	Bitmap *DilationEffect(Bitmap *bitmap, UINT rx, UINT ry, DilationMode mode, bool forceScalar = false);
 
 	// Dilation with a rectangular structuring element.  This is faster
 	// than the general DilationEffect() routine because it decomposes
 	// the SE into its base element.
-	Bitmap *DilationEffectRect(Bitmap *bitmap, UINT rx, UINT ry);
+	Bitmap *DilationEffectRect(Bitmap *bitmap, UINT rx, UINT ry, bool forceScalar = false);
 }
@@ -55,6 +55,19 @@ InputManager::InputManager()
 	// Raw input isn't yet initialized
 	rawInputHWnd = 0;
 
+	// Check for WOW64.  GetRawInputBuffer() returns RAWINPUT records with
+	// the 64-bit header layout in a WOW64 process, so we can't use input
+	// batching in that case.
+	BOOL wow64 = FALSE;
+	if (IsWow64Process(GetCurrentProcess(), &wow64) && wow64)
+		isWow64 = true;
+	rawInputBatching = !isWow64;
+
+	// Preallocate the raw input batch buffer.  This is enough for dozens
+	// of typical HID reports per drain pass, so we shouldn't need to grow
+	// it in practice.
+	rawInputBatchBuf.resize(2048);
+
 	// Command list.  This defines the set of commands that can be
 	// activated with keys and joystick buttons.  
 	//
@@ -120,7 +133,14 @@ InputManager::InputManager()
 			commands.back().buttons.emplace_back(Button::TypeKB, 0, c[i].defaultKey);
 	}
 
-	// load the scancode map from the system registry
+	// Set up the scancode map with each key mapped to itself, then load
+	// the remappings from the system registry
+	for (int row = 0; row < 3; ++row)
+	{
+		static const USHORT prefix[] = { 0x0000, 0xE000, 0xE100 };
+		for (int i = 0; i < 256; ++i)
+			scancodeMap[row][i] = static_cast<USHORT>(prefix[row] | i);
+	}
 	HKEYHolder hkey;
 	if (RegOpenKey(HKEY_LOCAL_MACHINE, _T("SYSTEM\\CurrentControlSet\\Control\\Keyboard Layout"), &hkey) == ERROR_SUCCESS)
 	{
@@ -147,7 +167,8 @@ InputManager::InputManager()
 				{
 					USHORT to = *(UINT16*)p++;
 					USHORT from = *(UINT16*)p++;
-					scancodeMap[from] = to;
+					if (int row = ScancodeMapRow(from); row >= 0)
+						scancodeMap[row][from & 0xFF] = to;
 				}
 			}
 		}
@@ -270,25 +291,82 @@ void InputManager::UninitRawInput()
 
 void InputManager::ProcessRawInput(UINT rawInputCode, HRAWINPUT hRawInput)
 {
-	// assume we'll apply the default processing
-	bool callDefProc = true;
+	// Read the data into our message buffer.  Try the buffer at its current
+	// size first, which usually suffices, since reports from a given device
+	// are all the same size.  If that fails, ask for the required size,
+	// grow the buffer, and try again.
+	UINT dwSize = static_cast<UINT>(rawInputMsgBuf.size() * sizeof(UINT64));
+	UINT result = dwSize == 0 ? (UINT)-1 : GetRawInputData(hRawInput, RID_INPUT, rawInputMsgBuf.data(), &dwSize, sizeof(RAWINPUTHEADER));
+	if (result == (UINT)-1)
+	{
+		// determine the size of the input buffer
+		dwSize = 0;
+		GetRawInputData(hRawInput, RID_INPUT, 0, &dwSize, sizeof(RAWINPUTHEADER));
+		if (dwSize == 0)
+			return;
+
+		// expand the buffer
+		rawInputMsgBuf.resize((dwSize + sizeof(UINT64) - 1) / sizeof(UINT64));
+
+		// Read the data.  If it doesn't come back at the expected size, 
+		// ignore the message.
+		if ((result = GetRawInputData(hRawInput, RID_INPUT, rawInputMsgBuf.data(), &dwSize, sizeof(RAWINPUTHEADER))) != dwSize)
+			return;
+	}
 
-	// determine the size of the input buffer
-	UINT dwSize;
-	GetRawInputData(hRawInput, RID_INPUT, 0, &dwSize, sizeof(RAWINPUTHEADER));
+	// process the message's record
+	ProcessRawInputRecord(rawInputCode, reinterpret_cast<RAWINPUT*>(rawInputMsgBuf.data()), result);
 
-	// allocate a buffer (and ignore the message if we don't save space)
-	std::unique_ptr<BYTE> buf(new (std::nothrow) BYTE[dwSize]);
-	if (buf.get() == 0)
-		return;
+	// process any further input that's already queued
+	if (rawInputBatching)
+		DrainRawInputBuffer();
+}
 
-	// Read the data.  If it doesn't come back at the expected size, 
-	// ignore the message.
-	if (GetRawInputData(hRawInput, RID_INPUT, buf.get(), &dwSize, sizeof(RAWINPUTHEADER)) != dwSize)
-		return;
+void InputManager::DrainRawInputBuffer()
+{
+	// Limit the number of passes, so that a device that's streaming
+	// reports continuously can't keep us here indefinitely.  Anything
+	// left over will come through as a new WM_INPUT message.
+	for (int pass = 0; pass < 8; ++pass)
+	{
+		// read as many queued records as will fit in the buffer
+		UINT cb = static_cast<UINT>(rawInputBatchBuf.size() * sizeof(UINT64));
+		UINT n = GetRawInputBuffer(reinterpret_cast<RAWINPUT*>(rawInputBatchBuf.data()), &cb, sizeof(RAWINPUTHEADER));
+
+		// stop when the queue is empty
+		if (n == 0)
+			return;
+
+		// On error, check if the buffer is too small for the next record.
+		// If so, 'cb' is the minimum size required, so grow the buffer and
+		// try again.
+		if (n == (UINT)-1)
+		{
+			UINT cbMin = 0;
+			if (GetRawInputBuffer(NULL, &cbMin, sizeof(RAWINPUTHEADER)) != 0 || cbMin == 0
+				|| cbMin <= rawInputBatchBuf.size() * sizeof(UINT64))
+				return;
+
+			rawInputBatchBuf.resize((cbMin * 8 + sizeof(UINT64) - 1) / sizeof(UINT64));
+			continue;
+		}
+
+		// process the records
+		RAWINPUT *raw = reinterpret_cast<RAWINPUT*>(rawInputBatchBuf.data());
+		for (UINT i = 0; i < n; ++i, raw = NEXTRAWINPUTBLOCK(raw))
+			ProcessRawInputRecord(static_cast<UINT>(raw->header.wParam), raw, raw->header.dwSize);
+	}
+}
+
+void InputManager::ProcessRawInputRecord(UINT rawInputCode, RAWINPUT *raw, UINT dwSize)
+{
+	// note the arrival time, for latency measurements
+	LARGE_INTEGER now;
+	QueryPerformanceCounter(&now);
+	rawInputEventTime = now.QuadPart;
+	if (raw->header.dwType == RIM_TYPEKEYBOARD)
+		lastKeyboardInputTime = now.QuadPart;
 
-	// get it as a RAWINPUT struct
-	RAWINPUT *raw = (RAWINPUT *)buf.get();
 
 	// if it's a HID input, send it to the joystick manager
 	if (raw->header.dwType == RIM_TYPEHID)
@@ -362,6 +440,9 @@ void InputManager::ProcessRawInput(UINT rawInputCode, HRAWINPUT hRawInput)
 			break;
 		}
 	}
+
+	// we're no longer processing a raw input record
+	rawInputEventTime = 0;
 }
 
 void InputManager::DiscoverRawInputDevices()
@@ -397,6 +478,22 @@ void InputManager::ProcessDeviceChange(USHORT what, HANDLE hDevice)
 	switch (what)
 	{
 	case GIDC_ARRIVAL:
+		// If we already know about the device, there's nothing to do.
+		// Windows sends arrival notifications at startup for devices
+		// that we've already found via discovery.
+		if (JoystickManager::GetInstance()->IsDevicePresent(hDevice))
+			break;
+
+		// Probe the device on the joystick manager's background thread.
+		// Querying the device strings and DirectInput GUID can take a
+		// long time on some USB hubs, so we don't want to do it here on
+		// the UI thread.  The thread posts GIDC_PROBED back to us when
+		// the device is ready.  If the thread isn't available, add the
+		// device inline.
+		if (rawInputHWnd != NULL
+			&& JoystickManager::GetInstance()->QueueDeviceProbe(hDevice, rawInputHWnd, WM_INPUT_DEVICE_CHANGE, GIDC_PROBED))
+			break;
+
 		// make sure that the DirectInput Instance GUID cache is up to date
 		JoystickManager::GetInstance()->UpdateInstanceGuidCache();
 
@@ -404,6 +501,11 @@ void InputManager::ProcessDeviceChange(USHORT what, HANDLE hDevice)
 		AddRawInputDevice(hDevice);
 		break;
 
+	case GIDC_PROBED:
+		// the probe thread has finished with one or more new devices
+		JoystickManager::GetInstance()->AddProbedDevices();
+		break;
+
 	case GIDC_REMOVAL:
 		// remove the device
 		RemoveRawInputDevice(hDevice);
@@ -430,8 +532,7 @@ void InputManager::AddRawInputDevice(HANDLE hDevice)
 			//   Usage Page 0x01, Usage 0x04 => Joystick
 			//   Usage Page 0x01, Usage 0x05 => Game Pad
 			//
-			if (info.hid.usUsagePage == 1 
-				&& (info.hid.usUsage == 4 || info.hid.usUsage == 5))
+			if (JoystickManager::IsJoystickDevice(info))
 			{
 				// It's a joystick or gamepad.  Add it through the joystick
 				// manager.
@@ -545,9 +646,9 @@ USHORT InputManager::TranslateScanCode(const RAWINPUT *raw) const
 	else if ((raw->data.keyboard.Flags & RI_KEY_E1) != 0)
 		scanCode |= 0xE100;
 
-	// if there's a key mapping in the system scancode map, apply it
-	if (auto it = scancodeMap.find(scanCode); it != scancodeMap.end())
-		scanCode = it->second;
+	// apply the system scancode map
+	if (int row = ScancodeMapRow(scanCode); row >= 0)
+		scanCode = scancodeMap[row][scanCode & 0xFF];
 
 	// return the result
 	return scanCode;
@@ -58,12 +58,45 @@ public:
 	// is the LPARAM.)  The caller must always call the
 	// DefWindowProc after calling this, since that performs
 	// required cleanup on the input buffer data.
+	//
+	// If batching is enabled, this also drains any further raw
+	// input that's already queued, via GetRawInputBuffer(), and
+	// processes it in the same pass.  High-rate HID devices
+	// (accelerometers and plungers, for example) can send reports
+	// faster than we'd otherwise process WM_INPUT messages, so
+	// this saves a window message round trip for each report.
 	void ProcessRawInput(UINT rimType, HRAWINPUT hRawInput);
 
+	// Enable/disable raw input batching.  Batching is enabled by
+	// default, except in 32-bit builds running under WOW64, where
+	// the buffered RAWINPUT layout doesn't match the 32-bit struct
+	// definitions; it can't be enabled in that configuration.
+	void EnableRawInputBatching(bool enable) { rawInputBatching = enable && !isWow64; }
+
+	// Input event timestamps, as QueryPerformanceCounter() ticks, for
+	// latency measurement.  GetRawInputEventTime() returns the arrival
+	// time of the raw input record currently being processed, so an event
+	// handler called synchronously from raw input processing (such as a
+	// joystick button handler) can find out when its event arrived; it
+	// returns 0 outside of raw input processing.  The last keyboard
+	// input time is the arrival time of the most recent raw keyboard
+	// record, which precedes the corresponding WM_KEYDOWN message.
+	INT64 GetRawInputEventTime() const { return rawInputEventTime; }
+	INT64 GetLastKeyboardInputTime() const { return lastKeyboardInputTime; }
+
 	// Process a device change notification.  The main window
 	// calls this on receiving a WM_INPUT_DEVICE_CHANGE message.
 	void ProcessDeviceChange(USHORT what, HANDLE hDevice);
 
+	// Private WM_INPUT_DEVICE_CHANGE code for a completed device probe.
+	// We probe newly attached joysticks on a background thread, which
+	// posts WM_INPUT_DEVICE_CHANGE back to the raw input window with
+	// this code when the device is ready.  That comes back to us via
+	// the window's normal ProcessDeviceChange() call, so the window
+	// needn't do anything special with it.  Windows only defines codes
+	// 1 (GIDC_ARRIVAL) and 2 (GIDC_REMOVAL).
+	static const USHORT GIDC_PROBED = 0x8000;
+
 	// Raw input subscriber.  A class that wants to process
 	// raw input events can implement this interface and then
 	// subscribe for events as needed.
@@ -271,6 +304,31 @@ protected:
 	// code.
 	void RemoveRawInputDevice(HANDLE hRawInputDevice);
 
+	// Process one raw input record.  ProcessRawInput() calls this
+	// for the WM_INPUT message data, and for each record drained
+	// from the raw input buffer.
+	void ProcessRawInputRecord(UINT rawInputCode, RAWINPUT *raw, UINT dwSize);
+
+	// Drain queued raw input via GetRawInputBuffer()
+	void DrainRawInputBuffer();
+
+	// Raw input buffers.  We keep these across calls so that we
+	// don't allocate memory on every input event.  These are
+	// vectors of UINT64 rather than BYTE to ensure the 8-byte
+	// alignment that GetRawInputBuffer() requires.
+	std::vector<UINT64> rawInputMsgBuf;
+	std::vector<UINT64> rawInputBatchBuf;
+
+	// is raw input batching enabled?
+	bool rawInputBatching = true;
+
+	// input event timestamps
+	INT64 rawInputEventTime = 0;
+	INT64 lastKeyboardInputTime = 0;
+
+	// are we a 32-bit process running on 64-bit Windows?
+	bool isWow64 = false;
+
 	// Command list
 	std::vector<Command> commands;
 
@@ -282,13 +340,28 @@ protected:
 
 	// Scan code map from the system registry.  This contains the data from
 	// HKEY_LOCAL_MACHINE\SYSTEM\CurrentControlSet\Control\Keyboard Layout\Scancode Map,
-	// arranged into a map keyed by hardware scan code and yielding the soft
-	// scan code that Windows will use for the key.
+	// arranged into a dense table indexed by hardware scan code and yielding
+	// the soft scan code that Windows will use for the key.  There's a row
+	// of 256 entries for each prefix (none, E0, E1), so that translating a
+	// key is a single array index.  Keys without mappings map to themselves.
 	//
 	// We need this to properly translate raw input keyboard events, because
 	// the raw input data reports the original hardware scan code, and we
 	// want to respect the user's soft key mappings.
-	std::unordered_map<USHORT, USHORT> scancodeMap;
+	USHORT scancodeMap[3][256];
+
+	// get the scancodeMap row for an E0/E1 prefix encoded in the high byte
+	// of a scan code, or -1 if it's not a valid prefix
+	static int ScancodeMapRow(USHORT scanCode)
+	{
+		switch (scanCode >> 8)
+		{
+		case 0x00: return 0;
+		case 0xE0: return 1;
+		case 0xE1: return 2;
+		default:   return -1;
+		}
+	}
 
 	// Map of keys that are currently down.  We use this in the raw input
 	// processor to determine if a "make" code is an auto-repeat key.  This
@@ -20,5 +20,5 @@ public:
 	void StoreConfig();
 
 	// On config file reloads, reload our configuration
-	virtual void OnConfigReload() override { LoadConfig(); }
+	virtual void OnConfigReload(const ConfigManager::ChangeSet &) override { LoadConfig(); }
 };
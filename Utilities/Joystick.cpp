@@ -5,7 +5,9 @@
 #include <Setupapi.h>
 #include <Hidsdi.h>
 #include <dinput.h>
+#include <algorithm>
 #include "Pointers.h"
+#include "WinUtil.h"
 #include "Joystick.h"
 
 #pragma comment(lib, "hid.lib")
@@ -15,6 +17,82 @@
 JoystickManager *JoystickManager::inst = 0;
 const TCHAR *JoystickManager::cv_RememberJSButtonSource = _T("RememberJSButtonSource");
 const GUID JoystickManager::emptyGuid = { 0x00000000, 0x0000, 0x0000, { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 } };
+std::list<JoystickManager::ProbeRequest> JoystickManager::probeQueue;
+std::list<std::unique_ptr<JoystickManager::DeviceProbe>> JoystickManager::probeDone;
+HandleHolder JoystickManager::hProbeThread;
+HandleHolder JoystickManager::hProbeEvent;
+bool JoystickManager::probeStarted = false;
+bool JoystickManager::probeShuttingDown = false;
+CriticalSection JoystickManager::probeLock;
+
+// Device descriptor cache storage
+struct JoystickDescriptorCacheData
+{
+	struct Entry
+	{
+		int vendorID;
+		int productID;
+		TSTRING prodName;
+		TSTRING serial;
+		GUID guid;
+	};
+
+	// entries, keyed by lower-case device path
+	static std::unordered_map<TSTRING, Entry> entries;
+
+	// has the cache changed since it was loaded?
+	static bool dirty;
+
+	// lock, since devices are probed on a background thread
+	static CriticalSection lock;
+};
+
+std::unordered_map<TSTRING, JoystickDescriptorCacheData::Entry> JoystickDescriptorCacheData::entries;
+bool JoystickDescriptorCacheData::dirty = false;
+CriticalSection JoystickDescriptorCacheData::lock;
+
+// Instance GUID snapshot storage
+struct JoystickInstanceGuidSnapshot
+{
+	// HID device handles at the time of the snapshot, sorted
+	static std::vector<HANDLE> devices;
+
+	// Instance GUIDs and lower-case device paths
+	static std::vector<std::pair<GUID, TSTRING>> guids;
+
+	// is the snapshot valid?
+	static bool valid;
+
+	// lock, since the snapshot can be taken on a background thread
+	static CriticalSection lock;
+};
+
+std::vector<HANDLE> JoystickInstanceGuidSnapshot::devices;
+std::vector<std::pair<GUID, TSTRING>> JoystickInstanceGuidSnapshot::guids;
+bool JoystickInstanceGuidSnapshot::valid = false;
+CriticalSection JoystickInstanceGuidSnapshot::lock;
+
+// Saved cache file format.  The file starts with a header, followed by
+// the entries.  Each entry is a fixed-size record, followed by the
+// device path, product name, and serial number, which are stored as
+// TCHARs without null terminators.
+struct JoystickDescriptorCacheFileHeader
+{
+	char signature[16];
+	UINT32 charSize;
+	UINT32 nEntries;
+};
+static const char joystickDescriptorCacheSignature[16] = "PBYJoystick/1";
+
+struct JoystickDescriptorCacheFileRecord
+{
+	INT32 vendorID;
+	INT32 productID;
+	GUID guid;
+	UINT32 pathLength;
+	UINT32 prodNameLength;
+	UINT32 serialLength;
+};
 
 bool JoystickManager::Init()
 {
@@ -69,6 +147,8 @@ JoystickManager::JoystickManager()
 
 JoystickManager::~JoystickManager()
 {
+	// stop the probe thread
+	ShutdownProbeThread();
 }
 
 void JoystickManager::AddDevice(HANDLE hDevice, const RID_DEVICE_INFO_HID *rid)
@@ -77,9 +157,27 @@ void JoystickManager::AddDevice(HANDLE hDevice, const RID_DEVICE_INFO_HID *rid)
 	// Windows can call this redundantly by sending device change
 	// notifications after startup for devices we've already found
 	// via discovery.
-	if (physJoysticks.find(hDevice) != physJoysticks.end())
+	if (IsDevicePresent(hDevice))
 		return;
 
+	// probe the device inline, looking up the GUID in our mapping table
+	DeviceProbe probe;
+	ProbeDevice(hDevice, rid, probe, [this](const TSTRING &pathKey)
+	{
+		auto it = pathToGuid.find(pathKey);
+		return it != pathToGuid.end() ? it->second : emptyGuid;
+	});
+
+	// add it
+	AddDevice(probe);
+}
+
+void JoystickManager::ProbeDevice(HANDLE hDevice, const RID_DEVICE_INFO_HID *rid,
+	DeviceProbe &probe, std::function<GUID(const TSTRING &pathKey)> lookupGuid)
+{
+	probe.hDevice = hDevice;
+	probe.hid = *rid;
+
 	// The Raw Input API doesn't provide a friendly name for the
 	// device, but we can get the device's USB product string from
 	// the HidD API.  All we need for that is a HidD handle for
@@ -90,61 +188,124 @@ void JoystickManager::AddDevice(HANDLE hDevice, const RID_DEVICE_INFO_HID *rid)
 	// the HidD handle.
 	TCHAR devname[512];
 	UINT sz = countof(devname);
-	GetRawInputDeviceInfo(hDevice, RIDI_DEVICENAME, &devname, &sz);
-	HANDLE fp = CreateFile(
-		devname, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE,
-		0, OPEN_EXISTING, 0, 0);
-	WCHAR prodname[128] = L"";
-	WCHAR serial[128] = L"";
-	if (fp != INVALID_HANDLE_VALUE)
-	{
-		// query the product name
-		if (!HidD_GetProductString(fp, prodname, countof(prodname)))
-			prodname[0] = 0;
-
-		// query the serial number string
-		if (!HidD_GetSerialNumberString(fp, serial, countof(serial)))
-			serial[0] = 0;
-
-		// done with the HidD device object handle
-		CloseHandle(fp);
+	if (GetRawInputDeviceInfo(hDevice, RIDI_DEVICENAME, &devname, &sz) == (UINT)-1)
+		devname[0] = 0;
+	probe.path = devname;
+	TSTRING pathKey = devname;
+	std::transform(pathKey.begin(), pathKey.end(), pathKey.begin(), ::_totlower);
+
+	// retrieve the preparsed data
+	UINT ppdSize = 0;
+	GetRawInputDeviceInfo(hDevice, RIDI_PREPARSEDDATA, 0, &ppdSize);
+	if (ppdSize != 0)
+	{
+		probe.ppData.reset(new (std::nothrow) BYTE[ppdSize]);
+		UINT ppdActual = ppdSize;
+		if (probe.ppData.get() != nullptr
+			&& GetRawInputDeviceInfo(hDevice, RIDI_PREPARSEDDATA, probe.ppData.get(), &ppdActual) != ppdSize)
+			probe.ppData.reset();
+	}
+
+	// check the descriptor cache for the strings and GUID
+	bool cached = false;
+	{
+		CriticalSectionLocker locker(JoystickDescriptorCacheData::lock);
+		auto &entries = JoystickDescriptorCacheData::entries;
+		if (auto it = entries.find(pathKey); it != entries.end()
+			&& it->second.vendorID == static_cast<int>(rid->dwVendorId)
+			&& it->second.productID == static_cast<int>(rid->dwProductId))
+		{
+			probe.prodName = it->second.prodName;
+			probe.serial = it->second.serial;
+			probe.guid = it->second.guid;
+			cached = true;
+		}
 	}
 
-	// If we weren't able to get a product name out of HidD, 
-	// synthesize a semi-friendly name from the VID/PID codes.
-	// It's rare to have more than one device of the same type 
-	// in a system, and most devices have hard-coded VID/PID 
-	// codes, so this should give us a unique name and stable
-	// name that we can use to correlate config records to the
-	// same device in a future session even if the "device name"
-	// path changes (due to reinstallation, e.g.).
-	if (prodname[0] == 0)
-	{
-		swprintf_s(prodname, L"Joystick %04lx:%04lx",
-			rid->dwVendorId, rid->dwProductId);
+	// if we didn't find the strings in the cache, ask the device
+	bool gotStrings = cached;
+	if (!cached)
+	{
+		HANDLE fp = CreateFile(
+			devname, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE,
+			0, OPEN_EXISTING, 0, 0);
+		WCHAR prodname[128] = L"";
+		WCHAR serial[128] = L"";
+		if (fp != INVALID_HANDLE_VALUE)
+		{
+			// query the product name
+			if (!HidD_GetProductString(fp, prodname, countof(prodname)))
+				prodname[0] = 0;
+
+			// query the serial number string
+			if (!HidD_GetSerialNumberString(fp, serial, countof(serial)))
+				serial[0] = 0;
+
+			// done with the HidD device object handle
+			CloseHandle(fp);
+			gotStrings = true;
+		}
+
+		// If we weren't able to get a product name out of HidD, 
+		// synthesize a semi-friendly name from the VID/PID codes.
+		// It's rare to have more than one device of the same type 
+		// in a system, and most devices have hard-coded VID/PID 
+		// codes, so this should give us a unique name and stable
+		// name that we can use to correlate config records to the
+		// same device in a future session even if the "device name"
+		// path changes (due to reinstallation, e.g.).
+		if (prodname[0] == 0)
+		{
+			swprintf_s(prodname, L"Joystick %04lx:%04lx",
+				rid->dwVendorId, rid->dwProductId);
+		}
+
+		// If we didn't get a serial, synthesize a placeholder serial number
+		if (serial[0] == 0)
+			wcscpy_s(serial, L"00000000");
+
+		probe.prodName = prodname;
+		probe.serial = serial;
 	}
 
-	// If we didn't get a serial, synthesize a placeholder serial number
-	if (serial[0] == 0)
-		wcscpy_s(serial, L"00000000");
+	// if we don't have a GUID yet, look it up
+	bool newGuid = false;
+	if (probe.guid == emptyGuid)
+		newGuid = (probe.guid = lookupGuid(pathKey)) != emptyGuid;
+
+	// Update the cache with anything new.  Don't cache the placeholder
+	// strings if we couldn't open the device, since the failure might
+	// be temporary.
+	if (gotStrings && (!cached || newGuid) && pathKey.length() != 0)
+	{
+		CriticalSectionLocker locker(JoystickDescriptorCacheData::lock);
+		auto &e = JoystickDescriptorCacheData::entries[pathKey];
+		e.vendorID = rid->dwVendorId;
+		e.productID = rid->dwProductId;
+		e.prodName = probe.prodName;
+		e.serial = probe.serial;
+		e.guid = probe.guid;
+		JoystickDescriptorCacheData::dirty = true;
+	}
+}
+
+void JoystickManager::AddDevice(DeviceProbe &probe)
+{
+	// if the handle is already in our joystick list, do nothing
+	if (IsDevicePresent(probe.hDevice))
+		return;
 
 	// Note the number of logical joysticks currently in our list.
 	// This will let us infer whether or not we had to add a new
 	// logical joystick for this physical joystick.
 	size_t nLogJs = GetLogicalJoystickCount();
 
-	// look up the GUID by device name
-	GUID guid = emptyGuid;
-	TSTRING pathKey = devname;
-	std::transform(pathKey.begin(), pathKey.end(), pathKey.begin(), ::_totlower);
-	if (auto it = pathToGuid.find(pathKey); it != pathToGuid.end())
-		guid = it->second;
-
 	// add it to the list
 	auto it = physJoysticks.emplace(
 		std::piecewise_construct,
-		std::forward_as_tuple(hDevice),
-		std::forward_as_tuple(rid->dwVendorId, rid->dwProductId, prodname, guid, hDevice, devname, serial));
+		std::forward_as_tuple(probe.hDevice),
+		std::forward_as_tuple(probe.hid.dwVendorId, probe.hid.dwProductId, probe.prodName.c_str(), probe.guid,
+			probe.hDevice, probe.path.c_str(), probe.serial.c_str(), probe.ppData.release()));
 
 	// retrieve the new physical joystick from the result
 	PhysicalJoystick *js = &it.first->second;
@@ -175,6 +336,239 @@ void JoystickManager::RemoveDevice(HANDLE hDevice)
 	}
 }
 
+bool JoystickManager::QueueDeviceProbe(HANDLE hDevice, HWND hwndNotify, UINT msg, WPARAM wParam)
+{
+	CriticalSectionLocker locker(probeLock);
+
+	// don't take new work once we've started shutting down
+	if (probeShuttingDown)
+		return false;
+
+	// start the thread on the first request
+	if (!probeStarted)
+	{
+		// only try once
+		probeStarted = true;
+
+		// create the work event, and launch the thread
+		DWORD tid;
+		if ((hProbeEvent = CreateEvent(NULL, FALSE, FALSE, NULL)) != NULL)
+			hProbeThread = CreateThread(NULL, 0, &ProbeThreadMain, nullptr, 0, &tid);
+	}
+
+	// if the thread isn't running, the caller will have to do the work
+	if (hProbeThread == NULL)
+		return false;
+
+	// queue the request and wake the thread
+	probeQueue.push_back({ hDevice, hwndNotify, msg, wParam });
+	SetEvent(hProbeEvent);
+	return true;
+}
+
+void JoystickManager::AddProbedDevices()
+{
+	for (;;)
+	{
+		// take the next completed probe
+		std::unique_ptr<DeviceProbe> probe;
+		{
+			CriticalSectionLocker locker(probeLock);
+			if (probeDone.size() == 0)
+				break;
+
+			probe.reset(probeDone.front().release());
+			probeDone.pop_front();
+		}
+
+		// Make sure the device is still attached.  If it was removed
+		// while the probe thread was working on it, we've already seen
+		// the removal notification, so we'd never remove it otherwise.
+		RID_DEVICE_INFO info;
+		UINT sz = info.cbSize = sizeof(info);
+		if (GetRawInputDeviceInfo(probe->hDevice, RIDI_DEVICEINFO, &info, &sz) != (UINT)-1)
+			AddDevice(*probe);
+	}
+}
+
+void JoystickManager::ShutdownProbeThread()
+{
+	// tell the thread to exit once the current probe is done, and wait for it
+	{
+		CriticalSectionLocker locker(probeLock);
+		probeShuttingDown = true;
+		probeQueue.clear();
+		if (hProbeEvent != NULL)
+			SetEvent(hProbeEvent);
+	}
+	if (hProbeThread != NULL)
+		WaitForSingleObject(hProbeThread, 5000);
+}
+
+DWORD WINAPI JoystickManager::ProbeThreadMain(LPVOID)
+{
+	// Our own DirectInput interface, for GUID lookups.  We create this
+	// on the first cache miss, and keep it for the life of the thread.
+	RefPtr<IDirectInput8> idi8;
+	auto LookupGuid = [&idi8](const TSTRING &pathKey)
+	{
+		GUID guid = emptyGuid;
+		if (idi8 == nullptr
+			&& FAILED(DirectInput8Create(G_hInstance, DIRECTINPUT_VERSION, IID_IDirectInput8, reinterpret_cast<void**>(&idi8), NULL)))
+			idi8 = nullptr;
+		if (idi8 != nullptr)
+		{
+			EnumInstanceGuids(idi8, [&guid, &pathKey](const GUID &g, const TCHAR *path) {
+				if (pathKey == path)
+					guid = g;
+			});
+		}
+		return guid;
+	};
+
+	for (;;)
+	{
+		// wait for work
+		WaitForSingleObject(hProbeEvent, INFINITE);
+
+		// probe the queued devices
+		for (;;)
+		{
+			ProbeRequest req;
+			{
+				CriticalSectionLocker locker(probeLock);
+				if (probeShuttingDown)
+					return 0;
+				if (probeQueue.size() == 0)
+					break;
+
+				req = probeQueue.front();
+				probeQueue.pop_front();
+			}
+
+			// retrieve the device information, and skip anything that's
+			// not a joystick
+			RID_DEVICE_INFO info;
+			UINT sz = info.cbSize = sizeof(info);
+			if (GetRawInputDeviceInfo(req.hDevice, RIDI_DEVICEINFO, &info, &sz) == (UINT)-1
+				|| !IsJoystickDevice(info))
+				continue;
+
+			// probe it
+			std::unique_ptr<DeviceProbe> probe(new DeviceProbe());
+			ProbeDevice(req.hDevice, &info.hid, *probe, LookupGuid);
+
+			// hand it to the UI thread
+			CriticalSectionLocker locker(probeLock);
+			if (!probeShuttingDown)
+			{
+				probeDone.emplace_back(probe.release());
+				PostMessage(req.hwndNotify, req.msg, req.wParam, reinterpret_cast<LPARAM>(req.hDevice));
+			}
+		}
+	}
+}
+
+void JoystickManager::LoadDescriptorCache(const TCHAR *filename)
+{
+	FILE *fp;
+	if (_tfopen_s(&fp, filename, _T("rb")) != 0)
+		return;
+
+	// check the header
+	JoystickDescriptorCacheFileHeader hdr;
+	if (fread(&hdr, sizeof(hdr), 1, fp) == 1
+		&& memcmp(hdr.signature, joystickDescriptorCacheSignature, sizeof(hdr.signature)) == 0
+		&& hdr.charSize == sizeof(TCHAR))
+	{
+		CriticalSectionLocker locker(JoystickDescriptorCacheData::lock);
+
+		// read a string
+		auto ReadString = [fp](TSTRING &s, UINT32 len)
+		{
+			s.assign(len, 0);
+			return len == 0 || fread(&s[0], sizeof(TCHAR), len, fp) == len;
+		};
+
+		// read the entries
+		for (UINT32 i = 0; i < hdr.nEntries; ++i)
+		{
+			// read the record
+			JoystickDescriptorCacheFileRecord rec;
+			if (fread(&rec, sizeof(rec), 1, fp) != 1 || rec.pathLength == 0 || rec.pathLength >= 32768
+				|| rec.prodNameLength >= 32768 || rec.serialLength >= 32768)
+				break;
+
+			// read the strings
+			TSTRING path;
+			JoystickDescriptorCacheData::Entry e;
+			if (!ReadString(path, rec.pathLength) || !ReadString(e.prodName, rec.prodNameLength) || !ReadString(e.serial, rec.serialLength))
+				break;
+
+			// add the entry, keeping any entry already made in this session
+			e.vendorID = rec.vendorID;
+			e.productID = rec.productID;
+			e.guid = rec.guid;
+			JoystickDescriptorCacheData::entries.emplace(path, e);
+		}
+	}
+
+	fclose(fp);
+}
+
+void JoystickManager::SaveDescriptorCache(const TCHAR *filename)
+{
+	CriticalSectionLocker locker(JoystickDescriptorCacheData::lock);
+
+	// if nothing has changed, there's nothing to save
+	if (!JoystickDescriptorCacheData::dirty)
+		return;
+
+	// Write to a temporary file, then move it into place, so that a
+	// crash while writing can't leave a truncated cache file behind.
+	TSTRING tmpFile = TSTRING(filename) + _T(".tmp");
+	FILE *fp;
+	if (_tfopen_s(&fp, tmpFile.c_str(), _T("wb")) != 0)
+		return;
+
+	// write the header
+	auto &entries = JoystickDescriptorCacheData::entries;
+	JoystickDescriptorCacheFileHeader hdr;
+	memcpy(hdr.signature, joystickDescriptorCacheSignature, sizeof(hdr.signature));
+	hdr.charSize = sizeof(TCHAR);
+	hdr.nEntries = static_cast<UINT32>(entries.size());
+	bool ok = fwrite(&hdr, sizeof(hdr), 1, fp) == 1;
+
+	// write a string
+	auto WriteString = [fp](const TSTRING &s) {
+		return s.length() == 0 || fwrite(s.c_str(), sizeof(TCHAR), s.length(), fp) == s.length(); };
+
+	// write the entries
+	for (auto &p : entries)
+	{
+		if (!ok)
+			break;
+
+		auto &e = p.second;
+		JoystickDescriptorCacheFileRecord rec;
+		ZeroMemory(&rec, sizeof(rec));
+		rec.vendorID = e.vendorID;
+		rec.productID = e.productID;
+		rec.guid = e.guid;
+		rec.pathLength = static_cast<UINT32>(p.first.length());
+		rec.prodNameLength = static_cast<UINT32>(e.prodName.length());
+		rec.serialLength = static_cast<UINT32>(e.serial.length());
+		ok = fwrite(&rec, sizeof(rec), 1, fp) == 1
+			&& WriteString(p.first) && WriteString(e.prodName) && WriteString(e.serial);
+	}
+
+	// close the file, and move it into place if we wrote it successfully
+	if (fclose(fp) == 0 && ok && MoveFileEx(tmpFile.c_str(), filename, MOVEFILE_REPLACE_EXISTING))
+		JoystickDescriptorCacheData::dirty = false;
+	else
+		DeleteFile(tmpFile.c_str());
+}
+
 const TCHAR *JoystickManager::Joystick::valNames[] = {
 	_T("X"),
 	_T("Y"),
@@ -208,31 +602,20 @@ JoystickManager::Joystick::Joystick(int vendorID, int productID, const TCHAR *pr
 
 JoystickManager::PhysicalJoystick::PhysicalJoystick(
 	int vendorID, int productID, const TCHAR *prodName, const GUID &instanceGuid,
-	HANDLE hRawDevice, const TCHAR *path, const TCHAR *serial)
+	HANDLE hRawDevice, const TCHAR *path, const TCHAR *serial, BYTE *preparsedData)
 	: Joystick(vendorID, productID, prodName, instanceGuid),
 	hRawDevice(hRawDevice),
 	path(path),
-	serial(serial)
+	serial(serial),
+	ppData(preparsedData)
 {
 	// assign our logical joystick
 	logjs = JoystickManager::GetInstance()->BindPhysicalToLogicalJoystick(this);
 
-	// retrieve the preparsed data size
-	UINT ppdSize;
-	GetRawInputDeviceInfo(hRawDevice, RIDI_PREPARSEDDATA, 0, &ppdSize);
-	if (ppdSize == 0)
-		return;
-
-	// allocate space for the preparsed data
-	ppData.reset(new (std::nothrow) BYTE[ppdSize]);
+	// we can't do anything more without the preparsed data
 	if (ppData.get() == 0)
 		return;
 
-	// retrieve the preparsed data
-	UINT ppdActual = ppdSize;
-	if (GetRawInputDeviceInfo(hRawDevice, RIDI_PREPARSEDDATA, ppData.get(), &ppdActual) != ppdSize)
-		return;
-
 	// retrieve the HID capabilities
 	PHIDP_PREPARSED_DATA ppd = (PHIDP_PREPARSED_DATA)ppData.get();
 	HIDP_CAPS caps;
@@ -391,7 +774,7 @@ JoystickManager::PhysicalJoystick::PhysicalJoystick(
 			if (usage >= iValFirst && usage <= iValLast)
 			{
 				// add the entry to the report group
-				brg->usageVal.emplace_back(v->UsagePage, usage);
+				brg->usageVal.emplace_back(v->UsagePage, usage, v->BitSize);
 
 				// mark it as present
 				int index = static_cast<int>(usage - iValFirst);
@@ -405,6 +788,68 @@ JoystickManager::PhysicalJoystick::PhysicalJoystick(
 			}
 		}
 	}
+
+	// figure the report byte locations of the buttons and values
+	BuildReportByteMap(ppd, caps.InputReportByteLength);
+}
+
+void JoystickManager::PhysicalJoystick::BuildReportByteMap(PHIDP_PREPARSED_DATA ppd, USHORT reportLen)
+{
+	// The HID parser doesn't expose the bit positions of the report
+	// fields directly, but we can infer them by encoding each field into
+	// a blank report and seeing which bytes change.
+	if (reportLen <= 1)
+		return;
+	std::vector<BYTE> buf(reportLen);
+
+	// find the range of non-zero bytes after the report ID prefix
+	auto FindRange = [&buf, reportLen](int &first, int &last)
+	{
+		first = INT_MAX;
+		last = -1;
+		for (int i = 1; i < reportLen; ++i)
+		{
+			if (buf[i] != 0)
+			{
+				first = min(first, i);
+				last = i;
+			}
+		}
+
+		// if we didn't find anything, cover the whole report to be safe
+		if (last < 0)
+			first = 0, last = INT_MAX;
+	};
+
+	for (auto &brg : buttonReportGroups)
+	{
+		// Encode every button.  Try each button number individually,
+		// since the group's buttons can come from multiple button caps
+		// entries, and the parser rejects the whole list if any one of
+		// the buttons isn't part of this report.
+		if (brg.nButtons != 0)
+		{
+			memset(buf.data(), 0, reportLen);
+			buf[0] = brg.reportId;
+			for (int button = 0; button < nButtonStates; ++button)
+			{
+				USAGE usage = static_cast<USAGE>(button);
+				ULONG n = 1;
+				HidP_SetUsages(HidP_Input, brg.usagePage, 0, &usage, &n, ppd, (PCHAR)buf.data(), reportLen);
+			}
+			FindRange(brg.buttonFirstByte, brg.buttonLastByte);
+		}
+
+		// encode each value with all bits set
+		for (auto &v : brg.usageVal)
+		{
+			memset(buf.data(), 0, reportLen);
+			buf[0] = brg.reportId;
+			ULONG allOnes = v.bitSize >= 32 ? 0xFFFFFFFF : (1UL << v.bitSize) - 1;
+			if (HidP_SetUsageValue(HidP_Input, v.usagePage, 0, v.usage, allOnes, ppd, (PCHAR)buf.data(), reportLen) == HIDP_STATUS_SUCCESS)
+				FindRange(v.firstByte, v.lastByte);
+		}
+	}
 }
 
 JoystickManager::PhysicalJoystick::ButtonReportGroup*
@@ -468,6 +913,32 @@ void JoystickManager::PhysicalJoystick::ProcessRawInput(UINT rawInputCode, RAWIN
 				// get the direct pointer
 				ButtonReportGroup *brg = &*brgit;
 
+				// Compare the report to the last one for this report ID,
+				// to find the range of bytes that changed.  If the report
+				// is identical, nothing can have changed, so there's no
+				// need to decode it at all.
+				int diffFirst = 0, diffLast = INT_MAX;
+				auto &lastReport = brg->lastReport;
+				if (lastReport.size() == dwSizeHid)
+				{
+					if (memcmp(lastReport.data(), pRawData, dwSizeHid) == 0)
+						break;
+
+					diffFirst = 0;
+					while (lastReport[diffFirst] == pRawData[diffFirst])
+						++diffFirst;
+					diffLast = static_cast<int>(dwSizeHid) - 1;
+					while (lastReport[diffLast] == pRawData[diffLast])
+						--diffLast;
+				}
+
+				// remember this report for next time
+				lastReport.assign(pRawData, pRawData + dwSizeHid);
+
+				// does a byte range overlap the changed bytes?
+				auto IsChanged = [diffFirst, diffLast](int first, int last) {
+					return first <= diffLast && last >= diffFirst; };
+
 				// Figure the NEXT and LAST on list indices
 				int lastOnIndex = brg->lastOnIndex;
 				int nextOnIndex = lastOnIndex ^ 1;
@@ -484,9 +955,13 @@ void JoystickManager::PhysicalJoystick::ProcessRawInput(UINT rawInputCode, RAWIN
 				// in the report.  Retrieve the report into the NEXT OnList
 				// in the button group object.  The OnList has nButtonStates
 				// elements allocated.
+				//
+				// Skip this if none of the bytes containing button bits
+				// changed since the last report.
 				ULONG usageLen = brg->nButtons;
-				if (HidP_GetUsages(HidP_Input, brg->usagePage, 0, nextOn, &usageLen, pp,
-					(PCHAR)raw->data.hid.bRawData, raw->data.hid.dwSizeHid) == HIDP_STATUS_SUCCESS)
+				if (IsChanged(brg->buttonFirstByte, brg->buttonLastByte)
+					&& HidP_GetUsages(HidP_Input, brg->usagePage, 0, nextOn, &usageLen, pp,
+					(PCHAR)pRawData, dwSizeHid) == HIDP_STATUS_SUCCESS)
 				{
 					// nextOn[] now contains usageLen Usages, i.e., button
 					// numbers for the ON buttons.  'OR' an 0x02 bit into
@@ -579,15 +1054,17 @@ void JoystickManager::PhysicalJoystick::ProcessRawInput(UINT rawInputCode, RAWIN
 					brg->on[nextOnIndex].nOn = usageLen;
 				}
 
-				// Read the axis value updates
+				// Read the axis value updates, skipping values whose bytes
+				// didn't change
 				std::list<ValueChange> valueChanges;
 				for (auto const& v : brg->usageVal)
 				{
 					// parse the value from the report
 					LONG newVal;
 					USAGE usage = v.usage;
-					if (HidP_GetScaledUsageValue(HidP_Input, v.usagePage, 0, usage, &newVal, pp,
-						(PCHAR)raw->data.hid.bRawData, raw->data.hid.dwSizeHid) == HIDP_STATUS_SUCCESS)
+					if (IsChanged(v.firstByte, v.lastByte)
+						&& HidP_GetScaledUsageValue(HidP_Input, v.usagePage, 0, usage, &newVal, pp,
+						(PCHAR)pRawData, dwSizeHid) == HIDP_STATUS_SUCCESS)
 					{
 						// if the value has changed, update it here and in our logical device
 						int iVal = usage - iValFirst;
@@ -748,32 +1225,87 @@ void JoystickManager::UpdateInstanceGuidCache()
 		guidToPath.clear();
 		pathToGuid.clear();
 
-		// enumerate game controller devices
-		struct CallbackContext
+		// enumerate game controller devices, via the snapshot
+		EnumInstanceGuidSnapshot(idi8, [this](const GUID &guid, const TCHAR *pathKey)
 		{
-			CallbackContext(JoystickManager *jm, IDirectInput8 *idi8) : jm(jm), idi8(idi8) { }
-			JoystickManager *jm;
-			IDirectInput8 *idi8;
-		}
-		ctx(this, idi8);
-		auto cb = [](LPCDIDEVICEINSTANCE ddi, LPVOID pvRef) -> BOOL
+			guidToPath.emplace(FormatGuid(guid), pathKey);
+			pathToGuid.emplace(pathKey, guid);
+		});
+	}
+}
+
+void JoystickManager::PrefetchInstanceGuids()
+{
+	// create a private DI8 interface for the enumeration
+	RefPtr<IDirectInput8> di;
+	if (SUCCEEDED(DirectInput8Create(G_hInstance, DIRECTINPUT_VERSION, IID_IDirectInput8, reinterpret_cast<void**>(&di), NULL)))
+		EnumInstanceGuidSnapshot(di, [](const GUID&, const TCHAR*) { });
+}
+
+void JoystickManager::EnumInstanceGuidSnapshot(IDirectInput8 *idi8, std::function<void(const GUID &guid, const TCHAR *pathKey)> func)
+{
+	// Get the current HID device handles.  Raw Input assigns a new
+	// handle each time a device is attached, so an unchanged handle
+	// list means that the snapshot still reflects the attached devices.
+	std::vector<HANDLE> devices;
+	UINT nDevices = 0;
+	if (GetRawInputDeviceList(NULL, &nDevices, sizeof(RAWINPUTDEVICELIST)) == 0 && nDevices != 0)
+	{
+		std::unique_ptr<RAWINPUTDEVICELIST[]> list(new RAWINPUTDEVICELIST[nDevices]);
+		UINT n = GetRawInputDeviceList(list.get(), &nDevices, sizeof(RAWINPUTDEVICELIST));
+		if (n != static_cast<UINT>(-1))
 		{
-			// open the device and retrieve its device path
-			auto ctx = static_cast<CallbackContext*>(pvRef);
-			RefPtr<IDirectInputDevice8> idev;
-			DIPROPGUIDANDPATH gp{ sizeof(gp), sizeof(DIPROPHEADER), 0, DIPH_DEVICE };
-			if (SUCCEEDED(ctx->idi8->CreateDevice(ddi->guidInstance, &idev, NULL))
-				&& SUCCEEDED(idev->GetProperty(DIPROP_GUIDANDPATH, &gp.diph)))
+			for (UINT i = 0; i < n; ++i)
 			{
-				// add the cache entry - canonicalize to lower-case for the key
-				_tcslwr_s(gp.wszPath);
-				ctx->jm->guidToPath.emplace(FormatGuid(ddi->guidInstance), gp.wszPath);
-				ctx->jm->pathToGuid.emplace(gp.wszPath, ddi->guidInstance);
+				if (list[i].dwType == RIM_TYPEHID)
+					devices.emplace_back(list[i].hDevice);
 			}
+		}
+	}
+	std::sort(devices.begin(), devices.end());
 
-			// continue the enumeration
-			return DIENUM_CONTINUE;
-		};
-		idi8->EnumDevices(DI8DEVCLASS_GAMECTRL, cb, &ctx, DIEDFL_ALLDEVICES);
+	// retake the snapshot if the devices have changed
+	CriticalSectionLocker locker(JoystickInstanceGuidSnapshot::lock);
+	auto &guids = JoystickInstanceGuidSnapshot::guids;
+	if (!JoystickInstanceGuidSnapshot::valid || devices != JoystickInstanceGuidSnapshot::devices)
+	{
+		guids.clear();
+		EnumInstanceGuids(idi8, [&guids](const GUID &guid, const TCHAR *pathKey) { guids.emplace_back(guid, pathKey); });
+		JoystickInstanceGuidSnapshot::devices = std::move(devices);
+		JoystickInstanceGuidSnapshot::valid = true;
 	}
+
+	// pass the snapshot to the callback
+	for (auto &g : guids)
+		func(g.first, g.second.c_str());
+}
+
+void JoystickManager::EnumInstanceGuids(IDirectInput8 *idi8, std::function<void(const GUID &guid, const TCHAR *pathKey)> func)
+{
+	// enumerate game controller devices
+	struct CallbackContext
+	{
+		CallbackContext(IDirectInput8 *idi8, std::function<void(const GUID&, const TCHAR*)> &func) : idi8(idi8), func(func) { }
+		IDirectInput8 *idi8;
+		std::function<void(const GUID&, const TCHAR*)> &func;
+	}
+	ctx(idi8, func);
+	auto cb = [](LPCDIDEVICEINSTANCE ddi, LPVOID pvRef) -> BOOL
+	{
+		// open the device and retrieve its device path
+		auto ctx = static_cast<CallbackContext*>(pvRef);
+		RefPtr<IDirectInputDevice8> idev;
+		DIPROPGUIDANDPATH gp{ sizeof(gp), sizeof(DIPROPHEADER), 0, DIPH_DEVICE };
+		if (SUCCEEDED(ctx->idi8->CreateDevice(ddi->guidInstance, &idev, NULL))
+			&& SUCCEEDED(idev->GetProperty(DIPROP_GUIDANDPATH, &gp.diph)))
+		{
+			// pass it to the callback - canonicalize to lower-case for the key
+			_tcslwr_s(gp.wszPath);
+			ctx->func(ddi->guidInstance, gp.wszPath);
+		}
+
+		// continue the enumeration
+		return DIENUM_CONTINUE;
+	};
+	idi8->EnumDevices(DI8DEVCLASS_GAMECTRL, cb, &ctx, DIEDFL_ALLDEVICES);
 }
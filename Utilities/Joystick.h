@@ -103,10 +103,12 @@
 #pragma once
 #include <vector>
 #include <memory>
+#include <limits.h>
 #include <unordered_map>
 #include <Hidsdi.h>
 #include <dinput.h>
 #include "Pointers.h"
+#include "WinUtil.h"
 
 // Joystick manager.
 class JoystickManager
@@ -212,6 +214,29 @@ public:
 	// Empty GUID.   This is a GUID with all bytes set to zero.
 	static const GUID emptyGuid;
 
+	// Device descriptor cache.  Setting up a newly attached device
+	// means asking the device for its USB product name and serial
+	// number strings, and finding its DirectInput Instance GUID, which
+	// means opening every game controller in the system.  Some USB
+	// hubs take hundreds of milliseconds to answer the string requests.
+	// So we cache the results, keyed by device path, and only use an
+	// entry if the VID/PID still match the device.  The application can
+	// keep the cache across sessions by loading it before initializing
+	// the input manager and saving it at exit.  A missing or invalid
+	// file is ignored, since it just means that we start with an empty
+	// cache.
+	static void LoadDescriptorCache(const TCHAR *filename);
+	static void SaveDescriptorCache(const TCHAR *filename);
+
+	// Fill the Instance GUID snapshot ahead of time.  Looking up the
+	// Instance GUIDs means opening every game controller through
+	// DirectInput, which is slow, so UpdateInstanceGuidCache() keeps a
+	// process-wide snapshot of the results, which it reuses as long as
+	// the set of attached HID devices hasn't changed.  This can be
+	// called on a background thread before the manager is created, to
+	// get the slow part out of the way early.
+	static void PrefetchInstanceGuids();
+
 	// Joystick description.  This is the base class for physical
 	// and logical joystick records.  (A physical joystick object
 	// represents an actual device found attached to the system.
@@ -365,9 +390,11 @@ public:
 	// close to the truth in most cases.)
 	struct PhysicalJoystick : Joystick
 	{
+		// Note that we take ownership of the preparsed data block, which
+		// can be null if it wasn't available.
 		PhysicalJoystick(
 			int vendorID, int productID, const TCHAR *prodName, const GUID &instanceGuid,
-			HANDLE hRawDevice, const TCHAR *devicePath,	const TCHAR *serial);
+			HANDLE hRawDevice, const TCHAR *devicePath,	const TCHAR *serial, BYTE *preparsedData);
 
 		// Raw device handle 
 		HANDLE hRawDevice;
@@ -511,6 +538,26 @@ public:
 				on[1].usage.reset(new USAGE[nButtons]);
 			}
 
+			// Range of report bytes containing the button bits, as
+			// inclusive byte offsets from the start of the report
+			// (including the report ID prefix byte).  We only need
+			// to decode the buttons when a byte in this range changes.
+			// We work this out when setting up the device, by asking
+			// the HID parser to encode each button into a blank
+			// report.  If that fails, the range covers the whole
+			// report, so that we always decode the buttons.
+			int buttonFirstByte = 0;
+			int buttonLastByte = INT_MAX;
+
+			// The last report we processed for this report ID.  Many
+			// devices send reports continuously, even when nothing
+			// has changed (accelerometer-equipped controllers can send
+			// hundreds per second), so we compare each new report to
+			// the last one, and skip decoding entirely if they're
+			// identical, or decode just the items in the changed bytes
+			// otherwise.
+			std::vector<BYTE> lastReport;
+
 			// Usage value descriptor.  For each usage value that
 			// appears under this report ID, we create a value
 			// here.  When we receive a report of this type, we
@@ -518,15 +565,27 @@ public:
 			// from the report and update our internal value slots.
 			struct UsageValueDesc
 			{
-				UsageValueDesc(USAGE usagePage, USAGE usage)
-					: usagePage(usagePage), usage(usage) { }
+				UsageValueDesc(USAGE usagePage, USAGE usage, USHORT bitSize)
+					: usagePage(usagePage), usage(usage), bitSize(bitSize) { }
 
 				USAGE usagePage;
 				USAGE usage;
+
+				// size of the value field in the report, in bits
+				USHORT bitSize;
+
+				// range of report bytes containing the value, as for
+				// the button byte range
+				int firstByte = 0;
+				int lastByte = INT_MAX;
 			};
 			std::vector<UsageValueDesc> usageVal;
 		};
 
+		// Build the report byte map, by figuring the report byte
+		// ranges for the buttons and values in each report group
+		void BuildReportByteMap(PHIDP_PREPARSED_DATA ppd, USHORT reportLen);
+
 		// Button report groups.  There's one per report ID listed 
 		// in the button capabilities lists.
 		std::list<ButtonReportGroup> buttonReportGroups;
@@ -564,11 +623,92 @@ protected:
 	~JoystickManager();
 
 	// Add a new physical device.  This is called during device
-	// discovery for each joystick found in the system, and any
-	// time a WM_INPUT_DEVICE_CHANGE notifies us of a new joystick
-	// being attached dynamically.
+	// discovery for each joystick found in the system.  This probes
+	// the device inline; devices attached dynamically, which we hear
+	// about through WM_INPUT_DEVICE_CHANGE, are normally probed on a
+	// background thread instead, via QueueDeviceProbe().
 	void AddDevice(HANDLE hDevice, const RID_DEVICE_INFO_HID *ridHidInfo);
 
+	// Device probe results.  This contains everything we need from
+	// the system to set up a physical joystick object.
+	struct DeviceProbe
+	{
+		HANDLE hDevice = NULL;
+		RID_DEVICE_INFO_HID hid;
+		TSTRING path;
+		TSTRING prodName;
+		TSTRING serial;
+		GUID guid = emptyGuid;
+		std::unique_ptr<BYTE> ppData;
+	};
+
+	// Probe a device.  This gathers the device information, using the
+	// descriptor cache where possible, and updating the cache with the
+	// results.  If the cache doesn't have an Instance GUID for the
+	// device, we call lookupGuid with the lower-case device path to
+	// find it.  This doesn't touch any joystick manager instance data,
+	// so it can be called from any thread.
+	static void ProbeDevice(HANDLE hDevice, const RID_DEVICE_INFO_HID *ridHidInfo,
+		DeviceProbe &probe, std::function<GUID(const TSTRING &pathKey)> lookupGuid);
+
+	// Add a device from a completed probe
+	void AddDevice(DeviceProbe &probe);
+
+	// Is a raw input device a joystick or gamepad?  We recognize HID
+	// Usage Page 0x01 (Generic Desktop) with Usage 0x04 (Joystick) or
+	// 0x05 (Game Pad).
+	static bool IsJoystickDevice(const RID_DEVICE_INFO &info)
+	{
+		return info.dwType == RIM_TYPEHID && info.hid.usUsagePage == 1
+			&& (info.hid.usUsage == 4 || info.hid.usUsage == 5);
+	}
+
+	// Is a device already in our physical joystick list?
+	bool IsDevicePresent(HANDLE hDevice) const { return physJoysticks.find(hDevice) != physJoysticks.end(); }
+
+	// Queue a newly attached device for probing.  The probe runs on a
+	// background thread, so that a slow device doesn't stall the UI.
+	// When the probe is done, the thread posts the given message to
+	// the given window, with the device handle as the LPARAM; the
+	// window should respond by calling AddProbedDevices().  Returns
+	// false if the probe thread isn't available, in which case the
+	// caller should add the device directly.
+	bool QueueDeviceProbe(HANDLE hDevice, HWND hwndNotify, UINT msg, WPARAM wParam);
+
+	// Add the devices that the probe thread has finished with.  Call
+	// this on the UI thread, on receiving the probe thread's message.
+	void AddProbedDevices();
+
+	// Stop the probe thread.  This is called at shutdown.
+	static void ShutdownProbeThread();
+
+	// Probe thread.  This is all static, so that a thread that's stuck
+	// in a device call at shutdown can't outlive the instance data it's
+	// working on.
+	struct ProbeRequest
+	{
+		HANDLE hDevice;
+		HWND hwndNotify;
+		UINT msg;
+		WPARAM wParam;
+	};
+	static std::list<ProbeRequest> probeQueue;
+	static std::list<std::unique_ptr<DeviceProbe>> probeDone;
+	static HandleHolder hProbeThread;
+	static HandleHolder hProbeEvent;
+	static bool probeStarted;
+	static bool probeShuttingDown;
+	static CriticalSection probeLock;
+	static DWORD WINAPI ProbeThreadMain(LPVOID);
+
+	// Enumerate the DirectInput game controllers, calling the callback
+	// with each device's Instance GUID and lower-case device path
+	static void EnumInstanceGuids(IDirectInput8 *idi8, std::function<void(const GUID &guid, const TCHAR *pathKey)> func);
+
+	// Update the Instance GUID snapshot if the attached HID devices have
+	// changed since it was taken, then call the callback for each entry
+	static void EnumInstanceGuidSnapshot(IDirectInput8 *idi8, std::function<void(const GUID &guid, const TCHAR *pathKey)> func);
+
 	// Remove a joystick from the system.  This is called when a
 	// WM_INPUT_DEVICE_CHANGE event notifies us that an existing
 	// joystick has been removed.  Note that no device information
@@ -203,40 +203,102 @@ bool GetAppNameFromCommandLine(TSTRING &appName, const TCHAR *cmdLine)
 
 // -----------------------------------------------------------------------
 //
-// Run a child process, capturing stdout to a text buffer
+// Asynchronous child process
 //
-bool CreateProcessCaptureStdout(
-	const TCHAR *exe, const TCHAR *params, DWORD timeout,
-	std::function<void(const BYTE*, long len)> onSuccess,
-	std::function<void(const TCHAR*)> onError)
+
+AsyncProcess::AsyncProcess(const Options &opts) :
+	timeout(opts.timeout),
+	priorityClass(opts.priorityClass),
+	affinityMask(opts.affinityMask),
+	workingDir(opts.workingDir != nullptr ? opts.workingDir : _T("")),
+	hwndNotify(opts.hwndNotify),
+	notifyMsg(opts.notifyMsg),
+	onDone(opts.onDone)
+{
+	ZeroMemory(&ov, sizeof(ov));
+	hDoneEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+}
+
+AsyncProcess::~AsyncProcess()
+{
+	// We only get here after completion, so there's no read in progress
+	// and the process wait has already fired.  We might be running in
+	// one of the thread pool callbacks, so don't wait for callbacks here;
+	// closing the pool objects just releases them once any callback
+	// that's still returning finishes.
+	if (tpIo != nullptr)
+		CloseThreadpoolIo(tpIo);
+	if (tpWait != nullptr)
+		CloseThreadpoolWait(tpWait);
+}
+
+AsyncProcess *AsyncProcess::Start(const TCHAR *exe, const TCHAR *params, const Options &opts)
 {
-	// Set up an "inheritable handle" security attributes struct,
-	// for creating the stdin and stdout/stderr handles for the
-	// child process.  These need to be inheritable so that we 
-	// can open the files and pass the handles to the child.
+	// create the object
+	AsyncProcess *p = new AsyncProcess(opts);
+
+	// Add a reference on behalf of the pending operation.  CheckDone()
+	// releases it when the process completes.
+	p->AddRef();
+
+	// Launch the process.  Hold the lock while we're setting up, so
+	// that the thread pool callbacks can't act until we're done.
+	CriticalSectionLocker locker(p->lock);
+	if (!p->Launch(exe, params))
+	{
+		p->status = Status::Failed;
+		p->pipeDone = p->processDone = true;
+	}
+
+	// If the launch failed, this signals completion immediately.  The
+	// caller's reference keeps the object alive either way.
+	p->CheckDone(locker);
+	return p;
+}
+
+bool AsyncProcess::Launch(const TCHAR *exe, const TCHAR *params)
+{
+	// Create a named pipe for the child's output.  (Anonymous pipes
+	// don't support overlapped I/O, so we need a named pipe, with a
+	// unique name, for our end.)
+	static volatile LONG pipeSerial = 0;
+	TCHAR pipeName[128];
+	_stprintf_s(pipeName, _T("\\\\.\\pipe\\PinballY.AsyncProcess.%lu.%ld"),
+		GetCurrentProcessId(), InterlockedIncrement(&pipeSerial));
+	hPipe = CreateNamedPipe(pipeName, PIPE_ACCESS_INBOUND | FILE_FLAG_OVERLAPPED | FILE_FLAG_FIRST_PIPE_INSTANCE,
+		PIPE_TYPE_BYTE | PIPE_READMODE_BYTE | PIPE_WAIT | PIPE_REJECT_REMOTE_CLIENTS,
+		1, 0, 64 * 1024, 0, NULL);
+	if (hPipe == INVALID_HANDLE_VALUE)
+	{
+		WindowsErrorMessage err;
+		error = MsgFmt(_T("Unable to create output pipe for child process %s (error %d, %s)"),
+			exe, err.GetCode(), err.Get());
+		return false;
+	}
+
+	// Open the child's end of the pipe, and the NUL file as its stdin.
+	// These need to be inheritable so that we can pass them to the child.
 	SECURITY_ATTRIBUTES sa;
 	sa.nLength = sizeof(sa);
 	sa.lpSecurityDescriptor = NULL;
 	sa.bInheritHandle = TRUE;
+	HandleHolder hWrite = CreateFile(pipeName, GENERIC_WRITE, 0, &sa, OPEN_EXISTING, 0, NULL);
+	HandleHolder hIn = CreateFile(_T("NUL"), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, &sa, OPEN_EXISTING, 0, NULL);
+	if (hWrite == INVALID_HANDLE_VALUE)
+	{
+		WindowsErrorMessage err;
+		error = MsgFmt(_T("Unable to open output pipe for child process %s (error %d, %s)"),
+			exe, err.GetCode(), err.Get());
+		return false;
+	}
 
-	// open the NUL file as stdin for the child
-	HandleHolder hStdIn = CreateFile(_T("NUL"), GENERIC_READ, 0, &sa, OPEN_EXISTING, 0, NULL);
-
-	// create a temp file to capture the stdout and stderr output
-	HandleHolder hStdOut;
-	TSTRING fnameStdOut;
-	TCHAR tmpPath[MAX_PATH] = _T("<no temp path>"), tmpName[MAX_PATH] = _T("<no temp name>");
-	GetTempPath(countof(tmpPath), tmpPath);
-	GetTempFileName(tmpPath, _T("PBYTmp"), 0, tmpName);
-	hStdOut = CreateFile(tmpName, GENERIC_WRITE, 0, &sa, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
-
-	// log an error if that failed, but continue with the capture
-	if (hStdOut == NULL)
+	// set up the thread pool objects for the pipe reads and the process wait
+	if ((tpIo = CreateThreadpoolIo(hPipe, &SReadCallback, this, NULL)) == nullptr
+		|| (tpWait = CreateThreadpoolWait(&SWaitCallback, this, NULL)) == nullptr)
 	{
-		// log the error
 		WindowsErrorMessage err;
-		onError(MsgFmt(_T("Unable to create temp file %s for output from child process (error %d, %s)"),
-			tmpName, err.GetCode(), err.Get()));
+		error = MsgFmt(_T("Unable to set up thread pool objects for child process %s (error %d, %s)"),
+			exe, err.GetCode(), err.Get());
 		return false;
 	}
 
@@ -245,140 +307,226 @@ bool CreateProcessCaptureStdout(
 	ZeroMemory(&sinfo, sizeof(sinfo));
 	sinfo.cb = sizeof(sinfo);
 	sinfo.dwFlags = STARTF_USESTDHANDLES;
-	sinfo.hStdInput = hStdIn;
-	sinfo.hStdOutput = hStdOut;
-	sinfo.hStdError = hStdOut;
+	sinfo.hStdInput = hIn;
+	sinfo.hStdOutput = hWrite;
+	sinfo.hStdError = hWrite;
 
-	// arrange to delete the temp file before we return
-	struct TempFileDeleter
+	// if the caller didn't specify a working directory, use the folder
+	// containing the program
+	if (workingDir.length() == 0)
 	{
-		TempFileDeleter(HandleHolder &hFile, const TCHAR *fname) : hFile(hFile), fname(fname) { }
-		HandleHolder &hFile;
-		const TCHAR *fname;
-
-		~TempFileDeleter()
-		{
-			hFile = NULL;
-			DeleteFile(fname);
-		}
-	};
-	TempFileDeleter tmpFileDeleter(hStdOut, tmpName);
-
-	// get the folder containing the program to use as the working directory
-	TCHAR folder[MAX_PATH];
-	_tcscpy_s(folder, exe);
-	PathRemoveFileSpec(folder);
+		TCHAR folder[MAX_PATH];
+		_tcscpy_s(folder, exe);
+		PathRemoveFileSpec(folder);
+		workingDir = folder;
+	}
 
 	// Launch the program.  Use CREATE_NO_WINDOW to run it invisibly,
 	// so that we don't get UI cruft from flashing a console window
-	// onto the screen briefly.
+	// onto the screen briefly.  Create it suspended, so that we can
+	// set its CPU affinity before it starts running.
 	PROCESS_INFORMATION pinfo;
 	ZeroMemory(&pinfo, sizeof(pinfo));
 	TSTRING cmdline(params);
-	if (!CreateProcess(exe, cmdline.data(), NULL, NULL, TRUE, CREATE_NO_WINDOW,
-		NULL, folder, &sinfo, &pinfo))
+	if (!CreateProcess(exe, cmdline.data(), NULL, NULL, TRUE, CREATE_NO_WINDOW | CREATE_SUSPENDED | priorityClass,
+		NULL, workingDir.c_str(), &sinfo, &pinfo))
 	{
 		WindowsErrorMessage err;
-		onError(MsgFmt(_T("Unable to create process %s (error %d, %s)"), exe, err.GetCode(), err.Get()));
+		error = MsgFmt(_T("Unable to create process %s (error %d, %s)"), exe, err.GetCode(), err.Get());
 		return false;
 	}
 
-	// close our copies of the file handles
-	hStdIn = NULL;
-	hStdOut = NULL;
-
-	// arrange to close the handles when we're done
-	HandleHolder hProc = pinfo.hProcess;
+	// set the affinity, if desired, and let the program start
+	hProcess = pinfo.hProcess;
+	pid = pinfo.dwProcessId;
+	if (affinityMask != 0)
+		SetProcessAffinityMask(hProcess, affinityMask);
+	ResumeThread(pinfo.hThread);
 	CloseHandle(pinfo.hThread);
 
-	// Wait for the program to finish, or until the timeout expires
-	if (WaitForSingleObject(pinfo.hProcess, timeout) == WAIT_OBJECT_0)
+	// Close our copies of the child's handles.  The pipe only reports
+	// end-of-file once all of the write handles are closed, so we can't
+	// keep one open ourselves.
+	hWrite = NULL;
+	hIn = NULL;
+
+	// start reading the output
+	StartRead();
+
+	// Start the process wait.  A thread pool wait takes a relative
+	// timeout as a negative count of 100ns intervals.
+	FILETIME ft, *pft = nullptr;
+	if (timeout != INFINITE)
 	{
-		class ReadErrorHandler : public ErrorHandler
-		{
-		public:
-			ReadErrorHandler(decltype(onError) &onError) : onError(onError) { }
-			decltype(onError) onError;
+		LARGE_INTEGER due;
+		due.QuadPart = -static_cast<LONGLONG>(timeout) * 10000;
+		ft.dwLowDateTime = due.LowPart;
+		ft.dwHighDateTime = static_cast<DWORD>(due.HighPart);
+		pft = &ft;
+	}
+	SetThreadpoolWait(tpWait, hProcess, pft);
 
-		protected:
-			virtual void Display(ErrorIconType icon, const TCHAR *msg) override { onError(msg); }
-		};
-		ReadErrorHandler eh(onError);
+	// success
+	return true;
+}
 
-		// Success - read the results
-		long len = 0;
-		std::unique_ptr<BYTE> buf(ReadFileAsStr(tmpName, eh, len, 0));
-		if (buf == nullptr)
-			return false;
+void AsyncProcess::StartRead()
+{
+	// Start the read.  Even if it completes immediately, the completion
+	// is still queued to the thread pool, so OnRead() handles the data
+	// either way.
+	ZeroMemory(&ov, sizeof(ov));
+	StartThreadpoolIo(tpIo);
+	if (!ReadFile(hPipe, readBuf, sizeof(readBuf), NULL, &ov) && GetLastError() != ERROR_IO_PENDING)
+	{
+		// The read failed outright, so no completion will be queued.
+		// This normally means that the child already closed its end
+		// of the pipe (ERROR_BROKEN_PIPE), which is our end-of-file.
+		CancelThreadpoolIo(tpIo);
+		pipeDone = true;
+	}
+}
 
-		// send the result to the callback
-		onSuccess(buf.get(), len);
+void AsyncProcess::OnRead(ULONG result, DWORD nBytes)
+{
+	CriticalSectionLocker locker(lock);
+
+	// On success, add the data to the buffer, and start the next read,
+	// unless we've aborted the process.  Any error ends the read loop:
+	// ERROR_BROKEN_PIPE means that the child closed its end of the pipe,
+	// and ERROR_OPERATION_ABORTED means that we cancelled the read.
+	if (result == NO_ERROR)
+	{
+		output.append(readBuf, nBytes);
+		if (status == Status::Running)
+			StartRead();
+		else
+			pipeDone = true;
 	}
 	else
-	{
-		// The process seems to be stuck.  Kill it so that we don't
-		// leave a zombie process hanging around.
-		SaferTerminateProcess(pinfo.hProcess);
+		pipeDone = true;
 
-		// Notify the callback of the failure
-		onError(MsgFmt(_T("Child process %s not responding; terminating"), exe));
-		return false;
+	// check for completion
+	CheckDone(locker);
+}
+
+void AsyncProcess::OnProcessWait(TP_WAIT_RESULT result)
+{
+	CriticalSectionLocker locker(lock);
+
+	// If the process exited, get its exit code.  Otherwise the timeout
+	// expired, so kill the process.
+	if (result == WAIT_OBJECT_0)
+		GetExitCodeProcess(hProcess, &exitCode);
+	else
+		Abort(Status::TimedOut);
+
+	// the process is done, either way
+	processDone = true;
+
+	// check for completion
+	CheckDone(locker);
+}
+
+void AsyncProcess::Cancel()
+{
+	CriticalSectionLocker locker(lock);
+	Abort(Status::Cancelled);
+}
+
+void AsyncProcess::Abort(Status newStatus)
+{
+	// if we've already finished or aborted, there's nothing to do
+	if (status != Status::Running)
+		return;
+
+	// set the new status
+	status = newStatus;
+
+	// Kill the process, so that we don't leave a zombie process hanging
+	// around.  The pending process wait (if any) fires when it exits.
+	if (!processDone)
+		SaferTerminateProcess(hProcess);
+
+	// Cancel the pending read.  The pipe normally breaks anyway once the
+	// process is gone, but a grandchild could have inherited the handle.
+	if (!pipeDone)
+		CancelIoEx(hPipe, &ov);
+}
+
+void AsyncProcess::CheckDone(CriticalSectionLocker &locker)
+{
+	// we're done when the process and the pipe are both finished
+	if (notified || !pipeDone || !processDone)
+		return;
+
+	// set the final status and release the lock
+	notified = true;
+	if (status == Status::Running)
+		status = Status::Exited;
+	locker.Unlock();
+
+	// invoke the callback, if any
+	if (onDone)
+		onDone(this);
+
+	// post the notification message, if desired, passing a reference
+	// to the window
+	if (hwndNotify != NULL)
+	{
+		AddRef();
+		if (!PostMessage(hwndNotify, notifyMsg, 0, reinterpret_cast<LPARAM>(this)))
+			Release();
 	}
 
-	// success
-	return true;
+	// signal the completion event
+	SetEvent(hDoneEvent);
+
+	// release the pending operation's reference
+	Release();
 }
 
+std::string AsyncProcess::GetOutput()
+{
+	CriticalSectionLocker locker(lock);
+	return output;
+}
 
 // -----------------------------------------------------------------------
 //
-// Search for the main window for a given process ID
+// Run a child process, capturing stdout to a text buffer
 //
-HWND FindMainWindowForProcess(DWORD pid, DWORD *pThreadId)
+bool CreateProcessCaptureStdout(
+	const TCHAR *exe, const TCHAR *params, DWORD timeout,
+	std::function<void(const BYTE*, long len)> onSuccess,
+	std::function<void(const TCHAR*)> onError)
 {
-	// set up a search context
-	struct EnumWindowsCtx
+	// launch the process and wait for it to finish
+	AsyncProcess::Options opts;
+	opts.timeout = timeout;
+	RefPtr<AsyncProcess> proc;
+	proc.Attach(AsyncProcess::Start(exe, params, opts));
+	proc->Wait();
+
+	// check the result
+	switch (proc->GetStatus())
 	{
-		EnumWindowsCtx(DWORD pid) : pid(pid), tid(0), hWnd(NULL) { }
-		DWORD pid;
-		DWORD tid;
-		HWND hWnd;
-	} ctx(pid);
-
-	// enumerate the top-level windows across the system
-	EnumWindows([](HWND hWnd, LPARAM lParam) -> BOOL
-	{
-		// recover our search context
-		auto ctx = (EnumWindowsCtx *)lParam;
-
-		// If this is a main window, check its process ID.  A "main window"
-		// is a visible window with no owner.
-		if (IsWindowVisible(hWnd) && GetWindow(hWnd, GW_OWNER) == NULL)
+	case AsyncProcess::Status::Exited:
 		{
-			// it's a top-level window - get its process and thread information
-			DWORD winPid = 0;
-			DWORD winTid = GetWindowThreadProcessId(hWnd, &winPid);
-			if (winPid == ctx->pid)
-			{
-				// it's one of our target process's windows - use its thread
-				ctx->tid = winTid;
-				ctx->hWnd = hWnd;
-
-				// stop the enumeration
-				return FALSE;
-			}
+			// success - send the result to the callback
+			std::string out = proc->GetOutput();
+			onSuccess(reinterpret_cast<const BYTE*>(out.c_str()), static_cast<long>(out.length()));
 		}
+		return true;
 
-		// it's not a match - continue the enumeration
-		return TRUE;
-	}, (LPARAM)&ctx);
-
-	// pass the thread ID back to the caller if desired
-	if (pThreadId != nullptr)
-		*pThreadId = ctx.tid;
+	case AsyncProcess::Status::Failed:
+		onError(proc->GetError());
+		return false;
 
-	// return the window handle
-	return ctx.hWnd;
+	default:
+		onError(MsgFmt(_T("Child process %s not responding; terminating"), exe));
+		return false;
+	}
 }
 
 // -----------------------------------------------------------------------
@@ -6,6 +6,8 @@
 #pragma once
 #include "../rapidxml/rapidxml.hpp"
 #include "StringUtil.h"
+#include "Pointers.h"
+#include "WinUtil.h"
 
 class ErrorHandler;
 
@@ -140,11 +142,176 @@ protected:
 };
 
 
+// -----------------------------------------------------------------------
+//
+// Asynchronous child process.  This launches a non-interactive console
+// program and returns immediately, while the program runs in the
+// background.  The child's stdout and stderr are connected to an
+// overlapped pipe that we read from the system thread pool, so the
+// output accumulates in a buffer as the program writes it, rather than
+// stalling the child when the pipe buffer fills up, and nothing has to
+// block a thread waiting for the child to exit.
+//
+// When the process exits (or fails, times out, or is cancelled), and
+// its output has been collected, we signal completion in any of the
+// ways the caller asked for:
+//
+// - the onDone callback is invoked on a thread pool thread
+//
+// - the notification message is posted to the notification window,
+//   with the AsyncProcess* in the LPARAM, carrying a reference on
+//   behalf of the window; the window handler must Release() it (or
+//   Attach() it to a RefPtr)
+//
+// - the done event is set, so Wait() returns
+//
+class AsyncProcess : public RefCounted
+{
+public:
+	// launch options
+	struct Options
+	{
+		// Working directory.  If this is null, we use the folder
+		// containing the program file.
+		const TCHAR *workingDir = nullptr;
+
+		// Maximum run time, in milliseconds.  If the program is still
+		// running when this expires, we terminate it.
+		DWORD timeout = INFINITE;
+
+		// Priority class for the child (e.g., BELOW_NORMAL_PRIORITY_CLASS),
+		// or 0 to use the normal default
+		DWORD priorityClass = 0;
+
+		// CPU affinity mask for the child, or 0 to use the default
+		DWORD_PTR affinityMask = 0;
+
+		// notification window and message
+		HWND hwndNotify = NULL;
+		UINT notifyMsg = 0;
+
+		// completion callback
+		std::function<void(AsyncProcess*)> onDone;
+	};
+
+	// Status
+	enum class Status
+	{
+		Running,     // still running
+		Exited,      // the program exited; GetExitCode() has its exit code
+		Failed,      // the program couldn't be launched; GetError() has details
+		TimedOut,    // the timeout expired, and we terminated the program
+		Cancelled    // cancelled via Cancel()
+	};
+
+	// Launch a program.  'exe' is the program file, and 'params' is the
+	// full command line to pass to it (including the program name as the
+	// first token, per the usual CreateProcess() conventions).  Returns
+	// a new object, with a reference on behalf of the caller.  This never
+	// returns null; a launch failure is reported through the normal
+	// completion mechanisms, with status Failed.
+	static AsyncProcess *Start(const TCHAR *exe, const TCHAR *params, const Options &opts);
+
+	// Wait for completion, up to the timeout.  Returns true if the
+	// process has completed.
+	bool Wait(DWORD timeout = INFINITE) { return WaitForSingleObject(hDoneEvent, timeout) == WAIT_OBJECT_0; }
+
+	// Get the completion event.  This is a manual-reset event that's
+	// signaled when the process completes.
+	HANDLE GetDoneEvent() const { return hDoneEvent; }
+
+	// Cancel the process.  This terminates the program if it's still
+	// running.  Completion is signaled as usual, with status Cancelled.
+	void Cancel();
+
+	// get the status
+	Status GetStatus() const { return status; }
+
+	// get the exit code; valid when the status is Exited
+	DWORD GetExitCode() const { return exitCode; }
+
+	// get the error message; valid when the status is Failed
+	const TCHAR *GetError() const { return error.c_str(); }
+
+	// Get the output collected so far.  This can be called while the
+	// process is running to get the partial output.
+	std::string GetOutput();
+
+	// get the process ID, or 0 if the launch failed
+	DWORD GetProcessId() const { return pid; }
+
+protected:
+	AsyncProcess(const Options &opts);
+	~AsyncProcess();
+
+	// launch the program; returns false on failure, with 'error' set
+	bool Launch(const TCHAR *exe, const TCHAR *params);
+
+	// start the next pipe read
+	void StartRead();
+
+	// thread pool callbacks
+	static void CALLBACK SReadCallback(PTP_CALLBACK_INSTANCE, PVOID ctx, PVOID overlapped,
+		ULONG result, ULONG_PTR nBytes, PTP_IO)
+		{ static_cast<AsyncProcess*>(ctx)->OnRead(result, static_cast<DWORD>(nBytes)); }
+	static void CALLBACK SWaitCallback(PTP_CALLBACK_INSTANCE, PVOID ctx, PTP_WAIT, TP_WAIT_RESULT result)
+		{ static_cast<AsyncProcess*>(ctx)->OnProcessWait(result); }
+	void OnRead(ULONG result, DWORD nBytes);
+	void OnProcessWait(TP_WAIT_RESULT result);
+
+	// Terminate the process and abort the pipe read, recording the
+	// given final status.  Call with the lock held.
+	void Abort(Status newStatus);
+
+	// Check for completion.  Completion requires both the process exit
+	// and the end of the output pipe.  Call with the lock held.  The
+	// caller must not touch the object after this returns, since this
+	// can release the last reference.
+	void CheckDone(CriticalSectionLocker &locker);
+
+	// options
+	DWORD timeout;
+	DWORD priorityClass;
+	DWORD_PTR affinityMask;
+	TSTRING workingDir;
+	HWND hwndNotify;
+	UINT notifyMsg;
+	std::function<void(AsyncProcess*)> onDone;
+
+	// process handle and ID
+	HandleHolder hProcess;
+	DWORD pid = 0;
+
+	// read end of the output pipe, and its thread pool I/O object
+	HandleHolder hPipe;
+	PTP_IO tpIo = nullptr;
+	OVERLAPPED ov;
+	char readBuf[4096];
+
+	// thread pool wait for the process exit
+	PTP_WAIT tpWait = nullptr;
+
+	// completion event
+	HandleHolder hDoneEvent;
+
+	// Status.  These are protected by the lock.
+	CriticalSection lock;
+	std::string output;
+	volatile Status status = Status::Running;
+	DWORD exitCode = 0;
+	TSTRING error;
+	bool pipeDone = false;
+	bool processDone = false;
+	bool notified = false;
+};
+
+
 // -----------------------------------------------------------------------
 //
 // Create a process, wait for it to finish, and capture its stdout and
 // stderr output to a text buffer.  This should be used only for non-
-// interactive processes that normally run in console windows.
+// interactive processes that normally run in console windows.  This
+// is a blocking wrapper around AsyncProcess.
 //
 bool CreateProcessCaptureStdout(
 	const TCHAR *exe, const TCHAR *params, DWORD timeout,
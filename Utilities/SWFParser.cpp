@@ -202,73 +202,64 @@ bool SWFParser::Load(const TCHAR *filename, ErrorHandler &eh, bool incremental)
 	//  C -> zlib compressed
 	//  Z -> LZMA compressed
 	//
-	// For greater efficiency, let's decompress the entire file into
-	// a memory buffer up front.  That lets us scan through the rest of
-	// the file as plain bytes, without having to descend into the
-	// decompression algorithm on every byte read.  This wouldn't be
-	// a good approach in general, because some SWF files can be quite
-	// large.  But for our limited use case of HyperPin Media Pack
-	// instruction cards, even the fully decompressed sizes should be
-	// fairly small.
-	if (buf[0] == 'C')
+	// For a compressed file, allocate a buffer for the whole decompressed
+	// stream, but don't decompress anything yet.  ParseFrame() decompresses
+	// each tag into the buffer as it reaches it, so an incremental load
+	// only pays for the tags through the first frame, and the rest of the
+	// work is spread over the animation.  The buffer's pages aren't touched
+	// until the data is decompressed into them, so the memory also grows
+	// as the parsing proceeds.  Once the data is decompressed, the tag
+	// readers can scan through it as plain bytes, without having to descend
+	// into the decompression algorithm on every byte read.
+	if (buf[0] == 'C' || buf[0] == 'Z')
 	{
-		// Zlib compression.  Set up a zlib decompression stream.
-		z_stream zstr;
-		ZeroMemory(&zstr, sizeof(zstr));
-		zstr.next_in = &buf[8];
-		zstr.avail_in = buflen - 8;
-		inflateInit(&zstr);
-
-		// set up an output buffer, and copy the uncompressed header portion
-		std::unique_ptr<BYTE> outbuf(new BYTE[uncompressedSize]);
-		memcpy(outbuf.get(), buf, 8);
-
-		// decompress the file into the output buffer
-		zstr.next_out = outbuf.get() + 8;
-		zstr.avail_out = uncompressedSize - 8;
-		int zerr = inflate(&zstr, Z_FINISH);
-		inflateEnd(&zstr);
-
-		// check that we finished reading the stream successfully
-		if (zerr != Z_STREAM_END)
+		// make sure the size is plausible
+		if (uncompressedSize < 8)
 		{
-			eh.Error(MsgFmt(_T("%s: zlib decompression failed, error %d"), filename, zerr));
+			eh.Error(MsgFmt(_T("%s: invalid SWF stream size"), filename));
 			return false;
 		}
 
-		// replace the original file buffer with the uncompressed buffer
-		fileContents.reset(buf = outbuf.release());
-	}
-	else if (buf[0] == 'Z')
-	{
-		// LZMA compression.  Set up an LZMA decoder.
-		RefPtr<ISequentialInStream> istream;
-		RefPtr<NCompress::NLzma::CDecoder> decoder;
-		decoder.Attach(new NCompress::NLzma::CDecoder());
-		istream.Attach(new LZMAReader::ByteInStream(&buf[8], buflen - 8));
-
-		// set up an output buffer, and copy the uncompressed header portion
-		std::unique_ptr<BYTE> outbuf(new BYTE[uncompressedSize]);
-		memcpy(outbuf.get(), buf, 8);
-
-		// decompress the file into the output buffer
-		UINT32 bytesRead = 0;
-		HRESULT hr = decoder->Read(outbuf.get() + 8, uncompressedSize - 8, &bytesRead);
-		if (!SUCCEEDED(hr) || bytesRead != uncompressedSize - 8)
+		// keep the compressed data for the decompressor
+		compressedContents.reset(fileContents.release());
+
+		if (buf[0] == 'C')
 		{
-			eh.Error(MsgFmt(_T("%s: LZMA decompression failed, HRESULT %lx, bytes read %ld"),
-				filename, static_cast<unsigned long>(hr), static_cast<unsigned long>(bytesRead)));
-			return false;
+			// Zlib compression.  The zlib stream follows the 8-byte header.
+			decompressor.reset(new ZlibReader(&buf[8], buflen - 8));
+		}
+		else
+		{
+			// LZMA compression.  The header is followed by the compressed
+			// data size (UINT32), the 5-byte LZMA properties, and then the
+			// compressed data.
+			if (buflen < 17)
+			{
+				eh.Error(MsgFmt(_T("%s: LZMA header missing"), filename));
+				return false;
+			}
+			decompressor.reset(new LZMAReader(&buf[12], &buf[17], buflen - 17, uncompressedSize - 8));
 		}
 
-		// replace the original file buffer with the uncompressed buffer
-		fileContents.reset(buf = outbuf.release());
+		// set up the output buffer, and copy the uncompressed header portion
+		fileContents.reset(new BYTE[uncompressedSize]);
+		memcpy(fileContents.get(), buf, 8);
+		buf = fileContents.get();
 	}
 
-	// Set up the stream reader.  Since we've already decompressed the whole
-	// file, we can just set up a plain ByteReader.  And since we've already
-	// read the header, we can start 8 bytes in.
-	reader.Init(buf + 8, uncompressedSize - 8);
+	// Set up the stream reader.  Since we're working from the complete (or
+	// to-be-decompressed) stream in memory, we can just set up a plain byte
+	// reader.  And since we've already read the header, we can start 8 bytes
+	// in.
+	streamLen = uncompressedSize - 8;
+	reader.Init(buf + 8, streamLen);
+
+	// decompress the frame header
+	if (!Decompress(32))
+	{
+		eh.Error(MsgFmt(_T("%s: decompression failed"), filename));
+		return false;
+	}
 
 	// set the foramt version in the reader, so that it can apply appropriate
 	// handling to types that vary by format version (e.g., String)
@@ -312,12 +303,26 @@ bool SWFParser::ParseFrame(ErrorHandler &eh)
 	// keep track of unhandled tags, for logging diagnostics
 	std::unordered_map<UINT16, bool> unimplementedTags;
 
+	// decompression error handler
+	auto DecompressError = [this, &eh]()
+	{
+		eh.Error(MsgFmt(_T("%s: decompression failed"), filename.c_str()));
+		return false;
+	};
+
 	// The rest of the file consists of "tags".  Read them all.
 	for (bool frameDone = false; !frameDone && reader.BytesRemaining() != 0; )
 	{
-		// read the tag header
+		// read the tag header, which is 6 bytes at most
+		if (!Decompress(6))
+			return DecompressError();
 		auto tagHdr = reader.ReadTagHeader();
 
+		// decompress the tag contents, so that the tag readers have the
+		// whole tag available
+		if (!Decompress(tagHdr.len))
+			return DecompressError();
+
 		// remember the starting position, so that we can skip any unused part
 		// of the record after finishing the type-specific reading
 		size_t startingRem = reader.BytesRemaining();
@@ -611,12 +616,42 @@ bool SWFParser::ParseFrame(ErrorHandler &eh)
 	{
 		reader.Init(nullptr, 0);
 		fileContents.reset(nullptr);
+		decompressor.reset();
+		compressedContents.reset();
 	}
 
 	// successful completion
 	return true;
 }
 
+bool SWFParser::Decompress(size_t len)
+{
+	// if the file isn't compressed, the whole stream is already available
+	if (decompressor == nullptr)
+		return true;
+
+	// figure the stream offset we need, limited to the stream size
+	size_t pos = streamLen - reader.BytesRemaining();
+	size_t target = len > streamLen - pos ? streamLen : pos + len;
+	if (target <= decompressedLen)
+		return true;
+
+	// Decompress at least 64K at a time, so that a run of small tags
+	// doesn't go through the decompressor many times over
+	size_t goal = max(target, min(streamLen, decompressedLen + 65536));
+	while (decompressedLen < goal)
+	{
+		size_t n = decompressor->ReadBytes(fileContents.get() + 8 + decompressedLen, goal - decompressedLen);
+		if (n == 0)
+			break;
+
+		decompressedLen += n;
+	}
+
+	// we succeeded if we got at least as far as the caller needed
+	return decompressedLen >= target;
+}
+
 D2D1_RECT_F SWFParser::SWFReader::ReadRect()
 {
 	// read the number of bits per element
@@ -850,15 +850,18 @@ public:
 		BYTE outbuf[1];
 	};
 
-	// LZMA stream reader
+	// LZMA stream reader.  'props' is the 5-byte LZMA properties header,
+	// and 'outSize' is the size of the decompressed stream.
 	class LZMAReader : public SWFReader
 	{
 	public:
-		LZMAReader(const BYTE *buf, size_t len)
+		LZMAReader(const BYTE *props, const BYTE *buf, size_t len, UINT64 outSize)
 		{
 			decoder.Attach(new NCompress::NLzma::CDecoder());
 			istream.Attach(new ByteInStream(buf, len));
+			decoder->SetDecoderProperties2(props, 5);
 			decoder->SetInStream(istream);
+			decoder->SetOutStreamSize(&outSize);
 		}
 
 		virtual BYTE ReadByte() override
@@ -917,7 +920,7 @@ public:
 
 			HRESULT STDMETHODCALLTYPE Read(void *data, UInt32 size, UInt32 *processedSize)
 			{
-				if (size < rem)
+				if (size > rem)
 					size = (UInt32)rem;
 
 				if (size == 0 && *processedSize == NULL)
@@ -969,6 +972,25 @@ protected:
 	// stream reader for the decompressed file
 	UncompressedReader reader;
 
+	// Incremental decompression.  For a compressed file, fileContents is
+	// allocated at the full decompressed size, but we only decompress into
+	// it as the tag parser reaches each tag, rather than decompressing the
+	// whole file up front.  That lets the first frame display as soon as
+	// the tags before the first ShowFrame are decompressed.  'decompressor'
+	// is the zlib or LZMA reader for the compressed stream, which reads
+	// from compressedContents.  streamLen is the length of the stream after
+	// the 8-byte file header, and decompressedLen is the number of bytes
+	// of it decompressed so far.
+	std::unique_ptr<BYTE> compressedContents;
+	std::unique_ptr<SWFReader> decompressor;
+	size_t streamLen = 0;
+	size_t decompressedLen = 0;
+
+	// Make sure that the next 'len' bytes of the stream, from the reader's
+	// current position, have been decompressed.  Returns false if the
+	// compressed stream ends early or is corrupted.
+	bool Decompress(size_t len);
+
 	// SWF format version
 	BYTE version = 0;
 
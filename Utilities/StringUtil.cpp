@@ -4,9 +4,12 @@
 #include "stdafx.h"
 #include <string.h>
 #include <vector>
+#include <unordered_map>
+#include <memory>
 #include <stdio.h>
 #include "Util.h"
 #include "StringUtil.h"
+#include "WinUtil.h"
 #include "LogError.h"
 #include "InstanceHandle.h"
 
@@ -120,6 +123,85 @@ bool tstriEndsWith(const TCHAR *str, const TCHAR *substr)
 	return len >= sublen && _tcsicmp(str + (len - sublen), substr) == 0;
 }
 
+// -----------------------------------------------------------------------
+//
+// Simple string scanners
+//
+
+TSTRING StripChars(const TCHAR *str, const TCHAR *chars)
+{
+	TSTRING s;
+	s.reserve(_tcslen(str));
+	for (const TCHAR *p = str; *p != 0; ++p)
+	{
+		if (_tcschr(chars, *p) == nullptr)
+			s.push_back(*p);
+	}
+	return s;
+}
+
+TSTRING StripSuffixI(const TCHAR *str, const TCHAR *suffix)
+{
+	size_t len = _tcslen(str);
+	size_t sublen = _tcslen(suffix);
+	if (len >= sublen && _tcsicmp(str + (len - sublen), suffix) == 0)
+		return TSTRING(str, len - sublen);
+	return str;
+}
+
+TSTRING ReplaceFileExt(const TCHAR *path, const TCHAR *newExt)
+{
+	// scan backwards for the '.', stopping at the start of the last path element
+	size_t len = _tcslen(path);
+	for (size_t i = len; i != 0; --i)
+	{
+		TCHAR c = path[i - 1];
+		if (c == '.')
+		{
+			// there must be at least one character after the '.'
+			if (i == len)
+				break;
+			return TSTRING(path, i - 1) + newExt;
+		}
+		if (c == '\\' || c == '/' || c == ':')
+			break;
+	}
+
+	// no extension - return the path unchanged
+	return TSTRING(path, len);
+}
+
+bool IsBlankString(const TCHAR *str)
+{
+	for (const TCHAR *p = str; *p != 0; ++p)
+	{
+		if (!_istspace(*p))
+			return false;
+	}
+	return true;
+}
+
+// -----------------------------------------------------------------------
+//
+// Shared regex pattern cache
+//
+
+const std::basic_regex<TCHAR> &GetCachedRegex(const TSTRING &pattern, std::regex_constants::syntax_option_type flags)
+{
+	// The cache is keyed by the flags and the pattern text.  The regex
+	// objects are held by pointer, so references to them stay valid as
+	// the map grows.
+	static CriticalSection lock;
+	static std::unordered_map<TSTRING, std::unique_ptr<std::basic_regex<TCHAR>>> cache;
+	TSTRING key = MsgFmt(_T("%x:"), static_cast<unsigned int>(flags)).Get() + pattern;
+
+	CriticalSectionLocker locker(lock);
+	auto &re = cache[key];
+	if (re == nullptr)
+		re.reset(new std::basic_regex<TCHAR>(pattern, flags));
+	return *re;
+}
+
 // -----------------------------------------------------------------------
 //
 // Type-overloaded covers for the system LoadString
@@ -241,6 +241,31 @@ bool tstriStartsWith(const TCHAR *str, const TCHAR *substr);
 bool tstrEndsWith(const TCHAR *str, const TCHAR *substr);
 bool tstriEndsWith(const TCHAR *str, const TCHAR *substr);
 
+// Simple string scanners.  These do the jobs that we'd otherwise do
+// with a one-off regex_replace() or regex_match() on a fixed pattern,
+// without the cost of compiling the pattern.
+//
+// StripChars() removes all occurrences of the characters in 'chars'.
+// StripSuffixI() removes 'suffix' from the end of the string if it's
+// there, ignoring case.  ReplaceFileExt() replaces the filename extension
+// (a '.' in the last path element followed by at least one character)
+// with 'newExt', which includes the '.'; a path with no extension is
+// returned unchanged.  IsBlankString() tests for an empty or all-
+// whitespace string.
+TSTRING StripChars(const TCHAR *str, const TCHAR *chars);
+TSTRING StripSuffixI(const TCHAR *str, const TCHAR *suffix);
+TSTRING ReplaceFileExt(const TCHAR *path, const TCHAR *newExt);
+bool IsBlankString(const TCHAR *str);
+
+// Shared regex pattern cache.  This returns a compiled regex for the
+// given pattern and flags, compiling it on the first request and then
+// reusing it for the rest of the session.  It's for patterns that are
+// built at run time, where a function-local static won't do.  The
+// cache can be used from any thread.  Patterns are never discarded, so
+// don't use this for patterns built from arbitrary user input.
+const std::basic_regex<TCHAR> &GetCachedRegex(const TSTRING &pattern,
+	std::regex_constants::syntax_option_type flags = std::regex_constants::ECMAScript);
+
 // Formatted string object.  This is a convenient way to format a string
 // for assignment to a string value or for a function argument.  Use 
 // printf-style formatting in the constructor.  This yields an object
@@ -0,0 +1,64 @@
+// This file is part of PinballY
+// Copyright 2018 Michael J Roberts | GPL v3 or later | NO WARRANTY
+//
+// Watchdog heartbeat
+//
+// This is the layout of the shared memory block that PinballY uses
+// to let the Watchdog process monitor its UI thread for hangs.  The
+// main process creates the block as a named file mapping before it
+// launches the watchdog, and the watchdog opens it by name, using the
+// parent process ID it gets on its command line.
+//
+// The UI thread increments the counter on every pass through its
+// message loop.  The watchdog samples the counter periodically, and
+// if it hasn't changed for longer than the hang timeout, it writes a
+// hang report: a minidump of the main process, plus a text file with
+// the UI thread's stack and the list of trace scopes (see Trace.h)
+// that were active on the UI thread when it stopped.  That usually
+// tells us what the program was doing, and with what file, which is
+// the part that's hard to reconstruct from a dump alone.
+//
+// Only the main process writes to the block, and the watchdog only
+// reads it.  The scope list isn't updated atomically, but that doesn't
+// matter in practice, because the watchdog only looks at it when the
+// UI thread has been stuck for a long time, so it's not changing.
+
+#pragma once
+#include <stdio.h>
+
+struct WatchdogHeartbeat
+{
+	// signature and structure size, for a sanity check on open
+	static const DWORD SIGNATURE = 0x42485950;   // 'PYHB'
+	DWORD signature;
+	DWORD size;
+
+	// UI thread ID
+	DWORD uiThreadId;
+
+	// Hang timeout, in milliseconds.  Zero disables hang reports.
+	volatile DWORD hangTimeout_ms;
+
+	// heartbeat counter, incremented on each message loop pass
+	volatile LONG counter;
+
+	// Active trace scopes on the UI thread, outermost first.  'depth' is
+	// the number of active scopes, which can exceed MaxScopes; we only
+	// record the outermost MaxScopes entries.
+	static const int MaxScopes = 8;
+	volatile LONG depth;
+	struct Scope
+	{
+		CHAR name[64];
+		CHAR category[32];
+		WCHAR detail[MAX_PATH];
+	}
+	scopes[MaxScopes];
+
+	// folder for hang reports
+	WCHAR reportFolder[MAX_PATH];
+
+	// build the file mapping name for a given PinballY process ID
+	static void GetMappingName(WCHAR *buf, size_t bufLen, DWORD pid)
+		{ swprintf_s(buf, bufLen, L"PinballY.Watchdog.Heartbeat.%lu", pid); }
+};